@@ -55,6 +55,7 @@ usage( const std::string& msg = "" )
         << "            [--min-level <num>]             : The minimum level to stop backfilling to.  (default=0)\n"
         << "            [--max-level <num>]             : The level to start backfilling from(default=inf)\n"                
         << "            [--db-options]                : db options string to pass to the image writer in quotes (e.g., \"JPEG_QUALITY 60\")\n"
+        << "            [--threads <num>]               : number of worker threads rebuilding tiles (default=0, use the main thread)\n"
         << std::endl
         << "         [--quiet]               : suppress progress output" << std::endl;
 
@@ -97,6 +98,10 @@ main(int argc, char** argv)
     unsigned maxLevel = ~0;
     args.read( "--max-level", maxLevel );  
 
+    // number of worker threads
+    unsigned numThreads = 0;
+    args.read( "--threads", numThreads );
+
     std::string dbOptions;
     args.read("--db-options", dbOptions);
     std::string::size_type n = 0;
@@ -129,5 +134,6 @@ main(int argc, char** argv)
     backfiller.setMinLevel( minLevel );
     backfiller.setMaxLevel( maxLevel );
     backfiller.setBounds( bounds );
+    backfiller.setNumThreads( numThreads );
     backfiller.process( tmsPath, options.get() );
 }
@@ -0,0 +1,310 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osg/Notify>
+#include <osg/Timer>
+#include <osg/AnimationPath>
+#include <osgDB/Registry>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osgViewer/Viewer>
+#include <osgEarth/MapNode>
+#include <osgEarth/Registry>
+#include <osgEarth/HTTPClient>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarthUtil/ExampleResources>
+#include <OpenThreads/Atomic>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#endif
+
+#define LC "[benchmark] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+int
+usage(const char* name)
+{
+    OE_NOTICE 
+        << "\nUsage: " << name << " file.earth --path camera.path [options]" << std::endl
+        << "\n    --path <file>        : camera path to replay (osg::AnimationPath format,"
+        << "\n                           e.g. recorded with the viewer's 'z' key)"
+        << "\n    --cold               : bypass the cache entirely (default: use the cache as configured)"
+        << "\n    --fps <n>            : path sampling rate (default 60)"
+        << "\n    --settle-timeout <s> : longest wait for full detail at the start of the path (default 120)"
+        << "\n    --out <file>         : write the report to a file instead of stdout"
+        << std::endl
+        << MapNodeHelper().usage() << std::endl;
+
+    return 0;
+}
+
+namespace
+{
+    /**
+     * Counts the nodes the database pager reads in, i.e. the terrain tiles
+     * (and any other paged data) loaded during the run.
+     */
+    struct CountingReadFileCallback : public osgDB::Registry::ReadFileCallback
+    {
+        CountingReadFileCallback( osgDB::Registry::ReadFileCallback* next ) : _next(next) { }
+
+        virtual osgDB::ReaderWriter::ReadResult readNode( const std::string& filename, const osgDB::Options* options )
+        {
+            osgDB::ReaderWriter::ReadResult r = _next.valid() ?
+                _next->readNode( filename, options ) :
+                osgDB::Registry::instance()->readNodeImplementation( filename, options );
+
+            if ( r.validNode() )
+                ++_numNodes;
+
+            return r;
+        }
+
+        osg::ref_ptr<osgDB::Registry::ReadFileCallback> _next;
+        OpenThreads::Atomic                             _numNodes;
+    };
+
+    /** True when the pager has nothing left to load, compile or merge. */
+    bool isPagerIdle( osgDB::DatabasePager* pager )
+    {
+        return
+            !pager->getRequestsInProgress() &&
+            pager->getFileRequestListSize() == 0 &&
+            pager->getDataToCompileListSize() == 0 &&
+            pager->getDataToMergeListSize() == 0;
+    }
+
+    /** Peak resident memory of this process, in bytes (0 if unknown). */
+    double getPeakMemory()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS pmc;
+        if ( GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)) )
+            return (double)pmc.PeakWorkingSetSize;
+        return 0.0;
+#else
+        struct rusage usage;
+        if ( getrusage(RUSAGE_SELF, &usage) != 0 )
+            return 0.0;
+#  ifdef __APPLE__
+        return (double)usage.ru_maxrss;          // bytes
+#  else
+        return (double)usage.ru_maxrss * 1024.0; // kilobytes
+#  endif
+#endif
+    }
+
+    /** Value at percentile "p" (0..1) of a sorted list. */
+    double percentile( const std::vector<double>& sorted, double p )
+    {
+        if ( sorted.empty() )
+            return 0.0;
+        unsigned i = (unsigned)(p * (double)(sorted.size()-1) + 0.5);
+        return sorted[std::min(i, (unsigned)sorted.size()-1)];
+    }
+
+    /** Points the camera at the path's interpolated position at "time". */
+    void applyPath( osgViewer::Viewer& viewer, osg::AnimationPath* path, double time )
+    {
+        osg::AnimationPath::ControlPoint cp;
+        if ( path->getInterpolatedControlPoint(time, cp) )
+        {
+            osg::Matrixd view;
+            cp.getInverse( view );
+            viewer.getCamera()->setViewMatrix( view );
+        }
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc,argv);
+
+    // help?
+    if ( arguments.read("--help") )
+        return usage(argv[0]);
+
+    std::string pathFile;
+    if ( !arguments.read("--path", pathFile) )
+        return usage(argv[0]);
+
+    bool cold = arguments.read("--cold");
+
+    double fps = 60.0;
+    arguments.read("--fps", fps);
+    if ( fps <= 0.0 )
+        fps = 60.0;
+
+    double settleTimeout = 120.0;
+    arguments.read("--settle-timeout", settleTimeout);
+
+    std::string outFile;
+    arguments.read("--out", outFile);
+
+    std::string earthFile;
+    for( int pos = 1; pos < arguments.argc() && earthFile.empty(); ++pos )
+    {
+        if ( osgDB::getLowerCaseFileExtension(arguments[pos]) == "earth" )
+            earthFile = arguments[pos];
+    }
+
+    // load the camera path:
+    osg::ref_ptr<osg::AnimationPath> path = new osg::AnimationPath();
+    {
+        std::ifstream in( pathFile.c_str() );
+        if ( !in.is_open() )
+        {
+            OE_WARN << LC << "Cannot open camera path \"" << pathFile << "\"" << std::endl;
+            return -1;
+        }
+        path->read( in );
+        if ( path->empty() )
+        {
+            OE_WARN << LC << "Camera path \"" << pathFile << "\" has no control points" << std::endl;
+            return -1;
+        }
+    }
+
+    // a cold run never touches the cache, so every tile comes from its source.
+    if ( cold )
+    {
+        osgEarth::Registry::instance()->setOverrideCachePolicy( CachePolicy::NO_CACHE );
+    }
+
+    osg::ref_ptr<CountingReadFileCallback> counter = new CountingReadFileCallback(
+        osgDB::Registry::instance()->getReadFileCallback() );
+
+    // create a viewer. No camera manipulator; the path drives the view matrix.
+    osgViewer::Viewer viewer(arguments);
+    viewer.getDatabasePager()->setUnrefImageDataAfterApplyPolicy( false, false );
+
+    osg::Node* node = MapNodeHelper().load( arguments, &viewer );
+    if ( !node )
+        return usage(argv[0]);
+
+    MapNode* mapNode = MapNode::findMapNode( node );
+    std::string engine = mapNode ? mapNode->getMapNodeOptions().getTerrainOptions().getDriver() : "";
+
+    viewer.setSceneData( node );
+    viewer.getCamera()->setNearFarRatio(0.00002);
+    viewer.getCamera()->setSmallFeatureCullingPixelSize(-1.0f);
+    viewer.realize();
+
+    // only count what the run itself loads.
+    osgDB::Registry::instance()->setReadFileCallback( counter.get() );
+    HTTPClient::resetStats();
+
+    osgDB::DatabasePager* pager = viewer.getDatabasePager();
+    osg::Timer_t runStart = osg::Timer::instance()->tick();
+
+    // 1. hold the camera at the start of the path until the pager runs dry.
+    //    Merged tiles can request children, so wait for a few idle frames.
+    const unsigned idleFramesNeeded = 10;
+    double startTime = path->getFirstTime();
+    double timeToFullDetail = -1.0;
+    unsigned idleFrames = 0;
+    while ( !viewer.done() )
+    {
+        applyPath( viewer, path.get(), startTime );
+        viewer.frame();
+
+        double elapsed = osg::Timer::instance()->delta_s( runStart, osg::Timer::instance()->tick() );
+        idleFrames = isPagerIdle(pager) ? idleFrames+1 : 0;
+        if ( idleFrames >= idleFramesNeeded )
+        {
+            timeToFullDetail = elapsed;
+            break;
+        }
+        if ( elapsed > settleTimeout )
+        {
+            OE_WARN << LC << "Full detail not reached within " << settleTimeout << "s" << std::endl;
+            break;
+        }
+    }
+
+    // 2. replay the path at a fixed sampling rate, timing each frame.
+    std::vector<double> frameTimes;
+    double step = 1.0/fps;
+    for( double t = startTime; t <= path->getLastTime() && !viewer.done(); t += step )
+    {
+        applyPath( viewer, path.get(), t );
+        osg::Timer_t frameStart = osg::Timer::instance()->tick();
+        viewer.frame();
+        frameTimes.push_back( osg::Timer::instance()->delta_m(frameStart, osg::Timer::instance()->tick()) );
+    }
+
+    double runTime = osg::Timer::instance()->delta_s( runStart, osg::Timer::instance()->tick() );
+
+    osgDB::Registry::instance()->setReadFileCallback( counter->_next.get() );
+
+    // report:
+    std::vector<double> sorted( frameTimes );
+    std::sort( sorted.begin(), sorted.end() );
+    double total = 0.0;
+    for( unsigned i = 0; i < sorted.size(); ++i )
+        total += sorted[i];
+
+    std::ofstream fout;
+    if ( !outFile.empty() )
+    {
+        fout.open( outFile.c_str() );
+        if ( !fout.is_open() )
+        {
+            OE_WARN << LC << "Cannot write report to \"" << outFile << "\"" << std::endl;
+            return -1;
+        }
+    }
+    std::ostream& out = fout.is_open() ? (std::ostream&)fout : std::cout;
+
+    out << "{" << std::endl
+        << "  \"earth_file\": \"" << earthFile << "\"," << std::endl
+        << "  \"camera_path\": \"" << pathFile << "\"," << std::endl
+        << "  \"engine\": \"" << engine << "\"," << std::endl
+        << "  \"cache\": \"" << (cold ? "cold" : "warm") << "\"," << std::endl
+        << "  \"time_to_full_detail_s\": " << timeToFullDetail << "," << std::endl
+        << "  \"run_time_s\": " << runTime << "," << std::endl
+        << "  \"frames\": " << sorted.size() << "," << std::endl
+        << "  \"frame_time_ms\": {" << std::endl
+        << "    \"mean\": " << (sorted.empty() ? 0.0 : total/(double)sorted.size()) << "," << std::endl
+        << "    \"p50\": "  << percentile(sorted, 0.50) << "," << std::endl
+        << "    \"p90\": "  << percentile(sorted, 0.90) << "," << std::endl
+        << "    \"p95\": "  << percentile(sorted, 0.95) << "," << std::endl
+        << "    \"p99\": "  << percentile(sorted, 0.99) << "," << std::endl
+        << "    \"max\": "  << (sorted.empty() ? 0.0 : sorted.back()) << std::endl
+        << "  }," << std::endl
+        << "  \"tiles_loaded\": " << (unsigned)counter->_numNodes << "," << std::endl
+        << "  \"http_responses\": " << HTTPClient::getNumResponses() << "," << std::endl
+        << "  \"bytes_fetched\": " << std::fixed << HTTPClient::getNumBytesReceived() << "," << std::endl
+        << "  \"peak_memory_bytes\": " << getPeakMemory() << std::endl
+        << "}" << std::endl;
+
+    return 0;
+}
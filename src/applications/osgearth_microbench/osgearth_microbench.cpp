@@ -0,0 +1,379 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osg/Notify>
+#include <osg/Timer>
+#include <osg/ArgumentParser>
+#include <osgEarth/Containers>
+#include <osgEarth/GeoData>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Map>
+#include <osgEarth/SpatialReference>
+#include <osgEarthFeatures/Feature>
+#include <osgEarthFeatures/GeometryCompiler>
+#include <osgEarthFeatures/Session>
+#include <osgEarthSymbology/ExtrusionSymbol>
+#include <osgEarthSymbology/PolygonSymbol>
+#include <osgEarthSymbology/Style>
+#include <OpenThreads/Thread>
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define LC "[microbench] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+int
+usage(const char* name)
+{
+    OE_NOTICE
+        << "\nUsage: " << name << " [options]" << std::endl
+        << "\n    --time <s>      : minimum time to run each kernel (default 1)"
+        << "\n    --filter <text> : only run the kernels whose names contain this text"
+        << "\n    --threads <n>   : threads for the contention kernels (default 4)"
+        << "\n    --list          : list the kernels and exit"
+        << std::endl;
+
+    return 0;
+}
+
+namespace
+{
+    /** One benchmarked operation. run() performs getOpsPerRun() operations. */
+    struct Kernel
+    {
+        virtual ~Kernel() { }
+        virtual const char* getName() const =0;
+        virtual unsigned getOpsPerRun() const { return 1u; }
+        virtual void run() =0;
+    };
+
+    /** Small, repeatable pseudo-random sequence */
+    struct LCG
+    {
+        LCG( unsigned seed =1u ) : _state(seed) { }
+        unsigned next() { _state = _state * 1664525u + 1013904223u; return _state >> 8; }
+        double   nextDouble() { return (double)next() / (double)(1u << 24); }
+        unsigned _state;
+    };
+
+    osg::Image* makeImage( unsigned s, unsigned t, GLenum format )
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage( s, t, 1, format, GL_UNSIGNED_BYTE );
+        LCG rand;
+        unsigned char* data = image->data();
+        for( unsigned i = 0; i < image->getTotalSizeInBytes(); ++i )
+            data[i] = (unsigned char)(rand.next() & 0xff);
+        return image;
+    }
+
+    osg::HeightField* makeHeightField( unsigned size )
+    {
+        osg::HeightField* hf = new osg::HeightField();
+        hf->allocate( size, size );
+        for( unsigned r = 0; r < size; ++r )
+            for( unsigned c = 0; c < size; ++c )
+                hf->setHeight( c, r, 100.0f * sinf(0.1f*c) * cosf(0.07f*r) );
+        return hf;
+    }
+
+    //------------------------------------------------------------------------
+
+    struct TransformKernel : public Kernel
+    {
+        TransformKernel()
+        {
+            _from = SpatialReference::create( "wgs84" );
+            _to   = SpatialReference::create( "spherical-mercator" );
+            LCG rand;
+            for( unsigned i = 0; i < 1024; ++i )
+                _points.push_back( osg::Vec3d(-180.0 + 360.0*rand.nextDouble(), -80.0 + 160.0*rand.nextDouble(), 0.0) );
+        }
+        const char* getName() const { return "srs_transform_1024pts"; }
+        unsigned getOpsPerRun() const { return _points.size(); }
+        void run()
+        {
+            std::vector<osg::Vec3d> points( _points );
+            _from->transform( points, _to.get() );
+        }
+        osg::ref_ptr<const SpatialReference> _from, _to;
+        std::vector<osg::Vec3d>              _points;
+    };
+
+    struct ReprojectKernel : public Kernel
+    {
+        ReprojectKernel()
+        {
+            const SpatialReference* wgs84 = SpatialReference::create( "wgs84" );
+            _image = GeoImage( makeImage(256, 256, GL_RGBA), GeoExtent(wgs84, -10.0, -10.0, 10.0, 10.0) );
+            _to    = SpatialReference::create( "spherical-mercator" );
+        }
+        const char* getName() const { return "geoimage_reproject_256"; }
+        void run()
+        {
+            GeoImage out = _image.reproject( _to.get(), 0L, 256, 256, true );
+        }
+        GeoImage                             _image;
+        osg::ref_ptr<const SpatialReference> _to;
+    };
+
+    struct SubSampleKernel : public Kernel
+    {
+        SubSampleKernel()
+        {
+            const SpatialReference* wgs84 = SpatialReference::create( "wgs84" );
+            _hf  = GeoHeightField( makeHeightField(257), GeoExtent(wgs84, 0.0, 0.0, 1.0, 1.0) );
+            _sub = GeoExtent( wgs84, 0.25, 0.25, 0.75, 0.75 );
+        }
+        const char* getName() const { return "geohf_subsample_257"; }
+        void run()
+        {
+            GeoHeightField out = _hf.createSubSample( _sub, INTERP_BILINEAR );
+        }
+        GeoHeightField _hf;
+        GeoExtent      _sub;
+    };
+
+    struct ResampleKernel : public Kernel
+    {
+        ResampleKernel()
+        {
+            _hf = makeHeightField( 257 );
+            _extent = GeoExtent( SpatialReference::create("wgs84"), 0.0, 0.0, 1.0, 1.0 );
+        }
+        const char* getName() const { return "resample_heightfield_257_to_65"; }
+        void run()
+        {
+            osg::ref_ptr<osg::HeightField> out = HeightFieldUtils::resampleHeightField( _hf.get(), _extent, 65, 65, INTERP_BILINEAR );
+        }
+        osg::ref_ptr<osg::HeightField> _hf;
+        GeoExtent                      _extent;
+    };
+
+    struct ResizeKernel : public Kernel
+    {
+        ResizeKernel() : _image( makeImage(256, 256, GL_RGBA) ) { }
+        const char* getName() const { return "image_resize_256_to_128"; }
+        void run()
+        {
+            osg::ref_ptr<osg::Image> out;
+            ImageUtils::resizeImage( _image.get(), 128, 128, out );
+        }
+        osg::ref_ptr<osg::Image> _image;
+    };
+
+    struct ConvertKernel : public Kernel
+    {
+        ConvertKernel() : _image( makeImage(256, 256, GL_RGB) ) { }
+        const char* getName() const { return "image_convert_rgb_to_rgba_256"; }
+        void run()
+        {
+            osg::ref_ptr<osg::Image> out = ImageUtils::convert( _image.get(), GL_RGBA, GL_UNSIGNED_BYTE );
+        }
+        osg::ref_ptr<osg::Image> _image;
+    };
+
+    struct ExpressionKernel : public Kernel
+    {
+        ExpressionKernel() : _expr( "[height] * 2.0 + [levels] * 3.5" ), _result( 0.0 )
+        {
+            _feature = new Feature( new Geometry(), SpatialReference::create("wgs84") );
+            _feature->set( "height", 20.0 );
+            _feature->set( "levels", 4 );
+        }
+        const char* getName() const { return "feature_eval_expression"; }
+        void run()
+        {
+            _result += _feature->eval( _expr );
+        }
+        osg::ref_ptr<Feature> _feature;
+        NumericExpression     _expr;
+        double                _result;
+    };
+
+    struct LRUKernel : public Kernel
+    {
+        struct Worker : public OpenThreads::Thread
+        {
+            Worker( LRUCache<int,int>* cache, unsigned seed, unsigned ops ) : _cache(cache), _rand(seed), _ops(ops) { }
+            void run()
+            {
+                for( unsigned i = 0; i < _ops; ++i )
+                {
+                    int key = (int)(_rand.next() % 2000u);
+                    LRUCache<int,int>::Record rec;
+                    if ( !_cache->get(key, rec) )
+                        _cache->insert( key, key );
+                }
+            }
+            LRUCache<int,int>* _cache;
+            LCG                _rand;
+            unsigned           _ops;
+        };
+
+        LRUKernel( unsigned threads ) : _cache( true, 1000 ), _threads( osg::maximum(threads, 1u) ) { }
+        const char* getName() const { return "lru_cache_contention"; }
+        unsigned getOpsPerRun() const { return _threads * OPS_PER_THREAD; }
+        void run()
+        {
+            std::vector<Worker*> workers;
+            for( unsigned i = 0; i < _threads; ++i )
+                workers.push_back( new Worker(&_cache, i+1, OPS_PER_THREAD) );
+            for( unsigned i = 0; i < _threads; ++i )
+                workers[i]->start();
+            for( unsigned i = 0; i < _threads; ++i )
+            {
+                workers[i]->join();
+                delete workers[i];
+            }
+        }
+        enum { OPS_PER_THREAD = 100000 };
+        LRUCache<int,int> _cache;
+        unsigned          _threads;
+    };
+
+    struct GeometryCompilerKernel : public Kernel
+    {
+        GeometryCompilerKernel()
+        {
+            _map     = new Map();
+            _session = new Session( _map.get() );
+
+            // a 10x10 block of square buildings, ~20m on a side
+            const SpatialReference* wgs84 = SpatialReference::create( "wgs84" );
+            for( unsigned r = 0; r < NUM_SIDE; ++r )
+            {
+                for( unsigned c = 0; c < NUM_SIDE; ++c )
+                {
+                    double x = 0.0004 * c, y = 0.0004 * r, d = 0.0002;
+                    Polygon* poly = new Polygon();
+                    poly->push_back( x, y );
+                    poly->push_back( x+d, y );
+                    poly->push_back( x+d, y+d );
+                    poly->push_back( x, y+d );
+                    _buildings.push_back( new Feature(poly, wgs84) );
+                }
+            }
+
+            _style.getOrCreate<ExtrusionSymbol>()->height() = 20.0f;
+            _style.getOrCreate<PolygonSymbol>()->fill()->color() = Color::White;
+        }
+        const char* getName() const { return "geometry_compiler_100_buildings"; }
+        unsigned getOpsPerRun() const { return _buildings.size(); }
+        void run()
+        {
+            // the compiler consumes its input, so work on copies (included in the time).
+            FeatureList features;
+            for( FeatureList::const_iterator i = _buildings.begin(); i != _buildings.end(); ++i )
+                features.push_back( new Feature(*i->get()) );
+
+            FilterContext cx( _session.get() );
+            GeometryCompiler compiler;
+            osg::ref_ptr<osg::Node> node = compiler.compile( features, _style, cx );
+        }
+        enum { NUM_SIDE = 10 };
+        osg::ref_ptr<Map>     _map;
+        osg::ref_ptr<Session> _session;
+        FeatureList           _buildings;
+        Style                 _style;
+    };
+
+    //------------------------------------------------------------------------
+
+    /** Runs a kernel for at least "minTime" seconds and prints the time per operation. */
+    void measure( Kernel* kernel, double minTime )
+    {
+        osg::Timer* timer = osg::Timer::instance();
+
+        // warm up (first-use allocations, lazy initialization)
+        kernel->run();
+
+        unsigned runs = 0;
+        osg::Timer_t start = timer->tick();
+        double elapsed = 0.0;
+        do
+        {
+            kernel->run();
+            ++runs;
+            elapsed = timer->delta_s( start, timer->tick() );
+        }
+        while( elapsed < minTime );
+
+        double ops = (double)runs * (double)kernel->getOpsPerRun();
+        std::cout
+            << std::left  << std::setw(36) << kernel->getName()
+            << std::right << std::setw(12) << std::fixed << std::setprecision(0) << ops << " ops"
+            << std::setw(14) << std::setprecision(1) << (1.0e9 * elapsed / ops) << " ns/op"
+            << std::endl;
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc,argv);
+
+    if ( arguments.read("--help") )
+        return usage(argv[0]);
+
+    double minTime = 1.0;
+    arguments.read( "--time", minTime );
+
+    std::string filter;
+    arguments.read( "--filter", filter );
+
+    unsigned threads = 4;
+    arguments.read( "--threads", threads );
+
+    bool listOnly = arguments.read( "--list" );
+
+    std::vector<Kernel*> kernels;
+    kernels.push_back( new TransformKernel() );
+    kernels.push_back( new ReprojectKernel() );
+    kernels.push_back( new SubSampleKernel() );
+    kernels.push_back( new ResampleKernel() );
+    kernels.push_back( new ResizeKernel() );
+    kernels.push_back( new ConvertKernel() );
+    kernels.push_back( new ExpressionKernel() );
+    kernels.push_back( new LRUKernel(threads) );
+    kernels.push_back( new GeometryCompilerKernel() );
+
+    for( unsigned i = 0; i < kernels.size(); ++i )
+    {
+        Kernel* kernel = kernels[i];
+        if ( filter.empty() || std::string(kernel->getName()).find(filter) != std::string::npos )
+        {
+            if ( listOnly )
+                std::cout << kernel->getName() << std::endl;
+            else
+                measure( kernel, minTime );
+        }
+        delete kernel;
+    }
+
+    return 0;
+}
@@ -28,12 +28,18 @@
 #include <osgEarth/Registry>
 #include <osgEarth/StringUtils>
 #include <osgEarth/HTTPClient>
+#include <osgEarth/CacheSeed>
+#include <osgEarth/CacheBundle>
+#include <osgEarth/BakedTile>
+#include <osgEarth/MapFrame>
 #include <osgEarthUtil/TMSPackager>
 #include <osgEarthDrivers/tms/TMSOptions>
+#include <osgEarthDrivers/mbtiles/MBTilesOptions>
 
 #include <iostream>
 #include <sstream>
 #include <iterator>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -65,7 +71,27 @@ usage( const std::string& msg = "" )
         << "            [--overwrite]                   : overwrite existing tiles\n"
         << "            [--keep-empties]                : writes out fully transparent image tiles (normally discarded)\n"
         << "            [--continue-single-color]       : continues to subdivide single color tiles, subdivision typicall stops on single color images\n"
+        << "            [--threads <num>]               : number of worker threads packaging tiles (default=0, package on the main thread)\n"
         << "            [--db-options]                : db options string to pass to the image writer in quotes (e.g., \"JPEG_QUALITY 60\")\n"
+        << "            [--estimate <rate>]             : reports the tiles, size and time (at rate tiles/s) instead of packaging; needs --max-level\n"
+        << std::endl
+        << "         --mbtiles                          : make one MBTiles database per image layer\n"
+        << "            <earth_file>                    : earth file defining layers to export (required)\n"
+        << "            --out <path>                    : output folder for the .mbtiles files (required)\n"
+        << "            [--bounds xmin ymin xmax ymax]* : bounds to package (in spherical mercator coordinates; default=entire map)\n"
+        << "            [--max-level <num>]             : max LOD level for tiles (all layers; default=inf)\n"
+        << "            [--out-earth <earthfile>]       : export an earth file referencing the new databases\n"
+        << "            [--ext <extension>]             : tile image format (default=png)\n"
+        << "            [--keep-empties]                : writes out fully transparent image tiles (normally discarded)\n"
+        << "            [--continue-single-color]       : continues to subdivide single color tiles\n"
+        << "            [--threads <num>]               : number of worker threads packaging tiles (default=0, package on the main thread)\n"
+        << std::endl
+        << "         --bake                             : bake terrain tiles into one bundle file for the mp engine's baked_tiles option\n"
+        << "            <earth_file>                    : earth file defining layers to bake (required)\n"
+        << "            --out <file>                    : output bundle file (required)\n"
+        << "            --max-level <num>               : max LOD level for tiles (required)\n"
+        << "            [--min-level <num>]             : min LOD level for tiles (default=0)\n"
+        << "            [--bounds xmin ymin xmax ymax]* : bounds to bake (in map coordinates; default=entire map)\n"
         << std::endl
         << "         [--quiet]               : suppress progress output" << std::endl;
 
@@ -85,6 +111,33 @@ message( const std::string& msg )
 }
 
 
+/** Prints the expected cost of packaging. */
+void
+printEstimate( const CacheSeed::Estimate& estimate, double rate )
+{
+    std::cout << "Estimated package:" << std::endl;
+    for( unsigned lod = 0; lod < estimate._tilesPerLevel.size(); ++lod )
+    {
+        if ( estimate._tilesPerLevel[lod] > 0 )
+            std::cout << "    Level " << lod << ": " << estimate._tilesPerLevel[lod] << " tiles" << std::endl;
+    }
+
+    for( unsigned i = 0; i < estimate._layers.size(); ++i )
+    {
+        const CacheSeed::LayerEstimate& layer = estimate._layers[i];
+        std::cout << "    Layer \"" << layer._name << "\": " << layer._tiles << " tiles, "
+            << (unsigned)(layer._bytesPerTile/1024.0 + 0.5) << " KB/tile from " << layer._samples << " samples" << std::endl;
+    }
+
+    std::cout
+        << "    Total: " << estimate._tiles << " tiles, " << estimate._requests << " requests, "
+        << (unsigned)(estimate._bytes/(1024.0*1024.0) + 0.5) << " MB" << std::endl;
+
+    if ( rate > 0.0 )
+        std::cout << "    Time at " << rate << " tiles/s: " << (unsigned)(estimate.getSeconds(rate) + 0.5) << " s" << std::endl;
+}
+
+
 /** Finds an argument with the specified extension. */
 std::string
 findArgumentWithExtension( osg::ArgumentParser& args, const std::string& ext )
@@ -159,18 +212,41 @@ makeTMS( osg::ArgumentParser& args )
 
     bool continueSingleColor = args.read("--continue-single-color");
 
+    // number of worker threads
+    unsigned numThreads = 0;
+    args.read("--threads", numThreads);
+
+    // throughput (tiles per second) at which to estimate the package
+    double estimateRate = 0.0;
+    bool estimate = args.read("--estimate", estimateRate);
+    if ( estimate && maxLevel == ~0 )
+        return usage( "--estimate requires --max-level" );
+
     // load up the map
     osg::ref_ptr<MapNode> mapNode = MapNode::load( args );
     if ( !mapNode.valid() )
         return usage( "Failed to load a valid .earth file" );
 
+    Map* map = mapNode->getMap();
+
+    if ( estimate )
+    {
+        CacheSeed estimator;
+        estimator.setMaxLevel( maxLevel );
+        for (unsigned int i = 0; i < bounds.size(); ++i)
+        {
+            if ( bounds[i].isValid() )
+                estimator.addExtent( GeoExtent(map->getProfile()->getSRS(), bounds[i]) );
+        }
+        printEstimate( estimator.estimate(map), estimateRate );
+        return 0;
+    }
+
     // create a folder for the output
     osgDB::makeDirectory(rootFolder);
     if ( !osgDB::fileExists(rootFolder) )
         return usage("Failed to create root output folder" );
 
-    Map* map = mapNode->getMap();
-
     // fire up a packager:
     TMSPackager packager( map->getProfile(), options);
 
@@ -178,6 +254,7 @@ makeTMS( osg::ArgumentParser& args )
     packager.setOverwrite( overwrite );
     packager.setKeepEmptyImageTiles( keepEmpties );
     packager.setSubdivideSingleColorImageTiles( continueSingleColor );
+    packager.setNumThreads( numThreads );
 
     if ( maxLevel != ~0 )
         packager.setMaxLevel( maxLevel );
@@ -324,6 +401,287 @@ makeTMS( osg::ArgumentParser& args )
     return 0;
 }
 
+/** Packages each image layer as an MBTiles database. */
+int
+makeMBTiles( osg::ArgumentParser& args )
+{
+    // tile image format
+    std::string extension = "png";
+    args.read( "--ext", extension );
+
+    // verbosity?
+    bool verbose = !args.read( "--quiet" );
+
+    std::string earthFile = findArgumentWithExtension(args, ".earth");
+
+    // folder to which to write the databases.
+    std::string rootFolder;
+    if ( !args.read( "--out", rootFolder ) )
+        rootFolder = Stringify() << earthFile << ".mbtiles_repo";
+
+    // write out an earth file
+    std::string outEarth;
+    args.read("--out-earth", outEarth);
+
+    // MBTiles is always spherical mercator, so package in that profile and
+    // let the layers reproject as needed.
+    const Profile* profile = Registry::instance()->getSphericalMercatorProfile();
+
+    std::vector< Bounds > bounds;
+    double xmin=DBL_MAX, ymin=DBL_MAX, xmax=DBL_MIN, ymax=DBL_MIN;
+    while (args.read("--bounds", xmin, ymin, xmax, ymax ))
+    {        
+        Bounds b;
+        b.xMin() = xmin, b.yMin() = ymin, b.xMax() = xmax, b.yMax() = ymax;
+        bounds.push_back( b );
+    }
+
+    // max level to which to generate
+    unsigned maxLevel = ~0;
+    args.read( "--max-level", maxLevel );
+
+    bool keepEmpties = args.read("--keep-empties");    
+
+    bool continueSingleColor = args.read("--continue-single-color");
+
+    // number of worker threads
+    unsigned numThreads = 0;
+    args.read("--threads", numThreads);
+
+    // load up the map
+    osg::ref_ptr<MapNode> mapNode = MapNode::load( args );
+    if ( !mapNode.valid() )
+        return usage( "Failed to load a valid .earth file" );
+
+    // create a folder for the output
+    osgDB::makeDirectory(rootFolder);
+    if ( !osgDB::fileExists(rootFolder) )
+        return usage("Failed to create root output folder" );
+
+    Map* map = mapNode->getMap();
+
+    TMSPackager packager( profile, 0L );
+
+    packager.setVerbose( verbose );
+    packager.setKeepEmptyImageTiles( keepEmpties );
+    packager.setSubdivideSingleColorImageTiles( continueSingleColor );
+    packager.setNumThreads( numThreads );
+
+    if ( maxLevel != ~0 )
+        packager.setMaxLevel( maxLevel );
+
+    for (unsigned int i = 0; i < bounds.size(); ++i)
+    {
+        if ( bounds[i].isValid() )
+            packager.addExtent( GeoExtent(profile->getSRS(), bounds[i]) );
+    }
+
+    osg::ref_ptr<Map> outMap = 0L;
+    if ( !outEarth.empty() )
+    {
+        outMap = new Map(map->getInitialMapOptions());
+    }
+
+    std::string outEarthFile = osgDB::concatPaths(rootFolder, osgDB::getSimpleFileName(outEarth));
+
+    ImageLayerVector imageLayers;
+    map->getImageLayers( imageLayers );
+
+    unsigned counter = 0;
+
+    for( ImageLayerVector::iterator i = imageLayers.begin(); i != imageLayers.end(); ++i, ++counter )
+    {
+        ImageLayer* layer = i->get();
+        if ( layer->getImageLayerOptions().enabled() == true )
+        {
+            std::string layerName = toLegalFileName( layer->getName() );
+            if ( layerName.empty() )
+                layerName = Stringify() << "image_layer_" << counter;
+
+            if ( verbose )
+            {
+                OE_NOTICE << LC << "Packaging image layer \"" << layerName << "\"" << std::endl;
+            }
+
+            MBTilesOptions mbtiles;
+            mbtiles.filename() = osgDB::concatPaths( rootFolder, layerName + ".mbtiles" );
+            mbtiles.format()   = extension;
+            mbtiles.writable() = true;
+
+            osg::ref_ptr<TileSource> output = TileSourceFactory::create( mbtiles );
+            if ( !output.valid() || output->startup(0L).isError() )
+            {
+                OE_WARN << LC << "Failed to open \"" << *mbtiles.filename() << "\" for writing" << std::endl;
+                continue;
+            }
+
+            TMSPackager::Result r = packager.package( layer, output.get() );
+
+            // close the database before anything reads it.
+            output = 0L;
+
+            if ( r.ok )
+            {
+                if ( outMap.valid() )
+                {
+                    // osgearth_mbtiles opens the file as-is, so record it in full.
+                    MBTilesOptions readOptions;
+                    readOptions.filename() = osgDB::getRealPath( *mbtiles.filename() );
+
+                    ImageLayerOptions layerOptions( layer->getName(), readOptions );
+                    layerOptions.mergeConfig( layer->getInitialOptions().getConfig(true) );
+                    layerOptions.cachePolicy() = CachePolicy::NO_CACHE;
+
+                    outMap->addImageLayer( new ImageLayer(layerOptions) );
+                }
+            }
+            else
+            {
+                OE_WARN << LC << r.message << std::endl;
+            }
+        }
+        else if ( verbose )
+        {
+            OE_NOTICE << LC << "Skipping disabled layer \"" << layer->getName() << "\"" << std::endl;
+        }
+    }
+
+    if ( verbose && map->getNumElevationLayers() > 0 )
+    {
+        OE_NOTICE << LC << "Skipping elevation layers; MBTiles holds imagery only" << std::endl;
+    }
+
+    // Finally, write an earth file if requested:
+    if ( outMap.valid() )
+    {
+        MapNodeOptions outNodeOptions = mapNode->getMapNodeOptions();
+        osg::ref_ptr<MapNode> outMapNode = new MapNode(outMap.get(), outNodeOptions);
+        if ( !osgDB::writeNodeFile(*outMapNode.get(), outEarthFile) )
+        {
+            OE_WARN << LC << "Error writing earth file to \"" << outEarthFile << "\"" << std::endl;
+        }
+        else if ( verbose )
+        {
+            OE_NOTICE << LC << "Wrote earth file to \"" << outEarthFile << "\"" << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+/** Bakes the map's terrain tiles into a bundle for the mp engine. */
+int
+makeBake( osg::ArgumentParser& args )
+{
+    bool verbose = !args.read( "--quiet" );
+
+    std::string outFile;
+    if ( !args.read( "--out", outFile ) )
+        return usage( "--bake requires --out" );
+
+    unsigned maxLevel = ~0;
+    if ( !args.read( "--max-level", maxLevel ) )
+        return usage( "--bake requires --max-level" );
+
+    unsigned minLevel = 0;
+    args.read( "--min-level", minLevel );
+
+    std::vector< Bounds > bounds;
+    double xmin=DBL_MAX, ymin=DBL_MAX, xmax=DBL_MIN, ymax=DBL_MIN;
+    while (args.read("--bounds", xmin, ymin, xmax, ymax ))
+    {
+        Bounds b;
+        b.xMin() = xmin, b.yMin() = ymin, b.xMax() = xmax, b.yMax() = ymax;
+        bounds.push_back( b );
+    }
+
+    // load up the map
+    osg::ref_ptr<MapNode> mapNode = MapNode::load( args );
+    if ( !mapNode.valid() )
+        return usage( "Failed to load a valid .earth file" );
+
+    Map* map = mapNode->getMap();
+    const Profile* profile = map->getProfile();
+
+    std::vector<GeoExtent> extents;
+    for (unsigned int i = 0; i < bounds.size(); ++i)
+    {
+        if ( bounds[i].isValid() )
+            extents.push_back( GeoExtent(profile->getSRS(), bounds[i]) );
+    }
+
+    osg::ref_ptr<CacheBundleWriter> writer = new CacheBundleWriter( outFile );
+    if ( !writer->isOpen() )
+        return usage( "Failed to create the output bundle file" );
+
+    // the engine checks the profile before using the tiles.
+    Config meta;
+    meta.add( "profile", profile->toProfileOptions().getConfig() );
+    meta.add( "min_level", minLevel );
+    meta.add( "max_level", maxLevel );
+    writer->setMetadata( BakedTile::BIN_ID, meta );
+
+    // the same layers the terrain engine builds tiles from:
+    MapFrame mapf( map, Map::MASKED_TERRAIN_LAYERS );
+
+    std::vector<TileKey> stack;
+    profile->getRootKeys( stack );
+    std::reverse( stack.begin(), stack.end() );
+
+    unsigned baked = 0;
+    while( !stack.empty() )
+    {
+        TileKey key = stack.back();
+        stack.pop_back();
+
+        bool inBounds = extents.empty();
+        for( unsigned i = 0; i < extents.size() && !inBounds; ++i )
+            inBounds = extents[i].intersects( key.getExtent() );
+        if ( !inBounds )
+            continue;
+
+        // a tile with no real data has nothing below it either, unless
+        // it's above the levels to bake.
+        osg::ref_ptr<BakedTile> tile = BakedTile::create( mapf, key );
+        if ( !tile.valid() && key.getLOD() >= minLevel )
+            continue;
+
+        if ( tile.valid() && key.getLOD() >= minLevel )
+        {
+            osg::ref_ptr<osg::Node> record = tile->toNode();
+            if ( !writer->write(BakedTile::BIN_ID, key.str(), record.get()) )
+            {
+                OE_WARN << LC << "Failed to write baked tile " << key.str() << std::endl;
+                return -1;
+            }
+
+            if ( verbose && (++baked % 100) == 0 )
+            {
+                OE_NOTICE << LC << "Baked " << baked << " tiles (now at " << key.str() << ")" << std::endl;
+            }
+        }
+
+        if ( key.getLOD() < maxLevel )
+        {
+            for( unsigned q = 4; q > 0; --q )
+                stack.push_back( key.createChildKey(q-1) );
+        }
+    }
+
+    if ( !writer->close() )
+    {
+        OE_WARN << LC << "Failed to finish the bundle file \"" << outFile << "\"" << std::endl;
+        return -1;
+    }
+
+    if ( verbose )
+    {
+        OE_NOTICE << LC << "Baked " << writer->getNumRecords() << " tiles to \"" << outFile << "\"" << std::endl;
+    }
+
+    return 0;
+}
+
 /**
  * Data packaging tool for osgEarth.
  */
@@ -337,6 +695,12 @@ main(int argc, char** argv)
     if ( args.read("--tms") )
         return makeTMS(args);
 
+    else if ( args.read("--mbtiles") )
+        return makeMBTiles(args);
+
+    else if ( args.read("--bake") )
+        return makeBake(args);
+
     else
         return usage();
 }
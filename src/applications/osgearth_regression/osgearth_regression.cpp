@@ -0,0 +1,584 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osg/Notify>
+#include <osg/Timer>
+#include <osg/AnimationPath>
+#include <osg/GraphicsContext>
+#include <osgDB/ReadFile>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osgViewer/Viewer>
+#include <osgEarth/MapNode>
+#include <osgEarth/Registry>
+#include <osgEarth/Cache>
+#include <osgEarth/CachePolicy>
+#include <osgEarth/Viewpoint>
+#include <osgEarth/StringUtils>
+#include <osgEarth/MemoryUsage>
+#include <osgEarthDrivers/cache_filesystem/FileSystemCache>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#endif
+
+#define LC "[regression] "
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+int
+usage(const char* name)
+{
+    OE_NOTICE
+        << "\nUsage: " << name << " [file.earth ...] [--dir <folder>] [options]" << std::endl
+        << "\n    --dir <folder>         : run every .earth file in a folder (e.g. tests)"
+        << "\n    --filter <text>        : only run maps whose file name contains <text>"
+        << "\n    --cache <folder>       : local cache to read from (default: regression_cache)"
+        << "\n    --prime                : fetch and cache whatever the cache lacks (default: cache only)"
+        << "\n    --path <file>          : camera path to fly (default: a canned approach and orbit)"
+        << "\n    --duration <s>         : length of the canned path (default 20)"
+        << "\n    --fps <n>              : path sampling rate (default 60)"
+        << "\n    --settle-timeout <s>   : longest wait for full detail (default 60)"
+        << "\n    --size <w> <h>         : offscreen surface size (default 1280 720)"
+        << "\n    --out <file.csv>       : write the results to a file (default: stdout)"
+        << "\n    --baseline <file.csv>  : compare against an earlier --out file"
+        << "\n    --threshold <percent>  : regression threshold for --baseline (default 10)"
+        << std::endl;
+
+    return 0;
+}
+
+namespace
+{
+    struct Settings
+    {
+        std::string _pathFile;
+        double      _duration;
+        double      _fps;
+        double      _settleTimeout;
+        int         _width, _height;
+    };
+
+    /**
+     * A reported metric. Lower is better for all of them; "slack" is the
+     * smallest increase worth calling a regression, so that noise in tiny
+     * values doesn't trip the threshold.
+     */
+    struct Metric
+    {
+        const char* _name;
+        bool        _compare;
+        double      _slack;
+    };
+
+    const Metric s_metrics[] = {
+        { "load_s",        true,  0.1  },
+        { "settle_s",      true,  0.25 },
+        { "frames",        false, 0.0  },
+        { "frame_mean_ms", true,  0.5  },
+        { "frame_p50_ms",  true,  0.5  },
+        { "frame_p90_ms",  true,  0.5  },
+        { "frame_p99_ms",  true,  1.0  },
+        { "frame_max_ms",  false, 0.0  },
+        { "memory_mb",     true,  1.0  },  // osgEarth's own accounting; see Registry::getMemoryUsage
+        { "peak_rss_mb",   false, 0.0  }   // whole process, so it only grows from map to map
+    };
+    const unsigned s_numMetrics = sizeof(s_metrics)/sizeof(s_metrics[0]);
+
+    typedef std::map<std::string, double>  Values;     // metric name => value
+    typedef std::map<std::string, Values>  ResultMap;  // map name => values
+
+    /** True when the pager has nothing left to load, compile or merge. */
+    bool isPagerIdle( osgDB::DatabasePager* pager )
+    {
+        return
+            !pager->getRequestsInProgress() &&
+            pager->getFileRequestListSize() == 0 &&
+            pager->getDataToCompileListSize() == 0 &&
+            pager->getDataToMergeListSize() == 0;
+    }
+
+    /** Peak resident memory of this process, in bytes (0 if unknown). */
+    double getPeakMemory()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS pmc;
+        if ( GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)) )
+            return (double)pmc.PeakWorkingSetSize;
+        return 0.0;
+#else
+        struct rusage usage;
+        if ( getrusage(RUSAGE_SELF, &usage) != 0 )
+            return 0.0;
+#  ifdef __APPLE__
+        return (double)usage.ru_maxrss;          // bytes
+#  else
+        return (double)usage.ru_maxrss * 1024.0; // kilobytes
+#  endif
+#endif
+    }
+
+    /** Value at percentile "p" (0..1) of a sorted list. */
+    double percentile( const std::vector<double>& sorted, double p )
+    {
+        if ( sorted.empty() )
+            return 0.0;
+        unsigned i = (unsigned)(p * (double)(sorted.size()-1) + 0.5);
+        return sorted[std::min(i, (unsigned)sorted.size()-1)];
+    }
+
+    /** Points the camera at the path's interpolated position at "time". */
+    void applyPath( osgViewer::Viewer& viewer, osg::AnimationPath* path, double time )
+    {
+        osg::AnimationPath::ControlPoint cp;
+        if ( path->getInterpolatedControlPoint(time, cp) )
+        {
+            osg::Matrixd view;
+            cp.getInverse( view );
+            viewer.getCamera()->setViewMatrix( view );
+        }
+    }
+
+    /**
+     * Builds the canned path: an approach from high above the map's first
+     * viewpoint (or the middle of the map) down to the viewpoint's range,
+     * tilting toward the horizon, then a half orbit around the focal point.
+     */
+    osg::AnimationPath* createCannedPath( MapNode* mapNode, double duration )
+    {
+        const SpatialReference* mapSRS = mapNode->getMapSRS();
+
+        Config viewpoints = mapNode->externalConfig().child("viewpoints");
+        const ConfigSet& oldViewpoints = mapNode->externalConfig().children("viewpoint");
+        for( ConfigSet::const_iterator i = oldViewpoints.begin(); i != oldViewpoints.end(); ++i )
+            viewpoints.add( *i );
+
+        GeoPoint focus;
+        double   range = 0.0;
+        if ( !viewpoints.children().empty() )
+        {
+            Viewpoint vp( viewpoints.children().front() );
+            const SpatialReference* vpSRS = vp.getSRS() ? vp.getSRS() : mapSRS->getGeographicSRS();
+            focus = GeoPoint( vpSRS, vp.x(), vp.y(), 0.0, ALTMODE_ABSOLUTE ).transform( mapSRS );
+            range = vp.getRange();
+        }
+
+        if ( !focus.isValid() || range <= 0.0 )
+        {
+            const GeoExtent& extent = mapNode->getMap()->getProfile()->getExtent();
+            focus = GeoPoint( mapSRS, extent.getCentroid(), ALTMODE_ABSOLUTE );
+            focus.z() = 0.0;
+            range = mapSRS->isGeographic() ?
+                extent.width() * 111000.0 * cos(osg::DegreesToRadians(focus.y())) :
+                extent.width();
+        }
+        range = osg::clampBetween( range, 500.0, 2.0e7 );
+
+        osg::Matrixd local2world;
+        focus.createLocalToWorld( local2world );
+        osg::Vec3d center = osg::Vec3d(0,0,0) * local2world;
+        osg::Vec3d up     = osg::Matrixd::transform3x3( osg::Vec3d(0,0,1), local2world );
+
+        osg::AnimationPath* path = new osg::AnimationPath();
+        const unsigned steps = 40;
+        for( unsigned i = 0; i <= steps; ++i )
+        {
+            double u = (double)i/(double)steps;
+
+            // first 60%: descend from 8x the range and tilt. Then orbit.
+            double a = osg::minimum( u/0.6, 1.0 );
+            double r = range * (8.0 - 7.0*a);
+            double tilt    = osg::DegreesToRadians( 20.0 + 40.0*a );
+            double heading = u > 0.6 ? osg::PI * (u-0.6)/0.4 : 0.0;
+
+            osg::Vec3d eyeLocal(
+                -r * sin(tilt) * sin(heading),
+                -r * sin(tilt) * cos(heading),
+                 r * cos(tilt) );
+            osg::Vec3d eye = eyeLocal * local2world;
+
+            osg::Matrixd camera = osg::Matrixd::inverse( osg::Matrixd::lookAt(eye, center, up) );
+            path->insert( u*duration, osg::AnimationPath::ControlPoint(camera.getTrans(), camera.getRotate()) );
+        }
+        return path;
+    }
+
+    /** Sets the viewer up to render into an offscreen pbuffer. */
+    bool setupOffscreen( osgViewer::Viewer& viewer, int width, int height )
+    {
+        osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits();
+        traits->readDISPLAY();
+        traits->setUndefinedScreenDetailsToDefaultScreen();
+        traits->x                = 0;
+        traits->y                = 0;
+        traits->width            = width;
+        traits->height           = height;
+        traits->windowDecoration = false;
+        traits->doubleBuffer     = false;
+        traits->pbuffer          = true;
+
+        osg::ref_ptr<osg::GraphicsContext> gc = osg::GraphicsContext::createGraphicsContext( traits.get() );
+        if ( !gc.valid() )
+            return false;
+
+        osg::Camera* camera = viewer.getCamera();
+        camera->setGraphicsContext( gc.get() );
+        camera->setViewport( new osg::Viewport(0, 0, width, height) );
+        camera->setProjectionMatrixAsPerspective( 30.0, (double)width/(double)height, 1.0, 1.0e7 );
+        camera->setDrawBuffer( GL_FRONT );
+        camera->setReadBuffer( GL_FRONT );
+        camera->setNearFarRatio( 0.00002 );
+        camera->setSmallFeatureCullingPixelSize( -1.0f );
+
+        viewer.setThreadingModel( osgViewer::Viewer::SingleThreaded );
+        return true;
+    }
+
+    /** Loads, settles and flies one map. Returns false if it could not run. */
+    bool runMap( const std::string& earthFile, const Settings& settings, Values& out )
+    {
+        osgViewer::Viewer viewer;
+        if ( !setupOffscreen(viewer, settings._width, settings._height) )
+        {
+            OE_WARN << LC << "Cannot create an offscreen surface" << std::endl;
+            return false;
+        }
+        viewer.getDatabasePager()->setUnrefImageDataAfterApplyPolicy( false, false );
+
+        // load time: opening the map and its layers.
+        osg::Timer_t loadStart = osg::Timer::instance()->tick();
+        osg::ref_ptr<osg::Node> node = osgDB::readNodeFile( earthFile );
+        MapNode* mapNode = MapNode::findMapNode( node.get() );
+        if ( !mapNode )
+        {
+            OE_WARN << LC << "Cannot load a map from " << earthFile << std::endl;
+            return false;
+        }
+        double loadTime = osg::Timer::instance()->delta_s( loadStart, osg::Timer::instance()->tick() );
+
+        osg::ref_ptr<osg::AnimationPath> path;
+        if ( !settings._pathFile.empty() )
+        {
+            path = new osg::AnimationPath();
+            std::ifstream in( settings._pathFile.c_str() );
+            path->read( in );
+        }
+        if ( !path.valid() || path->empty() )
+        {
+            path = createCannedPath( mapNode, settings._duration );
+        }
+
+        viewer.setSceneData( node.get() );
+        viewer.realize();
+
+        osgDB::DatabasePager* pager = viewer.getDatabasePager();
+
+        // time to settle: hold at the start of the path until the pager runs dry.
+        // Merged tiles can request children, so wait for a few idle frames.
+        const unsigned idleFramesNeeded = 10;
+        double startTime = path->getFirstTime();
+        double settleTime = settings._settleTimeout;
+        unsigned idleFrames = 0;
+        osg::Timer_t settleStart = osg::Timer::instance()->tick();
+        while ( !viewer.done() )
+        {
+            applyPath( viewer, path.get(), startTime );
+            viewer.frame();
+
+            double elapsed = osg::Timer::instance()->delta_s( settleStart, osg::Timer::instance()->tick() );
+            idleFrames = isPagerIdle(pager) ? idleFrames+1 : 0;
+            if ( idleFrames >= idleFramesNeeded )
+            {
+                settleTime = elapsed;
+                break;
+            }
+            if ( elapsed > settings._settleTimeout )
+            {
+                OE_WARN << LC << earthFile << ": full detail not reached within " << settings._settleTimeout << "s" << std::endl;
+                break;
+            }
+        }
+
+        // fly the path at a fixed sampling rate, timing each frame.
+        std::vector<double> frameTimes;
+        double step = 1.0/settings._fps;
+        for( double t = startTime; t <= path->getLastTime() && !viewer.done(); t += step )
+        {
+            applyPath( viewer, path.get(), t );
+            osg::Timer_t frameStart = osg::Timer::instance()->tick();
+            viewer.frame();
+            frameTimes.push_back( osg::Timer::instance()->delta_m(frameStart, osg::Timer::instance()->tick()) );
+        }
+
+        std::sort( frameTimes.begin(), frameTimes.end() );
+        double total = 0.0;
+        for( unsigned i = 0; i < frameTimes.size(); ++i )
+            total += frameTimes[i];
+
+        MemoryUsageMap usage;
+        Registry::instance()->getMemoryUsage( usage );
+        double memory = 0.0;
+        for( MemoryUsageMap::const_iterator i = usage.begin(); i != usage.end(); ++i )
+            memory += i->second;
+
+        out["load_s"]        = loadTime;
+        out["settle_s"]      = settleTime;
+        out["frames"]        = frameTimes.size();
+        out["frame_mean_ms"] = frameTimes.empty() ? 0.0 : total/(double)frameTimes.size();
+        out["frame_p50_ms"]  = percentile( frameTimes, 0.50 );
+        out["frame_p90_ms"]  = percentile( frameTimes, 0.90 );
+        out["frame_p99_ms"]  = percentile( frameTimes, 0.99 );
+        out["frame_max_ms"]  = frameTimes.empty() ? 0.0 : frameTimes.back();
+        out["memory_mb"]     = memory / 1048576.0;
+        out["peak_rss_mb"]   = getPeakMemory() / 1048576.0;
+
+        return true;
+    }
+
+    void writeResults( std::ostream& out, const std::vector<std::string>& names, const ResultMap& results )
+    {
+        out << "map";
+        for( unsigned m = 0; m < s_numMetrics; ++m )
+            out << "," << s_metrics[m]._name;
+        out << std::endl;
+
+        out << std::fixed << std::setprecision(3);
+        for( unsigned i = 0; i < names.size(); ++i )
+        {
+            ResultMap::const_iterator r = results.find( names[i] );
+            if ( r == results.end() )
+                continue;
+
+            out << names[i];
+            for( unsigned m = 0; m < s_numMetrics; ++m )
+            {
+                Values::const_iterator v = r->second.find( s_metrics[m]._name );
+                out << "," << (v != r->second.end() ? v->second : 0.0);
+            }
+            out << std::endl;
+        }
+    }
+
+    bool readResults( const std::string& file, ResultMap& results )
+    {
+        std::ifstream in( file.c_str() );
+        if ( !in.is_open() )
+            return false;
+
+        std::string line;
+        std::vector<std::string> columns;
+        while( std::getline(in, line) )
+        {
+            std::vector<std::string> fields;
+            StringTokenizer( line, fields, ",", "", true, true );
+            if ( fields.empty() )
+                continue;
+
+            if ( columns.empty() )
+            {
+                columns = fields;
+                continue;
+            }
+
+            Values& values = results[fields[0]];
+            for( unsigned i = 1; i < fields.size() && i < columns.size(); ++i )
+                values[columns[i]] = as<double>( fields[i], 0.0 );
+        }
+        return !columns.empty();
+    }
+
+    /** Reports each compared metric that got worse than the threshold; returns the count. */
+    unsigned compare( const ResultMap& baseline, const ResultMap& results, double threshold )
+    {
+        unsigned regressions = 0;
+        for( ResultMap::const_iterator r = results.begin(); r != results.end(); ++r )
+        {
+            ResultMap::const_iterator b = baseline.find( r->first );
+            if ( b == baseline.end() )
+            {
+                OE_NOTICE << LC << r->first << ": not in the baseline" << std::endl;
+                continue;
+            }
+
+            for( unsigned m = 0; m < s_numMetrics; ++m )
+            {
+                const Metric& metric = s_metrics[m];
+                if ( !metric._compare )
+                    continue;
+
+                Values::const_iterator cv = r->second.find( metric._name );
+                Values::const_iterator bv = b->second.find( metric._name );
+                if ( cv == r->second.end() || bv == b->second.end() )
+                    continue;
+
+                double delta = cv->second - bv->second;
+                if ( delta > metric._slack && delta > bv->second * threshold )
+                {
+                    OE_NOTICE << LC << "REGRESSION " << r->first << " " << metric._name << ": "
+                        << bv->second << " -> " << cv->second
+                        << " (+" << (bv->second > 0.0 ? 100.0*delta/bv->second : 100.0) << "%)" << std::endl;
+                    ++regressions;
+                }
+            }
+        }
+        return regressions;
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc,argv);
+
+    // help?
+    if ( arguments.read("--help") )
+        return usage(argv[0]);
+
+    Settings settings;
+    settings._duration      = 20.0;
+    settings._fps           = 60.0;
+    settings._settleTimeout = 60.0;
+    settings._width         = 1280;
+    settings._height        = 720;
+
+    arguments.read( "--path", settings._pathFile );
+    arguments.read( "--duration", settings._duration );
+    arguments.read( "--fps", settings._fps );
+    arguments.read( "--settle-timeout", settings._settleTimeout );
+    arguments.read( "--size", settings._width, settings._height );
+    if ( settings._fps <= 0.0 )
+        settings._fps = 60.0;
+
+    std::string dir, filter, outFile, baselineFile;
+    std::string cachePath = "regression_cache";
+    arguments.read( "--dir", dir );
+    arguments.read( "--filter", filter );
+    arguments.read( "--cache", cachePath );
+    arguments.read( "--out", outFile );
+    arguments.read( "--baseline", baselineFile );
+    bool prime = arguments.read( "--prime" );
+
+    double threshold = 10.0;
+    arguments.read( "--threshold", threshold );
+    threshold *= 0.01;
+
+    // gather the maps:
+    std::vector<std::string> earthFiles;
+    for( int pos = 1; pos < arguments.argc(); ++pos )
+    {
+        if ( osgDB::getLowerCaseFileExtension(arguments[pos]) == "earth" )
+            earthFiles.push_back( arguments[pos] );
+    }
+    if ( !dir.empty() )
+    {
+        osgDB::DirectoryContents contents = osgDB::getDirectoryContents( dir );
+        std::sort( contents.begin(), contents.end() );
+        for( osgDB::DirectoryContents::const_iterator i = contents.begin(); i != contents.end(); ++i )
+        {
+            if ( osgDB::getLowerCaseFileExtension(*i) == "earth" )
+                earthFiles.push_back( osgDB::concatPaths(dir, *i) );
+        }
+    }
+    if ( earthFiles.empty() )
+        return usage(argv[0]);
+
+    // a local cache, read-only unless priming, so runs don't depend on the network.
+    FileSystemCacheOptions cacheOptions;
+    cacheOptions.rootPath() = cachePath;
+    osg::ref_ptr<Cache> cache = CacheFactory::create( cacheOptions );
+    if ( !cache.valid() || !cache->isOK() )
+    {
+        OE_WARN << LC << "Cannot open the cache at " << cachePath << std::endl;
+        return -1;
+    }
+    Registry::instance()->setCache( cache.get() );
+    Registry::instance()->setOverrideCachePolicy( prime ? CachePolicy::USAGE_READ_WRITE : CachePolicy::CACHE_ONLY );
+
+    // run them:
+    std::vector<std::string> names;
+    ResultMap results;
+    unsigned failures = 0;
+    for( unsigned i = 0; i < earthFiles.size(); ++i )
+    {
+        std::string name = osgDB::getSimpleFileName( earthFiles[i] );
+        if ( !filter.empty() && name.find(filter) == std::string::npos )
+            continue;
+
+        OE_NOTICE << LC << "Running " << name << "..." << std::endl;
+
+        Values values;
+        if ( runMap(earthFiles[i], settings, values) )
+        {
+            names.push_back( name );
+            results[name] = values;
+        }
+        else
+        {
+            ++failures;
+        }
+    }
+
+    // report:
+    if ( outFile.empty() )
+    {
+        writeResults( std::cout, names, results );
+    }
+    else
+    {
+        std::ofstream out( outFile.c_str() );
+        if ( !out.is_open() )
+        {
+            OE_WARN << LC << "Cannot write results to " << outFile << std::endl;
+            return -1;
+        }
+        writeResults( out, names, results );
+    }
+
+    if ( failures > 0 )
+        OE_WARN << LC << failures << " map(s) failed to run" << std::endl;
+
+    if ( !baselineFile.empty() )
+    {
+        ResultMap baseline;
+        if ( !readResults(baselineFile, baseline) )
+        {
+            OE_WARN << LC << "Cannot read the baseline " << baselineFile << std::endl;
+            return -1;
+        }
+
+        unsigned regressions = compare( baseline, results, threshold );
+        OE_NOTICE << LC << regressions << " regression(s) beyond " << threshold*100.0 << "%" << std::endl;
+        if ( regressions > 0 )
+            return 1;
+    }
+
+    return 0;
+}
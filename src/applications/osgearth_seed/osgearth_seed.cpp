@@ -27,6 +27,7 @@
 #include <osgEarth/MapFrame>
 #include <osgEarth/Cache>
 #include <osgEarth/CacheSeed>
+#include <osgEarth/CacheBundle>
 #include <osgEarth/MapNode>
 #include <osgEarth/Registry>
 #include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
@@ -43,7 +44,11 @@ using namespace osgEarth::Drivers;
 int list( osg::ArgumentParser& args );
 int seed( osg::ArgumentParser& args );
 int purge( osg::ArgumentParser& args );
+int evict( osg::ArgumentParser& args );
+int exportBundle( osg::ArgumentParser& args );
+int importBundle( osg::ArgumentParser& args );
 int usage( const std::string& msg );
+void printEstimate( const CacheSeed::Estimate& estimate, double rate );
 int message( const std::string& msg );
 std::string prettyPrintTime( double seconds );
 
@@ -59,6 +64,12 @@ main(int argc, char** argv)
         return list( args );
     else if ( args.read( "--purge" ) )
         return purge( args );
+    else if ( args.read( "--evict" ) )
+        return evict( args );
+    else if ( args.read( "--export" ) )
+        return exportBundle( args );
+    else if ( args.read( "--import" ) )
+        return importBundle( args );
     else
         return usage("");
 }
@@ -84,8 +95,24 @@ usage( const std::string& msg )
         << "        [--index shapefile]             ; Use the feature extents in a shapefile to set the bounding boxes for seeding" << std::endl
         << "        [--cache-path path]             ; Overrides the cache path in the .earth file" << std::endl
         << "        [--cache-type type]             ; Overrides the cache type in the .earth file" << std::endl
+        << "        [--threads num]                 ; Worker threads per layer (default=0, seed on the main thread)" << std::endl
+        << "        [--journal file]                ; Records finished work so an interrupted seed can resume" << std::endl
+        << "        [--verify samples]              ; Spot-checks the journal against the cache instead of seeding" << std::endl
+        << "        [--estimate rate]               ; Reports the tiles, storage and time (at rate tiles/s) instead of seeding" << std::endl
         << std::endl
         << "    --purge file.earth                  ; Purges a layer cache in a .earth file (interactive)" << std::endl
+        << std::endl
+        << "    --evict file.earth                  ; Removes the least recently used tiles from caches over their size limit" << std::endl
+        << "        [--max-size MB]                 ; Size limit per layer cache (default=the cache's max_size and quotas)" << std::endl
+        << std::endl
+        << "    --export file.earth                 ; Writes the layer caches in a .earth file to a single bundle file" << std::endl
+        << "        --bundle file                   ; Bundle file to write" << std::endl
+        << "        [--min-level level]             ; Lowest LOD level to export (default=0)" << std::endl
+        << "        [--max-level level]             ; Highest LOD level to export (default=all)" << std::endl
+        << "        [--bounds xmin ymin xmax ymax]* ; Geospatial bounding box to export (in map coordinates; default=entire cache)" << std::endl
+        << std::endl
+        << "    --import file.earth                 ; Copies the contents of a bundle file into the cache in a .earth file" << std::endl
+        << "        --bundle file                   ; Bundle file to read" << std::endl
         << std::endl;
 
     return -1;
@@ -131,6 +158,22 @@ seed( osg::ArgumentParser& args )
     std::string cacheType;
     while (args.read("--cache-type", cacheType));
 
+    //Read the number of worker threads per layer
+    unsigned int numThreads = 0;
+    while (args.read("--threads", numThreads));
+
+    //Read the journal used to resume an interrupted seed
+    std::string journal;
+    while (args.read("--journal", journal));
+
+    //Read the number of samples per journal entry to verify
+    unsigned int verifySamples = 0;
+    while (args.read("--verify", verifySamples));
+
+    //Read the throughput (tiles per second) at which to estimate the seed
+    double estimateRate = 0.0;
+    bool estimate = args.read("--estimate", estimateRate);
+
     bool verbose = args.read("--verbose");
 
     //Read in the earth file.
@@ -145,6 +188,8 @@ seed( osg::ArgumentParser& args )
     CacheSeed seeder;
     seeder.setMinLevel( minLevel );
     seeder.setMaxLevel( maxLevel );
+    seeder.setNumThreads( numThreads );
+    seeder.setJournal( journal );
 
     // Read in an index shapefile
     std::string index;
@@ -181,6 +226,21 @@ seed( osg::ArgumentParser& args )
     }
 
 
+    if ( verifySamples > 0 )
+    {
+        if ( journal.empty() )
+            return usage( "--verify requires a --journal" );
+
+        seeder.verify( mapNode->getMap(), verifySamples );
+        return 0;
+    }
+
+    if ( estimate )
+    {
+        printEstimate( seeder.estimate(mapNode->getMap()), estimateRate );
+        return 0;
+    }
+
     osg::Timer_t start = osg::Timer::instance()->tick();
 
     seeder.seed( mapNode->getMap() );
@@ -249,33 +309,21 @@ list( osg::ArgumentParser& args )
 
 struct Entry
 {
-    bool                   _isImage;
-    std::string            _name;
-    osg::ref_ptr<CacheBin> _bin;
+    bool                         _isImage;
+    std::string                  _name;
+    osg::ref_ptr<CacheBin>       _bin;
+    osg::ref_ptr<const Profile>  _profile;
 };
 
 
-int
-purge( osg::ArgumentParser& args )
+/**
+ * Gets the cache bin of each terrain layer in a map.
+ */
+void
+getEntries( MapNode* mapNode, std::vector<Entry>& entries )
 {
-    //return usage( "Sorry, but purge is not yet implemented." );
-    
-    osg::ref_ptr<osg::Node> node = osgDB::readNodeFiles( args );
-    if ( !node.valid() )
-        return usage( "Failed to read .earth file." );
-
-    MapNode* mapNode = MapNode::findMapNode( node.get() );
-    if ( !mapNode )
-        return usage( "Input file was not a .earth file" );
-
     Map* map = mapNode->getMap();
 
-    if ( !map->getCache() )
-        return message( "Earth file does not contain a cache." );
-
-    std::vector<Entry> entries;
-
-
     ImageLayerVector imageLayers;
     map->getImageLayers( imageLayers );
     for( ImageLayerVector::const_iterator i = imageLayers.begin(); i != imageLayers.end(); ++i )
@@ -296,6 +344,7 @@ purge( osg::ArgumentParser& args )
             entries.back()._isImage = true;
             entries.back()._name = i->get()->getName();
             entries.back()._bin = bin;
+            entries.back()._profile = cacheProfile;
         }
     }
 
@@ -319,8 +368,173 @@ purge( osg::ArgumentParser& args )
             entries.back()._isImage = false;
             entries.back()._name = i->get()->getName();
             entries.back()._bin = bin;
+            entries.back()._profile = cacheProfile;
         }
     }
+}
+
+
+int
+evict( osg::ArgumentParser& args )
+{
+    //Read the size limit in MB; without one, each bin's configured limit applies
+    unsigned int maxSize = 0;
+    while (args.read("--max-size", maxSize));
+
+    osg::ref_ptr<osg::Node> node = osgDB::readNodeFiles( args );
+    if ( !node.valid() )
+        return usage( "Failed to read .earth file." );
+
+    MapNode* mapNode = MapNode::findMapNode( node.get() );
+    if ( !mapNode )
+        return usage( "Input file was not a .earth file" );
+
+    if ( !mapNode->getMap()->getCache() )
+        return message( "Earth file does not contain a cache." );
+
+    std::vector<Entry> entries;
+    getEntries( mapNode, entries );
+
+    unsigned long long maxBytes = (unsigned long long)maxSize * 1024ull * 1024ull;
+    for( unsigned i=0; i<entries.size(); ++i )
+    {
+        unsigned long long freed = entries[i]._bin->evict( maxBytes );
+        std::cout << entries[i]._name << ": freed " << (freed / (1024*1024)) << " MB" << std::endl;
+    }
+
+    return 0;
+}
+
+
+int
+exportBundle( osg::ArgumentParser& args )
+{
+    std::string bundlePath;
+    while (args.read("--bundle", bundlePath));
+    if ( bundlePath.empty() )
+        return usage( "--export requires a --bundle file" );
+
+    unsigned int minLevel = 0;
+    while (args.read("--min-level", minLevel));
+
+    unsigned int maxLevel = ~0u;
+    while (args.read("--max-level", maxLevel));
+
+    std::vector< Bounds > bounds;
+    double xmin=DBL_MAX, ymin=DBL_MAX, xmax=DBL_MIN, ymax=DBL_MIN;
+    while (args.read("--bounds", xmin, ymin, xmax, ymax ))
+    {
+        Bounds b;
+        b.xMin() = xmin, b.yMin() = ymin, b.xMax() = xmax, b.yMax() = ymax;
+        bounds.push_back( b );
+    }
+
+    bool verbose = args.read("--verbose");
+
+    osg::ref_ptr<osg::Node> node = osgDB::readNodeFiles( args );
+    if ( !node.valid() )
+        return usage( "Failed to read .earth file." );
+
+    MapNode* mapNode = MapNode::findMapNode( node.get() );
+    if ( !mapNode )
+        return usage( "Input file was not a .earth file" );
+
+    if ( !mapNode->getMap()->getCache() )
+        return message( "Earth file does not contain a cache." );
+
+    std::vector<GeoExtent> extents;
+    for (unsigned int i = 0; i < bounds.size(); i++)
+        extents.push_back( GeoExtent(mapNode->getMapSRS(), bounds[i]) );
+
+    std::vector<Entry> entries;
+    getEntries( mapNode, entries );
+
+    osg::ref_ptr<ProgressCallback> progress = verbose ? new ConsoleProgressCallback() : 0L;
+
+    osg::ref_ptr<CacheBundleWriter> writer = new CacheBundleWriter( bundlePath );
+    if ( !writer->isOpen() )
+        return message( "Cannot create bundle file " + bundlePath );
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    for( unsigned i=0; i<entries.size(); ++i )
+    {
+        unsigned count = writer->exportBin( entries[i]._bin.get(), entries[i]._profile.get(), extents, minLevel, maxLevel, progress.get() );
+        std::cout << entries[i]._name << ": exported " << count << " records" << std::endl;
+    }
+
+    if ( !writer->close() )
+        return message( "Failed to write bundle file " + bundlePath );
+
+    osg::Timer_t end = osg::Timer::instance()->tick();
+
+    OE_NOTICE << "Exported " << writer->getNumRecords() << " records in " << prettyPrintTime( osg::Timer::instance()->delta_s(start, end) ) << std::endl;
+
+    return 0;
+}
+
+
+int
+importBundle( osg::ArgumentParser& args )
+{
+    std::string bundlePath;
+    while (args.read("--bundle", bundlePath));
+    if ( bundlePath.empty() )
+        return usage( "--import requires a --bundle file" );
+
+    bool verbose = args.read("--verbose");
+
+    osg::ref_ptr<osg::Node> node = osgDB::readNodeFiles( args );
+    if ( !node.valid() )
+        return usage( "Failed to read .earth file." );
+
+    MapNode* mapNode = MapNode::findMapNode( node.get() );
+    if ( !mapNode )
+        return usage( "Input file was not a .earth file" );
+
+    Cache* cache = mapNode->getMap()->getCache();
+    if ( !cache )
+        return message( "Earth file does not contain a cache." );
+
+    osg::ref_ptr<CacheBundle> bundle = new CacheBundle( bundlePath );
+    if ( !bundle->isOpen() )
+        return message( "Cannot open bundle file " + bundlePath );
+
+    osg::ref_ptr<ProgressCallback> progress = verbose ? new ConsoleProgressCallback() : 0L;
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    unsigned count = bundle->importTo( cache, progress.get() );
+
+    osg::Timer_t end = osg::Timer::instance()->tick();
+
+    OE_NOTICE << "Imported " << count << " of " << bundle->getNumRecords() << " records in "
+        << prettyPrintTime( osg::Timer::instance()->delta_s(start, end) ) << std::endl;
+
+    return 0;
+}
+
+
+int
+purge( osg::ArgumentParser& args )
+{
+    //return usage( "Sorry, but purge is not yet implemented." );
+    
+    osg::ref_ptr<osg::Node> node = osgDB::readNodeFiles( args );
+    if ( !node.valid() )
+        return usage( "Failed to read .earth file." );
+
+    MapNode* mapNode = MapNode::findMapNode( node.get() );
+    if ( !mapNode )
+        return usage( "Input file was not a .earth file" );
+
+    Map* map = mapNode->getMap();
+
+    if ( !map->getCache() )
+        return message( "Earth file does not contain a cache." );
+
+    std::vector<Entry> entries;
+    getEntries( mapNode, entries );
 
     if ( entries.size() > 0 )
     {
@@ -398,3 +612,33 @@ std::string prettyPrintTime( double seconds )
     buf << hours << ":" << minutes << ":" << seconds;
     return buf.str();
 }
+
+/**
+ * Prints the expected cost of a seed.
+ */
+void printEstimate( const CacheSeed::Estimate& estimate, double rate )
+{
+    std::cout << "Estimated seed:" << std::endl;
+    for (unsigned int lod = 0; lod < estimate._tilesPerLevel.size(); ++lod)
+    {
+        if ( estimate._tilesPerLevel[lod] > 0 )
+            std::cout << "    Level " << lod << ": " << estimate._tilesPerLevel[lod] << " tiles" << std::endl;
+    }
+
+    for (unsigned int i = 0; i < estimate._layers.size(); ++i)
+    {
+        const CacheSeed::LayerEstimate& layer = estimate._layers[i];
+        std::cout << "    Layer \"" << layer._name << "\": " << layer._tiles << " tiles, ";
+        if ( layer._samples > 0 )
+            std::cout << (unsigned)(layer._bytesPerTile/1024.0 + 0.5) << " KB/tile from " << layer._samples << " samples" << std::endl;
+        else
+            std::cout << "no samples" << std::endl;
+    }
+
+    std::cout
+        << "    Total: " << estimate._tiles << " tiles, " << estimate._requests << " requests, "
+        << (unsigned)(estimate._bytes/(1024.0*1024.0) + 0.5) << " MB" << std::endl;
+
+    if ( rate > 0.0 )
+        std::cout << "    Time at " << rate << " tiles/s: " << prettyPrintTime(estimate.getSeconds(rate)) << std::endl;
+}
@@ -52,6 +52,9 @@ usage( const std::string& msg )
         << "    --order-by         ; Sort the features, if not already included in the expression. Append DESC for descending order!" << std::endl
         << "    --crop             ; Crops features instead of doing a centroid check.  Features can be added to multiple tiles when cropping is enabled" << std::endl
         << "    --dest-srs         ;The destination SRS string in any format osgEarth can understand (wkt, proj4, epsg).  If none is specified the source data SRS will be used" << std::endl
+        << "    --max-memory       ; Memory ceiling in MB for buffered features; spills them to temporary files past it (default: keep only feature IDs in memory)" << std::endl
+        << "    --temp-path        ; Folder for the temporary files used with --max-memory (default: a folder in the destination)" << std::endl
+        << "    --threads          ; The number of threads writing tiles (default: 0, write on the main thread)" << std::endl
         << std::endl;
 
     return -1;
@@ -79,6 +82,16 @@ int main(int argc, char** argv)
     unsigned int maxFeatures = 300;
     while (arguments.read("--max-features", maxFeatures));    
 
+    //The memory ceiling for external-memory packaging
+    unsigned int maxMemory = 0;
+    while (arguments.read("--max-memory", maxMemory));
+
+    std::string tempPath;
+    while (arguments.read("--temp-path", tempPath));
+
+    unsigned int numThreads = 0;
+    while (arguments.read("--threads", numThreads));
+
     //The destination directory
     std::string destination = "out";
     while (arguments.read("--out", destination));
@@ -177,6 +190,9 @@ int main(int argc, char** argv)
     packager.setQuery( query );
     packager.setMethod( cropMethod );    
     packager.setDestSRS( destSRS );
+    packager.setMaxMemory( maxMemory );
+    packager.setTempPath( tempPath );
+    packager.setNumThreads( numThreads );
     packager.package( features, destination, layer, description );
     osg::Timer_t endTime = osg::Timer::instance()->tick();
     OE_NOTICE << "Completed in " << osg::Timer::instance()->delta_s( startTime, endTime ) << " s " << std::endl;
@@ -18,11 +18,17 @@
 */
 
 #include <osg/Notify>
+#include <osg/AnimationPath>
 #include <osgViewer/Viewer>
 #include <osgEarthUtil/EarthManipulator>
 #include <osgEarthUtil/ExampleResources>
 #include <osgEarthAnnotation/ModelNode>
 
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+
 #define LC "[viewer] "
 
 using namespace osgEarth;
@@ -34,11 +40,119 @@ usage(const char* name)
 {
     OE_NOTICE 
         << "\nUsage: " << name << " file.earth" << std::endl
+        << "\n    --record-path <file> : record the camera path to a file (osg::AnimationPath format)"
+        << "\n    --play-path <file>   : play back a camera path at fixed time steps, then exit"
+        << "\n    --play-fps <n>       : playback steps per simulated second (default 60)"
+        << "\n    --stats-csv <file>   : write per-frame timing and paging stats to a CSV file"
+        << std::endl
         << MapNodeHelper().usage() << std::endl;
 
     return 0;
 }
 
+namespace
+{
+    /** Per-frame paging state, sampled right after the frame. */
+    struct PagerSample
+    {
+        double   _time;
+        double   _frameTime;
+        unsigned _pending;
+        unsigned _compile;
+        unsigned _merge;
+    };
+
+    double getStat( osg::Stats* stats, unsigned frame, const std::string& name )
+    {
+        double value = 0.0;
+        if ( stats && stats->getAttribute(frame, name, value) )
+            return value * 1000.0;
+        return 0.0;
+    }
+
+    /**
+     * Writes one CSV row per frame. Cull, draw and GPU times are filled in by
+     * the rendering threads and may arrive a couple of frames late, so rows
+     * are written with a lag.
+     */
+    class FrameStatsWriter
+    {
+    public:
+        FrameStatsWriter( osgViewer::Viewer& viewer, std::ostream& out ) : _viewer(viewer), _out(out)
+        {
+            _viewer.getViewerStats()->collectStats( "event", true );
+            _viewer.getViewerStats()->collectStats( "update", true );
+            _viewer.getCamera()->getStats()->collectStats( "rendering", true );
+            _viewer.getCamera()->getStats()->collectStats( "gpu", true );
+
+            _out << "frame,time_s,frame_ms,event_ms,update_ms,cull_ms,draw_ms,gpu_ms,"
+                 << "tiles_pending,pager_compile_queue,pager_merge_queue" << std::endl;
+        }
+
+        void sample( double frameTime )
+        {
+            osgDB::DatabasePager* pager = _viewer.getDatabasePager();
+            PagerSample& s = _samples[_viewer.getFrameStamp()->getFrameNumber()];
+            s._time      = _viewer.getFrameStamp()->getSimulationTime();
+            s._frameTime = frameTime;
+            s._pending   = pager ? pager->getFileRequestListSize() : 0u;
+            s._compile   = pager ? pager->getDataToCompileListSize() : 0u;
+            s._merge     = pager ? pager->getDataToMergeListSize() : 0u;
+
+            flush( LAG );
+        }
+
+        /** Writes every row older than "lag" frames. */
+        void flush( unsigned lag =0u )
+        {
+            unsigned current = _viewer.getFrameStamp()->getFrameNumber();
+            osg::Stats* viewerStats = _viewer.getViewerStats();
+            osg::Stats* cameraStats = _viewer.getCamera()->getStats();
+
+            while( !_samples.empty() && _samples.begin()->first + lag <= current )
+            {
+                unsigned f = _samples.begin()->first;
+                const PagerSample& s = _samples.begin()->second;
+                _out << f << ","
+                     << std::fixed << std::setprecision(4) << s._time << ","
+                     << std::setprecision(3) << s._frameTime << ","
+                     << getStat(viewerStats, f, "Event traversal time taken") << ","
+                     << getStat(viewerStats, f, "Update traversal time taken") << ","
+                     << getStat(cameraStats, f, "Cull traversal time taken") << ","
+                     << getStat(cameraStats, f, "Draw traversal time taken") << ","
+                     << getStat(cameraStats, f, "GPU draw time taken") << ","
+                     << s._pending << "," << s._compile << "," << s._merge << std::endl;
+                _samples.erase( _samples.begin() );
+            }
+        }
+
+    private:
+        enum { LAG = 3 };
+        osgViewer::Viewer&              _viewer;
+        std::ostream&                   _out;
+        std::map<unsigned, PagerSample> _samples;
+    };
+
+    /** Points the camera at the path's interpolated position at "time". */
+    void applyPath( osgViewer::Viewer& viewer, osg::AnimationPath* path, double time )
+    {
+        osg::AnimationPath::ControlPoint cp;
+        if ( path->getInterpolatedControlPoint(time, cp) )
+        {
+            osg::Matrixd view;
+            cp.getInverse( view );
+            viewer.getCamera()->setViewMatrix( view );
+        }
+    }
+
+    /** Adds the camera's current position to a path, at "time". */
+    void recordPath( osgViewer::Viewer& viewer, osg::AnimationPath* path, double time )
+    {
+        osg::Matrixd world = osg::Matrixd::inverse( viewer.getCamera()->getViewMatrix() );
+        path->insert( time, osg::AnimationPath::ControlPoint(world.getTrans(), world.getRotate()) );
+    }
+}
+
 int
 main(int argc, char** argv)
 {
@@ -51,6 +165,34 @@ main(int argc, char** argv)
     if ( arguments.read("--stencil") )
         osg::DisplaySettings::instance()->setMinimumNumStencilBits( 8 );
 
+    std::string recordFile, playFile, statsFile;
+    arguments.read( "--record-path", recordFile );
+    arguments.read( "--play-path", playFile );
+    arguments.read( "--stats-csv", statsFile );
+
+    double playFPS = 60.0;
+    arguments.read( "--play-fps", playFPS );
+    if ( playFPS <= 0.0 )
+        playFPS = 60.0;
+
+    osg::ref_ptr<osg::AnimationPath> playPath;
+    if ( !playFile.empty() )
+    {
+        std::ifstream in( playFile.c_str() );
+        if ( !in.is_open() )
+        {
+            OE_WARN << LC << "Cannot open camera path \"" << playFile << "\"" << std::endl;
+            return -1;
+        }
+        playPath = new osg::AnimationPath();
+        playPath->read( in );
+        if ( playPath->empty() )
+        {
+            OE_WARN << LC << "Camera path \"" << playFile << "\" has no control points" << std::endl;
+            return -1;
+        }
+    }
+
     // create a viewer:
     osgViewer::Viewer viewer(arguments);
 
@@ -71,7 +213,87 @@ main(int argc, char** argv)
         viewer.getCamera()->setNearFarRatio(0.00002);
         viewer.getCamera()->setSmallFeatureCullingPixelSize(-1.0f);
 
-        viewer.run();
+        if ( recordFile.empty() && !playPath.valid() && statsFile.empty() )
+        {
+            viewer.run();
+            return 0;
+        }
+
+        std::ofstream statsOut;
+        std::auto_ptr<FrameStatsWriter> statsWriter;
+        if ( !statsFile.empty() )
+        {
+            statsOut.open( statsFile.c_str() );
+            if ( !statsOut.is_open() )
+            {
+                OE_WARN << LC << "Cannot write stats to \"" << statsFile << "\"" << std::endl;
+                return -1;
+            }
+        }
+
+        // the path drives the view matrix during playback, not the manipulator.
+        if ( playPath.valid() )
+            viewer.setCameraManipulator( 0L );
+
+        viewer.realize();
+
+        if ( statsOut.is_open() )
+            statsWriter.reset( new FrameStatsWriter(viewer, statsOut) );
+
+        osg::ref_ptr<osg::AnimationPath> recordedPath = recordFile.empty() ? 0L : new osg::AnimationPath();
+        double step = 1.0/playFPS;
+        double frameTime = 0.0;
+        double startTime = -1.0;
+        unsigned playFrame = 0;
+
+        while( !viewer.done() )
+        {
+            osg::Timer_t frameStart = osg::Timer::instance()->tick();
+
+            if ( playPath.valid() )
+            {
+                // fixed simulated time steps, independent of the real frame rate.
+                double t = playPath->getFirstTime() + step * (double)playFrame++;
+                if ( t > playPath->getLastTime() )
+                    break;
+                applyPath( viewer, playPath.get(), t );
+                viewer.frame( t - playPath->getFirstTime() );
+            }
+            else
+            {
+                viewer.frame();
+            }
+
+            frameTime = osg::Timer::instance()->delta_m( frameStart, osg::Timer::instance()->tick() );
+
+            if ( recordedPath.valid() )
+            {
+                double t = viewer.getFrameStamp()->getSimulationTime();
+                if ( startTime < 0.0 )
+                    startTime = t;
+                recordPath( viewer, recordedPath.get(), t - startTime );
+            }
+
+            if ( statsWriter.get() )
+                statsWriter->sample( frameTime );
+        }
+
+        if ( statsWriter.get() )
+            statsWriter->flush();
+
+        if ( recordedPath.valid() )
+        {
+            std::ofstream out( recordFile.c_str() );
+            if ( out.is_open() )
+            {
+                recordedPath->write( out );
+                OE_NOTICE << LC << "Wrote camera path to \"" << recordFile << "\"" << std::endl;
+            }
+            else
+            {
+                OE_WARN << LC << "Cannot write camera path to \"" << recordFile << "\"" << std::endl;
+            }
+        }
     }
     else
     {
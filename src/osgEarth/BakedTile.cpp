@@ -0,0 +1,225 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/BakedTile>
+#include <osgEarth/MapFrame>
+#include <osgEarth/ImageLayer>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/GeoCommon>
+#include <osgEarth/StringUtils>
+#include <osg/Geode>
+#include <osg/Texture2D>
+#include <cfloat>
+#include <cstdio>
+#include <iomanip>
+
+#define LC "[BakedTile] "
+
+using namespace osgEarth;
+
+// names of the record's nodes:
+#define TILE_NAME      "baked_tile"
+#define ELEVATION_NAME "__elevation"
+
+// quantized value marking a sample with no data:
+#define QUANTIZED_NO_DATA 65535
+
+const char* BakedTile::BIN_ID = "baked_tiles";
+
+//------------------------------------------------------------------------
+
+BakedTile::BakedTile( const TileKey& key ) :
+_key       ( key ),
+_hfFallback( false )
+{
+    //nop
+}
+
+BakedTile*
+BakedTile::create(const MapFrame&   mapf,
+                  const TileKey&    key,
+                  ProgressCallback* progress)
+{
+    osg::ref_ptr<BakedTile> tile = new BakedTile( key );
+    bool hasRealData = false;
+
+    for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); ++i )
+    {
+        ImageLayer* layer = i->get();
+        if ( !layer->getEnabled() )
+            continue;
+
+        GeoImage image = layer->createImage( key, progress );
+        if ( image.valid() )
+        {
+            Layer baked;
+            baked._name  = layer->getName();
+            baked._image = image.getImage();
+            tile->_layers.push_back( baked );
+            hasRealData = true;
+        }
+    }
+
+    osg::ref_ptr<osg::HeightField> hf;
+    bool isFallback = false;
+    if ( mapf.getHeightField(key, true, hf, &isFallback, true, SAMPLE_FIRST_VALID, progress) )
+    {
+        tile->setHeightField( hf.get(), isFallback );
+        if ( !isFallback )
+            hasRealData = true;
+    }
+
+    return hasRealData ? tile.release() : 0L;
+}
+
+void
+BakedTile::setHeightField( osg::HeightField* hf, bool isFallback )
+{
+    _hf         = hf;
+    _hfFallback = isFallback;
+}
+
+osg::Image*
+BakedTile::getImage( const std::string& layerName ) const
+{
+    for( Layers::const_iterator i = _layers.begin(); i != _layers.end(); ++i )
+    {
+        if ( i->_name == layerName )
+            return i->_image.get();
+    }
+    return 0L;
+}
+
+osg::Node*
+BakedTile::toNode() const
+{
+    osg::Group* root = new osg::Group();
+    root->setName( TILE_NAME );
+
+    for( Layers::const_iterator i = _layers.begin(); i != _layers.end(); ++i )
+    {
+        if ( !i->_image.valid() )
+            continue;
+
+        // serialize the pixels, not a reference to the image's source file.
+        i->_image->setWriteHint( osg::Image::STORE_INLINE );
+
+        osg::Geode* geode = new osg::Geode();
+        geode->setName( i->_name );
+        geode->getOrCreateStateSet()->setTextureAttribute( 0, new osg::Texture2D(i->_image.get()) );
+        root->addChild( geode );
+    }
+
+    if ( _hf.valid() )
+    {
+        const osg::FloatArray* heights = _hf->getFloatArray();
+
+        float minH = FLT_MAX, maxH = -FLT_MAX;
+        for( osg::FloatArray::const_iterator h = heights->begin(); h != heights->end(); ++h )
+        {
+            if ( *h == NO_DATA_VALUE ) continue;
+            minH = osg::minimum( minH, *h );
+            maxH = osg::maximum( maxH, *h );
+        }
+        if ( minH > maxH )
+            minH = maxH = 0.0f;
+
+        // 65534 steps between the lowest and highest samples.
+        double scale = maxH > minH ? ((double)maxH - (double)minH) / (double)(QUANTIZED_NO_DATA-1) : 1.0;
+
+        osg::Image* image = new osg::Image();
+        image->allocateImage( _hf->getNumColumns(), _hf->getNumRows(), 1, GL_LUMINANCE, GL_UNSIGNED_SHORT );
+        image->setInternalTextureFormat( GL_LUMINANCE16 );
+        image->setWriteHint( osg::Image::STORE_INLINE );
+
+        unsigned short* q = (unsigned short*)image->data();
+        for( osg::FloatArray::const_iterator h = heights->begin(); h != heights->end(); ++h, ++q )
+        {
+            *q = *h == NO_DATA_VALUE ?
+                (unsigned short)QUANTIZED_NO_DATA :
+                (unsigned short)osg::minimum( ((double)*h - (double)minH) / scale + 0.5, (double)(QUANTIZED_NO_DATA-1) );
+        }
+
+        osg::Geode* geode = new osg::Geode();
+        geode->setName( ELEVATION_NAME );
+        geode->addDescription( Stringify() << std::setprecision(12) << "offset " << minH );
+        geode->addDescription( Stringify() << std::setprecision(12) << "scale " << scale );
+        geode->addDescription( Stringify() << "fallback " << (_hfFallback ? 1 : 0) );
+        geode->getOrCreateStateSet()->setTextureAttribute( 0, new osg::Texture2D(image) );
+        root->addChild( geode );
+    }
+
+    return root;
+}
+
+BakedTile*
+BakedTile::fromNode( const TileKey& key, const osg::Node* node )
+{
+    const osg::Group* root = node ? node->asGroup() : 0L;
+    if ( !root || root->getName() != TILE_NAME )
+        return 0L;
+
+    osg::ref_ptr<BakedTile> tile = new BakedTile( key );
+
+    for( unsigned c = 0; c < root->getNumChildren(); ++c )
+    {
+        const osg::Node*     child = root->getChild( c );
+        const osg::StateSet* ss    = child->getStateSet();
+        const osg::Texture*  tex   = ss ? dynamic_cast<const osg::Texture*>( ss->getTextureAttribute(0, osg::StateAttribute::TEXTURE) ) : 0L;
+        osg::Image*          image = tex ? const_cast<osg::Texture*>( tex )->getImage( 0 ) : 0L;
+        if ( !image )
+            continue;
+
+        if ( child->getName() != ELEVATION_NAME )
+        {
+            Layer baked;
+            baked._name  = child->getName();
+            baked._image = image;
+            tile->_layers.push_back( baked );
+            continue;
+        }
+
+        if ( image->getDataType() != GL_UNSIGNED_SHORT )
+        {
+            OE_WARN << LC << "Unsupported heightfield format in baked tile " << key.str() << std::endl;
+            continue;
+        }
+
+        double offset = 0.0, scale = 1.0;
+        int    fallback = 0;
+        for( unsigned d = 0; d < child->getNumDescriptions(); ++d )
+        {
+            const std::string& desc = child->getDescription( d );
+            ::sscanf( desc.c_str(), "offset %lf", &offset );
+            ::sscanf( desc.c_str(), "scale %lf", &scale );
+            ::sscanf( desc.c_str(), "fallback %d", &fallback );
+        }
+
+        osg::HeightField* hf = HeightFieldUtils::createReferenceHeightField( key.getExtent(), image->s(), image->t() );
+        osg::FloatArray* heights = hf->getFloatArray();
+        const unsigned short* q = (const unsigned short*)image->data();
+        for( osg::FloatArray::iterator h = heights->begin(); h != heights->end(); ++h, ++q )
+        {
+            *h = *q == QUANTIZED_NO_DATA ? NO_DATA_VALUE : (float)(offset + scale * (double)*q);
+        }
+
+        tile->setHeightField( hf, fallback != 0 );
+    }
+
+    return tile.release();
+}
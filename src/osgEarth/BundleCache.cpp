@@ -0,0 +1,200 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/BundleCache>
+#include <osgEarth/CachePolicy>
+#include <osgEarth/Registry>
+#include <osgEarth/URI>
+#include <osgDB/Registry>
+#include <sstream>
+
+using namespace osgEarth;
+
+#define LC "[BundleCache] "
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    /**
+     * Read-only bin backed by one bin of a cache bundle.
+     */
+    struct BundleCacheBin : public CacheBin
+    {
+        BundleCacheBin( const std::string& id, CacheBundle* bundle )
+            : CacheBin( id ),
+              _bundle ( bundle )
+        {
+            _rw = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+            _rwOptions = Registry::instance()->cloneOrCreateOptions();
+            CachePolicy::NO_CACHE.apply( _rwOptions.get() );
+        }
+
+        enum Type { TYPE_OBJECT, TYPE_IMAGE, TYPE_NODE };
+
+        ReadResult readObject( const std::string& key, double maxAge ) { return countedRead(key, maxAge, TYPE_OBJECT); }
+        ReadResult readImage ( const std::string& key, double maxAge ) { return countedRead(key, maxAge, TYPE_IMAGE); }
+        ReadResult readNode  ( const std::string& key, double maxAge ) { return countedRead(key, maxAge, TYPE_NODE); }
+
+        ReadResult readString( const std::string& key, double maxAge )
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            ReadResult r = read( key, maxAge, TYPE_OBJECT );
+            bool usable = r.succeeded() || r.code() == ReadResult::RESULT_EXPIRED;
+            return countRead( usable && r.get<StringObject>() ? r : ReadResult(), start );
+        }
+
+        ReadResult countedRead( const std::string& key, double maxAge, Type type )
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            return countRead( read(key, maxAge, type), start );
+        }
+
+        ReadResult read( const std::string& key, double maxAge, Type type )
+        {
+            if ( !_rw.valid() ) return ReadResult();
+
+            CacheBundle::Type recordType;
+            std::string       metaString, data;
+            ::time_t          timestamp;
+            if ( !_bundle->read( getID(), key, recordType, metaString, data, timestamp ) )
+                return ReadResult();
+
+            // an image record can only be read back as an image, and so on;
+            // objects are read with whichever reader matches the record.
+            if ( type != TYPE_OBJECT && (int)recordType != (int)type )
+                return ReadResult();
+
+            std::istringstream in( data );
+            osgDB::ReaderWriter::ReadResult r =
+                recordType == CacheBundle::TYPE_IMAGE ? _rw->readImage( in, _rwOptions.get() ) :
+                recordType == CacheBundle::TYPE_NODE  ? _rw->readNode( in, _rwOptions.get() ) :
+                                                        _rw->readObject( in, _rwOptions.get() );
+            if ( !r.success() )
+                return ReadResult();
+
+            Config meta;
+            if ( !metaString.empty() )
+                meta.fromJSON( metaString );
+
+            osg::Object* object =
+                recordType == CacheBundle::TYPE_IMAGE ? (osg::Object*)r.getImage() :
+                recordType == CacheBundle::TYPE_NODE  ? (osg::Object*)r.getNode() :
+                                                        r.getObject();
+
+            if ( maxAge < DBL_MAX && (double)(::time(0L) - timestamp) > maxAge )
+                return ReadResult( ReadResult::RESULT_EXPIRED, object, meta );
+
+            return ReadResult( object, meta );
+        }
+
+        bool write( const std::string& key, const osg::Object* object, const Config& meta )
+        {
+            return false;
+        }
+
+        bool isCached( const std::string& key, double maxAge )
+        {
+            ::time_t timestamp;
+            if ( !_bundle->contains( getID(), key, timestamp ) )
+                return false;
+
+            return maxAge >= DBL_MAX || (double)(::time(0L) - timestamp) <= maxAge;
+        }
+
+        bool purge()
+        {
+            return false;
+        }
+
+        bool getKeys( std::vector<std::string>& out_keys )
+        {
+            _bundle->getKeys( getID(), out_keys );
+            return true;
+        }
+
+        Config readMetadata()
+        {
+            return _bundle->getMetadata( getID() );
+        }
+
+        osg::ref_ptr<CacheBundle>         _bundle;
+        osg::ref_ptr<osgDB::ReaderWriter> _rw;
+        osg::ref_ptr<osgDB::Options>      _rwOptions;
+    };
+}
+
+//------------------------------------------------------------------------
+
+BundleCache::BundleCache( const BundleCacheOptions& options ) :
+Cache( options )
+{
+    if ( options.path().isSet() )
+    {
+        _bundle = new CacheBundle( URI(*options.path(), options.referrer()).full() );
+    }
+    else
+    {
+        OE_WARN << LC << "No bundle path specified" << std::endl;
+    }
+
+    init();
+}
+
+BundleCache::BundleCache( CacheBundle* bundle, const BundleCacheOptions& options ) :
+Cache  ( options ),
+_bundle( bundle )
+{
+    init();
+}
+
+void
+BundleCache::init()
+{
+    if ( !_bundle.valid() || !_bundle->isOpen() )
+    {
+        OE_WARN << LC << "Failed to open cache bundle" << std::endl;
+        _ok = false;
+    }
+}
+
+CacheBin*
+BundleCache::addBin( const std::string& binID )
+{
+    if ( !_ok ) return 0L;
+
+    CacheBin* bin = _bins.get( binID );
+    return bin ? bin : _bins.getOrCreate( binID, new BundleCacheBin(binID, _bundle.get()) );
+}
+
+CacheBin*
+BundleCache::getOrCreateDefaultBin()
+{
+    if ( !_ok ) return 0L;
+
+    static Threading::Mutex s_defaultBinMutex;
+    if ( !_defaultBin.valid() )
+    {
+        Threading::ScopedMutexLock lock( s_defaultBinMutex );
+        if ( !_defaultBin.valid() ) // double-check
+        {
+            _defaultBin = new BundleCacheBin( "__default", _bundle.get() );
+        }
+    }
+    return _defaultBin.get();
+}
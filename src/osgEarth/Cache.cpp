@@ -18,6 +18,8 @@
  */
 #include <osgEarth/Cache>
 #include <osgEarth/Registry>
+#include <osgEarth/TieredCache>
+#include <osgEarth/BundleCache>
 #include <osgEarth/ThreadingUtils>
 
 #include <osgDB/FileNameUtils>
@@ -59,6 +61,20 @@ Cache::removeBin( CacheBin* bin )
     _bins.remove( bin );
 }
 
+CacheBin::Stats
+Cache::getStats() const
+{
+    std::vector< osg::ref_ptr<CacheBin> > bins;
+    const_cast<Cache*>(this)->_bins.getValues( bins );
+    if ( _defaultBin.valid() )
+        bins.push_back( _defaultBin.get() );
+
+    CacheBin::Stats total;
+    for( unsigned i = 0; i < bins.size(); ++i )
+        total += bins[i]->getStats();
+    return total;
+}
+
 //------------------------------------------------------------------------
 
 #undef  LC
@@ -79,6 +95,14 @@ CacheFactory::create( const CacheOptions& options )
     {
         OE_WARN << LC << "Sorry, but TMS caching is no longer supported; try \"filesystem\" instead" << std::endl;
     }
+    else if ( options.getDriver() == "tiered" )
+    {
+        result = new TieredCache( TieredCacheOptions(options) );
+    }
+    else if ( options.getDriver() == "bundle" )
+    {
+        result = new BundleCache( BundleCacheOptions(options) );
+    }
 //    else if ( options.getDriver() == "tilecache" )
 //    {
 ////        result = new DiskCache( options );
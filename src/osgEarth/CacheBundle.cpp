@@ -0,0 +1,669 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/CacheBundle>
+#include <osgEarth/Profile>
+#include <osgEarth/TileKey>
+#include <osgEarth/StringUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/CachePolicy>
+#include <osgDB/Registry>
+#include <osgDB/FileUtils>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#   include <io.h>
+#else
+#   include <unistd.h>
+#endif
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+
+#define LC "[CacheBundle] "
+
+// Layout of a bundle file:
+//   header  - magic, version
+//   records - data bytes followed by metadata (JSON) bytes, back to back
+//   index   - for each bin: ID, metadata and entries (key, offset, lengths, type, time)
+//   trailer - offset of the index, magic
+#define BUNDLE_MAGIC   "OECB"
+#define BUNDLE_VERSION 1u
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    struct Header
+    {
+        char     _magic[4];
+        unsigned _version;
+    };
+
+    struct Trailer
+    {
+        unsigned long long _indexOffset;
+        char               _magic[4];
+        unsigned           _reserved;
+    };
+
+    // Fixed part of an index entry; preceded by the key length and key.
+    struct IndexRecord
+    {
+        unsigned long long _offset;
+        unsigned           _metaLen;
+        unsigned           _dataLen;
+        unsigned           _type;
+        unsigned           _reserved;
+        long long          _timestamp;
+    };
+
+    // Reads exactly "len" bytes at "offset". Without pread, the seek and the
+    // read must happen together, so they go under the caller's mutex.
+    bool readAt( int fd, char* buf, unsigned len, unsigned long long offset, Threading::Mutex& mutex )
+    {
+#ifdef _WIN32
+        Threading::ScopedMutexLock lock( mutex );
+        if ( ::_lseeki64( fd, (__int64)offset, SEEK_SET ) < 0 )
+            return false;
+        unsigned done = 0;
+        while( done < len )
+        {
+            int n = ::_read( fd, buf+done, len-done );
+            if ( n <= 0 ) return false;
+            done += (unsigned)n;
+        }
+        return true;
+#else
+        unsigned done = 0;
+        while( done < len )
+        {
+            ssize_t n = ::pread( fd, buf+done, len-done, (off_t)(offset+done) );
+            if ( n <= 0 ) return false;
+            done += (unsigned)n;
+        }
+        return true;
+#endif
+    }
+
+    // sequential reader over the in-memory index block.
+    struct IndexReader
+    {
+        IndexReader( const std::vector<char>& buf ) : _buf(buf), _pos(0), _ok(true) { }
+
+        bool get( void* out, unsigned len )
+        {
+            if ( !_ok || _pos + len > _buf.size() ) { _ok = false; return false; }
+            if ( len > 0 ) ::memcpy( out, &_buf[_pos], len );
+            _pos += len;
+            return true;
+        }
+
+        bool getString( std::string& out )
+        {
+            unsigned len = 0;
+            if ( !get(&len, sizeof(len)) || _pos + len > _buf.size() ) { _ok = false; return false; }
+            out.assign( len > 0 ? &_buf[_pos] : "", len );
+            _pos += len;
+            return true;
+        }
+
+        const std::vector<char>& _buf;
+        size_t                   _pos;
+        bool                     _ok;
+    };
+
+    void putString( std::ostream& out, const std::string& s )
+    {
+        unsigned len = s.size();
+        out.write( reinterpret_cast<const char*>(&len), sizeof(len) );
+        out.write( s.data(), len );
+    }
+
+    // parses a tile key string of the form "lod/x/y".
+    bool parseTileKey( const std::string& key, unsigned& lod, unsigned& x, unsigned& y )
+    {
+        char extra;
+        return ::sscanf( key.c_str(), "%u/%u/%u%c", &lod, &x, &y, &extra ) == 3;
+    }
+}
+
+//------------------------------------------------------------------------
+
+CacheBundle::CacheBundle( const std::string& path ) :
+_path( path ),
+_fd  ( -1 ),
+_size( 0 )
+{
+#ifdef _WIN32
+    _fd = ::_open( _path.c_str(), _O_RDONLY | _O_BINARY );
+#else
+    _fd = ::open( _path.c_str(), O_RDONLY );
+#endif
+
+    if ( _fd < 0 )
+    {
+        OE_WARN << LC << "Cannot open bundle \"" << _path << "\"" << std::endl;
+        return;
+    }
+
+    if ( !loadIndex() )
+    {
+        OE_WARN << LC << "Bundle \"" << _path << "\" is incomplete or corrupt" << std::endl;
+#ifdef _WIN32
+        ::_close( _fd );
+#else
+        ::close( _fd );
+#endif
+        _fd = -1;
+        _bins.clear();
+        return;
+    }
+
+    OE_INFO << LC << "Opened bundle \"" << _path << "\" with " << getNumRecords()
+        << " records in " << _bins.size() << " bins" << std::endl;
+}
+
+CacheBundle::~CacheBundle()
+{
+    if ( _fd >= 0 )
+    {
+#ifdef _WIN32
+        ::_close( _fd );
+#else
+        ::close( _fd );
+#endif
+    }
+}
+
+bool
+CacheBundle::loadIndex()
+{
+#ifdef _WIN32
+    __int64 size = ::_lseeki64( _fd, 0, SEEK_END );
+#else
+    off_t size = ::lseek( _fd, 0, SEEK_END );
+#endif
+    if ( size < (long long)(sizeof(Header) + sizeof(Trailer)) )
+        return false;
+    _size = (unsigned long long)size;
+
+    Header header;
+    if ( !readAt(_fd, reinterpret_cast<char*>(&header), sizeof(header), 0, _ioMutex) ||
+         ::memcmp(header._magic, BUNDLE_MAGIC, 4) != 0 )
+        return false;
+
+    if ( header._version != BUNDLE_VERSION )
+    {
+        OE_WARN << LC << "Unsupported bundle version " << header._version << std::endl;
+        return false;
+    }
+
+    Trailer trailer;
+    if ( !readAt(_fd, reinterpret_cast<char*>(&trailer), sizeof(trailer), _size - sizeof(trailer), _ioMutex) ||
+         ::memcmp(trailer._magic, BUNDLE_MAGIC, 4) != 0 ||
+         trailer._indexOffset < sizeof(Header) ||
+         trailer._indexOffset > _size - sizeof(trailer) )
+        return false;
+
+    unsigned long long indexLen = _size - sizeof(trailer) - trailer._indexOffset;
+    std::vector<char> buf( (size_t)indexLen );
+    if ( indexLen > 0 && !readAt(_fd, &buf[0], (unsigned)indexLen, trailer._indexOffset, _ioMutex) )
+        return false;
+
+    IndexReader in( buf );
+    unsigned numBins = 0;
+    in.get( &numBins, sizeof(numBins) );
+
+    for( unsigned b = 0; b < numBins && in._ok; ++b )
+    {
+        std::string binID, metaString;
+        in.getString( binID );
+        in.getString( metaString );
+
+        Bin& bin = _bins[binID];
+        if ( !metaString.empty() )
+            bin._metadata.fromJSON( metaString );
+
+        unsigned numEntries = 0;
+        in.get( &numEntries, sizeof(numEntries) );
+
+        for( unsigned e = 0; e < numEntries && in._ok; ++e )
+        {
+            std::string key;
+            IndexRecord rec;
+            in.getString( key );
+            if ( !in.get(&rec, sizeof(rec)) )
+                break;
+
+            if ( rec._offset + rec._dataLen + rec._metaLen > trailer._indexOffset )
+                return false;
+
+            Entry& entry     = bin._entries[key];
+            entry._offset    = rec._offset;
+            entry._metaLen   = rec._metaLen;
+            entry._dataLen   = rec._dataLen;
+            entry._type      = rec._type;
+            entry._timestamp = (::time_t)rec._timestamp;
+        }
+    }
+
+    return in._ok;
+}
+
+void
+CacheBundle::getBinIDs( std::vector<std::string>& out_binIDs ) const
+{
+    for( Bins::const_iterator i = _bins.begin(); i != _bins.end(); ++i )
+        out_binIDs.push_back( i->first );
+}
+
+bool
+CacheBundle::getKeys( const std::string& binID, std::vector<std::string>& out_keys ) const
+{
+    Bins::const_iterator b = _bins.find( binID );
+    if ( b == _bins.end() )
+        return false;
+
+    out_keys.reserve( out_keys.size() + b->second._entries.size() );
+    for( Entries::const_iterator i = b->second._entries.begin(); i != b->second._entries.end(); ++i )
+        out_keys.push_back( i->first );
+    return true;
+}
+
+Config
+CacheBundle::getMetadata( const std::string& binID ) const
+{
+    Bins::const_iterator b = _bins.find( binID );
+    return b != _bins.end() ? b->second._metadata : Config();
+}
+
+bool
+CacheBundle::contains( const std::string& binID, const std::string& key, ::time_t& out_timestamp ) const
+{
+    Bins::const_iterator b = _bins.find( binID );
+    if ( b == _bins.end() )
+        return false;
+
+    Entries::const_iterator i = b->second._entries.find( key );
+    if ( i == b->second._entries.end() )
+        return false;
+
+    out_timestamp = i->second._timestamp;
+    return true;
+}
+
+bool
+CacheBundle::read(const std::string& binID,
+                  const std::string& key,
+                  Type&              out_type,
+                  std::string&       out_meta,
+                  std::string&       out_data,
+                  ::time_t&          out_timestamp) const
+{
+    if ( _fd < 0 ) return false;
+
+    // the index never changes after open, so lookups need no lock.
+    Bins::const_iterator b = _bins.find( binID );
+    if ( b == _bins.end() )
+        return false;
+
+    Entries::const_iterator i = b->second._entries.find( key );
+    if ( i == b->second._entries.end() )
+        return false;
+
+    const Entry& entry = i->second;
+    std::vector<char> buf( entry._dataLen + entry._metaLen );
+    if ( !buf.empty() && !readAt(_fd, &buf[0], buf.size(), entry._offset, _ioMutex) )
+    {
+        OE_WARN << LC << "FAILED to read record \"" << key << "\" from " << _path << std::endl;
+        return false;
+    }
+
+    out_type      = (Type)entry._type;
+    out_data.assign( buf.empty() ? "" : &buf[0], entry._dataLen );
+    out_meta.assign( buf.empty() ? "" : &buf[entry._dataLen], entry._metaLen );
+    out_timestamp = entry._timestamp;
+    return true;
+}
+
+unsigned
+CacheBundle::getNumRecords() const
+{
+    unsigned count = 0;
+    for( Bins::const_iterator i = _bins.begin(); i != _bins.end(); ++i )
+        count += i->second._entries.size();
+    return count;
+}
+
+unsigned
+CacheBundle::importTo( Cache* cache, ProgressCallback* progress ) const
+{
+    if ( !cache || _fd < 0 )
+        return 0;
+
+    osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+    if ( !rw )
+    {
+        OE_WARN << LC << "No osgb plugin; cannot import " << _path << std::endl;
+        return 0;
+    }
+
+    osg::ref_ptr<osgDB::Options> rwOptions = Registry::instance()->cloneOrCreateOptions();
+    CachePolicy::NO_CACHE.apply( rwOptions.get() );
+
+    unsigned total = getNumRecords();
+    unsigned done = 0, copied = 0;
+
+    for( Bins::const_iterator b = _bins.begin(); b != _bins.end(); ++b )
+    {
+        CacheBin* bin = cache->addBin( b->first );
+        if ( !bin )
+        {
+            OE_WARN << LC << "Cannot create bin \"" << b->first << "\" for import" << std::endl;
+            done += b->second._entries.size();
+            continue;
+        }
+
+        if ( !b->second._metadata.empty() )
+            bin->writeMetadata( b->second._metadata );
+
+        for( Entries::const_iterator i = b->second._entries.begin(); i != b->second._entries.end(); ++i, ++done )
+        {
+            Type        type;
+            std::string metaString, data;
+            ::time_t    timestamp;
+            if ( !read(b->first, i->first, type, metaString, data, timestamp) )
+                continue;
+
+            std::istringstream in( data );
+            osgDB::ReaderWriter::ReadResult r =
+                type == TYPE_IMAGE ? rw->readImage( in, rwOptions.get() ) :
+                type == TYPE_NODE  ? rw->readNode( in, rwOptions.get() ) :
+                                     rw->readObject( in, rwOptions.get() );
+            if ( !r.success() )
+                continue;
+
+            Config meta;
+            if ( !metaString.empty() )
+                meta.fromJSON( metaString );
+
+            osg::Object* object =
+                type == TYPE_IMAGE ? (osg::Object*)r.getImage() :
+                type == TYPE_NODE  ? (osg::Object*)r.getNode() :
+                                     r.getObject();
+
+            if ( bin->write(i->first, object, meta) )
+                ++copied;
+
+            if ( progress && progress->reportProgress(done+1, total, "Importing " + b->first) )
+                return copied;
+        }
+    }
+
+    return copied;
+}
+
+//------------------------------------------------------------------------
+
+CacheBundleWriter::CacheBundleWriter( const std::string& path ) :
+_path  ( path ),
+_offset( 0 ),
+_failed( false )
+{
+    osgDB::makeDirectoryForFile( _path );
+    _out.open( _path.c_str(), std::ios::binary | std::ios::trunc );
+    if ( !_out.is_open() )
+    {
+        OE_WARN << LC << "Cannot create bundle \"" << _path << "\"" << std::endl;
+        return;
+    }
+
+    Header header;
+    ::memcpy( header._magic, BUNDLE_MAGIC, 4 );
+    header._version = BUNDLE_VERSION;
+    _out.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+    _offset = sizeof(header);
+
+    _rw = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+    _rwOptions = Registry::instance()->cloneOrCreateOptions();
+    _rwOptions->setOptionString( "Compressor=zlib" );
+    CachePolicy::NO_CACHE.apply( _rwOptions.get() );
+}
+
+CacheBundleWriter::~CacheBundleWriter()
+{
+    if ( _out.is_open() )
+    {
+        OE_WARN << LC << "Bundle \"" << _path << "\" was not closed; it will be unreadable" << std::endl;
+        _out.close();
+    }
+}
+
+bool
+CacheBundleWriter::write(const std::string& binID,
+                         const std::string& key,
+                         const osg::Object* object,
+                         const Config&      meta,
+                         ::time_t           timestamp)
+{
+    if ( !isOpen() || !object || !_rw.valid() )
+        return false;
+
+    std::ostringstream buf;
+    osgDB::ReaderWriter::WriteResult r;
+    CacheBundle::Type type;
+
+    if ( dynamic_cast<const osg::Image*>(object) )
+    {
+        r = _rw->writeImage( *static_cast<const osg::Image*>(object), buf, _rwOptions.get() );
+        type = CacheBundle::TYPE_IMAGE;
+    }
+    else if ( dynamic_cast<const osg::Node*>(object) )
+    {
+        r = _rw->writeNode( *static_cast<const osg::Node*>(object), buf, _rwOptions.get() );
+        type = CacheBundle::TYPE_NODE;
+    }
+    else
+    {
+        r = _rw->writeObject( *object, buf, _rwOptions.get() );
+        type = CacheBundle::TYPE_OBJECT;
+    }
+
+    if ( !r.success() )
+    {
+        OE_WARN << LC << "FAILED to serialize \"" << key << "\" from bin " << binID << std::endl;
+        return false;
+    }
+
+    std::string data = buf.str();
+    std::string metaString = meta.empty() ? "" : meta.toJSON();
+
+    _out.write( data.data(), data.size() );
+    _out.write( metaString.data(), metaString.size() );
+    if ( _out.fail() )
+    {
+        OE_WARN << LC << "FAILED to write to bundle \"" << _path << "\"" << std::endl;
+        _failed = true;
+        return false;
+    }
+
+    CacheBundle::Entry& entry = _bins[binID]._entries[key];
+    entry._offset    = _offset;
+    entry._dataLen   = data.size();
+    entry._metaLen   = metaString.size();
+    entry._type      = type;
+    entry._timestamp = timestamp != 0 ? timestamp : ::time(0L);
+
+    _offset += data.size() + metaString.size();
+    return true;
+}
+
+void
+CacheBundleWriter::setMetadata( const std::string& binID, const Config& meta )
+{
+    _bins[binID]._metadata = meta;
+}
+
+unsigned
+CacheBundleWriter::exportBin(CacheBin*                     bin,
+                             const Profile*                profile,
+                             const std::vector<GeoExtent>& extents,
+                             unsigned                      minLevel,
+                             unsigned                      maxLevel,
+                             ProgressCallback*             progress)
+{
+    if ( !bin || !isOpen() )
+        return 0;
+
+    std::vector<std::string> keys;
+    if ( !bin->getKeys(keys) )
+    {
+        OE_WARN << LC << "Cache bin " << bin->getID() << " cannot list its records; it cannot be exported" << std::endl;
+        return 0;
+    }
+
+    bool whole = extents.empty() && minLevel == 0 && maxLevel == ~0u;
+
+    // bring the extents into the bin's tiling SRS once.
+    std::vector<GeoExtent> localExtents;
+    if ( !extents.empty() )
+    {
+        if ( !profile )
+        {
+            OE_WARN << LC << "Exporting cache bin " << bin->getID() << " by extent requires its profile" << std::endl;
+            return 0;
+        }
+        for( std::vector<GeoExtent>::const_iterator i = extents.begin(); i != extents.end(); ++i )
+        {
+            GeoExtent e = profile->clampAndTransformExtent( *i );
+            if ( e.isValid() )
+                localExtents.push_back( e );
+        }
+    }
+
+    setMetadata( bin->getID(), bin->readMetadata() );
+
+    unsigned copied = 0;
+    for( unsigned k = 0; k < keys.size(); ++k )
+    {
+        const std::string& key = keys[k];
+
+        if ( !whole )
+        {
+            unsigned lod, x, y;
+            if ( !parseTileKey(key, lod, x, y) || lod < minLevel || lod > maxLevel )
+                continue;
+
+            if ( !localExtents.empty() )
+            {
+                GeoExtent tileExtent = TileKey( lod, x, y, profile ).getExtent();
+                bool hit = false;
+                for( unsigned e = 0; e < localExtents.size() && !hit; ++e )
+                    hit = localExtents[e].intersects( tileExtent );
+                if ( !hit )
+                    continue;
+            }
+        }
+
+        // the bin doesn't say what type a record is; the image reader rejects
+        // anything else by its header, so try it first.
+        ReadResult r = bin->readImage( key );
+        if ( r.empty() )
+            r = bin->readObject( key );
+
+        if ( r.getObject() && write(bin->getID(), key, r.getObject(), r.metadata()) )
+            ++copied;
+
+        if ( progress && progress->reportProgress(k+1, keys.size(), "Exporting " + bin->getID()) )
+            break;
+    }
+
+    OE_INFO << LC << "Exported " << copied << " records from cache bin " << bin->getID() << std::endl;
+    return copied;
+}
+
+unsigned
+CacheBundleWriter::getNumRecords() const
+{
+    unsigned count = 0;
+    for( CacheBundle::Bins::const_iterator i = _bins.begin(); i != _bins.end(); ++i )
+        count += i->second._entries.size();
+    return count;
+}
+
+bool
+CacheBundleWriter::close()
+{
+    if ( !_out.is_open() )
+        return false;
+
+    unsigned long long indexOffset = _offset;
+
+    unsigned numBins = _bins.size();
+    _out.write( reinterpret_cast<const char*>(&numBins), sizeof(numBins) );
+
+    for( CacheBundle::Bins::const_iterator b = _bins.begin(); b != _bins.end(); ++b )
+    {
+        putString( _out, b->first );
+        putString( _out, b->second._metadata.empty() ? "" : b->second._metadata.toJSON() );
+
+        unsigned numEntries = b->second._entries.size();
+        _out.write( reinterpret_cast<const char*>(&numEntries), sizeof(numEntries) );
+
+        for( CacheBundle::Entries::const_iterator i = b->second._entries.begin(); i != b->second._entries.end(); ++i )
+        {
+            IndexRecord rec;
+            rec._offset    = i->second._offset;
+            rec._metaLen   = i->second._metaLen;
+            rec._dataLen   = i->second._dataLen;
+            rec._type      = i->second._type;
+            rec._reserved  = 0;
+            rec._timestamp = (long long)i->second._timestamp;
+
+            putString( _out, i->first );
+            _out.write( reinterpret_cast<const char*>(&rec), sizeof(rec) );
+        }
+    }
+
+    Trailer trailer;
+    trailer._indexOffset = indexOffset;
+    ::memcpy( trailer._magic, BUNDLE_MAGIC, 4 );
+    trailer._reserved = 0;
+    _out.write( reinterpret_cast<const char*>(&trailer), sizeof(trailer) );
+
+    _out.flush();
+    bool ok = !_out.fail() && !_failed;
+    _out.close();
+
+    if ( ok )
+    {
+        OE_INFO << LC << "Wrote bundle \"" << _path << "\" with " << getNumRecords() << " records" << std::endl;
+    }
+    else
+    {
+        OE_WARN << LC << "FAILED to write bundle \"" << _path << "\"" << std::endl;
+        ::remove( _path.c_str() );
+    }
+    return ok;
+}
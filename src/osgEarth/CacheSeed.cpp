@@ -19,17 +19,152 @@
 
 #include <osgEarth/CacheSeed>
 #include <osgEarth/MapFrame>
+#include <osgEarth/TaskService>
 #include <OpenThreads/ScopedLock>
+#include <osgDB/FileUtils>
+#include <osgDB/Registry>
 #include <limits.h>
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
 
 #define LC "[CacheSeed] "
 
 using namespace osgEarth;
 using namespace OpenThreads;
 
+namespace
+{
+    /** Fetches one tile from one layer; the layer writes it to its cache. */
+    struct SeedTile
+    {
+        SeedTile() : _index(0), _gotData(false) { }
+
+        void execute()
+        {
+            if ( _imageLayer.valid() )
+                _gotData = _imageLayer->createImage( _key ).valid();
+            else if ( _elevationLayer.valid() )
+                _gotData = _elevationLayer->createHeightField( _key ).valid();
+        }
+
+        osg::ref_ptr<ImageLayer>     _imageLayer;
+        osg::ref_ptr<ElevationLayer> _elevationLayer;
+        TileKey                      _key;
+        unsigned                     _index;  // position of _key in its batch
+        bool                         _gotData;
+    };
+
+    typedef ParallelTask<SeedTile> SeedTileTask;
+
+    std::string formatTime( double seconds )
+    {
+        unsigned s = (unsigned)(seconds + 0.5);
+        std::stringstream buf;
+        if ( s >= 3600 )
+            buf << (s/3600) << "h ";
+        if ( s >= 60 )
+            buf << ((s/60)%60) << "m ";
+        buf << (s%60) << "s";
+        return buf.str();
+    }
+
+    /** Inclusive range of tile columns and rows at one level */
+    struct TileRect
+    {
+        unsigned _x0, _y0, _x1, _y1;
+    };
+
+    /** Part of the seed area in which a layer has data, in map coordinates */
+    struct LayerRegion
+    {
+        GeoExtent          _extent;
+        optional<unsigned> _minLevel, _maxLevel;
+    };
+
+    bool getTileRect( const Profile* profile, const GeoExtent& extent, unsigned lod, TileRect& out )
+    {
+        TileKey ll = profile->createTileKey( extent.xMin(), extent.yMin(), lod );
+        TileKey ur = profile->createTileKey( extent.xMax(), extent.yMax(), lod );
+        if ( !ll.valid() || !ur.valid() )
+            return false;
+
+        out._x0 = ll.getTileX();
+        out._x1 = ur.getTileX();
+        out._y0 = ur.getTileY();
+        out._y1 = ll.getTileY();
+        return out._x0 <= out._x1 && out._y0 <= out._y1;
+    }
+
+    /** Number of tiles covered by the union of overlapping rectangles. */
+    unsigned long long countTiles( const std::vector<TileRect>& rects )
+    {
+        // sweep the columns between rectangle edges, merging the rows covered in each.
+        std::vector<unsigned> xs;
+        for( unsigned i = 0; i < rects.size(); ++i )
+        {
+            xs.push_back( rects[i]._x0 );
+            xs.push_back( rects[i]._x1 + 1 );
+        }
+        std::sort( xs.begin(), xs.end() );
+        xs.erase( std::unique(xs.begin(), xs.end()), xs.end() );
+
+        unsigned long long count = 0;
+        for( unsigned i = 0; i + 1 < xs.size(); ++i )
+        {
+            std::vector< std::pair<unsigned, unsigned> > spans;
+            for( unsigned r = 0; r < rects.size(); ++r )
+            {
+                if ( rects[r]._x0 <= xs[i] && rects[r]._x1 >= xs[i] )
+                    spans.push_back( std::make_pair(rects[r]._y0, rects[r]._y1 + 1) );
+            }
+            if ( spans.empty() )
+                continue;
+
+            std::sort( spans.begin(), spans.end() );
+            unsigned long long rows = 0;
+            unsigned start = spans[0].first, end = spans[0].second;
+            for( unsigned k = 1; k < spans.size(); ++k )
+            {
+                if ( spans[k].first > end )
+                {
+                    rows += end - start;
+                    start = spans[k].first;
+                }
+                end = osg::maximum( end, spans[k].second );
+            }
+            rows += end - start;
+
+            count += rows * (unsigned long long)(xs[i+1] - xs[i]);
+        }
+        return count;
+    }
+
+    /** Size of an object as the file system cache would store it. */
+    unsigned getCachedSize( const osg::Object* object )
+    {
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+        if ( !rw )
+            return 0;
+
+        osg::ref_ptr<osgDB::Options> options = new osgDB::Options();
+        options->setOptionString( "Compressor=zlib" );
+
+        std::stringstream buf;
+        const osg::Image* image = dynamic_cast<const osg::Image*>( object );
+        osgDB::ReaderWriter::WriteResult r = image ?
+            rw->writeImage( *image, buf, options.get() ) :
+            rw->writeObject( *object, buf, options.get() );
+
+        return r.success() ? (unsigned)buf.str().size() : 0;
+    }
+}
+
 CacheSeed::CacheSeed():
 _minLevel (0),
 _maxLevel (12),
+_numThreads(0),
+_queueSize(256),
 _total    (0),
 _completed(0)
 {
@@ -264,10 +399,15 @@ void CacheSeed::seed( Map* map )
 
     OE_INFO << "Processing ~" << _total << " tiles" << std::endl;
 
-    for (unsigned int i = 0; i < keys.size(); ++i)
-    {
-        processKey( mapf, keys[i] );
-    }
+    if ( !_journalFile.empty() && !openJournal(map->getProfile()) )
+        return;
+
+    if ( _numThreads > 0 )
+        processKeysConcurrent( mapf, keys );
+    else
+        processKeys( mapf, keys );
+
+    closeJournal();
 
     _total = _completed;
 
@@ -281,90 +421,446 @@ void CacheSeed::incrementCompleted( unsigned int total ) const
 }
 
 void
-CacheSeed::processKey(const MapFrame& mapf, const TileKey& key ) const
+CacheSeed::processKeys(const MapFrame& mapf, const std::vector<TileKey>& keys ) const
 {
-    unsigned int x, y, lod;
-    key.getTileXY(x, y);
-    lod = key.getLevelOfDetail();
+    // sibling keys share a level, and get cached together so that the layers
+    // can batch their tile source requests.
+    std::vector<bool> gotData( keys.size(), true );
 
-    bool gotData = true;
+    std::vector<TileKey> keysToCache;
+    for (unsigned int i = 0; i < keys.size(); ++i)
+    {
+        unsigned int lod = keys[i].getLevelOfDetail();
+        if ( isJournaled(keys[i]) )
+            gotData[i] = false;
+        else if ( _minLevel <= lod && _maxLevel >= lod )
+            keysToCache.push_back( keys[i] );
+    }
 
-    if ( _minLevel <= lod && _maxLevel >= lod )
+    std::vector<bool> cached;
+    cacheTiles( mapf, keysToCache, cached );
+
+    for (unsigned int i = 0, c = 0; i < keys.size(); ++i)
     {
-        gotData = cacheTile( mapf, key );
-        if (gotData)
+        unsigned int lod = keys[i].getLevelOfDetail();
+        if ( _minLevel <= lod && _maxLevel >= lod && !isJournaled(keys[i]) )
         {
-        incrementCompleted( 1 );
+            gotData[i] = cached[c++];
+            if (gotData[i])
+            {
+                incrementCompleted( 1 );
+            }
+
+            if ( _progress.valid() && _progress->isCanceled() )
+                return; // Task has been cancelled by user
+
+            if ( _progress.valid() && gotData[i] && _progress->reportProgress(_completed, _total, std::string("Cached tile: ") + keys[i].str()) )
+                return; // Canceled
         }
+    }
 
-        if ( _progress.valid() && _progress->isCanceled() )
-            return; // Task has been cancelled by user
+    for (unsigned int i = 0; i < keys.size(); ++i)
+    {
+        const TileKey& key = keys[i];
+        unsigned int lod = key.getLevelOfDetail();
+
+        if ( gotData[i] && lod <= _maxLevel )
+        {
+            std::vector<TileKey> children( 4 );
+            for (unsigned int q = 0; q < 4; ++q)
+                children[q] = key.createChildKey(q);
+
+            bool intersectsKey = intersectsExtents( children );
 
-        if ( _progress.valid() && gotData && _progress->reportProgress(_completed, _total, std::string("Cached tile: ") + key.str()) )
-            return; // Canceled
+            //Check to see if the bounds intersects ANY of the tile's children.  If it does, then process all of the children
+            //for this level
+            if (intersectsKey)
+            {
+                processKeys(mapf, children);
+
+                if ( _progress.valid() && _progress->isCanceled() )
+                    return;
+            }
+        }
+
+        // the whole subtree under this key is done.
+        journalKey( key );
     }
+}
 
-    if ( gotData && lod <= _maxLevel )
+bool
+CacheSeed::intersectsExtents(const std::vector<TileKey>& keys) const
+{
+    if (_extents.empty())
+        return true;
+
+    for (unsigned int e = 0; e < _extents.size(); ++e)
     {
-        TileKey k0 = key.createChildKey(0);
-        TileKey k1 = key.createChildKey(1);
-        TileKey k2 = key.createChildKey(2);
-        TileKey k3 = key.createChildKey(3); 
+        for (unsigned int k = 0; k < keys.size(); ++k)
+        {
+            if (_extents[e].intersects( keys[k].getExtent() ))
+                return true;
+        }
+    }
+    return false;
+}
 
-        bool intersectsKey = false;
-        if (_extents.empty()) intersectsKey = true;
-        else
+void
+CacheSeed::processKeysConcurrent(const MapFrame& mapf, const std::vector<TileKey>& rootKeys)
+{
+    // Each layer gets its own pool of workers, so a slow source doesn't hold
+    // up the others.
+    std::vector< osg::ref_ptr<TaskService> > imageServices, elevationServices;
+
+    for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); ++i )
+        imageServices.push_back( new TaskService("CacheSeed " + i->get()->getName(), _numThreads) );
+
+    for( ElevationLayerVector::const_iterator i = mapf.elevationLayers().begin(); i != mapf.elevationLayers().end(); ++i )
+        elevationServices.push_back( new TaskService("CacheSeed " + i->get()->getName(), _numThreads) );
+
+    OE_INFO << LC << "Seeding with " << _numThreads << " thread(s) per layer" << std::endl;
+
+    osg::Timer_t startTime = osg::Timer::instance()->tick();
+
+    // Walk the pyramid breadth-first. A key's children are only visited
+    // if the key produced data, so each level waits on the one above it;
+    // within a level, at most _queueSize keys are in flight at a time.
+    std::vector<TileKey> levelKeys( rootKeys );
+    PendingKeys          pending;
+
+    while ( !levelKeys.empty() )
+    {
+        std::vector<TileKey> nextLevelKeys;
+
+        for (unsigned int first = 0; first < levelKeys.size(); first += _queueSize)
         {
-            for (unsigned int i = 0; i < _extents.size(); ++i)
+            unsigned int last = osg::minimum( first + _queueSize, (unsigned int)levelKeys.size() );
+
+            // keys outside the level range aren't cached, but their children might be.
+            std::vector<bool> gotData( last - first, true );
+            std::vector<bool> skipped( last - first, false );
+            std::vector< osg::ref_ptr<SeedTileTask> > tasks;
+            std::vector< TaskService* >               services;
+
+            for (unsigned int k = first; k < last; ++k)
+            {
+                const TileKey& key = levelKeys[k];
+                unsigned int lod = key.getLevelOfDetail();
+                if ( isJournaled(key) )
+                    skipped[k - first] = true;
+                if ( skipped[k - first] || lod < _minLevel || lod > _maxLevel )
+                    continue;
+
+                gotData[k - first] = false;
+
+                for (unsigned int i = 0; i < mapf.imageLayers().size(); ++i)
+                {
+                    ImageLayer* layer = mapf.getImageLayerAt( i );
+                    if ( layer->isKeyValid(key) )
+                    {
+                        SeedTileTask* task = new SeedTileTask();
+                        task->_imageLayer = layer;
+                        task->_key        = key;
+                        task->_index      = k - first;
+                        tasks.push_back( task );
+                        services.push_back( imageServices[i].get() );
+                    }
+                }
+
+                for (unsigned int i = 0; i < mapf.elevationLayers().size(); ++i)
+                {
+                    ElevationLayer* layer = mapf.elevationLayers()[i].get();
+                    if ( layer->isKeyValid(key) )
+                    {
+                        SeedTileTask* task = new SeedTileTask();
+                        task->_elevationLayer = layer;
+                        task->_key            = key;
+                        task->_index          = k - first;
+                        tasks.push_back( task );
+                        services.push_back( elevationServices[i].get() );
+                    }
+                }
+            }
+
+            if ( !tasks.empty() )
             {
-                if (_extents[i].intersects( k0.getExtent() ) ||
-                    _extents[i].intersects( k1.getExtent() ) ||
-                    _extents[i].intersects( k2.getExtent() ) ||
-                    _extents[i].intersects( k3.getExtent() ))
+                Threading::MultiEvent semaphore( tasks.size() );
+
+                for (unsigned int t = 0; t < tasks.size(); ++t)
                 {
-                    intersectsKey = true;
+                    tasks[t]->_mev = &semaphore;
+                    services[t]->add( tasks[t].get() );
                 }
 
+                semaphore.wait();
+
+                for (unsigned int t = 0; t < tasks.size(); ++t)
+                {
+                    if ( tasks[t]->_gotData )
+                        gotData[tasks[t]->_index] = true;
+                }
+            }
+
+            for (unsigned int k = first; k < last; ++k)
+            {
+                const TileKey& key = levelKeys[k];
+                unsigned int lod = key.getLevelOfDetail();
+
+                if ( skipped[k - first] || !gotData[k - first] )
+                {
+                    finishKey( key, pending );
+                    continue;
+                }
+
+                if ( lod >= _minLevel )
+                    incrementCompleted( 1 );
+
+                std::vector<TileKey> children( 4 );
+                for (unsigned int q = 0; q < 4; ++q)
+                    children[q] = key.createChildKey( q );
+
+                if ( lod < _maxLevel && intersectsExtents(children) )
+                {
+                    // the key's subtree is done once all four children are.
+                    pending[key] = 4;
+                    nextLevelKeys.insert( nextLevelKeys.end(), children.begin(), children.end() );
+                }
+                else
+                {
+                    finishKey( key, pending );
+                }
+            }
+
+            if ( _progress.valid() )
+            {
+                double elapsed = osg::Timer::instance()->delta_s( startTime, osg::Timer::instance()->tick() );
+                double rate    = elapsed > 0.0 ? (double)_completed / elapsed : 0.0;
+
+                std::stringstream buf;
+                buf.precision( 3 );
+                buf << "Level " << levelKeys[first].getLevelOfDetail() << ": "
+                    << _completed << " tiles, " << rate << " tiles/s";
+                if ( rate > 0.0 && _total > _completed )
+                    buf << ", ETA " << formatTime( (double)(_total - _completed) / rate );
+
+                if ( _progress->isCanceled() || _progress->reportProgress(_completed, _total, buf.str()) )
+                    return; // Canceled
+            }
+        }
+
+        levelKeys.swap( nextLevelKeys );
+    }
+}
+
+bool
+CacheSeed::openJournal(const Profile* profile)
+{
+    _journal.clear();
+
+    std::ifstream in( _journalFile.c_str() );
+    unsigned int lod, x, y;
+    while ( in >> lod >> x >> y )
+    {
+        _journal.insert( TileKey(lod, x, y, profile) );
+    }
+    in.close();
+
+    // drop entries already covered by a finished ancestor:
+    for (Journal::iterator i = _journal.begin(); i != _journal.end(); )
+    {
+        bool covered = false;
+        for (TileKey parent = i->createParentKey(); parent.valid() && !covered; parent = parent.createParentKey())
+            covered = _journal.find( parent ) != _journal.end();
+
+        if ( covered )
+            _journal.erase( i++ );
+        else
+            ++i;
+    }
+
+    if ( !_journal.empty() )
+    {
+        OE_NOTICE << LC << "Resuming from journal \"" << _journalFile << "\" ("
+            << _journal.size() << " finished subtrees)" << std::endl;
+    }
+
+    // rewrite the journal compacted, then append to it as subtrees finish.
+    writeJournal();
+
+    _journalOut.open( _journalFile.c_str(), std::ios::out | std::ios::app );
+    if ( !_journalOut.is_open() )
+    {
+        OE_WARN << LC << "Cannot write journal \"" << _journalFile << "\"; aborting." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void
+CacheSeed::writeJournal() const
+{
+    std::ofstream out( _journalFile.c_str(), std::ios::out | std::ios::trunc );
+    for (Journal::const_iterator i = _journal.begin(); i != _journal.end(); ++i)
+    {
+        out << i->getLevelOfDetail() << " " << i->getTileX() << " " << i->getTileY() << "\n";
+    }
+}
+
+void
+CacheSeed::closeJournal()
+{
+    if ( _journalOut.is_open() )
+    {
+        _journalOut.close();
+        writeJournal();
+    }
+    _journal.clear();
+}
+
+bool
+CacheSeed::isJournaled(const TileKey& key) const
+{
+    return !_journal.empty() && _journal.find( key ) != _journal.end();
+}
+
+void
+CacheSeed::journalKey(const TileKey& key) const
+{
+    if ( !_journalOut.is_open() || isJournaled(key) )
+        return;
+
+    unsigned int journalLevel = _journalLevel.isSet() ? _journalLevel.get() : (_maxLevel > 4 ? _maxLevel - 4 : 0);
+    if ( key.getLevelOfDetail() > journalLevel )
+        return;
+
+    // the key stands in for its children from now on.
+    for (unsigned int q = 0; q < 4; ++q)
+        _journal.erase( key.createChildKey(q) );
+    _journal.insert( key );
+
+    _journalOut << key.getLevelOfDetail() << " " << key.getTileX() << " " << key.getTileY() << std::endl;
+}
+
+void
+CacheSeed::finishKey(const TileKey& key, PendingKeys& pending) const
+{
+    journalKey( key );
+
+    TileKey parent = key.createParentKey();
+    if ( !parent.valid() )
+        return;
+
+    PendingKeys::iterator i = pending.find( parent );
+    if ( i != pending.end() && --i->second == 0 )
+    {
+        pending.erase( i );
+        finishKey( parent, pending );
+    }
+}
+
+unsigned
+CacheSeed::verify( Map* map, unsigned samples )
+{
+    if ( _journalFile.empty() || !osgDB::fileExists(_journalFile) )
+    {
+        OE_WARN << LC << "No journal to verify." << std::endl;
+        return 0;
+    }
+
+    if ( !openJournal(map->getProfile()) )
+        return 0;
+
+    MapFrame mapf( map, Map::TERRAIN_LAYERS, "CacheSeed::verify" );
+
+    unsigned dropped = 0, checked = 0;
+    for (Journal::iterator i = _journal.begin(); i != _journal.end(); )
+    {
+        const TileKey& root = *i;
+        unsigned int minLOD = osg::maximum( root.getLevelOfDetail(), _minLevel );
+
+        bool missing = false;
+        for (unsigned int s = 0; s < samples && !missing; ++s)
+        {
+            // random descendant at a random level within the seeded range.
+            unsigned int lod = minLOD + (_maxLevel >= minLOD ? ::rand() % (_maxLevel - minLOD + 1) : 0);
+            TileKey key = root;
+            while ( key.getLevelOfDetail() < lod )
+                key = key.createChildKey( ::rand() % 4 );
+
+            std::vector<TileKey> sample( 1, key );
+            if ( !intersectsExtents(sample) )
+                continue;
+
+            ++checked;
+            missing = !mapf.isCached( key );
+            if ( missing )
+            {
+                OE_INFO << LC << "Tile " << key.str() << " is missing; subtree " << root.str() << " will be seeded again" << std::endl;
             }
         }
 
-        //Check to see if the bounds intersects ANY of the tile's children.  If it does, then process all of the children
-        //for this level
-        if (intersectsKey)
+        if ( missing )
         {
-            processKey(mapf, k0);
-            processKey(mapf, k1);
-            processKey(mapf, k2);
-            processKey(mapf, k3);
+            _journal.erase( i++ );
+            ++dropped;
         }
+        else
+        {
+            ++i;
+        }
+
+        if ( _progress.valid() && _progress->isCanceled() )
+            break;
     }
+
+    OE_NOTICE << LC << "Checked " << checked << " tiles; dropped " << dropped << " subtrees from the journal" << std::endl;
+
+    closeJournal();
+    return dropped;
 }
 
-bool
-CacheSeed::cacheTile(const MapFrame& mapf, const TileKey& key ) const
+void
+CacheSeed::cacheTiles(const MapFrame& mapf, const std::vector<TileKey>& keys, std::vector<bool>& out_gotData ) const
 {
-    bool gotData = false;
+    out_gotData.assign( keys.size(), false );
 
     for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); i++ )
     {
         ImageLayer* layer = i->get();
-        if ( layer->isKeyValid( key ) )
+
+        std::vector<TileKey>  layerKeys;
+        std::vector<unsigned> layerIndices;
+        for (unsigned int k = 0; k < keys.size(); ++k)
         {
-            GeoImage image = layer->createImage( key );
-            if ( image.valid() )
-                gotData = true;
+            if ( layer->isKeyValid( keys[k] ) )
+            {
+                layerKeys.push_back( keys[k] );
+                layerIndices.push_back( k );
+            }
+        }
+
+        if ( layerKeys.empty() )
+            continue;
+
+        std::vector<GeoImage> images;
+        layer->createImages( layerKeys, images );
+        for (unsigned int k = 0; k < images.size(); ++k)
+        {
+            if ( images[k].valid() )
+                out_gotData[layerIndices[k]] = true;
         }
     }
 
     if ( mapf.elevationLayers().size() > 0 )
     {
-        osg::ref_ptr<osg::HeightField> hf;
-        mapf.getHeightField( key, false, hf );
-        if ( hf.valid() )
-            gotData = true;
+        for (unsigned int k = 0; k < keys.size(); ++k)
+        {
+            osg::ref_ptr<osg::HeightField> hf;
+            mapf.getHeightField( keys[k], false, hf );
+            if ( hf.valid() )
+                out_gotData[k] = true;
+        }
     }
-
-    return gotData;
 }
 
 void
@@ -372,3 +868,165 @@ CacheSeed::addExtent( const GeoExtent& value)
 {
     _extents.push_back( value );
 }
+
+CacheSeed::Estimate
+CacheSeed::estimate( Map* map, unsigned samples ) const
+{
+    Estimate result;
+
+    const Profile* profile = map->getProfile();
+    if ( !profile )
+        return result;
+
+    std::vector<GeoExtent> seedExtents = _extents;
+    if ( seedExtents.empty() )
+        seedExtents.push_back( profile->getExtent() );
+
+    std::vector< osg::ref_ptr<TerrainLayer> > layers;
+    MapFrame mapf( map, Map::TERRAIN_LAYERS, "CacheSeed::estimate" );
+    for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); ++i )
+        layers.push_back( i->get() );
+    for( ElevationLayerVector::const_iterator i = mapf.elevationLayers().begin(); i != mapf.elevationLayers().end(); ++i )
+        layers.push_back( i->get() );
+
+    result._tilesPerLevel.resize( _maxLevel + 1, 0 );
+    std::vector< std::vector<TileRect> > levelRects( _maxLevel + 1 );
+
+    for( unsigned i = 0; i < layers.size(); ++i )
+    {
+        TerrainLayer* layer = layers[i].get();
+        TileSource*   src   = layer->getTileSource();
+        if ( layer->isCacheOnly() || !src )
+            continue;
+
+        const TerrainLayerOptions& opt = layer->getTerrainLayerRuntimeOptions();
+        unsigned minLevel = osg::maximum( _minLevel, opt.minLevel().isSet() ? opt.minLevel().get() : 0u );
+        unsigned maxLevel = osg::minimum( _maxLevel, opt.maxLevel().isSet() ? opt.maxLevel().get() : _maxLevel );
+
+        // no deeper than the deepest data, when every data extent says how deep it goes.
+        const DataExtentList& dataExtents = src->getDataExtents();
+        unsigned dataMaxLevel = 0;
+        bool     hasDataMaxLevel = !dataExtents.empty();
+        for( DataExtentList::const_iterator d = dataExtents.begin(); d != dataExtents.end(); ++d )
+        {
+            if ( d->maxLevel().isSet() )
+                dataMaxLevel = osg::maximum( dataMaxLevel, d->maxLevel().get() );
+            else
+                hasDataMaxLevel = false;
+        }
+        if ( hasDataMaxLevel )
+            maxLevel = osg::minimum( maxLevel, dataMaxLevel );
+
+        // the parts of the seed area in which the layer has data.
+        std::vector<LayerRegion> regions;
+        for( unsigned e = 0; e < seedExtents.size(); ++e )
+        {
+            if ( dataExtents.empty() )
+            {
+                LayerRegion region;
+                region._extent = seedExtents[e];
+                regions.push_back( region );
+                continue;
+            }
+
+            for( DataExtentList::const_iterator d = dataExtents.begin(); d != dataExtents.end(); ++d )
+            {
+                LayerRegion region;
+                region._extent = d->transform( profile->getSRS() ).intersectionSameSRS( seedExtents[e] );
+                if ( !region._extent.isValid() || region._extent.area() <= 0.0 )
+                    continue;
+                region._minLevel = d->minLevel();
+                region._maxLevel = d->maxLevel();
+                regions.push_back( region );
+            }
+        }
+
+        LayerEstimate le;
+        le._name = layer->getName();
+        le._tilesPerLevel.resize( _maxLevel + 1, 0 );
+
+        std::vector<TileRect> deepestRects;
+        unsigned              deepestLevel = 0;
+
+        for( unsigned lod = minLevel; lod <= maxLevel; ++lod )
+        {
+            std::vector<TileRect> rects;
+            for( unsigned r = 0; r < regions.size(); ++r )
+            {
+                const LayerRegion& region = regions[r];
+                if ( (region._minLevel.isSet() && lod < region._minLevel.get()) ||
+                     (region._maxLevel.isSet() && lod > region._maxLevel.get()) )
+                    continue;
+
+                TileRect rect;
+                if ( getTileRect(profile, region._extent, lod, rect) )
+                    rects.push_back( rect );
+            }
+
+            if ( rects.empty() )
+                continue;
+
+            le._tilesPerLevel[lod] = countTiles( rects );
+            le._tiles += le._tilesPerLevel[lod];
+            levelRects[lod].insert( levelRects[lod].end(), rects.begin(), rects.end() );
+
+            deepestRects = rects;
+            deepestLevel = lod;
+        }
+
+        // measure a few tiles from the deepest level, which holds most of them.
+        const Profile* srcProfile = src->getProfile();
+        double totalBytes = 0.0;
+        unsigned seed = 12345u;
+        for( unsigned attempt = 0; srcProfile && le._samples < samples && attempt < 4*samples && !deepestRects.empty(); ++attempt )
+        {
+            seed = seed * 1103515245u + 12345u;
+            const TileRect& rect = deepestRects[(seed >> 16) % deepestRects.size()];
+            seed = seed * 1103515245u + 12345u;
+            unsigned x = rect._x0 + (seed >> 16) % (rect._x1 - rect._x0 + 1);
+            seed = seed * 1103515245u + 12345u;
+            unsigned y = rect._y0 + (seed >> 16) % (rect._y1 - rect._y0 + 1);
+
+            TileKey mapKey( deepestLevel, x, y, profile );
+            GeoPoint centroid, srcCentroid;
+            if ( !mapKey.getExtent().getCentroid(centroid) || !centroid.transform(srcProfile->getSRS(), srcCentroid) )
+                continue;
+
+            TileKey srcKey = srcProfile->createTileKey(
+                srcCentroid.x(), srcCentroid.y(), srcProfile->getEquivalentLOD(profile, deepestLevel) );
+            if ( !srcKey.valid() )
+                continue;
+
+            osg::ref_ptr<osg::Object> tile;
+            if ( dynamic_cast<ImageLayer*>(layer) )
+                tile = src->createImage( srcKey );
+            else
+                tile = src->createHeightField( srcKey );
+
+            unsigned size = tile.valid() ? getCachedSize( tile.get() ) : 0;
+            if ( size > 0 )
+            {
+                totalBytes += size;
+                ++le._samples;
+            }
+        }
+
+        if ( le._samples > 0 )
+            le._bytesPerTile = totalBytes / (double)le._samples;
+
+        result._requests += le._tiles;
+        result._bytes    += le._bytesPerTile * (double)le._tiles;
+        result._layers.push_back( le );
+
+        OE_INFO << LC << "Layer \"" << le._name << "\": ~" << le._tiles << " tiles, "
+            << (unsigned)le._bytesPerTile << " bytes/tile over " << le._samples << " samples" << std::endl;
+    }
+
+    for( unsigned lod = 0; lod < levelRects.size(); ++lod )
+    {
+        result._tilesPerLevel[lod] = countTiles( levelRects[lod] );
+        result._tiles += result._tilesPerLevel[lod];
+    }
+
+    return result;
+}
@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/Capabilities>
+#include <osgEarth/Config>
+#include <osgEarth/Registry>
 #include <osg/FragmentProgram>
 #include <osg/GraphicsContext>
 #include <osg/GL>
@@ -25,11 +27,16 @@
 #include <osg/Texture>
 #include <osgViewer/Version>
 #include <OpenThreads/Thread>
+#include <fstream>
+#include <sstream>
 
 using namespace osgEarth;
 
 #define LC "[Capabilities] "
 
+// bump this when the set of stored values changes.
+#define CAPS_FILE_VERSION 1
+
 // ---------------------------------------------------------------------------
 // A custom P-Buffer graphics context that we will use to query for OpenGL 
 // extension and hardware support. (Adapted from osgconv in OpenSceneGraph)
@@ -120,200 +127,376 @@ _supportsUniformBufferObjects( false ),
 _supportsNonPowerOfTwoTextures( false ),
 _maxUniformBlockSize    ( 0 ),
 _preferDLforStaticGeom  ( true ),
-_numProcessors          ( 1 )
+_numProcessors          ( 1 ),
+_fromFile               ( false )
 {
     // little hack to force the osgViewer library to link so we can create a graphics context
     osgViewerGetVersion();
 
-    // check the environment in order to disable ATI workarounds
-    bool enableATIworkarounds = true;
-    if ( ::getenv( "OSGEARTH_DISABLE_ATI_WORKAROUNDS" ) != 0L )
-        enableATIworkarounds = false;
-
     // logical CPUs (cores)
     _numProcessors = OpenThreads::GetNumberOfProcessors();
 
+    // a saved probe spares us the temporary graphics context. It is checked
+    // against the real context once one exists (see CapabilitiesCheckOperation).
+    const char* capsFile = ::getenv( "OSGEARTH_CAPABILITIES_FILE" );
+    if ( capsFile && readFile(capsFile) )
+    {
+        _fromFile = true;
+        OE_INFO << LC << "Read capabilities of \"" << _renderer << "\" from " << capsFile << std::endl;
+        return;
+    }
+
     // create a graphics context so we can query OpenGL support:
     MyGraphicsContext mgc;
 
     if ( mgc.valid() )
     {
-        osg::GraphicsContext* gc = mgc._gc.get();
-        unsigned int id = gc->getState()->getContextID();
-        const osg::GL2Extensions* GL2 = osg::GL2Extensions::Get( id, true );
+        probe( mgc._gc->getState()->getContextID() );
 
-        OE_INFO << LC << "Detected hardware capabilities:" << std::endl;
+        if ( capsFile )
+            writeFile( capsFile );
+    }
+}
 
-        _vendor = std::string( reinterpret_cast<const char*>(glGetString(GL_VENDOR)) );
-        OE_INFO << LC << "  Vendor = " << _vendor << std::endl;
+void
+Capabilities::probe( unsigned id )
+{
+    // check the environment in order to disable ATI workarounds
+    bool enableATIworkarounds = true;
+    if ( ::getenv( "OSGEARTH_DISABLE_ATI_WORKAROUNDS" ) != 0L )
+        enableATIworkarounds = false;
 
-        _renderer = std::string( reinterpret_cast<const char*>(glGetString(GL_RENDERER)) );
-        OE_INFO << LC << "  Renderer = " << _renderer << std::endl;
+    const osg::GL2Extensions* GL2 = osg::GL2Extensions::Get( id, true );
 
-        _version = std::string( reinterpret_cast<const char*>(glGetString(GL_VERSION)) );
-        OE_INFO << LC << "  Version = " << _version << std::endl;
+    OE_INFO << LC << "Detected hardware capabilities:" << std::endl;
 
-        glGetIntegerv( GL_MAX_TEXTURE_UNITS, &_maxFFPTextureUnits );
-        OE_INFO << LC << "  Max FFP texture units = " << _maxFFPTextureUnits << std::endl;
+    _vendor = std::string( reinterpret_cast<const char*>(glGetString(GL_VENDOR)) );
+    OE_INFO << LC << "  Vendor = " << _vendor << std::endl;
 
-        glGetIntegerv( GL_MAX_TEXTURE_IMAGE_UNITS_ARB, &_maxGPUTextureUnits );
-        OE_INFO << LC << "  Max GPU texture units = " << _maxGPUTextureUnits << std::endl;
+    _renderer = std::string( reinterpret_cast<const char*>(glGetString(GL_RENDERER)) );
+    OE_INFO << LC << "  Renderer = " << _renderer << std::endl;
 
-        glGetIntegerv( GL_MAX_TEXTURE_COORDS_ARB, &_maxGPUTextureCoordSets );
-        OE_INFO << LC << "  Max GPU texture coord indices = " << _maxGPUTextureCoordSets << std::endl;
+    _version = std::string( reinterpret_cast<const char*>(glGetString(GL_VERSION)) );
+    OE_INFO << LC << "  Version = " << _version << std::endl;
 
-        glGetIntegerv( GL_MAX_VERTEX_ATTRIBS, &_maxGPUAttribs );
-        OE_INFO << LC << "  Max GPU attributes = " << _maxGPUAttribs << std::endl;
+    glGetIntegerv( GL_MAX_TEXTURE_UNITS, &_maxFFPTextureUnits );
+    OE_INFO << LC << "  Max FFP texture units = " << _maxFFPTextureUnits << std::endl;
+
+    glGetIntegerv( GL_MAX_TEXTURE_IMAGE_UNITS_ARB, &_maxGPUTextureUnits );
+    OE_INFO << LC << "  Max GPU texture units = " << _maxGPUTextureUnits << std::endl;
+
+    glGetIntegerv( GL_MAX_TEXTURE_COORDS_ARB, &_maxGPUTextureCoordSets );
+    OE_INFO << LC << "  Max GPU texture coord indices = " << _maxGPUTextureCoordSets << std::endl;
+
+    glGetIntegerv( GL_MAX_VERTEX_ATTRIBS, &_maxGPUAttribs );
+    OE_INFO << LC << "  Max GPU attributes = " << _maxGPUAttribs << std::endl;
 
 #if 0
 #if defined(OSG_GLES2_AVAILABLE)
-        int maxVertAttributes = 0;
-        glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxVertAttributes);
-        _maxGPUTextureCoordSets = maxVertAttributes - 5; //-5 for vertex, normal, color, tangent and binormal
+    int maxVertAttributes = 0;
+    glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxVertAttributes);
+    _maxGPUTextureCoordSets = maxVertAttributes - 5; //-5 for vertex, normal, color, tangent and binormal
 #endif
 #endif
 
-        glGetIntegerv( GL_DEPTH_BITS, &_depthBits );
-        OE_INFO << LC << "  Depth buffer bits = " << _depthBits << std::endl;
+    glGetIntegerv( GL_DEPTH_BITS, &_depthBits );
+    OE_INFO << LC << "  Depth buffer bits = " << _depthBits << std::endl;
 
-        
-        glGetIntegerv( GL_MAX_TEXTURE_SIZE, &_maxTextureSize );
+    
+    glGetIntegerv( GL_MAX_TEXTURE_SIZE, &_maxTextureSize );
 #if !(defined(OSG_GLES1_AVAILABLE) || defined(OSG_GLES2_AVAILABLE))
-        // Use the texture-proxy method to determine the maximum texture size 
-        for( int s = _maxTextureSize; s > 2; s >>= 1 )
+    // Use the texture-proxy method to determine the maximum texture size 
+    for( int s = _maxTextureSize; s > 2; s >>= 1 )
+    {
+        glTexImage2D( GL_PROXY_TEXTURE_2D, 0, GL_RGBA8, s, s, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0L );
+        GLint width = 0;
+        glGetTexLevelParameteriv( GL_PROXY_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width );
+        if ( width == s )
         {
-            glTexImage2D( GL_PROXY_TEXTURE_2D, 0, GL_RGBA8, s, s, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0L );
-            GLint width = 0;
-            glGetTexLevelParameteriv( GL_PROXY_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width );
-            if ( width == s )
-            {
-                _maxTextureSize = s;
-                break;
-            }
+            _maxTextureSize = s;
+            break;
         }
+    }
 #endif
-        OE_INFO << LC << "  Max texture size = " << _maxTextureSize << std::endl;
+    OE_INFO << LC << "  Max texture size = " << _maxTextureSize << std::endl;
 
-        //PORT@tom, what effect will this have?
+    //PORT@tom, what effect will this have?
 #ifdef OSG_GL_FIXED_FUNCTION_AVAILABLE
-        glGetIntegerv( GL_MAX_LIGHTS, &_maxLights );
+    glGetIntegerv( GL_MAX_LIGHTS, &_maxLights );
 #else
-        _maxLights = 1;
+    _maxLights = 1;
 #endif
-        OE_INFO << LC << "  Max lights = " << _maxLights << std::endl;
+    OE_INFO << LC << "  Max lights = " << _maxLights << std::endl;
 
-        
-        if ( ::getenv("OSGEARTH_NO_GLSL") )
-            _supportsGLSL = false;
-        else
-            _supportsGLSL = GL2->isGlslSupported();
-        OE_INFO << LC << "  GLSL = " << SAYBOOL(_supportsGLSL) << std::endl;
+    
+    if ( ::getenv("OSGEARTH_NO_GLSL") )
+        _supportsGLSL = false;
+    else
+        _supportsGLSL = GL2->isGlslSupported();
+    OE_INFO << LC << "  GLSL = " << SAYBOOL(_supportsGLSL) << std::endl;
 
-        if ( _supportsGLSL )
-        {
-            _GLSLversion = GL2->getLanguageVersion();
-            OE_INFO << LC << "  GLSL Version = " << _GLSLversion << std::endl;
-        }
+    if ( _supportsGLSL )
+    {
+        _GLSLversion = GL2->getLanguageVersion();
+        OE_INFO << LC << "  GLSL Version = " << _GLSLversion << std::endl;
+    }
 
-        _supportsTextureArrays = 
-            _supportsGLSL &&
-            osg::getGLVersionNumber() >= 2.0 && // hopefully this will detect Intel cards
-            osg::isGLExtensionSupported( id, "GL_EXT_texture_array" );
-        OE_INFO << LC << "  Texture arrays = " << SAYBOOL(_supportsTextureArrays) << std::endl;
+    _supportsTextureArrays = 
+        _supportsGLSL &&
+        osg::getGLVersionNumber() >= 2.0 && // hopefully this will detect Intel cards
+        osg::isGLExtensionSupported( id, "GL_EXT_texture_array" );
+    OE_INFO << LC << "  Texture arrays = " << SAYBOOL(_supportsTextureArrays) << std::endl;
 
-        _supportsTexture3D = osg::isGLExtensionSupported( id, "GL_EXT_texture3D" );
-        OE_INFO << LC << "  3D textures = " << SAYBOOL(_supportsTexture3D) << std::endl;
+    _supportsTexture3D = osg::isGLExtensionSupported( id, "GL_EXT_texture3D" );
+    OE_INFO << LC << "  3D textures = " << SAYBOOL(_supportsTexture3D) << std::endl;
 
-        _supportsMultiTexture = 
-            osg::getGLVersionNumber() >= 1.3 ||
-            osg::isGLExtensionSupported( id, "GL_ARB_multitexture") ||
-            osg::isGLExtensionSupported( id, "GL_EXT_multitexture" );
-        OE_INFO << LC << "  Multitexturing = " << SAYBOOL(_supportsMultiTexture) << std::endl;
+    _supportsMultiTexture = 
+        osg::getGLVersionNumber() >= 1.3 ||
+        osg::isGLExtensionSupported( id, "GL_ARB_multitexture") ||
+        osg::isGLExtensionSupported( id, "GL_EXT_multitexture" );
+    OE_INFO << LC << "  Multitexturing = " << SAYBOOL(_supportsMultiTexture) << std::endl;
 
-        _supportsStencilWrap = osg::isGLExtensionSupported( id, "GL_EXT_stencil_wrap" );
-        OE_INFO << LC << "  Stencil wrapping = " << SAYBOOL(_supportsStencilWrap) << std::endl;
+    _supportsStencilWrap = osg::isGLExtensionSupported( id, "GL_EXT_stencil_wrap" );
+    OE_INFO << LC << "  Stencil wrapping = " << SAYBOOL(_supportsStencilWrap) << std::endl;
 
-        _supportsTwoSidedStencil = osg::isGLExtensionSupported( id, "GL_EXT_stencil_two_side" );
-        OE_INFO << LC << "  2-sided stencils = " << SAYBOOL(_supportsTwoSidedStencil) << std::endl;
+    _supportsTwoSidedStencil = osg::isGLExtensionSupported( id, "GL_EXT_stencil_two_side" );
+    OE_INFO << LC << "  2-sided stencils = " << SAYBOOL(_supportsTwoSidedStencil) << std::endl;
 
-        _supportsDepthPackedStencilBuffer = osg::isGLExtensionSupported( id, "GL_EXT_packed_depth_stencil" ) || 
-                                            osg::isGLExtensionSupported( id, "GL_OES_packed_depth_stencil" );
-        OE_INFO << LC << "  depth-packed stencil = " << SAYBOOL(_supportsDepthPackedStencilBuffer) << std::endl;
+    _supportsDepthPackedStencilBuffer = osg::isGLExtensionSupported( id, "GL_EXT_packed_depth_stencil" ) || 
+                                        osg::isGLExtensionSupported( id, "GL_OES_packed_depth_stencil" );
+    OE_INFO << LC << "  depth-packed stencil = " << SAYBOOL(_supportsDepthPackedStencilBuffer) << std::endl;
 
-        _supportsOcclusionQuery = osg::isGLExtensionSupported( id, "GL_ARB_occlusion_query" );
-        OE_INFO << LC << "  occlusion query = " << SAYBOOL(_supportsOcclusionQuery) << std::endl;
+    _supportsOcclusionQuery = osg::isGLExtensionSupported( id, "GL_ARB_occlusion_query" );
+    OE_INFO << LC << "  occlusion query = " << SAYBOOL(_supportsOcclusionQuery) << std::endl;
 
-        _supportsDrawInstanced = 
-            _supportsGLSL &&
-            osg::isGLExtensionOrVersionSupported( id, "GL_EXT_draw_instanced", 3.1f );
-        OE_INFO << LC << "  draw instanced = " << SAYBOOL(_supportsDrawInstanced) << std::endl;
+    _supportsDrawInstanced = 
+        _supportsGLSL &&
+        osg::isGLExtensionOrVersionSupported( id, "GL_EXT_draw_instanced", 3.1f );
+    OE_INFO << LC << "  draw instanced = " << SAYBOOL(_supportsDrawInstanced) << std::endl;
 
-        glGetIntegerv( GL_MAX_UNIFORM_BLOCK_SIZE, &_maxUniformBlockSize );
-        OE_INFO << LC << "  max uniform block size = " << _maxUniformBlockSize << std::endl;
+    glGetIntegerv( GL_MAX_UNIFORM_BLOCK_SIZE, &_maxUniformBlockSize );
+    OE_INFO << LC << "  max uniform block size = " << _maxUniformBlockSize << std::endl;
 
-        _supportsUniformBufferObjects = 
-            _supportsGLSL &&
-            osg::isGLExtensionOrVersionSupported( id, "GL_ARB_uniform_buffer_object", 2.0f );
-        OE_INFO << LC << "  uniform buffer objects = " << SAYBOOL(_supportsUniformBufferObjects) << std::endl;
+    _supportsUniformBufferObjects = 
+        _supportsGLSL &&
+        osg::isGLExtensionOrVersionSupported( id, "GL_ARB_uniform_buffer_object", 2.0f );
+    OE_INFO << LC << "  uniform buffer objects = " << SAYBOOL(_supportsUniformBufferObjects) << std::endl;
 
-        if ( _supportsUniformBufferObjects && _maxUniformBlockSize == 0 )
-        {
-            OE_INFO << LC << "  ...but disabled, since UBO block size reports zero" << std::endl;
-            _supportsUniformBufferObjects = false;
-        }
+    if ( _supportsUniformBufferObjects && _maxUniformBlockSize == 0 )
+    {
+        OE_INFO << LC << "  ...but disabled, since UBO block size reports zero" << std::endl;
+        _supportsUniformBufferObjects = false;
+    }
 
-        _supportsNonPowerOfTwoTextures =
-            osg::isGLExtensionSupported( id, "GL_ARB_texture_non_power_of_two" );
-        OE_INFO << LC << "  NPOT textures = " << SAYBOOL(_supportsNonPowerOfTwoTextures) << std::endl;
+    _supportsNonPowerOfTwoTextures =
+        osg::isGLExtensionSupported( id, "GL_ARB_texture_non_power_of_two" );
+    OE_INFO << LC << "  NPOT textures = " << SAYBOOL(_supportsNonPowerOfTwoTextures) << std::endl;
 
 
-        //_supportsTexture2DLod = osg::isGLExtensionSupported( id, "GL_ARB_shader_texture_lod" );
-        //OE_INFO << LC << "  texture2DLod = " << SAYBOOL(_supportsTexture2DLod) << std::endl;
+    //_supportsTexture2DLod = osg::isGLExtensionSupported( id, "GL_ARB_shader_texture_lod" );
+    //OE_INFO << LC << "  texture2DLod = " << SAYBOOL(_supportsTexture2DLod) << std::endl;
 
-        // NVIDIA:
-        bool isNVIDIA = _vendor.find("NVIDIA") == 0;
+    // NVIDIA:
+    bool isNVIDIA = _vendor.find("NVIDIA") == 0;
 
-        // NVIDIA has h/w acceleration of some kind for display lists, supposedly.
-        // In any case they do benchmark much faster in osgEarth for static geom.
-        // BUT unfortunately, they dont' seem to work too well with shaders. Colors
-        // change randomly, etc. Might work OK for textured geometry but not for 
-        // untextured. TODO: investigate.
+    // NVIDIA has h/w acceleration of some kind for display lists, supposedly.
+    // In any case they do benchmark much faster in osgEarth for static geom.
+    // BUT unfortunately, they dont' seem to work too well with shaders. Colors
+    // change randomly, etc. Might work OK for textured geometry but not for 
+    // untextured. TODO: investigate.
 #if 1
-        _preferDLforStaticGeom = false;
-        if ( ::getenv("OSGEARTH_TRY_DISPLAY_LISTS") )
-        {
-            _preferDLforStaticGeom = true;
-        }
+    _preferDLforStaticGeom = false;
+    if ( ::getenv("OSGEARTH_TRY_DISPLAY_LISTS") )
+    {
+        _preferDLforStaticGeom = true;
+    }
 #else
-        if ( ::getenv("OSGEARTH_ALWAYS_USE_VBOS") )
-        {
-            _preferDLforStaticGeom = false;
-        }
-        else
-        {
-            _preferDLforStaticGeom = isNVIDIA;
-        }
+    if ( ::getenv("OSGEARTH_ALWAYS_USE_VBOS") )
+    {
+        _preferDLforStaticGeom = false;
+    }
+    else
+    {
+        _preferDLforStaticGeom = isNVIDIA;
+    }
 #endif
 
-        OE_INFO << LC << "  prefer DL for static geom = " << SAYBOOL(_preferDLforStaticGeom) << std::endl;
+    OE_INFO << LC << "  prefer DL for static geom = " << SAYBOOL(_preferDLforStaticGeom) << std::endl;
 
-        // ATI workarounds:
-        bool isATI = _vendor.find("ATI ") == 0;
+    // ATI workarounds:
+    bool isATI = _vendor.find("ATI ") == 0;
 
-        _supportsMipmappedTextureUpdates = isATI && enableATIworkarounds ? false : true;
-        OE_INFO << LC << "  Mipmapped texture updates = " << SAYBOOL(_supportsMipmappedTextureUpdates) << std::endl;
+    _supportsMipmappedTextureUpdates = isATI && enableATIworkarounds ? false : true;
+    OE_INFO << LC << "  Mipmapped texture updates = " << SAYBOOL(_supportsMipmappedTextureUpdates) << std::endl;
 
 #if 0
-        // Intel workarounds:
-        bool isIntel = 
-            _vendor.find("Intel ")   != std::string::npos ||
-            _vendor.find("Intel(R)") != std::string::npos ||
-            _vendor.compare("Intel") == 0;
+    // Intel workarounds:
+    bool isIntel = 
+        _vendor.find("Intel ")   != std::string::npos ||
+        _vendor.find("Intel(R)") != std::string::npos ||
+        _vendor.compare("Intel") == 0;
 #endif
 
-        _maxFastTextureSize = _maxTextureSize;
+    _maxFastTextureSize = _maxTextureSize;
 
-        OE_INFO << LC << "  Max Fast Texture Size = " << _maxFastTextureSize << std::endl;
+    OE_INFO << LC << "  Max Fast Texture Size = " << _maxFastTextureSize << std::endl;
+}
+
+bool
+Capabilities::isSameDriver() const
+{
+    const char* vendor   = reinterpret_cast<const char*>( glGetString(GL_VENDOR) );
+    const char* renderer = reinterpret_cast<const char*>( glGetString(GL_RENDERER) );
+    const char* version  = reinterpret_cast<const char*>( glGetString(GL_VERSION) );
+
+    return
+        vendor && renderer && version &&
+        _vendor   == vendor   &&
+        _renderer == renderer &&
+        _version  == version;
+}
+
+Config
+Capabilities::getConfig() const
+{
+    Config conf( "capabilities" );
+    conf.add( "file_version",                 CAPS_FILE_VERSION );
+    conf.add( "vendor",                       _vendor );
+    conf.add( "renderer",                     _renderer );
+    conf.add( "version",                      _version );
+    conf.add( "max_ffp_texture_units",        _maxFFPTextureUnits );
+    conf.add( "max_gpu_texture_units",        _maxGPUTextureUnits );
+    conf.add( "max_gpu_texture_coord_sets",   _maxGPUTextureCoordSets );
+    conf.add( "max_gpu_attribs",              _maxGPUAttribs );
+    conf.add( "max_texture_size",             _maxTextureSize );
+    conf.add( "max_fast_texture_size",        _maxFastTextureSize );
+    conf.add( "max_lights",                   _maxLights );
+    conf.add( "depth_bits",                   _depthBits );
+    conf.add( "glsl",                         _supportsGLSL );
+    conf.add( "glsl_version",                 _GLSLversion );
+    conf.add( "texture_arrays",               _supportsTextureArrays );
+    conf.add( "texture_3d",                   _supportsTexture3D );
+    conf.add( "multitexture",                 _supportsMultiTexture );
+    conf.add( "stencil_wrap",                 _supportsStencilWrap );
+    conf.add( "two_sided_stencil",            _supportsTwoSidedStencil );
+    conf.add( "texture_2d_lod",               _supportsTexture2DLod );
+    conf.add( "mipmapped_texture_updates",    _supportsMipmappedTextureUpdates );
+    conf.add( "depth_packed_stencil",         _supportsDepthPackedStencilBuffer );
+    conf.add( "occlusion_query",              _supportsOcclusionQuery );
+    conf.add( "draw_instanced",               _supportsDrawInstanced );
+    conf.add( "uniform_buffer_objects",       _supportsUniformBufferObjects );
+    conf.add( "npot_textures",                _supportsNonPowerOfTwoTextures );
+    conf.add( "max_uniform_block_size",       _maxUniformBlockSize );
+    conf.add( "prefer_display_lists",         _preferDLforStaticGeom );
+    return conf;
+}
+
+bool
+Capabilities::readFile( const std::string& filename )
+{
+    std::ifstream in( filename.c_str() );
+    if ( !in.is_open() )
+        return false;
+
+    std::stringstream buf;
+    buf << in.rdbuf();
+
+    Config conf;
+    if ( !conf.fromJSON(buf.str()) || conf.value<int>("file_version", 0) != CAPS_FILE_VERSION || !conf.hasValue("renderer") )
+    {
+        OE_INFO << LC << "Ignoring unreadable capabilities file " << filename << std::endl;
+        return false;
     }
+
+    conf.getIfSet( "vendor",                     _vendor );
+    conf.getIfSet( "renderer",                   _renderer );
+    conf.getIfSet( "version",                    _version );
+    conf.getIfSet( "max_ffp_texture_units",      _maxFFPTextureUnits );
+    conf.getIfSet( "max_gpu_texture_units",      _maxGPUTextureUnits );
+    conf.getIfSet( "max_gpu_texture_coord_sets", _maxGPUTextureCoordSets );
+    conf.getIfSet( "max_gpu_attribs",            _maxGPUAttribs );
+    conf.getIfSet( "max_texture_size",           _maxTextureSize );
+    conf.getIfSet( "max_fast_texture_size",      _maxFastTextureSize );
+    conf.getIfSet( "max_lights",                 _maxLights );
+    conf.getIfSet( "depth_bits",                 _depthBits );
+    conf.getIfSet( "glsl",                       _supportsGLSL );
+    conf.getIfSet( "glsl_version",               _GLSLversion );
+    conf.getIfSet( "texture_arrays",             _supportsTextureArrays );
+    conf.getIfSet( "texture_3d",                 _supportsTexture3D );
+    conf.getIfSet( "multitexture",               _supportsMultiTexture );
+    conf.getIfSet( "stencil_wrap",               _supportsStencilWrap );
+    conf.getIfSet( "two_sided_stencil",          _supportsTwoSidedStencil );
+    conf.getIfSet( "texture_2d_lod",             _supportsTexture2DLod );
+    conf.getIfSet( "mipmapped_texture_updates",  _supportsMipmappedTextureUpdates );
+    conf.getIfSet( "depth_packed_stencil",       _supportsDepthPackedStencilBuffer );
+    conf.getIfSet( "occlusion_query",            _supportsOcclusionQuery );
+    conf.getIfSet( "draw_instanced",             _supportsDrawInstanced );
+    conf.getIfSet( "uniform_buffer_objects",     _supportsUniformBufferObjects );
+    conf.getIfSet( "npot_textures",              _supportsNonPowerOfTwoTextures );
+    conf.getIfSet( "max_uniform_block_size",     _maxUniformBlockSize );
+    conf.getIfSet( "prefer_display_lists",       _preferDLforStaticGeom );
+
+    // environment overrides still apply to saved values.
+    if ( ::getenv("OSGEARTH_NO_GLSL") )
+        _supportsGLSL = false;
+
+    return true;
 }
 
+bool
+Capabilities::writeFile( const std::string& filename ) const
+{
+    std::ofstream out( filename.c_str() );
+    if ( !out.is_open() )
+    {
+        OE_WARN << LC << "Cannot write capabilities file " << filename << std::endl;
+        return false;
+    }
+
+    out << getConfig().toJSON( true );
+    out.flush();
+    return !out.fail();
+}
+
+//------------------------------------------------------------------------
+
+CapabilitiesCheckOperation::CapabilitiesCheckOperation() :
+osg::GraphicsOperation( "osgEarth::CapabilitiesCheckOperation", false )
+{
+    //nop
+}
+
+void
+CapabilitiesCheckOperation::operator()( osg::GraphicsContext* gc )
+{
+    if ( !gc || !gc->getState() )
+        return;
+
+    Capabilities& caps = const_cast<Capabilities&>( Registry::instance()->getCapabilities() );
+
+    if ( caps._fromFile )
+    {
+        if ( caps.isSameDriver() )
+            return;
+
+        // a different GPU or driver; probe this one and replace the file.
+        OE_NOTICE << LC << "Graphics driver changed since capabilities were saved; probing again" << std::endl;
+    }
+    else if ( !caps._renderer.empty() )
+    {
+        // already probed.
+        return;
+    }
+    else
+    {
+        // the startup probe could not create a context; use the real one.
+        OE_NOTICE << LC << "Probing capabilities on the first graphics context" << std::endl;
+    }
+
+    caps.probe( gc->getState()->getContextID() );
+    caps._fromFile = false;
+
+    const char* capsFile = ::getenv( "OSGEARTH_CAPABILITIES_FILE" );
+    if ( capsFile )
+        caps.writeFile( capsFile );
+}
@@ -68,7 +68,6 @@ namespace
         GLSL_DEFAULT_PRECISION_FLOAT "\n"
 
          // uniforms from this ClampingTechnique:
-         "uniform sampler2D oe_clamp_depthTex; \n"
          "uniform mat4 oe_clamp_cameraView2depthClip; \n"
 #ifdef SUPPORT_Z
          "uniform mat4 oe_clamp_depthClip2depthView; \n"
@@ -87,6 +86,8 @@ namespace
          "varying float oe_clamp_simvertrange; \n"
          "varying float oe_clamp_alphaFactor; \n"
 
+         "float oe_clamp_sampleDepth(in vec4 depthClip); \n"
+
          "void oe_clamp_vertex(inout vec4 VertexVIEW) \n"
          "{ \n"
          //   start by mocing the vertex into view space.
@@ -104,7 +105,7 @@ namespace
          "    vec4 v_depthClip = oe_clamp_cameraView2depthClip * v_view_orig; \n"
 
          //   sample the depth map.
-         "    float d = texture2DProj( oe_clamp_depthTex, v_depthClip ).r; \n"
+         "    float d = oe_clamp_sampleDepth( v_depthClip ); \n"
 
          //   now transform into depth-view space so we can apply the height-above-ground:
          "    vec4 p_depthClip = vec4(v_depthClip.x, v_depthClip.y, d, 1.0); \n"
@@ -150,6 +151,42 @@ namespace
          "} \n";
 
 
+    // samples the depth map at a single point.
+    const char directSamplingShader[] =
+
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+
+        "uniform sampler2D oe_clamp_depthTex; \n"
+
+        "float oe_clamp_sampleDepth(in vec4 depthClip) \n"
+        "{ \n"
+        "    return texture2DProj( oe_clamp_depthTex, depthClip ).r; \n"
+        "} \n";
+
+
+    // samples the 2x2 texels around the point and keeps the nearest one --
+    // i.e. the highest terrain -- so a coarse map never sinks geometry.
+    const char conservativeSamplingShader[] =
+
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+
+        "uniform sampler2D oe_clamp_depthTex; \n"
+        "uniform vec2 oe_clamp_texelSize; \n"
+
+        "float oe_clamp_sampleDepth(in vec4 depthClip) \n"
+        "{ \n"
+        "    vec2 uv = depthClip.xy/depthClip.w; \n"
+        "    vec2 h  = 0.5*oe_clamp_texelSize; \n"
+        "    float d = texture2D( oe_clamp_depthTex, uv + vec2(-h.x, -h.y) ).r; \n"
+        "    d = min( d, texture2D( oe_clamp_depthTex, uv + vec2( h.x, -h.y) ).r ); \n"
+        "    d = min( d, texture2D( oe_clamp_depthTex, uv + vec2(-h.x,  h.y) ).r ); \n"
+        "    d = min( d, texture2D( oe_clamp_depthTex, uv + vec2( h.x,  h.y) ).r ); \n"
+        "    return d; \n"
+        "} \n";
+
+
     const char clampingFragmentShader[] =
 
         "#version " GLSL_VERSION_STR "\n"
@@ -194,6 +231,14 @@ namespace
         osg::ref_ptr<osg::Uniform>   _horizonDistanceUniform;
 
         unsigned _renderLeafCount;
+
+        // the last capture, for reuse:
+        bool         _rendered;
+        unsigned     _renderedFrame;
+        osg::Matrixd _renderedViewMatrix;
+        osg::Matrixd _renderedProjMatrix;
+
+        LocalPerViewData() : _renderLeafCount(0), _rendered(false), _renderedFrame(0) { }
     };
 }
 
@@ -273,7 +318,11 @@ static osgEarthRegisterRenderBinProxy<ClampingRenderBin> s_regbin(OSGEARTH_CLAMP
 //---------------------------------------------------------------------------
 
 ClampingTechnique::ClampingTechnique() :
-_textureSize( 4096 )
+_textureSize   ( 4096 ),
+_conservative  ( false ),
+_reuseTolerance( 0.0f ),
+_maxReuseFrames( 30 ),
+_engine        ( 0L )
 {
     // disable if GLSL is not supported
     _supported = Registry::capabilities().supportsGLSL();
@@ -314,7 +363,7 @@ ClampingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     local->_rttTexture->setTextureSize( *_textureSize, *_textureSize );
     local->_rttTexture->setInternalFormat( GL_DEPTH_COMPONENT );
     local->_rttTexture->setFilter( osg::Texture::MIN_FILTER, osg::Texture::NEAREST );
-    local->_rttTexture->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
+    local->_rttTexture->setFilter( osg::Texture::MAG_FILTER, _conservative ? osg::Texture::NEAREST : osg::Texture::LINEAR );
 
     // this is important. geometry that is outside the depth texture will clamp to the
     // closest edge value in the texture -- this is good when you are rendering a 
@@ -395,6 +444,11 @@ ClampingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
         "oe_clamp_depthTex", 
         osg::Uniform::SAMPLER_2D )->set( _textureUnit );
 
+    // size of one depth map texel, for conservative sampling:
+    local->_groupStateSet->getOrCreateUniform(
+        "oe_clamp_texelSize",
+        osg::Uniform::FLOAT_VEC2 )->set( osg::Vec2f(1.0f/float(*_textureSize), 1.0f/float(*_textureSize)) );
+
     // matrix that transforms a vert from EYE coords to the depth camera's CLIP coord.
     local->_camViewToDepthClipUniform = local->_groupStateSet->getOrCreateUniform( 
         "oe_clamp_cameraView2depthClip", 
@@ -426,6 +480,9 @@ ClampingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     vp->setName( "ClampingTechnique" );
     vp->setFunction( "oe_clamp_vertex",   clampingVertexShader,   ShaderComp::LOCATION_VERTEX_VIEW );
     vp->setFunction( "oe_clamp_fragment", clampingFragmentShader, ShaderComp::LOCATION_FRAGMENT_COLORING );
+    vp->setShader( "oe_clamp_sampleDepth", new osg::Shader(
+        osg::Shader::VERTEX,
+        _conservative ? conservativeSamplingShader : directSamplingShader ) );
     local->_groupStateSet->setAttributeAndModes( vp, osg::StateAttribute::ON );
 }
 
@@ -464,80 +521,132 @@ ClampingTechnique::cullOverlayGroup(OverlayDecorator::TechRTTParams& params,
 {
     if ( params._rttCamera.valid() && hasData(params) )
     {
-        // update the RTT camera.
-        params._rttCamera->setViewMatrix      ( params._rttViewMatrix );
-        params._rttCamera->setProjectionMatrix( params._rttProjMatrix );
-
         LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
 
-        // prime our CPM with the current cull visitor:
-        //local._cpm->setup( cv );
+        // decide whether last frame's depth map is still close enough to use.
+        unsigned frame = cv->getFrameStamp() ? cv->getFrameStamp()->getFrameNumber() : 0u;
+        bool reuse =
+            _reuseTolerance > 0.0f &&
+            local._rendered &&
+            frame - local._renderedFrame < _maxReuseFrames &&
+            getProjectionDrift(
+                local._renderedViewMatrix * local._renderedProjMatrix,
+                params._rttViewMatrix * params._rttProjMatrix ) <= (double)_reuseTolerance;
+
+        if ( !reuse )
+        {
+            // update the RTT camera.
+            params._rttCamera->setViewMatrix      ( params._rttViewMatrix );
+            params._rttCamera->setProjectionMatrix( params._rttProjMatrix );
+
+            // create the depth texture (render the terrain to tex)
+            params._rttCamera->accept( *cv );
+
+            local._rendered           = true;
+            local._renderedFrame      = frame;
+            local._renderedViewMatrix = params._rttViewMatrix;
+            local._renderedProjMatrix = params._rttProjMatrix;
+        }
+
+        cullClampedGroup( params, local._rttTexture.get(), local._renderedViewMatrix, local._renderedProjMatrix, cv );
+    }
+}
+
+
+bool
+ClampingTechnique::cullSharedOverlayGroup(OverlayDecorator::TechRTTParams& params,
+                                          OverlayDecorator::TechRTTParams& source,
+                                          osgUtil::CullVisitor*            cv )
+{
+    if ( !params._rttCamera.valid() || !source._techniqueData.valid() || !hasData(params) )
+        return false;
+
+    const LocalPerViewData& sourceLocal = *static_cast<const LocalPerViewData*>(source._techniqueData.get());
+    if ( !sourceLocal._rendered )
+        return false;
+
+    // clamp against the source's depth map; nothing to render.
+    cullClampedGroup( params, sourceLocal._rttTexture.get(), sourceLocal._renderedViewMatrix, sourceLocal._renderedProjMatrix, cv );
+    return true;
+}
+
+
+void
+ClampingTechnique::cullClampedGroup(OverlayDecorator::TechRTTParams& params,
+                                    osg::Texture*                    depthTexture,
+                                    const osg::Matrixd&              rttViewMatrix,
+                                    const osg::Matrixd&              rttProjMatrix,
+                                    osgUtil::CullVisitor*            cv )
+{
+    LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
 
-        // create the depth texture (render the terrain to tex)
-        params._rttCamera->accept( *cv );
+    // bind the depth map to clamp against (ours, or one we are sharing).
+    if ( local._groupStateSet->getTextureAttribute(_textureUnit, osg::StateAttribute::TEXTURE) != depthTexture )
+    {
+        local._groupStateSet->setTextureAttributeAndModes( _textureUnit, depthTexture, osg::StateAttribute::ON );
+    }
 
-        // construct a matrix that transforms from camera view coords to depth texture
-        // clip coords directly. This will avoid precision loss in the 32-bit shader.
-        static osg::Matrix s_scaleBiasMat = 
-            osg::Matrix::translate(1.0,1.0,1.0) * 
-            osg::Matrix::scale    (0.5,0.5,0.5);
+    // construct a matrix that transforms from camera view coords to depth texture
+    // clip coords directly. This will avoid precision loss in the 32-bit shader.
+    static osg::Matrix s_scaleBiasMat = 
+        osg::Matrix::translate(1.0,1.0,1.0) * 
+        osg::Matrix::scale    (0.5,0.5,0.5);
 
-        static osg::Matrix s_invScaleBiasMat = osg::Matrix::inverse(
-            osg::Matrix::translate(1.0,1.0,1.0) * 
-            osg::Matrix::scale    (0.5,0.5,0.5) );
+    static osg::Matrix s_invScaleBiasMat = osg::Matrix::inverse(
+        osg::Matrix::translate(1.0,1.0,1.0) * 
+        osg::Matrix::scale    (0.5,0.5,0.5) );
 
-        osg::Matrix cameraViewToDepthView =
-            cv->getCurrentCamera()->getInverseViewMatrix() * 
-            params._rttViewMatrix;
+    osg::Matrix cameraViewToDepthView =
+        cv->getCurrentCamera()->getInverseViewMatrix() * 
+        rttViewMatrix;
 
-        osg::Matrix depthViewToDepthClip = 
-            //local._cpm->_clampedDepthProjMatrix *
-            params._rttProjMatrix *
-            s_scaleBiasMat;
+    osg::Matrix depthViewToDepthClip = 
+        //local._cpm->_clampedDepthProjMatrix *
+        rttProjMatrix *
+        s_scaleBiasMat;
 
-        osg::Matrix cameraViewToDepthClip =
-            cameraViewToDepthView *
-            depthViewToDepthClip;
-        local._camViewToDepthClipUniform->set( cameraViewToDepthClip );
+    osg::Matrix cameraViewToDepthClip =
+        cameraViewToDepthView *
+        depthViewToDepthClip;
+    local._camViewToDepthClipUniform->set( cameraViewToDepthClip );
 
-        local._horizonDistanceUniform->set( float(*params._horizonDistance) );
+    local._horizonDistanceUniform->set( float(*params._horizonDistance) );
 
-        //OE_NOTICE << "HD = " << std::setprecision(8) << float(*params._horizonDistance) << std::endl;
+    //OE_NOTICE << "HD = " << std::setprecision(8) << float(*params._horizonDistance) << std::endl;
 
 #if SUPPORT_Z
-        osg::Matrix depthClipToDepthView;
-        depthClipToDepthView.invert( depthViewToDepthClip );
-        local._depthClipToDepthViewUniform->set( depthClipToDepthView );
+    osg::Matrix depthClipToDepthView;
+    depthClipToDepthView.invert( depthViewToDepthClip );
+    local._depthClipToDepthViewUniform->set( depthClipToDepthView );
 
-        osg::Matrix depthViewToCameraView;
-        depthViewToCameraView.invert( cameraViewToDepthView );
-        local._depthViewToCamViewUniform->set( depthViewToCameraView );
+    osg::Matrix depthViewToCameraView;
+    depthViewToCameraView.invert( cameraViewToDepthView );
+    local._depthViewToCamViewUniform->set( depthViewToCameraView );
 #else
 
-        osg::Matrix depthClipToCameraView;
-        depthClipToCameraView.invert( cameraViewToDepthClip );
-        local._depthClipToCamViewUniform->set( depthClipToCameraView );
+    osg::Matrix depthClipToCameraView;
+    depthClipToCameraView.invert( cameraViewToDepthClip );
+    local._depthClipToCamViewUniform->set( depthClipToCameraView );
 #endif
 
-        if ( params._group->getNumChildren() > 0 )
-        {
-            // traverse the overlay nodes, applying the clamping shader.
-            cv->pushStateSet( local._groupStateSet.get() );
-
-            // Since the vertex shader is moving the verts to clamp them to the terrain,
-            // OSG will not be able to properly cull the geometry. (Specifically: OSG may
-            // cull geometry which is invisible when NOT clamped, but becomes visible after
-            // GPU clamping.) We work around that by using a Proxy cull visitor that will 
-            // use the RTT camera's matrixes for frustum culling (instead of the main camera's).
-            ProxyCullVisitor pcv( cv, params._rttProjMatrix, params._rttViewMatrix );
-
-            // cull the clampable geometry.
-            params._group->accept( pcv );
-            //params._group->accept( *cv ); // old way - direct traversal
-
-            // done; pop the clamping shaders.
-            cv->popStateSet();
-        }
+    if ( params._group->getNumChildren() > 0 )
+    {
+        // traverse the overlay nodes, applying the clamping shader.
+        cv->pushStateSet( local._groupStateSet.get() );
+
+        // Since the vertex shader is moving the verts to clamp them to the terrain,
+        // OSG will not be able to properly cull the geometry. (Specifically: OSG may
+        // cull geometry which is invisible when NOT clamped, but becomes visible after
+        // GPU clamping.) We work around that by using a Proxy cull visitor that will 
+        // use the RTT camera's matrixes for frustum culling (instead of the main camera's).
+        ProxyCullVisitor pcv( cv, rttProjMatrix, rttViewMatrix );
+
+        // cull the clampable geometry.
+        params._group->accept( pcv );
+        //params._group->accept( *cv ); // old way - direct traversal
+
+        // done; pop the clamping shaders.
+        cv->popStateSet();
     }
 }
 
@@ -552,6 +661,14 @@ ClampingTechnique::setTextureSize( int texSize )
 }
 
 
+void
+ClampingTechnique::setConservativeFiltering( bool value )
+{
+    // takes effect for views set up after the change.
+    _conservative = value;
+}
+
+
 void
 ClampingTechnique::onInstall( TerrainEngineNode* engine )
 {
@@ -81,6 +81,8 @@ ColorFilterRegistry::writeChain(const ColorFilterChain& chain, Config& out_confi
         Config conf = i->get()->getConfig();
         if ( !conf.empty() )
         {
+            if ( i->get()->isConstant() )
+                conf.set( "constant", true );
             out_config.add( conf );
             wroteAtLeastOne = true;
         }
@@ -106,6 +108,7 @@ ColorFilterRegistry::createOne(const Config& conf) const
         ColorFilter* object = f->second->create(conf);
         if ( object )
         {
+            object->setConstant( conf.value<bool>("constant", false) );
             return object;
         }
     }
@@ -21,7 +21,9 @@
 #include <osgEarth/StringUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/Progress>
+#include <osgEarth/TaskService>
 #include <osgDB/FileNameUtils>
+#include <OpenThreads/Thread>
 
 #define LC "[CompositeTileSource] "
 
@@ -119,6 +121,76 @@ namespace
 
         ImageLayerTileProcessor _processor;
     };
+
+    /**
+     * Fetches one component's image. Whoever claims the task first runs it:
+     * a service thread, or the requesting thread, which works through its own
+     * queued tasks instead of waiting behind other requests (and so can't
+     * deadlock when composites nest).
+     */
+    struct FetchComponent : public TaskRequest
+    {
+        FetchComponent() { }
+
+        bool claim() { return _claimed.exchange( 1u ) == 0u; }
+
+        void operator()( ProgressCallback* )
+        {
+            if ( claim() )
+                fetch();
+        }
+
+        void fetch()
+        {
+            if ( !_callback.valid() || !_callback->isCanceled() )
+                _image = _source->createImage( _key, _op.get(), _callback.get() );
+            _done.set();
+        }
+
+        osg::ref_ptr<TileSource>                   _source;
+        TileKey                                    _key;
+        osg::ref_ptr<ImageLayerPreCacheOperation>  _op;
+        osg::ref_ptr<ProgressCallback>             _callback;  // (TaskRequest has its own _progress)
+        osg::ref_ptr<osg::Image>                   _image;
+        OpenThreads::Atomic                        _claimed;
+        Threading::Event                           _done;
+    };
+
+    Threading::Mutex          s_fetchServiceMutex;
+    osg::ref_ptr<TaskService> s_fetchService;
+
+    TaskService* getFetchService()
+    {
+        Threading::ScopedMutexLock lock( s_fetchServiceMutex );
+        if ( !s_fetchService.valid() )
+        {
+            s_fetchService = new TaskService(
+                "CompositeTileSource",
+                osg::maximum( 8, 2*OpenThreads::GetNumberOfProcessors() ) );
+        }
+        return s_fetchService.get();
+    }
+
+    /** Whether every pixel of an image is fully opaque. */
+    bool isOpaque( const osg::Image* image )
+    {
+        if ( !ImageUtils::hasAlphaChannel(image) )
+            return true;
+
+        if ( image->getPixelFormat() == GL_RGBA && image->getDataType() == GL_UNSIGNED_BYTE )
+        {
+            for( int t=0; t<image->t(); ++t )
+            {
+                const unsigned char* p = image->data(0, t);
+                for( int s=0; s<image->s(); ++s, p += 4 )
+                    if ( p[3] != 255 )
+                        return false;
+            }
+            return true;
+        }
+
+        return !ImageUtils::hasTransparency( image, 0.999f );
+    }
 }
 
 //-----------------------------------------------------------------------
@@ -168,18 +240,18 @@ CompositeTileSource::createImage(const TileKey&    key,
     ImageMixVector images;
     images.reserve( _options._components.size() );
 
+    // Components are composited bottom (first) to top (last). Work out which
+    // ones might have data here without any I/O, then fetch those together.
+    typedef std::vector< osg::ref_ptr<FetchComponent> > FetchVector;
+    FetchVector fetches( _options._components.size() );
+
     for(CompositeTileSourceOptions::ComponentVector::const_iterator i = _options._components.begin();
         i != _options._components.end();
         ++i )
     {
-        if ( progress && progress->isCanceled() )
-            return 0L;
-
         ImageInfo imageInfo;
         imageInfo.dataInExtents = false;
 
-
-
         TileSource* source = i->_tileSourceInstance.get();
         if ( source )
         {
@@ -212,47 +284,112 @@ CompositeTileSource::createImage(const TileKey&    key,
             if (minLevel > (int)key.getLevelOfDetail() ||
                 maxLevel < (int)key.getLevelOfDetail() )
             {
+                // (push an empty entry; it keeps indices lined up with the components)
+                images.push_back( imageInfo );
                 continue;
             }
-            
-                //Only try to get data if the source actually has data                
-                if (source->hasDataInExtent( key.getExtent() ) )
-                {
-                    //We have data within these extents
-                    imageInfo.dataInExtents = true;
 
-                    if ( !source->getBlacklist()->contains( key.getTileId() ) )
-                    {                        
-                        osg::ref_ptr< ImageLayerPreCacheOperation > preCacheOp;
-                        if ( i->_imageLayerOptions.isSet() )
-                        {
-                            preCacheOp = new ImageLayerPreCacheOperation();
-                            preCacheOp->_processor.init( i->_imageLayerOptions.value(), _dbOptions.get(), true );                        
-                        }
-
-                        imageInfo.image = source->createImage( key, preCacheOp.get(), progress );
-                        imageInfo.opacity = 1.0f;
+            //Only try to get data if the source actually has data
+            if (source->hasDataInExtent( key.getExtent() ) )
+            {
+                //We have data within these extents
+                imageInfo.dataInExtents = true;
+                imageInfo.opacity = i->_imageLayerOptions.isSet() ? i->_imageLayerOptions->opacity().value() : 1.0f;
 
-                        //If the image is not valid and the progress was not cancelled, blacklist
-                        if (!imageInfo.image.valid() && (!progress || !progress->isCanceled()))
-                        {
-                            //Add the tile to the blacklist
-                            OE_DEBUG << LC << "Adding tile " << key.str() << " to the blacklist" << std::endl;
-                            source->getBlacklist()->add( key.getTileId() );
-                        }
-                        imageInfo.opacity = i->_imageLayerOptions.isSet() ? i->_imageLayerOptions->opacity().value() : 1.0f;
-                    }
-                }
-                else
+                // no data at this level means a parent fallback below, so don't ask.
+                if ( source->hasData( key ) && !source->getBlacklist()->contains( key.getTileId() ) )
                 {
-                    OE_DEBUG << LC << "Source has no data at " << key.str() << std::endl;
+                    FetchComponent* fetch = new FetchComponent();
+                    fetch->_source   = source;
+                    fetch->_key      = key;
+                    fetch->_callback = progress;
+                    if ( i->_imageLayerOptions.isSet() )
+                    {
+                        fetch->_op = new ImageLayerPreCacheOperation();
+                        fetch->_op->_processor.init( i->_imageLayerOptions.value(), _dbOptions.get(), true );
+                    }
+                    fetches[images.size()] = fetch;
                 }
+            }
+            else
+            {
+                OE_DEBUG << LC << "Source has no data at " << key.str() << std::endl;
+            }
         }
 
         //Add the ImageInfo to the list
         images.push_back( imageInfo );
     }
 
+    // Queue all but the top fetch, then work down from the top: run what no
+    // service thread has started yet, and wait for what one has. Once an
+    // opaque component covers the tile, nothing below it can show through,
+    // so the fetches below it are dropped (those not yet started never run).
+    int top = -1;
+    for( int i = (int)fetches.size()-1; i >= 0 && top < 0; --i )
+        if ( fetches[i].valid() )
+            top = i;
+
+    if ( top > 0 )
+    {
+        TaskService* service = getFetchService();
+        for( int i = 0; i < top; ++i )
+            if ( fetches[i].valid() )
+                service->add( fetches[i].get() );
+    }
+
+    int coveredBelow = -1;
+    for( int i = top; i >= 0; --i )
+    {
+        FetchComponent* fetch = fetches[i].get();
+        ImageInfo& info = images[i];
+
+        if ( i < coveredBelow )
+        {
+            if ( fetch )
+                fetch->claim();
+            info.image = 0L;
+            info.dataInExtents = false;
+            continue;
+        }
+
+        if ( !fetch )
+            continue;
+
+        if ( fetch->claim() )
+            fetch->fetch();
+        else
+            fetch->_done.wait();
+
+        info.image = fetch->_image.get();
+
+        //If the image is not valid and the progress was not cancelled, blacklist
+        if ( !info.image.valid() && (!progress || !progress->isCanceled()) )
+        {
+            //Add the tile to the blacklist
+            OE_DEBUG << LC << "Adding tile " << key.str() << " to the blacklist" << std::endl;
+            fetch->_source->getBlacklist()->add( key.getTileId() );
+        }
+
+        if ( info.image.valid() && info.opacity >= 1.0f && coveredBelow < 0 && isOpaque(info.image.get()) )
+        {
+            coveredBelow = i;
+        }
+    }
+
+    if ( progress && progress->isCanceled() )
+        return 0L;
+
+    // an opaque component also covers anything that would fall back below it.
+    if ( coveredBelow > 0 )
+    {
+        for( int i = 0; i < coveredBelow; ++i )
+        {
+            images[i].image = 0L;
+            images[i].dataInExtents = false;
+        }
+    }
+
     unsigned numValidImages = 0;
     osg::Vec2s textureSize;
     for (unsigned int i = 0; i < images.size(); i++)
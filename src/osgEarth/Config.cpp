@@ -25,14 +25,26 @@
 #include <sstream>
 #include <fstream>
 #include <iomanip>
+#include <vector>
 
 using namespace osgEarth;
 
+const ConfigSet&
+Config::emptyChildren()
+{
+    static const ConfigSet s_empty;
+    return s_empty;
+}
+
 void
 Config::setReferrer( const std::string& referrer )
 {
     _referrer = referrer;
-    for( ConfigSet::iterator i = _children.begin(); i != _children.end(); i++ )
+    if ( children().empty() )
+        return;
+
+    ConfigSet& kids = mutableChildren();
+    for( ConfigSet::iterator i = kids.begin(); i != kids.end(); i++ )
     { 
         i->setReferrer( osgEarth::getFullPath(_referrer, i->_referrer) );
     }
@@ -56,14 +68,17 @@ Config::fromXML( std::istream& in )
 {
     osg::ref_ptr<XmlDocument> xml = XmlDocument::load( in );
     if ( xml.valid() )
-        *this = xml->getConfig();
+    {
+        Config conf = xml->getConfig();
+        swap( conf );
+    }
     return xml.valid();
 }
 
 Config
 Config::child( const std::string& childName ) const
 {
-    for( ConfigSet::const_iterator i = _children.begin(); i != _children.end(); i++ ) {
+    for( ConfigSet::const_iterator i = children().begin(); i != children().end(); i++ ) {
         if ( i->key() == childName )
             return *i;
     }
@@ -76,7 +91,7 @@ Config::child( const std::string& childName ) const
 const Config*
 Config::child_ptr( const std::string& childName ) const
 {
-    for( ConfigSet::const_iterator i = _children.begin(); i != _children.end(); i++ ) {
+    for( ConfigSet::const_iterator i = children().begin(); i != children().end(); i++ ) {
         if ( i->key() == childName )
             return &(*i);
     }
@@ -86,7 +101,11 @@ Config::child_ptr( const std::string& childName ) const
 Config*
 Config::mutable_child( const std::string& childName )
 {
-    for( ConfigSet::iterator i = _children.begin(); i != _children.end(); i++ ) {
+    if ( !hasChild(childName) )
+        return 0L;
+
+    ConfigSet& kids = mutableChildren();
+    for( ConfigSet::iterator i = kids.begin(); i != kids.end(); i++ ) {
         if ( i->key() == childName )
             return &(*i);
     }
@@ -98,11 +117,11 @@ void
 Config::merge( const Config& rhs ) 
 {
     // remove any matching keys first; this will allow the addition of multi-key values
-    for( ConfigSet::const_iterator c = rhs._children.begin(); c != rhs._children.end(); ++c )
+    for( ConfigSet::const_iterator c = rhs.children().begin(); c != rhs.children().end(); ++c )
         remove( c->key() );
 
     // add in the new values.
-    for( ConfigSet::const_iterator c = rhs._children.begin(); c != rhs._children.end(); ++c )
+    for( ConfigSet::const_iterator c = rhs.children().begin(); c != rhs.children().end(); ++c )
         add( *c );
 }
 
@@ -112,11 +131,11 @@ Config::find( const std::string& key, bool checkMe ) const
     if ( checkMe && key == this->key() )
         return this;
 
-    for( ConfigSet::const_iterator c = _children.begin(); c != _children.end(); ++c )
+    for( ConfigSet::const_iterator c = children().begin(); c != children().end(); ++c )
         if ( key == c->key() )
             return &(*c);
 
-    for( ConfigSet::const_iterator c = _children.begin(); c != _children.end(); ++c )
+    for( ConfigSet::const_iterator c = children().begin(); c != children().end(); ++c )
     {
         const Config* r = c->find(key, false);
         if ( r ) return r;
@@ -131,11 +150,16 @@ Config::find( const std::string& key, bool checkMe )
     if ( checkMe && key == this->key() )
         return this;
 
-    for( ConfigSet::iterator c = _children.begin(); c != _children.end(); ++c )
+    // search the shared list first so that only the path to a match gets unshared.
+    if ( !static_cast<const Config*>(this)->find(key, false) )
+        return 0L;
+
+    ConfigSet& kids = mutableChildren();
+    for( ConfigSet::iterator c = kids.begin(); c != kids.end(); ++c )
         if ( key == c->key() )
             return &(*c);
 
-    for( ConfigSet::iterator c = _children.begin(); c != _children.end(); ++c )
+    for( ConfigSet::iterator c = kids.begin(); c != kids.end(); ++c )
     {
         Config* r = c->find(key, false);
         if ( r ) return r;
@@ -183,65 +207,162 @@ namespace
         return value;
     }
 
-    void json2conf( const Json::Value& json, Config& conf )
+    /**
+     * Builds a Config straight from the events of a Json::StreamReader, with
+     * the same mapping conf2json() writes and Config has always read:
+     * - an object with a single scalar member becomes a simple key/value Config;
+     * - "$key" and "$value" members set the key and value;
+     * - the elements of a "$children" array become children;
+     * - any other array or object becomes a child, named after the member,
+     *   holding its contents;
+     * - any other scalar member becomes a simple child.
+     */
+    struct ConfigBuilder : public Json::StreamHandler
     {
-        if ( json.type() == Json::objectValue )
+        struct Frame
+        {
+            Frame( bool isObject ) : _isObject(isObject), _numMembers(0), _hasPending(false) { }
+            Config      _conf;
+            bool        _isObject;
+            std::string _member;      // name of the member being read (objects)
+            unsigned    _numMembers;
+            bool        _hasPending;  // first scalar member, held back for the single-member rule
+            std::string _pendingName;
+            std::string _pendingValue;
+        };
+
+        ConfigBuilder( const Config& target ) : _root(target) { }
+
+        Config             _root;
+        std::vector<Frame> _frames;
+
+        static void addMember( Config& conf, const std::string& name, const std::string& value )
         {
-            Json::Value::Members members = json.getMemberNames();
+            if ( name == "$key" )
+                conf.key() = value;
+            else if ( name == "$value" )
+                conf.value() = value;
+            else
+                conf.add( name, value );
+        }
 
-            if ( members.size() == 1 )
+        static void flushPending( Frame& frame )
+        {
+            if ( frame._hasPending )
+            {
+                addMember( frame._conf, frame._pendingName, frame._pendingValue );
+                frame._hasPending = false;
+            }
+        }
+
+        void open( bool isObject )
+        {
+            if ( !_frames.empty() && _frames.back()._isObject )
+            {
+                flushPending( _frames.back() );
+                _frames.back()._numMembers++;
+            }
+
+            _frames.push_back( Frame(isObject) );
+
+            // the outermost container builds on top of the target itself.
+            if ( _frames.size() == 1 )
+                _frames.back()._conf.swap( _root );
+        }
+
+        void close()
+        {
+            Frame& frame = _frames.back();
+            if ( frame._isObject )
             {
-                const Json::Value& value = json[members[0]];
-                if ( value.type() != Json::nullValue && value.type() != Json::objectValue && value.type() != Json::arrayValue )
+                if ( frame._numMembers == 1 && frame._hasPending )
                 {
-                    conf.key() = members[0];
-                    conf.value() = value.asString();
-                    return;
+                    frame._conf.key()   = frame._pendingName;
+                    frame._conf.value() = frame._pendingValue;
+                    frame._hasPending   = false;
                 }
+                flushPending( frame );
             }
 
-            for( Json::Value::Members::const_iterator i = members.begin(); i != members.end(); ++i )
+            Config done;
+            done.swap( frame._conf );
+            bool isArray = !frame._isObject;
+            _frames.pop_back();
+
+            if ( _frames.empty() )
+            {
+                _root.swap( done );
+                return;
+            }
+
+            Frame& parent = _frames.back();
+            if ( parent._isObject )
             {
-                const Json::Value& value = json[*i];
-                if ( (*i) == "$key" )
+                if ( isArray && parent._member == "$children" )
                 {
-                    conf.key() = value.asString();
+                    for( ConfigSet::const_iterator i = done.children().begin(); i != done.children().end(); ++i )
+                        parent._conf.add( *i );
                 }
-                else if ( (*i) == "$value" )
+                else if ( isArray || done.key().empty() )
                 {
-                    conf.value() = value.asString();
+                    done.key() = parent._member;
+                    parent._conf.add( done );
                 }
-                else if ( (*i) == "$children" && value.isArray() )
+                else
                 {
-                    json2conf( value, conf );
+                    Config element( parent._member );
+                    element.add( done );
+                    parent._conf.add( element );
                 }
-                else if ( value.isArray() )
+            }
+            else if ( !done.empty() )
+            {
+                parent._conf.add( done );
+            }
+        }
+
+        bool startObject() { open(true);  return true; }
+        bool startArray()  { open(false); return true; }
+        bool endObject()   { close(); return true; }
+        bool endArray()    { close(); return true; }
+
+        bool key( const std::string& name )
+        {
+            _frames.back()._member = name;
+            return true;
+        }
+
+        bool value( const std::string& text, Json::ValueType type )
+        {
+            // numbers keep their source text, so no precision is lost.
+            if ( _frames.empty() )
+            {
+                _root.value() = text;
+            }
+            else if ( _frames.back()._isObject )
+            {
+                Frame& frame = _frames.back();
+                flushPending( frame );
+                if ( ++frame._numMembers == 1 && type != Json::nullValue )
                 {
-                    Config element( *i );
-                    json2conf( value, element );
-                    conf.add( element );
+                    frame._hasPending   = true;
+                    frame._pendingName  = frame._member;
+                    frame._pendingValue = text;
                 }
                 else
                 {
-                    conf.add( *i, value.asString() );
+                    addMember( frame._conf, frame._member, text );
                 }
             }
-        }
-        else if ( json.type() == Json::arrayValue )
-        {          
-            for( Json::Value::const_iterator j = json.begin(); j != json.end(); ++j )
+            else if ( !text.empty() )
             {
                 Config child;
-                json2conf( *j, child );
-                if ( !child.empty() )
-                    conf.add( child );
+                child.value() = text;
+                _frames.back()._conf.add( child );
             }
+            return true;
         }
-        else if ( json.type() != Json::nullValue )
-        {
-            conf.value() = json.asString();
-        }
-    }
+    };
 }
 
 std::string
@@ -257,11 +378,12 @@ Config::toJSON( bool pretty ) const
 bool
 Config::fromJSON( const std::string& input )
 {
-    Json::Reader reader;
-    Json::Value root( Json::objectValue );
-    if ( reader.parse( input, root ) )
+    // stream the document straight into a Config; no intermediate Json::Value tree.
+    ConfigBuilder builder( *this );
+    Json::StreamReader reader;
+    if ( reader.parse( input, builder ) )
     {
-        json2conf( root, *this );
+        swap( builder._root );
         return true;
     }
     return false;
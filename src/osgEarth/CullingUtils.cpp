@@ -21,9 +21,14 @@
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/DPLineSegmentIntersector>
 #include <osgEarth/GeoData>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/ThreadingUtils>
 #include <osg/ClusterCullingCallback>
 #include <osg/PrimitiveSet>
 #include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Point>
 #include <osg/TemplatePrimitiveFunctor>
 #include <osgUtil/CullVisitor>
 #include <osgUtil/IntersectionVisitor>
@@ -562,6 +567,91 @@ CullNodeByHorizon::operator()(osg::Node* node, osg::NodeVisitor* nv)
 
 //------------------------------------------------------------------------
 
+namespace
+{
+    // Magnitude, along a unit direction, of the lowest point that still
+    // hides "p" (in scaled space) whenever it is itself behind the horizon.
+    // Negative means no such point exists.
+    double horizonCullingMagnitude( const osg::Vec3d& p, const osg::Vec3d& direction )
+    {
+        // points below the ellipsoid count as being on it.
+        double magnitude2 = osg::maximum( 1.0, p.length2() );
+        double magnitude  = sqrt( magnitude2 );
+
+        osg::Vec3d dirToPoint = p;
+        dirToPoint.normalize();
+
+        double cosAlpha = dirToPoint * direction;
+        double sinAlpha = (dirToPoint ^ direction).length();
+        double cosBeta  = 1.0/magnitude;
+        double sinBeta  = sqrt( magnitude2 - 1.0 ) * cosBeta;
+
+        double denom = cosAlpha*cosBeta - sinAlpha*sinBeta;
+        return denom > 0.0 ? 1.0/denom : -1.0;
+    }
+}
+
+HorizonCullingCallback::HorizonCullingCallback(const std::vector<osg::Vec3d>& boundingPoints,
+                                               const osg::EllipsoidModel*     ellipsoid ) :
+_valid( false )
+{
+    if ( !ellipsoid || boundingPoints.empty() )
+        return;
+
+    _invRadii.set(
+        1.0/ellipsoid->getRadiusEquator(),
+        1.0/ellipsoid->getRadiusEquator(),
+        1.0/ellipsoid->getRadiusPolar() );
+
+    // aim the culling point through the centroid of the samples.
+    osg::Vec3d direction;
+    for( unsigned i = 0; i < boundingPoints.size(); ++i )
+        direction += osg::componentMultiply( boundingPoints[i], _invRadii );
+    if ( direction.normalize() == 0.0 )
+        return;
+
+    double magnitude = 0.0;
+    for( unsigned i = 0; i < boundingPoints.size(); ++i )
+    {
+        double m = horizonCullingMagnitude( osg::componentMultiply(boundingPoints[i], _invRadii), direction );
+        if ( m < 0.0 )
+            return;
+        magnitude = osg::maximum( magnitude, m );
+    }
+
+    _cullingPoint = direction * magnitude;
+    _valid = true;
+}
+
+bool
+HorizonCullingCallback::isOccluded(const osg::Vec3d& viewPoint) const
+{
+    if ( !_valid )
+        return false;
+
+    osg::Vec3d eye = osg::componentMultiply( viewPoint, _invRadii );
+
+    // a viewpoint inside the ellipsoid has no horizon to speak of.
+    double vh2 = eye.length2() - 1.0;
+    if ( vh2 <= 0.0 )
+        return false;
+
+    osg::Vec3d vt = _cullingPoint - eye;
+    double vtDotVc = -(vt * eye);
+    return vtDotVc > vh2 && vtDotVc*vtDotVc/vt.length2() > vh2;
+}
+
+void
+HorizonCullingCallback::operator()(osg::Node* node, osg::NodeVisitor* nv)
+{
+    if ( nv && nv->getVisitorType() == nv->CULL_VISITOR && isOccluded(nv->getViewPoint()) )
+        return;
+
+    traverse( node, nv );
+}
+
+//------------------------------------------------------------------------
+
 CullNodeByNormal::CullNodeByNormal( const osg::Vec3d& normal )
 {
     _normal = normal;
@@ -1051,3 +1141,74 @@ LODScaleGroup::traverse(osg::NodeVisitor& nv)
 
     osg::Group::traverse( nv );
 }
+
+//------------------------------------------------------------------------
+
+OcclusionQueryGroup::OcclusionQueryGroup( unsigned queryFrameCount, unsigned visibilityThreshold ) :
+_queryPointSize( 5.0f )
+{
+    setQueryFrameCount( osg::maximum(queryFrameCount, 1u) );
+    setVisibilityThreshold( visibilityThreshold );
+    setDebugDisplay( false );
+
+    // the query must run after the terrain has written the depth buffer.
+    getQueryStateSet()->setRenderBinDetails( 9, "RenderBin" );
+
+    setQueriesEnabled( Registry::capabilities().supportsOcclusionQuery() );
+}
+
+void
+OcclusionQueryGroup::setQueryPoint( const osg::Vec3d& point )
+{
+    _queryPoint = point;
+    dirtyBound();
+}
+
+void
+OcclusionQueryGroup::clearQueryPoint()
+{
+    _queryPoint.unset();
+    dirtyBound();
+}
+
+void
+OcclusionQueryGroup::setQueryPointSize( float value )
+{
+    _queryPointSize = value;
+    dirtyBound();
+}
+
+osg::BoundingSphere
+OcclusionQueryGroup::computeBound() const
+{
+    // box query: the base class fits the query geometry to the children.
+    if ( !_queryPoint.isSet() )
+        return osg::OcclusionQueryNode::computeBound();
+
+    {
+        // same locking as the base class; this can run in the update
+        // traversal or from an application thread.
+        Threading::ScopedMutexLock lock( _computeBoundMutex );
+
+        OcclusionQueryGroup* nonConstThis = const_cast<OcclusionQueryGroup*>( this );
+
+        osg::ref_ptr<osg::Vec3Array> v = new osg::Vec3Array(1);
+        (*v)[0] = *_queryPoint;
+
+        osg::Geometry* geom = static_cast<osg::Geometry*>( nonConstThis->_queryGeode->getDrawable(0) );
+        geom->setVertexArray( v.get() );
+        geom->getPrimitiveSetList().clear();
+        geom->addPrimitiveSet( new osg::DrawArrays(GL_POINTS, 0, 1) );
+        geom->dirtyBound();
+        nonConstThis->getQueryStateSet()->setAttributeAndModes( new osg::Point(_queryPointSize), 1 );
+
+        geom = static_cast<osg::Geometry*>( nonConstThis->_debugGeode->getDrawable(0) );
+        geom->setVertexArray( v.get() );
+        geom->getPrimitiveSetList().clear();
+        geom->addPrimitiveSet( new osg::DrawArrays(GL_POINTS, 0, 1) );
+        geom->dirtyBound();
+        nonConstThis->getDebugStateSet()->setAttributeAndModes( new osg::Point(_queryPointSize), 1 );
+    }
+
+    return osg::Group::computeBound();
+}
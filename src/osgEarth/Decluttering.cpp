@@ -25,6 +25,8 @@
 #include <osgUtil/StateGraph>
 #include <osgText/Text>
 #include <osg/UserDataContainer>
+#include <osg/Viewport>
+#include <osg/Math>
 #include <set>
 #include <algorithm>
 
@@ -32,6 +34,9 @@
 
 #define FADE_UNIFORM_NAME "oe_declutter_fade"
 
+// size of a cell in the screen-space occupancy grid, in pixels
+#define DECLUTTER_GRID_CELL_SIZE 64.0
+
 using namespace osgEarth;
 
 //----------------------------------------------------------------------------
@@ -86,6 +91,97 @@ namespace
     
     typedef std::pair<const osg::Node*, osg::BoundingBox> RenderLeafBox;
 
+    /**
+     * Uniform screen-space grid over the occupied window-space boxes. Each cell
+     * lists the boxes that touch it, so an occupancy test only has to look at
+     * the boxes in the cells its own box covers instead of at every box.
+     * Boxes that extend past the viewport are clamped into the edge cells.
+     */
+    struct DeclutterGrid
+    {
+        DeclutterGrid() : _numCols(0), _numRows(0) { }
+
+        // clears the grid and fits it to a viewport. Cell storage is kept for re-use.
+        void reset( const osg::Viewport* vp, const std::vector<RenderLeafBox>* boxes )
+        {
+            _boxes   = boxes;
+            _x0      = vp->x();
+            _y0      = vp->y();
+            _numCols = std::max( 1, (int)ceil(vp->width() / DECLUTTER_GRID_CELL_SIZE) );
+            _numRows = std::max( 1, (int)ceil(vp->height() / DECLUTTER_GRID_CELL_SIZE) );
+
+            if ( _cells.size() < (unsigned)(_numCols*_numRows) )
+                _cells.resize( _numCols*_numRows );
+            for( unsigned i = 0; i < _cells.size(); ++i )
+                _cells[i].clear();
+        }
+
+        // whether the box overlaps a recorded box with a different parent.
+        bool isOccupied( const osg::BoundingBox& box, const osg::Node* parent ) const
+        {
+            int c0, c1, r0, r1;
+            getRange( box, c0, c1, r0, r1 );
+            for( int r = r0; r <= r1; ++r )
+            {
+                for( int c = c0; c <= c1; ++c )
+                {
+                    const std::vector<unsigned>& cell = _cells[r*_numCols + c];
+                    for( std::vector<unsigned>::const_iterator i = cell.begin(); i != cell.end(); ++i )
+                    {
+                        const RenderLeafBox& used = (*_boxes)[*i];
+
+                        // only need a 2D test since we're in clip space
+                        bool isClear =
+                            box.xMin() > used.second.xMax() ||
+                            box.xMax() < used.second.xMin() ||
+                            box.yMin() > used.second.yMax() ||
+                            box.yMax() < used.second.yMin();
+
+                        // an overlap with a drawable of the same parent is acceptable.
+                        if ( !isClear && parent != used.first )
+                            return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        // records the box at the specified index in the box list.
+        void insert( unsigned index )
+        {
+            int c0, c1, r0, r1;
+            getRange( (*_boxes)[index].second, c0, c1, r0, r1 );
+            for( int r = r0; r <= r1; ++r )
+                for( int c = c0; c <= c1; ++c )
+                    _cells[r*_numCols + c].push_back( index );
+        }
+
+        void getRange( const osg::BoundingBox& box, int& c0, int& c1, int& r0, int& r1 ) const
+        {
+            // a degenerate box (e.g. a drawable behind the eye) covers the whole grid.
+            if ( osg::isNaN(box.xMin()) || osg::isNaN(box.xMax()) || osg::isNaN(box.yMin()) || osg::isNaN(box.yMax()) )
+            {
+                c0 = 0; c1 = _numCols-1; r0 = 0; r1 = _numRows-1;
+                return;
+            }
+            c0 = toCell( box.xMin() - _x0, _numCols );
+            c1 = toCell( box.xMax() - _x0, _numCols );
+            r0 = toCell( box.yMin() - _y0, _numRows );
+            r1 = toCell( box.yMax() - _y0, _numRows );
+        }
+
+        static int toCell( double v, int num )
+        {
+            double cell = floor( v / DECLUTTER_GRID_CELL_SIZE );
+            return cell < 0.0 ? 0 : cell >= (double)num ? num-1 : (int)cell;
+        }
+
+        const std::vector<RenderLeafBox>*   _boxes;
+        double                              _x0, _y0;
+        int                                 _numCols, _numRows;
+        std::vector< std::vector<unsigned> > _cells;
+    };
+
     // Data structure stored one-per-View.
     struct PerViewInfo
     {
@@ -98,6 +194,7 @@ namespace
         osgUtil::RenderBin::RenderLeafList _passed;
         osgUtil::RenderBin::RenderLeafList _failed;
         std::vector<RenderLeafBox>         _used;
+        DeclutterGrid                      _grid;
 
         // time stamp of the previous pass, for calculating animation speed
         double _lastTimeStamp;
@@ -221,6 +318,9 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
         const osg::Viewport* vp = cam->getViewport();
         osg::Matrix windowMatrix = vp->computeWindowMatrix();
 
+        // spatial index of the occupied boxes:
+        local._grid.reset( vp, &local._used );
+
         // Track the parent nodes of drawables that are obscured (and culled). Drawables
         // with the same parent node (typically a Geode) are considered to be grouped and
         // will be culled as a group.
@@ -266,24 +366,9 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
                 else
                 {
                     // weed out any drawables that are obscured by closer drawables.
-                    // TODO: think about a more efficient algorithm - right now we are just using
-                    // brute force to compare all bbox's
-                    for( std::vector<RenderLeafBox>::const_iterator j = local._used.begin(); j != local._used.end(); ++j )
+                    if ( local._grid.isOccupied(box, drawableParent) )
                     {
-                        // only need a 2D test since we're in clip space
-                        bool isClear =
-                            box.xMin() > j->second.xMax() ||
-                            box.xMax() < j->second.xMin() ||
-                            box.yMin() > j->second.yMax() ||
-                            box.yMax() < j->second.yMin();
-
-                        // if there's an overlap (and the conflict isn't from the same drawable
-                        // parent, which is acceptable), then the leaf is culled.
-                        if ( !isClear && drawableParent != j->first )
-                        {
-                            visible = false;
-                            break;
-                        }
+                        visible = false;
                     }
                 }
             }
@@ -293,6 +378,8 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
                 // passed the test, so add the leaf's bbox to the "used" list, and add the leaf
                 // to the final draw list.
                 local._used.push_back( std::make_pair(drawableParent, box) );
+                if ( s_enabledGlobally )
+                    local._grid.insert( local._used.size()-1 );
                 local._passed.push_back( leaf );
             }
 
@@ -20,11 +20,13 @@
 #include <osgEarth/Capabilities>
 #include <osgEarth/Registry>
 #include <osgEarth/VirtualProgram>
+#include <osgEarth/StringUtils>
 
 #include <osg/BlendFunc>
 #include <osg/TexGen>
 #include <osg/Texture2D>
 #include <osg/Uniform>
+#include <cmath>
 
 #define LC "[DrapingTechnique] "
 
@@ -40,9 +42,70 @@ namespace
     // Additional per-view data stored by the draping technique.
     struct LocalPerViewData : public osg::Referenced
     {
+        LocalPerViewData() : _rendered(false), _renderedRevision(0), _renderedNumChildren(0) { }
+
         osg::ref_ptr<osg::Uniform> _texGenUniform;  // when shady
         osg::ref_ptr<osg::TexGen>  _texGen;         // when not shady
+        osg::ref_ptr<osg::Texture2D> _texture;      // this view's overlay texture
+
+        std::vector<osg::ref_ptr<osg::Camera> > _cameras; // RTT camera per cascade; [0] is the main one
+
+        // what the overlay texture currently holds:
+        bool                      _rendered;
+        std::vector<osg::Matrixd> _renderedMVPs;        // per cascade
+        unsigned                  _renderedRevision;
+        unsigned                  _renderedNumChildren;
+        osg::BoundingSphere       _renderedBound;
     };
+
+    // The projection of a cascade: a fraction of the full projection,
+    // centered on the eye (the origin of the RTT view) but kept within
+    // the full extent.
+    osg::Matrixd cascadeProjection( const osg::Matrixd& proj, unsigned index, double ratio )
+    {
+        double l, r, b, t, n, f;
+        if ( index == 0 || !proj.getOrtho(l, r, b, t, n, f) )
+            return proj;
+
+        double scale = pow( ratio, (double)index );
+        double hw = 0.5*(r-l)*scale;
+        double hh = 0.5*(t-b)*scale;
+        double cx = osg::clampBetween( 0.0, l+hw, r-hw );
+        double cy = osg::clampBetween( 0.0, b+hh, t-hh );
+
+        return osg::Matrixd::ortho( cx-hw, cx+hw, cy-hh, cy+hh, n, f );
+    }
+
+    // Points a view's texture projection at the overlay texture as it was
+    // rendered with the given (per cascade) MVPs.
+    void projectTexture( LocalPerViewData& local, const std::vector<osg::Matrixd>& MVPs, osgUtil::CullVisitor* cv )
+    {
+        // this xforms from clip [-1..1] to texture [0..1] space
+        static osg::Matrix s_scaleBiasMat = 
+            osg::Matrix::translate(1.0,1.0,1.0) * 
+            osg::Matrix::scale(0.5,0.5,0.5);
+
+        if ( local._texGenUniform.valid() )
+        {
+            // premultiply the inv view matrix so we don't have
+            // precision problems in the shader (and it's faster too)
+            const osg::Matrixd& inverseView = cv->getCurrentCamera()->getInverseViewMatrix();
+            if ( MVPs.size() == 1 )
+            {
+                local._texGenUniform->set( inverseView * MVPs[0] * s_scaleBiasMat );
+            }
+            else
+            {
+                for( unsigned i = 0; i < MVPs.size(); ++i )
+                    local._texGenUniform->setElement( i, osg::Matrixf(inverseView * MVPs[i] * s_scaleBiasMat) );
+            }
+        }
+        else if ( local._texGen.valid() && !MVPs.empty() )
+        {
+            // FFP path
+            local._texGen->setPlanesFromMatrix( MVPs[0] * s_scaleBiasMat );
+        }
+    }
 }
 
 //---------------------------------------------------------------------------
@@ -53,7 +116,11 @@ _textureSize     ( 1024 ),
 _useShaders      ( false ),
 _mipmapping      ( false ),
 _rttBlending     ( true ),
-_attachStencil   ( true )
+_attachStencil   ( true ),
+_renderOnDemand  ( false ),
+_reprojectionTolerance( 0.01f ),
+_numCascades     ( 1 ),
+_cascadeRatio    ( 0.25f )
 {
     // nop
 }
@@ -101,13 +168,19 @@ DrapingTechnique::reestablish(TerrainEngineNode* engine)
 void
 DrapingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
 {
+    // cascades share the texture, a quarter each, and need the shader path.
+    // mipmaps would bleed across the quarters.
+    unsigned numCascades = _useShaders ? _numCascades : 1u;
+    int      cascadeSize = numCascades > 1 ? *_textureSize/2 : *_textureSize;
+    bool     mipmapping  = _mipmapping && numCascades == 1;
+
     // create the projected texture:
     osg::Texture2D* projTexture = new osg::Texture2D();
     projTexture->setTextureSize( *_textureSize, *_textureSize );
     projTexture->setInternalFormat( GL_RGBA );
     projTexture->setSourceFormat( GL_RGBA );
     projTexture->setSourceType( GL_UNSIGNED_BYTE );
-    projTexture->setFilter( osg::Texture::MIN_FILTER, _mipmapping? osg::Texture::LINEAR_MIPMAP_LINEAR: osg::Texture::LINEAR );
+    projTexture->setFilter( osg::Texture::MIN_FILTER, mipmapping? osg::Texture::LINEAR_MIPMAP_LINEAR: osg::Texture::LINEAR );
     projTexture->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
     projTexture->setWrap( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_BORDER );
     projTexture->setWrap( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_BORDER );
@@ -121,11 +194,11 @@ DrapingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     // this ref frame causes the RTT to inherit its viewpoint from above (in order to properly
     // process PagedLOD's etc. -- it doesn't affect the perspective of the RTT camera though)
     params._rttCamera->setReferenceFrame( osg::Camera::ABSOLUTE_RF_INHERIT_VIEWPOINT );
-    params._rttCamera->setViewport( 0, 0, *_textureSize, *_textureSize );
+    params._rttCamera->setViewport( 0, 0, cascadeSize, cascadeSize );
     params._rttCamera->setComputeNearFarMode( osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR );
     params._rttCamera->setRenderOrder( osg::Camera::PRE_RENDER );
     params._rttCamera->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
-    params._rttCamera->attach( osg::Camera::COLOR_BUFFER, projTexture, 0, 0, _mipmapping );
+    params._rttCamera->attach( osg::Camera::COLOR_BUFFER, projTexture, 0, 0, mipmapping );
 
     if ( _attachStencil )
     {
@@ -201,16 +274,93 @@ DrapingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     rttStateSet->setMode(GL_DEPTH_TEST, 0);
     rttStateSet->setBinName( "TraversalOrderBin" );
 
+    // fire up the local per-view data:
+    LocalPerViewData* local = new LocalPerViewData();
+    params._techniqueData = local;
+    local->_texture = projTexture;
+    local->_cameras.push_back( params._rttCamera.get() );
+
+    // the other cascades render the same graph into their own quarters of the texture.
+    for( unsigned i = 1; i < numCascades; ++i )
+    {
+        osg::Camera* camera = new osg::Camera( *params._rttCamera.get(), osg::CopyOp::SHALLOW_COPY );
+        camera->setViewport( (i%2)*cascadeSize, (i/2)*cascadeSize, cascadeSize, cascadeSize );
+        local->_cameras.push_back( camera );
+    }
+
     // add to the terrain stateset, i.e. the stateset that the OverlayDecorator will
     // apply to the terrain before cull-traversing it. This will activate the projective
     // texturing on the terrain.
     params._terrainStateSet->setTextureAttributeAndModes( *_textureUnit, projTexture, osg::StateAttribute::ON );
-
-    // fire up the local per-view data:
-    LocalPerViewData* local = new LocalPerViewData();
-    params._techniqueData = local;
     
-    if ( _useShaders )
+    if ( _useShaders && numCascades > 1 )
+    {
+        // GPU path, cascaded
+
+        VirtualProgram* vp = new VirtualProgram();
+        vp->setName( "DrapingTechnique terrain shaders");
+        params._terrainStateSet->setAttributeAndModes( vp, osg::StateAttribute::ON );
+
+        params._terrainStateSet->getOrCreateUniform(
+            "oe_overlay_tex", osg::Uniform::SAMPLER_2D )->set( *_textureUnit );
+
+        // one texture projection matrix per cascade.
+        local->_texGenUniform = new osg::Uniform( osg::Uniform::FLOAT_MAT4, "oe_overlay_texmatrix", numCascades );
+        params._terrainStateSet->addUniform( local->_texGenUniform.get() );
+
+        std::stringstream vs, fs;
+        vs <<
+            "#version " GLSL_VERSION_STR "\n"
+            GLSL_DEFAULT_PRECISION_FLOAT "\n"
+            "uniform mat4 oe_overlay_texmatrix[" << numCascades << "]; \n";
+        for( unsigned i = 0; i < numCascades; ++i )
+            vs << "varying vec4 oe_overlay_texcoord" << i << "; \n";
+        vs <<
+            "void oe_overlay_vertex(inout vec4 VertexVIEW) \n"
+            "{ \n";
+        for( unsigned i = 0; i < numCascades; ++i )
+            vs << "    oe_overlay_texcoord" << i << " = oe_overlay_texmatrix[" << i << "] * VertexVIEW; \n";
+        vs <<
+            "} \n";
+
+        vp->setFunction( "oe_overlay_vertex", vs.str(), ShaderComp::LOCATION_VERTEX_VIEW );
+
+        // sample the finest cascade that covers the fragment. The margin keeps
+        // the filter from reaching into the neighboring quarter.
+        fs <<
+            "#version " GLSL_VERSION_STR "\n"
+            GLSL_DEFAULT_PRECISION_FLOAT "\n"
+            "uniform sampler2D oe_overlay_tex; \n";
+        for( unsigned i = 0; i < numCascades; ++i )
+            fs << "varying vec4 oe_overlay_texcoord" << i << "; \n";
+        fs <<
+            "bool oe_overlay_inside(in vec2 c) \n"
+            "{ \n"
+            "    const float m = " << std::fixed << 1.0/(double)cascadeSize << "; \n"
+            "    return all(greaterThan(c, vec2(m))) && all(lessThan(c, vec2(1.0-m))); \n"
+            "} \n"
+
+            "void oe_overlay_fragment( inout vec4 color ) \n"
+            "{ \n"
+            "    vec4 texel = vec4(0.0); \n"
+            "    vec2 c; \n";
+        for( int i = (int)numCascades-1; i >= 0; --i )
+        {
+            fs <<
+                "    c = oe_overlay_texcoord" << i << ".xy / oe_overlay_texcoord" << i << ".w; \n"
+                "    if ( oe_overlay_inside(c) ) \n"
+                "        texel = texture2D(oe_overlay_tex, vec2(" << (i%2)*0.5 << ", " << (i/2)*0.5 << ") + 0.5*c); \n"
+                << (i > 0 ? "    else { \n" : "");
+        }
+        for( unsigned i = 1; i < numCascades; ++i )
+            fs << "    } \n";
+        fs <<
+            "    color = vec4( mix( color.rgb, texel.rgb, texel.a ), color.a); \n"
+            "} \n";
+
+        vp->setFunction( "oe_overlay_fragment", fs.str(), ShaderComp::LOCATION_FRAGMENT_COLORING );
+    }
+    else if ( _useShaders )
     {            
         // GPU path
 
@@ -297,33 +447,107 @@ DrapingTechnique::cullOverlayGroup(OverlayDecorator::TechRTTParams& params,
 {
     if ( params._rttCamera.valid() )
     {
-        // this xforms from clip [-1..1] to texture [0..1] space
-        static osg::Matrix s_scaleBiasMat = 
-            osg::Matrix::translate(1.0,1.0,1.0) * 
-            osg::Matrix::scale(0.5,0.5,0.5);
-
-        params._rttCamera->setViewMatrix      ( params._rttViewMatrix );
-        params._rttCamera->setProjectionMatrix( params._rttProjMatrix );
+        LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
 
-        osg::Matrix VPT = params._rttViewMatrix * params._rttProjMatrix * s_scaleBiasMat;
+        // take back our own texture if we were sharing another view's.
+        if ( params._terrainStateSet->getTextureAttribute(*_textureUnit, osg::StateAttribute::TEXTURE) != local._texture.get() )
+        {
+            params._terrainStateSet->setTextureAttributeAndModes( *_textureUnit, local._texture.get(), osg::StateAttribute::ON );
+        }
 
-        LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
+        std::vector<osg::Matrixd> projMatrices( local._cameras.size() );
+        std::vector<osg::Matrixd> MVPs( local._cameras.size() );
+        for( unsigned i = 0; i < local._cameras.size(); ++i )
+        {
+            projMatrices[i] = cascadeProjection( params._rttProjMatrix, i, _cascadeRatio );
+            MVPs[i] = params._rttViewMatrix * projMatrices[i];
+        }
 
-        if ( local._texGenUniform.valid() )
+        bool render = !_renderOnDemand || isStale( params, MVPs );
+        if ( render )
         {
-            // premultiply the inv view matrix so we don't have
-            // precision problems in the shader (and it's faster too)
-            local._texGenUniform->set( cv->getCurrentCamera()->getInverseViewMatrix() * VPT );
+            for( unsigned i = 0; i < local._cameras.size(); ++i )
+            {
+                local._cameras[i]->setViewMatrix      ( params._rttViewMatrix );
+                local._cameras[i]->setProjectionMatrix( projMatrices[i] );
+            }
+
+            local._rendered            = true;
+            local._renderedMVPs        = MVPs;
+            local._renderedRevision    = _revision;
+            local._renderedNumChildren = params._group->getNumChildren();
+            local._renderedBound       = params._group->getBound();
         }
-        else
+
+        // project the texture the way it was last rendered, which is not
+        // necessarily this frame.
+        projectTexture( local, local._renderedMVPs, cv );
+
+        // traverse the overlay group (via the RTT cameras).
+        if ( render )
         {
-            // FFP path
-            local._texGen->setPlanesFromMatrix( VPT );
+            for( unsigned i = 0; i < local._cameras.size(); ++i )
+                local._cameras[i]->accept( *cv );
         }
+    }
+}
+
+
+bool
+DrapingTechnique::cullSharedOverlayGroup(OverlayDecorator::TechRTTParams& params,
+                                         OverlayDecorator::TechRTTParams& source,
+                                         osgUtil::CullVisitor*            cv )
+{
+    if ( !params._rttCamera.valid() || !source._techniqueData.valid() )
+        return false;
+
+    LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
+    const LocalPerViewData& sourceLocal = *static_cast<const LocalPerViewData*>(source._techniqueData.get());
+
+    // the source must hold a texture laid out the way our shaders expect.
+    if ( !sourceLocal._rendered ||
+         sourceLocal._renderedMVPs.size() != local._cameras.size() ||
+         sourceLocal._texGenUniform.valid() != local._texGenUniform.valid() )
+        return false;
+
+    // project the source's texture onto our terrain; nothing to render.
+    if ( params._terrainStateSet->getTextureAttribute(*_textureUnit, osg::StateAttribute::TEXTURE) != sourceLocal._texture.get() )
+    {
+        params._terrainStateSet->setTextureAttributeAndModes( *_textureUnit, sourceLocal._texture.get(), osg::StateAttribute::ON );
+    }
+
+    projectTexture( local, sourceLocal._renderedMVPs, cv );
+    return true;
+}
+
+
+bool
+DrapingTechnique::isStale(OverlayDecorator::TechRTTParams& params,
+                          const std::vector<osg::Matrixd>& MVPs ) const
+{
+    const LocalPerViewData& local = *static_cast<const LocalPerViewData*>(params._techniqueData.get());
+
+    if ( !local._rendered || local._renderedMVPs.size() != MVPs.size() )
+        return true;
 
-        // traverse the overlay group (via the RTT camera).
-        params._rttCamera->accept( *cv );
+    // content changes:
+    if ( local._renderedRevision != (unsigned)_revision ||
+         local._renderedNumChildren != params._group->getNumChildren() )
+        return true;
+
+    const osg::BoundingSphere& bound = params._group->getBound();
+    if ( bound.center() != local._renderedBound.center() ||
+         bound.radius() != local._renderedBound.radius() )
+        return true;
+
+    // projection changes:
+    for( unsigned i = 0; i < MVPs.size(); ++i )
+    {
+        if ( getProjectionDrift(local._renderedMVPs[i], MVPs[i]) > (double)_reprojectionTolerance )
+            return true;
     }
+
+    return false;
 }
 
 
@@ -381,6 +605,37 @@ DrapingTechnique::setAttachStencil( bool value )
     _attachStencil = value;
 }
 
+void
+DrapingTechnique::setRenderOnDemand( bool value )
+{
+    _renderOnDemand = value;
+    dirty();
+}
+
+void
+DrapingTechnique::setReprojectionTolerance( float value )
+{
+    _reprojectionTolerance = osg::maximum( value, 0.0f );
+}
+
+void
+DrapingTechnique::dirty()
+{
+    ++_revision;
+}
+
+void
+DrapingTechnique::setNumCascades( unsigned value )
+{
+    _numCascades = osg::clampBetween( value, 1u, 3u );
+}
+
+void
+DrapingTechnique::setCascadeRatio( float value )
+{
+    _cascadeRatio = osg::clampBetween( value, 0.05f, 0.95f );
+}
+
 void
 DrapingTechnique::onInstall( TerrainEngineNode* engine )
 {
@@ -25,11 +25,19 @@
 #include <osg/ComputeBoundsVisitor>
 #include <osg/MatrixTransform>
 #include <osg/BufferIndexBinding>
+#include <osg/Texture2D>
 #include <osgUtil/MeshOptimizers>
+#include <cstring>
 
 #define MAX_COUNT_UBO   (Registry::capabilities().getMaxUniformBlockSize()/64)
 #define MAX_COUNT_ARRAY 128 // max size of a mat4 uniform array...how to query?
 
+// instance texture layout: four RGBA32F texels per instance (three rows of
+// the transform, then the color), INSTANCES_PER_ROW instances per row.
+#define TEXELS_PER_INSTANCE 4
+#define INSTANCES_PER_ROW   256
+#define INSTANCE_TEX_WIDTH  (TEXELS_PER_INSTANCE * INSTANCES_PER_ROW)
+
 using namespace osgEarth;
 using namespace osgEarth::DrawInstanced;
 
@@ -49,6 +57,59 @@ namespace
         StaticBoundingBox( const osg::BoundingBox& bbox ) : _bbox(bbox) { }
         osg::BoundingBox computeBound(const osg::Drawable&) const { return _bbox; }
     };
+
+    // The instance texture goes on the last image unit, out of the way of the
+    // model's own textures.
+    int getInstanceTextureUnit()
+    {
+        return osg::maximum( 1, Registry::capabilities().getMaxGPUTextureUnits() ) - 1;
+    }
+
+    // Packs instances [offset, offset+count) into an instance texture.
+    osg::Texture2D* createInstanceTexture(const std::vector<osg::Matrixd>& matrices,
+                                          const std::vector<osg::Vec4f>&   colors,
+                                          unsigned                         offset,
+                                          unsigned                         count )
+    {
+        unsigned rows = (count + INSTANCES_PER_ROW - 1) / INSTANCES_PER_ROW;
+
+        osg::Image* image = new osg::Image();
+        image->allocateImage( INSTANCE_TEX_WIDTH, rows, 1, GL_RGBA, GL_FLOAT );
+        image->setInternalTextureFormat( GL_RGBA32F_ARB );
+        ::memset( image->data(), 0, image->getTotalSizeInBytes() );
+
+        float* ptr = reinterpret_cast<float*>( image->data() );
+        for( unsigned i = 0; i < count; ++i, ptr += 4*TEXELS_PER_INSTANCE )
+        {
+            // OSG matrices post-multiply row vectors, so row r of the output
+            // is the dot product of the vertex with column r.
+            const osg::Matrixd& m = matrices[offset + i];
+            for( unsigned r = 0; r < 3; ++r )
+            {
+                ptr[4*r+0] = (float)m(0,r);
+                ptr[4*r+1] = (float)m(1,r);
+                ptr[4*r+2] = (float)m(2,r);
+                ptr[4*r+3] = (float)m(3,r);
+            }
+
+            osg::Vec4f color = offset + i < colors.size() ? colors[offset + i] : osg::Vec4f(1,1,1,1);
+            ptr[12] = color.r();
+            ptr[13] = color.g();
+            ptr[14] = color.b();
+            ptr[15] = color.a();
+        }
+
+        osg::Texture2D* tex = new osg::Texture2D( image );
+        tex->setFilter( osg::Texture::MIN_FILTER, osg::Texture::NEAREST );
+        tex->setFilter( osg::Texture::MAG_FILTER, osg::Texture::NEAREST );
+        tex->setWrap  ( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
+        tex->setWrap  ( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE );
+        tex->setResizeNonPowerOfTwoHint( false );
+        tex->setInternalFormat( GL_RGBA32F_ARB );
+        tex->setSourceFormat( GL_RGBA );
+        tex->setSourceType( GL_FLOAT );
+        return tex;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -292,3 +353,109 @@ DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent )
         }
     }
 }
+
+
+osg::Node*
+DrawInstanced::createTextureInstancedNode(osg::Node*                       model,
+                                          const std::vector<osg::Matrixd>& matrices,
+                                          const std::vector<osg::Vec4f>&   colors )
+{
+    if ( !model || matrices.empty() )
+        return 0L;
+
+    // the instances' combined bounding box stands in for the bounds of the
+    // geometry, which cannot be computed for instanced draws.
+    osg::ComputeBoundsVisitor cbv;
+    model->accept( cbv );
+    const osg::BoundingBox& nodeBox = cbv.getBoundingBox();
+
+    osg::BoundingBox bbox;
+    for( std::vector<osg::Matrixd>::const_iterator m = matrices.begin(); m != matrices.end(); ++m )
+    {
+        for( unsigned c = 0; c < 8; ++c )
+            bbox.expandBy( nodeBox.corner(c) * (*m) );
+    }
+
+    // one texture holds as many instances as there are texture rows.
+    unsigned maxRows = osg::maximum( 1, Registry::capabilities().getMaxTextureSize() );
+    unsigned maxSliceSize = maxRows * INSTANCES_PER_ROW;
+
+    int unit = getInstanceTextureUnit();
+
+    osg::Group* group = new osg::Group();
+
+    for( unsigned offset = 0; offset < matrices.size(); offset += maxSliceSize )
+    {
+        unsigned count = osg::minimum( maxSliceSize, (unsigned)matrices.size() - offset );
+
+        // copy only what the conversion changes, so the model can stay shared.
+        osg::Node* instanced = osg::clone(
+            model,
+            osg::CopyOp::DEEP_COPY_NODES | osg::CopyOp::DEEP_COPY_DRAWABLES | osg::CopyOp::DEEP_COPY_PRIMITIVES );
+
+        ConvertToDrawInstanced cdi( count, bbox, true );
+        instanced->accept( cdi );
+
+        osg::Group* slice = new osg::Group();
+        slice->getOrCreateStateSet()->setTextureAttribute(
+            unit, createInstanceTexture(matrices, colors, offset, count), osg::StateAttribute::ON );
+        slice->addChild( instanced );
+        group->addChild( slice );
+    }
+
+    group->setComputeBoundingSphereCallback( new StaticBound(osg::BoundingSphere(bbox)) );
+    group->dirtyBound();
+
+    return group;
+}
+
+
+void
+DrawInstanced::installTextureInstancing(osg::StateSet* stateset)
+{
+    if ( !stateset )
+        return;
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(stateset);
+
+    std::stringstream buf;
+
+    buf << "#version 120 \n"
+        << "#extension GL_EXT_gpu_shader4 : enable \n"
+        << "uniform sampler2D oe_di_instanceTex; \n"
+        << "varying vec4 osg_FrontColor; \n"
+        << "varying vec3 oe_Normal; \n"
+        << "void oe_di_setInstancePosition(inout vec4 VertexModel)\n"
+        << "{\n"
+        << "    int   t  = gl_InstanceID * " << TEXELS_PER_INSTANCE << "; \n"
+        << "    ivec2 uv = ivec2( t % " << INSTANCE_TEX_WIDTH << ", t / " << INSTANCE_TEX_WIDTH << " ); \n"
+        << "    vec4 r0 = texelFetch2D( oe_di_instanceTex, uv, 0 ); \n"
+        << "    vec4 r1 = texelFetch2D( oe_di_instanceTex, uv + ivec2(1,0), 0 ); \n"
+        << "    vec4 r2 = texelFetch2D( oe_di_instanceTex, uv + ivec2(2,0), 0 ); \n"
+        << "    vec4 c  = texelFetch2D( oe_di_instanceTex, uv + ivec2(3,0), 0 ); \n"
+        << "    VertexModel = vec4( dot(r0, VertexModel), dot(r1, VertexModel), dot(r2, VertexModel), VertexModel.w ); \n"
+        << "    oe_Normal = vec3( dot(r0.xyz, oe_Normal), dot(r1.xyz, oe_Normal), dot(r2.xyz, oe_Normal) ); \n"
+        << "    osg_FrontColor *= c; \n"
+        << "}\n";
+
+    vp->setFunction(
+        "oe_di_setInstancePosition",
+        buf.str(),
+        ShaderComp::LOCATION_VERTEX_MODEL );
+
+    stateset->getOrCreateUniform( "oe_di_instanceTex", osg::Uniform::SAMPLER_2D )->set( getInstanceTextureUnit() );
+}
+
+
+void
+DrawInstanced::removeTextureInstancing(osg::StateSet* stateset)
+{
+    if ( !stateset )
+        return;
+
+    stateset->removeUniform( "oe_di_instanceTex" );
+
+    VirtualProgram* vp = VirtualProgram::get(stateset);
+    if ( vp )
+        vp->removeShader( "oe_di_setInstancePosition" );
+}
@@ -26,6 +26,36 @@ using namespace osgEarth;
 
 // --------------------------------------------------------------------------
 
+namespace
+{
+    // Applies a localization matrix to many points. Localization matrices are
+    // affine, so this skips the perspective divide of Vec3d * Matrixd when it can.
+    struct Localizer
+    {
+        Localizer( const osg::Matrixd& m ) : _m( m )
+        {
+            _affine =
+                m(0,3) == 0.0 && m(1,3) == 0.0 && m(2,3) == 0.0 && m(3,3) == 1.0;
+        }
+
+        osg::Vec3d operator()( const osg::Vec3d& p ) const
+        {
+            if ( !_affine )
+                return p * _m;
+
+            return osg::Vec3d(
+                p.x()*_m(0,0) + p.y()*_m(1,0) + p.z()*_m(2,0) + _m(3,0),
+                p.x()*_m(0,1) + p.y()*_m(1,1) + p.z()*_m(2,1) + _m(3,1),
+                p.x()*_m(0,2) + p.y()*_m(1,2) + p.z()*_m(2,2) + _m(3,2) );
+        }
+
+        const osg::Matrixd& _m;
+        bool                _affine;
+    };
+}
+
+// --------------------------------------------------------------------------
+
 osg::Matrixd
 ECEF::createLocalToWorld( const osg::Vec3d& input )
 {
@@ -90,12 +120,15 @@ ECEF::transformAndLocalize(const std::vector<osg::Vec3d>& input,
     const SpatialReference* ecefSRS = outputSRS->getECEF();
     output->reserve( output->size() + input.size() );
 
-    for( std::vector<osg::Vec3d>::const_iterator i = input.begin(); i != input.end(); ++i )
+    // transform the whole array in one call, which resolves the SRS pair once
+    // and skips GDAL altogether when the input is already geodetic.
+    std::vector<osg::Vec3d> ecef( input );
+    inputSRS->transform( ecef, ecefSRS );
+
+    Localizer localize( world2local );
+    for( std::vector<osg::Vec3d>::const_iterator i = ecef.begin(); i != ecef.end(); ++i )
     {
-        osg::Vec3d ecef;
-        inputSRS->transform( *i, ecefSRS, ecef );
-        //inputSRS->transformToECEF( *i, ecef );
-        output->push_back( ecef * world2local );
+        output->push_back( localize(*i) );
     }
 }
 
@@ -114,20 +147,50 @@ ECEF::transformAndLocalize(const std::vector<osg::Vec3d>& input,
     if ( out_normals )
         out_normals->reserve( out_verts->size() );
 
-    for( std::vector<osg::Vec3d>::const_iterator i = input.begin(); i != input.end(); ++i )
+    std::vector<osg::Vec3d> ecef( input );
+    inputSRS->transform( ecef, ecefSRS );
+
+    Localizer localize( world2local );
+    for( std::vector<osg::Vec3d>::iterator i = ecef.begin(); i != ecef.end(); ++i )
     {
-        osg::Vec3d ecef;
-        inputSRS->transform( *i, ecefSRS, ecef );
-        out_verts->push_back( ecef * world2local );
+        out_verts->push_back( localize(*i) );
 
         if ( out_normals )
         {
-            ecef.normalize();
-            out_normals->push_back( osg::Matrix::transform3x3(ecef, world2local) );
+            i->normalize();
+            out_normals->push_back( osg::Matrix::transform3x3(*i, world2local) );
         }
     }
 }
 
+void
+ECEF::geodeticToECEF(std::vector<osg::Vec3d>&   points,
+                     const osg::EllipsoidModel* em )
+{
+    // same formulation as osg::EllipsoidModel::convertLatLongHeightToXYZ, with
+    // the ellipsoid constants hoisted out of the loop.
+    const double a   = em->getRadiusEquator();
+    const double b   = em->getRadiusPolar();
+    const double e2  = (a*a - b*b) / (a*a);
+    const double d2r = osg::PI / 180.0;
+
+    osg::Vec3d* p   = points.size() > 0 ? &points[0] : 0L;
+    osg::Vec3d* end = p + points.size();
+
+    for( ; p != end; ++p )
+    {
+        double lon = p->x() * d2r;
+        double lat = p->y() * d2r;
+        double h   = p->z();
+
+        double sinLat = sin(lat), cosLat = cos(lat);
+        double N = a / sqrt(1.0 - e2*sinLat*sinLat);
+
+        double r = (N + h) * cosLat;
+        p->set( r*cos(lon), r*sin(lon), (N*(1.0-e2) + h) * sinLat );
+    }
+}
+
 void
 ECEF::transformAndGetRotationMatrix(const osg::Vec3d&       input,
                                     const SpatialReference* inputSRS,
@@ -0,0 +1,195 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ElevationBounds>
+#include <osgEarth/GeoCommon>
+#include <osgEarth/StringUtils>
+#include <sstream>
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+
+#define LC "[ElevationBounds] "
+
+//------------------------------------------------------------------------
+
+ElevationBounds::ElevationBounds() :
+_policy( CachePolicy::NO_CACHE )
+{
+    //nop
+}
+
+bool
+ElevationBounds::getBounds( const TileKey& key, float& out_min, float& out_max ) const
+{
+    if ( !key.valid() )
+        return false;
+
+    // exact hit in memory:
+    {
+        ScopedReadLock shared( _mutex );
+        RangeMap::const_iterator i = _ranges.find( key );
+        if ( i != _ranges.end() )
+        {
+            out_min = i->second._min;
+            out_max = i->second._max;
+            return true;
+        }
+    }
+
+    // exact hit in the cache; keep it in memory for next time.
+    Range range;
+    if ( readFromCache(key, range) )
+    {
+        ScopedWriteLock exclusive( _mutex );
+        const_cast<ElevationBounds*>(this)->_ranges[key] = range;
+        out_min = range._min;
+        out_max = range._max;
+        return true;
+    }
+
+    // nearest recorded ancestor:
+    ScopedReadLock shared( _mutex );
+    for( TileKey parent = key.createParentKey(); parent.valid(); parent = parent.createParentKey() )
+    {
+        RangeMap::const_iterator i = _ranges.find( parent );
+        if ( i != _ranges.end() )
+        {
+            out_min = i->second._min;
+            out_max = i->second._max;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+ElevationBounds::record( const TileKey& key, const osg::HeightField* hf )
+{
+    if ( !hf )
+        return;
+
+    const osg::HeightField::HeightList& heights = hf->getFloatArray()->asVector();
+
+    float minHeight = FLT_MAX, maxHeight = -FLT_MAX;
+    for( unsigned i = 0; i < heights.size(); ++i )
+    {
+        float h = heights[i];
+        if ( h != NO_DATA_VALUE )
+        {
+            if ( h < minHeight ) minHeight = h;
+            if ( h > maxHeight ) maxHeight = h;
+        }
+    }
+
+    if ( minHeight <= maxHeight )
+    {
+        record( key, minHeight, maxHeight );
+    }
+}
+
+void
+ElevationBounds::record( const TileKey& key, float minHeight, float maxHeight )
+{
+    if ( !key.valid() )
+        return;
+
+    osg::ref_ptr<CacheBin> bin;
+    {
+        ScopedWriteLock exclusive( _mutex );
+
+        Range& range = _ranges[key];
+        range._min = minHeight;
+        range._max = maxHeight;
+
+        // widen the ancestors we already know about.
+        for( TileKey parent = key.createParentKey(); parent.valid(); parent = parent.createParentKey() )
+        {
+            RangeMap::iterator i = _ranges.find( parent );
+            if ( i != _ranges.end() )
+            {
+                i->second._min = osg::minimum( i->second._min, minHeight );
+                i->second._max = osg::maximum( i->second._max, maxHeight );
+            }
+        }
+
+        if ( _policy.isCacheWriteable() )
+            bin = _bin.get();
+    }
+
+    if ( bin.valid() )
+    {
+        std::stringstream buf;
+        buf.precision( 9 );
+        buf << minHeight << " " << maxHeight;
+        osg::ref_ptr<StringObject> value = new StringObject( buf.str() );
+        bin->write( key.str(), value.get() );
+    }
+}
+
+unsigned
+ElevationBounds::getNumEntries() const
+{
+    ScopedReadLock shared( _mutex );
+    return _ranges.size();
+}
+
+void
+ElevationBounds::clear()
+{
+    ScopedWriteLock exclusive( _mutex );
+    _ranges.clear();
+}
+
+void
+ElevationBounds::reset( const std::string& signature, CacheBin* bin, const CachePolicy& policy )
+{
+    ScopedWriteLock exclusive( _mutex );
+
+    if ( signature != _signature )
+    {
+        _ranges.clear();
+        _signature = signature;
+    }
+
+    _bin    = bin;
+    _policy = policy;
+}
+
+bool
+ElevationBounds::readFromCache( const TileKey& key, Range& out_range ) const
+{
+    osg::ref_ptr<CacheBin> bin;
+    {
+        ScopedReadLock shared( _mutex );
+        if ( _policy.isCacheReadable() )
+            bin = _bin.get();
+    }
+
+    if ( !bin.valid() )
+        return false;
+
+    ReadResult r = bin->readString( key.str() );
+    if ( !r.succeeded() )
+        return false;
+
+    std::stringstream buf( r.getString() );
+    buf >> out_range._min >> out_range._max;
+    return !buf.fail() && out_range._min <= out_range._max;
+}
@@ -19,6 +19,7 @@
 #include <osgEarth/ElevationLayer>
 #include <osgEarth/VerticalDatum>
 #include <osgEarth/HeightFieldUtils>
+#include <osgEarth/QuantizedHeightField>
 #include <osgEarth/Progress>
 #include <osg/Version>
 
@@ -27,6 +28,83 @@ using namespace OpenThreads;
 
 #define LC "[ElevationLayer] \"" << getName() << "\" : "
 
+// number of fallback ancestors, and of empty keys, each layer remembers
+#define FALLBACK_CACHE_SIZE 32
+#define NO_DATA_CACHE_SIZE  1024
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    /**
+     * Samples one source heightfield at the posts of an output grid. When the
+     * source shares the output SRS, the post-to-pixel mapping is separable, so
+     * it is computed once per column and once per row; otherwise each sample
+     * falls back on GeoHeightField::getElevation.
+     */
+    struct HeightFieldSampler
+    {
+        void init(const GeoHeightField&   geoHF,
+                  const SpatialReference* outputSRS,
+                  double minx, double miny,
+                  double dx,   double dy,
+                  unsigned width, unsigned height )
+        {
+            _geoHF = &geoHF;
+            _hf    = geoHF.getHeightField();
+
+            const GeoExtent& ex = geoHF.getExtent();
+            _separable =
+                ex.getSRS()->isEquivalentTo( outputSRS ) &&
+                ex.getSRS()->isVertEquivalentTo( outputSRS );
+
+            if ( _separable )
+            {
+                double xInterval = ex.width()  / (double)(_hf->getNumColumns()-1);
+                double yInterval = ex.height() / (double)(_hf->getNumRows()-1);
+                double maxc      = (double)(_hf->getNumColumns()-1);
+                double maxr      = (double)(_hf->getNumRows()-1);
+
+                // pixel coordinates, or -1 outside the extent:
+                _px.resize( width );
+                for( unsigned c = 0; c < width; ++c )
+                {
+                    double x = minx + dx*(double)c;
+                    _px[c] = ex.contains(x, ex.yMin()) ? osg::clampBetween((x - ex.xMin())/xInterval, 0.0, maxc) : -1.0;
+                }
+
+                _py.resize( height );
+                for( unsigned r = 0; r < height; ++r )
+                {
+                    double y = miny + dy*(double)r;
+                    _py[r] = ex.contains(ex.xMin(), y) ? osg::clampBetween((y - ex.yMin())/yInterval, 0.0, maxr) : -1.0;
+                }
+            }
+        }
+
+        bool sample(unsigned c, unsigned r,
+                    double x, double y,
+                    const SpatialReference* outputSRS,
+                    ElevationInterpolation  interp,
+                    float&                  out_elevation ) const
+        {
+            if ( !_separable )
+                return _geoHF->getElevation( outputSRS, x, y, interp, outputSRS, out_elevation );
+
+            if ( _px[c] < 0.0 || _py[r] < 0.0 )
+                return false;
+
+            out_elevation = HeightFieldUtils::getHeightAtPixel( _hf, _px[c], _py[r], interp );
+            return true;
+        }
+
+        const GeoHeightField*   _geoHF;
+        const osg::HeightField* _hf;
+        bool                    _separable;
+        std::vector<double>     _px, _py;
+    };
+}
+
 //------------------------------------------------------------------------
 
 ElevationLayerOptions::ElevationLayerOptions( const ConfigOptions& options ) :
@@ -54,6 +132,7 @@ ElevationLayerOptions::getConfig( bool isolate ) const
 {
     Config conf = TerrainLayerOptions::getConfig( isolate );
     conf.updateIfSet("offset", _offset);
+    conf.updateIfSet("quantize_error", _cacheQuantizationError);
     return conf;
 }
 
@@ -61,6 +140,7 @@ void
 ElevationLayerOptions::fromConfig( const Config& conf )
 {
     conf.getIfSet( "offset", _offset );
+    conf.getIfSet( "quantize_error", _cacheQuantizationError );
 }
 
 void
@@ -100,21 +180,27 @@ namespace
 
 ElevationLayer::ElevationLayer( const ElevationLayerOptions& options ) :
 TerrainLayer   ( options, &_runtimeOptions ),
-_runtimeOptions( options )
+_runtimeOptions( options ),
+_fallbackCache ( true, FALLBACK_CACHE_SIZE ),
+_noDataCache   ( true, NO_DATA_CACHE_SIZE )
 {
     init();
 }
 
 ElevationLayer::ElevationLayer( const std::string& name, const TileSourceOptions& driverOptions ) :
 TerrainLayer   ( ElevationLayerOptions(name, driverOptions), &_runtimeOptions ),
-_runtimeOptions( ElevationLayerOptions(name, driverOptions) )
+_runtimeOptions( ElevationLayerOptions(name, driverOptions) ),
+_fallbackCache ( true, FALLBACK_CACHE_SIZE ),
+_noDataCache   ( true, NO_DATA_CACHE_SIZE )
 {
     init();
 }
 
 ElevationLayer::ElevationLayer( const ElevationLayerOptions& options, TileSource* tileSource ) :
 TerrainLayer   ( options, &_runtimeOptions, tileSource ),
-_runtimeOptions( options )
+_runtimeOptions( options ),
+_fallbackCache ( true, FALLBACK_CACHE_SIZE ),
+_noDataCache   ( true, NO_DATA_CACHE_SIZE )
 {
     init();
 }
@@ -196,6 +282,7 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
     // If the key is blacklisted, fail.
     if ( source->getBlacklist()->contains( key.getTileId() ) )
     {
+        recordMetric( LayerMetrics::BLACKLISTED );
         OE_DEBUG << LC << "Tile " << key.str() << " is blacklisted " << std::endl;
         return 0L;
     }
@@ -212,7 +299,10 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
         }
 
         // Make it from the source:
+        osg::Timer_t start = osg::Timer::instance()->tick();
         result = source->createHeightField( key, _preCacheOp.get(), progress );
+        recordTime( LayerMetrics::STAGE_SOURCE, start );
+        recordHeightFieldResult( result, progress );
 
         // If the result is good, we how have a heightfield but it's vertical values
         // are still relative to the tile source's vertical datum. Convert them.
@@ -239,7 +329,9 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
     else
     {
         // note: this method takes care of the vertical datum shift internally.
+        osg::Timer_t start = osg::Timer::instance()->tick();
         result = assembleHeightFieldFromTileSource( key, progress );
+        recordTime( LayerMetrics::STAGE_ASSEMBLY, start );
     }
 
 #if 0
@@ -268,6 +360,22 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
 }
 
 
+void
+ElevationLayer::recordHeightFieldResult(const osg::HeightField* hf,
+                                        ProgressCallback*       progress)
+{
+    if ( hf )
+    {
+        recordMetric( LayerMetrics::SOURCE_TILES );
+        recordMetric( LayerMetrics::BYTES, (double)(hf->getNumColumns() * hf->getNumRows() * sizeof(float)) );
+    }
+    else if ( !progress || !progress->isCanceled() )
+    {
+        recordMetric( LayerMetrics::SOURCE_ERRORS );
+    }
+}
+
+
 osg::HeightField*
 ElevationLayer::assembleHeightFieldFromTileSource(const TileKey&    key,
                                                   ProgressCallback* progress)
@@ -290,13 +398,54 @@ ElevationLayer::assembleHeightFieldFromTileSource(const TileKey&    key,
     // we will do that later.
     if ( intersectingTiles.size() > 0 )
     {
+        // Ask the tile source for all the tiles it should have in one batch, so the
+        // driver can fetch them together. Tiles that come back empty get blacklisted
+        // (as createHeightFieldFromTileSource would) and resolved through the parent
+        // fallback below.
+        TileSource* source = getTileSource();
+        TileSource::HeightFieldVector batchHFs( intersectingTiles.size() );
+        if ( source )
+        {
+            std::vector<TileKey>  batchKeys;
+            std::vector<unsigned> batchIndices;
+            for (unsigned int i = 0; i < intersectingTiles.size(); ++i)
+            {
+                const TileKey& layerKey = intersectingTiles[i];
+                if ( isKeyValid(layerKey) &&
+                     !source->getBlacklist()->contains( layerKey.getTileId() ) &&
+                     source->hasData( layerKey ) )
+                {
+                    batchKeys.push_back( layerKey );
+                    batchIndices.push_back( i );
+                }
+            }
+
+            if ( !batchKeys.empty() )
+            {
+                TileSource::HeightFieldVector hfs;
+                osg::Timer_t start = osg::Timer::instance()->tick();
+                source->createHeightFields( batchKeys, hfs, _preCacheOp.get(), progress );
+                recordTime( LayerMetrics::STAGE_SOURCE, start );
+                for (unsigned int i = 0; i < batchKeys.size(); ++i)
+                {
+                    recordHeightFieldResult( hfs[i].get(), progress );
+                    if ( hfs[i].valid() )
+                        batchHFs[batchIndices[i]] = hfs[i];
+                    else if ( !progress || !progress->isCanceled() )
+                        source->getBlacklist()->add( batchKeys[i].getTileId() );
+                }
+            }
+        }
+
         for (unsigned int i = 0; i < intersectingTiles.size(); ++i)
         {
             const TileKey& layerKey = intersectingTiles[i];
 
             if ( isKeyValid(layerKey) )
             {
-                osg::HeightField* hf = createHeightFieldFromTileSource( layerKey, progress );
+                osg::HeightField* hf = batchHFs[i].valid() ?
+                    batchHFs[i].release() :
+                    createHeightFieldFromTileSource( layerKey, progress );
                 if ( hf )
                 {
                     heightFields.push_back( GeoHeightField(hf, layerKey.getExtent()) );
@@ -423,13 +572,18 @@ ElevationLayer::createHeightField(const TileKey&    key,
     bool fromCache = false;
     if ( cacheBin && getCachePolicy().isCacheReadable() )
     {
+        osg::Timer_t start = osg::Timer::instance()->tick();
         ReadResult r = cacheBin->readObject( key.str() );
-        if ( r.succeeded() )
+        if ( r.succeeded() && !isCacheEntryStale(key, r.metadata()) )
         {
-            result = r.release<osg::HeightField>();
+            // the cache may hold a quantized copy; expand it on the way out.
+            QuantizedHeightField* qhf = dynamic_cast<QuantizedHeightField*>( r.getObject() );
+            result = qhf ? qhf->decode() : r.release<osg::HeightField>();
             if ( result )
                 fromCache = true;
         }
+        recordTime( LayerMetrics::STAGE_CACHE_READ, start );
+        recordMetric( fromCache ? LayerMetrics::CACHE_HITS : LayerMetrics::CACHE_MISSES );
     }
 
     // if we're cache-only, but didn't get data from the cache, fail silently.
@@ -457,7 +611,18 @@ ElevationLayer::createHeightField(const TileKey&    key,
          !fromCache    &&
          getCachePolicy().isCacheWriteable() )
     {
-        cacheBin->write( key.str(), result );
+        osg::ref_ptr<QuantizedHeightField> qhf;
+        if ( _runtimeOptions.cacheQuantizationError().isSet() )
+            qhf = QuantizedHeightField::encode( result, _runtimeOptions.cacheQuantizationError().value() );
+
+        Config meta = getCacheEntryMetadata();
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        bool written = qhf.valid() ?
+            cacheBin->write( key.str(), qhf.get(), meta ) :
+            cacheBin->write( key.str(), result, meta );
+        if ( written )
+            recordMetric( LayerMetrics::CACHE_WRITES );
+        recordTime( LayerMetrics::STAGE_CACHE_WRITE, start );
     }
 
     if ( result )
@@ -479,6 +644,51 @@ ElevationLayer::createHeightField(const TileKey&    key,
 }
 
 
+GeoHeightField
+ElevationLayer::createHeightFieldWithFallback(const TileKey&    key,
+                                              TileKey&          out_key,
+                                              ProgressCallback* progress )
+{
+    for( TileKey k = key; k.valid(); k = k.createParentKey() )
+    {
+        // keys differing only by vertical datum produce different heights,
+        // so the profile signature is part of the cache key.
+        TileKey::UniqueCode cacheKey = k.getUniqueCode();
+
+        if ( k != key )
+        {
+            LRUCache<TileKey::UniqueCode, GeoHeightField>::Record rec;
+            if ( _fallbackCache.get(cacheKey, rec) )
+            {
+                out_key = k;
+                return rec.value();
+            }
+        }
+
+        LRUCache<TileKey::UniqueCode, bool>::Record empty;
+        if ( _noDataCache.get(cacheKey, empty) )
+            continue;
+
+        GeoHeightField geoHF = createHeightField( k, progress );
+        if ( geoHF.valid() )
+        {
+            if ( k != key )
+                _fallbackCache.insert( cacheKey, geoHF );
+            out_key = k;
+            return geoHF;
+        }
+
+        // don't remember misses that were only due to cancelation.
+        if ( progress && progress->isCanceled() )
+            break;
+
+        _noDataCache.insert( cacheKey, true );
+    }
+
+    return GeoHeightField::INVALID;
+}
+
+
 bool
 ElevationLayer::isKeyValid(const TileKey& key) const
 {
@@ -565,21 +775,16 @@ ElevationLayerVector::createHeightField(const TileKey&                  key,
 
         if ( layer->getEnabled() && layer->getVisible() && layer->isKeyValid( keyToUse ) )
         {
-            GeoHeightField geoHF = layer->createHeightField( keyToUse, progress );
+            GeoHeightField geoHF;
 
-            // if "fallback" is set, try to fall back on lower LODs.
-            if ( !geoHF.valid() && fallback )
+            // if "fallback" is set, try to fall back on lower LODs. The layer
+            // remembers recent ancestors, so siblings share one fetch.
+            if ( fallback )
             {
-                TileKey hf_key = keyToUse.createParentKey();
+                TileKey hf_key;
+                geoHF = layer->createHeightFieldWithFallback( keyToUse, hf_key, progress );
 
-                while ( hf_key.valid() && !geoHF.valid() )
-                {
-                    geoHF = layer->createHeightField( hf_key, progress );
-                    if ( !geoHF.valid() )
-                        hf_key = hf_key.createParentKey();
-                }
-
-                if ( geoHF.valid() )
+                if ( geoHF.valid() && hf_key != keyToUse )
                 {
                     if ( hf_key.getLevelOfDetail() < lowestLOD )
                     {
@@ -590,6 +795,10 @@ ElevationLayerVector::createHeightField(const TileKey&                  key,
                     numFallbacks++;
                 }
             }
+            else
+            {
+                geoHF = layer->createHeightField( keyToUse, progress );
+            }
 
             if ( geoHF.valid() )
             {
@@ -698,67 +907,58 @@ ElevationLayerVector::createHeightField(const TileKey&                  key,
 
         const SpatialReference* keySRS = keyToUse.getProfile()->getSRS();
 
-        // Create the new heightfield by sampling all layer heightfields.
-        for (unsigned int c = 0; c < width; ++c)
+        // Map the output posts onto each layer once. Iterate BACKWARDS because the
+        // last layer is the highest priority.
+        std::vector<HeightFieldSampler> samplers( heightFields.size() );
+        for( unsigned i = 0; i < heightFields.size(); ++i )
         {
-            double x = minx + (dx * (double)c);
-            for (unsigned r = 0; r < height; ++r)
-            {
-                double y = miny + (dy * (double)r);
+            samplers[i].init( heightFields[heightFields.size()-1-i], keySRS, minx, miny, dx, dy, width, height );
+        }
 
-                //Collect elevations from all of the layers. Iterate BACKWARDS because the last layer
-                // is the highest priority.
-                std::vector<float> elevations;
-                for( GeoHeightFieldVector::reverse_iterator itr = heightFields.rbegin(); itr != heightFields.rend(); ++itr )
-                {
-                    const GeoHeightField& geoHF = *itr;
+        float* heights = &out_result->getFloatArray()->front();
 
-                    float elevation = 0.0f;
-                    if ( geoHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation) )
-                    {
-                        if (elevation != NO_DATA_VALUE)
-                        {
-                            elevations.push_back(elevation);
-                        }
-                    }
-                }
+        // Create the new heightfield by sampling all layer heightfields, one row at a time.
+        for (unsigned r = 0; r < height; ++r)
+        {
+            double y = miny + (dy * (double)r);
+            float* row = heights + r*width;
+
+            for (unsigned int c = 0; c < width; ++c)
+            {
+                double x = minx + (dx * (double)c);
 
                 float elevation = NO_DATA_VALUE;
+                float value     = 0.0f;
+                unsigned count  = 0;
 
-                //The list of elevations only contains valid values
-                if (elevations.size() > 0)
+                for( std::vector<HeightFieldSampler>::const_iterator s = samplers.begin(); s != samplers.end(); ++s )
                 {
-                    if (samplePolicy == SAMPLE_FIRST_VALID)
-                    {
-                        elevation = elevations[0];
-                    }
-                    else if (samplePolicy == SAMPLE_HIGHEST)
-                    {
-                        elevation = -FLT_MAX;
-                        for (unsigned int i = 0; i < elevations.size(); ++i)
-                        {
-                            if (elevation < elevations[i]) elevation = elevations[i];
-                        }
-                    }
-                    else if (samplePolicy == SAMPLE_LOWEST)
+                    float sample;
+                    if ( !s->sample(c, r, x, y, keySRS, interpolation, sample) || sample == NO_DATA_VALUE )
+                        continue;
+
+                    if ( count == 0 ||
+                         (samplePolicy == SAMPLE_HIGHEST && sample > value) ||
+                         (samplePolicy == SAMPLE_LOWEST  && sample < value) )
                     {
-                        elevation = FLT_MAX;
-                        for (unsigned i = 0; i < elevations.size(); ++i)
-                        {
-                            if (elevation > elevations[i]) elevation = elevations[i];
-                        }
+                        value = sample;
                     }
-                    else if (samplePolicy == SAMPLE_AVERAGE)
+                    else if ( samplePolicy == SAMPLE_AVERAGE )
                     {
-                        elevation = 0.0;
-                        for (unsigned i = 0; i < elevations.size(); ++i)
-                        {
-                            elevation += elevations[i];
-                        }
-                        elevation /= (float)elevations.size();
+                        value += sample;
                     }
+                    ++count;
+
+                    // the highest-priority valid sample wins.
+                    if ( samplePolicy == SAMPLE_FIRST_VALID )
+                        break;
                 }
-                out_result->setHeight(c, r, elevation);
+
+                if ( count > 0 )
+                {
+                    elevation = samplePolicy == SAMPLE_AVERAGE ? value / (float)count : value;
+                }
+                row[c] = elevation;
             }
         }
     }
@@ -807,21 +1007,28 @@ ElevationLayerVector::createHeightField(const TileKey&                  key,
 
         const SpatialReference* keySRS = keyToUse.getProfile()->getSRS();
 
+        unsigned width  = out_result->getNumColumns();
+        unsigned height = out_result->getNumRows();
+        float* heights = &out_result->getFloatArray()->front();
+
+        HeightFieldSampler sampler;
         for( GeoHeightFieldVector::iterator itr = offsetHeightFields.begin(); itr != offsetHeightFields.end(); ++itr )
         {
-            for (unsigned int c = 0; c < out_result->getNumColumns(); c++)
+            sampler.init( *itr, keySRS, minx, miny, dx, dy, width, height );
+
+            for (unsigned int r = 0; r < height; r++)
             {
-                double x = minx + (dx * (double)c);
-                for (unsigned int r = 0; r < out_result->getNumRows(); r++)
-                {                         
-                    double y = miny + (dy * (double)r);
-                    float elevation = 0.0;                    
-                    if (itr->getElevation(keySRS, x, y, interpolation, keySRS, elevation))
-                    {                    
-                        double h = out_result->getHeight( c, r );                        
-                        h += elevation;                                     
-                        out_result->setHeight( c, r, h );
-                    }                                
+                double y = miny + (dy * (double)r);
+                float* row = heights + r*width;
+
+                for (unsigned int c = 0; c < width; c++)
+                {
+                    double x = minx + (dx * (double)c);
+                    float elevation;
+                    if (sampler.sample(c, r, x, y, keySRS, interpolation, elevation))
+                    {
+                        row[c] += elevation;
+                    }
                 }
             }
         }
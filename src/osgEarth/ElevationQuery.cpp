@@ -1,14 +1,44 @@
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/Locators>
 #include <osgEarth/HeightFieldUtils>
+#include <osgEarth/TaskService>
 #include <osgUtil/IntersectionVisitor>
 #include <osgUtil/LineSegmentIntersector>
+#include <OpenThreads/Thread>
+#include <climits>
+#include <map>
 
 #define LC "[ElevationQuery] "
 
 using namespace osgEarth;
 using namespace OpenThreads;
 
+namespace
+{
+    // fetches the heightfield for one tile of a batch query.
+    struct BuildHeightField
+    {
+        void init( const MapFrame* mapf, const TileKey& key )
+        {
+            _mapf = mapf;
+            _key  = key;
+        }
+
+        void execute()
+        {
+            HeightFieldCache* cache = _mapf->getHeightFieldCache();
+            if ( cache )
+                cache->getOrCreateHeightField( *_mapf, _key, true, _hf, 0L );
+        }
+
+        const MapFrame*                _mapf;
+        TileKey                        _key;
+        osg::ref_ptr<osg::HeightField> _hf;
+    };
+
+    typedef std::map< TileKey, std::vector<unsigned> > PointBuckets;
+}
+
 ElevationQuery::ElevationQuery( const Map* map ) :
 _mapf( map, Map::TERRAIN_LAYERS )
 {
@@ -21,6 +51,11 @@ _mapf( mapFrame )
     postCTOR();
 }
 
+ElevationQuery::~ElevationQuery()
+{
+    //nop
+}
+
 void
 ElevationQuery::postCTOR()
 {
@@ -41,6 +76,9 @@ ElevationQuery::sync()
     {
         _tileSize = 0;        
 
+        // the map changed, so the tiles we're holding on to may be stale.
+        _tileCache.clear();
+
         for( ElevationLayerVector::const_iterator i = _mapf.elevationLayers().begin(); i != _mapf.elevationLayers().end(); ++i )
         {
             // we need the maximum tile size
@@ -53,9 +91,15 @@ ElevationQuery::sync()
 
 unsigned int
 ElevationQuery::getMaxLevel( double x, double y, const SpatialReference* srs, const Profile* profile ) const
+{
+    return getMaxLevel( _mapf, x, y, srs, profile );
+}
+
+unsigned int
+ElevationQuery::getMaxLevel( const MapFrame& mapf, double x, double y, const SpatialReference* srs, const Profile* profile )
 {
     unsigned int maxLevel = 0;
-    for( ElevationLayerVector::const_iterator i = _mapf.elevationLayers().begin(); i != _mapf.elevationLayers().end(); ++i )
+    for( ElevationLayerVector::const_iterator i = mapf.elevationLayers().begin(); i != mapf.elevationLayers().end(); ++i )
     {
         unsigned int layerMax = 0;
         osgEarth::TileSource* ts = i->get()->getTileSource();
@@ -90,7 +134,7 @@ ElevationQuery::getMaxLevel( double x, double y, const SpatialReference* srs, co
     // need to check the image layers too, because if image layers do deeper than elevation layers,
     // upsampling occurs that can change the formation of the terrain skin.
     // NOTE: this probably doesn't happen in "triangulation" interpolation mode.. -gw
-    for( ImageLayerVector::const_iterator i = _mapf.imageLayers().begin(); i != _mapf.imageLayers().end(); ++i )
+    for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); ++i )
     {
         unsigned int layerMax = 0;
         osgEarth::TileSource* ts = i->get()->getTileSource();
@@ -171,14 +215,16 @@ ElevationQuery::getElevations(std::vector<osg::Vec3d>& points,
                               double                   desiredResolution )
 {
     sync();
-    for( osg::Vec3dArray::iterator i = points.begin(); i != points.end(); ++i )
+
+    std::vector<double> elevations;
+    std::vector<bool>   valid;
+    getElevationsImpl( points, pointsSRS, elevations, valid, desiredResolution );
+
+    for( unsigned i = 0; i < points.size(); ++i )
     {
-        double elevation;
-        double z = (*i).z();
-        GeoPoint p(pointsSRS, *i, ALTMODE_ABSOLUTE);
-        if ( getElevationImpl( p, elevation, desiredResolution ) )
+        if ( valid[i] )
         {
-            (*i).z() = ignoreZ ? elevation : elevation + z;
+            points[i].z() = ignoreZ ? elevations[i] : elevations[i] + points[i].z();
         }
     }
     return true;
@@ -191,21 +237,183 @@ ElevationQuery::getElevations(const std::vector<osg::Vec3d>& points,
                               double                         desiredResolution )
 {
     sync();
-    for( osg::Vec3dArray::const_iterator i = points.begin(); i != points.end(); ++i )
+
+    std::vector<double> elevations;
+    std::vector<bool>   valid;
+    getElevationsImpl( points, pointsSRS, elevations, valid, desiredResolution );
+
+    out_elevations.insert( out_elevations.end(), elevations.begin(), elevations.end() );
+    return true;
+}
+
+void
+ElevationQuery::getElevationsImpl(const std::vector<osg::Vec3d>& points,
+                                  const SpatialReference*        pointsSRS,
+                                  std::vector<double>&           out_elevations,
+                                  std::vector<bool>&             out_valid,
+                                  double                         desiredResolution )
+{
+    out_elevations.assign( points.size(), 0.0 );
+    out_valid.assign( points.size(), false );
+
+    if ( points.empty() )
+        return;
+
+    if ( _mapf.elevationLayers().empty() )
     {
-        double elevation;
-        GeoPoint p(pointsSRS, *i, ALTMODE_ABSOLUTE);
+        // this means there are no heightfields.
+        out_valid.assign( points.size(), true );
+        return;
+    }
 
-        if ( getElevationImpl(p, elevation, desiredResolution) )
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    const Profile*          profile = _mapf.getProfile();
+    const SpatialReference* mapSRS  = profile->getSRS();
+
+    // transform all the input coords to map coords in one go:
+    std::vector<osg::Vec3d> mapPoints( points );
+    if ( pointsSRS && !pointsSRS->isEquivalentTo(mapSRS) && !pointsSRS->transform(mapPoints, mapSRS) )
+    {
+        // some point failed; fall back on querying them one at a time.
+        for( unsigned i = 0; i < points.size(); ++i )
         {
-            out_elevations.push_back( elevation );
+            GeoPoint p( pointsSRS, points[i], ALTMODE_ABSOLUTE );
+            out_valid[i] = getElevationImpl( p, out_elevations[i], desiredResolution );
         }
+        return;
+    }
+
+    unsigned desiredLevel = UINT_MAX;
+    if ( desiredResolution > 0.0 )
+    {
+        desiredLevel = profile->getLevelOfDetailForHorizResolution( desiredResolution, _tileSize );
+    }
+
+    // group the points by the tile that holds them:
+    PointBuckets buckets;
+    unsigned numOutside = 0;
+    for( unsigned i = 0; i < mapPoints.size(); ++i )
+    {
+        const osg::Vec3d& p = mapPoints[i];
+        unsigned level = osg::minimum( getMaxLevel(p.x(), p.y(), mapSRS, profile), desiredLevel );
+        TileKey key = profile->createTileKey( p.x(), p.y(), level );
+        if ( key.valid() )
+            buckets[key].push_back( i );
         else
+            ++numOutside;
+    }
+
+    if ( numOutside > 0 )
+    {
+        OE_WARN << LC << "Fail: " << numOutside << " coords fall outside map" << std::endl;
+    }
+
+    ElevationInterpolation interp = _mapf.getMapInfo().getElevationInterpolation();
+
+    // work through the tiles in chunks no bigger than the tile cache, so a batch
+    // that covers a large area does not hold every heightfield at once.
+    unsigned chunkSize = osg::maximum( _tileCache.getMaxSize(), 1u );
+
+    PointBuckets::const_iterator chunkStart = buckets.begin();
+    while( chunkStart != buckets.end() )
+    {
+        std::vector<PointBuckets::const_iterator>  chunk;
+        std::vector<osg::ref_ptr<osg::HeightField> > tiles;
+        std::vector< osg::ref_ptr< ParallelTask<BuildHeightField> > > builds;
+
+        // serve what we can from the tile cache:
+        PointBuckets::const_iterator b = chunkStart;
+        for( ; b != buckets.end() && chunk.size() < chunkSize; ++b )
+        {
+            chunk.push_back( b );
+            tiles.push_back( 0L );
+
+            TileCache::Record record;
+            if ( _tileCache.get(b->first, record) )
+                tiles.back() = record.value().get();
+        }
+        chunkStart = b;
+
+        // build the missing heightfields, in parallel if there is more than one:
+        unsigned numMissing = 0;
+        for( unsigned i = 0; i < tiles.size(); ++i )
         {
-            out_elevations.push_back( 0.0 );
+            if ( !tiles[i].valid() )
+                ++numMissing;
+        }
+
+        if ( numMissing > 0 )
+        {
+            Threading::MultiEvent semaphore( numMissing );
+
+            if ( numMissing > 1 && !_batchService.valid() )
+            {
+                _batchService = new TaskService( "ElevationQuery", OpenThreads::GetNumberOfProcessors() );
+            }
+
+            for( unsigned i = 0; i < tiles.size(); ++i )
+            {
+                if ( !tiles[i].valid() )
+                {
+                    ParallelTask<BuildHeightField>* build = new ParallelTask<BuildHeightField>( &semaphore );
+                    build->init( &_mapf, chunk[i]->first );
+                    builds.push_back( build );
+
+                    if ( numMissing > 1 )
+                        _batchService->add( build );
+                    else
+                        (*build)( 0L );
+                }
+                else
+                {
+                    builds.push_back( 0L );
+                }
+            }
+
+            semaphore.wait();
+
+            for( unsigned i = 0; i < tiles.size(); ++i )
+            {
+                if ( builds[i].valid() )
+                {
+                    tiles[i] = builds[i]->_hf.get();
+                    if ( tiles[i].valid() )
+                        _tileCache.insert( chunk[i]->first, tiles[i].get() );
+                    else
+                        OE_WARN << LC << "Unable to create heightfield for key " << chunk[i]->first.str() << std::endl;
+                }
+            }
+        }
+
+        // sample every point of each tile:
+        for( unsigned i = 0; i < tiles.size(); ++i )
+        {
+            const osg::HeightField* tile = tiles[i].get();
+            if ( !tile )
+                continue;
+
+            const GeoExtent& extent = chunk[i]->first.getExtent();
+            double xInterval = extent.width()  / (double)(tile->getNumColumns()-1);
+            double yInterval = extent.height() / (double)(tile->getNumRows()-1);
+
+            const std::vector<unsigned>& indices = chunk[i]->second;
+            for( std::vector<unsigned>::const_iterator j = indices.begin(); j != indices.end(); ++j )
+            {
+                out_elevations[*j] = (double)HeightFieldUtils::getHeightAtLocation(
+                    tile,
+                    mapPoints[*j].x(), mapPoints[*j].y(),
+                    extent.xMin(), extent.yMin(),
+                    xInterval, yInterval, interp );
+
+                out_valid[*j] = true;
+            }
         }
     }
-    return true;
+
+    osg::Timer_t end = osg::Timer::instance()->tick();
+    _queries   += (double)points.size();
+    _totalTime += osg::Timer::instance()->delta_s( start, end );
 }
 
 bool
@@ -273,8 +481,10 @@ ElevationQuery::getElevationImpl(const GeoPoint& point,
     if ( !tile.valid() )
     {
         // generate the heightfield corresponding to the tile key, automatically falling back
-        // on lower resolution if necessary:
-        _mapf.getHeightField( key, true, tile, 0L );
+        // on lower resolution if necessary. The map's cache shares it with the terrain.
+        HeightFieldCache* cache = _mapf.getHeightFieldCache();
+        if ( cache )
+            cache->getOrCreateHeightField( _mapf, key, true, tile, 0L );
 
         // bail out if we could not make a heightfield a all.
         if ( !tile.valid() )
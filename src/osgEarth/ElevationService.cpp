@@ -0,0 +1,354 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ElevationService>
+#include <osgEarth/ElevationQuery>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/TaskService>
+#include <OpenThreads/Thread>
+#include <map>
+
+#define LC "[ElevationService] "
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+
+//------------------------------------------------------------------------
+
+ElevationFuture::ElevationFuture( const GeoPoint& point, double desiredResolution ) :
+_point            ( point ),
+_desiredResolution( desiredResolution ),
+_elevation        ( 0.0 ),
+_resolution       ( 0.0 ),
+_ok               ( false )
+{
+    //nop
+}
+
+bool
+ElevationFuture::wait()
+{
+    while( !_ready.isSet() )
+        _ready.wait();
+    return _ok;
+}
+
+//------------------------------------------------------------------------
+
+// runs one asynchronous query on the service's threads.
+struct ElevationService::AsyncQuery : public TaskRequest
+{
+    AsyncQuery( ElevationService* service, ElevationFuture* future )
+        : _service( service ), _future( future ) { }
+
+    void operator()( ProgressCallback* progress )
+    {
+        _service->runAsync( _future.get() );
+    }
+
+    ElevationService*             _service;
+    osg::ref_ptr<ElevationFuture> _future;
+};
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    typedef std::map< const Map*, osg::ref_ptr<ElevationService> > ServiceRegistry;
+
+    ServiceRegistry  s_services;
+    Threading::Mutex s_servicesMutex;
+}
+
+ElevationService*
+ElevationService::get( const Map* map )
+{
+    if ( !map )
+        return 0L;
+
+    ScopedMutexLock lock( s_servicesMutex );
+
+    // let go of services whose maps are gone.
+    for( ServiceRegistry::iterator i = s_services.begin(); i != s_services.end(); )
+    {
+        if ( !i->second->_map.valid() )
+            s_services.erase( i++ );
+        else
+            ++i;
+    }
+
+    osg::ref_ptr<ElevationService>& service = s_services[map];
+    if ( !service.valid() )
+        service = new ElevationService( map );
+
+    return service.get();
+}
+
+ElevationService::ElevationService( const Map* map ) :
+_map      ( map ),
+_mapf     ( map, Map::TERRAIN_LAYERS, "ElevationService" ),
+_tileSize ( 0 ),
+_tileCache( true, 128 )
+{
+    sync();
+}
+
+ElevationService::~ElevationService()
+{
+    // joins the query threads.
+    _asyncService = 0L;
+
+    // anything still queued never ran.
+    for( Futures::iterator i = _futures.begin(); i != _futures.end(); ++i )
+    {
+        i->get()->_ready.set();
+    }
+}
+
+void
+ElevationService::setMaxTilesToCache( unsigned value )
+{
+    _tileCache.setMaxSize( value );
+}
+
+unsigned
+ElevationService::getMaxTilesToCache() const
+{
+    return _tileCache.getMaxSize();
+}
+
+void
+ElevationService::sync()
+{
+    if ( !_mapf.needsSync() && _tileSize > 0 )
+        return;
+
+    ScopedWriteLock lock( _mapfMutex );
+
+    if ( _mapf.sync() || _tileSize == 0 )
+    {
+        _tileSize = 0;
+        for( ElevationLayerVector::const_iterator i = _mapf.elevationLayers().begin(); i != _mapf.elevationLayers().end(); ++i )
+        {
+            // we need the maximum tile size
+            int layerTileSize = i->get()->getTileSize();
+            if ( layerTileSize > _tileSize )
+                _tileSize = layerTileSize;
+        }
+
+        // the elevation stack changed, so the cached tiles are stale.
+        _tileCache.clear();
+    }
+}
+
+bool
+ElevationService::getElevation(const GeoPoint& point,
+                               double&         out_elevation,
+                               double          desiredResolution,
+                               double*         out_actualResolution)
+{
+    sync();
+    ScopedReadLock lock( _mapfMutex );
+    return getElevationImpl( point, out_elevation, desiredResolution, out_actualResolution );
+}
+
+bool
+ElevationService::getElevations(std::vector<osg::Vec3d>& points,
+                                const SpatialReference*  pointsSRS,
+                                bool                     ignoreZ,
+                                double                   desiredResolution)
+{
+    sync();
+    ScopedReadLock lock( _mapfMutex );
+
+    for( std::vector<osg::Vec3d>::iterator i = points.begin(); i != points.end(); ++i )
+    {
+        double elevation;
+        GeoPoint p( pointsSRS, *i, ALTMODE_ABSOLUTE );
+        if ( getElevationImpl(p, elevation, desiredResolution, 0L) )
+        {
+            (*i).z() = ignoreZ ? elevation : elevation + (*i).z();
+        }
+    }
+    return true;
+}
+
+ElevationFuture*
+ElevationService::getElevationAsync(const GeoPoint& point,
+                                    double          desiredResolution)
+{
+    ElevationFuture* future = new ElevationFuture( point, desiredResolution );
+
+    ScopedMutexLock lock( _asyncMutex );
+
+    if ( !_asyncService.valid() )
+    {
+        _asyncService = new TaskService( "ElevationService", OpenThreads::GetNumberOfProcessors() );
+    }
+
+    _futures.insert( future );
+    _asyncService->add( new AsyncQuery(this, future) );
+
+    return future;
+}
+
+void
+ElevationService::runAsync( ElevationFuture* future )
+{
+    future->_ok = getElevation(
+        future->_point,
+        future->_elevation,
+        future->_desiredResolution,
+        &future->_resolution );
+
+    {
+        ScopedMutexLock lock( _asyncMutex );
+        _futures.erase( future );
+    }
+
+    future->_ready.set();
+}
+
+bool
+ElevationService::getElevationImpl(const GeoPoint& point,
+                                   double&         out_elevation,
+                                   double          desiredResolution,
+                                   double*         out_actualResolution)
+{
+    if ( _mapf.elevationLayers().empty() )
+    {
+        // this means there are no heightfields.
+        out_elevation = 0.0;
+        return true;
+    }
+
+    //This is the max resolution that we actually have data at this point
+    unsigned int bestAvailLevel = ElevationQuery::getMaxLevel( _mapf, point.x(), point.y(), point.getSRS(), _mapf.getProfile() );
+
+    if ( desiredResolution > 0.0 )
+    {
+        unsigned int desiredLevel = _mapf.getProfile()->getLevelOfDetailForHorizResolution( desiredResolution, _tileSize );
+        if ( desiredLevel < bestAvailLevel ) bestAvailLevel = desiredLevel;
+    }
+
+    // transform the input coords to map coords:
+    GeoPoint mapPoint = point;
+    if ( point.isValid() && !point.getSRS()->isEquivalentTo( _mapf.getProfile()->getSRS() ) )
+    {
+        mapPoint = point.transform( _mapf.getProfile()->getSRS() );
+        if ( !mapPoint.isValid() )
+        {
+            OE_WARN << LC << "Fail: coord transform failed" << std::endl;
+            return false;
+        }
+    }
+
+    // get the tilekey corresponding to the tile we need:
+    TileKey key = _mapf.getProfile()->createTileKey( mapPoint.x(), mapPoint.y(), bestAvailLevel );
+    if ( !key.valid() )
+    {
+        OE_WARN << LC << "Fail: coords fall outside map" << std::endl;
+        return false;
+    }
+
+    osg::ref_ptr<osg::HeightField> tile;
+    if ( !getHeightField(key, tile) )
+    {
+        OE_WARN << LC << "Unable to create heightfield for key " << key.str() << std::endl;
+        return false;
+    }
+
+    // see what the actual resolution of the heightfield is.
+    if ( out_actualResolution )
+        *out_actualResolution = (double)tile->getXInterval();
+
+    const GeoExtent& extent = key.getExtent();
+    double xInterval = extent.width()  / (double)(tile->getNumColumns()-1);
+    double yInterval = extent.height() / (double)(tile->getNumRows()-1);
+
+    out_elevation = (double) HeightFieldUtils::getHeightAtLocation(
+        tile.get(),
+        mapPoint.x(), mapPoint.y(),
+        extent.xMin(), extent.yMin(),
+        xInterval, yInterval, _mapf.getMapInfo().getElevationInterpolation() );
+
+    return true;
+}
+
+bool
+ElevationService::getHeightField( const TileKey& key, osg::ref_ptr<osg::HeightField>& out_hf )
+{
+    TileCache::Record record;
+    if ( _tileCache.get(key, record) )
+    {
+        out_hf = record.value().get();
+        return true;
+    }
+
+    // join a fetch already in flight for this key, or start one.
+    osg::ref_ptr<PendingTile> pending;
+    bool fetch = false;
+    {
+        ScopedMutexLock lock( _pendingMutex );
+
+        PendingTiles::iterator i = _pending.find( key );
+        if ( i != _pending.end() )
+        {
+            pending = i->second.get();
+        }
+        else
+        {
+            // a fetch may have finished since we checked the cache.
+            if ( _tileCache.get(key, record) )
+            {
+                out_hf = record.value().get();
+                return true;
+            }
+
+            pending = new PendingTile();
+            _pending[key] = pending.get();
+            fetch = true;
+        }
+    }
+
+    if ( fetch )
+    {
+        // generate the heightfield corresponding to the tile key, automatically falling back
+        // on lower resolution if necessary. The map's cache shares it with the terrain.
+        HeightFieldCache* cache = _mapf.getHeightFieldCache();
+        if ( cache )
+            cache->getOrCreateHeightField( _mapf, key, true, pending->_hf, 0L );
+
+        if ( pending->_hf.valid() )
+            _tileCache.insert( key, pending->_hf.get() );
+
+        {
+            ScopedMutexLock lock( _pendingMutex );
+            _pending.erase( key );
+        }
+
+        pending->_done.set();
+    }
+    else
+    {
+        pending->_done.wait();
+    }
+
+    out_hf = pending->_hf.get();
+    return out_hf.valid();
+}
@@ -29,14 +29,12 @@
 #include <osg/Notify>
 #include <osg/Timer>
 
-#include <gdal_priv.h>
-#include <gdalwarper.h>
-#include <ogr_spatialref.h>
 #include <memory.h>
 
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <vector>
 
 #define LC "[GeoData] "
 
@@ -1234,7 +1232,7 @@ GeoImage::crop( const GeoExtent& extent, bool exact, unsigned int width, unsigne
     //Check for equivalence
     if ( extent.getSRS()->isEquivalentTo( getSRS() ) )
     {
-        //If we want an exact crop or they want to specify the output size of the image, use GDAL
+        //If we want an exact crop or they want to specify the output size of the image, resample with reproject()
         if (exact || width != 0 || height != 0 )
         {
             OE_DEBUG << "[osgEarth::GeoImage::crop] Performing exact crop" << std::endl;
@@ -1253,7 +1251,7 @@ GeoImage::crop( const GeoExtent& extent, bool exact, unsigned int width, unsigne
                 OE_DEBUG << "[osgEarth::GeoImage::crop] Computed output image size " << width << "x" << height << std::endl;
             }
 
-            //Note:  Passing in the current SRS simply forces GDAL to not do any warping
+            //Note:  Passing in the current SRS simply makes reproject() a plain resample
             return reproject( getSRS(), &extent, width, height, useBilinearInterpolation);
         }
         else
@@ -1319,159 +1317,6 @@ GeoImage::addTransparentBorder(bool leftBorder, bool rightBorder, bool bottomBor
 
 namespace
 {
-    osg::Image*
-    createImageFromDataset(GDALDataset* ds)
-    {
-        // called internally -- GDAL lock not required
-
-        //Allocate the image
-        osg::Image *image = new osg::Image;
-        image->allocateImage(ds->GetRasterXSize(), ds->GetRasterYSize(), 1, GL_RGBA, GL_UNSIGNED_BYTE);
-
-        ds->RasterIO(GF_Read, 0, 0, image->s(), image->t(), (void*)image->data(), image->s(), image->t(), GDT_Byte, 4, NULL, 4, 4 * image->s(), 1);
-        ds->FlushCache();
-
-        image->flipVertical();
-
-        return image;
-    }
-
-    GDALDataset*
-    createMemDS(int width, int height, double minX, double minY, double maxX, double maxY, const std::string &projection)
-    {
-        //Get the MEM driver
-        GDALDriver* memDriver = (GDALDriver*)GDALGetDriverByName("MEM");
-        if (!memDriver)
-        {
-            OE_NOTICE << "[osgEarth::GeoData] Could not get MEM driver" << std::endl;
-        }
-
-        //Create the in memory dataset.
-        GDALDataset* ds = memDriver->Create("", width, height, 4, GDT_Byte, 0);
-
-        //Initialize the color interpretation
-        ds->GetRasterBand(1)->SetColorInterpretation(GCI_RedBand);
-        ds->GetRasterBand(2)->SetColorInterpretation(GCI_GreenBand);
-        ds->GetRasterBand(3)->SetColorInterpretation(GCI_BlueBand);
-        ds->GetRasterBand(4)->SetColorInterpretation(GCI_AlphaBand);
-
-        //Initialize the geotransform
-        double geotransform[6];
-        double x_units_per_pixel = (maxX - minX) / (double)width;
-        double y_units_per_pixel = (maxY - minY) / (double)height;
-        geotransform[0] = minX;
-        geotransform[1] = x_units_per_pixel;
-        geotransform[2] = 0;
-        geotransform[3] = maxY;
-        geotransform[4] = 0;
-        geotransform[5] = -y_units_per_pixel;
-        ds->SetGeoTransform(geotransform);
-        ds->SetProjection(projection.c_str());
-
-        return ds;
-    }
-
-    GDALDataset*
-    createDataSetFromImage(const osg::Image* image, double minX, double minY, double maxX, double maxY, const std::string &projection)
-    {
-        //Clone the incoming image
-        osg::ref_ptr<osg::Image> clonedImage = new osg::Image(*image);
-
-        //Flip the image
-        clonedImage->flipVertical();  
-
-        GDALDataset* srcDS = createMemDS(image->s(), image->t(), minX, minY, maxX, maxY, projection);
-
-        //Write the image data into the memory dataset
-        //If the image is already RGBA, just read all 4 bands in one call
-        if (image->getPixelFormat() == GL_RGBA)
-        {
-            srcDS->RasterIO(GF_Write, 0, 0, clonedImage->s(), clonedImage->t(), (void*)clonedImage->data(), clonedImage->s(), clonedImage->t(), GDT_Byte, 4, NULL, 4, 4 * image->s(), 1);
-        }
-        else if (image->getPixelFormat() == GL_RGB)
-        {    
-            //OE_NOTICE << "[osgEarth::GeoData] Reprojecting RGB " << std::endl;
-            //Read the read, green and blue bands
-            srcDS->RasterIO(GF_Write, 0, 0, clonedImage->s(), clonedImage->t(), (void*)clonedImage->data(), clonedImage->s(), clonedImage->t(), GDT_Byte, 3, NULL, 3, 3 * image->s(), 1);
-
-            //Initialize the alpha values to 255.
-            unsigned char *alpha = new unsigned char[clonedImage->s() * clonedImage->t()];
-            memset(alpha, 255, clonedImage->s() * clonedImage->t());
-
-            GDALRasterBand* alphaBand = srcDS->GetRasterBand(4);
-            alphaBand->RasterIO(GF_Write, 0, 0, clonedImage->s(), clonedImage->t(), alpha, clonedImage->s(),clonedImage->t(), GDT_Byte, 0, 0);
-
-            delete[] alpha;
-        }
-        else
-        {
-            OE_WARN << LC << "createDataSetFromImage: unsupported pixel format " << std::hex << image->getPixelFormat() << std::endl;
-        }
-        srcDS->FlushCache();
-
-        return srcDS;
-    }
-
-    osg::Image*
-    reprojectImage(osg::Image* srcImage, const std::string srcWKT, double srcMinX, double srcMinY, double srcMaxX, double srcMaxY,
-                   const std::string destWKT, double destMinX, double destMinY, double destMaxX, double destMaxY,
-                   int width = 0, int height = 0, bool useBilinearInterpolation = true)
-    {
-        GDAL_SCOPED_LOCK;
-        osg::Timer_t start = osg::Timer::instance()->tick();
-
-        //Create a dataset from the source image
-        GDALDataset* srcDS = createDataSetFromImage(srcImage, srcMinX, srcMinY, srcMaxX, srcMaxY, srcWKT);
-
-        OE_DEBUG << LC << "Source image is " << srcImage->s() << "x" << srcImage->t() << std::endl;
-
-
-        if (width == 0 || height == 0)
-        {
-            double outgeotransform[6];
-            double extents[4];
-            void* transformer = GDALCreateGenImgProjTransformer(srcDS, srcWKT.c_str(), NULL, destWKT.c_str(), 1, 0, 0);
-            GDALSuggestedWarpOutput2(srcDS,
-                GDALGenImgProjTransform, transformer,
-                outgeotransform,
-                &width,
-                &height,
-                extents,
-                0);
-            GDALDestroyGenImgProjTransformer(transformer);
-        }
-	    OE_DEBUG << "Creating warped output of " << width <<"x" << height << std::endl;
-       
-        GDALDataset* destDS = createMemDS(width, height, destMinX, destMinY, destMaxX, destMaxY, destWKT);
-
-        if (useBilinearInterpolation == true)
-        {
-            GDALReprojectImage(srcDS, NULL,
-                               destDS, NULL,
-                               GRA_Bilinear,
-                               0,0,0,0,0);
-        }
-        else
-        {
-            GDALReprojectImage(srcDS, NULL,
-                               destDS, NULL,
-                               GRA_NearestNeighbour,
-                               0,0,0,0,0);
-        }
-
-        osg::Image* result = createImageFromDataset(destDS);
-        
-        delete srcDS;
-        delete destDS;  
-
-        osg::Timer_t end = osg::Timer::instance()->tick();
-
-        OE_DEBUG << "Reprojected image in " << osg::Timer::instance()->delta_m(start,end) << std::endl;
-
-        return result;
-    }    
-
-
     osg::Image*
     manualReproject(
         const osg::Image* image, 
@@ -1649,6 +1494,521 @@ namespace
 
         return result;
     }
+
+    // Control points are placed at most this many destination pixels apart.
+#define WARP_MAX_STEP  16
+
+    // Largest allowed error of an interpolated source coordinate, in source pixels.
+#define WARP_MAX_ERROR 0.125
+
+    /**
+     * Whether warpImage() can sample an image directly: 8 bits per component,
+     * 1 to 4 components, and a single slice.
+     */
+    bool canWarp(const osg::Image* image)
+    {
+        if ( !image || image->r() != 1 || image->getDataType() != GL_UNSIGNED_BYTE )
+            return false;
+
+        unsigned numComponents = osg::Image::computeNumComponents( image->getPixelFormat() );
+        unsigned bits = osg::Image::computePixelSizeInBits( image->getPixelFormat(), image->getDataType() );
+        return numComponents >= 1 && numComponents <= 4 && bits == numComponents * 8;
+    }
+
+    /**
+     * Control point positions along one axis: every "step" pixels, plus one on
+     * the last pixel. There are always at least two so every pixel falls in a cell.
+     */
+    void computeWarpNodes(unsigned size, unsigned step, std::vector<unsigned>& out_nodes)
+    {
+        out_nodes.clear();
+        for(unsigned i = 0; i + 1 < size; i += step)
+            out_nodes.push_back( i );
+        out_nodes.push_back( size-1 );
+        if ( out_nodes.size() < 2 )
+            out_nodes.push_back( size-1 );
+    }
+
+    /**
+     * For each pixel along an axis, the cell that holds it and its position
+     * within that cell [0..1].
+     */
+    void locateWarpCells(unsigned size, const std::vector<unsigned>& nodes, std::vector<unsigned>& out_cells, std::vector<float>& out_weights)
+    {
+        out_cells.resize( size );
+        out_weights.resize( size );
+        unsigned cell = 0;
+        for(unsigned i = 0; i < size; ++i)
+        {
+            while( cell + 2 < nodes.size() && i > nodes[cell+1] )
+                ++cell;
+            unsigned span = nodes[cell+1] - nodes[cell];
+            out_cells[i]   = cell;
+            out_weights[i] = span > 0 ? (float)(i - nodes[cell]) / (float)span : 0.0f;
+        }
+    }
+
+    /**
+     * Transforms destination pixel centers to source pixel coordinates.
+     * Each point is (column, row) in destination pixels; results go to out_x/out_y
+     * in the same order.
+     */
+    bool transformWarpPoints(const std::vector<osg::Vec2d>& pixels,
+                             const GeoExtent&               srcExtent,
+                             unsigned                       srcWidth,
+                             unsigned                       srcHeight,
+                             const GeoExtent&               destExtent,
+                             unsigned                       destWidth,
+                             unsigned                       destHeight,
+                             std::vector<double>&           out_x,
+                             std::vector<double>&           out_y)
+    {
+        const double dx = destExtent.width()  / (double)destWidth;
+        const double dy = destExtent.height() / (double)destHeight;
+
+        std::vector<osg::Vec3d> points( pixels.size() );
+        for(unsigned i = 0; i < pixels.size(); ++i)
+        {
+            points[i].set(
+                destExtent.xMin() + (pixels[i].x() + 0.5) * dx,
+                destExtent.yMin() + (pixels[i].y() + 0.5) * dy,
+                0.0 );
+        }
+
+        bool ok = destExtent.getSRS()->transform( points, srcExtent.getSRS() );
+
+        // source pixel coordinates, with pixel centers on whole numbers.
+        const double xfac = (double)srcWidth  / srcExtent.width();
+        const double yfac = (double)srcHeight / srcExtent.height();
+
+        out_x.resize( points.size() );
+        out_y.resize( points.size() );
+        for(unsigned i = 0; i < points.size(); ++i)
+        {
+            out_x[i] = (points[i].x() - srcExtent.xMin()) * xfac - 0.5;
+            out_y[i] = (points[i].y() - srcExtent.yMin()) * yfac - 0.5;
+        }
+        return ok;
+    }
+
+    /**
+     * Source pixel coordinates of a sparse grid of control points over the
+     * destination image. The spacing starts at WARP_MAX_STEP and halves until
+     * interpolating between control points stays within WARP_MAX_ERROR of the
+     * exact transform at the cell centers, so strongly curved transforms end up
+     * with a dense grid.
+     */
+    struct WarpGrid
+    {
+        std::vector<unsigned> _nodesX, _nodesY;
+        std::vector<double>   _srcX, _srcY;     // row-major, _nodesY.size() rows of _nodesX.size()
+
+        bool compute(const GeoExtent& srcExtent, unsigned srcWidth, unsigned srcHeight,
+                     const GeoExtent& destExtent, unsigned destWidth, unsigned destHeight)
+        {
+            for(unsigned step = WARP_MAX_STEP; step >= 1; step /= 2)
+            {
+                computeWarpNodes( destWidth,  step, _nodesX );
+                computeWarpNodes( destHeight, step, _nodesY );
+                const unsigned nx = _nodesX.size(), ny = _nodesY.size();
+
+                std::vector<osg::Vec2d> pixels;
+                pixels.reserve( nx*ny );
+                for(unsigned j = 0; j < ny; ++j)
+                    for(unsigned i = 0; i < nx; ++i)
+                        pixels.push_back( osg::Vec2d(_nodesX[i], _nodesY[j]) );
+
+                // if any control point fails to transform, interpolation can't be
+                // trusted; drop to one control point per pixel.
+                bool ok = transformWarpPoints( pixels, srcExtent, srcWidth, srcHeight, destExtent, destWidth, destHeight, _srcX, _srcY );
+                if ( step == 1 )
+                    return ok;
+                if ( !ok )
+                {
+                    step = 2;
+                    continue;
+                }
+
+                // compare the interpolated cell centers against the real thing.
+                std::vector<osg::Vec2d> centers;
+                centers.reserve( (nx-1)*(ny-1) );
+                for(unsigned j = 0; j + 1 < ny; ++j)
+                    for(unsigned i = 0; i + 1 < nx; ++i)
+                        centers.push_back( osg::Vec2d(0.5*(_nodesX[i]+_nodesX[i+1]), 0.5*(_nodesY[j]+_nodesY[j+1])) );
+
+                std::vector<double> cx, cy;
+                if ( !transformWarpPoints( centers, srcExtent, srcWidth, srcHeight, destExtent, destWidth, destHeight, cx, cy ) )
+                {
+                    step = 2;
+                    continue;
+                }
+
+                double maxError = 0.0;
+                unsigned k = 0;
+                for(unsigned j = 0; j + 1 < ny; ++j)
+                {
+                    for(unsigned i = 0; i + 1 < nx; ++i, ++k)
+                    {
+                        unsigned n00 = j*nx + i, n10 = n00 + 1, n01 = n00 + nx, n11 = n01 + 1;
+                        double ix = 0.25*(_srcX[n00] + _srcX[n10] + _srcX[n01] + _srcX[n11]);
+                        double iy = 0.25*(_srcY[n00] + _srcY[n10] + _srcY[n01] + _srcY[n11]);
+                        maxError = osg::maximum( maxError, osg::maximum(fabs(ix-cx[k]), fabs(iy-cy[k])) );
+                    }
+                }
+
+                // the negated test also rejects NaNs.
+                if ( !(maxError > WARP_MAX_ERROR) )
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    /** Copies the source pixel nearest to each sample point. */
+    template<unsigned N>
+    void warpNearest(const unsigned char* src, unsigned srcRowBytes, int srcWidth, int srcHeight,
+                     const float* px, const float* py, unsigned count, unsigned char* out)
+    {
+        const float xmax = (float)srcWidth - 0.5f, ymax = (float)srcHeight - 0.5f;
+        for(unsigned c = 0; c < count; ++c, out += N)
+        {
+            const float x = px[c], y = py[c];
+            if ( !(x >= -0.5f && x <= xmax && y >= -0.5f && y <= ymax) )
+                continue;
+
+            int col = osg::minimum( (int)(x + 0.5f), srcWidth-1 );
+            int row = osg::minimum( (int)(y + 0.5f), srcHeight-1 );
+            const unsigned char* p = src + row*srcRowBytes + col*N;
+            for(unsigned k = 0; k < N; ++k)
+                out[k] = p[k];
+        }
+    }
+
+    /** Blends the four source pixels around each sample point, in 8-bit fixed point. */
+    template<unsigned N>
+    void warpBilinear(const unsigned char* src, unsigned srcRowBytes, int srcWidth, int srcHeight,
+                      const float* px, const float* py, unsigned count, unsigned char* out)
+    {
+        const float xmax = (float)srcWidth - 0.5f, ymax = (float)srcHeight - 0.5f;
+        for(unsigned c = 0; c < count; ++c, out += N)
+        {
+            const float x = px[c], y = py[c];
+            if ( !(x >= -0.5f && x <= xmax && y >= -0.5f && y <= ymax) )
+                continue;
+
+            // floor() without the call; x and y are >= -0.5 here.
+            int col0 = (int)(x + 1.0f) - 1;
+            int row0 = (int)(y + 1.0f) - 1;
+            int wx = (int)((x - (float)col0) * 256.0f + 0.5f);
+            int wy = (int)((y - (float)row0) * 256.0f + 0.5f);
+
+            int col1 = osg::minimum( col0+1, srcWidth-1 );
+            int row1 = osg::minimum( row0+1, srcHeight-1 );
+            col0 = osg::maximum( col0, 0 );
+            row0 = osg::maximum( row0, 0 );
+
+            const unsigned char* p00 = src + row0*srcRowBytes + col0*N;
+            const unsigned char* p10 = src + row0*srcRowBytes + col1*N;
+            const unsigned char* p01 = src + row1*srcRowBytes + col0*N;
+            const unsigned char* p11 = src + row1*srcRowBytes + col1*N;
+
+            for(unsigned k = 0; k < N; ++k)
+            {
+                int bottom = p00[k] * (256 - wx) + p10[k] * wx;
+                int top    = p01[k] * (256 - wx) + p11[k] * wx;
+                out[k] = (unsigned char)((bottom * (256 - wy) + top * wy + 32768) >> 16);
+            }
+        }
+    }
+
+    /**
+     * Reprojects an 8-bit image without going through GDAL. A sparse grid of
+     * control points is transformed into the source SRS (see WarpGrid); source
+     * coordinates in between are interpolated one destination row at a time,
+     * and the kernels above sample the image buffer directly. Nothing here takes
+     * the GDAL lock, so any number of threads can warp at once.
+     */
+    osg::Image*
+    warpImage(
+        const osg::Image* image,
+        const GeoExtent&  src_extent,
+        const GeoExtent&  dest_extent,
+        unsigned int      width,
+        unsigned int      height,
+        bool              useBilinearInterpolation)
+    {
+        if (width == 0 || height == 0)
+        {
+            //If no width and height are specified, just use the minimum dimension for the image
+            width = osg::minimum(image->s(), image->t());
+            height = osg::minimum(image->s(), image->t());
+        }
+
+        WarpGrid grid;
+        if ( !grid.compute(src_extent, image->s(), image->t(), dest_extent, width, height) )
+        {
+            // we can't tell which points failed; carry on, since the bounds
+            // checks in the kernels drop samples that land outside the source.
+            OE_DEBUG << LC << "Some points failed to transform during image warp" << std::endl;
+        }
+
+        osg::Image* result = new osg::Image();
+        result->allocateImage(width, height, 1, image->getPixelFormat(), GL_UNSIGNED_BYTE);
+        result->setInternalTextureFormat(image->getInternalTextureFormat());
+
+        //Initialize the image to be completely transparent/black
+        memset(result->data(), 0, result->getImageSizeInBytes());
+
+        std::vector<unsigned> cellX, cellY;
+        std::vector<float>    weightX, weightY;
+        locateWarpCells( width,  grid._nodesX, cellX, weightX );
+        locateWarpCells( height, grid._nodesY, cellY, weightY );
+
+        const unsigned nx = grid._nodesX.size();
+        std::vector<double> nodeRowX( nx ), nodeRowY( nx );
+        std::vector<float>  px( width ), py( width );
+
+        const unsigned char* src = image->data();
+        const unsigned srcRowBytes = image->getRowSizeInBytes();
+        const unsigned numComponents = osg::Image::computeNumComponents( image->getPixelFormat() );
+
+        for(unsigned r = 0; r < height; ++r)
+        {
+            // source coordinates of the control point columns at this row,
+            const double* x0 = &grid._srcX[cellY[r] * nx];
+            const double* y0 = &grid._srcY[cellY[r] * nx];
+            const double  wy = weightY[r];
+            for(unsigned i = 0; i < nx; ++i)
+            {
+                nodeRowX[i] = x0[i] + (x0[i+nx] - x0[i]) * wy;
+                nodeRowY[i] = y0[i] + (y0[i+nx] - y0[i]) * wy;
+            }
+
+            // ...and of every pixel in the row.
+            for(unsigned c = 0; c < width; ++c)
+            {
+                const unsigned i = cellX[c];
+                const double   wx = weightX[c];
+                px[c] = (float)(nodeRowX[i] + (nodeRowX[i+1] - nodeRowX[i]) * wx);
+                py[c] = (float)(nodeRowY[i] + (nodeRowY[i+1] - nodeRowY[i]) * wx);
+            }
+
+            unsigned char* out = result->data(0, r);
+
+            if ( useBilinearInterpolation )
+            {
+                switch( numComponents )
+                {
+                case 1: warpBilinear<1>( src, srcRowBytes, image->s(), image->t(), &px[0], &py[0], width, out ); break;
+                case 2: warpBilinear<2>( src, srcRowBytes, image->s(), image->t(), &px[0], &py[0], width, out ); break;
+                case 3: warpBilinear<3>( src, srcRowBytes, image->s(), image->t(), &px[0], &py[0], width, out ); break;
+                case 4: warpBilinear<4>( src, srcRowBytes, image->s(), image->t(), &px[0], &py[0], width, out ); break;
+                }
+            }
+            else
+            {
+                switch( numComponents )
+                {
+                case 1: warpNearest<1>( src, srcRowBytes, image->s(), image->t(), &px[0], &py[0], width, out ); break;
+                case 2: warpNearest<2>( src, srcRowBytes, image->s(), image->t(), &px[0], &py[0], width, out ); break;
+                case 3: warpNearest<3>( src, srcRowBytes, image->s(), image->t(), &px[0], &py[0], width, out ); break;
+                case 4: warpNearest<4>( src, srcRowBytes, image->s(), image->t(), &px[0], &py[0], width, out ); break;
+                }
+            }
+        }
+
+        return result;
+    }
+    /**
+     * Whether source x depends only on destination x, and source y only on
+     * destination y, when reprojecting between two SRSs. That holds for a
+     * plain resample and for the spherical mercator <-> geographic pair,
+     * which is the most common reprojection by far (web tile services on a
+     * geodetic profile).
+     */
+    bool isSeparable(const SpatialReference* from, const SpatialReference* to)
+    {
+        // user-defined SRSs can remap points in pre/postTransform.
+        if ( from->isUserDefined() || to->isUserDefined() )
+            return false;
+
+        return
+            from->isEquivalentTo( to ) ||
+            ( from->isSphericalMercator() && to->isGeographic() ) ||
+            ( from->isGeographic() && to->isSphericalMercator() );
+    }
+
+    /**
+     * Lookup table for one axis of a separable warp: for each destination
+     * column (or row), the source pixel(s) to read and how to blend them.
+     */
+    struct WarpAxis
+    {
+        std::vector<int>           _i0, _i1;    // source pixels to blend
+        std::vector<int>           _w;          // 8-bit weight of _i1
+        std::vector<unsigned char> _valid;      // 0 if the sample lands outside the source
+        bool                       _contiguous; // destination pixel i reads source pixel _i0[0]+i, unblended
+
+        void compute(const std::vector<double>& coords, int srcSize, bool bilinear)
+        {
+            const unsigned size = coords.size();
+            _i0.assign( size, 0 );
+            _i1.assign( size, 0 );
+            _w.assign( size, 0 );
+            _valid.assign( size, 0 );
+            _contiguous = true;
+
+            for(unsigned i = 0; i < size; ++i)
+            {
+                const double v = coords[i];
+                if ( !(v >= -0.5 && v <= (double)srcSize - 0.5) )
+                {
+                    _contiguous = false;
+                    continue;
+                }
+
+                _valid[i] = 1;
+                if ( bilinear )
+                {
+                    int i0 = (int)(v + 1.0) - 1;
+                    _w[i]  = (int)((v - (double)i0) * 256.0 + 0.5);
+                    _i1[i] = osg::minimum( i0+1, srcSize-1 );
+                    _i0[i] = osg::maximum( i0, 0 );
+                    if ( _w[i] == 256 )
+                    {
+                        _i0[i] = _i1[i];
+                        _w[i] = 0;
+                    }
+                }
+                else
+                {
+                    _i0[i] = _i1[i] = osg::minimum( (int)(v + 0.5), srcSize-1 );
+                }
+
+                if ( _w[i] != 0 || _i0[i] != _i0[0] + (int)i )
+                    _contiguous = false;
+            }
+        }
+    };
+
+    /** Fills one destination row from one or two source rows through a column table. */
+    template<unsigned N>
+    void warpSeparableRow(const unsigned char* row0, const unsigned char* row1, int wy,
+                          const WarpAxis& cols, unsigned char* out)
+    {
+        const unsigned width = cols._i0.size();
+
+        if ( cols._contiguous )
+        {
+            const unsigned char* p0 = row0 + cols._i0[0]*N;
+            if ( wy == 0 )
+            {
+                // straight row copy.
+                memcpy( out, p0, width*N );
+            }
+            else
+            {
+                const unsigned char* p1 = row1 + cols._i0[0]*N;
+                for(unsigned k = 0; k < width*N; ++k)
+                    out[k] = (unsigned char)((p0[k] * (256 - wy) + p1[k] * wy + 128) >> 8);
+            }
+            return;
+        }
+
+        for(unsigned c = 0; c < width; ++c, out += N)
+        {
+            if ( !cols._valid[c] )
+                continue;
+
+            const int wx = cols._w[c];
+            const unsigned char* p00 = row0 + cols._i0[c]*N;
+            const unsigned char* p10 = row0 + cols._i1[c]*N;
+            const unsigned char* p01 = row1 + cols._i0[c]*N;
+            const unsigned char* p11 = row1 + cols._i1[c]*N;
+
+            for(unsigned k = 0; k < N; ++k)
+            {
+                int bottom = p00[k] * (256 - wx) + p10[k] * wx;
+                int top    = p01[k] * (256 - wx) + p11[k] * wx;
+                out[k] = (unsigned char)((bottom * (256 - wy) + top * wy + 32768) >> 16);
+            }
+        }
+    }
+
+    /**
+     * Reprojects an 8-bit image between two SRSs for which isSeparable() is
+     * true. Only one row and one column of points go through the transform;
+     * they become row and column remap tables, and each destination row is
+     * gathered from at most two source rows. With matching horizontal
+     * resolution (the usual mercator -> geodetic tile case) a row is a plain
+     * memcpy.
+     */
+    osg::Image*
+    warpSeparableImage(
+        const osg::Image* image,
+        const GeoExtent&  src_extent,
+        const GeoExtent&  dest_extent,
+        unsigned int      width,
+        unsigned int      height,
+        bool              useBilinearInterpolation)
+    {
+        if (width == 0 || height == 0)
+        {
+            //If no width and height are specified, just use the minimum dimension for the image
+            width = osg::minimum(image->s(), image->t());
+            height = osg::minimum(image->s(), image->t());
+        }
+
+        // one pass along the middle row for the columns, one along the middle
+        // column for the rows.
+        std::vector<osg::Vec2d> colPixels( width ), rowPixels( height );
+        for(unsigned c = 0; c < width; ++c)
+            colPixels[c].set( c, 0.5*(height-1) );
+        for(unsigned r = 0; r < height; ++r)
+            rowPixels[r].set( 0.5*(width-1), r );
+
+        std::vector<double> colX, colY, rowX, rowY;
+        bool ok =
+            transformWarpPoints( colPixels, src_extent, image->s(), image->t(), dest_extent, width, height, colX, colY ) &&
+            transformWarpPoints( rowPixels, src_extent, image->s(), image->t(), dest_extent, width, height, rowX, rowY );
+        if ( !ok )
+        {
+            OE_DEBUG << LC << "Some points failed to transform during separable image warp" << std::endl;
+        }
+
+        WarpAxis cols, rows;
+        cols.compute( colX, image->s(), useBilinearInterpolation );
+        rows.compute( rowY, image->t(), useBilinearInterpolation );
+
+        osg::Image* result = new osg::Image();
+        result->allocateImage(width, height, 1, image->getPixelFormat(), GL_UNSIGNED_BYTE);
+        result->setInternalTextureFormat(image->getInternalTextureFormat());
+
+        //Initialize the image to be completely transparent/black
+        memset(result->data(), 0, result->getImageSizeInBytes());
+
+        const unsigned numComponents = osg::Image::computeNumComponents( image->getPixelFormat() );
+
+        for(unsigned r = 0; r < height; ++r)
+        {
+            if ( !rows._valid[r] )
+                continue;
+
+            const unsigned char* row0 = image->data(0, rows._i0[r]);
+            const unsigned char* row1 = image->data(0, rows._i1[r]);
+            unsigned char*       out  = result->data(0, r);
+
+            switch( numComponents )
+            {
+            case 1: warpSeparableRow<1>( row0, row1, rows._w[r], cols, out ); break;
+            case 2: warpSeparableRow<2>( row0, row1, rows._w[r], cols, out ); break;
+            case 3: warpSeparableRow<3>( row0, row1, rows._w[r], cols, out ); break;
+            case 4: warpSeparableRow<4>( row0, row1, rows._w[r], cols, out ); break;
+            }
+        }
+
+        return result;
+    }
 }
 
 
@@ -1668,27 +2028,19 @@ GeoImage::reproject(const SpatialReference* to_srs, const GeoExtent* to_extent,
 
     osg::Image* resultImage = 0L;
 
-    if ( getSRS()->isUserDefined()      || 
-        to_srs->isUserDefined()         ||
-        getSRS()->isSphericalMercator() ||
-        to_srs->isSphericalMercator() )
-        //( getSRS()->isSphericalMercator() && to_srs->isGeographic() ) ||
-        //( getSRS()->isGeographic() && to_srs->isSphericalMercator() ) )
+    if ( canWarp(getImage()) && isSeparable(getSRS(), destExtent.getSRS()) )
     {
-        // if either of the SRS is a custom projection, we have to do a manual reprojection since
-        // GDAL will not recognize the SRS.
-        resultImage = manualReproject(getImage(), getExtent(), *to_extent, width, height);
+        resultImage = warpSeparableImage(getImage(), getExtent(), destExtent, width, height, useBilinearInterpolation);
+    }
+    else if ( canWarp(getImage()) )
+    {
+        resultImage = warpImage(getImage(), getExtent(), destExtent, width, height, useBilinearInterpolation);
     }
     else
     {
-        // otherwise use GDAL.
-        resultImage = reprojectImage(getImage(),
-            getSRS()->getWKT(),
-            getExtent().xMin(), getExtent().yMin(), getExtent().xMax(), getExtent().yMax(),
-            to_srs->getWKT(),
-            destExtent.xMin(), destExtent.yMin(), destExtent.xMax(), destExtent.yMax(),
-            width, height, useBilinearInterpolation);
-    }   
+        // formats the warper can't sample directly go through the pixel reader.
+        resultImage = manualReproject(getImage(), getExtent(), destExtent, width, height);
+    }
     return GeoImage(resultImage, destExtent);
 }
 
@@ -52,6 +52,34 @@ GeoMath::distance(const std::vector< osg::Vec3d > &points, double radius)
     return length;
 }
 
+void
+GeoMath::distances(const std::vector< osg::Vec3d > &points, std::vector< double >& out_distances, double radius)
+{
+    out_distances.clear();
+    if (points.size() < 2)
+        return;
+
+    out_distances.reserve(points.size()-1);
+
+    double lat1 = osg::DegreesToRadians(points[0].y());
+    double lon1 = osg::DegreesToRadians(points[0].x());
+    double cosLat1 = cos(lat1);
+
+    for (unsigned int i = 1; i < points.size(); ++i)
+    {
+        double lat2 = osg::DegreesToRadians(points[i].y());
+        double lon2 = osg::DegreesToRadians(points[i].x());
+        double cosLat2 = cos(lat2);
+
+        double sinHalfDLat = sin(0.5*(lat2-lat1));
+        double sinHalfDLon = sin(0.5*(lon2-lon1));
+        double a = sinHalfDLat*sinHalfDLat + cosLat1*cosLat2*sinHalfDLon*sinHalfDLon;
+        out_distances.push_back( radius * 2.0 * atan2(sqrt(a), sqrt(1.0-a)) );
+
+        lat1 = lat2, lon1 = lon2, cosLat1 = cosLat2;
+    }
+}
+
 double
 GeoMath::distance(const osg::Vec3d& p1, const osg::Vec3d& p2, const SpatialReference* srs )
 {
@@ -185,6 +213,40 @@ GeoMath::interpolate(double lat1Rad, double lon1Rad,
     em.convertXYZToLatLongHeight( v0.x(), v0.y(), v0.z(), out_latRad, out_lonRad, dummy );
 }
 
+void
+GeoMath::interpolate(const osg::Vec3d& p0, const osg::Vec3d& p1, unsigned parts, std::vector<osg::Vec3d>& out)
+{
+    static osg::EllipsoidModel em;
+
+    out.push_back( p0 );
+    if ( parts < 2 )
+        return;
+
+    osg::Vec3d v0, v1;
+
+    em.convertLatLongHeightToXYZ(osg::DegreesToRadians(p0.y()), osg::DegreesToRadians(p0.x()), 0, v0.x(), v0.y(), v0.z());
+    double r0 = v0.length();
+    v0.normalize();
+    em.convertLatLongHeightToXYZ(osg::DegreesToRadians(p1.y()), osg::DegreesToRadians(p1.x()), 0, v1.x(), v1.y(), v1.z());
+    double r1 = v1.length();
+    v1.normalize();
+
+    osg::Vec3d axis   = v0 ^ v1;
+    double     angle  = acos( v0 * v1 );
+    double     radius = 0.5*(r0 + r1);
+    double     zdelta = p1.z() - p0.z();
+
+    for( unsigned i=1; i<parts; ++i )
+    {
+        double t = double(i)/double(parts);
+        osg::Vec3d v = (osg::Quat(angle * t, axis) * v0) * radius;
+
+        double lat, lon, dummy;
+        em.convertXYZToLatLongHeight( v.x(), v.y(), v.z(), lat, lon, dummy );
+        out.push_back( osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), p0.z() + t*zdelta) );
+    }
+}
+
 double
 GeoMath::rhumbDistance(double lat1Rad, double lon1Rad,
                        double lat2Rad, double lon2Rad,
@@ -218,6 +280,37 @@ GeoMath::rhumbDistance(const std::vector< osg::Vec3d > &points, double radius)
     return length;
 }
 
+void
+GeoMath::rhumbDistances(const std::vector< osg::Vec3d > &points, std::vector< double >& out_distances, double radius)
+{
+    out_distances.clear();
+    if (points.size() < 2)
+        return;
+
+    out_distances.reserve(points.size()-1);
+
+    // the Mercator latitude of each point, computed once:
+    double lat1 = osg::DegreesToRadians(points[0].y());
+    double lon1 = osg::DegreesToRadians(points[0].x());
+    double phi1 = log(tan(lat1/2.0+osg::PI/4.0));
+
+    for (unsigned int i = 1; i < points.size(); ++i)
+    {
+        double lat2 = osg::DegreesToRadians(points[i].y());
+        double lon2 = osg::DegreesToRadians(points[i].x());
+        double phi2 = log(tan(lat2/2.0+osg::PI/4.0));
+
+        double dLat = (lat2 - lat1);
+        double dLon = osg::absolute(lon2 - lon1);
+        double dPhi = phi2 - phi1;
+        double q = (!osg::isNaN(dLat/dPhi)) ? dLat/dPhi : cos(lat1);  // E-W line gives dPhi=0
+        if (dLon > osg::PI) dLon = 2.0*osg::PI - dLon;
+        out_distances.push_back( sqrt(dLat*dLat + q*q*dLon*dLon) * radius );
+
+        lat1 = lat2, lon1 = lon2, phi1 = phi2;
+    }
+}
+
 double
 GeoMath::rhumbBearing(double lat1Rad, double lon1Rad,
                       double lat2Rad, double lon2Rad)
@@ -254,3 +347,27 @@ GeoMath::rhumbDestination(double lat1Rad, double lon1Rad,
   out_lonRad = lon2Rad;
 }
 
+void
+GeoMath::rhumbInterpolate(const osg::Vec3d& p0, const osg::Vec3d& p1, unsigned parts, std::vector<osg::Vec3d>& out)
+{
+    out.push_back( p0 );
+    if ( parts < 2 )
+        return;
+
+    // the line's length and bearing are the same for every step.
+    double lat1 = osg::DegreesToRadians(p0.y()), lon1 = osg::DegreesToRadians(p0.x());
+    double lat2 = osg::DegreesToRadians(p1.y()), lon2 = osg::DegreesToRadians(p1.x());
+
+    double totalDistance = rhumbDistance( lat1, lon1, lat2, lon2 );
+    double bearing       = rhumbBearing( lat1, lon1, lat2, lon2 );
+    double zdelta        = p1.z() - p0.z();
+
+    for( unsigned i=1; i<parts; ++i )
+    {
+        double t = double(i)/double(parts);
+
+        double lat3, lon3;
+        rhumbDestination( lat1, lon1, bearing, t * totalDistance, lat3, lon3 );
+        out.push_back( osg::Vec3d(osg::RadiansToDegrees(lon3), osg::RadiansToDegrees(lat3), p0.z() + t*zdelta) );
+    }
+}
@@ -19,15 +19,22 @@
 
 #include <osgEarth/Geoid>
 #include <osgEarth/HeightFieldUtils>
+#include <osgEarth/GeoData>
+#include <osgEarth/StringUtils>
+#include <iomanip>
 
 #define LC "[Geoid] "
 
 using namespace osgEarth;
 
 
+// number of per-tile height grids each geoid keeps around
+#define GRID_CACHE_SIZE 256
+
 Geoid::Geoid() :
 _units( Units::METERS ),
-_valid( false )
+_valid( false ),
+_grids( true, GRID_CACHE_SIZE )
 {
     //nop
 }
@@ -43,6 +50,7 @@ void
 Geoid::setHeightField( osg::HeightField* hf )
 {
     _hf = hf;
+    _grids.clear();
     _bounds = Bounds(
         _hf->getOrigin().x(),
         _hf->getOrigin().y(),
@@ -91,6 +99,66 @@ Geoid::getHeight(double lat_deg, double lon_deg, const ElevationInterpolation& i
     return result;
 }
 
+bool
+Geoid::getHeights(const GeoExtent&                      extent,
+                  unsigned                              numCols,
+                  unsigned                              numRows,
+                  osg::ref_ptr<const osg::HeightField>& out_grid ) const
+{
+    if ( !_valid || !extent.isValid() || numCols < 2 || numRows < 2 )
+        return false;
+
+    std::string key = Stringify()
+        << std::setprecision(17)
+        << extent.getSRS()->getHorizInitString() << ";"
+        << extent.xMin() << "," << extent.yMin() << "," << extent.xMax() << "," << extent.yMax() << ";"
+        << numCols << "x" << numRows;
+
+    GridCache::Record rec;
+    if ( _grids.get(key, rec) )
+    {
+        out_grid = rec.value().get();
+        return true;
+    }
+
+    // geodetic location of every post:
+    double dx = extent.width()  / (double)(numCols-1);
+    double dy = extent.height() / (double)(numRows-1);
+
+    std::vector<osg::Vec3d> points;
+    points.reserve( numCols*numRows );
+    for( unsigned r=0; r<numRows; ++r )
+    {
+        double y = extent.yMin() + dy*(double)r;
+        for( unsigned c=0; c<numCols; ++c )
+        {
+            points.push_back( osg::Vec3d(extent.xMin() + dx*(double)c, y, 0.0) );
+        }
+    }
+
+    if ( !extent.getSRS()->isGeographic() )
+    {
+        if ( !extent.getSRS()->transform(points, extent.getSRS()->getGeographicSRS()) )
+            return false;
+    }
+
+    osg::ref_ptr<osg::HeightField> grid = new osg::HeightField();
+    grid->allocate( numCols, numRows );
+    grid->setOrigin( osg::Vec3d(extent.xMin(), extent.yMin(), 0.0) );
+    grid->setXInterval( dx );
+    grid->setYInterval( dy );
+
+    osg::HeightField::HeightList& heights = grid->getFloatArray()->asVector();
+    for( unsigned i=0; i<points.size(); ++i )
+    {
+        heights[i] = getHeight( points[i].y(), points[i].x(), INTERP_BILINEAR );
+    }
+
+    _grids.insert( key, grid.get() );
+    out_grid = grid.get();
+    return true;
+}
+
 bool
 Geoid::isEquivalentTo( const Geoid& rhs ) const
 {
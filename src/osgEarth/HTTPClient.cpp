@@ -20,6 +20,9 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Version>
 #include <osgEarth/Progress>
+#include <osgEarth/TaskService>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/TraceRecorder>
 #include <osgDB/ReadFile>
 #include <osgDB/Registry>
 #include <osgDB/FileNameUtils>
@@ -27,11 +30,21 @@
 #include <string.h>
 #include <sstream>
 #include <fstream>
+#include <iomanip>
 #include <iterator>
 #include <iostream>
 #include <algorithm>
+#include <list>
 #include <curl/curl.h>
 
+#if LIBCURL_VERSION_NUM < 0x071c00
+#  ifdef WIN32
+#    include <winsock2.h>
+#  else
+#    include <sys/select.h>
+#  endif
+#endif
+
 #define LC "[HTTPClient] "
 
 //#define OE_TEST OE_NOTICE
@@ -128,6 +141,43 @@ namespace osgEarth
     }
 }
 
+// Captures the response headers we need for cache revalidation.
+static size_t CurlHeaderCallback(char* buffer, size_t size, size_t nitems, void* data)
+{
+    size_t realsize = size * nitems;
+    typedef std::map<std::string,std::string> Headers;
+    Headers* headers = (Headers*)data;
+    if ( headers )
+    {
+        std::string line( buffer, realsize );
+        std::string::size_type colon = line.find( ':' );
+        if ( colon != std::string::npos )
+        {
+            std::string name  = trim( line.substr(0, colon) );
+            std::string value = trim( line.substr(colon+1) );
+            if ( ciEquals(name, IOMetadata::ETAG) )
+                (*headers)[IOMetadata::ETAG] = value;
+            else if ( ciEquals(name, IOMetadata::LAST_MODIFIED) )
+                (*headers)[IOMetadata::LAST_MODIFIED] = value;
+            else if ( ciEquals(name, IOMetadata::CONTENT_RANGE) )
+                (*headers)[IOMetadata::CONTENT_RANGE] = value;
+        }
+    }
+    return realsize;
+}
+
+// Builds a curl header list from request headers (caller frees it).
+static struct curl_slist* makeCurlHeaders(const HTTPRequest::Headers& headers)
+{
+    struct curl_slist* list = 0L;
+    for( HTTPRequest::Headers::const_iterator i = headers.begin(); i != headers.end(); ++i )
+    {
+        std::string line = i->first + ": " + i->second;
+        list = curl_slist_append( list, line.c_str() );
+    }
+    return list;
+}
+
 static int CurlProgressCallback(void *clientp,double dltotal,double dlnow,double ultotal,double ulnow)
 {
     ProgressCallback* callback = (ProgressCallback*)clientp;
@@ -149,6 +199,7 @@ HTTPRequest::HTTPRequest( const std::string& url )
 
 HTTPRequest::HTTPRequest( const HTTPRequest& rhs ) :
 _parameters( rhs._parameters ),
+_headers( rhs._headers ),
 _url( rhs._url )
 {
     //nop
@@ -186,6 +237,18 @@ HTTPRequest::getParameters() const
     return _parameters; 
 }
 
+void
+HTTPRequest::addHeader( const std::string& name, const std::string& value )
+{
+    _headers[name] = value;
+}
+
+const HTTPRequest::Headers&
+HTTPRequest::getHeaders() const
+{
+    return _headers;
+}
+
 std::string
 HTTPRequest::getURL() const
 {
@@ -309,6 +372,76 @@ namespace
 
     // HTTP debugging.
     static bool                        s_HTTP_DEBUG = false;
+
+    // transfer statistics.
+    static Threading::Mutex            s_statsMutex;
+    static unsigned                    s_numResponses = 0;
+    static double                      s_numBytesReceived = 0.0;
+    static HTTPHostStatsMap            s_hostStats;
+
+    // "host[:port]" part of a URL, used to key the host statistics.
+    std::string getHostOf( const std::string& url )
+    {
+        std::string::size_type start = url.find( "://" );
+        start = start == std::string::npos ? 0 : start+3;
+        std::string::size_type end = url.find_first_of( "/?#", start );
+        std::string host = url.substr( start, end == std::string::npos ? std::string::npos : end-start );
+
+        // drop any user credentials.
+        std::string::size_type at = host.rfind( '@' );
+        if ( at != std::string::npos )
+            host = host.substr( at+1 );
+
+        return toLower( host );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+HTTPHostStats::HTTPHostStats() :
+_numResponses( 0 ),
+_numCanceled ( 0 ),
+_numFailed   ( 0 ),
+_numRetries  ( 0 ),
+_bytes       ( 0.0 ),
+_inFlight    ( 0 ),
+_peakInFlight( 0 )
+{
+    //nop
+}
+
+std::string
+HTTPHostStats::toString() const
+{
+    std::stringstream buf;
+    buf << std::fixed << std::setprecision(1);
+
+    buf << "responses=" << _numResponses
+        << " canceled=" << _numCanceled
+        << " failed=" << _numFailed
+        << " retries=" << _numRetries
+        << " KB=" << _bytes/1024.0
+        << " peak in flight=" << _peakInFlight;
+
+    buf << " codes:";
+    for( std::map<long,unsigned>::const_iterator i = _statusCodes.begin(); i != _statusCodes.end(); ++i )
+        buf << " " << i->first << "=" << i->second;
+
+    const char*             names[] = { "dns", "connect", "tls", "first byte", "total" };
+    const LatencyHistogram* hists[] = { &_dnsTime, &_connectTime, &_tlsTime, &_firstByteTime, &_totalTime };
+    for( unsigned i = 0; i < 5; ++i )
+    {
+        if ( hists[i]->getCount() == 0 )
+            continue;
+
+        buf << "\n    " << std::setw(10) << std::left << names[i] << std::right
+            << " n=" << hists[i]->getCount()
+            << " mean=" << hists[i]->getMean()
+            << " p95<=" << hists[i]->getPercentile(0.95)
+            << " max=" << hists[i]->getMax() << " ms";
+    }
+
+    return buf.str();
 }
 
 HTTPClient&
@@ -368,10 +501,15 @@ HTTPClient::initializeImpl()
 
     curl_easy_setopt( _curl_handle, CURLOPT_USERAGENT, userAgent.c_str() );
     curl_easy_setopt( _curl_handle, CURLOPT_WRITEFUNCTION, osgEarth::StreamObjectReadCallback );
+    curl_easy_setopt( _curl_handle, CURLOPT_HEADERFUNCTION, &CurlHeaderCallback );
     curl_easy_setopt( _curl_handle, CURLOPT_FOLLOWLOCATION, (void*)1 );
     curl_easy_setopt( _curl_handle, CURLOPT_MAXREDIRS, (void*)5 );
     curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSFUNCTION, &CurlProgressCallback);
     curl_easy_setopt( _curl_handle, CURLOPT_NOPROGRESS, (void*)0 ); //FALSE);    
+
+    // advertise every encoding curl can decode (gzip, deflate); responses
+    // arrive already decompressed.
+    curl_easy_setopt( _curl_handle, CURLOPT_ENCODING, "" );
     long timeout = s_timeout;
     const char* timeoutEnv = getenv("OSGEARTH_HTTP_TIMEOUT");
     if (timeoutEnv)
@@ -423,7 +561,7 @@ HTTPClient::globalInit()
 }
 
 void
-HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port) const
+HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port)
 {
     // try to set proxy host/port by reading the CURL proxy options
     if ( options )
@@ -445,6 +583,76 @@ HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host,
     }
 }
 
+void
+HTTPClient::getProxySettings(const osgDB::Options* options, std::string& proxy_addr, std::string& proxy_auth)
+{
+    std::string proxy_host;
+    std::string proxy_port = "8080";
+
+    //TODO: don't do all this proxy setup on every GET. Just do it once per client, or only when 
+    // the proxy information changes.
+
+    //Try to get the proxy settings from the global settings
+    if (s_proxySettings.isSet())
+    {
+        proxy_host = s_proxySettings.get().hostName();
+        std::stringstream buf;
+        buf << s_proxySettings.get().port();
+        proxy_port = buf.str();
+
+        std::string proxy_username = s_proxySettings.get().userName();
+        std::string proxy_password = s_proxySettings.get().password();
+        if (!proxy_username.empty() && !proxy_password.empty())
+        {
+            proxy_auth = proxy_username + std::string(":") + proxy_password;
+        }
+    }
+
+    //Try to get the proxy settings from the local options that are passed in.
+    readOptions( options, proxy_host, proxy_port );
+
+    optional< ProxySettings > proxySettings;
+    ProxySettings::fromOptions( options, proxySettings );
+    if (proxySettings.isSet())
+    {       
+        proxy_host = proxySettings.get().hostName();
+        proxy_port = toString<int>(proxySettings.get().port());
+        OE_DEBUG << "Read proxy settings from options " << proxy_host << " " << proxy_port << std::endl;
+    }
+
+    //Try to get the proxy settings from the environment variable
+    const char* proxyEnvAddress = getenv("OSG_CURL_PROXY");
+    if (proxyEnvAddress) //Env Proxy Settings
+    {
+        proxy_host = std::string(proxyEnvAddress);
+
+        const char* proxyEnvPort = getenv("OSG_CURL_PROXYPORT"); //Searching Proxy Port on Env
+        if (proxyEnvPort)
+        {
+            proxy_port = std::string( proxyEnvPort );
+        }
+    }
+
+    const char* proxyEnvAuth = getenv("OSGEARTH_CURL_PROXYAUTH");	
+    if (proxyEnvAuth)
+    {
+        proxy_auth = std::string(proxyEnvAuth);
+    }
+
+    if ( !proxy_host.empty() )
+    {
+        std::stringstream buf;
+        buf << proxy_host << ":" << proxy_port;
+        proxy_addr = buf.str();
+    
+        if ( s_HTTP_DEBUG )
+            OE_NOTICE << LC << "Using proxy: " << proxy_addr << std::endl;
+
+        if ( s_HTTP_DEBUG && !proxy_auth.empty() )
+            OE_NOTICE << LC << "Using proxy authentication " << proxy_auth << std::endl;
+    }
+}
+
 namespace
 {
     // from: http://www.rosettacode.org/wiki/Tokenizing_A_String#C.2B.2B
@@ -477,7 +685,7 @@ namespace
 void
 HTTPClient::decodeMultipartStream(const std::string&   boundary,
                                   HTTPResponse::Part*  input,
-                                  HTTPResponse::Parts& output) const
+                                  HTTPResponse::Parts& output)
 {
     std::string bstr = std::string("--") + boundary;
     std::string line;
@@ -580,7 +788,15 @@ HTTPClient::readImage(const std::string&    location,
                       const osgDB::Options* options,
                       ProgressCallback*     callback)
 {
-    return getClient().doReadImage( location, options, callback );
+    return getClient().doReadImage( HTTPRequest(location), options, callback );
+}
+
+ReadResult
+HTTPClient::readImage(const HTTPRequest&    request,
+                      const osgDB::Options* options,
+                      ProgressCallback*     callback)
+{
+    return getClient().doReadImage( request, options, callback );
 }
 
 ReadResult
@@ -588,7 +804,15 @@ HTTPClient::readNode(const std::string&    location,
                      const osgDB::Options* options,
                      ProgressCallback*     callback)
 {
-    return getClient().doReadNode( location, options, callback );
+    return getClient().doReadNode( HTTPRequest(location), options, callback );
+}
+
+ReadResult
+HTTPClient::readNode(const HTTPRequest&    request,
+                     const osgDB::Options* options,
+                     ProgressCallback*     callback)
+{
+    return getClient().doReadNode( request, options, callback );
 }
 
 ReadResult
@@ -596,7 +820,15 @@ HTTPClient::readObject(const std::string&    location,
                        const osgDB::Options* options,
                        ProgressCallback*     callback)
 {
-    return getClient().doReadObject( location, options, callback );
+    return getClient().doReadObject( HTTPRequest(location), options, callback );
+}
+
+ReadResult
+HTTPClient::readObject(const HTTPRequest&    request,
+                       const osgDB::Options* options,
+                       ProgressCallback*     callback)
+{
+    return getClient().doReadObject( request, options, callback );
 }
 
 ReadResult
@@ -604,7 +836,15 @@ HTTPClient::readString(const std::string&    location,
                        const osgDB::Options* options,
                        ProgressCallback*     callback)
 {
-    return getClient().doReadString( location, options, callback );
+    return getClient().doReadString( HTTPRequest(location), options, callback );
+}
+
+ReadResult
+HTTPClient::readString(const HTTPRequest&    request,
+                       const osgDB::Options* options,
+                       ProgressCallback*     callback)
+{
+    return getClient().doReadString( request, options, callback );
 }
 
 bool
@@ -614,92 +854,553 @@ HTTPClient::download(const std::string& uri,
     return getClient().doDownload( uri, localPath );
 }
 
-HTTPResponse
-HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, ProgressCallback* callback) const
+//----------------------------------------------------------------------------
+
+HTTPFuture::HTTPFuture( const HTTPRequest& request, const osgDB::Options* options, ProgressCallback* progress ) :
+_url     ( request.getURL() ),
+_headers ( request.getHeaders() ),
+_options ( options ),
+_progress( progress ? progress : new ProgressCallback() )
 {
-    initialize();
+    //nop
+}
 
-    const osgDB::AuthenticationMap* authenticationMap = (options && options->getAuthenticationMap()) ? 
-            options->getAuthenticationMap() :
+const HTTPResponse&
+HTTPFuture::getResponse()
+{
+    while( !_ready.isSet() )
+        _ready.wait();
+    return _response;
+}
+
+void
+HTTPFuture::cancel()
+{
+    _progress->cancel();
+}
+
+/**
+ * Runs all asynchronous transfers on one thread through a curl "multi" handle.
+ * The multi handle owns the connection cache (so connections stay alive between
+ * requests to the same host) and shares DNS lookups across its transfers.
+ */
+class osgEarth::AsyncHTTPEngine : public OpenThreads::Thread
+{
+public:
+    struct Transfer
+    {
+        osg::ref_ptr<HTTPFuture>         _future;
+        osg::ref_ptr<HTTPResponse::Part> _part;
+        StreamObject*                    _sp;
+        CURL*                            _handle;
+        struct curl_slist*               _headers;
+        char                             _errorBuf[CURL_ERROR_SIZE];
+    };
+
+    AsyncHTTPEngine() : _done(false), _started(false), _maxActive(32u)
+    {
+        _multi = curl_multi_init();
+#if LIBCURL_VERSION_NUM >= 0x071000
+        curl_multi_setopt( _multi, CURLMOPT_MAXCONNECTS, (long)_maxActive );
+#endif
+    }
+
+    virtual ~AsyncHTTPEngine()
+    {
+        _done = true;
+        while( isRunning() )
+            OpenThreads::Thread::YieldCurrentThread();
+
+        for( std::list<CURL*>::iterator i = _idleHandles.begin(); i != _idleHandles.end(); ++i )
+            curl_easy_cleanup( *i );
+        curl_multi_cleanup( _multi );
+    }
+
+    void add( HTTPFuture* future )
+    {
+        Threading::ScopedMutexLock lock( _queueMutex );
+        _queue.push_back( future );
+        if ( !_started )
+        {
+            _started = true;
+            start();
+        }
+    }
+
+    void setMaxActive( unsigned value ) { _maxActive = std::max(value, 1u); }
+    unsigned getMaxActive() const { return _maxActive; }
+
+    void run()
+    {
+        while( !_done )
+        {
+            admit();
+
+            if ( _active.empty() )
+            {
+                OpenThreads::Thread::microSleep( 5000 );
+                continue;
+            }
+
+            int running = 0;
+            while( curl_multi_perform(_multi, &running) == CURLM_CALL_MULTI_PERFORM );
+
+            int left = 0;
+            CURLMsg* msg;
+            while( (msg = curl_multi_info_read(_multi, &left)) != 0L )
+            {
+                if ( msg->msg == CURLMSG_DONE )
+                    finish( msg->easy_handle, msg->data.result );
+            }
+
+            // wait for socket activity (bounded, so that new requests get admitted)
+            if ( !_active.empty() )
+            {
+#if LIBCURL_VERSION_NUM >= 0x071c00
+                int numfds = 0;
+                curl_multi_wait( _multi, 0L, 0, 10, &numfds );
+#else
+                fd_set readfds, writefds, errfds;
+                FD_ZERO(&readfds); FD_ZERO(&writefds); FD_ZERO(&errfds);
+                int maxfd = -1;
+                curl_multi_fdset( _multi, &readfds, &writefds, &errfds, &maxfd );
+                if ( maxfd >= 0 )
+                {
+                    struct timeval tv;
+                    tv.tv_sec = 0;
+                    tv.tv_usec = 10000;
+                    ::select( maxfd+1, &readfds, &writefds, &errfds, &tv );
+                }
+                else
+                {
+                    OpenThreads::Thread::microSleep( 10000 );
+                }
+#endif
+            }
+        }
+
+        // abandon anything still in flight.
+        for( std::map<CURL*,Transfer*>::iterator i = _active.begin(); i != _active.end(); ++i )
+        {
+            curl_multi_remove_handle( _multi, i->first );
+            HTTPClient::endTransfer( i->second->_future->getURL() );
+            i->second->_future->_response._cancelled = true;
+            complete( i->second );
+        }
+        _active.clear();
+    }
+
+private:
+    void admit()
+    {
+        Threading::ScopedMutexLock lock( _queueMutex );
+        while( !_queue.empty() && _active.size() < _maxActive )
+        {
+            osg::ref_ptr<HTTPFuture> future = _queue.front();
+            _queue.pop_front();
+
+            if ( future->getProgressCallback()->isCanceled() )
+            {
+                future->_response._cancelled = true;
+                future->_ready.set();
+                future->getProgressCallback()->onCompleted();
+                continue;
+            }
+
+            Transfer* t  = new Transfer();
+            t->_future   = future.get();
+            t->_part     = new HTTPResponse::Part();
+            t->_sp       = new StreamObject( &t->_part->_stream );
+            t->_handle   = acquireHandle();
+            t->_headers  = makeCurlHeaders( future->_headers );
+            t->_errorBuf[0] = 0;
+
+            configure( t );
+            curl_multi_add_handle( _multi, t->_handle );
+            _active[t->_handle] = t;
+            HTTPClient::beginTransfer( future->getURL() );
+        }
+    }
+
+    CURL* acquireHandle()
+    {
+        if ( _idleHandles.empty() )
+            return curl_easy_init();
+
+        CURL* handle = _idleHandles.front();
+        _idleHandles.pop_front();
+        curl_easy_reset( handle );
+        return handle;
+    }
+
+    void configure( Transfer* t )
+    {
+        CURL* handle = t->_handle;
+        HTTPFuture* future = t->_future.get();
+
+        std::string userAgent = s_userAgent;
+        const char* userAgentEnv = getenv("OSGEARTH_USERAGENT");
+        if (userAgentEnv)
+            userAgent = std::string(userAgentEnv);
+
+        curl_easy_setopt( handle, CURLOPT_USERAGENT, userAgent.c_str() );
+        curl_easy_setopt( handle, CURLOPT_URL, future->getURL().c_str() );
+        curl_easy_setopt( handle, CURLOPT_WRITEFUNCTION, osgEarth::StreamObjectReadCallback );
+        curl_easy_setopt( handle, CURLOPT_WRITEDATA, (void*)t->_sp );
+        curl_easy_setopt( handle, CURLOPT_HEADERFUNCTION, &CurlHeaderCallback );
+        curl_easy_setopt( handle, CURLOPT_HEADERDATA, (void*)&t->_part->_headers );
+        if ( t->_headers )
+            curl_easy_setopt( handle, CURLOPT_HTTPHEADER, t->_headers );
+        curl_easy_setopt( handle, CURLOPT_FOLLOWLOCATION, (void*)1 );
+        curl_easy_setopt( handle, CURLOPT_MAXREDIRS, (void*)5 );
+        curl_easy_setopt( handle, CURLOPT_PROGRESSFUNCTION, &CurlProgressCallback );
+        curl_easy_setopt( handle, CURLOPT_PROGRESSDATA, (void*)future->getProgressCallback() );
+        curl_easy_setopt( handle, CURLOPT_NOPROGRESS, (void*)0 );
+        curl_easy_setopt( handle, CURLOPT_ENCODING, "" );
+        curl_easy_setopt( handle, CURLOPT_ERRORBUFFER, (void*)t->_errorBuf );
+        curl_easy_setopt( handle, CURLOPT_SSL_VERIFYPEER, (void*)0 );
+        curl_easy_setopt( handle, CURLOPT_NOSIGNAL, (void*)1 );
+#if LIBCURL_VERSION_NUM >= 0x071900
+        curl_easy_setopt( handle, CURLOPT_TCP_KEEPALIVE, 1L );
+#endif
+
+        long timeout = s_timeout;
+        const char* timeoutEnv = getenv("OSGEARTH_HTTP_TIMEOUT");
+        if (timeoutEnv)
+            timeout = osgEarth::as<long>(std::string(timeoutEnv), 0);
+        curl_easy_setopt( handle, CURLOPT_TIMEOUT, timeout );
+
+        std::string proxy_addr, proxy_auth;
+        HTTPClient::getProxySettings( future->_options.get(), proxy_addr, proxy_auth );
+        if ( !proxy_addr.empty() )
+        {
+            curl_easy_setopt( handle, CURLOPT_PROXY, proxy_addr.c_str() );
+            if ( !proxy_auth.empty() )
+                curl_easy_setopt( handle, CURLOPT_PROXYUSERPWD, proxy_auth.c_str() );
+        }
+
+        const osgDB::AuthenticationMap* authenticationMap = (future->_options.valid() && future->_options->getAuthenticationMap()) ? 
+            future->_options->getAuthenticationMap() :
             osgDB::Registry::instance()->getAuthenticationMap();
 
-    std::string proxy_host;
-    std::string proxy_port = "8080";
+        const osgDB::AuthenticationDetails* details = authenticationMap ?
+            authenticationMap->getAuthenticationDetails(future->getURL()) :
+            0;
 
-    std::string proxy_auth;
+        if (details)
+        {
+            std::string password(details->username + std::string(":") + details->password);
+            curl_easy_setopt( handle, CURLOPT_USERPWD, password.c_str() );
+#if LIBCURL_VERSION_NUM >= 0x070a07
+            curl_easy_setopt( handle, CURLOPT_HTTPAUTH, details->httpAuthentication ); 
+#endif
+        }
+    }
 
-    //TODO: don't do all this proxy setup on every GET. Just do it once per client, or only when 
-    // the proxy information changes.
+    void finish( CURL* handle, CURLcode res )
+    {
+        std::map<CURL*,Transfer*>::iterator i = _active.find( handle );
+        if ( i == _active.end() )
+            return;
 
-    //Try to get the proxy settings from the global settings
-    if (s_proxySettings.isSet())
+        Transfer* t = i->second;
+        _active.erase( i );
+        curl_multi_remove_handle( _multi, handle );
+        HTTPClient::endTransfer( t->_future->getURL() );
+
+        long response_code = 0L;
+        curl_easy_getinfo( handle, CURLINFO_RESPONSE_CODE, &response_code );
+
+        if ( s_HTTP_DEBUG )
+        {
+            OE_NOTICE << LC << "GET(" << response_code << ") async: \"" << t->_future->getURL() << "\"" << std::endl;
+        }
+
+        t->_future->_response = HTTPClient::makeResponse( handle, res, response_code, t->_part.get(), t->_future->getURL() );
+        complete( t );
+    }
+
+    void complete( Transfer* t )
     {
-        proxy_host = s_proxySettings.get().hostName();
-        std::stringstream buf;
-        buf << s_proxySettings.get().port();
-        proxy_port = buf.str();
+        _idleHandles.push_back( t->_handle );
 
-        std::string proxy_username = s_proxySettings.get().userName();
-        std::string proxy_password = s_proxySettings.get().password();
-        if (!proxy_username.empty() && !proxy_password.empty())
+        t->_future->_ready.set();
+        t->_future->getProgressCallback()->onCompleted();
+
+        if ( t->_headers )
+            curl_slist_free_all( t->_headers );
+        delete t->_sp;
+        delete t;
+    }
+
+    CURLM*                              _multi;
+    volatile bool                       _done;
+    bool                                _started;
+    unsigned                            _maxActive;
+    std::map<CURL*,Transfer*>           _active;
+    std::list<CURL*>                    _idleHandles;
+    std::list< osg::ref_ptr<HTTPFuture> > _queue;
+    Threading::Mutex                    _queueMutex;
+};
+
+namespace
+{
+    AsyncHTTPEngine*         s_asyncEngine = 0L;
+    Threading::Mutex         s_asyncEngineMutex;
+    unsigned                 s_maxAsyncRequests = 32u;
+}
+
+HTTPFuture*
+HTTPClient::getAsync( const HTTPRequest&    request,
+                      const osgDB::Options* options,
+                      ProgressCallback*     callback )
+{
+    {
+        Threading::ScopedMutexLock lock( s_asyncEngineMutex );
+        if ( !s_asyncEngine )
         {
-            proxy_auth = proxy_username + std::string(":") + proxy_password;
+            s_asyncEngine = new AsyncHTTPEngine();
+            s_asyncEngine->setMaxActive( s_maxAsyncRequests );
         }
     }
 
-    //Try to get the proxy settings from the local options that are passed in.
-    readOptions( options, proxy_host, proxy_port );
+    HTTPFuture* future = new HTTPFuture( request, options, callback );
+    s_asyncEngine->add( future );
+    return future;
+}
 
-    optional< ProxySettings > proxySettings;
-    ProxySettings::fromOptions( options, proxySettings );
-    if (proxySettings.isSet())
-    {       
-        proxy_host = proxySettings.get().hostName();
-        proxy_port = toString<int>(proxySettings.get().port());
-        OE_DEBUG << "Read proxy settings from options " << proxy_host << " " << proxy_port << std::endl;
+HTTPFuture*
+HTTPClient::getAsync( const std::string&    url,
+                      const osgDB::Options* options,
+                      ProgressCallback*     callback )
+{
+    return getAsync( HTTPRequest(url), options, callback );
+}
+
+void
+HTTPClient::setMaxAsyncRequests( unsigned value )
+{
+    Threading::ScopedMutexLock lock( s_asyncEngineMutex );
+    s_maxAsyncRequests = std::max( value, 1u );
+    if ( s_asyncEngine )
+        s_asyncEngine->setMaxActive( s_maxAsyncRequests );
+}
+
+unsigned
+HTTPClient::getMaxAsyncRequests()
+{
+    return s_maxAsyncRequests;
+}
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    /** Signals the waiting thread once the pool is finished with a decode. */
+    struct DecodeProgress : public ProgressCallback
+    {
+        void onCompleted() { _done.set(); }
+        Threading::Event _done;
+    };
+
+    /** Decodes one downloaded image on a decode pool thread. */
+    struct DecodeTask : public TaskRequest
+    {
+        DecodeTask( osgDB::ReaderWriter* reader, std::istream& in, const osgDB::Options* options ) :
+            _reader( reader ), _in( in ), _options( options ) { }
+
+        void operator()( ProgressCallback* progress )
+        {
+            ScopedTrace trace( "decode", "http" );
+            _rr = _reader->readImage( _in, _options.get() );
+
+            unsigned maxSize = HTTPClient::getMaxJPEGSize();
+            osg::Image* image = _rr.getImage();
+            if ( image && maxSize > 0 &&
+                (image->s() > (int)maxSize || image->t() > (int)maxSize) &&
+                 _reader->acceptsExtension("jpg") )
+            {
+                double scale = (double)maxSize / (double)osg::maximum(image->s(), image->t());
+                osg::ref_ptr<osg::Image> reduced;
+                if ( ImageUtils::resizeImage(
+                    image,
+                    osg::maximum(1u, (unsigned)(image->s() * scale)),
+                    osg::maximum(1u, (unsigned)(image->t() * scale)),
+                    reduced) )
+                {
+                    _rr = osgDB::ReaderWriter::ReadResult( reduced.get() );
+                }
+            }
+        }
+
+        osgDB::ReaderWriter*                    _reader;
+        std::istream&                           _in;
+        osg::ref_ptr<const osgDB::Options>      _options;
+        osgDB::ReaderWriter::ReadResult         _rr;
+    };
+
+    osg::ref_ptr<TaskService> s_decodeService;
+    Threading::Mutex          s_decodeServiceMutex;
+    int                       s_numDecodeThreads = -1; // -1 = not yet initialized
+    unsigned                  s_maxJPEGSize      = 0u;
+
+    void initDecodeThreads()
+    {
+        if ( s_numDecodeThreads < 0 )
+        {
+            s_numDecodeThreads = OpenThreads::GetNumberOfProcessors();
+            const char* decodeEnv = ::getenv("OSGEARTH_DECODE_THREADS");
+            if ( decodeEnv )
+                s_numDecodeThreads = osg::maximum( 0, osgEarth::as<int>(std::string(decodeEnv), s_numDecodeThreads) );
+        }
     }
 
-    //Try to get the proxy settings from the environment variable
-    const char* proxyEnvAddress = getenv("OSG_CURL_PROXY");
-    if (proxyEnvAddress) //Env Proxy Settings
+    /** Decodes an image in the decode pool, or inline if the pool is disabled. */
+    osgDB::ReaderWriter::ReadResult decodeImage( osgDB::ReaderWriter* reader, std::istream& in, const osgDB::Options* options )
     {
-        proxy_host = std::string(proxyEnvAddress);
+        osg::ref_ptr<TaskService> service;
+        {
+            Threading::ScopedMutexLock lock( s_decodeServiceMutex );
+            initDecodeThreads();
+            if ( s_numDecodeThreads > 0 )
+            {
+                if ( !s_decodeService.valid() )
+                    s_decodeService = new TaskService( "HTTP decode", s_numDecodeThreads );
+                service = s_decodeService.get();
+            }
+        }
 
-        const char* proxyEnvPort = getenv("OSG_CURL_PROXYPORT"); //Searching Proxy Port on Env
-        if (proxyEnvPort)
+        osg::ref_ptr<DecodeTask> task = new DecodeTask( reader, in, options );
+
+        if ( !service.valid() )
         {
-            proxy_port = std::string( proxyEnvPort );
+            (*task)( 0L );
         }
+        else
+        {
+            osg::ref_ptr<DecodeProgress> progress = new DecodeProgress();
+            task->setProgressCallback( progress.get() );
+            service->add( task.get() );
+            progress->_done.wait();
+        }
+
+        return task->_rr;
     }
+}
 
-    const char* proxyEnvAuth = getenv("OSGEARTH_CURL_PROXYAUTH");	
-    if (proxyEnvAuth)
+void
+HTTPClient::setNumDecodeThreads( unsigned value )
+{
+    Threading::ScopedMutexLock lock( s_decodeServiceMutex );
+    s_numDecodeThreads = (int)value;
+    if ( s_decodeService.valid() && value > 0 )
+        s_decodeService->setNumThreads( value );
+}
+
+unsigned
+HTTPClient::getNumDecodeThreads()
+{
+    Threading::ScopedMutexLock lock( s_decodeServiceMutex );
+    initDecodeThreads();
+    return (unsigned)s_numDecodeThreads;
+}
+
+void
+HTTPClient::setMaxJPEGSize( unsigned value )
+{
+    s_maxJPEGSize = value;
+}
+
+unsigned
+HTTPClient::getMaxJPEGSize()
+{
+    return s_maxJPEGSize;
+}
+
+unsigned
+HTTPClient::getNumResponses()
+{
+    Threading::ScopedMutexLock lock( s_statsMutex );
+    return s_numResponses;
+}
+
+double
+HTTPClient::getNumBytesReceived()
+{
+    Threading::ScopedMutexLock lock( s_statsMutex );
+    return s_numBytesReceived;
+}
+
+void
+HTTPClient::getHostStats( HTTPHostStatsMap& out_stats )
+{
+    Threading::ScopedMutexLock lock( s_statsMutex );
+    out_stats = s_hostStats;
+}
+
+void
+HTTPClient::resetStats()
+{
+    Threading::ScopedMutexLock lock( s_statsMutex );
+    s_numResponses     = 0;
+    s_numBytesReceived = 0.0;
+
+    // keep the transfers still running; they will end after the reset.
+    for( HTTPHostStatsMap::iterator i = s_hostStats.begin(); i != s_hostStats.end(); ++i )
     {
-        proxy_auth = std::string(proxyEnvAuth);
+        unsigned inFlight = i->second._inFlight;
+        i->second = HTTPHostStats();
+        i->second._inFlight = inFlight;
+        i->second._peakInFlight = inFlight;
     }
+}
+
+void
+HTTPClient::beginTransfer( const std::string& url )
+{
+    Threading::ScopedMutexLock lock( s_statsMutex );
+    HTTPHostStats& stats = s_hostStats[getHostOf(url)];
+    stats._inFlight++;
+    stats._peakInFlight = std::max( stats._peakInFlight, stats._inFlight );
+}
+
+void
+HTTPClient::endTransfer( const std::string& url )
+{
+    Threading::ScopedMutexLock lock( s_statsMutex );
+    HTTPHostStats& stats = s_hostStats[getHostOf(url)];
+    if ( stats._inFlight > 0 )
+        stats._inFlight--;
+}
+
+void
+HTTPClient::recordRetry( const std::string& url )
+{
+    Threading::ScopedMutexLock lock( s_statsMutex );
+    s_hostStats[getHostOf(url)]._numRetries++;
+}
+
+HTTPResponse
+HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, ProgressCallback* callback) const
+{
+    initialize();
+
+    const osgDB::AuthenticationMap* authenticationMap = (options && options->getAuthenticationMap()) ? 
+            options->getAuthenticationMap() :
+            osgDB::Registry::instance()->getAuthenticationMap();
+
+    std::string proxy_addr, proxy_auth;
+    getProxySettings( options, proxy_addr, proxy_auth );
 
     // Set up proxy server:
-    std::string proxy_addr;
-    if ( !proxy_host.empty() )
+    if ( !proxy_addr.empty() )
     {
-        std::stringstream buf;
-        buf << proxy_host << ":" << proxy_port;
-        std::string bufStr;
-        bufStr = buf.str();
-        proxy_addr = bufStr;
-    
-        if ( s_HTTP_DEBUG )
-            OE_NOTICE << LC << "Using proxy: " << proxy_addr << std::endl;
-
         //curl_easy_setopt( _curl_handle, CURLOPT_HTTPPROXYTUNNEL, 1 ); 
         curl_easy_setopt( _curl_handle, CURLOPT_PROXY, proxy_addr.c_str() );
 
         //Setup the proxy authentication if setup
         if (!proxy_auth.empty())
         {
-            if ( s_HTTP_DEBUG )
-                OE_NOTICE << LC << "Using proxy authentication " << proxy_auth << std::endl;
-
             curl_easy_setopt( _curl_handle, CURLOPT_PROXYUSERPWD, proxy_auth.c_str());
         }
     }
@@ -771,9 +1472,21 @@ HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, Pr
         curl_easy_setopt( _curl_handle, CURLOPT_ERRORBUFFER, (void*)errorBuf );
 
         curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)&sp);
-        res = curl_easy_perform( _curl_handle );
+        curl_easy_setopt( _curl_handle, CURLOPT_HEADERDATA, (void*)&part->_headers );
+        struct curl_slist* requestHeaders = makeCurlHeaders( request.getHeaders() );
+        curl_easy_setopt( _curl_handle, CURLOPT_HTTPHEADER, requestHeaders );
+        beginTransfer( request.getURL() );
+        {
+            ScopedTrace trace( "get", "http" );
+            res = curl_easy_perform( _curl_handle );
+        }
+        endTransfer( request.getURL() );
         curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)0 );
         curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSDATA, (void*)0);
+        curl_easy_setopt( _curl_handle, CURLOPT_HEADERDATA, (void*)0 );
+        curl_easy_setopt( _curl_handle, CURLOPT_HTTPHEADER, (void*)0 );
+        if ( requestHeaders )
+            curl_slist_free_all( requestHeaders );
 
         //Disable peer certificate verification to allow us to access in https servers where the peer certificate cannot be verified.
         curl_easy_setopt( _curl_handle, CURLOPT_SSL_VERIFYPEER, (void*)0 );
@@ -803,16 +1516,78 @@ HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, Pr
         OE_NOTICE << LC << "GET(" << response_code << "): \"" << request.getURL() << "\"" << std::endl;
     }
 
+    return makeResponse( _curl_handle, res, response_code, part.get(), request.getURL() );
+}
+
+
+HTTPResponse
+HTTPClient::makeResponse(void* handle, int curlCode, long response_code, HTTPResponse::Part* part, const std::string& url)
+{
+    CURLcode res = (CURLcode)curlCode;
+    CURL* curl = (CURL*)handle;
+
     HTTPResponse response( response_code );
+
+    double bytesReceived = 0.0;
+    curl_easy_getinfo( curl, CURLINFO_SIZE_DOWNLOAD, &bytesReceived );
+
+    // curl's timers are all measured from the start of the transfer.
+    double dns = 0.0, connect = 0.0, tls = 0.0, firstByte = 0.0, total = 0.0;
+    curl_easy_getinfo( curl, CURLINFO_NAMELOOKUP_TIME,    &dns );
+    curl_easy_getinfo( curl, CURLINFO_CONNECT_TIME,       &connect );
+#if LIBCURL_VERSION_NUM >= 0x071300
+    curl_easy_getinfo( curl, CURLINFO_APPCONNECT_TIME,    &tls );
+#endif
+    curl_easy_getinfo( curl, CURLINFO_STARTTRANSFER_TIME, &firstByte );
+    curl_easy_getinfo( curl, CURLINFO_TOTAL_TIME,         &total );
+
+    {
+        Threading::ScopedMutexLock lock( s_statsMutex );
+        ++s_numResponses;
+        s_numBytesReceived += bytesReceived;
+
+        HTTPHostStats& stats = s_hostStats[getHostOf(url)];
+        stats._bytes += bytesReceived;
+
+        if ( res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT )
+            stats._numCanceled++;
+        else if ( response_code == 0L )
+            stats._numFailed++;
+        else
+        {
+            stats._numResponses++;
+            stats._statusCodes[response_code]++;
+        }
+
+        // a reused connection reports no lookup or connect time.
+        if ( connect > 0.0 )
+        {
+            stats._dnsTime.add( 1000.0*dns );
+            stats._connectTime.add( 1000.0*(connect-dns) );
+            if ( tls > 0.0 )
+                stats._tlsTime.add( 1000.0*(tls-connect) );
+        }
+        if ( firstByte > 0.0 )
+            stats._firstByteTime.add( 1000.0*firstByte );
+        stats._totalTime.add( 1000.0*total );
+    }
+
+    // a "not modified" reply has no body (and usually no Content-Type); just
+    // keep the headers so the caller can refresh its cached copy.
+    if ( response_code == HTTPResponse::NOT_MODIFIED && res == CURLE_OK )
+    {
+        response._parts.push_back( part );
+        return response;
+    }
     
     // read the response content type:
     char* content_type_cp;
-    curl_easy_getinfo( _curl_handle, CURLINFO_CONTENT_TYPE, &content_type_cp );
+    curl_easy_getinfo( curl, CURLINFO_CONTENT_TYPE, &content_type_cp );
     if ( content_type_cp == NULL )
     {
         OE_WARN << LC
             << "NULL Content-Type (protocol violation) " 
-            << "URL=" << request.getURL() << std::endl;
+            << "URL=" << url << std::endl;
         return HTTPResponse(0L);
     }
     response._mimeType = content_type_cp;
@@ -832,14 +1607,14 @@ HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, Pr
             OE_DEBUG << LC << "detected multipart data; decoding..." << std::endl;
 
             //TODO: parse out the "wcs" -- this is WCS-specific
-            decodeMultipartStream( "wcs", part.get(), response._parts );
+            decodeMultipartStream( "wcs", part, response._parts );
         }
         else
         {
             // store headers that we care about
             part->_headers[IOMetadata::CONTENT_TYPE] = response._mimeType;
 
-            response._parts.push_back( part.get() );
+            response._parts.push_back( part );
         }
     }
     else  /*if (res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT) */
@@ -930,15 +1705,25 @@ namespace
 }
 
 ReadResult
-HTTPClient::doReadImage(const std::string&    location,
+HTTPClient::doReadImage(const HTTPRequest&    request,
                         const osgDB::Options* options,
                         ProgressCallback*     callback)
 {
     initialize();
 
-    ReadResult result;
+    std::string location = request.getURL();
+    HTTPResponse response = this->doGet(request, options, callback);
 
-    HTTPResponse response = this->doGet(location, options, callback);
+    return readImage( response, location, options, callback );
+}
+
+ReadResult
+HTTPClient::readImage(const HTTPResponse&   response,
+                      const std::string&    location,
+                      const osgDB::Options* options,
+                      ProgressCallback*     callback)
+{
+    ReadResult result;
 
     if (response.isOK())
     {
@@ -951,7 +1736,7 @@ HTTPClient::doReadImage(const std::string&    location,
 
         else 
         {
-            osgDB::ReaderWriter::ReadResult rr = reader->readImage(response.getPartStream(0), options);
+            osgDB::ReaderWriter::ReadResult rr = decodeImage(reader, response.getPartStream(0), options);
             if ( rr.validImage() )
             {
                 result = ReadResult(rr.takeImage(), response.getHeadersAsConfig() );
@@ -967,6 +1752,10 @@ HTTPClient::doReadImage(const std::string&    location,
             }
         }
     }
+    else if ( response.getCode() == HTTPResponse::NOT_MODIFIED )
+    {
+        result = ReadResult( ReadResult::RESULT_NOT_MODIFIED, 0L, response.getHeadersAsConfig() );
+    }
     else
     {
         result = ReadResult(
@@ -982,6 +1771,7 @@ HTTPClient::doReadImage(const std::string&    location,
             {
                 OE_DEBUG << "Error in HTTPClient for " << location << " but it's recoverable" << std::endl;
                 callback->setNeedsRetry( true );
+                recordRetry( location );
             }
         }
     }
@@ -994,7 +1784,7 @@ HTTPClient::doReadImage(const std::string&    location,
 }
 
 ReadResult
-HTTPClient::doReadNode(const std::string&    location,
+HTTPClient::doReadNode(const HTTPRequest&    request,
                        const osgDB::Options* options,
                        ProgressCallback*     callback)
 {
@@ -1002,7 +1792,8 @@ HTTPClient::doReadNode(const std::string&    location,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet(location, options, callback);
+    std::string location = request.getURL();
+    HTTPResponse response = this->doGet(request, options, callback);
 
     if (response.isOK())
     {
@@ -1031,6 +1822,10 @@ HTTPClient::doReadNode(const std::string&    location,
             }
         }
     }
+    else if ( response.getCode() == HTTPResponse::NOT_MODIFIED )
+    {
+        result = ReadResult( ReadResult::RESULT_NOT_MODIFIED, 0L, response.getHeadersAsConfig() );
+    }
     else
     {
         result = ReadResult(
@@ -1046,6 +1841,7 @@ HTTPClient::doReadNode(const std::string&    location,
             {
                 OE_DEBUG << "Error in HTTPClient for " << location << " but it's recoverable" << std::endl;
                 callback->setNeedsRetry( true );
+                recordRetry( location );
             }
         }
     }
@@ -1054,7 +1850,7 @@ HTTPClient::doReadNode(const std::string&    location,
 }
 
 ReadResult
-HTTPClient::doReadObject(const std::string&    location,
+HTTPClient::doReadObject(const HTTPRequest&    request,
                          const osgDB::Options* options,
                          ProgressCallback*     callback)
 {
@@ -1062,7 +1858,8 @@ HTTPClient::doReadObject(const std::string&    location,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet(location, options, callback);
+    std::string location = request.getURL();
+    HTTPResponse response = this->doGet(request, options, callback);
 
     if (response.isOK())
     {
@@ -1091,6 +1888,10 @@ HTTPClient::doReadObject(const std::string&    location,
             }
         }
     }
+    else if ( response.getCode() == HTTPResponse::NOT_MODIFIED )
+    {
+        result = ReadResult( ReadResult::RESULT_NOT_MODIFIED, 0L, response.getHeadersAsConfig() );
+    }
     else
     {
         result = ReadResult(
@@ -1106,6 +1907,7 @@ HTTPClient::doReadObject(const std::string&    location,
             {
                 OE_DEBUG << "Error in HTTPClient for " << location << " but it's recoverable" << std::endl;
                 callback->setNeedsRetry( true );
+                recordRetry( location );
             }
         }
     }
@@ -1115,7 +1917,7 @@ HTTPClient::doReadObject(const std::string&    location,
 
 
 ReadResult
-HTTPClient::doReadString(const std::string&    location,
+HTTPClient::doReadString(const HTTPRequest&    request,
                          const osgDB::Options* options,
                          ProgressCallback*     callback )
 {
@@ -1123,12 +1925,18 @@ HTTPClient::doReadString(const std::string&    location,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet( location, options, callback );
+    std::string location = request.getURL();
+    HTTPResponse response = this->doGet( request, options, callback );
     if ( response.isOK() )
     {
         result = ReadResult( new StringObject(response.getPartAsString(0)), response.getHeadersAsConfig());
     }
 
+    else if ( response.getCode() == HTTPResponse::NOT_MODIFIED )
+    {
+        result = ReadResult( ReadResult::RESULT_NOT_MODIFIED, 0L, response.getHeadersAsConfig() );
+    }
+
     else if ( response.getCode() >= 400 && response.getCode() < 500 && response.getCode() != 404 )
     {
         // for request errors, return an error result with the part data intact
@@ -1154,6 +1962,7 @@ HTTPClient::doReadString(const std::string&    location,
             {
                 OE_DEBUG << "Error in HTTPClient for " << location << " but it's recoverable" << std::endl;
                 callback->setNeedsRetry( true );
+                recordRetry( location );
             }
         }
     }
@@ -0,0 +1,132 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/HeightFieldCache>
+#include <osgEarth/MapFrame>
+#include <osgEarth/Registry>
+
+using namespace osgEarth;
+
+#define LC "[HeightFieldCache] "
+
+//------------------------------------------------------------------------
+
+bool
+HeightFieldCache::Key::operator < (const Key& rhs) const
+{
+    if ( _key < rhs._key ) return true;
+    if ( rhs._key < _key ) return false;
+    if ( _revision != rhs._revision ) return _revision < rhs._revision;
+    if ( _fallback != rhs._fallback ) return !_fallback;
+    if ( _convertToHAE != rhs._convertToHAE ) return !_convertToHAE;
+    return _samplePolicy < rhs._samplePolicy;
+}
+
+//------------------------------------------------------------------------
+
+HeightFieldCache::HeightFieldCache( unsigned maxSize ) :
+_cache            ( true, maxSize ),
+_quantizationError( -1.0f )
+{
+    Registry::addMemoryReporter( this );
+}
+
+HeightFieldCache::~HeightFieldCache()
+{
+    Registry::removeMemoryReporter( this );
+}
+
+struct HeightFieldCache::SizeCounter
+{
+    void operator()( const Key& key, const Value& value )
+    {
+        _counter.add( sizeof(Key) + sizeof(Value) );
+        if ( value._hf.valid() )
+            _counter.add( value._hf.get() );
+        else if ( value._qhf.valid() && _counter.mark(value._qhf.get()) )
+            _counter.add( value._qhf->getSizeInBytes() );
+    }
+    MemoryCounter _counter;
+};
+
+double
+HeightFieldCache::getSizeInBytes() const
+{
+    SizeCounter size;
+    _cache.forEach( size );
+    return size._counter.getBytes();
+}
+
+void
+HeightFieldCache::getMemoryUsage( MemoryUsageMap& usage ) const
+{
+    usage["heightfield_cache"] += getSizeInBytes();
+}
+
+bool
+HeightFieldCache::getOrCreateHeightField(const MapFrame&                 frame,
+                                         const TileKey&                  key,
+                                         bool                            fallback,
+                                         osg::ref_ptr<osg::HeightField>& out_hf,
+                                         bool*                           out_isFallback,
+                                         bool                            convertToHAE,
+                                         ElevationSamplePolicy           samplePolicy,
+                                         ProgressCallback*               progress) const
+{
+    Key cachekey;
+    cachekey._key          = key.getUniqueCode();
+    cachekey._revision     = (int)frame.getRevision();
+    cachekey._fallback     = fallback;
+    cachekey._convertToHAE = convertToHAE;
+    cachekey._samplePolicy = samplePolicy;
+
+    LRUCache<Key,Value>::Record rec;
+    if ( _cache.get(cachekey, rec) )
+    {
+        if ( rec.value()._qhf.valid() )
+            out_hf = rec.value()._qhf->decode();
+        else
+            out_hf = rec.value()._hf.get();
+
+        if ( out_isFallback )
+            *out_isFallback = rec.value()._isFallback;
+
+        return out_hf.valid();
+    }
+
+    bool isFallback = false;
+    if ( !frame.getHeightField(key, fallback, out_hf, &isFallback, convertToHAE, samplePolicy, progress) )
+        return false;
+
+    if ( out_isFallback )
+        *out_isFallback = isFallback;
+
+    // don't cache a result that was cut short.
+    if ( progress && progress->isCanceled() )
+        return true;
+
+    Value value;
+    if ( _quantizationError >= 0.0f )
+        value._qhf = QuantizedHeightField::encode( out_hf.get(), _quantizationError );
+    if ( !value._qhf.valid() )
+        value._hf = out_hf.get();
+    value._isFallback = isFallback;
+    _cache.insert( cachekey, value );
+
+    return true;
+}
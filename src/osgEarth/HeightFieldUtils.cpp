@@ -22,9 +22,262 @@
 #include <osgEarth/Geoid>
 #include <osgEarth/CullingUtils>
 #include <osg/Notify>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define OE_HF_SSE2 1
+#endif
 
 using namespace osgEarth;
 
+//------------------------------------------------------------------------
+
+namespace
+{
+    /**
+     * Where each output column (or row) lands in the source grid. Computed once
+     * per resample so the row kernels below don't redo the floor/ceil/clamp
+     * work of getHeightAtPixel at every post. The values match what
+     * getHeightAtPixel computes, so the kernels produce identical results.
+     */
+    struct Axis
+    {
+        std::vector<double> _p;    // fractional pixel coordinate
+        std::vector<int>    _i0;   // lower bracketing post (nearest post for INTERP_NEAREST)
+        std::vector<int>    _i1;   // upper bracketing post
+        std::vector<double> _w0;   // i1 - p
+        std::vector<double> _w1;   // p - i0
+        std::vector<double> _rem;  // p - (int)p, for INTERP_AVERAGE
+
+        Axis( unsigned reserve ) {
+            _p.reserve(reserve); _i0.reserve(reserve); _i1.reserve(reserve);
+            _w0.reserve(reserve); _w1.reserve(reserve); _rem.reserve(reserve);
+        }
+
+        void push( double p, int size, ElevationInterpolation interp )
+        {
+            int i0, i1;
+            if ( interp == INTERP_NEAREST )
+            {
+                i0 = i1 = (int)(unsigned int)osg::round(p);
+            }
+            else
+            {
+                i0 = osg::maximum((int)floor(p), 0);
+                i1 = osg::maximum(osg::minimum((int)ceil(p), size-1), 0);
+
+                if ( interp == INTERP_TRIANGULATE && i0 == i1 )
+                {
+                    if ( i0 < size-2 )
+                        i1 = i0 + 1;
+                    else
+                        i0 = i1 - 1;
+                }
+
+                if ( i0 > i1 ) i0 = i1;
+            }
+
+            _p.push_back( p );
+            _i0.push_back( i0 );
+            _i1.push_back( i1 );
+            _w0.push_back( (double)i1 - p );
+            _w1.push_back( p - (double)i0 );
+            _rem.push_back( p - (int)p );
+        }
+    };
+
+    void resampleNearest( const float* src, int srcCols, const Axis& cols, const Axis& rows, float* dest )
+    {
+        unsigned numCols = cols._p.size();
+        for( unsigned j = 0; j < rows._p.size(); ++j, dest += numCols )
+        {
+            const float* row = src + rows._i0[j]*srcCols;
+            for( unsigned i = 0; i < numCols; ++i )
+                dest[i] = row[cols._i0[i]];
+        }
+    }
+
+    inline bool anyNoData( float a, float b, float c, float d )
+    {
+        return a == NO_DATA_VALUE || b == NO_DATA_VALUE || c == NO_DATA_VALUE || d == NO_DATA_VALUE;
+    }
+
+    // one post of the bilinear kernel; same arithmetic as getHeightAtPixel.
+    inline float bilinear( const float* lo, const float* hi, const Axis& cols, unsigned i,
+                           bool rowEq, double wy0, double wy1 )
+    {
+        int c0 = cols._i0[i], c1 = cols._i1[i];
+        float llHeight = lo[c0], lrHeight = lo[c1], ulHeight = hi[c0], urHeight = hi[c1];
+
+        if ( anyNoData(llHeight, lrHeight, ulHeight, urHeight) )
+            return NO_DATA_VALUE;
+
+        if ( c0 == c1 && rowEq )
+            return llHeight;
+        else if ( c0 == c1 )
+            return wy0 * llHeight + wy1 * ulHeight;
+        else if ( rowEq )
+            return cols._w0[i] * llHeight + cols._w1[i] * lrHeight;
+
+        float r1 = cols._w0[i] * llHeight + cols._w1[i] * lrHeight;
+        float r2 = cols._w0[i] * ulHeight + cols._w1[i] * urHeight;
+        return wy0 * r1 + wy1 * r2;
+    }
+
+    void resampleBilinear( const float* src, int srcCols, const Axis& cols, const Axis& rows, float* dest )
+    {
+        unsigned numCols = cols._p.size();
+        for( unsigned j = 0; j < rows._p.size(); ++j, dest += numCols )
+        {
+            const float* lo  = src + rows._i0[j]*srcCols;
+            const float* hi  = src + rows._i1[j]*srcCols;
+            bool        rowEq = rows._i0[j] == rows._i1[j];
+            double      wy0   = rows._w0[j];
+            double      wy1   = rows._w1[j];
+
+            unsigned i = 0;
+
+#ifdef OE_HF_SSE2
+            // two posts at a time when both take the full bilinear branch. The float
+            // round trips mirror the float temporaries of the scalar code.
+            if ( !rowEq )
+            {
+                __m128d vwy0 = _mm_set1_pd( wy0 );
+                __m128d vwy1 = _mm_set1_pd( wy1 );
+
+                for( ; i+1 < numCols; i += 2 )
+                {
+                    int a0 = cols._i0[i],   a1 = cols._i1[i];
+                    int b0 = cols._i0[i+1], b1 = cols._i1[i+1];
+
+                    if ( a0 == a1 || b0 == b1 ||
+                         anyNoData(lo[a0], lo[a1], hi[a0], hi[a1]) ||
+                         anyNoData(lo[b0], lo[b1], hi[b0], hi[b1]) )
+                    {
+                        dest[i]   = bilinear( lo, hi, cols, i,   rowEq, wy0, wy1 );
+                        dest[i+1] = bilinear( lo, hi, cols, i+1, rowEq, wy0, wy1 );
+                        continue;
+                    }
+
+                    __m128d w0 = _mm_loadu_pd( &cols._w0[i] );
+                    __m128d w1 = _mm_loadu_pd( &cols._w1[i] );
+                    __m128d ll = _mm_set_pd( lo[b0], lo[a0] );
+                    __m128d lr = _mm_set_pd( lo[b1], lo[a1] );
+                    __m128d ul = _mm_set_pd( hi[b0], hi[a0] );
+                    __m128d ur = _mm_set_pd( hi[b1], hi[a1] );
+
+                    __m128d r1 = _mm_cvtps_pd( _mm_cvtpd_ps( _mm_add_pd(_mm_mul_pd(w0, ll), _mm_mul_pd(w1, lr)) ) );
+                    __m128d r2 = _mm_cvtps_pd( _mm_cvtpd_ps( _mm_add_pd(_mm_mul_pd(w0, ul), _mm_mul_pd(w1, ur)) ) );
+                    __m128  h  = _mm_cvtpd_ps( _mm_add_pd(_mm_mul_pd(vwy0, r1), _mm_mul_pd(vwy1, r2)) );
+
+                    _mm_storel_pi( (__m64*)(dest+i), h );
+                }
+            }
+#endif
+
+            for( ; i < numCols; ++i )
+            {
+                dest[i] = bilinear( lo, hi, cols, i, rowEq, wy0, wy1 );
+            }
+        }
+    }
+
+    void resampleAverage( const float* src, int srcCols, const Axis& cols, const Axis& rows, float* dest )
+    {
+        unsigned numCols = cols._p.size();
+        for( unsigned j = 0; j < rows._p.size(); ++j, dest += numCols )
+        {
+            const float* lo    = src + rows._i0[j]*srcCols;
+            const float* hi    = src + rows._i1[j]*srcCols;
+            double       y_rem = rows._rem[j];
+
+            for( unsigned i = 0; i < numCols; ++i )
+            {
+                int c0 = cols._i0[i], c1 = cols._i1[i];
+                float llHeight = lo[c0], lrHeight = lo[c1], ulHeight = hi[c0], urHeight = hi[c1];
+
+                if ( anyNoData(llHeight, lrHeight, ulHeight, urHeight) )
+                {
+                    dest[i] = NO_DATA_VALUE;
+                    continue;
+                }
+
+                double x_rem = cols._rem[i];
+                double w00 = (1.0 - y_rem) * (1.0 - x_rem) * (double)llHeight;
+                double w01 = (1.0 - y_rem) * x_rem * (double)lrHeight;
+                double w10 = y_rem * (1.0 - x_rem) * (double)ulHeight;
+                double w11 = y_rem * x_rem * (double)urHeight;
+
+                dest[i] = (float)(w00 + w01 + w10 + w11);
+            }
+        }
+    }
+
+    void resampleTriangulate( const float* src, int srcCols, const Axis& cols, const Axis& rows, float* dest )
+    {
+        unsigned numCols = cols._p.size();
+        for( unsigned j = 0; j < rows._p.size(); ++j, dest += numCols )
+        {
+            int          rowMin = rows._i0[j], rowMax = rows._i1[j];
+            const float* lo     = src + rowMin*srcCols;
+            const float* hi     = src + rowMax*srcCols;
+            double       r      = rows._p[j];
+            double       dy     = rows._w1[j];
+
+            for( unsigned i = 0; i < numCols; ++i )
+            {
+                int colMin = cols._i0[i], colMax = cols._i1[i];
+                float llHeight = lo[colMin], lrHeight = lo[colMax], ulHeight = hi[colMin], urHeight = hi[colMax];
+
+                if ( anyNoData(llHeight, lrHeight, ulHeight, urHeight) )
+                {
+                    dest[i] = NO_DATA_VALUE;
+                    continue;
+                }
+
+                double c  = cols._p[i];
+                double dx = cols._w1[i];
+
+                osg::Vec3d v0, v1, v2;
+                if (dx > dy)
+                {
+                    v0.set(colMin, rowMin, llHeight);
+                    v1.set(colMax, rowMin, lrHeight);
+                    v2.set(colMax, rowMax, urHeight);
+                }
+                else
+                {
+                    v0.set(colMin, rowMin, llHeight);
+                    v1.set(colMax, rowMax, urHeight);
+                    v2.set(colMin, rowMax, ulHeight);
+                }
+
+                osg::Vec3d n = (v1 - v0) ^ (v2 - v0);
+                dest[i] = ( n.x() * ( c - v0.x() ) + n.y() * ( r - v0.y() ) ) / -n.z() + v0.z();
+            }
+        }
+    }
+
+    // fills "dest" (row-major, cols x rows posts) by sampling "src".
+    void resample( const osg::HeightField* src, const Axis& cols, const Axis& rows,
+                   ElevationInterpolation interp, float* dest )
+    {
+        const float* data    = &src->getFloatArray()->front();
+        int          srcCols = src->getNumColumns();
+
+        switch( interp )
+        {
+        case INTERP_NEAREST:     resampleNearest    ( data, srcCols, cols, rows, dest ); break;
+        case INTERP_AVERAGE:     resampleAverage    ( data, srcCols, cols, rows, dest ); break;
+        case INTERP_TRIANGULATE: resampleTriangulate( data, srcCols, cols, rows, dest ); break;
+        default:                 resampleBilinear   ( data, srcCols, cols, rows, dest ); break;
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
 float
 HeightFieldUtils::getHeightAtPixel(const osg::HeightField* hf, double c, double r, ElevationInterpolation interpolation)
 {
@@ -374,17 +627,17 @@ HeightFieldUtils::createSubSample(osg::HeightField* input, const GeoExtent& inpu
     // copy over the skirt height, adjusting it for relative tile size.
     dest->setSkirtHeight( input->getSkirtHeight() * div );
 
+    // same post positions as stepping getHeightAtLocation across the extent:
     double x, y;
     int col, row;
 
+    Axis cols( numCols ), rows( numRows );
     for( x = outputEx.xMin(), col=0; col < numCols; x += dx, col++ )
-    {
-        for( y = outputEx.yMin(), row=0; row < numRows; y += dy, row++ )
-        {
-            float height = HeightFieldUtils::getHeightAtLocation( input, x, y, inputEx.xMin(), inputEx.yMin(), xInterval, yInterval, interpolation);
-            dest->setHeight( col, row, height );
-        }
-    }
+        cols.push( osg::clampBetween((x - inputEx.xMin()) / xInterval, 0.0, (double)(numCols-1)), numCols, interpolation );
+    for( y = outputEx.yMin(), row=0; row < numRows; y += dy, row++ )
+        rows.push( osg::clampBetween((y - inputEx.yMin()) / yInterval, 0.0, (double)(numRows-1)), numRows, interpolation );
+
+    resample( input, cols, rows, interpolation, &dest->getFloatArray()->front() );
 
     osg::Vec3d orig( outputEx.xMin(), outputEx.yMin(), input->getOrigin().z() );
     dest->setOrigin( orig );
@@ -419,17 +672,24 @@ HeightFieldUtils::resampleHeightField(osg::HeightField*      input,
     output->setYInterval( stepY );
     output->setOrigin( origin );
     
+    // same post positions as getHeightAtNormalizedLocation:
+    int numCols = input->getNumColumns();
+    int numRows = input->getNumRows();
+
+    Axis cols( newColumns ), rows( newRows );
+    for( int x = 0; x < newColumns; ++x )
+    {
+        double nx = (double)x / (double)(newColumns-1);
+        cols.push( osg::clampBetween(nx, 0.0, 1.0) * (double)(numCols - 1), numCols, interp );
+    }
     for( int y = 0; y < newRows; ++y )
     {
-        for( int x = 0; x < newColumns; ++x )
-        {
-            double nx = (double)x / (double)(newColumns-1);
-            double ny = (double)y / (double)(newRows-1);
-            float h = getHeightAtNormalizedLocation( input, nx, ny, interp );
-            output->setHeight( x, y, h );
-        }
+        double ny = (double)y / (double)(newRows-1);
+        rows.push( osg::clampBetween(ny, 0.0, 1.0) * (double)(numRows - 1), numRows, interp );
     }
 
+    resample( input, cols, rows, interp, &output->getFloatArray()->front() );
+
     return output;
 }
 
@@ -445,25 +705,12 @@ HeightFieldUtils::createReferenceHeightField( const GeoExtent& ex, unsigned numC
 
     const VerticalDatum* vdatum = ex.isValid() ? ex.getSRS()->getVerticalDatum() : 0L;
 
-    if ( vdatum )
+    osg::ref_ptr<const osg::HeightField> geoidHeights;
+    if ( vdatum && vdatum->getGeoid() &&
+         vdatum->getGeoid()->getHeights(ex, numCols, numRows, geoidHeights) )
     {
-        // need the lat/long extent for geoid queries:
-        GeoExtent geodeticExtent = ex.getSRS()->isGeographic() ? ex : ex.transform( ex.getSRS()->getGeographicSRS() );
-        double latMin = geodeticExtent.yMin();
-        double lonMin = geodeticExtent.xMin();
-        double lonInterval = geodeticExtent.width() / (double)(numCols-1);
-        double latInterval = geodeticExtent.height() / (double)(numRows-1);
-
-        for( unsigned r=0; r<numRows; ++r )
-        {            
-            double lat = latMin + latInterval*(double)r;
-            for( unsigned c=0; c<numCols; ++c )
-            {
-                double lon = lonMin + lonInterval*(double)c;
-                double offset = vdatum->msl2hae(lat, lon, 0.0);
-                hf->setHeight( c, r, offset );
-            }
-        }
+        // the reference surface is the geoid itself:
+        hf->getHeightList() = geoidHeights->getHeightList();
     }
     else
     {
@@ -481,27 +728,16 @@ HeightFieldUtils::resolveInvalidHeights(osg::HeightField* grid,
                                         float             invalidValue,
                                         const Geoid*      geoid)
 {
-    if ( geoid )
+    osg::ref_ptr<const osg::HeightField> geoidHeights;
+    if ( geoid && geoid->getHeights(ex, grid->getNumColumns(), grid->getNumRows(), geoidHeights) )
     {
-        // need the lat/long extent for geoid queries:
-        unsigned numRows = grid->getNumRows();
-        unsigned numCols = grid->getNumColumns();
-        GeoExtent geodeticExtent = ex.getSRS()->isGeographic() ? ex : ex.transform( ex.getSRS()->getGeographicSRS() );
-        double latMin = geodeticExtent.yMin();
-        double lonMin = geodeticExtent.xMin();
-        double lonInterval = geodeticExtent.width() / (double)(numCols-1);
-        double latInterval = geodeticExtent.height() / (double)(numRows-1);
-
-        for( unsigned r=0; r<numRows; ++r )
+        osg::HeightField::HeightList&       heights = grid->getHeightList();
+        const osg::HeightField::HeightList& offsets = geoidHeights->getHeightList();
+        for(unsigned int i=0; i<heights.size(); i++ )
         {
-            double lat = latMin + latInterval*(double)r;
-            for( unsigned c=0; c<numCols; ++c )
+            if ( heights[i] == invalidValue )
             {
-                double lon = lonMin + lonInterval*(double)c;
-                if ( grid->getHeight(c, r) == invalidValue )
-                {
-                    grid->setHeight( c, r, geoid->getHeight(lat, lon) );
-                }
+                heights[i] = offsets[i];
             }
         }
     }
@@ -605,6 +841,67 @@ HeightFieldUtils::createClusterCullingCallback(osg::HeightField*          grid,
     return ccc;
 }
 
+osg::NodeCallback*
+HeightFieldUtils::createHorizonCullingCallback(const osg::HeightField* grid,
+                                               const GeoExtent&        extent,
+                                               float                   verticalScale )
+{
+    if ( !extent.isValid() )
+        return 0L;
+
+    const osg::EllipsoidModel* em = extent.getSRS()->getEllipsoid();
+    if ( !em )
+        return 0L;
+
+    // only the top of the tile matters; anything lower is hidden first.
+    float maxHeight = 0.0f;
+    if ( grid )
+    {
+        const osg::HeightField::HeightList& heights = grid->getHeightList();
+        for( unsigned i = 0; i < heights.size(); ++i )
+        {
+            if ( heights[i] != NO_DATA_VALUE && heights[i] > maxHeight )
+                maxHeight = heights[i];
+        }
+    }
+    maxHeight *= verticalScale;
+
+    // sample the tile's perimeter at the maximum height, densely enough that
+    // the ellipsoid bulging between samples stays below the culling point.
+    const unsigned segments = 8;
+    std::vector<osg::Vec3d> points;
+    points.reserve( 4*segments + 1 );
+
+    for( unsigned i = 0; i < segments; ++i )
+    {
+        double t = (double)i/(double)segments;
+        double x = extent.xMin() + t*extent.width();
+        double y = extent.yMin() + t*extent.height();
+        GeoPoint samples[4] = {
+            GeoPoint(extent.getSRS(), x, extent.yMin(), maxHeight, ALTMODE_ABSOLUTE),
+            GeoPoint(extent.getSRS(), extent.xMax() - t*extent.width(), extent.yMax(), maxHeight, ALTMODE_ABSOLUTE),
+            GeoPoint(extent.getSRS(), extent.xMin(), extent.yMax() - t*extent.height(), maxHeight, ALTMODE_ABSOLUTE),
+            GeoPoint(extent.getSRS(), extent.xMax(), y, maxHeight, ALTMODE_ABSOLUTE) };
+
+        for( unsigned s = 0; s < 4; ++s )
+        {
+            osg::Vec3d world;
+            if ( !samples[s].toWorld(world) )
+                return 0L;
+            points.push_back( world );
+        }
+    }
+
+    osg::Vec3d centroid = extent.getCentroid();
+    GeoPoint center( extent.getSRS(), centroid.x(), centroid.y(), maxHeight, ALTMODE_ABSOLUTE );
+    osg::Vec3d world;
+    if ( center.toWorld(world) )
+        points.push_back( world );
+
+    osg::ref_ptr<HorizonCullingCallback> culler = new HorizonCullingCallback( points, em );
+    return culler->isValid() ? culler.release() : 0L;
+}
+
 /******************************************************************************************/
 
 ReplaceInvalidDataOperator::ReplaceInvalidDataOperator():
@@ -27,7 +27,10 @@ using namespace osgEarth;
 
 //------------------------------------------------------------------------
 
-const std::string IOMetadata::CONTENT_TYPE = "Content-type";
+const std::string IOMetadata::CONTENT_TYPE  = "Content-type";
+const std::string IOMetadata::ETAG          = "ETag";
+const std::string IOMetadata::LAST_MODIFIED = "Last-Modified";
+const std::string IOMetadata::CONTENT_RANGE = "Content-Range";
 
 //------------------------------------------------------------------------
 
@@ -27,6 +27,10 @@
 #include <osgEarth/URI>
 #include <osg/Version>
 #include <osgDB/WriteFile>
+#include <osgDB/Registry>
+#if OSG_MIN_VERSION_REQUIRED(3,0,0)
+#include <osgDB/ImageProcessor>
+#endif
 #include <memory.h>
 #include <limits.h>
 
@@ -64,6 +68,8 @@ ImageLayerOptions::setDefaults()
     _maxRange.init( FLT_MAX );
     _lodBlending.init( false );
     _featherPixels.init( false );
+    _textureCompression.init( osg::Texture::USE_IMAGE_DATA_FORMAT );
+    _cacheCompressed.init( false );
 }
 
 void
@@ -83,6 +89,11 @@ ImageLayerOptions::fromConfig( const Config& conf )
     conf.getIfSet( "lod_blending",   _lodBlending );
     conf.getIfSet( "shared",         _shared );
     conf.getIfSet( "feather_pixels", _featherPixels);
+    conf.getIfSet( "cache_compressed", _cacheCompressed );
+
+    conf.getIfSet( "texture_compression", "none", _textureCompression, osg::Texture::USE_IMAGE_DATA_FORMAT );
+    conf.getIfSet( "texture_compression", "dxt1", _textureCompression, osg::Texture::USE_S3TC_DXT1_COMPRESSION );
+    conf.getIfSet( "texture_compression", "dxt5", _textureCompression, osg::Texture::USE_S3TC_DXT5_COMPRESSION );
 
     if ( conf.hasValue( "transparent_color" ) )
         _transparentColor = stringToColor( conf.value( "transparent_color" ), osg::Vec4ub(0,0,0,0));
@@ -106,6 +117,11 @@ ImageLayerOptions::getConfig( bool isolate ) const
     conf.updateIfSet( "lod_blending",   _lodBlending );
     conf.updateIfSet( "shared",         _shared );
     conf.updateIfSet( "feather_pixels", _featherPixels );
+    conf.updateIfSet( "cache_compressed", _cacheCompressed );
+
+    conf.updateIfSet( "texture_compression", "none", _textureCompression, osg::Texture::USE_IMAGE_DATA_FORMAT );
+    conf.updateIfSet( "texture_compression", "dxt1", _textureCompression, osg::Texture::USE_S3TC_DXT1_COMPRESSION );
+    conf.updateIfSet( "texture_compression", "dxt5", _textureCompression, osg::Texture::USE_S3TC_DXT5_COMPRESSION );
 
     if (_transparentColor.isSet())
         conf.update("transparent_color", colorToString( _transparentColor.value()));
@@ -371,6 +387,51 @@ ImageLayer::initPreCacheOp()
     _preCacheOp = op;
 }
 
+bool
+ImageLayer::isCompressible( const TileKey& key ) const
+{
+    // Only compress tiles in the map profile. Tiles in any other profile are
+    // intermediates that still have to be mosaiced or reprojected.
+    return
+        _runtimeOptions.textureCompression() != osg::Texture::USE_IMAGE_DATA_FORMAT &&
+        _targetProfileHint.valid() &&
+        key.getProfile()->isEquivalentTo( _targetProfileHint.get() );
+}
+
+void
+ImageLayer::compressImage( osg::ref_ptr<osg::Image>& image ) const
+{
+    if ( !image.valid() || ImageUtils::isCompressed(image.get()) )
+        return;
+
+#if OSG_MIN_VERSION_REQUIRED(3,0,0)
+    osgDB::ImageProcessor* ip = osgDB::Registry::instance()->getImageProcessor();
+    if ( !ip )
+    {
+        static bool s_warned = false;
+        if ( !s_warned )
+        {
+            OE_WARN << LC << "No image processor plugin available; texture compression disabled" << std::endl;
+            s_warned = true;
+        }
+        return;
+    }
+
+    osg::Texture::InternalFormatMode mode = *_runtimeOptions.textureCompression();
+    if ( mode == osg::Texture::USE_S3TC_DXT5_COMPRESSION && !ImageUtils::hasAlphaChannel(image.get()) )
+    {
+        mode = osg::Texture::USE_S3TC_DXT1_COMPRESSION;
+    }
+
+    // compress a copy; the original may be shared with the cache.
+    osg::ref_ptr<osg::Image> compressed = new osg::Image( *image.get(), osg::CopyOp::DEEP_COPY_ALL );
+    ip->compress( *compressed.get(), mode, true, false, osgDB::ImageProcessor::USE_CPU, osgDB::ImageProcessor::NORMAL );
+
+    if ( ImageUtils::isCompressed(compressed.get()) )
+        image = compressed.get();
+#endif
+}
+
 
 CacheBin*
 ImageLayer::getCacheBin( const Profile* profile )
@@ -390,6 +451,103 @@ ImageLayer::createImage( const TileKey& key, ProgressCallback* progress, bool fo
 }
 
 
+void
+ImageLayer::createImages( const std::vector<TileKey>& keys, std::vector<GeoImage>& out_images, ProgressCallback* progress )
+{
+    out_images.assign( keys.size(), GeoImage::INVALID );
+
+    TileSource* source = getTileSource();
+
+    // Collect the keys that would go straight to the tile source: same profile,
+    // not cached, not filtered out by the layer's level or resolution limits.
+    std::vector<TileKey>  batchKeys;
+    std::vector<unsigned> batchIndices;
+
+    if ( source && getEnabled() && !isCacheOnly() && getProfile() && !_runtimeOptions.minResolution().isSet() )
+    {
+        for( unsigned i = 0; i < keys.size(); ++i )
+        {
+            const TileKey& key = keys[i];
+
+            if ( !key.getProfile()->isEquivalentTo( getProfile() ) )
+                continue;
+
+            if ( _runtimeOptions.minLevel().isSet() && key.getLOD() < _runtimeOptions.minLevel().value() )
+                continue;
+
+            CacheBin* cacheBin = getCacheBin( key.getProfile() );
+            // an entry that an invalidate() might cover has to be re-checked the slow way.
+            if ( cacheBin && getCachePolicy().isCacheReadable() && cacheBin->isCached( key.str() ) &&
+                 !isCacheEntryStale( key, Config() ) )
+                continue;
+
+            if ( source->getBlacklist()->contains( key.getTileId() ) ||
+                 !source->hasDataAtLOD( key.getLevelOfDetail() ) ||
+                 !source->hasDataInExtent( key.getExtent() ) )
+                continue;
+
+            batchKeys.push_back( key );
+            batchIndices.push_back( i );
+        }
+    }
+
+    if ( !batchKeys.empty() )
+    {
+        TileSource::ImageVector images;
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        source->createImages( batchKeys, images, _preCacheOp.get(), progress );
+        recordTime( LayerMetrics::STAGE_SOURCE, start );
+
+        for( unsigned i = 0; i < batchKeys.size(); ++i )
+        {
+            const TileKey& key = batchKeys[i];
+            osg::Image* image = images[i].get();
+            recordImageResult( image, progress );
+
+            if ( !image )
+            {
+                // blacklist it, just like createImageFromTileSource would.
+                if ( !progress || !progress->isCanceled() )
+                    source->getBlacklist()->add( key.getTileId() );
+                continue;
+            }
+
+            // Process images with full alpha to properly support MP blending.
+            if ( *_runtimeOptions.featherPixels() )
+                ImageUtils::featherAlphaRegions( image );
+
+            ImageUtils::normalizeImage( image );
+
+            osg::ref_ptr<osg::Image> tile = image;
+            bool compress = isCompressible( key );
+            if ( compress && *_runtimeOptions.cacheCompressed() )
+                compressImage( tile );
+
+            CacheBin* cacheBin = getCacheBin( key.getProfile() );
+            if ( cacheBin && getCachePolicy().isCacheWriteable() )
+            {
+                osg::Timer_t writeStart = osg::Timer::instance()->tick();
+                if ( cacheBin->write( key.str(), tile.get(), getCacheEntryMetadata() ) )
+                    recordMetric( LayerMetrics::CACHE_WRITES );
+                recordTime( LayerMetrics::STAGE_CACHE_WRITE, writeStart );
+            }
+
+            if ( compress )
+                compressImage( tile );
+
+            out_images[batchIndices[i]] = GeoImage( tile.get(), key.getExtent() );
+        }
+    }
+
+    // Everything else (cached, reprojected, failed) takes the usual route.
+    for( unsigned i = 0; i < keys.size(); ++i )
+    {
+        if ( !out_images[i].valid() )
+            out_images[i] = createImage( keys[i], progress );
+    }
+}
+
+
 GeoImage
 ImageLayer::createImageInNativeProfile( const TileKey& key, ProgressCallback* progress, bool forceFallback, bool& out_isFallback)
 {
@@ -428,7 +586,7 @@ ImageLayer::createImageInNativeProfile( const TileKey& key, ProgressCallback* pr
             GeoImage image = createImageInKeyProfile( *k, progress, true, isFallback );
             if ( image.valid() )
             {
-                mosaic.getImages().push_back( TileImage(image.getImage(), *k) );
+                mosaic.getImages().push_back( TileImage(image.getImage(), k) );
                 if ( !isFallback )
                     foundAtLeastOneRealTile = true;
             }
@@ -553,15 +711,22 @@ ImageLayer::createImageInKeyProfile( const TileKey& key, ProgressCallback* progr
     // map profile, we can try this first.
     if ( cacheBin && getCachePolicy().isCacheReadable() )
     {
+        osg::Timer_t start = osg::Timer::instance()->tick();
         ReadResult r = cacheBin->readImage( key.str() );
-        if ( r.succeeded() )
+        recordTime( LayerMetrics::STAGE_CACHE_READ, start );
+
+        if ( r.succeeded() && !isCacheEntryStale(key, r.metadata()) )
         {            
+            recordMetric( LayerMetrics::CACHE_HITS );
             ImageUtils::normalizeImage( r.getImage() );
-            return GeoImage( r.releaseImage(), key.getExtent() );
+            osg::ref_ptr<osg::Image> image = r.releaseImage();
+            if ( isCompressible(key) )
+                compressImage( image );
+            return GeoImage( image.get(), key.getExtent() );
         }
         else
         {
-            //OE_INFO << LC << getName() << " : " << key.str() << " cache miss" << std::endl;
+            recordMetric( LayerMetrics::CACHE_MISSES );
         }
     }
     
@@ -580,6 +745,14 @@ ImageLayer::createImageInKeyProfile( const TileKey& key, ProgressCallback* progr
         ImageUtils::normalizeImage( result.getImage() );
     }
 
+    bool compress = result.valid() && isCompressible( key );
+    if ( compress && *_runtimeOptions.cacheCompressed() )
+    {
+        osg::ref_ptr<osg::Image> image = result.getImage();
+        compressImage( image );
+        result = GeoImage( image.get(), result.getExtent() );
+    }
+
     // If we got a result, the cache is valid and we are caching in the map profile, write to the map cache.
     if (result.valid()  &&
         //JB:  Removed the check to not write out fallback data.  If you have a low resolution base dataset (max lod 3) and a high resolution insert (max lod 22)
@@ -594,8 +767,17 @@ ImageLayer::createImageInKeyProfile( const TileKey& key, ProgressCallback* progr
             OE_INFO << LC << "WARNING! mismatched extents." << std::endl;
         }
 
-        cacheBin->write( key.str(), result.getImage() );
-        //OE_INFO << LC << "WRITING " << key.str() << " to the cache." << std::endl;
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        if ( cacheBin->write( key.str(), result.getImage(), getCacheEntryMetadata() ) )
+            recordMetric( LayerMetrics::CACHE_WRITES );
+        recordTime( LayerMetrics::STAGE_CACHE_WRITE, start );
+    }
+
+    if ( compress && !*_runtimeOptions.cacheCompressed() )
+    {
+        osg::ref_ptr<osg::Image> image = result.getImage();
+        compressImage( image );
+        result = GeoImage( image.get(), result.getExtent() );
     }
 
     if ( result.valid() )
@@ -638,13 +820,17 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
     // If the profiles are different, use a compositing method to assemble the tile.
     if ( !key.getProfile()->isEquivalentTo( getProfile() ) )
     {
-        return assembleImageFromTileSource( key, progress, out_isFallback );
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        GeoImage assembled = assembleImageFromTileSource( key, progress, out_isFallback );
+        recordTime( LayerMetrics::STAGE_ASSEMBLY, start );
+        return assembled;
     }
 
     // Fail is the image is blacklisted.
     // ..unless there will be a fallback attempt.
     if ( source->getBlacklist()->contains( key.getTileId() ) && !forceFallback )
     {
+        recordMetric( LayerMetrics::BLACKLISTED );
         OE_DEBUG << LC << "createImageFromTileSource: blacklisted(" << key.str() << ")" << std::endl;
         return GeoImage::INVALID;
     }
@@ -675,7 +861,7 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
         {
             if ( !source->getBlacklist()->contains( finalKey.getTileId() ) )
             {
-                result = source->createImage( finalKey, op.get(), progress );
+                result = createImageFromSource( source, finalKey, op.get(), progress );
                 if ( result.valid() )
                 {
                     if ( finalKey.getLevelOfDetail() != key.getLevelOfDetail() )
@@ -707,7 +893,7 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
 
     else
     {
-        result = source->createImage( key, op.get(), progress );
+        result = createImageFromSource( source, key, op.get(), progress );
     }
 
     // Process images with full alpha to properly support MP blending.    
@@ -727,6 +913,35 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
 }
 
 
+osg::Image*
+ImageLayer::createImageFromSource(TileSource*                 source,
+                                  const TileKey&              key,
+                                  TileSource::ImageOperation* op,
+                                  ProgressCallback*           progress)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    osg::ref_ptr<osg::Image> image = source->createImage( key, op, progress );
+    recordTime( LayerMetrics::STAGE_SOURCE, start );
+    recordImageResult( image.get(), progress );
+    return image.release();
+}
+
+
+void
+ImageLayer::recordImageResult( const osg::Image* image, ProgressCallback* progress )
+{
+    if ( image )
+    {
+        recordMetric( LayerMetrics::SOURCE_TILES );
+        recordMetric( LayerMetrics::BYTES, (double)image->getTotalSizeInBytesIncludingMipmaps() );
+    }
+    else if ( !progress || !progress->isCanceled() )
+    {
+        recordMetric( LayerMetrics::SOURCE_ERRORS );
+    }
+}
+
+
 GeoImage
 ImageLayer::assembleImageFromTileSource(const TileKey&    key,
                                         ProgressCallback* progress,
@@ -759,13 +974,62 @@ ImageLayer::assembleImageFromTileSource(const TileKey&    key,
         bool retry = false;
         ImageMosaic mosaic;
 
-        for( std::vector<TileKey>::iterator k = intersectingKeys.begin(); k != intersectingKeys.end(); ++k )
+        // Ask the tile source for all the tiles it should have in one batch, so the
+        // driver can fetch them together. Tiles that come back empty are blacklisted
+        // (as createImageFromTileSource would) and resolved through the fallback
+        // path below.
+        TileSource* source = getTileSource();
+        TileSource::ImageVector batchImages( intersectingKeys.size() );
         {
-            double minX, minY, maxX, maxY;
-            k->getExtent().getBounds(minX, minY, maxX, maxY);
+            std::vector<TileKey>  batchKeys;
+            std::vector<unsigned> batchIndices;
+            for( unsigned i = 0; i < intersectingKeys.size(); ++i )
+            {
+                const TileKey& k = intersectingKeys[i];
+                if ( !source->getBlacklist()->contains( k.getTileId() ) &&
+                     source->hasDataAtLOD( k.getLevelOfDetail() ) &&
+                     source->hasDataInExtent( k.getExtent() ) )
+                {
+                    batchKeys.push_back( k );
+                    batchIndices.push_back( i );
+                }
+            }
+
+            if ( !batchKeys.empty() )
+            {
+                TileSource::ImageVector images;
+                osg::Timer_t start = osg::Timer::instance()->tick();
+                source->createImages( batchKeys, images, _preCacheOp.get(), progress );
+                recordTime( LayerMetrics::STAGE_SOURCE, start );
+                for( unsigned i = 0; i < batchKeys.size(); ++i )
+                {
+                    recordImageResult( images[i].get(), progress );
+                    if ( images[i].valid() )
+                        batchImages[batchIndices[i]] = images[i];
+                    else if ( !progress || !progress->isCanceled() )
+                        source->getBlacklist()->add( batchKeys[i].getTileId() );
+                }
+            }
+        }
+
+        for( unsigned i = 0; i < intersectingKeys.size(); ++i )
+        {
+            const TileKey& k = intersectingKeys[i];
 
             bool isFallback = false;
-            GeoImage image = createImageFromTileSource( *k, progress, true, isFallback );
+            GeoImage image;
+            if ( batchImages[i].valid() )
+            {
+                // Process images with full alpha to properly support MP blending.
+                if ( *_runtimeOptions.featherPixels() )
+                    ImageUtils::featherAlphaRegions( batchImages[i].get() );
+                image = GeoImage( batchImages[i].get(), k.getExtent() );
+            }
+            else
+            {
+                image = createImageFromTileSource( k, progress, true, isFallback );
+            }
+
             if ( image.valid() )
             {
                 // make sure the image is RGBA.
@@ -779,7 +1043,7 @@ ImageLayer::assembleImageFromTileSource(const TileKey&    key,
                     }
                 }
 
-                mosaic.getImages().push_back( TileImage(image.getImage(), *k) );
+                mosaic.getImages().push_back( TileImage(image.getImage(), k) );
                 if ( !isFallback )
                     foundAtLeastOneRealTile = true;
             }
@@ -27,6 +27,11 @@
 #include <string.h>
 #include <memory.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define OE_IMAGE_SSE2 1
+#endif
+
 #define LC "[ImageUtils] "
 
 
@@ -163,6 +168,202 @@ ImageUtils::createBumpMap(const osg::Image* input)
     return output;
 }
 
+//------------------------------------------------------------------------
+
+// Row kernels for the common formats. PixelReader/PixelWriter go through a
+// function pointer and an osg::Vec4 per pixel; these work on whole rows of
+// raw data instead, and the generic reader/writer remain the fallback for
+// everything else. Byte channels are copied exactly (the float round trip
+// of the generic path turns 255 into 254).
+
+namespace
+{
+    // RGBA8 working pixel for the format kernels.
+    struct Texel { GLubyte c[4]; };
+
+    struct L8
+    {
+        typedef GLubyte Type;
+        enum { Channels = 1 };
+        static void read ( const Type* p, Texel& x ) { x.c[0] = x.c[1] = x.c[2] = p[0]; x.c[3] = 255; }
+        static void write( const Texel& x, Type* p ) { p[0] = x.c[0]; }
+    };
+
+    struct RGB8
+    {
+        typedef GLubyte Type;
+        enum { Channels = 3 };
+        static void read ( const Type* p, Texel& x ) { x.c[0] = p[0]; x.c[1] = p[1]; x.c[2] = p[2]; x.c[3] = 255; }
+        static void write( const Texel& x, Type* p ) { p[0] = x.c[0]; p[1] = x.c[1]; p[2] = x.c[2]; }
+    };
+
+    struct RGBA8
+    {
+        typedef GLubyte Type;
+        enum { Channels = 4 };
+        static void read ( const Type* p, Texel& x ) { x.c[0] = p[0]; x.c[1] = p[1]; x.c[2] = p[2]; x.c[3] = p[3]; }
+        static void write( const Texel& x, Type* p ) { p[0] = x.c[0]; p[1] = x.c[1]; p[2] = x.c[2]; p[3] = x.c[3]; }
+    };
+
+    // float to byte exactly as the generic writer does it.
+    inline GLubyte floatToByte( float f ) { return (GLubyte)( f / (1.0f/255.0f) ); }
+
+    struct L32F
+    {
+        typedef GLfloat Type;
+        enum { Channels = 1 };
+        static void read( const Type* p, Texel& x ) { x.c[0] = x.c[1] = x.c[2] = floatToByte(p[0]); x.c[3] = 255; }
+    };
+
+    struct RGBA32F
+    {
+        typedef GLfloat Type;
+        enum { Channels = 4 };
+        static void read( const Type* p, Texel& x ) {
+            x.c[0] = floatToByte(p[0]); x.c[1] = floatToByte(p[1]);
+            x.c[2] = floatToByte(p[2]); x.c[3] = floatToByte(p[3]); }
+    };
+
+    typedef void (*RowKernel)( const unsigned char* in, unsigned char* out, unsigned count );
+
+    template<typename SRC, typename DST>
+    void convertRow( const unsigned char* in, unsigned char* out, unsigned count )
+    {
+        const typename SRC::Type* src = (const typename SRC::Type*)in;
+        typename DST::Type*       dst = (typename DST::Type*)out;
+        Texel x;
+        for( unsigned i = 0; i < count; ++i, src += SRC::Channels, dst += DST::Channels )
+        {
+            SRC::read( src, x );
+            DST::write( x, dst );
+        }
+    }
+
+    enum Layout { LAYOUT_OTHER, LAYOUT_L8, LAYOUT_RGB8, LAYOUT_RGBA8, LAYOUT_L32F, LAYOUT_RGBA32F };
+
+    Layout getLayout( GLenum pixelFormat, GLenum dataType )
+    {
+        if ( dataType == GL_UNSIGNED_BYTE )
+        {
+            if ( pixelFormat == GL_LUMINANCE ) return LAYOUT_L8;
+            if ( pixelFormat == GL_RGB )       return LAYOUT_RGB8;
+            if ( pixelFormat == GL_RGBA )      return LAYOUT_RGBA8;
+        }
+        else if ( dataType == GL_FLOAT )
+        {
+            if ( pixelFormat == GL_LUMINANCE ) return LAYOUT_L32F;
+            if ( pixelFormat == GL_RGBA )      return LAYOUT_RGBA32F;
+        }
+        return LAYOUT_OTHER;
+    }
+
+    template<typename SRC>
+    RowKernel chooseConvertRow( Layout dst )
+    {
+        switch( dst )
+        {
+        case LAYOUT_L8:    return &convertRow<SRC, L8>;
+        case LAYOUT_RGB8:  return &convertRow<SRC, RGB8>;
+        case LAYOUT_RGBA8: return &convertRow<SRC, RGBA8>;
+        default:           return 0L;
+        }
+    }
+
+    /** Kernel that converts rows of "src" pixels to "dst" pixels, or NULL. */
+    RowKernel getConvertRow( GLenum srcFormat, GLenum srcType, GLenum dstFormat, GLenum dstType )
+    {
+        Layout dst = getLayout( dstFormat, dstType );
+        switch( getLayout(srcFormat, srcType) )
+        {
+        case LAYOUT_L8:      return chooseConvertRow<L8>( dst );
+        case LAYOUT_RGB8:    return chooseConvertRow<RGB8>( dst );
+        case LAYOUT_RGBA8:   return chooseConvertRow<RGBA8>( dst );
+        case LAYOUT_L32F:    return chooseConvertRow<L32F>( dst );
+        case LAYOUT_RGBA32F: return chooseConvertRow<RGBA32F>( dst );
+        default:             return 0L;
+        }
+    }
+
+    // nearest-neighbor row copy for images of the same format.
+    template<unsigned N>
+    void resampleRow( const unsigned char* in, unsigned char* out, const unsigned* cols, unsigned count )
+    {
+        for( unsigned i = 0; i < count; ++i, out += N )
+        {
+            const unsigned char* p = in + cols[i];
+            for( unsigned b = 0; b < N; ++b )
+                out[b] = p[b];
+        }
+    }
+
+    void resampleRow( const unsigned char* in, unsigned char* out, const unsigned* cols, unsigned count, unsigned pixelBytes )
+    {
+        switch( pixelBytes )
+        {
+        case 1:  resampleRow<1>( in, out, cols, count ); break;
+        case 2:  resampleRow<2>( in, out, cols, count ); break;
+        case 3:  resampleRow<3>( in, out, cols, count ); break;
+        case 4:  resampleRow<4>( in, out, cols, count ); break;
+        case 16: resampleRow<16>( in, out, cols, count ); break;
+        default:
+            for( unsigned i = 0; i < count; ++i, out += pixelBytes )
+                memcpy( out, in + cols[i], pixelBytes );
+        }
+    }
+
+    // blends a row of "src" over "dest" like MixImage, in the byte domain.
+    template<unsigned SRC_N, unsigned DST_N>
+    void mixRow( const GLubyte* src, GLubyte* dst, unsigned count, float a, bool srcHasAlpha, bool destHasAlpha )
+    {
+        const float r8 = 1.0f/255.0f;
+
+        for( unsigned i = 0; i < count; ++i, src += SRC_N, dst += DST_N )
+        {
+            float sa = srcHasAlpha && SRC_N == 4 ? a * ((float)src[SRC_N-1] * r8) : a;
+            float da = destHasAlpha && DST_N == 4 ? (float)dst[DST_N-1] * r8 : 1.0f;
+
+#ifdef OE_IMAGE_SSE2
+            if ( SRC_N == 4 && DST_N == 4 )
+            {
+                int srcPixel, dstPixel;
+                memcpy( &srcPixel, src, 4 );
+                memcpy( &dstPixel, dst, 4 );
+                const __m128i zero = _mm_setzero_si128();
+                __m128 s = _mm_cvtepi32_ps( _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(srcPixel), zero), zero) );
+                __m128 d = _mm_cvtepi32_ps( _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(dstPixel), zero), zero) );
+                __m128 r = _mm_add_ps(
+                    _mm_add_ps( _mm_mul_ps(d, _mm_set1_ps(1.0f-sa)), _mm_mul_ps(s, _mm_set1_ps(sa)) ),
+                    _mm_set1_ps(0.5f) );
+                __m128i packed = _mm_packus_epi16( _mm_packs_epi32(_mm_cvttps_epi32(r), zero), zero );
+                int rgba = _mm_cvtsi128_si32( packed );
+                memcpy( dst, &rgba, 3 );
+                dst[3] = (GLubyte)( osg::maximum(sa, da) * 255.0f + 0.5f );
+                continue;
+            }
+#endif
+            for( unsigned c = 0; c < 3; ++c )
+                dst[c] = (GLubyte)( (float)dst[c]*(1.0f-sa) + (float)src[c]*sa + 0.5f );
+            if ( DST_N == 4 )
+                dst[DST_N-1] = (GLubyte)( osg::maximum(sa, da) * 255.0f + 0.5f );
+        }
+    }
+
+    typedef void (*MixKernel)( const GLubyte*, GLubyte*, unsigned, float, bool, bool );
+
+    MixKernel getMixRow( const osg::Image* src, const osg::Image* dest )
+    {
+        Layout s = getLayout( src->getPixelFormat(), src->getDataType() );
+        Layout d = getLayout( dest->getPixelFormat(), dest->getDataType() );
+        if ( s == LAYOUT_RGBA8 && d == LAYOUT_RGBA8 ) return &mixRow<4,4>;
+        if ( s == LAYOUT_RGB8  && d == LAYOUT_RGBA8 ) return &mixRow<3,4>;
+        if ( s == LAYOUT_RGBA8 && d == LAYOUT_RGB8  ) return &mixRow<4,3>;
+        if ( s == LAYOUT_RGB8  && d == LAYOUT_RGB8  ) return &mixRow<3,3>;
+        return 0L;
+    }
+}
+
+//------------------------------------------------------------------------
+
 bool
 ImageUtils::resizeImage(const osg::Image* input, 
                         unsigned int out_s, unsigned int out_t, 
@@ -213,16 +414,44 @@ ImageUtils::resizeImage(const osg::Image* input,
     {
         memcpy( output->data(), input->data(), input->getTotalSizeInBytes() );
     }
+    else if (
+        input->getPixelFormat() == output->getPixelFormat() &&
+        input->getDataType()    == output->getDataType() &&
+        input->getPixelSizeInBits() % 8 == 0 &&
+        !isCompressed(input) )
+    {
+        // same format: copy the nearest pixel's bytes, a row at a time.
+        unsigned int pixel_size_bytes = input->getPixelSizeInBits() / 8;
+
+        unsigned char* dataOffset = output->getMipmapData(mipmapLevel);
+        unsigned int   dataRowSizeBytes = output->getRowSizeInBytes() >> mipmapLevel;
+
+        std::vector<unsigned> cols( out_s );
+        for( unsigned int output_col = 0; output_col < out_s; output_col++ )
+        {
+            float output_col_ratio = (float)output_col/(float)out_s;
+            unsigned int input_col = (unsigned int)( output_col_ratio * (float)in_s );
+            if ( input_col >= in_s ) input_col = in_s-1;
+            cols[output_col] = input_col * pixel_size_bytes;
+        }
+
+        for( unsigned int output_row=0; output_row < out_t; output_row++ )
+        {
+            float output_row_ratio = (float)output_row/(float)out_t;
+            unsigned int input_row = (unsigned int)( output_row_ratio * (float)in_t );
+            if ( input_row >= in_t ) input_row = in_t-1;
+
+            resampleRow(
+                input->data(0, input_row),
+                dataOffset + output_row*dataRowSizeBytes,
+                &cols[0], out_s, pixel_size_bytes );
+        }
+    }
     else
     {       
         PixelReader read( input );
         PixelWriter write( output.get() );
 
-        unsigned int pixel_size_bytes = input->getRowSizeInBytes() / in_s;
-
-        unsigned char* dataOffset = output->getMipmapData(mipmapLevel);
-        unsigned int   dataRowSizeBytes = output->getRowSizeInBytes() >> mipmapLevel;
-
         for( unsigned int output_row=0; output_row < out_t; output_row++ )
         {
             // get an appropriate input row
@@ -304,6 +533,80 @@ ImageUtils::createMipmapBlendedImage( const osg::Image* primary, const osg::Imag
 
 namespace
 {
+    // zeroth-order modified Bessel function of the first kind
+    double besselI0( double x )
+    {
+        double sum = 1.0, term = 1.0, q = 0.25*x*x;
+        for( int k = 1; k < 32 && term > 1e-12*sum; ++k )
+        {
+            term *= q / (double)(k*k);
+            sum  += term;
+        }
+        return sum;
+    }
+
+    // Kaiser-windowed sinc taps for a 2:1 reduction; tap i sits at
+    // source offset (i - 2.5) from the destination pixel's center.
+    void computeKaiserTaps( float* taps )
+    {
+        const double alpha = 4.0, halfWidth = 3.0;
+        double sum = 0.0;
+        for( int i = 0; i < 6; ++i )
+        {
+            double x = (double)i - 2.5;
+            double sinc = osg::PI * 0.5 * x;
+            sinc = sin(sinc) / sinc;
+            double r = x / halfWidth;
+            double window = besselI0( alpha * sqrt(1.0 - r*r) ) / besselI0( alpha );
+            taps[i] = (float)(sinc * window);
+            sum += taps[i];
+        }
+        for( int i = 0; i < 6; ++i )
+            taps[i] = (float)(taps[i] / sum);
+    }
+
+    typedef std::vector<osg::Vec4f> Level;
+
+    void downsampleBox( const Level& in, int s, int t, Level& out, int ns, int nt )
+    {
+        for( int y = 0; y < nt; ++y )
+        {
+            int y0 = osg::minimum( 2*y, t-1 ), y1 = osg::minimum( 2*y+1, t-1 );
+            for( int x = 0; x < ns; ++x )
+            {
+                int x0 = osg::minimum( 2*x, s-1 ), x1 = osg::minimum( 2*x+1, s-1 );
+                out[y*ns+x] = (in[y0*s+x0] + in[y0*s+x1] + in[y1*s+x0] + in[y1*s+x1]) * 0.25f;
+            }
+        }
+    }
+
+    void downsampleKaiser( const Level& in, int s, int t, Level& out, int ns, int nt, const float* taps )
+    {
+        // separable: filter the rows into a half-width buffer, then the columns.
+        Level rows( ns * t );
+        for( int y = 0; y < t; ++y )
+        {
+            for( int x = 0; x < ns; ++x )
+            {
+                osg::Vec4f sum;
+                for( int i = 0; i < 6; ++i )
+                    sum += in[y*s + osg::clampBetween(2*x-2+i, 0, s-1)] * taps[i];
+                rows[y*ns+x] = sum;
+            }
+        }
+
+        for( int y = 0; y < nt; ++y )
+        {
+            for( int x = 0; x < ns; ++x )
+            {
+                osg::Vec4f sum;
+                for( int i = 0; i < 6; ++i )
+                    sum += rows[osg::clampBetween(2*y-2+i, 0, t-1)*ns + x] * taps[i];
+                out[y*ns+x] = sum;
+            }
+        }
+    }
+
     struct MixImage
     {
         float _a;
@@ -323,6 +626,112 @@ namespace
     };
 }
 
+bool
+ImageUtils::generateMipmaps( osg::Image* image, MipmapFilter filter, bool gammaCorrect )
+{
+    if ( !image || image->r() != 1 || image->isMipmap() || isCompressed(image) )
+        return false;
+
+    if ( !PixelReader::supports(image) || !PixelWriter::supports(image) )
+        return false;
+
+    int s = image->s(), t = image->t();
+    int numLevels = osg::Image::computeNumberOfMipmapLevels( s, t );
+    if ( numLevels < 2 )
+        return false;
+
+    const float gamma = 2.2f;
+
+    // level 0, as floats (linear, if requested)
+    Level level( s * t );
+    PixelReader read( image );
+    for( int y = 0; y < t; ++y )
+    {
+        for( int x = 0; x < s; ++x )
+        {
+            osg::Vec4f c = read( x, y );
+            if ( gammaCorrect )
+                c.set( powf(c.r(), gamma), powf(c.g(), gamma), powf(c.b(), gamma), c.a() );
+            level[y*s+x] = c;
+        }
+    }
+
+    float taps[6];
+    if ( filter == MIPMAP_KAISER )
+        computeKaiserTaps( taps );
+
+    // levels 1..n, each in its own image until we know the total size.
+    std::vector< osg::ref_ptr<osg::Image> > levels;
+    unsigned totalSizeBytes = image->getImageSizeInBytes();
+
+    for( int m = 1; m < numLevels; ++m )
+    {
+        int ns = osg::maximum( s >> 1, 1 ), nt = osg::maximum( t >> 1, 1 );
+        Level next( ns * nt );
+
+        if ( filter == MIPMAP_KAISER && s >= 4 && t >= 4 )
+            downsampleKaiser( level, s, t, next, ns, nt, taps );
+        else
+            downsampleBox( level, s, t, next, ns, nt );
+
+        osg::Image* out = new osg::Image();
+        out->allocateImage( ns, nt, 1, image->getPixelFormat(), image->getDataType(), image->getPacking() );
+        PixelWriter write( out );
+        for( int y = 0; y < nt; ++y )
+        {
+            for( int x = 0; x < ns; ++x )
+            {
+                osg::Vec4f c = next[y*ns+x];
+                if ( gammaCorrect )
+                {
+                    c.set(
+                        powf(osg::clampBetween(c.r(), 0.0f, 1.0f), 1.0f/gamma),
+                        powf(osg::clampBetween(c.g(), 0.0f, 1.0f), 1.0f/gamma),
+                        powf(osg::clampBetween(c.b(), 0.0f, 1.0f), 1.0f/gamma),
+                        c.a() );
+                }
+                for( int i = 0; i < 4; ++i )
+                    c[i] = osg::clampBetween( c[i], 0.0f, 1.0f );
+                write( c, x, y );
+            }
+        }
+
+        levels.push_back( out );
+        totalSizeBytes += out->getImageSizeInBytes();
+
+        level.swap( next );
+        s = ns;
+        t = nt;
+    }
+
+    // pack level 0 and the new levels into one buffer.
+    unsigned char* data = new unsigned char[totalSizeBytes];
+    memcpy( data, image->data(), image->getImageSizeInBytes() );
+
+    osg::Image::MipmapDataType offsets;
+    unsigned offset = image->getImageSizeInBytes();
+    for( unsigned i = 0; i < levels.size(); ++i )
+    {
+        offsets.push_back( offset );
+        memcpy( data + offset, levels[i]->data(), levels[i]->getImageSizeInBytes() );
+        offset += levels[i]->getImageSizeInBytes();
+    }
+
+    levels.clear();
+
+    image->setImage(
+        image->s(), image->t(), 1,
+        image->getInternalTextureFormat(),
+        image->getPixelFormat(),
+        image->getDataType(),
+        data, osg::Image::USE_NEW_DELETE,
+        image->getPacking() );
+
+    image->setMipmapLevels( offsets );
+
+    return true;
+}
+
 bool
 ImageUtils::mix(osg::Image* dest, const osg::Image* src, float a)
 {
@@ -334,6 +743,15 @@ ImageUtils::mix(osg::Image* dest, const osg::Image* src, float a)
     mixer._srcHasAlpha = src->getPixelSizeInBits() == 32;
     mixer._destHasAlpha = src->getPixelSizeInBits() == 32;    
 
+    MixKernel mixRow = getMixRow( src, dest );
+    if ( mixRow )
+    {
+        for( int r=0; r<src->r() && r<dest->r(); ++r )
+            for( int t=0; t<src->t(); ++t )
+                mixRow( src->data(0,t,r), dest->data(0,t,r), src->s(), mixer._a, mixer._srcHasAlpha, mixer._destHasAlpha );
+        return true;
+    }
+
     mixer.accept( src, dest );  
 
     return true;
@@ -560,6 +978,15 @@ ImageUtils::convert(const osg::Image* image, GLenum pixelFormat, GLenum dataType
     else
         result->setInternalTextureFormat( pixelFormat );
 
+    RowKernel convertRow = getConvertRow( image->getPixelFormat(), image->getDataType(), pixelFormat, dataType );
+    if ( convertRow )
+    {
+        for( int r=0; r<image->r(); ++r )
+            for( int t=0; t<image->t(); ++t )
+                convertRow( image->data(0,t,r), result->data(0,t,r), image->s() );
+        return result;
+    }
+
     PixelVisitor<CopyImage>().accept( image, result );
 
     return result;
@@ -628,9 +1055,64 @@ ImageUtils::hasTransparency(const osg::Image* image, float threshold)
 }
 
 
+namespace
+{
+    // featherAlphaRegions on RGBA8 data: the same passes, on raw pixels.
+    void featherAlphaRegionsRGBA8( osg::Image* image, float maxAlpha )
+    {
+        int ns = image->s();
+        int nt = image->t();
+
+        #define FEATHER_OPAQUE(P) ( (float)(P)[3] * (1.0f/255.0f) > maxAlpha )
+
+        for( int t=0; t<nt; ++t )
+        {
+            GLubyte* row = image->data(0, t);
+            for( int s=0; s<ns; ++s )
+            {
+                GLubyte* p = row + 4*s;
+                if ( FEATHER_OPAQUE(p) )
+                    continue;
+                if ( s < ns-1 && FEATHER_OPAQUE(p+4) ) {
+                    memcpy( p, p+4, 4 );
+                }
+                else if ( s > 0 && FEATHER_OPAQUE(p-4) ) {
+                    memcpy( p, p-4, 4 );
+                    break;
+                }
+            }
+        }
+
+        for( int s=0; s<ns; ++s )
+        {
+            for( int t=0; t<nt; ++t )
+            {
+                GLubyte* p = image->data(s, t);
+                if ( FEATHER_OPAQUE(p) )
+                    continue;
+                if ( t < nt-1 && FEATHER_OPAQUE(image->data(s, t+1)) ) {
+                    memcpy( p, image->data(s, t+1), 4 );
+                }
+                else if ( t > 0 && FEATHER_OPAQUE(image->data(s, t-1)) ) {
+                    memcpy( p, image->data(s, t-1), 4 );
+                    break;
+                }
+            }
+        }
+
+        #undef FEATHER_OPAQUE
+    }
+}
+
 void
 ImageUtils::featherAlphaRegions(osg::Image* image, float maxAlpha)
 {
+    if ( getLayout(image->getPixelFormat(), image->getDataType()) == LAYOUT_RGBA8 )
+    {
+        featherAlphaRegionsRGBA8( image, maxAlpha );
+        return;
+    }
+
     PixelReader read (image);
     PixelWriter write(image);
 
@@ -2725,6 +2725,373 @@ std::istream& operator>>( std::istream &sin, Value &root )
     return sin;
 }
 
+
+// Class StreamReader
+// //////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // container states of the StreamReader's explicit stack
+    enum StreamState
+    {
+        STATE_VALUE,         // expecting a value
+        STATE_ARRAY_FIRST,   // expecting a value or ']'
+        STATE_OBJECT_FIRST,  // expecting a member name or '}'
+        STATE_OBJECT_KEY,    // expecting a member name
+        STATE_AFTER_VALUE    // expecting ',' or the end of the container
+    };
+
+    void appendUTF8( std::string& out, unsigned int cp )
+    {
+        if ( cp <= 0x7F )
+        {
+            out += static_cast<char>(cp);
+        }
+        else if ( cp <= 0x7FF )
+        {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else if ( cp <= 0xFFFF )
+        {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool readHex4( const char*& current, const char* end, unsigned int& out )
+    {
+        if ( end - current < 4 )
+            return false;
+        out = 0;
+        for( int i = 0; i < 4; ++i )
+        {
+            char c = *current++;
+            out *= 16;
+            if ( c >= '0' && c <= '9' )      out += c - '0';
+            else if ( c >= 'a' && c <= 'f' ) out += c - 'a' + 10;
+            else if ( c >= 'A' && c <= 'F' ) out += c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+}
+
+StreamReader::StreamReader() :
+begin_  ( 0L ),
+end_    ( 0L ),
+current_( 0L )
+{
+}
+
+bool
+StreamReader::parse( const std::string& document, StreamHandler& handler )
+{
+   const char* begin = document.c_str();
+   return parse( begin, begin + document.length(), handler );
+}
+
+bool
+StreamReader::parse( std::istream& in, StreamHandler& handler )
+{
+   std::string doc;
+   std::getline( in, doc, (char)EOF );
+   return parse( doc, handler );
+}
+
+bool
+StreamReader::parse( const char* beginDoc, const char* endDoc, StreamHandler& handler )
+{
+   begin_   = beginDoc;
+   end_     = endDoc;
+   current_ = beginDoc;
+   error_.clear();
+
+   // '{' or '[' for each open container
+   std::vector<char> stack;
+   StreamState state = STATE_VALUE;
+
+   for( ;; )
+   {
+      skipSpaces();
+
+      if ( state == STATE_AFTER_VALUE && stack.empty() )
+         return true;
+
+      if ( current_ == end_ )
+         return fail( stack.empty() ? "Expecting a value" : "Unexpected end of document" );
+
+      char c = *current_;
+
+      switch( state )
+      {
+      case STATE_ARRAY_FIRST:
+         if ( c == ']' )
+         {
+            ++current_;
+            stack.pop_back();
+            if ( !handler.endArray() ) return fail( "Stopped by handler" );
+            state = STATE_AFTER_VALUE;
+            break;
+         }
+         // fall through: first element
+
+      case STATE_VALUE:
+         if ( c == '{' )
+         {
+            ++current_;
+            stack.push_back( '{' );
+            if ( !handler.startObject() ) return fail( "Stopped by handler" );
+            state = STATE_OBJECT_FIRST;
+         }
+         else if ( c == '[' )
+         {
+            ++current_;
+            stack.push_back( '[' );
+            if ( !handler.startArray() ) return fail( "Stopped by handler" );
+            state = STATE_ARRAY_FIRST;
+         }
+         else
+         {
+            if ( !readScalar(handler) ) return false;
+            state = STATE_AFTER_VALUE;
+         }
+         break;
+
+      case STATE_OBJECT_FIRST:
+         if ( c == '}' )
+         {
+            ++current_;
+            stack.pop_back();
+            if ( !handler.endObject() ) return fail( "Stopped by handler" );
+            state = STATE_AFTER_VALUE;
+            break;
+         }
+         // fall through: first member
+
+      case STATE_OBJECT_KEY:
+         {
+            if ( c != '"' )
+               return fail( "Missing '}' or object member name" );
+            std::string name;
+            if ( !readString(name) ) return false;
+            skipSpaces();
+            if ( current_ == end_ || *current_ != ':' )
+               return fail( "Missing ':' after object member name" );
+            ++current_;
+            if ( !handler.key(name) ) return fail( "Stopped by handler" );
+            state = STATE_VALUE;
+         }
+         break;
+
+      case STATE_AFTER_VALUE:
+         ++current_;
+         if ( stack.back() == '{' )
+         {
+            if ( c == ',' )
+               state = STATE_OBJECT_KEY;
+            else if ( c == '}' )
+            {
+               stack.pop_back();
+               if ( !handler.endObject() ) return fail( "Stopped by handler" );
+            }
+            else
+               return fail( "Missing ',' or '}' in object declaration" );
+         }
+         else
+         {
+            if ( c == ',' )
+               state = STATE_VALUE;
+            else if ( c == ']' )
+            {
+               stack.pop_back();
+               if ( !handler.endArray() ) return fail( "Stopped by handler" );
+            }
+            else
+               return fail( "Missing ',' or ']' in array declaration" );
+         }
+         break;
+      }
+   }
+}
+
+bool
+StreamReader::fail( const std::string& message )
+{
+   int line = 1;
+   const char* lineStart = begin_;
+   for( const char* p = begin_; p < current_; ++p )
+   {
+      if ( *p == '\n' )
+      {
+         ++line;
+         lineStart = p + 1;
+      }
+   }
+
+   std::stringstream buf;
+   buf << "Line " << line << ", Column " << int(current_ - lineStart) + 1 << ": " << message;
+   error_ = buf.str();
+   return false;
+}
+
+void
+StreamReader::skipSpaces()
+{
+   while ( current_ != end_ )
+   {
+      char c = *current_;
+      if ( c == ' ' || c == '\t' || c == '\r' || c == '\n' )
+      {
+         ++current_;
+      }
+      else if ( c == '/' && end_ - current_ > 1 && current_[1] == '/' )
+      {
+         while ( current_ != end_ && *current_ != '\n' && *current_ != '\r' )
+            ++current_;
+      }
+      else if ( c == '/' && end_ - current_ > 1 && current_[1] == '*' )
+      {
+         current_ += 2;
+         while ( end_ - current_ > 1 && !(current_[0] == '*' && current_[1] == '/') )
+            ++current_;
+         current_ = end_ - current_ > 1 ? current_ + 2 : end_;
+      }
+      else
+      {
+         break;
+      }
+   }
+}
+
+bool
+StreamReader::readString( std::string& decoded )
+{
+   ++current_; // skip '"'
+
+   // copy unescaped runs in one go
+   const char* run = current_;
+   while ( current_ != end_ )
+   {
+      char c = *current_;
+      if ( c == '"' )
+      {
+         decoded.append( run, current_ );
+         ++current_;
+         return true;
+      }
+      else if ( c == '\\' )
+      {
+         decoded.append( run, current_ );
+         ++current_;
+         if ( current_ == end_ )
+            return fail( "Empty escape sequence in string" );
+
+         char escape = *current_++;
+         switch( escape )
+         {
+         case '"':  decoded += '"';  break;
+         case '/':  decoded += '/';  break;
+         case '\\': decoded += '\\'; break;
+         case 'b':  decoded += '\b'; break;
+         case 'f':  decoded += '\f'; break;
+         case 'n':  decoded += '\n'; break;
+         case 'r':  decoded += '\r'; break;
+         case 't':  decoded += '\t'; break;
+         case 'u':
+            {
+               unsigned int cp;
+               if ( !readHex4(current_, end_, cp) )
+                  return fail( "Bad unicode escape sequence in string" );
+
+               // combine a surrogate pair
+               if ( cp >= 0xD800 && cp <= 0xDBFF &&
+                    end_ - current_ >= 6 && current_[0] == '\\' && current_[1] == 'u' )
+               {
+                  const char* low = current_ + 2;
+                  unsigned int cp2;
+                  if ( readHex4(low, end_, cp2) && cp2 >= 0xDC00 && cp2 <= 0xDFFF )
+                  {
+                     cp = 0x10000 + ((cp - 0xD800) << 10) + (cp2 - 0xDC00);
+                     current_ = low;
+                  }
+               }
+               appendUTF8( decoded, cp );
+            }
+            break;
+         default:
+            return fail( "Bad escape sequence in string" );
+         }
+         run = current_;
+      }
+      else
+      {
+         ++current_;
+      }
+   }
+
+   return fail( "Missing '\"' at end of string" );
+}
+
+bool
+StreamReader::readScalar( StreamHandler& handler )
+{
+   char c = *current_;
+
+   if ( c == '"' )
+   {
+      std::string decoded;
+      if ( !readString(decoded) ) return false;
+      return handler.value(decoded, stringValue) || fail( "Stopped by handler" );
+   }
+
+   if ( c == '-' || (c >= '0' && c <= '9') )
+   {
+      const char* start = current_;
+      bool isReal = false, isNegative = (c == '-');
+      ++current_;
+      while ( current_ != end_ )
+      {
+         c = *current_;
+         if ( c >= '0' && c <= '9' )
+            ++current_;
+         else if ( in(c, '.', 'e', 'E', '+', '-') )
+            ++current_, isReal = true;
+         else
+            break;
+      }
+      ValueType type = isReal ? realValue : isNegative ? intValue : uintValue;
+      return handler.value(std::string(start, current_), type) || fail( "Stopped by handler" );
+   }
+
+   struct Literal { const char* text; int length; ValueType type; };
+   static const Literal literals[] = {
+      { "true",  4, booleanValue },
+      { "false", 5, booleanValue },
+      { "null",  4, nullValue } };
+
+   for( unsigned i = 0; i < 3; ++i )
+   {
+      const Literal& lit = literals[i];
+      if ( end_ - current_ >= lit.length && strncmp(current_, lit.text, lit.length) == 0 )
+      {
+         current_ += lit.length;
+         std::string text = lit.type == nullValue ? std::string() : std::string(lit.text);
+         return handler.value(text, lit.type) || fail( "Stopped by handler" );
+      }
+   }
+
+   return fail( "Syntax error: value, object or array expected" );
+}
+
 namespace osgEarth {
     namespace Json {
 
@@ -0,0 +1,171 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/LayerMetrics>
+#include <osg/Timer>
+#include <osg/Math>
+#include <sstream>
+#include <iomanip>
+
+using namespace osgEarth;
+
+#define LC "[LayerMetrics] "
+
+//------------------------------------------------------------------------
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void
+LatencyHistogram::reset()
+{
+    for( unsigned i = 0; i < NUM_BUCKETS; ++i )
+        _buckets[i] = 0u;
+    _count = 0u;
+    _total = 0.0;
+    _max   = 0.0;
+}
+
+double
+LatencyHistogram::getBucketLimit( unsigned i )
+{
+    return (double)(1u << osg::minimum(i, (unsigned)NUM_BUCKETS-1u));
+}
+
+void
+LatencyHistogram::add( double ms )
+{
+    unsigned b = 0;
+    while( b < NUM_BUCKETS-1 && ms >= getBucketLimit(b) )
+        ++b;
+
+    _buckets[b]++;
+    _count++;
+    _total += ms;
+    _max = osg::maximum( _max, ms );
+}
+
+double
+LatencyHistogram::getPercentile( double p ) const
+{
+    if ( _count == 0 )
+        return 0.0;
+
+    double rank = osg::clampBetween(p, 0.0, 1.0) * (double)_count;
+    unsigned sum = 0;
+    for( unsigned i = 0; i < NUM_BUCKETS-1; ++i )
+    {
+        sum += _buckets[i];
+        if ( (double)sum >= rank )
+            return osg::minimum( getBucketLimit(i), _max );
+    }
+    return _max;
+}
+
+//------------------------------------------------------------------------
+
+LayerMetrics::LayerMetrics()
+{
+    reset();
+}
+
+void
+LayerMetrics::reset()
+{
+    for( unsigned i = 0; i < NUM_COUNTERS; ++i )
+        _counters[i] = 0.0;
+    for( unsigned i = 0; i < NUM_STAGES; ++i )
+        _stages[i].reset();
+    _startTime = osg::Timer::instance()->time_s();
+}
+
+double
+LayerMetrics::getCacheHitRatio() const
+{
+    double reads = _counters[CACHE_HITS] + _counters[CACHE_MISSES];
+    return reads > 0.0 ? _counters[CACHE_HITS]/reads : 0.0;
+}
+
+double
+LayerMetrics::getElapsedTime() const
+{
+    return osg::Timer::instance()->time_s() - _startTime;
+}
+
+const char*
+LayerMetrics::getCounterName( Counter counter )
+{
+    switch( counter )
+    {
+    case CACHE_HITS:    return "cache hits";
+    case CACHE_MISSES:  return "cache misses";
+    case CACHE_WRITES:  return "cache writes";
+    case SOURCE_TILES:  return "source tiles";
+    case SOURCE_ERRORS: return "source errors";
+    case BLACKLISTED:   return "blacklisted";
+    case BYTES:         return "bytes";
+    default:            return "";
+    }
+}
+
+const char*
+LayerMetrics::getStageName( Stage stage )
+{
+    switch( stage )
+    {
+    case STAGE_CACHE_READ:  return "cache read";
+    case STAGE_CACHE_WRITE: return "cache write";
+    case STAGE_SOURCE:      return "source";
+    case STAGE_ASSEMBLY:    return "assembly";
+    default:                return "";
+    }
+}
+
+std::string
+LayerMetrics::toString() const
+{
+    std::stringstream buf;
+    buf << std::fixed << std::setprecision(1);
+
+    double elapsed = getElapsedTime();
+    buf << "over " << elapsed << " s:";
+    for( unsigned i = 0; i < NUM_COUNTERS; ++i )
+        buf << " " << getCounterName((Counter)i) << "=" << (unsigned long long)_counters[i];
+    buf << " hit ratio=" << 100.0*getCacheHitRatio() << "%";
+
+    if ( elapsed > 0.0 )
+        buf << " rate=" << _counters[SOURCE_TILES]/elapsed << " tiles/s, " << _counters[BYTES]/(1024.0*elapsed) << " KB/s";
+
+    for( unsigned i = 0; i < NUM_STAGES; ++i )
+    {
+        const LatencyHistogram& h = _stages[i];
+        if ( h.getCount() == 0 )
+            continue;
+
+        buf << "\n    " << std::setw(12) << std::left << getStageName((Stage)i) << std::right
+            << " n=" << h.getCount()
+            << " mean=" << h.getMean()
+            << " p50<=" << h.getPercentile(0.5)
+            << " p95<=" << h.getPercentile(0.95)
+            << " max=" << h.getMax() << " ms";
+    }
+
+    return buf.str();
+}
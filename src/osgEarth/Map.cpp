@@ -23,7 +23,11 @@
 #include <osgEarth/TileSource>
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/URI>
+#include <osgEarth/StringUtils>
+#include <osgEarth/TaskService>
+#include <OpenThreads/Thread>
 #include <iterator>
+#include <sstream>
 
 using namespace osgEarth;
 
@@ -31,11 +35,28 @@ using namespace osgEarth;
 
 //------------------------------------------------------------------------
 
+namespace
+{
+    // opens a layer's tile source on a startup thread.
+    struct StartLayer
+    {
+        void execute()
+        {
+            _layer->getTileSource();
+        }
+
+        osg::ref_ptr<TerrainLayer> _layer;
+    };
+}
+
+//------------------------------------------------------------------------
+
 Map::Map( const MapOptions& options ) :
 osg::Referenced      ( true ),
 _mapOptions          ( options ),
 _initMapOptions      ( options ),
-_dataModelRevision   ( 0 )
+_dataModelRevision   ( 0 ),
+_publishedRevision   ( 0 )
 {
     if (_mapOptions.cachePolicy().isSet() &&
         _mapOptions.cachePolicy()->usage() == CachePolicy::USAGE_CACHE_ONLY )
@@ -89,6 +110,10 @@ _dataModelRevision   ( 0 )
     {
         _elevationLayers.setExpressTileSize( *_mapOptions.elevationTileSize() );
     }
+
+    _elevationBounds = new ElevationBounds();
+
+    _heightFieldCache = new HeightFieldCache();
 }
 
 Map::~Map()
@@ -284,7 +309,16 @@ Map::setName( const std::string& name ) {
 Revision
 Map::getDataModelRevision() const
 {
-    Threading::ScopedReadLock lock( const_cast<Map*>(this)->_mapDataMutex );
+    // no lock: writers publish each new revision atomically.
+    return (int)(unsigned)_publishedRevision;
+}
+
+Revision
+Map::nextDataModelRevision()
+{
+    // caller holds the write lock.
+    ++_dataModelRevision;
+    _publishedRevision.exchange( (unsigned)(int)_dataModelRevision );
     return _dataModelRevision;
 }
 
@@ -330,6 +364,9 @@ Map::setCache( Cache* cache )
     {
         _cache = cache;
 
+        // re-point the elevation bounds at the new cache on next use.
+        _elevationBoundsRevision.reset();
+
         if ( _cache.valid() )
         {
             _cache->apply( _dbOptions.get() );
@@ -387,120 +424,282 @@ Map::endUpdate()
     }
 }
 
+void
+Map::prepareLayer( TerrainLayer* layer )
+{
+    // Set the DB options for the map from the layer, including the cache policy.
+    layer->setDBOptions( _dbOptions.get() );
+
+    // propagate the cache to the layer:
+    layer->setCache( this->getCache() );
+
+    // Tell the layer the map profile, if possible:
+    if ( _profile.valid() )
+    {
+        layer->setTargetProfileHint( _profile.get() );
+    }
+}
+
 void
 Map::addImageLayer( ImageLayer* layer )
 {
     osgEarth::Registry::instance()->clearBlacklist();
-    unsigned int index = -1;
     if ( layer )
     {
-        // Set the DB options for the map from the layer, including the cache policy.
-        layer->setDBOptions( _dbOptions.get() );
+        prepareLayer( layer );
+        addPreparedImageLayer( layer, UINT_MAX );
+    }   
+}
 
-        // propagate the cache to the layer:
-        layer->setCache( this->getCache() );
 
-        // Tell the layer the map profile, if possible:
-        if ( _profile.valid() )
-        {
-            layer->setTargetProfileHint( _profile.get() );
-        }
+void
+Map::insertImageLayer( ImageLayer* layer, unsigned int index )
+{
+    osgEarth::Registry::instance()->clearBlacklist();
+    if ( layer )
+    {
+        prepareLayer( layer );
+        addPreparedImageLayer( layer, index );
+    }   
+}
 
-        int newRevision;
+void
+Map::addPreparedImageLayer( ImageLayer* layer, unsigned index )
+{
+    int newRevision;
 
-        // Add the layer to our stack.
-        {
-            Threading::ScopedWriteLock lock( _mapDataMutex );
+    // Add the layer to our stack.
+    {
+        Threading::ScopedWriteLock lock( _mapDataMutex );
 
+        if ( index >= _imageLayers.size() )
+        {
             _imageLayers.push_back( layer );
-            index = _imageLayers.size() - 1;
-            newRevision = ++_dataModelRevision;
+            if ( index == UINT_MAX )
+                index = _imageLayers.size() - 1;
         }
-
-        // a separate block b/c we don't need the mutex   
-        for( MapCallbackList::iterator i = _mapCallbacks.begin(); i != _mapCallbacks.end(); i++ )
+        else
         {
-            i->get()->onMapModelChanged( MapModelChange(
-                MapModelChange::ADD_IMAGE_LAYER, newRevision, layer, index) );
-        }   
+            _imageLayers.insert( _imageLayers.begin() + index, layer );
+        }
+
+        newRevision = nextDataModelRevision();
+    }
+
+    // a separate block b/c we don't need the mutex   
+    for( MapCallbackList::iterator i = _mapCallbacks.begin(); i != _mapCallbacks.end(); i++ )
+    {
+        i->get()->onMapModelChanged( MapModelChange(
+            MapModelChange::ADD_IMAGE_LAYER, newRevision, layer, index) );
     }   
 }
 
-
 void
-Map::insertImageLayer( ImageLayer* layer, unsigned int index )
+Map::addElevationLayer( ElevationLayer* layer )
 {
     osgEarth::Registry::instance()->clearBlacklist();
     if ( layer )
     {
-        //Set options for the map from the layer
-        layer->setDBOptions( _dbOptions.get() );
-
-        //Set the Cache for the MapLayer to our cache.
-        layer->setCache( this->getCache() );
+        prepareLayer( layer );
+        addPreparedElevationLayer( layer, UINT_MAX );
+    }   
+}
 
-        // Tell the layer the map profile, if possible:
-        if ( _profile.valid() )
-            layer->setTargetProfileHint( _profile.get() );
+void
+Map::addPreparedElevationLayer( ElevationLayer* layer, unsigned index )
+{
+    int newRevision;
 
-        int newRevision;
+    // Add the layer to our stack.
+    {
+        Threading::ScopedWriteLock lock( _mapDataMutex );
 
-        // Add the layer to our stack.
+        if ( index >= _elevationLayers.size() )
         {
-            Threading::ScopedWriteLock lock( _mapDataMutex );
-
-            if (index >= _imageLayers.size())
-                _imageLayers.push_back(layer);
-            else
-                _imageLayers.insert( _imageLayers.begin() + index, layer );
-
-            newRevision = ++_dataModelRevision;
+            _elevationLayers.push_back( layer );
+            index = _elevationLayers.size() - 1;
         }
-
-        // a separate block b/c we don't need the mutex   
-        for( MapCallbackList::iterator i = _mapCallbacks.begin(); i != _mapCallbacks.end(); i++ )
+        else
         {
-            i->get()->onMapModelChanged( MapModelChange(
-                MapModelChange::ADD_IMAGE_LAYER, newRevision, layer, index) );
-        }   
+            _elevationLayers.insert( _elevationLayers.begin() + index, layer );
+        }
+
+        newRevision = nextDataModelRevision();
+    }
+
+    // a separate block b/c we don't need the mutex   
+    for( MapCallbackList::iterator i = _mapCallbacks.begin(); i != _mapCallbacks.end(); i++ )
+    {
+        i->get()->onMapModelChanged( MapModelChange(
+            MapModelChange::ADD_ELEVATION_LAYER, newRevision, layer, index) );
     }   
 }
 
+TaskService*
+Map::getLayerStartupService()
+{
+    if ( !_layerStartupService.valid() )
+    {
+        // startup is mostly I/O-bound, so use more threads than cores.
+        _layerStartupService = new TaskService(
+            "Map layer startup",
+            osg::maximum( 8, 2*OpenThreads::GetNumberOfProcessors() ) );
+    }
+    return _layerStartupService.get();
+}
+
 void
-Map::addElevationLayer( ElevationLayer* layer )
+Map::addLayers(const ImageLayerVector&     imageLayers,
+               const ElevationLayerVector& elevationLayers,
+               bool                        async )
 {
     osgEarth::Registry::instance()->clearBlacklist();
-    unsigned int index = -1;
-    if ( layer )
+
+    // a projected map without a profile takes it from its layers, which
+    // therefore have to be in the map before anything else happens.
+    if ( async && !isGeocentric() && !_mapOptions.profile().isSet() )
+    {
+        OE_INFO << LC << "No map profile; starting layers synchronously" << std::endl;
+        async = false;
+    }
+
+    PendingLayerVector batch;
+    for( ImageLayerVector::const_iterator i = imageLayers.begin(); i != imageLayers.end(); ++i )
     {
-        //Set options for the map from the layer
-        layer->setDBOptions( _dbOptions.get() );
+        if ( i->valid() )
+        {
+            PendingLayer p;
+            p._layer   = i->get();
+            p._isImage = true;
+            p._added   = false;
+            batch.push_back( p );
+        }
+    }
+    for( ElevationLayerVector::const_iterator i = elevationLayers.begin(); i != elevationLayers.end(); ++i )
+    {
+        if ( i->valid() )
+        {
+            PendingLayer p;
+            p._layer   = i->get();
+            p._isImage = false;
+            p._added   = false;
+            batch.push_back( p );
+        }
+    }
 
-        //Set the Cache for the MapLayer to our cache.
-        layer->setCache( this->getCache() );
-        
-        // Tell the layer the map profile, if possible:
-        if ( _profile.valid() )
-            layer->setTargetProfileHint( _profile.get() );
+    if ( batch.empty() )
+        return;
 
-        int newRevision;
+    // the layers need the map's I/O settings before they start.
+    for( PendingLayerVector::iterator i = batch.begin(); i != batch.end(); ++i )
+    {
+        prepareLayer( i->_layer.get() );
+    }
 
-        // Add the layer to our stack.
+    TaskService* service = getLayerStartupService();
+
+    if ( async )
+    {
+        for( PendingLayerVector::iterator i = batch.begin(); i != batch.end(); ++i )
         {
-            Threading::ScopedWriteLock lock( _mapDataMutex );
+            ParallelTask<StartLayer>* task = new ParallelTask<StartLayer>();
+            task->_layer = i->_layer.get();
+            i->_startup = task;
+            service->add( task );
+        }
 
-            _elevationLayers.push_back( layer );
-            index = _elevationLayers.size() - 1;
-            newRevision = ++_dataModelRevision;
+        _pendingLayers.insert( _pendingLayers.end(), batch.begin(), batch.end() );
+        return;
+    }
+
+    // synchronous: start them all, wait, and add them in order.
+    Threading::MultiEvent started( (int)batch.size() );
+    for( PendingLayerVector::iterator i = batch.begin(); i != batch.end(); ++i )
+    {
+        ParallelTask<StartLayer>* task = new ParallelTask<StartLayer>( &started );
+        task->_layer = i->_layer.get();
+        i->_startup = task;
+        service->add( task );
+    }
+    started.wait();
+
+    beginUpdate();
+    for( PendingLayerVector::iterator i = batch.begin(); i != batch.end(); ++i )
+    {
+        if ( i->_isImage )
+            addPreparedImageLayer( static_cast<ImageLayer*>(i->_layer.get()), UINT_MAX );
+        else
+            addPreparedElevationLayer( static_cast<ElevationLayer*>(i->_layer.get()), UINT_MAX );
+    }
+    endUpdate();
+}
+
+unsigned
+Map::addPendingLayers()
+{
+    if ( _pendingLayers.empty() )
+        return 0;
+
+    bool updating = false;
+
+    for( unsigned i = 0; i < _pendingLayers.size(); ++i )
+    {
+        // by value; a callback may add layers and grow the vector.
+        PendingLayer p = _pendingLayers[i];
+        if ( p._added || !p._startup->isCompleted() )
+            continue;
+
+        // insert it in front of the next layer from its batch that is already
+        // in the map, so that the batch order survives.
+        unsigned index = UINT_MAX;
+        for( unsigned j = i+1; j < _pendingLayers.size() && index == UINT_MAX; ++j )
+        {
+            const PendingLayer& next = _pendingLayers[j];
+            if ( next._added && next._isImage == p._isImage )
+            {
+                Threading::ScopedReadLock lock( _mapDataMutex );
+                if ( p._isImage )
+                {
+                    for( unsigned k = 0; k < _imageLayers.size(); ++k )
+                        if ( _imageLayers[k].get() == next._layer.get() ) { index = k; break; }
+                }
+                else
+                {
+                    for( unsigned k = 0; k < _elevationLayers.size(); ++k )
+                        if ( _elevationLayers[k].get() == next._layer.get() ) { index = k; break; }
+                }
+            }
         }
 
-        // a separate block b/c we don't need the mutex   
-        for( MapCallbackList::iterator i = _mapCallbacks.begin(); i != _mapCallbacks.end(); i++ )
+        if ( !updating )
         {
-            i->get()->onMapModelChanged( MapModelChange(
-                MapModelChange::ADD_ELEVATION_LAYER, newRevision, layer, index) );
-        }   
-    }   
+            beginUpdate();
+            updating = true;
+        }
+
+        if ( p._isImage )
+            addPreparedImageLayer( static_cast<ImageLayer*>(p._layer.get()), index );
+        else
+            addPreparedElevationLayer( static_cast<ElevationLayer*>(p._layer.get()), index );
+
+        _pendingLayers[i]._added = true;
+        OE_INFO << LC << "Layer \"" << p._layer->getName() << "\" is ready" << std::endl;
+    }
+
+    if ( updating )
+        endUpdate();
+
+    unsigned numPending = 0;
+    for( PendingLayerVector::const_iterator i = _pendingLayers.begin(); i != _pendingLayers.end(); ++i )
+    {
+        if ( !i->_added )
+            ++numPending;
+    }
+
+    if ( numPending == 0 )
+        _pendingLayers.clear();
+
+    return numPending;
 }
 
 void 
@@ -521,7 +720,7 @@ Map::removeImageLayer( ImageLayer* layer )
             if ( i->get() == layerToRemove.get() )
             {
                 _imageLayers.erase( i );
-                newRevision = ++_dataModelRevision;
+                newRevision = nextDataModelRevision();
                 break;
             }
         }
@@ -557,7 +756,7 @@ Map::removeElevationLayer( ElevationLayer* layer )
             if ( i->get() == layerToRemove.get() )
             {
                 _elevationLayers.erase( i );
-                newRevision = ++_dataModelRevision;
+                newRevision = nextDataModelRevision();
                 break;
             }
         }
@@ -607,7 +806,7 @@ Map::moveImageLayer( ImageLayer* layer, unsigned int newIndex )
         _imageLayers.erase( i_oldIndex );
         _imageLayers.insert( _imageLayers.begin() + newIndex, layerToMove.get() );
 
-        newRevision = ++_dataModelRevision;
+        newRevision = nextDataModelRevision();
     }
 
     // a separate block b/c we don't need the mutex
@@ -654,7 +853,7 @@ Map::moveElevationLayer( ElevationLayer* layer, unsigned int newIndex )
         _elevationLayers.erase( i_oldIndex );
         _elevationLayers.insert( _elevationLayers.begin() + newIndex, layerToMove.get() );
 
-        newRevision = ++_dataModelRevision;
+        newRevision = nextDataModelRevision();
     }
 
     // a separate block b/c we don't need the mutex
@@ -680,7 +879,7 @@ Map::addModelLayer( ModelLayer* layer )
             Threading::ScopedWriteLock lock( _mapDataMutex );
             _modelLayers.push_back( layer );
             index = _modelLayers.size() - 1;
-            newRevision = ++_dataModelRevision;
+            newRevision = nextDataModelRevision();
         }
 
         // initialize the model layer
@@ -704,7 +903,7 @@ Map::insertModelLayer( ModelLayer* layer, unsigned int index )
         {
             Threading::ScopedWriteLock lock( _mapDataMutex );
             _modelLayers.insert( _modelLayers.begin() + index, layer );
-            newRevision = ++_dataModelRevision;
+            newRevision = nextDataModelRevision();
         }
 
         // initialize the model layer
@@ -735,7 +934,7 @@ Map::removeModelLayer( ModelLayer* layer )
                 if ( i->get() == layer )
                 {
                     _modelLayers.erase( i );
-                    newRevision = ++_dataModelRevision;
+                    newRevision = nextDataModelRevision();
                     break;
                 }
             }
@@ -782,7 +981,7 @@ Map::moveModelLayer( ModelLayer* layer, unsigned int newIndex )
         _modelLayers.erase( i_oldIndex );
         _modelLayers.insert( _modelLayers.begin() + newIndex, layerToMove.get() );
 
-        newRevision = ++_dataModelRevision;
+        newRevision = nextDataModelRevision();
     }
 
     // a separate block b/c we don't need the mutex
@@ -805,7 +1004,7 @@ Map::addTerrainMaskLayer( MaskLayer* layer )
         {
             Threading::ScopedWriteLock lock( _mapDataMutex );
             _terrainMaskLayers.push_back(layer);
-            newRevision = ++_dataModelRevision;
+            newRevision = nextDataModelRevision();
         }
 
         layer->initialize( _dbOptions.get(), this );
@@ -834,7 +1033,7 @@ Map::removeTerrainMaskLayer( MaskLayer* layer )
                 if ( i->get() == layer )
                 {
                     _terrainMaskLayers.erase( i );
-                    newRevision = ++_dataModelRevision;
+                    newRevision = nextDataModelRevision();
                     break;
                 }
             }
@@ -870,7 +1069,7 @@ Map::clear()
         //maskLayersRemoved.swap ( _terrainMaskLayers );
 
         // calculate a new revision.
-        newRevision = ++_dataModelRevision;
+        newRevision = nextDataModelRevision();
     }
     
     // a separate block b/c we don't need the mutex   
@@ -1059,7 +1258,7 @@ Map::getHeightField(const TileKey&                  key,
 
     ElevationInterpolation interp = getMapOptions().elevationInterpolation().get();    
 
-    return _elevationLayers.createHeightField(
+    bool ok = _elevationLayers.createHeightField(
         key, 
         fallback, 
         convertToHAE ? _profileNoVDatum.get() : 0L,
@@ -1068,64 +1267,113 @@ Map::getHeightField(const TileKey&                  key,
         out_result,  
         out_isFallback,
         progress );
+
+    if ( ok && convertToHAE && samplePolicy == SAMPLE_FIRST_VALID )
+    {
+        syncElevationBounds();
+        _elevationBounds->record( key, out_result.get() );
+    }
+
+    return ok;
 }
 
-const SpatialReference*
-Map::getWorldSRS() const
+ElevationBounds*
+Map::getElevationBounds() const
 {
-    return isGeocentric() ? getSRS()->getECEF() : getSRS();
+    Threading::ScopedReadLock lock( const_cast<Map*>(this)->_mapDataMutex );
+    syncElevationBounds();
+    return _elevationBounds.get();
 }
 
-bool
-Map::sync( MapFrame& frame ) const
+// Caller must hold a read lock on the map data.
+void
+Map::syncElevationBounds() const
 {
-    bool result = false;
+    Threading::ScopedMutexLock lock( _elevationBoundsMutex );
+
+    if ( _elevationBoundsRevision == _dataModelRevision )
+        return;
 
-    if ( frame._mapDataModelRevision != _dataModelRevision || !frame._initialized )
+    // The signature identifies the elevation data set. Entries only persist
+    // when every layer has a stable cache ID.
+    std::stringstream buf;
+    buf << getMapOptions().elevationInterpolation().get();
+    bool persistent = true;
+    for( ElevationLayerVector::const_iterator i = _elevationLayers.begin(); i != _elevationLayers.end(); ++i )
     {
-        // hold the read lock while copying the layer lists.
-        Threading::ScopedReadLock lock( const_cast<Map*>(this)->_mapDataMutex );
+        const ElevationLayer* layer = i->get();
+        if ( !layer->getEnabled() )
+            continue;
 
-        if ( frame._parts & IMAGE_LAYERS )
+        const TerrainLayerOptions& options = layer->getTerrainLayerRuntimeOptions();
+        if ( options.cacheId().isSet() && !options.cacheId()->empty() )
+            buf << ";" << options.cacheId().get();
+        else
         {
-            if ( !frame._initialized )
-                frame._imageLayers.reserve( _imageLayers.size() );
-            frame._imageLayers.clear();
-            std::copy( _imageLayers.begin(), _imageLayers.end(), std::back_inserter(frame._imageLayers) );
+            buf << ";uid" << layer->getUID();
+            persistent = false;
         }
+        if ( layer->getElevationLayerOptions().offset() == true )
+            buf << "+offset";
+    }
+    std::string signature = buf.str();
 
-        if ( frame._parts & ELEVATION_LAYERS )
-        {
-            frame._elevationLayers = _elevationLayers;
-            //if ( !frame._initialized )
-            //    frame._elevationLayers.reserve( _elevationLayers.size() );
-            //frame._elevationLayers.clear();
-            //std::copy( _elevationLayers.begin(), _elevationLayers.end(), std::back_inserter(frame._elevationLayers) );
-            if ( _mapOptions.elevationTileSize().isSet() )
-                frame._elevationLayers.setExpressTileSize( *_mapOptions.elevationTileSize() );
-        }
+    CacheBin* bin = 0L;
+    Cache* cache = _cache.get();
+    if ( persistent && cache && _profile.valid() )
+    {
+        std::string binId = Stringify()
+            << "elevation_bounds_" << std::hex << hashString(signature)
+            << "_" << _profile->getFullSignature();
+        bin = cache->getBin( binId );
+        if ( !bin )
+            bin = cache->addBin( binId );
+    }
 
-        if ( frame._parts & MODEL_LAYERS )
-        {
-            if ( !frame._initialized )
-                frame._modelLayers.reserve( _modelLayers.size() );
-            frame._modelLayers.clear();
-            std::copy( _modelLayers.begin(), _modelLayers.end(), std::back_inserter(frame._modelLayers) );
-        }
+    _elevationBounds->reset( signature, bin, getMapOptions().cachePolicy().get() );
+    _elevationBoundsRevision = (int)_dataModelRevision;
+}
 
-        if ( frame._parts & MASK_LAYERS )
-        {
-          if ( !frame._initialized )
-              frame._maskLayers.reserve( _terrainMaskLayers.size() );
-          frame._maskLayers.clear();
-          std::copy( _terrainMaskLayers.begin(), _terrainMaskLayers.end(), std::back_inserter(frame._maskLayers) );
-        }
+const SpatialReference*
+Map::getWorldSRS() const
+{
+    return isGeocentric() ? getSRS()->getECEF() : getSRS();
+}
+
+osg::ref_ptr<const Map::LayerSnapshot>
+Map::getLayerSnapshot() const
+{
+    // hold the read lock so the lists cannot change while we copy them.
+    Threading::ScopedReadLock lock( const_cast<Map*>(this)->_mapDataMutex );
+    Threading::ScopedMutexLock snapshotLock( _layerSnapshotMutex );
+
+    if ( !_layerSnapshot.valid() || (int)_layerSnapshot->_revision != (int)_dataModelRevision )
+    {
+        LayerSnapshot* snapshot = new LayerSnapshot();
+        snapshot->_revision        = _dataModelRevision;
+        snapshot->_imageLayers     = _imageLayers;
+        snapshot->_elevationLayers = _elevationLayers;
+        snapshot->_modelLayers     = _modelLayers;
+        snapshot->_maskLayers      = _terrainMaskLayers;
+
+        if ( _mapOptions.elevationTileSize().isSet() )
+            snapshot->_elevationLayers.setExpressTileSize( *_mapOptions.elevationTileSize() );
+
+        _layerSnapshot = snapshot;
+    }
+
+    return _layerSnapshot;
+}
 
-        // sync the revision numbers.
-        frame._initialized = true;
-        frame._mapDataModelRevision = _dataModelRevision;
-            
-        result = true;
-    }    
-    return result;
+bool
+Map::sync( MapFrame& frame ) const
+{
+    if ( frame._initialized && (int)frame._mapDataModelRevision == (int)getDataModelRevision() )
+        return false;
+
+    // every frame at the same revision shares one snapshot.
+    frame._snapshot = getLayerSnapshot();
+    frame._mapDataModelRevision = frame._snapshot->_revision;
+    frame._initialized = true;
+    return true;
 }
@@ -41,12 +41,17 @@ _name                ( name ),
 _mapInfo             ( src._mapInfo ),
 _parts               ( src._parts ),
 _mapDataModelRevision( src._mapDataModelRevision ),
-_imageLayers         ( src._imageLayers ),
-_elevationLayers     ( src._elevationLayers ),
-_modelLayers         ( src._modelLayers ),
-_maskLayers          ( src._maskLayers )
+_snapshot            ( src._snapshot )
 {
-    //no sync required here; we copied the arrays etc
+    //no sync required here; we share the source frame's snapshot
+}
+
+
+const Map::LayerSnapshot&
+MapFrame::emptySnapshot()
+{
+    static osg::ref_ptr<Map::LayerSnapshot> s_empty = new Map::LayerSnapshot();
+    return *s_empty.get();
 }
 
 
@@ -61,10 +66,7 @@ MapFrame::sync()
     }
     else
     {
-        _imageLayers.clear();
-        _elevationLayers.clear();
-        _modelLayers.clear();
-        _maskLayers.clear();        
+        _snapshot = 0L;
     }
 
     return changed;
@@ -80,6 +82,12 @@ MapFrame::needsSync() const
 }
 
 
+HeightFieldCache*
+MapFrame::getHeightFieldCache() const
+{
+    return _map.valid() ? _map->getHeightFieldCache() : 0L;
+}
+
 bool
 MapFrame::getHeightField(const TileKey&                  key,
                          bool                            fallback,
@@ -94,7 +102,7 @@ MapFrame::getHeightField(const TileKey&                  key,
     
 
 
-    return _elevationLayers.createHeightField(
+    bool ok = elevationLayers().createHeightField(
         key,
         fallback, 
         convertToHAE ? _map->getProfileNoVDatum() : 0L,
@@ -103,37 +111,49 @@ MapFrame::getHeightField(const TileKey&                  key,
         out_hf, 
         out_isFallback,
         progress );    
+
+    // only a frame that matches the live map may contribute to its bounds.
+    if ( ok && convertToHAE && samplePolicy == SAMPLE_FIRST_VALID &&
+         (int)_mapDataModelRevision == (int)_map->getDataModelRevision() )
+    {
+        _map->getElevationBounds()->record( key, out_hf.get() );
+    }
+
+    return ok;
 }
 
 
 int
 MapFrame::indexOf( ImageLayer* layer ) const
 {
-    ImageLayerVector::const_iterator i = std::find( _imageLayers.begin(), _imageLayers.end(), layer );
-    return i != _imageLayers.end() ? i - _imageLayers.begin() : -1;
+    const ImageLayerVector& layers = imageLayers();
+    ImageLayerVector::const_iterator i = std::find( layers.begin(), layers.end(), layer );
+    return i != layers.end() ? i - layers.begin() : -1;
 }
 
 
 int
 MapFrame::indexOf( ElevationLayer* layer ) const
 {
-    ElevationLayerVector::const_iterator i = std::find( _elevationLayers.begin(), _elevationLayers.end(), layer );
-    return i != _elevationLayers.end() ? i - _elevationLayers.begin() : -1;
+    const ElevationLayerVector& layers = elevationLayers();
+    ElevationLayerVector::const_iterator i = std::find( layers.begin(), layers.end(), layer );
+    return i != layers.end() ? i - layers.begin() : -1;
 }
 
 
 int
 MapFrame::indexOf( ModelLayer* layer ) const
 {
-    ModelLayerVector::const_iterator i = std::find( _modelLayers.begin(), _modelLayers.end(), layer );
-    return i != _modelLayers.end() ? i - _modelLayers.begin() : -1;
+    const ModelLayerVector& layers = modelLayers();
+    ModelLayerVector::const_iterator i = std::find( layers.begin(), layers.end(), layer );
+    return i != layers.end() ? i - layers.begin() : -1;
 }
 
 
 ImageLayer*
 MapFrame::getImageLayerByUID( UID uid ) const
 {
-    for(ImageLayerVector::const_iterator i = _imageLayers.begin(); i != _imageLayers.end(); ++i )
+    for(ImageLayerVector::const_iterator i = imageLayers().begin(); i != imageLayers().end(); ++i )
         if ( i->get()->getUID() == uid )
             return i->get();
     return 0L;
@@ -143,7 +163,7 @@ MapFrame::getImageLayerByUID( UID uid ) const
 ImageLayer*
 MapFrame::getImageLayerByName( const std::string& name ) const
 {
-    for(ImageLayerVector::const_iterator i = _imageLayers.begin(); i != _imageLayers.end(); ++i )
+    for(ImageLayerVector::const_iterator i = imageLayers().begin(); i != imageLayers().end(); ++i )
         if ( i->get()->getName() == name )
             return i->get();
     return 0L;
@@ -331,13 +331,26 @@ MapNode::init()
             draping->setMipMapping( *_mapNodeOptions.overlayMipMapping() );
         if ( _mapNodeOptions.overlayAttachStencil().isSet() )
             draping->setAttachStencil( *_mapNodeOptions.overlayAttachStencil() );
+        if ( _mapNodeOptions.overlayRenderOnDemand().isSet() )
+            draping->setRenderOnDemand( *_mapNodeOptions.overlayRenderOnDemand() );
+        if ( _mapNodeOptions.overlayCascades().isSet() )
+            draping->setNumCascades( *_mapNodeOptions.overlayCascades() );
 
         _overlayDecorator->addTechnique( draping );
     }
 
     // install the Clamping technique for overlays:
     {
-        _overlayDecorator->addTechnique( new ClampingTechnique() );
+        ClampingTechnique* clamping = new ClampingTechnique();
+
+        if ( _mapNodeOptions.clampingTextureSize().isSet() )
+            clamping->setTextureSize( *_mapNodeOptions.clampingTextureSize() );
+        if ( _mapNodeOptions.clampingConservative().isSet() )
+            clamping->setConservativeFiltering( *_mapNodeOptions.clampingConservative() );
+        if ( _mapNodeOptions.clampingReuseTolerance().isSet() )
+            clamping->setReuseTolerance( *_mapNodeOptions.clampingReuseTolerance() );
+
+        _overlayDecorator->addTechnique( clamping );
     }
 
 
@@ -356,6 +369,10 @@ MapNode::init()
     // install a layer callback for processing further map actions:
     _map->addMapCallback( _mapCallback.get()  );
 
+    // layers that start up asynchronously join the map during the update
+    // traversal, so make sure we get one.
+    ADJUST_UPDATE_TRAV_COUNT( this, 1 );
+
     osg::StateSet* ss = getOrCreateStateSet();
 
     if ( _mapNodeOptions.enableLighting().isSet() )
@@ -725,6 +742,12 @@ MapNode::traverse( osg::NodeVisitor& nv )
 
     else
     {
+        if ( nv.getVisitorType() == nv.UPDATE_VISITOR )
+        {
+            // add layers whose tile sources finished starting up.
+            _map->addPendingLayers();
+        }
+
         osg::Group::traverse( nv );
     }
 }
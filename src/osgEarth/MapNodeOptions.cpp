@@ -40,7 +40,11 @@ _overlayBlending     ( true ),
 _overlayMipMapping   ( false ),
 _overlayTextureSize  ( 4096 ),
 _terrainOptions      ( 0L ),
-_overlayAttachStencil( true )
+_overlayAttachStencil( true ),
+_overlayRenderOnDemand( false ),
+_overlayCascades     ( 1 ),
+_clampingConservative( false ),
+_clampingReuseTolerance( 0.0f )
 {
     mergeConfig( conf );
 }
@@ -54,6 +58,10 @@ _overlayBlending     ( true ),
 _overlayTextureSize  ( 4096 ),
 _overlayMipMapping   ( false ),
 _overlayAttachStencil( true ),
+_overlayRenderOnDemand( false ),
+_overlayCascades     ( 1 ),
+_clampingConservative( false ),
+_clampingReuseTolerance( 0.0f ),
 _terrainOptions      ( 0L )
 {
     setTerrainOptions( to );
@@ -68,7 +76,11 @@ _overlayBlending     ( true ),
 _overlayTextureSize  ( 4096 ),
 _overlayMipMapping   ( false ),
 _terrainOptions      ( 0L ),
-_overlayAttachStencil( true )
+_overlayAttachStencil( true ),
+_overlayRenderOnDemand( false ),
+_overlayCascades     ( 1 ),
+_clampingConservative( false ),
+_clampingReuseTolerance( 0.0f )
 {
     mergeConfig( rhs.getConfig() );
 }
@@ -98,6 +110,11 @@ MapNodeOptions::getConfig() const
     conf.updateIfSet   ( "overlay_texture_size",   _overlayTextureSize );
     conf.updateIfSet   ( "overlay_mipmapping",     _overlayMipMapping );
     conf.updateIfSet   ( "overlay_attach_stencil", _overlayAttachStencil );
+    conf.updateIfSet   ( "overlay_on_demand",      _overlayRenderOnDemand );
+    conf.updateIfSet   ( "overlay_cascades",       _overlayCascades );
+    conf.updateIfSet   ( "clamping_texture_size",  _clampingTextureSize );
+    conf.updateIfSet   ( "clamping_conservative",  _clampingConservative );
+    conf.updateIfSet   ( "clamping_reuse",         _clampingReuseTolerance );
 
     return conf;
 }
@@ -115,6 +132,11 @@ MapNodeOptions::mergeConfig( const Config& conf )
     conf.getIfSet   ( "overlay_texture_size",   _overlayTextureSize );
     conf.getIfSet   ( "overlay_mipmapping",     _overlayMipMapping );
     conf.getIfSet   ( "overlay_attach_stencil", _overlayAttachStencil );
+    conf.getIfSet   ( "overlay_on_demand",      _overlayRenderOnDemand );
+    conf.getIfSet   ( "overlay_cascades",       _overlayCascades );
+    conf.getIfSet   ( "clamping_texture_size",  _clampingTextureSize );
+    conf.getIfSet   ( "clamping_conservative",  _clampingConservative );
+    conf.getIfSet   ( "clamping_reuse",         _clampingReuseTolerance );
 
     if ( conf.hasChild( "terrain" ) )
     {
@@ -48,6 +48,7 @@ MapOptions::fromConfig( const Config& conf )
     conf.getIfSet( "elevation_interpolation", "triangulate", _elevationInterpolation, INTERP_TRIANGULATE);
 
     conf.getIfSet( "elevation_tile_size", _elevTileSize );
+    conf.getIfSet( "async_layer_startup", _asyncLayerStartup );
 }
 
 Config
@@ -71,6 +72,7 @@ MapOptions::getConfig() const
     conf.updateIfSet( "elevation_interpolation", "triangulate", _elevationInterpolation, INTERP_TRIANGULATE);
 
     conf.updateIfSet( "elevation_tile_size", _elevTileSize );
+    conf.updateIfSet( "async_layer_startup", _asyncLayerStartup );
 
     return conf;
 }
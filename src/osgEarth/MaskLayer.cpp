@@ -72,20 +72,23 @@ MaskLayerOptions::mergeConfig( const Config& conf )
 //------------------------------------------------------------------------
 
 MaskLayer::MaskLayer( const MaskLayerOptions& options ) :
-_initOptions( options )
+_initOptions( options ),
+_clippedBoundaries( true, 4096 )
 {
     copyOptions();
 }
 
 MaskLayer::MaskLayer( const std::string& name, const MaskSourceOptions& options ) :
-_initOptions( MaskLayerOptions( name, options ) )
+_initOptions( MaskLayerOptions( name, options ) ),
+_clippedBoundaries( true, 4096 )
 {
     copyOptions();
 }
 
 MaskLayer::MaskLayer( const MaskLayerOptions& options, MaskSource* source ) :
 _maskSource( source ),
-_initOptions( options )
+_initOptions( options ),
+_clippedBoundaries( true, 4096 )
 {
     copyOptions();
 }
@@ -131,8 +134,113 @@ MaskLayer::getOrCreateBoundary( float heightScale, const SpatialReference *srs,
 				vIt->z() = vIt->z() * heightScale;
 
             _maskSource->sync( _maskSourceRev );
+
+            // clipped from the old boundary:
+            _clippedBoundaries.clear();
         }
     }
 
     return _boundary.get();
 }
+
+namespace
+{
+    // One Sutherland-Hodgman pass: keeps the part of the ring on the
+    // inside of the axis-aligned line "axis = value", interpolating z
+    // at the crossings.
+    void clipRing( const osg::Vec3dArray& in, osg::Vec3dArray& out, int axis, double value, bool keepGreater )
+    {
+        out.clear();
+        if ( in.empty() )
+            return;
+
+        const osg::Vec3d* prev = &in.back();
+        bool prevIn = keepGreater ? (*prev)[axis] >= value : (*prev)[axis] <= value;
+
+        for( osg::Vec3dArray::const_iterator i = in.begin(); i != in.end(); ++i )
+        {
+            const osg::Vec3d& curr = *i;
+            bool currIn = keepGreater ? curr[axis] >= value : curr[axis] <= value;
+
+            if ( currIn != prevIn )
+            {
+                double t = (value - (*prev)[axis]) / (curr[axis] - (*prev)[axis]);
+                osg::Vec3d p = *prev + (curr - *prev) * t;
+                p[axis] = value;
+                out.push_back( p );
+            }
+            if ( currIn )
+            {
+                out.push_back( curr );
+            }
+
+            prev   = &curr;
+            prevIn = currIn;
+        }
+    }
+
+    osg::Vec3dArray* clipBoundary( const osg::Vec3dArray* in, double xmin, double ymin, double xmax, double ymax )
+    {
+        osg::ref_ptr<osg::Vec3dArray> a = new osg::Vec3dArray();
+        osg::ref_ptr<osg::Vec3dArray> b = new osg::Vec3dArray();
+
+        clipRing( *in, *a, 0, xmin, true  );
+        clipRing( *a,  *b, 0, xmax, false );
+        clipRing( *b,  *a, 1, ymin, true  );
+        clipRing( *a,  *b, 1, ymax, false );
+
+        // a ring with fewer than 3 points has no area in the tile.
+        if ( b->size() < 3 )
+            b->clear();
+
+        return b.release();
+    }
+}
+
+bool
+MaskLayer::getOrCreateBoundary(const TileKey&                 key,
+                               osg::ref_ptr<osg::Vec3dArray>& output,
+                               float                          heightScale,
+                               const SpatialReference*        srs,
+                               ProgressCallback*              progress)
+{
+    osg::ref_ptr<osg::Vec3dArray> boundary = getOrCreateBoundary( heightScale, srs, progress );
+    if ( !boundary.valid() || !key.valid() )
+        return false;
+
+    ClippedBoundaryCache::Record rec;
+    if ( _clippedBoundaries.get(key, rec) )
+    {
+        output = rec.value();
+        return true;
+    }
+
+    // clip from the parent's result, which is usually much smaller than
+    // the full boundary. Its margin is twice ours, so it covers ours.
+    osg::ref_ptr<osg::Vec3dArray> source = boundary.get();
+    if ( key.getLOD() > 0 )
+    {
+        if ( !getOrCreateBoundary(key.createParentKey(), source, heightScale, srs, progress) )
+            return false;
+    }
+
+    GeoExtent extent = key.getExtent();
+    if ( srs && extent.getSRS() && !extent.getSRS()->isHorizEquivalentTo(srs) )
+        extent = extent.transform( srs );
+
+    if ( source->empty() || !extent.isValid() )
+    {
+        output = new osg::Vec3dArray();
+    }
+    else
+    {
+        double mx = 0.125 * extent.width(), my = 0.125 * extent.height();
+        output = clipBoundary(
+            source.get(),
+            extent.xMin() - mx, extent.yMin() - my,
+            extent.xMax() + mx, extent.yMax() + my );
+    }
+
+    _clippedBoundaries.insert( key, output.get() );
+    return true;
+}
@@ -20,6 +20,12 @@
 #include <osgEarth/StringUtils>
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/Containers>
+#include <osgEarth/QuantizedHeightField>
+#include <osgEarth/Registry>
+#include <osg/Image>
+#include <osg/Shape>
+#include <list>
+#include <map>
 
 using namespace osgEarth;
 
@@ -31,36 +37,69 @@ namespace
 {
     typedef std::pair<osg::ref_ptr<const osg::Object>, Config> MemCacheEntry;
     typedef LRUCache<std::string, MemCacheEntry> MemCacheLRU;
+    typedef ShardedLRUCache<std::string, MemCacheEntry> MemCacheShardedLRU;
 
-    struct MemCacheBin : public CacheBin
+    unsigned long estimateSizeInBytes( const osg::Object* object );
+
+    /** A bin that can report the approximate size of its contents. */
+    struct MemCacheSizedBin
     {
-        MemCacheBin( const std::string& id, unsigned maxSize )
+        virtual unsigned long getSizeInBytes() const =0;
+        virtual ~MemCacheSizedBin() { }
+    };
+
+    template<typename LRU>
+    struct MemCacheBinT : public CacheBin, public MemCacheSizedBin
+    {
+        MemCacheBinT( const std::string& id, LRU* lru )
             : CacheBin( id ),
-              _lru    ( true, maxSize )
+              _lru    ( lru )
         {
             //nop
         }
 
+        struct SizeFunctor
+        {
+            SizeFunctor() : _bytes(0L) { }
+            void operator()( const std::string& key, const MemCacheEntry& entry ) {
+                _bytes += key.size() + estimateSizeInBytes( entry.first.get() );
+            }
+            unsigned long _bytes;
+        };
+
+        unsigned long getSizeInBytes() const
+        {
+            SizeFunctor size;
+            _lru->forEach( size );
+            return size._bytes;
+        }
+
+        virtual ~MemCacheBinT()
+        {
+            delete _lru;
+        }
+
         ReadResult readObject(const std::string& key,
                               double             maxAge )
         {
-            MemCacheLRU::Record rec;
-            _lru.get(key, rec);
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            typename LRU::Record rec;
+            _lru->get(key, rec);
 
             // clone required since the cache is in memory
 
             if ( rec.valid() )
             {
-                //OE_INFO << LC << "hits: " << _lru.getStats()._hitRatio*100.0f << "%" << std::endl;
+                //OE_INFO << LC << "hits: " << _lru->getStats()._hitRatio*100.0f << "%" << std::endl;
 
-                return ReadResult( 
+                return countRead( ReadResult( 
                    osg::clone(rec.value().first.get(), osg::CopyOp::DEEP_COPY_ALL),
-                   rec.value().second );
+                   rec.value().second ), start );
             }
             else
             {
-                //OE_INFO << LC << "hits: " << _lru.getStats()._hitRatio*100.0f << "%" << std::endl;
-                return ReadResult();
+                //OE_INFO << LC << "hits: " << _lru->getStats()._hitRatio*100.0f << "%" << std::endl;
+                return countRead( ReadResult(), start );
             }
         }
 
@@ -84,46 +123,385 @@ namespace
 
         bool write( const std::string& key, const osg::Object* object, const Config& meta )
         {
+            osg::Timer_t start = osg::Timer::instance()->tick();
             if ( object ) 
             {
-                _lru.insert( key, std::make_pair(object, meta) );
-                return true;
+                _lru->insert( key, std::make_pair(object, meta) );
+                return countWrite( true, object, start );
             }
             else
-                return false;
+                return countWrite( false, object, start );
         }
 
         bool isCached( const std::string& key, double maxAge ) 
         {
-            return _lru.has(key);
+            return _lru->has(key);
         }
 
         bool purge()
         {
+            _lru->clear();
+            return true;
+        }
+
+    private:
+        LRU* _lru;
+    };
+
+    /** Approximate memory footprint of a cached object. */
+    unsigned long estimateSizeInBytes( const osg::Object* object )
+    {
+        const osg::Image* image = dynamic_cast<const osg::Image*>( object );
+        if ( image )
+            return sizeof(osg::Image) + image->getTotalSizeInBytesIncludingMipmaps();
+
+        const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>( object );
+        if ( hf )
+            return sizeof(osg::HeightField) + hf->getNumColumns() * hf->getNumRows() * sizeof(float);
+
+        const QuantizedHeightField* qhf = dynamic_cast<const QuantizedHeightField*>( object );
+        if ( qhf )
+            return qhf->getSizeInBytes();
+
+        // unknown object type; count the shell.
+        return sizeof(osg::Object);
+    }
+
+    struct MemCacheByteBin;
+
+    /**
+     * Process-wide byte accounting shared by every byte-budgeted MemCache bin.
+     * When the global total exceeds the limit, the largest bins give up their
+     * least-recently-used entries first.
+     */
+    struct MemCacheBudget
+    {
+        MemCacheBudget() : _totalBytes(0L), _maxBytes(0L)
+        {
+            const char* env = ::getenv("OSGEARTH_MEMCACHE_MAX_BYTES");
+            if ( env )
+                _maxBytes = as<unsigned long>( std::string(env), 0L );
+        }
+
+        void add( MemCacheByteBin* bin )
+        {
+            Threading::ScopedMutexLock lock( _binsMutex );
+            _bins.push_back( bin );
+        }
+
+        void remove( MemCacheByteBin* bin )
+        {
+            Threading::ScopedMutexLock lock( _binsMutex );
+            _bins.remove( bin );
+        }
+
+        void adjust( long delta )
+        {
+            Threading::ScopedMutexLock lock( _totalMutex );
+            _totalBytes = (unsigned long)( (long)_totalBytes + delta );
+        }
+
+        unsigned long getTotalBytes() const
+        {
+            Threading::ScopedMutexLock lock( _totalMutex );
+            return _totalBytes;
+        }
+
+        bool isOverBudget() const
+        {
+            return _maxBytes > 0L && getTotalBytes() > _maxBytes;
+        }
+
+        void enforce();
+
+        std::list<MemCacheByteBin*> _bins;
+        mutable Threading::Mutex    _binsMutex;
+        unsigned long               _totalBytes;
+        mutable Threading::Mutex    _totalMutex;
+        unsigned long               _maxBytes;
+    };
+
+    MemCacheBudget& getBudget()
+    {
+        // never destroyed, since bins may outlive static destruction
+        static MemCacheBudget* s_budget = new MemCacheBudget();
+        return *s_budget;
+    }
+
+    /**
+     * A memory cache bin that caps its contents by size in bytes rather than
+     * by number of entries.
+     */
+    struct MemCacheByteBin : public CacheBin, public MemCacheSizedBin
+    {
+        struct Entry
+        {
+            MemCacheEntry                    _data;
+            unsigned long                    _bytes;
+            std::list<std::string>::iterator _lru;
+        };
+        typedef std::map<std::string, Entry> EntryMap;
+
+        MemCacheByteBin( const std::string& id, const MemCache* owner, unsigned long maxBytes )
+            : CacheBin  ( id ),
+              _owner    ( owner ),
+              _maxBytes ( maxBytes ),
+              _bytes    ( 0L )
+        {
+            getBudget().add( this );
+        }
+
+        virtual ~MemCacheByteBin()
+        {
+            getBudget().remove( this );
+            getBudget().adjust( -(long)_bytes );
+        }
+
+        ReadResult readObject(const std::string& key,
+                              double             maxAge )
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            Threading::ScopedMutexLock lock( _mutex );
+            EntryMap::iterator i = _entries.find( key );
+            if ( i == _entries.end() )
+                return countRead( ReadResult(), start );
+
+            _lru.splice( _lru.end(), _lru, i->second._lru );
+
+            // clone required since the cache is in memory
+            return countRead( ReadResult( 
+                osg::clone(i->second._data.first.get(), osg::CopyOp::DEEP_COPY_ALL),
+                i->second._data.second ), start );
+        }
+
+        ReadResult readImage(const std::string& key,
+                             double             maxAge )
+        {
+            return readObject( key, maxAge );
+        }
+
+        ReadResult readString(const std::string& key,
+                              double             maxAge )
+        {
+            return readObject( key, maxAge );
+        }
+
+        ReadResult readConfig(const std::string& key,
+                              double             maxAge )
+        {
+            return readObject( key, maxAge );
+        }
+
+        bool write( const std::string& key, const osg::Object* object, const Config& meta )
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            if ( !object )
+                return countWrite( false, object, start );
+
+            unsigned long bytes = estimateSizeInBytes( object );
+            {
+                Threading::ScopedMutexLock lock( _mutex );
+
+                EntryMap::iterator i = _entries.find( key );
+                if ( i != _entries.end() )
+                {
+                    release( i->second._bytes );
+                    _lru.erase( i->second._lru );
+                    _entries.erase( i );
+                }
+
+                Entry& entry = _entries[key];
+                entry._data  = std::make_pair(object, meta);
+                entry._bytes = bytes;
+                entry._lru   = _lru.insert( _lru.end(), key );
+                _bytes += bytes;
+                getBudget().adjust( (long)bytes );
+
+                // honor the per-bin budget (always keep the newest entry):
+                if ( _maxBytes > 0L )
+                    trim_impl( _maxBytes, 1u );
+            }
+
+            // honor the process-wide budget:
+            if ( getBudget().isOverBudget() )
+                getBudget().enforce();
+
+            return countWrite( true, object, start );
+        }
+
+        bool isCached( const std::string& key, double maxAge ) 
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            return _entries.find( key ) != _entries.end();
+        }
+
+        bool purge()
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            release( _bytes );
+            _entries.clear();
             _lru.clear();
             return true;
         }
 
+        /** Drops LRU entries until this bin holds no more than "target" bytes. */
+        void trim( unsigned long target )
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            trim_impl( target, 0u );
+        }
+
+        unsigned long getSizeInBytes() const
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            return _bytes;
+        }
+
+        const MemCache* getOwner() const { return _owner; }
+
     private:
-        MemCacheLRU _lru;
+        void release( unsigned long bytes )
+        {
+            _bytes -= bytes;
+            getBudget().adjust( -(long)bytes );
+        }
+
+        void trim_impl( unsigned long target, unsigned keep )
+        {
+            while( _bytes > target && _lru.size() > keep )
+            {
+                EntryMap::iterator i = _entries.find( _lru.front() );
+                release( i->second._bytes );
+                _entries.erase( i );
+                _lru.pop_front();
+            }
+        }
+
+        const MemCache*          _owner;
+        unsigned long            _maxBytes;
+        unsigned long            _bytes;
+        EntryMap                 _entries;
+        std::list<std::string>   _lru;
+        mutable Threading::Mutex _mutex;
     };
-    
+
+    void MemCacheBudget::enforce()
+    {
+        Threading::ScopedMutexLock lock( _binsMutex );
+
+        // Trim the largest bins first, each down to its fair share, until we fit.
+        while( isOverBudget() && !_bins.empty() )
+        {
+            MemCacheByteBin* largest = 0L;
+            unsigned long    largestSize = 0L;
+            for( std::list<MemCacheByteBin*>::iterator i = _bins.begin(); i != _bins.end(); ++i )
+            {
+                unsigned long size = (*i)->getSizeInBytes();
+                if ( size > largestSize )
+                {
+                    largest = *i;
+                    largestSize = size;
+                }
+            }
+
+            if ( !largest )
+                break;
+
+            unsigned long excess = getTotalBytes() - _maxBytes;
+            unsigned long share  = _maxBytes / _bins.size();
+            unsigned long target = largestSize > excess ? largestSize - excess : 0L;
+            largest->trim( std::max(target, std::min(share, largestSize-1)) );
+
+            // no progress means the leftover is spread too thin; finish it off.
+            if ( largest->getSizeInBytes() == largestSize )
+                largest->trim( target );
+        }
+    }
+
+    CacheBin* createBin( const std::string& id, unsigned maxSize, bool concurrent, unsigned long maxBytes, const MemCache* owner )
+    {
+        // byte accounting applies whenever a byte budget is in play:
+        if ( maxBytes > 0L || getBudget()._maxBytes > 0L )
+            return new MemCacheByteBin( id, owner, maxBytes );
+        else if ( concurrent )
+            return new MemCacheBinT<MemCacheShardedLRU>( id, new MemCacheShardedLRU(maxSize) );
+        else
+            return new MemCacheBinT<MemCacheLRU>( id, new MemCacheLRU(true, maxSize) );
+    }
 
     static Threading::Mutex s_defaultBinMutex;
 }
 
 //------------------------------------------------------------------------
 
-MemCache::MemCache( unsigned maxBinSize ) :
-_maxBinSize( std::max(maxBinSize, 1u) )
+MemCache::MemCache( unsigned maxBinSize, bool concurrent ) :
+_maxBinSize( std::max(maxBinSize, 1u) ),
+_concurrent( concurrent ),
+_maxBinSizeInBytes( 0L )
+{
+    Registry::addMemoryReporter( this );
+}
+
+MemCache::~MemCache()
+{
+    Registry::removeMemoryReporter( this );
+}
+
+void
+MemCache::setMaxBinSizeInBytes( unsigned long bytes )
+{
+    _maxBinSizeInBytes = bytes;
+}
+
+unsigned long
+MemCache::getSizeInBytes() const
+{
+    std::vector< osg::ref_ptr<CacheBin> > bins;
+    const_cast<MemCache*>(this)->_bins.getValues( bins );
+    if ( _defaultBin.valid() )
+        bins.push_back( _defaultBin.get() );
+
+    unsigned long total = 0L;
+    for( unsigned i = 0; i < bins.size(); ++i )
+    {
+        const MemCacheSizedBin* bin = dynamic_cast<const MemCacheSizedBin*>( bins[i].get() );
+        if ( bin )
+            total += bin->getSizeInBytes();
+    }
+    return total;
+}
+
+void
+MemCache::getMemoryUsage( MemoryUsageMap& usage ) const
+{
+    usage["memcache"] += getSizeInBytes();
+}
+
+void
+MemCache::setGlobalMaxSizeInBytes( unsigned long bytes )
+{
+    MemCacheBudget& budget = getBudget();
+    budget._maxBytes = bytes;
+    if ( budget.isOverBudget() )
+        budget.enforce();
+}
+
+unsigned long
+MemCache::getGlobalMaxSizeInBytes()
+{
+    return getBudget()._maxBytes;
+}
+
+unsigned long
+MemCache::getGlobalSizeInBytes()
 {
-    //nop
+    return getBudget().getTotalBytes();
 }
 
 CacheBin*
 MemCache::addBin( const std::string& binID )
 {
-    return _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize) );
+    return _bins.getOrCreate( binID, createBin(binID, _maxBinSize, _concurrent, _maxBinSizeInBytes, this) );
 }
 
 CacheBin*
@@ -135,7 +513,7 @@ MemCache::getOrCreateDefaultBin()
         // double check
         if ( !_defaultBin.valid() )
         {
-            _defaultBin = new MemCacheBin("__default", _maxBinSize);
+            _defaultBin = createBin("__default", _maxBinSize, _concurrent, _maxBinSizeInBytes, this);
         }
     }
 
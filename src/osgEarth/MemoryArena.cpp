@@ -0,0 +1,171 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/MemoryArena>
+#include <cstdlib>
+#include <new>
+
+using namespace osgEarth;
+
+#define LC "[MemoryArena] "
+
+// size of each block the arena carves objects out of
+#define BLOCK_SIZE  (64*1024)
+
+// allocations bigger than this go straight to the heap
+#define MAX_ARENA_ALLOC (BLOCK_SIZE/8)
+
+// every allocation is prefixed by a header naming its arena (NULL = heap);
+// sized to keep the payload 16-byte aligned.
+#define HEADER_SIZE 16
+
+#if defined(_MSC_VER)
+#  define OE_THREAD_LOCAL __declspec(thread)
+#else
+#  define OE_THREAD_LOCAL __thread
+#endif
+
+namespace
+{
+    OE_THREAD_LOCAL MemoryArena* s_currentArena = 0L;
+
+    bool s_arenasEnabled = ::getenv("OSGEARTH_NO_MEMORY_ARENA") == 0L;
+}
+
+struct MemoryArena::Block
+{
+    Block* _next;
+    char   _pad[HEADER_SIZE - sizeof(Block*)];
+};
+
+//------------------------------------------------------------------------
+
+MemoryArena::Scope::Scope() :
+_arena   ( 0L ),
+_previous( s_currentArena )
+{
+    if ( s_arenasEnabled )
+    {
+        _arena = new MemoryArena();
+        s_currentArena = _arena;
+    }
+}
+
+MemoryArena::Scope::~Scope()
+{
+    s_currentArena = _previous;
+    if ( _arena )
+        _arena->release();
+}
+
+//------------------------------------------------------------------------
+
+MemoryArena::MemoryArena() :
+_blocks( 0L ),
+_next  ( 0L ),
+_end   ( 0L ),
+_live  ( 1 )
+{
+    //nop
+}
+
+MemoryArena::~MemoryArena()
+{
+    while( _blocks )
+    {
+        Block* next = _blocks->_next;
+        ::free( _blocks );
+        _blocks = next;
+    }
+}
+
+void*
+MemoryArena::bump( std::size_t size )
+{
+    size = (size + 15) & ~(std::size_t)15;
+
+    if ( _next + size > _end )
+    {
+        Block* block = (Block*)::malloc( sizeof(Block) + BLOCK_SIZE );
+        if ( !block )
+            return 0L;
+        block->_next = _blocks;
+        _blocks = block;
+        _next   = (char*)(block + 1);
+        _end    = _next + BLOCK_SIZE;
+    }
+
+    void* ptr = _next;
+    _next += size;
+    ++_live;
+    return ptr;
+}
+
+void
+MemoryArena::release()
+{
+    if ( --_live == 0 )
+        delete this;
+}
+
+void*
+MemoryArena::allocate( std::size_t size )
+{
+    MemoryArena* arena = s_currentArena;
+
+    char* block = 0L;
+    if ( arena && size + HEADER_SIZE <= MAX_ARENA_ALLOC )
+        block = (char*)arena->bump( size + HEADER_SIZE );
+
+    if ( !block )
+    {
+        arena = 0L;
+        block = (char*)::malloc( size + HEADER_SIZE );
+        if ( !block )
+            throw std::bad_alloc();
+    }
+
+    *(MemoryArena**)block = arena;
+    return block + HEADER_SIZE;
+}
+
+void
+MemoryArena::deallocate( void* ptr )
+{
+    if ( !ptr )
+        return;
+
+    char* block = (char*)ptr - HEADER_SIZE;
+    MemoryArena* arena = *(MemoryArena**)block;
+    if ( arena )
+        arena->release();
+    else
+        ::free( block );
+}
+
+void
+MemoryArena::setEnabled( bool value )
+{
+    s_arenasEnabled = value;
+}
+
+bool
+MemoryArena::getEnabled()
+{
+    return s_arenasEnabled;
+}
@@ -0,0 +1,184 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/MemoryUsage>
+#include <osg/Image>
+#include <osg/Shape>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/StateSet>
+#include <osg/Texture>
+#include <osg/NodeVisitor>
+
+using namespace osgEarth;
+
+#define LC "[MemoryCounter] "
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    struct CountingVisitor : public osg::NodeVisitor
+    {
+        CountingVisitor( MemoryCounter& counter ) :
+            osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+            _counter        ( counter )
+        {
+            setNodeMaskOverride( ~0 );
+        }
+
+        void apply( osg::Node& node )
+        {
+            if ( !_counter.mark(&node) )
+                return;
+            _counter.add( sizeof(osg::Node) );
+            _counter.add( node.getStateSet() );
+            traverse( node );
+        }
+
+        void apply( osg::Geode& geode )
+        {
+            if ( !_counter.mark(&geode) )
+                return;
+            _counter.add( sizeof(osg::Geode) );
+            _counter.add( geode.getStateSet() );
+            for( unsigned i = 0; i < geode.getNumDrawables(); ++i )
+                _counter.add( geode.getDrawable(i) );
+        }
+
+        MemoryCounter& _counter;
+    };
+}
+
+//------------------------------------------------------------------------
+
+void
+MemoryCounter::add( const osg::Image* image )
+{
+    if ( mark(image) )
+    {
+        _bytes += sizeof(osg::Image);
+        if ( image->data() )
+            _bytes += image->getTotalSizeInBytesIncludingMipmaps();
+    }
+}
+
+void
+MemoryCounter::add( const osg::HeightField* hf )
+{
+    if ( mark(hf) )
+    {
+        _bytes += sizeof(osg::HeightField) + hf->getNumColumns() * hf->getNumRows() * sizeof(float);
+    }
+}
+
+void
+MemoryCounter::add( const osg::StateAttribute* attr )
+{
+    if ( mark(attr) )
+    {
+        _bytes += sizeof(osg::StateAttribute);
+
+        const osg::Texture* tex = dynamic_cast<const osg::Texture*>( attr );
+        if ( tex )
+        {
+            for( unsigned i = 0; i < tex->getNumImages(); ++i )
+                add( tex->getImage(i) );
+        }
+    }
+}
+
+void
+MemoryCounter::add( const osg::StateSet* stateSet )
+{
+    if ( mark(stateSet) )
+    {
+        _bytes += sizeof(osg::StateSet);
+
+        const osg::StateSet::AttributeList& attrs = stateSet->getAttributeList();
+        for( osg::StateSet::AttributeList::const_iterator i = attrs.begin(); i != attrs.end(); ++i )
+            add( i->second.first.get() );
+
+        const osg::StateSet::TextureAttributeList& texAttrs = stateSet->getTextureAttributeList();
+        for( unsigned unit = 0; unit < texAttrs.size(); ++unit )
+        {
+            for( osg::StateSet::AttributeList::const_iterator i = texAttrs[unit].begin(); i != texAttrs[unit].end(); ++i )
+                add( i->second.first.get() );
+        }
+
+        _bytes += stateSet->getUniformList().size() * sizeof(osg::Uniform);
+    }
+}
+
+void
+MemoryCounter::add( const osg::Drawable* drawable )
+{
+    if ( !mark(drawable) )
+        return;
+
+    _bytes += sizeof(osg::Drawable);
+    add( drawable->getStateSet() );
+
+    const osg::Geometry* geom = drawable->asGeometry();
+    if ( !geom )
+        return;
+
+    const osg::Array* arrays[] = {
+        geom->getVertexArray(),
+        geom->getNormalArray(),
+        geom->getColorArray(),
+        geom->getSecondaryColorArray(),
+        geom->getFogCoordArray() };
+
+    for( unsigned i = 0; i < 5; ++i )
+    {
+        if ( mark(arrays[i]) )
+            _bytes += sizeof(osg::Array) + arrays[i]->getTotalDataSize();
+    }
+
+    for( unsigned i = 0; i < geom->getNumTexCoordArrays(); ++i )
+    {
+        const osg::Array* a = geom->getTexCoordArray(i);
+        if ( mark(a) )
+            _bytes += sizeof(osg::Array) + a->getTotalDataSize();
+    }
+
+    for( unsigned i = 0; i < geom->getNumVertexAttribArrays(); ++i )
+    {
+        const osg::Array* a = geom->getVertexAttribArray(i);
+        if ( mark(a) )
+            _bytes += sizeof(osg::Array) + a->getTotalDataSize();
+    }
+
+    for( unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i )
+    {
+        const osg::PrimitiveSet* p = geom->getPrimitiveSet(i);
+        if ( mark(p) )
+            _bytes += sizeof(osg::PrimitiveSet) + p->getTotalDataSize();
+    }
+}
+
+void
+MemoryCounter::add( const osg::Node* node )
+{
+    if ( node )
+    {
+        CountingVisitor cv( *this );
+        const_cast<osg::Node*>(node)->accept( cv );
+    }
+}
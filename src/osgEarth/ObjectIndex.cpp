@@ -0,0 +1,110 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ObjectIndex>
+#include <osgEarth/Notify>
+
+using namespace osgEarth;
+
+#define LC "[ObjectIndex] "
+
+// IDs are written to an RGB8 buffer, so they have to fit in 24 bits.
+#define MAX_OBJECT_ID 0xFFFFFFu
+
+//------------------------------------------------------------------------
+
+ObjectIndex*
+ObjectIndex::instance()
+{
+    static osg::ref_ptr<ObjectIndex> s_index;
+    static Threading::Mutex          s_indexMutex;
+
+    if ( !s_index.valid() )
+    {
+        Threading::ScopedMutexLock lock( s_indexMutex );
+        if ( !s_index.valid() ) // double-check
+            s_index = new ObjectIndex();
+    }
+    return s_index.get();
+}
+
+ObjectIndex::ObjectIndex() :
+_nextID( 1 )
+{
+    //nop
+}
+
+ObjectID
+ObjectIndex::insert( osg::Referenced* owner, unsigned long data )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    if ( _entries.size() >= MAX_OBJECT_ID )
+    {
+        OE_WARN << LC << "Out of object IDs" << std::endl;
+        return 0;
+    }
+
+    // wrap around (skipping zero and any IDs still in use) once the
+    // counter runs out of bits.
+    while ( _entries.find(_nextID) != _entries.end() )
+    {
+        _nextID = _nextID < MAX_OBJECT_ID ? _nextID + 1 : 1;
+    }
+
+    ObjectID id = _nextID;
+    _nextID = _nextID < MAX_OBJECT_ID ? _nextID + 1 : 1;
+
+    Entry& entry = _entries[id];
+    entry._owner = owner;
+    entry._data  = data;
+    return id;
+}
+
+void
+ObjectIndex::remove( ObjectID id )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _entries.erase( id );
+}
+
+bool
+ObjectIndex::get( ObjectID id, osg::ref_ptr<osg::Referenced>& out_owner, unsigned long& out_data ) const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    EntryMap::const_iterator i = _entries.find( id );
+    if ( i == _entries.end() )
+        return false;
+
+    out_data = i->second._data;
+    return i->second._owner.lock( out_owner );
+}
+
+unsigned
+ObjectIndex::getNumObjects() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _entries.size();
+}
+
+osg::Uniform*
+ObjectIndex::createUniform( ObjectID id )
+{
+    return new osg::Uniform( getUniformName(), (float)id );
+}
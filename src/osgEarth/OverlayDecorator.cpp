@@ -202,6 +202,30 @@ namespace
 
         maxDistance = sqrt(maxDist2);
     }
+
+
+    /**
+     * Whether the RTT extent of "inner" lies within the RTT extent of
+     * "outer", i.e. whether inner's overlay can be read out of outer's
+     * textures.
+     */
+    bool
+    isCoveredBy(const OverlayDecorator::TechRTTParams& inner,
+                const OverlayDecorator::TechRTTParams& outer)
+    {
+        osg::Matrixd innerToOuter =
+            osg::Matrixd::inverse(inner._rttViewMatrix * inner._rttProjMatrix) *
+            outer._rttViewMatrix * outer._rttProjMatrix;
+
+        for( int c = 0; c < 4; ++c )
+        {
+            osg::Vec3d corner( c&1 ? 1.0 : -1.0, c&2 ? 1.0 : -1.0, 0.0 );
+            osg::Vec3d p = corner * innerToOuter;
+            if ( osg::absolute(p.x()) > 1.0 || osg::absolute(p.y()) > 1.0 )
+                return false;
+        }
+        return true;
+    }
 }
 
 //---------------------------------------------------------------------------
@@ -639,6 +663,43 @@ OverlayDecorator::getPerViewData(osg::Camera* key)
 }
 
 
+OverlayDecorator::PerViewData*
+OverlayDecorator::findPerViewData(osg::Camera* key)
+{
+    Threading::ScopedReadLock shared( _perViewDataMutex );
+    PerViewDataMap::iterator i = _perViewData.find(key);
+    return i != _perViewData.end() && i->second._sharedTerrainStateSet.valid() ? &i->second : 0L;
+}
+
+
+void
+OverlayDecorator::setOverlaysEnabled( osg::Camera* view, bool value )
+{
+    if ( view )
+    {
+        getPerViewData( view )._enabled = value;
+    }
+}
+
+
+bool
+OverlayDecorator::getOverlaysEnabled( osg::Camera* view )
+{
+    PerViewData* pvd = findPerViewData( view );
+    return pvd ? pvd->_enabled : true;
+}
+
+
+void
+OverlayDecorator::setOverlaySource( osg::Camera* view, osg::Camera* source )
+{
+    if ( view )
+    {
+        getPerViewData( view )._source = source != view ? source : 0L;
+    }
+}
+
+
 void
 OverlayDecorator::traverse( osg::NodeVisitor& nv )
 {
@@ -651,9 +712,14 @@ OverlayDecorator::traverse( osg::NodeVisitor& nv )
             osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
             osg::Camera* camera = cv->getCurrentCamera();
 
-            if ( camera != 0L && (_rttTraversalMask & nv.getTraversalMask()) != 0 )
+            PerViewData* pvdp = camera ? &getPerViewData( camera ) : 0L;
+
+            if ( pvdp && pvdp->_enabled && (_rttTraversalMask & nv.getTraversalMask()) != 0 )
             {
-                PerViewData& pvd = getPerViewData( camera );
+                PerViewData& pvd = *pvdp;
+
+                // the view whose overlays we may reuse, if any:
+                PerViewData* source = pvd._source.valid() ? findPerViewData( pvd._source.get() ) : 0L;
 
                 //TODO:
                 // check whether we need to recalculate the RTT camera params.
@@ -671,11 +737,22 @@ OverlayDecorator::traverse( osg::NodeVisitor& nv )
                 // shared terrain culling pass:
                 cullTerrainAndCalculateRTTParams( cv, pvd );
 
-                // prep and traverse the RTT camera(s):
+                // prep and traverse the RTT camera(s), or borrow the source view's
+                // results when they cover this view:
                 for(unsigned i=0; i<_techniques.size(); ++i)
                 {
                     TechRTTParams& params = pvd._techParams[i];
-                    _techniques[i]->cullOverlayGroup( params, cv );
+
+                    bool shared =
+                        source != 0L &&
+                        source->_techParams[i]._rttCamera.valid() &&
+                        isCoveredBy( params, source->_techParams[i] ) &&
+                        _techniques[i]->cullSharedOverlayGroup( params, source->_techParams[i], cv );
+
+                    if ( !shared )
+                    {
+                        _techniques[i]->cullOverlayGroup( params, cv );
+                    }
                 }
 
 #if 0
@@ -19,11 +19,15 @@
 
 #include <osgEarth/PrimitiveIntersector>
 #include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
 
 #include <osg/Geode>
 #include <osg/KdTree>
 #include <osg/Notify>
 #include <osg/TemplatePrimitiveFunctor>
+#include <algorithm>
+#include <map>
+#include <vector>
 
 #define LC "[PrmitiveIntersector] "
 
@@ -251,6 +255,406 @@ struct PrimitiveIntersectorFunctor
 
 };
 
+
+// Drawables with fewer primitives than this are scanned linearly.
+#define BVH_MIN_PRIMITIVES 64
+
+// Maximum number of primitives in a BVH leaf.
+#define BVH_LEAF_SIZE 8
+
+/**
+ * Records the primitives of a drawable as vertex indices, numbered the way
+ * PrimitiveIntersectorFunctor numbers them (one index per point, line,
+ * triangle or quad).
+ */
+struct PrimitiveCollector
+{
+    struct Primitive
+    {
+        unsigned _v[4];
+        unsigned _numVerts;
+        unsigned _index;
+    };
+
+    const void*            _first;
+    unsigned               _stride;
+    unsigned               _numVerts;
+    std::vector<Primitive> _prims;
+    bool                   _ok;
+
+    PrimitiveCollector() : _first(0L), _stride(0), _numVerts(0), _ok(true) { }
+
+    template<typename V>
+    unsigned vertexIndex(const V& v)
+    {
+        ptrdiff_t offset = (const char*)&v - (const char*)_first;
+        unsigned  i      = (unsigned)(offset / (ptrdiff_t)_stride);
+        if ( offset < 0 || offset % (ptrdiff_t)_stride != 0 || i >= _numVerts )
+            _ok = false;
+        return i;
+    }
+
+    template<typename V>
+    void add(unsigned numVerts, const V* v1, const V* v2, const V* v3, const V* v4, bool temporary)
+    {
+        // vertices that are not in the vertex array cannot be indexed.
+        if ( temporary ) _ok = false;
+        if ( !_ok ) return;
+
+        Primitive p;
+        p._numVerts = numVerts;
+        p._index    = _prims.size();
+        p._v[0] = vertexIndex(*v1);
+        p._v[1] = v2 ? vertexIndex(*v2) : 0;
+        p._v[2] = v3 ? vertexIndex(*v3) : 0;
+        p._v[3] = v4 ? vertexIndex(*v4) : 0;
+        _prims.push_back( p );
+    }
+
+    template<typename V>
+    inline void operator () (const V& v1, bool temporary)
+    { add<V>(1, &v1, 0L, 0L, 0L, temporary); }
+
+    template<typename V>
+    inline void operator () (const V& v1, const V& v2, bool temporary)
+    { add<V>(2, &v1, &v2, 0L, 0L, temporary); }
+
+    template<typename V>
+    inline void operator () (const V& v1, const V& v2, const V& v3, bool temporary)
+    { add<V>(3, &v1, &v2, &v3, 0L, temporary); }
+
+    template<typename V>
+    inline void operator () (const V& v1, const V& v2, const V& v3, const V& v4, bool temporary)
+    { add<V>(4, &v1, &v2, &v3, &v4, temporary); }
+};
+
+/**
+ * Bounding volume hierarchy over the primitives of one drawable, in the
+ * drawable's local coordinates. Built once and then only read.
+ */
+class PrimitiveBVH : public osg::Referenced
+{
+public:
+    static PrimitiveBVH* create(const osg::Geometry* geom)
+    {
+        const osg::Array* verts = geom->getVertexArray();
+        unsigned stride =
+            dynamic_cast<const osg::Vec3dArray*>(verts) ? sizeof(osg::Vec3d) :
+            dynamic_cast<const osg::Vec3Array*>(verts)  ? sizeof(osg::Vec3) : 0;
+        if ( stride == 0 || verts->getNumElements() == 0 )
+            return 0L;
+
+        osg::TemplatePrimitiveFunctor<PrimitiveCollector> c;
+        c._first    = verts->getDataPointer();
+        c._stride   = stride;
+        c._numVerts = verts->getNumElements();
+        geom->accept( c );
+
+        if ( !c._ok || c._prims.size() < BVH_MIN_PRIMITIVES )
+            return 0L;
+
+        PrimitiveBVH* bvh = new PrimitiveBVH();
+        bvh->_verts  = verts;
+        bvh->_double = stride == sizeof(osg::Vec3d);
+        bvh->_prims.swap( c._prims );
+        bvh->build();
+        return bvh;
+    }
+
+    /** Runs the functor against the primitives whose boxes the segment crosses. */
+    void intersect(const osg::Vec3d& s, const osg::Vec3d& e, double expand, PrimitiveIntersectorFunctor& f) const
+    {
+        osg::Vec3d d = e - s;
+        osg::Vec3d ex(expand, expand, expand);
+
+        std::vector<unsigned> stack;
+        stack.reserve( 64 );
+        stack.push_back( 0 );
+
+        while( !stack.empty() )
+        {
+            const Node& node = _nodes[stack.back()];
+            stack.pop_back();
+
+            if ( !crosses(s, d, node._min - ex, node._max + ex) )
+                continue;
+
+            if ( node._count > 0 )
+            {
+                for( unsigned i = node._first; i < node._first + node._count; ++i )
+                {
+                    if ( f._limitOneIntersection && f._hit )
+                        return;
+                    run( _prims[i], f );
+                }
+            }
+            else
+            {
+                stack.push_back( node._first );
+                stack.push_back( node._first + 1 );
+            }
+        }
+    }
+
+protected:
+    typedef PrimitiveCollector::Primitive Primitive;
+
+    // interior nodes keep their two children at _first, _first+1; leaves
+    // keep _count primitives starting at _first.
+    struct Node
+    {
+        osg::Vec3d _min, _max;
+        unsigned   _first;
+        unsigned   _count;
+    };
+
+    osg::ref_ptr<const osg::Array> _verts;
+    bool                           _double;
+    std::vector<Primitive>         _prims;
+    std::vector<Node>              _nodes;
+
+    osg::Vec3d vertex(unsigned i) const
+    {
+        return _double ?
+            (*static_cast<const osg::Vec3dArray*>(_verts.get()))[i] :
+            osg::Vec3d((*static_cast<const osg::Vec3Array*>(_verts.get()))[i]);
+    }
+
+    void run(const Primitive& p, PrimitiveIntersectorFunctor& f) const
+    {
+        f._index = p._index;
+
+        if ( _double )
+        {
+            // real vertex references, so hits can report vertex indices.
+            const osg::Vec3dArray& v = *static_cast<const osg::Vec3dArray*>(_verts.get());
+            switch( p._numVerts )
+            {
+            case 1: f(v[p._v[0]], false); break;
+            case 2: f(v[p._v[0]], v[p._v[1]], false); break;
+            case 3: f(v[p._v[0]], v[p._v[1]], v[p._v[2]], false); break;
+            case 4: f(v[p._v[0]], v[p._v[1]], v[p._v[2]], v[p._v[3]], false); break;
+            }
+        }
+        else
+        {
+            osg::Vec3d v0 = vertex(p._v[0]), v1 = vertex(p._v[1]), v2 = vertex(p._v[2]), v3 = vertex(p._v[3]);
+            switch( p._numVerts )
+            {
+            case 1: f(v0, true); break;
+            case 2: f(v0, v1, true); break;
+            case 3: f(v0, v1, v2, true); break;
+            case 4: f(v0, v1, v2, v3, true); break;
+            }
+        }
+    }
+
+    void bounds(const Primitive& p, osg::Vec3d& out_min, osg::Vec3d& out_max) const
+    {
+        out_min = out_max = vertex(p._v[0]);
+        for( unsigned i = 1; i < p._numVerts; ++i )
+        {
+            osg::Vec3d v = vertex(p._v[i]);
+            out_min.set( osg::minimum(out_min.x(), v.x()), osg::minimum(out_min.y(), v.y()), osg::minimum(out_min.z(), v.z()) );
+            out_max.set( osg::maximum(out_max.x(), v.x()), osg::maximum(out_max.y(), v.y()), osg::maximum(out_max.z(), v.z()) );
+        }
+    }
+
+    struct LessCentroid
+    {
+        LessCentroid(const std::vector<osg::Vec3d>& centroids, int axis) : _centroids(centroids), _axis(axis) { }
+        bool operator()(const Primitive& lhs, const Primitive& rhs) const {
+            return _centroids[lhs._index][_axis] < _centroids[rhs._index][_axis];
+        }
+        const std::vector<osg::Vec3d>& _centroids;
+        int _axis;
+    };
+
+    void build()
+    {
+        std::vector<osg::Vec3d> mins( _prims.size() ), maxs( _prims.size() ), centroids( _prims.size() );
+        for( unsigned i = 0; i < _prims.size(); ++i )
+        {
+            bounds( _prims[i], mins[i], maxs[i] );
+            centroids[i] = (mins[i] + maxs[i]) * 0.5;
+        }
+
+        _nodes.reserve( 2 * (_prims.size() / BVH_LEAF_SIZE + 1) );
+        _nodes.push_back( Node() );
+
+        // (node, first, count)
+        struct Task { unsigned _node, _first, _count; };
+        std::vector<Task> tasks;
+        Task root = { 0, 0, (unsigned)_prims.size() };
+        tasks.push_back( root );
+
+        while( !tasks.empty() )
+        {
+            Task task = tasks.back();
+            tasks.pop_back();
+
+            // primitive indices are their original positions, so they look
+            // up the precomputed bounds.
+            osg::Vec3d bmin( DBL_MAX, DBL_MAX, DBL_MAX ), bmax( -DBL_MAX, -DBL_MAX, -DBL_MAX );
+            osg::Vec3d cmin = bmin, cmax = bmax;
+            for( unsigned i = task._first; i < task._first + task._count; ++i )
+            {
+                unsigned k = _prims[i]._index;
+                for( int a = 0; a < 3; ++a )
+                {
+                    bmin[a] = osg::minimum( bmin[a], mins[k][a] );
+                    bmax[a] = osg::maximum( bmax[a], maxs[k][a] );
+                    cmin[a] = osg::minimum( cmin[a], centroids[k][a] );
+                    cmax[a] = osg::maximum( cmax[a], centroids[k][a] );
+                }
+            }
+
+            _nodes[task._node]._min = bmin;
+            _nodes[task._node]._max = bmax;
+
+            osg::Vec3d extent = cmax - cmin;
+            int axis = extent.x() >= extent.y() && extent.x() >= extent.z() ? 0 : extent.y() >= extent.z() ? 1 : 2;
+
+            if ( task._count <= BVH_LEAF_SIZE || extent[axis] <= 0.0 )
+            {
+                _nodes[task._node]._first = task._first;
+                _nodes[task._node]._count = task._count;
+                continue;
+            }
+
+            // median split along the longest axis of the centroids.
+            unsigned half = task._count / 2;
+            std::nth_element(
+                _prims.begin() + task._first,
+                _prims.begin() + task._first + half,
+                _prims.begin() + task._first + task._count,
+                LessCentroid(centroids, axis) );
+
+            unsigned children = _nodes.size();
+            _nodes.push_back( Node() );
+            _nodes.push_back( Node() );
+            _nodes[task._node]._first = children;
+            _nodes[task._node]._count = 0;
+
+            Task lo = { children,   task._first,        half };
+            Task hi = { children+1, task._first + half, task._count - half };
+            tasks.push_back( lo );
+            tasks.push_back( hi );
+        }
+    }
+
+    // whether the segment s + d*[0,1] crosses the box (slab test).
+    static bool crosses(const osg::Vec3d& s, const osg::Vec3d& d, const osg::Vec3d& bmin, const osg::Vec3d& bmax)
+    {
+        double t0 = 0.0, t1 = 1.0;
+        for( int a = 0; a < 3; ++a )
+        {
+            if ( d[a] == 0.0 )
+            {
+                if ( s[a] < bmin[a] || s[a] > bmax[a] )
+                    return false;
+            }
+            else
+            {
+                double inv = 1.0 / d[a];
+                double ta = (bmin[a] - s[a]) * inv;
+                double tb = (bmax[a] - s[a]) * inv;
+                if ( ta > tb ) std::swap( ta, tb );
+                t0 = osg::maximum( t0, ta );
+                t1 = osg::minimum( t1, tb );
+                if ( t0 > t1 )
+                    return false;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * Process-wide cache of drawable BVHs. An entry is rebuilt when the
+ * drawable's vertices or primitive sets have been dirtied since it was
+ * built, and dropped once the drawable is gone.
+ */
+class PrimitiveBVHCache
+{
+public:
+    static PrimitiveBVHCache& instance()
+    {
+        static PrimitiveBVHCache s_cache;
+        return s_cache;
+    }
+
+    bool get(const osg::Drawable* drawable, osg::ref_ptr<const PrimitiveBVH>& out_bvh)
+    {
+        const osg::Geometry* geom = drawable->asGeometry();
+        if ( !geom || !geom->getVertexArray() )
+            return false;
+
+        unsigned signature = getSignature( geom );
+
+        Threading::ScopedMutexLock lock( _mutex );
+
+        Entry& entry = _entries[drawable];
+        osg::ref_ptr<const osg::Drawable> live;
+        if ( !entry._drawable.lock(live) || live.get() != drawable || entry._signature != signature )
+        {
+            entry._drawable  = drawable;
+            entry._signature = signature;
+            entry._bvh       = PrimitiveBVH::create( geom );
+
+            if ( _entries.size() > _pruneSize )
+                prune();
+        }
+
+        out_bvh = entry._bvh.get();
+        return out_bvh.valid();
+    }
+
+protected:
+    PrimitiveBVHCache() : _pruneSize( 1024 ) { }
+
+    struct Entry
+    {
+        Entry() : _signature( 0 ) { }
+        osg::observer_ptr<const osg::Drawable> _drawable;
+        unsigned                               _signature;
+        osg::ref_ptr<const PrimitiveBVH>       _bvh;
+    };
+    typedef std::map<const osg::Drawable*, Entry> Entries;
+
+    Entries          _entries;
+    unsigned         _pruneSize;
+    Threading::Mutex _mutex;
+
+    static unsigned getSignature(const osg::Geometry* geom)
+    {
+        const osg::Array* verts = geom->getVertexArray();
+        unsigned sig = verts->getModifiedCount() * 31u + verts->getNumElements();
+        sig = sig * 31u + (unsigned)(size_t)verts;
+
+        const osg::Geometry::PrimitiveSetList& psets = geom->getPrimitiveSetList();
+        sig = sig * 31u + psets.size();
+        for( unsigned i = 0; i < psets.size(); ++i )
+            sig = sig * 31u + psets[i]->getModifiedCount() + (unsigned)(size_t)psets[i].get();
+
+        return sig;
+    }
+
+    // drops the entries of deleted drawables; only runs again once the
+    // cache has doubled, so its cost is spread over many insertions.
+    void prune()
+    {
+        for( Entries::iterator i = _entries.begin(); i != _entries.end(); )
+        {
+            if ( !i->second._drawable.valid() )
+                _entries.erase( i++ );
+            else
+                ++i;
+        }
+        _pruneSize = osg::maximum( 1024u, 2u * (unsigned)_entries.size() );
+    }
+};
+
 } //namespace
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -386,7 +790,13 @@ void PrimitiveIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Draw
 
     ti.set(s,e,_thickness-_start);
     ti._limitOneIntersection = (_intersectionLimit == LIMIT_ONE_PER_DRAWABLE || _intersectionLimit == LIMIT_ONE);
-    drawable->accept(ti);
+
+    // large drawables only test the primitives whose boxes the segment crosses.
+    osg::ref_ptr<const PrimitiveBVH> bvh;
+    if ( PrimitiveBVHCache::instance().get(drawable, bvh) )
+        bvh->intersect(s, e, (_thickness - _start).length(), ti);
+    else
+        drawable->accept(ti);
 
     if (ti._hit)
     {
@@ -302,9 +302,11 @@ osg::Referenced( true )
 
     // make a profile sig (sans srs) and an srs sig for quick comparisons.
     ProfileOptions temp = toProfileOptions();
-    _fullSignature = Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
+    _fullSignatureHash = hashString( temp.getConfig().toJSON() );
+    _fullSignature = Stringify() << std::hex << _fullSignatureHash;
     temp.vsrsString() = "";
-    _horizSignature = Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
+    _horizSignatureHash = hashString( temp.getConfig().toJSON() );
+    _horizSignature = Stringify() << std::hex << _horizSignatureHash;
 }
 
 Profile::Profile(const SpatialReference* srs,
@@ -329,9 +331,11 @@ osg::Referenced( true )
 
     // make a profile sig (sans srs) and an srs sig for quick comparisons.
     ProfileOptions temp = toProfileOptions();
-    _fullSignature = Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
+    _fullSignatureHash = hashString( temp.getConfig().toJSON() );
+    _fullSignature = Stringify() << std::hex << _fullSignatureHash;
     temp.vsrsString() = "";
-    _horizSignature = Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
+    _horizSignatureHash = hashString( temp.getConfig().toJSON() );
+    _horizSignature = Stringify() << std::hex << _horizSignatureHash;
 }
 
 Profile::ProfileType
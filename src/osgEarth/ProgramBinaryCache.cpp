@@ -0,0 +1,260 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ProgramBinaryCache>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/StringUtils>
+#include <osg/GLExtensions>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+
+#define LC "[ProgramBinaryCache] "
+
+#define BINARY_EXTENSION "oepb"
+#define BINARY_MAGIC     "OEPB"
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    /** FNV-1a; paired with hashString() to make key collisions unlikely. */
+    unsigned fnvHash( const std::string& input )
+    {
+        unsigned h = 2166136261u;
+        for( std::string::const_iterator i = input.begin(); i != input.end(); ++i )
+        {
+            h ^= (unsigned char)*i;
+            h *= 16777619u;
+        }
+        return h;
+    }
+}
+
+//------------------------------------------------------------------------
+
+ProgramBinaryCache::ProgramBinaryCache( const std::string& path, bool preload ) :
+_path( path )
+{
+    if ( !osgDB::fileExists(_path) && !osgDB::makeDirectory(_path) )
+    {
+        OE_WARN << LC << "Cannot create folder " << _path << std::endl;
+        return;
+    }
+
+    if ( preload )
+    {
+        osgDB::DirectoryContents files = osgDB::getDirectoryContents( _path );
+        for( osgDB::DirectoryContents::const_iterator i = files.begin(); i != files.end(); ++i )
+        {
+            if ( osgDB::getLowerCaseFileExtension(*i) != BINARY_EXTENSION )
+                continue;
+
+            std::string key = osgDB::getNameLessExtension( *i );
+            osg::Program::ProgramBinary* binary = readBinary( key );
+            if ( binary )
+                _binaries[key] = binary;
+        }
+
+        OE_INFO << LC << "Preloaded " << _binaries.size() << " program binaries from " << _path << std::endl;
+    }
+}
+
+unsigned
+ProgramBinaryCache::getNumBinaries() const
+{
+    ScopedMutexLock lock( _mutex );
+    return _binaries.size();
+}
+
+std::string
+ProgramBinaryCache::getKey( const osg::Program* program ) const
+{
+    const Capabilities& caps = Registry::capabilities();
+
+    std::stringstream buf;
+    buf << caps.getVendor() << '\n' << caps.getRenderer() << '\n' << caps.getVersion() << '\n';
+
+    for( unsigned i = 0; i < program->getNumShaders(); ++i )
+    {
+        const osg::Shader* shader = program->getShader(i);
+        buf << (int)shader->getType() << '\n' << shader->getShaderSource() << '\n';
+    }
+
+    const osg::Program::AttribBindingList& abl = program->getAttribBindingList();
+    for( osg::Program::AttribBindingList::const_iterator i = abl.begin(); i != abl.end(); ++i )
+        buf << "a:" << i->first << '=' << i->second << '\n';
+
+    const osg::Program::FragDataBindingList& fbl = program->getFragDataBindingList();
+    for( osg::Program::FragDataBindingList::const_iterator i = fbl.begin(); i != fbl.end(); ++i )
+        buf << "f:" << i->first << '=' << i->second << '\n';
+
+    const osg::Program::UniformBlockBindingList& ubl = program->getUniformBlockBindingList();
+    for( osg::Program::UniformBlockBindingList::const_iterator i = ubl.begin(); i != ubl.end(); ++i )
+        buf << "u:" << i->first << '=' << i->second << '\n';
+
+    std::string text = buf.str();
+
+    std::stringstream key;
+    key << std::hex << std::setfill('0')
+        << std::setw(8) << hashString(text)
+        << std::setw(8) << fnvHash(text)
+        << '-' << text.size();
+    return key.str();
+}
+
+std::string
+ProgramBinaryCache::getFileName( const std::string& key ) const
+{
+    return osgDB::concatPaths( _path, key + "." + BINARY_EXTENSION );
+}
+
+osg::Program::ProgramBinary*
+ProgramBinaryCache::readBinary( const std::string& key ) const
+{
+    std::ifstream in( getFileName(key).c_str(), std::ios::binary );
+    if ( !in.is_open() )
+        return 0L;
+
+    char     magic[4];
+    unsigned format = 0, size = 0;
+    in.read( magic, 4 );
+    in.read( reinterpret_cast<char*>(&format), sizeof(format) );
+    in.read( reinterpret_cast<char*>(&size),   sizeof(size) );
+    if ( in.fail() || std::string(magic, 4) != BINARY_MAGIC || size == 0 )
+        return 0L;
+
+    osg::ref_ptr<osg::Program::ProgramBinary> binary = new osg::Program::ProgramBinary();
+    binary->allocate( size );
+    in.read( reinterpret_cast<char*>(binary->getData()), size );
+    if ( in.fail() )
+        return 0L;
+
+    binary->setFormat( (GLenum)format );
+    return binary.release();
+}
+
+bool
+ProgramBinaryCache::writeBinary( const std::string& key, const osg::Program::ProgramBinary* binary ) const
+{
+    std::ofstream out( getFileName(key).c_str(), std::ios::binary | std::ios::trunc );
+    if ( !out.is_open() )
+        return false;
+
+    unsigned format = (unsigned)binary->getFormat();
+    unsigned size   = binary->getSize();
+    out.write( BINARY_MAGIC, 4 );
+    out.write( reinterpret_cast<const char*>(&format), sizeof(format) );
+    out.write( reinterpret_cast<const char*>(&size),   sizeof(size) );
+    out.write( reinterpret_cast<const char*>(binary->getData()), size );
+    out.flush();
+    return !out.fail();
+}
+
+bool
+ProgramBinaryCache::setBinary( osg::Program* program )
+{
+    if ( !program )
+        return false;
+
+    std::string key = getKey( program );
+
+    osg::ref_ptr<osg::Program::ProgramBinary> binary;
+    {
+        ScopedMutexLock lock( _mutex );
+        _pending[program] = key;
+
+        if ( _failed.find(key) != _failed.end() )
+            return false;
+
+        BinaryMap::const_iterator i = _binaries.find( key );
+        if ( i != _binaries.end() )
+            binary = i->second.get();
+    }
+
+    if ( !binary.valid() )
+    {
+        binary = readBinary( key );
+        if ( !binary.valid() )
+            return false;
+
+        ScopedMutexLock lock( _mutex );
+        _binaries[key] = binary.get();
+    }
+
+    program->setProgramBinary( binary.get() );
+    return true;
+}
+
+void
+ProgramBinaryCache::update( osg::Program* program, osg::State& state )
+{
+    std::string key;
+    {
+        ScopedMutexLock lock( _mutex );
+        KeyMap::iterator i = _pending.find( program );
+        if ( i == _pending.end() )
+            return;
+        key = i->second;
+        _pending.erase( i );
+    }
+
+    unsigned contextID = state.getContextID();
+    osg::Program::PerContextProgram* pcp = program->getPCP( contextID );
+    bool linked = pcp && pcp->isLinked();
+
+    if ( program->getProgramBinary() )
+    {
+        if ( linked )
+            return;
+
+        // the driver rejected it; link from source from now on.
+        OE_INFO << LC << "Discarding program binary " << key << " for \"" << program->getName() << "\"" << std::endl;
+        {
+            ScopedMutexLock lock( _mutex );
+            _binaries.erase( key );
+            _failed.insert( key );
+        }
+        ::remove( getFileName(key).c_str() );
+
+        program->setProgramBinary( 0L );
+        program->dirtyProgram();
+        return;
+    }
+
+    if ( !linked || !osg::isGLExtensionOrVersionSupported(contextID, "GL_ARB_get_program_binary", 4.1f) )
+        return;
+
+    osg::ref_ptr<osg::Program::ProgramBinary> binary = program->compileProgramBinary( state );
+    if ( !binary.valid() || binary->getSize() == 0 )
+        return;
+
+    if ( writeBinary(key, binary.get()) )
+    {
+        ScopedMutexLock lock( _mutex );
+        _binaries[key] = binary.get();
+        OE_DEBUG << LC << "Stored program binary " << key << " for \"" << program->getName() << "\"" << std::endl;
+    }
+}
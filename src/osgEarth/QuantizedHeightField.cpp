@@ -0,0 +1,193 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/QuantizedHeightField>
+#include <osgEarth/GeoCommon>
+#include <osgDB/ObjectWrapper>
+#include <osgDB/Registry>
+
+using namespace osgEarth;
+
+// code reserved for NO_DATA_VALUE; valid heights use 0..MAX_CODE.
+#define NO_DATA_CODE 0xFFFFu
+#define MAX_CODE     0xFFFEu
+
+//------------------------------------------------------------------------
+
+QuantizedHeightField::QuantizedHeightField() :
+osg::Object  (),
+_numColumns  ( 0 ),
+_numRows     ( 0 ),
+_xInterval   ( 1.0f ),
+_yInterval   ( 1.0f ),
+_skirtHeight ( 0.0f ),
+_borderWidth ( 0 ),
+_offset      ( 0.0f ),
+_scale       ( 0.0f )
+{
+    //nop
+}
+
+QuantizedHeightField::QuantizedHeightField( const QuantizedHeightField& rhs, const osg::CopyOp& op ) :
+osg::Object  ( rhs, op ),
+_numColumns  ( rhs._numColumns ),
+_numRows     ( rhs._numRows ),
+_origin      ( rhs._origin ),
+_xInterval   ( rhs._xInterval ),
+_yInterval   ( rhs._yInterval ),
+_skirtHeight ( rhs._skirtHeight ),
+_borderWidth ( rhs._borderWidth ),
+_offset      ( rhs._offset ),
+_scale       ( rhs._scale ),
+_values      ( rhs._values )
+{
+    //nop
+}
+
+QuantizedHeightField*
+QuantizedHeightField::encode( const osg::HeightField* hf, float maxError )
+{
+    if ( !hf || hf->getNumColumns() == 0 || hf->getNumRows() == 0 )
+        return 0L;
+
+    const osg::HeightField::HeightList& heights = hf->getFloatArray()->asVector();
+
+    // find the range of the valid heights.
+    float minHeight = FLT_MAX, maxHeight = -FLT_MAX;
+    for( unsigned i = 0; i < heights.size(); ++i )
+    {
+        float h = heights[i];
+        if ( h != NO_DATA_VALUE )
+        {
+            if ( h < minHeight ) minHeight = h;
+            if ( h > maxHeight ) maxHeight = h;
+        }
+    }
+    if ( minHeight > maxHeight )
+        minHeight = maxHeight = 0.0f; // all NO_DATA
+
+    double scale = ((double)maxHeight - (double)minHeight) / (double)MAX_CODE;
+    if ( 0.5 * scale > (double)maxError )
+        return 0L;
+
+    QuantizedHeightField* q = new QuantizedHeightField();
+    q->_numColumns  = hf->getNumColumns();
+    q->_numRows     = hf->getNumRows();
+    q->_origin      = hf->getOrigin();
+    q->_xInterval   = hf->getXInterval();
+    q->_yInterval   = hf->getYInterval();
+    q->_skirtHeight = hf->getSkirtHeight();
+    q->_borderWidth = hf->getBorderWidth();
+    q->_offset      = minHeight;
+    q->_scale       = (float)scale;
+
+    // quantize and delta-code each row; neighboring posts are usually close,
+    // so most deltas are small and a compressor packs them tightly.
+    q->_values.resize( heights.size() * 2 );
+    char* out = &q->_values[0];
+    double invScale = scale > 0.0 ? 1.0/scale : 0.0;
+
+    for( unsigned r = 0; r < q->_numRows; ++r )
+    {
+        const float* row = &heights[r * q->_numColumns];
+        unsigned prev = 0;
+        for( unsigned c = 0; c < q->_numColumns; ++c )
+        {
+            unsigned code;
+            if ( row[c] == NO_DATA_VALUE )
+            {
+                code = NO_DATA_CODE;
+            }
+            else
+            {
+                code = (unsigned)(((double)row[c] - (double)minHeight) * invScale + 0.5);
+                if ( code > MAX_CODE ) code = MAX_CODE;
+            }
+
+            unsigned delta = (code - prev) & 0xFFFFu;
+            *out++ = (char)(delta & 0xFF);
+            *out++ = (char)(delta >> 8);
+            prev = code;
+        }
+    }
+
+    return q;
+}
+
+osg::HeightField*
+QuantizedHeightField::decode() const
+{
+    if ( _values.size() != (size_t)_numColumns * (size_t)_numRows * 2 )
+        return 0L;
+
+    osg::HeightField* hf = new osg::HeightField();
+    hf->allocate( _numColumns, _numRows );
+    hf->setOrigin( _origin );
+    hf->setXInterval( _xInterval );
+    hf->setYInterval( _yInterval );
+    hf->setSkirtHeight( _skirtHeight );
+    hf->setBorderWidth( _borderWidth );
+
+    if ( _numColumns == 0 || _numRows == 0 )
+        return hf;
+
+    osg::HeightField::HeightList& heights = hf->getFloatArray()->asVector();
+    const unsigned char* in = reinterpret_cast<const unsigned char*>( _values.data() );
+
+    for( unsigned r = 0; r < _numRows; ++r )
+    {
+        float* row = &heights[r * _numColumns];
+        unsigned prev = 0;
+        for( unsigned c = 0; c < _numColumns; ++c )
+        {
+            unsigned delta = (unsigned)in[0] | ((unsigned)in[1] << 8);
+            in += 2;
+
+            unsigned code = (prev + delta) & 0xFFFFu;
+            row[c] = code == NO_DATA_CODE ?
+                NO_DATA_VALUE :
+                (float)((double)_offset + (double)code * (double)_scale);
+            prev = code;
+        }
+    }
+
+    return hf;
+}
+
+//------------------------------------------------------------------------
+
+/**
+ * Registers QuantizedHeightField with OSG's serialization framework so that
+ * caches can store it in .osgb files like any other object.
+ */
+REGISTER_OBJECT_WRAPPER(QuantizedHeightField,
+                        new osgEarth::QuantizedHeightField,
+                        osgEarth::QuantizedHeightField,
+                        "osg::Object osgEarth::QuantizedHeightField")
+{
+    ADD_UINT_SERIALIZER  ( NumColumns,  0u );
+    ADD_UINT_SERIALIZER  ( NumRows,     0u );
+    ADD_VEC3_SERIALIZER  ( Origin,      osg::Vec3() );
+    ADD_FLOAT_SERIALIZER ( XInterval,   1.0f );
+    ADD_FLOAT_SERIALIZER ( YInterval,   1.0f );
+    ADD_FLOAT_SERIALIZER ( SkirtHeight, 0.0f );
+    ADD_UINT_SERIALIZER  ( BorderWidth, 0u );
+    ADD_FLOAT_SERIALIZER ( Offset,      0.0f );
+    ADD_FLOAT_SERIALIZER ( Scale,       0.0f );
+    ADD_STRING_SERIALIZER( Values,      "" );
+}
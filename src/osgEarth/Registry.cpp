@@ -21,11 +21,13 @@
 #include <osgEarth/Cube>
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/ShaderFactory>
+#include <osgEarth/ProgramBinaryCache>
 #include <osgEarth/TaskService>
 #include <osgEarth/IOTypes>
 #include <osgEarth/ColorFilter>
 #include <osgEarth/StateSetCache>
 #include <osgEarth/HTTPClient>
+#include <osgEarth/SpatialReference>
 #include <osgEarthDrivers/cache_filesystem/FileSystemCache>
 #include <osg/Notify>
 #include <osg/Version>
@@ -34,6 +36,7 @@
 #include <ogr_api.h>
 #include <stdlib.h>
 #include <locale>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
@@ -72,6 +75,13 @@ _terrainEngineDriver( "mp" )
     // thread pool for general use
     _taskServiceManager = new TaskServiceManager();
 
+    // let idle task threads borrow work from busy services
+    if ( ::getenv("OSGEARTH_TASK_WORK_STEALING") )
+    {
+        _taskServiceManager->setWorkStealing( true );
+        OE_INFO << LC << "Task work-stealing enabled from environment variable" << std::endl;
+    }
+
     // optimizes sharing of state attributes and state sets for
     // performance boost
     _stateSetCache = new StateSetCache();
@@ -132,6 +142,14 @@ _terrainEngineDriver( "mp" )
         OE_INFO << LC << "NO-CACHE MODE set from environment variable" << std::endl;
     }
 
+    // see if there's a shader program binary cache in the envvar
+    const char* binaryCachePath = ::getenv("OSGEARTH_PROGRAM_BINARY_CACHE_PATH");
+    if ( binaryCachePath )
+    {
+        _programBinaryCache = new ProgramBinaryCache( std::string(binaryCachePath) );
+        OE_INFO << LC << "PROGRAM BINARY CACHE PATH set from environment variable: \"" << binaryCachePath << "\"" << std::endl;
+    }
+
     const char* teStr = ::getenv("OSGEARTH_TERRAIN_ENGINE");
     if ( teStr )
     {
@@ -346,6 +364,18 @@ Registry::setCache( osgEarth::Cache* cache )
         cache->apply( _defaultOptions.get() );
 }
 
+ProgramBinaryCache*
+Registry::getProgramBinaryCache() const
+{
+    return _programBinaryCache.get();
+}
+
+void
+Registry::setProgramBinaryCache( ProgramBinaryCache* cache )
+{
+    _programBinaryCache = cache;
+}
+
 bool
 Registry::isBlacklisted(const std::string& filename)
 {
@@ -506,6 +536,59 @@ Registry::getStateSetCache() const
     return _stateSetCache.get();
 }
 
+namespace
+{
+    struct MemoryReporters
+    {
+        std::vector<MemoryReporter*> _reporters;
+        Threading::Mutex             _mutex;
+    };
+
+    MemoryReporters& getMemoryReporters()
+    {
+        // never destroyed, since reporters may outlive static destruction
+        static MemoryReporters* s_reporters = new MemoryReporters();
+        return *s_reporters;
+    }
+}
+
+void
+Registry::addMemoryReporter( MemoryReporter* reporter )
+{
+    if ( reporter )
+    {
+        MemoryReporters& r = getMemoryReporters();
+        Threading::ScopedMutexLock lock( r._mutex );
+        if ( std::find(r._reporters.begin(), r._reporters.end(), reporter) == r._reporters.end() )
+            r._reporters.push_back( reporter );
+    }
+}
+
+void
+Registry::removeMemoryReporter( MemoryReporter* reporter )
+{
+    MemoryReporters& r = getMemoryReporters();
+    Threading::ScopedMutexLock lock( r._mutex );
+    std::vector<MemoryReporter*>::iterator i = std::find(r._reporters.begin(), r._reporters.end(), reporter);
+    if ( i != r._reporters.end() )
+        r._reporters.erase( i );
+}
+
+void
+Registry::getMemoryUsage( MemoryUsageMap& out_usage ) const
+{
+    if ( _stateSetCache.valid() )
+        out_usage["stateset_cache"] += _stateSetCache->getSizeInBytes();
+
+    out_usage["srs_cache"] += SpatialReference::getCacheSizeInBytes();
+
+    // holding the lock keeps a reporter from going away while it reports.
+    MemoryReporters& r = getMemoryReporters();
+    Threading::ScopedMutexLock lock( r._mutex );
+    for( std::vector<MemoryReporter*>::const_iterator i = r._reporters.begin(); i != r._reporters.end(); ++i )
+        (*i)->getMemoryUsage( out_usage );
+}
+
 
 //Simple class used to add a file extension alias for the earth_tile to the earth plugin
 class RegisterEarthTileExtension
@@ -296,11 +296,13 @@ ShaderFactory::createColorFilterChainFragmentShader(const std::string&      func
         "#version " GLSL_VERSION_STR "\n"
         GLSL_DEFAULT_PRECISION_FLOAT "\n";
 
-    // write out the shader function prototypes:
+    // write out the shader function prototypes (constant filters are inlined):
+    std::string code;
     for( ColorFilterChain::const_iterator i = chain.begin(); i != chain.end(); ++i )
     {
         ColorFilter* filter = i->get();
-        buf << "void " << filter->getEntryPointFunctionName() << "(inout vec4 color);\n";
+        if ( !filter->isConstant() || !filter->getConstantCode(code) )
+            buf << "void " << filter->getEntryPointFunctionName() << "(inout vec4 color);\n";
     }
 
     // write out the main function:
@@ -311,7 +313,10 @@ ShaderFactory::createColorFilterChainFragmentShader(const std::string&      func
     for( ColorFilterChain::const_iterator i = chain.begin(); i != chain.end(); ++i )
     {
         ColorFilter* filter = i->get();
-        buf << INDENT << filter->getEntryPointFunctionName() << "(color);\n";
+        if ( filter->isConstant() && filter->getConstantCode(code) )
+            buf << INDENT << "{\n" << code << INDENT << "}\n";
+        else
+            buf << INDENT << filter->getEntryPointFunctionName() << "(color);\n";
     }
         
     buf << "} \n";
@@ -74,23 +74,26 @@ SparseTexture2DArray::apply( osg::State& state ) const
 
     if (textureObject && _textureDepth>0)
     {
-        const osg::Image* image = firstValidImage();
-        if (image && getModifiedCount(0, contextID) != image->getModifiedCount())
+        // The texture object only has to be re-specified if its size, format,
+        // mipmap count or depth changed. Modified slices are subloaded in place.
+        GLsizei new_width = _textureWidth, new_height = _textureHeight, new_numMipmapLevels = _numMipmapLevels;
+
+        int first = firstValidImageIndex();
+        const osg::Image* image = first >= 0 ? _images[first].get() : 0L;
+        if (image && (getModifiedCount(first, contextID) != image->getModifiedCount() || getTextureParameterDirty(contextID)))
         {
             // compute the internal texture format, this set the _internalFormat to an appropriate value.
             computeInternalFormat();
 
-            GLsizei new_width, new_height, new_numMipmapLevels;
-
             // compute the dimensions of the texture.
             computeRequiredTextureDimensions(state, *image, new_width, new_height, new_numMipmapLevels);
+        }
 
-            if (!textureObject->match(GL_TEXTURE_2D_ARRAY_EXT, new_numMipmapLevels, _internalFormat, new_width, new_height, 1, _borderWidth))
-            {
-                Texture::releaseTextureObject(contextID, _textureObjectBuffer[contextID].get());
-                _textureObjectBuffer[contextID] = 0;
-                textureObject = 0;
-            }
+        if (!textureObject->match(GL_TEXTURE_2D_ARRAY_EXT, new_numMipmapLevels, _internalFormat, new_width, new_height, _textureDepth, _borderWidth))
+        {
+            Texture::releaseTextureObject(contextID, _textureObjectBuffer[contextID].get());
+            _textureObjectBuffer[contextID] = 0;
+            textureObject = 0;
         }
     }
 
@@ -110,6 +113,9 @@ SparseTexture2DArray::apply( osg::State& state ) const
         //}
         //else
         {
+            const Texture::Extensions* texExtensions = Texture::getExtensions(contextID,true);
+            bool regenerateMipmaps = false;
+
             // for each image of the texture array do
             for (GLsizei n=0; n < _textureDepth; n++)
             {
@@ -121,8 +127,20 @@ SparseTexture2DArray::apply( osg::State& state ) const
                 {
                     applyTexImage2DArray_subload(state, image, _textureWidth, _textureHeight, n, _internalFormat, _numMipmapLevels);
                     getModifiedCount(n,contextID) = image->getModifiedCount();
+
+                    if ( _min_filter != LINEAR && _min_filter != NEAREST && !image->isMipmap() &&
+                         _useHardwareMipMapGeneration && texExtensions->isGenerateMipMapSupported() )
+                    {
+                        regenerateMipmaps = true;
+                    }
                 }
             }
+
+            // a slice subloaded without mipmaps only updated level 0.
+            if ( regenerateMipmaps )
+            {
+                generateMipmap( state );
+            }
         }
     }
 
@@ -27,11 +27,27 @@
 #include <ogr_api.h>
 #include <ogr_spatialref.h>
 #include <algorithm>
+#include <cstdlib>
 
 #define LC "[SpatialReference] "
 
 using namespace osgEarth;
 
+// Set OSGEARTH_SERIALIZE_TRANSFORMS to run all OGR coordinate transforms
+// under the global GDAL lock, for PROJ builds that are not thread safe.
+namespace
+{
+    bool s_serializeTransforms = ::getenv("OSGEARTH_SERIALIZE_TRANSFORMS") != 0L;
+
+    // serializes SRS creation and access to the SRS cache. A function
+    // static, since SRS objects may be created during static init.
+    Threading::Mutex& getCreateMutex()
+    {
+        static Threading::Mutex s_mutex;
+        return s_mutex;
+    }
+}
+
 // took this out, see issue #79
 //#define USE_CUSTOM_MERCATOR_TRANSFORM 1
 //#undef USE_CUSTOM_MERCATOR_TRANSFORM
@@ -94,18 +110,6 @@ namespace
         return true;
     }
 
-    void geodeticToECEF(std::vector<osg::Vec3d>& points, const osg::EllipsoidModel* em)
-    {
-        for( unsigned i=0; i<points.size(); ++i )
-        {
-            double x, y, z;
-            em->convertLatLongHeightToXYZ(
-                osg::DegreesToRadians( points[i].y() ), osg::DegreesToRadians( points[i].x() ), points[i].z(),
-                x, y, z );
-            points[i].set( x, y, z );
-        }
-    }
-
     void ECEFtoGeodetic(std::vector<osg::Vec3d>& points, const osg::EllipsoidModel* em)
     {
         for( unsigned i=0; i<points.size(); ++i )
@@ -129,6 +133,27 @@ SpatialReference::SRSCache& SpatialReference::getSRSCache()
     return s_cache;
 }
 
+double
+SpatialReference::getCacheSizeInBytes()
+{
+    Threading::ScopedMutexLock exclusive(getCreateMutex());
+
+    double total = 0.0;
+    const SRSCache& cache = getSRSCache();
+    for( SRSCache::const_iterator i = cache.begin(); i != cache.end(); ++i )
+    {
+        const SpatialReference* srs = i->second.get();
+        total += sizeof(SpatialReference) +
+            srs->_name.size() + srs->_wkt.size() + srs->_proj4.size() +
+            srs->_init_type.size() + srs->_datum.size();
+
+        Threading::ScopedReadLock shared( srs->_transformHandleCachesMutex );
+        for( ThreadTransformHandleCaches::const_iterator t = srs->_transformHandleCaches.begin(); t != srs->_transformHandleCaches.end(); ++t )
+            total += t->second.size() * sizeof(TransformHandle);
+    }
+    return total;
+}
+
 SpatialReference*
 SpatialReference::createFromPROJ4( const std::string& proj4, const std::string& name )
 {
@@ -203,8 +228,7 @@ SpatialReference*
 SpatialReference::create( const Key& key, bool useCache )
 {
     // serialized access to SRS creation.
-    static Threading::Mutex s_mutex;
-    Threading::ScopedMutexLock exclusive(s_mutex);
+    Threading::ScopedMutexLock exclusive(getCreateMutex());
 
     // first, check the SRS cache to see if it already exists:
     if ( useCache )
@@ -416,9 +440,13 @@ SpatialReference::~SpatialReference()
     {
         GDAL_SCOPED_LOCK;
 
-        for (TransformHandleCache::iterator itr = _transformHandleCache.begin(); itr != _transformHandleCache.end(); ++itr)
+        for (ThreadTransformHandleCaches::iterator t = _transformHandleCaches.begin(); t != _transformHandleCaches.end(); ++t)
         {
-            OCTDestroyCoordinateTransformation(itr->second);
+            for (TransformHandleCache::iterator itr = t->second.begin(); itr != t->second.end(); ++itr)
+            {
+                if ( itr->second._handle )
+                    OCTDestroyCoordinateTransformation(itr->second._handle);
+            }
         }
 
         if ( _owns_handle )
@@ -1034,7 +1062,7 @@ SpatialReference::transform(std::vector<osg::Vec3d>& points,
     {
         const SpatialReference* outputGeoSRS = outputSRS->getGeodeticSRS();
         success = transform(points, outputGeoSRS);
-        geodeticToECEF(points, outputGeoSRS->getEllipsoid());
+        ECEF::geodeticToECEF(points, outputGeoSRS->getEllipsoid());
         return success;
     }
 
@@ -1114,28 +1142,59 @@ SpatialReference::transform2D(double x, double y,
 }
 
 
+void*
+SpatialReference::getTransformHandle(const SpatialReference* out_srs) const
+{
+    unsigned threadId = Threading::getCurrentThreadId();
+
+    // find this thread's handle cache. Only this thread ever touches its own
+    // cache, so after the lookup no lock is needed.
+    TransformHandleCache* cache = 0L;
+    {
+        Threading::ScopedReadLock sharedLock( _transformHandleCachesMutex );
+        ThreadTransformHandleCaches::iterator t = _transformHandleCaches.find( threadId );
+        if ( t != _transformHandleCaches.end() )
+            cache = &t->second;
+    }
+    if ( !cache )
+    {
+        Threading::ScopedWriteLock exclusiveLock( _transformHandleCachesMutex );
+        cache = &_transformHandleCaches[threadId];
+    }
+
+    TransformHandleCache::iterator itr = cache->find( out_srs );
+    if ( itr != cache->end() )
+    {
+        // make sure the target wasn't deleted and replaced by a new SRS at the same address.
+        if ( itr->second._target.valid() && itr->second._target.get() == out_srs )
+            return itr->second._handle;
+
+        GDAL_SCOPED_LOCK;
+        if ( itr->second._handle )
+            OCTDestroyCoordinateTransformation( itr->second._handle );
+        cache->erase( itr );
+    }
+
+    OE_DEBUG << LC << "allocating new OCT Transform" << std::endl;
+
+    TransformHandle& entry = (*cache)[out_srs];
+    entry._target = out_srs;
+    {
+        // creating a transformation reads the shared OSR handles; not thread safe.
+        GDAL_SCOPED_LOCK;
+        entry._handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle );
+    }
+    return entry._handle;
+}
+
+
 bool
 SpatialReference::transformXYPointArrays(double*  x,
                                          double*  y,
                                          unsigned count,
                                          const SpatialReference* out_srs) const
 {  
-    // Transform the X and Y values inside an exclusive GDAL/OGR lock
-    GDAL_SCOPED_LOCK;
-
-    void* xform_handle = NULL;
-    TransformHandleCache::const_iterator itr = _transformHandleCache.find(out_srs->getWKT());
-    if (itr != _transformHandleCache.end())
-    {
-        //OE_DEBUG << LC << "using cached transform handle" << std::endl;
-        xform_handle = itr->second;
-    }
-    else
-    {
-        OE_DEBUG << LC << "allocating new OCT Transform" << std::endl;
-        xform_handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle);
-        const_cast<SpatialReference*>(this)->_transformHandleCache[out_srs->getWKT()] = xform_handle;
-    }
+    void* xform_handle = getTransformHandle( out_srs );
 
     if ( !xform_handle )
     {
@@ -1146,6 +1205,14 @@ SpatialReference::transformXYPointArrays(double*  x,
         return false;
     }
 
+    // The handle belongs to this thread, so the transform itself needs no lock
+    // unless the user asked for serialized transforms.
+    if ( s_serializeTransforms )
+    {
+        GDAL_SCOPED_LOCK;
+        return OCTTransform( xform_handle, count, x, y, 0L ) > 0;
+    }
+
     return OCTTransform( xform_handle, count, x, y, 0L ) > 0;
 }
 
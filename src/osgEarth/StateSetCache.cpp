@@ -17,9 +17,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/StateSetCache>
+#include <osgEarth/MemoryUsage>
 #include <osg/NodeVisitor>
 #include <osg/Geode>
 #include <osg/BufferIndexBinding>
+#include <osg/Material>
+#include <osg/LineWidth>
+#include <osg/LineStipple>
+#include <osg/PolygonOffset>
+#include <osg/Depth>
+#include <osg/BlendFunc>
+#include <osg/CullFace>
+#include <cstring>
 
 #define LC "[StateSetCache] "
 
@@ -29,6 +38,41 @@ using namespace osgEarth;
 
 namespace
 {
+    inline void mix( unsigned& h, unsigned value )
+    {
+        h ^= value + 0x9e3779b9u + (h << 6) + (h >> 2);
+    }
+
+    inline void mix( unsigned& h, float value )
+    {
+        value += 0.0f; // -0 compares equal to +0, so hash it alike
+        unsigned bits;
+        ::memcpy( &bits, &value, sizeof(bits) );
+        mix( h, bits );
+    }
+
+    inline void mix( unsigned& h, const osg::Vec4& value )
+    {
+        mix( h, value.r() ); mix( h, value.g() ); mix( h, value.b() ); mix( h, value.a() );
+    }
+
+    inline void mix( unsigned& h, const char* str )
+    {
+        for( ; str && *str; ++str )
+        {
+            h ^= (unsigned char)*str;
+            h *= 16777619u;
+        }
+    }
+
+    void mixModes( unsigned& h, const osg::StateSet::ModeList& modes )
+    {
+        for( osg::StateSet::ModeList::const_iterator i = modes.begin(); i != modes.end(); ++i )
+        {
+            mix( h, (unsigned)i->first );
+            mix( h, (unsigned)i->second );
+        }
+    }
     /**
      * Visitor that calls StateSetCache::share on all attributes found
      * in a scene graph.
@@ -225,47 +269,141 @@ StateSetCache::eligible(osg::StateAttribute* attr) const
 }
 
 
+unsigned
+StateSetCache::hash( const osg::StateAttribute* attr )
+{
+    unsigned h = 2166136261u;
+    mix( h, attr->className() );
+    mix( h, (unsigned)attr->getType() );
+    mix( h, attr->getMember() );
+
+    // a few parameters of common attributes, so that the many instances of
+    // one type don't all land in the same shard.
+    if ( const osg::Material* m = dynamic_cast<const osg::Material*>(attr) )
+    {
+        mix( h, (unsigned)m->getColorMode() );
+        mix( h, m->getDiffuse(osg::Material::FRONT) );
+        mix( h, m->getAmbient(osg::Material::FRONT) );
+        mix( h, m->getEmission(osg::Material::FRONT) );
+    }
+    else if ( const osg::LineWidth* lw = dynamic_cast<const osg::LineWidth*>(attr) )
+    {
+        mix( h, lw->getWidth() );
+    }
+    else if ( const osg::LineStipple* ls = dynamic_cast<const osg::LineStipple*>(attr) )
+    {
+        mix( h, (unsigned)ls->getFactor() );
+        mix( h, (unsigned)ls->getPattern() );
+    }
+    else if ( const osg::PolygonOffset* po = dynamic_cast<const osg::PolygonOffset*>(attr) )
+    {
+        mix( h, po->getFactor() );
+        mix( h, po->getUnits() );
+    }
+    else if ( const osg::Depth* d = dynamic_cast<const osg::Depth*>(attr) )
+    {
+        mix( h, (unsigned)d->getFunction() );
+        mix( h, (unsigned)d->getWriteMask() );
+    }
+    else if ( const osg::BlendFunc* bf = dynamic_cast<const osg::BlendFunc*>(attr) )
+    {
+        mix( h, (unsigned)bf->getSource() );
+        mix( h, (unsigned)bf->getDestination() );
+    }
+    else if ( const osg::CullFace* cf = dynamic_cast<const osg::CullFace*>(attr) )
+    {
+        mix( h, (unsigned)cf->getMode() );
+    }
+
+    return h;
+}
+
+
+unsigned
+StateSetCache::hash( const osg::StateSet* stateSet )
+{
+    unsigned h = 2166136261u;
+
+    mixModes( h, stateSet->getModeList() );
+
+    const osg::StateSet::AttributeList& attrs = stateSet->getAttributeList();
+    for( osg::StateSet::AttributeList::const_iterator i = attrs.begin(); i != attrs.end(); ++i )
+    {
+        mix( h, (unsigned)i->second.second );
+        if ( i->second.first.valid() )
+            mix( h, hash(i->second.first.get()) );
+    }
+
+    const osg::StateSet::TextureModeList& texModes = stateSet->getTextureModeList();
+    for( unsigned unit = 0; unit < texModes.size(); ++unit )
+    {
+        mix( h, unit );
+        mixModes( h, texModes[unit] );
+    }
+
+    const osg::StateSet::TextureAttributeList& texAttrs = stateSet->getTextureAttributeList();
+    for( unsigned unit = 0; unit < texAttrs.size(); ++unit )
+    {
+        mix( h, unit );
+        for( osg::StateSet::AttributeList::const_iterator i = texAttrs[unit].begin(); i != texAttrs[unit].end(); ++i )
+        {
+            mix( h, (unsigned)i->second.second );
+            if ( i->second.first.valid() )
+                mix( h, hash(i->second.first.get()) );
+        }
+    }
+
+    const osg::StateSet::UniformList& uniforms = stateSet->getUniformList();
+    for( osg::StateSet::UniformList::const_iterator i = uniforms.begin(); i != uniforms.end(); ++i )
+    {
+        mix( h, i->first.c_str() );
+    }
+
+    return h;
+}
+
+
 bool
 StateSetCache::share(osg::ref_ptr<osg::StateSet>& input,
                      osg::ref_ptr<osg::StateSet>& output,
                      bool                         checkEligible)
 {
-    bool shared     = false;
-    bool shareattrs = true;
-
     if ( !checkEligible || eligible(input.get()) )
     {
-        Threading::ScopedMutexLock lock( _mutex );
-        shareattrs = false;
+        // share the attributes first. Once the stateset is in the cache, other
+        // threads may compare against it at any time, so it must not change.
+        // (Sharing equivalent attributes doesn't change how it compares.)
+        ShareStateAttributes sa(this);
+        sa.applyStateSet( input.get() );
 
-        std::pair<StateSetSet::iterator,bool> result = _stateSetCache.insert( input );
+        ++_stateSetQueries;
+
+        Shard& shard = _shards[ hash(input.get()) % NUM_SHARDS ];
+        Threading::ScopedMutexLock lock( shard._mutex );
+
+        std::pair<StateSetSet::iterator,bool> result = shard._stateSets.insert( input );
         if ( result.second )
         {
             // first use
             output = input.get();
-            shareattrs = true;
-            shared = false;
+            return false;
         }
         else
         {
             // found a share!
             output = result.first->get();
-            shared = true;
+            ++_stateSetShares;
+            return true;
         }
     }
     else
     {
         output = input.get();
-        shared = false;
-    }
 
-    if ( shareattrs )
-    {
         ShareStateAttributes sa(this);
         sa.applyStateSet( input.get() );
+        return false;
     }
-
-    return shared;
 }
 
 
@@ -277,9 +415,12 @@ StateSetCache::share(osg::ref_ptr<osg::StateAttribute>& input,
 {
     if ( !checkEligible || eligible(input.get()) )
     {
-        Threading::ScopedMutexLock lock( _mutex );
+        ++_attributeQueries;
 
-        std::pair<StateAttributeSet::iterator,bool> result = _stateAttributeCache.insert( input );
+        Shard& shard = _shards[ hash(input.get()) % NUM_SHARDS ];
+        Threading::ScopedMutexLock lock( shard._mutex );
+
+        std::pair<StateAttributeSet::iterator,bool> result = shard._attributes.insert( input );
         if ( result.second )
         {
             // first use
@@ -290,6 +431,7 @@ StateSetCache::share(osg::ref_ptr<osg::StateAttribute>& input,
         {
             // found a share!
             output = result.first->get();
+            ++_attributeShares;
             return true;
         }
     }
@@ -301,11 +443,63 @@ StateSetCache::share(osg::ref_ptr<osg::StateAttribute>& input,
 }
 
 
+unsigned
+StateSetCache::size() const
+{
+    unsigned total = 0;
+    for( unsigned i = 0; i < NUM_SHARDS; ++i )
+    {
+        Threading::ScopedMutexLock lock( _shards[i]._mutex );
+        total += _shards[i]._stateSets.size();
+    }
+    return total;
+}
+
+
+double
+StateSetCache::getSizeInBytes() const
+{
+    MemoryCounter counter;
+    for( unsigned i = 0; i < NUM_SHARDS; ++i )
+    {
+        Threading::ScopedMutexLock lock( _shards[i]._mutex );
+        for( StateSetSet::const_iterator s = _shards[i]._stateSets.begin(); s != _shards[i]._stateSets.end(); ++s )
+            counter.add( s->get() );
+        for( StateAttributeSet::const_iterator a = _shards[i]._attributes.begin(); a != _shards[i]._attributes.end(); ++a )
+            counter.add( a->get() );
+    }
+    return counter.getBytes();
+}
+
+
+StateSetCache::Stats
+StateSetCache::getStats() const
+{
+    Stats stats;
+    stats._stateSets  = 0;
+    stats._attributes = 0;
+    for( unsigned i = 0; i < NUM_SHARDS; ++i )
+    {
+        Threading::ScopedMutexLock lock( _shards[i]._mutex );
+        stats._stateSets  += _shards[i]._stateSets.size();
+        stats._attributes += _shards[i]._attributes.size();
+    }
+
+    stats._stateSetQueries  = _stateSetQueries;
+    stats._stateSetShares   = _stateSetShares;
+    stats._attributeQueries = _attributeQueries;
+    stats._attributeShares  = _attributeShares;
+    return stats;
+}
+
+
 void
 StateSetCache::clear()
 {
-    Threading::ScopedMutexLock lock( _mutex );
-
-    _stateAttributeCache.clear();
-    _stateSetCache.clear();
+    for( unsigned i = 0; i < NUM_SHARDS; ++i )
+    {
+        Threading::ScopedMutexLock lock( _shards[i]._mutex );
+        _shards[i]._attributes.clear();
+        _shards[i]._stateSets.clear();
+    }
 }
@@ -17,8 +17,10 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/TaskService>
+#include <osgEarth/TraceRecorder>
 #include <osg/Notify>
 #include <osg/Math>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -30,7 +32,9 @@ using namespace OpenThreads;
 TaskRequest::TaskRequest( float priority ) :
 osg::Referenced( true ),
 _priority( priority ),
-_state( STATE_IDLE )
+_state( STATE_IDLE ),
+_stamp( 0 ),
+_completedEvent( 0L )
 {
     _progress = new ProgressCallback();
 }
@@ -43,6 +47,9 @@ TaskRequest::run()
         _startTime = osg::Timer::instance()->tick();
         (*this)( _progress.get() );        
         _endTime = osg::Timer::instance()->tick();
+
+        if ( TraceRecorder::isEnabled() )
+            TraceRecorder::instance()->record( _name.empty() ? "task" : _name, "task", _startTime, _endTime );
     }
     else
     {
@@ -65,24 +72,82 @@ TaskRequest::wasCanceled() const
 
 //------------------------------------------------------------------------
 
-TaskRequestQueue::TaskRequestQueue() :
+TaskRequestQueue::TaskRequestQueue( unsigned numShards ) :
 osg::Referenced( true ),
-_done( false )
+_done( false ),
+_stamp( 0 )
+{
+    numShards = osg::maximum( numShards, 1u );
+    for( unsigned i=0; i<numShards; ++i )
+        _shards.push_back( new Shard() );
+}
+
+TaskRequestQueue::~TaskRequestQueue()
 {
+    for( unsigned i=0; i<_shards.size(); ++i )
+        delete _shards[i];
 }
 
 void
 TaskRequestQueue::clear()
 {
-    ScopedLock<Mutex> lock(_mutex);
-    _requests.clear();
+    for( unsigned i=0; i<_shards.size(); ++i )
+    {
+        ScopedLock<Mutex> lock( _shards[i]->_mutex );
+        for( unsigned n = _shards[i]->_requests.size(); n > 0; --n )
+            --_numPending;
+        _shards[i]->_requests.clear();
+        _shards[i]->_stamps.clear();
+        _shards[i]->_index.clear();
+    }
 }
 
 unsigned int
 TaskRequestQueue::getNumRequests() const
 {
-    ScopedLock<Mutex> lock(const_cast<TaskRequestQueue*>(this)->_mutex);
-    return _requests.size();
+    unsigned int total = 0;
+    for( unsigned i=0; i<_shards.size(); ++i )
+    {
+        ScopedLock<Mutex> lock( _shards[i]->_mutex );
+        total += _shards[i]->_requests.size();
+    }
+    return total;
+}
+
+void
+TaskRequestQueue::insert( Shard& shard, TaskRequest* request )
+{
+    // a request that is re-added while still queued just moves.
+    RequestIndex::iterator existing = shard._index.find( request );
+    if ( existing != shard._index.end() )
+        erase( shard, existing );
+
+    // insert by priority.
+    Entry entry;
+    entry._priority = shard._requests.insert( std::pair<float,osg::ref_ptr<TaskRequest> >(request->getPriority(), request) );
+    entry._stamp    = shard._stamps.insert( std::pair<int,TaskRequest*>(request->getStamp(), request) );
+    shard._index[request] = entry;
+    ++_numPending;
+}
+
+void
+TaskRequestQueue::erase( Shard& shard, RequestIndex::iterator i )
+{
+    shard._stamps.erase( i->second._stamp );
+    shard._requests.erase( i->second._priority ); // may release the request
+    shard._index.erase( i );
+    --_numPending;
+}
+
+TaskRequest*
+TaskRequestQueue::popFront( Shard& shard )
+{
+    if ( shard._requests.empty() )
+        return 0L;
+
+    osg::ref_ptr<TaskRequest> next = shard._requests.begin()->second.get();
+    erase( shard, shard._index.find(next.get()) );
+    return next.release();
 }
 
 void 
@@ -94,58 +159,179 @@ TaskRequestQueue::add( TaskRequest* request )
     if ( !request->getProgressCallback() )
         request->setProgressCallback( new ProgressCallback() );
 
-    ScopedLock<Mutex> lock(_mutex);
+    // spread the requests across the shards (only one in normal mode).
+    Shard& shard = _shards.size() == 1 ? *_shards[0] : *_shards[(++_nextShard) % _shards.size()];
+    {
+        ScopedLock<Mutex> lock( shard._mutex );
+        insert( shard, request );
+    }
 
-    // insert by priority.
-    _requests.insert( std::pair<float,TaskRequest*>(request->getPriority(), request) );
+    // since there is data in the queue, wake up one waiting task thread.
+    ScopedLock<Mutex> lock( _mutex );
+    _cond.signal();
+}
 
-#if 0
-    // insert by priority.
-    bool inserted = false;
-    for( TaskRequestList::iterator i = _requests.begin(); i != _requests.end(); i++ )
+bool
+TaskRequestQueue::reprioritize( TaskRequest* request, float priority )
+{
+    if ( !request )
+        return false;
+
+    for( unsigned s=0; s<_shards.size(); ++s )
     {
-        if ( request->getPriority() > i->get()->getPriority() )
+        Shard& shard = *_shards[s];
+        ScopedLock<Mutex> lock( shard._mutex );
+
+        RequestIndex::iterator i = shard._index.find( request );
+        if ( i != shard._index.end() )
         {
-            _requests.insert( i, request );
-            inserted = true;
-            //OE_NOTICE << "TaskRequestQueue size=" << _requests.size() << std::endl;
-            break;
+            // hold a ref so the request survives its removal from the map.
+            osg::ref_ptr<TaskRequest> hold = request;
+            shard._requests.erase( i->second._priority );
+            request->setPriority( priority );
+            i->second._priority = shard._requests.insert(
+                std::pair<float,osg::ref_ptr<TaskRequest> >(priority, request) );
+            return true;
         }
     }
 
-    if ( !inserted )
-        _requests.push_back( request );
-#endif
+    request->setPriority( priority );
+    return false;
+}
 
-    // since there is data in the queue, wake up one waiting task thread.
-    _cond.signal();
+unsigned
+TaskRequestQueue::cancelOlderThan( int stamp )
+{
+    TaskRequestVector canceled;
+
+    for( unsigned s=0; s<_shards.size(); ++s )
+    {
+        Shard& shard = *_shards[s];
+        ScopedLock<Mutex> lock( shard._mutex );
+
+        // The stamp index is keyed by the stamp each request had when it was
+        // queued. Callers may since have refreshed it with setStamp(), so check
+        // the live value and re-key anything that turns out to be current.
+        StampIndex::iterator i = shard._stamps.begin();
+        while( i != shard._stamps.end() && i->first < stamp )
+        {
+            TaskRequest* request = i->second;
+            RequestIndex::iterator r = shard._index.find( request );
+
+            if ( request->getStamp() < stamp )
+            {
+                canceled.push_back( request );
+                ++i;
+                erase( shard, r );
+            }
+            else
+            {
+                shard._stamps.erase( i++ );
+                r->second._stamp = shard._stamps.insert( std::pair<int,TaskRequest*>(request->getStamp(), request) );
+            }
+        }
+    }
+
+    // complete the canceled requests outside the locks, exactly the way
+    // a TaskThread would discard them:
+    for( TaskRequestVector::iterator i = canceled.begin(); i != canceled.end(); ++i )
+    {
+        TaskRequest* request = i->get();
+        request->cancel();
+        request->setState( TaskRequest::STATE_COMPLETED );
+        if ( request->getProgressCallback() )
+            request->getProgressCallback()->onCompleted();
+    }
+
+    return canceled.size();
+}
+
+TaskRequest*
+TaskRequestQueue::popFrom( Shard& shard )
+{
+    ScopedLock<Mutex> lock( shard._mutex );
+    return popFront( shard );
+}
+
+TaskRequest*
+TaskRequestQueue::tryPopFrom( Shard& shard )
+{
+    // don't wait on a shard that another thread is already working on.
+    if ( shard._mutex.trylock() != 0 )
+        return 0L;
+
+    TaskRequest* next = popFront( shard );
+    shard._mutex.unlock();
+    return next;
 }
 
 TaskRequest* 
-TaskRequestQueue::get()
+TaskRequestQueue::get( unsigned shardIndex )
 {
-    ScopedLock<Mutex> lock(_mutex);
+    unsigned numShards = _shards.size();
 
-    while ( !_done && _requests.empty() )
+    if ( numShards == 1 )
     {
-        // releases the mutex and waits on the condition.
-        _cond.wait( &_mutex );
+        for( ; ; )
+        {
+            if ( _done )
+                return 0L;
+
+            TaskRequest* next = popFrom( *_shards[0] );
+            if ( next )
+            {
+                // I'm done, someone else take a turn:
+                // (technically this shouldn't be necessary since add() bumps the semaphore once
+                // for each request in the queue)
+                ScopedLock<Mutex> lock( _mutex );
+                _cond.signal();
+                return next;
+            }
+
+            ScopedLock<Mutex> lock( _mutex );
+            while ( !_done && _numPending == 0 )
+            {
+                // releases the mutex and waits on the condition.
+                _cond.wait( &_mutex );
+            }
+        }
     }
 
+    // work-stealing mode: own shard first, then the others.
     if ( _done )
-    {
         return 0L;
+
+    shardIndex = shardIndex % numShards;
+    TaskRequest* next = popFrom( *_shards[shardIndex] );
+    for( unsigned i=1; next == 0L && i<numShards; ++i )
+        next = tryPopFrom( *_shards[(shardIndex+i) % numShards] );
+
+    if ( !next )
+    {
+        // nothing local; nap briefly so the caller can go look for work elsewhere.
+        ScopedLock<Mutex> lock( _mutex );
+        if ( !_done && _numPending == 0 )
+            _cond.wait( &_mutex, 10 );
     }
 
-    osg::ref_ptr<TaskRequest> next = _requests.begin()->second.get(); //_requests.front();
-    _requests.erase( _requests.begin() ); //_requests.pop_front();
+    return next;
+}
 
-    // I'm done, someone else take a turn:
-    // (technically this shouldn't be necessary since add() bumps the semaphore once
-    // for each request in the queue)
-    _cond.signal();
+TaskRequest*
+TaskRequestQueue::steal()
+{
+    if ( _done || _numPending == 0 )
+        return 0L;
 
-    return next.release();
+    unsigned numShards = _shards.size();
+    unsigned start = _nextShard;
+    for( unsigned i=0; i<numShards; ++i )
+    {
+        TaskRequest* next = tryPopFrom( *_shards[(start+i) % numShards] );
+        if ( next )
+            return next;
+    }
+    return 0L;
 }
 
 void
@@ -166,8 +352,62 @@ TaskRequestQueue::setDone()
 
 //------------------------------------------------------------------------
 
-TaskThread::TaskThread( TaskRequestQueue* queue ) :
+TaskStealGroup::TaskStealGroup() :
+osg::Referenced( true )
+{
+    //nop
+}
+
+void
+TaskStealGroup::addQueue( TaskRequestQueue* queue )
+{
+    Threading::ScopedWriteLock exclusive( _queuesMutex );
+    if ( queue && std::find(_queues.begin(), _queues.end(), queue) == _queues.end() )
+        _queues.push_back( queue );
+}
+
+void
+TaskStealGroup::removeQueue( TaskRequestQueue* queue )
+{
+    Threading::ScopedWriteLock exclusive( _queuesMutex );
+    std::vector<TaskRequestQueue*>::iterator i = std::find(_queues.begin(), _queues.end(), queue);
+    if ( i != _queues.end() )
+        _queues.erase( i );
+}
+
+TaskRequest*
+TaskStealGroup::steal( TaskRequestQueue* thief )
+{
+    Threading::ScopedReadLock shared( _queuesMutex );
+
+    unsigned numQueues = _queues.size();
+    if ( numQueues < 2 )
+        return 0L;
+
+    // rotate the starting victim so no one service gets picked on.
+    unsigned start = ++_nextVictim;
+    for( unsigned i=0; i<numQueues; ++i )
+    {
+        TaskRequestQueue* victim = _queues[(start+i) % numQueues];
+        if ( victim != thief )
+        {
+            TaskRequest* loot = victim->steal();
+            if ( loot )
+            {
+                ++_numStolen;
+                return loot;
+            }
+        }
+    }
+    return 0L;
+}
+
+//------------------------------------------------------------------------
+
+TaskThread::TaskThread( TaskRequestQueue* queue, unsigned shard, TaskStealGroup* group ) :
 _queue( queue ),
+_group( group ),
+_shard( shard ),
 _done( false )
 {
     //nop
@@ -178,11 +418,17 @@ TaskThread::run()
 {
     while( !_done )
     {
-        _request = _queue->get();
+        _request = _queue->get( _shard );
 
         if ( _done )
             break;
 
+        // our own queue is dry; see if another service could use a hand.
+        if ( !_request.valid() && _group.valid() )
+        {
+            _request = _group->steal( _queue.get() );
+        }
+
         if (_request.valid())
         { 
             // discard a completed or canceled request:
@@ -215,6 +461,12 @@ TaskThread::run()
             // Release the request
             _request = 0;
         }
+
+        // a NULL request from a finished queue means it's time to go.
+        else if ( _queue->isDone() )
+        {
+            break;
+        }
     }
 }
 
@@ -244,12 +496,30 @@ TaskService::TaskService( const std::string& name, int numThreads ):
 osg::Referenced( true ),
 _lastRemoveFinishedThreadsStamp(0),
 _name(name),
-_numThreads( 0 )
+_numThreads( 0 ),
+_nextShard( 0 )
 {
     _queue = new TaskRequestQueue();
     setNumThreads( numThreads );
 }
 
+TaskService::TaskService( const std::string& name, int numThreads, TaskStealGroup* group ):
+osg::Referenced( true ),
+_lastRemoveFinishedThreadsStamp(0),
+_name(name),
+_numThreads( 0 ),
+_nextShard( 0 ),
+_group( group )
+{
+    // one shard per core so that the owner threads rarely contend, no matter
+    // how many threads the manager ends up allocating to this service.
+    unsigned numShards = group ? osg::maximum( numThreads, OpenThreads::GetNumberOfProcessors() ) : 1;
+    _queue = new TaskRequestQueue( numShards );
+    if ( _group.valid() )
+        _group->addQueue( _queue.get() );
+    setNumThreads( numThreads );
+}
+
 unsigned int
 TaskService::getNumRequests() const
 {
@@ -263,8 +533,23 @@ TaskService::add( TaskRequest* request )
     _queue->add( request );
 }
 
+bool
+TaskService::reprioritize( TaskRequest* request, float priority )
+{
+    return _queue->reprioritize( request, priority );
+}
+
+unsigned
+TaskService::cancelOlderThan( int stamp )
+{
+    return _queue->cancelOlderThan( stamp );
+}
+
 TaskService::~TaskService()
 {
+    if ( _group.valid() )
+        _group->removeQueue( _queue.get() );
+
     _queue->setDone();
 
     for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
@@ -331,7 +616,7 @@ TaskService::adjustThreadCount()
         //We need to add some threads
         for (int i = 0; i < diff; ++i)
         {
-            TaskThread* thread = new TaskThread( _queue.get() );
+            TaskThread* thread = new TaskThread( _queue.get(), _nextShard++, _group.get() );
             _threads.push_back( thread );
             thread->start();
         }       
@@ -384,9 +669,10 @@ TaskService::removeFinishedThreads()
 
 TaskServiceManager::TaskServiceManager( int numThreads ) :
 _numThreads( 0 ),
-_targetNumThreads( numThreads )
+_targetNumThreads( numThreads ),
+_workStealing( false )
 {
-    //nop
+    _stealGroup = new TaskStealGroup();
 }
 
 void
@@ -412,7 +698,9 @@ TaskServiceManager::add( UID uid, float weight )
     }
     else
     {
-        TaskService* newService = new TaskService( "", 1 );
+        TaskService* newService = _workStealing ?
+            new TaskService( "", 1, _stealGroup.get() ) :
+            new TaskService( "", 1 );
         _services[uid] = WeightedTaskService( newService, weight );
         reallocate( _targetNumThreads );
         return newService;
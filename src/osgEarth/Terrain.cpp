@@ -18,6 +18,8 @@
  */
 
 #include <osgEarth/Terrain>
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/HeightFieldUtils>
 #include <osgEarth/DPLineSegmentIntersector>
 #include <osgUtil/IntersectionVisitor>
 #include <osgUtil/LineSegmentIntersector>
@@ -53,6 +55,103 @@ namespace
             }
         }
     };
+
+    /**
+     * Samples the heightfields of an engine's resident tiles at world points.
+     * Keeps the summary of the last tile it used, since consecutive samples
+     * along a segment usually land in the same tile.
+     */
+    struct ResidentHeightSampler
+    {
+        ResidentHeightSampler(const TerrainEngineNode* engine, const Profile* profile, bool geocentric, float verticalScale)
+            : _engine       ( engine ),
+              _em           ( geocentric ? profile->getSRS()->getEllipsoid() : 0L ),
+              _verticalScale( verticalScale ),
+              _lastMaxHeight( 0.0 )
+        {
+            //nop
+        }
+
+        struct Sample
+        {
+            double _height;     // terrain height under the point
+            double _maxHeight;  // highest post in the tile
+            double _cellSize;   // post spacing in world units
+            double _edgeDist;   // distance to the nearest tile edge in world units
+        };
+
+        // world point to map (x, y) plus the point's own height, in the
+        // same terms as the heightfields.
+        void toMap( const osg::Vec3d& world, osg::Vec3d& out ) const
+        {
+            if ( _em )
+            {
+                double lat, lon, h;
+                _em->convertXYZToLatLongHeight( world.x(), world.y(), world.z(), lat, lon, h );
+                out.set( osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), h );
+            }
+            else
+            {
+                out = world;
+            }
+        }
+
+        bool sample( double x, double y, Sample& out )
+        {
+            TileKey key;
+            osg::ref_ptr<const osg::HeightField> hf;
+            if ( !_engine->getResidentHeightField(x, y, key, hf) || !hf.valid() )
+                return false;
+
+            if ( hf->getNumColumns() < 2 || hf->getNumRows() < 2 )
+                return false;
+
+            const GeoExtent& ex = key.getExtent();
+
+            if ( key != _lastKey || hf.get() != _lastHF.get() )
+            {
+                const osg::HeightField::HeightList& heights = hf->getFloatArray()->asVector();
+                float maxHeight = -FLT_MAX;
+                for( unsigned i = 0; i < heights.size(); ++i )
+                {
+                    if ( heights[i] != NO_DATA_VALUE && heights[i] > maxHeight )
+                        maxHeight = heights[i];
+                }
+                _lastKey       = key;
+                _lastHF        = hf.get();
+                _lastMaxHeight = (double)maxHeight * _verticalScale;
+            }
+
+            // world units per map unit along x and y:
+            double mx = 1.0, my = 1.0;
+            if ( _em )
+            {
+                my = osg::DegreesToRadians(1.0) * _em->getRadiusEquator();
+                mx = my * osg::maximum( cos(osg::DegreesToRadians(y)), 0.1 );
+            }
+
+            double nx = osg::clampBetween( (x - ex.xMin()) / ex.width(),  0.0, 1.0 );
+            double ny = osg::clampBetween( (y - ex.yMin()) / ex.height(), 0.0, 1.0 );
+
+            out._height    = (double)HeightFieldUtils::getHeightAtNormalizedLocation(hf.get(), nx, ny) * _verticalScale;
+            out._maxHeight = _lastMaxHeight;
+            out._cellSize  = osg::minimum(
+                mx * ex.width()  / (double)(hf->getNumColumns()-1),
+                my * ex.height() / (double)(hf->getNumRows()-1) );
+            out._edgeDist  = osg::minimum(
+                mx * osg::minimum(x - ex.xMin(), ex.xMax() - x),
+                my * osg::minimum(y - ex.yMin(), ex.yMax() - y) );
+            return true;
+        }
+
+        const TerrainEngineNode*   _engine;
+        const osg::EllipsoidModel* _em;
+        double                     _verticalScale;
+
+        TileKey                               _lastKey;
+        osg::ref_ptr<const osg::HeightField>  _lastHF;
+        double                                _lastMaxHeight;
+    };
 }
 
 //---------------------------------------------------------------------------
@@ -61,7 +160,8 @@ Terrain::Terrain(osg::Node* graph, const Profile* mapProfile, bool geocentric, c
 _graph         ( graph ),
 _profile       ( mapProfile ),
 _geocentric    ( geocentric ),
-_terrainOptions( terrainOptions )
+_terrainOptions( terrainOptions ),
+_verticalScale ( 1.0f )
 {
     //nop
 }
@@ -103,16 +203,27 @@ Terrain::getHeight(osg::Node*              patch,
         //getSRS()->transformToECEF(end, end);
     }
 
+    // the live terrain can answer this from its resident heightfields.
+    if ( !patch )
+    {
+        osg::Vec3d hit;
+        if ( !intersect(start, end, hit) )
+            return false;
+
+        getSRS()->transformFromWorld(hit, hit, out_hae);
+        if ( out_hamsl )
+            *out_hamsl = hit.z();
+
+        return true;
+    }
+
     osgUtil::LineSegmentIntersector* lsi = new osgUtil::LineSegmentIntersector(start, end);
     lsi->setIntersectionLimit(osgUtil::Intersector::LIMIT_ONE);
 
     osgUtil::IntersectionVisitor iv( lsi );
     iv.setTraversalMask( ~_terrainOptions.secondaryTraversalMask().value() );
 
-    if ( patch )
-        patch->accept( iv );
-    else
-        _graph->accept( iv );
+    patch->accept( iv );
 
     osgUtil::LineSegmentIntersector::Intersections& results = lsi->getIntersections();
     if ( !results.empty() )
@@ -121,8 +232,12 @@ Terrain::getHeight(osg::Node*              patch,
         osg::Vec3d hit = firstHit.getWorldIntersectPoint();
 
         getSRS()->transformFromWorld(hit, hit, out_hae);
+
+        // the patch geometry is unscaled; the shaders exaggerate it.
+        if ( out_hae )
+            *out_hae *= _verticalScale;
         if ( out_hamsl )
-            *out_hamsl = hit.z();
+            *out_hamsl = hit.z() * _verticalScale;
 
         return true;
     }
@@ -141,6 +256,130 @@ Terrain::getHeight(const SpatialReference* srs,
 }
 
 
+bool
+Terrain::intersect(const osg::Vec3d& start, const osg::Vec3d& end, osg::Vec3d& out_world) const
+{
+    osg::ref_ptr<osg::Node> graph;
+    if ( !_graph.lock(graph) )
+        return false;
+
+    const TerrainEngineNode* engine = dynamic_cast<const TerrainEngineNode*>( graph.get() );
+    if ( engine && engine->hasResidentHeightFields() )
+    {
+        return intersectHeightFields( engine, start, end, out_world );
+    }
+
+    osg::ref_ptr<DPLineSegmentIntersector> lsi = new DPLineSegmentIntersector(start, end);
+    lsi->setIntersectionLimit(osgUtil::Intersector::LIMIT_NEAREST);
+
+    osgUtil::IntersectionVisitor iv( lsi.get() );
+    iv.setTraversalMask( ~_terrainOptions.secondaryTraversalMask().value() );
+    graph->accept( iv );
+
+    if ( lsi->containsIntersections() )
+    {
+        out_world = lsi->getIntersections().begin()->getWorldIntersectPoint();
+        applyVerticalScale( out_world );
+        return true;
+    }
+    return false;
+}
+
+
+bool
+Terrain::intersectHeightFields(const TerrainEngineNode* engine,
+                               const osg::Vec3d&        start,
+                               const osg::Vec3d&        end,
+                               osg::Vec3d&              out_world) const
+{
+    osg::Vec3d dir = end - start;
+    double length = dir.normalize();
+    if ( length <= 0.0 )
+        return false;
+
+    ResidentHeightSampler sampler( engine, getProfile(), isGeocentric(), *_terrainOptions.verticalScale() * _verticalScale );
+    ResidentHeightSampler::Sample sample;
+
+    // step along the segment. Above a tile's highest post, the segment can
+    // drop no faster than it advances, so it may skip ahead by its clearance
+    // (as long as it stays in the tile); near the surface it steps by the
+    // post spacing, and a crossing is refined by bisection.
+    double t = 0.0, prevT = 0.0;
+    bool   above = false;
+
+    for( unsigned iter = 0; iter < 100000 && t <= length; ++iter )
+    {
+        osg::Vec3d map;
+        sampler.toMap( start + dir*t, map );
+
+        double step;
+        if ( sampler.sample(map.x(), map.y(), sample) )
+        {
+            if ( map.z() <= sample._height )
+            {
+                if ( !above )
+                {
+                    // started out below the surface.
+                    out_world = start + dir*t;
+                    return true;
+                }
+
+                double lo = prevT, hi = t;
+                for( unsigned b = 0; b < 24 && hi-lo > 0.01; ++b )
+                {
+                    double mid = 0.5*(lo+hi);
+                    sampler.toMap( start + dir*mid, map );
+                    if ( sampler.sample(map.x(), map.y(), sample) && map.z() <= sample._height )
+                        hi = mid;
+                    else
+                        lo = mid;
+                }
+
+                out_world = start + dir*hi;
+                return true;
+            }
+
+            step = sample._cellSize * 0.5;
+            if ( map.z() > sample._maxHeight )
+            {
+                step = osg::maximum( step, osg::minimum(map.z() - sample._maxHeight, sample._edgeDist) );
+            }
+        }
+        else
+        {
+            // no resident tile here, so no terrain either.
+            step = length / 256.0;
+        }
+
+        above = true;
+        prevT = t;
+
+        // always test the far end.
+        if ( t < length && t + step > length )
+            t = length;
+        else
+            t += step;
+    }
+
+    return false;
+}
+
+
+void
+Terrain::applyVerticalScale(osg::Vec3d& world) const
+{
+    // scene graph hits are on the unscaled geometry. Moving the hit along its
+    // vertical is exact for a vertical ray and close enough for an oblique one.
+    if ( _verticalScale == 1.0f )
+        return;
+
+    osg::Vec3d map;
+    getSRS()->transformFromWorld( world, map );
+    map.z() *= _verticalScale;
+    getSRS()->transformToWorld( map, world );
+}
+
+
 bool
 Terrain::getWorldCoordsUnderMouse(osg::View* view, float x, float y, osg::Vec3d& out_coords ) const
 {
@@ -148,6 +387,31 @@ Terrain::getWorldCoordsUnderMouse(osg::View* view, float x, float y, osg::Vec3d&
     if ( !view2 || !_graph.valid() )
         return false;
 
+    // with resident heightfields, intersect the pick ray through them.
+    const TerrainEngineNode* engine = dynamic_cast<const TerrainEngineNode*>( _graph.get() );
+    if ( engine && engine->hasResidentHeightFields() )
+    {
+        float local_x, local_y;
+        const osg::Camera* camera = view2->getCameraContainingPosition( x, y, local_x, local_y );
+        if ( !camera || !camera->getViewport() )
+            return false;
+
+        osg::Matrixd matrix = 
+            camera->getViewMatrix() *
+            camera->getProjectionMatrix() *
+            camera->getViewport()->computeWindowMatrix();
+
+        osg::Matrixd inverse;
+        if ( !inverse.invert(matrix) )
+            return false;
+
+        return intersectHeightFields(
+            engine,
+            osg::Vec3d(local_x, local_y, 0.0) * inverse,
+            osg::Vec3d(local_x, local_y, 1.0) * inverse,
+            out_coords );
+    }
+
     osgUtil::LineSegmentIntersector::Intersections results;
 
     osg::NodePath path;
@@ -161,6 +425,7 @@ Terrain::getWorldCoordsUnderMouse(osg::View* view, float x, float y, osg::Vec3d&
         // find the first hit under the mouse:
         osgUtil::LineSegmentIntersector::Intersection first = *(results.begin());
         out_coords = first.getWorldIntersectPoint();
+        applyVerticalScale( out_coords );
         return true;
     }
     return false;
@@ -190,6 +455,7 @@ Terrain::getWorldCoordsUnderMouse(osg::View* view,
         // find the first hit under the mouse:
         osgUtil::LineSegmentIntersector::Intersection first = *(results.begin());
         out_coords = first.getWorldIntersectPoint();
+        applyVerticalScale( out_coords );
         for( osg::NodePath::reverse_iterator j = first.nodePath.rbegin(); j != first.nodePath.rend(); ++j ) {
             if ( !(*j)->getName().empty() ) {
                 out_node = (*j);
@@ -24,9 +24,13 @@
 #include <osgEarth/NodeUtils>
 #include <osgEarth/MapModelChange>
 #include <osgDB/ReadFile>
+#include <osgDB/DatabasePager>
 #include <osg/CullFace>
 #include <osg/PolygonOffset>
 #include <osgViewer/View>
+#include <osg/Version>
+#include <algorithm>
+#include <set>
 
 #define LC "[TerrainEngineNode] "
 
@@ -171,10 +175,15 @@ TerrainEngineNode::TerrainEngineNode() :
 _verticalScale         ( 1.0f ),
 _elevationSamplingRatio( 1.0f ),
 _initStage             ( INIT_NONE ),
-_dirtyCount            ( 0 )
+_dirtyCount            ( 0 ),
+_synchronousLoading    ( false )
 {
     // register for event traversals so we can properly reset the dirtyCount
     ADJUST_EVENT_TRAV_COUNT( this, 1 );
+
+    // register for update traversals so we can fire load-complete callbacks
+    // and service synchronous tile loads
+    ADJUST_UPDATE_TRAV_COUNT( this, 1 );
 }
 
 
@@ -482,7 +491,233 @@ TerrainEngineNode::traverse( osg::NodeVisitor& nv )
         _dirtyCount = 0;
     }
 
+    else if ( nv.getVisitorType() == osg::NodeVisitor::UPDATE_VISITOR )
+    {
+        updateLoadTracking( nv.getFrameStamp() );
+    }
+
+    // watch the tile requests this cull makes on behalf of its camera.
+    LoadTracker*  tracker = 0L;
+    osg::Camera*  camera  = 0L;
+    if ( nv.getVisitorType() == osg::NodeVisitor::CULL_VISITOR )
+    {
+        osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+        camera = cv ? cv->getCurrentCamera() : 0L;
+        if ( camera )
+            tracker = beginLoadTracking( camera, nv );
+    }
+
     osg::CoordinateSystemNode::traverse( nv );
+
+    if ( tracker )
+    {
+        endLoadTracking( camera, tracker, nv );
+    }
+}
+
+//------------------------------------------------------------------------
+
+/**
+ * Stands in for the cull visitor's database request handler (normally the
+ * DatabasePager) while the terrain is culled. It counts the tile requests and
+ * either forwards them or, in synchronous mode, queues them for the engine.
+ */
+struct TerrainEngineNode::LoadTracker : public osg::NodeVisitor::DatabaseRequestHandler
+{
+    LoadTracker( TerrainEngineNode* engine ) : _engine( engine ), _numRequests( 0 ) { }
+
+#if OSG_MIN_VERSION_REQUIRED(3,0,0)
+    void requestNodeFile(const std::string&        fileName,
+                         osg::NodePath&            nodePath,
+                         float                     priority,
+                         const osg::FrameStamp*    framestamp,
+                         osg::ref_ptr<osg::Referenced>& databaseRequest,
+                         const osg::Referenced*    options )
+    {
+        ++_numRequests;
+
+        if ( _engine->_synchronousLoading )
+        {
+            osg::Group* parent = nodePath.empty() ? 0L : nodePath.back()->asGroup();
+            if ( parent )
+            {
+                SyncLoad load;
+                load._fileName = fileName;
+                load._parent   = parent;
+                load._options  = options;
+                load._pager    = _next.get();
+
+                Threading::ScopedMutexLock lock( _engine->_loadMutex );
+                _engine->_syncLoads.push_back( load );
+            }
+        }
+        else if ( _next.valid() )
+        {
+            _next->requestNodeFile( fileName, nodePath, priority, framestamp, databaseRequest, options );
+        }
+    }
+#endif
+
+    TerrainEngineNode*                                    _engine; // owns us
+    osg::ref_ptr<osg::NodeVisitor::DatabaseRequestHandler> _next;
+    unsigned                                              _numRequests;
+};
+
+void
+TerrainEngineNode::addLoadCompleteCallback( LoadCompleteCallback* cb )
+{
+    if ( cb )
+    {
+        Threading::ScopedMutexLock lock( _loadMutex );
+        _loadCompleteCallbacks.push_back( cb );
+    }
+}
+
+void
+TerrainEngineNode::removeLoadCompleteCallback( LoadCompleteCallback* cb )
+{
+    Threading::ScopedMutexLock lock( _loadMutex );
+    LoadCompleteCallbacks::iterator i = std::find( _loadCompleteCallbacks.begin(), _loadCompleteCallbacks.end(), cb );
+    if ( i != _loadCompleteCallbacks.end() )
+        _loadCompleteCallbacks.erase( i );
+}
+
+bool
+TerrainEngineNode::isLoadComplete( const osg::Camera* camera ) const
+{
+    Threading::ScopedMutexLock lock( _loadMutex );
+    CameraLoadStates::const_iterator i = _loadStates.find( camera );
+    return i != _loadStates.end() && i->second._complete;
+}
+
+unsigned
+TerrainEngineNode::getNumPendingTiles( const osg::Camera* camera ) const
+{
+    Threading::ScopedMutexLock lock( _loadMutex );
+    CameraLoadStates::const_iterator i = _loadStates.find( camera );
+    return i != _loadStates.end() ? i->second._numRequests : 0u;
+}
+
+void
+TerrainEngineNode::setSynchronousLoading( bool value )
+{
+    _synchronousLoading = value;
+}
+
+TerrainEngineNode::LoadTracker*
+TerrainEngineNode::beginLoadTracking( osg::Camera* camera, osg::NodeVisitor& nv )
+{
+#if !OSG_MIN_VERSION_REQUIRED(3,0,0)
+    // older request handlers have a different signature; no tracking.
+    return 0L;
+#else
+    // without a pager there is nobody to forward to, and PagedLODs won't ask.
+    if ( !nv.getDatabaseRequestHandler() && !_synchronousLoading )
+        return 0L;
+
+    LoadTracker* tracker;
+    {
+        Threading::ScopedMutexLock lock( _loadMutex );
+        CameraLoadState& state = _loadStates[camera];
+        if ( !state._tracker.valid() )
+        {
+            state._camera  = camera;
+            state._tracker = new LoadTracker( this );
+        }
+        tracker = state._tracker.get();
+    }
+
+    // a camera is only culled by one thread at a time, so the tracker is ours.
+    tracker->_next        = nv.getDatabaseRequestHandler();
+    tracker->_numRequests = 0;
+    nv.setDatabaseRequestHandler( tracker );
+    return tracker;
+#endif
+}
+
+void
+TerrainEngineNode::endLoadTracking( osg::Camera* camera, LoadTracker* tracker, osg::NodeVisitor& nv )
+{
+    nv.setDatabaseRequestHandler( tracker->_next.get() );
+    tracker->_next = 0L;
+
+    Threading::ScopedMutexLock lock( _loadMutex );
+    CameraLoadState& state = _loadStates[camera];
+    bool complete = tracker->_numRequests == 0;
+    if ( complete && !state._complete )
+        state._notify = true;
+    state._complete    = complete;
+    state._numRequests = tracker->_numRequests;
+}
+
+void
+TerrainEngineNode::updateLoadTracking( const osg::FrameStamp* fs )
+{
+    SyncLoads loads;
+    std::vector< osg::ref_ptr<osg::Camera> > completed;
+    LoadCompleteCallbacks callbacks;
+    {
+        Threading::ScopedMutexLock lock( _loadMutex );
+        loads.swap( _syncLoads );
+
+        for( CameraLoadStates::iterator i = _loadStates.begin(); i != _loadStates.end(); )
+        {
+            osg::ref_ptr<osg::Camera> camera;
+            if ( !i->second._camera.lock(camera) )
+            {
+                _loadStates.erase( i++ );
+                continue;
+            }
+            if ( i->second._notify )
+            {
+                i->second._notify = false;
+                completed.push_back( camera.get() );
+            }
+            ++i;
+        }
+
+        if ( !completed.empty() )
+            callbacks = _loadCompleteCallbacks;
+    }
+
+    // synchronous loads: read each requested tile and merge it right away,
+    // the way the pager would. Several cameras may ask for the same tile.
+    std::set< std::pair<osg::Group*, std::string> > done;
+    for( SyncLoads::iterator i = loads.begin(); i != loads.end(); ++i )
+    {
+        osg::ref_ptr<osg::Group> parent;
+        if ( !i->_parent.lock(parent) )
+            continue;
+
+        if ( !done.insert( std::make_pair(parent.get(), i->_fileName) ).second )
+            continue;
+
+        osg::ref_ptr<osg::Node> node = osgDB::readNodeFile(
+            i->_fileName,
+            dynamic_cast<const osgDB::Options*>( i->_options.get() ) );
+
+        if ( node.valid() )
+        {
+            parent->addChild( node.get() );
+
+            // let the pager expire the new tile's PagedLODs like any other.
+            osg::ref_ptr<osg::Referenced> pager;
+            if ( i->_pager.lock(pager) )
+            {
+                osgDB::DatabasePager* dbp = dynamic_cast<osgDB::DatabasePager*>( pager.get() );
+                if ( dbp )
+                    dbp->registerPagedLODs( node.get(), fs ? fs->getFrameNumber() : 0u );
+            }
+        }
+    }
+
+    for( unsigned c = 0; c < completed.size(); ++c )
+    {
+        for( LoadCompleteCallbacks::iterator i = callbacks.begin(); i != callbacks.end(); ++i )
+        {
+            i->get()->onLoadComplete( this, completed[c].get() );
+        }
+    }
 }
 
 //------------------------------------------------------------------------
@@ -18,9 +18,11 @@
  */
 #include <osgEarth/TerrainLayer>
 #include <osgEarth/TileSource>
+#include <osgEarth/MemCache>
 #include <osgEarth/Registry>
 #include <osgEarth/StringUtils>
 #include <osgEarth/TimeControl>
+#include <osgEarth/TraceRecorder>
 #include <osgEarth/URI>
 #include <osgDB/WriteFile>
 #include <osg/Version>
@@ -32,6 +34,12 @@ using namespace OpenThreads;
 
 #define LC "[TerrainLayer] \"" << getName() << "\": "
 
+// most invalidate() calls a layer remembers; older ones are merged into one whole-layer change.
+#define MAX_DATA_CHANGES 128
+
+// cache entry metadata key recording when the entry was written
+#define LAYER_TIME_KEY "layer_time"
+
 //------------------------------------------------------------------------
 
 TerrainLayerOptions::TerrainLayerOptions( const ConfigOptions& options ) :
@@ -95,6 +103,8 @@ TerrainLayerOptions::getConfig( bool isolate ) const
     conf.updateObjIfSet( "cache_policy", _cachePolicy );
     conf.updateObjIfSet( "proxy",        _proxySettings );
 
+    conf.updateIfSet( "metrics_interval", _metricsInterval );
+
     // Merge the TileSource options
     if ( !isolate && driver().isSet() )
         conf.merge( driver()->getConfig() );
@@ -124,6 +134,8 @@ TerrainLayerOptions::fromConfig( const Config& conf )
     conf.getObjIfSet( "cache_policy", _cachePolicy );
     conf.getObjIfSet( "proxy",        _proxySettings );
 
+    conf.getIfSet( "metrics_interval", _metricsInterval );
+
     // legacy support:
     if ( conf.value<bool>( "cache_only", false ) == true )
         _cachePolicy->usage() = CachePolicy::USAGE_CACHE_ONLY;
@@ -183,6 +195,10 @@ TerrainLayer::init()
     _tileSourceInitAttempted = false;
     _tileSourceInitFailed    = false;
     _tileSize                = 256;
+    _dataRevision            = Revision(0);
+    _forgottenRevision       = Revision(0);
+    _forgottenTime           = 0;
+    _lastMetricsReport       = osg::Timer::instance()->tick();
     _dbOptions               = Registry::instance()->cloneOrCreateOptions();
     
     initializeCachePolicy( _dbOptions.get() );
@@ -342,6 +358,186 @@ TerrainLayer::isDynamic() const
     return ts ? ts->isDynamic() : false;
 }
 
+void
+TerrainLayer::invalidate( const GeoExtent& extent )
+{
+    Revision revision;
+    {
+        Threading::ScopedWriteLock exclusive( _dataChangesMutex );
+
+        DataChange change;
+        change._revision = ++_dataRevision;
+        change._extent   = extent;
+        change._time     = ::time(0L);
+        _dataChanges.push_back( change );
+
+        while( _dataChanges.size() > MAX_DATA_CHANGES )
+        {
+            _forgottenRevision = _dataChanges.front()._revision;
+            _forgottenTime     = _dataChanges.front()._time;
+            _dataChanges.pop_front();
+        }
+
+        revision = _dataRevision;
+    }
+
+    // tiles the source already handed out (or refused) may be out of date now.
+    TileSource* ts = getTileSource();
+    if ( ts )
+    {
+        if ( ts->getMemCache() )
+        {
+            CacheBin* bin = ts->getMemCache()->getOrCreateDefaultBin();
+            if ( bin )
+                bin->purge();
+        }
+        if ( ts->getBlacklist() )
+        {
+            ts->getBlacklist()->clear();
+        }
+    }
+
+    OE_DEBUG << LC << "Invalidated " << (extent.isValid() ? extent.toString() : "all data")
+        << " (revision " << (int)revision << ")" << std::endl;
+}
+
+Revision
+TerrainLayer::getDataRevision() const
+{
+    Threading::ScopedReadLock shared( _dataChangesMutex );
+    return _dataRevision;
+}
+
+bool
+TerrainLayer::getInvalidExtents( const Revision& since, std::vector<GeoExtent>& out_extents ) const
+{
+    Threading::ScopedReadLock shared( _dataChangesMutex );
+
+    if ( (int)since < (int)_forgottenRevision )
+        return false;
+
+    for( std::deque<DataChange>::const_iterator i = _dataChanges.begin(); i != _dataChanges.end(); ++i )
+    {
+        if ( (int)i->_revision > (int)since )
+            out_extents.push_back( i->_extent );
+    }
+    return true;
+}
+
+LayerMetrics
+TerrainLayer::getMetrics() const
+{
+    Threading::ScopedMutexLock lock( _metricsMutex );
+    return _metrics;
+}
+
+void
+TerrainLayer::resetMetrics()
+{
+    Threading::ScopedMutexLock lock( _metricsMutex );
+    _metrics.reset();
+    _lastMetricsReport = osg::Timer::instance()->tick();
+}
+
+CacheBin::Stats
+TerrainLayer::getCacheStats() const
+{
+    CacheBin::Stats total;
+    Threading::ScopedReadLock shared( const_cast<TerrainLayer*>(this)->_cacheBinsMutex );
+    for( CacheBinInfoMap::const_iterator i = _cacheBins.begin(); i != _cacheBins.end(); ++i )
+    {
+        if ( i->second._bin.valid() )
+            total += i->second._bin->getStats();
+    }
+    return total;
+}
+
+void
+TerrainLayer::recordMetric( LayerMetrics::Counter counter, double amount )
+{
+    {
+        Threading::ScopedMutexLock lock( _metricsMutex );
+        _metrics.increment( counter, amount );
+    }
+    reportMetrics();
+}
+
+void
+TerrainLayer::recordTime( LayerMetrics::Stage stage, osg::Timer_t start )
+{
+    osg::Timer_t now = osg::Timer::instance()->tick();
+    {
+        Threading::ScopedMutexLock lock( _metricsMutex );
+        _metrics.addTime( stage, osg::Timer::instance()->delta_m(start, now) );
+    }
+
+    if ( TraceRecorder::isEnabled() )
+        TraceRecorder::instance()->record( getName() + " " + LayerMetrics::getStageName(stage), "layer", start, now );
+
+    reportMetrics();
+}
+
+void
+TerrainLayer::reportMetrics()
+{
+    if ( !_runtimeOptions->metricsInterval().isSet() )
+        return;
+
+    std::string report;
+    {
+        Threading::ScopedMutexLock lock( _metricsMutex );
+        osg::Timer_t now = osg::Timer::instance()->tick();
+        if ( osg::Timer::instance()->delta_s(_lastMetricsReport, now) < *_runtimeOptions->metricsInterval() )
+            return;
+        _lastMetricsReport = now;
+        report = _metrics.toString();
+    }
+
+    OE_NOTICE << LC << "Metrics " << report << std::endl;
+    if ( _cache.valid() )
+        OE_NOTICE << LC << "Cache " << getCacheStats().toString() << std::endl;
+}
+
+Config
+TerrainLayer::getCacheEntryMetadata() const
+{
+    Config meta;
+
+    // only layers that have been invalidated need the stamp.
+    Threading::ScopedReadLock shared( _dataChangesMutex );
+    if ( (int)_dataRevision > 0 )
+        meta.update( LAYER_TIME_KEY, (long)::time(0L) );
+
+    return meta;
+}
+
+bool
+TerrainLayer::isCacheEntryStale( const TileKey& key, const Config& metadata ) const
+{
+    Threading::ScopedReadLock shared( _dataChangesMutex );
+    if ( (int)_dataRevision == 0 )
+        return false;
+
+    // entries without a stamp were written before the first invalidate().
+    ::time_t written = metadata.value<long>( LAYER_TIME_KEY, 0L );
+
+    // time() only has one-second resolution, so a tie counts as stale.
+    if ( written <= _forgottenTime )
+        return true;
+
+    const GeoExtent& keyExtent = key.getExtent();
+    for( std::deque<DataChange>::const_reverse_iterator i = _dataChanges.rbegin(); i != _dataChanges.rend(); ++i )
+    {
+        if ( written > i->_time )
+            break;
+
+        if ( !i->_extent.isValid() || i->_extent.intersects(keyExtent) )
+            return true;
+    }
+
+    return false;
+}
+
 CacheBin*
 TerrainLayer::getCacheBin( const Profile* profile )
 {
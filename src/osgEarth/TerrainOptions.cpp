@@ -101,6 +101,7 @@ _attenuationDistance( 1000000 ),
 _lodTransitionTimeSeconds( 0.5f ),
 _enableMipmapping( true ),
 _clusterCulling( true ),
+_horizonCulling( true ),
 _enableBlending( false ),
 _mercatorFastPath( true ),
 _minFilter( osg::Texture::LINEAR_MIPMAP_LINEAR ),
@@ -133,6 +134,7 @@ TerrainOptions::getConfig() const
     conf.updateIfSet( "lod_transition_time", _lodTransitionTimeSeconds );
     conf.updateIfSet( "mipmapping", _enableMipmapping );
     conf.updateIfSet( "cluster_culling", _clusterCulling );
+    conf.updateIfSet( "horizon_culling", _horizonCulling );
     conf.updateIfSet( "blending", _enableBlending );
     conf.updateIfSet( "mercator_fast_path", _mercatorFastPath );
     conf.updateIfSet( "primary_traversal_mask", _primaryTraversalMask );
@@ -180,6 +182,7 @@ TerrainOptions::fromConfig( const Config& conf )
     conf.getIfSet( "lod_transition_time", _lodTransitionTimeSeconds );
     conf.getIfSet( "mipmapping", _enableMipmapping );
     conf.getIfSet( "cluster_culling", _clusterCulling );
+    conf.getIfSet( "horizon_culling", _horizonCulling );
     conf.getIfSet( "blending", _enableBlending );
     conf.getIfSet( "mercator_fast_path", _mercatorFastPath );
     conf.getIfSet( "primary_traversal_mask", _primaryTraversalMask );
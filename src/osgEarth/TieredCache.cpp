@@ -0,0 +1,353 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TieredCache>
+#include <osgEarth/MemCache>
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
+#include <ctime>
+#include <map>
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+
+#define LC "[TieredCache] "
+
+// name of the metadata entry that records when a front-tier entry was written
+#define TIER_TIME_KEY "__tiered_time"
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    typedef std::pair<osg::ref_ptr<const osg::Object>, Config> PendingWrite;
+    typedef std::map<std::string, PendingWrite> PendingWrites;
+
+    /**
+     * Bin that fronts a back-tier bin with a front-tier bin.
+     */
+    struct TieredCacheBin : public CacheBin
+    {
+        TieredCacheBin(const std::string&        id,
+                       CacheBin*                 front,
+                       CacheBin*                 back,
+                       const TieredCacheOptions& options,
+                       TaskService*              writeService )
+            : CacheBin     ( id ),
+              _front       ( front ),
+              _back        ( back ),
+              _promote     ( options.promote() == true ),
+              _writeService( writeService ),
+              _drainQueued ( false )
+        {
+            //nop
+        }
+
+        virtual ~TieredCacheBin()
+        {
+            drain();
+        }
+
+        enum Type { TYPE_OBJECT, TYPE_IMAGE, TYPE_NODE, TYPE_STRING };
+
+        ReadResult readObject( const std::string& key, double maxAge ) { return countedRead(key, maxAge, TYPE_OBJECT); }
+        ReadResult readImage ( const std::string& key, double maxAge ) { return countedRead(key, maxAge, TYPE_IMAGE); }
+        ReadResult readNode  ( const std::string& key, double maxAge ) { return countedRead(key, maxAge, TYPE_NODE); }
+        ReadResult readString( const std::string& key, double maxAge ) { return countedRead(key, maxAge, TYPE_STRING); }
+
+        // the tiers keep their own stats; these describe the combined bin.
+        ReadResult countedRead( const std::string& key, double maxAge, Type type )
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            return countRead( read(key, maxAge, type), start );
+        }
+
+        bool write( const std::string& key, const osg::Object* object, const Config& meta )
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            return countWrite( write_impl(key, object, meta), object, start );
+        }
+
+        ReadResult read( const std::string& key, double maxAge, Type type )
+        {
+            // 1. front tier. It doesn't track age itself, so we stamp entries on
+            //    the way in and check the stamp on the way out.
+            ReadResult r = _front->readObject( key, maxAge );
+            if ( r.succeeded() )
+            {
+                Config meta = r.metadata();
+                ::time_t written = meta.value<long>( TIER_TIME_KEY, 0L );
+                meta.remove( TIER_TIME_KEY );
+                if ( maxAge >= DBL_MAX || (double)(::time(0L) - written) <= maxAge )
+                {
+                    if ( isType(r.getObject(), type) )
+                        return ReadResult( r.releaseObject(), meta );
+                }
+            }
+
+            // 2. writes not yet in the back tier
+            {
+                ScopedMutexLock lock( _pendingMutex );
+                PendingWrites::const_iterator i = _pending.find( key );
+                if ( i != _pending.end() && isType(i->second.first.get(), type) )
+                {
+                    return ReadResult(
+                        osg::clone(i->second.first.get(), osg::CopyOp::DEEP_COPY_ALL),
+                        i->second.second );
+                }
+            }
+
+            // 3. back tier, promoting hits.
+            r =
+                type == TYPE_IMAGE  ? _back->readImage ( key, maxAge ) :
+                type == TYPE_NODE   ? _back->readNode  ( key, maxAge ) :
+                type == TYPE_STRING ? _back->readString( key, maxAge ) :
+                                      _back->readObject( key, maxAge );
+
+            if ( r.succeeded() && _promote )
+            {
+                writeFront( key, r.getObject(), r.metadata() );
+            }
+
+            return r;
+        }
+
+        bool write_impl( const std::string& key, const osg::Object* object, const Config& meta )
+        {
+            if ( !object ) return false;
+
+            writeFront( key, object, meta );
+
+            if ( !_writeService.valid() )
+                return _back->write( key, object, meta );
+
+            // write-back: hold on to a copy and let the writer thread store it.
+            {
+                ScopedMutexLock lock( _pendingMutex );
+                _pending[key] = PendingWrite( osg::clone(object, osg::CopyOp::DEEP_COPY_ALL), meta );
+                if ( _drainQueued )
+                    return true;
+                _drainQueued = true;
+            }
+
+            _writeService->add( new DrainRequest(this) );
+            return true;
+        }
+
+        bool isCached( const std::string& key, double maxAge )
+        {
+            {
+                ScopedMutexLock lock( _pendingMutex );
+                if ( _pending.find(key) != _pending.end() )
+                    return true;
+            }
+            return _back->isCached( key, maxAge );
+        }
+
+        bool touch( const std::string& key )
+        {
+            // re-stamp the front-tier copy, if there is one.
+            ReadResult r = _front->readObject( key, DBL_MAX );
+            if ( r.succeeded() )
+            {
+                Config meta = r.metadata();
+                meta.remove( TIER_TIME_KEY );
+                writeFront( key, r.getObject(), meta );
+            }
+            return _back->touch( key );
+        }
+
+        bool purge()
+        {
+            {
+                ScopedMutexLock lock( _pendingMutex );
+                _pending.clear();
+            }
+            _front->purge();
+            return _back->purge();
+        }
+
+        bool getKeys( std::vector<std::string>& out_keys )
+        {
+            return _back->getKeys( out_keys );
+        }
+
+        Config readMetadata()
+        {
+            return _back->readMetadata();
+        }
+
+        bool writeMetadata( const Config& meta )
+        {
+            return _back->writeMetadata( meta );
+        }
+
+        // stores pending write-back records in the back tier.
+        void drain()
+        {
+            for( ;; )
+            {
+                std::string  key;
+                PendingWrite entry;
+                {
+                    ScopedMutexLock lock( _pendingMutex );
+                    if ( _pending.empty() )
+                    {
+                        _drainQueued = false;
+                        return;
+                    }
+                    key   = _pending.begin()->first;
+                    entry = _pending.begin()->second;
+                }
+
+                _back->write( key, entry.first.get(), entry.second );
+
+                {
+                    // only retire the entry if it was not replaced in the meantime.
+                    ScopedMutexLock lock( _pendingMutex );
+                    PendingWrites::iterator i = _pending.find( key );
+                    if ( i != _pending.end() && i->second.first == entry.first )
+                        _pending.erase( i );
+                }
+            }
+        }
+
+        struct DrainRequest : public TaskRequest
+        {
+            DrainRequest( TieredCacheBin* bin ) : _bin( bin ) { }
+
+            void operator()( ProgressCallback* progress )
+            {
+                _bin->drain();
+            }
+
+            osg::ref_ptr<TieredCacheBin> _bin;
+        };
+
+    private:
+        // the front tier shares whatever it stores with every reader, so give
+        // it a private copy along with a timestamp.
+        void writeFront( const std::string& key, const osg::Object* object, const Config& meta )
+        {
+            Config frontMeta = meta;
+            frontMeta.update( TIER_TIME_KEY, (long)::time(0L) );
+            osg::ref_ptr<osg::Object> copy = osg::clone( object, osg::CopyOp::DEEP_COPY_ALL );
+            _front->write( key, copy.get(), frontMeta );
+        }
+
+        bool isType( const osg::Object* object, Type type ) const
+        {
+            return
+                type == TYPE_IMAGE  ? dynamic_cast<const osg::Image*>(object) != 0L :
+                type == TYPE_NODE   ? dynamic_cast<const osg::Node*>(object) != 0L :
+                type == TYPE_STRING ? dynamic_cast<const StringObject*>(object) != 0L :
+                                      object != 0L;
+        }
+
+        osg::ref_ptr<CacheBin>    _front;
+        osg::ref_ptr<CacheBin>    _back;
+        bool                      _promote;
+        osg::ref_ptr<TaskService> _writeService;
+        PendingWrites             _pending;
+        bool                      _drainQueued;
+        Threading::Mutex          _pendingMutex;
+    };
+}
+
+//------------------------------------------------------------------------
+
+TieredCache::TieredCache( const TieredCacheOptions& options ) :
+Cache         ( options ),
+_tieredOptions( options )
+{
+    MemCache* mem = new MemCache( _tieredOptions.memoryEntries().value(), _tieredOptions.concurrent() == true );
+    if ( _tieredOptions.memoryBytes().value() > 0 )
+        mem->setMaxBinSizeInBytes( _tieredOptions.memoryBytes().value() );
+    _front = mem;
+
+    if ( _tieredOptions.backCache().isSet() )
+    {
+        _back = CacheFactory::create( _tieredOptions.backCache().value() );
+    }
+    else
+    {
+        OE_WARN << LC << "No back-tier <cache> specified" << std::endl;
+    }
+
+    init();
+}
+
+TieredCache::TieredCache( Cache* front, Cache* back, const TieredCacheOptions& options ) :
+Cache         ( options ),
+_tieredOptions( options ),
+_front        ( front ),
+_back         ( back )
+{
+    init();
+}
+
+void
+TieredCache::init()
+{
+    if ( !_front.valid() || !_back.valid() || !_front->isOK() || !_back->isOK() )
+    {
+        OE_WARN << LC << "Failed to initialize cache tiers" << std::endl;
+        _ok = false;
+        return;
+    }
+
+    if ( _tieredOptions.writePolicy() == TieredCacheOptions::WRITE_BACK )
+    {
+        _writeService = new TaskService( "TieredCache write-back", 1 );
+    }
+}
+
+CacheBin*
+TieredCache::createBin( CacheBin* front, CacheBin* back )
+{
+    if ( !front || !back )
+        return 0L;
+
+    return new TieredCacheBin( back->getID(), front, back, _tieredOptions, _writeService.get() );
+}
+
+CacheBin*
+TieredCache::addBin( const std::string& binID )
+{
+    if ( !_ok ) return 0L;
+
+    CacheBin* bin = createBin( _front->addBin(binID), _back->addBin(binID) );
+    return bin ? _bins.getOrCreate( binID, bin ) : 0L;
+}
+
+CacheBin*
+TieredCache::getOrCreateDefaultBin()
+{
+    if ( !_ok ) return 0L;
+
+    static Threading::Mutex s_defaultBinMutex;
+    if ( !_defaultBin.valid() )
+    {
+        Threading::ScopedMutexLock lock( s_defaultBinMutex );
+        if ( !_defaultBin.valid() ) // double-check
+        {
+            _defaultBin = createBin( _front->getOrCreateDefaultBin(), _back->getOrCreateDefaultBin() );
+        }
+    }
+    return _defaultBin.get();
+}
@@ -19,6 +19,7 @@
 
 #include <osgEarth/TileKey>
 #include <osgEarth/StringUtils>
+#include <string.h>
 
 using namespace osgEarth;
 
@@ -28,6 +29,25 @@ TileKey TileKey::INVALID( 0, 0, 0, 0L );
 
 //------------------------------------------------------------------------
 
+namespace
+{
+    // writes "value" in decimal at "out"; returns the char after it.
+    char* writeUnsigned( char* out, unsigned value )
+    {
+        char digits[10];
+        int n = 0;
+        do {
+            digits[n++] = (char)('0' + value % 10u);
+            value /= 10u;
+        } while( value > 0u );
+        while( n > 0 )
+            *out++ = digits[--n];
+        return out;
+    }
+}
+
+//------------------------------------------------------------------------
+
 TileKey::TileKey( unsigned int lod, unsigned int tile_x, unsigned int tile_y, const Profile* profile)
 {
     _x = tile_x;
@@ -47,10 +67,15 @@ TileKey::TileKey( unsigned int lod, unsigned int tile_x, unsigned int tile_y, co
 
         _extent = GeoExtent( _profile->getSRS(), xmin, ymin, xmax, ymax );
 
-        _key = Stringify() << _lod << "/" << _x << "/" << _y;
+        _code = pack( _lod, _x, _y );
+
+        // short enough for the small-string buffer of most std::strings.
+        char buf[MAX_STR_LENGTH];
+        _key.assign( buf, str(buf) );
     }
     else
     {
+        _code = ~0ULL;
         _extent = GeoExtent::INVALID;
         _key = "invalid";
     }
@@ -58,6 +83,7 @@ TileKey::TileKey( unsigned int lod, unsigned int tile_x, unsigned int tile_y, co
 
 TileKey::TileKey( const TileKey& rhs ) :
 _key( rhs._key ),
+_code( rhs._code ),
 _lod(rhs._lod),
 _x(rhs._x),
 _y(rhs._y),
@@ -67,6 +93,37 @@ _extent( rhs._extent )
     //NOP
 }
 
+unsigned
+TileKey::str( char* buffer ) const
+{
+    if ( !valid() )
+    {
+        strcpy( buffer, "invalid" );
+        return 7u;
+    }
+
+    char* p = writeUnsigned( buffer, _lod );
+    *p++ = '/';
+    p = writeUnsigned( p, _x );
+    *p++ = '/';
+    p = writeUnsigned( p, _y );
+    *p = 0;
+    return (unsigned)(p - buffer);
+}
+
+std::size_t
+TileKey::hash() const
+{
+    // neighboring keys differ only in their low bits, so mix everything.
+    unsigned long long h = _code ^ ((unsigned long long)getProfileCode() * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return (std::size_t)h;
+}
+
 const Profile*
 TileKey::getProfile() const
 {
@@ -23,7 +23,10 @@
 #include <osgEarth/ImageUtils>
 #include <osgEarth/FileUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/Progress>
 #include <osgEarth/ThreadingUtils>
+#include <osgEarth/TaskService>
+#include <OpenThreads/Thread>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
@@ -38,15 +41,107 @@ using namespace osgEarth;
 
 //------------------------------------------------------------------------
 
+namespace
+{
+    // threads that fetch the keys of a batch concurrently. Fetches mostly
+    // wait on I/O, so there are more of them than cores.
+    Threading::Mutex          s_batchServiceMutex;
+    osg::ref_ptr<TaskService> s_batchService;
+
+    TaskService* getBatchService()
+    {
+        Threading::ScopedMutexLock lock( s_batchServiceMutex );
+        if ( !s_batchService.valid() )
+        {
+            s_batchService = new TaskService(
+                "TileSource batch",
+                osg::maximum( 8, 2*OpenThreads::GetNumberOfProcessors() ) );
+        }
+        return s_batchService.get();
+    }
+}
+
+struct TileSource::BatchTask
+{
+    BatchTask() : _source(0L), _key(0L), _image(0L), _heightField(0L), _callback(0L) { }
+
+    void execute()
+    {
+        if ( _callback && _callback->isCanceled() )
+            return;
+
+        if ( _image )
+            *_image = _source->createImage( *_key, _callback );
+        else
+            *_heightField = _source->createHeightField( *_key, _callback );
+    }
+
+    TileSource*                     _source;
+    const TileKey*                  _key;
+    osg::ref_ptr<osg::Image>*       _image;
+    osg::ref_ptr<osg::HeightField>* _heightField;
+    ProgressCallback*               _callback;  // (TaskRequest has its own _progress)
+};
+
+//------------------------------------------------------------------------
+
 TileBlacklist::TileBlacklist()
 {
-    //NOP
+    _bloom = new OpenThreads::Atomic[BLOOM_WORDS];
+}
+
+TileBlacklist::~TileBlacklist()
+{
+    delete [] _bloom;
+}
+
+namespace
+{
+    // two independent hashes of a tile id, for double hashing.
+    void hashTileID( const osgTerrain::TileID& tile, unsigned& h1, unsigned& h2 )
+    {
+        unsigned long long h = TileKey::pack( (unsigned)tile.level, (unsigned)tile.x, (unsigned)tile.y );
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        h1 = (unsigned)h;
+        h2 = (unsigned)(h >> 32) | 1u;
+    }
+}
+
+bool
+TileBlacklist::bloomMightContain(const osgTerrain::TileID& tile) const
+{
+    unsigned h1, h2;
+    hashTileID( tile, h1, h2 );
+    for( unsigned i = 0; i < BLOOM_PROBES; ++i )
+    {
+        unsigned bit = (h1 + i*h2) & ((1u << BLOOM_BITS_LOG2) - 1u);
+        if ( ((unsigned)_bloom[bit >> 5] & (1u << (bit & 31u))) == 0u )
+            return false;
+    }
+    return true;
+}
+
+void
+TileBlacklist::bloomAdd(const osgTerrain::TileID& tile)
+{
+    unsigned h1, h2;
+    hashTileID( tile, h1, h2 );
+    for( unsigned i = 0; i < BLOOM_PROBES; ++i )
+    {
+        unsigned bit = (h1 + i*h2) & ((1u << BLOOM_BITS_LOG2) - 1u);
+        _bloom[bit >> 5].OR( 1u << (bit & 31u) );
+    }
 }
 
 void
 TileBlacklist::add(const osgTerrain::TileID &tile)
 {
     Threading::ScopedWriteLock lock(_mutex);
+    bloomAdd(tile);
     _tiles.insert(tile);
     OE_DEBUG << "Added " << tile.level << " (" << tile.x << ", " << tile.y << ") to blacklist" << std::endl;
 }
@@ -56,6 +151,7 @@ TileBlacklist::remove(const osgTerrain::TileID &tile)
 {
     Threading::ScopedWriteLock lock(_mutex);
     _tiles.erase(tile);
+    // (its filter bits stay set; contains() falls through to the set)
     OE_DEBUG << "Removed " << tile.level << " (" << tile.x << ", " << tile.y << ") from blacklist" << std::endl;
 }
 
@@ -64,12 +160,18 @@ TileBlacklist::clear()
 {
     Threading::ScopedWriteLock lock(_mutex);
     _tiles.clear();
+    for( unsigned i = 0; i < BLOOM_WORDS; ++i )
+        _bloom[i].AND( 0u );
     OE_DEBUG << "Cleared blacklist" << std::endl;
 }
 
 bool
 TileBlacklist::contains(const osgTerrain::TileID &tile) const
 {
+    // lock-free for the common case of a tile that was never blacklisted.
+    if ( !bloomMightContain(tile) )
+        return false;
+
     Threading::ScopedReadLock lock(const_cast<TileBlacklist*>(this)->_mutex);
     return _tiles.find(tile) != _tiles.end();
 }
@@ -150,6 +252,8 @@ _noDataValue          ( (float)SHRT_MIN ),
 _minValidValue        ( -32000.0f ),
 _maxValidValue        (  32000.0f ),
 _L2CacheSize          ( 16 ),
+_L2CacheMaxBytes      ( 0 ),
+_L2CacheConcurrent    ( false ),
 _bilinearReprojection ( true )
 { 
     fromConfig( _conf );
@@ -168,6 +272,8 @@ TileSourceOptions::getConfig() const
     conf.updateIfSet( "nodata_max", _maxValidValue ); // backcompat
     conf.updateIfSet( "blacklist_filename", _blacklistFilename);
     conf.updateIfSet( "l2_cache_size", _L2CacheSize );
+    conf.updateIfSet( "l2_cache_max_bytes", _L2CacheMaxBytes );
+    conf.updateIfSet( "l2_cache_concurrent", _L2CacheConcurrent );
     conf.updateIfSet( "bilinear_reprojection", _bilinearReprojection );
     conf.updateObjIfSet( "profile", _profileOptions );
     return conf;
@@ -191,6 +297,8 @@ TileSourceOptions::fromConfig( const Config& conf )
     conf.getIfSet( "nodata_max", _maxValidValue );
     conf.getIfSet( "blacklist_filename", _blacklistFilename);
     conf.getIfSet( "l2_cache_size", _L2CacheSize );
+    conf.getIfSet( "l2_cache_max_bytes", _L2CacheMaxBytes );
+    conf.getIfSet( "l2_cache_concurrent", _L2CacheConcurrent );
     conf.getIfSet( "bilinear_reprojection", _bilinearReprojection );
     conf.getObjIfSet( "profile", _profileOptions );
 
@@ -229,7 +337,9 @@ _status ( Status::Error("Not initialized") )
     }
     else if ( *options.L2CacheSize() > 0 )
     {
-        _memCache = new MemCache( *options.L2CacheSize() );
+        _memCache = new MemCache( *options.L2CacheSize(), *options.L2CacheConcurrent() );
+        if ( *options.L2CacheMaxBytes() > 0 )
+            _memCache->setMaxBinSizeInBytes( *options.L2CacheMaxBytes() );
     }
 
     if (_options.blacklistFilename().isSet())
@@ -384,6 +494,166 @@ TileSource::createHeightField(const TileKey&        key,
     return hf;
 }
 
+void
+TileSource::createImages(const std::vector<TileKey>& keys,
+                         ImageVector&                out_images,
+                         ImageOperation*             prepOp,
+                         ProgressCallback*           progress )
+{
+    out_images.assign( keys.size(), 0L );
+
+    if ( _status != STATUS_OK )
+        return;
+
+    // Take what we can from the memcache and pass the rest to the driver in one go.
+    std::vector<TileKey>  newKeys;
+    std::vector<unsigned> newIndices;
+    for( unsigned i=0; i<keys.size(); ++i )
+    {
+        if (_memCache.valid())
+        {
+            ReadResult r = _memCache->getOrCreateDefaultBin()->readImage( keys[i].str() );
+            if ( r.succeeded() )
+            {
+                out_images[i] = r.releaseImage();
+                continue;
+            }
+        }
+        newKeys.push_back( keys[i] );
+        newIndices.push_back( i );
+    }
+
+    if ( newKeys.empty() )
+        return;
+
+    ImageVector newImages( newKeys.size() );
+    createImages( newKeys, newImages, progress );
+
+    for( unsigned i=0; i<newKeys.size(); ++i )
+    {
+        osg::ref_ptr<osg::Image>& newImage = newImages[i];
+
+        if ( prepOp )
+            (*prepOp)( newImage );
+
+        if ( newImage.valid() && _memCache.valid() )
+        {
+            _memCache->getOrCreateDefaultBin()->write( newKeys[i].str(), newImage.get() );
+        }
+
+        out_images[newIndices[i]] = newImage.get();
+    }
+}
+
+void
+TileSource::createHeightFields(const std::vector<TileKey>& keys,
+                               HeightFieldVector&          out_heightFields,
+                               HeightFieldOperation*       prepOp,
+                               ProgressCallback*           progress )
+{
+    out_heightFields.assign( keys.size(), 0L );
+
+    if ( _status != STATUS_OK )
+        return;
+
+    std::vector<TileKey>  newKeys;
+    std::vector<unsigned> newIndices;
+    for( unsigned i=0; i<keys.size(); ++i )
+    {
+        if (_memCache.valid())
+        {
+            ReadResult r = _memCache->getOrCreateDefaultBin()->readObject( keys[i].str() );
+            if ( r.succeeded() )
+            {
+                out_heightFields[i] = r.release<osg::HeightField>();
+                continue;
+            }
+        }
+        newKeys.push_back( keys[i] );
+        newIndices.push_back( i );
+    }
+
+    if ( newKeys.empty() )
+        return;
+
+    HeightFieldVector newHFs( newKeys.size() );
+    createHeightFields( newKeys, newHFs, progress );
+
+    for( unsigned i=0; i<newKeys.size(); ++i )
+    {
+        osg::ref_ptr<osg::HeightField>& newHF = newHFs[i];
+
+        if ( prepOp )
+            (*prepOp)( newHF );
+
+        // as in createHeightField(), hand out a copy so the caller can't
+        // modify the memcached instance.
+        if ( newHF.valid() && _memCache.valid() )
+        {
+            _memCache->getOrCreateDefaultBin()->write( newKeys[i].str(), newHF.get() );
+            out_heightFields[newIndices[i]] = new osg::HeightField( *newHF.get() );
+        }
+        else
+        {
+            out_heightFields[newIndices[i]] = newHF.get();
+        }
+    }
+}
+
+void
+TileSource::createImages(const std::vector<TileKey>& keys,
+                         ImageVector&                out_images,
+                         ProgressCallback*           progress)
+{
+    fetchBatch( keys, &out_images, 0L, progress );
+}
+
+void
+TileSource::createHeightFields(const std::vector<TileKey>& keys,
+                               HeightFieldVector&          out_heightFields,
+                               ProgressCallback*           progress)
+{
+    fetchBatch( keys, 0L, &out_heightFields, progress );
+}
+
+void
+TileSource::fetchBatch(const std::vector<TileKey>& keys,
+                       ImageVector*                out_images,
+                       HeightFieldVector*          out_heightFields,
+                       ProgressCallback*           progress)
+{
+    if ( keys.empty() )
+        return;
+
+    // One key at a time would add up the latency of each, which is what a
+    // reprojected mosaic pays for its 2-6 source tiles. Run the first key in
+    // this thread and the rest on the batch service.
+    typedef ParallelTask<BatchTask> Task;
+    std::vector< osg::ref_ptr<Task> > tasks;
+    tasks.reserve( keys.size() );
+    Threading::MultiEvent done( (int)keys.size()-1 );
+
+    TaskService* service = keys.size() > 1 ? getBatchService() : 0L;
+
+    for( unsigned i=0; i<keys.size(); ++i )
+    {
+        Task* task = i > 0 ? new Task( &done ) : new Task();
+        task->_source      = this;
+        task->_key         = &keys[i];
+        task->_image       = out_images       ? &(*out_images)[i]       : 0L;
+        task->_heightField = out_heightFields ? &(*out_heightFields)[i] : 0L;
+        task->_callback    = progress;
+        tasks.push_back( task );
+
+        if ( i > 0 )
+            service->add( task );
+    }
+
+    tasks[0]->execute();
+    if ( keys.size() > 1 )
+        done.wait();
+}
+
 bool
 TileSource::isOK() const 
 {
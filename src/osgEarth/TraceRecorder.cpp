@@ -0,0 +1,208 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TraceRecorder>
+#include <osgEarth/Notify>
+#include <OpenThreads/Thread>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+
+using namespace osgEarth;
+
+#define LC "[TraceRecorder] "
+
+#define DEFAULT_CAPACITY 65536u
+
+volatile bool TraceRecorder::s_enabled = false;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    TraceRecorder s_recorder;
+
+    // writes a string as a JSON string literal.
+    void writeJSONString( std::ostream& out, const std::string& value )
+    {
+        out << '"';
+        for( std::string::const_iterator i = value.begin(); i != value.end(); ++i )
+        {
+            char c = *i;
+            if ( c == '"' || c == '\\' )
+                out << '\\' << c;
+            else if ( (unsigned char)c < 0x20 )
+                out << ' ';
+            else
+                out << c;
+        }
+        out << '"';
+    }
+}
+
+//------------------------------------------------------------------------
+
+TraceRecorder*
+TraceRecorder::instance()
+{
+    return &s_recorder;
+}
+
+TraceRecorder::TraceRecorder() :
+_capacity( DEFAULT_CAPACITY ),
+_next    ( 0 ),
+_origin  ( osg::Timer::instance()->tick() )
+{
+    const char* path = ::getenv("OSGEARTH_TRACE_FILE");
+    if ( path && *path )
+    {
+        _exitPath = path;
+        s_enabled = true;
+    }
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    if ( !_exitPath.empty() )
+    {
+        // no logging here; the notifier may already be gone.
+        s_enabled = false;
+        std::ofstream out( _exitPath.c_str() );
+        if ( out.is_open() )
+            write( out );
+    }
+}
+
+void
+TraceRecorder::setEnabled( bool value )
+{
+    s_enabled = value;
+}
+
+void
+TraceRecorder::setCapacity( unsigned value )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _capacity = osg::maximum( value, 1u );
+    _events.clear();
+    _next = 0;
+}
+
+unsigned
+TraceRecorder::getCapacity() const
+{
+    return _capacity;
+}
+
+void
+TraceRecorder::record( const std::string& name, const char* category, osg::Timer_t start, osg::Timer_t end )
+{
+    if ( !s_enabled )
+        return;
+
+    OpenThreads::Thread* thread = OpenThreads::Thread::CurrentThread();
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    Event* e;
+    if ( _events.size() < _capacity )
+    {
+        _events.push_back( Event() );
+        e = &_events.back();
+    }
+    else
+    {
+        e = &_events[_next];
+    }
+    _next = (_next + 1) % _capacity;
+
+    e->_name     = name;
+    e->_category = category ? category : "osgEarth";
+    e->_start    = start;
+    e->_end      = end;
+    e->_thread   = thread ? (unsigned)thread->getThreadId() : 0u;
+}
+
+unsigned
+TraceRecorder::getNumEvents() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _events.size();
+}
+
+void
+TraceRecorder::clear()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _events.clear();
+    _next = 0;
+}
+
+void
+TraceRecorder::write( std::ostream& out ) const
+{
+    std::vector<Event> events;
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        if ( _events.size() < _capacity )
+        {
+            events = _events;
+        }
+        else
+        {
+            // oldest first:
+            events.insert( events.end(), _events.begin() + _next, _events.end() );
+            events.insert( events.end(), _events.begin(), _events.begin() + _next );
+        }
+    }
+
+    osg::Timer* timer = osg::Timer::instance();
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for( unsigned i = 0; i < events.size(); ++i )
+    {
+        const Event& e = events[i];
+        if ( i > 0 )
+            out << ",";
+        out << "\n{\"name\":";
+        writeJSONString( out, e._name );
+        out << ",\"cat\":";
+        writeJSONString( out, e._category );
+        out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e._thread
+            << ",\"ts\":"  << timer->delta_u( _origin, e._start )
+            << ",\"dur\":" << timer->delta_u( e._start, e._end )
+            << "}";
+    }
+    out << "\n]}\n";
+}
+
+bool
+TraceRecorder::write( const std::string& path ) const
+{
+    std::ofstream out( path.c_str() );
+    if ( !out.is_open() )
+    {
+        OE_WARN << LC << "Cannot write trace to " << path << std::endl;
+        return false;
+    }
+
+    write( out );
+    OE_INFO << LC << "Wrote " << getNumEvents() << " trace events to " << path << std::endl;
+    return !out.fail();
+}
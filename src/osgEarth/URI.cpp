@@ -26,8 +26,10 @@
 #include <osgDB/ReadFile>
 #include <osgDB/ReaderWriter>
 #include <osgDB/Archive>
+#include <OpenThreads/Atomic>
 #include <fstream>
 #include <sstream>
+#include <map>
 
 #define LC "[URI] "
 
@@ -277,24 +279,27 @@ namespace
 
     struct ReadObject
     {
+        const char* name() const { return "object"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_OBJECTS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readObject(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key, double maxAge ) { return bin->readObject(key, maxAge); }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readObject(uri, opt, p); }
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readObject(req, opt, p); }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return ReadResult(osgDB::readObjectFile(uri, opt)); }
     };
 
     struct ReadNode
     {
+        const char* name() const { return "node"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_NODES) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readNode(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key, double maxAge ) { return bin->readObject(key, maxAge); }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readNode(uri, opt, p); }
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readNode(req, opt, p); }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return ReadResult(osgDB::readNodeFile(uri, opt)); }
     };
 
     struct ReadImage
     {
+        const char* name() const { return "image"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { 
             return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_IMAGES) != 0); 
         }
@@ -308,9 +313,9 @@ namespace
             if ( r.getImage() ) r.getImage()->setFileName( key );
             return r;
         }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p ) { 
-            ReadResult r = HTTPClient::readImage(uri, opt, p);
-            if ( r.getImage() ) r.getImage()->setFileName( uri );
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { 
+            ReadResult r = HTTPClient::readImage(req, opt, p);
+            if ( r.getImage() ) r.getImage()->setFileName( req.getURL() );
             return r;
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { 
@@ -322,13 +327,238 @@ namespace
 
     struct ReadString
     {
+        const char* name() const { return "string"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_STRINGS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readString(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key, double maxAge ) { return bin->readString(key, maxAge); }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readString(uri, opt, p); }
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readString(req, opt, p); }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return readStringFile(uri, opt); }
     };
 
+    //--------------------------------------------------------------------
+    // Reads a remote URI, consulting the cache per the caching policy.
+
+    template<typename READ_FUNCTOR>
+    ReadResult readRemote(
+        READ_FUNCTOR&         reader,
+        const URI&            uri,
+        URIReadCallback*      cb,
+        const osgDB::Options* dbOptions,
+        const osgDB::Options* localOptions,
+        ProgressCallback*     progress,
+        bool&                 gotResultFromCallback )
+    {
+        ReadResult result;
+
+        bool callbackCachingOK = !cb || reader.callbackRequestsCaching(cb);
+
+        // establish the caching policy.
+        optional<CachePolicy> cp;
+        if ( !Registry::instance()->getCachePolicy( cp, localOptions ) )
+            cp = CachePolicy::DEFAULT;
+
+        // get a cache bin if we need it:
+        CacheBin* bin = 0L;
+        if ( (cp->usage() != CachePolicy::USAGE_NO_CACHE) && callbackCachingOK )
+        {
+            bin = s_getCacheBin( dbOptions );
+        }
+
+        // first try to go to the cache if there is one. An expired record is
+        // kept so we can ask the server whether it is still current.
+        ReadResult stale;
+        if ( bin && cp->isCacheReadable() )
+        {
+            result = reader.fromCache( bin, uri.cacheKey(), *cp->maxAge() );
+            if ( result.succeeded() )
+            {
+                result.setIsFromCache(true);
+            }
+            else if ( result.code() == ReadResult::RESULT_EXPIRED )
+            {
+                stale = result;
+                result = ReadResult();
+            }
+        }
+
+        // not in the cache, so proceed to read it from the network.
+        if ( result.empty() )
+        {
+            // Need to do this to support nested PLODs and Proxynodes.
+            osg::ref_ptr<osgDB::Options> remoteOptions =
+                Registry::instance()->cloneOrCreateOptions( localOptions );
+            remoteOptions->getDatabasePathList().push_front( osgDB::getFilePath(uri.full()) );
+
+            // try to use the callback if it's set. Callback ignores the caching policy.
+            if ( cb )
+            {                
+                result = reader.fromCallback( cb, uri.full(), remoteOptions.get() );
+
+                if ( result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
+                {
+                    // "not implemented" is the only excuse for falling back
+                    gotResultFromCallback = true;
+                }
+            }
+
+            if ( !gotResultFromCallback )
+            {
+                // still no data, go to the source:
+                if ( result.empty() && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
+                {
+                    HTTPRequest request( uri.full() );
+
+                    // revalidate an expired record instead of downloading it again:
+                    if ( stale.getObject() )
+                    {
+                        const Config& meta = stale.metadata();
+                        if ( meta.hasValue(IOMetadata::ETAG) )
+                            request.addHeader( "If-None-Match", meta.value(IOMetadata::ETAG) );
+                        if ( meta.hasValue(IOMetadata::LAST_MODIFIED) )
+                            request.addHeader( "If-Modified-Since", meta.value(IOMetadata::LAST_MODIFIED) );
+                    }
+
+                    result = reader.fromHTTP( request, remoteOptions.get(), progress );
+
+                    if ( result.code() == ReadResult::RESULT_NOT_MODIFIED && stale.getObject() )
+                    {
+                        // server says our copy is current; refresh its timestamp.
+                        result = ReadResult( stale.getObject(), stale.metadata() );
+                        result.setIsFromCache( true );
+                        if ( bin && cp->isCacheWriteable() && !bin->touch(uri.cacheKey()) )
+                        {
+                            bin->write( uri.cacheKey(), result.getObject(), result.metadata() );
+                        }
+                    }
+                }
+
+                // in cache-only mode, an expired record beats nothing at all:
+                else if ( result.empty() && stale.getObject() )
+                {
+                    result = ReadResult( stale.getObject(), stale.metadata() );
+                    result.setIsFromCache( true );
+                }
+
+                // write the result to the cache if possible:
+                if ( result.succeeded() && !result.isFromCache() && bin && cp->isCacheWriteable() )
+                {
+                    bin->write( uri.cacheKey(), result.getObject(), result.metadata() );
+                }
+            }
+        }
+
+        OE_TEST << LC 
+            << uri.base() << ": " 
+            << (result.succeeded() ? "OK" : "FAILED") 
+            << "; policy=" << cp->usageString()
+            << (result.isFromCache() && result.succeeded() ? "; (from cache)" : "")
+            << std::endl;
+
+        return result;
+    }
+
+    //--------------------------------------------------------------------
+    // Single-flight table: concurrent reads of the same remote resource
+    // wait on one fetch/decode and share its result.
+
+    struct InFlightRead : public osg::Referenced
+    {
+        InFlightRead() : _fromCallback(false) { }
+        Threading::Event _done;
+        ReadResult       _result;
+        bool             _fromCallback;
+    };
+
+    typedef std::map<std::string, osg::ref_ptr<InFlightRead> > InFlightReadTable;
+
+    InFlightReadTable   s_inFlightReads;
+    Threading::Mutex    s_inFlightReadsMutex;
+    OpenThreads::Atomic s_numLeaderReads;
+    OpenThreads::Atomic s_numCoalescedReads;
+    bool                s_coalesceReads = ::getenv("OSGEARTH_NO_READ_COALESCING") == 0L;
+
+    template<typename READ_FUNCTOR>
+    ReadResult readRemoteCoalesced(
+        READ_FUNCTOR&         reader,
+        const URI&            uri,
+        URIReadCallback*      cb,
+        const osgDB::Options* dbOptions,
+        const osgDB::Options* localOptions,
+        ProgressCallback*     progress,
+        bool&                 gotResultFromCallback )
+    {
+        if ( !s_coalesceReads )
+        {
+            return readRemote( reader, uri, cb, dbOptions, localOptions, progress, gotResultFromCallback );
+        }
+
+        std::string key = Stringify()
+            << reader.name() << ":" << uri.full() << "|" << uri.cacheKey()
+            << "|" << (localOptions ? localOptions->getOptionString() : "");
+
+        for( ; ; )
+        {
+            osg::ref_ptr<InFlightRead> flight;
+            bool leader = false;
+            {
+                Threading::ScopedMutexLock lock( s_inFlightReadsMutex );
+                InFlightReadTable::iterator i = s_inFlightReads.find( key );
+                if ( i != s_inFlightReads.end() )
+                {
+                    flight = i->second.get();
+                }
+                else
+                {
+                    flight = new InFlightRead();
+                    s_inFlightReads[key] = flight.get();
+                    leader = true;
+                }
+            }
+
+            if ( leader )
+            {
+                ++s_numLeaderReads;
+
+                ReadResult result = readRemote( reader, uri, cb, dbOptions, localOptions, progress, gotResultFromCallback );
+                flight->_result       = result;
+                flight->_fromCallback = gotResultFromCallback;
+                {
+                    Threading::ScopedMutexLock lock( s_inFlightReadsMutex );
+                    s_inFlightReads.erase( key );
+                }
+                flight->_done.set();
+                return result;
+            }
+
+            ++s_numCoalescedReads;
+
+            while( !flight->_done.isSet() )
+                flight->_done.wait();
+
+            // the leader was canceled; that's no reason for us to fail. Try again.
+            if ( flight->_result.code() == ReadResult::RESULT_CANCELED )
+            {
+                if ( progress && progress->isCanceled() )
+                    return ReadResult( ReadResult::RESULT_CANCELED );
+                continue;
+            }
+
+            // clone the shared object so each reader owns its copy, as the caches do.
+            gotResultFromCallback = flight->_fromCallback;
+            const ReadResult& shared = flight->_result;
+            osg::Object* object = shared.getObject();
+            if ( object )
+            {
+                osg::Object* copy = osg::clone( object, osg::CopyOp::DEEP_COPY_ALL );
+                if ( copy )
+                    object = copy;
+            }
+            ReadResult result( shared.code(), object, shared.metadata() );
+            result.setIsFromCache( shared.isFromCache() );
+            return result;
+        }
+    }
+
     //--------------------------------------------------------------------
     // MASTER read template function. I templatized this so we wouldn't
     // have 4 95%-identical code paths to maintain...
@@ -401,72 +631,8 @@ namespace
                 // remote URI, consider caching:
                 else
                 {
-                    bool callbackCachingOK = !cb || reader.callbackRequestsCaching(cb);
-
-                    // establish the caching policy.
-                    optional<CachePolicy> cp;
-                    if ( !Registry::instance()->getCachePolicy( cp, localOptions ) )
-                        cp = CachePolicy::DEFAULT;
-
-                    // get a cache bin if we need it:
-                    CacheBin* bin = 0L;
-                    if ( (cp->usage() != CachePolicy::USAGE_NO_CACHE) && callbackCachingOK )
-                    {
-                        bin = s_getCacheBin( dbOptions );
-                    }
-
-                    // first try to go to the cache if there is one:
-                    if ( bin && cp->isCacheReadable() )
-                    {
-                        result = reader.fromCache( bin, uri.cacheKey(), *cp->maxAge() );
-                        if ( result.succeeded() )
-                            result.setIsFromCache(true);
-                    }
-
-                    // not in the cache, so proceed to read it from the network.
-                    if ( result.empty() )
-                    {
-                        // Need to do this to support nested PLODs and Proxynodes.
-                        osg::ref_ptr<osgDB::Options> remoteOptions =
-                            Registry::instance()->cloneOrCreateOptions( localOptions );
-                        remoteOptions->getDatabasePathList().push_front( osgDB::getFilePath(uri.full()) );
-
-                        // try to use the callback if it's set. Callback ignores the caching policy.
-                        if ( cb )
-                        {                
-                            result = reader.fromCallback( cb, uri.full(), remoteOptions.get() );
-
-                            if ( result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
-                            {
-                                // "not implemented" is the only excuse for falling back
-                                gotResultFromCallback = true;
-                            }
-                        }
-
-                        if ( !gotResultFromCallback )
-                        {
-                            // still no data, go to the source:
-                            if ( result.empty() && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
-                            {
-                                result = reader.fromHTTP( uri.full(), remoteOptions.get(), progress );
-                            }
-
-                            // write the result to the cache if possible:
-                            if ( result.succeeded() && bin && cp->isCacheWriteable() )
-                            {
-                                bin->write( uri.cacheKey(), result.getObject(), result.metadata() );
-                            }
-                        }
-                    }
-
-                    OE_TEST << LC 
-                        << uri.base() << ": " 
-                        << (result.succeeded() ? "OK" : "FAILED") 
-                        << "; policy=" << cp->usageString()
-                        << (result.isFromCache() && result.succeeded() ? "; (from cache)" : "")
-                        << std::endl;
+                    result = readRemoteCoalesced( reader, uri, cb, dbOptions, localOptions, progress, gotResultFromCallback );
                 }
-
                     
                 if ( result.getObject() && !gotResultFromCallback )
                 {
@@ -519,6 +685,30 @@ URI::readString(const osgDB::Options* dbOptions,
     return doRead<ReadString>( *this, dbOptions, progress );
 }
 
+void
+URI::setCoalesceReads( bool value )
+{
+    s_coalesceReads = value;
+}
+
+bool
+URI::getCoalesceReads()
+{
+    return s_coalesceReads;
+}
+
+unsigned
+URI::getNumLeaderReads()
+{
+    return s_numLeaderReads;
+}
+
+unsigned
+URI::getNumCoalescedReads()
+{
+    return s_numCoalescedReads;
+}
+
 
 //------------------------------------------------------------------------
 
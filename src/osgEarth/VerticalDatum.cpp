@@ -98,7 +98,7 @@ VerticalDatum::transform(const VerticalDatum* from,
 
     if ( from )
     {
-        in_out_z = from->msl2hae( lat_deg, lon_deg, INTERP_BILINEAR );
+        in_out_z = from->msl2hae( lat_deg, lon_deg, in_out_z );
     }
 
     Units fromUnits = from ? from->getUnits() : Units::METERS;
@@ -108,7 +108,7 @@ VerticalDatum::transform(const VerticalDatum* from,
 
     if ( to )
     {
-        in_out_z = to->hae2msl( lat_deg, lon_deg, INTERP_BILINEAR );
+        in_out_z = to->hae2msl( lat_deg, lon_deg, in_out_z );
     }
 
     return true;
@@ -138,31 +138,43 @@ VerticalDatum::transform(const VerticalDatum* from,
 
     unsigned cols = hf->getNumColumns();
     unsigned rows = hf->getNumRows();
-    osg::Vec3d sw = hf->getOrigin();
-    osg::Vec3d ne;
-    ne.x() = sw.x() + hf->getXInterval()*double(rows);
-    ne.y() = sw.y() + hf->getYInterval()*double(cols);
-    double xstep = hf->getXInterval();
-    double ystep = hf->getYInterval();
-
-    if ( !extent.getSRS()->isGeographic() )
+    if ( cols == 0 || rows == 0 )
+        return true;
+
+    // Geoid heights come from per-tile grids that are computed once and
+    // shared; the conversion itself is then a pass of adds over the posts.
+    osg::ref_ptr<const osg::HeightField> fromGrid, toGrid;
+    if ( from && from->getGeoid() )
+        from->getGeoid()->getHeights( extent, cols, rows, fromGrid );
+    if ( to && to->getGeoid() )
+        to->getGeoid()->getHeights( extent, cols, rows, toGrid );
+
+    Units fromUnits = from ? from->getUnits() : Units::METERS;
+    Units toUnits   = to ? to->getUnits() : fromUnits;
+    float scale     = (float)fromUnits.convertTo( toUnits, 1.0 );
+
+    osg::HeightField::HeightList& heights = hf->getFloatArray()->asVector();
+    float*   h   = &heights[0];
+    unsigned num = heights.size();
+
+    if ( fromGrid.valid() )
+    {
+        const float* n = &fromGrid->getFloatArray()->front();
+        for( unsigned i=0; i<num; ++i )
+            if ( h[i] != NO_DATA_VALUE ) h[i] += n[i];
+    }
+
+    if ( scale != 1.0f )
     {
-        const SpatialReference* geoSRS = extent.getSRS()->getGeographicSRS();
-        extent.getSRS()->transform(sw, geoSRS, sw);
-        extent.getSRS()->transform(ne, geoSRS, ne);
-        xstep = (ne.x()-sw.x()) / double(cols);
-        ystep = (ne.y()-sw.y()) / double(rows);
+        for( unsigned i=0; i<num; ++i )
+            if ( h[i] != NO_DATA_VALUE ) h[i] *= scale;
     }
 
-    for( unsigned c=0; c<cols; ++c)
+    if ( toGrid.valid() )
     {
-        double lon = sw.x() + xstep*double(c);
-        for( unsigned r=0; r<rows; ++r)
-        {
-            double lat = sw.y() + ystep*double(r);
-            float& h = hf->getHeight(r, c);
-            VerticalDatum::transform( from, to, lat, lon, h );
-        }
+        const float* n = &toGrid->getFloatArray()->front();
+        for( unsigned i=0; i<num; ++i )
+            if ( h[i] != NO_DATA_VALUE ) h[i] -= n[i];
     }
 
     return true;
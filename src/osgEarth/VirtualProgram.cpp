@@ -20,12 +20,14 @@
 
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
+#include <osgEarth/ProgramBinaryCache>
 #include <osgEarth/ShaderFactory>
 #include <osgEarth/ShaderUtils>
 #include <osg/Shader>
 #include <osg/Program>
 #include <osg/State>
 #include <osg/Notify>
+#include <OpenThreads/Atomic>
 #include <sstream>
 
 #define LC "[VirtualProgram] "
@@ -54,6 +56,10 @@ namespace
 
     bool s_dumpShaders = false;        // debugging
 
+    // source of VirtualProgram revisions. They are unique across all VPs so that
+    // a new VP at a recycled address never matches a remembered one.
+    OpenThreads::Atomic s_revisionGen;
+
     /** A hack for OSG 2.8.x to get access to the state attribute vector. */
     /** TODO: no longer needed in OSG 3+ ?? */
     class StateHack : public osg::State 
@@ -109,6 +115,7 @@ VirtualProgram::get(osg::StateSet* stateset)
 
 
 VirtualProgram::VirtualProgram( unsigned mask ) : 
+_revision          ( ++s_revisionGen ),
 _mask              ( mask ),
 _inherit           ( true )
 {
@@ -134,6 +141,7 @@ _inherit           ( true )
 VirtualProgram::VirtualProgram(const VirtualProgram& rhs, const osg::CopyOp& copyop ) :
 osg::StateAttribute( rhs, copyop ),
 _shaderMap         ( rhs._shaderMap ),
+_revision          ( ++s_revisionGen ),
 _mask              ( rhs._mask ),
 _functions         ( rhs._functions ),
 _inherit           ( rhs._inherit ),
@@ -194,6 +202,7 @@ VirtualProgram::addBindAttribLocation( const std::string& name, GLuint index )
 #else
     _attribBindingList[name] = index;
 #endif
+    _revision = ++s_revisionGen;
 }
 
 void
@@ -202,6 +211,7 @@ VirtualProgram::removeBindAttribLocation( const std::string& name )
     std::map<std::string,std::string>::iterator i = _attribAliases.find(name);
     if ( i != _attribAliases.end() )
         _attribBindingList.erase(i->second);
+    _revision = ++s_revisionGen;
 }
 
 void
@@ -239,6 +249,7 @@ VirtualProgram::setShader(const std::string&                 shaderID,
 
     shader->setName( shaderID );
     _shaderMap[shaderID] = ShaderEntry(shader, ov);
+    _revision = ++s_revisionGen;
 
     return shader;
 }
@@ -262,6 +273,7 @@ VirtualProgram::setShader(osg::Shader*                       shader,
     ShaderPreProcessor::run( shader );
 
     _shaderMap[shader->getName()] = ShaderEntry(shader, ov);
+    _revision = ++s_revisionGen;
 
     return shader;
 }
@@ -305,6 +317,7 @@ void
 VirtualProgram::removeShader( const std::string& shaderID )
 {
     _shaderMap.erase( shaderID );
+    _revision = ++s_revisionGen;
 
     for(FunctionLocationMap::iterator i = _functions.begin(); i != _functions.end(); ++i )
     {
@@ -371,6 +384,7 @@ VirtualProgram::setInheritShaders( bool value )
         // not particularly thread safe if called after use.. meh
         _programCache.clear();
         _accumulatedFunctions.clear();
+        _revision = ++s_revisionGen;
     }
 }
 
@@ -613,13 +627,56 @@ VirtualProgram::buildProgram(osg::State&        state,
     addShadersToProgram( buildVector, accumAttribBindings, accumAttribAliases, program );
     addTemplateDataToProgram( program );
 
+    // skip the compile and link if an earlier session left us a binary.
+    ProgramBinaryCache* binaryCache = Registry::instance()->getProgramBinaryCache();
+    if ( binaryCache )
+        binaryCache->setBinary( program );
+
     // finally, put own new program in the cache.
-    _programCache[ keyVector ] = program;
+    ProgramEntry entry;
+    entry._shaders = keyVector;
+    entry._program = program;
+    _programCache[ hashShaders(keyVector) ].push_back( entry );
 
     return program;
 }
 
 
+unsigned
+VirtualProgram::hashShaders( const ShaderVector& shaders )
+{
+    // FNV-1a over the shader pointers; the key only needs to tell
+    // shader sets apart within one process.
+    unsigned h = 2166136261u;
+    for( ShaderVector::const_iterator i = shaders.begin(); i != shaders.end(); ++i )
+    {
+        size_t p = reinterpret_cast<size_t>( i->get() );
+        for( unsigned b = 0; b < sizeof(size_t); ++b, p >>= 8 )
+        {
+            h ^= (unsigned)(p & 0xFF);
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+
+osg::Program*
+VirtualProgram::findProgram( unsigned hash, const ShaderVector& shaders ) const
+{
+    ProgramMap::const_iterator p = _programCache.find( hash );
+    if ( p != _programCache.end() )
+    {
+        for( ProgramEntries::const_iterator e = p->second.begin(); e != p->second.end(); ++e )
+        {
+            if ( e->_shaders == shaders )
+                return e->_program.get();
+        }
+    }
+    return 0L;
+}
+
+
 void
 VirtualProgram::apply( osg::State& state ) const
 {
@@ -635,42 +692,89 @@ VirtualProgram::apply( osg::State& state ) const
         return;
     }
 
-    // first, find and collect all the VirtualProgram attributes:
-    ShaderMap         accumShaderMap;
-    AttribBindingList accumAttribBindings;
-    AttribAliasMap    accumAttribAliases;
-    
+    // find the span of the attribute stack that contributes to this VP:
+    // from the deepest VP that doesn't inherit, up to here.
+    const StateHack::AttributeVec* av = 0L;
+    unsigned start = 0;
     if ( _inherit )
     {
-        const StateHack::AttributeVec* av = StateHack::GetAttributeVec( state, this );
+        av = StateHack::GetAttributeVec( state, this );
         if ( av && av->size() > 0 )
         {
-            // find the deepest VP that doesn't inherit:
-            unsigned start = 0;
             for( start = (int)av->size()-1; start > 0; --start )
             {
                 const VirtualProgram* vp = dynamic_cast<const VirtualProgram*>( (*av)[start].first );
                 if ( vp && (vp->_mask & _mask) && vp->_inherit == false )
                     break;
             }
-            
-            // collect shaders from there to here:
-            for( unsigned i=start; i<av->size(); ++i )
+        }
+        else
+        {
+            av = 0L;
+        }
+    }
+
+    // if the stack is the same one we resolved last time in this context,
+    // reuse that program.
+    LastProgram& last = _lastProgram[state.getContextID()];
+    if ( last._program.valid() )
+    {
+        bool same = true;
+        unsigned n = 0;
+        if ( av )
+        {
+            for( unsigned i = start; i < av->size() && same; ++i )
             {
                 const VirtualProgram* vp = dynamic_cast<const VirtualProgram*>( (*av)[i].first );
                 if ( vp && (vp->_mask && _mask) )
                 {
-                    for( ShaderMap::const_iterator i = vp->_shaderMap.begin(); i != vp->_shaderMap.end(); ++i )
-                    {
-                        addToAccumulatedMap( accumShaderMap, i->first, i->second );
-                    }
+                    same =
+                        n < last._stack.size() &&
+                        last._stack[n].first  == vp &&
+                        last._stack[n].second == vp->_revision;
+                    ++n;
+                }
+            }
+        }
 
-                    const AttribBindingList& abl = vp->getAttribBindingList();
-                    accumAttribBindings.insert( abl.begin(), abl.end() );
+        same = same &&
+            n+1 == last._stack.size() &&
+            last._stack[n].first  == this &&
+            last._stack[n].second == _revision;
 
-                    const AttribAliasMap& aliases = vp->getAttribAliases();
-                    accumAttribAliases.insert( aliases.begin(), aliases.end() );
+        if ( same )
+        {
+            last._program->apply( state );
+            return;
+        }
+    }
+
+    // first, find and collect all the VirtualProgram attributes:
+    ShaderMap         accumShaderMap;
+    AttribBindingList accumAttribBindings;
+    AttribAliasMap    accumAttribAliases;
+    std::vector<StackEntry> stack;
+    
+    if ( av )
+    {
+        // collect shaders from there to here:
+        for( unsigned i=start; i<av->size(); ++i )
+        {
+            const VirtualProgram* vp = dynamic_cast<const VirtualProgram*>( (*av)[i].first );
+            if ( vp && (vp->_mask && _mask) )
+            {
+                for( ShaderMap::const_iterator i = vp->_shaderMap.begin(); i != vp->_shaderMap.end(); ++i )
+                {
+                    addToAccumulatedMap( accumShaderMap, i->first, i->second );
                 }
+
+                const AttribBindingList& abl = vp->getAttribBindingList();
+                accumAttribBindings.insert( abl.begin(), abl.end() );
+
+                const AttribAliasMap& aliases = vp->getAttribAliases();
+                accumAttribAliases.insert( aliases.begin(), aliases.end() );
+
+                stack.push_back( StackEntry(vp, vp->_revision) );
             }
         }
     }
@@ -686,6 +790,8 @@ VirtualProgram::apply( osg::State& state ) const
     const AttribAliasMap& aliases = this->getAttribAliases();
     accumAttribAliases.insert( aliases.begin(), aliases.end() );
 
+    stack.push_back( StackEntry(this, _revision) );
+
 
     if ( accumShaderMap.size() )
     {
@@ -702,19 +808,16 @@ VirtualProgram::apply( osg::State& state ) const
             ShaderEntry& entry = i->second;
             vec.push_back( entry.first.get() );
         }
+        unsigned hash = hashShaders( vec );
         
         // see if there's already a program associated with this list:
         osg::Program* program = 0L;
+        bool          built   = false;
         
         // look up the program:
         {
             Threading::ScopedReadLock shared( _programCacheMutex );
-            
-            ProgramMap::const_iterator p = _programCache.find( vec );
-            if ( p != _programCache.end() )
-            {
-                program = p->second.get();
-            }
+            program = findProgram( hash, vec );
         }
         
         // if not found, lock and build it:
@@ -723,20 +826,27 @@ VirtualProgram::apply( osg::State& state ) const
             Threading::ScopedWriteLock exclusive( _programCacheMutex );
             
             // look again in case of contention:
-            ProgramMap::const_iterator p = _programCache.find( vec );
-            if ( p != _programCache.end() )
-            {
-                program = p->second.get();
-            }
-            else
+            program = findProgram( hash, vec );
+            if ( !program )
             {
                 VirtualProgram* nc = const_cast<VirtualProgram*>(this);
                 program = nc->buildProgram( state, accumShaderMap, accumAttribBindings, accumAttribAliases);
+                built = true;
             }
         }
+
+        // remember the stack for next time.
+        last._stack.swap( stack );
+        last._program = program;
         
         // finally, apply the program attribute.
         program->apply( state );
+
+        // the first apply linked the program; the binary cache takes it from here.
+        if ( built && Registry::instance()->getProgramBinaryCache() )
+        {
+            Registry::instance()->getProgramBinaryCache()->update( program, state );
+        }
     }
 }
 
@@ -0,0 +1,247 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthAnnotation/AnnotationClampManager>
+#include <osgEarthAnnotation/AnnotationNode>
+#include <cmath>
+
+#define LC "[AnnotationClampManager] "
+
+// map profile LOD of the index grid cells
+#define INDEX_LOD 6
+
+// annotations that span more cells than this are visited for every tile
+#define MAX_INDEXED_CELLS 64
+
+using namespace osgEarth;
+using namespace osgEarth::Annotation;
+
+//------------------------------------------------------------------------
+
+AnnotationClampManager*
+AnnotationClampManager::getOrCreate( Terrain* terrain )
+{
+    typedef std::map<Terrain*, osg::observer_ptr<AnnotationClampManager> > Managers;
+    static Managers         s_managers;
+    static Threading::Mutex s_managersMutex;
+
+    if ( !terrain || !terrain->getProfile() )
+        return 0L;
+
+    Threading::ScopedMutexLock lock( s_managersMutex );
+
+    // the terrain owns its manager (through its callback list), so an
+    // expired entry means the terrain went away.
+    for( Managers::iterator i = s_managers.begin(); i != s_managers.end(); )
+    {
+        if ( !i->second.valid() )
+            s_managers.erase( i++ );
+        else
+            ++i;
+    }
+
+    osg::observer_ptr<AnnotationClampManager>& manager = s_managers[terrain];
+    if ( !manager.valid() )
+    {
+        AnnotationClampManager* m = new AnnotationClampManager( terrain->getProfile() );
+        terrain->addTerrainCallback( m );
+        manager = m;
+    }
+    return manager.get();
+}
+
+AnnotationClampManager::AnnotationClampManager( const Profile* profile ) :
+_profile( profile ),
+_lod    ( INDEX_LOD )
+{
+    //nop
+}
+
+unsigned
+AnnotationClampManager::getNumAnnotations() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _entries.size();
+}
+
+void
+AnnotationClampManager::add( AnnotationNode* annotation )
+{
+    if ( !annotation )
+        return;
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    // re-adding just refreshes the index.
+    Entry& entry = _entries[annotation];
+    unindex( annotation, entry );
+
+    entry._annotation = annotation;
+    index( annotation, entry );
+}
+
+void
+AnnotationClampManager::remove( AnnotationNode* annotation )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    EntryMap::iterator i = _entries.find( annotation );
+    if ( i != _entries.end() )
+    {
+        unindex( annotation, i->second );
+        _entries.erase( i );
+    }
+}
+
+void
+AnnotationClampManager::update( AnnotationNode* annotation )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    EntryMap::iterator i = _entries.find( annotation );
+    if ( i != _entries.end() )
+    {
+        unindex( annotation, i->second );
+        index( annotation, i->second );
+    }
+}
+
+void
+AnnotationClampManager::index( AnnotationNode* annotation, Entry& entry )
+{
+    entry._cells.clear();
+
+    GeoExtent extent;
+    if ( annotation->getClampExtent(extent) && extent.isValid() )
+        extent = extent.transform( _profile->getSRS() );
+
+    if ( extent.isValid() && !extent.crossesAntimeridian() )
+    {
+        const GeoExtent& pe = _profile->getExtent();
+        double w, h;
+        unsigned cols, rows;
+        _profile->getTileDimensions( _lod, w, h );
+        _profile->getNumTiles( _lod, cols, rows );
+
+        int c0 = osg::clampBetween( (int)floor((extent.xMin() - pe.xMin()) / w), 0, (int)cols-1 );
+        int c1 = osg::clampBetween( (int)floor((extent.xMax() - pe.xMin()) / w), 0, (int)cols-1 );
+        int r0 = osg::clampBetween( (int)floor((pe.yMax() - extent.yMax()) / h), 0, (int)rows-1 );
+        int r1 = osg::clampBetween( (int)floor((pe.yMax() - extent.yMin()) / h), 0, (int)rows-1 );
+
+        if ( (c1-c0+1)*(r1-r0+1) <= MAX_INDEXED_CELLS )
+        {
+            for( int r = r0; r <= r1; ++r )
+            {
+                for( int c = c0; c <= c1; ++c )
+                {
+                    Cell cell( c, r );
+                    entry._cells.push_back( cell );
+                    _cells[cell].insert( annotation );
+                }
+            }
+            return;
+        }
+    }
+
+    _unindexed.insert( annotation );
+}
+
+void
+AnnotationClampManager::unindex( AnnotationNode* annotation, Entry& entry )
+{
+    if ( entry._cells.empty() )
+    {
+        _unindexed.erase( annotation );
+        return;
+    }
+
+    for( std::vector<Cell>::const_iterator c = entry._cells.begin(); c != entry._cells.end(); ++c )
+    {
+        CellMap::iterator i = _cells.find( *c );
+        if ( i != _cells.end() )
+        {
+            i->second.erase( annotation );
+            if ( i->second.empty() )
+                _cells.erase( i );
+        }
+    }
+    entry._cells.clear();
+}
+
+void
+AnnotationClampManager::onTileAdded( const TileKey& key, osg::Node* tile, TerrainCallbackContext& context )
+{
+    // gather the annotations under the tile, then clamp outside the lock
+    // since reclamping can move an annotation.
+    std::vector< osg::ref_ptr<AnnotationNode> > candidates;
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+
+        AnnotationSet visit( _unindexed );
+
+        unsigned lod = key.getLOD();
+        unsigned c0, c1, r0, r1;
+        if ( lod >= _lod )
+        {
+            c0 = c1 = key.getTileX() >> (lod - _lod);
+            r0 = r1 = key.getTileY() >> (lod - _lod);
+        }
+        else
+        {
+            unsigned span = 1u << (_lod - lod);
+            c0 = key.getTileX() * span; c1 = c0 + span - 1;
+            r0 = key.getTileY() * span; r1 = r0 + span - 1;
+        }
+
+        if ( (c1-c0+1)*(r1-r0+1) > _cells.size() )
+        {
+            // coarse tile: cheaper to scan the occupied cells.
+            for( CellMap::const_iterator i = _cells.begin(); i != _cells.end(); ++i )
+            {
+                if ( i->first.first >= c0 && i->first.first <= c1 && i->first.second >= r0 && i->first.second <= r1 )
+                    visit.insert( i->second.begin(), i->second.end() );
+            }
+        }
+        else
+        {
+            for( unsigned r = r0; r <= r1; ++r )
+            {
+                for( unsigned c = c0; c <= c1; ++c )
+                {
+                    CellMap::const_iterator i = _cells.find( Cell(c, r) );
+                    if ( i != _cells.end() )
+                        visit.insert( i->second.begin(), i->second.end() );
+                }
+            }
+        }
+
+        candidates.reserve( visit.size() );
+        for( AnnotationSet::const_iterator i = visit.begin(); i != visit.end(); ++i )
+        {
+            osg::ref_ptr<AnnotationNode> annotation;
+            EntryMap::iterator e = _entries.find( *i );
+            if ( e != _entries.end() && e->second._annotation.lock(annotation) )
+                candidates.push_back( annotation.get() );
+        }
+    }
+
+    for( unsigned i = 0; i < candidates.size(); ++i )
+    {
+        candidates[i]->reclamp( key, tile, context.getTerrain() );
+    }
+}
@@ -19,6 +19,7 @@
 
 #include <osgEarthAnnotation/AnnotationNode>
 #include <osgEarthAnnotation/AnnotationSettings>
+#include <osgEarthAnnotation/AnnotationClampManager>
 #include <osgEarthAnnotation/AnnotationUtils>
 
 #include <osgEarth/DepthOffset>
@@ -31,24 +32,6 @@ using namespace osgEarth::Annotation;
 
 //-------------------------------------------------------------------
 
-namespace osgEarth { namespace Annotation
-{
-    struct AutoClampCallback : public TerrainCallback
-    {
-        AutoClampCallback( AnnotationNode* annotation):
-        _annotation( annotation )
-        {
-        }
-
-        void onTileAdded( const TileKey& key, osg::Node* tile, TerrainCallbackContext& context )
-        {
-            _annotation->reclamp( key, tile, context.getTerrain() );
-        }
-
-        AnnotationNode* _annotation;
-    };
-}  }
-
 //-------------------------------------------------------------------
 
 Style AnnotationNode::s_emptyStyle;
@@ -60,13 +43,16 @@ _mapNode    ( mapNode ),
 _dynamic    ( false ),
 _autoclamp  ( false ),
 _depthAdj   ( false ),
-_activeDs   ( 0L )
+_activeDs   ( 0L ),
+_objectID   ( 0 )
 {
     //Note: Cannot call setMapNode() here because it's a virtual function.
     //      Each subclass will be separately responsible at ctor time.
 
     // always blend.
     this->getOrCreateStateSet()->setMode( GL_BLEND, osg::StateAttribute::ON );
+
+    registerObjectID();
 }
 
 AnnotationNode::AnnotationNode(MapNode* mapNode, const Config& conf) :
@@ -74,7 +60,8 @@ _mapNode    ( mapNode ),
 _dynamic    ( false ),
 _autoclamp  ( false ),
 _depthAdj   ( false ),
-_activeDs   ( 0L )
+_activeDs   ( 0L ),
+_objectID   ( 0 )
 {
     if ( conf.hasValue("lighting") )
     {
@@ -99,11 +86,28 @@ _activeDs   ( 0L )
         this->getOrCreateStateSet()->setMode( GL_BLEND, osg::StateAttribute::ON );
     }
 
+    registerObjectID();
 }
 
 AnnotationNode::~AnnotationNode()
 {
+    // the map node may already be gone, so drop out of the manager directly.
+    osg::ref_ptr<AnnotationClampManager> manager;
+    if ( _clampManager.lock(manager) )
+        manager->remove( this );
+
     setMapNode( 0L );
+
+    if ( _objectID != 0 )
+        ObjectIndex::instance()->remove( _objectID );
+}
+
+void
+AnnotationNode::registerObjectID()
+{
+    _objectID = ObjectIndex::instance()->insert( this );
+    if ( _objectID != 0 )
+        this->getOrCreateStateSet()->addUniform( ObjectIndex::createUniform(_objectID) );
 }
 
 void
@@ -124,17 +128,15 @@ AnnotationNode::setMapNode( MapNode* mapNode )
 {
     if ( getMapNode() != mapNode )
     {
-        // relocate the auto-clamping callback, if there is one:
-        osg::ref_ptr<MapNode> oldMapNode = _mapNode.get();
-        if ( oldMapNode.valid() )
+        // move to the new terrain's clamp manager, if we're auto-clamping:
+        osg::ref_ptr<AnnotationClampManager> manager;
+        if ( _clampManager.lock(manager) )
         {
-            if ( _autoClampCallback )
-            {
-                oldMapNode->getTerrain()->removeTerrainCallback( _autoClampCallback.get() );
-                if ( mapNode )
-                    mapNode->getTerrain()->addTerrainCallback( _autoClampCallback.get() );
-            }
-        }		
+            manager->remove( this );
+            _clampManager = mapNode ? AnnotationClampManager::getOrCreate( mapNode->getTerrain() ) : 0L;
+            if ( _clampManager.valid() )
+                _clampManager->add( this );
+        }
 
         _mapNode = mapNode;
 
@@ -165,14 +167,16 @@ AnnotationNode::setCPUAutoClamping( bool value )
 
             if ( AnnotationSettings::getContinuousClamping() )
             {
-                _autoClampCallback = new AutoClampCallback( this );
-                getMapNode()->getTerrain()->addTerrainCallback( _autoClampCallback.get() );
+                // one shared terrain callback clamps every annotation under a new tile.
+                _clampManager = AnnotationClampManager::getOrCreate( getMapNode()->getTerrain() );
+                if ( _clampManager.valid() )
+                    _clampManager->add( this );
             }
         }
-        else if ( _autoclamp && !value && _autoClampCallback.valid())
+        else if ( _autoclamp && !value && _clampManager.valid() )
         {
-            getMapNode()->getTerrain()->removeTerrainCallback( _autoClampCallback );
-            _autoClampCallback = 0;
+            _clampManager->remove( this );
+            _clampManager = 0L;
         }
 
         _autoclamp = value;
@@ -201,6 +205,14 @@ AnnotationNode::setCPUAutoClamping( bool value )
     }
 }
 
+void
+AnnotationNode::dirtyClampExtent()
+{
+    osg::ref_ptr<AnnotationClampManager> manager;
+    if ( _clampManager.lock(manager) )
+        manager->update( this );
+}
+
 void
 AnnotationNode::setDepthAdjustment( bool enable )
 {
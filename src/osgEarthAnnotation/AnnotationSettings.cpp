@@ -28,3 +28,4 @@ bool AnnotationSettings::_continuousClamping = true;
 bool AnnotationSettings::_autoDepthOffset = true;
 double AnnotationSettings::_occlusionCullingMaxElevation = 200000.0;
 double AnnotationSettings::_occlusionCullingHeightAdjustment = 5.0;
+bool AnnotationSettings::_occlusionQueries = true;
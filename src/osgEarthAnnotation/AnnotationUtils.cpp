@@ -20,6 +20,7 @@
 #include <osgEarthAnnotation/AnnotationUtils>
 #include <osgEarthSymbology/Color>
 #include <osgEarthSymbology/MeshSubdivider>
+#include <osgEarthSymbology/IconAtlas>
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/VirtualProgram>
@@ -178,18 +179,31 @@ AnnotationUtils::createImageGeometry(osg::Image*       image,
     if ( !image )
         return 0L;
 
-    osg::Texture2D* texture = new osg::Texture2D();
-    texture->setFilter(osg::Texture::MIN_FILTER,osg::Texture::LINEAR_MIPMAP_LINEAR);
-    texture->setFilter(osg::Texture::MAG_FILTER,osg::Texture::LINEAR);
-    texture->setResizeNonPowerOfTwoHint(false);
-    texture->setImage( image );
+    // if the icon atlas takes the image, share its page state so that icons
+    // on the same page can be drawn together.
+    IconAtlas::Entry atlas;
+    bool useAtlas = textureUnit == 0 && IconAtlas::instance()->getOrAdd( image, atlas );
 
-    // set up the decoration.
-    osg::StateSet* dstate = new osg::StateSet;
-    dstate->setMode(GL_CULL_FACE,osg::StateAttribute::OFF);
-    dstate->setMode(GL_LIGHTING,osg::StateAttribute::OFF);
-    //dstate->setMode(GL_BLEND, 1); // redundant. AnnotationNode sets blending.
-    dstate->setTextureAttributeAndModes(0, texture,osg::StateAttribute::ON);   
+    osg::StateSet* dstate = 0L;
+    if ( useAtlas )
+    {
+        dstate = atlas._stateSet.get();
+    }
+    else
+    {
+        osg::Texture2D* texture = new osg::Texture2D();
+        texture->setFilter(osg::Texture::MIN_FILTER,osg::Texture::LINEAR_MIPMAP_LINEAR);
+        texture->setFilter(osg::Texture::MAG_FILTER,osg::Texture::LINEAR);
+        texture->setResizeNonPowerOfTwoHint(false);
+        texture->setImage( image );
+
+        // set up the decoration.
+        dstate = new osg::StateSet;
+        dstate->setMode(GL_CULL_FACE,osg::StateAttribute::OFF);
+        dstate->setMode(GL_LIGHTING,osg::StateAttribute::OFF);
+        //dstate->setMode(GL_BLEND, 1); // redundant. AnnotationNode sets blending.
+        dstate->setTextureAttributeAndModes(0, texture,osg::StateAttribute::ON);   
+    }
 
     // set up the geoset.
     osg::Geometry* geom = new osg::Geometry();
@@ -219,11 +233,18 @@ AnnotationUtils::createImageGeometry(osg::Image*       image,
     if ( verts->getVertexBufferObject() )
         verts->getVertexBufferObject()->setUsage(GL_STATIC_DRAW_ARB);
 
+    osg::Vec2f t0( 0, 0 ), t1( 1, 1 );
+    if ( useAtlas )
+    {
+        t0 = atlas._minUV;
+        t1 = atlas._maxUV;
+    }
+
     osg::Vec2Array* tcoords = new osg::Vec2Array(4);
-    (*tcoords)[0].set(0, 0);
-    (*tcoords)[1].set(1, 0);
-    (*tcoords)[2].set(1, 1);
-    (*tcoords)[3].set(0, 1);
+    (*tcoords)[0].set(t0.x(), t0.y());
+    (*tcoords)[1].set(t1.x(), t0.y());
+    (*tcoords)[2].set(t1.x(), t1.y());
+    (*tcoords)[3].set(t0.x(), t1.y());
     geom->setTexCoordArray(textureUnit,tcoords);
 
     osg::Vec4Array* colors = new osg::Vec4Array(1);
@@ -40,6 +40,9 @@
 
 #define LC "[FeatureNode] "
 
+// maximum number of newly added terrain tiles to clamp to in one frame
+#define MAX_CLAMP_TILES_PER_FRAME 2
+
 using namespace osgEarth;
 using namespace osgEarth::Annotation;
 using namespace osgEarth::Features;
@@ -67,6 +70,8 @@ FeatureNode::init()
 
     // if there is existing geometry, kill it
     this->removeChildren( 0, this->getNumChildren() );
+    clearPendingTiles();
+    _featureExtent = GeoExtent::INVALID;
 
     if ( !getMapNode() )
         return;
@@ -148,8 +153,12 @@ FeatureNode::init()
                 // The polytope will ensure we only clamp to intersecting tiles:
                 _feature->getWorldBoundingPolytope( getMapNode()->getMapSRS(), _featurePolytope );
 
-                // activate the terrain callback:
+                // ..and the extent lets us clamp only the vertices under a new tile:
+                _featureExtent = extent.transform( getMapNode()->getMapSRS() );
+
+                // activate the terrain callback (and re-index if it was already active):
                 setCPUAutoClamping( true );
+                dirtyClampExtent();
 
                 // set default lighting based on whether we are extruding:
                 setLightingIfNotSet( _feature->style()->has<ExtrusionSymbol>() );
@@ -204,18 +213,80 @@ FeatureNode::getAttachPoint()
 }
 
 
+bool
+FeatureNode::getClampExtent( GeoExtent& out_extent ) const
+{
+    out_extent = _featureExtent;
+    return _featureExtent.isValid();
+}
+
 // This will be called by AnnotationNode when a new terrain tile comes in.
+// Rather than clamping right away, queue the tile; the update traversal clamps
+// the vertices under a few queued tiles each frame.
 void
 FeatureNode::reclamp( const TileKey& key, osg::Node* tile, const Terrain* )
 {
-    if ( _featurePolytope.contains( tile->getBound() ) )
+    if ( !_featurePolytope.contains( tile->getBound() ) )
+        return;
+
+    if ( _featureExtent.isValid() && !_featureExtent.intersects(key.getExtent()) )
+        return;
+
+    // a tile that's already queued just picks up the new node.
+    for( std::list<PendingTile>::iterator i = _pendingTiles.begin(); i != _pendingTiles.end(); ++i )
+    {
+        if ( i->_key == key )
+        {
+            i->_tile = tile;
+            return;
+        }
+    }
+
+    if ( _pendingTiles.empty() )
+        ADJUST_UPDATE_TRAV_COUNT( this, 1 );
+
+    PendingTile pending;
+    pending._key  = key;
+    pending._tile = tile;
+    _pendingTiles.push_back( pending );
+}
+
+void
+FeatureNode::traverse( osg::NodeVisitor& nv )
+{
+    if ( nv.getVisitorType() == nv.UPDATE_VISITOR && !_pendingTiles.empty() )
+    {
+        for( unsigned n = 0; n < MAX_CLAMP_TILES_PER_FRAME && !_pendingTiles.empty(); ++n )
+        {
+            PendingTile pending = _pendingTiles.front();
+            _pendingTiles.pop_front();
+
+            // the tile may have paged out in the meantime; its replacement
+            // will come through reclamp() on its own.
+            osg::ref_ptr<osg::Node> tile;
+            if ( pending._tile.lock(tile) )
+                clampMesh( tile.get(), pending._key.getExtent() );
+        }
+
+        if ( _pendingTiles.empty() )
+            ADJUST_UPDATE_TRAV_COUNT( this, -1 );
+    }
+
+    AnnotationNode::traverse( nv );
+}
+
+void
+FeatureNode::clearPendingTiles()
+{
+    if ( !_pendingTiles.empty() )
     {
-        clampMesh( tile );
+        _pendingTiles.clear();
+        ADJUST_UPDATE_TRAV_COUNT( this, -1 );
     }
 }
 
 void
-FeatureNode::clampMesh( osg::Node* terrainModel )
+FeatureNode::clampMesh( osg::Node* terrainModel, const GeoExtent& extent )
 {
     if ( getMapNode() )
     {
@@ -233,6 +304,7 @@ FeatureNode::clampMesh( osg::Node* terrainModel )
         }
 
         MeshClamper clamper( terrainModel, getMapNode()->getMapSRS(), getMapNode()->isGeocentric(), relative, scale, offset );
+        clamper.setClampingExtent( extent );
         this->accept( clamper );
 
         this->dirtyBound();
@@ -0,0 +1,466 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthAnnotation/LabelBatch>
+#include <osgEarthAnnotation/AnnotationUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/VirtualProgram>
+#include <osgEarthSymbology/Color>
+#include <osg/Depth>
+#include <algorithm>
+#include <cfloat>
+
+#define LC "[LabelBatch] "
+
+// vertex attribute slots for the per-vertex pixel offset and visibility flag
+#define ATTR_OFFSET  osg::Drawable::ATTRIBUTE_6
+#define ATTR_VISIBLE osg::Drawable::ATTRIBUTE_7
+
+// glyph resolution requested from the font
+#define GLYPH_RESOLUTION 32
+
+// size of a declutter bitmap cell, in pixels
+#define OCCUPANCY_CELL_SIZE 4
+
+using namespace osgEarth;
+using namespace osgEarth::Annotation;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    const char* s_labelVertex =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+        "attribute vec2 oe_label_offset; \n"
+        "attribute float oe_label_visible; \n"
+        "uniform vec2 oe_label_viewport; \n"
+        "varying vec2 oe_label_texc; \n"
+        "void oe_label_vertex(inout vec4 VertexCLIP) \n"
+        "{ \n"
+        "    oe_label_texc = gl_MultiTexCoord0.st; \n"
+        "    if ( oe_label_visible < 0.5 ) \n"
+        "        VertexCLIP = vec4(0.0, 0.0, -2.0, 1.0); \n" // collapse hidden quads
+        "    else \n"
+        "        VertexCLIP.xy += oe_label_offset * 2.0 * VertexCLIP.w / oe_label_viewport; \n"
+        "} \n";
+
+    const char* s_labelFragment =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+        "uniform sampler2D oe_label_tex; \n"
+        "varying vec2 oe_label_texc; \n"
+        "void oe_label_fragment(inout vec4 color) \n"
+        "{ \n"
+        "    color.a *= texture2D(oe_label_tex, oe_label_texc).a; \n"
+        "} \n";
+
+    struct SortByPriority
+    {
+        SortByPriority( const std::vector<float>& p ) : _p(p) { }
+        bool operator()( unsigned lhs, unsigned rhs ) const { return _p[lhs] > _p[rhs]; }
+        const std::vector<float>& _p;
+    };
+}
+
+//------------------------------------------------------------------------
+
+LabelBatch::LabelBatch( const TextSymbol* symbol ) :
+_size       ( 16.0f ),
+_color      ( Color::White ),
+_alignment  ( TextSymbol::ALIGN_BASE_LINE ),
+_encoding   ( osgText::String::ENCODING_UNDEFINED ),
+_declutter  ( true ),
+_orderDirty ( false )
+{
+    if ( symbol )
+    {
+        if ( symbol->font().isSet() )
+            _font = osgText::readFontFile( *symbol->font() );
+        if ( symbol->size().isSet() )
+            _size = *symbol->size();
+        if ( symbol->fill().isSet() )
+            _color = symbol->fill()->color();
+        if ( symbol->pixelOffset().isSet() )
+            _pixelOffset.set( symbol->pixelOffset()->x(), symbol->pixelOffset()->y() );
+        if ( symbol->alignment().isSet() )
+            _alignment = *symbol->alignment();
+        if ( symbol->encoding().isSet() )
+            _encoding = AnnotationUtils::convertTextSymbolEncoding( *symbol->encoding() );
+    }
+
+    if ( !_font.valid() )
+        _font = Registry::instance()->getDefaultFont();
+
+    _geode = new osg::Geode();
+    addChild( _geode.get() );
+
+    osg::StateSet* ss = getOrCreateStateSet();
+    ss->setMode( GL_LIGHTING, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED );
+    ss->setMode( GL_BLEND, osg::StateAttribute::ON );
+    ss->setMode( GL_CULL_FACE, osg::StateAttribute::OFF );
+    ss->setAttributeAndModes( new osg::Depth(osg::Depth::ALWAYS, 0.0, 1.0, false), osg::StateAttribute::ON );
+    ss->setRenderBinDetails( 99999, "RenderBin" );
+    ss->addUniform( new osg::Uniform("oe_label_tex", 0) );
+
+    VirtualProgram* vp = new VirtualProgram();
+    vp->setName( "osgEarth::LabelBatch" );
+    vp->addBindAttribLocation( "oe_label_offset",  ATTR_OFFSET );
+    vp->addBindAttribLocation( "oe_label_visible", ATTR_VISIBLE );
+    vp->setFunction( "oe_label_vertex",   s_labelVertex,   ShaderComp::LOCATION_VERTEX_CLIP );
+    vp->setFunction( "oe_label_fragment", s_labelFragment, ShaderComp::LOCATION_FRAGMENT_COLORING );
+    ss->setAttributeAndModes( vp, osg::StateAttribute::ON );
+}
+
+osg::Geometry*
+LabelBatch::getOrCreateGeometry( osgText::Glyph* glyph, unsigned& out_index )
+{
+    const osg::Texture* texture = glyph->getTexture();
+
+    std::map<const osg::Texture*, unsigned>::const_iterator i = _geomIndex.find( texture );
+    if ( i != _geomIndex.end() )
+    {
+        out_index = i->second;
+        return _geoms[out_index];
+    }
+
+    osg::Geometry* geom = new osg::Geometry();
+    geom->setUseVertexBufferObjects( true );
+    geom->setUseDisplayList( false );
+    geom->setDataVariance( _declutter ? osg::Object::DYNAMIC : osg::Object::STATIC );
+
+    geom->setVertexArray( new osg::Vec3Array() );
+    geom->setTexCoordArray( 0, new osg::Vec2Array() );
+
+    geom->setVertexAttribArray( ATTR_OFFSET, new osg::Vec2Array() );
+    geom->setVertexAttribBinding( ATTR_OFFSET, osg::Geometry::BIND_PER_VERTEX );
+    geom->setVertexAttribArray( ATTR_VISIBLE, new osg::FloatArray() );
+    geom->setVertexAttribBinding( ATTR_VISIBLE, osg::Geometry::BIND_PER_VERTEX );
+
+    osg::Vec4Array* colors = new osg::Vec4Array();
+    colors->push_back( _color );
+    geom->setColorArray( colors );
+    geom->setColorBinding( osg::Geometry::BIND_OVERALL );
+
+    geom->addPrimitiveSet( new osg::DrawElementsUInt(GL_TRIANGLES) );
+
+    geom->getOrCreateStateSet()->setTextureAttributeAndModes(
+        0, const_cast<osg::Texture*>(texture), osg::StateAttribute::ON );
+
+    out_index = _geoms.size();
+    _geoms.push_back( geom );
+    _geomIndex[texture] = out_index;
+    _geode->addDrawable( geom );
+    return geom;
+}
+
+unsigned
+LabelBatch::addLabel( const std::string& text, const osg::Vec3d& anchor, float priority )
+{
+    Label label;
+    label._anchor   = anchor;
+    label._priority = priority;
+    label._visible  = true;
+
+    // lay out the glyph quads in pixels, with the origin on the baseline.
+    struct Quad
+    {
+        osgText::Glyph* _glyph;
+        osg::Vec2f      _min, _max;
+    };
+    std::vector<Quad> quads;
+
+    osg::Vec2f lo( FLT_MAX, FLT_MAX ), hi( -FLT_MAX, -FLT_MAX );
+    float cursor = 0.0f;
+
+    osgText::String str( text, _encoding );
+    osgText::FontResolution resolution( GLYPH_RESOLUTION, GLYPH_RESOLUTION );
+
+    for( osgText::String::const_iterator c = str.begin(); c != str.end() && _font.valid(); ++c )
+    {
+        osgText::Glyph* glyph = _font->getGlyph( resolution, *c );
+        if ( !glyph )
+            continue;
+
+        const osg::Vec2& bearing = glyph->getHorizontalBearing();
+
+        Quad quad;
+        quad._glyph = glyph;
+        quad._min.set( cursor + bearing.x()*_size, bearing.y()*_size );
+        quad._max.set( quad._min.x() + glyph->getWidth()*_size, quad._min.y() + glyph->getHeight()*_size );
+        quads.push_back( quad );
+
+        lo.set( osg::minimum(lo.x(), quad._min.x()), osg::minimum(lo.y(), quad._min.y()) );
+        hi.set( osg::maximum(hi.x(), quad._max.x()), osg::maximum(hi.y(), quad._max.y()) );
+
+        cursor += glyph->getHorizontalAdvance() * _size;
+    }
+
+    if ( quads.empty() )
+    {
+        label._min = label._max = _pixelOffset;
+        _labels.push_back( label );
+        _orderDirty = true;
+        return _labels.size()-1;
+    }
+
+    // shift the layout for the alignment.
+    osg::Vec2f shift = _pixelOffset;
+
+    switch( _alignment )
+    {
+    case TextSymbol::ALIGN_CENTER_TOP:
+    case TextSymbol::ALIGN_CENTER_CENTER:
+    case TextSymbol::ALIGN_CENTER_BOTTOM:
+    case TextSymbol::ALIGN_CENTER_BASE_LINE:
+    case TextSymbol::ALIGN_CENTER_BOTTOM_BASE_LINE:
+        shift.x() -= 0.5f*(lo.x() + hi.x()); break;
+    case TextSymbol::ALIGN_RIGHT_TOP:
+    case TextSymbol::ALIGN_RIGHT_CENTER:
+    case TextSymbol::ALIGN_RIGHT_BOTTOM:
+    case TextSymbol::ALIGN_RIGHT_BASE_LINE:
+    case TextSymbol::ALIGN_RIGHT_BOTTOM_BASE_LINE:
+        shift.x() -= hi.x(); break;
+    default:
+        shift.x() -= lo.x(); break;
+    }
+
+    switch( _alignment )
+    {
+    case TextSymbol::ALIGN_LEFT_TOP:
+    case TextSymbol::ALIGN_CENTER_TOP:
+    case TextSymbol::ALIGN_RIGHT_TOP:
+        shift.y() -= hi.y(); break;
+    case TextSymbol::ALIGN_LEFT_CENTER:
+    case TextSymbol::ALIGN_CENTER_CENTER:
+    case TextSymbol::ALIGN_RIGHT_CENTER:
+        shift.y() -= 0.5f*(lo.y() + hi.y()); break;
+    case TextSymbol::ALIGN_LEFT_BOTTOM:
+    case TextSymbol::ALIGN_CENTER_BOTTOM:
+    case TextSymbol::ALIGN_RIGHT_BOTTOM:
+        shift.y() -= lo.y(); break;
+    default:
+        break; // base line
+    }
+
+    label._min = lo + shift;
+    label._max = hi + shift;
+
+    // append the quads to the geometry of their glyph textures.
+    for( std::vector<Quad>::const_iterator q = quads.begin(); q != quads.end(); ++q )
+    {
+        unsigned index;
+        osg::Geometry* geom = getOrCreateGeometry( q->_glyph, index );
+
+        osg::Vec3Array*  verts   = static_cast<osg::Vec3Array*>( geom->getVertexArray() );
+        osg::Vec2Array*  texc    = static_cast<osg::Vec2Array*>( geom->getTexCoordArray(0) );
+        osg::Vec2Array*  offsets = static_cast<osg::Vec2Array*>( geom->getVertexAttribArray(ATTR_OFFSET) );
+        osg::FloatArray* visible = static_cast<osg::FloatArray*>( geom->getVertexAttribArray(ATTR_VISIBLE) );
+        osg::DrawElementsUInt* de = static_cast<osg::DrawElementsUInt*>( geom->getPrimitiveSet(0) );
+
+        unsigned first = verts->size();
+        osg::Vec2f lo = q->_min + shift, hi = q->_max + shift;
+        const osg::Vec2& tmin = q->_glyph->getMinTexCoord();
+        const osg::Vec2& tmax = q->_glyph->getMaxTexCoord();
+
+        for( unsigned k = 0; k < 4; ++k )
+            verts->push_back( anchor );
+
+        offsets->push_back( osg::Vec2f(lo.x(), lo.y()) );
+        offsets->push_back( osg::Vec2f(hi.x(), lo.y()) );
+        offsets->push_back( osg::Vec2f(hi.x(), hi.y()) );
+        offsets->push_back( osg::Vec2f(lo.x(), hi.y()) );
+
+        texc->push_back( osg::Vec2f(tmin.x(), tmin.y()) );
+        texc->push_back( osg::Vec2f(tmax.x(), tmin.y()) );
+        texc->push_back( osg::Vec2f(tmax.x(), tmax.y()) );
+        texc->push_back( osg::Vec2f(tmin.x(), tmax.y()) );
+
+        visible->insert( visible->end(), 4, 1.0f );
+
+        de->push_back( first );   de->push_back( first+1 ); de->push_back( first+2 );
+        de->push_back( first );   de->push_back( first+2 ); de->push_back( first+3 );
+
+        // extend the last span if it's in the same geometry.
+        if ( !label._spans.empty() && label._spans.back()._geometry == index &&
+             label._spans.back()._first + label._spans.back()._count == first )
+        {
+            label._spans.back()._count += 4;
+        }
+        else
+        {
+            Span span;
+            span._geometry = index;
+            span._first    = first;
+            span._count    = 4;
+            label._spans.push_back( span );
+        }
+
+        verts->dirty();
+        texc->dirty();
+        offsets->dirty();
+        visible->dirty();
+        de->dirty();
+        geom->dirtyBound();
+    }
+
+    _labels.push_back( label );
+    _orderDirty = true;
+    return _labels.size()-1;
+}
+
+void
+LabelBatch::setLabelVisible( unsigned index, bool visible )
+{
+    if ( index >= _labels.size() || _labels[index]._visible == visible )
+        return;
+
+    Label& label = _labels[index];
+    label._visible = visible;
+
+    for( std::vector<Span>::const_iterator s = label._spans.begin(); s != label._spans.end(); ++s )
+    {
+        osg::FloatArray* flags = static_cast<osg::FloatArray*>( _geoms[s->_geometry]->getVertexAttribArray(ATTR_VISIBLE) );
+        std::fill( flags->begin() + s->_first, flags->begin() + s->_first + s->_count, visible ? 1.0f : 0.0f );
+        flags->dirty();
+    }
+}
+
+bool
+LabelBatch::getLabelVisible( unsigned index ) const
+{
+    return index < _labels.size() && _labels[index]._visible;
+}
+
+void
+LabelBatch::setDeclutter( bool value )
+{
+    _declutter = value;
+    for( unsigned i = 0; i < _geoms.size(); ++i )
+        _geoms[i]->setDataVariance( value ? osg::Object::DYNAMIC : osg::Object::STATIC );
+}
+
+void
+LabelBatch::declutter( osgUtil::CullVisitor* cv )
+{
+    const osg::Viewport* vp = cv->getCurrentCamera()->getViewport();
+    if ( !vp )
+        return;
+
+    if ( _orderDirty )
+    {
+        std::vector<float> priorities( _labels.size() );
+        _order.resize( _labels.size() );
+        for( unsigned i = 0; i < _labels.size(); ++i )
+        {
+            priorities[i] = _labels[i]._priority;
+            _order[i]     = i;
+        }
+        std::stable_sort( _order.begin(), _order.end(), SortByPriority(priorities) );
+        _orderDirty = false;
+    }
+
+    // coarse bitmap of the occupied screen cells:
+    int cols = (int)vp->width()  / OCCUPANCY_CELL_SIZE + 1;
+    int rows = (int)vp->height() / OCCUPANCY_CELL_SIZE + 1;
+    _occupied.assign( cols*rows, 0 );
+
+    osg::Matrixd mvpw = *cv->getMVPW();
+
+    for( std::vector<unsigned>::const_iterator i = _order.begin(); i != _order.end(); ++i )
+    {
+        const Label& label = _labels[*i];
+
+        // labels behind the eye are hidden outright.
+        osg::Vec4d clip = osg::Vec4d(label._anchor, 1.0) * mvpw;
+        if ( clip.w() <= 0.0 )
+        {
+            setLabelVisible( *i, false );
+            continue;
+        }
+
+        double x = clip.x()/clip.w() - vp->x(), y = clip.y()/clip.w() - vp->y();
+        int c0 = (int)floor((x + label._min.x()) / OCCUPANCY_CELL_SIZE);
+        int c1 = (int)floor((x + label._max.x()) / OCCUPANCY_CELL_SIZE);
+        int r0 = (int)floor((y + label._min.y()) / OCCUPANCY_CELL_SIZE);
+        int r1 = (int)floor((y + label._max.y()) / OCCUPANCY_CELL_SIZE);
+
+        // off-screen labels can't conflict with anything visible.
+        if ( c1 < 0 || r1 < 0 || c0 >= cols || r0 >= rows )
+        {
+            setLabelVisible( *i, true );
+            continue;
+        }
+
+        c0 = osg::maximum(c0, 0); c1 = osg::minimum(c1, cols-1);
+        r0 = osg::maximum(r0, 0); r1 = osg::minimum(r1, rows-1);
+
+        bool clear = true;
+        for( int r = r0; r <= r1 && clear; ++r )
+            for( int c = c0; c <= c1 && clear; ++c )
+                clear = _occupied[r*cols + c] == 0;
+
+        if ( clear )
+        {
+            for( int r = r0; r <= r1; ++r )
+                std::fill( _occupied.begin() + r*cols + c0, _occupied.begin() + r*cols + c1 + 1, 1 );
+        }
+
+        setLabelVisible( *i, clear );
+    }
+}
+
+void
+LabelBatch::traverse( osg::NodeVisitor& nv )
+{
+    if ( nv.getVisitorType() == nv.CULL_VISITOR )
+    {
+        osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>( &nv );
+        osg::Camera* camera = cv->getCurrentCamera();
+
+        if ( _declutter )
+            declutter( cv );
+
+        // the shader needs the viewport size to convert pixel offsets.
+        osg::ref_ptr<osg::StateSet>& ss = _perCameraStateSet.get( camera );
+        if ( !ss.valid() )
+        {
+            ss = new osg::StateSet();
+            ss->addUniform( new osg::Uniform(osg::Uniform::FLOAT_VEC2, "oe_label_viewport") );
+        }
+        const osg::Viewport* vp = camera->getViewport();
+        if ( vp )
+            ss->getUniform( "oe_label_viewport" )->set( osg::Vec2f(vp->width(), vp->height()) );
+
+        // the glyph quads extend past the anchors' bounds, which can be a point;
+        // so don't let small-feature culling discard them.
+        cv->pushStateSet( ss.get() );
+        cv->pushCurrentMask();
+        cv->getCurrentCullingSet().setCullingMask(
+            cv->getCurrentCullingSet().getCullingMask() & ~osg::CullSettings::SMALL_FEATURE_CULLING );
+
+        osg::Group::traverse( nv );
+
+        cv->popCurrentMask();
+        cv->popStateSet();
+    }
+    else
+    {
+        osg::Group::traverse( nv );
+    }
+}
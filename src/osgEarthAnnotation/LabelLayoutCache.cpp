@@ -0,0 +1,149 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthAnnotation/LabelLayoutCache>
+#include <osgEarthAnnotation/AnnotationUtils>
+
+#define LC "[LabelLayoutCache] "
+
+using namespace osgEarth;
+using namespace osgEarth::Annotation;
+using namespace osgEarth::Symbology;
+
+//------------------------------------------------------------------------
+
+LabelLayoutCache*
+LabelLayoutCache::instance()
+{
+    static osg::ref_ptr<LabelLayoutCache> s_cache;
+    static Threading::Mutex               s_cacheMutex;
+
+    if ( !s_cache.valid() )
+    {
+        Threading::ScopedMutexLock lock( s_cacheMutex );
+        if ( !s_cache.valid() ) // double-check
+            s_cache = new LabelLayoutCache();
+    }
+    return s_cache.get();
+}
+
+LabelLayoutCache::LabelLayoutCache() :
+_maxEntries( 8192 ),
+_queries   ( 0 ),
+_hits      ( 0 )
+{
+    //nop
+}
+
+void
+LabelLayoutCache::setMaxEntries( unsigned value )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _maxEntries = value;
+    evict();
+}
+
+std::string
+LabelLayoutCache::getLayoutKey( const TextSymbol* symbol )
+{
+    return symbol ? symbol->getConfig().toJSON(false) : std::string();
+}
+
+bool
+LabelLayoutCache::getOrCreate(const std::string&           text,
+                              const TextSymbol*            symbol,
+                              osg::ref_ptr<osg::Drawable>& output,
+                              const std::string&           layoutKey )
+{
+    std::string key = text;
+    key += '\n';
+    key += layoutKey.empty() ? getLayoutKey(symbol) : layoutKey;
+
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        ++_queries;
+
+        EntryMap::iterator i = _entries.find( key );
+        if ( i != _entries.end() )
+        {
+            ++_hits;
+            _lru.splice( _lru.end(), _lru, i->second._lru );
+            output = i->second._drawable.get();
+            return true;
+        }
+    }
+
+    // lay out the text outside the lock.
+    osg::ref_ptr<osg::Drawable> drawable = AnnotationUtils::createTextDrawable( text, symbol, osg::Vec3(0,0,0) );
+    if ( !drawable.valid() )
+        return false;
+
+    // compute the bounds now, so threads sharing the drawable never race to.
+    drawable->getBound();
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    // another thread may have laid out the same label in the meantime;
+    // keep the first one so everyone shares it.
+    EntryMap::iterator i = _entries.find( key );
+    if ( i != _entries.end() )
+    {
+        output = i->second._drawable.get();
+        return true;
+    }
+
+    Entry& entry    = _entries[key];
+    entry._drawable = drawable.get();
+    entry._lru      = _lru.insert( _lru.end(), key );
+    output          = drawable.get();
+
+    evict();
+    return true;
+}
+
+void
+LabelLayoutCache::evict()
+{
+    // never evict the most recent entry.
+    while( _entries.size() > _maxEntries && _lru.size() > 1 )
+    {
+        _entries.erase( _lru.front() );
+        _lru.pop_front();
+    }
+}
+
+LabelLayoutCache::Stats
+LabelLayoutCache::getStats() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    Stats stats;
+    stats._entries = _entries.size();
+    stats._queries = _queries;
+    stats._hits    = _hits;
+    return stats;
+}
+
+void
+LabelLayoutCache::clear()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _entries.clear();
+    _lru.clear();
+    _queries = 0;
+    _hits    = 0;
+}
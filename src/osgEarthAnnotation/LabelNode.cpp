@@ -84,6 +84,21 @@ OrthoNode( mapNode, GeoPoint::INVALID )
     init( style );
 }
 
+LabelNode::LabelNode(MapNode*            mapNode,
+                     const GeoPoint&     position,
+                     const std::string&  text,
+                     const Style&        style,
+                     LabelLayoutCache*   layoutCache,
+                     const std::string&  layoutKey ) :
+
+OrthoNode   ( mapNode, position ),
+_text       ( text ),
+_layoutCache( layoutCache ),
+_layoutKey  ( layoutKey )
+{
+    init( style );
+}
+
 void
 LabelNode::init( const Style& style )
 {
@@ -105,6 +120,14 @@ LabelNode::setText( const std::string& text )
         return;
     }
 
+    // never modify a shared drawable; fetch the one for the new text instead.
+    if ( _layoutCache.valid() && !_dynamic )
+    {
+        _text = text;
+        setStyle( _style );
+        return;
+    }
+
     osgText::Text* d = dynamic_cast<osgText::Text*>(_geode->getDrawable(0));
     if ( d )
     {
@@ -125,6 +148,11 @@ LabelNode::setStyle( const Style& style )
     
     this->clearDecoration();
 
+    // the layout key was made for the original style, so a restyled label
+    // gets a private drawable.
+    if ( _layoutCache.valid() && _geode->getNumDrawables() > 0 && &style != &_style )
+        _layoutCache = 0L;
+
     _geode->removeDrawables( 0, _geode->getNumDrawables() );
 
     _style = style;
@@ -134,8 +162,10 @@ LabelNode::setStyle( const Style& style )
     if ( _text.empty() )
         _text = symbol->content()->eval();
 
-    osg::Drawable* t = AnnotationUtils::createTextDrawable( _text, symbol, osg::Vec3(0,0,0) );
-    _geode->addDrawable(t);
+    osg::ref_ptr<osg::Drawable> t;
+    if ( !_layoutCache.valid() || _dynamic || !_layoutCache->getOrCreate(_text, symbol, t, _layoutKey) )
+        t = AnnotationUtils::createTextDrawable( _text, symbol, osg::Vec3(0,0,0) );
+    _geode->addDrawable( t.get() );
 
     applyStyle( _style );
 
@@ -163,6 +193,15 @@ LabelNode::setDynamic( bool dynamic )
 {
     OrthoNode::setDynamic( dynamic );
 
+    // a dynamic label changes its drawable, so it can't share one.
+    if ( dynamic && _layoutCache.valid() )
+    {
+        _layoutCache = 0L;
+        setStyle( _style );
+        if ( getAnnotationData() )
+            setAnnotationData( getAnnotationData() );
+    }
+
     osgText::Text* d = dynamic_cast<osgText::Text*>(_geode->getDrawable(0));
     if ( d )
     {
@@ -123,6 +123,8 @@ LocalizedNode::setPosition( const GeoPoint& pos )
             _mapPosition = pos;
         }
 
+        dirtyClampExtent();
+
         // make sure the node is set up for auto-z-update if necessary:
         configureForAltitudeMode( _mapPosition.altitudeMode() );
 
@@ -248,6 +250,16 @@ LocalizedNode::reclamp( const TileKey& key, osg::Node* tile, const Terrain* terr
     }
 }
 
+bool
+LocalizedNode::getClampExtent( GeoExtent& out_extent ) const
+{
+    if ( !_mapPosition.isValid() )
+        return false;
+
+    out_extent = GeoExtent( _mapPosition.getSRS(), _mapPosition.x(), _mapPosition.y(), _mapPosition.x(), _mapPosition.y() );
+    return true;
+}
+
 
 osg::Node*
 LocalizedNode::applyAltitudePolicy(osg::Node* node, const Style& style)
@@ -24,11 +24,11 @@
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/CullingUtils>
 #include <osgEarth/MapNode>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
 #include <osgText/Text>
 #include <osg/ComputeBoundsVisitor>
 #include <osgUtil/IntersectionVisitor>
-#include <osg/OcclusionQueryNode>
-#include <osg/Point>
 #include <osg/Depth>
 
 using namespace osgEarth;
@@ -36,60 +36,6 @@ using namespace osgEarth::Annotation;
 
 //------------------------------------------------------------------------
 
-namespace
-{
-    struct OrthoOQNode : public osg::OcclusionQueryNode
-    {
-        OrthoOQNode( const std::string& name ) 
-        {
-            setName( name );
-            setVisibilityThreshold(1);
-            setDebugDisplay(true);
-            setCullingActive(false);
-        }
-
-        virtual osg::BoundingSphere computeBound() const
-        {
-            {
-                // Need to make this routine thread-safe. Typically called by the update
-                //   Visitor, or just after the update traversal, but could be called by
-                //   an application thread or by a non-osgViewer application.
-                Threading::ScopedMutexLock lock( _computeBoundMutex );
-
-                // This is the logical place to put this code, but the method is const. Cast
-                //   away constness to compute the bounding box and modify the query geometry.
-                OrthoOQNode* nonConstThis = const_cast<OrthoOQNode*>( this );
-
-                osg::ref_ptr<osg::Vec3Array> v = new osg::Vec3Array(1);
-                (*v)[0].set( _xform->getMatrix().getTrans() );
-
-                osg::Geometry* geom = static_cast< osg::Geometry* >( nonConstThis->_queryGeode->getDrawable( 0 ) );
-                geom->setVertexArray( v.get() );
-                geom->getPrimitiveSetList().clear();
-                geom->addPrimitiveSet( new osg::DrawArrays(GL_POINTS,0,1) );
-                nonConstThis->getQueryStateSet()->setAttributeAndModes(new osg::Point(15), 1);
-                nonConstThis->getQueryStateSet()->setBinNumber(INT_MAX);
-
-                geom = static_cast< osg::Geometry* >( nonConstThis->_debugGeode->getDrawable( 0 ) );
-                geom->setVertexArray( v.get() );
-                geom->getPrimitiveSetList().clear();
-                geom->addPrimitiveSet( new osg::DrawArrays(GL_POINTS,0,1) );
-                nonConstThis->getDebugStateSet()->setAttributeAndModes(new osg::Point(15), 1);
-                osg::Depth* d = new osg::Depth( osg::Depth::LEQUAL, 0.f, 1.f, false );
-                nonConstThis->getDebugStateSet()->setAttributeAndModes( d, osg::StateAttribute::ON | osg::StateAttribute::PROTECTED);
-                (*dynamic_cast<osg::Vec4Array*>(geom->getColorArray()))[0].set(1,0,0,1);
-            }
-
-            return Group::computeBound();
-        }
-
-        osg::MatrixTransform* _xform;
-    };
-}
-
-//------------------------------------------------------------------------
-
-
 OrthoNode::OrthoNode(MapNode*        mapNode,
                      const GeoPoint& position ) :
 
@@ -111,27 +57,17 @@ _occlusionCulling( false )
     setHorizonCulling( true );
 }
 
-//#define TRY_OQ 1
-#undef TRY_OQ
-
 void
 OrthoNode::init()
 {
     _switch = new osg::Switch();
 
-    // install it, but deactivate it until we can get it to work.
-#ifdef TRY_OQ
-    OrthoOQNode* oq = new OrthoOQNode("");
-    oq->setQueriesEnabled(true);
-    _oq = oq;
+    // occlusion query group; it acts as a plain group until occlusion
+    // culling is enabled.
+    _oq = new OcclusionQueryGroup();
+    _oq->setQueriesEnabled( false );
     _oq->addChild( _switch );
     this->addChild( _oq );
-#else
-    this->addChild( _switch );
-#endif
-
-    //_oq->addChild( _switch );
-    //this->addChild( _oq );
 
     _autoxform = new AnnotationUtils::OrthoNodeAutoTransform();
     _autoxform->setAutoRotateMode( osg::AutoTransform::ROTATE_TO_SCREEN );
@@ -266,6 +202,8 @@ OrthoNode::setPosition( const GeoPoint& position )
         _mapPosition = position;
     }
 
+    dirtyClampExtent();
+
     // make sure the node is set up for auto-z-update if necessary:
     configureForAltitudeMode( _mapPosition.altitudeMode() );
 
@@ -364,6 +302,11 @@ OrthoNode::updateTransforms( const GeoPoint& p, osg::Node* patch )
         {                                
             _occlusionCuller->setWorld( adjustOcclusionCullingPoint( world ));
         } 
+
+        if (_oq->getQueriesEnabled())
+        {
+            _oq->setQueryPoint( adjustOcclusionCullingPoint( world ) );
+        }
     }
     else
     {
@@ -459,19 +402,28 @@ OrthoNode::setOcclusionCulling( bool value )
         if ( _occlusionCulling && getMapNode() )
         {
             osg::Vec3d world = _autoxform->getPosition();
-            _occlusionCuller = new OcclusionCullingCallback( getMapNode()->getMapSRS(),  adjustOcclusionCullingPoint(world), getMapNode()->getTerrainEngine() );			
-            _occlusionCuller->setMaxElevation( getOcclusionCullingMaxElevation() );            
-            addCullCallback( _occlusionCuller.get()  );
+
+            if ( AnnotationSettings::getOcclusionQueries() && Registry::capabilities().supportsOcclusionQuery() )
+            {
+                // query the GPU with a point at the anchor; no CPU ray tests.
+                _oq->setQueryPoint( adjustOcclusionCullingPoint(world) );
+                _oq->setQueriesEnabled( true );
+            }
+            else
+            {
+                _occlusionCuller = new OcclusionCullingCallback( getMapNode()->getMapSRS(),  adjustOcclusionCullingPoint(world), getMapNode()->getTerrainEngine() );			
+                _occlusionCuller->setMaxElevation( getOcclusionCullingMaxElevation() );            
+                addCullCallback( _occlusionCuller.get()  );
+            }
         }
         else
         {
-            if (_occlusionCulling)
+            _oq->setQueriesEnabled( false );
+
+            if (_occlusionCuller.valid())
             {
-                if (_occlusionCuller.valid())
-                {
-                    removeCullCallback( _occlusionCuller.get() );
-                    _occlusionCuller = 0;
-                }
+                removeCullCallback( _occlusionCuller.get() );
+                _occlusionCuller = 0;
             }
         }
     }
@@ -505,3 +457,13 @@ OrthoNode::reclamp( const TileKey& key, osg::Node* tile, const Terrain* terrain
         updateTransforms( _mapPosition, tile );
     }
 }
+
+bool
+OrthoNode::getClampExtent( GeoExtent& out_extent ) const
+{
+    if ( !_mapPosition.isValid() )
+        return false;
+
+    out_extent = GeoExtent( _mapPosition.getSRS(), _mapPosition.x(), _mapPosition.y(), _mapPosition.x(), _mapPosition.y() );
+    return true;
+}
@@ -0,0 +1,744 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthAnnotation/TrackNodeGroup>
+#include <osgEarth/MapNode>
+#include <osgEarth/Registry>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/ImageUtils>
+#include <osgEarthSymbology/Color>
+#include <osgText/Glyph>
+#include <osgUtil/CullVisitor>
+#include <osg/Depth>
+#include <cfloat>
+#include <cstring>
+#include <cmath>
+
+#define LC "[TrackNodeGroup] "
+
+// vertex attribute slots for the per-vertex pixel offset and visibility flag
+#define ATTR_OFFSET  osg::Drawable::ATTRIBUTE_6
+#define ATTR_VISIBLE osg::Drawable::ATTRIBUTE_7
+
+// glyph resolution requested from the font
+#define GLYPH_RESOLUTION 32
+
+// range of characters held in the glyph sheet
+#define FIRST_GLYPH 32
+#define LAST_GLYPH  126
+
+// empty pixels around each glyph in the sheet
+#define GUTTER 2
+
+// glyph quads first reserved for a field value; values that outgrow
+// their slot move to a new one twice the size.
+#define INITIAL_SLOT_CAPACITY 8
+
+using namespace osgEarth;
+using namespace osgEarth::Annotation;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    const char* s_trackVertex =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+        "attribute vec2 oe_trackgroup_offset; \n"
+        "attribute float oe_trackgroup_visible; \n"
+        "uniform vec2 oe_trackgroup_viewport; \n"
+        "varying vec2 oe_trackgroup_texc; \n"
+        "void oe_trackgroup_vertex(inout vec4 VertexCLIP) \n"
+        "{ \n"
+        "    oe_trackgroup_texc = gl_MultiTexCoord0.st; \n"
+        "    if ( oe_trackgroup_visible < 0.5 ) \n"
+        "        VertexCLIP = vec4(0.0, 0.0, -2.0, 1.0); \n" // collapse hidden quads
+        "    else \n"
+        "        VertexCLIP.xy += oe_trackgroup_offset * 2.0 * VertexCLIP.w / oe_trackgroup_viewport; \n"
+        "} \n";
+
+    // icons modulate the full color; glyphs only have coverage in alpha.
+    const char* s_trackFragment =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+        "uniform sampler2D oe_trackgroup_tex; \n"
+        "uniform bool oe_trackgroup_alphaOnly; \n"
+        "varying vec2 oe_trackgroup_texc; \n"
+        "void oe_trackgroup_fragment(inout vec4 color) \n"
+        "{ \n"
+        "    vec4 texel = texture2D(oe_trackgroup_tex, oe_trackgroup_texc); \n"
+        "    if ( oe_trackgroup_alphaOnly ) \n"
+        "        color.a *= texel.a; \n"
+        "    else \n"
+        "        color *= texel; \n"
+        "} \n";
+
+    // offset that moves a layout box [lo, hi] (relative to the baseline origin)
+    // into place for a text alignment.
+    osg::Vec2f alignmentShift( TextSymbol::Alignment alignment, const osg::Vec2f& lo, const osg::Vec2f& hi )
+    {
+        osg::Vec2f shift;
+
+        switch( alignment )
+        {
+        case TextSymbol::ALIGN_CENTER_TOP:
+        case TextSymbol::ALIGN_CENTER_CENTER:
+        case TextSymbol::ALIGN_CENTER_BOTTOM:
+        case TextSymbol::ALIGN_CENTER_BASE_LINE:
+        case TextSymbol::ALIGN_CENTER_BOTTOM_BASE_LINE:
+            shift.x() = -0.5f*(lo.x() + hi.x()); break;
+        case TextSymbol::ALIGN_RIGHT_TOP:
+        case TextSymbol::ALIGN_RIGHT_CENTER:
+        case TextSymbol::ALIGN_RIGHT_BOTTOM:
+        case TextSymbol::ALIGN_RIGHT_BASE_LINE:
+        case TextSymbol::ALIGN_RIGHT_BOTTOM_BASE_LINE:
+            shift.x() = -hi.x(); break;
+        default:
+            shift.x() = -lo.x(); break;
+        }
+
+        switch( alignment )
+        {
+        case TextSymbol::ALIGN_LEFT_TOP:
+        case TextSymbol::ALIGN_CENTER_TOP:
+        case TextSymbol::ALIGN_RIGHT_TOP:
+            shift.y() = -hi.y(); break;
+        case TextSymbol::ALIGN_LEFT_CENTER:
+        case TextSymbol::ALIGN_CENTER_CENTER:
+        case TextSymbol::ALIGN_RIGHT_CENTER:
+            shift.y() = -0.5f*(lo.y() + hi.y()); break;
+        case TextSymbol::ALIGN_LEFT_BOTTOM:
+        case TextSymbol::ALIGN_CENTER_BOTTOM:
+        case TextSymbol::ALIGN_RIGHT_BOTTOM:
+            shift.y() = -lo.y(); break;
+        default:
+            break; // base line
+        }
+
+        return shift;
+    }
+
+    // appends "count" hidden quads to a geometry.
+    void appendQuads( osg::Geometry* geom, unsigned count, const osg::Vec4f& color )
+    {
+        osg::Vec3Array*  verts   = static_cast<osg::Vec3Array*>( geom->getVertexArray() );
+        osg::Vec2Array*  texc    = static_cast<osg::Vec2Array*>( geom->getTexCoordArray(0) );
+        osg::Vec2Array*  offsets = static_cast<osg::Vec2Array*>( geom->getVertexAttribArray(ATTR_OFFSET) );
+        osg::FloatArray* visible = static_cast<osg::FloatArray*>( geom->getVertexAttribArray(ATTR_VISIBLE) );
+        osg::DrawElementsUInt* de = static_cast<osg::DrawElementsUInt*>( geom->getPrimitiveSet(0) );
+
+        unsigned first = verts->size();
+        verts  ->resize( first + 4*count );
+        texc   ->resize( first + 4*count );
+        offsets->resize( first + 4*count );
+        visible->resize( first + 4*count, 0.0f );
+
+        if ( geom->getColorBinding() == osg::Geometry::BIND_PER_VERTEX )
+        {
+            osg::Vec4Array* colors = static_cast<osg::Vec4Array*>( geom->getColorArray() );
+            colors->resize( first + 4*count, color );
+            colors->dirty();
+        }
+
+        for( unsigned q = first; q < first + 4*count; q += 4 )
+        {
+            de->push_back( q );   de->push_back( q+1 ); de->push_back( q+2 );
+            de->push_back( q );   de->push_back( q+2 ); de->push_back( q+3 );
+        }
+
+        verts->dirty();
+        texc->dirty();
+        offsets->dirty();
+        visible->dirty();
+        de->dirty();
+        geom->dirtyBound();
+    }
+
+    // writes one quad's corners (in pixels) and texture rectangle.
+    void setQuad( osg::Geometry* geom, unsigned quad, const osg::Vec2f* corners,
+                  const osg::Vec2f& minUV, const osg::Vec2f& maxUV )
+    {
+        osg::Vec2Array* texc    = static_cast<osg::Vec2Array*>( geom->getTexCoordArray(0) );
+        osg::Vec2Array* offsets = static_cast<osg::Vec2Array*>( geom->getVertexAttribArray(ATTR_OFFSET) );
+
+        unsigned v = 4*quad;
+        for( unsigned k = 0; k < 4; ++k )
+            (*offsets)[v+k] = corners[k];
+
+        (*texc)[v+0].set( minUV.x(), minUV.y() );
+        (*texc)[v+1].set( maxUV.x(), minUV.y() );
+        (*texc)[v+2].set( maxUV.x(), maxUV.y() );
+        (*texc)[v+3].set( minUV.x(), maxUV.y() );
+
+        texc->dirty();
+        offsets->dirty();
+    }
+
+    void setQuadVisible( osg::Geometry* geom, unsigned quad, unsigned count, bool visible )
+    {
+        osg::FloatArray* flags = static_cast<osg::FloatArray*>( geom->getVertexAttribArray(ATTR_VISIBLE) );
+        std::fill( flags->begin() + 4*quad, flags->begin() + 4*(quad+count), visible ? 1.0f : 0.0f );
+        flags->dirty();
+    }
+}
+
+//------------------------------------------------------------------------
+
+TrackNodeGroup::TrackNodeGroup( MapNode* mapNode, const TrackNodeFieldSchema& fieldSchema ) :
+_hasOrigin( false )
+{
+    if ( mapNode )
+        _mapSRS = mapNode->getMapSRS();
+
+    // private atlas, so the group's icons all land on one texture.
+    _atlas = new IconAtlas();
+
+    osg::ref_ptr<osgText::Font> font;
+
+    for( TrackNodeFieldSchema::const_iterator i = fieldSchema.begin(); i != fieldSchema.end(); ++i )
+    {
+        const TextSymbol* symbol = i->second._symbol.get();
+
+        Field field;
+        field._size      = 16.0f;
+        field._color     = Color::White;
+        field._alignment = TextSymbol::ALIGN_LEFT_BASE_LINE;
+
+        if ( symbol )
+        {
+            if ( symbol->size().isSet() )
+                field._size = *symbol->size();
+            if ( symbol->fill().isSet() )
+                field._color = symbol->fill()->color();
+            if ( symbol->pixelOffset().isSet() )
+                field._pixelOffset.set( symbol->pixelOffset()->x(), symbol->pixelOffset()->y() );
+            if ( symbol->alignment().isSet() )
+                field._alignment = *symbol->alignment();
+
+            // all fields share one glyph sheet, so the first font wins.
+            if ( !font.valid() && symbol->font().isSet() )
+                font = osgText::readFontFile( *symbol->font() );
+        }
+
+        _fieldIndex[i->first] = _fields.size();
+        _fields.push_back( field );
+    }
+
+    _values.resize( _fields.size() );
+    _slots.resize( _fields.size() );
+
+    if ( !font.valid() )
+        font = Registry::instance()->getDefaultFont();
+
+    _xform = new osg::MatrixTransform();
+    addChild( _xform.get() );
+
+    osg::Geode* geode = new osg::Geode();
+    _xform->addChild( geode );
+
+    _iconGeom = createGeometry( false );
+    _iconGeom->getOrCreateStateSet()->setRenderBinDetails( 99998, "RenderBin" );
+    _iconGeom->getOrCreateStateSet()->addUniform( new osg::Uniform("oe_trackgroup_alphaOnly", false) );
+    geode->addDrawable( _iconGeom.get() );
+
+    _textGeom = createGeometry( true );
+    _textGeom->getOrCreateStateSet()->setRenderBinDetails( 99999, "RenderBin" );
+    _textGeom->getOrCreateStateSet()->addUniform( new osg::Uniform("oe_trackgroup_alphaOnly", true) );
+    geode->addDrawable( _textGeom.get() );
+
+    buildGlyphSheet( font.get() );
+
+    osg::StateSet* ss = getOrCreateStateSet();
+    ss->setMode( GL_LIGHTING, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED );
+    ss->setMode( GL_BLEND, osg::StateAttribute::ON );
+    ss->setMode( GL_CULL_FACE, osg::StateAttribute::OFF );
+    ss->setAttributeAndModes( new osg::Depth(osg::Depth::ALWAYS, 0.0, 1.0, false), osg::StateAttribute::ON );
+    ss->addUniform( new osg::Uniform("oe_trackgroup_tex", 0) );
+
+    VirtualProgram* vp = new VirtualProgram();
+    vp->setName( "osgEarth::TrackNodeGroup" );
+    vp->addBindAttribLocation( "oe_trackgroup_offset",  ATTR_OFFSET );
+    vp->addBindAttribLocation( "oe_trackgroup_visible", ATTR_VISIBLE );
+    vp->setFunction( "oe_trackgroup_vertex",   s_trackVertex,   ShaderComp::LOCATION_VERTEX_CLIP );
+    vp->setFunction( "oe_trackgroup_fragment", s_trackFragment, ShaderComp::LOCATION_FRAGMENT_COLORING );
+    ss->setAttributeAndModes( vp, osg::StateAttribute::ON );
+}
+
+osg::Geometry*
+TrackNodeGroup::createGeometry( bool perVertexColor )
+{
+    osg::Geometry* geom = new osg::Geometry();
+    geom->setUseVertexBufferObjects( true );
+    geom->setUseDisplayList( false );
+    geom->setDataVariance( osg::Object::DYNAMIC );
+
+    geom->setVertexArray( new osg::Vec3Array() );
+    geom->setTexCoordArray( 0, new osg::Vec2Array() );
+
+    geom->setVertexAttribArray( ATTR_OFFSET, new osg::Vec2Array() );
+    geom->setVertexAttribBinding( ATTR_OFFSET, osg::Geometry::BIND_PER_VERTEX );
+    geom->setVertexAttribArray( ATTR_VISIBLE, new osg::FloatArray() );
+    geom->setVertexAttribBinding( ATTR_VISIBLE, osg::Geometry::BIND_PER_VERTEX );
+
+    osg::Vec4Array* colors = new osg::Vec4Array();
+    if ( !perVertexColor )
+        colors->push_back( Color::White );
+    geom->setColorArray( colors );
+    geom->setColorBinding( perVertexColor ? osg::Geometry::BIND_PER_VERTEX : osg::Geometry::BIND_OVERALL );
+
+    geom->addPrimitiveSet( new osg::DrawElementsUInt(GL_TRIANGLES) );
+    return geom;
+}
+
+void
+TrackNodeGroup::buildGlyphSheet( osgText::Font* font )
+{
+    _glyphs.assign( LAST_GLYPH - FIRST_GLYPH + 1, Glyph() );
+    for( unsigned i = 0; i < _glyphs.size(); ++i )
+        _glyphs[i]._valid = false;
+
+    if ( !font )
+        return;
+
+    // gather the glyphs and the largest glyph image.
+    osgText::FontResolution resolution( GLYPH_RESOLUTION, GLYPH_RESOLUTION );
+    std::vector<osgText::Glyph*> glyphs( _glyphs.size(), (osgText::Glyph*)0L );
+    int cell = 1;
+    for( unsigned i = 0; i < _glyphs.size(); ++i )
+    {
+        glyphs[i] = font->getGlyph( resolution, FIRST_GLYPH + i );
+        if ( glyphs[i] && ImageUtils::PixelReader::supports(glyphs[i]) )
+            cell = osg::maximum( cell, osg::maximum(glyphs[i]->s(), glyphs[i]->t()) );
+    }
+    cell += GUTTER;
+
+    // lay the glyphs out on a grid, 16 to a row.
+    const int cols = 16;
+    const int rows = (_glyphs.size() + cols - 1) / cols;
+    int width = 1, height = 1;
+    while( width  < cols*cell ) width  <<= 1;
+    while( height < rows*cell ) height <<= 1;
+
+    osg::Image* sheet = new osg::Image();
+    sheet->allocateImage( width, height, 1, GL_ALPHA, GL_UNSIGNED_BYTE );
+    sheet->setInternalTextureFormat( GL_ALPHA );
+    ::memset( sheet->data(), 0, sheet->getTotalSizeInBytes() );
+
+    for( unsigned i = 0; i < _glyphs.size(); ++i )
+    {
+        osgText::Glyph* glyph = glyphs[i];
+        if ( !glyph )
+            continue;
+
+        Glyph& g = _glyphs[i];
+        g._advance = glyph->getHorizontalAdvance();
+
+        // glyphs with no pixels (e.g. space) only advance the cursor.
+        if ( glyph->s() < 1 || glyph->t() < 1 || !ImageUtils::PixelReader::supports(glyph) )
+        {
+            g._valid = true;
+            g._min = g._max = osg::Vec2f(0,0);
+            continue;
+        }
+
+        int x = (i % cols) * cell, y = (i / cols) * cell;
+        ImageUtils::PixelReader read( glyph );
+        for( int t = 0; t < glyph->t(); ++t )
+        {
+            unsigned char* out = sheet->data( x, y + t );
+            for( int s = 0; s < glyph->s(); ++s )
+                out[s] = (unsigned char)(read(s, t).a() * 255.0f);
+        }
+
+        const osg::Vec2& bearing = glyph->getHorizontalBearing();
+        g._valid = true;
+        g._min.set( bearing.x(), bearing.y() );
+        g._max.set( bearing.x() + glyph->getWidth(), bearing.y() + glyph->getHeight() );
+        g._minUV.set( (float)x/(float)width, (float)y/(float)height );
+        g._maxUV.set( (float)(x + glyph->s())/(float)width, (float)(y + glyph->t())/(float)height );
+    }
+
+    osg::Texture2D* tex = new osg::Texture2D( sheet );
+    tex->setFilter( osg::Texture::MIN_FILTER, osg::Texture::LINEAR );
+    tex->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
+    tex->setWrap  ( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
+    tex->setWrap  ( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE );
+    tex->setResizeNonPowerOfTwoHint( false );
+    _textGeom->getOrCreateStateSet()->setTextureAttributeAndModes( 0, tex, osg::StateAttribute::ON );
+}
+
+int
+TrackNodeGroup::addIcon( osg::Image* image )
+{
+    IconAtlas::Entry entry;
+    if ( !_atlas->getOrAdd(image, entry) )
+    {
+        OE_WARN << LC << "Icon " << (image ? image->getFileName() : "(null)") << " is too large for the atlas" << std::endl;
+        return -1;
+    }
+
+    // everything draws in one batch, so every icon must be on the first page.
+    osg::StateSet* ss = _iconGeom->getOrCreateStateSet();
+    osg::StateAttribute* tex = ss->getTextureAttribute( 0, osg::StateAttribute::TEXTURE );
+    if ( !tex )
+    {
+        ss->setTextureAttributeAndModes( 0, entry._texture.get(), osg::StateAttribute::ON );
+    }
+    else if ( tex != entry._texture.get() )
+    {
+        OE_WARN << LC << "Icon atlas is full; icon " << image->getFileName() << " ignored" << std::endl;
+        return -1;
+    }
+
+    Icon icon;
+    icon._size.set( (float)image->s(), (float)image->t() );
+    icon._minUV = entry._minUV;
+    icon._maxUV = entry._maxUV;
+    _icons.push_back( icon );
+    return _icons.size()-1;
+}
+
+bool
+TrackNodeGroup::toLocal( const GeoPoint& position, osg::Vec3f& out )
+{
+    GeoPoint mapPoint = position;
+    if ( _mapSRS.valid() && !position.transform(_mapSRS.get(), mapPoint) )
+        return false;
+
+    osg::Vec3d world;
+    if ( !mapPoint.toWorld(world) )
+        return false;
+
+    // keep the vertices in single precision by going relative to the first track.
+    if ( !_hasOrigin )
+    {
+        _origin    = world;
+        _hasOrigin = true;
+        _xform->setMatrix( osg::Matrixd::translate(_origin) );
+    }
+
+    out = world - _origin;
+    return true;
+}
+
+TrackNodeGroup::Slot
+TrackNodeGroup::allocateSlot( unsigned capacity )
+{
+    Slot slot;
+    slot._capacity = capacity;
+
+    std::map<unsigned, std::vector<unsigned> >::iterator i = _freeSlots.find( capacity );
+    if ( i != _freeSlots.end() && !i->second.empty() )
+    {
+        slot._first = i->second.back();
+        i->second.pop_back();
+        return slot;
+    }
+
+    slot._first = _textGeom->getVertexArray()->getNumElements() / 4;
+    appendQuads( _textGeom.get(), capacity, Color::White );
+    return slot;
+}
+
+unsigned
+TrackNodeGroup::addTrack( const GeoPoint& position, int icon, double heading )
+{
+    unsigned id;
+    if ( !_freeTracks.empty() )
+    {
+        id = _freeTracks.back();
+        _freeTracks.pop_back();
+    }
+    else
+    {
+        id = _positions.size();
+        _positions.push_back( osg::Vec3f() );
+        _headings.push_back( 0.0f );
+        _iconIndex.push_back( -1 );
+        _visible.push_back( 0 );
+        _used.push_back( 0 );
+        appendQuads( _iconGeom.get(), 1, Color::White );
+
+        for( unsigned f = 0; f < _fields.size(); ++f )
+        {
+            _values[f].push_back( std::string() );
+            _slots[f].push_back( allocateSlot(INITIAL_SLOT_CAPACITY) );
+        }
+    }
+
+    _used[id]      = 1;
+    _visible[id]   = 1;
+    _iconIndex[id] = icon;
+    _headings[id]  = (float)osg::DegreesToRadians( heading );
+    if ( !toLocal(position, _positions[id]) )
+        _positions[id].set( 0, 0, 0 );
+
+    for( unsigned f = 0; f < _fields.size(); ++f )
+    {
+        _values[f][id].clear();
+        writeField( f, id );
+    }
+
+    writeIcon( id );
+    writeAnchors( id );
+    writeVisibility( id );
+    return id;
+}
+
+void
+TrackNodeGroup::removeTrack( unsigned id )
+{
+    if ( id >= _used.size() || !_used[id] )
+        return;
+
+    // keep the track's quads; a later addTrack reuses them with the ID.
+    _used[id] = 0;
+    writeVisibility( id );
+    _freeTracks.push_back( id );
+}
+
+void
+TrackNodeGroup::setPosition( unsigned id, const GeoPoint& position )
+{
+    if ( id >= _used.size() || !_used[id] )
+        return;
+
+    if ( toLocal(position, _positions[id]) )
+        writeAnchors( id );
+}
+
+void
+TrackNodeGroup::setHeading( unsigned id, double heading )
+{
+    if ( id >= _used.size() || !_used[id] )
+        return;
+
+    _headings[id] = (float)osg::DegreesToRadians( heading );
+    writeIcon( id );
+}
+
+void
+TrackNodeGroup::setIcon( unsigned id, int icon )
+{
+    if ( id >= _used.size() || !_used[id] )
+        return;
+
+    _iconIndex[id] = icon;
+    writeIcon( id );
+    writeVisibility( id );
+}
+
+void
+TrackNodeGroup::setFieldValue( unsigned id, const std::string& name, const std::string& value )
+{
+    if ( id >= _used.size() || !_used[id] )
+        return;
+
+    std::map<std::string, unsigned>::const_iterator i = _fieldIndex.find( name );
+    if ( i == _fieldIndex.end() )
+        return;
+
+    unsigned f = i->second;
+    if ( _values[f][id] == value )
+        return;
+
+    _values[f][id] = value;
+
+    // move to a bigger slot if the value no longer fits.
+    Slot& slot = _slots[f][id];
+    if ( value.size() > slot._capacity )
+    {
+        setQuadVisible( _textGeom.get(), slot._first, slot._capacity, false );
+        _freeSlots[slot._capacity].push_back( slot._first );
+
+        unsigned capacity = slot._capacity;
+        while( capacity < value.size() )
+            capacity *= 2;
+        slot = allocateSlot( capacity );
+
+        writeField( f, id );
+        writeAnchors( id );
+    }
+    else
+    {
+        writeField( f, id );
+    }
+
+    writeVisibility( id );
+}
+
+void
+TrackNodeGroup::setTrackVisible( unsigned id, bool visible )
+{
+    if ( id >= _used.size() || !_used[id] || (_visible[id] != 0) == visible )
+        return;
+
+    _visible[id] = visible ? 1 : 0;
+    writeVisibility( id );
+}
+
+void
+TrackNodeGroup::writeIcon( unsigned id )
+{
+    int index = _iconIndex[id];
+    if ( index < 0 || index >= (int)_icons.size() )
+        return;
+
+    const Icon& icon = _icons[index];
+
+    // rotate the corners counter-clockwise by the heading, as IconSymbol does.
+    float c = cosf( _headings[id] ), s = sinf( _headings[id] );
+    float hw = 0.5f*icon._size.x(), hh = 0.5f*icon._size.y();
+    osg::Vec2f corners[4] = {
+        osg::Vec2f(-hw, -hh), osg::Vec2f(hw, -hh), osg::Vec2f(hw, hh), osg::Vec2f(-hw, hh) };
+
+    for( unsigned k = 0; k < 4; ++k )
+        corners[k].set( c*corners[k].x() - s*corners[k].y(), s*corners[k].x() + c*corners[k].y() );
+
+    setQuad( _iconGeom.get(), id, corners, icon._minUV, icon._maxUV );
+}
+
+void
+TrackNodeGroup::writeField( unsigned f, unsigned id )
+{
+    const Field&       field = _fields[f];
+    const Slot&        slot  = _slots[f][id];
+    const std::string& value = _values[f][id];
+
+    // lay out the glyph quads in pixels, with the origin on the baseline.
+    std::vector<const Glyph*> glyphs;
+    std::vector<float>        cursors;
+    osg::Vec2f lo( FLT_MAX, FLT_MAX ), hi( -FLT_MAX, -FLT_MAX );
+    float cursor = 0.0f;
+
+    for( unsigned i = 0; i < value.size() && glyphs.size() < slot._capacity; ++i )
+    {
+        unsigned char ch = (unsigned char)value[i];
+        if ( ch < FIRST_GLYPH || ch > LAST_GLYPH || !_glyphs[ch - FIRST_GLYPH]._valid )
+            continue;
+
+        const Glyph& g = _glyphs[ch - FIRST_GLYPH];
+        glyphs.push_back( &g );
+        cursors.push_back( cursor );
+
+        lo.set( osg::minimum(lo.x(), cursor + g._min.x()*field._size), osg::minimum(lo.y(), g._min.y()*field._size) );
+        hi.set( osg::maximum(hi.x(), cursor + g._max.x()*field._size), osg::maximum(hi.y(), g._max.y()*field._size) );
+
+        cursor += g._advance * field._size;
+    }
+
+    osg::Vec2f shift = field._pixelOffset;
+    if ( !glyphs.empty() )
+        shift += alignmentShift( field._alignment, lo, hi );
+
+    osg::Vec4Array* colors = static_cast<osg::Vec4Array*>( _textGeom->getColorArray() );
+
+    for( unsigned i = 0; i < glyphs.size(); ++i )
+    {
+        const Glyph& g = *glyphs[i];
+        osg::Vec2f gmin = osg::Vec2f(cursors[i], 0.0f) + g._min*field._size + shift;
+        osg::Vec2f gmax = osg::Vec2f(cursors[i], 0.0f) + g._max*field._size + shift;
+
+        osg::Vec2f corners[4] = {
+            osg::Vec2f(gmin.x(), gmin.y()), osg::Vec2f(gmax.x(), gmin.y()),
+            osg::Vec2f(gmax.x(), gmax.y()), osg::Vec2f(gmin.x(), gmax.y()) };
+
+        setQuad( _textGeom.get(), slot._first + i, corners, g._minUV, g._maxUV );
+
+        for( unsigned k = 0; k < 4; ++k )
+            (*colors)[4*(slot._first + i) + k] = field._color;
+    }
+    colors->dirty();
+
+    // park the unused quads of the slot on the anchor with no area.
+    osg::Vec2f zero[4];
+    for( unsigned i = glyphs.size(); i < slot._capacity; ++i )
+        setQuad( _textGeom.get(), slot._first + i, zero, osg::Vec2f(0,0), osg::Vec2f(0,0) );
+}
+
+void
+TrackNodeGroup::writeAnchors( unsigned id )
+{
+    const osg::Vec3f& anchor = _positions[id];
+
+    osg::Vec3Array* verts = static_cast<osg::Vec3Array*>( _iconGeom->getVertexArray() );
+    std::fill( verts->begin() + 4*id, verts->begin() + 4*(id+1), anchor );
+    verts->dirty();
+    _iconGeom->dirtyBound();
+
+    verts = static_cast<osg::Vec3Array*>( _textGeom->getVertexArray() );
+    for( unsigned f = 0; f < _fields.size(); ++f )
+    {
+        const Slot& slot = _slots[f][id];
+        std::fill( verts->begin() + 4*slot._first, verts->begin() + 4*(slot._first + slot._capacity), anchor );
+    }
+    verts->dirty();
+    _textGeom->dirtyBound();
+}
+
+void
+TrackNodeGroup::writeVisibility( unsigned id )
+{
+    bool visible = _used[id] && _visible[id];
+
+    int icon = _iconIndex[id];
+    setQuadVisible( _iconGeom.get(), id, 1, visible && icon >= 0 && icon < (int)_icons.size() );
+
+    for( unsigned f = 0; f < _fields.size(); ++f )
+    {
+        const Slot& slot = _slots[f][id];
+        setQuadVisible( _textGeom.get(), slot._first, slot._capacity, visible );
+    }
+}
+
+void
+TrackNodeGroup::traverse( osg::NodeVisitor& nv )
+{
+    if ( nv.getVisitorType() == nv.CULL_VISITOR )
+    {
+        osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>( &nv );
+        osg::Camera* camera = cv->getCurrentCamera();
+
+        // the shader needs the viewport size to convert pixel offsets.
+        osg::ref_ptr<osg::StateSet>& ss = _perCameraStateSet.get( camera );
+        if ( !ss.valid() )
+        {
+            ss = new osg::StateSet();
+            ss->addUniform( new osg::Uniform(osg::Uniform::FLOAT_VEC2, "oe_trackgroup_viewport") );
+        }
+        const osg::Viewport* vp = camera->getViewport();
+        if ( vp )
+            ss->getUniform( "oe_trackgroup_viewport" )->set( osg::Vec2f(vp->width(), vp->height()) );
+
+        // the quads extend past the anchors' bounds, so don't let
+        // small-feature culling discard a lone track.
+        cv->pushStateSet( ss.get() );
+        cv->pushCurrentMask();
+        cv->getCurrentCullingSet().setCullingMask(
+            cv->getCurrentCullingSet().getCullingMask() & ~osg::CullSettings::SMALL_FEATURE_CULLING );
+
+        osg::Group::traverse( nv );
+
+        cv->popCurrentMask();
+        cv->popStateSet();
+    }
+    else
+    {
+        osg::Group::traverse( nv );
+    }
+}
@@ -26,6 +26,8 @@
 #include <osgEarthSymbology/AGG.h>
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
 
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
@@ -50,6 +52,141 @@ using namespace OpenThreads;
 
 /********************************************************************/
 
+namespace
+{
+    // a feature's geometry, cropped to the image, and the image rows it covers.
+    struct Shape
+    {
+        osg::ref_ptr<Feature>  _feature;
+        osg::ref_ptr<Geometry> _geom;
+        double                 _rowMin, _rowMax;
+    };
+    typedef std::vector<Shape> Shapes;
+
+    // settings shared by every stripe of an image.
+    struct RasterParams
+    {
+        double               _xmin, _ymin, _xf, _yf;
+        osg::Vec4            _color;
+        const LineSymbol*    _masterLine;
+        const PolygonSymbol* _masterPoly;
+    };
+
+    // rasterizes the shapes that touch rows [firstRow, firstRow+numRows).
+    void rasterize(const Shapes&       shapes,
+                   const RasterParams& params,
+                   osg::Image*         image,
+                   unsigned            firstRow,
+                   unsigned            numRows)
+    {
+        unsigned stride = image->s()*4;
+        agg::rendering_buffer rbuf( image->data() + firstRow*stride, image->s(), numRows, stride );
+
+        // Create the renderer and the rasterizer
+        agg::renderer<agg::span_abgr32> ren(rbuf);
+        agg::rasterizer ras;
+
+        // Setup the rasterizer
+        ras.gamma(1.3);
+        ras.filling_rule(agg::fill_even_odd);
+
+        double yoffset = (double)firstRow;
+
+        for( Shapes::const_iterator s = shapes.begin(); s != shapes.end(); ++s )
+        {
+            if ( s->_rowMax < yoffset || s->_rowMin > yoffset + (double)numRows )
+                continue;
+
+            const Feature* feature = s->_feature.get();
+
+            // set up a default color:
+            osg::Vec4 c = params._color;
+            unsigned int a = (unsigned int)(127+(c.a()*255)/2); // scale alpha up
+            agg::rgba8 fgColor( (unsigned int)(c.r()*255), (unsigned int)(c.g()*255), (unsigned int)(c.b()*255), a );
+
+            ConstGeometryIterator gi( s->_geom.get() );
+            while( gi.hasMore() )
+            {
+                c = params._color;
+                const Geometry* g = gi.next();
+            
+                const LineSymbol* line = feature->style().isSet() ? 
+                    feature->style()->getSymbol<LineSymbol>() : params._masterLine;
+
+                const PolygonSymbol* poly =
+                    feature->style().isSet() ? feature->style()->getSymbol<PolygonSymbol>() : params._masterPoly;
+
+                if (g->getType() == Geometry::TYPE_RING || g->getType() == Geometry::TYPE_LINESTRING)
+                {
+                    if ( line )
+                        c = line->stroke()->color();
+                    else if ( poly )
+                        c = poly->fill()->color();
+                }
+
+                else if ( g->getType() == Geometry::TYPE_POLYGON )
+                {
+                    if ( poly )
+                        c = poly->fill()->color();
+                    else if ( line )
+                        c = line->stroke()->color();
+                }
+
+                a = (unsigned int)(127+(c.a()*255)/2); // scale alpha up
+                fgColor = agg::rgba8( (unsigned int)(c.r()*255), (unsigned int)(c.g()*255), (unsigned int)(c.b()*255), a );
+
+                ras.filling_rule( agg::fill_even_odd );
+                for( Geometry::const_iterator p = g->begin(); p != g->end(); p++ )
+                {
+                    const osg::Vec3d& p0 = *p;
+                    double x0 = params._xf*(p0.x()-params._xmin);
+                    double y0 = params._yf*(p0.y()-params._ymin) - yoffset;
+
+                    if ( p == g->begin() )
+                        ras.move_to_d( x0, y0 );
+                    else
+                        ras.line_to_d( x0, y0 );
+                }
+            }
+            ras.render(ren, fgColor);
+            ras.reset();
+        }
+    }
+
+    struct RasterizeStripe
+    {
+        RasterizeStripe() : _shapes(0L), _params(0L), _image(0L), _firstRow(0), _numRows(0) { }
+
+        void execute()
+        {
+            rasterize( *_shapes, *_params, _image, _firstRow, _numRows );
+        }
+
+        const Shapes*       _shapes;
+        const RasterParams* _params;
+        osg::Image*         _image;
+        unsigned            _firstRow, _numRows;
+    };
+
+    // threads that rasterize the stripes of a metatile.
+    Threading::Mutex          s_stripeServiceMutex;
+    osg::ref_ptr<TaskService> s_stripeService;
+
+    TaskService* getStripeService()
+    {
+        Threading::ScopedMutexLock lock( s_stripeServiceMutex );
+        if ( !s_stripeService.valid() )
+        {
+            s_stripeService = new TaskService(
+                "AGGLite stripes",
+                osg::maximum( 2, OpenThreads::GetNumberOfProcessors() ) );
+        }
+        return s_stripeService.get();
+    }
+}
+
+/********************************************************************/
+
 class AGGLiteRasterizerTileSource : public FeatureTileSource
 {
 public:
@@ -252,17 +389,6 @@ public:
         xform.setLocalizeCoordinates( false );
         context = xform.push( features, context );
 
-        // set up the AGG renderer:
-        agg::rendering_buffer rbuf( image->data(), image->s(), image->t(), image->s()*4 );
-
-        // Create the renderer and the rasterizer
-        agg::renderer<agg::span_abgr32> ren(rbuf);
-        agg::rasterizer ras;
-
-        // Setup the rasterizer
-        ras.gamma(1.3);
-        ras.filling_rule(agg::fill_even_odd);
-
         GeoExtent cropExtent = GeoExtent(imageExtent);
         cropExtent.scale(1.1, 1.1);
 
@@ -272,78 +398,66 @@ public:
         cropPoly->push_back( osg::Vec3d( cropExtent.xMax(), cropExtent.yMax(), 0 ));
         cropPoly->push_back( osg::Vec3d( cropExtent.xMin(), cropExtent.yMax(), 0 ));
 
-        double lineWidth = 1.0;
-        if ( masterLine )
-            lineWidth = (double)masterLine->stroke()->width().value();
-
-        osg::Vec4 color = osg::Vec4(1, 1, 1, 1);
-        if ( masterLine )
-            color = masterLine->stroke()->color();
-
-        // render the features
+        RasterParams params;
+        params._xmin       = xmin;
+        params._ymin       = ymin;
+        params._xf         = xf;
+        params._yf         = yf;
+        params._color      = masterLine ? masterLine->stroke()->color() : osg::Vec4(1, 1, 1, 1);
+        params._masterLine = masterLine;
+        params._masterPoly = masterPoly;
+
+        // crop the features once; every stripe shares the results.
+        Shapes shapes;
+        shapes.reserve( features.size() );
         for(FeatureList::iterator i = features.begin(); i != features.end(); i++)
         {
-            Feature* feature = i->get();
-
-            Geometry* geometry = feature->getGeometry();
-
-            osg::ref_ptr< Geometry > croppedGeometry;
-            if ( ! geometry->crop( cropPoly.get(), croppedGeometry ) )
+            Shape shape;
+            if ( ! i->get()->getGeometry()->crop( cropPoly.get(), shape._geom ) )
                 continue;
 
-            // set up a default color:
-            osg::Vec4 c = color;
-            unsigned int a = (unsigned int)(127+(c.a()*255)/2); // scale alpha up
-            agg::rgba8 fgColor( (unsigned int)(c.r()*255), (unsigned int)(c.g()*255), (unsigned int)(c.b()*255), a );
-
-            GeometryIterator gi( croppedGeometry.get() );
-            while( gi.hasMore() )
-            {
-                c = color;
-                Geometry* g = gi.next();
-            
-                const LineSymbol* line = feature->style().isSet() ? 
-                    feature->style()->getSymbol<LineSymbol>() : masterLine;
+            Bounds bounds = shape._geom->getBounds();
+            shape._feature = i->get();
+            shape._rowMin  = yf*(bounds.yMin()-ymin);
+            shape._rowMax  = yf*(bounds.yMax()-ymin);
+            shapes.push_back( shape );
+        }
 
-                const PolygonSymbol* poly =
-                    feature->style().isSet() ? feature->style()->getSymbol<PolygonSymbol>() : masterPoly;
+        // render the features. A metatile is split into one stripe per row of
+        // tiles, and the stripes rasterize in parallel (the calling thread
+        // takes the first one).
+        unsigned ppt = (unsigned)getPixelsPerTile();
+        unsigned numStripes = 1;
+        if ( ppt > 0 && (unsigned)image->t() > ppt )
+            numStripes = ((unsigned)image->t() + ppt - 1) / ppt;
 
-                if (g->getType() == Geometry::TYPE_RING || g->getType() == Geometry::TYPE_LINESTRING)
-                {
-                    if ( line )
-                        c = line->stroke()->color();
-                    else if ( poly )
-                        c = poly->fill()->color();
-                }
-
-                else if ( g->getType() == Geometry::TYPE_POLYGON )
-                {
-                    if ( poly )
-                        c = poly->fill()->color();
-                    else if ( line )
-                        c = line->stroke()->color();
-                }
+        unsigned stripeRows = ((unsigned)image->t() + numStripes - 1) / numStripes;
 
-                a = (unsigned int)(127+(c.a()*255)/2); // scale alpha up
-                fgColor = agg::rgba8( (unsigned int)(c.r()*255), (unsigned int)(c.g()*255), (unsigned int)(c.b()*255), a );
+        typedef ParallelTask<RasterizeStripe> StripeTask;
+        std::vector< osg::ref_ptr<StripeTask> > tasks;
+        tasks.reserve( numStripes );
 
-                ras.filling_rule( agg::fill_even_odd );
-                for( Geometry::iterator p = g->begin(); p != g->end(); p++ )
-                {
-                    const osg::Vec3d& p0 = *p;
-                    double x0 = xf*(p0.x()-xmin);
-                    double y0 = yf*(p0.y()-ymin);
+        TaskService* service = numStripes > 1 ? getStripeService() : 0L;
+        Threading::MultiEvent done( (int)numStripes-1 );
 
-                    if ( p == g->begin() )
-                        ras.move_to_d( x0, y0 );
-                    else
-                        ras.line_to_d( x0, y0 );
-                }
-            }
-            ras.render(ren, fgColor);
-            ras.reset();
+        for( unsigned i = 0; i < numStripes; ++i )
+        {
+            StripeTask* task = i > 0 ? new StripeTask( &done ) : new StripeTask();
+            task->_shapes   = &shapes;
+            task->_params   = &params;
+            task->_image    = image;
+            task->_firstRow = osg::minimum( i * stripeRows, (unsigned)image->t() );
+            task->_numRows  = osg::minimum( stripeRows, (unsigned)image->t() - task->_firstRow );
+            tasks.push_back( task );
+
+            if ( i > 0 )
+                service->add( task );
         }
 
+        tasks[0]->execute();
+        if ( numStripes > 1 )
+            done.wait();
+
         bd->_pass++;
         return true;
     }
@@ -1,5 +1,5 @@
 #include "MapService.h"
-#include <osgEarth/JsonUtils>
+#include <osgEarth/Config>
 #include <osgEarth/Registry>
 #include <osg/Notify>
 #include <sstream>
@@ -135,18 +135,18 @@ MapService::init( const URI& _uri, const osgDB::ReaderWriter::Options* options )
     if ( r.failed() )
         return setError( "Unable to read metadata from ArcGIS service" );
 
-    Json::Value doc;
-    Json::Reader reader;
-//    if ( !reader.parse( response.getPartStream(0), doc ) )
-    if ( !reader.parse( r.getString(), doc ) )
+    // stream the descriptor straight into a Config (no JSON DOM).
+    Config doc;
+    if ( !doc.fromJSON( r.getString() ) )
         return setError( "Unable to parse metadata; invalid JSON" );
 
     // Read the profile. We are using "fullExtent"; perhaps an option to use "initialExtent" instead?
-    double xmin = doc["fullExtent"].get("xmin", 0).asDouble();
-    double ymin = doc["fullExtent"].get("ymin", 0).asDouble();
-    double xmax = doc["fullExtent"].get("xmax", 0).asDouble();
-    double ymax = doc["fullExtent"].get("ymax", 0).asDouble();
-    int srs = doc["fullExtent"].get("spatialReference", osgEarth::Json::Value::null).get("wkid", 0).asInt();
+    Config j_extent = doc.child("fullExtent");
+    double xmin = j_extent.value<double>("xmin", 0.0);
+    double ymin = j_extent.value<double>("ymin", 0.0);
+    double xmax = j_extent.value<double>("xmax", 0.0);
+    double ymax = j_extent.value<double>("ymax", 0.0);
+    int srs = j_extent.child("spatialReference").value<int>("wkid", 0);
     
     //Assumes the SRS is going to be an EPSG code
     std::stringstream ss;
@@ -158,15 +158,15 @@ MapService::init( const URI& _uri, const osgDB::ReaderWriter::Options* options )
     }
 
     // Read the layers list
-    Json::Value j_layers = doc["layers"];
+    const ConfigSet j_layers = doc.child("layers").children();
     if ( j_layers.empty() )
         return setError( "Map service contains no layers" );
 
-    for( unsigned int i=0; i<j_layers.size(); i++ )
+    int i = 0;
+    for( ConfigSet::const_iterator layer = j_layers.begin(); layer != j_layers.end(); ++layer, ++i )
     {
-        Json::Value layer = j_layers[i];
-        int id = i; // layer.get("id", -1).asInt();
-        std::string name = layer["name"].asString();
+        int id = i; // layer->value<int>("id", -1);
+        std::string name = layer->value("name");
 
         if ( id >= 0 && !name.empty() )
         {
@@ -184,32 +184,33 @@ MapService::init( const URI& _uri, const osgDB::ReaderWriter::Options* options )
     int num_tiles_high = 1;
 
     // Read the tiling schema
-    Json::Value j_tileinfo = doc["tileInfo"];
-    if ( !j_tileinfo.empty() )
+    if ( doc.hasChild("tileInfo") )
     {
+        Config j_tileinfo = doc.child("tileInfo");
+
         tiled = true;
 
      //   return setError( "Map service does not define a tiling schema" );
 
         // TODO: what do we do if the width <> height?
-        tile_rows = j_tileinfo.get( "rows", 0 ).asInt();
-        tile_cols = j_tileinfo.get( "cols", 0 ).asInt();
+        tile_rows = j_tileinfo.value<int>( "rows", 0 );
+        tile_cols = j_tileinfo.value<int>( "cols", 0 );
         if ( tile_rows <= 0 && tile_cols <= 0 )
             return setError( "Map service tile size not specified" );
 
-        format = j_tileinfo.get( "format", "" ).asString();
+        format = j_tileinfo.value( "format" );
         if ( format.empty() )
             return setError( "Map service tile schema does not specify an image format" );
 
-        Json::Value j_levels = j_tileinfo["lods"];
+        const ConfigSet j_levels = j_tileinfo.child("lods").children();
         if ( j_levels.empty() )
             return setError( "Map service tile schema contains no LODs" );
         
         min_level = INT_MAX;
         max_level = 0;
-        for( unsigned int i=0; i<j_levels.size(); i++ )
+        for( ConfigSet::const_iterator lod = j_levels.begin(); lod != j_levels.end(); ++lod )
         {
-            int level = j_levels[i].get( "level", -1 ).asInt();
+            int level = lod->value<int>( "level", -1 );
             if ( level >= 0 && level < min_level )
                 min_level = level;
             if ( level >= 0 && level > max_level )
@@ -218,8 +219,8 @@ MapService::init( const URI& _uri, const osgDB::ReaderWriter::Options* options )
 
         if (j_levels.size() > 0)
         {
-            int l = j_levels[0u].get("level", -1).asInt();
-            double res = j_levels[0u].get("resolution", 0.0).asDouble();
+            int l = j_levels.front().value<int>("level", -1);
+            double res = j_levels.front().value<double>("resolution", 0.0);
             num_tiles_wide = (int)osg::round((xmax - xmin) / (res * tile_cols));
             num_tiles_high = (int)osg::round((ymax - ymin) / (res * tile_cols));
 
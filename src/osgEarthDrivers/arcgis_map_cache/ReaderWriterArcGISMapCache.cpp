@@ -19,6 +19,8 @@
 
 #include <osgEarth/TileSource>
 #include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
 #include <osgEarth/URI>
 
 #include <osg/Notify>
@@ -30,13 +32,263 @@
 
 #include <sstream>
 #include <iomanip>
+#include <list>
+#include <map>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#   include <io.h>
+#   include <windows.h>
+#else
+#   include <unistd.h>
+#   include <sys/mman.h>
+#endif
 
 using namespace osgEarth;
 
+#define LC "[AGSMapCacheSource] "
+
 #define PROPERTY_URL        "url"
 #define PROPERTY_MAP        "map"
 #define PROPERTY_LAYER      "layer"
 #define PROPERTY_FORMAT     "format"
+#define PROPERTY_COMPACT    "compact"
+
+// Compact caches pack 128x128 tiles into each bundle. Version 1 keeps the
+// index in a separate .bundlx file (5-byte offsets, column-major, after a
+// 16-byte header; each tile is preceded by its 4-byte size). Version 2
+// keeps it in the .bundle itself (8-byte entries holding a 40-bit offset
+// and 24-bit size, row-major, after a 64-byte header).
+#define BUNDLE_DIM          128
+#define BUNDLX_HEADER       16
+#define BUNDLX_ENTRY        5
+#define BUNDLE_V2_HEADER    64
+#define BUNDLE_V2_ENTRY     8
+#define MAX_OPEN_BUNDLES    32
+
+namespace
+{
+    /** A read-only memory mapping of the first "len" bytes of a file. */
+    class MappedIndex
+    {
+    public:
+        MappedIndex( int fd, unsigned len ) : _data( 0L ), _len( 0 )
+        {
+#ifdef _WIN32
+            _mapping = ::CreateFileMappingA( (HANDLE)::_get_osfhandle(fd), 0L, PAGE_READONLY, 0, len, 0L );
+            if ( _mapping )
+            {
+                _data = (const unsigned char*)::MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, len );
+                if ( _data ) _len = len;
+            }
+#else
+            void* p = ::mmap( 0L, len, PROT_READ, MAP_SHARED, fd, 0 );
+            if ( p != MAP_FAILED )
+            {
+                _data = (const unsigned char*)p;
+                _len  = len;
+            }
+#endif
+        }
+
+        ~MappedIndex()
+        {
+#ifdef _WIN32
+            if ( _data )    ::UnmapViewOfFile( _data );
+            if ( _mapping ) ::CloseHandle( _mapping );
+#else
+            if ( _data )    ::munmap( (void*)_data, _len );
+#endif
+        }
+
+        bool valid() const { return _data != 0L; }
+
+        /** Little-endian integer of "bytes" bytes at "offset" */
+        unsigned long long get( unsigned offset, unsigned bytes ) const
+        {
+            unsigned long long value = 0;
+            for( unsigned i = 0; i < bytes; ++i )
+                value |= (unsigned long long)_data[offset+i] << (8*i);
+            return value;
+        }
+
+        unsigned size() const { return _len; }
+
+    private:
+        const unsigned char* _data;
+        unsigned             _len;
+#ifdef _WIN32
+        HANDLE               _mapping;
+#endif
+    };
+
+    /** One open bundle: its index mapped into memory, and its data read in place. */
+    class CompactBundle : public osg::Referenced
+    {
+    public:
+        CompactBundle( const std::string& basePath ) :
+          _fd       ( -1 ),
+          _indexFd  ( -1 ),
+          _index    ( 0L ),
+          _version  ( 0 )
+        {
+#ifdef _WIN32
+            int flags = O_RDONLY | O_BINARY;
+#else
+            int flags = O_RDONLY;
+#endif
+            _fd = ::open( (basePath + ".bundle").c_str(), flags );
+            if ( _fd < 0 )
+                return;
+
+            // version 1 has a separate index file:
+            _indexFd = ::open( (basePath + ".bundlx").c_str(), flags );
+            if ( _indexFd >= 0 )
+            {
+                _index   = new MappedIndex( _indexFd, BUNDLX_HEADER + BUNDLE_DIM*BUNDLE_DIM*BUNDLX_ENTRY );
+                _version = 1;
+            }
+            else
+            {
+                _index   = new MappedIndex( _fd, BUNDLE_V2_HEADER + BUNDLE_DIM*BUNDLE_DIM*BUNDLE_V2_ENTRY );
+                _version = 2;
+            }
+
+            if ( !_index->valid() )
+            {
+                OE_WARN << LC << "Cannot map the index of " << basePath << ".bundle" << std::endl;
+                _version = 0;
+            }
+        }
+
+        bool valid() const { return _version > 0; }
+
+        /** Reads the tile at row and column "row" and "col" within the bundle. */
+        bool read( unsigned row, unsigned col, std::string& out ) const
+        {
+            unsigned long long offset;
+            unsigned           size;
+
+            if ( _version == 1 )
+            {
+                offset = _index->get( BUNDLX_HEADER + (col*BUNDLE_DIM + row)*BUNDLX_ENTRY, BUNDLX_ENTRY );
+
+                char sizeBuf[4];
+                if ( !readAt(sizeBuf, 4, offset) )
+                    return false;
+                size = (unsigned char)sizeBuf[0] | ((unsigned char)sizeBuf[1] << 8) | ((unsigned char)sizeBuf[2] << 16) | ((unsigned)(unsigned char)sizeBuf[3] << 24);
+                offset += 4;
+            }
+            else
+            {
+                unsigned long long entry = _index->get( BUNDLE_V2_HEADER + (row*BUNDLE_DIM + col)*BUNDLE_V2_ENTRY, BUNDLE_V2_ENTRY );
+                offset = entry & 0xFFFFFFFFFFull;
+                size   = (unsigned)(entry >> 40);
+            }
+
+            // no tile here
+            if ( size == 0 )
+                return false;
+
+            out.resize( size );
+            return readAt( &out[0], size, offset );
+        }
+
+    protected:
+        virtual ~CompactBundle()
+        {
+            delete _index;
+            if ( _indexFd >= 0 ) ::close( _indexFd );
+            if ( _fd >= 0 )      ::close( _fd );
+        }
+
+        // Reads exactly "len" bytes at "offset". Without pread, the seek and
+        // the read must happen together, so they go under the mutex.
+        bool readAt( char* buf, unsigned len, unsigned long long offset ) const
+        {
+            unsigned done = 0;
+#ifdef _WIN32
+            Threading::ScopedMutexLock lock( _ioMutex );
+            if ( ::_lseeki64( _fd, (__int64)offset, SEEK_SET ) < 0 )
+                return false;
+            while( done < len )
+            {
+                int n = ::_read( _fd, buf+done, len-done );
+                if ( n <= 0 ) return false;
+                done += (unsigned)n;
+            }
+#else
+            while( done < len )
+            {
+                ssize_t n = ::pread( _fd, buf+done, len-done, (off_t)(offset+done) );
+                if ( n <= 0 ) return false;
+                done += (unsigned)n;
+            }
+#endif
+            return true;
+        }
+
+        int                      _fd;
+        int                      _indexFd;
+        MappedIndex*             _index;
+        unsigned                 _version;
+        mutable Threading::Mutex _ioMutex;  // only used where positioned I/O is unavailable
+    };
+
+    /**
+     * The most recently used bundles, kept open. An entry holds a null
+     * bundle for a bundle file that does not exist, so a sparse cache does
+     * not keep probing the disk.
+     */
+    class BundleCache
+    {
+    public:
+        BundleCache() { }
+
+        CompactBundle* get( const std::string& basePath )
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+
+            Bundles::iterator i = _bundles.find( basePath );
+            if ( i != _bundles.end() )
+            {
+                _lru.splice( _lru.end(), _lru, i->second._lru );
+                return i->second._bundle.get();
+            }
+
+            osg::ref_ptr<CompactBundle> bundle = new CompactBundle( basePath );
+            if ( !bundle->valid() )
+                bundle = 0L;
+
+            if ( _bundles.size() >= MAX_OPEN_BUNDLES )
+            {
+                _bundles.erase( _lru.front() );
+                _lru.pop_front();
+            }
+
+            Entry& entry = _bundles[basePath];
+            entry._bundle = bundle.get();
+            entry._lru    = _lru.insert( _lru.end(), basePath );
+            return bundle.get();
+        }
+
+    private:
+        struct Entry
+        {
+            osg::ref_ptr<CompactBundle>      _bundle;
+            std::list<std::string>::iterator _lru;
+        };
+        typedef std::map<std::string, Entry> Bundles;
+
+        Bundles                _bundles;
+        std::list<std::string> _lru;      // least recently used first
+        Threading::Mutex       _mutex;
+    };
+}
 
 class AGSMapCacheSource : public TileSource
 {
@@ -65,6 +317,10 @@ public:
 
         if ( _format.empty() )
             _format = "png";
+
+        // whether the cache is in compact (.bundle) form; detected if not set
+        if ( conf.hasValue(PROPERTY_COMPACT) )
+            _compact = conf.value<bool>( PROPERTY_COMPACT, false );
     }
 
     Status initialize( const osgDB::Options* dbOptions )
@@ -75,6 +331,39 @@ public:
         //Set the profile to global geodetic.
         setProfile(osgEarth::Registry::instance()->getGlobalGeodeticProfile());
 
+        std::string layerPath = Stringify() << _url << "/" << _map << "/Layers/" << _layer;
+
+        if ( !_compact.isSet() )
+        {
+            // a local cache whose first level holds bundles is compact.
+            _compact = false;
+            if ( !osgDB::containsServerAddress(_url) )
+            {
+                osgDB::DirectoryContents files = osgDB::getDirectoryContents( layerPath + "/L00" );
+                for( osgDB::DirectoryContents::const_iterator i = files.begin(); i != files.end(); ++i )
+                {
+                    if ( osgDB::getLowerCaseFileExtension(*i) == "bundle" )
+                    {
+                        _compact = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if ( _compact == true )
+        {
+            if ( osgDB::containsServerAddress(_url) )
+                return Status::Error( "Compact map caches must be on a local or network file system" );
+
+            osgDB::Registry* registry = osgDB::Registry::instance();
+            _pngReader    = registry->getReaderWriterForExtension( "png" );
+            _jpegReader   = registry->getReaderWriterForExtension( "jpg" );
+            _formatReader = registry->getReaderWriterForExtension( _format );
+
+            OE_INFO << LC << "Reading compact cache " << layerPath << std::endl;
+        }
+
         return STATUS_OK;
     }
 
@@ -88,6 +377,11 @@ public:
         unsigned int tile_x, tile_y;
         key.getTileXY( tile_x, tile_y );
 
+        if ( _compact == true )
+        {
+            return createImageFromBundle( level, tile_x, tile_y );
+        }
+
         std::string bufStr = Stringify()
             << _url << "/" << _map 
             << "/Layers/" << _layer
@@ -100,6 +394,43 @@ public:
         return URI(bufStr).getImage( _dbOptions.get(), progress );
     }
 
+    osg::Image* createImageFromBundle( int level, unsigned tile_x, unsigned tile_y )
+    {
+        unsigned bundleRow = tile_y - (tile_y % BUNDLE_DIM);
+        unsigned bundleCol = tile_x - (tile_x % BUNDLE_DIM);
+
+        std::string basePath = Stringify()
+            << _url << "/" << _map 
+            << "/Layers/" << _layer
+            << "/L" << std::setw(2) << std::setfill('0') << level
+            << "/R" << std::hex << std::setw(4) << std::setfill('0') << bundleRow
+            << "C"  << std::hex << std::setw(4) << std::setfill('0') << bundleCol;
+
+        CompactBundle* bundle = _bundles.get( basePath );
+        if ( !bundle )
+            return 0L;
+
+        std::string data;
+        if ( !bundle->read(tile_y - bundleRow, tile_x - bundleCol, data) )
+            return 0L;
+
+        // tiles in a "mixed" cache may be either PNG or JPEG.
+        osgDB::ReaderWriter* rw = 0L;
+        if ( data.size() > 4 && data.compare(1, 3, "PNG") == 0 )
+            rw = _pngReader.get();
+        else if ( data.size() > 2 && (unsigned char)data[0] == 0xFF && (unsigned char)data[1] == 0xD8 )
+            rw = _jpegReader.get();
+        else
+            rw = _formatReader.get();
+
+        if ( !rw )
+            return 0L;
+
+        std::istringstream in( data );
+        osgDB::ReaderWriter::ReadResult rr = rw->readImage( in, _dbOptions.get() );
+        return rr.validImage() ? rr.takeImage() : 0L;
+    }
+
     // override
     osg::HeightField* createHeightField( const TileKey& key, ProgressCallback* progress)
     {
@@ -118,7 +449,10 @@ private:
     std::string _map;
     std::string _layer;
     std::string _format;
+    optional<bool> _compact;
     osg::ref_ptr<osgDB::Options> _dbOptions;
+    BundleCache _bundles;
+    osg::ref_ptr<osgDB::ReaderWriter> _pngReader, _jpegReader, _formatReader;
 };
 
 
@@ -17,15 +17,24 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "FileSystemCache"
+#include "PackStore"
 #include <osgEarth/Cache>
 #include <osgEarth/StringUtils>
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/XmlUtils>
 #include <osgEarth/URI>
 #include <osgEarth/Registry>
+#include <osgEarth/TaskService>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <osg/observer_ptr>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <ctime>
+#include <cstdlib>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
@@ -33,10 +42,123 @@ using namespace osgEarth::Threading;
 
 #ifndef _WIN32
 #   include <unistd.h>
+#   include <utime.h>
+#else
+#   include <sys/utime.h>
 #endif
 
+#define ACCESS_INDEX_FILE   "osgearth_access.idx"
+#define ACCESS_INDEX_HEADER "osgearth_access 1"
+
+// an eviction pass trims a bin to this fraction of its limit, so that it
+// doesn't run again right after the next few writes.
+#define EVICTION_LOW_WATER 0.9
+
 namespace
 {
+    /**
+     * Sizes and last access times of a bin's records, for least recently
+     * used eviction. Access times are tracked here rather than taken from
+     * file access times, which are often disabled or coarse. The index lives
+     * in memory and is saved to the bin folder after each eviction pass and
+     * when the bin closes.
+     */
+    class AccessIndex
+    {
+    public:
+        AccessIndex() : _totalBytes(0), _loaded(false), _dirty(false) { }
+
+        /** Whether the index is loaded and tracking accesses */
+        bool isLoaded() const { return _loaded; }
+
+        /** Reads the saved index. Returns false if there is none. */
+        bool load( const std::string& path );
+
+        /** Starts an empty index, to be filled with written() calls. */
+        void reset( const std::string& path );
+
+        /** Saves the index, if it changed since the last save. */
+        bool save();
+
+        void accessed( const std::string& key );
+        void written( const std::string& key, unsigned long long size, ::time_t when );
+        void removed( const std::string& key );
+        void clear();
+
+        unsigned long long getTotalBytes() const;
+
+        /** Gets the last access time of a record; false if it is not indexed */
+        bool getAccess( const std::string& key, ::time_t& out_access ) const;
+
+        /**
+         * Gets the least recently used keys that must go for the index to hold
+         * no more than "maxBytes". Returns the number of bytes they hold.
+         */
+        unsigned long long getLeastRecentlyUsed( unsigned long long maxBytes, std::vector<std::string>& out_keys ) const;
+
+    protected:
+        struct Record
+        {
+            unsigned long long _size;
+            ::time_t           _access;
+        };
+        typedef std::map<std::string, Record> Records;
+
+        struct LessAccess
+        {
+            template<typename P>
+            bool operator()( const P& lhs, const P& rhs ) const { return lhs.first < rhs.first; }
+        };
+
+        std::string              _path;
+        Records                  _records;
+        unsigned long long       _totalBytes;
+        bool                     _loaded;
+        bool                     _dirty;
+        mutable Threading::Mutex _mutex;
+    };
+
+    /**
+     * Base for the bins of a FileSystemCache: tracks record accesses when the
+     * bin has a size limit, and queues an eviction pass on the cache's
+     * eviction service once enough has been written since the last one.
+     */
+    class EvictingCacheBin : public CacheBin
+    {
+    public:
+        EvictingCacheBin( const std::string& binID, unsigned long long maxBytes, TaskService* evictionService );
+
+    protected:
+        /** Call after writing "bytes" to the bin; may queue an eviction pass. */
+        void wrote( unsigned long long bytes );
+
+        /** Call at the start of an eviction pass. */
+        void evicting();
+
+        unsigned long long        _maxBytes;
+        AccessIndex               _access;
+        osg::ref_ptr<TaskService> _evictionService;
+        unsigned long long        _bytesSinceEviction;
+        bool                      _evictionPending;
+        Threading::Mutex          _evictionMutex;
+        Threading::Mutex          _evictionPassMutex; // one eviction pass at a time
+    };
+
+    // runs an eviction pass on a bin, on the cache's eviction service.
+    struct AsyncEvict : public TaskRequest
+    {
+        AsyncEvict( CacheBin* bin ) : _bin( bin ) { }
+
+        void operator()( ProgressCallback* progress )
+        {
+            osg::ref_ptr<CacheBin> bin = _bin.get();
+            if ( bin.valid() )
+                bin->evict( 0 );
+        }
+
+        osg::observer_ptr<CacheBin> _bin;
+    };
+
     /** 
      * Cache that stores data in the local file system.
      */
@@ -64,17 +186,22 @@ namespace
 
         void init();
 
-        std::string            _rootPath;
+        CacheBin* createBin( const std::string& binID );
+
+        std::string               _rootPath;
+        FileSystemCacheOptions    _options;
+        osg::ref_ptr<TaskService> _evictionService;
     };
 
     /** 
      * Cache bin implementation for a FileSystemCache.
      * You don't need to create this object directly; use FileSystemCache::createBin instead.
     */
-    class FileSystemCacheBin : public CacheBin
+    class FileSystemCacheBin : public EvictingCacheBin
     {
     public:
-        FileSystemCacheBin( const std::string& name, const std::string& rootPath );
+        FileSystemCacheBin( const std::string& name, const std::string& rootPath,
+                            unsigned long long maxBytes, TaskService* evictionService );
 
     public: // CacheBin interface
 
@@ -90,17 +217,81 @@ namespace
 
         bool isCached( const std::string& key, double maxAge =DBL_MAX );
 
+        bool touch( const std::string& key );
+
         bool purge();
 
+        unsigned long long evict( unsigned long long maxBytes );
+
+        bool getKeys( std::vector<std::string>& out_keys );
+
         Config readMetadata();
 
         bool writeMetadata( const Config& meta );
 
     protected:
+        virtual ~FileSystemCacheBin();
+
         bool purgeDirectory( const std::string& dir );
+        void loadAccessIndex();
+        void indexDirectory( const std::string& dir, const std::string& prefix );
+        void listDirectory( const std::string& dir, const std::string& prefix, std::vector<std::string>& out_keys );
+        void recordWrite( const std::string& legalKey );
+
+        bool                              _ok;
+        std::string                       _metaPath;
+        osg::ref_ptr<osgDB::ReaderWriter> _rw;
+        osg::ref_ptr<osgDB::Options>      _rwOptions;
+        Threading::ReadWriteMutex         _rwmutex;
+    };
+
+    /**
+     * Cache bin that keeps its records in a PackStore (a few large pack
+     * files with an index) instead of one file per record.
+     */
+    class PackedFileSystemCacheBin : public EvictingCacheBin
+    {
+    public:
+        PackedFileSystemCacheBin( const std::string& name, const std::string& rootPath, const FileSystemCacheOptions& options,
+                                  unsigned long long maxBytes, TaskService* evictionService );
+
+    public: // CacheBin interface
+
+        ReadResult readObject( const std::string& key, double maxAge =DBL_MAX );
+
+        ReadResult readImage( const std::string& key, double maxAge =DBL_MAX );
+
+        ReadResult readNode( const std::string& key, double maxAge =DBL_MAX );
+
+        ReadResult readString( const std::string& key, double maxAge =DBL_MAX );
+
+        bool write( const std::string& key, const osg::Object* object, const Config& meta );
+
+        bool isCached( const std::string& key, double maxAge =DBL_MAX );
+
+        bool touch( const std::string& key );
+
+        bool purge();
+
+        unsigned long long evict( unsigned long long maxBytes );
+
+        bool getKeys( std::vector<std::string>& out_keys );
+
+        Config readMetadata();
+
+        bool writeMetadata( const Config& meta );
+
+    protected:
+        virtual ~PackedFileSystemCacheBin();
+
+        enum Type { TYPE_OBJECT, TYPE_IMAGE, TYPE_NODE };
+
+        ReadResult read( const std::string& key, double maxAge, Type type );
+        void loadAccessIndex();
 
         bool                              _ok;
         std::string                       _metaPath;
+        osg::ref_ptr<PackStore>           _store;
         osg::ref_ptr<osgDB::ReaderWriter> _rw;
         osg::ref_ptr<osgDB::Options>      _rwOptions;
         Threading::ReadWriteMutex         _rwmutex;
@@ -117,6 +308,40 @@ namespace
         }
     }
 
+    // whether a cached file is older than maxAge seconds (by modification time)
+    bool isExpired( const std::string& fullPath, double maxAge )
+    {
+        if ( maxAge >= DBL_MAX )
+            return false;
+
+        struct stat buf;
+        if ( ::stat( fullPath.c_str(), &buf ) != 0 )
+            return false;
+
+        return (double)(::time(0L) - buf.st_mtime) > maxAge;
+    }
+
+    // reverses toLegalFileName(), which escapes characters as "{hex}".
+    std::string fromLegalFileName( const std::string& name )
+    {
+        std::string result;
+        for( std::string::size_type i = 0; i < name.size(); ++i )
+        {
+            if ( name[i] == '{' )
+            {
+                std::string::size_type end = name.find( '}', i );
+                if ( end != std::string::npos )
+                {
+                    result += (char)::strtol( name.substr(i+1, end-i-1).c_str(), 0L, 16 );
+                    i = end;
+                    continue;
+                }
+            }
+            result += name[i];
+        }
+        return result;
+    }
+
     void readMeta( const std::string& fullPath, Config& meta )
     {
         std::ifstream inmeta( fullPath.c_str() );
@@ -141,13 +366,237 @@ namespace
 //#undef  OE_DEBUG
 //#define OE_DEBUG OE_INFO
 
+namespace
+{
+    bool
+    AccessIndex::load( const std::string& path )
+    {
+        ScopedMutexLock lock( _mutex );
+        _path = path;
+        _records.clear();
+        _totalBytes = 0;
+        _loaded = false;
+        _dirty  = false;
+
+        std::ifstream in( path.c_str() );
+        std::string line;
+        if ( !in.is_open() || !std::getline(in, line) || line != ACCESS_INDEX_HEADER )
+            return false;
+
+        // each line is "access size key"; the key runs to the end of the line.
+        while( std::getline(in, line) )
+        {
+            std::stringstream buf( line );
+            long long access;
+            Record rec;
+            if ( !(buf >> access >> rec._size) )
+                continue;
+            buf.get();
+            std::string key;
+            std::getline( buf, key );
+            if ( key.empty() )
+                continue;
+
+            rec._access = (::time_t)access;
+            _records[key] = rec;
+            _totalBytes += rec._size;
+        }
+
+        _loaded = true;
+        return true;
+    }
+
+    void
+    AccessIndex::reset( const std::string& path )
+    {
+        ScopedMutexLock lock( _mutex );
+        _path = path;
+        _records.clear();
+        _totalBytes = 0;
+        _loaded = true;
+        _dirty  = true;
+    }
+
+    bool
+    AccessIndex::save()
+    {
+        std::stringstream buf;
+        std::string path;
+        {
+            ScopedMutexLock lock( _mutex );
+            if ( !_loaded || !_dirty )
+                return true;
+
+            buf << ACCESS_INDEX_HEADER << "\n";
+            for( Records::const_iterator i = _records.begin(); i != _records.end(); ++i )
+                buf << (long long)i->second._access << " " << i->second._size << " " << i->first << "\n";
+
+            path = _path;
+            _dirty = false;
+        }
+
+        // write a new file and move it into place, so that a crash never
+        // leaves a partial index behind.
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out( tempPath.c_str(), std::ios_base::out | std::ios_base::trunc );
+            if ( !out.is_open() )
+                return false;
+            out << buf.rdbuf();
+            out.flush();
+            if ( out.fail() )
+                return false;
+        }
+#ifdef _WIN32
+        ::remove( path.c_str() );
+#endif
+        return ::rename( tempPath.c_str(), path.c_str() ) == 0;
+    }
+
+    void
+    AccessIndex::accessed( const std::string& key )
+    {
+        ScopedMutexLock lock( _mutex );
+        if ( !_loaded )
+            return;
+
+        Records::iterator i = _records.find( key );
+        if ( i != _records.end() )
+        {
+            i->second._access = ::time(0L);
+            _dirty = true;
+        }
+    }
+
+    void
+    AccessIndex::written( const std::string& key, unsigned long long size, ::time_t when )
+    {
+        ScopedMutexLock lock( _mutex );
+        if ( !_loaded )
+            return;
+
+        Record& rec = _records[key];
+        if ( _totalBytes >= rec._size )
+            _totalBytes -= rec._size;
+        rec._size   = size;
+        rec._access = when;
+        _totalBytes += size;
+        _dirty = true;
+    }
+
+    void
+    AccessIndex::removed( const std::string& key )
+    {
+        ScopedMutexLock lock( _mutex );
+        Records::iterator i = _records.find( key );
+        if ( i != _records.end() )
+        {
+            _totalBytes -= osg::minimum( _totalBytes, i->second._size );
+            _records.erase( i );
+            _dirty = true;
+        }
+    }
+
+    void
+    AccessIndex::clear()
+    {
+        ScopedMutexLock lock( _mutex );
+        _records.clear();
+        _totalBytes = 0;
+        _dirty = true;
+    }
+
+    unsigned long long
+    AccessIndex::getTotalBytes() const
+    {
+        ScopedMutexLock lock( _mutex );
+        return _totalBytes;
+    }
+
+    bool
+    AccessIndex::getAccess( const std::string& key, ::time_t& out_access ) const
+    {
+        ScopedMutexLock lock( _mutex );
+        Records::const_iterator i = _records.find( key );
+        if ( i == _records.end() )
+            return false;
+        out_access = i->second._access;
+        return true;
+    }
+
+    unsigned long long
+    AccessIndex::getLeastRecentlyUsed( unsigned long long maxBytes, std::vector<std::string>& out_keys ) const
+    {
+        ScopedMutexLock lock( _mutex );
+        if ( _totalBytes <= maxBytes )
+            return 0;
+
+        std::vector< std::pair< ::time_t, Records::const_iterator > > byAccess;
+        byAccess.reserve( _records.size() );
+        for( Records::const_iterator i = _records.begin(); i != _records.end(); ++i )
+            byAccess.push_back( std::make_pair(i->second._access, i) );
+        std::sort( byAccess.begin(), byAccess.end(), LessAccess() );
+
+        unsigned long long bytes = 0;
+        for( unsigned i = 0; i < byAccess.size() && _totalBytes - bytes > maxBytes; ++i )
+        {
+            out_keys.push_back( byAccess[i].second->first );
+            bytes += byAccess[i].second->second._size;
+        }
+        return bytes;
+    }
+
+    //------------------------------------------------------------------------
+
+    EvictingCacheBin::EvictingCacheBin(const std::string& binID,
+                                       unsigned long long maxBytes,
+                                       TaskService*       evictionService) :
+    CacheBin            ( binID ),
+    _maxBytes           ( maxBytes ),
+    _evictionService    ( evictionService ),
+    _bytesSinceEviction ( maxBytes ), // the first write checks the limit
+    _evictionPending    ( false )
+    {
+        //nop
+    }
+
+    void
+    EvictingCacheBin::wrote( unsigned long long bytes )
+    {
+        if ( _maxBytes == 0 || !_evictionService.valid() )
+            return;
+
+        // checking costs a sort of the index, so wait for a few percent of
+        // the limit to come in first.
+        {
+            ScopedMutexLock lock( _evictionMutex );
+            _bytesSinceEviction += bytes;
+            if ( _evictionPending || _bytesSinceEviction < _maxBytes / 32 )
+                return;
+            _evictionPending = true;
+        }
+
+        _evictionService->add( new AsyncEvict(this) );
+    }
+
+    void
+    EvictingCacheBin::evicting()
+    {
+        ScopedMutexLock lock( _evictionMutex );
+        _evictionPending    = false;
+        _bytesSinceEviction = 0;
+    }
+}
+
+//------------------------------------------------------------------------
+
 namespace
 {
     FileSystemCache::FileSystemCache( const CacheOptions& options ) :
-    Cache( options )
+    Cache   ( options ),
+    _options( options )
     {
-        FileSystemCacheOptions fsco( options );
-        _rootPath = URI( *fsco.rootPath(), options.referrer() ).full();
+        _rootPath = URI( *_options.rootPath(), options.referrer() ).full();
         init();
     }
 
@@ -160,12 +609,29 @@ namespace
             OE_WARN << LC << "FAILED to create root folder for cache at \"" << _rootPath << "\"" << std::endl;
             _ok = false;
         }
+
+        // bins with a size limit queue their eviction passes here.
+        if ( _options.maxSize().value() > 0 || !_options.binQuotas().empty() )
+            _evictionService = new TaskService( "FileSystemCache eviction", 1 );
+    }
+
+    CacheBin*
+    FileSystemCache::createBin( const std::string& name )
+    {
+        unsigned long long maxBytes = (unsigned long long)_options.getMaxSize( name ) * 1024ull * 1024ull;
+
+        if ( _options.packed() == true )
+            return new PackedFileSystemCacheBin( name, _rootPath, _options, maxBytes, _evictionService.get() );
+        else
+            return new FileSystemCacheBin( name, _rootPath, maxBytes, _evictionService.get() );
     }
 
     CacheBin*
     FileSystemCache::addBin( const std::string& name )
     {
-        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath ) );
+        // opening a bin may load its access index, so don't make one just to throw it away.
+        CacheBin* bin = _bins.get( name );
+        return bin ? bin : _bins.getOrCreate( name, createBin( name ) );
     }
 
     CacheBin*
@@ -177,7 +643,7 @@ namespace
             Threading::ScopedMutexLock lock( s_defaultBinMutex );
             if ( !_defaultBin.valid() ) // double-check
             {
-                _defaultBin = new FileSystemCacheBin( "__default", _rootPath );
+                _defaultBin = createBin( "__default" );
             }
         }
         return _defaultBin.get();
@@ -186,9 +652,11 @@ namespace
     //------------------------------------------------------------------------
 
     FileSystemCacheBin::FileSystemCacheBin(const std::string&   binID,
-                                           const std::string&   rootPath) :
-    CacheBin ( binID ),
-    _ok      ( true )
+                                           const std::string&   rootPath,
+                                           unsigned long long   maxBytes,
+                                           TaskService*         evictionService) :
+    EvictingCacheBin( binID, maxBytes, evictionService ),
+    _ok             ( true )
     {
         std::string binPath = osgDB::concatPaths( rootPath, binID );
         _metaPath = osgDB::concatPaths( binPath, "osgearth_cacheinfo.json" );
@@ -208,15 +676,88 @@ namespace
             _rwOptions->setOptionString( "Compressor=zlib" );
 #endif
             CachePolicy::NO_CACHE.apply(_rwOptions.get());
+
+            if ( _maxBytes > 0 )
+                loadAccessIndex();
         }
     }
 
+    FileSystemCacheBin::~FileSystemCacheBin()
+    {
+        _access.save();
+    }
+
+    void
+    FileSystemCacheBin::loadAccessIndex()
+    {
+        std::string binDir = osgDB::getFilePath( _metaPath );
+        if ( _access.load( osgDB::concatPaths(binDir, ACCESS_INDEX_FILE) ) )
+            return;
+
+        // no index yet: build one from the files, with their modification
+        // times standing in for the last access.
+        OE_INFO << LC << "Indexing cache bin " << getID() << std::endl;
+        _access.reset( osgDB::concatPaths(binDir, ACCESS_INDEX_FILE) );
+        indexDirectory( binDir, "" );
+        _access.save();
+    }
+
+    void
+    FileSystemCacheBin::indexDirectory( const std::string& dir, const std::string& prefix )
+    {
+        osgDB::DirectoryContents dc = osgDB::getDirectoryContents( dir );
+        for( osgDB::DirectoryContents::const_iterator i = dc.begin(); i != dc.end(); ++i )
+        {
+            if ( i->compare(".") == 0 || i->compare("..") == 0 )
+                continue;
+
+            std::string full = osgDB::concatPaths( dir, *i );
+            std::string name = prefix.empty() ? *i : prefix + "/" + *i;
+
+            if ( osgDB::fileType(full) == osgDB::DIRECTORY )
+            {
+                indexDirectory( full, name );
+            }
+            else if ( osgDB::getLowerCaseFileExtension(*i) == "osgb" )
+            {
+                struct stat buf;
+                if ( ::stat(full.c_str(), &buf) != 0 )
+                    continue;
+
+                unsigned long long size = (unsigned long long)buf.st_size;
+                std::string base = osgDB::getNameLessExtension( full );
+                struct stat metaBuf;
+                if ( ::stat((base + ".meta").c_str(), &metaBuf) == 0 )
+                    size += (unsigned long long)metaBuf.st_size;
+
+                _access.written( osgDB::getNameLessExtension(name), size, buf.st_mtime );
+            }
+        }
+    }
+
+    void
+    FileSystemCacheBin::recordWrite( const std::string& legalKey )
+    {
+        if ( !_access.isLoaded() )
+            return;
+
+        URI fileURI( legalKey, _metaPath );
+        unsigned long long size = 0;
+        struct stat buf;
+        if ( ::stat((fileURI.full() + ".osgb").c_str(), &buf) == 0 )
+            size += (unsigned long long)buf.st_size;
+        if ( ::stat((fileURI.full() + ".meta").c_str(), &buf) == 0 )
+            size += (unsigned long long)buf.st_size;
+
+        _access.written( legalKey, size, ::time(0L) );
+        wrote( size );
+    }
+
     ReadResult
     FileSystemCacheBin::readImage(const std::string& key, double maxAge)
     {
-        if ( !_ok ) return 0L;
-
-        //todo: handle maxAge
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        if ( !_ok ) return countRead( ReadResult(), start );
 
         // mangle "key" into a legal path name
         URI fileURI( toLegalFileName(key), _metaPath );
@@ -233,19 +774,23 @@ namespace
                 if ( osgDB::fileExists(metafile) )
                     readMeta( metafile, meta );
 
-                return ReadResult( r.getImage(), meta );
+                _access.accessed( toLegalFileName(key) );
+
+                if ( isExpired(fileURI.full() + ".osgb", maxAge) )
+                    return countRead( ReadResult( ReadResult::RESULT_EXPIRED, r.getImage(), meta ), start );
+
+                return countRead( ReadResult( r.getImage(), meta ), start );
             }
         }
 
-        return ReadResult(); //error
+        return countRead( ReadResult(), start ); //error
     }
 
     ReadResult
     FileSystemCacheBin::readObject(const std::string& key, double maxAge)
     {
-        if ( !_ok ) return 0L;
-
-        //todo: handle maxAge
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        if ( !_ok ) return countRead( ReadResult(), start );
 
         // mangle "key" into a legal path name
         URI fileURI( toLegalFileName(key), _metaPath );
@@ -262,20 +807,24 @@ namespace
                 if ( osgDB::fileExists(metafile) )
                     readMeta( metafile, meta );
 
+                _access.accessed( toLegalFileName(key) );
+
+                if ( isExpired(fileURI.full() + ".osgb", maxAge) )
+                    return countRead( ReadResult( ReadResult::RESULT_EXPIRED, r.getObject(), meta ), start );
+
                 // TODO: read metadata
-                return ReadResult( r.getObject(), meta );
+                return countRead( ReadResult( r.getObject(), meta ), start );
             }
         }
 
-        return ReadResult();
+        return countRead( ReadResult(), start );
     }
 
     ReadResult
     FileSystemCacheBin::readNode(const std::string& key, double maxAge)
     {
-        if ( !_ok ) return 0L;
-
-        //todo: handle maxAge
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        if ( !_ok ) return countRead( ReadResult(), start );
 
         // mangle "key" into a legal path name
         URI fileURI( toLegalFileName(key), _metaPath );
@@ -292,24 +841,31 @@ namespace
                 if ( osgDB::fileExists(metafile) )
                     readMeta( metafile, meta );
 
-                return ReadResult( r.getNode(), meta );
+                _access.accessed( toLegalFileName(key) );
+
+                if ( isExpired(fileURI.full() + ".osgb", maxAge) )
+                    return countRead( ReadResult( ReadResult::RESULT_EXPIRED, r.getNode(), meta ), start );
+
+                return countRead( ReadResult( r.getNode(), meta ), start );
             }
         }
 
-        return ReadResult();
+        return countRead( ReadResult(), start );
     }
 
     ReadResult
     FileSystemCacheBin::readString(const std::string& key, double maxAge)
     {
         ReadResult r = readObject(key, maxAge);
-        return r.succeeded() && r.get<StringObject>() ? r : ReadResult();
+        bool usable = r.succeeded() || r.code() == ReadResult::RESULT_EXPIRED;
+        return usable && r.get<StringObject>() ? r : ReadResult();
     }
 
     bool
     FileSystemCacheBin::write( const std::string& key, const osg::Object* object, const Config& meta )
     {
-        if ( !_ok || !object ) return false;
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        if ( !_ok || !object ) return countWrite( false, object, start );
 
         // convert the key into a legal filename:
         URI fileURI( toLegalFileName(key), _metaPath );
@@ -341,7 +897,7 @@ namespace
             else
             {
                 std::string filename = fileURI.full() + ".osgb";
-                r = _rw->writeObject( *object, filename );
+                r = _rw->writeObject( *object, filename, _rwOptions.get() );
                 objWriteOK = r.success();
             }
 
@@ -356,13 +912,14 @@ namespace
         if ( objWriteOK )
         {
             OE_DEBUG << LC << "Wrote \"" << key << "\" to cache bin " << getID() << std::endl;
+            recordWrite( toLegalFileName(key) );
         }
         else
         {
             OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin " << getID() << std::endl;
         }
 
-        return objWriteOK;
+        return countWrite( objWriteOK, object, start );
     }
 
     bool
@@ -371,7 +928,20 @@ namespace
         if ( !_ok ) return false;
 
         URI fileURI( toLegalFileName(key), _metaPath );
-        return osgDB::fileExists( fileURI.full() + ".osgb" );
+        std::string filename = fileURI.full() + ".osgb";
+        return osgDB::fileExists( filename ) && !isExpired( filename, maxAge );
+    }
+
+    bool
+    FileSystemCacheBin::touch( const std::string& key )
+    {
+        if ( !_ok ) return false;
+
+        URI fileURI( toLegalFileName(key), _metaPath );
+        _access.accessed( toLegalFileName(key) );
+
+        ScopedWriteLock exclusiveLock( _rwmutex );
+        return ::utime( (fileURI.full() + ".osgb").c_str(), 0L ) == 0;
     }
 
     bool
@@ -420,10 +990,80 @@ namespace
         {
             ScopedWriteLock exclusiveLock( _rwmutex );
             std::string binDir = osgDB::getFilePath( _metaPath );
+            _access.clear();
             return purgeDirectory( binDir );
         }
     }
 
+    unsigned long long
+    FileSystemCacheBin::evict( unsigned long long maxBytes )
+    {
+        if ( !_ok ) return 0;
+
+        unsigned long long limit = maxBytes > 0 ? maxBytes : _maxBytes;
+        if ( limit == 0 ) return 0;
+
+        ScopedMutexLock pass( _evictionPassMutex );
+        evicting();
+
+        if ( !_access.isLoaded() )
+            loadAccessIndex();
+
+        if ( _access.getTotalBytes() <= limit )
+        {
+            _access.save();
+            return 0;
+        }
+
+        std::vector<std::string> keys;
+        unsigned long long freed = _access.getLeastRecentlyUsed( (unsigned long long)(EVICTION_LOW_WATER * (double)limit), keys );
+        {
+            ScopedWriteLock exclusiveLock( _rwmutex );
+            for( std::vector<std::string>::const_iterator i = keys.begin(); i != keys.end(); ++i )
+            {
+                URI fileURI( *i, _metaPath );
+                ::unlink( (fileURI.full() + ".osgb").c_str() );
+                ::unlink( (fileURI.full() + ".meta").c_str() );
+                _access.removed( *i );
+            }
+        }
+        _access.save();
+
+        OE_INFO << LC << "Evicted " << keys.size() << " records (" << (freed / (1024*1024)) << "MB) from cache bin "
+            << getID() << " to stay under " << (limit / (1024*1024)) << "MB" << std::endl;
+
+        return freed;
+    }
+
+    bool
+    FileSystemCacheBin::getKeys( std::vector<std::string>& out_keys )
+    {
+        if ( !_ok ) return false;
+
+        ScopedReadLock sharedLock( _rwmutex );
+        listDirectory( osgDB::getFilePath(_metaPath), "", out_keys );
+        return true;
+    }
+
+    void
+    FileSystemCacheBin::listDirectory( const std::string& dir, const std::string& prefix, std::vector<std::string>& out_keys )
+    {
+        osgDB::DirectoryContents dc = osgDB::getDirectoryContents( dir );
+        for( osgDB::DirectoryContents::const_iterator i = dc.begin(); i != dc.end(); ++i )
+        {
+            if ( i->compare(".") == 0 || i->compare("..") == 0 )
+                continue;
+
+            std::string full = osgDB::concatPaths( dir, *i );
+            std::string name = prefix.empty() ? *i : prefix + "/" + *i;
+
+            if ( osgDB::fileType(full) == osgDB::DIRECTORY )
+                listDirectory( full, name, out_keys );
+            else if ( osgDB::getLowerCaseFileExtension(*i) == "osgb" )
+                out_keys.push_back( fromLegalFileName(osgDB::getNameLessExtension(name)) );
+        }
+    }
+
     Config
     FileSystemCacheBin::readMetadata()
     {
@@ -454,6 +1094,274 @@ namespace
         }
         return false;
     }
+
+    //------------------------------------------------------------------------
+
+    PackedFileSystemCacheBin::PackedFileSystemCacheBin(const std::string&            binID,
+                                                       const std::string&            rootPath,
+                                                       const FileSystemCacheOptions& options,
+                                                       unsigned long long            maxBytes,
+                                                       TaskService*                  evictionService) :
+    EvictingCacheBin( binID, maxBytes, evictionService ),
+    _ok             ( true )
+    {
+        std::string binPath = osgDB::concatPaths( rootPath, binID );
+        _metaPath = osgDB::concatPaths( binPath, "osgearth_cacheinfo.json" );
+
+        OE_INFO << LC << "Initializing packed cache bin: " << binPath << std::endl;
+
+        _store = new PackStore(
+            binPath,
+            std::min( options.maxPackSize().value(), 4095u ) * 1024u * 1024u,
+            options.compactionThreshold().value() );
+
+        if ( !_store->isOpen() )
+        {
+            OE_WARN << LC << "FAILED to open packed cache bin at \"" << binPath << "\"" << std::endl;
+            _ok = false;
+        }
+        else
+        {
+            _rw = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+#ifdef OSGEARTH_HAVE_ZLIB
+            _rwOptions = Registry::instance()->cloneOrCreateOptions();
+            _rwOptions->setOptionString( "Compressor=zlib" );
+#endif
+            CachePolicy::NO_CACHE.apply(_rwOptions.get());
+
+            if ( _maxBytes > 0 )
+                loadAccessIndex();
+        }
+    }
+
+    PackedFileSystemCacheBin::~PackedFileSystemCacheBin()
+    {
+        _access.save();
+    }
+
+    void
+    PackedFileSystemCacheBin::loadAccessIndex()
+    {
+        // the store knows which records exist and how big they are; the saved
+        // index adds the access times, where it has them.
+        std::string path = osgDB::concatPaths( osgDB::getFilePath(_metaPath), ACCESS_INDEX_FILE );
+        AccessIndex saved;
+        bool haveSaved = saved.load( path );
+
+        std::vector<PackStore::RecordInfo> records;
+        _store->getRecords( records );
+
+        _access.reset( path );
+        for( std::vector<PackStore::RecordInfo>::const_iterator i = records.begin(); i != records.end(); ++i )
+        {
+            ::time_t access = i->_timestamp;
+            if ( haveSaved )
+                saved.getAccess( i->_key, access );
+            _access.written( i->_key, i->_length, access );
+        }
+    }
+
+    ReadResult
+    PackedFileSystemCacheBin::read( const std::string& key, double maxAge, Type type )
+    {
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        if ( !_ok ) return countRead( ReadResult(), start );
+
+        std::string metaString, data;
+        ::time_t    timestamp;
+        if ( !_store->read( key, metaString, data, timestamp ) )
+            return countRead( ReadResult(), start );
+
+        std::istringstream in( data );
+        osgDB::ReaderWriter::ReadResult r =
+            type == TYPE_IMAGE ? _rw->readImage( in, _rwOptions.get() ) :
+            type == TYPE_NODE  ? _rw->readNode( in, _rwOptions.get() ) :
+                                 _rw->readObject( in, _rwOptions.get() );
+        if ( !r.success() )
+            return countRead( ReadResult(), start );
+
+        Config meta;
+        if ( !metaString.empty() )
+            meta.fromJSON( metaString );
+
+        osg::Object* object =
+            type == TYPE_IMAGE ? (osg::Object*)r.getImage() :
+            type == TYPE_NODE  ? (osg::Object*)r.getNode() :
+                                 r.getObject();
+
+        _access.accessed( key );
+
+        if ( maxAge < DBL_MAX && (double)(::time(0L) - timestamp) > maxAge )
+            return countRead( ReadResult( ReadResult::RESULT_EXPIRED, object, meta ), start );
+
+        return countRead( ReadResult( object, meta ), start );
+    }
+
+    ReadResult
+    PackedFileSystemCacheBin::readImage(const std::string& key, double maxAge)
+    {
+        return read( key, maxAge, TYPE_IMAGE );
+    }
+
+    ReadResult
+    PackedFileSystemCacheBin::readObject(const std::string& key, double maxAge)
+    {
+        return read( key, maxAge, TYPE_OBJECT );
+    }
+
+    ReadResult
+    PackedFileSystemCacheBin::readNode(const std::string& key, double maxAge)
+    {
+        return read( key, maxAge, TYPE_NODE );
+    }
+
+    ReadResult
+    PackedFileSystemCacheBin::readString(const std::string& key, double maxAge)
+    {
+        ReadResult r = readObject(key, maxAge);
+        bool usable = r.succeeded() || r.code() == ReadResult::RESULT_EXPIRED;
+        return usable && r.get<StringObject>() ? r : ReadResult();
+    }
+
+    bool
+    PackedFileSystemCacheBin::write( const std::string& key, const osg::Object* object, const Config& meta )
+    {
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        if ( !_ok || !object ) return countWrite( false, object, start );
+
+        std::ostringstream out;
+        osgDB::ReaderWriter::WriteResult r;
+
+        if ( dynamic_cast<const osg::Image*>(object) )
+            r = _rw->writeImage( *static_cast<const osg::Image*>(object), out, _rwOptions.get() );
+        else if ( dynamic_cast<const osg::Node*>(object) )
+            r = _rw->writeNode( *static_cast<const osg::Node*>(object), out, _rwOptions.get() );
+        else
+            r = _rw->writeObject( *object, out, _rwOptions.get() );
+
+        std::string metaString = meta.empty() ? "" : meta.toJSON();
+        std::string data = out.str();
+        bool objWriteOK = r.success() && _store->write( key, metaString, data );
+
+        if ( objWriteOK )
+        {
+            OE_DEBUG << LC << "Wrote \"" << key << "\" to cache bin " << getID() << std::endl;
+
+            // roughly the record length in the pack.
+            unsigned long long size = key.size() + metaString.size() + data.size();
+            _access.written( key, size, ::time(0L) );
+            wrote( size );
+        }
+        else
+        {
+            OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin " << getID() << std::endl;
+        }
+
+        return countWrite( objWriteOK, object, start );
+    }
+
+    bool
+    PackedFileSystemCacheBin::isCached( const std::string& key, double maxAge )
+    {
+        if ( !_ok ) return false;
+
+        ::time_t timestamp;
+        if ( !_store->contains( key, timestamp ) )
+            return false;
+
+        return maxAge >= DBL_MAX || (double)(::time(0L) - timestamp) <= maxAge;
+    }
+
+    bool
+    PackedFileSystemCacheBin::touch( const std::string& key )
+    {
+        _access.accessed( key );
+        return _ok && _store->touch( key );
+    }
+
+    bool
+    PackedFileSystemCacheBin::purge()
+    {
+        _access.clear();
+        return _ok && _store->purge();
+    }
+
+    unsigned long long
+    PackedFileSystemCacheBin::evict( unsigned long long maxBytes )
+    {
+        if ( !_ok ) return 0;
+
+        unsigned long long limit = maxBytes > 0 ? maxBytes : _maxBytes;
+        if ( limit == 0 ) return 0;
+
+        ScopedMutexLock pass( _evictionPassMutex );
+        evicting();
+
+        if ( !_access.isLoaded() )
+            loadAccessIndex();
+
+        std::vector<std::string> keys;
+        unsigned long long freed = 0;
+        if ( _access.getTotalBytes() > limit )
+        {
+            freed = _access.getLeastRecentlyUsed( (unsigned long long)(EVICTION_LOW_WATER * (double)limit), keys );
+
+            // the store compacts itself once enough of it is dead space.
+            _store->remove( keys );
+            for( std::vector<std::string>::const_iterator i = keys.begin(); i != keys.end(); ++i )
+                _access.removed( *i );
+
+            OE_INFO << LC << "Evicted " << keys.size() << " records (" << (freed / (1024*1024)) << "MB) from cache bin "
+                << getID() << " to stay under " << (limit / (1024*1024)) << "MB" << std::endl;
+        }
+
+        _access.save();
+        return freed;
+    }
+
+    bool
+    PackedFileSystemCacheBin::getKeys( std::vector<std::string>& out_keys )
+    {
+        if ( !_ok ) return false;
+
+        std::vector<PackStore::RecordInfo> records;
+        _store->getRecords( records );
+        out_keys.reserve( out_keys.size() + records.size() );
+        for( std::vector<PackStore::RecordInfo>::const_iterator i = records.begin(); i != records.end(); ++i )
+            out_keys.push_back( i->_key );
+        return true;
+    }
+
+    Config
+    PackedFileSystemCacheBin::readMetadata()
+    {
+        if ( !_ok ) return Config();
+
+        ScopedReadLock sharedLock( _rwmutex );
+        
+        Config conf;
+        conf.fromJSON( URI(_metaPath).getString(_rwOptions.get()) );
+
+        return conf;
+    }
+
+    bool
+    PackedFileSystemCacheBin::writeMetadata( const Config& conf )
+    {
+        if ( !_ok ) return false;
+
+        ScopedWriteLock exclusiveLock( _rwmutex );
+
+        std::fstream output( _metaPath.c_str(), std::ios_base::out );
+        if ( output.is_open() )
+        {
+            output << conf.toJSON(true);
+            output.flush();
+            output.close();
+            return true;
+        }
+        return false;
+    }
 }
 
 //------------------------------------------------------------------------
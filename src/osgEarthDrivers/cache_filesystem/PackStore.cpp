@@ -0,0 +1,745 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackStore"
+#include <osgEarth/StringUtils>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#   include <io.h>
+#else
+#   include <unistd.h>
+#endif
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+using namespace osgEarth::Threading;
+
+#define LC "[PackStore] "
+
+namespace
+{
+    const unsigned RECORD_MAGIC = 0x4b50454f; // "OEPK"
+
+    // Fixed part of a pack record; followed by key, metadata and data bytes.
+    struct RecordHeader
+    {
+        unsigned _magic;
+        unsigned _keyLen;
+        unsigned _metaLen;
+        unsigned _dataLen;
+    };
+
+    // Fixed part of an index journal entry; preceded by the key length and key.
+    struct IndexRecord
+    {
+        unsigned           _pack;
+        unsigned           _length;
+        unsigned long long _offset;
+        long long          _timestamp;
+    };
+
+    int openFile( const std::string& path, bool append )
+    {
+#ifdef _WIN32
+        int flags = _O_RDWR | _O_CREAT | _O_BINARY | (append ? _O_APPEND : 0);
+        return ::_open( path.c_str(), flags, _S_IREAD | _S_IWRITE );
+#else
+        int flags = O_RDWR | O_CREAT | (append ? O_APPEND : 0);
+        return ::open( path.c_str(), flags, 0644 );
+#endif
+    }
+
+    void closeFile( int fd )
+    {
+#ifdef _WIN32
+        ::_close( fd );
+#else
+        ::close( fd );
+#endif
+    }
+
+    unsigned long long fileSize( int fd )
+    {
+#ifdef _WIN32
+        __int64 size = ::_lseeki64( fd, 0, SEEK_END );
+#else
+        off_t size = ::lseek( fd, 0, SEEK_END );
+#endif
+        return size > 0 ? (unsigned long long)size : 0ull;
+    }
+
+    // Reads exactly "len" bytes at "offset". Without pread, the seek and the
+    // read must happen together, so they go under the caller's mutex.
+    bool readAt( int fd, char* buf, unsigned len, unsigned long long offset, Threading::Mutex& mutex )
+    {
+#ifdef _WIN32
+        Threading::ScopedMutexLock lock( mutex );
+        if ( ::_lseeki64( fd, (__int64)offset, SEEK_SET ) < 0 )
+            return false;
+        unsigned done = 0;
+        while( done < len )
+        {
+            int n = ::_read( fd, buf+done, len-done );
+            if ( n <= 0 ) return false;
+            done += (unsigned)n;
+        }
+        return true;
+#else
+        unsigned done = 0;
+        while( done < len )
+        {
+            ssize_t n = ::pread( fd, buf+done, len-done, (off_t)(offset+done) );
+            if ( n <= 0 ) return false;
+            done += (unsigned)n;
+        }
+        return true;
+#endif
+    }
+
+    // Writes all of "len" bytes at the current file position.
+    bool writeAll( int fd, const char* buf, unsigned len )
+    {
+        unsigned done = 0;
+        while( done < len )
+        {
+#ifdef _WIN32
+            int n = ::_write( fd, buf+done, len-done );
+#else
+            ssize_t n = ::write( fd, buf+done, len-done );
+#endif
+            if ( n <= 0 ) return false;
+            done += (unsigned)n;
+        }
+        return true;
+    }
+
+    void serializeIndexRecord( const std::string& key, const IndexRecord& rec, std::vector<char>& out )
+    {
+        unsigned keyLen = key.size();
+        out.resize( sizeof(unsigned) + keyLen + sizeof(IndexRecord) );
+        char* ptr = &out[0];
+        ::memcpy( ptr, &keyLen, sizeof(unsigned) );     ptr += sizeof(unsigned);
+        if ( keyLen > 0 )
+            ::memcpy( ptr, key.data(), keyLen );
+        ptr += keyLen;
+        ::memcpy( ptr, &rec, sizeof(IndexRecord) );
+    }
+
+    // Deletes a file, if it exists.
+    void removeFile( const std::string& path )
+    {
+        if ( osgDB::fileExists(path) )
+            ::remove( path.c_str() );
+    }
+
+    // Don't bother compacting until there is at least this much dead space.
+    const unsigned long long MIN_DEAD_BYTES_TO_COMPACT = 1ull << 24;
+}
+
+//------------------------------------------------------------------------
+
+PackStore::PackStore(const std::string& folder,
+                     unsigned           maxPackSize,
+                     float              compactThreshold) :
+_ok               ( false ),
+_folder           ( folder ),
+_maxPackSize      ( maxPackSize > 0 ? maxPackSize : 1u<<30 ),
+_compactThreshold ( compactThreshold ),
+_current          ( 0L ),
+_nextPackId       ( 0 ),
+_indexFd          ( -1 ),
+_liveBytes        ( 0 ),
+_packBytes        ( 0 )
+{
+    _indexPath = osgDB::concatPaths( _folder, "pack.idx" );
+
+    ScopedWriteLock exclusive( _mutex );
+    _ok = open();
+    if ( _ok && needsCompaction() )
+    {
+        compactImpl();
+    }
+}
+
+PackStore::~PackStore()
+{
+    ScopedWriteLock exclusive( _mutex );
+    close();
+}
+
+std::string
+PackStore::packPath( unsigned id ) const
+{
+    char buf[32];
+    ::sprintf( buf, "pack_%05u.dat", id );
+    return osgDB::concatPaths( _folder, buf );
+}
+
+bool
+PackStore::open()
+{
+    osgDB::makeDirectory( _folder );
+    if ( !osgDB::fileExists(_folder) )
+    {
+        OE_WARN << LC << "FAILED to create folder \"" << _folder << "\"" << std::endl;
+        return false;
+    }
+
+    _packBytes  = 0;
+    _nextPackId = 0;
+
+    if ( !loadIndex() )
+        return false;
+
+    // open every pack the index refers to; records in missing packs are lost.
+    for( Index::iterator i = _index.begin(); i != _index.end(); )
+    {
+        unsigned id = i->second._pack;
+        if ( _packs.find(id) == _packs.end() )
+        {
+            Pack* pack = openPack( id, false );
+            if ( !pack )
+            {
+                OE_WARN << LC << "Missing pack file " << packPath(id) << std::endl;
+                _liveBytes -= i->second._length;
+                _index.erase( i++ );
+                continue;
+            }
+            _packs[id] = pack;
+            _packBytes += pack->_size;
+        }
+        if ( id >= _nextPackId )
+            _nextPackId = id + 1;
+        ++i;
+    }
+
+    // packs that nothing refers to (e.g. left over from an interrupted
+    // compaction) hold no live data.
+    osgDB::DirectoryContents files = osgDB::getDirectoryContents( _folder );
+    for( osgDB::DirectoryContents::const_iterator f = files.begin(); f != files.end(); ++f )
+    {
+        unsigned id;
+        if ( ::sscanf( f->c_str(), "pack_%05u.dat", &id ) == 1 && _packs.find(id) == _packs.end() )
+        {
+            OE_DEBUG << LC << "Removing unreferenced pack " << *f << std::endl;
+            removeFile( osgDB::concatPaths(_folder, *f) );
+        }
+    }
+
+    _indexFd = openFile( _indexPath, true );
+    if ( _indexFd < 0 )
+    {
+        OE_WARN << LC << "FAILED to open index \"" << _indexPath << "\"" << std::endl;
+        return false;
+    }
+
+    // carry on appending to the newest pack if it has room.
+    if ( !_packs.empty() && _packs.rbegin()->second->_size < _maxPackSize )
+        _current = _packs.rbegin()->second;
+
+    OE_DEBUG << LC << "Opened " << _folder << ": " << _index.size() << " records in "
+        << _packs.size() << " packs" << std::endl;
+
+    return true;
+}
+
+void
+PackStore::close()
+{
+    for( Packs::iterator i = _packs.begin(); i != _packs.end(); ++i )
+        closePack( i->second, false );
+    _packs.clear();
+    _current = 0L;
+
+    if ( _indexFd >= 0 )
+    {
+        closeFile( _indexFd );
+        _indexFd = -1;
+    }
+}
+
+bool
+PackStore::loadIndex()
+{
+    _index.clear();
+    _liveBytes = 0;
+
+    std::ifstream in( _indexPath.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !in.is_open() )
+        return true; // new store
+
+    std::string key;
+    for( ; ; )
+    {
+        unsigned keyLen;
+        if ( !in.read( (char*)&keyLen, sizeof(unsigned) ) )
+            break;
+
+        key.resize( keyLen );
+        IndexRecord rec;
+        if ( (keyLen > 0 && !in.read( &key[0], keyLen )) || !in.read( (char*)&rec, sizeof(IndexRecord) ) )
+        {
+            // a torn entry at the end of the journal; everything before it stands.
+            OE_INFO << LC << "Ignoring truncated index entry in " << _indexPath << std::endl;
+            break;
+        }
+
+        Index::iterator i = _index.find( key );
+        if ( i != _index.end() )
+        {
+            _liveBytes -= i->second._length;
+            if ( rec._length == 0 )
+                _index.erase( i );
+        }
+
+        if ( rec._length > 0 )
+        {
+            Entry& entry     = _index[key];
+            entry._pack      = rec._pack;
+            entry._offset    = rec._offset;
+            entry._length    = rec._length;
+            entry._timestamp = (::time_t)rec._timestamp;
+            _liveBytes += rec._length;
+        }
+    }
+
+    return true;
+}
+
+bool
+PackStore::appendIndex( const std::string& key, const Entry& entry )
+{
+    IndexRecord rec;
+    rec._pack      = entry._pack;
+    rec._length    = entry._length;
+    rec._offset    = entry._offset;
+    rec._timestamp = (long long)entry._timestamp;
+
+    std::vector<char> buf;
+    serializeIndexRecord( key, rec, buf );
+    return writeAll( _indexFd, &buf[0], buf.size() );
+}
+
+PackStore::Pack*
+PackStore::openPack( unsigned id, bool create )
+{
+    std::string path = packPath( id );
+    if ( !create && !osgDB::fileExists(path) )
+        return 0L;
+
+    int fd = openFile( path, false );
+    if ( fd < 0 )
+        return 0L;
+
+    Pack* pack  = new Pack();
+    pack->_id   = id;
+    pack->_fd   = fd;
+    pack->_size = fileSize( fd );
+    return pack;
+}
+
+PackStore::Pack*
+PackStore::startPack()
+{
+    Pack* pack = openPack( _nextPackId, true );
+    if ( pack )
+    {
+        ++_nextPackId;
+        _packs[pack->_id] = pack;
+    }
+    else
+    {
+        OE_WARN << LC << "FAILED to create pack " << packPath(_nextPackId) << std::endl;
+    }
+    return pack;
+}
+
+void
+PackStore::closePack( Pack* pack, bool remove )
+{
+    if ( pack->_fd >= 0 )
+        closeFile( pack->_fd );
+    if ( remove )
+        removeFile( packPath(pack->_id) );
+    delete pack;
+}
+
+bool
+PackStore::readRecord( Pack* pack, const Entry& entry, std::vector<char>& out_buf )
+{
+    if ( !pack || entry._length < sizeof(RecordHeader) )
+        return false;
+
+    out_buf.resize( entry._length );
+    return readAt( pack->_fd, &out_buf[0], entry._length, entry._offset, pack->_ioMutex );
+}
+
+bool
+PackStore::appendRecord( Pack* pack, const std::vector<char>& buf, Entry& out_entry )
+{
+#ifdef _WIN32
+    if ( ::_lseeki64( pack->_fd, (__int64)pack->_size, SEEK_SET ) < 0 )
+        return false;
+#else
+    if ( ::lseek( pack->_fd, (off_t)pack->_size, SEEK_SET ) < 0 )
+        return false;
+#endif
+
+    if ( !writeAll( pack->_fd, &buf[0], buf.size() ) )
+        return false;
+
+    out_entry._pack   = pack->_id;
+    out_entry._offset = pack->_size;
+    out_entry._length = buf.size();
+
+    pack->_size += buf.size();
+    _packBytes  += buf.size();
+    return true;
+}
+
+bool
+PackStore::read(const std::string& key,
+                std::string&       out_meta,
+                std::string&       out_data,
+                ::time_t&          out_timestamp)
+{
+    if ( !_ok ) return false;
+
+    std::vector<char> buf;
+    {
+        ScopedReadLock shared( _mutex );
+
+        Index::const_iterator i = _index.find( key );
+        if ( i == _index.end() )
+            return false;
+
+        Packs::const_iterator p = _packs.find( i->second._pack );
+        if ( p == _packs.end() || !readRecord( p->second, i->second, buf ) )
+        {
+            OE_WARN << LC << "FAILED to read record \"" << key << "\"" << std::endl;
+            return false;
+        }
+        out_timestamp = i->second._timestamp;
+    }
+
+    RecordHeader header;
+    ::memcpy( &header, &buf[0], sizeof(RecordHeader) );
+    unsigned long long total = sizeof(RecordHeader) + (unsigned long long)header._keyLen + header._metaLen + header._dataLen;
+    if ( header._magic != RECORD_MAGIC || total != buf.size() ||
+         key.compare( 0, std::string::npos, &buf[sizeof(RecordHeader)], header._keyLen ) != 0 )
+    {
+        OE_WARN << LC << "Corrupt record \"" << key << "\" in " << _folder << std::endl;
+        return false;
+    }
+
+    const char* ptr = &buf[sizeof(RecordHeader) + header._keyLen];
+    out_meta.assign( ptr, header._metaLen );
+    out_data.assign( ptr + header._metaLen, header._dataLen );
+    return true;
+}
+
+bool
+PackStore::write(const std::string& key,
+                 const std::string& meta,
+                 const std::string& data)
+{
+    if ( !_ok ) return false;
+
+    RecordHeader header;
+    header._magic   = RECORD_MAGIC;
+    header._keyLen  = key.size();
+    header._metaLen = meta.size();
+    header._dataLen = data.size();
+
+    std::vector<char> buf( sizeof(RecordHeader) + key.size() + meta.size() + data.size() );
+    char* ptr = &buf[0];
+    ::memcpy( ptr, &header, sizeof(RecordHeader) ); ptr += sizeof(RecordHeader);
+    if ( !key.empty() )  ::memcpy( ptr, key.data(), key.size() );
+    ptr += key.size();
+    if ( !meta.empty() ) ::memcpy( ptr, meta.data(), meta.size() );
+    ptr += meta.size();
+    if ( !data.empty() ) ::memcpy( ptr, data.data(), data.size() );
+
+    ScopedWriteLock exclusive( _mutex );
+
+    // roll over to a fresh pack when this one is full. That's also a good
+    // moment to reclaim dead space.
+    if ( _current && _current->_size > 0 && _current->_size + buf.size() > _maxPackSize )
+    {
+        _current = 0L;
+        if ( needsCompaction() )
+            compactImpl();
+    }
+
+    if ( !_current )
+    {
+        _current = startPack();
+        if ( !_current )
+            return false;
+    }
+
+    Entry entry;
+    if ( !appendRecord( _current, buf, entry ) )
+    {
+        OE_WARN << LC << "FAILED to write record \"" << key << "\"" << std::endl;
+        return false;
+    }
+    entry._timestamp = ::time(0L);
+
+    if ( !appendIndex( key, entry ) )
+    {
+        OE_WARN << LC << "FAILED to index record \"" << key << "\"" << std::endl;
+        return false;
+    }
+
+    Index::iterator i = _index.find( key );
+    if ( i != _index.end() )
+        _liveBytes -= i->second._length;
+
+    _index[key] = entry;
+    _liveBytes += entry._length;
+    return true;
+}
+
+bool
+PackStore::contains( const std::string& key, ::time_t& out_timestamp )
+{
+    if ( !_ok ) return false;
+
+    ScopedReadLock shared( _mutex );
+    Index::const_iterator i = _index.find( key );
+    if ( i == _index.end() )
+        return false;
+
+    out_timestamp = i->second._timestamp;
+    return true;
+}
+
+bool
+PackStore::touch( const std::string& key )
+{
+    if ( !_ok ) return false;
+
+    ScopedWriteLock exclusive( _mutex );
+    Index::iterator i = _index.find( key );
+    if ( i == _index.end() )
+        return false;
+
+    i->second._timestamp = ::time(0L);
+    return appendIndex( key, i->second );
+}
+
+bool
+PackStore::remove( const std::vector<std::string>& keys )
+{
+    if ( !_ok ) return false;
+
+    ScopedWriteLock exclusive( _mutex );
+
+    bool ok = true;
+    for( std::vector<std::string>::const_iterator k = keys.begin(); k != keys.end(); ++k )
+    {
+        Index::iterator i = _index.find( *k );
+        if ( i == _index.end() )
+            continue;
+
+        // a zero length marks a deletion in the index journal.
+        Entry entry = i->second;
+        entry._length = 0;
+        if ( !appendIndex( *k, entry ) )
+        {
+            ok = false;
+            break;
+        }
+
+        _liveBytes -= i->second._length;
+        _index.erase( i );
+    }
+
+    if ( needsCompaction() )
+        compactImpl();
+
+    return ok;
+}
+
+void
+PackStore::getRecords( std::vector<RecordInfo>& out_records )
+{
+    ScopedReadLock shared( _mutex );
+    out_records.reserve( out_records.size() + _index.size() );
+    for( Index::const_iterator i = _index.begin(); i != _index.end(); ++i )
+    {
+        RecordInfo info;
+        info._key       = i->first;
+        info._length    = i->second._length;
+        info._timestamp = i->second._timestamp;
+        out_records.push_back( info );
+    }
+}
+
+bool
+PackStore::purge()
+{
+    if ( !_ok ) return false;
+
+    ScopedWriteLock exclusive( _mutex );
+
+    for( Packs::iterator i = _packs.begin(); i != _packs.end(); ++i )
+        closePack( i->second, true );
+    _packs.clear();
+    _current = 0L;
+    _index.clear();
+    _liveBytes = 0;
+    _packBytes = 0;
+
+    if ( _indexFd >= 0 )
+        closeFile( _indexFd );
+    removeFile( _indexPath );
+    _indexFd = openFile( _indexPath, true );
+
+    _ok = _indexFd >= 0;
+    return _ok;
+}
+
+bool
+PackStore::compact()
+{
+    if ( !_ok ) return false;
+
+    ScopedWriteLock exclusive( _mutex );
+    return compactImpl();
+}
+
+bool
+PackStore::needsCompaction() const
+{
+    unsigned long long dead = _packBytes > _liveBytes ? _packBytes - _liveBytes : 0ull;
+    return
+        dead >= MIN_DEAD_BYTES_TO_COMPACT &&
+        (double)dead > (double)_compactThreshold * (double)_packBytes;
+}
+
+bool
+PackStore::compactImpl()
+{
+    OE_INFO << LC << "Compacting " << _folder << " ("
+        << _liveBytes << " live of " << _packBytes << " bytes)" << std::endl;
+
+    Packs oldPacks;
+    oldPacks.swap( _packs );
+    unsigned long long oldPackBytes = _packBytes;
+    _current   = 0L;
+    _packBytes = 0;
+
+    // copy each live record into the new packs and journal it into a new index.
+    std::string tempIndexPath = _indexPath + ".tmp";
+    removeFile( tempIndexPath );
+    int tempFd = openFile( tempIndexPath, true );
+
+    bool ok = tempFd >= 0;
+    Index newIndex;
+    std::vector<char> buf, indexBuf;
+
+    for( Index::const_iterator i = _index.begin(); ok && i != _index.end(); ++i )
+    {
+        Packs::const_iterator p = oldPacks.find( i->second._pack );
+        ok = p != oldPacks.end() && readRecord( p->second, i->second, buf );
+        if ( !ok ) break;
+
+        if ( _current && _current->_size > 0 && _current->_size + buf.size() > _maxPackSize )
+            _current = 0L;
+        if ( !_current )
+            _current = startPack();
+
+        Entry entry;
+        ok = _current && appendRecord( _current, buf, entry );
+        if ( !ok ) break;
+        entry._timestamp = i->second._timestamp;
+
+        IndexRecord rec;
+        rec._pack      = entry._pack;
+        rec._length    = entry._length;
+        rec._offset    = entry._offset;
+        rec._timestamp = (long long)entry._timestamp;
+        serializeIndexRecord( i->first, rec, indexBuf );
+        ok = writeAll( tempFd, &indexBuf[0], indexBuf.size() );
+
+        newIndex[i->first] = entry;
+    }
+
+    if ( tempFd >= 0 )
+        closeFile( tempFd );
+
+    // swap the new index in for the old one. Once the rename lands, the new
+    // packs are the live data and the old ones can go.
+    bool swapped = false;
+    if ( ok )
+    {
+        closeFile( _indexFd );
+        _indexFd = -1;
+        removeFile( _indexPath );
+        swapped = ::rename( tempIndexPath.c_str(), _indexPath.c_str() ) == 0;
+    }
+
+    if ( !swapped )
+    {
+        // back out: drop the new packs and carry on with the old ones.
+        OE_WARN << LC << "FAILED to compact " << _folder << std::endl;
+        for( Packs::iterator i = _packs.begin(); i != _packs.end(); ++i )
+            closePack( i->second, true );
+        _packs.swap( oldPacks );
+        _packBytes = oldPackBytes;
+        _current   = 0L;
+        removeFile( tempIndexPath );
+
+        if ( _indexFd < 0 )
+        {
+            // the old index was already removed; rewrite it from memory.
+            _indexFd = openFile( _indexPath, true );
+            for( Index::const_iterator i = _index.begin(); _indexFd >= 0 && i != _index.end(); ++i )
+                appendIndex( i->first, i->second );
+            _ok = _indexFd >= 0;
+        }
+        return false;
+    }
+
+    for( Packs::iterator i = oldPacks.begin(); i != oldPacks.end(); ++i )
+        closePack( i->second, true );
+
+    _index.swap( newIndex );
+
+    _indexFd = openFile( _indexPath, true );
+    if ( _indexFd < 0 )
+    {
+        OE_WARN << LC << "FAILED to reopen index \"" << _indexPath << "\"" << std::endl;
+        _ok = false;
+    }
+
+    OE_INFO << LC << "Compacted " << _folder << " to " << _packBytes << " bytes in "
+        << _packs.size() << " packs" << std::endl;
+
+    return true;
+}
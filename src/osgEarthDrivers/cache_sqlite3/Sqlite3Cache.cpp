@@ -18,1733 +18,786 @@
  */
 #include "Sqlite3CacheOptions"
 
-#include <osgEarth/FileUtils>
+#include <osgEarth/Cache>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
 #include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/URI>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
 #include <osgDB/ReaderWriter>
-#if OSG_MIN_VERSION_REQUIRED(2,9,5)
-#  include <osgDB/Options>
-#endif
-#include <OpenThreads/Mutex>
-#include <OpenThreads/ScopedLock>
-#include <cstring>
-#include <fstream>
-
-// for the compressor stuff
-#if OSG_MIN_VERSION_REQUIRED(2,9,8)
-#  define USE_SERIALIZERS
-#  include <osgDB/Serializer>
-#endif
-
+#include <osgDB/Registry>
+#include <osg/Math>
+#include <sstream>
+#include <map>
+#include <set>
+#include <ctime>
 #include <sqlite3.h>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
-using namespace OpenThreads;
+using namespace osgEarth::Threading;
 
 #define LC "[Sqlite3Cache] "
 
-#define USE_TRANSACTIONS
-#define USE_L2_CACHE
-
-//#define SPLIT_DB_FILE
-//#define SPLIT_LAYER_DB
-#define UPDATE_ACCESS_TIMES
-#define UPDATE_ACCESS_TIMES_POOL
-#define MAX_REQUEST_TO_RUN_PURGE 100
-
-#define PURGE_GENERAL
-//#define INSERT_POOL
-
-//#define MONITOR_THREAD_HEALTH
-
 // --------------------------------------------------------------------------
 
-// opens a database connection with default settings.
-static
-sqlite3* openDatabase( const std::string& path, bool serialized )
+namespace
 {
-    //Try to create the path if it doesn't exist
-    std::string dirPath = osgDB::getFilePath(path);    
-
-    //If the path doesn't currently exist or we can't create the path, don't cache the file
-    if (!osgDB::fileExists(dirPath) && !osgDB::makeDirectory(dirPath))
+    // quotes an SQL identifier (table name)
+    std::string quoteIdentifier( const std::string& name )
     {
-        OE_WARN << LC << "Couldn't create path " << dirPath << std::endl;
+        std::string out = "\"";
+        for( std::string::const_iterator i = name.begin(); i != name.end(); ++i )
+        {
+            if ( *i == '"' ) out += "\"\"";
+            else             out += *i;
+        }
+        return out + "\"";
     }
 
-    sqlite3* db = 0L;
-
-    // not sure if SHAREDCACHE is necessary or wise 
-    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
-    flags |= serialized ? SQLITE_OPEN_FULLMUTEX : SQLITE_OPEN_NOMUTEX;
-
-    int rc = sqlite3_open_v2( path.c_str(), &db, flags, 0L );
-
-    if ( rc != 0 )
+    /**
+     * A database connection that belongs to a single thread. It keeps its
+     * prepared statements for reuse, so each statement is compiled once per
+     * thread instead of once per call.
+     */
+    struct Connection : public osg::Referenced
     {
-        OE_WARN << LC << "Failed to open cache \"" << path << "\": " << sqlite3_errmsg(db) << std::endl;
-        return 0L;
-    }
+        Connection() : _db( 0L ) { }
 
-    // make sure that writes actually finish
-    sqlite3_busy_timeout( db, 60000 );
+        bool open( const std::string& path, bool serialized, bool wal )
+        {
+            int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+            flags |= serialized ? SQLITE_OPEN_FULLMUTEX : SQLITE_OPEN_NOMUTEX;
 
-    return db;
-}
+            if ( sqlite3_open_v2( path.c_str(), &_db, flags, 0L ) != SQLITE_OK )
+            {
+                OE_WARN << LC << "Failed to open cache \"" << path << "\": " << sqlite3_errmsg(_db) << std::endl;
+                sqlite3_close( _db );
+                _db = 0L;
+                return false;
+            }
 
-// --------------------------------------------------------------------------
+            // make sure that writes actually finish
+            sqlite3_busy_timeout( _db, 60000 );
 
-// a slightly customized Cache class that will support asynchronous writes
-struct AsyncCache : public Cache
-{
-public:
-    AsyncCache(const CacheOptions& options =CacheOptions()): Cache(options) { }
-    virtual void setImageSync(
-        const TileKey& key,
-        const CacheSpec& spec,
-        const osg::Image* image ) =0;
-};
+            // WAL lets readers proceed while another connection is writing;
+            // NORMAL sync is durable enough for a cache in that mode.
+            if ( wal )
+            {
+                exec( "PRAGMA journal_mode=WAL" );
+                exec( "PRAGMA synchronous=NORMAL" );
+            }
+            return true;
+        }
 
+        bool exec( const std::string& sql )
+        {
+            char* errMsg = 0L;
+            if ( sqlite3_exec( _db, sql.c_str(), 0L, 0L, &errMsg ) != SQLITE_OK )
+            {
+                OE_WARN << LC << "SQL error (" << sql << "): " << (errMsg ? errMsg : "unknown") << std::endl;
+                sqlite3_free( errMsg );
+                return false;
+            }
+            return true;
+        }
 
-// --------------------------------------------------------------------------
+        // returns a cached statement for the SQL, reset and with no bindings.
+        sqlite3_stmt* prepare( const std::string& sql )
+        {
+            Statements::iterator i = _statements.find( sql );
+            if ( i != _statements.end() )
+            {
+                sqlite3_reset( i->second );
+                sqlite3_clear_bindings( i->second );
+                return i->second;
+            }
 
-struct MetadataRecord
-{
-    std::string   _layerName;
-    std::string   _format;
-    int           _tileSize;
-    osg::ref_ptr<const Profile> _profile;
-    std::string   _compressor;
-};
+            sqlite3_stmt* stmt = 0L;
+            if ( sqlite3_prepare_v2( _db, sql.c_str(), sql.length(), &stmt, 0L ) != SQLITE_OK )
+            {
+                OE_WARN << LC << "Failed to prepare SQL (" << sql << "): " << sqlite3_errmsg(_db) << std::endl;
+                sqlite3_finalize( stmt );
+                return 0L;
+            }
+            _statements[sql] = stmt;
+            return stmt;
+        }
 
-/**
- * This database table holds one record for each cached layer in the database.
- */
-struct MetadataTable
-{
-    MetadataTable() { }
+        sqlite3* _db;
 
-    bool initialize( sqlite3* db )
-    {
-        std::string sql =
-            "CREATE TABLE IF NOT EXISTS metadata ("
-            "layer varchar(255) PRIMARY KEY UNIQUE, "
-            "format varchar(255), "
-            "compressor varchar(64), "
-            "tilesize int, "
-            "srs varchar(1024), "
-            "xmin double, "
-            "ymin double, "
-            "xmax double, "
-            "ymax double, "
-            "tw int, "
-            "th int )";
-
-        OE_DEBUG << LC << "SQL = " << sql << std::endl;
-
-        char* errMsg = 0L;
-        int err = sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg );
-        if ( err != SQLITE_OK )
+    protected:
+        virtual ~Connection()
         {
-            OE_WARN << LC << "[Sqlite3Cache] Creating metadata: " << errMsg << std::endl;
-            sqlite3_free( errMsg );
-            return false;
+            for( Statements::iterator i = _statements.begin(); i != _statements.end(); ++i )
+                sqlite3_finalize( i->second );
+            if ( _db )
+                sqlite3_close( _db );
         }
 
-        // prep the insert/select statement SQL strings:
-        _insertSQL = 
-            "INSERT OR REPLACE INTO metadata "
-            "(layer,format,compressor,tilesize,srs,xmin,ymin,xmax,ymax,tw,th) "
-            "VALUES (?,?,?,?,?,?,?,?,?,?,?)";
-
-        _selectSQL =
-            "SELECT layer,format,compressor,tilesize,srs,xmin,ymin,xmax,ymax,tw,th "
-            "FROM metadata WHERE layer = ?";
-
-        return true;
-    }
+        typedef std::map<std::string, sqlite3_stmt*> Statements;
+        Statements _statements;
+    };
 
-    bool store( const MetadataRecord& rec, sqlite3* db )
+    /**
+     * State shared by a cache and its bins: the database location and one
+     * connection per thread.
+     */
+    struct Database : public osg::Referenced
     {
-        sqlite3_stmt* insert = 0;
-        int rc = sqlite3_prepare_v2( db, _insertSQL.c_str(), _insertSQL.length(), &insert, 0L );
-        if ( rc != SQLITE_OK )
+        Database( const std::string& path, const Sqlite3CacheOptions& options ) :
+            _path      ( path ),
+            _serialized( options.serialized() == true ),
+            _wal       ( options.wal() == true )
         {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
+            if ( options.asyncWrites() == true )
+                _writeService = new TaskService( "Sqlite3Cache writer", 1 );
         }
 
-        sqlite3_bind_text( insert, 1, rec._layerName.c_str(), -1, 0L );
-        sqlite3_bind_text( insert, 2, rec._format.c_str(), -1, 0L );
-        sqlite3_bind_text( insert, 3, rec._compressor.c_str(), -1, 0L );
-        sqlite3_bind_int ( insert, 4, rec._tileSize );
-        sqlite3_bind_text( insert, 5, rec._profile->getSRS()->getInitString().c_str(), -1, 0L );
-        sqlite3_bind_double( insert, 6, rec._profile->getExtent().xMin() );
-        sqlite3_bind_double( insert, 7, rec._profile->getExtent().yMin() );
-        sqlite3_bind_double( insert, 8, rec._profile->getExtent().xMax() );
-        sqlite3_bind_double( insert, 9, rec._profile->getExtent().yMax() );
-        unsigned int tw, th;
-        rec._profile->getNumTiles( 0, tw, th );
-        sqlite3_bind_int( insert, 10, tw );
-        sqlite3_bind_int( insert, 11, th );
-
-        bool success;
-
-        rc = sqlite3_step(insert);
-        if ( rc != SQLITE_DONE )
-        {
-            OE_WARN << LC << "SQL INSERT failed: " << sqlite3_errmsg( db )
-                << "; SQL = " << _insertSQL
-                << std::endl;
-            success = false;
-        }
-        else
+        // gets the calling thread's connection, opening it if necessary.
+        Connection* getConnection()
         {
-            OE_DEBUG << LC << "Stored metadata record for \"" << rec._layerName << "\"" << std::endl;
-            success = true;
+            osg::ref_ptr<Connection>& conn = _connections.get();
+            if ( !conn.valid() )
+            {
+                conn = new Connection();
+                conn->open( _path, _serialized, _wal );
+            }
+            return conn->_db ? conn.get() : 0L;
         }
 
-        sqlite3_finalize( insert );
-        return success;
-    }
+        std::string                        _path;
+        bool                               _serialized;
+        bool                               _wal;
+        PerThread< osg::ref_ptr<Connection> > _connections;
+        osg::ref_ptr<TaskService>          _writeService;
+    };
+}
+
+// --------------------------------------------------------------------------
 
-    bool load( const std::string& key, sqlite3* db, MetadataRecord& output )
+namespace
+{
+    /**
+     * Cache that stores each bin as a table in a single sqlite3 database.
+     */
+    class Sqlite3Cache : public Cache
     {
-        bool success = true;
+    public:
+        Sqlite3Cache() { } // unused
+        Sqlite3Cache( const Sqlite3Cache& rhs, const osg::CopyOp& op ) { } // unused
+        META_Object( osgEarth, Sqlite3Cache );
 
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, _selectSQL.c_str(), _selectSQL.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
+        Sqlite3Cache( const CacheOptions& options );
 
-        sqlite3_bind_text( select, 1, key.c_str(), -1, 0L );
+    public: // Cache interface
 
-        rc = sqlite3_step( select );
-        if ( rc == SQLITE_ROW ) 
-        {
-            // got a result            
-            output._layerName = (char*)sqlite3_column_text( select, 0 );
-            output._format = (char*)sqlite3_column_text( select, 1 );
-            output._compressor = (char*)sqlite3_column_text( select, 2 );
-            output._tileSize = sqlite3_column_int( select, 3 );
-            ProfileOptions pconf;
-            pconf.srsString() = (char*)sqlite3_column_text( select, 4 );
-            pconf.bounds() = Bounds(
-                sqlite3_column_double( select, 5 ),
-                sqlite3_column_double( select, 6 ),
-                sqlite3_column_double( select, 7 ),
-                sqlite3_column_double( select, 8 ) );
-            pconf.numTilesWideAtLod0() = sqlite3_column_int( select, 9 );
-            pconf.numTilesHighAtLod0() = sqlite3_column_int( select, 10 );
-            output._profile = Profile::create( pconf );
-            success = true;
-        }
-        else
-        {
-            // no result
-            OE_DEBUG << "NO metadata record found for \"" << key << "\"" << std::endl;
-            success = false;
-        }
+        CacheBin* addBin( const std::string& binID );
 
-        sqlite3_finalize( select );
-        return success;
-    }
+        CacheBin* getOrCreateDefaultBin();
 
+    protected:
+        CacheBin* createBin( const std::string& binID );
 
-    bool loadAllLayers( sqlite3* db, std::vector<std::string>& output )
+        Sqlite3CacheOptions     _options;
+        osg::ref_ptr<Database>  _db;
+    };
+
+    /**
+     * Cache bin backed by one table of a Sqlite3Cache database.
+     *
+     * Writes are serialized on the calling thread and queued; once the queue
+     * reaches the batch size (or has waited long enough) it is committed in
+     * a single transaction, on the background writer when async writes are
+     * enabled. Reads check the queue first, so a queued record is readable
+     * right away. Access times are recorded the same way and written with
+     * the next batch.
+     */
+    class Sqlite3CacheBin : public CacheBin
     {
-        bool success = true;
+    public:
+        Sqlite3CacheBin( const std::string& binID, Database* db, const Sqlite3CacheOptions& options );
 
-        sqlite3_stmt* select = 0L;
-        std::string selectLayersSQL = "select layer from \"metadata\"";
-        int rc = sqlite3_prepare_v2( db, selectLayersSQL.c_str(), selectLayersSQL.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
+    public: // CacheBin interface
 
-        success = true;
-        rc = sqlite3_step( select );
-        while (rc == SQLITE_ROW) {
-            output.push_back((char*)sqlite3_column_text( select, 0 ));
-            rc = sqlite3_step( select );
-        }
+        ReadResult readObject( const std::string& key, double maxAge =DBL_MAX );
 
-        if (rc != SQLITE_DONE)
-        {
-            // no result
-            OE_WARN << "NO layers found in metadata" << std::endl;
-            success = false;
-        }
+        ReadResult readImage( const std::string& key, double maxAge =DBL_MAX );
 
-        sqlite3_finalize( select );
-        return success;
-    }
+        ReadResult readNode( const std::string& key, double maxAge =DBL_MAX );
 
-    std::string _insertSQL;
-    std::string _selectSQL;
- };
+        ReadResult readString( const std::string& key, double maxAge =DBL_MAX );
 
-// --------------------------------------------------------------------------
+        bool write( const std::string& key, const osg::Object* object, const Config& meta );
 
-struct ImageRecord
-{
-    ImageRecord( const TileKey& key ) : _key(key) { }
-    TileKey _key;
-    int _created;
-    int _accessed;
-    osg::ref_ptr<const osg::Image> _image;
-};
+        bool isCached( const std::string& key, double maxAge =DBL_MAX );
 
-#ifdef INSERT_POOL
-class Sqlite3Cache;
-struct AsyncInsertPool : public TaskRequest {
-    struct Entry {
-        TileKey _key;
-        osg::ref_ptr<osg::Image> _image;
-        std::string _format;
-        Entry() {}
-        Entry(const TileKey& key, const std::string& format, osg::Image* img) : _key(key), _format(format), _image(img) {}
-    };
+        bool touch( const std::string& key );
 
-    typedef std::map<std::string, Entry> PoolContainer;
+        bool purge();
 
-    AsyncInsertPool(const std::string& layerName, Sqlite3Cache* cache );
+        Config readMetadata();
 
-    void addEntry( const TileKey& key, const std::string& format, osg::Image* image)
-    {
-        const std::string& keyStr = key.str();
-        if (_pool.find(keyStr) != _pool.end())
-            return;
-        _pool[keyStr] = Entry(key, format, image);
-    }
+        bool writeMetadata( const Config& meta );
 
-    osg::Image* findImage(const std::string& key)
-    {
-        PoolContainer::iterator it = _pool.find(key);
-        if (it != _pool.end()) {
-            return it->second._image.get();
-        }
-        return 0;
-    }
+    public:
+        /** Commits all queued writes and access times. */
+        void flush();
 
-    void operator()( ProgressCallback* progress );
-    
-    PoolContainer _pool;
-    std::string _layerName;
-    osg::observer_ptr<Sqlite3Cache> _cache;
-};
-#endif
+    protected:
+        virtual ~Sqlite3CacheBin();
 
-/**
- * Database table that holds one record per cached imagery tile in a layer. The layer name
- * is the table name.
- */
-struct LayerTable : public osg::Referenced
-{
-    LayerTable( const MetadataRecord& meta, sqlite3* db )
-        : _meta(meta)
-    {        
-        _tableName = "layer_" + _meta._layerName;
-        // create the table and load the processors.
-        if ( ! initialize( db ) )
+        enum Type { TYPE_OBJECT, TYPE_IMAGE, TYPE_NODE };
+
+        struct Record
         {
-            return;
-        }
+            ::time_t    _created;
+            std::string _meta;
+            std::string _data;
+        };
+        typedef std::map<std::string, Record> Records;
 
-        // initialize the SELECT statement for fetching records
-        std::stringstream buf;
-#ifdef SPLIT_DB_FILE
-        buf << "SELECT created,accessed,size FROM \"" << tableName << "\" WHERE key = ?";
-#else
-        buf << "SELECT created,accessed,data FROM \"" << _tableName << "\" WHERE key = ?";
-#endif
-        _selectSQL = buf.str();
-
-        // initialize the UPDATE statement for updating the timestamp of an accessed record
-        buf.str("");
-        buf << "UPDATE \"" << _tableName << "\" SET accessed = ? "
-            << "WHERE key = ?";
-        _updateTimeSQL = buf.str();
-
-        buf.str("");
-        buf << "UPDATE \"" << _tableName << "\" SET accessed = ? "
-            << "WHERE key in ( ? )";
-        _updateTimePoolSQL = buf.str();
-        
-        // initialize the INSERT statement for writing records.
-        buf.str("");
-        buf << "INSERT OR REPLACE INTO \"" << _tableName << "\" "
-#ifdef SPLIT_DB_FILE
-            << "(key,created,accessed,size) VALUES (?,?,?,?)";
-#else
-            << "(key,created,accessed,data) VALUES (?,?,?,?)";
-#endif
-        _insertSQL = buf.str();
-
-        // initialize the DELETE statements for purging old records.
-        buf.str("");
-        buf << "DELETE FROM \"" << _tableName << "\" "
-            << "INDEXED BY \"" << _tableName << "_lruindex\" "
-            << "WHERE accessed < ?";
-        _purgeSQL = buf.str();
-        
-        buf.str("");
-        buf << "DELETE FROM \""  << _tableName << "\" WHERE key in (SELECT key FROM \"" << _tableName << "\" WHERE \"accessed\" < ? limit ?)";
-        _purgeLimitSQL = buf.str();          
-
-        buf.str("");
-        buf << "SELECT key FROM \"" << _tableName << "\" WHERE \"accessed\" < ? limit ?";
-        _purgeSelect = buf.str();
-
-        _statsLoaded = 0;
-        _statsStored = 0;
-        _statsDeleted = 0;
-    }
+        ReadResult read( const std::string& key, double maxAge, Type type );
+        bool fetch( const std::string& key, Record& out, bool withData );
+        void scheduleFlush();
+        void enforceMaxSize( Connection* conn );
 
+        bool                              _ok;
+        osg::ref_ptr<Database>            _db;
+        std::string                       _table;
+        unsigned                          _batchSize;
+        unsigned long long                _maxBytes;
+        Records                           _pending;     // queued, not yet committed
+        Records                           _flushing;    // being committed now
+        std::set<std::string>             _accessed;    // keys read since the last commit
+        ::time_t                          _oldestPending;
+        bool                              _flushQueued;
+        unsigned                          _numFlushes;
+        Threading::Mutex                  _pendingMutex;
+        Threading::Mutex                  _flushMutex;
+        osg::ref_ptr<osgDB::ReaderWriter> _rw;
+        osg::ref_ptr<osgDB::Options>      _rwOptions;
+    };
 
-    sqlite3_int64 getTableSize(sqlite3* db)
+    // commits a bin's queued writes on the background writer.
+    struct AsyncFlush : public TaskRequest
     {
-#ifdef SPLIT_DB_FILE
-        std::string query = "select sum(size) from \"" + _tableName + "\";";
-#else
-        std::string query = "select sum(length(data)) from \"" + _tableName + "\";";
-#endif
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, query.c_str(), query.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(db) << std::endl;
-            return -1;
-        }
+        AsyncFlush( Sqlite3CacheBin* bin ) : _bin( bin ) { }
 
-        rc = sqlite3_step( select );
-        if ( rc != SQLITE_ROW)
+        void operator()( ProgressCallback* progress )
         {
-            OE_WARN << LC << "SQL QUERY failed for " << query << ": " 
-                << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                << ", rc = " << rc << std::endl;
-            sqlite3_finalize( select );
-            return -1;
+            osg::ref_ptr<Sqlite3CacheBin> bin = _bin.get();
+            if ( bin.valid() )
+                bin->flush();
         }
-        sqlite3_int64 size = sqlite3_column_int(select, 0);
-        sqlite3_finalize( select );
-        return size;
-    }
 
-    int getNbEntry(sqlite3* db) {
-        std::string query = "select count(*) from \"" + _tableName + "\";";
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, query.c_str(), query.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(db) << std::endl;
-            return -1;
-        }
-
-        rc = sqlite3_step( select );
-        if ( rc != SQLITE_ROW)
-        {
-            OE_WARN << LC << "SQL QUERY failed for " << query << ": " 
-                << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                << ", rc = " << rc << std::endl;
-            sqlite3_finalize( select );
-            return -1;
-        }
-        int nbItems = sqlite3_column_int(select, 0);
-        sqlite3_finalize( select );
-        return nbItems;
-    }
+        osg::observer_ptr<Sqlite3CacheBin> _bin;
+    };
+}
 
-    void checkAndPurgeIfNeeded(sqlite3* db, unsigned int maxSize )
-    {
-        int size = getTableSize(db);
-        OE_DEBUG << _meta._layerName <<  std::dec << " : "  << size/1024/1024 << " MB" << std::endl;
-        if (size < 0 || size < 1.2 * maxSize)
-            return;
-            
-        ::time_t t = ::time(0L);
-        int nbElements = getNbEntry(db);
-        float averageSize = size * 1.0 / nbElements;
-        float diffSize = size - maxSize;
-        int maxElementToRemove = static_cast<int>(ceil(diffSize/averageSize));
-        OE_DEBUG << _meta._layerName <<  " try to remove " << std::dec << maxElementToRemove << " / " <<  nbElements << " to save place" << std::endl;
-        purge(t, maxElementToRemove, db);
-    }
+// --------------------------------------------------------------------------
 
-    bool store( const ImageRecord& rec, sqlite3* db )
+namespace
+{
+    Sqlite3Cache::Sqlite3Cache( const CacheOptions& options ) :
+    Cache   ( options ),
+    _options( options )
     {
-        displayStats();
-
-        sqlite3_stmt* insert = 0L;
-        int rc = sqlite3_prepare_v2( db, _insertSQL.c_str(), _insertSQL.length(), &insert, 0L );
-        if ( rc != SQLITE_OK )
+        if ( !_options.path().isSet() || _options.path()->empty() )
         {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
-
-        // bind the key string:
-        std::string keyStr = rec._key.str();
-        sqlite3_bind_text( insert, 1, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-        sqlite3_bind_int(  insert, 2, rec._created );
-        sqlite3_bind_int(  insert, 3, rec._accessed );
-
-        // serialize the image:
-#ifdef SPLIT_DB_FILE
-        std::stringstream outStream;
-        _rw->writeImage( *rec._image.get(), outStream, _rwOptions.get() );
-        std::string outBuf = outStream.str();
-        std::string fname = _meta._layerName + "_" + keyStr+".osgb";
-        {
-            std::ofstream file(fname.c_str(), std::ios::out | std::ios::binary);
-            if (file.is_open()) {
-                file.write(outBuf.c_str(), outBuf.length());
-            }
+            OE_WARN << LC << "No database path specified" << std::endl;
+            _ok = false;
+            return;
         }
-        sqlite3_bind_int( insert, 4, outBuf.length() );
-#else
-        std::stringstream outStream;
-        _rw->writeImage( *rec._image.get(), outStream, _rwOptions.get() );
-        std::string outBuf = outStream.str();
-        sqlite3_bind_blob( insert, 4, outBuf.c_str(), outBuf.length(), SQLITE_STATIC );
-#endif
 
-        // write to the database:
-        rc = sqlite3_step( insert );
+        std::string path = URI( *_options.path(), options.referrer() ).full();
 
-        if ( rc != SQLITE_DONE )
-        {
-            OE_WARN << LC << "SQL INSERT failed for key " << rec._key.str() << ": " 
-                << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                << ", rc = " << rc << std::endl;
-            sqlite3_finalize( insert );
-            return false;
-        }
-        else
+        std::string dirPath = osgDB::getFilePath( path );
+        if ( !dirPath.empty() && !osgDB::fileExists(dirPath) && !osgDB::makeDirectory(dirPath) )
         {
-            OE_DEBUG << LC << "cache INSERT tile " << rec._key.str() << std::endl;
-            sqlite3_finalize( insert );
-            _statsStored++;
-            return true;
+            OE_WARN << LC << "Couldn't create path " << dirPath << std::endl;
+            _ok = false;
+            return;
         }
-    }
 
-#ifdef INSERT_POOL
-    bool beginStore(sqlite3* db, sqlite3_stmt*& insert) 
-    {
-        int rc;
-        rc = sqlite3_exec( db, "BEGIN TRANSACTION", NULL, NULL, NULL);
-        if (rc != 0) {
-            OE_WARN << LC << "Failed to begin transaction batch of insert for " << _meta._layerName << " "  << sqlite3_errmsg(db) << std::endl;
-            return false;
-        }
+        _db = new Database( path, _options );
 
-        // prepare for multiple inserts
-        rc = sqlite3_prepare_v2( db, _insertSQL.c_str(), _insertSQL.length(), &insert, 0L );
-        if ( rc != SQLITE_OK )
+        Connection* conn = _db->getConnection();
+        if ( !conn || !conn->exec("CREATE TABLE IF NOT EXISTS osgearth_bin_metadata (bin TEXT PRIMARY KEY, json TEXT)") )
         {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
-        return true;
-    }
-
-    bool storePool(sqlite3* db, const AsyncInsertPool::PoolContainer& entries, sqlite3_stmt* insert)
-    {
-        ::time_t t = ::time(0L);
-        sqlite3_bind_int(  insert, 2, t );
-        sqlite3_bind_int(  insert, 3, t );
-        int rc;
-        for (AsyncInsertPool::PoolContainer::const_iterator it = entries.begin(); it != entries.end(); ++it) {
-            
-            // bind the key string:
-            std::string keyStr = it->first;
-            sqlite3_bind_text( insert, 1, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-
-            // serialize the image:
-#ifdef SPLIT_DB_FILE
-            std::stringstream outStream;
-            _rw->writeImage( * (it)->second._image.get(), outStream, _rwOptions.get() );
-            std::string outBuf = outStream.str();
-            std::string fname = _meta._layerName + "_" + keyStr+".osgb";
-            {
-                std::ofstream file(fname.c_str(), std::ios::out | std::ios::binary);
-                if (file.is_open()) {
-                    file.write(outBuf.c_str(), outBuf.length());
-                }
-            }
-            sqlite3_bind_int( insert, 4, outBuf.length() );
-#else
-            std::stringstream outStream;
-            _rw->writeImage( * (it)->second._image.get(), outStream, _rwOptions.get() );
-            std::string outBuf = outStream.str();
-            sqlite3_bind_blob( insert, 4, outBuf.c_str(), outBuf.length(), SQLITE_STATIC );
-#endif
-            rc = sqlite3_step(insert);   // executes the INSERT
-            if ( rc != SQLITE_DONE )
-            {
-                OE_WARN << LC << "SQL INSERT failed for key " << keyStr << ": " 
-                        << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                        << ", rc = " << rc << std::endl;
-                sqlite3_finalize(insert); // clean up prepared statement
-                return false;
-            }
-            sqlite3_reset(insert);  // reset the statement 
+            _ok = false;
+            return;
         }
 
-        _statsStored += entries.size();
-        return true;
+        OE_INFO << LC << "Opened cache database " << path << std::endl;
     }
 
-    bool endStore(sqlite3* db, sqlite3_stmt* insert)
+    CacheBin*
+    Sqlite3Cache::createBin( const std::string& binID )
     {
-        int rc = 0;
-        rc = sqlite3_finalize(insert); // clean up prepared statement
-        rc = sqlite3_exec( db, "COMMIT", NULL, NULL, NULL);  // COMMIT all dirty pages at once
-        if (rc != 0) {
-            OE_WARN << LC << "Failed to commit batch of insert for " << _meta._layerName << " "  << sqlite3_errmsg(db) << std::endl;
-            return false;
-        }
-        
-        return true;
+        return new Sqlite3CacheBin( binID, _db.get(), _options );
     }
-#endif
-
-    bool updateAccessTime( const TileKey& key, int newTimestamp, sqlite3* db )
-    { 
-        sqlite3_stmt* update = 0L;
-        int rc = sqlite3_prepare_v2( db, _updateTimeSQL.c_str(), _updateTimeSQL.length(), &update, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL " << _updateTimeSQL << "; " << sqlite3_errmsg(db) << std::endl;
-            return false;
-        }
-
-        bool success = true;
-        sqlite3_bind_int( update, 1, newTimestamp );
-        std::string keyStr = key.str();
-        sqlite3_bind_text( update, 2, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-        rc = sqlite3_step( update );
-        if ( rc != SQLITE_DONE )
-        {
-            OE_WARN << LC << "Failed to update timestamp for " << key.str() << " on layer " << _meta._layerName << " rc = " << rc << std::endl;
-            success = false;
-        }
 
-        sqlite3_finalize( update );
-        return success;
+    CacheBin*
+    Sqlite3Cache::addBin( const std::string& binID )
+    {
+        if ( !_ok ) return 0L;
+        return _bins.getOrCreate( binID, createBin( binID ) );
     }
 
-    bool updateAccessTimePool( const std::string&  keyStr, int newTimestamp, sqlite3* db )
+    CacheBin*
+    Sqlite3Cache::getOrCreateDefaultBin()
     {
-        //OE_WARN << LC << "update access times " << _meta._layerName << " " << keyStr << std::endl;
-        sqlite3_stmt* update = 0L;
-        int rc = sqlite3_prepare_v2( db, _updateTimePoolSQL.c_str(), _updateTimePoolSQL.length(), &update, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL " << _updateTimePoolSQL << "; " << sqlite3_errmsg(db) << std::endl;
-            return false;
-        }
+        if ( !_ok ) return 0L;
 
-        bool success = true;
-        sqlite3_bind_int( update, 1, newTimestamp );
-        sqlite3_bind_text( update, 2, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-        rc = sqlite3_step( update );
-        if ( rc != SQLITE_DONE )
+        static Threading::Mutex s_defaultBinMutex;
+        if ( !_defaultBin.valid() )
         {
-            OE_WARN << LC << "Failed to update timestamp for " << keyStr << " on layer " << _meta._layerName << " rc = " << rc << std::endl;
-            success = false;
+            Threading::ScopedMutexLock lock( s_defaultBinMutex );
+            if ( !_defaultBin.valid() ) // double-check
+            {
+                _defaultBin = createBin( "__default" );
+            }
         }
-
-        sqlite3_finalize( update );
-        return success;
+        return _defaultBin.get();
     }
 
-    bool load( const TileKey& key, ImageRecord& output, sqlite3* db )
+    //------------------------------------------------------------------------
+
+    Sqlite3CacheBin::Sqlite3CacheBin(const std::string&         binID,
+                                     Database*                  db,
+                                     const Sqlite3CacheOptions& options) :
+    CacheBin      ( binID ),
+    _ok           ( true ),
+    _db           ( db ),
+    _table        ( quoteIdentifier("bin_" + binID) ),
+    _batchSize    ( osg::maximum(options.batchSize().value(), 1u) ),
+    _maxBytes     ( (unsigned long long)options.maxSize().value() * 1024ull * 1024ull ),
+    _oldestPending( 0 ),
+    _flushQueued  ( false ),
+    _numFlushes   ( 0 )
     {
-        displayStats();
-        int imageBufLen = 0;
-        
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, _selectSQL.c_str(), _selectSQL.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
+        Connection* conn = _db->getConnection();
+        if ( !conn ||
+             !conn->exec("CREATE TABLE IF NOT EXISTS " + _table + " (key TEXT PRIMARY KEY, created INTEGER, accessed INTEGER, meta TEXT, data BLOB)") ||
+             !conn->exec("CREATE INDEX IF NOT EXISTS " + quoteIdentifier("bin_" + binID + "_accessed") + " ON " + _table + " (accessed)") )
         {
-            OE_WARN << LC << "Failed to prepare SQL: " << _selectSQL << "; " << sqlite3_errmsg(db) << std::endl;
-            return false;
+            OE_WARN << LC << "FAILED to create table for cache bin " << binID << std::endl;
+            _ok = false;
         }
-
-        std::string keyStr = key.str();
-        sqlite3_bind_text( select, 1, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-
-        rc = sqlite3_step( select );
-        if ( rc != SQLITE_ROW ) // == SQLITE_DONE ) // SQLITE_DONE means "no more rows"
+        else
         {
-            // cache miss
-            OE_DEBUG << LC << "Cache MISS on tile " << key.str() << std::endl;
-            sqlite3_finalize(select);
-            return false;
-        }
+            OE_INFO << LC << "Initializing cache bin: " << binID << std::endl;
 
-        // copy the timestamps:
-        output._created  = sqlite3_column_int( select, 0 );
-        output._accessed = sqlite3_column_int( select, 1 );
-
-#ifdef SPLIT_DB_FILE
-        std::string fname(keyStr);
-        osgDB::ReaderWriter::ReadResult rr = _rw->readImage( _meta._layerName + "_" +fname+".osgb" );
-#else
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
-        const char* data = (const char*)sqlite3_column_blob( select, 2 );
-        imageBufLen = sqlite3_column_bytes( select, 2 );
-
-        // deserialize the image from the buffer:
-        std::string imageString( data, imageBufLen );
-        std::stringstream imageBufStream( imageString );
-        osgDB::ReaderWriter::ReadResult rr = _rw->readImage( imageBufStream );
+            _rw = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+#ifdef OSGEARTH_HAVE_ZLIB
+            _rwOptions = Registry::instance()->cloneOrCreateOptions();
+            _rwOptions->setOptionString( "Compressor=zlib" );
 #endif
-        if ( rr.error() )
-        {
-            OE_WARN << LC << "Failed to read image from database: " << rr.message() << std::endl;
-        }
-        else
-        {
-            output._image = rr.takeImage();
-            output._key = key;
-            OE_DEBUG << LC << "Cache HIT on tile " << key.str() << std::endl;
+            CachePolicy::NO_CACHE.apply(_rwOptions.get());
         }
-
-        sqlite3_finalize(select);
-
-        _statsLoaded++;
-        return output._image.valid();
     }
 
-    void displayStats()
+    Sqlite3CacheBin::~Sqlite3CacheBin()
     {
-        osg::Timer_t t = osg::Timer::instance()->tick();
-        if (osg::Timer::instance()->delta_s( _statsLastCheck, t) > 10.0) {
-            double d = osg::Timer::instance()->delta_s(_statsStartTimer, t);
-            OE_DEBUG << _meta._layerName << " time " << d << " stored " << std::dec << _statsStored << " rate " << _statsStored * 1.0 / d << std::endl;
-            OE_DEBUG << _meta._layerName << " time " << d << " loaded " << std::dec  << _statsLoaded << " rate " << _statsLoaded * 1.0 / d << std::endl;
-            OE_DEBUG << _meta._layerName << " time " << d << " deleted " << std::dec  << _statsDeleted << " rate " << _statsDeleted * 1.0 / d << std::endl;
-            _statsLastCheck = t;
-        }
+        if ( _ok )
+            flush();
     }
 
-    bool purge( int utcTimeStamp, int maxToRemove, sqlite3* db )
+    bool
+    Sqlite3CacheBin::fetch( const std::string& key, Record& out, bool withData )
     {
-        if ( maxToRemove < 0 )
-            return false;
-
-        sqlite3_stmt* purge = 0L;
-        
-        int rc;
+        // queued records first; they are newer than anything in the table.
         {
-#ifdef SPLIT_DB_FILE
+            ScopedMutexLock lock( _pendingMutex );
+            Records::const_iterator i = _pending.find( key );
+            if ( i != _pending.end() )
             {
-                std::vector<std::string> deleteFiles;
-                sqlite3_stmt* selectPurge = 0L;
-                rc = sqlite3_prepare_v2( db, _purgeSelect.c_str(), _purgeSelect.length(), &selectPurge, 0L);
-                if ( rc != SQLITE_OK )
-                {
-                    OE_WARN << LC << "Failed to prepare SQL: " << _purgeSelect << "; " << sqlite3_errmsg(db) << std::endl;
-                    return false;
-                }
-                sqlite3_bind_int( selectPurge, 2, maxToRemove );
-                sqlite3_bind_int( selectPurge, 1, utcTimeStamp );
-
-                rc = sqlite3_step( selectPurge );
-                if ( rc != SQLITE_ROW && rc != SQLITE_DONE)
-                {
-                    OE_WARN << LC << "SQL QUERY failed for " << _purgeSelect << ": " 
-                            << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                            << ", rc = " << rc << std::endl;
-                    sqlite3_finalize( selectPurge );
-                    return false;
-                }
-                while (rc == SQLITE_ROW) {
-                    std::string f((const char*)sqlite3_column_text( selectPurge, 0 ));
-                    deleteFiles.push_back(f);
-                    rc = sqlite3_step( selectPurge );
-                }
-                if (rc != SQLITE_DONE) {
-                    OE_WARN << LC << "SQL QUERY failed for " << _purgeSelect << ": " 
-                            << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                            << ", rc = " << rc << std::endl;
-                    sqlite3_finalize( selectPurge );
-                    return false;
-                }
-                sqlite3_finalize( selectPurge );
-                while (!deleteFiles.empty()) {
-                    std::string fname = _meta._layerName + "_" + deleteFiles.back() +".osgb";
-                    int run = unlink(fname.c_str());
-                    if (run) {
-                        OE_WARN << "Error while removing file " << fname << std::endl;
-                    }
-                    deleteFiles.pop_back();
-                }
+                out = i->second;
+                return true;
             }
-#endif
-            rc = sqlite3_prepare_v2( db, _purgeLimitSQL.c_str(), _purgeLimitSQL.length(), &purge, 0L );
-            if ( rc != SQLITE_OK )
+            i = _flushing.find( key );
+            if ( i != _flushing.end() )
             {
-                OE_WARN << LC << "Failed to prepare SQL: " << _purgeLimitSQL << "; " << sqlite3_errmsg(db) << std::endl;
-                return false;
+                out = i->second;
+                return true;
             }
-            sqlite3_bind_int( purge, 2, maxToRemove );
         }
 
-        sqlite3_bind_int( purge, 1, utcTimeStamp );
+        Connection* conn = _db->getConnection();
+        if ( !conn ) return false;
+
+        sqlite3_stmt* stmt = conn->prepare( withData ?
+            "SELECT created, meta, data FROM " + _table + " WHERE key = ?" :
+            "SELECT created FROM " + _table + " WHERE key = ?" );
+        if ( !stmt ) return false;
+
+        sqlite3_bind_text( stmt, 1, key.c_str(), key.length(), SQLITE_STATIC );
 
-        rc = sqlite3_step( purge );
-        if ( rc != SQLITE_DONE )
+        bool found = false;
+        if ( sqlite3_step(stmt) == SQLITE_ROW )
         {
-            // cache miss
-            OE_DEBUG << LC << "Error purging records from \"" << _meta._layerName << "\"; " << sqlite3_errmsg(db) << std::endl;
-            sqlite3_finalize(purge);
-            return false;
+            out._created = (::time_t)sqlite3_column_int64( stmt, 0 );
+            if ( withData )
+            {
+                const char* meta = (const char*)sqlite3_column_text( stmt, 1 );
+                out._meta = meta ? meta : "";
+                const char* data = (const char*)sqlite3_column_blob( stmt, 2 );
+                out._data.assign( data ? data : "", sqlite3_column_bytes(stmt, 2) );
+            }
+            found = true;
         }
-
-        sqlite3_finalize(purge);
-        _statsDeleted += maxToRemove;
-        return true;
+        sqlite3_reset( stmt );
+        return found;
     }
 
-    /** Initializes the layer by creating the layer's table (if necessary), loading the
-        appropriate reader-writer for the image data, and initializing the compressor
-        if necessary. */
-    bool initialize( sqlite3* db )
+    ReadResult
+    Sqlite3CacheBin::read( const std::string& key, double maxAge, Type type )
     {
-        // first create the table if it does not already exist:
-        std::stringstream buf;
-        buf << "CREATE TABLE IF NOT EXISTS \"" << _tableName << "\" ("
-            << "key char(64) PRIMARY KEY UNIQUE, "
-            << "created int, "
-            << "accessed int, "
-#ifdef SPLIT_DB_FILE
-            << "size int )";
-#else
-            << "data blob )";
-#endif
-        std::string sql = buf.str();
-
-        OE_DEBUG << LC << "SQL = " << sql << std::endl;
-
-        char* errMsg = 0L;
-        int rc = sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Creating layer \"" << _meta._layerName << "\": " << errMsg << std::endl;
-            sqlite3_free( errMsg );
-            return false;
-        }
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        if ( !_ok ) return countRead( ReadResult(), start );
 
-        // create an index on the time-last-accessed column
-        buf.str("");
-        buf << "CREATE INDEX IF NOT EXISTS \"" 
-            << _tableName << "_lruindex\" "
-            << "ON \"" << _tableName << "\" (accessed)";
-        sql = buf.str();
+        Record rec;
+        if ( !fetch(key, rec, true) )
+            return countRead( ReadResult(), start );
 
-        OE_DEBUG << LC << "SQL = " << sql << std::endl;
+        std::istringstream in( rec._data );
+        osgDB::ReaderWriter::ReadResult r =
+            type == TYPE_IMAGE ? _rw->readImage( in, _rwOptions.get() ) :
+            type == TYPE_NODE  ? _rw->readNode( in, _rwOptions.get() ) :
+                                 _rw->readObject( in, _rwOptions.get() );
+        if ( !r.success() )
+            return countRead( ReadResult(), start );
 
-        rc = sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg );
-        if ( rc != SQLITE_OK )
         {
-            OE_WARN << LC << "Creating index for layer \"" << _meta._layerName << "\": " << errMsg << std::endl;
-            sqlite3_free( errMsg );
-            //return false;
+            ScopedMutexLock lock( _pendingMutex );
+            _accessed.insert( key );
         }
 
-        // next load the appropriate ReaderWriter:
+        Config meta;
+        if ( !rec._meta.empty() )
+            meta.fromJSON( rec._meta );
 
-#if OSG_MIN_VERSION_REQUIRED(2,9,5)
-        _rw = osgDB::Registry::instance()->getReaderWriterForMimeType( _meta._format );
-        if ( !_rw.valid() )
-#endif
-            _rw = osgDB::Registry::instance()->getReaderWriterForExtension( _meta._format );
-        if ( !_rw.valid() )
-        {
-            OE_WARN << LC << "Creating layer: Cannot initialize ReaderWriter for format \"" 
-                << _meta._format << "\"" << std::endl;
-            return false;
-        }
+        osg::Object* object =
+            type == TYPE_IMAGE ? (osg::Object*)r.getImage() :
+            type == TYPE_NODE  ? (osg::Object*)r.getNode() :
+                                 r.getObject();
 
-        if ( !_meta._compressor.empty() )
-            _rwOptions = new osgDB::ReaderWriter::Options( "Compressor=" + _meta._compressor );
+        if ( maxAge < DBL_MAX && (double)(::time(0L) - rec._created) > maxAge )
+            return countRead( ReadResult( ReadResult::RESULT_EXPIRED, object, meta ), start );
 
-        _statsLastCheck = _statsStartTimer = osg::Timer::instance()->tick();
-        return true;
+        return countRead( ReadResult( object, meta ), start );
     }
 
-    std::string _selectSQL;
-    std::string _insertSQL;
-    std::string _updateTimeSQL;
-    std::string _updateTimePoolSQL;
- 
-    std::string _purgeSelect;
-    std::string _purgeSQL;
-    std::string _purgeLimitSQL;
-    MetadataRecord _meta;
-    std::string _tableName;
-
-    osg::ref_ptr<osgDB::ReaderWriter> _rw;
-    osg::ref_ptr<osgDB::ReaderWriter::Options> _rwOptions;
-
-    osg::Timer_t _statsStartTimer;
-    osg::Timer_t _statsLastCheck;
-
-    int _statsLoaded;
-    int _statsStored;
-    int _statsDeleted;
-
-};
-
-// --------------------------------------------------------------------------
-
-typedef std::map<std::string,osg::ref_ptr<LayerTable> > LayerTablesByName;
-
-// --------------------------------------------------------------------------
-
-//TODO: might want to move this up out of this plugin at some point.
-
-struct AsyncPurge : public TaskRequest {
-    AsyncPurge( const std::string& layerName, int olderThanUTC, Cache* cache )
-        : _layerName(layerName), _olderThanUTC(olderThanUTC), _cache(cache) { }
-
-    void operator()( ProgressCallback* progress ) { 
-        osg::ref_ptr<Cache> cache = _cache.get();
-        if ( cache.valid() )
-            cache->purge( _layerName, _olderThanUTC, false );
+    ReadResult
+    Sqlite3CacheBin::readImage(const std::string& key, double maxAge)
+    {
+        return read( key, maxAge, TYPE_IMAGE );
     }
 
-    std::string _layerName;
-    int _olderThanUTC;
-    osg::observer_ptr<Cache> _cache;
-};
-
-struct AsyncInsert : public TaskRequest {
-    AsyncInsert( const TileKey& key, const CacheSpec& spec, const osg::Image* image, AsyncCache* cache )
-        : _cacheSpec(spec), _key(key), _image(image), _cache(cache) { }
-
-    void operator()( ProgressCallback* progress ) {
-        osg::ref_ptr<AsyncCache> cache = _cache.get();
-        if ( cache.valid() )
-            cache->setImageSync( _key, _cacheSpec, _image.get() );
+    ReadResult
+    Sqlite3CacheBin::readObject(const std::string& key, double maxAge)
+    {
+        return read( key, maxAge, TYPE_OBJECT );
     }
 
-    CacheSpec _cacheSpec;
-    TileKey _key;
-    osg::ref_ptr<const osg::Image> _image;
-    osg::observer_ptr<AsyncCache> _cache;
-};
-
-class Sqlite3Cache;
-struct AsyncUpdateAccessTime : public TaskRequest
-{
-    AsyncUpdateAccessTime( const TileKey& key, const std::string& cacheId, int timeStamp, Sqlite3Cache* cache );
-    void operator()( ProgressCallback* progress );
-
-    TileKey _key;
-    std::string _cacheId;
-    int _timeStamp;
-    osg::observer_ptr<Sqlite3Cache> _cache;
-};
-
-
-
-struct AsyncUpdateAccessTimePool : public TaskRequest
-{
-    AsyncUpdateAccessTimePool( const std::string& cacheId, Sqlite3Cache* cache );
-    void addEntry(const TileKey& key, int timeStamp);
-    void addEntryInternal(const TileKey& key);
-
-    void operator()( ProgressCallback* progress );
-    const std::string& getCacheId() { return _cacheId; }
-    int getNbEntry() const { return _keys.size(); }
-    std::map<std::string, int> _keys;
-    std::string _cacheId;
-    std::string _keyStr;
-    int _timeStamp;
-    osg::observer_ptr<Sqlite3Cache> _cache;
-};
-
+    ReadResult
+    Sqlite3CacheBin::readNode(const std::string& key, double maxAge)
+    {
+        return read( key, maxAge, TYPE_NODE );
+    }
 
+    ReadResult
+    Sqlite3CacheBin::readString(const std::string& key, double maxAge)
+    {
+        ReadResult r = readObject(key, maxAge);
+        bool usable = r.succeeded() || r.code() == ReadResult::RESULT_EXPIRED;
+        return usable && r.get<StringObject>() ? r : ReadResult();
+    }
 
-// --------------------------------------------------------------------------
+    bool
+    Sqlite3CacheBin::write( const std::string& key, const osg::Object* object, const Config& meta )
+    {
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        if ( !_ok || !object ) return countWrite( false, object, start );
 
-struct ThreadTable {
-    ThreadTable(LayerTable* table, sqlite3* db) : _table(table), _db(db) { }
-    LayerTable* _table;
-    sqlite3* _db;
-};
+        std::ostringstream out;
+        osgDB::ReaderWriter::WriteResult r;
 
-class Sqlite3Cache : public AsyncCache
-{
-public:
-    Sqlite3Cache( const CacheOptions& options ) 
-      : AsyncCache(options), _options(options),  _db(0L)
-    {                
-        if ( _options.path().get().empty() || options.getReferenceURI().empty() )
-            _databasePath = _options.path().get();
+        if ( dynamic_cast<const osg::Image*>(object) )
+            r = _rw->writeImage( *static_cast<const osg::Image*>(object), out, _rwOptions.get() );
+        else if ( dynamic_cast<const osg::Node*>(object) )
+            r = _rw->writeNode( *static_cast<const osg::Node*>(object), out, _rwOptions.get() );
         else
-        {
-           _databasePath = osgEarth::getFullPath( options.getReferenceURI(), _options.path().get() );
-        }
-
-        
-        setName( "sqlite3" );
-
-        _nbRequest = 0;
-
-        //_settings = dynamic_cast<const Sqlite3CacheOptions*>( options );
-        //if ( !_settings.valid() )
-        //    _settings = new Sqlite3CacheOptions( options );
-
-        OE_INFO << LC << "options: " << _options.getConfig().toString() << std::endl;
-
-        if ( sqlite3_threadsafe() == 0 )
-        {
-            OE_WARN << LC << "SQLITE3 IS NOT COMPILED IN THREAD-SAFE MODE" << std::endl;
-            // TODO: something in this unlikely condition
-        }
-
-        // enabled shared cache mode.
-        //sqlite3_enable_shared_cache( 1 );
+            r = _rw->writeObject( *object, out );
 
-#ifdef USE_L2_CACHE
-        _L2cache = new MemCache();
-        _L2cache->setMaxNumTilesInCache( 64 );
-        OE_INFO << LC << "Using L2 memory cache" << std::endl;
-#endif
-        
-        _db = openDatabase( _databasePath, _options.serialized().value() );
-
-        if ( _db )
+        if ( !r.success() )
         {
-            if ( ! _metadata.initialize( _db ) )
-                _db = 0L;
+            OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin " << getID() << std::endl;
+            return countWrite( false, object, start );
         }
 
-        if ( _db && _options.asyncWrites() == true )
         {
-            _writeService = new osgEarth::TaskService( "Sqlite3Cache Write Service", 1 );
+            ScopedMutexLock lock( _pendingMutex );
+            Record& rec = _pending[key];
+            rec._created = ::time(0L);
+            rec._meta    = meta.empty() ? "" : meta.toJSON();
+            rec._data    = out.str();
+            if ( _pending.size() == 1 )
+                _oldestPending = rec._created;
         }
 
-        
-        if (!_metadata.loadAllLayers( _db, _layersList )) {
-            OE_WARN << "can't read layers in meta data" << std::endl;
-        }
+        OE_DEBUG << LC << "Queued \"" << key << "\" for cache bin " << getID() << std::endl;
 
+        scheduleFlush();
+        return countWrite( true, object, start );
     }
 
-    // just here to satisfy the osg::Object requirements
-    Sqlite3Cache() { }
-    Sqlite3Cache( const Sqlite3Cache& rhs, const osg::CopyOp& op ) { }
-    META_Object(osgEarth,Sqlite3Cache);
-
-public: // Cache interface
-    
-    /**
-     * Gets whether the given TileKey is cached or not
-     */
-    bool isCached( const TileKey& key, const CacheSpec& spec ) const
+    void
+    Sqlite3CacheBin::scheduleFlush()
     {
-        // this looks ineffecient, but usually when isCached() is called, getImage() will be
-        // called soon thereafter. And this call will load it into the L2 cache so the subsequent
-        // getImage call will not hit the DB again.
-        osg::ref_ptr<const osg::Image> temp;
-        return const_cast<Sqlite3Cache*>(this)->getImage( key, spec, temp );
-    }
-
-    /**
-     * Store the cache profile for the given profile.
-     */
-    virtual void storeProperties( const CacheSpec& spec, const Profile* profile, unsigned int tileSize ) 
-    {
-        if ( !_db ) return;
-
-        if ( spec.cacheId().empty() || profile == 0L || spec.format().empty() )
         {
-            OE_WARN << "ILLEGAL: cannot cache a layer without a layer id" << std::endl;
-            return;
-        }
+            ScopedMutexLock lock( _pendingMutex );
 
-        ScopedLock<Mutex> lock( _tableListMutex ); // b/c we're using the base db handle
-#ifdef SPLIT_LAYER_DB
-        sqlite3* db = getOrCreateMetaDbForThread();
-#else
-        sqlite3* db = getOrCreateDbForThread();
-#endif
-        if ( !db )
-            return;
-
-        //OE_INFO << "Storing metadata for layer \"" << layerName << "\"" << std::endl;
-
-        MetadataRecord rec;
-        rec._layerName = spec.cacheId();
-        rec._profile = profile;
-        rec._tileSize = tileSize;
-
-#ifdef USE_SERIALIZERS
-        rec._format = "osgb";
-        rec._compressor = "zlib";
-#else
-        rec._format = spec.format();
-#endif
-
-        _metadata.store( rec, db );
-    }
-
-    /**
-     * Loads the cache profile for the given layer.
-     */
-    virtual bool loadProperties( 
-        const std::string&           cacheId, 
-        CacheSpec&                   out_spec, 
-        osg::ref_ptr<const Profile>& out_profile,
-        unsigned int&                out_tileSize ) 
-    {
-        if ( !_db ) return 0L;
-
-        ScopedLock<Mutex> lock( _tableListMutex ); // b/c we're using the base db handle
-
-#ifdef SPLIT_LAYER_DB
-        sqlite3* db = getOrCreateMetaDbForThread();
-#else
-        sqlite3* db = getOrCreateDbForThread();
-#endif
-        if ( !db )
-            return 0L;
-
-        OE_DEBUG << LC << "Loading metadata for layer \"" << cacheId << "\"" << std::endl;
+            // commit once the batch is full, or if the oldest queued write
+            // has waited more than a couple of seconds.
+            if ( _pending.size() < _batchSize && ::time(0L) - _oldestPending < 2 )
+                return;
 
-        MetadataRecord rec;
-        if ( _metadata.load( cacheId, db, rec ) )
-        {
-            out_spec = CacheSpec( rec._layerName, rec._format );
-            out_tileSize = rec._tileSize;
-            out_profile = rec._profile;
+            if ( _db->_writeService.valid() )
+            {
+                if ( !_flushQueued )
+                {
+                    _flushQueued = true;
+                    _db->_writeService->add( new AsyncFlush(this) );
+                }
+                return;
+            }
         }
-        return 0L;
+
+        flush();
     }
 
-    /**
-     * Gets the cached image for the given TileKey
-     */
-    bool getImage( const TileKey& key, const CacheSpec& spec, osg::ref_ptr<const osg::Image>& out_image )
+    void
+    Sqlite3CacheBin::flush()
     {
-        if ( !_db ) return false;
-
-        // wait if we are purging the db
-        ScopedLock<Mutex> lock2( _pendingPurgeMutex );
+        ScopedMutexLock flushLock( _flushMutex );
 
-        // first try the L2 cache.
-        if ( _L2cache.valid() )
+        std::set<std::string> accessed;
         {
-            if ( _L2cache->getImage( key, spec, out_image ) )
-                return true;
+            ScopedMutexLock lock( _pendingMutex );
+            _flushing.swap( _pending );
+            accessed.swap( _accessed );
+            _flushQueued = false;
         }
 
-        // next check the deferred-write queue.
-        if ( _options.asyncWrites() == true )
-        {
-#ifdef INSERT_POOL
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-            std::string name = layerName;
-            std::map<std::string, osg::ref_ptr<AsyncInsertPool> >::iterator it = _pendingWrites.find(name);
-            if (it != _pendingWrites.end()) {
-                AsyncInsertPool* p = it->second.get();
-                if (p) {
-                    osg::Image* img = p->findImage(key.str());
-                    if (img) {
-                        // todo: update the access time, or let it slide?
-                        OE_DEBUG << LC << "Got key that is write-queued: " << key.str() << std::endl;
-                        return img;
-                    }
-                }
-            }
-#else
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-            std::string name = key.str() + spec.cacheId(); //layerName;
-            std::map<std::string,osg::ref_ptr<AsyncInsert> >::iterator i = _pendingWrites.find(name);
-            if ( i != _pendingWrites.end() )
-            {
-                // todo: update the access time, or let it slide?
-                OE_DEBUG << LC << "Got key that is write-queued: " << key.str() << std::endl;
-                out_image = i->second->_image.get();
-                return out_image.valid();
-                //return i->second->_image.get();
-            }
-#endif
-        }
+        if ( _flushing.empty() && accessed.empty() )
+            return;
 
-        // finally, try to query the database.
-        ThreadTable tt = getTable( spec.cacheId() ); //layerName);
-        if ( tt._table )
+        Connection* conn = _db->getConnection();
+        if ( conn && conn->exec("BEGIN IMMEDIATE") )
         {
-            ImageRecord rec( key );
-            if (!tt._table->load( key, rec, tt._db ))
-                return false;
-
-            // load it into the L2 cache
-            out_image = rec._image.release();
+            bool ok = true;
 
-            if ( out_image.valid() && _L2cache.valid() )
-                _L2cache->setImage( key, spec, out_image.get() );
+            sqlite3_stmt* insert = conn->prepare(
+                "INSERT OR REPLACE INTO " + _table + " (key, created, accessed, meta, data) VALUES (?, ?, ?, ?, ?)" );
+            if ( !insert ) ok = false;
 
-#ifdef UPDATE_ACCESS_TIMES
-
-#ifdef UPDATE_ACCESS_TIMES_POOL
-            // update the last-access time
-            int t = (int)::time(0L);
+            for( Records::const_iterator i = _flushing.begin(); ok && i != _flushing.end(); ++i )
             {
-                ScopedLock<Mutex> lock( _pendingUpdateMutex );
-                osg::ref_ptr<AsyncUpdateAccessTimePool> pool;
-                std::map<std::string,osg::ref_ptr<AsyncUpdateAccessTimePool> >::iterator i = _pendingUpdates.find( spec.cacheId() ); //layerName);
-                if ( i != _pendingUpdates.end() )
+                const Record& rec = i->second;
+                sqlite3_bind_text ( insert, 1, i->first.c_str(), i->first.length(), SQLITE_STATIC );
+                sqlite3_bind_int64( insert, 2, (sqlite3_int64)rec._created );
+                sqlite3_bind_int64( insert, 3, (sqlite3_int64)rec._created );
+                sqlite3_bind_text ( insert, 4, rec._meta.c_str(), rec._meta.length(), SQLITE_STATIC );
+                sqlite3_bind_blob ( insert, 5, rec._data.data(), rec._data.size(), SQLITE_STATIC );
+                if ( sqlite3_step(insert) != SQLITE_DONE )
                 {
-                    i->second->addEntry(key, t);
-                    pool = i->second;
-                    OE_DEBUG << LC << "Add key " << key.str() << " to existing layer batch " << spec.name() << std::endl;
-                } else {
-                    pool = new AsyncUpdateAccessTimePool(spec.cacheId(), this);
-                    pool->addEntry(key, t);
-                    _pendingUpdates[spec.cacheId()] = pool.get();
-                    _writeService->add(pool.get());
+                    OE_WARN << LC << "FAILED to write \"" << i->first << "\" to cache bin " << getID()
+                        << ": " << sqlite3_errmsg(conn->_db) << std::endl;
+                    ok = false;
                 }
+                sqlite3_reset( insert );
+                sqlite3_clear_bindings( insert );
             }
-#else
-            // update the last-access time
-            int t = (int)::time(0L);
-            _writeService->add( new AsyncUpdateAccessTime(  key, layerName, t, this ) );
-#endif
 
-#endif // UPDATE_ACCESS_TIMES
-
-            return out_image.valid();
-        }
-        else
-        {
-            OE_DEBUG << LC << "What, no layer table?" << std::endl;
-        }
-        return false;
-    }
-
-    /**
-     * Sets the cached image for the given TileKey
-     */
-    void setImage( const TileKey& key, const CacheSpec& spec, const osg::Image* image )
-    {        
-        if ( !_db ) return;
-
-        if ( _options.asyncWrites() == true )
-        {
-            // the "pending writes" table is here so that we don't try to write data to
-            // the cache more than once when using an asynchronous write service.
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-#ifdef INSERT_POOL
-            std::string name = layerName;
-            std::map<std::string, osg::ref_ptr<AsyncInsertPool> >::iterator it = _pendingWrites.find(name);
-            if ( it == _pendingWrites.end() )
+            if ( ok && !accessed.empty() )
             {
-                AsyncInsertPool* req = new AsyncInsertPool(layerName, this);
-                req->addEntry(key, format, image);
-                _pendingWrites[name] = req;
-                _writeService->add( req );
-            }
-            else
-            {
-                it->second->addEntry(key, format, image);
+                sqlite3_stmt* update = conn->prepare(
+                    "UPDATE " + _table + " SET accessed = ? WHERE key = ?" );
+                sqlite3_int64 now = (sqlite3_int64)::time(0L);
+
+                for( std::set<std::string>::const_iterator i = accessed.begin(); update && i != accessed.end(); ++i )
+                {
+                    sqlite3_bind_int64( update, 1, now );
+                    sqlite3_bind_text ( update, 2, i->c_str(), i->length(), SQLITE_STATIC );
+                    sqlite3_step( update );
+                    sqlite3_reset( update );
+                    sqlite3_clear_bindings( update );
+                }
             }
-#else
-            std::string name = key.str() + spec.cacheId();
-            if ( _pendingWrites.find(name) == _pendingWrites.end() )
+
+            if ( !ok || !conn->exec("COMMIT") )
             {
-                AsyncInsert* req = new AsyncInsert(key, spec, image, this);
-                _pendingWrites[name] = req;
-                _writeService->add( req );
+                conn->exec( "ROLLBACK" );
             }
             else
             {
-                //NOTE: this should probably never happen.
-                OE_WARN << LC << "Tried to setImage; already in queue: " << key.str() << std::endl;
-            }
-#endif
-        }
-        else
-        {
-
-            setImageSync( key, spec, image );
-        }
-    }
-
-    /**
-     * Purges records from the database.
-     */
-    bool purge( const std::string& layerName, int olderThanUTC, bool async )
-    {
-        if ( !_db ) return false;
+                OE_DEBUG << LC << "Committed " << _flushing.size() << " records to cache bin " << getID() << std::endl;
 
-        // purge the L2 cache first:
-        if ( async == true && _options.asyncWrites() == true )
-        {
-#ifdef PURGE_GENERAL
-            if (!_pendingPurges.empty())
-                return false;
-            ScopedLock<Mutex> lock( _pendingPurgeMutex );
-            AsyncPurge* req = new AsyncPurge(layerName, olderThanUTC, this);
-            _writeService->add( req);
-            _pendingPurges[layerName] = req;
-#else
-            if (_pendingPurges.find(layerName) != _pendingPurges.end()) {
-                return false;
-            } else {
-                ScopedLock<Mutex> lock( _pendingPurgeMutex );
-                AsyncPurge* req = new AsyncPurge(layerName, olderThanUTC, this);
-                _writeService->add( req);
-                _pendingPurges[layerName] = req;
+                // checking the size scans the table, so don't do it every time.
+                if ( _maxBytes > 0 && (_numFlushes++ % 16) == 0 )
+                    enforceMaxSize( conn );
             }
-#endif
         }
-        else
-        {
-#ifdef PURGE_GENERAL
-            ScopedLock<Mutex> lock( _pendingPurgeMutex );
-
-            sqlite3_int64 limit = _options.maxSize().value() * 1024 * 1024;
-            std::map<std::string, std::pair<sqlite3_int64,int> > layers;
-            sqlite3_int64 totalSize = 0;
-            for (unsigned int i = 0; i < _layersList.size(); ++i) {
-                ThreadTable tt = getTable( _layersList[i] );
-                if ( tt._table ) {
-                    sqlite3_int64 size = tt._table->getTableSize(tt._db);
-                    layers[_layersList[i] ].first = size;
-                    layers[_layersList[i] ].second = tt._table->getNbEntry(tt._db);
-                    totalSize += size;
-                }
-            }
-            OE_INFO << LC << "SQlite cache size " << totalSize/(1024*1024) << " MB" << std::endl;
-            if (totalSize > 1.2 * limit) {
-                sqlite3_int64 diff = totalSize - limit;
-                for (unsigned int i = 0; i < _layersList.size(); ++i) {
-                    float ratio = layers[_layersList[i] ].first * 1.0 / (float)(totalSize);
-                    int sizeToRemove = (int)floor(ratio * diff);
-                    if (sizeToRemove > 0) {
-                        if (sizeToRemove / 1024 > 1024) {
-                            OE_DEBUG << "Try to remove " << sizeToRemove/(1024*1024) << " MB in " << _layersList[i] << std::endl;
-                        } else {
-                            OE_DEBUG << "Try to remove " << sizeToRemove/1024 << " KB in " << _layersList[i] << std::endl;
-                        }
-
-                        if ( _L2cache.valid() )
-                            _L2cache->purge( _layersList[i], olderThanUTC, async );
-                        ThreadTable tt = getTable(_layersList[i]);
-                        if ( tt._table ) {
-                            float averageSizePerElement = layers[_layersList[i] ].first * 1.0 /layers[_layersList[i] ].second;
-                            int nb = (int)floor(sizeToRemove / averageSizePerElement);
-                            if (nb ) {
-                                OE_DEBUG << "remove " << nb << " / " << layers[_layersList[i] ].second << " elements in " << _layersList[i] << std::endl;
-                                tt._table->purge(olderThanUTC, nb, tt._db);
-                            }
-                        }
-                    }
-                }
-            }
-            _pendingPurges.clear();
-            displayPendingOperations();
 
-#else
-            ScopedLock<Mutex> lock( _pendingPurgeMutex );
-            if ( _L2cache.valid() )
-                _L2cache->purge( layerName, olderThanUTC, async );
-
-            ThreadTable tt = getTable( layerName );
-            if ( tt._table )
-            {
-                _pendingPurges.erase( layerName );
-
-                unsigned int maxsize = _options.getSize(layerName);
-                tt._table->checkAndPurgeIfNeeded(tt._db, maxsize * 1024 * 1024);
-                displayPendingOperations();
-            }
-#endif
-        }
-        return true;
+        ScopedMutexLock lock( _pendingMutex );
+        _flushing.clear();
     }
 
-    /**
-     * updateAccessTime records on the database.
-     */
-    bool updateAccessTimeSync( const std::string& layerName, const TileKey& key, int newTimestamp )
+    void
+    Sqlite3CacheBin::enforceMaxSize( Connection* conn )
     {
-        if ( !_db ) return false;
+        sqlite3_stmt* stmt = conn->prepare(
+            "SELECT COALESCE(SUM(LENGTH(data)), 0), COUNT(*) FROM " + _table );
+        if ( !stmt ) return;
 
-        ThreadTable tt = getTable(layerName);
-        if ( tt._table )
+        unsigned long long bytes = 0, count = 0;
+        if ( sqlite3_step(stmt) == SQLITE_ROW )
         {
-            tt._table->updateAccessTime( key, newTimestamp, tt._db );
+            bytes = (unsigned long long)sqlite3_column_int64( stmt, 0 );
+            count = (unsigned long long)sqlite3_column_int64( stmt, 1 );
         }
-        return true;
-    }
+        sqlite3_reset( stmt );
 
-    /**
-     * updateAccessTime records on the database.
-     */
-    bool updateAccessTimeSyncPool( const std::string& layerName, const std::string& keys, int newTimestamp )
-    {
-        if ( !_db ) return false;
+        if ( bytes <= _maxBytes || count == 0 )
+            return;
 
-        ThreadTable tt = getTable(layerName);
-        if ( tt._table )
-        {
-            tt._table->updateAccessTimePool( keys, newTimestamp, tt._db );
-        }
+        // remove the least recently accessed records, in proportion to the overrun.
+        sqlite3_int64 numToRemove = (sqlite3_int64)( count * (bytes - _maxBytes) / bytes ) + 1;
 
-        {
-            ScopedLock<Mutex> lock( _pendingUpdateMutex );
-            _pendingUpdates.erase( layerName );
-            displayPendingOperations();
-        }
-        return true;
-    }
+        stmt = conn->prepare(
+            "DELETE FROM " + _table + " WHERE key IN (SELECT key FROM " + _table + " ORDER BY accessed ASC LIMIT ?)" );
+        if ( !stmt ) return;
 
-#ifdef INSERT_POOL
-    void setImageSyncPool( AsyncInsertPool* pool, const std::string& layerName)
-    {
-        ScopedLock<Mutex> lock( _pendingWritesMutex );
-        const AsyncInsertPool::PoolContainer& entries = pool->_pool;
-        OE_WARN << "write " << entries.size() << std::endl;
-        ThreadTable tt = getTable(layerName);
-        if ( tt._table )
+        sqlite3_bind_int64( stmt, 1, numToRemove );
+        if ( sqlite3_step(stmt) == SQLITE_DONE )
         {
-            sqlite3_stmt* insert;
-            if (!tt._table->beginStore( tt._db, insert )) {
-                return;
-            }
-            if (!tt._table->storePool( tt._db, entries, insert )) {
-                return;
-            }
-            if (!tt._table->endStore( tt._db, insert )) {
-                return;
-            }
+            OE_INFO << LC << "Removed " << numToRemove << " records from cache bin " << getID()
+                << " to stay under " << (_maxBytes / (1024*1024)) << "MB" << std::endl;
         }
-        _pendingWrites.erase( layerName );
-        displayPendingOperations();
-    }
-#endif
-
-private:
-
-    void displayPendingOperations() {
-        if (_pendingWrites.size())
-            OE_DEBUG<< LC << "pending insert " << _pendingWrites.size() << std::endl;
-        if (_pendingUpdates.size())
-            OE_DEBUG << LC << "pending update " << _pendingUpdates.size() << std::endl;
-        if (_pendingPurges.size())
-            OE_DEBUG << LC << "pending purge " << _pendingPurges.size() << std::endl;
-        //OE_INFO << LC << "Pending writes: " << std::dec << _writeService->getNumRequests() << std::endl;
+        sqlite3_reset( stmt );
     }
 
-    void setImageSync( const TileKey& key, const CacheSpec& spec, const osg::Image* image )
+    bool
+    Sqlite3CacheBin::isCached( const std::string& key, double maxAge )
     {
-        if (_options.maxSize().value() > 0 && _nbRequest > MAX_REQUEST_TO_RUN_PURGE) {
-            int t = (int)::time(0L);
-            purge(spec.cacheId(), t, _options.asyncWrites().value() );
-            _nbRequest = 0;
-        }
-        _nbRequest++;
-
-        ThreadTable tt = getTable( spec.cacheId() );
-        if ( tt._table )
-        {
-            ::time_t t = ::time(0L);
-            ImageRecord rec( key );
-            rec._created = (int)t;
-            rec._accessed = (int)t;
-            rec._image = image;
+        if ( !_ok ) return false;
 
-            tt._table->store( rec, tt._db );
-        }
+        Record rec;
+        if ( !fetch(key, rec, false) )
+            return false;
 
-        if ( _options.asyncWrites() == true )
-        {
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-            std::string name = key.str() + spec.cacheId();
-            _pendingWrites.erase( name );
-            displayPendingOperations();
-        }
+        return maxAge >= DBL_MAX || (double)(::time(0L) - rec._created) <= maxAge;
     }
 
-
-#ifdef SPLIT_LAYER_DB
-    sqlite3* getOrCreateDbForThread(const std::string& layer)
+    bool
+    Sqlite3CacheBin::touch( const std::string& key )
     {
-        sqlite3* db = 0L;
-
-        // this method assumes the thread already holds a lock on _tableListMutex, which
-        // doubles to protect _dbPerThread
+        if ( !_ok ) return false;
 
-        Thread* thread = Thread::CurrentThread();
-        std::map<Thread*,sqlite3*>::const_iterator k = _dbPerThreadLayers[layer].find(thread);
-        if ( k == _dbPerThreadLayers[layer].end() )
+        ::time_t now = ::time(0L);
         {
-            db = openDatabase( layer + _options.path().value(), _options.serialized().value() );
-            if ( db )
-            {
-                _dbPerThreadLayers[layer][thread] = db;
-                OE_INFO << LC << "Created DB handle " << std::hex << db << " for thread " << thread << std::endl;
-            }
-            else
+            ScopedMutexLock lock( _pendingMutex );
+            Records::iterator i = _pending.find( key );
+            if ( i != _pending.end() )
             {
-                OE_WARN << LC << "Failed to open DB on thread " << thread << std::endl;
+                i->second._created = now;
+                return true;
             }
         }
-        else
-        {
-            db = k->second;
-        }
 
-        return db;
-    }
+        // a record in the middle of a commit will land first; wait for it.
+        ScopedMutexLock flushLock( _flushMutex );
 
+        Connection* conn = _db->getConnection();
+        if ( !conn ) return false;
 
-    sqlite3* getOrCreateMetaDbForThread()
-    {
-        sqlite3* db = 0L;
+        sqlite3_stmt* stmt = conn->prepare(
+            "UPDATE " + _table + " SET created = ?, accessed = ? WHERE key = ?" );
+        if ( !stmt ) return false;
 
-        // this method assumes the thread already holds a lock on _tableListMutex, which
-        // doubles to protect _dbPerThread
+        sqlite3_bind_int64( stmt, 1, (sqlite3_int64)now );
+        sqlite3_bind_int64( stmt, 2, (sqlite3_int64)now );
+        sqlite3_bind_text ( stmt, 3, key.c_str(), key.length(), SQLITE_STATIC );
 
-        Thread* thread = Thread::CurrentThread();
-        std::map<Thread*,sqlite3*>::const_iterator k = _dbPerThreadMeta.find(thread);
-        if ( k == _dbPerThreadMeta.end() )
-        {
-            db = openDatabase( _options.path().value(), _options.serialized().value() );
-            if ( db )
-            {
-                _dbPerThreadMeta[thread] = db;
-                OE_INFO << LC << "Created DB handle " << std::hex << db << " for thread " << thread << std::endl;
-            }
-            else
-            {
-                OE_WARN << LC << "Failed to open DB on thread " << thread << std::endl;
-            }
-        }
-        else
-        {
-            db = k->second;
-        }
-
-        return db;
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(conn->_db) > 0;
+        sqlite3_reset( stmt );
+        return ok;
     }
 
-#else
-    sqlite3* getOrCreateDbForThread()
+    bool
+    Sqlite3CacheBin::purge()
     {
-        sqlite3* db = 0L;
+        if ( !_ok ) return false;
 
-        // this method assumes the thread already holds a lock on _tableListMutex, which
-        // doubles to protect _dbPerThread
-
-        Thread* thread = Thread::CurrentThread();
-        std::map<Thread*,sqlite3*>::const_iterator k = _dbPerThread.find(thread);
-        if ( k == _dbPerThread.end() )
+        ScopedMutexLock flushLock( _flushMutex );
         {
-            db = openDatabase( _databasePath, _options.serialized().value() );
-            if ( db )
-            {
-                _dbPerThread[thread] = db;
-                OE_DEBUG << LC << "Created DB handle " << std::hex << db << " for thread " << thread << std::endl;
-            }
-            else
-            {
-                OE_WARN << LC << "Failed to open DB on thread " << thread << std::endl;
-            }
-        }
-        else
-        {
-            db = k->second;
+            ScopedMutexLock lock( _pendingMutex );
+            _pending.clear();
+            _accessed.clear();
         }
 
-        return db;
+        Connection* conn = _db->getConnection();
+        return conn && conn->exec( "DELETE FROM " + _table );
     }
-#endif
 
-    // gets the layer table for the specified layer name, creating it if it does
-    // not already exist...
-    ThreadTable getTable( const std::string& tableName )
+    Config
+    Sqlite3CacheBin::readMetadata()
     {
-        ScopedLock<Mutex> lock( _tableListMutex );
-
-#ifdef SPLIT_LAYER_DB
-        sqlite3* db = getOrCreateDbForThread(tableName);
-#else
-        sqlite3* db = getOrCreateDbForThread();
-#endif
-        if ( !db )
-            return ThreadTable( 0L, 0L );
-
-        LayerTablesByName::iterator i = _tables.find(tableName);
-        if ( i == _tables.end() )
-        {
-            MetadataRecord meta;
-#ifdef SPLIT_LAYER_DB
-            sqlite3* metadb = getOrCreateMetaDbForThread();
-            if ( !_metadata.load( tableName, metadb, meta ) )
-#else
-            if ( !_metadata.load( tableName, db, meta ) )
-#endif
-            {
-                OE_WARN << LC << "Cannot operate on \"" << tableName << "\" because metadata does not exist."
-                    << std::endl;
-                return ThreadTable( 0L, 0L );
-            }
-
-            _tables[tableName] = new LayerTable( meta, db );
-            OE_DEBUG << LC << "New LayerTable for " << tableName << std::endl;
-        }
-        return ThreadTable( _tables[tableName].get(), db );
-    }
-
-private:
-
-    const Sqlite3CacheOptions _options;
-    //osg::ref_ptr<const Sqlite3CacheOptions> _settings;
-    osg::ref_ptr<osgDB::ReaderWriter> _defaultRW;
-    Mutex             _tableListMutex;
-    MetadataTable     _metadata;
-    LayerTablesByName _tables;
-
-    bool _useAsyncWrites;
-    osg::ref_ptr<TaskService> _writeService;
-    Mutex _pendingWritesMutex;
-
-#ifdef INSERT_POOL
-    std::map<std::string, osg::ref_ptr<AsyncInsertPool> > _pendingWrites;
-#else
-    std::map<std::string, osg::ref_ptr<AsyncInsert> > _pendingWrites;
-#endif
-    Mutex _pendingUpdateMutex;
-    std::map<std::string, osg::ref_ptr<AsyncUpdateAccessTimePool> > _pendingUpdates;
-
-    Mutex _pendingPurgeMutex;
-    std::map<std::string, osg::ref_ptr<AsyncPurge> > _pendingPurges;
+        if ( !_ok ) return Config();
 
-    sqlite3* _db;
-    std::map<Thread*,sqlite3*> _dbPerThread;
+        Connection* conn = _db->getConnection();
+        if ( !conn ) return Config();
 
-    std::map<std::string, std::map<Thread*,sqlite3*> > _dbPerThreadLayers;
-    std::map<Thread*,sqlite3*> _dbPerThreadMeta;
+        sqlite3_stmt* stmt = conn->prepare( "SELECT json FROM osgearth_bin_metadata WHERE bin = ?" );
+        if ( !stmt ) return Config();
 
-    osg::ref_ptr<MemCache> _L2cache;
+        sqlite3_bind_text( stmt, 1, getID().c_str(), getID().length(), SQLITE_STATIC );
 
-    int _count;
-    int _nbRequest;
-
-    std::vector<std::string> _layersList;
-    std::string _databasePath;
-};
-
-
-
-AsyncUpdateAccessTime::AsyncUpdateAccessTime( const TileKey& key, const std::string& cacheId, int timeStamp, Sqlite3Cache* cache ) : 
-_key(key), _cacheId(cacheId), _timeStamp(timeStamp), _cache(cache)
-{
-    //nop
-}
-
-void AsyncUpdateAccessTime::operator()( ProgressCallback* progress ) 
-{ 
-    osg::ref_ptr<Sqlite3Cache> cache = _cache.get();
-    if ( cache.valid() ) {
-        //OE_WARN << "AsyncUpdateAccessTime will process " << _key << std::endl;
-        cache->updateAccessTimeSync( _cacheId, _key , _timeStamp );
-    }
-}
-
-
-AsyncUpdateAccessTimePool::AsyncUpdateAccessTimePool(const std::string& cacheId, Sqlite3Cache* cache) :
-_cacheId(cacheId), _cache(cache)
-{
-    //nop
-}
-
-void AsyncUpdateAccessTimePool::addEntry(const TileKey& key, int timeStamp)
-{
-    unsigned int lod = key.getLevelOfDetail();
-    addEntryInternal(key);
-    if (lod > 0) {
-        TileKey previous = key;
-        for (int i = (int)lod-1; i >= 0; --i) {
-            TileKey ancestor = previous.createAncestorKey(i);
-            if (ancestor.valid())
-                addEntryInternal(ancestor);
-            previous = ancestor;
+        Config conf;
+        if ( sqlite3_step(stmt) == SQLITE_ROW )
+        {
+            const char* json = (const char*)sqlite3_column_text( stmt, 0 );
+            if ( json )
+                conf.fromJSON( json );
         }
+        sqlite3_reset( stmt );
+        return conf;
     }
-    _timeStamp = timeStamp;
-}
 
-void AsyncUpdateAccessTimePool::addEntryInternal(const TileKey& key)
-{
-    const std::string& keyStr = key.str();
-    if (_keys.find(keyStr) == _keys.end()) {
-        _keys[keyStr] = 1;
-        if (_keyStr.empty())
-            _keyStr = keyStr;
-        else
-            _keyStr += ", " + keyStr;
-    }
-}
+    bool
+    Sqlite3CacheBin::writeMetadata( const Config& conf )
+    {
+        if ( !_ok ) return false;
 
-void AsyncUpdateAccessTimePool::operator()( ProgressCallback* progress ) 
-{ 
-    osg::ref_ptr<Sqlite3Cache> cache = _cache.get();
-    if ( cache.valid() ) {
-        //OE_INFO << "AsyncUpdateAccessTimePool will process " << _keys.size() << std::endl;
-        cache->updateAccessTimeSyncPool( _cacheId, _keyStr , _timeStamp );
-    }
-}
+        Connection* conn = _db->getConnection();
+        if ( !conn ) return false;
 
+        sqlite3_stmt* stmt = conn->prepare( "INSERT OR REPLACE INTO osgearth_bin_metadata (bin, json) VALUES (?, ?)" );
+        if ( !stmt ) return false;
 
-#ifdef INSERT_POOL
-AsyncInsertPool::AsyncInsertPool(const std::string& layerName, Sqlite3Cache* cache ) : _layerName(layerName), _cache(cache) { }
-void AsyncInsertPool::operator()( ProgressCallback* progress )
-{
-    osg::ref_ptr<Sqlite3Cache> cache = _cache.get();
-    if ( cache.valid() ) {
-        cache->setImageSyncPool( this, _layerName );
+        std::string json = conf.toJSON( true );
+        sqlite3_bind_text( stmt, 1, getID().c_str(), getID().length(), SQLITE_STATIC );
+        sqlite3_bind_text( stmt, 2, json.c_str(), json.length(), SQLITE_STATIC );
+
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset( stmt );
+        return ok;
     }
 }
-#endif
 
 //------------------------------------------------------------------------
 
@@ -1778,4 +831,3 @@ public:
 };
 
 REGISTER_OSGPLUGIN(osgearth_cache_sqlite3, Sqlite3CacheFactory)
-
@@ -44,6 +44,10 @@ EarthFileSerializer2::deserialize( const Config& conf, const std::string& refere
 
     // Read the layers in LAST (otherwise they will not benefit from the cache/profile configuration)
 
+    // Image and elevation layers start up concurrently.
+    ImageLayerVector     imageLayers;
+    ElevationLayerVector elevationLayers;
+
     // Image layers:
     ConfigSet images = conf.children( "image" );
     for( ConfigSet::const_iterator i = images.begin(); i != images.end(); i++ )
@@ -55,7 +59,7 @@ EarthFileSerializer2::deserialize( const Config& conf, const std::string& refere
         layerOpt.name() = layerDriverConf.value("name");
         //layerOpt.driver() = TileSourceOptions( layerDriverConf );
 
-        map->addImageLayer( new ImageLayer(layerOpt) );
+        imageLayers.push_back( new ImageLayer(layerOpt) );
     }
 
     // Elevation layers:
@@ -72,10 +76,12 @@ EarthFileSerializer2::deserialize( const Config& conf, const std::string& refere
             ElevationLayerOptions layerOpt( layerDriverConf );
             layerOpt.name() = layerDriverConf.value( "name" );
 
-            map->addElevationLayer( new ElevationLayer(layerOpt) );
+            elevationLayers.push_back( new ElevationLayer(layerOpt) );
         }
     }
 
+    map->addLayers( imageLayers, elevationLayers, mapOptions.asyncLayerStartup() == true );
+
     // Model layers:
     ConfigSet models = conf.children( "model" );
     for( ConfigSet::const_iterator i = models.begin(); i != models.end(); i++ )
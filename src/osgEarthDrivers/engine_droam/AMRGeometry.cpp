@@ -45,7 +45,8 @@ AMRTriangle::AMRTriangle()
 AMRTriangle::AMRTriangle(const MeshNode& n0, const osg::Vec2& t0,
                          const MeshNode& n1, const osg::Vec2& t1, 
                          const MeshNode& n2, const osg::Vec2& t2) :
-_node0(n0), _node1(n1), _node2(n2)
+_node0(n0), _node1(n1), _node2(n2),
+_t0(t0), _t1(t1), _t2(t2)
 {
     _stateSet = new osg::StateSet();
     // should this be INT_SAMPLER_2D?
@@ -80,6 +81,26 @@ AMRTriangle::expand( osg::BoundingBox& box )
     box.expandBy( _node2._vertex );
 }
 
+static bool
+sameNode( const MeshNode& lhs, const MeshNode& rhs )
+{
+    return
+        lhs._vertex        == rhs._vertex &&
+        lhs._normal        == rhs._normal &&
+        lhs._geodeticCoord == rhs._geodeticCoord &&
+        lhs._geodeticRot   == rhs._geodeticRot;
+}
+
+bool
+AMRTriangle::matches(const MeshNode& n0, const osg::Vec2& t0,
+                     const MeshNode& n1, const osg::Vec2& t1, 
+                     const MeshNode& n2, const osg::Vec2& t2) const
+{
+    return
+        _t0 == t0 && _t1 == t1 && _t2 == t2 &&
+        sameNode( _node0, n0 ) && sameNode( _node1, n1 ) && sameNode( _node2, n2 );
+}
+
 // --------------------------------------------------------------------------
 
 AMRDrawable::AMRDrawable()
@@ -492,6 +492,27 @@ static osg::Vec2f otex[8] =
     TEX->push_back( OFFSET + (T2*SPAN) ); \
     TEX->push_back( OFFSET + (T3*SPAN) );
 
+// Returns the triangle from the previous refresh that has the same corners, or a new
+// one. Splits and merges only change part of a diamond, so reusing the unchanged
+// triangles means only the changed ones get new uniforms uploaded.
+static AMRTriangle*
+reuseOrCreate(AMRTriangleList& previous,
+              const MeshNode& n0, const osg::Vec2& t0,
+              const MeshNode& n1, const osg::Vec2& t1,
+              const MeshNode& n2, const osg::Vec2& t2 )
+{
+    for( AMRTriangleList::iterator i = previous.begin(); i != previous.end(); ++i )
+    {
+        if ( i->get()->matches(n0, t0, n1, t1, n2, t2) )
+        {
+            osg::ref_ptr<AMRTriangle> tri = i->get();
+            previous.erase( i );
+            return tri.release();
+        }
+    }
+    return new AMRTriangle( n0, t0, n1, t1, n2, t2 );
+}
+
 void
 Diamond::refreshDrawable()
 {
@@ -523,8 +544,9 @@ Diamond::refreshDrawable()
 
     int o = _orientation;
     
-    // Start by clearing out the old primitive set:
-    _amrDrawable->_triangles.clear();
+    // Start by clearing out the old primitive set, keeping its triangles for reuse:
+    AMRTriangleList previous;
+    previous.swap( _amrDrawable->_triangles );
 
     //if ( false ) //!_isSplit ) // took this out to preserve the diamond center point.
     //{
@@ -551,7 +573,7 @@ Diamond::refreshDrawable()
 
         if ( !_c[0].valid() || !_c[0]->_isSplit )
         {
-            _amrDrawable->add( new AMRTriangle(
+            _amrDrawable->add( reuseOrCreate( previous,
                 node(),               offset + center * span,
                 _a[QUADTREE]->node(), offset + OT(T_QUADTREE,o) * span,
                 _a[PARENT_R]->node(), offset + OT(T_PARENT_R,o) * span ) );
@@ -560,14 +582,14 @@ Diamond::refreshDrawable()
         {
             if ( !q0 )
             {
-                _amrDrawable->add( new AMRTriangle(
+                _amrDrawable->add( reuseOrCreate( previous,
                     node(),               offset + center * span,
                     _a[QUADTREE]->node(), offset + OT(T_QUADTREE,o) * span,
                     _c[0]->node(),        offset + OT(T_CHILD_0,o) * span ) );
             }
             if ( !q1 )
             {
-                _amrDrawable->add( new AMRTriangle(
+                _amrDrawable->add( reuseOrCreate( previous,
                     node(),               offset + center * span,
                     _c[0]->node(),        offset + OT(T_CHILD_0,o) * span,
                     _a[PARENT_R]->node(), offset + OT(T_PARENT_R,o) * span ) );
@@ -576,7 +598,7 @@ Diamond::refreshDrawable()
 
         if ( !_c[1].valid() || !_c[1]->_isSplit )
         {
-            _amrDrawable->add( new AMRTriangle(
+            _amrDrawable->add( reuseOrCreate( previous,
                 node(),               offset + center * span,
                 _a[PARENT_R]->node(), offset + OT(T_PARENT_R,o) * span,
                 _a[GDPARENT]->node(), offset + OT(T_GDPARENT,o) * span ) );
@@ -585,14 +607,14 @@ Diamond::refreshDrawable()
         {
             if ( !q1 )
             {
-                _amrDrawable->add( new AMRTriangle(
+                _amrDrawable->add( reuseOrCreate( previous,
                     node(),               offset + center * span,
                     _a[PARENT_R]->node(), offset + OT(T_PARENT_R,o) * span,
                     _c[1]->node(),        offset + OT(T_CHILD_1,o) * span ) );
             }
             if ( !q2 )
             {
-                _amrDrawable->add( new AMRTriangle(
+                _amrDrawable->add( reuseOrCreate( previous,
                     node(),               offset + center * span,
                     _c[1]->node(),        offset + OT(T_CHILD_1,o) * span,
                     _a[GDPARENT]->node(), offset + OT(T_GDPARENT,o) * span ) );
@@ -601,7 +623,7 @@ Diamond::refreshDrawable()
 
         if ( !_c[2].valid() || !_c[2]->_isSplit )
         {
-            _amrDrawable->add( new AMRTriangle(
+            _amrDrawable->add( reuseOrCreate( previous,
                 node(),               offset + center * span,
                 _a[GDPARENT]->node(), offset + OT(T_GDPARENT,o) * span,
                 _a[PARENT_L]->node(), offset + OT(T_PARENT_L,o) * span ) );
@@ -610,14 +632,14 @@ Diamond::refreshDrawable()
         {
             if ( !q2 )
             {
-                _amrDrawable->add( new AMRTriangle(
+                _amrDrawable->add( reuseOrCreate( previous,
                     node(),               offset + center * span,
                     _a[GDPARENT]->node(), offset + OT(T_GDPARENT,o) * span,
                     _c[2]->node(),        offset + OT(T_CHILD_2,o) * span ) );
             }
             if ( !q3 )
             {
-                _amrDrawable->add( new AMRTriangle(
+                _amrDrawable->add( reuseOrCreate( previous,
                     node(),               offset + center * span,
                     _c[2]->node(),        offset + OT(T_CHILD_2,o) * span,
                     _a[PARENT_L]->node(), offset + OT(T_PARENT_L,o) * span ) );
@@ -626,7 +648,7 @@ Diamond::refreshDrawable()
 
         if ( !_c[3].valid() || !_c[3]->_isSplit )
         {
-            _amrDrawable->add( new AMRTriangle(
+            _amrDrawable->add( reuseOrCreate( previous,
                 node(),               offset + center * span,
                 _a[PARENT_L]->node(), offset + OT(T_PARENT_L,o) * span,
                 _a[QUADTREE]->node(), offset + OT(T_QUADTREE,o) * span ) );
@@ -635,14 +657,14 @@ Diamond::refreshDrawable()
         {
             if ( !q3 )
             {
-                _amrDrawable->add( new AMRTriangle(
+                _amrDrawable->add( reuseOrCreate( previous,
                     node(),               offset + center * span,
                     _a[PARENT_L]->node(), offset + OT(T_PARENT_L,o) * span,
                     _c[3]->node(),        offset + OT(T_CHILD_3,o) * span ) );
             }
             if ( !q0 )
             {
-                _amrDrawable->add( new AMRTriangle(
+                _amrDrawable->add( reuseOrCreate( previous,
                     node(),               offset + center * span,
                     _c[3]->node(),        offset + OT(T_CHILD_3,o) * span,
                     _a[QUADTREE]->node(), offset + OT(T_QUADTREE,o) * span ) );
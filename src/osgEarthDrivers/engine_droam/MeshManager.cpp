@@ -19,6 +19,7 @@
 #include "MeshManager"
 #include <osg/CullFace>
 #include <osg/Texture2D>
+#include <osg/Timer>
 
 // --------------------------------------------------------------------------
 
@@ -44,7 +45,7 @@ _map( map ),
 _minGeomLevel( 1 ),
 _minActiveLevel( 0 ),
 _maxActiveLevel( MAX_ACTIVE_LEVEL ),
-_maxJobsPerFrame( MAX_JOBS_PER_FRAME )
+_frameBudgetMS( FRAME_BUDGET_MS )
 {
     // fire up a task service to load textures.
     _imageService = new TaskService( "Image Service", 16 );
@@ -154,12 +155,15 @@ outlineTexture( osg::Image* image )
 void
 MeshManager::update()
 {
+    // split, merge and image jobs share one time slice. Each queue gets at least one
+    // job per frame so that none of them starves; the rest wait for the next frame.
+    const osg::Timer* timer = osg::Timer::instance();
+    osg::Timer_t start = timer->tick();
     int j;
 
     // process the split queue. these are diamonds that have requested to be split into
     // all four children.
-    for( j=0; j<_maxJobsPerFrame && !_splitQueue.empty(); ++j )
-    //if( !_splitQueue.empty() )
+    for( j=0; !_splitQueue.empty() && (j == 0 || timer->delta_m(start, timer->tick()) < _frameBudgetMS); ++j )
     {
         Diamond* d = _splitQueue.top()._d.get();
         if ( d->_status == ACTIVE && d->referenceCount() > 1 )
@@ -185,9 +189,7 @@ MeshManager::update()
 
     // process the merge queue. these are diamonds that have requested that all their
     // children be removed.
-    // FUTURE: process jobs until we reach some sort of time quota?
-
-    for( j=0; j<_maxJobsPerFrame && !_mergeQueue.empty(); ++j )
+    for( j=0; !_mergeQueue.empty() && (j == 0 || timer->delta_m(start, timer->tick()) < _frameBudgetMS); ++j )
     {
         Diamond* d = _mergeQueue.top()._d.get();
         if ( d->_status == ACTIVE && d->referenceCount() > 1 )
@@ -215,8 +217,7 @@ MeshManager::update()
 
     // process the texture image request queue.
     j=0;
-    for( DiamondJobList::iterator i = _imageQueue.begin(); i != _imageQueue.end() && j < _maxJobsPerFrame; ++j )
-    //if( _imageQueue.size() > 0 )
+    for( DiamondJobList::iterator i = _imageQueue.begin(); i != _imageQueue.end() && (j == 0 || timer->delta_m(start, timer->tick()) < _frameBudgetMS); ++j )
     {
         bool increment = true;
         bool remove = true;
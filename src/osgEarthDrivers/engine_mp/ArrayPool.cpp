@@ -0,0 +1,206 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "ArrayPool"
+#include <osg/Geometry>
+
+using namespace osgEarth_engine_mp;
+using namespace osgEarth;
+
+#define LC "[ArrayPool] "
+
+//----------------------------------------------------------------------------
+
+namespace
+{
+    template<typename T>
+    T* makeArray( unsigned capacity )
+    {
+        T* array = new T();
+        array->reserve( capacity );
+        return array;
+    }
+
+    // empties an array without giving up its memory, and reports that capacity.
+    bool clearArray( osg::Array* array, unsigned& out_capacity )
+    {
+        switch( array->getType() )
+        {
+        case osg::Array::Vec2ArrayType:
+            static_cast<osg::Vec2Array*>(array)->clear();
+            out_capacity = static_cast<osg::Vec2Array*>(array)->capacity();
+            return true;
+        case osg::Array::Vec3ArrayType:
+            static_cast<osg::Vec3Array*>(array)->clear();
+            out_capacity = static_cast<osg::Vec3Array*>(array)->capacity();
+            return true;
+        case osg::Array::Vec4ArrayType:
+            static_cast<osg::Vec4Array*>(array)->clear();
+            out_capacity = static_cast<osg::Vec4Array*>(array)->capacity();
+            return true;
+        case osg::Array::FloatArrayType:
+            static_cast<osg::FloatArray*>(array)->clear();
+            out_capacity = static_cast<osg::FloatArray*>(array)->capacity();
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+
+ArrayPool::ArrayPool( unsigned maxPerBucket ) :
+_maxPerBucket( maxPerBucket ),
+_numArrays   ( 0 ),
+_sizeInBytes ( 0 ),
+_hits        ( 0 ),
+_requests    ( 0 )
+{
+    //nop
+}
+
+
+osg::Array*
+ArrayPool::take( osg::Array::Type type, unsigned capacity )
+{
+    if ( _maxPerBucket == 0 )
+        return 0L;
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    ++_requests;
+
+    Buckets::iterator i = _buckets.find( BucketKey(type, capacity) );
+    if ( i == _buckets.end() || i->second.empty() )
+        return 0L;
+
+    // hand it out unreferenced; the caller will take ownership.
+    osg::Array* array = i->second.back().release();
+    i->second.pop_back();
+
+    --_numArrays;
+    _sizeInBytes -= capacity * array->getElementSize();
+    ++_hits;
+
+    return array;
+}
+
+
+osg::Vec2Array*
+ArrayPool::getVec2Array( unsigned capacity )
+{
+    osg::Array* array = take( osg::Array::Vec2ArrayType, capacity );
+    return array ? static_cast<osg::Vec2Array*>(array) : makeArray<osg::Vec2Array>(capacity);
+}
+
+
+osg::Vec3Array*
+ArrayPool::getVec3Array( unsigned capacity )
+{
+    osg::Array* array = take( osg::Array::Vec3ArrayType, capacity );
+    return array ? static_cast<osg::Vec3Array*>(array) : makeArray<osg::Vec3Array>(capacity);
+}
+
+
+osg::Vec4Array*
+ArrayPool::getVec4Array( unsigned capacity )
+{
+    osg::Array* array = take( osg::Array::Vec4ArrayType, capacity );
+    return array ? static_cast<osg::Vec4Array*>(array) : makeArray<osg::Vec4Array>(capacity);
+}
+
+
+osg::FloatArray*
+ArrayPool::getFloatArray( unsigned capacity )
+{
+    osg::Array* array = take( osg::Array::FloatArrayType, capacity );
+    return array ? static_cast<osg::FloatArray*>(array) : makeArray<osg::FloatArray>(capacity);
+}
+
+
+void
+ArrayPool::recycle( osg::Array* array )
+{
+    // the owner's reference must be the only one, or someone else is still using it.
+    if ( _maxPerBucket == 0 || !array || array->referenceCount() != 1 )
+        return;
+
+    // hold a reference while we work on it.
+    osg::ref_ptr<osg::Array> ref = array;
+
+    unsigned capacity = 0;
+    if ( !clearArray(array, capacity) || capacity == 0 )
+        return;
+
+    // buffer objects are shared by all the arrays of a geometry, so the
+    // array cannot take its old one along into a new geometry.
+    array->setVertexBufferObject( 0L );
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    Bucket& bucket = _buckets[BucketKey(array->getType(), capacity)];
+    if ( bucket.size() < _maxPerBucket )
+    {
+        bucket.push_back( array );
+        ++_numArrays;
+        _sizeInBytes += capacity * array->getElementSize();
+    }
+}
+
+
+void
+ArrayPool::recycle( osg::Geometry* geom )
+{
+    if ( _maxPerBucket == 0 || !geom )
+        return;
+
+    recycle( geom->getVertexArray() );
+    recycle( geom->getNormalArray() );
+
+    for( unsigned i=0; i<geom->getNumTexCoordArrays(); ++i )
+        recycle( geom->getTexCoordArray(i) );
+
+    for( unsigned i=0; i<geom->getNumVertexAttribArrays(); ++i )
+        recycle( geom->getVertexAttribArray(i) );
+}
+
+
+unsigned
+ArrayPool::getNumArrays() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _numArrays;
+}
+
+
+unsigned
+ArrayPool::getSizeInBytes() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _sizeInBytes;
+}
+
+
+void
+ArrayPool::getHitRate( unsigned& out_hits, unsigned& out_requests ) const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    out_hits     = _hits;
+    out_requests = _requests;
+}
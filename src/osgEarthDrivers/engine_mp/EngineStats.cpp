@@ -0,0 +1,201 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "EngineStats"
+#include <osgEarth/StringUtils>
+
+using namespace osgEarth_engine_mp;
+using namespace osgEarth;
+
+#define LC "[EngineStats] "
+
+//----------------------------------------------------------------------------
+
+EngineStats::Timing::Timing() :
+_count      ( 0 ),
+_totalMillis( 0.0 ),
+_maxMillis  ( 0.0 )
+{
+    for( unsigned i=0; i<NUM_BUCKETS; ++i )
+        _histogram[i] = 0;
+}
+
+void
+EngineStats::Timing::add( double millis )
+{
+    ++_count;
+    _totalMillis += millis;
+    _maxMillis    = osg::maximum( _maxMillis, millis );
+
+    // bucket i holds times under 2^i ms; the last one holds the rest.
+    unsigned bucket = 0;
+    for( double limit = 1.0; bucket < NUM_BUCKETS-1 && millis >= limit; limit *= 2.0 )
+        ++bucket;
+    ++_histogram[bucket];
+}
+
+EngineStats::Snapshot::Snapshot() :
+_liveTiles     ( 0 ),
+_pendingTiles  ( 0 ),
+_tilesCreated  ( 0 ),
+_tilesUpsampled( 0 ),
+_tilesExpired  ( 0 ),
+_totalCreated  ( 0 ),
+_totalUpsampled( 0 ),
+_totalExpired  ( 0 )
+{
+    //nop
+}
+
+//----------------------------------------------------------------------------
+
+EngineStats::EngineStats() :
+_created      ( 0 ),
+_upsampled    ( 0 ),
+_expired      ( 0 ),
+_lastFrame    ( 0 ),
+_publishedOnce( false )
+{
+    //nop
+}
+
+const char*
+EngineStats::getStageName( Stage stage )
+{
+    switch( stage )
+    {
+    case STAGE_DATA_FETCH:  return "fetch";
+    case STAGE_HEIGHTFIELD: return "heightfield";
+    case STAGE_COMPILE:     return "compile";
+    case STAGE_MERGE:       return "merge";
+    case STAGE_GL_COMPILE:  return "gl compile";
+    default:                return "unknown";
+    }
+}
+
+void
+EngineStats::record( Stage stage, double millis )
+{
+    if ( stage >= NUM_STAGES )
+        return;
+
+    Threading::ScopedMutexLock lock( _mutex );
+    _current[stage].add( millis );
+}
+
+void
+EngineStats::tileCreated()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    ++_created;
+}
+
+void
+EngineStats::tileUpsampled()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    ++_upsampled;
+}
+
+void
+EngineStats::tileExpired()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    ++_expired;
+}
+
+void
+EngineStats::publish( osg::Stats* stats, unsigned frameNumber, unsigned liveTiles, unsigned pendingTiles )
+{
+    Snapshot s;
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+
+        if ( _publishedOnce && frameNumber == _lastFrame )
+            return;
+        _publishedOnce = true;
+        _lastFrame     = frameNumber;
+
+        // roll the current frame into the totals and start a new one.
+        Snapshot& p = _published;
+        p._liveTiles      = liveTiles;
+        p._pendingTiles   = pendingTiles;
+        p._tilesCreated   = _created;
+        p._tilesUpsampled = _upsampled;
+        p._tilesExpired   = _expired;
+        p._totalCreated   += _created;
+        p._totalUpsampled += _upsampled;
+        p._totalExpired   += _expired;
+        _created = _upsampled = _expired = 0;
+
+        for( unsigned i=0; i<NUM_STAGES; ++i )
+        {
+            Timing& total = p._total[i];
+            const Timing& frame = _current[i];
+            total._count       += frame._count;
+            total._totalMillis += frame._totalMillis;
+            total._maxMillis    = osg::maximum( total._maxMillis, frame._maxMillis );
+            for( unsigned b=0; b<NUM_BUCKETS; ++b )
+                total._histogram[b] += frame._histogram[b];
+
+            p._frame[i] = frame;
+            _current[i].reset();
+        }
+
+        s = p;
+    }
+
+    if ( !stats || !stats->collectStats("mp") )
+        return;
+
+    stats->setAttribute( frameNumber, "MP live tiles",      s._liveTiles );
+    stats->setAttribute( frameNumber, "MP pending tiles",   s._pendingTiles );
+    stats->setAttribute( frameNumber, "MP tiles created",   s._tilesCreated );
+    stats->setAttribute( frameNumber, "MP tiles upsampled", s._tilesUpsampled );
+    stats->setAttribute( frameNumber, "MP tiles expired",   s._tilesExpired );
+
+    for( unsigned i=0; i<NUM_STAGES; ++i )
+    {
+        std::string name = Stringify() << "MP " << getStageName((Stage)i);
+        const Timing& frame = s._frame[i];
+        const Timing& total = s._total[i];
+
+        // this frame:
+        stats->setAttribute( frameNumber, name + " count",  frame._count );
+        stats->setAttribute( frameNumber, name + " ms",     frame._totalMillis );
+        stats->setAttribute( frameNumber, name + " max ms", frame._maxMillis );
+
+        // since startup:
+        stats->setAttribute( frameNumber, name + " total count", total._count );
+        stats->setAttribute( frameNumber, name + " total ms",    total._totalMillis );
+        for( unsigned b=0; b<NUM_BUCKETS; ++b )
+        {
+            std::string bucket = b < NUM_BUCKETS-1 ?
+                Stringify() << " <" << (1u << b) << "ms" :
+                Stringify() << " >=" << (1u << (b-1)) << "ms";
+            stats->setAttribute( frameNumber, name + bucket, total._histogram[b] );
+        }
+    }
+}
+
+void
+EngineStats::getSnapshot( Snapshot& out_snapshot ) const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    out_snapshot = _published;
+}
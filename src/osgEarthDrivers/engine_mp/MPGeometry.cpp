@@ -19,6 +19,7 @@
 #include "MPGeometry"
 
 #include <osg/Version>
+#include <osg/buffered_value>
 
 using namespace osg;
 using namespace osgEarth_engine_mp;
@@ -27,11 +28,47 @@ using namespace osgEarth;
 #define LC "[MPGeometry] "
 
 
+//----------------------------------------------------------------------------
+
+namespace
+{
+    /**
+     * The layer uniforms are only ever set by MPGeometry, so their values
+     * persist in the current program from one tile to the next. This tracks
+     * what was last uploaded (per graphics context) so that a tile whose
+     * values match the previous tile's skip the upload. The record expires
+     * when the program or the frame changes.
+     */
+    struct LayerUniformState
+    {
+        LayerUniformState() : _pcp(0L), _frame(0u) { reset(0L, 0u); }
+
+        void reset( const osg::Program::PerContextProgram* pcp, unsigned frame )
+        {
+            _pcp   = pcp;
+            _frame = frame;
+            _opacitySet = _uidSet = _orderSet = false;
+        }
+
+        const osg::Program::PerContextProgram* _pcp;
+        unsigned _frame;
+        bool     _opacitySet, _uidSet, _orderSet;
+        float    _opacity;
+        int      _uid;
+        int      _order;
+    };
+
+    // accessed only from the draw thread of each context.
+    osg::buffered_object<LayerUniformState> s_layerUniformState;
+}
+
+
 //----------------------------------------------------------------------------
 
 MPGeometry::MPGeometry(const Map* map, int imageUnit) : 
 osg::Geometry    ( ), 
 _map             ( map, Map::IMAGE_LAYERS ),
+_hasPendingLayers( false ),
 _imageUnit       ( imageUnit )
 {
     _opacityUniform = new osg::Uniform( osg::Uniform::FLOAT, "oe_layer_opacity" );
@@ -46,6 +83,111 @@ _imageUnit       ( imageUnit )
     _texMatParentUniform = new osg::Uniform(osg::Uniform::FLOAT_MAT4, "oe_layer_parent_matrix");
 
     _imageUnitParent = _imageUnit + 1; // temp
+
+    _compactScale.set( 1.0f, 1.0f, 1.0f );
+    _compactOffset.set( 0.0f, 0.0f, 0.0f );
+    _compactScaleUniform  = new osg::Uniform( "oe_mp_vertex_scale",  _compactScale );
+    _compactOffsetUniform = new osg::Uniform( "oe_mp_vertex_offset", _compactOffset );
+}
+
+
+MPGeometry::~MPGeometry()
+{
+    if ( _arrayPool.valid() )
+    {
+        // the layers' texture coordinates are only recycled if this geometry
+        // owns them outright (i.e., they did not come from the compiler's cache).
+        for( std::vector<Layer>::iterator i = _layers.begin(); i != _layers.end(); ++i )
+        {
+            _arrayPool->recycle( i->_texCoords.get() );
+        }
+
+        _arrayPool->recycle( this );
+    }
+}
+
+
+void
+MPGeometry::compactVertices()
+{
+    osg::Vec3Array* verts = dynamic_cast<osg::Vec3Array*>( getVertexArray() );
+    if ( !verts || verts->empty() )
+        return;
+
+    // quantize each axis over the bounds of the geometry.
+    osg::BoundingBox box;
+    for( osg::Vec3Array::const_iterator v = verts->begin(); v != verts->end(); ++v )
+        box.expandBy( *v );
+
+    _compactOffset = box.center();
+    for( int i=0; i<3; ++i )
+    {
+        float halfSize    = 0.5f * (box._max[i] - box._min[i]);
+        _compactScale[i] = halfSize > 0.0f ? halfSize / 32767.0f : 1.0f;
+    }
+
+    _compactVerts = new osg::Vec3sArray();
+    _compactVerts->reserve( verts->size() );
+    for( osg::Vec3Array::const_iterator v = verts->begin(); v != verts->end(); ++v )
+    {
+        osg::Vec3s q;
+        for( int i=0; i<3; ++i )
+        {
+            float n = osg::round( ((*v)[i] - _compactOffset[i]) / _compactScale[i] );
+            q[i] = (short)osg::clampBetween( n, -32767.0f, 32767.0f );
+        }
+        _compactVerts->push_back( q );
+    }
+
+    if ( getUseVertexBufferObjects() )
+    {
+        _compactVerts->setVertexBufferObject( new osg::VertexBufferObject() );
+        _compactVerts->getVertexBufferObject()->setUsage( GL_STATIC_DRAW_ARB );
+
+        // the float vertices are only used on the CPU from now on.
+        verts->setVertexBufferObject( 0L );
+    }
+
+    _compactScaleUniform->set( _compactScale );
+    _compactOffsetUniform->set( _compactOffset );
+
+    // normals: GL expands signed bytes back to [-1..1] on its own.
+    osg::Vec3Array* normals = dynamic_cast<osg::Vec3Array*>( getNormalArray() );
+    if ( normals && getNormalBinding() == osg::Geometry::BIND_PER_VERTEX )
+    {
+        osg::Vec3bArray* packed = new osg::Vec3bArray();
+        packed->reserve( normals->size() );
+        for( osg::Vec3Array::const_iterator n = normals->begin(); n != normals->end(); ++n )
+        {
+            osg::Vec3f unit = *n;
+            unit.normalize();
+            packed->push_back( osg::Vec3b(
+                (char)osg::round( unit.x() * 127.0f ),
+                (char)osg::round( unit.y() * 127.0f ),
+                (char)osg::round( unit.z() * 127.0f ) ) );
+        }
+        setNormalArray( packed );
+        setNormalBinding( osg::Geometry::BIND_PER_VERTEX );
+    }
+}
+
+
+void
+MPGeometry::addLayer(const Layer& layer)
+{
+    Threading::ScopedMutexLock exclusive( _mapSyncMutex );
+    _pendingLayers.push_back( layer );
+    _hasPendingLayers = true;
+}
+
+
+bool
+MPGeometry::hasLayer(osgEarth::UID layerID) const
+{
+    Threading::ScopedMutexLock exclusive( _mapSyncMutex );
+    return
+        std::find( _layers.begin(), _layers.end(), layerID ) != _layers.end() ||
+        std::find( _pendingLayers.begin(), _pendingLayers.end(), layerID ) != _pendingLayers.end();
 }
 
 
@@ -53,13 +195,30 @@ void
 MPGeometry::renderPrimitiveSets(osg::State& state,
                                 bool        usingVBOs) const
 {
-    // check the map frame to see if it's up to date
-    if ( _map.needsSync() )
+    // check the map frame to see if it's up to date, and merge any queued layers.
+    if ( _map.needsSync() || _hasPendingLayers )
     {
         // this lock protects a MapFrame sync when we have multiple DRAW threads.
         Threading::ScopedMutexLock exclusive( _mapSyncMutex );
 
-        if ( _map.needsSync() && _map.sync() ) // always double check
+        bool reorder = _map.needsSync() && _map.sync(); // always double check
+
+        if ( _hasPendingLayers )
+        {
+            for( std::vector<Layer>::const_iterator p = _pendingLayers.begin(); p != _pendingLayers.end(); ++p )
+            {
+                std::vector<Layer>::iterator j = std::find( _layers.begin(), _layers.end(), p->_layerID );
+                if ( j != _layers.end() )
+                    *j = *p;
+                else
+                    _layers.push_back( *p );
+            }
+            _pendingLayers.clear();
+            _hasPendingLayers = false;
+            reorder = true;
+        }
+
+        if ( reorder )
         {
             // This should only happen is the layer ordering changes;
             // If layers are added or removed, the Tile gets rebuilt and
@@ -87,6 +246,8 @@ MPGeometry::renderPrimitiveSets(osg::State& state,
     GLint uidLocation;
     GLint orderLocation;
     GLint texMatParentLocation;
+    GLint compactScaleLocation;
+    GLint compactOffsetLocation;
 
     // yes, it's possible that the PCP is not set up yet.
     // TODO: can we optimize this so we don't need to get uni locations every time?
@@ -96,6 +257,20 @@ MPGeometry::renderPrimitiveSets(osg::State& state,
         uidLocation          = pcp->getUniformLocation( _layerUIDUniform->getNameID() );
         orderLocation        = pcp->getUniformLocation( _layerOrderUniform->getNameID() );
         texMatParentLocation = pcp->getUniformLocation( _texMatParentUniform->getNameID() );
+
+        // the position decoding for the compact vertex layout (identity otherwise).
+        compactScaleLocation  = pcp->getUniformLocation( _compactScaleUniform->getNameID() );
+        compactOffsetLocation = pcp->getUniformLocation( _compactOffsetUniform->getNameID() );
+        _compactScaleUniform->apply( ext, compactScaleLocation );
+        _compactOffsetUniform->apply( ext, compactOffsetLocation );
+    }
+
+    // the layer uniform values already present in the current program:
+    LayerUniformState& us = s_layerUniformState[state.getContextID()];
+    unsigned frame = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0u;
+    if ( us._pcp != pcp || us._frame != frame )
+    {
+        us.reset( pcp, frame );
     }
 
     // activate the tile coordinate set - same for all layers
@@ -103,9 +278,6 @@ MPGeometry::renderPrimitiveSets(osg::State& state,
 
     if ( _layers.size() > 0 )
     {
-        float prev_opacity        = -1.0f;
-        float prev_alphaThreshold = -1.0f;
-
         // first bind any shared layers
         // TODO: optimize by pre-storing shared indexes
         for(unsigned i=0; i<_layers.size(); ++i)
@@ -128,8 +300,9 @@ MPGeometry::renderPrimitiveSets(osg::State& state,
             }
         }
 
-        // track the active image unit.
-        int activeImageUnit = -1;
+        // track the active image unit and the coordinates bound to it.
+        int                   activeImageUnit = -1;
+        const osg::Vec2Array* activeTexCoords = 0L;
 
         // interate over all the image layers
         for(unsigned i=0; i<_layers.size(); ++i)
@@ -156,37 +329,58 @@ MPGeometry::renderPrimitiveSets(osg::State& state,
                     layer._texParent->apply( state );
                 }
 
-                // bind the texture coordinates for this layer.
-                // TODO: can probably optimize this by sharing or using texture matrixes.
-                // State::setTexCoordPointer does some redundant work under the hood.
-                state.setTexCoordPointer( _imageUnit, layer._texCoords.get() );
+                // bind the texture coordinates for this layer. Layers with the same
+                // profile share their coordinates, and State::setTexCoordPointer
+                // does some redundant work under the hood, so skip the rebind.
+                if ( layer._texCoords.get() != activeTexCoords )
+                {
+                    state.setTexCoordPointer( _imageUnit, layer._texCoords.get() );
+                    activeTexCoords = layer._texCoords.get();
+                }
 
                 // apply uniform values:
                 if ( pcp )
                 {
                     // apply opacity:
                     float opacity = layer._imageLayer->getOpacity();
-                    if ( opacity != prev_opacity )
+                    if ( !us._opacitySet || opacity != us._opacity )
                     {
                         _opacityUniform->set( opacity );
                         _opacityUniform->apply( ext, opacityLocation );
-                        prev_opacity = opacity;
+                        us._opacity    = opacity;
+                        us._opacitySet = true;
                     }
 
                     // assign the layer UID:
-                    _layerUIDUniform->set( layer._layerID );
-                    _layerUIDUniform->apply( ext, uidLocation );
+                    if ( !us._uidSet || layer._layerID != us._uid )
+                    {
+                        _layerUIDUniform->set( layer._layerID );
+                        _layerUIDUniform->apply( ext, uidLocation );
+                        us._uid    = layer._layerID;
+                        us._uidSet = true;
+                    }
 
                     // assign the layer order:
-                    _layerOrderUniform->set( (int)layersDrawn );
-                    _layerOrderUniform->apply( ext, orderLocation );
+                    if ( !us._orderSet || (int)layersDrawn != us._order )
+                    {
+                        _layerOrderUniform->set( (int)layersDrawn );
+                        _layerOrderUniform->apply( ext, orderLocation );
+                        us._order    = (int)layersDrawn;
+                        us._orderSet = true;
+                    }
 
-                    // assign the parent texture matrix
+                    // assign the parent texture matrix. A zero matrix tells the
+                    // shader there's no parent texture to blend with.
                     if ( layer._texParent.valid() )
                     {
                         _texMatParentUniform->set( layer._texMatParent );
                         _texMatParentUniform->apply( ext, texMatParentLocation );
                     }
+                    else
+                    {
+                        _texMatParentUniform->set( osg::Matrixf(0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0) );
+                        _texMatParentUniform->apply( ext, texMatParentLocation );
+                    }
                 }
 
                 // draw the primitive sets.
@@ -207,14 +401,21 @@ MPGeometry::renderPrimitiveSets(osg::State& state,
     // if we didn't draw anything, draw the raw tiles anyway with no texture.
     if ( layersDrawn == 0 )
     {
-        _opacityUniform->set( 1.0f );
-        _opacityUniform->apply( ext, opacityLocation );
+        if ( pcp )
+        {
+            _opacityUniform->set( 1.0f );
+            _opacityUniform->apply( ext, opacityLocation );
 
-        _layerUIDUniform->set( (int)-1 ); // indicates a non-textured layer
-        _layerUIDUniform->apply( ext, uidLocation );
+            _layerUIDUniform->set( (int)-1 ); // indicates a non-textured layer
+            _layerUIDUniform->apply( ext, uidLocation );
 
-        _layerOrderUniform->set( (int)0 );
-        _layerOrderUniform->apply( ext, orderLocation );
+            _layerOrderUniform->set( (int)0 );
+            _layerOrderUniform->apply( ext, orderLocation );
+
+            us._opacity = 1.0f; us._opacitySet = true;
+            us._uid     = -1;   us._uidSet     = true;
+            us._order   = 0;    us._orderSet   = true;
+        }
 
         // draw the primitives themselves.
         for(unsigned int primitiveSetNum=0; primitiveSetNum!=_primitives.size(); ++primitiveSetNum)
@@ -244,6 +445,8 @@ MPGeometry::releaseGLObjects(osg::State* state) const
         if ( layer._texCoords.valid() && layer._texCoords->referenceCount() == 1 )
             layer._texCoords->releaseGLObjects( state );
     }
+    if ( _compactVerts.valid() )
+        _compactVerts->releaseGLObjects( state );
 }
 
 
@@ -313,7 +516,9 @@ MPGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
 
     // set up arrays
 #if OSG_MIN_VERSION_REQUIRED( 3, 1, 8 )
-    if( _vertexArray.valid() )
+    if( _compactVerts.valid() )
+        state.setVertexPointer(_compactVerts.get());
+    else if( _vertexArray.valid() )
         state.setVertexPointer(_vertexArray.get());
 
     if (_normalArray.valid() && _normalArray->getBinding()==osg::Array::BIND_PER_VERTEX)
@@ -328,7 +533,9 @@ MPGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
     if (_fogCoordArray.valid() && _fogCoordArray->getBinding()==osg::Array::BIND_PER_VERTEX)
         state.setFogCoordPointer(_fogCoordArray.get());
 #else
-    if( _vertexData.array.valid() )
+    if( _compactVerts.valid() )
+        state.setVertexPointer(_compactVerts.get());
+    else if( _vertexData.array.valid() )
         state.setVertexPointer(_vertexData.array.get());
 
     if (_normalData.binding==BIND_PER_VERTEX && _normalData.array.valid())
@@ -162,6 +162,16 @@ public:
                         for(unsigned i=0; i<s_times.size(); ++i)
                             t += s_times[i];
                         OE_DEBUG << LC << "Average time = " << (t/s_times.size()) << " s." << std::endl;
+
+                        ArrayPool* pool = engineNode->getArrayPool();
+                        if ( pool )
+                        {
+                            unsigned hits, requests;
+                            pool->getHitRate( hits, requests );
+                            OE_DEBUG << LC << "Array pool: " << pool->getNumArrays() << " arrays ("
+                                << (pool->getSizeInBytes()/1024) << " KB), reused "
+                                << hits << " of " << requests << std::endl;
+                        }
                     }
                 }
 
@@ -21,6 +21,7 @@
 #include "TerrainNode"
 #include "TileModelFactory"
 #include "TileModelCompiler"
+#include "MPGeometry"
 
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/ImageUtils>
@@ -29,6 +30,7 @@
 #include <osgEarth/ShaderFactory>
 #include <osgEarth/MapModelChange>
 #include <osgEarth/Progress>
+#include <osgEarth/CullingUtils>
 
 #include <osg/TexEnv>
 #include <osg/TexEnvCombine>
@@ -36,6 +38,10 @@
 #include <osg/Timer>
 #include <osg/Depth>
 #include <osg/BlendFunc>
+#include <osgViewer/View>
+
+#include <cfloat>
+#include <algorithm>
 
 #define LC "[MPTerrainEngineNode] "
 
@@ -116,6 +122,109 @@ MPTerrainEngineNode::getUID() const
 
 //------------------------------------------------------------------------
 
+namespace
+{
+    /**
+     * Adds image layers to a live tile in place. Fetches each layer's texture,
+     * generates its texture coordinates for every geometry in the tile, and
+     * queues the result on the geometries; the vertices, normals and skirts
+     * are left untouched. With "replace", layers the tile already has are
+     * fetched again and replace the existing data.
+     */
+    struct AddImageLayersToTile : public TaskRequest
+    {
+        AddImageLayersToTile( TileNode* tile, TileModelFactory* factory, const ImageLayerVector& layers, bool replace =false ) :
+            TaskRequest( -(float)tile->getKey().getLOD() ), // finest tiles first
+            _tile      ( tile ),
+            _factory   ( factory ),
+            _layers    ( layers ),
+            _replace   ( replace ) { }
+
+        void operator()( ProgressCallback* progress )
+        {
+            const TileModel* model = _tile->getTileModel();
+            if ( !model || _tile->getNumChildren() == 0 || !_tile->getChild(0)->asGeode() )
+                return;
+
+            // all of the tile's geometries live in its surface geode.
+            osg::Geode* geode = _tile->getChild(0)->asGeode();
+            std::vector<MPGeometry*> geoms;
+            for( unsigned i = 0; i < geode->getNumDrawables(); ++i )
+            {
+                MPGeometry* geom = dynamic_cast<MPGeometry*>( geode->getDrawable(i) );
+                if ( geom )
+                    geoms.push_back( geom );
+            }
+            if ( geoms.empty() )
+                return;
+
+            osg::ref_ptr<const GeoLocator> geoLocator = model->_tileLocator.get();
+            if ( geoLocator->getCoordinateSystemType() == GeoLocator::GEOCENTRIC )
+                geoLocator = geoLocator->getGeographicFromGeocentric();
+
+            osg::Vec3d center = _tile->getMatrix().getTrans();
+
+            for( ImageLayerVector::const_iterator i = _layers.begin(); i != _layers.end(); ++i )
+            {
+                ImageLayer* layer = i->get();
+                if ( !_replace && geoms[0]->hasLayer(layer->getUID()) )
+                    continue;
+
+                TileModel::ColorData colorData;
+                if ( !_factory->createColorData(_tile->getKey(), layer, colorData) )
+                    continue;
+
+                osg::ref_ptr<const GeoLocator> colorLocator = colorData.getLocator();
+                if ( colorLocator->getCoordinateSystemType() == GeoLocator::GEOCENTRIC )
+                    colorLocator = colorLocator->getGeographicFromGeocentric();
+
+                bool sameLocator = colorLocator->isEquivalentTo( *geoLocator.get() );
+
+                MPGeometry::Layer mpLayer;
+                mpLayer._layerID    = layer->getUID();
+                mpLayer._imageLayer = layer;
+                mpLayer._tex        = colorData.getTexture();
+
+                for( std::vector<MPGeometry*>::iterator g = geoms.begin(); g != geoms.end(); ++g )
+                {
+                    const osg::Vec3Array* verts = dynamic_cast<const osg::Vec3Array*>( (*g)->getVertexArray() );
+                    if ( !verts )
+                        continue;
+
+                    // same mapping as TileModelCompiler: tile unit coords, then into the layer's space.
+                    osg::Vec2Array* texCoords = new osg::Vec2Array();
+                    texCoords->reserve( verts->size() );
+                    if ( (*g)->getUseVertexBufferObjects() )
+                        texCoords->setVertexBufferObject( new osg::VertexBufferObject() );
+
+                    for( osg::Vec3Array::const_iterator v = verts->begin(); v != verts->end(); ++v )
+                    {
+                        osg::Vec3d ndc;
+                        model->_tileLocator->modelToUnit( osg::Vec3d(*v) + center, ndc );
+                        if ( !sameLocator )
+                        {
+                            osg::Vec3d color_ndc;
+                            osgTerrain::Locator::convertLocalCoordBetween( *geoLocator.get(), ndc, *colorLocator.get(), color_ndc );
+                            ndc = color_ndc;
+                        }
+                        texCoords->push_back( osg::Vec2(ndc.x(), ndc.y()) );
+                    }
+
+                    mpLayer._texCoords = texCoords;
+                    (*g)->addLayer( mpLayer );
+                }
+            }
+        }
+
+        osg::ref_ptr<TileNode>         _tile;
+        osg::ref_ptr<TileModelFactory> _factory;
+        ImageLayerVector               _layers;
+        bool                           _replace;
+    };
+}
+
+//------------------------------------------------------------------------
+
 MPTerrainEngineNode::ElevationChangedCallback::ElevationChangedCallback( MPTerrainEngineNode* terrain ):
 _terrain( terrain )
 {
@@ -145,12 +254,18 @@ _shaderUpdateRequired ( false )
 {
     _uid = Registry::instance()->createUID();
 
+    _stats = new EngineStats();
+
     // install an elevation callback so we can update elevation data
     _elevationCallback = new ElevationChangedCallback( this );
+
+    Registry::addMemoryReporter( this );
 }
 
 MPTerrainEngineNode::~MPTerrainEngineNode()
 {
+    Registry::removeMemoryReporter( this );
+
     unregisterEngine( _uid );
 
     if ( _update_mapf )
@@ -159,6 +274,49 @@ MPTerrainEngineNode::~MPTerrainEngineNode()
     }
 }
 
+void
+MPTerrainEngineNode::getMemoryUsage( MemoryUsageMap& usage ) const
+{
+    if ( !_liveTiles.valid() )
+        return;
+
+    TileNodeVector tiles;
+    _liveTiles->getTiles( tiles );
+
+    // each counter only counts a shared object (e.g. a fallback image or a
+    // neighbor's heightfield) once.
+    MemoryCounter geometry, elevation;
+    std::map<std::string, MemoryCounter> layers;
+
+    for( TileNodeVector::iterator i = tiles.begin(); i != tiles.end(); ++i )
+    {
+        const TileModel* model = (*i)->getTileModel();
+        if ( model )
+        {
+            for( TileModel::ColorDataByUID::const_iterator c = model->_colorData.begin(); c != model->_colorData.end(); ++c )
+            {
+                const TileModel::ColorData& color = c->second;
+                MemoryCounter& layer = layers[color._layer.valid() ? color._layer->getName() : ""];
+                layer.add( color._texture.get() );
+                layer.add( color._image.get() );
+
+                // the tile's stateset refers to the same texture; don't count it as geometry.
+                geometry.mark( color._texture.get() );
+                geometry.mark( color._image.get() );
+            }
+
+            elevation.add( model->_elevationData.getHeightField() );
+        }
+
+        geometry.add( i->get() );
+    }
+
+    usage["terrain.geometry"]  += geometry.getBytes();
+    usage["terrain.elevation"] += elevation.getBytes();
+    for( std::map<std::string, MemoryCounter>::const_iterator i = layers.begin(); i != layers.end(); ++i )
+        usage["terrain.image." + i->first] += i->second.getBytes();
+}
+
 void
 MPTerrainEngineNode::preInitialize( const Map* map, const TerrainOptions& options )
 {
@@ -190,9 +348,24 @@ MPTerrainEngineNode::postInitialize( const Map* map, const TerrainOptions& optio
     {
         _deadTiles = new TileNodeRegistry("dead");
     }
+
+    // recycles the arrays of expired tiles (pass-through when the size is zero):
+    _arrayPool = new ArrayPool( _terrainOptions.arrayPoolSize().get() );
+
+    // set up a registry for budgeted GL pre-compilation:
+    if ( _terrainOptions.compileBudget().get() > 0.0f )
+    {
+        _pendingTiles = new TileNodeRegistry("pending");
+    }
     
     // initialize the model factory:
-    _tileModelFactory = new TileModelFactory(getMap(), _liveTiles.get(), _terrainOptions );
+    _tileModelFactory = new TileModelFactory(getMap(), _liveTiles.get(), _terrainOptions, _stats.get() );
+
+    // builds tiles ahead of the camera:
+    if ( _terrainOptions.prefetchTime().get() > 0.0f )
+    {
+        _prefetcher = new TilePrefetcher( getMap(), _tileModelFactory.get(), _liveTiles.get(), _terrainOptions );
+    }
 
 
     // handle an already-established map profile:
@@ -209,6 +382,11 @@ MPTerrainEngineNode::postInitialize( const Map* map, const TerrainOptions& optio
         this->getTextureCompositor()->reserveTextureImageUnit( _primaryUnit );
         this->getTextureCompositor()->reserveTextureImageUnit( _secondaryUnit );
 
+        // per-tile elevation textures requested up front (the GPU skirts
+        // and normals read them too):
+        if ( _terrainOptions.elevationTextures() == true || _terrainOptions.gpuEdges() == true )
+            requireElevationTextures();
+
         //this->getTextureCompositor()->reserveAttribIndex( _attribIndex1 );
         //this->getTextureCompositor()->reserveAttribIndex( _attribIndex2 );
     }
@@ -264,6 +442,50 @@ MPTerrainEngineNode::computeBound() const
 }
 
 
+void
+MPTerrainEngineNode::traverse( osg::NodeVisitor& nv )
+{
+    if ( nv.getVisitorType() == osg::NodeVisitor::CULL_VISITOR )
+    {
+        // watch the camera so we can build tiles ahead of it.
+        if ( _prefetcher.valid() )
+        {
+            _prefetcher->update( nv );
+        }
+
+        // close out the frame's stats and hand them to the viewer.
+        const osg::FrameStamp* fs = nv.getFrameStamp();
+        if ( fs && _liveTiles.valid() )
+        {
+            osg::Stats* stats = 0L;
+            osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+            if ( cv && cv->getCurrentCamera() )
+            {
+                osgViewer::View* view = dynamic_cast<osgViewer::View*>( cv->getCurrentCamera()->getView() );
+                if ( view && view->getViewerBase() )
+                    stats = view->getViewerBase()->getViewerStats();
+            }
+
+            _stats->publish(
+                stats,
+                fs->getFrameNumber(),
+                _liveTiles->size(),
+                _pendingTiles.valid() ? _pendingTiles->size() : 0u );
+        }
+    }
+
+    else if ( nv.getVisitorType() == osg::NodeVisitor::UPDATE_VISITOR )
+    {
+        if ( _liveTiles.valid() && _update_mapf )
+        {
+            updateInvalidatedImageLayers();
+        }
+    }
+
+    TerrainEngineNode::traverse( nv );
+}
+
+
 void
 MPTerrainEngineNode::refresh()
 {
@@ -299,7 +521,7 @@ MPTerrainEngineNode::createTerrain()
         _tileModelFactory->getHeightFieldCache()->clear();
 
     // New terrain
-    _terrain = new TerrainNode( _deadTiles.get() );
+    _terrain = new TerrainNode( _deadTiles.get(), _pendingTiles.get(), _terrainOptions.compileBudget().get(), _stats.get() );
     this->addChild( _terrain );
 
     // Enable blending on the terrain node; this will result in the underlying
@@ -320,6 +542,7 @@ MPTerrainEngineNode::createTerrain()
     // create a root node for each root tile key.
     OE_INFO << LC << "Creating root keys (" << keys.size() << ")" << std::flush;
 
+    TileNodeVector rootTiles;
     for( unsigned i=0; i<keys.size(); ++i )
     {
         osg::Node* node = factory->createRootNode( keys[i] );
@@ -329,7 +552,7 @@ MPTerrainEngineNode::createTerrain()
             _terrain->addChild( node );
             TileNode* tilenode = osgEarth::findTopMostNodeOfType<TileNode>(node);
             if ( tilenode )
-                _liveTiles->add( tilenode );
+                rootTiles.push_back( tilenode );
         }
         else
         {
@@ -337,12 +560,76 @@ MPTerrainEngineNode::createTerrain()
         }
     }
 
+    // register the root tiles in one batch.
+    _liveTiles->add( rootTiles );
+
     OE_INFO_CONTINUE << "done." << std::endl;
 
     updateShaders();
 }
 
 
+int
+MPTerrainEngineNode::requireElevationTextures()
+{
+    Threading::ScopedMutexLock lock( _elevationTexMutex );
+
+    if ( !_terrainOptions.elevationTextureUnit().isSet() )
+    {
+        int unit;
+        if ( !getTextureCompositor()->reserveTextureImageUnit(unit) )
+        {
+            OE_WARN << LC << "No texture image unit available for elevation textures" << std::endl;
+            return -1;
+        }
+
+        getOrCreateStateSet()->getOrCreateUniform( "oe_terrain_tex", osg::Uniform::SAMPLER_2D )->set( unit );
+
+        // the tile compilers read the unit from the options.
+        _terrainOptions.elevationTextureUnit() = unit;
+
+        OE_INFO << LC << "Elevation textures on image unit " << unit << std::endl;
+    }
+
+    return *_terrainOptions.elevationTextureUnit();
+}
+
+
+bool
+MPTerrainEngineNode::getResidentHeightField(double                                x,
+                                            double                                y,
+                                            TileKey&                              out_key,
+                                            osg::ref_ptr<const osg::HeightField>& out_hf) const
+{
+    if ( !_liveTiles.valid() || !getMap() )
+        return false;
+
+    // descend the live tile quadtree toward the point for as long as the
+    // next tile down is resident.
+    const Profile* profile = getMap()->getProfile();
+    bool found = false;
+
+    for( TileKey key = profile->createTileKey(x, y, *_terrainOptions.firstLOD());
+         key.valid();
+         key = profile->createTileKey(x, y, key.getLOD()+1) )
+    {
+        osg::ref_ptr<TileNode> tile;
+        if ( !_liveTiles->get(key, tile) )
+            break;
+
+        const TileModel* model = tile->isValid() ? tile->getTileModel() : 0L;
+        if ( model && model->hasElevation() )
+        {
+            out_key = key;
+            out_hf  = model->_elevationData.getHeightField();
+            found   = true;
+        }
+    }
+
+    return found;
+}
+
+
 KeyNodeFactory*
 MPTerrainEngineNode::getKeyNodeFactory()
 {
@@ -358,7 +645,9 @@ MPTerrainEngineNode::getKeyNodeFactory()
             _update_mapf->terrainMaskLayers(),
             _primaryUnit,
             optimizeTriangleOrientation,
-            _terrainOptions );
+            _terrainOptions,
+            _arrayPool.get(),
+            _stats.get() );
 
         // initialize a key node factory.
         knf = new SerialKeyNodeFactory( 
@@ -366,6 +655,7 @@ MPTerrainEngineNode::getKeyNodeFactory()
             compiler,
             _liveTiles.get(),
             _deadTiles.get(),
+            _pendingTiles.get(),
             _terrainOptions, 
             MapInfo( getMap() ),
             _terrain, 
@@ -396,6 +686,8 @@ MPTerrainEngineNode::createUpsampledNode(const TileKey&    key,
         if ( upsampledModel.valid() )
         {
             result = getKeyNodeFactory()->getCompiler()->compile( upsampledModel );
+            if ( result )
+                _stats->tileUpsampled();
         }
     }
     else
@@ -419,6 +711,8 @@ MPTerrainEngineNode::createNode(const TileKey&    key,
     OE_DEBUG << LC << "Create node for \"" << key.str() << "\"" << std::endl;
 
     osg::Node* result =  getKeyNodeFactory()->createNode( key, progress );
+    if ( result )
+        _stats->tileCreated();
     return result;
 }
 
@@ -497,6 +791,15 @@ MPTerrainEngineNode::onMapModelChanged( const MapModelChange& change )
 void
 MPTerrainEngineNode::addImageLayer( ImageLayer* layerAdded )
 {
+    // a regular layer only changes the texture set, so add it to the live
+    // tiles in place instead of rebuilding the terrain.
+    if ( layerAdded && !layerAdded->isShared() && layerAdded->getEnabled() && _liveTiles.valid() )
+    {
+        addImageLayerToLiveTiles( layerAdded );
+        updateShaders(); // for the layer's color filters
+        return;
+    }
+
     if ( layerAdded )
     {
         // for a shared layer, allocate a shared image unit if necessary.
@@ -526,6 +829,17 @@ MPTerrainEngineNode::addImageLayer( ImageLayer* layerAdded )
 void
 MPTerrainEngineNode::removeImageLayer( ImageLayer* layerRemoved )
 {
+    // the geometries drop layers that are no longer in the map on their next
+    // draw (see MPGeometry), so a regular layer needs no rebuild.
+    if ( layerRemoved )
+        _imageLayerDataRevisions.erase( layerRemoved->getUID() );
+
+    if ( layerRemoved && !layerRemoved->isShared() )
+    {
+        updateShaders();
+        return;
+    }
+
     if ( layerRemoved )
     {
         // for a shared layer, release the shared image unit.
@@ -542,6 +856,144 @@ MPTerrainEngineNode::removeImageLayer( ImageLayer* layerRemoved )
     refresh();
 }
 
+void
+MPTerrainEngineNode::addImageLayerToLiveTiles( ImageLayer* layer )
+{
+    if ( !_layerUpdateService.valid() )
+    {
+        _layerUpdateService = new TaskService( "MP image layer update", OpenThreads::GetNumberOfProcessors() );
+    }
+
+    // tiles that are still being built from the old map model get the
+    // layer when they arrive (see TilePagedLOD).
+    _liveTiles->setMapRevision( _update_mapf->getRevision() );
+
+    TileNodeVector tiles;
+    _liveTiles->getTiles( tiles );
+
+    ImageLayerVector layers;
+    layers.push_back( layer );
+
+    for( TileNodeVector::iterator i = tiles.begin(); i != tiles.end(); ++i )
+    {
+        _layerUpdateService->add( new AddImageLayersToTile(i->get(), _tileModelFactory.get(), layers) );
+    }
+
+    OE_INFO << LC << "Adding layer \"" << layer->getName() << "\" to " << tiles.size() << " live tiles" << std::endl;
+}
+
+
+void
+MPTerrainEngineNode::updateInvalidatedImageLayers()
+{
+    TileNodeVector tiles;
+    bool gotTiles = false;
+
+    for( ImageLayerVector::const_iterator i = _update_mapf->imageLayers().begin(); i != _update_mapf->imageLayers().end(); ++i )
+    {
+        ImageLayer* layer = i->get();
+
+        Revision current = layer->getDataRevision();
+        std::map<UID, Revision>::iterator r = _imageLayerDataRevisions.find( layer->getUID() );
+        if ( r == _imageLayerDataRevisions.end() )
+        {
+            // first sighting; the tiles were built from the current data.
+            _imageLayerDataRevisions[layer->getUID()] = current;
+            continue;
+        }
+
+        if ( (int)r->second == (int)current )
+            continue;
+
+        std::vector<GeoExtent> extents;
+        bool everything = !layer->getInvalidExtents( r->second, extents );
+        r->second = current;
+
+        if ( !layer->getEnabled() || layer->isShared() )
+            continue;
+
+        for( std::vector<GeoExtent>::const_iterator e = extents.begin(); e != extents.end() && !everything; ++e )
+        {
+            if ( !e->isValid() )
+                everything = true;
+        }
+
+        if ( !gotTiles )
+        {
+            _liveTiles->getTiles( tiles );
+            gotTiles = true;
+        }
+
+        if ( !_layerUpdateService.valid() )
+        {
+            _layerUpdateService = new TaskService( "MP image layer update", OpenThreads::GetNumberOfProcessors() );
+        }
+
+        ImageLayerVector layers;
+        layers.push_back( layer );
+
+        unsigned count = 0;
+        for( TileNodeVector::iterator t = tiles.begin(); t != tiles.end(); ++t )
+        {
+            bool affected = everything;
+            const GeoExtent& tileExtent = t->get()->getKey().getExtent();
+            for( std::vector<GeoExtent>::const_iterator e = extents.begin(); e != extents.end() && !affected; ++e )
+            {
+                affected = e->intersects( tileExtent );
+            }
+
+            if ( affected )
+            {
+                _layerUpdateService->add( new AddImageLayersToTile(t->get(), _tileModelFactory.get(), layers, true) );
+                ++count;
+            }
+        }
+
+        OE_DEBUG << LC << "Reloading layer \"" << layer->getName() << "\" on " << count << " live tiles" << std::endl;
+    }
+}
+
+
+void
+MPTerrainEngineNode::updateTileImageLayers( TileNode* tile )
+{
+    const TileModel* model = tile ? tile->getTileModel() : 0L;
+    if ( !model )
+        return;
+
+    // layers that missed the tile's fetch deadline replace their stand-in data.
+    const std::vector<UID>& deferredUIDs = model->_deferredLayers;
+
+    ImageLayerVector layers, deferred;
+    for( ImageLayerVector::const_iterator i = _update_mapf->imageLayers().begin(); i != _update_mapf->imageLayers().end(); ++i )
+    {
+        if ( i->get()->getEnabled() && !i->get()->isShared() )
+        {
+            if ( std::find(deferredUIDs.begin(), deferredUIDs.end(), i->get()->getUID()) != deferredUIDs.end() )
+                deferred.push_back( i->get() );
+            else
+                layers.push_back( i->get() );
+        }
+    }
+
+    if ( deferred.size() > 0 && !_layerUpdateService.valid() )
+    {
+        _layerUpdateService = new TaskService( "MP image layer update", OpenThreads::GetNumberOfProcessors() );
+    }
+
+    if ( deferred.size() > 0 )
+    {
+        _layerUpdateService->add( new AddImageLayersToTile(tile, _tileModelFactory.get(), deferred, true) );
+    }
+
+    // only tiles built before a layer was added live can be missing one.
+    if ( layers.size() > 0 && _layerUpdateService.valid() && (int)model->_revision < (int)_liveTiles->getMapRevision() )
+    {
+        _layerUpdateService->add( new AddImageLayersToTile(tile, _tileModelFactory.get(), layers) );
+    }
+}
+
+
 void
 MPTerrainEngineNode::moveImageLayer( unsigned int oldIndex, unsigned int newIndex )
 {
@@ -688,6 +1140,78 @@ MPTerrainEngineNode::updateShaders()
 
         vp->setFunction( "oe_mp_setup_coloring", vs, ShaderComp::LOCATION_VERTEX_MODEL, 0.0 );
 
+        // Compact vertex layout: restore the model position from the quantized one
+        // before any other model-stage function sees it.
+        if ( _terrainOptions.compactVertices() == true )
+        {
+            std::string vs_compact =
+                "#version " GLSL_VERSION_STR "\n"
+                GLSL_DEFAULT_PRECISION_FLOAT "\n"
+                "uniform vec3 oe_mp_vertex_scale; \n"
+                "uniform vec3 oe_mp_vertex_offset; \n"
+                "void oe_mp_decode_vertex(inout vec4 VertexModel) \n"
+                "{ \n"
+                "    VertexModel.xyz = VertexModel.xyz * oe_mp_vertex_scale + oe_mp_vertex_offset; \n"
+                "} \n";
+
+            vp->setFunction( "oe_mp_decode_vertex", vs_compact, ShaderComp::LOCATION_VERTEX_MODEL, -FLT_MAX );
+
+            terrainStateSet->getOrCreateUniform( "oe_mp_vertex_scale",  osg::Uniform::FLOAT_VEC3 )->set( osg::Vec3f(1,1,1) );
+            terrainStateSet->getOrCreateUniform( "oe_mp_vertex_offset", osg::Uniform::FLOAT_VEC3 )->set( osg::Vec3f(0,0,0) );
+        }
+
+        // GPU skirts and normals: the compiler leaves the skirt bottoms on the
+        // surface with a downward normal, and this lowers them by the tile's skirt
+        // height (oe_mp_skirt is only set on the skirt geometry). Normals come from
+        // the gradient of the elevation texture, which carries a border from the
+        // neighboring tiles so that both sides of an edge compute the same normal.
+        if ( _terrainOptions.gpuEdges() == true )
+        {
+            std::string vs_edges =
+                "#version " GLSL_VERSION_STR "\n"
+                GLSL_DEFAULT_PRECISION_FLOAT "\n"
+                "attribute vec4 oe_terrain_attr; \n"
+                "uniform sampler2D oe_terrain_tex; \n"
+                "uniform mat4 oe_terrain_tex_matrix; \n"
+                "uniform vec4 oe_terrain_tex_size; \n"
+                "uniform float oe_mp_skirt_height; \n"
+                "uniform bool oe_mp_skirt; \n"
+                "varying vec4 oe_layer_tilec; \n"
+                "varying vec3 oe_Normal; \n"
+                "void oe_mp_gpu_edges(inout vec4 VertexModel) \n"
+                "{ \n"
+                "    vec3 up = oe_terrain_attr.xyz; \n"
+                "    if ( oe_mp_skirt && dot(gl_Normal, up) < 0.0 ) \n"
+                "    { \n"
+                "        VertexModel.xyz -= up * oe_mp_skirt_height; \n"
+                "        oe_Normal = up; \n"
+                "    } \n"
+                // tiles without elevation have no texture (size = 0).
+                "    if ( oe_terrain_tex_size.x > 0.0 ) \n"
+                "    { \n"
+                "        vec2 c  = (oe_terrain_tex_matrix * oe_layer_tilec).st; \n"
+                "        vec2 dt = 1.0/oe_terrain_tex_size.xy; \n"
+                "        float w = texture2DLod(oe_terrain_tex, c - vec2(dt.x, 0.0), 0.0).r; \n"
+                "        float e = texture2DLod(oe_terrain_tex, c + vec2(dt.x, 0.0), 0.0).r; \n"
+                "        float s = texture2DLod(oe_terrain_tex, c - vec2(0.0, dt.y), 0.0).r; \n"
+                "        float n = texture2DLod(oe_terrain_tex, c + vec2(0.0, dt.y), 0.0).r; \n"
+                "        vec3 east = cross(vec3(0.0, 0.0, 1.0), up); \n"
+                "        east = dot(east, east) > 1.0e-6 ? normalize(east) : vec3(1.0, 0.0, 0.0); \n"
+                "        vec3 north = cross(up, east); \n"
+                "        oe_Normal = normalize( up \n"
+                "            + east  * (w-e)/(2.0*oe_terrain_tex_size.z) \n"
+                "            + north * (s-n)/(2.0*oe_terrain_tex_size.w) ); \n"
+                "    } \n"
+                "} \n";
+
+            // after oe_mp_setup_coloring, which sets oe_layer_tilec.
+            vp->setFunction( "oe_mp_gpu_edges", vs_edges, ShaderComp::LOCATION_VERTEX_MODEL, 1.0 );
+
+            terrainStateSet->getOrCreateUniform( "oe_terrain_tex_size", osg::Uniform::FLOAT_VEC4 )->set( osg::Vec4f(0,0,0,0) );
+            terrainStateSet->getOrCreateUniform( "oe_mp_skirt_height",  osg::Uniform::FLOAT )->set( 0.0f );
+            terrainStateSet->getOrCreateUniform( "oe_mp_skirt",         osg::Uniform::BOOL )->set( false );
+        }
+
         if ( _terrainOptions.premultipliedAlpha() == true )
             vp->setFunction( "oe_mp_apply_coloring_pma", fs_pma, ShaderComp::LOCATION_FRAGMENT_COLORING, 0.0 );
         else
@@ -726,9 +1250,20 @@ MPTerrainEngineNode::updateShaders()
                         for( ColorFilterChain::const_iterator j = chain.begin(); j != chain.end(); ++j )
                         {
                             const ColorFilter* filter = j->get();
-                            cf_head << "void " << filter->getEntryPointFunctionName() << "(inout vec4 color);\n";
-                            cf_body << I << I << filter->getEntryPointFunctionName() << "(color);\n";
-                            filter->install( terrainStateSet );
+
+                            // constant filters are folded right into the layer's block,
+                            // so they cost neither a call nor a uniform.
+                            std::string code;
+                            if ( filter->isConstant() && filter->getConstantCode(code) )
+                            {
+                                cf_body << I << I << "{\n" << code << I << I << "}\n";
+                            }
+                            else
+                            {
+                                cf_head << "void " << filter->getEntryPointFunctionName() << "(inout vec4 color);\n";
+                                cf_body << I << I << filter->getEntryPointFunctionName() << "(color);\n";
+                                filter->install( terrainStateSet );
+                            }
                         }
                         cf_body << I << "}\n";
                         ifStarted = true;
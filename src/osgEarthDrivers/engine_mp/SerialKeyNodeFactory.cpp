@@ -84,6 +84,7 @@ SerialKeyNodeFactory::SerialKeyNodeFactory(TileModelFactory*             modelFa
                                            TileModelCompiler*            modelCompiler,
                                            TileNodeRegistry*             liveTiles,
                                            TileNodeRegistry*             deadTiles,
+                                           TileNodeRegistry*             pendingTiles,
                                            const MPTerrainEngineOptions& options,
                                            const MapInfo&                mapInfo,
                                            TerrainNode*                  terrain,
@@ -92,6 +93,7 @@ _modelFactory    ( modelFactory ),
 _modelCompiler   ( modelCompiler ),
 _liveTiles       ( liveTiles ),
 _deadTiles       ( deadTiles ),
+_pendingTiles    ( pendingTiles ),
 _options         ( options ),
 _mapInfo         ( mapInfo ),
 _terrain         ( terrain ),
@@ -130,7 +132,7 @@ SerialKeyNodeFactory::createTile(TileModel* model,
 
         osgDB::Options* dbOptions = Registry::instance()->cloneOrCreateOptions();
 
-        TileGroup* plod = new TileGroup(tileNode, _engineUID, _liveTiles.get(), _deadTiles.get(), dbOptions);
+        TileGroup* plod = new TileGroup(tileNode, _engineUID, _liveTiles.get(), _deadTiles.get(), _pendingTiles.get(), dbOptions);
         plod->setSubtileRange( minRange );
 
 
@@ -157,6 +159,18 @@ SerialKeyNodeFactory::createTile(TileModel* model,
             *_options.verticalScale() ) );
     }
 
+    // this one rejects tiles (and their subtiles) behind the horizon:
+    if ( _mapInfo.isGeocentric() && _options.horizonCulling() == true )
+    {
+        osg::NodeCallback* hcc = HeightFieldUtils::createHorizonCullingCallback(
+            model->_elevationData.getHeightField(),
+            tileNode->getKey().getExtent(),
+            *_options.verticalScale() );
+
+        if ( hcc )
+            result->addCullCallback( hcc );
+    }
+
     return result;
 }
 
@@ -18,6 +18,7 @@
 */
 #include "TerrainNode"
 #include "QuickReleaseGLObjects"
+#include "CompileGLObjects"
 
 #include <osgEarth/Registry>
 #include <osgEarth/Map>
@@ -37,15 +38,28 @@ using namespace OpenThreads;
 
 //----------------------------------------------------------------------------
 
-TerrainNode::TerrainNode(TileNodeRegistry* removedTiles ) :
+TerrainNode::TerrainNode(TileNodeRegistry* removedTiles,
+                         TileNodeRegistry* pendingTiles,
+                         float             compileBudget,
+                         EngineStats*      stats ) :
 _tilesToQuickRelease            ( removedTiles ),
-_quickReleaseCallbackInstalled  ( false )
+_quickReleaseCallbackInstalled  ( false ),
+_tilesToCompile                 ( pendingTiles ),
+_compileBudget                  ( compileBudget ),
+_compileCallbackInstalled       ( false ),
+_stats                          ( stats )
 {
     // tick the update count to install the quick release callback:
     if ( _tilesToQuickRelease.valid() )
     {
         ADJUST_UPDATE_TRAV_COUNT( this, 1 );
     }
+
+    // ..and the compile callback:
+    if ( _tilesToCompile.valid() )
+    {
+        ADJUST_UPDATE_TRAV_COUNT( this, 1 );
+    }
 }
 
 
@@ -80,6 +94,33 @@ TerrainNode::traverse( osg::NodeVisitor &nv )
                 ADJUST_UPDATE_TRAV_COUNT( this, -1 );
             }
         }
+
+        // if the terrain engine requested a compile budget, install the
+        // pre-compile draw callback now.
+        if ( !_compileCallbackInstalled && _tilesToCompile.valid() )
+        {
+            osg::Camera* cam = findFirstParentOfType<osg::Camera>( this );
+            if ( cam )
+            {
+                osg::Camera::DrawCallback* cbToNest = cam->getPreDrawCallback();
+
+                // if it's another compile callback, we'll just replace it.
+                CompileGLObjects* previous = dynamic_cast<CompileGLObjects*>(cbToNest);
+                if ( previous )
+                    cbToNest = previous->_next.get();
+
+                cam->setPreDrawCallback( new CompileGLObjects(
+                    _tilesToCompile.get(),
+                    _compileBudget,
+                    _stats.get(),
+                    cbToNest ) );
+
+                _compileCallbackInstalled = true;
+                OE_INFO << LC << "Tile GL pre-compilation enabled (" << _compileBudget << " ms/frame)" << std::endl;
+
+                ADJUST_UPDATE_TRAV_COUNT( this, -1 );
+            }
+        }
     }
 
     osg::Group::traverse( nv );
@@ -33,6 +33,7 @@ TileGroup::TileGroup(TileNode*         tilenode,
                      const UID&        engineUID,
                      TileNodeRegistry* live,
                      TileNodeRegistry* dead,
+                     TileNodeRegistry* pending,
                      osgDB::Options*   dbOptions)
 {
     _numSubtilesUpsampling = 0;
@@ -45,7 +46,7 @@ TileGroup::TileGroup(TileNode*         tilenode,
     for(unsigned q=0; q<4; ++q)
     {
         TileKey subkey = tilenode->getKey().createChildKey(q);
-        TilePagedLOD* lod = new TilePagedLOD(this, subkey, engineUID, live, dead);
+        TilePagedLOD* lod = new TilePagedLOD(this, subkey, engineUID, live, dead, pending);
         lod->setDatabaseOptions( dbOptions );
         lod->setCenter( tilenode->getBound().center() );
         lod->setRadius( tilenode->getBound().radius() );
@@ -61,6 +62,29 @@ TileGroup::setSubtileRange(float range)
 }
 
 
+bool
+TileGroup::subtilesCompiled() const
+{
+    for( unsigned q=0; q<4; ++q )
+    {
+        const osg::Group* plod = static_cast<const osg::Group*>( getChild(1+q) );
+        if ( plod->getNumChildren() == 0 )
+            return false;
+
+        const osg::Node* child = plod->getChild(0);
+        const TileNode*  tilenode = dynamic_cast<const TileNode*>( child );
+        if ( !tilenode )
+        {
+            const TileGroup* group = dynamic_cast<const TileGroup*>( child );
+            tilenode = group ? group->getTileNode() : 0L;
+        }
+        if ( tilenode && !tilenode->isGLCompiled() )
+            return false;
+    }
+    return true;
+}
+
+
 void
 TileGroup::traverse(osg::NodeVisitor& nv)
 {
@@ -81,12 +105,13 @@ TileGroup::traverse(osg::NodeVisitor& nv)
 
         // if we are out of subtile range, or we're in range but the subtiles are
         // not all loaded yet, or we are skipping subtiles, draw the current tile.
-        if ( range > _subtileRange || _numSubtilesLoaded < 4 || !_traverseSubtiles )
+        if ( range > _subtileRange || _numSubtilesLoaded < 4 || !_traverseSubtiles || !subtilesCompiled() )
         {
             _tilenode->accept( nv );
         }
 
-        // if we're in range, traverse the subtiles.
+        // if we're in range, traverse the subtiles. (Their TilePagedLODs keep them
+        // hidden until all four are loaded and compiled.)
         if ( _traverseSubtiles && range <= _subtileRange )
         {
             for( unsigned q=0; q<4; ++q )
@@ -127,7 +127,8 @@ _fallbackData( fallbackData )
     _texture->setMaxAnisotropy( 16.0f );
     _texture->setResizeNonPowerOfTwoHint(false);
     _texture->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
-    _texture->setFilter( osg::Texture::MIN_FILTER, osg::Texture::LINEAR );
+    _texture->setFilter( osg::Texture::MIN_FILTER, image && image->isMipmap() ? osg::Texture::LINEAR_MIPMAP_LINEAR : osg::Texture::LINEAR );
+    _texture->setUseHardwareMipMapGeneration( false );
     _texture->setWrap( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
     _texture->setWrap( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE );
     _texture->setWrap( osg::Texture::WRAP_R, osg::Texture::CLAMP_TO_EDGE );
@@ -163,7 +164,9 @@ _tileLocator   ( rhs._tileLocator.get() ),
 _colorData     ( rhs._colorData ),
 _elevationData ( rhs._elevationData ),
 _sampleRatio   ( rhs._sampleRatio ),
-_parentStateSet( rhs._parentStateSet )
+_parentStateSet( rhs._parentStateSet ),
+_revision      ( rhs._revision ),
+_deferredLayers( rhs._deferredLayers )
 {
     //nop
 }
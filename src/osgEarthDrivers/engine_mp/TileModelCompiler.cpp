@@ -32,9 +32,13 @@
 #include <osg/Geometry>
 #include <osg/MatrixTransform>
 #include <osg/GL2Extensions>
+#include <osg/Texture2D>
 #include <osgUtil/DelaunayTriangulator>
 #include <osgUtil/Optimizer>
 
+#include <cstring>
+#include <sstream>
+
 using namespace osgEarth_engine_mp;
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
@@ -102,12 +106,13 @@ namespace
     struct MaskRecord
     {
         osg::ref_ptr<osg::Vec3dArray> _boundary;
+        osg::ref_ptr<osg::Vec3dArray> _tileBoundary;          // _boundary clipped near the tile
         osg::Vec3d                    _ndcMin, _ndcMax;
         MPGeometry*                   _geom;
         osg::ref_ptr<osg::Vec3Array>  _internal;
 
-        MaskRecord(osg::Vec3dArray* boundary, osg::Vec3d& ndcMin, osg::Vec3d& ndcMax, MPGeometry* geom) 
-            : _boundary(boundary), _ndcMin(ndcMin), _ndcMax(ndcMax), _geom(geom), _internal(new osg::Vec3Array()) { }
+        MaskRecord(osg::Vec3dArray* boundary, osg::Vec3dArray* tileBoundary, osg::Vec3d& ndcMin, osg::Vec3d& ndcMax, MPGeometry* geom) 
+            : _boundary(boundary), _tileBoundary(tileBoundary), _ndcMin(ndcMin), _ndcMax(ndcMax), _geom(geom), _internal(new osg::Vec3Array()) { }
     };
 
     typedef std::vector<MaskRecord> MaskRecordVector;
@@ -135,10 +140,12 @@ namespace
             textureImageUnit = 0;
             renderTileCoords = 0L;
             ownsTileCoords   = false;
+            arrayPool        = 0L;
         }
 
         bool                     useVBOs;
         int                      textureImageUnit;
+        ArrayPool*               arrayPool;                     // recycled per-vertex arrays
 
         const TileModel*              model;                   // the tile's data model
         osg::ref_ptr<const TileModel> parentModel;             // parent model reference
@@ -192,9 +199,6 @@ namespace
      */
     void setupMaskRecords( Data& d )
     {
-        // TODO: Set up the boundary sets globally in the TileModelCompiler instead of
-        // generating the boundaries every time for every tile.
-
         for (MaskLayerVector::const_iterator it = d.maskLayers.begin(); it != d.maskLayers.end(); ++it)
         {
           // When displaying Plate Carre, Heights have to be converted from meters to degrees.
@@ -206,7 +210,6 @@ namespace
             scale = d.scaleHeight / 111319.0f;
           }
 
-          // TODO: no need to do this for every tile right?
           osg::Vec3dArray* boundary = (*it)->getOrCreateBoundary(
               scale, 
               d.model->_tileLocator->getDataExtent().getSRS() );
@@ -249,7 +252,17 @@ namespace
                 MPGeometry* mask_geom = new MPGeometry( d.model->_map.get(), d.textureImageUnit );
                 mask_geom->setUseVertexBufferObjects(d.useVBOs);
                 d.surfaceGeode->addDrawable(mask_geom);
-                d.maskRecords.push_back( MaskRecord(boundary, min_ndc, max_ndc, mask_geom) );
+
+                // the part of the boundary near this tile, which the mask layer
+                // clips from the parent tile's part and caches.
+                osg::ref_ptr<osg::Vec3dArray> tileBoundary;
+                (*it)->getOrCreateBoundary(
+                    d.model->_tileKey,
+                    tileBoundary,
+                    scale,
+                    d.model->_tileLocator->getDataExtent().getSRS() );
+
+                d.maskRecords.push_back( MaskRecord(boundary, tileBoundary.get(), min_ndc, max_ndc, mask_geom) );
               }
            }
         }
@@ -312,16 +325,14 @@ namespace
         d.numVerticesInSkirt   = d.createSkirt ? (2 * (d.numCols*2 + d.numRows*2 - 4)) : 0;
 
         // allocate and assign vertices
-        d.surfaceVerts = new osg::Vec3Array();
-        d.surfaceVerts->reserve( d.numVerticesInSurface );
+        d.surfaceVerts = d.arrayPool->getVec3Array( d.numVerticesInSurface );
         d.surface->setVertexArray( d.surfaceVerts );
 
         if ( d.surfaceVerts->getVertexBufferObject() )
             d.surfaceVerts->getVertexBufferObject()->setUsage(GL_STATIC_DRAW_ARB);
 
         // allocate and assign normals
-        d.normals = new osg::Vec3Array();
-        d.normals->reserve( d.numVerticesInSurface );
+        d.normals = d.arrayPool->getVec3Array( d.numVerticesInSurface );
         d.surface->setNormalArray( d.normals );
         d.surface->setNormalBinding( osg::Geometry::BIND_PER_VERTEX );
 
@@ -333,22 +344,19 @@ namespace
 
         // vertex attribution
         // for each vertex, a vec4 containing a unit extrusion vector in [0..2] and the raw elevation in [3]
-        d.surfaceAttribs = new osg::Vec4Array();
-        d.surfaceAttribs->reserve( d.numVerticesInSurface );
+        d.surfaceAttribs = d.arrayPool->getVec4Array( d.numVerticesInSurface );
         d.surface->setVertexAttribArray( osg::Drawable::ATTRIBUTE_6, d.surfaceAttribs );
         d.surface->setVertexAttribBinding( osg::Drawable::ATTRIBUTE_6, osg::Geometry::BIND_PER_VERTEX );
         d.surface->setVertexAttribNormalize( osg::Drawable::ATTRIBUTE_6, false );
 
         // for each vertex, index 0 holds the interpolated elevation from the lower lod (for morphing)
-        d.surfaceAttribs2 = new osg::Vec4Array();
-        d.surfaceAttribs2->reserve( d.numVerticesInSurface );
+        d.surfaceAttribs2 = d.arrayPool->getVec4Array( d.numVerticesInSurface );
         d.surface->setVertexAttribArray( osg::Drawable::ATTRIBUTE_7, d.surfaceAttribs2 );
         d.surface->setVertexAttribBinding( osg::Drawable::ATTRIBUTE_7, osg::Geometry::BIND_PER_VERTEX );
         d.surface->setVertexAttribNormalize( osg::Drawable::ATTRIBUTE_7, false );
         
         // temporary data structures for triangulation support
-        d.elevations = new osg::FloatArray();
-        d.elevations->reserve( d.numVerticesInSurface );
+        d.elevations = d.arrayPool->getFloatArray( d.numVerticesInSurface );
         d.indices.resize( d.numVerticesInSurface, -1 );
     }
 
@@ -432,16 +440,14 @@ namespace
                 else
                 {
                     // cannot use the tex coord array cache if there are masking records.
-                    r._texCoords = new osg::Vec2Array();
-                    r._texCoords->reserve( d.numVerticesInSurface );
+                    r._texCoords = d.arrayPool->getVec2Array( d.numVerticesInSurface );
                     r._ownsTexCoords = true;
 
                     //r._tileCoords = new osg::Vec2Array();
                     //r._tileCoords->reserve( d.numVerticesInSurface );
                     //r._ownsTileCoords = true;
 
-                    r._skirtTexCoords = new osg::Vec2Array();
-                    r._skirtTexCoords->reserve( d.numVerticesInSkirt );
+                    r._skirtTexCoords = d.arrayPool->getVec2Array( d.numVerticesInSkirt );
                     r._ownsSkirtTexCoords = true;
 
                     if ( d.maskRecords.size() > 0 )
@@ -458,14 +464,13 @@ namespace
                     r._locator = locator->getGeographicFromGeocentric();
                 }
 
-                // install the parent color data layer if necessary.
-                if ( d.parentModel.valid() )
-                {
-                    d.parentModel->getColorData( r._layer.getUID(), r._layerParent );
-                }
-                else
+                // find the nearest ancestor holding this layer. Its texture is
+                // already resident, so blending only needs a scale/bias matrix into
+                // it. If there's none, the layer has no parent and doesn't blend.
+                osg::ref_ptr<const TileModel> ancestor = d.parentModel.get();
+                while( ancestor.valid() && !ancestor->getColorData(r._layer.getUID(), r._layerParent) )
                 {
-                    r._layerParent = r._layer;
+                    ancestor = ancestor->getParentTileModel();
                 }
 
                 d.renderLayers.push_back( r );
@@ -767,9 +772,11 @@ namespace
                     }
                 }
 
-                //Create local polygon representing mask
+                //Create local polygon representing mask. The clipped boundary has
+                //the same footprint within the tile and is usually far smaller.
+                osg::Vec3dArray* boundary = (*mr)._tileBoundary.valid() ? (*mr)._tileBoundary.get() : (*mr)._boundary.get();
                 osg::ref_ptr<Polygon> maskPoly = new Polygon();
-                for (osg::Vec3dArray::iterator it = (*mr)._boundary->begin(); it != (*mr)._boundary->end(); ++it)
+                for (osg::Vec3dArray::iterator it = boundary->begin(); it != boundary->end(); ++it)
                 {
                     osg::Vec3d local;
                     d.geoLocator->convertModelToLocal(*it, local);
@@ -797,7 +804,18 @@ namespace
 
                 //Crop the mask to the stitching poly (for case where mask crosses tile edge)
                 osg::ref_ptr<Geometry> maskCrop;
-                maskPoly->crop(maskSkirtPoly.get(), maskCrop);
+                if ( !maskPoly->crop(maskSkirtPoly.get(), maskCrop) && boundary != (*mr)._boundary.get() && !maskPoly->empty() )
+                {
+                    // the clip's zero-width edges can trip up the crop; fall back on the full boundary.
+                    maskPoly->clear();
+                    for (osg::Vec3dArray::iterator it = (*mr)._boundary->begin(); it != (*mr)._boundary->end(); ++it)
+                    {
+                        osg::Vec3d local;
+                        d.geoLocator->convertModelToLocal(*it, local);
+                        maskPoly->push_back(local);
+                    }
+                    maskPoly->crop(maskSkirtPoly.get(), maskCrop);
+                }
 
                 GeometryIterator i( maskCrop.get(), false );
                 while( i.hasMore() )
@@ -1010,7 +1028,7 @@ namespace
      * tile edges that hides the gap effect caused when you render two adjacent tiles at
      * different LODs.
      */
-    void createSkirtGeometry( Data& d, double skirtRatio )
+    void createSkirtGeometry( Data& d, double skirtRatio, bool gpu )
     {
         // surface normals will double as our skirt extrusion vectors
         osg::Vec3Array* skirtVectors = d.normals;
@@ -1018,16 +1036,20 @@ namespace
         // find the skirt height
         double skirtHeight = d.surfaceBound.radius() * skirtRatio;
 
-        // build the verts first:
-        osg::Vec3Array* skirtVerts = new osg::Vec3Array();
-        osg::Vec3Array* skirtNormals = new osg::Vec3Array();
-        osg::Vec4Array* skirtAttribs = new osg::Vec4Array();
-        osg::Vec4Array* skirtAttribs2 = new osg::Vec4Array();
+        // on the GPU path the bottom verts stay on the surface, flagged with a
+        // downward normal, and the vertex shader lowers them (see
+        // MPTerrainEngineNode::updateShaders). They need tile coordinates to
+        // sample the elevation texture.
+        double extrusion = gpu ? 0.0 : skirtHeight;
+        osg::Vec2Array* skirtTileCoords = gpu && d.renderTileCoords ? new osg::Vec2Array() : 0L;
+        if ( skirtTileCoords )
+            skirtTileCoords->reserve( d.numVerticesInSkirt );
 
-        skirtVerts->reserve( d.numVerticesInSkirt );
-        skirtNormals->reserve( d.numVerticesInSkirt );
-        skirtAttribs->reserve( d.numVerticesInSkirt );
-        skirtAttribs2->reserve( d.numVerticesInSkirt );
+        // build the verts first:
+        osg::Vec3Array* skirtVerts    = d.arrayPool->getVec3Array( d.numVerticesInSkirt );
+        osg::Vec3Array* skirtNormals  = d.arrayPool->getVec3Array( d.numVerticesInSkirt );
+        osg::Vec4Array* skirtAttribs  = d.arrayPool->getVec4Array( d.numVerticesInSkirt );
+        osg::Vec4Array* skirtAttribs2 = d.arrayPool->getVec4Array( d.numVerticesInSkirt );
 
         Indices skirtBreaks;
         skirtBreaks.reserve( d.numVerticesInSkirt );
@@ -1047,19 +1069,26 @@ namespace
             {
                 const osg::Vec3f& surfaceVert = (*d.surfaceVerts)[orig_i];
                 skirtVerts->push_back( surfaceVert );
-                skirtVerts->push_back( surfaceVert - ((*skirtVectors)[orig_i])*skirtHeight );
+                skirtVerts->push_back( surfaceVert - ((*skirtVectors)[orig_i])*extrusion );
 
                 const osg::Vec3f& surfaceNormal = (*d.normals)[orig_i];
                 skirtNormals->push_back( surfaceNormal );
-                skirtNormals->push_back( surfaceNormal );
+                skirtNormals->push_back( gpu ? -surfaceNormal : surfaceNormal );
+
+                if ( skirtTileCoords )
+                {
+                    const osg::Vec2& tc = (*d.renderTileCoords)[orig_i];
+                    skirtTileCoords->push_back( tc );
+                    skirtTileCoords->push_back( tc );
+                }
 
                 const osg::Vec4f& surfaceAttribs = (*d.surfaceAttribs)[orig_i];
                 skirtAttribs->push_back( surfaceAttribs );
-                skirtAttribs->push_back( surfaceAttribs - osg::Vec4f(0,0,0,skirtHeight) );
+                skirtAttribs->push_back( surfaceAttribs - osg::Vec4f(0,0,0,extrusion) );
 
                 const osg::Vec4f& surfaceAttribs2 = (*d.surfaceAttribs2)[orig_i];
                 skirtAttribs2->push_back( surfaceAttribs2 );
-                skirtAttribs2->push_back( surfaceAttribs2 - osg::Vec4f(0,0,0,skirtHeight) );
+                skirtAttribs2->push_back( surfaceAttribs2 - osg::Vec4f(0,0,0,extrusion) );
 
 
                 if ( d.renderLayers.size() > 0 )
@@ -1090,19 +1119,26 @@ namespace
             {
                 const osg::Vec3f& surfaceVert = (*d.surfaceVerts)[orig_i];
                 skirtVerts->push_back( surfaceVert );
-                skirtVerts->push_back( surfaceVert - ((*skirtVectors)[orig_i])*skirtHeight );
+                skirtVerts->push_back( surfaceVert - ((*skirtVectors)[orig_i])*extrusion );
 
                 const osg::Vec3f& surfaceNormal = (*d.normals)[orig_i];
                 skirtNormals->push_back( surfaceNormal );
-                skirtNormals->push_back( surfaceNormal );
+                skirtNormals->push_back( gpu ? -surfaceNormal : surfaceNormal );
+
+                if ( skirtTileCoords )
+                {
+                    const osg::Vec2& tc = (*d.renderTileCoords)[orig_i];
+                    skirtTileCoords->push_back( tc );
+                    skirtTileCoords->push_back( tc );
+                }
 
                 const osg::Vec4f& surfaceAttribs = (*d.surfaceAttribs)[orig_i];
                 skirtAttribs->push_back( surfaceAttribs );
-                skirtAttribs->push_back( surfaceAttribs - osg::Vec4f(0,0,0,skirtHeight) );
+                skirtAttribs->push_back( surfaceAttribs - osg::Vec4f(0,0,0,extrusion) );
 
                 const osg::Vec4f& surfaceAttribs2 = (*d.surfaceAttribs2)[orig_i];
                 skirtAttribs2->push_back( surfaceAttribs2 );
-                skirtAttribs2->push_back( surfaceAttribs2 - osg::Vec4f(0,0,0,skirtHeight) );
+                skirtAttribs2->push_back( surfaceAttribs2 - osg::Vec4f(0,0,0,extrusion) );
 
                 if ( d.renderLayers.size() > 0 )
                 {
@@ -1132,19 +1168,26 @@ namespace
             {
                 const osg::Vec3f& surfaceVert = (*d.surfaceVerts)[orig_i];
                 skirtVerts->push_back( surfaceVert );
-                skirtVerts->push_back( surfaceVert - ((*skirtVectors)[orig_i])*skirtHeight );
+                skirtVerts->push_back( surfaceVert - ((*skirtVectors)[orig_i])*extrusion );
 
                 const osg::Vec3f& surfaceNormal = (*d.normals)[orig_i];
                 skirtNormals->push_back( surfaceNormal );
-                skirtNormals->push_back( surfaceNormal );
+                skirtNormals->push_back( gpu ? -surfaceNormal : surfaceNormal );
+
+                if ( skirtTileCoords )
+                {
+                    const osg::Vec2& tc = (*d.renderTileCoords)[orig_i];
+                    skirtTileCoords->push_back( tc );
+                    skirtTileCoords->push_back( tc );
+                }
 
                 const osg::Vec4f& surfaceAttribs = (*d.surfaceAttribs)[orig_i];
                 skirtAttribs->push_back( surfaceAttribs );
-                skirtAttribs->push_back( surfaceAttribs - osg::Vec4f(0,0,0,skirtHeight) );
+                skirtAttribs->push_back( surfaceAttribs - osg::Vec4f(0,0,0,extrusion) );
 
                 const osg::Vec4f& surfaceAttribs2 = (*d.surfaceAttribs2)[orig_i];
                 skirtAttribs2->push_back( surfaceAttribs2 );
-                skirtAttribs2->push_back( surfaceAttribs2 - osg::Vec4f(0,0,0,skirtHeight) );
+                skirtAttribs2->push_back( surfaceAttribs2 - osg::Vec4f(0,0,0,extrusion) );
 
                 if ( d.renderLayers.size() > 0 )
                 {
@@ -1174,19 +1217,26 @@ namespace
             {
                 const osg::Vec3f& surfaceVert = (*d.surfaceVerts)[orig_i];
                 skirtVerts->push_back( surfaceVert );
-                skirtVerts->push_back( surfaceVert - ((*skirtVectors)[orig_i])*skirtHeight );
+                skirtVerts->push_back( surfaceVert - ((*skirtVectors)[orig_i])*extrusion );
 
                 const osg::Vec3f& surfaceNormal = (*d.normals)[orig_i];
                 skirtNormals->push_back( surfaceNormal );
-                skirtNormals->push_back( surfaceNormal );
+                skirtNormals->push_back( gpu ? -surfaceNormal : surfaceNormal );
+
+                if ( skirtTileCoords )
+                {
+                    const osg::Vec2& tc = (*d.renderTileCoords)[orig_i];
+                    skirtTileCoords->push_back( tc );
+                    skirtTileCoords->push_back( tc );
+                }
 
                 const osg::Vec4f& surfaceAttribs = (*d.surfaceAttribs)[orig_i];
                 skirtAttribs->push_back( surfaceAttribs );
-                skirtAttribs->push_back( surfaceAttribs - osg::Vec4f(0,0,0,skirtHeight) );
+                skirtAttribs->push_back( surfaceAttribs - osg::Vec4f(0,0,0,extrusion) );
 
                 const osg::Vec4f& surfaceAttribs2 = (*d.surfaceAttribs2)[orig_i];
                 skirtAttribs2->push_back( surfaceAttribs2 );
-                skirtAttribs2->push_back( surfaceAttribs2 - osg::Vec4f(0,0,0,skirtHeight) );
+                skirtAttribs2->push_back( surfaceAttribs2 - osg::Vec4f(0,0,0,extrusion) );
 
                 if ( d.renderLayers.size() > 0 )
                 {
@@ -1224,6 +1274,21 @@ namespace
         d.skirt->setVertexAttribBinding  (osg::Drawable::ATTRIBUTE_7, osg::Geometry::BIND_PER_VERTEX);
         d.skirt->setVertexAttribNormalize(osg::Drawable::ATTRIBUTE_7, false);
 
+        if ( gpu )
+        {
+            if ( skirtTileCoords )
+                d.skirt->_tileCoords = skirtTileCoords;
+
+            // count the lowered verts in the bounds, for culling.
+            osg::BoundingBox box;
+            for( unsigned i=1; i<skirtVerts->size(); i+=2 )
+            {
+                box.expandBy( (*skirtVerts)[i] );
+                box.expandBy( (*skirtVerts)[i] + (*skirtNormals)[i]*skirtHeight );
+            }
+            d.skirt->setInitialBound( box );
+        }
+
         // GW: not sure why this break stuff is here...?
 #if 0
         //Add a primative set for each continuous skirt strip
@@ -1241,23 +1306,86 @@ namespace
      * Builds triangles for the surface geometry, and recalculates the surface normals
      * to be optimized for slope.
      */
-    void tessellateSurfaceGeometry( Data& d, bool optimizeTriangleOrientation, bool normalizeEdges )
+    void tessellateSurfaceGeometry( Data& d, bool optimizeTriangleOrientation, bool normalizeEdges, CompilerCache& cache )
     {    
         bool swapOrientation = !(d.model->_tileLocator->orientationOpenGL());
 
         bool recalcNormals   = d.model->hasElevation(); //d.model->_elevationData.getHFLayer() != 0L;
 
-        osg::DrawElements* elements;
+        // A tile with no masks and no missing heights has one vertex per grid
+        // post, in grid order, so its triangulation depends only on the grid size,
+        // the orientation and which diagonal each quad uses. Such tiles can share
+        // a single index buffer.
+        bool shareable =
+            d.maskRecords.empty() &&
+            d.surfaceVerts->size() == d.numRows * d.numCols;
+
+        std::string elementsKey;
+        if ( shareable )
+        {
+            std::stringstream buf;
+            buf << d.numCols << "x" << d.numRows << (swapOrientation ? "s" : "n") << ":";
+            elementsKey = buf.str();
+
+            if ( optimizeTriangleOrientation )
+            {
+                // one bit per quad: set when the quad is split along its 01-10 diagonal.
+                std::string pattern( ((d.numRows-1) * (d.numCols-1) + 7) / 8, '\0' );
+                unsigned q = 0;
+                for(unsigned j=0; j<d.numRows-1; ++j)
+                {
+                    for(unsigned i=0; i<d.numCols-1; ++i, ++q)
+                    {
+                        int i00 = swapOrientation ? (j+1)*d.numCols + i : j*d.numCols + i;
+                        int i01 = swapOrientation ? j*d.numCols + i     : i00 + d.numCols;
+                        int i10 = i00+1;
+                        int i11 = i01+1;
+
+                        float e00 = (*d.elevations)[i00];
+                        float e10 = (*d.elevations)[i10];
+                        float e01 = (*d.elevations)[i01];
+                        float e11 = (*d.elevations)[i11];
+
+                        if ( !(fabsf(e00-e11)<fabsf(e01-e10)) )
+                            pattern[q >> 3] |= (char)(1 << (q & 7));
+                    }
+                }
+                elementsKey += pattern;
+            }
+        }
+
+        // reuse a cached index buffer if there is one; in that case the loop
+        // below only accumulates the normals.
+        osg::DrawElements* elements = 0L;
 
-        if ( d.surfaceVerts->size() < 0xFF )
-            elements = new osg::DrawElementsUByte(GL_TRIANGLES);
-        else if ( d.surfaceVerts->size() < 0xFFFF )
-            elements = new osg::DrawElementsUShort(GL_TRIANGLES);
+        CompilerCache::SurfaceElementsCache::Record record;
+        if ( shareable && cache._surfaceElements.get(elementsKey, record) )
+        {
+            d.surface->addPrimitiveSet( record.value().get() );
+        }
         else
-            elements = new osg::DrawElementsUShort(GL_TRIANGLES);
+        {
+            if ( d.surfaceVerts->size() < 0xFF )
+                elements = new osg::DrawElementsUByte(GL_TRIANGLES);
+            else if ( d.surfaceVerts->size() < 0xFFFF )
+                elements = new osg::DrawElementsUShort(GL_TRIANGLES);
+            else
+                elements = new osg::DrawElementsUShort(GL_TRIANGLES);
 
-        elements->reserveElements((d.numRows-1) * (d.numCols-1) * 6);
-        d.surface->addPrimitiveSet( elements );
+            elements->reserveElements((d.numRows-1) * (d.numCols-1) * 6);
+
+            if ( shareable )
+            {
+                // Note: anything in the cache must have its own buffer object. No sharing!
+                if ( d.useVBOs )
+                    elements->setElementBufferObject( new osg::ElementBufferObject() );
+                cache._surfaceElements.insert( elementsKey, elements );
+            }
+
+            d.surface->addPrimitiveSet( elements );
+        }
+
+        bool walkQuads = elements != 0L || recalcNormals;
 
         if ( recalcNormals )
         {
@@ -1268,7 +1396,7 @@ namespace
             }
         }
 
-        for(unsigned j=0; j<d.numRows-1; ++j)
+        for(unsigned j=0; walkQuads && j<d.numRows-1; ++j)
         {
             for(unsigned i=0; i<d.numCols-1; ++i)
             {
@@ -1331,13 +1459,16 @@ namespace
 
                         if (!optimizeTriangleOrientation || fabsf(e00-e11)<fabsf(e01-e10))
                         {
-                            elements->addElement(i01);
-                            elements->addElement(i00);
-                            elements->addElement(i11);
+                            if ( elements )
+                            {
+                                elements->addElement(i01);
+                                elements->addElement(i00);
+                                elements->addElement(i11);
 
-                            elements->addElement(i00);
-                            elements->addElement(i10);
-                            elements->addElement(i11);
+                                elements->addElement(i00);
+                                elements->addElement(i10);
+                                elements->addElement(i11);
+                            }
 
                             if (recalcNormals)
                             {                        
@@ -1354,13 +1485,16 @@ namespace
                         }
                         else
                         {
-                            elements->addElement(i01);
-                            elements->addElement(i00);
-                            elements->addElement(i10);
+                            if ( elements )
+                            {
+                                elements->addElement(i01);
+                                elements->addElement(i00);
+                                elements->addElement(i10);
 
-                            elements->addElement(i01);
-                            elements->addElement(i10);
-                            elements->addElement(i11);
+                                elements->addElement(i01);
+                                elements->addElement(i10);
+                                elements->addElement(i11);
+                            }
 
                             if (recalcNormals)
                             {                       
@@ -1822,6 +1956,108 @@ namespace
     }
 
 
+    // uploads the tile's heightfield as a float texture for shader effects
+    // (see TerrainEngineNode::requireElevationTextures). With "border", the
+    // texture gets a one-sample border from the neighboring tiles (extrapolated
+    // where there is no neighbor), so that gradients at the edges agree with
+    // the neighbors'.
+    void installElevationTexture( Data& d, TileNode* tile, int unit, bool border )
+    {
+        osg::HeightField* hf        = d.model->_elevationData.getHeightField();
+        GeoLocator*       hfLocator = d.model->_elevationData.getLocator();
+        if ( !hf || !hfLocator || hf->getNumColumns() < 2 || hf->getNumRows() < 2 )
+            return;
+
+        unsigned cols = hf->getNumColumns();
+        unsigned rows = hf->getNumRows();
+        unsigned b    = border ? 1 : 0;
+        unsigned texCols = cols + 2*b;
+        unsigned texRows = rows + 2*b;
+
+        osg::Image* image = new osg::Image();
+        image->allocateImage( texCols, texRows, 1, GL_LUMINANCE, GL_FLOAT );
+        image->setInternalTextureFormat( GL_LUMINANCE32F_ARB );
+
+        if ( !border )
+        {
+            ::memcpy( image->data(), &hf->getFloatArray()->front(), cols*rows*sizeof(float) );
+        }
+        else
+        {
+            float* out = (float*)image->data();
+            for( unsigned r=0; r<rows; ++r )
+                ::memcpy( &out[(r+1)*texCols + 1], &hf->getFloatArray()->at(r*cols), cols*sizeof(float) );
+
+            // neighbors share the edge samples, so the border comes from the
+            // second sample in. Only usable when the tile holds its own grid
+            // (i.e. it isn't a parent's grid being upsampled).
+            bool ownGrid = hfLocator->getDataExtent() == d.model->_tileKey.getExtent();
+            osg::HeightField* w = ownGrid ? d.model->_elevationData.getNeighbor( -1, 0 ) : 0L;
+            osg::HeightField* e = ownGrid ? d.model->_elevationData.getNeighbor(  1, 0 ) : 0L;
+            osg::HeightField* s = ownGrid ? d.model->_elevationData.getNeighbor(  0, 1 ) : 0L;
+            osg::HeightField* n = ownGrid ? d.model->_elevationData.getNeighbor(  0,-1 ) : 0L;
+            if ( w && (w->getNumColumns() != cols || w->getNumRows() != rows) ) w = 0L;
+            if ( e && (e->getNumColumns() != cols || e->getNumRows() != rows) ) e = 0L;
+            if ( s && (s->getNumColumns() != cols || s->getNumRows() != rows) ) s = 0L;
+            if ( n && (n->getNumColumns() != cols || n->getNumRows() != rows) ) n = 0L;
+
+            for( unsigned r=0; r<rows; ++r )
+            {
+                out[(r+1)*texCols] =
+                    w ? w->getHeight(cols-2, r) : 2.0f*hf->getHeight(0, r) - hf->getHeight(1, r);
+                out[(r+1)*texCols + texCols-1] =
+                    e ? e->getHeight(1, r) : 2.0f*hf->getHeight(cols-1, r) - hf->getHeight(cols-2, r);
+            }
+            for( unsigned c=0; c<cols; ++c )
+            {
+                out[c+1] =
+                    s ? s->getHeight(c, rows-2) : 2.0f*hf->getHeight(c, 0) - hf->getHeight(c, 1);
+                out[(texRows-1)*texCols + c+1] =
+                    n ? n->getHeight(c, 1) : 2.0f*hf->getHeight(c, rows-1) - hf->getHeight(c, rows-2);
+            }
+
+            // corners are never sampled on their own; keep them continuous.
+            unsigned top = (texRows-1)*texCols;
+            out[0]             = out[1]           + out[texCols]       - out[texCols+1];
+            out[texCols-1]     = out[texCols-2]   + out[2*texCols-1]   - out[2*texCols-2];
+            out[top]           = out[top+1]       + out[top-texCols]   - out[top-texCols+1];
+            out[top+texCols-1] = out[top+texCols-2] + out[top-1]       - out[top-2];
+        }
+
+        osg::Texture2D* tex = new osg::Texture2D( image );
+        tex->setFilter( osg::Texture::MIN_FILTER, osg::Texture::LINEAR );
+        tex->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
+        tex->setWrap( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
+        tex->setWrap( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE );
+        tex->setResizeNonPowerOfTwoHint( false );
+        tex->setUnRefImageDataAfterApply( true );
+
+        // unit tile coordinates -> heightfield coordinates (an upsampled tile
+        // still holds its parent's grid), then onto the texel centers.
+        osg::Matrixd texMat;
+        hfLocator->createScaleBiasMatrix( d.model->_tileLocator->getDataExtent(), texMat );
+        texMat.postMult( osg::Matrixd::scale( (cols-1)/(double)texCols, (rows-1)/(double)texRows, 1.0 ) );
+        texMat.postMult( osg::Matrixd::translate( (b+0.5)/(double)texCols, (b+0.5)/(double)texRows, 0.0 ) );
+
+        // sample spacing in meters, for gradients.
+        const GeoExtent& ex = hfLocator->getDataExtent();
+        double dx = ex.width()  / (double)(cols-1);
+        double dy = ex.height() / (double)(rows-1);
+        if ( ex.getSRS()->isGeographic() )
+        {
+            double metersPerDegree = ex.getSRS()->getEllipsoid()->getRadiusEquator() * osg::PI / 180.0;
+            dy *= metersPerDegree;
+            dx *= metersPerDegree * cos( osg::DegreesToRadians(d.model->_tileKey.getExtent().yMin() + 0.5*d.model->_tileKey.getExtent().height()) );
+        }
+
+        osg::StateSet* stateset = tile->getOrCreateStateSet();
+        stateset->setTextureAttribute( unit, tex );
+        stateset->getOrCreateUniform( "oe_terrain_tex_matrix", osg::Uniform::FLOAT_MAT4 )->set( osg::Matrixf(texMat) );
+        stateset->getOrCreateUniform( "oe_terrain_tex_size", osg::Uniform::FLOAT_VEC4 )->set(
+            osg::Vec4f( (float)texCols, (float)texRows, (float)dx, (float)dy ) );
+    }
+
+
     struct CullByTraversalMask : public osg::Drawable::CullCallback
     {
         CullByTraversalMask( unsigned mask ) : _mask(mask) { }
@@ -1839,23 +2075,37 @@ namespace
 TileModelCompiler::TileModelCompiler(const MaskLayerVector&              masks,
                                      int                                 texImageUnit,
                                      bool                                optimizeTriOrientation,
-                                     const MPTerrainEngineOptions& options) :
+                                     const MPTerrainEngineOptions& options,
+                                     ArrayPool*                          arrayPool,
+                                     EngineStats*                        stats) :
 _masks                 ( masks ),
 _optimizeTriOrientation( optimizeTriOrientation ),
 _options               ( options ),
-_textureImageUnit      ( texImageUnit )
+_textureImageUnit      ( texImageUnit ),
+_arrayPool             ( arrayPool ),
+_stats                 ( stats )
 {
     _cullByTraversalMask = new CullByTraversalMask(*options.secondaryTraversalMask());
+
+    // shared by all skirts, so the vertex shader can tell them from the surface.
+    if ( options.gpuEdges() == true )
+    {
+        _gpuSkirtStateSet = new osg::StateSet();
+        _gpuSkirtStateSet->getOrCreateUniform( "oe_mp_skirt", osg::Uniform::BOOL )->set( true );
+    }
 }
 
 
 TileNode*
 TileModelCompiler::compile(const TileModel* model)
 {
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
     TileNode* tile = new TileNode( model->_tileKey, model );
 
     // Working data for the build.
     Data d(model, _masks);
+    d.arrayPool = _arrayPool.get();
 
     d.parentModel = model->getParentTileModel();
     d.scaleHeight = *_options.verticalScale();    
@@ -1867,6 +2117,7 @@ TileModelCompiler::compile(const TileModel* model)
     // A Geode/Geometry for the surface:
     d.surface = new MPGeometry( model->_map.get(), _textureImageUnit );
     d.surface->setUseVertexBufferObjects(d.useVBOs);
+    d.surface->setArrayPool( _arrayPool.get() );
     d.surfaceGeode = new osg::Geode();
     d.surfaceGeode->addDrawable( d.surface );
     d.surfaceGeode->setNodeMask( *_options.primaryTraversalMask() );
@@ -1882,6 +2133,7 @@ TileModelCompiler::compile(const TileModel* model)
     {
         d.skirt = new MPGeometry( model->_map.get(), _textureImageUnit );
         d.skirt->setUseVertexBufferObjects(d.useVBOs);
+        d.skirt->setArrayPool( _arrayPool.get() );
 
         // slightly faster than a separate geode:
         //d.skirt->setDataVariance( osg::Object::DYNAMIC ); // since we're using a custom cull callback
@@ -1918,11 +2170,22 @@ TileModelCompiler::compile(const TileModel* model)
         createMaskGeometry( d );
 
     // build the skirts.
+    bool gpuEdges = _options.gpuEdges() == true;
     if ( d.createSkirt )
-        createSkirtGeometry( d, *_options.heightFieldSkirtRatio() );
+    {
+        createSkirtGeometry( d, *_options.heightFieldSkirtRatio(), gpuEdges );
 
-    // tesselate the surface verts into triangles.
-    tessellateSurfaceGeometry( d, _optimizeTriOrientation, *_options.normalizeEdges() );
+        if ( gpuEdges )
+        {
+            d.skirt->setStateSet( _gpuSkirtStateSet.get() );
+            tile->getOrCreateStateSet()->getOrCreateUniform( "oe_mp_skirt_height", osg::Uniform::FLOAT )->set(
+                (float)(d.surfaceBound.radius() * *_options.heightFieldSkirtRatio()) );
+        }
+    }
+
+    // tesselate the surface verts into triangles. The GPU normals don't need
+    // the edges normalized.
+    tessellateSurfaceGeometry( d, _optimizeTriOrientation, *_options.normalizeEdges() && !gpuEdges, _cache );
 
     // installs the per-layer rendering data into the Geometry objects.
     installRenderData( d );
@@ -1946,6 +2209,24 @@ TileModelCompiler::compile(const TileModel* model)
         MeshConsolidator::convertToTriangles( *((*mr)._geom) );
     }
     
+    // switch to the compact vertex layout if requested. The mask and stitching
+    // geometries keep the full layout.
+    if ( _options.compactVertices() == true )
+    {
+        d.surface->compactVertices();
+        if ( d.skirt )
+            d.skirt->compactVertices();
+    }
+
+    // the elevation scratch array goes straight back to the pool.
+    _arrayPool->recycle( d.elevations.get() );
+
+    // per-tile elevation texture, if an effect asked for them.
+    if ( _options.elevationTextureUnit().isSet() && model->hasElevation() )
+    {
+        installElevationTexture( d, tile, *_options.elevationTextureUnit(), gpuEdges );
+    }
+
     if (osgDB::Registry::instance()->getBuildKdTreesHint()==osgDB::ReaderWriter::Options::BUILD_KDTREES &&
         osgDB::Registry::instance()->getKdTreeBuilder())
     {            
@@ -1953,5 +2234,8 @@ TileModelCompiler::compile(const TileModel* model)
         tile->accept(*builder);
     }
 
+    if ( _stats.valid() )
+        _stats->record( EngineStats::STAGE_COMPILE, start );
+
     return tile;
 }
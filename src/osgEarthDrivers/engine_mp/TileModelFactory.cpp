@@ -21,6 +21,13 @@
 #include <osgEarth/MapInfo>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/HeightFieldUtils>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/BakedTile>
+#include <osgEarth/Registry>
+#include <osgEarth/CachePolicy>
+#include <osg/BufferObject>
+#include <osgDB/Registry>
+#include <sstream>
 
 using namespace osgEarth_engine_mp;
 using namespace osgEarth;
@@ -33,6 +40,37 @@ using namespace OpenThreads;
 
 namespace
 {
+    // Readies a tile image for upload, on the loading thread.
+    void prepareImage( osg::Image* image, const MPTerrainEngineOptions& opt )
+    {
+        // convert the image to PMA. This must be done in the CPU; for some
+        // reason (which we could not determine) it fails to try this after the
+        // texture lookup in the shader. Compressed images are left alone.
+        if ( opt.premultipliedAlpha() == true && !ImageUtils::isCompressed(image) )
+        {
+            ImageUtils::convertToPremultipliedAlpha( image );
+        }
+
+        // build the mip chain here so the draw thread doesn't have to.
+        if ( opt.mipmaps() == true && !ImageUtils::isCompressed(image) )
+        {
+            ImageUtils::generateMipmaps(
+                image,
+                *opt.mipmapFilter(),
+                *opt.mipmapGammaCorrect() );
+        }
+
+        // stage the texels in a pixel buffer object. The GL copies them into
+        // the PBO when the texture compiles, and the texture upload that
+        // follows is an asynchronous transfer out of the PBO instead of a
+        // copy out of client memory that blocks the draw thread. The PBO
+        // goes away with the image once the texture has applied it.
+        if ( opt.pixelBufferUploads() == true && !image->getPixelBufferObject() )
+        {
+            image->setPixelBufferObject( new osg::PixelBufferObject(image) );
+        }
+    }
+
     struct BuildColorData
     {
         void init( const TileKey&                      key, 
@@ -117,13 +155,7 @@ namespace
                 else
                     locator = GeoLocator::createForExtent(geoImage.getExtent(), *_mapInfo);
 
-                // convert the image to PMA. This must be done in the CPU; for some
-                // reason (which we could not determine) it fails to try this after the
-                // texture lookup in the shader.
-                if ( _opt->premultipliedAlpha() == true )
-                {
-                    ImageUtils::convertToPremultipliedAlpha( geoImage.getImage() );
-                }
+                prepareImage( geoImage.getImage(), *_opt );
 
                 // add the color layer to the repo.
                 _model->_colorData[_layer->getUID()] = TileModel::ColorData(
@@ -150,6 +182,63 @@ namespace
         TileModel*     _model;
         const MPTerrainEngineOptions* _opt;
     };
+
+    // Counts down the parallel image layer fetches of one tile. Fetches that
+    // miss the deadline keep a reference, so it outlives the waiting thread.
+    struct FetchLatch : public osg::Referenced
+    {
+        FetchLatch( int num ) : _event( num ) { }
+        Threading::MultiEvent _event;
+    };
+
+    // Fetches one image layer into a private scratch model, so that the
+    // layers of a tile can load at the same time. Holds copies of everything
+    // it needs, since the requesting thread may stop waiting for it.
+    struct FetchColorData : public TaskRequest
+    {
+        FetchColorData(const TileKey&                key,
+                       ImageLayer*                   layer,
+                       const MapInfo&                mapInfo,
+                       const MPTerrainEngineOptions& opt,
+                       FetchLatch*                   latch ) :
+            _key     ( key ),
+            _layer   ( layer ),
+            _mapInfo ( mapInfo ),
+            _opt     ( &opt ),
+            _model   ( new TileModel() ),
+            _ok      ( false ),
+            _latch   ( latch ) { }
+
+        void operator()( ProgressCallback* progress )
+        {
+            BuildColorData build;
+            build.init( _key, _layer.get(), 0, _mapInfo, *_opt, _model.get() );
+            _ok = build.execute();
+            _done.set();
+            _latch->_event.notify();
+        }
+
+        // whether the fetch finished. Waiting on the (set) event synchronizes
+        // with the fetching thread before the caller reads the results.
+        bool isDone()
+        {
+            return _done.isSet() && _done.wait();
+        }
+
+        bool getColorData( TileModel::ColorData& out ) const
+        {
+            return _ok && _model->getColorData( _layer->getUID(), out );
+        }
+
+        TileKey                       _key;
+        osg::ref_ptr<ImageLayer>      _layer;
+        MapInfo                       _mapInfo;
+        const MPTerrainEngineOptions* _opt;
+        osg::ref_ptr<TileModel>       _model;
+        bool                          _ok;
+        Threading::Event              _done;
+        osg::ref_ptr<FetchLatch>      _latch;
+    };
 }
 
 //------------------------------------------------------------------------
@@ -178,7 +267,7 @@ namespace
             bool isFallback = false;
 
             //if ( _mapf->getHeightField( _key, true, hf, &isFallback ) )
-            if (_hfCache->getOrCreateHeightField( *_mapf, _key, true, hf, &isFallback) )
+            if (getHeightField( _key, hf, isFallback ) )
             {
 #if 0
                 // Put it in the repo
@@ -196,7 +285,7 @@ namespace
 #endif
 
 #if 1
-                if ( *_opt->normalizeEdges() )
+                if ( *_opt->normalizeEdges() || *_opt->gpuEdges() )
 #endif
                 {
                     // next, query the neighboring tiles to get adjacency information.
@@ -209,13 +298,8 @@ namespace
                                 TileKey nk = _key.createNeighborKey(x, y);
                                 if ( nk.valid() )
                                 {
-                                    if (_hfCache->getOrCreateHeightField( *_mapf, nk, true, hf, &isFallback) )
+                                    if (getHeightField( nk, hf, isFallback ) )
                                     {
-                                        if ( mapInfo.isPlateCarre() )
-                                        {
-                                            HeightFieldUtils::scaleHeightFieldToDegrees( hf.get() );
-                                        }
-
                                         _model->_elevationData.setNeighbor( x, y, hf.get() );
                                     }
                                 }
@@ -226,13 +310,8 @@ namespace
                     // parent too.
                     if ( _key.getLOD() > 0 )
                     {
-                        if ( _hfCache->getOrCreateHeightField( *_mapf, _key.createParentKey(), true, hf, &isFallback) )
+                        if ( getHeightField( _key.createParentKey(), hf, isFallback ) )
                         {
-                            if ( mapInfo.isPlateCarre() )
-                            {
-                                HeightFieldUtils::scaleHeightFieldToDegrees( hf.get() );
-                            }
-
                             _model->_elevationData.setParent( hf.get() );
                         }
                     }
@@ -240,6 +319,21 @@ namespace
             }
         }
 
+        // Fetches a heightfield through the map's shared cache. Plate Carre maps
+        // scale the heights, so they get a private copy to scale.
+        bool getHeightField( const TileKey& key, osg::ref_ptr<osg::HeightField>& out_hf, bool& out_isFallback )
+        {
+            if ( !_hfCache->getOrCreateHeightField(*_mapf, key, true, out_hf, &out_isFallback) )
+                return false;
+
+            if ( _mapf->getMapInfo().isPlateCarre() )
+            {
+                out_hf = new osg::HeightField( *out_hf.get(), osg::CopyOp::DEEP_COPY_ALL );
+                HeightFieldUtils::scaleHeightFieldToDegrees( out_hf.get() );
+            }
+            return true;
+        }
+
         TileKey                  _key;
         const MapFrame*          _mapf;
         const MPTerrainEngineOptions* _opt;
@@ -252,18 +346,59 @@ namespace
 
 TileModelFactory::TileModelFactory(const Map*                          map, 
                                    TileNodeRegistry*                   liveTiles,
-                                   const MPTerrainEngineOptions& terrainOptions ) :
+                                   const MPTerrainEngineOptions& terrainOptions,
+                                   EngineStats*                  stats ) :
 _map           ( map ),
 _liveTiles     ( liveTiles ),
-_terrainOptions( terrainOptions )
+_terrainOptions( terrainOptions ),
+_prefetched    ( true, 64 ),
+_stats         ( stats ),
+_lateFetches   ( true, 256 ),
+_bakedHFs      ( true, 64 )
 {
-    _hfCache = new HeightFieldCache();
+    _hfCache = map->getHeightFieldCache();
+
+    // tiles baked offline, which stand in for the map's layers where present:
+    if ( terrainOptions.bakedTiles().isSet() )
+    {
+        const std::string& path = terrainOptions.bakedTiles()->full();
+        osg::ref_ptr<CacheBundle> bundle = new CacheBundle( path );
+        osg::ref_ptr<const Profile> bakedProfile;
+
+        Config meta = bundle->isOpen() ? bundle->getMetadata( BakedTile::BIN_ID ) : Config();
+        if ( meta.hasChild("profile") )
+            bakedProfile = Profile::create( ProfileOptions(meta.child("profile")) );
+
+        if ( !bundle->isOpen() )
+        {
+            OE_WARN << LC << "Failed to open baked tiles \"" << path << "\"" << std::endl;
+        }
+        else if ( !bakedProfile.valid() || !bakedProfile->isHorizEquivalentTo(map->getProfile()) )
+        {
+            OE_WARN << LC << "Baked tiles \"" << path << "\" do not match the map profile; ignoring them" << std::endl;
+        }
+        else
+        {
+            _baked          = bundle.get();
+            _bakedRW        = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+            _bakedRWOptions = Registry::instance()->cloneOrCreateOptions();
+            CachePolicy::NO_CACHE.apply( _bakedRWOptions.get() );
+            OE_INFO << LC << "Using " << bundle->getNumRecords() << " baked tiles from \"" << path << "\"" << std::endl;
+        }
+    }
+
+    // in parallel mode, the layers of a tile load concurrently:
+    if ( terrainOptions.loadingPolicy()->mode() == LoadingPolicy::MODE_PARALLEL )
+    {
+        int num = computeLoadingThreads( terrainOptions.loadingPolicy().get() );
+        _fetchService = new TaskService( "MP layer fetch", osg::maximum(num, 1) );
+    }
 }
 
 HeightFieldCache*
 TileModelFactory::getHeightFieldCache() const
 {
-    return _hfCache;
+    return _hfCache.get();
 }
 
 
@@ -273,43 +408,129 @@ TileModelFactory::createTileModel(const TileKey&           key,
                                   bool&                    out_hasRealData)
 {
     MapFrame mapf( _map, Map::MASKED_TERRAIN_LAYERS );
-    
+
+    osg::ref_ptr<TileModel> model;
+    out_hasRealData = false;
+
+    // use a model that was built ahead of time, as long as the map has not
+    // changed since.
+    LRUCache<TileKey,PrefetchedModel>::Record rec;
+    if ( _prefetched.get(key, rec) )
+    {
+        _prefetched.erase( key );
+        if ( rec.value()._model->_revision == mapf.getRevision() )
+        {
+            model           = rec.value()._model.get();
+            out_hasRealData = rec.value()._hasRealData;
+        }
+    }
+
+    if ( !model.valid() )
+    {
+        buildTileModel( mapf, key, model, out_hasRealData );
+        if ( !model.valid() )
+            return;
+    }
+
+    // look up the parent model and cache it.
+    osg::ref_ptr<TileNode> parentTile;
+    if ( _liveTiles->get(key.createParentKey(), parentTile) )
+        model->_parentModel = parentTile->getTileModel();
+
+    out_model = model.release();
+}
+
+
+void
+TileModelFactory::prefetchTileModel(const TileKey& key)
+{
+    // nothing to do if the tile is already built or waiting.
+    osg::ref_ptr<TileNode> tile;
+    if ( _prefetched.has(key) || _liveTiles->get(key, tile) )
+        return;
+
+    MapFrame mapf( _map, Map::MASKED_TERRAIN_LAYERS );
+
+    PrefetchedModel entry;
+    buildTileModel( mapf, key, entry._model, entry._hasRealData );
+    if ( entry._model.valid() )
+    {
+        _prefetched.insert( key, entry );
+    }
+}
+
+
+bool
+TileModelFactory::isPrefetched(const TileKey& key) const
+{
+    return _prefetched.has( key );
+}
+
+
+void
+TileModelFactory::buildTileModel(const MapFrame&          mapf,
+                                 const TileKey&           key,
+                                 osg::ref_ptr<TileModel>& out_model,
+                                 bool&                    out_hasRealData)
+{
     const MapInfo& mapInfo = mapf.getMapInfo();
 
     osg::ref_ptr<TileModel> model = new TileModel();
     model->_map         = _map;
     model->_tileKey     = key;
     model->_tileLocator = GeoLocator::createForKey(key, mapInfo);
+    model->_revision    = mapf.getRevision();
 
     // init this to false, then search for real data. "Real data" is data corresponding
     // directly to the key, as opposed to fallback data, which is derived from a lower
     // LOD key.
     out_hasRealData = false;
     
-    // Fetch the image data and make color layers.
-    unsigned order = 0;
-    for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); ++i )
+    if ( _baked.valid() && readBakedTileModel(mapf, key, model.get()) )
     {
-        ImageLayer* layer = i->get();
-
-        if ( layer->getEnabled() )
+        // baked offline; nothing to fetch.
+    }
+    else if ( _fetchService.valid() )
+    {
+        // image layers load on the fetch service while this thread builds
+        // the elevation data.
+        fetchColorData( mapf, key, model.get() );
+    }
+    else
+    {
+        // Fetch the image data and make color layers.
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        unsigned order = 0;
+        for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); ++i )
         {
-            BuildColorData build;
-            build.init( key, layer, order, mapInfo, _terrainOptions, model.get() );
-            
-            bool addedToModel = build.execute();
-            if ( addedToModel )
+            ImageLayer* layer = i->get();
+
+            if ( layer->getEnabled() )
             {
-                // only bump the order if we added something to the data model.
-                order++;
+                BuildColorData build;
+                build.init( key, layer, order, mapInfo, _terrainOptions, model.get() );
+                
+                bool addedToModel = build.execute();
+                if ( addedToModel )
+                {
+                    // only bump the order if we added something to the data model.
+                    order++;
+                }
             }
         }
-    }
 
-    // make an elevation layer.
-    BuildElevationData build;
-    build.init( key, mapf, _terrainOptions, model.get(), _hfCache );
-    build.execute();
+        if ( _stats.valid() )
+            _stats->record( EngineStats::STAGE_DATA_FETCH, start );
+
+        // make an elevation layer.
+        start = osg::Timer::instance()->tick();
+        BuildElevationData build;
+        build.init( key, mapf, _terrainOptions, model.get(), _hfCache );
+        build.execute();
+
+        if ( _stats.valid() )
+            _stats->record( EngineStats::STAGE_HEIGHTFIELD, start );
+    }
 
 
     // Bail out now if there's no data to be had.
@@ -346,10 +567,282 @@ TileModelFactory::createTileModel(const TileKey&           key,
         out_hasRealData = true;
     }
 
-    // look up the parent model and cache it.
+    out_model = model.release();
+}
+
+
+BakedTile*
+TileModelFactory::readBakedTile(const TileKey& key) const
+{
+    if ( !_baked.valid() || !_bakedRW.valid() )
+        return 0L;
+
+    CacheBundle::Type type;
+    std::string       meta, data;
+    ::time_t          timestamp;
+    if ( !_baked->read(BakedTile::BIN_ID, key.str(), type, meta, data, timestamp) || type != CacheBundle::TYPE_NODE )
+        return 0L;
+
+    std::istringstream in( data );
+    osgDB::ReaderWriter::ReadResult r = _bakedRW->readNode( in, _bakedRWOptions.get() );
+    if ( !r.success() )
+    {
+        OE_WARN << LC << "Failed to read baked tile " << key.str() << std::endl;
+        return 0L;
+    }
+
+    return BakedTile::fromNode( key, r.getNode() );
+}
+
+
+bool
+TileModelFactory::getBakedHeightField(const MapFrame&                 mapf,
+                                      const TileKey&                  key,
+                                      osg::ref_ptr<osg::HeightField>& out_hf,
+                                      bool&                           out_isFallback)
+{
+    LRUCache<TileKey, BakedHeightField>::Record rec;
+    if ( _bakedHFs.get(key, rec) )
+    {
+        out_hf         = rec.value()._hf.get();
+        out_isFallback = rec.value()._isFallback;
+    }
+    else
+    {
+        osg::ref_ptr<BakedTile> baked = readBakedTile( key );
+        if ( baked.valid() && baked->getHeightField() )
+        {
+            out_hf         = baked->getHeightField();
+            out_isFallback = baked->isHeightFieldFallback();
+        }
+
+        // outside the baked area, use the map's elevation layers.
+        else if ( !_hfCache->getOrCreateHeightField(mapf, key, true, out_hf, &out_isFallback) )
+        {
+            return false;
+        }
+
+        BakedHeightField entry;
+        entry._hf         = out_hf.get();
+        entry._isFallback = out_isFallback;
+        _bakedHFs.insert( key, entry );
+    }
+
+    // Plate Carre maps scale the heights, so they get a private copy to scale.
+    if ( mapf.getMapInfo().isPlateCarre() )
+    {
+        out_hf = new osg::HeightField( *out_hf.get(), osg::CopyOp::DEEP_COPY_ALL );
+        HeightFieldUtils::scaleHeightFieldToDegrees( out_hf.get() );
+    }
+    return true;
+}
+
+
+bool
+TileModelFactory::readBakedTileModel(const MapFrame& mapf,
+                                     const TileKey&  key,
+                                     TileModel*      model)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    osg::ref_ptr<BakedTile> baked = readBakedTile( key );
+    if ( !baked.valid() )
+        return false;
+
+    const MapInfo& mapInfo = mapf.getMapInfo();
+
+    // image layers, matched to the baked images by name; baked images are
+    // in the map profile, so they share the tile's extent.
+    unsigned order = 0;
+    for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); ++i )
+    {
+        ImageLayer* layer = i->get();
+        if ( !layer->getEnabled() )
+            continue;
+
+        osg::Image* image = baked->getImage( layer->getName() );
+        if ( !image )
+            continue;
+
+        prepareImage( image, _terrainOptions );
+
+        model->_colorData[layer->getUID()] = TileModel::ColorData(
+            layer,
+            order++,
+            image,
+            GeoLocator::createForKey( key, mapInfo ),
+            key,
+            false );
+    }
+
+    if ( _stats.valid() )
+        _stats->record( EngineStats::STAGE_DATA_FETCH, start );
+
+    // elevation, with its neighbors for edge normalization:
+    start = osg::Timer::instance()->tick();
+
+    osg::ref_ptr<osg::HeightField> hf;
+    bool isFallback = false;
+    if ( baked->getHeightField() && getBakedHeightField(mapf, key, hf, isFallback) )
+    {
+        model->_elevationData = TileModel::ElevationData(
+            hf.get(),
+            GeoLocator::createForKey( key, mapInfo ),
+            isFallback );
+
+        if ( *_terrainOptions.normalizeEdges() || *_terrainOptions.gpuEdges() )
+        {
+            for( int x=-1; x<=1; x++ )
+            {
+                for( int y=-1; y<=1; y++ )
+                {
+                    if ( x != 0 || y != 0 )
+                    {
+                        TileKey nk = key.createNeighborKey(x, y);
+                        if ( nk.valid() && getBakedHeightField(mapf, nk, hf, isFallback) )
+                        {
+                            model->_elevationData.setNeighbor( x, y, hf.get() );
+                        }
+                    }
+                }
+            }
+
+            if ( key.getLOD() > 0 && getBakedHeightField(mapf, key.createParentKey(), hf, isFallback) )
+            {
+                model->_elevationData.setParent( hf.get() );
+            }
+        }
+    }
+
+    if ( _stats.valid() )
+        _stats->record( EngineStats::STAGE_HEIGHTFIELD, start );
+
+    return true;
+}
+
+
+bool
+TileModelFactory::createColorData(const TileKey&         key,
+                                  ImageLayer*            layer,
+                                  TileModel::ColorData&  out_colorData)
+{
+    if ( !layer || !layer->getEnabled() )
+        return false;
+
+    // finish a fetch that a tile build stopped waiting for.
+    LRUCache<LateFetchKey, osg::ref_ptr<TaskRequest> >::Record rec;
+    if ( _lateFetches.get(LateFetchKey(key, layer->getUID()), rec) )
+    {
+        _lateFetches.erase( LateFetchKey(key, layer->getUID()) );
+        FetchColorData* fetch = static_cast<FetchColorData*>( rec.value().get() );
+        fetch->_done.wait();
+        return fetch->getColorData( out_colorData );
+    }
+
+    MapInfo mapInfo( _map );
+
+    // build into a scratch model; the order is irrelevant since the
+    // geometry sorts its layers against the map.
+    osg::ref_ptr<TileModel> model = new TileModel();
+    model->_map = _map;
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    BuildColorData build;
+    build.init( key, layer, 0, mapInfo, _terrainOptions, model.get() );
+    bool ok = build.execute();
+
+    if ( _stats.valid() )
+        _stats->record( EngineStats::STAGE_DATA_FETCH, start );
+
+    if ( !ok )
+        return false;
+
+    return model->getColorData( layer->getUID(), out_colorData );
+}
+
+
+void
+TileModelFactory::fetchColorData(const MapFrame&  mapf,
+                                 const TileKey&   key,
+                                 TileModel*       model)
+{
+    const MapInfo& mapInfo = mapf.getMapInfo();
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    ImageLayerVector layers;
+    for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); ++i )
+    {
+        if ( i->get()->getEnabled() )
+            layers.push_back( i->get() );
+    }
+
+    osg::ref_ptr<FetchLatch> latch = new FetchLatch( layers.size() );
+    std::vector< osg::ref_ptr<FetchColorData> > fetches;
+    for( ImageLayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i )
+    {
+        FetchColorData* fetch = new FetchColorData( key, i->get(), mapInfo, _terrainOptions, latch.get() );
+        fetches.push_back( fetch );
+        _fetchService->add( fetch );
+    }
+
+    // make an elevation layer in the meantime; the tile geometry depends on
+    // it, so it always has to finish.
+    osg::Timer_t hfStart = osg::Timer::instance()->tick();
+    BuildElevationData build;
+    build.init( key, mapf, _terrainOptions, model, _hfCache );
+    build.execute();
+
+    if ( _stats.valid() )
+        _stats->record( EngineStats::STAGE_HEIGHTFIELD, hfStart );
+
+    // wait out whatever remains of the deadline.
+    float deadline = _terrainOptions.layerFetchDeadline().get();
+    if ( deadline > 0.0f )
+    {
+        double elapsed = osg::Timer::instance()->delta_m( start, osg::Timer::instance()->tick() );
+        if ( elapsed < (double)deadline )
+            latch->_event.wait( (unsigned long)((double)deadline - elapsed) );
+    }
+    else
+    {
+        latch->_event.wait();
+    }
+
+    // a layer that is not ready yet stands in the parent tile's texture and
+    // gets patched in once the tile is live.
     osg::ref_ptr<TileNode> parentTile;
-    if ( _liveTiles->get(key.createParentKey(), parentTile) )
-        model->_parentModel = parentTile->getTileModel();
+    if ( key.getLOD() > 0 )
+        _liveTiles->get( key.createParentKey(), parentTile );
 
-    out_model = model.release();
+    unsigned order = 0;
+    for( unsigned i = 0; i < fetches.size(); ++i )
+    {
+        FetchColorData* fetch = fetches[i].get();
+        UID uid = fetch->_layer->getUID();
+        TileModel::ColorData colorData;
+
+        if ( fetch->isDone() )
+        {
+            if ( !fetch->getColorData(colorData) )
+                continue;
+        }
+        else
+        {
+            _lateFetches.insert( LateFetchKey(key, uid), fetch );
+            model->_deferredLayers.push_back( uid );
+
+            const TileModel* parentModel = parentTile.valid() ? parentTile->getTileModel() : 0L;
+            if ( !parentModel || !parentModel->getColorData(uid, colorData) )
+                continue;
+            colorData._fallbackData = true;
+        }
+
+        // only bump the order if we added something to the data model.
+        colorData._order = order++;
+        model->_colorData[uid] = colorData;
+    }
+
+    if ( _stats.valid() )
+        _stats->record( EngineStats::STAGE_DATA_FETCH, start );
 }
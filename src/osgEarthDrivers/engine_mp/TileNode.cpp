@@ -36,7 +36,8 @@ TileNode::TileNode( const TileKey& key, const TileModel* model ) :
 _key               ( key ),
 _model             ( model ),
 _bornTime          ( 0.0 ),
-_lastTraversalFrame( 0 )
+_lastTraversalFrame( 0 ),
+_glCompiled        ( true )
 {
     this->setName( key.str() );
 
@@ -119,4 +120,8 @@ TileNode::releaseGLObjects(osg::State* state) const
 {
     if ( _model.valid() )
         _model->releaseGLObjects( state );
+
+    // the elevation texture, if there is one.
+    if ( getStateSet() )
+        getStateSet()->releaseGLObjects( state );
 }
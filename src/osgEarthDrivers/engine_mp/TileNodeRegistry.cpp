@@ -36,14 +36,23 @@ _name( name )
 }
 
 
+unsigned
+TileNodeRegistry::shardIndex( const TileKey& key )
+{
+    // (the hash mixes the whole key; neighbors differ only in their low bits)
+    return (unsigned)(key.hash() % NUM_SHARDS);
+}
+
+
 void
 TileNodeRegistry::add( TileNode* tile )
 {
     if ( tile )
     {
-        Threading::ScopedWriteLock exclusive( _tilesMutex );
-        _tiles[ tile->getKey() ] = tile;
-        OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+        Shard& shard = getShard( tile->getKey() );
+        Threading::ScopedWriteLock exclusive( shard._mutex );
+        shard._tiles[ tile->getKey().getCode() ] = tile;
+        OE_TEST << LC << _name << ": shard tiles=" << shard._tiles.size() << std::endl;
     }
 }
 
@@ -51,14 +60,27 @@ TileNodeRegistry::add( TileNode* tile )
 void
 TileNodeRegistry::add( const TileNodeVector& tiles )
 {
-    if ( tiles.size() > 0 )
+    if ( tiles.size() == 0 )
+        return;
+
+    // bucket the tiles by shard so that each shard is locked only once.
+    std::vector<TileNode*> buckets[NUM_SHARDS];
+    for( TileNodeVector::const_iterator i = tiles.begin(); i != tiles.end(); ++i )
     {
-        Threading::ScopedWriteLock exclusive( _tilesMutex );
-        for( TileNodeVector::const_iterator i = tiles.begin(); i != tiles.end(); ++i )
+        if ( i->valid() )
+            buckets[shardIndex(i->get()->getKey())].push_back( i->get() );
+    }
+
+    for( unsigned s = 0; s < NUM_SHARDS; ++s )
+    {
+        if ( buckets[s].size() > 0 )
         {
-            _tiles[ i->get()->getKey() ] = i->get();
+            Threading::ScopedWriteLock exclusive( _shards[s]._mutex );
+            for( std::vector<TileNode*>::const_iterator i = buckets[s].begin(); i != buckets[s].end(); ++i )
+            {
+                _shards[s]._tiles[ (*i)->getKey().getCode() ] = *i;
+            }
         }
-        OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
     }
 }
 
@@ -68,9 +90,37 @@ TileNodeRegistry::remove( TileNode* tile )
 {
     if ( tile )
     {
-        Threading::ScopedWriteLock exclusive( _tilesMutex );
-        _tiles.erase( tile->getKey() );
-        OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+        Shard& shard = getShard( tile->getKey() );
+        Threading::ScopedWriteLock exclusive( shard._mutex );
+        shard._tiles.erase( tile->getKey().getCode() );
+        OE_TEST << LC << _name << ": shard tiles=" << shard._tiles.size() << std::endl;
+    }
+}
+
+
+void
+TileNodeRegistry::remove( const TileNodeVector& tiles )
+{
+    if ( tiles.size() == 0 )
+        return;
+
+    std::vector<TileNode*> buckets[NUM_SHARDS];
+    for( TileNodeVector::const_iterator i = tiles.begin(); i != tiles.end(); ++i )
+    {
+        if ( i->valid() )
+            buckets[shardIndex(i->get()->getKey())].push_back( i->get() );
+    }
+
+    for( unsigned s = 0; s < NUM_SHARDS; ++s )
+    {
+        if ( buckets[s].size() > 0 )
+        {
+            Threading::ScopedWriteLock exclusive( _shards[s]._mutex );
+            for( std::vector<TileNode*>::const_iterator i = buckets[s].begin(); i != buckets[s].end(); ++i )
+            {
+                _shards[s]._tiles.erase( (*i)->getKey().getCode() );
+            }
+        }
     }
 }
 
@@ -78,10 +128,11 @@ TileNodeRegistry::remove( TileNode* tile )
 bool
 TileNodeRegistry::get( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 {
-    Threading::ScopedReadLock shared( _tilesMutex );
+    Shard& shard = getShard( key );
+    Threading::ScopedReadLock shared( shard._mutex );
 
-    TileNodeMap::iterator i = _tiles.find(key);
-    if ( i != _tiles.end() )
+    TileNodeMap::iterator i = shard._tiles.find( key.getCode() );
+    if ( i != shard._tiles.end() )
     {
         out_tile = i->second.get();
         return true;
@@ -93,14 +144,15 @@ TileNodeRegistry::get( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 bool
 TileNodeRegistry::take( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 {
-    Threading::ScopedWriteLock exclusive( _tilesMutex );
+    Shard& shard = getShard( key );
+    Threading::ScopedWriteLock exclusive( shard._mutex );
 
-    TileNodeMap::iterator i = _tiles.find(key);
-    if ( i != _tiles.end() )
+    TileNodeMap::iterator i = shard._tiles.find( key.getCode() );
+    if ( i != shard._tiles.end() )
     {
         out_tile = i->second.get();
-        _tiles.erase( i );
-        OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+        shard._tiles.erase( i );
+        OE_TEST << LC << _name << ": shard tiles=" << shard._tiles.size() << std::endl;
         return true;
     }
     return false;
@@ -110,20 +162,36 @@ TileNodeRegistry::take( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 void
 TileNodeRegistry::run( TileNodeRegistry::Operation& op )
 {
-    Threading::ScopedWriteLock lock( _tilesMutex );
-    unsigned size = _tiles.size();
-    op.operator()( _tiles );
-    if ( size != _tiles.size() )
-        OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+    for( unsigned s = 0; s < NUM_SHARDS; ++s )
+    {
+        Threading::ScopedWriteLock lock( _shards[s]._mutex );
+        op.operator()( _shards[s]._tiles );
+    }
 }
 
 
 void
 TileNodeRegistry::run( const TileNodeRegistry::ConstOperation& op ) const
 {
-    Threading::ScopedReadLock lock( _tilesMutex );
-    op.operator()( _tiles );
-    OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+    for( unsigned s = 0; s < NUM_SHARDS; ++s )
+    {
+        Threading::ScopedReadLock lock( _shards[s]._mutex );
+        op.operator()( _shards[s]._tiles );
+    }
+}
+
+
+void
+TileNodeRegistry::getTiles( TileNodeVector& out_tiles ) const
+{
+    for( unsigned s = 0; s < NUM_SHARDS; ++s )
+    {
+        Threading::ScopedReadLock shared( _shards[s]._mutex );
+        for( TileNodeMap::const_iterator i = _shards[s]._tiles.begin(); i != _shards[s]._tiles.end(); ++i )
+        {
+            out_tiles.push_back( i->second.get() );
+        }
+    }
 }
 
 
@@ -131,5 +199,23 @@ bool
 TileNodeRegistry::empty() const
 {
     // don't bother mutex-protecteding this.
-    return _tiles.empty();
+    for( unsigned s = 0; s < NUM_SHARDS; ++s )
+    {
+        if ( !_shards[s]._tiles.empty() )
+            return false;
+    }
+    return true;
+}
+
+
+unsigned
+TileNodeRegistry::size() const
+{
+    unsigned total = 0;
+    for( unsigned s = 0; s < NUM_SHARDS; ++s )
+    {
+        Threading::ScopedReadLock shared( _shards[s]._mutex );
+        total += _shards[s]._tiles.size();
+    }
+    return total;
 }
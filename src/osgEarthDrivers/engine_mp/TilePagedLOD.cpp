@@ -18,6 +18,7 @@
 */
 #include "TilePagedLOD"
 #include "TileNodeRegistry"
+#include "MPTerrainEngineNode"
 #include <osg/Version>
 
 using namespace osgEarth_engine_mp;
@@ -33,11 +34,14 @@ TilePagedLOD::TilePagedLOD(TileGroup*        tilegroup,
                            const TileKey&    subkey,
                            const UID&        engineUID,
                            TileNodeRegistry* live,
-                           TileNodeRegistry* dead) :
+                           TileNodeRegistry* dead,
+                           TileNodeRegistry* pending) :
 osg::PagedLOD(),
 _tilegroup ( tilegroup ),
 _live      ( live ),
 _dead      ( dead ),
+_pending   ( pending ),
+_engineUID ( engineUID ),
 _upsampling( false )
 {
     _numChildrenThatCannotBeExpired = 0;
@@ -60,9 +64,14 @@ TilePagedLOD::addChild(osg::Node* node)
     TileGroup* subtilegroup = dynamic_cast<TileGroup*>(node);
     if ( subtilegroup )
     {
+        osg::Timer_t start = osg::Timer::instance()->tick();
         _live->add( subtilegroup->getTileNode() );
+        updateImageLayers( subtilegroup->getTileNode() );
+        queueForCompile( subtilegroup->getTileNode() );
         ++_tilegroup->numSubtilesLoaded();
-        return osg::PagedLOD::addChild( node );
+        bool added = osg::PagedLOD::addChild( node );
+        recordStats( EngineStats::STAGE_MERGE, start );
+        return added;
     }
 
     // If that fails, check whether this is a simple TileNode. This means that 
@@ -75,10 +84,15 @@ TilePagedLOD::addChild(osg::Node* node)
         // If it's a legit tile, add it normally and inform our parent.
         if ( subtile->isValid() )
         {
+            osg::Timer_t start = osg::Timer::instance()->tick();
             _upsampling = false;
             _live->add( subtile );
+            updateImageLayers( subtile );
+            queueForCompile( subtile );
             ++_tilegroup->numSubtilesLoaded();
-            return osg::PagedLOD::addChild( node );
+            bool added = osg::PagedLOD::addChild( node );
+            recordStats( EngineStats::STAGE_MERGE, start );
+            return added;
         }
 
         // if it's an "invalid" marker tile, queue up a request to create an upsampled
@@ -115,6 +129,42 @@ TilePagedLOD::addChild(osg::Node* node)
 }
 
 
+void
+TilePagedLOD::queueForCompile(TileNode* tile)
+{
+    // hide the tile until the draw thread compiles it (see CompileGLObjects).
+    if ( _pending && tile )
+    {
+        tile->setGLCompiled( false );
+        _pending->add( tile );
+    }
+}
+
+
+void
+TilePagedLOD::updateImageLayers(TileNode* tile)
+{
+    const TileModel* model = tile ? tile->getTileModel() : 0L;
+    if ( model && _live && ((int)model->_revision < (int)_live->getMapRevision() || !model->_deferredLayers.empty()) )
+    {
+        osg::ref_ptr<MPTerrainEngineNode> engine;
+        MPTerrainEngineNode::getEngineByUID( _engineUID, engine );
+        if ( engine.valid() )
+            engine->updateTileImageLayers( tile );
+    }
+}
+
+
+void
+TilePagedLOD::recordStats(EngineStats::Stage stage, osg::Timer_t start)
+{
+    osg::ref_ptr<MPTerrainEngineNode> engine;
+    MPTerrainEngineNode::getEngineByUID( _engineUID, engine );
+    if ( engine.valid() )
+        engine->getEngineStats()->record( stage, start );
+}
+
+
 void
 TilePagedLOD::traverse(osg::NodeVisitor& nv)
 {
@@ -122,7 +172,7 @@ TilePagedLOD::traverse(osg::NodeVisitor& nv)
     // our group of four) are ready as well.
     if ( _children.size() > 0 )
     {
-         bool ready = _tilegroup->numSubtilesLoaded() == 4;
+         bool ready = _tilegroup->numSubtilesLoaded() == 4 && _tilegroup->subtilesCompiled();
          _children[0]->setNodeMask(ready? ~0 : 0);
     }
     osg::PagedLOD::traverse( nv );
@@ -163,6 +213,8 @@ TilePagedLOD::removeExpiredChildren(double         expiryTime,
             {
                 if ( _live )
                     _live->remove( tilenode );
+                if ( _pending )
+                    _pending->remove( tilenode );
                 if ( _dead )
                     _dead->add( tilenode );
             }
@@ -170,6 +222,11 @@ TilePagedLOD::removeExpiredChildren(double         expiryTime,
             OE_DEBUG << "Expired " << _prefix << std::endl;
             --_tilegroup->numSubtilesLoaded();
 
+            osg::ref_ptr<MPTerrainEngineNode> engine;
+            MPTerrainEngineNode::getEngineByUID( _engineUID, engine );
+            if ( engine.valid() )
+                engine->getEngineStats()->tileExpired();
+
             return Group::removeChildren(cindex,1);
         }
     }
@@ -0,0 +1,201 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "TilePrefetcher"
+#include <osgEarth/GeoData>
+#include <osg/FrameStamp>
+
+using namespace osgEarth_engine_mp;
+using namespace osgEarth;
+
+#define LC "[TilePrefetcher] "
+
+// number of points sampled along the predicted path
+#define NUM_PATH_SAMPLES 4
+
+//----------------------------------------------------------------------------
+
+namespace
+{
+    struct PrefetchTileModel : public TaskRequest
+    {
+        PrefetchTileModel( TileModelFactory* factory, const TileKey& key, float priority )
+            : TaskRequest( priority ), _factory( factory ), _key( key ) { }
+
+        void operator()( ProgressCallback* progress )
+        {
+            if ( !progress || !progress->isCanceled() )
+                _factory->prefetchTileModel( _key );
+        }
+
+        osg::ref_ptr<TileModelFactory> _factory;
+        TileKey                        _key;
+    };
+
+    // bounding radius of a tile, computed the same way as SerialKeyNodeFactory
+    // does for the subtile range.
+    double getTileRadius( const TileKey& key )
+    {
+        const GeoExtent& extent = key.getExtent();
+        GeoPoint lowerLeft (extent.getSRS(), extent.xMin(), extent.yMin(), 0.0, ALTMODE_ABSOLUTE);
+        GeoPoint upperRight(extent.getSRS(), extent.xMax(), extent.yMax(), 0.0, ALTMODE_ABSOLUTE);
+        osg::Vec3d ll, ur;
+        lowerLeft.toWorld( ll );
+        upperRight.toWorld( ur );
+        return (ur - ll).length() / 2.0;
+    }
+}
+
+//----------------------------------------------------------------------------
+
+TilePrefetcher::TilePrefetcher(const Map*                             map,
+                               TileModelFactory*                      factory,
+                               TileNodeRegistry*                      liveTiles,
+                               const Drivers::MPTerrainEngineOptions& options) :
+_map       ( map ),
+_factory   ( factory ),
+_liveTiles ( liveTiles ),
+_options   ( options ),
+_lastFrame ( ~0u ),
+_lastTime  ( 0.0 ),
+_tracking  ( false ),
+_stamp     ( 0 )
+{
+    // one thread, so prefetching never competes much with the pager.
+    _service = new TaskService( "MP tile prefetch", 1 );
+}
+
+
+TileKey
+TilePrefetcher::getKeyForViewpoint(const osg::Vec3d& mapPoint, double altitude) const
+{
+    const Profile* profile = _map->getProfile();
+
+    unsigned lod    = _options.firstLOD().value();
+    unsigned maxLOD = _options.maxLOD().value();
+    float    factor = _options.minTileRangeFactor().value();
+
+    // a tile pages in its subtiles once the eye comes within range of it,
+    // so descend until the altitude falls outside that range.
+    TileKey key = profile->createTileKey( mapPoint.x(), mapPoint.y(), lod );
+    while ( key.valid() && lod < maxLOD && altitude < getTileRadius(key) * factor )
+    {
+        TileKey child = profile->createTileKey( mapPoint.x(), mapPoint.y(), ++lod );
+        if ( !child.valid() )
+            break;
+        key = child;
+    }
+
+    return key;
+}
+
+
+void
+TilePrefetcher::prefetch(const TileKey& key, float priority, int stamp)
+{
+    if ( !key.valid() || _factory->isPrefetched(key) )
+        return;
+
+    osg::ref_ptr<TileNode> tile;
+    if ( _liveTiles->get(key, tile) )
+        return;
+
+    PrefetchTileModel* request = new PrefetchTileModel( _factory.get(), key, priority );
+    request->setStamp( stamp );
+    _service->add( request );
+}
+
+
+void
+TilePrefetcher::update(osg::NodeVisitor& nv)
+{
+    const osg::FrameStamp* fs = nv.getFrameStamp();
+    if ( !fs )
+        return;
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    // only follow one camera per frame.
+    if ( fs->getFrameNumber() == _lastFrame )
+        return;
+
+    osg::Vec3d eye  = nv.getEyePoint();
+    double     time = fs->getReferenceTime();
+
+    if ( _tracking && time > _lastTime )
+    {
+        // average with the previous estimate to smooth out frame jitter.
+        osg::Vec3d velocity = (eye - _lastEye) / (time - _lastTime);
+        _velocity = (_velocity + velocity) * 0.5;
+    }
+
+    _lastFrame = fs->getFrameNumber();
+    _lastTime  = time;
+    _lastEye   = eye;
+    _tracking  = true;
+
+    // find the eye's altitude; nothing to predict if the camera is
+    // barely moving relative to it.
+    const SpatialReference* srs = _map->getProfile()->getSRS();
+    osg::Vec3d mapEye;
+    double altitude = 0.0;
+    if ( !srs->transformFromWorld(eye, mapEye, &altitude) )
+        return;
+
+    osg::Vec3d travel = _velocity * _options.prefetchTime().value();
+    if ( travel.length() < 0.1 * osg::maximum(altitude, 1.0) )
+        return;
+
+    // the far end of the path decides whether the prediction has changed.
+    osg::Vec3d target[NUM_PATH_SAMPLES];
+    double     targetAlt[NUM_PATH_SAMPLES];
+    for( unsigned i=0; i<NUM_PATH_SAMPLES; ++i )
+    {
+        osg::Vec3d world = eye + travel * ( double(i+1)/double(NUM_PATH_SAMPLES) );
+        targetAlt[i] = 0.0;
+        if ( !srs->transformFromWorld(world, target[i], &targetAlt[i]) )
+            return;
+    }
+
+    TileKey farKey = getKeyForViewpoint( target[NUM_PATH_SAMPLES-1], osg::maximum(targetAlt[NUM_PATH_SAMPLES-1], 1.0) );
+    if ( !farKey.valid() || farKey == _lastTarget )
+        return;
+
+    _lastTarget = farKey;
+
+    // drop whatever the old prediction left in the queue.
+    int stamp = ++_stamp;
+    _service->cancelOlderThan( stamp );
+
+    // the tile under each point along the path, nearest first..
+    for( unsigned i=0; i<NUM_PATH_SAMPLES; ++i )
+    {
+        TileKey key = getKeyForViewpoint( target[i], osg::maximum(targetAlt[i], 1.0) );
+        prefetch( key, (float)i, stamp );
+    }
+
+    // ..and the ring of tiles around the far end.
+    for( int y=-1; y<=1; ++y )
+    {
+        for( int x=-1; x<=1; ++x )
+        {
+            if ( x != 0 || y != 0 )
+                prefetch( farKey.createNeighborKey(x, y), (float)NUM_PATH_SAMPLES, stamp );
+        }
+    }
+}
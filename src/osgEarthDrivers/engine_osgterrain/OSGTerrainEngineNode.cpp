@@ -903,7 +903,9 @@ OSGTerrainEngineNode::updateTextureCombining()
                 for( ColorFilterChain::const_iterator j = chain.begin(); j != chain.end(); ++j )
                 {
                     const ColorFilter* filter = j->get();
-                    filter->install( terrainStateSet );
+                    std::string code;
+                    if ( !filter->isConstant() || !filter->getConstantCode(code) ) // else inlined
+                        filter->install( terrainStateSet );
                 }
             }
         }
@@ -0,0 +1,118 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "ParallelKeyNodeFactory"
+
+using namespace osgEarth_engine_quadtree;
+using namespace osgEarth;
+using namespace OpenThreads;
+
+#define LC "[ParallelKeyNodeFactory] "
+
+//--------------------------------------------------------------------------
+
+namespace
+{
+    // builds the tile model for one child key.
+    struct BuildTileModel
+    {
+        void init( TileModelFactory* factory, const TileKey& key )
+        {
+            _factory     = factory;
+            _key         = key;
+            _realData    = false;
+            _lodBlending = false;
+        }
+
+        void execute()
+        {
+            _factory->createTileModel( _key, _model, _realData, _lodBlending );
+        }
+
+        TileModelFactory*       _factory;
+        TileKey                 _key;
+        osg::ref_ptr<TileModel> _model;
+        bool                    _realData;
+        bool                    _lodBlending;
+    };
+}
+
+//--------------------------------------------------------------------------
+
+ParallelKeyNodeFactory::ParallelKeyNodeFactory(TileModelFactory*        modelFactory,
+                                               TileModelCompiler*       modelCompiler,
+                                               TileNodeRegistry*        liveTiles,
+                                               TileNodeRegistry*        deadTiles,
+                                               const QuadTreeTerrainEngineOptions& options,
+                                               const MapInfo&           mapInfo,
+                                               TerrainNode*             terrain,
+                                               UID                      engineUID,
+                                               TaskService*             service ) :
+SerialKeyNodeFactory( modelFactory, modelCompiler, liveTiles, deadTiles, options, mapInfo, terrain, engineUID ),
+_service            ( service )
+{
+    //nop
+}
+
+osg::Node*
+ParallelKeyNodeFactory::createNode( const TileKey& parentKey )
+{
+    if ( !_service.valid() )
+        return SerialKeyNodeFactory::createNode( parentKey );
+
+    // An event for synchronizing the completion of all four builds:
+    Threading::MultiEvent semaphore( 4 );
+
+    osg::ref_ptr< ParallelTask<BuildTileModel> > tasks[4];
+    for( unsigned i = 0; i < 4; ++i )
+    {
+        tasks[i] = new ParallelTask<BuildTileModel>( &semaphore );
+        tasks[i]->init( _modelFactory.get(), parentKey.createChildKey(i) );
+        _service->add( tasks[i].get() );
+    }
+
+    // Wait for them to complete:
+    semaphore.wait();
+
+    bool tileHasAnyRealData = false;
+    for( unsigned i = 0; i < 4; ++i )
+    {
+        if ( tasks[i]->_model.valid() && tasks[i]->_realData )
+        {
+            tileHasAnyRealData = true;
+        }
+    }
+
+    osg::Group* root = 0L;
+
+    // assemble the tile (same rules as the serial factory).
+    if ( tileHasAnyRealData || _options.minLOD().isSet() || parentKey.getLevelOfDetail() == 0 )
+    {
+        root = new TileNodeGroup();
+
+        for( unsigned i = 0; i < 4; ++i )
+        {
+            if ( tasks[i]->_model.valid() )
+            {
+                addTile( tasks[i]->_model.get(), tasks[i]->_realData, tasks[i]->_lodBlending, root );
+            }
+        }
+    }
+
+    return root;
+}
@@ -18,6 +18,7 @@
 */
 #include "QuadTreeTerrainEngineNode"
 #include "SerialKeyNodeFactory"
+#include "ParallelKeyNodeFactory"
 #include "TerrainNode"
 #include "TileModelFactory"
 #include "TileModelCompiler"
@@ -181,6 +182,21 @@ QuadTreeTerrainEngineNode::postInitialize( const Map* map, const TerrainOptions&
     // initialize the model factory:
     _tileModelFactory = new TileModelFactory(getMap(), _liveTiles.get(), _terrainOptions );
 
+    // in parallel mode, the four children of a tile build their models concurrently:
+    if ( _terrainOptions.loadingPolicy()->mode() == LoadingPolicy::MODE_PARALLEL )
+    {
+        unsigned num = 2 * OpenThreads::GetNumberOfProcessors();
+        if ( _terrainOptions.loadingPolicy()->numLoadingThreads().isSet() )
+        {
+            num = *_terrainOptions.loadingPolicy()->numLoadingThreads();
+        }
+        else if ( _terrainOptions.loadingPolicy()->numLoadingThreadsPerCore().isSet() )
+        {
+            num = (unsigned)(*_terrainOptions.loadingPolicy()->numLoadingThreadsPerCore() * OpenThreads::GetNumberOfProcessors());
+        }
+        _tileService = new TaskService( "QuadTree TileModel", osg::maximum(num, 1u) );
+    }
+
 
     // handle an already-established map profile:
     if ( _update_mapf->getProfile() )
@@ -337,15 +353,31 @@ QuadTreeTerrainEngineNode::getKeyNodeFactory()
             _terrainOptions );
 
         // initialize a key node factory.
-        knf = new SerialKeyNodeFactory( 
-            _tileModelFactory.get(),
-            compiler,
-            _liveTiles.get(),
-            _deadTiles.get(),
-            _terrainOptions, 
-            MapInfo( getMap() ),
-            _terrain, 
-            _uid );
+        if ( _tileService.valid() )
+        {
+            knf = new ParallelKeyNodeFactory(
+                _tileModelFactory.get(),
+                compiler,
+                _liveTiles.get(),
+                _deadTiles.get(),
+                _terrainOptions,
+                MapInfo( getMap() ),
+                _terrain,
+                _uid,
+                _tileService.get() );
+        }
+        else
+        {
+            knf = new SerialKeyNodeFactory( 
+                _tileModelFactory.get(),
+                compiler,
+                _liveTiles.get(),
+                _deadTiles.get(),
+                _terrainOptions, 
+                MapInfo( getMap() ),
+                _terrain, 
+                _uid );
+        }
     }
 
     return knf.get();
@@ -581,7 +613,9 @@ QuadTreeTerrainEngineNode::updateTextureCombining()
                 for( ColorFilterChain::const_iterator j = chain.begin(); j != chain.end(); ++j )
                 {
                     const ColorFilter* filter = j->get();
-                    filter->install( terrainStateSet );
+                    std::string code;
+                    if ( !filter->isConstant() || !filter->getConstantCode(code) ) // else inlined
+                        filter->install( terrainStateSet );
                 }
             }
         }
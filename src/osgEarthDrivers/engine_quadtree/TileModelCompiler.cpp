@@ -90,12 +90,13 @@ namespace
     struct MaskRecord
     {
         osg::ref_ptr<osg::Vec3dArray> _boundary;
+        osg::ref_ptr<osg::Vec3dArray> _tileBoundary;          // _boundary clipped near the tile
         osg::Vec3d                    _ndcMin, _ndcMax;
         osg::Geometry*                _geom;
         osg::ref_ptr<osg::Vec3Array>  _internal;
 
-        MaskRecord(osg::Vec3dArray* boundary, osg::Vec3d& ndcMin, osg::Vec3d& ndcMax, osg::Geometry* geom) 
-            : _boundary(boundary), _ndcMin(ndcMin), _ndcMax(ndcMax), _geom(geom), _internal(new osg::Vec3Array()) { }
+        MaskRecord(osg::Vec3dArray* boundary, osg::Vec3dArray* tileBoundary, osg::Vec3d& ndcMin, osg::Vec3d& ndcMax, osg::Geometry* geom) 
+            : _boundary(boundary), _tileBoundary(tileBoundary), _ndcMin(ndcMin), _ndcMax(ndcMax), _geom(geom), _internal(new osg::Vec3Array()) { }
     };
 
     typedef std::vector<MaskRecord> MaskRecordVector;
@@ -181,9 +182,6 @@ namespace
      */
     void setupMaskRecords( Data& d )
     {
-        // TODO: Set up the boundary sets globally in the TileModelCompiler instead of
-        // generating the boundaries every time for every tile.
-
         for (MaskLayerVector::const_iterator it = d.maskLayers.begin(); it != d.maskLayers.end(); ++it)
         {
           // When displaying Plate Carre, Heights have to be converted from meters to degrees.
@@ -195,7 +193,6 @@ namespace
             scale = d.scaleHeight / 111319.0f;
           }
 
-          // TODO: no need to do this for every tile right?
           osg::Vec3dArray* boundary = (*it)->getOrCreateBoundary(
               scale, 
               d.model->_tileLocator->getDataExtent().getSRS() );
@@ -237,7 +234,17 @@ namespace
                 osg::Geometry* mask_geom = new osg::Geometry();
                 mask_geom->setUseVertexBufferObjects(d.useVBOs);
                 d.surfaceGeode->addDrawable(mask_geom);
-                d.maskRecords.push_back( MaskRecord(boundary, min_ndc, max_ndc, mask_geom) );
+
+                // the part of the boundary near this tile, which the mask layer
+                // clips from the parent tile's part and caches.
+                osg::ref_ptr<osg::Vec3dArray> tileBoundary;
+                (*it)->getOrCreateBoundary(
+                    d.model->_tileKey,
+                    tileBoundary,
+                    scale,
+                    d.model->_tileLocator->getDataExtent().getSRS() );
+
+                d.maskRecords.push_back( MaskRecord(boundary, tileBoundary.get(), min_ndc, max_ndc, mask_geom) );
               }
            }
         }
@@ -747,9 +754,11 @@ namespace
                     }
                 }
 
-                //Create local polygon representing mask
+                //Create local polygon representing mask. The clipped boundary has
+                //the same footprint within the tile and is usually far smaller.
+                osg::Vec3dArray* boundary = (*mr)._tileBoundary.valid() ? (*mr)._tileBoundary.get() : (*mr)._boundary.get();
                 osg::ref_ptr<Polygon> maskPoly = new Polygon();
-                for (osg::Vec3dArray::iterator it = (*mr)._boundary->begin(); it != (*mr)._boundary->end(); ++it)
+                for (osg::Vec3dArray::iterator it = boundary->begin(); it != boundary->end(); ++it)
                 {
                     osg::Vec3d local;
                     d.geoLocator->convertModelToLocal(*it, local);
@@ -777,7 +786,18 @@ namespace
 
                 //Crop the mask to the stitching poly (for case where mask crosses tile edge)
                 osg::ref_ptr<Geometry> maskCrop;
-                maskPoly->crop(maskSkirtPoly.get(), maskCrop);
+                if ( !maskPoly->crop(maskSkirtPoly.get(), maskCrop) && boundary != (*mr)._boundary.get() && !maskPoly->empty() )
+                {
+                    // the clip's zero-width edges can trip up the crop; fall back on the full boundary.
+                    maskPoly->clear();
+                    for (osg::Vec3dArray::iterator it = (*mr)._boundary->begin(); it != (*mr)._boundary->end(); ++it)
+                    {
+                        osg::Vec3d local;
+                        d.geoLocator->convertModelToLocal(*it, local);
+                        maskPoly->push_back(local);
+                    }
+                    maskPoly->crop(maskSkirtPoly.get(), maskCrop);
+                }
 
                 GeometryIterator i( maskCrop.get(), false );
                 while( i.hasMore() )
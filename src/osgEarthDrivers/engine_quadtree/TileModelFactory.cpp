@@ -168,7 +168,7 @@ namespace
             bool isFallback = false;
 
             //if ( _mapf->getHeightField( _key, true, hf, &isFallback ) )
-            if (_hfCache->getOrCreateHeightField( *_mapf, _key, true, hf, &isFallback) )
+            if (getHeightField( _key, hf, isFallback ) )
             {                
 
                 // Put it in the repo
@@ -191,14 +191,9 @@ namespace
                                 TileKey nk = _key.createNeighborKey(x, y);
                                 if ( nk.valid() )
                                 {
-                                    if (_hfCache->getOrCreateHeightField( *_mapf, nk, true, hf, &isFallback) )
+                                    if (getHeightField( nk, hf, isFallback ) )
                                     //if ( _mapf->getHeightField(nk, true, hf, &isFallback) )
                                     {               
-                                        if ( mapInfo.isPlateCarre() )
-                                        {
-                                            HeightFieldUtils::scaleHeightFieldToDegrees( hf.get() );
-                                        }
-
                                         _model->_elevationData.setNeighbor( x, y, hf.get() );
                                     }
                                 }
@@ -213,11 +208,8 @@ namespace
                     // find the parent tile as well, for LOD morphing!!
                     if ( _key.getLevelOfDetail() > 0 )
                     {
-                        if (_hfCache->getOrCreateHeightField( *_mapf, _key.createParentKey(), true, hf, &isFallback ))
+                        if (getHeightField( _key.createParentKey(), hf, isFallback ))
                         {       
-                            if ( mapInfo.isPlateCarre() )
-                                HeightFieldUtils::scaleHeightFieldToDegrees( hf.get() );
-
                             _model->_elevationData.setParent( hf.get() );
                         }
                     }
@@ -226,6 +218,21 @@ namespace
             }
         }
 
+        // Fetches a heightfield through the map's shared cache. Plate Carre maps
+        // scale the heights, so they get a private copy to scale.
+        bool getHeightField( const TileKey& key, osg::ref_ptr<osg::HeightField>& out_hf, bool& out_isFallback )
+        {
+            if ( !_hfCache->getOrCreateHeightField(*_mapf, key, true, out_hf, &out_isFallback) )
+                return false;
+
+            if ( _mapf->getMapInfo().isPlateCarre() )
+            {
+                out_hf = new osg::HeightField( *out_hf.get(), osg::CopyOp::DEEP_COPY_ALL );
+                HeightFieldUtils::scaleHeightFieldToDegrees( out_hf.get() );
+            }
+            return true;
+        }
+
         TileKey                  _key;
         const MapFrame*          _mapf;
         const QuadTreeTerrainEngineOptions* _opt;
@@ -243,13 +250,17 @@ _map           ( map ),
 _liveTiles     ( liveTiles ),
 _terrainOptions( terrainOptions )
 {
-    _hfCache = new HeightFieldCache();
+    _hfCache = map->getHeightFieldCache();
+
+    // the cache is shared with everything else using this map.
+    if ( _terrainOptions.heightFieldQuantizationError().isSet() )
+        _hfCache->setQuantizationError( _terrainOptions.heightFieldQuantizationError().value() );
 }
 
 HeightFieldCache*
 TileModelFactory::getHeightFieldCache() const
 {
-    return _hfCache;
+    return _hfCache.get();
 }
 
 
@@ -42,7 +42,7 @@ TileNodeRegistry::add( TileNode* tile )
     if ( tile )
     {
         Threading::ScopedWriteLock exclusive( _tilesMutex );
-        _tiles[ tile->getKey() ] = tile;
+        _tiles[ tile->getKey().getCode() ] = tile;
         OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
     }
 }
@@ -56,7 +56,7 @@ TileNodeRegistry::add( const TileNodeVector& tiles )
         Threading::ScopedWriteLock exclusive( _tilesMutex );
         for( TileNodeVector::const_iterator i = tiles.begin(); i != tiles.end(); ++i )
         {
-            _tiles[ i->get()->getKey() ] = i->get();
+            _tiles[ i->get()->getKey().getCode() ] = i->get();
         }
         OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
     }
@@ -69,7 +69,7 @@ TileNodeRegistry::remove( TileNode* tile )
     if ( tile )
     {
         Threading::ScopedWriteLock exclusive( _tilesMutex );
-        _tiles.erase( tile->getKey() );
+        _tiles.erase( tile->getKey().getCode() );
         OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
     }
 }
@@ -80,7 +80,7 @@ TileNodeRegistry::get( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 {
     Threading::ScopedReadLock shared( _tilesMutex );
 
-    TileNodeMap::iterator i = _tiles.find(key);
+    TileNodeMap::iterator i = _tiles.find( key.getCode() );
     if ( i != _tiles.end() )
     {
         out_tile = i->second.get();
@@ -95,7 +95,7 @@ TileNodeRegistry::take( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 {
     Threading::ScopedWriteLock exclusive( _tilesMutex );
 
-    TileNodeMap::iterator i = _tiles.find(key);
+    TileNodeMap::iterator i = _tiles.find( key.getCode() );
     if ( i != _tiles.end() )
     {
         out_tile = i->second.get();
@@ -12,10 +12,12 @@
 #include <osg/NodeVisitor>
 #include <osg/Texture2D>
 
+#include <osgEarth/HeightFieldCache>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Notify>
 #include <osgEarth/VerticalSpatialReference>
 #include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
 
 #include "GeoPatch"
 #include "MultiArray"
@@ -56,13 +58,15 @@ Geographic::Geographic(const Map* map,
     int serviceThreads = computeLoadingThreads(_options.loadingPolicy().get());
     _hfService = new TaskService("Height Field Service", serviceThreads);
     _imageService = new TaskService("Image Service", serviceThreads);
+    _patchService = new TaskService("Patch Service", serviceThreads);
 }
 
 Geographic::Geographic(const Geographic& rhs, const osg::CopyOp& copyop)
     : PatchSet(rhs, copyop),
       _profile(static_cast<EulerProfile*>(copyop(rhs._profile.get()))),
       _eModel(static_cast<EllipsoidModel*>(copyop(rhs._eModel.get()))),
-      _hfService(rhs._hfService), _imageService(rhs._imageService)
+      _hfService(rhs._hfService), _imageService(rhs._imageService),
+      _patchService(rhs._patchService)
 {
 }
 
@@ -309,11 +313,18 @@ namespace
 {
 // Get a height field from the map, or an empty one if there is no
 // data for this tile.
-GeoHeightField getGeoHeightField(MapFrame& mapf, const TileKey& key,
+GeoHeightField getGeoHeightField(const MapFrame& mapf, const TileKey& key,
                                  int resolution)
 {
     osg::ref_ptr<HeightField> hf;
-    mapf.getHeightField(key, true, hf, 0L, INTERP_BILINEAR);
+    // Go through the map's heightfield cache: neighboring patches, and
+    // the children of patches that were merged across the Date Line,
+    // resample the same tiles.
+    HeightFieldCache* cache = mapf.getHeightFieldCache();
+    if (cache)
+        cache->getOrCreateHeightField(mapf, key, true, hf, 0L, true);
+    else
+        mapf.getHeightField(key, true, hf, 0L, true);
     if  (!hf)
         hf = key.getProfile()->getVerticalSRS()
             ->createReferenceHeightField(key.getExtent(),
@@ -566,6 +577,57 @@ Node* Geographic::createChild(const PatchOptions* parentOptions, int childNum)
 
 }
 
+namespace
+{
+// Builds one child patch group on a patch service thread.
+struct BuildChild
+{
+    void init(Geographic* gpatchset, const PatchOptions* parentOptions,
+              int childNum)
+    {
+        _gpatchset = gpatchset;
+        _parentOptions = parentOptions;
+        _childNum = childNum;
+    }
+
+    void execute()
+    {
+        _result = _gpatchset->createChild(_parentOptions, _childNum);
+    }
+
+    Geographic* _gpatchset;
+    const PatchOptions* _parentOptions;
+    int _childNum;
+    ref_ptr<Node> _result;
+};
+}
+
+void Geographic::createChildren(const PatchOptions* parentOptions,
+                                Group* result)
+{
+    if (!_patchService.valid())
+    {
+        PatchSet::createChildren(parentOptions, result);
+        return;
+    }
+    // The pager thread waits here while the expensive vertex and
+    // culling computations for the children run concurrently.
+    Threading::MultiEvent semaphore(4);
+    ref_ptr<ParallelTask<BuildChild> > tasks[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        tasks[i] = new ParallelTask<BuildChild>(&semaphore);
+        tasks[i]->init(this, parentOptions, i);
+        _patchService->add(tasks[i].get());
+    }
+    semaphore.wait();
+    for (int i = 0; i < 4; ++i)
+    {
+        if (tasks[i]->_result.valid())
+            result->addChild(tasks[i]->_result.get());
+    }
+}
+
 // A tile can be thought of lying between edges with integer
 // coordinates at its LOD. With x going to the right and y going down,
 // a tile between (tile_x, tile_y) and (tile_x + 1, tile_y + 1).
@@ -343,4 +343,10 @@ osg::Node* PatchSet::createChild(const PatchOptions* parentOptions, int childNum
                                     pgroupOptions);
     return pgroup;
 }
+
+void PatchSet::createChildren(const PatchOptions* parentOptions, Group* result)
+{
+    for (int i = 0; i < 4; ++i)
+        result->addChild(createChild(parentOptions, i));
+}
 }
@@ -81,8 +81,7 @@ public:
             }
             PatchSet* pset = poptions->getPatchSet();
             Group* result = new Group;
-            for (int i = 0; i < 4; ++i)
-                result->addChild(pset->createChild(poptions, i));
+            pset->createChildren(poptions, result);
             return result;
 
         }
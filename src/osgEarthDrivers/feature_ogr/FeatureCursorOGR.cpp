@@ -35,7 +35,8 @@ FeatureCursorOGR::FeatureCursorOGR(OGRDataSourceH           dsHandle,
                                    const FeatureSource*     source,
                                    const FeatureProfile*    profile,
                                    const Symbology::Query&  query,
-                                   const FeatureFilterList& filters ) :
+                                   const FeatureFilterList& filters,
+                                   TaskService*             readAheadService ) :
 _source           ( source ),
 _dsHandle         ( dsHandle ),
 _layerHandle      ( layerHandle ),
@@ -45,7 +46,8 @@ _query            ( query ),
 _chunkSize        ( 500 ),
 _nextHandleToQueue( 0L ),
 _profile          ( profile ),
-_filters          ( filters )
+_filters          ( filters ),
+_readAheadService ( readAheadService )
 {
     {
         OGR_SCOPED_LOCK;
@@ -138,11 +140,18 @@ _filters          ( filters )
         }
     }
 
-    readChunk();
+    if ( _readAheadService.valid() )
+        startReadAhead();
+    else
+        readChunk();
 }
 
 FeatureCursorOGR::~FeatureCursorOGR()
 {
+    // the read-ahead request uses our handles, so let it finish first.
+    if ( _pendingChunk.valid() )
+        _pendingChunk->_done.wait();
+
     OGR_SCOPED_LOCK;
 
     if ( _nextHandleToQueue )
@@ -161,6 +170,9 @@ FeatureCursorOGR::~FeatureCursorOGR()
 bool
 FeatureCursorOGR::hasMore() const
 {
+    if ( _readAheadService.valid() )
+        return const_cast<FeatureCursorOGR*>(this)->collectReadAhead();
+
     return _resultSetHandle && ( _queue.size() > 0 || _nextHandleToQueue != 0L );
 }
 
@@ -183,6 +195,97 @@ FeatureCursorOGR::nextFeature()
 }
 
 
+/**
+ * Reads one chunk of features on the read-ahead service.
+ */
+struct FeatureCursorOGR::ChunkRequest : public TaskRequest
+{
+    ChunkRequest( FeatureCursorOGR* cursor ) : _cursor( cursor ), _endReached( false ) { }
+
+    void operator()( ProgressCallback* progress )
+    {
+        _cursor->readAheadChunk( _features, _endReached );
+        _done.set();
+    }
+
+    FeatureCursorOGR* _cursor; // the cursor waits for us before it goes away
+    FeatureList       _features;
+    bool              _endReached;
+    Threading::Event  _done;
+};
+
+void
+FeatureCursorOGR::startReadAhead()
+{
+    if ( !_resultSetHandle )
+        return;
+
+    _pendingChunk = new ChunkRequest( this );
+    _readAheadService->add( _pendingChunk.get() );
+}
+
+// waits for chunks until the queue has something in it or the reads are done,
+// starting the next read as soon as a chunk arrives so that it overlaps with
+// the caller's processing.
+bool
+FeatureCursorOGR::collectReadAhead()
+{
+    while( _queue.empty() && _pendingChunk.valid() )
+    {
+        _pendingChunk->_done.wait();
+        osg::ref_ptr<ChunkRequest> chunk = _pendingChunk.get();
+        _pendingChunk = 0L;
+
+        for( FeatureList::iterator i = chunk->_features.begin(); i != chunk->_features.end(); ++i )
+            _queue.push( i->get() );
+
+        if ( !chunk->_endReached )
+            startReadAhead();
+    }
+    return !_queue.empty();
+}
+
+// reads a chunk of features in read-ahead mode. The data source belongs to this
+// cursor alone and only one chunk is in flight at a time, so this runs without
+// the GDAL lock.
+void
+FeatureCursorOGR::readAheadChunk( FeatureList& out, bool& endReached )
+{
+    endReached = false;
+
+    for( unsigned i=0; i<_chunkSize; i++ )
+    {
+        OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
+        if ( !handle )
+        {
+            endReached = true;
+            break;
+        }
+
+        osg::ref_ptr<Feature> f = OgrUtils::createFeature( handle, _profile.get() );
+        if ( f.valid() && !_source->isBlacklisted(f->getFID()) )
+        {
+            out.push_back( f.get() );
+        }
+        OGR_F_Destroy( handle );
+    }
+
+    // preprocess the features using the filter list:
+    if ( out.size() > 0 && _filters.size() > 0 )
+    {
+        FeatureList preProcessList( out );
+
+        FilterContext cx;
+        cx.profile() = _profile.get();
+
+        for( FeatureFilterList::const_iterator i = _filters.begin(); i != _filters.end(); ++i )
+        {
+            FeatureFilter* filter = i->get();
+            cx = filter->push( preProcessList, cx );
+        }
+    }
+}
+
 // reads a chunk of features into a memory cache; do this for performance
 // and to avoid needing the OGR Mutex every time
 void
@@ -197,7 +300,7 @@ FeatureCursorOGR::readChunk()
 
     if ( _nextHandleToQueue )
     {
-        osg::ref_ptr<Feature> f = OgrUtils::createFeature( _nextHandleToQueue, _profile->getSRS() );
+        osg::ref_ptr<Feature> f = OgrUtils::createFeature( _nextHandleToQueue, _profile.get() );
         if ( f.valid() && !_source->isBlacklisted(f->getFID()) )
         {
             _queue.push( f );
@@ -217,7 +320,7 @@ FeatureCursorOGR::readChunk()
         OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
         if ( handle )
         {
-            osg::ref_ptr<Feature> f = OgrUtils::createFeature( handle, _profile->getSRS() );
+            osg::ref_ptr<Feature> f = OgrUtils::createFeature( handle, _profile.get() );
             if ( f.valid() && !_source->isBlacklisted(f->getFID()) )
             {
                 _queue.push( f );
@@ -30,6 +30,7 @@
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
+#include <OpenThreads/Thread>
 #include <list>
 #include <ogr_api.h>
 
@@ -286,18 +287,33 @@ public:
             // Each cursor requires its own DS handle so that multi-threaded access will work.
             // The cursor impl will dispose of the new DS handle.
 
-            OGRDataSourceH dsHandle = OGROpenShared( _source.c_str(), 0, &_ogrDriverHandle );
+            // In read-ahead mode the cursor reads without the lock, so its handle
+            // must not be shared with anyone else.
+            bool readAhead = _options.readAhead() == true;
+
+            OGRDataSourceH dsHandle = readAhead ?
+                OGROpen( _source.c_str(), 0, &_ogrDriverHandle ) :
+                OGROpenShared( _source.c_str(), 0, &_ogrDriverHandle );
+
             if ( dsHandle )
             {
                 OGRLayerH layerHandle = OGR_DS_GetLayer( dsHandle, _layerIndex );
 
+                if ( readAhead && !_readAheadService.valid() )
+                {
+                    _readAheadService = new TaskService(
+                        "OGR read-ahead",
+                        osg::maximum( 2, OpenThreads::GetNumberOfProcessors() ) );
+                }
+
                 return new FeatureCursorOGR( 
                     dsHandle,
                     layerHandle, 
                     this,
                     getFeatureProfile(),
                     query, 
-                    _options.filters() );
+                    _options.filters(),
+                    readAhead ? _readAheadService.get() : 0L );
             }
             else
             {
@@ -336,7 +352,7 @@ public:
             {
                 const FeatureProfile* p = getFeatureProfile();
                 const SpatialReference* srs = p ? p->getSRS() : 0L;
-                result = OgrUtils::createFeature( handle, srs );
+                result = OgrUtils::createFeature( handle, srs, p ? p->getAttributeSchema() : 0L );
                 OGR_F_Destroy( handle );
             }
         }
@@ -477,6 +493,7 @@ private:
     bool _writable;
     FeatureSchema _schema;
     Geometry::Type _geometryType;
+    osg::ref_ptr<TaskService> _readAheadService;
 };
 
 
@@ -21,11 +21,15 @@
 #include <osgEarth/Registry>
 #include <osgEarth/XmlUtils>
 #include <osgEarth/FileUtils>
+#include <osgEarth/Containers>
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
 #include <osgEarthFeatures/FeatureSource>
 #include <osgEarthFeatures/Filter>
 #include <osgEarthFeatures/BufferFilter>
 #include <osgEarthFeatures/ScaleFilter>
 #include <osgEarthFeatures/OgrUtils>
+#include <osgEarthFeatures/GeoJSONReader>
 #include <osgEarthUtil/TFS>
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
@@ -49,6 +53,57 @@ using namespace osgEarth::Drivers;
 
 #define OGR_SCOPED_LOCK GDAL_SCOPED_LOCK
 
+namespace
+{
+    /**
+     * A tile read that runs once, on whichever thread gets to it first: a
+     * prefetch thread, or the pager thread that asks for the tile.
+     */
+    struct TileFetch : public TaskRequest
+    {
+        TileFetch( const URI& uri, const osgDB::Options* dbOptions ) :
+            _uri      ( uri ),
+            _dbOptions( dbOptions ),
+            _done     ( false ) { }
+
+        void operator()( ProgressCallback* progress )
+        {
+            get();
+        }
+
+        ReadResult get()
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            if ( !_done )
+            {
+                _result = _uri.readString( _dbOptions.get() );
+                _done   = true;
+            }
+            return _result;
+        }
+
+        URI                                _uri;
+        osg::ref_ptr<const osgDB::Options> _dbOptions;
+        ReadResult                         _result;
+        bool                               _done;
+        Threading::Mutex                   _mutex;
+    };
+
+    // threads that fetch sibling tiles ahead of the pager.
+    Threading::Mutex          s_prefetchServiceMutex;
+    osg::ref_ptr<TaskService> s_prefetchService;
+
+    TaskService* getPrefetchService()
+    {
+        Threading::ScopedMutexLock lock( s_prefetchServiceMutex );
+        if ( !s_prefetchService.valid() )
+        {
+            s_prefetchService = new TaskService( "TFS prefetch", 4 );
+        }
+        return s_prefetchService.get();
+    }
+}
+
 /**
  * A FeatureSource that reads features from a TFS layer
  * 
@@ -59,7 +114,8 @@ public:
     TFSFeatureSource(const TFSFeatureOptions& options ) :
       FeatureSource( options ),
       _options     ( options ),
-      _layerValid(false)
+      _layerValid(false),
+      _fetches     ( 32 )
     {                
     }
 
@@ -124,6 +180,25 @@ public:
 
     bool getFeatures( const std::string& buffer, const std::string& mimeType, FeatureList& features )
     {        
+        // GeoJSON parses straight into features, without OGR (or its lock):
+        if ( isJSON(mimeType) )
+        {
+            FeatureList parsed;
+            GeoJSONReader reader( _layer.getSRS() );
+            if ( !reader.read(buffer, parsed) )
+            {
+                OE_WARN << LC << "Error reading TFS response: " << reader.getError() << std::endl;
+                return false;
+            }
+
+            for( FeatureList::iterator i = parsed.begin(); i != parsed.end(); ++i )
+            {
+                if ( !isBlacklisted(i->get()->getFID()) )
+                    features.push_back( i->get() );
+            }
+            return true;
+        }
+
         // find the right driver for the given mime type
         OGR_SCOPED_LOCK;
                 
@@ -253,7 +328,9 @@ public:
         URI uri(url);
 
         // read the data:
-        ReadResult r = uri.readString( _dbOptions.get() );
+        ReadResult r = _options.prefetchSiblings() == true ?
+            readTile( url, query ) :
+            uri.readString( _dbOptions.get() );
 
         const std::string& buffer = r.getString();
         const Config&      meta   = r.metadata();
@@ -305,6 +382,66 @@ public:
         return result;
     }
 
+    /**
+     * Reads a tile through the table of recent fetches, then starts fetching
+     * the tile's siblings in the background.
+     */
+    ReadResult readTile( const std::string& url, const Symbology::Query& query )
+    {
+        osg::ref_ptr<TileFetch> fetch = getOrCreateFetch( url, false );
+
+        if ( query.tileKey().isSet() )
+        {
+            const TileKey& key = query.tileKey().get();
+
+            unsigned tilesWide, tilesHigh;
+            key.getProfile()->getNumTiles( key.getLOD(), tilesWide, tilesHigh );
+
+            unsigned x0 = key.getTileX() & ~1u;
+            unsigned y0 = key.getTileY() & ~1u;
+            for( unsigned y = y0; y < y0+2 && y < tilesHigh; ++y )
+            {
+                for( unsigned x = x0; x < x0+2 && x < tilesWide; ++x )
+                {
+                    if ( x == key.getTileX() && y == key.getTileY() )
+                        continue;
+
+                    Symbology::Query sibling;
+                    sibling.tileKey() = TileKey( key.getLOD(), x, y, key.getProfile() );
+                    std::string siblingURL = createURL( sibling );
+                    if ( !Registry::instance()->isBlacklisted(siblingURL) )
+                        getOrCreateFetch( siblingURL, true );
+                }
+            }
+        }
+
+        return fetch->get();
+    }
+
+    /**
+     * Finds the fetch for a URL, or creates one (and optionally queues it).
+     * Fetches stay in the table after they complete, so a tile that was just
+     * read is not prefetched again when one of its siblings comes in.
+     */
+    osg::ref_ptr<TileFetch> getOrCreateFetch( const std::string& url, bool queue )
+    {
+        osg::ref_ptr<TileFetch> fetch;
+        {
+            Threading::ScopedMutexLock lock( _fetchesMutex );
+            TileFetchCache::Record rec;
+            if ( _fetches.get(url, rec) )
+                return rec.value();
+
+            fetch = new TileFetch( URI(url), _dbOptions.get() );
+            _fetches.insert( url, fetch.get() );
+        }
+
+        if ( queue )
+            getPrefetchService()->add( fetch.get() );
+
+        return fetch;
+    }
+
     /**
     * Gets the Feature with the given FID
     * @returns
@@ -340,6 +477,10 @@ private:
     osg::ref_ptr<osgDB::Options>    _dbOptions;    
     TFSLayer                        _layer;
     bool                            _layerValid;
+
+    typedef LRUCache< std::string, osg::ref_ptr<TileFetch> > TileFetchCache;
+    TileFetchCache                  _fetches;
+    Threading::Mutex                _fetchesMutex;
 };
 
 
@@ -26,6 +26,7 @@
 #include <osgEarthFeatures/ScaleFilter>
 #include <osgEarthUtil/WFS>
 #include <osgEarthFeatures/OgrUtils>
+#include <osgEarthFeatures/GeoJSONReader>
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -190,11 +191,33 @@ public:
 
     bool getFeatures( const std::string& buffer, const std::string& mimeType, FeatureList& features )
     {
-        OGR_SCOPED_LOCK;        
-
         bool json = isJSON( mimeType );
         bool gml  = isGML( mimeType );
 
+        // GeoJSON parses straight into features, without OGR (or its lock):
+        if ( json )
+        {
+            FeatureProfile* fp = getFeatureProfile();
+
+            FeatureList parsed;
+            GeoJSONReader reader( fp ? fp->getSRS() : 0L );
+            reader.setAttributeSchema( fp ? fp->getAttributeSchema() : 0L );
+            if ( !reader.read(buffer, parsed) )
+            {
+                OE_WARN << LC << "Error reading WFS response: " << reader.getError() << std::endl;
+                return false;
+            }
+
+            for( FeatureList::iterator i = parsed.begin(); i != parsed.end(); ++i )
+            {
+                if ( !isBlacklisted(i->get()->getFID()) )
+                    features.push_back( i->get() );
+            }
+            return true;
+        }
+
+        OGR_SCOPED_LOCK;        
+
         // find the right driver for the given mime type
         OGRSFDriverH ogrDriver =
             json ? OGRGetDriverByName( "GeoJSON" ) :
@@ -248,7 +271,7 @@ public:
             {
                 if ( feat_handle )
                 {
-                    osg::ref_ptr<Feature> f = OgrUtils::createFeature( feat_handle, srs );
+                    osg::ref_ptr<Feature> f = OgrUtils::createFeature( feat_handle, srs, fp ? fp->getAttributeSchema() : 0L );
                     if ( f.valid() && !isBlacklisted(f->getFID()) )
                     {
                         features.push_back( f.release() );
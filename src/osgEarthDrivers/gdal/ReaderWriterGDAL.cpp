@@ -22,6 +22,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/URI>
+#include <osgEarth/ThreadingUtils>
 
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -33,6 +34,9 @@
 #include <sstream>
 #include <stdlib.h>
 #include <memory.h>
+#include <float.h>
+#include <vector>
+#include <map>
 
 #include <gdal_priv.h>
 #include <gdalwarper.h>
@@ -627,7 +631,9 @@ public:
       _srcDS(NULL),
       _warpedDS(NULL),
       _options(options),
-      _maxDataLevel(30)
+      _maxDataLevel(30),
+      _threadDatasets(false),
+      _warpMode(WARP_NONE)
     {    
     }
 
@@ -635,6 +641,13 @@ public:
     {                     
         GDAL_SCOPED_LOCK;
 
+        // Close the per-thread handles
+        for (ThreadDatasetMap::iterator i = _threadDatasetMap.begin(); i != _threadDatasetMap.end(); ++i)
+        {
+            closeDatasets(i->second);
+        }
+        _threadDatasetMap.clear();
+
         // Close the _warpedDS dataset if :
         // - it exists
         // - and is different from _srcDS
@@ -969,25 +982,19 @@ public:
 
             if ( profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar()) )
             {
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    profile->getSRS()->getWKT().c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    NULL);
+                _warpMode    = WARP_POLAR;
+                _warpSrcWKT  = src_srs->getWKT();
+                _warpDestWKT = profile->getSRS()->getWKT();
             }
             else
             {                                
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRT(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    destWKT.c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    0);
+                _warpMode    = WARP_NORMAL;
+                _warpSrcWKT  = src_srs->getWKT();
+                _warpDestWKT = destWKT;
             }
 
+            _warpedDS = createWarpedDataset(_srcDS);
+
             if ( _warpedDS )
             {
                 warpedSRSWKT = _warpedDS->GetProjectionRef();
@@ -999,6 +1006,25 @@ public:
             warpedSRSWKT = src_srs->getWKT();
         }
 
+        // Remember how to open the same datasets again, so each reader thread can
+        // have its own handles. VRTs (built or cached) reopen from their XML.
+        if ( !useExternalDataset && _options.threadDatasets() == true && _warpedDS )
+        {
+            GDALDriverH driver = GDALGetDatasetDriver(_srcDS);
+            if ( driver && std::string(GDALGetDriverShortName(driver)) == "VRT" )
+            {
+                char** vrtXML = _srcDS->GetMetadata("xml:VRT");
+                if ( vrtXML && vrtXML[0] )
+                    _threadSource = vrtXML[0];
+            }
+            else if ( _srcDS->GetDescription() )
+            {
+                _threadSource = _srcDS->GetDescription();
+            }
+
+            _threadDatasets = !_threadSource.empty();
+        }
+
         //Get the _geotransform
         if ( getProfile() )
         {
@@ -1117,8 +1143,6 @@ public:
     */
     static GDALRasterBand* findBandByColorInterp(GDALDataset *ds, GDALColorInterp colorInterp)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetColorInterpretation() == colorInterp) return ds->GetRasterBand(i);
@@ -1128,8 +1152,6 @@ public:
 
     static GDALRasterBand* findBandByDataType(GDALDataset *ds, GDALDataType dataType)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetRasterDataType() == dataType) return ds->GetRasterBand(i);
@@ -1221,6 +1243,197 @@ public:
         geoY = _geotransform[3] + _geotransform[4] * x + _geotransform[5] * y;
     }
 
+    /**
+     * Creates the warping VRT for a source dataset, or returns the source
+     * itself when no warping is needed. Call with the GDAL lock held.
+     */
+    GDALDataset* createWarpedDataset(GDALDataset* srcDS)
+    {
+        if ( _warpMode == WARP_POLAR )
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
+                srcDS,
+                _warpSrcWKT.c_str(),
+                _warpDestWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                NULL);
+        }
+        else if ( _warpMode == WARP_NORMAL )
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRT(
+                srcDS,
+                _warpSrcWKT.c_str(),
+                _warpDestWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                0);
+        }
+        return srcDS;
+    }
+
+    /** Closes a per-thread set of handles. Call with the GDAL lock held. */
+    void closeDatasets(Datasets& ds)
+    {
+        if (ds._warpedDS && ds._warpedDS != ds._srcDS)
+            GDALClose(ds._warpedDS);
+        if (ds._srcDS)
+            GDALClose(ds._srcDS);
+        ds._warpedDS = ds._srcDS = NULL;
+    }
+
+    /**
+     * Gets the calling thread's own (warped) dataset, opening it on first use.
+     * Returns NULL if per-thread handles are unavailable, in which case the
+     * caller must use the shared _warpedDS under the GDAL lock.
+     */
+    GDALDataset* getThreadDataset()
+    {
+        if ( !_threadDatasets )
+            return NULL;
+
+        unsigned id = osgEarth::Threading::getCurrentThreadId();
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_threadDatasetMapMutex);
+            ThreadDatasetMap::const_iterator i = _threadDatasetMap.find(id);
+            if ( i != _threadDatasetMap.end() )
+                return i->second._warpedDS;
+        }
+
+        // opening datasets and creating warpers is not thread safe.
+        Datasets ds;
+        {
+            GDAL_SCOPED_LOCK;
+            ds._srcDS = (GDALDataset*)GDALOpen( _threadSource.c_str(), GA_ReadOnly );
+            if ( ds._srcDS )
+                ds._warpedDS = createWarpedDataset( ds._srcDS );
+
+            if ( !ds._warpedDS )
+            {
+                OE_WARN << LC << "Failed to open a per-thread dataset for " << getName()
+                    << "; using the shared dataset" << std::endl;
+                closeDatasets( ds );
+            }
+        }
+
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_threadDatasetMapMutex);
+        _threadDatasetMap[id] = ds;
+        return ds._warpedDS;
+    }
+
+    /**
+     * Holds the global GDAL lock only when reading through the shared
+     * dataset handles.
+     */
+    struct SharedDatasetLock
+    {
+        SharedDatasetLock(bool shared) :
+            _mutex( shared ? &osgEarth::Registry::instance()->getGDALMutex() : 0L )
+        {
+            if ( _mutex ) _mutex->lock();
+        }
+        ~SharedDatasetLock()
+        {
+            if ( _mutex ) _mutex->unlock();
+        }
+        OpenThreads::ReentrantMutex* _mutex;
+    };
+
+    /**
+     * Picks the coarsest overview level that still has at least the resolution
+     * of the target buffer, for all of the bands. Returns -1 to read from the
+     * full resolution bands.
+     */
+    static int selectOverviewLevel(GDALRasterBand** bands, int numBands, int width, int height, int target_width, int target_height)
+    {
+        double maxScaleX = (double)width / (double)target_width;
+        double maxScaleY = (double)height / (double)target_height;
+        if (maxScaleX <= 1.0 || maxScaleY <= 1.0)
+            return -1;
+
+        int best = -1;
+        for (int level = 0; level < bands[0]->GetOverviewCount(); ++level)
+        {
+            GDALRasterBand* overview = bands[0]->GetOverview(level);
+            if (!overview || overview->GetXSize() <= 0 || overview->GetYSize() <= 0)
+                continue;
+
+            // all the bands need a matching overview at this level
+            bool consistent = true;
+            for (int i = 1; i < numBands && consistent; ++i)
+            {
+                GDALRasterBand* other = level < bands[i]->GetOverviewCount() ? bands[i]->GetOverview(level) : 0L;
+                consistent = other && other->GetXSize() == overview->GetXSize() && other->GetYSize() == overview->GetYSize();
+            }
+            if (!consistent)
+                continue;
+
+            double scaleX = (double)bands[0]->GetXSize() / (double)overview->GetXSize();
+            double scaleY = (double)bands[0]->GetYSize() / (double)overview->GetYSize();
+            if (scaleX <= maxScaleX && scaleY <= maxScaleY)
+            {
+                if (best < 0 || overview->GetXSize() < bands[0]->GetOverview(best)->GetXSize())
+                    best = level;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * Reads a window of several bands into one pixel-interleaved byte buffer
+     * (numBands bytes per pixel). Zoomed-out reads come from the best matching
+     * overview so they don't touch the full resolution data; full resolution
+     * reads fetch all the bands in a single dataset RasterIO call.
+     */
+    static bool readInterleaved(GDALDataset* ds, GDALRasterBand** bands, int numBands,
+                                int off_x, int off_y, int width, int height,
+                                unsigned char* buffer, int target_width, int target_height)
+    {
+        int level = selectOverviewLevel(bands, numBands, width, height, target_width, target_height);
+
+        if (level < 0)
+        {
+            std::vector<int> bandMap(numBands);
+            bool sameDataset = true;
+            for (int i = 0; i < numBands; ++i)
+            {
+                bandMap[i] = bands[i]->GetBand();
+                sameDataset = sameDataset && bands[i]->GetDataset() == ds;
+            }
+
+            if (sameDataset)
+            {
+                return ds->RasterIO(GF_Read, off_x, off_y, width, height, buffer, target_width, target_height, GDT_Byte,
+                                    numBands, &bandMap[0], numBands, numBands * target_width, 1) == CE_None;
+            }
+        }
+
+        for (int i = 0; i < numBands; ++i)
+        {
+            GDALRasterBand* band = bands[i];
+            int x = off_x, y = off_y, w = width, h = height;
+
+            if (level >= 0)
+            {
+                // map the window into the overview's pixel space
+                band = bands[i]->GetOverview(level);
+                double scaleX = (double)bands[i]->GetXSize() / (double)band->GetXSize();
+                double scaleY = (double)bands[i]->GetYSize() / (double)band->GetYSize();
+                x = osg::minimum((int)floor((double)off_x / scaleX), band->GetXSize() - 1);
+                y = osg::minimum((int)floor((double)off_y / scaleY), band->GetYSize() - 1);
+                w = osg::maximum(osg::minimum((int)osg::round((double)width / scaleX), band->GetXSize() - x), 1);
+                h = osg::maximum(osg::minimum((int)osg::round((double)height / scaleY), band->GetYSize() - y), 1);
+            }
+
+            if (band->RasterIO(GF_Read, x, y, w, h, buffer + i, target_width, target_height, GDT_Byte,
+                               numBands, numBands * target_width) != CE_None)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
     osg::Image* createImage( const TileKey&        key,
                              ProgressCallback*     progress)
     {
@@ -1231,7 +1444,12 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        // read through this thread's own handles if possible; otherwise the
+        // shared ones, which need the global lock.
+        GDALDataset* warpedDS = getThreadDataset();
+        SharedDatasetLock lock( warpedDS == NULL );
+        if ( !warpedDS )
+            warpedDS = _warpedDS;
 
         int tileSize = _options.tileSize().value();
 
@@ -1256,11 +1474,11 @@ public:
             int width = int(((xmax - _geotransform[0]) / _geotransform[1]) - off_x);
             int height = int(((ymin - _geotransform[3]) / _geotransform[5]) - off_y);
 
-            if (off_x + width > _warpedDS->GetRasterXSize())
+            if (off_x + width > warpedDS->GetRasterXSize())
             {
-                int oversize_right = off_x + width - _warpedDS->GetRasterXSize();
+                int oversize_right = off_x + width - warpedDS->GetRasterXSize();
                 target_width = target_width - int(float(oversize_right) / width * target_width);
-                width = _warpedDS->GetRasterXSize() - off_x;
+                width = warpedDS->GetRasterXSize() - off_x;
             }
 
             if (off_x < 0)
@@ -1272,11 +1490,11 @@ public:
                 off_x = 0;
             }
 
-            if (off_y + height > _warpedDS->GetRasterYSize())
+            if (off_y + height > warpedDS->GetRasterYSize())
             {
-                int oversize_bottom = off_y + height - _warpedDS->GetRasterYSize();
+                int oversize_bottom = off_y + height - warpedDS->GetRasterYSize();
                 target_height = target_height - (int)osg::round(float(oversize_bottom) / height * target_height);
-                height = _warpedDS->GetRasterYSize() - off_y;
+                height = warpedDS->GetRasterYSize() - off_y;
             }
 
 
@@ -1299,44 +1517,44 @@ public:
 
 
 
-            GDALRasterBand* bandRed = findBandByColorInterp(_warpedDS, GCI_RedBand);
-            GDALRasterBand* bandGreen = findBandByColorInterp(_warpedDS, GCI_GreenBand);
-            GDALRasterBand* bandBlue = findBandByColorInterp(_warpedDS, GCI_BlueBand);
-            GDALRasterBand* bandAlpha = findBandByColorInterp(_warpedDS, GCI_AlphaBand);
+            GDALRasterBand* bandRed = findBandByColorInterp(warpedDS, GCI_RedBand);
+            GDALRasterBand* bandGreen = findBandByColorInterp(warpedDS, GCI_GreenBand);
+            GDALRasterBand* bandBlue = findBandByColorInterp(warpedDS, GCI_BlueBand);
+            GDALRasterBand* bandAlpha = findBandByColorInterp(warpedDS, GCI_AlphaBand);
 
-            GDALRasterBand* bandGray = findBandByColorInterp(_warpedDS, GCI_GrayIndex);
+            GDALRasterBand* bandGray = findBandByColorInterp(warpedDS, GCI_GrayIndex);
 
-            GDALRasterBand* bandPalette = findBandByColorInterp(_warpedDS, GCI_PaletteIndex);
+            GDALRasterBand* bandPalette = findBandByColorInterp(warpedDS, GCI_PaletteIndex);
 
             if (!bandRed && !bandGreen && !bandBlue && !bandAlpha && !bandGray && !bandPalette)
             {
                 OE_DEBUG << LC << "Could not determine bands based on color interpretation, using band count" << std::endl;
                 //We couldn't find any valid bands based on the color interp, so just make an educated guess based on the number of bands in the file
                 //RGB = 3 bands
-                if (_warpedDS->GetRasterCount() == 3)
+                if (warpedDS->GetRasterCount() == 3)
                 {
-                    bandRed   = _warpedDS->GetRasterBand( 1 );
-                    bandGreen = _warpedDS->GetRasterBand( 2 );
-                    bandBlue  = _warpedDS->GetRasterBand( 3 );
+                    bandRed   = warpedDS->GetRasterBand( 1 );
+                    bandGreen = warpedDS->GetRasterBand( 2 );
+                    bandBlue  = warpedDS->GetRasterBand( 3 );
                 }
                 //RGBA = 4 bands
-                else if (_warpedDS->GetRasterCount() == 4)
+                else if (warpedDS->GetRasterCount() == 4)
                 {
-                    bandRed   = _warpedDS->GetRasterBand( 1 );
-                    bandGreen = _warpedDS->GetRasterBand( 2 );
-                    bandBlue  = _warpedDS->GetRasterBand( 3 );
-                    bandAlpha = _warpedDS->GetRasterBand( 4 );
+                    bandRed   = warpedDS->GetRasterBand( 1 );
+                    bandGreen = warpedDS->GetRasterBand( 2 );
+                    bandBlue  = warpedDS->GetRasterBand( 3 );
+                    bandAlpha = warpedDS->GetRasterBand( 4 );
                 }
                 //Gray = 1 band
-                else if (_warpedDS->GetRasterCount() == 1)
+                else if (warpedDS->GetRasterCount() == 1)
                 {
-                    bandGray = _warpedDS->GetRasterBand( 1 );
+                    bandGray = warpedDS->GetRasterBand( 1 );
                 }
                 //Gray + alpha = 2 bands
-                else if (_warpedDS->GetRasterCount() == 2)
+                else if (warpedDS->GetRasterCount() == 2)
                 {
-                    bandGray  = _warpedDS->GetRasterBand( 1 );
-                    bandAlpha = _warpedDS->GetRasterBand( 2 );
+                    bandGray  = warpedDS->GetRasterBand( 1 );
+                    bandAlpha = warpedDS->GetRasterBand( 2 );
                 }
             }
 
@@ -1348,14 +1566,6 @@ public:
 
             if (bandRed && bandGreen && bandBlue)
             {
-                unsigned char *red = new unsigned char[target_width * target_height];
-                unsigned char *green = new unsigned char[target_width * target_height];
-                unsigned char *blue = new unsigned char[target_width * target_height];
-                unsigned char *alpha = new unsigned char[target_width * target_height];
-
-                //Initialize the alpha values to 255.
-                memset(alpha, 255, target_width * target_height);
-
                 image = new osg::Image;
                 image->allocateImage(tileSize, tileSize, 1, pixelFormat, GL_UNSIGNED_BYTE);
                 memset(image->data(), 0, image->getImageSizeInBytes());
@@ -1363,14 +1573,15 @@ public:
                 //Nearest interpolation just uses RasterIO to sample the imagery and should be very fast.
                 if (!*_options.interpolateImagery() || _options.interpolation() == INTERP_NEAREST)
                 {
-                    bandRed->RasterIO(GF_Read, off_x, off_y, width, height, red, target_width, target_height, GDT_Byte, 0, 0);
-                    bandGreen->RasterIO(GF_Read, off_x, off_y, width, height, green, target_width, target_height, GDT_Byte, 0, 0);
-                    bandBlue->RasterIO(GF_Read, off_x, off_y, width, height, blue, target_width, target_height, GDT_Byte, 0, 0);
+                    GDALRasterBand* bands[4] = { bandRed, bandGreen, bandBlue, bandAlpha };
+                    int numBands = bandAlpha ? 4 : 3;
+                    std::vector<unsigned char> pixels(target_width * target_height * numBands);
+                    readInterleaved(warpedDS, bands, numBands, off_x, off_y, width, height, &pixels[0], target_width, target_height);
 
-                    if (bandAlpha)
-                    {
-                        bandAlpha->RasterIO(GF_Read, off_x, off_y, width, height, alpha, target_width, target_height, GDT_Byte, 0, 0);
-                    }
+                    float noDataRed   = getBandNoDataValue(bandRed);
+                    float noDataGreen = getBandNoDataValue(bandGreen);
+                    float noDataBlue  = getBandNoDataValue(bandBlue);
+                    float noDataAlpha = bandAlpha ? getBandNoDataValue(bandAlpha) : 0.0f;
 
                     for (int src_row = 0, dst_row = tile_offset_top;
                         src_row < target_height;
@@ -1380,17 +1591,18 @@ public:
                             src_col < target_width;
                             ++src_col, ++dst_col)
                         {
-                            unsigned char r = red[src_col + src_row * target_width];
-                            unsigned char g = green[src_col + src_row * target_width];
-                            unsigned char b = blue[src_col + src_row * target_width];
-                            unsigned char a = alpha[src_col + src_row * target_width];
+                            const unsigned char* pixel = &pixels[(src_col + src_row * target_width) * numBands];
+                            unsigned char r = pixel[0];
+                            unsigned char g = pixel[1];
+                            unsigned char b = pixel[2];
+                            unsigned char a = bandAlpha ? pixel[3] : 255;
                             *(image->data(dst_col, dst_row) + 0) = r;
                             *(image->data(dst_col, dst_row) + 1) = g;
                             *(image->data(dst_col, dst_row) + 2) = b;                            
-                            if (!isValidValue( r, bandRed)    ||
-                                !isValidValue( g, bandGreen)  || 
-                                !isValidValue( b, bandBlue)   ||
-                                (bandAlpha && !isValidValue( a, bandAlpha )))
+                            if (!isValidValue( r, noDataRed)    ||
+                                !isValidValue( g, noDataGreen)  || 
+                                !isValidValue( b, noDataBlue)   ||
+                                (bandAlpha && !isValidValue( a, noDataAlpha )))
                             {
                                 a = 0.0f;
                             }                            
@@ -1420,19 +1632,9 @@ public:
                     }
                 }
 
-                delete []red;
-                delete []green;
-                delete []blue;
-                delete []alpha;
             }
             else if (bandGray)
             {
-                unsigned char *gray = new unsigned char[target_width * target_height];
-                unsigned char *alpha = new unsigned char[target_width * target_height];
-
-                //Initialize the alpha values to 255.
-                memset(alpha, 255, target_width * target_height);
-
                 image = new osg::Image;
                 image->allocateImage(tileSize, tileSize, 1, pixelFormat, GL_UNSIGNED_BYTE);
                 memset(image->data(), 0, image->getImageSizeInBytes());
@@ -1440,12 +1642,13 @@ public:
 
                 if (!*_options.interpolateImagery() || _options.interpolation() == INTERP_NEAREST)
                 {
-                    bandGray->RasterIO(GF_Read, off_x, off_y, width, height, gray, target_width, target_height, GDT_Byte, 0, 0);
+                    GDALRasterBand* bands[2] = { bandGray, bandAlpha };
+                    int numBands = bandAlpha ? 2 : 1;
+                    std::vector<unsigned char> pixels(target_width * target_height * numBands);
+                    readInterleaved(warpedDS, bands, numBands, off_x, off_y, width, height, &pixels[0], target_width, target_height);
 
-                    if (bandAlpha)
-                    {
-                        bandAlpha->RasterIO(GF_Read, off_x, off_y, width, height, alpha, target_width, target_height, GDT_Byte, 0, 0);
-                    }
+                    float noDataGray  = getBandNoDataValue(bandGray);
+                    float noDataAlpha = bandAlpha ? getBandNoDataValue(bandAlpha) : 0.0f;
 
                     for (int src_row = 0, dst_row = tile_offset_top;
                         src_row < target_height;
@@ -1455,13 +1658,14 @@ public:
                             src_col < target_width;
                             ++src_col, ++dst_col)
                         {
-                            unsigned char g = gray[src_col + src_row * target_width];
-                            unsigned char a = alpha[src_col + src_row * target_width];
+                            const unsigned char* pixel = &pixels[(src_col + src_row * target_width) * numBands];
+                            unsigned char g = pixel[0];
+                            unsigned char a = bandAlpha ? pixel[1] : 255;
                             *(image->data(dst_col, dst_row) + 0) = g;
                             *(image->data(dst_col, dst_row) + 1) = g;
                             *(image->data(dst_col, dst_row) + 2) = g;                            
-                            if (!isValidValue( g, bandGray) ||
-                               (bandAlpha && !isValidValue( a, bandAlpha)))
+                            if (!isValidValue( g, noDataGray) ||
+                               (bandAlpha && !isValidValue( a, noDataAlpha)))
                             {
                                 a = 0.0f;
                             }
@@ -1493,9 +1697,6 @@ public:
                     }
                 }
 
-                delete []gray;
-                delete []alpha;
-
             }
             else if (bandPalette)
             {
@@ -1563,10 +1764,8 @@ public:
         return image.release();
     }
 
-    bool isValidValue(float v, GDALRasterBand* band)
+    float getBandNoDataValue(GDALRasterBand* band)
     {
-        GDAL_SCOPED_LOCK;
-
         float bandNoData = -32767.0f;
         int success;
         float value = band->GetNoDataValue(&success);
@@ -1574,7 +1773,16 @@ public:
         {
             bandNoData = value;
         }
+        return bandNoData;
+    }
 
+    bool isValidValue(float v, GDALRasterBand* band)
+    {
+        return isValidValue(v, getBandNoDataValue(band));
+    }
+
+    bool isValidValue(float v, float bandNoData)
+    {
         //Check to see if the value is equal to the bands specified no data
         if (bandNoData == v) return false;
         //Check to see if the value is equal to the user specified nodata value
@@ -1591,18 +1799,64 @@ public:
         return true;
     }
 
+    /** Reads single pixels straight from a raster band. */
+    struct BandSampler
+    {
+        BandSampler(GDALRasterBand* band, float noData) : _band(band), _noData(noData) { }
 
-    float getInterpolatedValue(GDALRasterBand *band, double x, double y, bool applyOffset=true)
+        float get(int col, int row) const
+        {
+            float value = 0.0f;
+            _band->RasterIO(GF_Read, col, row, 1, 1, &value, 1, 1, GDT_Float32, 0, 0);
+            return value;
+        }
+
+        GDALRasterBand* _band;
+        float           _noData;
+    };
+
+    /**
+     * Reads pixels from a window of a raster band that was read into memory
+     * with a single RasterIO call.
+     */
+    struct WindowSampler
     {
-        double r, c;
-        GDALApplyGeoTransform(_invtransform, x, y, &c, &r);
+        WindowSampler() : _x0(0), _y0(0), _width(0), _height(0), _noData(0.0f) { }
 
+        bool read(GDALRasterBand* band, int x0, int y0, int width, int height, float noData)
+        {
+            _x0     = x0;
+            _y0     = y0;
+            _width  = width;
+            _height = height;
+            _noData = noData;
+            _data.resize(width * height);
+            return band->RasterIO(GF_Read, x0, y0, width, height, &_data[0], width, height, GDT_Float32, 0, 0) == CE_None;
+        }
+
+        float get(int col, int row) const
+        {
+            return _data[(row - _y0) * _width + (col - _x0)];
+        }
+
+        int                _x0, _y0, _width, _height;
+        float              _noData;
+        std::vector<float> _data;
+    };
+
+    /**
+     * Interpolates a value at pixel location (c, r) of a raster of the given
+     * size, fetching pixels from the sampler.
+     */
+    template<typename SAMPLER>
+    float interpolate(const SAMPLER& sampler, double c, double r, int rasterWidth, int rasterHeight, bool applyOffset)
+    {
         //Account for slight rounding errors.  If we are right on the edge of the dataset, clamp to the edge
         double eps = 0.0001;
         if (osg::equivalent(c, 0, eps)) c = 0;
         if (osg::equivalent(r, 0, eps)) r = 0;
-        if (osg::equivalent(c, (double)_warpedDS->GetRasterXSize(), eps)) c = _warpedDS->GetRasterXSize();
-        if (osg::equivalent(r, (double)_warpedDS->GetRasterYSize(), eps)) r = _warpedDS->GetRasterYSize();
+        if (osg::equivalent(c, (double)rasterWidth, eps)) c = rasterWidth;
+        if (osg::equivalent(r, (double)rasterHeight, eps)) r = rasterHeight;
 
         if (applyOffset)
         {
@@ -1617,31 +1871,31 @@ public:
             {
                 c = 0;
             }
-            else if (c > _warpedDS->GetRasterXSize()-1 && c <= _warpedDS->GetRasterXSize()-0.5)
+            else if (c > rasterWidth-1 && c <= rasterWidth-0.5)
             {
-                c = _warpedDS->GetRasterXSize()-1;
+                c = rasterWidth-1;
             }
 
             if (r < 0 && r >= -0.5)
             {
                 r = 0;
             }
-            else if (r > _warpedDS->GetRasterYSize()-1 && r <= _warpedDS->GetRasterYSize()-0.5)
+            else if (r > rasterHeight-1 && r <= rasterHeight-0.5)
             {
-                r = _warpedDS->GetRasterYSize()-1;
+                r = rasterHeight-1;
             }
         }
 
         float result = 0.0f;
 
         //If the location is outside of the pixel values of the dataset, just return 0
-        if (c < 0 || r < 0 || c > _warpedDS->GetRasterXSize()-1 || r > _warpedDS->GetRasterYSize()-1)
+        if (c < 0 || r < 0 || c > rasterWidth-1 || r > rasterHeight-1)
             return NO_DATA_VALUE;
 
         if ( _options.interpolation() == INTERP_NEAREST )
         {
-            band->RasterIO(GF_Read, (int)osg::round(c), (int)osg::round(r), 1, 1, &result, 1, 1, GDT_Float32, 0, 0);
-            if (!isValidValue( result, band))
+            result = sampler.get((int)osg::round(c), (int)osg::round(r));
+            if (!isValidValue( result, sampler._noData))
             {
                 return NO_DATA_VALUE;
             }
@@ -1649,27 +1903,21 @@ public:
         else
         {
             int rowMin = osg::maximum((int)floor(r), 0);
-            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(_warpedDS->GetRasterYSize()-1)), 0);
+            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(rasterHeight-1)), 0);
             int colMin = osg::maximum((int)floor(c), 0);
-            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(_warpedDS->GetRasterXSize()-1)), 0);
+            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(rasterWidth-1)), 0);
 
             if (rowMin > rowMax) rowMin = rowMax;
             if (colMin > colMax) colMin = colMax;
 
             float urHeight, llHeight, ulHeight, lrHeight;
 
-            band->RasterIO(GF_Read, colMin, rowMin, 1, 1, &llHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMin, rowMax, 1, 1, &ulHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMax, rowMin, 1, 1, &lrHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMax, rowMax, 1, 1, &urHeight, 1, 1, GDT_Float32, 0, 0);
-
-            /*
-            if (!isValidValue(urHeight, band)) urHeight = 0.0f;
-            if (!isValidValue(llHeight, band)) llHeight = 0.0f;
-            if (!isValidValue(ulHeight, band)) ulHeight = 0.0f;
-            if (!isValidValue(lrHeight, band)) lrHeight = 0.0f;
-            */
-            if (!isValidValue(urHeight, band) || (!isValidValue(llHeight, band)) ||(!isValidValue(ulHeight, band)) || (!isValidValue(lrHeight, band)))
+            llHeight = sampler.get(colMin, rowMin);
+            ulHeight = sampler.get(colMin, rowMax);
+            lrHeight = sampler.get(colMax, rowMin);
+            urHeight = sampler.get(colMax, rowMax);
+
+            if (!isValidValue(urHeight, sampler._noData) || (!isValidValue(llHeight, sampler._noData)) ||(!isValidValue(ulHeight, sampler._noData)) || (!isValidValue(lrHeight, sampler._noData)))
             {
                 return NO_DATA_VALUE;
             }
@@ -1722,6 +1970,116 @@ public:
         return result;
     }
 
+    float getInterpolatedValue(GDALRasterBand *band, double x, double y, bool applyOffset=true)
+    {
+        double r, c;
+        GDALApplyGeoTransform(_invtransform, x, y, &c, &r);
+
+        BandSampler sampler(band, getBandNoDataValue(band));
+        return interpolate(sampler, c, r, band->GetXSize(), band->GetYSize(), applyOffset);
+    }
+
+    /**
+     * Picks the coarsest overview of a band whose pixels are still no larger
+     * than the spacing between heightfield posts, so a zoomed-out tile reads
+     * far fewer pixels. Returns the band itself if no overview qualifies.
+     */
+    GDALRasterBand* selectOverview(GDALRasterBand* band, double pixelsPerPostX, double pixelsPerPostY, double& out_scaleX, double& out_scaleY)
+    {
+        GDALRasterBand* best = band;
+        out_scaleX = 1.0;
+        out_scaleY = 1.0;
+
+        for (int i = 0; i < band->GetOverviewCount(); ++i)
+        {
+            GDALRasterBand* overview = band->GetOverview(i);
+            if (!overview || overview->GetXSize() <= 0 || overview->GetYSize() <= 0)
+                continue;
+
+            double scaleX = (double)band->GetXSize() / (double)overview->GetXSize();
+            double scaleY = (double)band->GetYSize() / (double)overview->GetYSize();
+            if (scaleX <= pixelsPerPostX && scaleY <= pixelsPerPostY && scaleX > out_scaleX)
+            {
+                best = overview;
+                out_scaleX = scaleX;
+                out_scaleY = scaleY;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * Fills a heightfield by reading the band window that covers the tile in one
+     * RasterIO call and interpolating from memory. Returns false if the window
+     * could not be read, in which case the caller samples the band directly.
+     */
+    bool readHeightFieldWindow(osg::HeightField* hf, GDALRasterBand* band, double xmin, double ymin, double xmax, double ymax)
+    {
+        int tileSize = hf->getNumColumns();
+        double dx = (xmax - xmin) / (tileSize-1);
+        double dy = (ymax - ymin) / (tileSize-1);
+
+        // sample the overview that best matches the post spacing.
+        double scaleX, scaleY;
+        GDALRasterBand* source = selectOverview(
+            band,
+            dx / osg::absolute(_geotransform[1]),
+            dy / osg::absolute(_geotransform[5]),
+            scaleX, scaleY);
+
+        int sourceWidth  = source->GetXSize();
+        int sourceHeight = source->GetYSize();
+
+        // pixel window covering the tile corners, with a one-pixel margin for
+        // the half-pixel offset and the interpolation neighbors.
+        double cmin = DBL_MAX, rmin = DBL_MAX, cmax = -DBL_MAX, rmax = -DBL_MAX;
+        double cornersX[4] = { xmin, xmax, xmin, xmax };
+        double cornersY[4] = { ymin, ymin, ymax, ymax };
+        for (int i = 0; i < 4; ++i)
+        {
+            double c, r;
+            GDALApplyGeoTransform(_invtransform, cornersX[i], cornersY[i], &c, &r);
+            c /= scaleX;
+            r /= scaleY;
+            cmin = osg::minimum(cmin, c); cmax = osg::maximum(cmax, c);
+            rmin = osg::minimum(rmin, r); rmax = osg::maximum(rmax, r);
+        }
+
+        int x0 = osg::maximum((int)floor(cmin) - 1, 0);
+        int y0 = osg::maximum((int)floor(rmin) - 1, 0);
+        int x1 = osg::minimum((int)ceil(cmax) + 1, sourceWidth - 1);
+        int y1 = osg::minimum((int)ceil(rmax) + 1, sourceHeight - 1);
+
+        if (x0 > x1 || y0 > y1)
+        {
+            // no overlap at all
+            for (unsigned int i = 0; i < hf->getHeightList().size(); ++i) hf->getHeightList()[i] = NO_DATA_VALUE;
+            return true;
+        }
+
+        // don't buffer windows that are unreasonably large (no usable overviews)
+        if ((double)(x1 - x0 + 1) * (double)(y1 - y0 + 1) > 4096.0 * 4096.0)
+            return false;
+
+        WindowSampler sampler;
+        if (!sampler.read(source, x0, y0, x1 - x0 + 1, y1 - y0 + 1, getBandNoDataValue(band)))
+            return false;
+
+        for (int c = 0; c < tileSize; ++c)
+        {
+            double geoX = xmin + (dx * (double)c);
+            for (int r = 0; r < tileSize; ++r)
+            {
+                double geoY = ymin + (dy * (double)r);
+                double pc, pr;
+                GDALApplyGeoTransform(_invtransform, geoX, geoY, &pc, &pr);
+                float h = interpolate(sampler, pc / scaleX, pr / scaleY, sourceWidth, sourceHeight, true);
+                hf->setHeight(c, r, h);
+            }
+        }
+        return true;
+    }
+
 
     osg::HeightField* createHeightField( const TileKey&        key,
                                          ProgressCallback*     progress)
@@ -1732,7 +2090,12 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        // read through this thread's own handles if possible; otherwise the
+        // shared ones, which need the global lock.
+        GDALDataset* warpedDS = getThreadDataset();
+        SharedDatasetLock lock( warpedDS == NULL );
+        if ( !warpedDS )
+            warpedDS = _warpedDS;
 
         int tileSize = _options.tileSize().value();
 
@@ -1747,24 +2110,31 @@ public:
             key.getExtent().getBounds(xmin, ymin, xmax, ymax);
 
             // Try to find a FLOAT band
-            GDALRasterBand* band = findBandByDataType(_warpedDS, GDT_Float32);
+            GDALRasterBand* band = findBandByDataType(warpedDS, GDT_Float32);
             if (band == NULL)
             {
                 // Just get first band
-                band = _warpedDS->GetRasterBand(1);
+                band = warpedDS->GetRasterBand(1);
             }
 
-            double dx = (xmax - xmin) / (tileSize-1);
-            double dy = (ymax - ymin) / (tileSize-1);
-
-            for (int c = 0; c < tileSize; ++c)
+            if (!readHeightFieldWindow(hf.get(), band, xmin, ymin, xmax, ymax))
             {
-                double geoX = xmin + (dx * (double)c);
-                for (int r = 0; r < tileSize; ++r)
+                double dx = (xmax - xmin) / (tileSize-1);
+                double dy = (ymax - ymin) / (tileSize-1);
+
+                BandSampler sampler(band, getBandNoDataValue(band));
+
+                for (int c = 0; c < tileSize; ++c)
                 {
-                    double geoY = ymin + (dy * (double)r);
-                    float h = getInterpolatedValue(band, geoX, geoY);
-                    hf->setHeight(c, r, h);
+                    double geoX = xmin + (dx * (double)c);
+                    for (int r = 0; r < tileSize; ++r)
+                    {
+                        double geoY = ymin + (dy * (double)r);
+                        double pc, pr;
+                        GDALApplyGeoTransform(_invtransform, geoX, geoY, &pc, &pr);
+                        float h = interpolate(sampler, pc, pr, warpedDS->GetRasterXSize(), warpedDS->GetRasterYSize(), true);
+                        hf->setHeight(c, r, h);
+                    }
                 }
             }
         }
@@ -1785,6 +2155,24 @@ private:
 
     GDALDataset* _srcDS;
     GDALDataset* _warpedDS;
+
+    enum WarpMode { WARP_NONE, WARP_NORMAL, WARP_POLAR };
+
+    struct Datasets
+    {
+        Datasets() : _srcDS(NULL), _warpedDS(NULL) { }
+        GDALDataset* _srcDS;
+        GDALDataset* _warpedDS;
+    };
+    typedef std::map<unsigned, Datasets> ThreadDatasetMap;
+
+    bool             _threadDatasets;
+    std::string      _threadSource;
+    WarpMode         _warpMode;
+    std::string      _warpSrcWKT;
+    std::string      _warpDestWKT;
+    ThreadDatasetMap _threadDatasetMap;
+    OpenThreads::Mutex _threadDatasetMapMutex;
     double       _geotransform[6];
     double       _invtransform[6];
 
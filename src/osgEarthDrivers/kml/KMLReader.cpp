@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "KMLReader"
+#include "KMLStreamReader"
 #include "KML_Root"
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
@@ -24,12 +25,218 @@
 #include <osgEarth/ShaderGenerator>
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/Decluttering>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Thread>
 #include <stack>
 #include <iterator>
 
 using namespace osgEarth_kml;
 using namespace osgEarth;
 
+namespace
+{
+    /** Sets up a context that builds under "root". */
+    void initContext(KMLContext&           cx,
+                     MapNode*              mapNode,
+                     const KMLOptions*     options,
+                     osg::Group*           root,
+                     const osgDB::Options* dbOptions,
+                     URIResultCache&       defaultUriCache)
+    {
+        cx._mapNode   = mapNode;
+        cx._sheet     = new StyleSheet();
+        cx._options   = options;
+        cx._srs       = SpatialReference::create( "wgs84", "egm96" );
+        cx._groupStack.push( root );
+
+        // clone the dbOptions, and install a resource cache if there isn't one already:
+        if ( !URIResultCache::from(dbOptions) )
+        {
+            osgDB::Options* newOptions = Registry::instance()->cloneOrCreateOptions();
+            defaultUriCache.apply( newOptions );
+            cx._dbOptions = newOptions;
+        }
+        else
+        {
+            cx._dbOptions = dbOptions;
+        }
+
+        if ( cx._options->iconAndLabelGroup().valid() && cx._options->declutter() == true )
+        {
+            Decluttering::setEnabled( cx._options->iconAndLabelGroup()->getOrCreateStateSet(), true );
+        }
+    }
+
+    void reportCacheStats(const KMLContext& cx)
+    {
+        URIResultCache* cacheUsed = URIResultCache::from(cx._dbOptions.get());
+        CacheStats stats = cacheUsed->getStats();
+        OE_INFO << LC << "URI Cache: " << stats._queries << " reads, " << (stats._hitRatio*100.0) << "% hits" << std::endl;
+    }
+
+    /**
+     * Nodes built by a background load, waiting for the update traversal to
+     * add them. A null parent stands for the root of the load.
+     */
+    struct PendingNodes : public osg::Referenced
+    {
+        struct Entry
+        {
+            osg::ref_ptr<osg::Group> _parent;
+            osg::ref_ptr<osg::Node>  _child;
+        };
+        typedef std::vector<Entry> Entries;
+
+        Entries          _entries;
+        Threading::Mutex _mutex;
+    };
+
+    /**
+     * Thread that streams a KML file and hands over what it builds in
+     * batches. It never references the root group, so the root (which
+     * owns the thread through its update callback) can go away at any time.
+     */
+    class BackgroundLoader : public osg::Referenced,
+                             public OpenThreads::Thread,
+                             public KMLStreamReader::Publisher
+    {
+    public:
+        BackgroundLoader(const URI&            uri,
+                         MapNode*              mapNode,
+                         const KMLOptions&     options,
+                         const osgDB::Options* dbOptions,
+                         PendingNodes*         pending) :
+          _uri      ( uri ),
+          _mapNode  ( mapNode ),
+          _options  ( options ),
+          _dbOptions( dbOptions ),
+          _pending  ( pending ),
+          _numBuilt ( 0 ),
+          _progress ( new ProgressCallback() )
+        {
+            _top = new osg::Group();
+
+            // icons and labels go to the user's group through the queue too.
+            _icons = _options.iconAndLabelGroup().get();
+            if ( _icons.valid() )
+            {
+                _iconStaging = new osg::Group();
+                _options.iconAndLabelGroup() = _iconStaging.get();
+            }
+        }
+
+        /** Stops the load and waits for the thread to exit. */
+        void cancel()
+        {
+            _progress->cancel();
+            if ( isRunning() )
+                join();
+        }
+
+    public: // Publisher
+
+        void publish( osg::Group* parent, osg::Node* child )
+        {
+            PendingNodes::Entry entry;
+            entry._parent = parent == _top.get() ? 0L : parent;
+            entry._child  = child;
+            _batch.push_back( entry );
+        }
+
+        void onFeatureBuilt()
+        {
+            if ( _iconStaging.valid() )
+            {
+                for( unsigned i = 0; i < _iconStaging->getNumChildren(); ++i )
+                    publish( _icons.get(), _iconStaging->getChild(i) );
+                _iconStaging->removeChildren( 0, _iconStaging->getNumChildren() );
+            }
+
+            if ( ++_numBuilt % osg::maximum(_options.batchSize().value(), 1u) == 0 )
+                flush();
+        }
+
+    public: // OpenThreads::Thread
+
+        void run()
+        {
+            osg::ref_ptr<MapNode> mapNode;
+            if ( !_mapNode.lock(mapNode) )
+                return;
+
+            KMLContext cx;
+            URIResultCache defaultUriCache;
+            initContext( cx, mapNode.get(), &_options, _top.get(), _dbOptions.get(), defaultUriCache );
+
+            URIStream in( _uri );
+            KMLStreamReader reader( cx, this );
+            reader.read( in, _progress.get() );
+            flush();
+
+            OE_INFO << LC << "Loaded " << _numBuilt << " features from " << _uri.full() << std::endl;
+            reportCacheStats( cx );
+        }
+
+    protected:
+        virtual ~BackgroundLoader() { }
+
+        void flush()
+        {
+            if ( _batch.empty() )
+                return;
+
+            Threading::ScopedMutexLock lock( _pending->_mutex );
+            _pending->_entries.insert( _pending->_entries.end(), _batch.begin(), _batch.end() );
+            _batch.clear();
+        }
+
+        URI                                _uri;
+        osg::observer_ptr<MapNode>         _mapNode;
+        KMLOptions                         _options;
+        osg::ref_ptr<const osgDB::Options> _dbOptions;
+        osg::ref_ptr<PendingNodes>         _pending;
+        PendingNodes::Entries              _batch;
+        unsigned                           _numBuilt;
+        osg::ref_ptr<ProgressCallback>     _progress;
+        osg::ref_ptr<osg::Group>           _top;
+        osg::ref_ptr<osg::Group>           _icons;
+        osg::ref_ptr<osg::Group>           _iconStaging;
+    };
+
+    /** Adds the nodes of a background load to the graph, and stops the load with the graph. */
+    struct PublishCallback : public osg::NodeCallback
+    {
+        PublishCallback( BackgroundLoader* loader, PendingNodes* pending )
+            : _loader( loader ), _pending( pending ) { }
+
+        void operator()( osg::Node* node, osg::NodeVisitor* nv )
+        {
+            PendingNodes::Entries entries;
+            {
+                Threading::ScopedMutexLock lock( _pending->_mutex );
+                entries.swap( _pending->_entries );
+            }
+
+            osg::Group* root = node->asGroup();
+            for( PendingNodes::Entries::const_iterator i = entries.begin(); i != entries.end(); ++i )
+            {
+                osg::Group* parent = i->_parent.valid() ? i->_parent.get() : root;
+                parent->addChild( i->_child.get() );
+            }
+
+            traverse( node, nv );
+        }
+
+        virtual ~PublishCallback()
+        {
+            _loader->cancel();
+        }
+
+        osg::ref_ptr<BackgroundLoader> _loader;
+        osg::ref_ptr<PendingNodes>     _pending;
+    };
+}
+
 KMLReader::KMLReader( MapNode* mapNode, const KMLOptions* options ) :
 _mapNode( mapNode ),
 _options( options )
@@ -40,6 +247,11 @@ _options( options )
 osg::Node*
 KMLReader::read( std::istream& in, const osgDB::Options* dbOptions )
 {
+    if ( _options && (_options->streaming() == true || _options->loadInBackground() == true) )
+    {
+        return readStreaming( in, dbOptions );
+    }
+
     // pull the URI context out of the DB options:
     URIContext context(dbOptions);
 
@@ -65,35 +277,12 @@ KMLReader::read( const Config& conf, const osgDB::Options* dbOptions )
 
     root->setName( conf.referrer() );
 
-    KMLContext cx;
-    cx._mapNode   = _mapNode;
-    cx._sheet     = new StyleSheet();
-    cx._options   = _options;
-    cx._srs       = SpatialReference::create( "wgs84", "egm96" );
-    cx._groupStack.push( root );
-
-    // clone the dbOptions, and install a resource cache if there isn't one already:
-    URIResultCache defaultUriCache;
-    if ( !URIResultCache::from(dbOptions) )
-    {
-        osgDB::Options* newOptions = Registry::instance()->cloneOrCreateOptions();
-        defaultUriCache.apply( newOptions );
-        cx._dbOptions = newOptions;
-    }
-    else
-    {
-        cx._dbOptions = dbOptions;
-    }
-
     // intialize the KML options with the defaults if necessary:
     KMLOptions blankOptions;
-    if ( cx._options == 0L )
-        cx._options = &blankOptions;
 
-    if ( cx._options->iconAndLabelGroup().valid() && cx._options->declutter() == true )
-    {
-        Decluttering::setEnabled( cx._options->iconAndLabelGroup()->getOrCreateStateSet(), true );
-    }
+    KMLContext cx;
+    URIResultCache defaultUriCache;
+    initContext( cx, _mapNode, _options ? _options : &blankOptions, root, dbOptions, defaultUriCache );
 
     const Config* top = conf.hasChild("kml" ) ? conf.child_ptr("kml") : &conf;
 
@@ -105,9 +294,52 @@ KMLReader::read( const Config& conf, const osgDB::Options* dbOptions )
         kmlRoot.build( *top, cx );   // third pass.
     }
 
-    URIResultCache* cacheUsed = URIResultCache::from(cx._dbOptions.get());
-    CacheStats stats = cacheUsed->getStats();
-    OE_INFO << LC << "URI Cache: " << stats._queries << " reads, " << (stats._hitRatio*100.0) << "% hits" << std::endl;
+    reportCacheStats( cx );
+
+    return root;
+}
+
+osg::Node*
+KMLReader::readStreaming( std::istream& in, const osgDB::Options* dbOptions )
+{
+    URIContext context(dbOptions);
+
+    osg::ref_ptr<osg::Group> root = new osg::Group();
+    root->setName( context.referrer() );
+
+    KMLOptions blankOptions;
+
+    KMLContext cx;
+    URIResultCache defaultUriCache;
+    initContext( cx, _mapNode, _options ? _options : &blankOptions, root.get(), dbOptions, defaultUriCache );
+
+    KMLStreamReader reader( cx );
+    if ( !reader.read(in) && root->getNumChildren() == 0 )
+        return 0L;
+
+    reportCacheStats( cx );
+
+    return root.release();
+}
+
+osg::Node*
+KMLReader::readInBackground( const URI& uri, const osgDB::Options* dbOptions )
+{
+    KMLOptions options = _options ? *_options : KMLOptions();
+
+    // decluttering is set up here, not on the loader thread.
+    if ( options.iconAndLabelGroup().valid() && options.declutter() == true )
+    {
+        Decluttering::setEnabled( options.iconAndLabelGroup()->getOrCreateStateSet(), true );
+    }
+
+    osg::Group* root = new osg::Group();
+    root->setName( uri.full() );
+
+    osg::ref_ptr<PendingNodes>     pending = new PendingNodes();
+    osg::ref_ptr<BackgroundLoader> loader  = new BackgroundLoader( uri, _mapNode, options, dbOptions, pending.get() );
+    root->setUpdateCallback( new PublishCallback(loader.get(), pending.get()) );
 
+    loader->start();
     return root;
 }
@@ -0,0 +1,584 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "KMLStreamReader"
+#include "KML_Feature"
+#include "KML_Style"
+#include "KML_StyleMap"
+#include "KML_Schema"
+#include "KML_NetworkLinkControl"
+#include "KML_PhotoOverlay"
+#include "KML_ScreenOverlay"
+#include "KML_GroundOverlay"
+#include "KML_NetworkLink"
+#include "KML_Placemark"
+#include <osgEarth/StringUtils>
+#include <osgEarth/XmlUtils>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+using namespace osgEarth_kml;
+using namespace osgEarth;
+
+#define BLOCK_SIZE 65536
+
+namespace
+{
+    /**
+     * Pull parser for the subset of XML that KML uses. Yields start tags,
+     * end tags and text in document order, reading the stream one block at
+     * a time. Names are lower-cased and text has its entities decoded and
+     * its whitespace condensed, as XmlDocument does.
+     */
+    class XmlPullParser
+    {
+    public:
+        enum Token { TOKEN_START, TOKEN_END, TOKEN_TEXT, TOKEN_EOF, TOKEN_ERROR };
+
+        XmlPullParser( std::istream& in ) : _in( in ), _pos( 0 ), _pendingEnd( false ) { }
+
+        Token next();
+
+        const std::string&   name()  const { return _name; }
+        const XmlAttributes& attrs() const { return _attrs; }
+        const std::string&   text()  const { return _text; }
+
+    private:
+        bool more();
+        bool ensure( std::string::size_type count );
+        bool lookingAt( const char* str );
+        bool find( const char* delim, std::string::size_type& out );
+        bool parseStartTag();
+
+        std::istream&          _in;
+        std::string            _buf;
+        std::string::size_type _pos;
+        bool                   _pendingEnd;
+        std::string            _name;
+        std::string            _text;
+        XmlAttributes          _attrs;
+    };
+
+    void appendUTF8( unsigned code, std::string& out )
+    {
+        if ( code < 0x80 ) {
+            out += (char)code;
+        }
+        else if ( code < 0x800 ) {
+            out += (char)(0xC0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else if ( code < 0x10000 ) {
+            out += (char)(0xE0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else {
+            out += (char)(0xF0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3F));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    /** Decodes character references; optionally collapses whitespace runs to one space. */
+    std::string decode( const std::string& in, bool condense )
+    {
+        std::string out;
+        out.reserve( in.size() );
+        bool inSpace = false;
+
+        for( std::string::size_type i = 0; i < in.size(); ++i )
+        {
+            char c = in[i];
+
+            if ( condense && ::isspace((unsigned char)c) )
+            {
+                if ( !inSpace )
+                    out += ' ';
+                inSpace = true;
+                continue;
+            }
+            inSpace = false;
+
+            std::string::size_type semi;
+            if ( c == '&' && (semi = in.find(';', i)) != std::string::npos && semi - i <= 10 )
+            {
+                std::string ent = in.substr( i+1, semi-i-1 );
+                bool known = true;
+
+                if      ( ent == "lt" )   out += '<';
+                else if ( ent == "gt" )   out += '>';
+                else if ( ent == "amp" )  out += '&';
+                else if ( ent == "quot" ) out += '"';
+                else if ( ent == "apos" ) out += '\'';
+                else if ( ent.size() > 1 && ent[0] == '#' )
+                {
+                    bool hex = ent[1] == 'x' || ent[1] == 'X';
+                    unsigned code = (unsigned)::strtoul( ent.c_str() + (hex ? 2 : 1), 0L, hex ? 16 : 10 );
+                    appendUTF8( code, out );
+                }
+                else known = false;
+
+                if ( known )
+                {
+                    i = semi;
+                    continue;
+                }
+            }
+
+            out += c;
+        }
+        return out;
+    }
+
+    bool XmlPullParser::more()
+    {
+        if ( !_in.good() )
+            return false;
+
+        // drop what's been consumed.
+        if ( _pos > 0 )
+        {
+            _buf.erase( 0, _pos );
+            _pos = 0;
+        }
+
+        char block[BLOCK_SIZE];
+        _in.read( block, BLOCK_SIZE );
+        std::streamsize count = _in.gcount();
+        if ( count <= 0 )
+            return false;
+
+        _buf.append( block, (std::string::size_type)count );
+        return true;
+    }
+
+    bool XmlPullParser::ensure( std::string::size_type count )
+    {
+        while( _buf.size() - _pos < count )
+        {
+            if ( !more() )
+                return false;
+        }
+        return true;
+    }
+
+    bool XmlPullParser::lookingAt( const char* str )
+    {
+        std::string::size_type len = ::strlen( str );
+        return ensure( len ) && _buf.compare( _pos, len, str ) == 0;
+    }
+
+    bool XmlPullParser::find( const char* delim, std::string::size_type& out )
+    {
+        // "searched" counts the bytes past _pos that cannot start a match, so
+        // reading another block doesn't search the same bytes again.
+        std::string::size_type len      = ::strlen( delim );
+        std::string::size_type searched = 0;
+        for(;;)
+        {
+            out = _buf.find( delim, _pos + searched );
+            if ( out != std::string::npos )
+                return true;
+
+            if ( _buf.size() - _pos >= len )
+                searched = _buf.size() - _pos - len + 1;
+
+            if ( !more() )
+                return false;
+        }
+    }
+
+    bool XmlPullParser::parseStartTag()
+    {
+        // find the closing '>', skipping any inside quoted attribute values.
+        std::string::size_type i = _pos + 1;
+        char quote = 0;
+        for(;;)
+        {
+            if ( i >= _buf.size() )
+            {
+                std::string::size_type offset = i - _pos;
+                if ( !more() )
+                    return false;
+                i = _pos + offset;
+                continue;
+            }
+
+            char c = _buf[i];
+            if ( quote )
+            {
+                if ( c == quote ) quote = 0;
+            }
+            else if ( c == '"' || c == '\'' ) quote = c;
+            else if ( c == '>' ) break;
+            ++i;
+        }
+
+        std::string tag = _buf.substr( _pos+1, i-_pos-1 );
+        _pos = i+1;
+
+        _pendingEnd = !tag.empty() && tag[tag.size()-1] == '/';
+        if ( _pendingEnd )
+            tag.erase( tag.size()-1 );
+
+        std::string::size_type p = 0, n = tag.size();
+        while( p < n && !::isspace((unsigned char)tag[p]) ) ++p;
+        _name = toLower( tag.substr(0, p) );
+
+        _attrs.clear();
+        for(;;)
+        {
+            while( p < n && ::isspace((unsigned char)tag[p]) ) ++p;
+            if ( p >= n )
+                break;
+
+            std::string::size_type start = p;
+            while( p < n && tag[p] != '=' && !::isspace((unsigned char)tag[p]) ) ++p;
+            std::string attrName = toLower( tag.substr(start, p-start) );
+
+            while( p < n && ::isspace((unsigned char)tag[p]) ) ++p;
+            if ( p >= n || tag[p] != '=' )
+                continue; // valueless attribute; ignore it.
+            ++p;
+            while( p < n && ::isspace((unsigned char)tag[p]) ) ++p;
+            if ( p >= n || (tag[p] != '"' && tag[p] != '\'') )
+                break;
+
+            char q = tag[p++];
+            std::string::size_type end = tag.find( q, p );
+            if ( end == std::string::npos )
+                end = n;
+
+            _attrs[attrName] = decode( tag.substr(p, end-p), false );
+            p = end < n ? end+1 : n;
+        }
+
+        return !_name.empty();
+    }
+
+    XmlPullParser::Token XmlPullParser::next()
+    {
+        if ( _pendingEnd )
+        {
+            // the end of a self-closing element; _name is still its name.
+            _pendingEnd = false;
+            return TOKEN_END;
+        }
+
+        for(;;)
+        {
+            if ( !ensure(1) )
+                return TOKEN_EOF;
+
+            std::string::size_type i;
+
+            if ( _buf[_pos] != '<' )
+            {
+                if ( !find("<", i) )
+                    i = _buf.size();
+                _text = decode( _buf.substr(_pos, i-_pos), true );
+                _pos = i;
+                return TOKEN_TEXT;
+            }
+
+            if ( lookingAt("<!--") )
+            {
+                if ( !find("-->", i) ) return TOKEN_ERROR;
+                _pos = i+3;
+            }
+            else if ( lookingAt("<![CDATA[") )
+            {
+                if ( !find("]]>", i) ) return TOKEN_ERROR;
+                _text = _buf.substr( _pos+9, i-_pos-9 );
+                _pos = i+3;
+                return TOKEN_TEXT;
+            }
+            else if ( lookingAt("<?") )
+            {
+                if ( !find("?>", i) ) return TOKEN_ERROR;
+                _pos = i+2;
+            }
+            else if ( lookingAt("<!") )
+            {
+                // DOCTYPE; skip any internal subset in brackets.
+                if ( !find(">", i) ) return TOKEN_ERROR;
+                std::string::size_type bracket = _buf.find( '[', _pos );
+                if ( bracket != std::string::npos && bracket < i )
+                {
+                    _pos = bracket;
+                    if ( !find("]", i) ) return TOKEN_ERROR;
+                    _pos = i;
+                    if ( !find(">", i) ) return TOKEN_ERROR;
+                }
+                _pos = i+1;
+            }
+            else if ( lookingAt("</") )
+            {
+                if ( !find(">", i) ) return TOKEN_ERROR;
+                _name = toLower( trim(_buf.substr(_pos+2, i-_pos-2)) );
+                _pos = i+1;
+                return TOKEN_END;
+            }
+            else
+            {
+                return parseStartTag() ? TOKEN_START : TOKEN_ERROR;
+            }
+        }
+    }
+
+    bool isContainer( const std::string& name )
+    {
+        return name == "document" || name == "folder";
+    }
+
+    bool isFeature( const std::string& name )
+    {
+        return
+            name == "placemark"     ||
+            name == "networklink"   ||
+            name == "groundoverlay" ||
+            name == "screenoverlay" ||
+            name == "photooverlay";
+    }
+
+    Config makeElement( const std::string& name, const XmlAttributes& attrs )
+    {
+        Config conf( name );
+        for( XmlAttributes::const_iterator a = attrs.begin(); a != attrs.end(); ++a )
+            conf.set( a->first, a->second );
+        return conf;
+    }
+}
+
+//------------------------------------------------------------------------
+
+KMLStreamReader::KMLStreamReader( KMLContext& cx, Publisher* publisher ) :
+_cx       ( cx ),
+_publisher( publisher )
+{
+    //nop
+}
+
+bool
+KMLStreamReader::read( std::istream& in, ProgressCallback* progress )
+{
+    XmlPullParser parser( in );
+
+    // the level for the group we were given:
+    _levels.clear();
+    Level base;
+    base._published = true;
+    base._pushed    = false;
+    _levels.push_back( base );
+
+    // elements being collected below the current container, and their text:
+    std::vector<Config>      elements;
+    std::vector<std::string> texts;
+
+    bool ok = true;
+
+    for(;;)
+    {
+        XmlPullParser::Token token = parser.next();
+
+        if ( token == XmlPullParser::TOKEN_EOF )
+            break;
+
+        if ( token == XmlPullParser::TOKEN_ERROR )
+        {
+            OE_WARN << LC << "Error in XML document " << URIContext(_cx._dbOptions.get()).referrer() << std::endl;
+            ok = false;
+            break;
+        }
+
+        if ( progress && progress->isCanceled() )
+        {
+            ok = false;
+            break;
+        }
+
+        if ( !elements.empty() )
+        {
+            if ( token == XmlPullParser::TOKEN_START )
+            {
+                elements.push_back( makeElement(parser.name(), parser.attrs()) );
+                texts.push_back( std::string() );
+            }
+            else if ( token == XmlPullParser::TOKEN_TEXT )
+            {
+                texts.back() += parser.text();
+            }
+            else // TOKEN_END
+            {
+                Config conf = elements.back();
+                conf.value() = trim( texts.back() );
+                elements.pop_back();
+                texts.pop_back();
+
+                if ( !elements.empty() )
+                    elements.back().add( conf );
+                else
+                    handleElement( conf );
+            }
+        }
+
+        else if ( token == XmlPullParser::TOKEN_START )
+        {
+            if ( parser.name() == "kml" || isContainer(parser.name()) )
+            {
+                beginContainer( makeElement(parser.name(), parser.attrs()) );
+            }
+            else
+            {
+                elements.push_back( makeElement(parser.name(), parser.attrs()) );
+                texts.push_back( std::string() );
+            }
+        }
+
+        else if ( token == XmlPullParser::TOKEN_END && _levels.size() > 1 )
+        {
+            endContainer();
+        }
+    }
+
+    // close whatever a truncated document left open.
+    while( _levels.size() > 1 )
+        endContainer();
+
+    return ok;
+}
+
+void
+KMLStreamReader::beginContainer( const Config& conf )
+{
+    publishLevel( _levels.back() );
+
+    Level level;
+    level._props     = conf;
+    level._published = conf.key() == "kml"; // the kml element has no group.
+    level._pushed    = false;
+    _levels.push_back( level );
+}
+
+void
+KMLStreamReader::endContainer()
+{
+    // an empty container still gets its group.
+    publishLevel( _levels.back() );
+
+    if ( _levels.back()._pushed )
+        _cx._groupStack.pop();
+
+    _levels.pop_back();
+}
+
+void
+KMLStreamReader::publishLevel( Level& level )
+{
+    if ( level._published )
+        return;
+
+    // like KML_Document/KML_Folder::build, with the properties read so far.
+    osg::Group* group = new osg::Group();
+    KML_Feature feature;
+    feature.build( level._props, _cx, group );
+
+    osg::Group* parent = _cx._groupStack.top().get();
+    if ( _publisher )
+        _publisher->publish( parent, group );
+    else
+        parent->addChild( group );
+
+    _cx._groupStack.push( group );
+    level._published = true;
+    level._pushed    = true;
+    level._props     = Config();
+}
+
+void
+KMLStreamReader::handleElement( const Config& conf )
+{
+    const std::string& name = conf.key();
+
+    if ( isFeature(name) )
+    {
+        publishLevel( _levels.back() );
+        buildFeature( conf );
+    }
+    else if ( name == "style" )
+    {
+        KML_Style style;
+        style.scan ( conf, _cx );
+        style.scan2( conf, _cx );
+    }
+    else if ( name == "stylemap" )
+    {
+        KML_StyleMap styleMap;
+        styleMap.scan ( conf, _cx );
+        styleMap.scan2( conf, _cx );
+    }
+    else if ( name == "schema" )
+    {
+        KML_Schema schema;
+        schema.scan ( conf, _cx );
+        schema.scan2( conf, _cx );
+    }
+    else if ( name == "networklinkcontrol" )
+    {
+        KML_NetworkLinkControl control;
+        control.scan ( conf, _cx );
+        control.scan2( conf, _cx );
+    }
+    else if ( !_levels.back()._published )
+    {
+        // a container property (name, visibility, LookAt, ...)
+        _levels.back()._props.add( conf );
+    }
+}
+
+void
+KMLStreamReader::buildFeature( const Config& conf )
+{
+    // build into a staging group, then hand the results to the container.
+    osg::ref_ptr<osg::Group> staging = new osg::Group();
+    _cx._groupStack.push( staging.get() );
+
+    const std::string& name = conf.key();
+    if      ( name == "placemark" )     build_one( Placemark,     conf, _cx )
+    else if ( name == "networklink" )   build_one( NetworkLink,   conf, _cx )
+    else if ( name == "groundoverlay" ) build_one( GroundOverlay, conf, _cx )
+    else if ( name == "screenoverlay" ) build_one( ScreenOverlay, conf, _cx )
+    else if ( name == "photooverlay" )  build_one( PhotoOverlay,  conf, _cx )
+
+    _cx._groupStack.pop();
+
+    osg::Group* parent = _cx._groupStack.top().get();
+    for( unsigned i = 0; i < staging->getNumChildren(); ++i )
+    {
+        if ( _publisher )
+            _publisher->publish( parent, staging->getChild(i) );
+        else
+            parent->addChild( staging->getChild(i) );
+    }
+
+    if ( _publisher )
+        _publisher->onFeatureBuilt();
+}
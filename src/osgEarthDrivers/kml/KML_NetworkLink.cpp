@@ -17,17 +17,307 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "KML_NetworkLink"
+#include "KML_Root"
+#include "KML_Placemark"
+#include "KML_GroundOverlay"
+#include "KML_ScreenOverlay"
+#include "KML_PhotoOverlay"
 #include <osgEarth/GeoMath>
 #include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/XmlUtils>
+#include <osgEarth/Decluttering>
+#include <OpenThreads/Thread>
 #include <osg/PagedLOD>
 #include <osg/ProxyNode>
 #include <osg/Version>
+#include <map>
+#include <set>
+#include <sstream>
 
 #undef  LC
 #define LC "[KML_NetworkLink] "
 
 using namespace osgEarth_kml;
 
+namespace
+{
+    /**
+     * Changes found by a refresh, waiting for the update traversal. Each
+     * feature is keyed by its KML id; a changed feature maps to the group
+     * holding its rebuilt nodes.
+     */
+    struct PendingChanges : public osg::Referenced
+    {
+        typedef std::map<std::string, osg::ref_ptr<osg::Group> > Changed;
+
+        Changed               _changed;
+        std::set<std::string> _removed;
+        Threading::Mutex      _mutex;
+    };
+
+    /**
+     * Thread that re-reads an "onInterval" NetworkLink. Each refresh
+     * compares the features of the new document with those of the last one
+     * and rebuilds only the features that are new or whose KML changed; a
+     * change to the document's styles rebuilds everything.
+     */
+    class LinkRefresher : public osg::Referenced,
+                          public OpenThreads::Thread
+    {
+    public:
+        LinkRefresher(const URI&            uri,
+                      double                interval,
+                      MapNode*              mapNode,
+                      const KMLOptions&     options,
+                      const osgDB::Options* dbOptions,
+                      PendingChanges*       pending) :
+          _uri      ( uri ),
+          _interval ( interval ),
+          _mapNode  ( mapNode ),
+          _options  ( options ),
+          _pending  ( pending ),
+          _progress ( new ProgressCallback() ),
+          _docHash  ( 0 ),
+          _styleHash( 0 )
+        {
+            // icons and labels stay with their placemarks, so that replacing
+            // a placemark replaces them too.
+            _options.iconAndLabelGroup() = 0L;
+
+            // always go to the server.
+            osgDB::Options* newOptions = Registry::instance()->cloneOrCreateOptions( dbOptions );
+            CachePolicy noCache = CachePolicy::NO_CACHE;
+            noCache.apply( newOptions );
+            _dbOptions = newOptions;
+        }
+
+        /** Stops refreshing and waits for the thread to exit. */
+        void cancel()
+        {
+            _progress->cancel();
+            if ( isRunning() )
+                join();
+        }
+
+    public: // OpenThreads::Thread
+
+        void run()
+        {
+            while( !_progress->isCanceled() )
+            {
+                refresh();
+
+                // sleep in short steps so cancelation is quick.
+                for( double t = 0.0; t < _interval && !_progress->isCanceled(); t += 0.1 )
+                    OpenThreads::Thread::microSleep( 100000 );
+            }
+        }
+
+    protected:
+        virtual ~LinkRefresher() { }
+
+        typedef std::map<std::string, const Config*> Features;
+
+        /** Collects the features of a document by id, and the text of its shared styles. */
+        void collect( const Config& conf, Features& features, std::string& styles, unsigned& numUnnamed )
+        {
+            for( ConfigSet::const_iterator i = conf.children().begin(); i != conf.children().end(); ++i )
+            {
+                const std::string& key = i->key();
+                if ( key == "document" || key == "folder" )
+                {
+                    collect( *i, features, styles, numUnnamed );
+                }
+                else if ( key == "style" || key == "stylemap" || key == "schema" )
+                {
+                    styles += i->toJSON();
+                }
+                else if (
+                    key == "placemark"     || key == "networklink"   ||
+                    key == "groundoverlay" || key == "screenoverlay" ||
+                    key == "photooverlay" )
+                {
+                    // features without an id are matched by their order.
+                    std::string id = i->value("id");
+                    if ( id.empty() )
+                        id = Stringify() << key << "#" << numUnnamed++;
+                    features[id] = &(*i);
+                }
+            }
+        }
+
+        void refresh()
+        {
+            osg::ref_ptr<MapNode> mapNode;
+            if ( !_mapNode.lock(mapNode) )
+                return;
+
+            ReadResult r = _uri.readString( _dbOptions.get(), _progress.get() );
+            if ( r.failed() )
+            {
+                OE_WARN << LC << "Failed to refresh " << _uri.full() << ": " << r.getResultCodeString() << std::endl;
+                return;
+            }
+
+            // nothing to do if the document did not change at all.
+            const std::string& text = r.getString();
+            unsigned docHash = hashString( text );
+            if ( docHash == _docHash && !_signatures.empty() )
+                return;
+            _docHash = docHash;
+
+            std::istringstream in( text );
+            osg::ref_ptr<XmlDocument> xml = XmlDocument::load( in, URIContext(_uri.full()) );
+            if ( !xml.valid() )
+                return;
+
+            Config conf = xml->getConfig();
+            const Config* top = conf.hasChild("kml") ? conf.child_ptr("kml") : &conf;
+
+            Features    features;
+            std::string styles;
+            unsigned    numUnnamed = 0;
+            collect( *top, features, styles, numUnnamed );
+
+            unsigned styleHash = hashString( styles );
+            bool     rebuildAll = styleHash != _styleHash;
+            _styleHash = styleHash;
+
+            KMLContext cx;
+            cx._mapNode   = mapNode.get();
+            cx._sheet     = new StyleSheet();
+            cx._options   = &_options;
+            cx._srs       = SpatialReference::create( "wgs84", "egm96" );
+            cx._dbOptions = _dbOptions.get();
+
+            // shared styles, for the features that use them:
+            KML_Root root;
+            root.scan ( *top, cx );
+            root.scan2( *top, cx );
+
+            PendingChanges::Changed changed;
+            std::map<std::string, unsigned> signatures;
+
+            for( Features::const_iterator i = features.begin(); i != features.end(); ++i )
+            {
+                const Config& fconf = *i->second;
+                unsigned signature = hashString( fconf.toJSON() );
+                signatures[i->first] = signature;
+
+                std::map<std::string, unsigned>::const_iterator old = _signatures.find( i->first );
+                if ( !rebuildAll && old != _signatures.end() && old->second == signature )
+                    continue;
+
+                osg::ref_ptr<osg::Group> group = new osg::Group();
+                cx._groupStack.push( group.get() );
+
+                const std::string& key = fconf.key();
+                if      ( key == "placemark" )     build_one( Placemark,     fconf, cx )
+                else if ( key == "networklink" )   build_one( NetworkLink,   fconf, cx )
+                else if ( key == "groundoverlay" ) build_one( GroundOverlay, fconf, cx )
+                else if ( key == "screenoverlay" ) build_one( ScreenOverlay, fconf, cx )
+                else if ( key == "photooverlay" )  build_one( PhotoOverlay,  fconf, cx )
+
+                cx._groupStack.pop();
+                changed[i->first] = group.get();
+            }
+
+            std::set<std::string> removed;
+            for( std::map<std::string, unsigned>::const_iterator i = _signatures.begin(); i != _signatures.end(); ++i )
+            {
+                if ( signatures.find(i->first) == signatures.end() )
+                    removed.insert( i->first );
+            }
+
+            _signatures.swap( signatures );
+
+            OE_DEBUG << LC << "Refreshed " << _uri.full() << ": " << changed.size() << " rebuilt, "
+                << removed.size() << " removed, " << (_signatures.size() - changed.size()) << " unchanged" << std::endl;
+
+            if ( changed.empty() && removed.empty() )
+                return;
+
+            Threading::ScopedMutexLock lock( _pending->_mutex );
+            for( PendingChanges::Changed::const_iterator i = changed.begin(); i != changed.end(); ++i )
+            {
+                _pending->_changed[i->first] = i->second.get();
+                _pending->_removed.erase( i->first );
+            }
+            for( std::set<std::string>::const_iterator i = removed.begin(); i != removed.end(); ++i )
+            {
+                _pending->_changed.erase( *i );
+                _pending->_removed.insert( *i );
+            }
+        }
+
+        URI                                _uri;
+        double                             _interval;
+        osg::observer_ptr<MapNode>         _mapNode;
+        KMLOptions                         _options;
+        osg::ref_ptr<const osgDB::Options> _dbOptions;
+        osg::ref_ptr<PendingChanges>       _pending;
+        osg::ref_ptr<ProgressCallback>     _progress;
+        unsigned                           _docHash;
+        unsigned                           _styleHash;
+        std::map<std::string, unsigned>    _signatures;  // hash of each feature's KML, by id
+    };
+
+    /** Swaps refreshed features into the graph, and stops refreshing with the graph. */
+    struct RefreshCallback : public osg::NodeCallback
+    {
+        RefreshCallback( LinkRefresher* refresher, PendingChanges* pending )
+            : _refresher( refresher ), _pending( pending ) { }
+
+        void operator()( osg::Node* node, osg::NodeVisitor* nv )
+        {
+            PendingChanges::Changed changed;
+            std::set<std::string>   removed;
+            {
+                Threading::ScopedMutexLock lock( _pending->_mutex );
+                changed.swap( _pending->_changed );
+                removed.swap( _pending->_removed );
+            }
+
+            osg::Group* root = node->asGroup();
+
+            for( PendingChanges::Changed::const_iterator i = changed.begin(); i != changed.end(); ++i )
+            {
+                osg::ref_ptr<osg::Group>& current = _features[i->first];
+                if ( current.valid() )
+                    root->replaceChild( current.get(), i->second.get() );
+                else
+                    root->addChild( i->second.get() );
+                current = i->second.get();
+            }
+
+            for( std::set<std::string>::const_iterator i = removed.begin(); i != removed.end(); ++i )
+            {
+                Features::iterator f = _features.find( *i );
+                if ( f != _features.end() )
+                {
+                    root->removeChild( f->second.get() );
+                    _features.erase( f );
+                }
+            }
+
+            traverse( node, nv );
+        }
+
+        virtual ~RefreshCallback()
+        {
+            _refresher->cancel();
+        }
+
+        typedef std::map<std::string, osg::ref_ptr<osg::Group> > Features;
+
+        osg::ref_ptr<LinkRefresher>  _refresher;
+        osg::ref_ptr<PendingChanges> _pending;
+        Features                     _features;
+    };
+}
+
 void
 KML_NetworkLink::build( const Config& conf, KMLContext& cx )
 {
@@ -36,6 +326,8 @@ KML_NetworkLink::build( const Config& conf, KMLContext& cx )
     // parse the link:
     std::string href = KMLUtils::parseLink(conf);
 
+    const Config& linkConf = conf.hasChild("link") ? conf.child("link") : conf.child("url");
+
     // "open" determines whether to load it immediately
     bool open = conf.value<bool>("open", false);
 
@@ -103,6 +395,30 @@ KML_NetworkLink::build( const Config& conf, KMLContext& cx )
         cx._groupStack.top()->addChild( plod );
     }
 
+    else if ( toLower(linkConf.value("refreshmode")) == "oninterval" && linkConf.value<double>("refreshinterval", 0.0) > 0.0 )
+    {
+        // a live link: refreshed on a thread, and updated feature by feature.
+        URI uri( href, URIContext(cx._dbOptions.get()) );
+        double interval = linkConf.value<double>( "refreshinterval", 0.0 );
+
+        osg::Group* group = new osg::Group();
+        group->setName( name );
+
+        if ( cx._options->declutter() == true )
+        {
+            Decluttering::setEnabled( group->getOrCreateStateSet(), true );
+        }
+
+        osg::ref_ptr<PendingChanges> pending   = new PendingChanges();
+        osg::ref_ptr<LinkRefresher>  refresher = new LinkRefresher( uri, interval, cx._mapNode, *cx._options, cx._dbOptions.get(), pending.get() );
+        group->setUpdateCallback( new RefreshCallback(refresher.get(), pending.get()) );
+        refresher->start();
+
+        OE_INFO << LC << "Refreshing " << uri.full() << " every " << interval << "s" << std::endl;
+
+        cx._groupStack.top()->addChild( group );
+    }
+
     else 
     {
         osg::ProxyNode* proxy = new osg::ProxyNode();
@@ -24,12 +24,42 @@
 #include <osgDB/ObjectWrapper>
 #include <osgEarth/HTTPClient>
 #include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
 #include <osgEarth/ThreadingUtils>
+#include <cstring>
+#include <list>
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
 
 #define LC "[KMZArchive] "
 
+// smallest and largest HTTP range request for a remote archive, and how
+// many fetched bytes to keep around.
+#define MIN_FETCH   ( 64u * 1024u )
+#define MAX_FETCH   ( 4u * 1024u * 1024u )
+#define MAX_CACHED  ( 16u * 1024u * 1024u )
+
 using namespace osgEarth;
 
+/** Random-access bytes of an archive, which minizip reads through its I/O hooks. */
+struct KMZSource
+{
+    virtual ~KMZSource() { }
+
+    virtual unsigned long long size() const =0;
+
+    /** Copies up to "len" bytes at "offset" into "buf"; returns the number copied. */
+    virtual unsigned long read( unsigned long long offset, void* buf, unsigned long len ) =0;
+};
+
 namespace
 {
     URI downloadToCache( const URI& uri )
@@ -65,38 +95,415 @@ namespace
 
         return URI();
     }
+
+    /** A local archive, mapped into memory. */
+    class MappedFileSource : public KMZSource
+    {
+    public:
+        MappedFileSource( const std::string& path ) : _data( 0L ), _size( 0 )
+        {
+#ifdef _WIN32
+            _mapping = 0L;
+            _file = ::CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0L, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0L );
+            if ( _file != INVALID_HANDLE_VALUE )
+            {
+                LARGE_INTEGER size;
+                if ( ::GetFileSizeEx(_file, &size) && size.QuadPart > 0 )
+                {
+                    _mapping = ::CreateFileMappingA( _file, 0L, PAGE_READONLY, 0, 0, 0L );
+                    if ( _mapping )
+                    {
+                        _data = (const char*)::MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, 0 );
+                        if ( _data )
+                            _size = (unsigned long long)size.QuadPart;
+                    }
+                }
+            }
+#else
+            int fd = ::open( path.c_str(), O_RDONLY );
+            if ( fd >= 0 )
+            {
+                struct stat st;
+                if ( ::fstat(fd, &st) == 0 && st.st_size > 0 )
+                {
+                    void* p = ::mmap( 0L, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+                    if ( p != MAP_FAILED )
+                    {
+                        _data = (const char*)p;
+                        _size = (unsigned long long)st.st_size;
+                    }
+                }
+                ::close( fd ); // the mapping outlives the descriptor
+            }
+#endif
+        }
+
+        virtual ~MappedFileSource()
+        {
+#ifdef _WIN32
+            if ( _data )    ::UnmapViewOfFile( _data );
+            if ( _mapping ) ::CloseHandle( _mapping );
+            if ( _file != INVALID_HANDLE_VALUE ) ::CloseHandle( _file );
+#else
+            if ( _data )
+                ::munmap( (void*)_data, (size_t)_size );
+#endif
+        }
+
+        bool valid() const { return _data != 0L; }
+
+        unsigned long long size() const { return _size; }
+
+        unsigned long read( unsigned long long offset, void* buf, unsigned long len )
+        {
+            if ( offset >= _size )
+                return 0;
+            if ( len > _size - offset )
+                len = (unsigned long)(_size - offset);
+            ::memcpy( buf, _data + offset, len );
+            return len;
+        }
+
+    private:
+        const char*        _data;
+        unsigned long long _size;
+#ifdef _WIN32
+        HANDLE             _file;
+        HANDLE             _mapping;
+#endif
+    };
+
+    /**
+     * A remote archive, read with HTTP range requests. Fetched spans are
+     * kept (up to MAX_CACHED bytes), and a run of sequential reads fetches
+     * progressively larger spans, so streaming out one big entry takes a few
+     * requests rather than one per minizip buffer.
+     */
+    class RemoteSource : public KMZSource
+    {
+    public:
+        RemoteSource( const std::string& url ) :
+          _url        ( url ),
+          _size       ( 0 ),
+          _nextOffset ( 0 ),
+          _fetchSize  ( MIN_FETCH ),
+          _cachedBytes( 0 )
+        {
+            // the zip directory is at the end of the file, so start with the
+            // tail; the reply also gives the size of the file.
+            std::stringstream range;
+            range << "bytes=-" << MIN_FETCH;
+            fetch( range.str() );
+        }
+
+        bool valid() const { return _size > 0; }
+
+        unsigned long long size() const { return _size; }
+
+        unsigned long read( unsigned long long offset, void* buf, unsigned long len )
+        {
+            if ( offset >= _size )
+                return 0;
+            if ( len > _size - offset )
+                len = (unsigned long)(_size - offset);
+
+            const Span* span = findSpan( offset, len );
+            if ( !span )
+            {
+                _fetchSize = offset == _nextOffset ? osg::minimum(_fetchSize*2u, MAX_FETCH) : MIN_FETCH;
+
+                unsigned long long count = osg::maximum( (unsigned long long)len, (unsigned long long)_fetchSize );
+                count = osg::minimum( count, _size - offset );
+
+                std::stringstream range;
+                range << "bytes=" << offset << "-" << (offset + count - 1);
+                if ( fetch(range.str()) )
+                    span = findSpan( offset, len );
+                if ( !span )
+                    return 0;
+            }
+
+            ::memcpy( buf, span->second.data() + (offset - span->first), len );
+            _nextOffset = offset + len;
+            return len;
+        }
+
+    private:
+        typedef std::pair<unsigned long long, std::string> Span;
+        typedef std::list<Span> Spans;  // oldest first
+
+        const Span* findSpan( unsigned long long offset, unsigned long len ) const
+        {
+            for( Spans::const_reverse_iterator i = _spans.rbegin(); i != _spans.rend(); ++i )
+            {
+                if ( i->first <= offset && offset + len <= i->first + i->second.size() )
+                    return &(*i);
+            }
+            return 0L;
+        }
+
+        bool fetch( const std::string& range )
+        {
+            HTTPRequest request( _url );
+            request.addHeader( "Range", range );
+            HTTPResponse response = HTTPClient::get( request );
+
+            Span span;
+            if ( response.getCode() == HTTPResponse::PARTIAL && response.getNumParts() > 0 )
+            {
+                // Content-Range: bytes first-last/total
+                const std::string& cr = response.getPartHeader( 0, IOMetadata::CONTENT_RANGE );
+                std::string::size_type first = cr.find_first_of( "0123456789" );
+                std::string::size_type dash  = cr.find( '-', first );
+                std::string::size_type slash = cr.find( '/', dash );
+                if ( first == std::string::npos || dash == std::string::npos || slash == std::string::npos )
+                    return false;
+
+                span.first = as<unsigned long long>( cr.substr(first, dash-first), 0ull );
+                _size      = as<unsigned long long>( trim(cr.substr(slash+1)), 0ull );
+            }
+            else if ( response.isOK() && response.getNumParts() > 0 )
+            {
+                // no range support; the reply is the whole file.
+                span.first = 0;
+                _size      = response.getPartSize( 0 );
+                _spans.clear();
+                _cachedBytes = 0;
+            }
+            else
+            {
+                return false;
+            }
+
+            span.second = response.getPartAsString( 0 );
+            _cachedBytes += span.second.size();
+            _spans.push_back( span );
+
+            while( _cachedBytes > MAX_CACHED && _spans.size() > 1 )
+            {
+                _cachedBytes -= _spans.front().second.size();
+                _spans.pop_front();
+            }
+            return true;
+        }
+
+        std::string        _url;
+        unsigned long long _size;
+        unsigned long long _nextOffset;
+        unsigned           _fetchSize;
+        Spans              _spans;
+        unsigned long long _cachedBytes;
+    };
+
+    // minizip I/O hooks over a KMZSource (the "opaque" pointer).
+    struct ZipStream
+    {
+        KMZSource*         _source;
+        unsigned long long _pos;
+    };
+
+    voidpf ZCALLBACK zipOpen( voidpf opaque, const char* filename, int mode )
+    {
+        ZipStream* stream = new ZipStream();
+        stream->_source = static_cast<KMZSource*>( opaque );
+        stream->_pos    = 0;
+        return stream;
+    }
+
+    uLong ZCALLBACK zipRead( voidpf opaque, voidpf stream, void* buf, uLong size )
+    {
+        ZipStream* s = static_cast<ZipStream*>( stream );
+        uLong count = s->_source->read( s->_pos, buf, size );
+        s->_pos += count;
+        return count;
+    }
+
+    uLong ZCALLBACK zipWrite( voidpf opaque, voidpf stream, const void* buf, uLong size )
+    {
+        return 0; // read-only
+    }
+
+    long ZCALLBACK zipTell( voidpf opaque, voidpf stream )
+    {
+        return (long)static_cast<ZipStream*>( stream )->_pos;
+    }
+
+    long ZCALLBACK zipSeek( voidpf opaque, voidpf stream, uLong offset, int origin )
+    {
+        ZipStream* s = static_cast<ZipStream*>( stream );
+        unsigned long long pos;
+        switch( origin )
+        {
+        case ZLIB_FILEFUNC_SEEK_SET: pos = offset; break;
+        case ZLIB_FILEFUNC_SEEK_CUR: pos = s->_pos + offset; break;
+        case ZLIB_FILEFUNC_SEEK_END: pos = s->_source->size() + offset; break;
+        default: return -1;
+        }
+        if ( pos > s->_source->size() )
+            return -1;
+        s->_pos = pos;
+        return 0;
+    }
+
+    int ZCALLBACK zipClose( voidpf opaque, voidpf stream )
+    {
+        delete static_cast<ZipStream*>( stream );
+        return 0;
+    }
+
+    int ZCALLBACK zipError( voidpf opaque, voidpf stream )
+    {
+        return 0;
+    }
 }
 
 //------------------------------------------------------------------------
 
 KMZArchive::KMZArchive( const URI& archiveURI ) :
 _archiveURI( archiveURI ),
-_buf( 0L ),
-_bufsize( 1024000 )
+_uf        ( 0L ),
+_source    ( 0L ),
+_buf       ( 0L ),
+_bufsize   ( 1024000 )
 {
     supportsExtension( "kmz", "KMZ" );
 
-    // download the KMZ to a local cache - cannot open zip files remotely.
-    URI localURI( archiveURI );
-    if ( osgDB::containsServerAddress(archiveURI.full()) )
+    if ( openSource(archiveURI) )
     {
-        localURI = downloadToCache( archiveURI );
+        buildIndex();
+    }
+    else
+    {
+        OE_WARN << LC << "Cannot open archive " << archiveURI.full() << std::endl;
     }
 
-    _uf = unzOpen( localURI.full().c_str() );
     _buf = (void*)new char[_bufsize];
 }
 
 KMZArchive::~KMZArchive()
 {
+    close();
+
     if ( _buf )
-        delete [] _buf;
+        delete [] (char*)_buf;
+}
+
+bool
+KMZArchive::openSource( const URI& uri )
+{
+    std::string localPath = uri.full();
+
+    if ( osgDB::containsServerAddress(uri.full()) )
+    {
+        RemoteSource* remote = new RemoteSource( uri.full() );
+        if ( remote->valid() )
+        {
+            _source = remote;
+        }
+        else
+        {
+            // no partial requests; fall back on downloading the whole thing.
+            delete remote;
+            localPath = downloadToCache( uri ).full();
+            if ( localPath.empty() )
+                return false;
+        }
+    }
+
+    if ( !_source )
+    {
+        MappedFileSource* mapped = new MappedFileSource( localPath );
+        if ( mapped->valid() )
+        {
+            _source = mapped;
+        }
+        else
+        {
+            delete mapped;
+            _uf = unzOpen( localPath.c_str() );
+            return _uf != 0L;
+        }
+    }
+
+    zlib_filefunc_def io;
+    io.zopen_file  = zipOpen;
+    io.zread_file  = zipRead;
+    io.zwrite_file = zipWrite;
+    io.ztell_file  = zipTell;
+    io.zseek_file  = zipSeek;
+    io.zclose_file = zipClose;
+    io.zerror_file = zipError;
+    io.opaque      = _source;
+
+    _uf = unzOpen2( uri.full().c_str(), &io );
+    return _uf != 0L;
+}
+
+void
+KMZArchive::buildIndex()
+{
+    char filename_inzip[2048];
+    unz_file_info file_info;
+
+    for( int err = unzGoToFirstFile(_uf); err == UNZ_OK; err = unzGoToNextFile(_uf) )
+    {
+        if ( unzGetCurrentFileInfo( _uf, &file_info, filename_inzip, sizeof(filename_inzip), 0L, 0, 0L, 0) != UNZ_OK )
+        {
+            OE_WARN << LC << "Error with zipfile " << _archiveURI.base() << std::endl;
+            break;
+        }
+
+        unz_file_pos pos;
+        if ( unzGetFilePos(_uf, &pos) != UNZ_OK )
+            continue;
+
+        std::string name( filename_inzip );
+        std::string lc = osgEarth::toLower( name );
+        _index[name] = pos;
+        _lowerIndex.insert( std::make_pair(lc, pos) );
+
+        if ( _masterFile.empty() && endsWith(lc, ".kml") )
+            _masterFile = name;
+    }
+
+    // the master file is doc.kml, or failing that, the first KML file.
+    Index::const_iterator doc = _lowerIndex.find( "doc.kml" );
+    if ( doc != _lowerIndex.end() )
+        _masterFile = "doc.kml";
+
+    OE_DEBUG << LC << "Indexed " << _index.size() << " entries in " << _archiveURI.base() << std::endl;
+}
+
+bool
+KMZArchive::locate( const std::string& fileInZip ) const
+{
+    // ".kml" is a special case meaning the master file.
+    const std::string& name = fileInZip == ".kml" ? _masterFile : fileInZip;
+    if ( name.empty() )
+        return false;
+
+    Index::const_iterator i = _index.find( name );
+    if ( i == _index.end() )
+    {
+        i = _lowerIndex.find( osgEarth::toLower(name) );
+        if ( i == _lowerIndex.end() )
+            return false;
+    }
+
+    unz_file_pos pos = i->second;
+    return unzGoToFilePos( _uf, &pos ) == UNZ_OK;
 }
 
 void 
 KMZArchive::close()
 {
+    if ( _uf )
+        unzClose( _uf );
     _uf = 0;
+
+    if ( _source )
+        delete _source;
+    _source = 0L;
 }
 
 /** Get the file name which represents the archived file.*/
@@ -110,15 +517,16 @@ KMZArchive::getArchiveFileName() const
 std::string
 KMZArchive::getMasterFileName() const 
 {
-    return "doc.kml";
+    return _masterFile.empty() ? "doc.kml" : _masterFile;
 }
 
 /** return true if file exists in archive.*/
 bool
 KMZArchive::fileExists(const std::string& filename) const
 {
-    //todo
-    return false;
+    return
+        _index.find(filename) != _index.end() ||
+        _lowerIndex.find(osgEarth::toLower(filename)) != _lowerIndex.end();
 }
 
 /** return type of file. */
@@ -132,7 +540,9 @@ KMZArchive::getFileType(const std::string& filename) const
 bool 
 KMZArchive::getFileNames(FileNameList& fileNames) const
 {
-    return false;
+    for( Index::const_iterator i = _index.begin(); i != _index.end(); ++i )
+        fileNames.push_back( i->first );
+    return true;
 }
 
 /** return the contents of a directory.
@@ -150,14 +560,7 @@ KMZArchive::readToBuffer( const std::string& fileInZip, std::ostream& iobuf ) co
     // help from:
     // http://bytes.com/topic/c/answers/764381-reading-contents-zip-files
 
-
-    //OE_INFO << LC << "Attempting to read \"" << fileInZip << "\" from \"" << _archiveURI.base() << "\"" << std::endl;
-
-
     int err = UNZ_OK;
-    unz_file_info file_info;
-    char filename_inzip[2048];
-    bool got_file_info = false;
 
     if ( _uf == 0 )
     {
@@ -165,59 +568,15 @@ KMZArchive::readToBuffer( const std::string& fileInZip, std::ostream& iobuf ) co
         return false;
     }
 
-    if ( fileInZip == ".kml" )
-    {
-        // special case; first try the master file (doc.kml), then failing that, look
-        // for the first KML file in the archive.
-        if ( unzLocateFile( _uf, "doc.kml", 0 ) != 0 )
-        {
-            if ( unzGoToFirstFile( _uf ) != UNZ_OK )
-            {
-                OE_WARN << LC << "Archive is empty" << std::endl;
-                return false;
-            }
-
-            while( err == UNZ_OK )
-            {
-                if ( unzGetCurrentFileInfo( _uf, &file_info, filename_inzip, sizeof(filename_inzip), 0L, 0, 0L, 0) )
-                {
-                    OE_WARN << LC << "Error with zipfile " << _archiveURI.base() << std::endl;
-                    return false;
-                }
-
-                got_file_info = true;
-                std::string lc = osgEarth::toLower( std::string(filename_inzip) );
-                if ( endsWith( lc, ".kml" ) )
-                {
-                    break;
-                }
-
-                err = unzGoToNextFile( _uf );
-            }
-
-            if ( err != UNZ_OK )
-            {
-                OE_WARN << LC << "No KML file found in archive" << std::endl;
-                return false;
-            }
-        }
-    }
-
-    else if ( unzLocateFile( _uf, fileInZip.c_str(), 0 ) )
+    if ( !locate(fileInZip) )
     {
-        OE_WARN << LC << "Failed to locate '" << fileInZip << "' in '" << _archiveURI.base() << "'" << std::endl;
+        if ( fileInZip == ".kml" )
+            OE_WARN << LC << "No KML file found in archive" << std::endl;
+        else
+            OE_WARN << LC << "Failed to locate '" << fileInZip << "' in '" << _archiveURI.base() << "'" << std::endl;
         return false;
     }
 
-    if ( !got_file_info )
-    {
-        if ( unzGetCurrentFileInfo( _uf, &file_info, filename_inzip, sizeof(filename_inzip), 0L, 0, 0L, 0) )
-        {
-            OE_WARN << LC << "Error with zipfile " << _archiveURI.base() << std::endl;
-            return false;
-        }
-    }
-
     err = unzOpenCurrentFilePassword( _uf, 0L );
     if ( err != UNZ_OK )
     {
@@ -235,10 +594,7 @@ KMZArchive::readToBuffer( const std::string& fileInZip, std::ostream& iobuf ) co
         }
         if ( err > 0 )
         {
-            for( unsigned i=0; i<(unsigned)err; ++i )
-            {
-                iobuf.put( *(((char*)_buf)+i) );
-            }
+            iobuf.write( (const char*)_buf, err );
         }
     }
     while( err > 0 );
@@ -73,6 +73,19 @@ struct ReaderWriterKML : public osgDB::ReaderWriter
             // propagate the source URI along to the stream reader
             osg::ref_ptr<osgDB::Options> myOptions = Registry::instance()->cloneOrCreateOptions(dbOptions);
             URIContext(url).apply( myOptions.get() );
+
+            // a background load opens the file on its own thread.
+            MapNode* mapNode = dbOptions ? const_cast<MapNode*>(
+                static_cast<const MapNode*>( dbOptions->getPluginData("osgEarth::MapNode")) ) : 0L;
+            const KMLOptions* kmlOptions = dbOptions ?
+                static_cast<const KMLOptions*>( dbOptions->getPluginData("osgEarth::KMLOptions") ) : 0L;
+
+            if ( mapNode && kmlOptions && kmlOptions->loadInBackground() == true )
+            {
+                KMLReader reader( mapNode, kmlOptions );
+                return reader.readInBackground( URI(url), myOptions.get() );
+            }
+
             return readNode( URIStream(url), myOptions.get() );
         }
     }
@@ -18,7 +18,9 @@
  */
 #include <osgEarthFeatures/LabelSource>
 #include <osgEarthAnnotation/LabelNode>
+#include <osgEarthAnnotation/LabelLayoutCache>
 #include <osgEarth/DepthOffset>
+#include <osgEarth/StringUtils>
 #include <osgDB/FileNameUtils>
 #include <osgUtil/Optimizer>
 
@@ -65,6 +67,9 @@ public:
         StringExpression  contentExpr ( *text->content() );
         NumericExpression priorityExpr( *text->priority() );
 
+        // the same label often appears in many tiles; share its layout.
+        std::string layoutKey = LabelLayoutCache::getLayoutKey( text );
+
         if ( text->removeDuplicateLabels() == true )
         {
             // in remove-duplicates mode, make a list of unique features, selecting
@@ -105,7 +110,7 @@ public:
             {
                 const std::string& value = i->first;
                 const Feature* feature = i->second.second.get();
-                group->addChild( makeLabelNode(context, feature, value, styleCopy, priorityExpr) );
+                group->addChild( makeLabelNode(context, feature, value, styleCopy, priorityExpr, layoutKey) );
             }
         }
 
@@ -125,7 +130,7 @@ public:
                 if ( value.empty() )
                     continue;
 
-                group->addChild( makeLabelNode(context, feature, value, styleCopy, priorityExpr) );
+                group->addChild( makeLabelNode(context, feature, value, styleCopy, priorityExpr, layoutKey) );
             }
         }
 
@@ -143,20 +148,33 @@ public:
                              const Feature*       feature, 
                              const std::string&   value, 
                              const Style&         style, 
-                             NumericExpression&   priorityExpr )
+                             NumericExpression&   priorityExpr,
+                             const std::string&   layoutKey )
     {		
+		const TextSymbol* text = style.get<TextSymbol>();
+
+        // labels sharing a layout share its annotation data too, so keep
+        // different priorities apart.
+        double      priority = 0.0;
+        std::string labelKey = layoutKey;
+        if ( text->priority().isSet() )
+        {
+            priority = feature->eval( priorityExpr, &context );
+            labelKey += "|" + toString(priority);
+        }
+
         LabelNode* labelNode = new LabelNode(
             0L,
             GeoPoint(feature->getSRS(), feature->getGeometry()->getBounds().center(), ALTMODE_ABSOLUTE),
             value,
-            style );
-
-		const TextSymbol* text = style.get<TextSymbol>();
+            style,
+            LabelLayoutCache::instance(),
+            labelKey );
 
         if ( text->priority().isSet() )
         {
             AnnotationData* data = new AnnotationData();
-            data->setPriority( feature->eval(priorityExpr, &context) );
+            data->setPriority( priority );
             labelNode->setAnnotationData( data );
         }
 
@@ -0,0 +1,173 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/LabelSource>
+#include <osgEarthAnnotation/LabelBatch>
+#include <osgDB/FileNameUtils>
+#include <osg/MatrixTransform>
+
+using namespace osgEarth;
+using namespace osgEarth::Annotation;
+using namespace osgEarth::Features;
+
+/**
+ * Label provider that draws all the labels of a feature set with a single
+ * LabelBatch, rather than with one LabelNode per label.
+ * Select it with "text-provider: batch".
+ */
+class BatchLabelSource : public LabelSource
+{
+public:
+    BatchLabelSource( const LabelSourceOptions& options )
+        : LabelSource( options )
+    {
+        //nop
+    }
+
+    /**
+     * Creates a simple label. The caller is responsible for placing it in the scene.
+     */
+    osg::Node* createNode(
+        const std::string& text,
+        const Style&       style )
+    {
+        return 0L; // no support
+    }
+
+    /**
+     * Creates a batch of positioned labels from a feature list.
+     */
+    osg::Node* createNode(
+        const FeatureList&   input,
+        const Style&         style,
+        const FilterContext& context )
+    {
+        const TextSymbol* text = style.get<TextSymbol>();
+        if ( text == 0L )
+            return 0L;
+
+        StringExpression  contentExpr ( *text->content() );
+        NumericExpression priorityExpr( *text->priority() );
+
+        // collect the labels first so we can localize the batch around them.
+        std::vector<const Feature*> features;
+        std::vector<std::string>    values;
+
+        if ( text->removeDuplicateLabels() == true )
+        {
+            // in remove-duplicates mode, label only the feature with the
+            // largest area for each distinct label value.
+            typedef std::pair<double, const Feature*> Entry;
+            typedef std::map<std::string, Entry>      EntryMap;
+            EntryMap used;
+
+            for( FeatureList::const_iterator i = input.begin(); i != input.end(); ++i )
+            {
+                Feature* feature = i->get();
+                if ( feature && feature->getGeometry() )
+                {
+                    const std::string& value = feature->eval( contentExpr, &context );
+                    if ( !value.empty() )
+                    {
+                        double area = feature->getGeometry()->getBounds().area2d();
+                        EntryMap::iterator u = used.find( value );
+                        if ( u == used.end() || area > u->second.first )
+                            used[value] = Entry(area, feature);
+                    }
+                }
+            }
+
+            for( EntryMap::const_iterator i = used.begin(); i != used.end(); ++i )
+            {
+                values.push_back( i->first );
+                features.push_back( i->second.second );
+            }
+        }
+        else
+        {
+            for( FeatureList::const_iterator i = input.begin(); i != input.end(); ++i )
+            {
+                const Feature* feature = i->get();
+                if ( !feature || !feature->getGeometry() )
+                    continue;
+
+                const std::string& value = feature->eval( contentExpr, &context );
+                if ( value.empty() )
+                    continue;
+
+                values.push_back( value );
+                features.push_back( feature );
+            }
+        }
+
+        if ( features.empty() )
+            return 0L;
+
+        // world-space anchors, relative to the first one to preserve precision.
+        std::vector<osg::Vec3d> anchors( features.size() );
+        for( unsigned i = 0; i < features.size(); ++i )
+        {
+            GeoPoint point( features[i]->getSRS(), features[i]->getGeometry()->getBounds().center(), ALTMODE_ABSOLUTE );
+            point.toWorld( anchors[i] );
+        }
+
+        osg::Vec3d origin = anchors[0];
+
+        LabelBatch* batch = new LabelBatch( text );
+        if ( text->declutter().isSet() )
+            batch->setDeclutter( *text->declutter() );
+
+        for( unsigned i = 0; i < features.size(); ++i )
+        {
+            float priority = text->priority().isSet() ?
+                (float)features[i]->eval( priorityExpr, &context ) : 0.0f;
+
+            batch->addLabel( values[i], anchors[i] - origin, priority );
+        }
+
+        osg::MatrixTransform* xform = new osg::MatrixTransform( osg::Matrix::translate(origin) );
+        xform->addChild( batch );
+        return xform;
+    }
+};
+
+//------------------------------------------------------------------------
+
+class BatchLabelSourceDriver : public LabelSourceDriver
+{
+public:
+    BatchLabelSourceDriver()
+    {
+        supportsExtension( "osgearth_label_batch", "osgEarth batched label plugin" );
+    }
+
+    virtual const char* className()
+    {
+        return "osgEarth Batched Label Plugin";
+    }
+
+    virtual ReadResult readObject(const std::string& file_name, const Options* options) const
+    {
+        if ( !acceptsExtension(osgDB::getLowerCaseFileExtension( file_name )))
+            return ReadResult::FILE_NOT_HANDLED;
+
+        return new BatchLabelSource( getLabelSourceOptions(options) );
+    }
+};
+
+REGISTER_OSGPLUGIN(osgearth_label_batch, BatchLabelSourceDriver)
@@ -99,6 +99,11 @@ public:
         StringExpression  contentExpr ( *text->content() );
         NumericExpression priorityExpr( *text->priority() );
 
+        // load the font once for all the labels.
+        osg::ref_ptr<osgText::Font> font;
+        if ( text->font().isSet() )
+            font = osgText::readFontFile( *text->font() );
+
         //bool makeECEF = false;
         const SpatialReference* ecef = 0L;
         if ( context.isGeoreferenced() )
@@ -143,8 +148,8 @@ public:
                     label->setHaloColor( text->halo()->color() );
                 if ( text->size().isSet() )
                     label->setFontSize( *text->size() );
-                if ( text->font().isSet() )
-                    label->setFont( osgText::readFontFile(*text->font()) );
+                if ( font.valid() )
+                    label->setFont( font.get() );
 
                 Controls::ControlNode* node = new Controls::ControlNode( label, priority );
 
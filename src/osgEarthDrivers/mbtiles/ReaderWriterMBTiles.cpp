@@ -23,6 +23,8 @@
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -33,24 +35,118 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <map>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
+using namespace osgEarth::Threading;
 
 #include <sqlite3.h>
 
 
 #define LC "[MBTilesSource] "
 
+// number of stored tiles to collect in one transaction
+#define WRITE_BATCH_SIZE 256
+
+namespace
+{
+    /**
+     * A connection to the database along with its prepared statements, so
+     * each statement is compiled once per connection instead of once per tile.
+     */
+    struct Connection : public osg::Referenced
+    {
+        Connection() : _db( 0L ) { }
+
+        bool open( const std::string& filename, bool writable )
+        {
+            // each connection is only ever used by one thread at a time.
+            int flags = SQLITE_OPEN_NOMUTEX;
+            flags |= writable ? (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) : SQLITE_OPEN_READONLY;
+
+            if ( sqlite3_open_v2( filename.c_str(), &_db, flags, 0L ) != SQLITE_OK )
+            {
+                OE_WARN << LC << "Failed to open database \"" << filename << "\": " << sqlite3_errmsg(_db) << std::endl;
+                sqlite3_close( _db );
+                _db = 0L;
+                return false;
+            }
+
+            sqlite3_busy_timeout( _db, 60000 );
+            return true;
+        }
+
+        bool exec( const std::string& sql )
+        {
+            char* errMsg = 0L;
+            if ( sqlite3_exec( _db, sql.c_str(), 0L, 0L, &errMsg ) != SQLITE_OK )
+            {
+                OE_WARN << LC << "SQL error (" << sql << "): " << (errMsg ? errMsg : "unknown") << std::endl;
+                sqlite3_free( errMsg );
+                return false;
+            }
+            return true;
+        }
+
+        // returns a cached statement for the SQL, reset and with no bindings.
+        sqlite3_stmt* prepare( const std::string& sql )
+        {
+            Statements::iterator i = _statements.find( sql );
+            if ( i != _statements.end() )
+            {
+                sqlite3_reset( i->second );
+                sqlite3_clear_bindings( i->second );
+                return i->second;
+            }
+
+            sqlite3_stmt* stmt = 0L;
+            if ( sqlite3_prepare_v2( _db, sql.c_str(), sql.length(), &stmt, 0L ) != SQLITE_OK )
+            {
+                OE_WARN << LC << "Failed to prepare SQL: " << sql << "; " << sqlite3_errmsg(_db) << std::endl;
+                sqlite3_finalize( stmt );
+                return 0L;
+            }
+            _statements[sql] = stmt;
+            return stmt;
+        }
+
+        sqlite3* _db;
+
+    protected:
+        virtual ~Connection()
+        {
+            for( Statements::iterator i = _statements.begin(); i != _statements.end(); ++i )
+                sqlite3_finalize( i->second );
+            if ( _db )
+                sqlite3_close( _db );
+        }
+
+        typedef std::map<std::string, sqlite3_stmt*> Statements;
+        Statements _statements;
+    };
+
+    // locks a mutex if there is one.
+    struct OptionalLock
+    {
+        OptionalLock( Mutex* mutex ) : _mutex( mutex ) { if ( _mutex ) _mutex->lock(); }
+        ~OptionalLock() { if ( _mutex ) _mutex->unlock(); }
+        Mutex* _mutex;
+    };
+}
+
+
 class MBTilesSource : public TileSource
 {
 public:
     MBTilesSource( const TileSourceOptions& options ) :
       TileSource( options ),
       _options( options ),      
-      _database( NULL ),
       _minLevel( 0 ),
-      _maxLevel( 20 )
+      _maxLevel( 20 ),
+      _pendingWrites( 0 ),
+      _inTransaction( false ),
+      _levelsKnown( false )
     {
     }
 
@@ -76,22 +172,35 @@ public:
         }
 #endif
 
-        int flags = SQLITE_OPEN_READONLY;
-        int rc = sqlite3_open_v2( _options.filename()->c_str(), &_database, flags, 0L );
-        if ( rc != 0 )
-        {                        
-            std::stringstream buf;
-            buf << "Failed to open database \"" << *_options.filename() << "\": " << sqlite3_errmsg(_database);
-            return Status::Error(buf.str());
+        _filename = _options.filename().value();
+
+        // In write mode every thread shares the one read-write connection
+        // (sqlite allows only one writer anyway); in read mode each thread
+        // gets a read-only connection of its own.
+        if ( _options.writable() == true )
+        {
+            osg::ref_ptr<Connection> conn = new Connection();
+            if ( !conn->open(_filename, true) || !createTables(conn.get()) )
+            {
+                return Status::Error( Stringify() << "Failed to open database \"" << _filename << "\" for writing" );
+            }
+            _writeConnection = conn.get();
+        }
+
+        OptionalLock lock( getConnectionMutex() );
+        Connection* conn = getConnection();
+        if ( !conn )
+        {
+            return Status::Error( Stringify() << "Failed to open database \"" << _filename << "\"" );
         }
 
         //Print out some metadata
         std::string name, type, version, description, format;
-        getMetaData( "name", name );
-        getMetaData( "type", type);
-        getMetaData( "version", version );
-        getMetaData( "description", description );
-        getMetaData( "format", format );
+        getMetaData( conn, "name", name );
+        getMetaData( conn, "type", type);
+        getMetaData( conn, "version", version );
+        getMetaData( conn, "description", description );
+        getMetaData( conn, "format", format );
         OE_NOTICE << "name=" << name << std::endl
                   << "type=" << type << std::endl
                   << "version=" << version << std::endl
@@ -117,10 +226,26 @@ public:
 
         OE_DEBUG << LC <<  "_tileFormat = " << _tileFormat << std::endl;
 
+        // A new database needs the required metadata filled in.
+        if ( _writeConnection.valid() )
+        {
+            if ( name.empty() )
+                setMetaData( conn, "name", osgDB::getStrippedName(_filename) );
+            if ( type.empty() )
+                setMetaData( conn, "type", "baselayer" );
+            if ( version.empty() )
+                setMetaData( conn, "version", "1.0" );
+            if ( description.empty() )
+                setMetaData( conn, "description", "" );
+            if ( format.empty() )
+                setMetaData( conn, "format", _tileFormat );
+            setMetaData( conn, "bounds", "-180.0,-85.0511,180.0,85.0511" );
+        }
+
         //Get the ReaderWriter
         _rw = osgDB::Registry::instance()->getReaderWriterForExtension( _tileFormat );
 
-        computeLevels();
+        computeLevels( conn );
 
         _emptyImage = ImageUtils::createEmptyImage( 256, 256 );
         
@@ -135,91 +260,165 @@ public:
         int x = key.getTileX();
         int y = key.getTileY();
 
-        if (z < (int)_minLevel)
+        unsigned int numRows, numCols;
+        key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
+        y  = numRows - y - 1;
+
+        //Get the image
+        std::string imageString;
         {
-            return _emptyImage.get();            
+            OptionalLock lock( getConnectionMutex() );
+
+            if (z < (int)_minLevel)
+            {
+                return _emptyImage.get();            
+            }
+
+            if (z > (int)_maxLevel)
+            {
+                //If we're at the max level, just return NULL
+                return NULL;
+            }
+
+            Connection* conn = getConnection();
+            if ( !conn )
+                return NULL;
+
+            std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+            sqlite3_stmt* select = conn->prepare( query );
+            if ( !select )
+                return NULL;
+
+            sqlite3_bind_int( select, 1, z );
+            sqlite3_bind_int( select, 2, x );
+            sqlite3_bind_int( select, 3, y );
+
+            int rc = sqlite3_step( select );
+            if ( rc == SQLITE_ROW)
+            {                     
+                // the pointer returned from _blob gets freed internally by sqlite, supposedly
+                const char* data = (const char*)sqlite3_column_blob( select, 0 );
+                int imageBufLen = sqlite3_column_bytes( select, 0 );
+                imageString.assign( data, imageBufLen );
+            }
+            else
+            {
+                OE_DEBUG << LC << "SQL QUERY failed for " << query << ": " << std::endl;
+            }
+
+            // end the read right away instead of when the statement is next used.
+            sqlite3_reset( select );
         }
 
-        if (z > (int)_maxLevel)
-        {
-            //If we're at the max level, just return NULL
+        if ( imageString.empty() || !_rw.valid() )
             return NULL;
+
+        // deserialize the image from the buffer:
+        osg::Image* result = NULL;
+        std::stringstream imageBufStream( imageString );
+        osgDB::ReaderWriter::ReadResult rr = _rw->readImage( imageBufStream );
+        if (rr.validImage())
+        {
+            result = rr.takeImage();                
+        }
+        return result;
+    }
+
+    // override
+    bool isWritable() const
+    {
+        return _writeConnection.valid();
+    }
+
+    // override
+    bool storeImage( const TileKey& key, osg::Image* image, ProgressCallback* progress )
+    {
+        if ( !_writeConnection.valid() || !image || !_rw.valid() )
+            return false;
+
+        // encode before taking the lock.
+        std::stringstream buf;
+        osgDB::ReaderWriter::WriteResult wr = _rw->writeImage( *image, buf, _dbOptions.get() );
+        if ( !wr.success() )
+        {
+            OE_WARN << LC << "Failed to encode tile " << key.str() << " as " << _tileFormat << std::endl;
+            return false;
         }
+        std::string data = buf.str();
+
+        int z = key.getLevelOfDetail();
+        int x = key.getTileX();
+        int y = key.getTileY();
 
         unsigned int numRows, numCols;
         key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
         y  = numRows - y - 1;
 
-        //Get the image
-        sqlite3_stmt* select = NULL;
-        std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-        int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &select, 0L );
-        if ( rc != SQLITE_OK )
+        ScopedMutexLock lock( _writeMutex );
+        Connection* conn = _writeConnection.get();
+
+        // group the writes into transactions; one per tile is very slow.
+        if ( !_inTransaction )
         {
-            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
-            return NULL;
+            if ( !conn->exec("BEGIN") )
+                return false;
+            _inTransaction = true;
         }
 
-        bool valid = true;        
-        sqlite3_bind_int( select, 1, z );
-        sqlite3_bind_int( select, 2, x );
-        sqlite3_bind_int( select, 3, y );
+        std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
+        sqlite3_stmt* insert = conn->prepare( query );
+        if ( !insert )
+            return false;
 
+        sqlite3_bind_int ( insert, 1, z );
+        sqlite3_bind_int ( insert, 2, x );
+        sqlite3_bind_int ( insert, 3, y );
+        sqlite3_bind_blob( insert, 4, data.c_str(), data.length(), SQLITE_STATIC );
 
-        osg::Image* result = NULL;
-        rc = sqlite3_step( select );
-        if ( rc == SQLITE_ROW)
-        {                     
-            // the pointer returned from _blob gets freed internally by sqlite, supposedly
-            const char* data = (const char*)sqlite3_column_blob( select, 0 );
-            int imageBufLen = sqlite3_column_bytes( select, 0 );
-
-            // deserialize the image from the buffer:
-            std::string imageString( data, imageBufLen );
-            std::stringstream imageBufStream( imageString );
-            osgDB::ReaderWriter::ReadResult rr = _rw->readImage( imageBufStream );
-            if (rr.validImage())
-            {
-                result = rr.takeImage();                
-            }
+        int rc = sqlite3_step( insert );
+        sqlite3_reset( insert );
+        if ( rc != SQLITE_DONE )
+        {
+            OE_WARN << LC << "Failed to store tile " << key.str() << ": " << sqlite3_errmsg(conn->_db) << std::endl;
+            return false;
         }
-        else
+
+        if ( !_levelsKnown )
         {
-            OE_DEBUG << LC << "SQL QUERY failed for " << query << ": " << std::endl;
-            valid = false;
+            // the first tile sets the range; the table might have been empty.
+            _minLevel = _maxLevel = z;
+            _levelsKnown = true;
         }
+        _minLevel = osg::minimum( _minLevel, (unsigned)z );
+        _maxLevel = osg::maximum( _maxLevel, (unsigned)z );
 
-        sqlite3_finalize( select );
-        return result;
+        if ( ++_pendingWrites >= WRITE_BATCH_SIZE )
+            commit();
 
+        return true;
     }
 
-    bool getMetaData( const std::string& key, std::string& value )
+    bool getMetaData( Connection* conn, const std::string& key, std::string& value )
     {
         //get the metadata
-        sqlite3_stmt* select = NULL;
         std::string query = "SELECT value from metadata where name = ?";
-        int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+        sqlite3_stmt* select = conn->prepare( query );
+        if ( !select )
             return false;
-        }
-
 
         bool valid = true;
-        std::string keyStr = std::string( key );
-        rc = sqlite3_bind_text( select, 1, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
+        int rc = sqlite3_bind_text( select, 1, key.c_str(), key.length(), SQLITE_STATIC );
         if (rc != SQLITE_OK )
         {
-            OE_WARN << LC << "Failed to bind text: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+            OE_WARN << LC << "Failed to bind text: " << query << "; " << sqlite3_errmsg(conn->_db) << std::endl;
             return false;
         }
 
         rc = sqlite3_step( select );
         if ( rc == SQLITE_ROW)
         {                     
-            value = (char*)sqlite3_column_text( select, 0 );
+            const char* text = (const char*)sqlite3_column_text( select, 0 );
+            value = text ? text : "";
         }
         else
         {
@@ -227,25 +426,48 @@ public:
             valid = false;
         }
 
-        sqlite3_finalize( select );
+        sqlite3_reset( select );
         return valid;
     }
 
-    void computeLevels()
-    {        
-        sqlite3_stmt* select = NULL;
-        std::string query = "SELECT min(zoom_level), max(zoom_level) from tiles";
-        int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &select, 0L );
-        if ( rc != SQLITE_OK )
+    bool setMetaData( Connection* conn, const std::string& key, const std::string& value )
+    {
+        // the spec doesn't require a unique index on the name, so replace by hand.
+        sqlite3_stmt* remove = conn->prepare( "DELETE FROM metadata WHERE name = ?" );
+        if ( !remove )
+            return false;
+        sqlite3_bind_text( remove, 1, key.c_str(), key.length(), SQLITE_STATIC );
+        sqlite3_step( remove );
+        sqlite3_reset( remove );
+
+        sqlite3_stmt* insert = conn->prepare( "INSERT INTO metadata (name, value) VALUES (?, ?)" );
+        if ( !insert )
+            return false;
+        sqlite3_bind_text( insert, 1, key.c_str(), key.length(), SQLITE_STATIC );
+        sqlite3_bind_text( insert, 2, value.c_str(), value.length(), SQLITE_STATIC );
+        int rc = sqlite3_step( insert );
+        sqlite3_reset( insert );
+        if ( rc != SQLITE_DONE )
         {
-            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+            OE_WARN << LC << "Failed to write metadata \"" << key << "\": " << sqlite3_errmsg(conn->_db) << std::endl;
+            return false;
         }
+        return true;
+    }
 
-        rc = sqlite3_step( select );
-        if ( rc == SQLITE_ROW)
+    void computeLevels( Connection* conn )
+    {        
+        std::string query = "SELECT min(zoom_level), max(zoom_level) from tiles";
+        sqlite3_stmt* select = conn->prepare( query );
+        if ( !select )
+            return;
+
+        int rc = sqlite3_step( select );
+        if ( rc == SQLITE_ROW && sqlite3_column_type(select, 0) != SQLITE_NULL )
         {                     
             _minLevel = sqlite3_column_int( select, 0 );
             _maxLevel = sqlite3_column_int( select, 1 );
+            _levelsKnown = true;
             OE_NOTICE << "Min=" << _minLevel << " Max=" << _maxLevel << std::endl;
         }
         else
@@ -253,7 +475,7 @@ public:
             OE_DEBUG << LC << "SQL QUERY failed for " << query << ": " << std::endl;
         }
 
-        sqlite3_finalize( select );        
+        sqlite3_reset( select );
     }
 
     // override
@@ -262,9 +484,67 @@ public:
         return _tileFormat;
     }
 
+protected:
+    virtual ~MBTilesSource()
+    {
+        if ( _writeConnection.valid() )
+        {
+            ScopedMutexLock lock( _writeMutex );
+            commit();
+
+            if ( _levelsKnown )
+            {
+                setMetaData( _writeConnection.get(), "minzoom", Stringify() << _minLevel );
+                setMetaData( _writeConnection.get(), "maxzoom", Stringify() << _maxLevel );
+            }
+        }
+    }
+
 private:
+    // creates the MBTiles schema in a new database.
+    bool createTables( Connection* conn )
+    {
+        return
+            conn->exec( "CREATE TABLE IF NOT EXISTS metadata (name text, value text)" ) &&
+            conn->exec( "CREATE TABLE IF NOT EXISTS tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob)" ) &&
+            conn->exec( "CREATE UNIQUE INDEX IF NOT EXISTS tile_index on tiles (zoom_level, tile_column, tile_row)" );
+    }
+
+    // gets the calling thread's read connection, or the shared one in write mode.
+    // (caller holds the lock from getConnectionMutex)
+    Connection* getConnection()
+    {
+        if ( _writeConnection.valid() )
+            return _writeConnection.get();
+
+        osg::ref_ptr<Connection>& conn = _readConnections.get();
+        if ( !conn.valid() )
+        {
+            conn = new Connection();
+            conn->open( _filename, false );
+        }
+        return conn->_db ? conn.get() : 0L;
+    }
+
+    // the shared write connection needs a lock; the per-thread ones don't.
+    Mutex* getConnectionMutex()
+    {
+        return _writeConnection.valid() ? &_writeMutex : 0L;
+    }
+
+    // commits the open write transaction, if any. (caller holds _writeMutex)
+    void commit()
+    {
+        if ( _inTransaction )
+        {
+            _writeConnection->exec( "COMMIT" );
+            _inTransaction = false;
+            _pendingWrites = 0;
+        }
+    }
+
     const MBTilesOptions _options;    
-    sqlite3* _database;
+    std::string _filename;
     unsigned int _minLevel;
     unsigned int _maxLevel;
     osg::ref_ptr< osg::Image> _emptyImage;
@@ -273,6 +553,12 @@ private:
     osg::ref_ptr<osgDB::Options> _dbOptions;
     std::string _tileFormat;
 
+    PerThread< osg::ref_ptr<Connection> > _readConnections;
+    osg::ref_ptr<Connection>              _writeConnection;
+    Mutex                                 _writeMutex;
+    unsigned                              _pendingWrites;
+    bool                                  _inTransaction;
+    bool                                  _levelsKnown;
 };
 
 
@@ -27,8 +27,17 @@
 #include <osg/LOD>
 #include <osg/Notify>
 #include <osg/MatrixTransform>
+#include <osgEarth/ThreadingUtils>
 #include <osg/io_utils>
+#include <osg/PagedLOD>
 #include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <map>
+#include <sstream>
+
+#define LC "[SimpleModelSource] "
+
+#define PSEUDO_EXTENSION "osgearth_pseudo_simple"
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
@@ -72,11 +81,137 @@ namespace
 
 //--------------------------------------------------------------------------
 
+class SimpleModelSource;
+
+// pseudo-loader registry, for paging tiles in through the model source that
+// owns them. A tile's pseudo-URI is "<real path>.<uid>.osgearth_pseudo_simple".
+
+namespace
+{
+    Threading::ReadWriteMutex _sourcesMutex;
+    typedef std::map<UID, osg::observer_ptr<SimpleModelSource> > SourceRegistry;
+    SourceRegistry _sources;
+
+    std::string makePseudoURI( const std::string& path, UID uid )
+    {
+        std::stringstream buf;
+        buf << path << "." << uid << "." << PSEUDO_EXTENSION;
+        return buf.str();
+    }
+
+    /**
+     * Redirects the PagedLODs in a tile through the pseudo-loader, so that
+     * their children get the same treatment when they page in.
+     */
+    struct RedirectPagedLODs : public osg::NodeVisitor
+    {
+        RedirectPagedLODs( UID uid, const optional<float>& priOffset, const optional<float>& priScale )
+            : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+              _uid      ( uid ),
+              _priOffset( priOffset ),
+              _priScale ( priScale ) { }
+
+        void apply( osg::PagedLOD& plod )
+        {
+            bool redirected = false;
+            for( unsigned i = 0; i < plod.getNumFileNames(); ++i )
+            {
+                const std::string& name = plod.getFileName( i );
+                if ( name.empty() || osgDB::getLowerCaseFileExtension(name) == PSEUDO_EXTENSION )
+                    continue;
+
+                // the pager requests the database path plus the file name.
+                plod.setFileName( i, makePseudoURI(plod.getDatabasePath() + name, _uid) );
+                redirected = true;
+
+                if ( _priOffset.isSet() )
+                    plod.setPriorityOffset( i, plod.getPriorityOffset(i) + *_priOffset );
+                if ( _priScale.isSet() )
+                    plod.setPriorityScale( i, plod.getPriorityScale(i) * (*_priScale) );
+            }
+
+            if ( redirected )
+                plod.setDatabasePath( "" );
+
+            traverse( plod );
+        }
+
+        UID                    _uid;
+        const optional<float>& _priOffset;
+        const optional<float>& _priScale;
+    };
+}
+
+//--------------------------------------------------------------------------
+
 class SimpleModelSource : public ModelSource
 {
 public:
     SimpleModelSource( const ModelSourceOptions& options )
-        : ModelSource( options ), _options(options) { }
+        : ModelSource( options ), _options(options)
+    {
+        _uid = Registry::instance()->createUID();
+
+        Threading::ScopedWriteLock exclusive( _sourcesMutex );
+        _sources[_uid] = this;
+    }
+
+    /**
+     * Loads one tile of a paged model (see SimpleModelOptions::paging).
+     * Called from the pager's threads, through the pseudo-loader.
+     */
+    osg::Node* loadTile( const std::string& path, const osgDB::Options* dbOptions, ProgressCallback* progress =0L )
+    {
+        // required for the tile's own relative refs:
+        osg::ref_ptr<osgDB::Options> localOptions = 
+            Registry::instance()->cloneOrCreateOptions( dbOptions );
+
+        localOptions->getDatabasePathList().push_back( osgDB::getFilePath(path) );
+
+        osg::ref_ptr<osg::Node> tile = URI(path).getNode( localOptions.get(), progress );
+        if ( tile.valid() )
+        {
+            RedirectPagedLODs redirect( _uid, _options.priorityOffset(), _options.priorityScale() );
+            tile->accept( redirect );
+
+            applyShaderPolicy( tile.get() );
+        }
+
+        return tile.release();
+    }
+
+    /**
+     * Loads the root tiles in a directory: each file with the tile extension,
+     * and each sub-directory "X" holding "X.<extension>".
+     */
+    osg::Node* loadRootTiles( const std::string& dir, const osgDB::Options* dbOptions, ProgressCallback* progress )
+    {
+        osg::ref_ptr<osg::Group> group = new osg::Group();
+        std::string ext = osgDB::convertToLowerCase( *_options.tileExtension() );
+
+        osgDB::DirectoryContents files = osgDB::getSortedDirectoryContents( dir );
+        for( osgDB::DirectoryContents::const_iterator f = files.begin(); f != files.end(); ++f )
+        {
+            if ( *f == "." || *f == ".." )
+                continue;
+
+            std::string path = osgDB::concatPaths( dir, *f );
+            if ( osgDB::fileType(path) == osgDB::DIRECTORY )
+                path = osgDB::concatPaths( path, *f + "." + ext );
+            else if ( osgDB::getLowerCaseFileExtension(path) != ext )
+                continue;
+
+            if ( !osgDB::fileExists(path) )
+                continue;
+
+            osg::Node* tile = loadTile( path, dbOptions, progress );
+            if ( tile )
+                group->addChild( tile );
+        }
+
+        OE_INFO << LC << "Loaded " << group->getNumChildren() << " root tiles from " << dir << std::endl;
+        return group.release();
+    }
 
     //override
     void initialize( const osgDB::Options* dbOptions )
@@ -93,6 +228,17 @@ public:
         {
             result = _options.node();
         }
+        else if ( _options.paging() == true )
+        {
+            // for the tiles the pager will load later:
+            _dbOptions = Registry::instance()->cloneOrCreateOptions( dbOptions );
+
+            const std::string& path = _options.url()->full();
+            if ( osgDB::fileType(path) == osgDB::DIRECTORY )
+                result = loadRootTiles( path, dbOptions, progress );
+            else
+                result = loadTile( path, dbOptions, progress );
+        }
         else
         {
             // required if the model includes local refs, like PagedLOD or ProxyNode:
@@ -151,29 +297,46 @@ public:
             result = node;
         }
 
-        // generate a shader program to render the model.
-        if ( result.valid() )
+        // generate a shader program to render the model. (Paged tiles do
+        // this as they load.)
+        if ( result.valid() && _options.paging() != true )
         {
-            if ( _options.shaderPolicy() == SHADERPOLICY_GENERATE )
-            {
-                ShaderGenerator gen;
-                result->accept( gen );
-            }
-            else if ( _options.shaderPolicy() == SHADERPOLICY_DISABLE )
-            {
-                result->getOrCreateStateSet()->setAttributeAndModes(
-                    new osg::Program(),
-                    osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE );
-            }
+            applyShaderPolicy( result.get() );
         }
 
 
         return result.release();
     }
 
+    /** Options to use when paging in tiles */
+    const osgDB::Options* getDBOptions() const { return _dbOptions.get(); }
+
 protected:
 
-    const SimpleModelOptions _options;
+    virtual ~SimpleModelSource()
+    {
+        Threading::ScopedWriteLock exclusive( _sourcesMutex );
+        _sources.erase( _uid );
+    }
+
+    void applyShaderPolicy( osg::Node* node )
+    {
+        if ( _options.shaderPolicy() == SHADERPOLICY_GENERATE )
+        {
+            ShaderGenerator gen;
+            node->accept( gen );
+        }
+        else if ( _options.shaderPolicy() == SHADERPOLICY_DISABLE )
+        {
+            node->getOrCreateStateSet()->setAttributeAndModes(
+                new osg::Program(),
+                osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE );
+        }
+    }
+
+    const SimpleModelOptions     _options;
+    UID                          _uid;
+    osg::ref_ptr<osgDB::Options> _dbOptions;
 };
 
 
@@ -183,6 +346,7 @@ public:
     SimpleModelSourceFactory()
     {
         supportsExtension( "osgearth_model_simple", "osgEarth simple model plugin" );
+        supportsExtension( PSEUDO_EXTENSION, "osgEarth simple model tile pseudo-loader" );
     }
 
     virtual const char* className()
@@ -197,6 +361,32 @@ public:
 
         return ReadResult( new SimpleModelSource( getModelSourceOptions(options) ) );
     }
+
+    virtual ReadResult readNode(const std::string& uri, const Options* options) const
+    {
+        if ( osgDB::getLowerCaseFileExtension(uri) != PSEUDO_EXTENSION )
+            return ReadResult::FILE_NOT_HANDLED;
+
+        // "<real path>.<uid>.osgearth_pseudo_simple"
+        std::string stripped = osgDB::getNameLessExtension( uri );
+        UID uid = as<UID>( osgDB::getFileExtension(stripped), -1 );
+        std::string path = osgDB::getNameLessExtension( stripped );
+
+        osg::ref_ptr<SimpleModelSource> source;
+        {
+            Threading::ScopedReadLock shared( _sourcesMutex );
+            SourceRegistry::const_iterator i = _sources.find( uid );
+            if ( i != _sources.end() )
+                source = i->second.get();
+        }
+
+        // the layer went away; the tile will never be shown.
+        if ( !source.valid() )
+            return ReadResult::FILE_NOT_FOUND;
+
+        osg::Node* tile = source->loadTile( path, source->getDBOptions() );
+        return tile ? ReadResult( tile ) : ReadResult::ERROR_IN_READING_FILE;
+    }
 };
 
 REGISTER_OSGPLUGIN(osgearth_model_simple, SimpleModelSourceFactory) 
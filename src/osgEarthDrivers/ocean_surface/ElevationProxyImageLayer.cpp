@@ -17,15 +17,37 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "ElevationProxyImageLayer"
+#include <osgEarth/HeightFieldCache>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
 
 using namespace osgEarth_ocean_surface;
 using namespace osgEarth;
+using namespace osgEarth::Threading;
+
+#define LC "[ElevationProxyImageLayer] "
+
+// encoded images held in memory
+#define MAX_MASKS 128
 
 ElevationProxyImageLayer::ElevationProxyImageLayer( Map* sourceMap, const ImageLayerOptions& options ) :
-ImageLayer( options ),
-_sourceMap( sourceMap ),
-_mapf     ( sourceMap )
+ImageLayer      ( options ),
+_sourceMap      ( sourceMap ),
+_mapf           ( sourceMap ),
+_masks          ( true, MAX_MASKS ),
+_maskPolicy     ( CachePolicy::NO_CACHE ),
+_maskBinRevision( -1 )
 {
+    // the layer's own cache policy governs the encoded images, which this
+    // layer stores itself; the base class never caches anything.
+    if ( sourceMap )
+    {
+        optional<CachePolicy> policy = options.cachePolicy();
+        if ( !policy.isSet() )
+            Registry::instance()->getCachePolicy( policy, sourceMap->getDBOptions() );
+        _maskPolicy = policy.isSet() ? *policy : CachePolicy::DEFAULT;
+    }
+
     _runtimeOptions.cachePolicy() = CachePolicy::NO_CACHE;
 }
 
@@ -48,29 +70,110 @@ ElevationProxyImageLayer::isCached( const TileKey& key ) const
     return true;
 }
 
-GeoImage
-ElevationProxyImageLayer::createImage(const TileKey& key, ProgressCallback* progress, bool forceFallback)
+osg::Image*
+ElevationProxyImageLayer::encode( const osg::HeightField* hf ) const
 {
-    osg::ref_ptr<Map> map = _sourceMap.get();
-    if ( map.valid() )
+    // encode the heightfield as a 16-bit normalized LUNIMANCE image
+    osg::Image* image = new osg::Image();
+    image->allocateImage(hf->getNumColumns(), hf->getNumRows(), 1, GL_LUMINANCE, GL_UNSIGNED_SHORT);
+    image->setInternalTextureFormat( GL_LUMINANCE16 );
+
+    // rows are tightly packed, so the samples map straight onto the pixels.
+    const osg::FloatArray* floats = hf->getFloatArray();
+    unsigned short*        pixels = reinterpret_cast<unsigned short*>( image->data() );
+    for( unsigned int i = 0; i < floats->size(); ++i  )
     {
-        osg::ref_ptr<osg::HeightField> hf;
-        if ( map->getHeightField( key, true, hf ) )
+        pixels[i] = (unsigned short)(32768 + (short)(*floats)[i]);
+    }
+
+    return image;
+}
+
+CacheBin*
+ElevationProxyImageLayer::getMaskBin( const MapFrame& frame )
+{
+    if ( _maskPolicy == CachePolicy::NO_CACHE )
+        return 0L;
+
+    ScopedMutexLock lock( _maskBinMutex );
+
+    // the images depend on the elevation layers, so each combination of
+    // them gets its own bin.
+    if ( _maskBinRevision != (int)frame.getRevision() )
+    {
+        _maskBinRevision = (int)frame.getRevision();
+        _maskBin = 0L;
+
+        osg::ref_ptr<Map> map = _sourceMap.get();
+        Cache* cache = map.valid() ? map->getCache() : 0L;
+        if ( cache && frame.getProfile() )
         {
-            // encode the heightfield as a 16-bit normalized LUNIMANCE image
-            osg::Image* image = new osg::Image();
-            image->allocateImage(hf->getNumColumns(), hf->getNumRows(), 1, GL_LUMINANCE, GL_UNSIGNED_SHORT);
-            image->setInternalTextureFormat( GL_LUMINANCE16 );
-            const osg::FloatArray* floats = hf->getFloatArray();
-            for( unsigned int i = 0; i < floats->size(); ++i  )
+            std::stringstream buf;
+            buf << frame.getProfile()->getFullSignature();
+            for( ElevationLayerVector::const_iterator i = frame.elevationLayers().begin(); i != frame.elevationLayers().end(); ++i )
             {
-                int col = i % hf->getNumColumns();
-                int row = i / hf->getNumColumns();
-                *(unsigned short*)image->data( col, row ) = (unsigned short)(32768 + (short)floats->at(i));
+                if ( i->get()->getEnabled() )
+                    buf << ";" << i->get()->getTerrainLayerRuntimeOptions().getConfig().toJSON();
             }
 
-            return GeoImage( image, key.getExtent() );
+            std::string binID = Stringify() << "ocean_proxy_" << std::hex << hashString(buf.str());
+            _maskBin = cache->addBin( binID );
         }
     }
-    return GeoImage::INVALID;
+
+    return _maskBin.get();
+}
+
+GeoImage
+ElevationProxyImageLayer::createImage(const TileKey& key, ProgressCallback* progress, bool forceFallback)
+{
+    osg::ref_ptr<Map> map = _sourceMap.get();
+    if ( !map.valid() )
+        return GeoImage::INVALID;
+
+    // frames are cheap; they share the map's layer snapshot.
+    MapFrame frame( map.get(), Map::ELEVATION_LAYERS );
+    std::string maskKey = Stringify() << key.str() << "@" << (int)frame.getRevision();
+
+    LRUCache<std::string, osg::ref_ptr<osg::Image> >::Record rec;
+    if ( _masks.get(maskKey, rec) )
+    {
+        return GeoImage( rec.value().get(), key.getExtent() );
+    }
+
+    osg::ref_ptr<CacheBin> bin = getMaskBin( frame );
+    if ( bin.valid() && _maskPolicy.isCacheReadable() )
+    {
+        ReadResult r = bin->readImage( key.str(), _maskPolicy.maxAge().value() );
+        if ( r.succeeded() )
+        {
+            osg::ref_ptr<osg::Image> image = r.releaseImage();
+            _masks.insert( maskKey, image.get() );
+            return GeoImage( image.get(), key.getExtent() );
+        }
+    }
+
+    // same arguments the terrain engines use, so a tile they already built
+    // comes straight out of the cache.
+    osg::ref_ptr<osg::HeightField> hf;
+    bool isFallback = false;
+    HeightFieldCache* hfCache = map->getHeightFieldCache();
+    bool ok = hfCache ?
+        hfCache->getOrCreateHeightField( frame, key, true, hf, &isFallback, true, SAMPLE_FIRST_VALID, progress ) :
+        frame.getHeightField( key, true, hf, &isFallback, true, SAMPLE_FIRST_VALID, progress );
+
+    if ( !ok || !hf.valid() )
+        return GeoImage::INVALID;
+
+    osg::ref_ptr<osg::Image> image = encode( hf.get() );
+
+    // a canceled result may be incomplete, so don't keep it.
+    if ( !progress || !progress->isCanceled() )
+    {
+        _masks.insert( maskKey, image.get() );
+        if ( bin.valid() && _maskPolicy.isCacheWriteable() )
+            bin->write( key.str(), image.get() );
+    }
+
+    return GeoImage( image.get(), key.getExtent() );
 }
@@ -99,8 +99,8 @@ OceanSurfaceContainer::rebuild()
         {
             // install an "elevation proxy" layer that reads elevation tiles from the
             // parent map and turns them into encoded images for our shader to use.
+            // The images follow the parent map's cache policy.
             ImageLayerOptions epo( "ocean-proxy" );
-            epo.cachePolicy() = CachePolicy::NO_CACHE;
             epo.maxLevel() = *_options.maxLOD();
             oceanMap->addImageLayer( new ElevationProxyImageLayer(_parentMapNode->getMap(), epo) );
         }
@@ -45,11 +45,47 @@ using namespace osgEarth::Drivers;
 /*
  * LoadImageOperation is a simple operation that simply loads an image in a background thread
  */
+namespace
+{
+    /** FNV-1a over a block of bytes */
+    unsigned hashBytes( const unsigned char* data, unsigned len )
+    {
+        unsigned h = 2166136261u;
+        for( unsigned i = 0; i < len; ++i )
+        {
+            h ^= data[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    bool sameLayout( const osg::Image* a, const osg::Image* b )
+    {
+        return
+            a->s() == b->s() && a->t() == b->t() && a->r() == b->r() &&
+            a->getPixelFormat() == b->getPixelFormat() &&
+            a->getDataType() == b->getDataType() &&
+            a->getPacking() == b->getPacking() &&
+            a->getRowSizeInBytes() == b->getRowSizeInBytes();
+    }
+}
+
+/**
+ * Loads the image, and compares it with the previous one: an identical
+ * image (by hash) is flagged as unchanged, and an image with the same
+ * layout gets the range of rows that differ.
+ */
 class LoadImageOperation : public osg::Operation
 {
 public:
-    LoadImageOperation(const std::string& filename):
+    LoadImageOperation(const std::string& filename, osg::Image* previous, unsigned previousHash):
       _filename(filename),
+          _previous(previous),
+          _previousHash(previousHash),
+          _hash(0),
+          _unchanged(false),
+          _firstRow(0),
+          _numRows(0),
           _done(false)
       {
       }
@@ -64,20 +100,55 @@ public:
               _image = osgDB::readImageFile( _filename );                                     
               if (_image.valid()) break;              
           }
+
+          if ( _image.valid() )
+          {
+              _hash = hashBytes( _image->data(), _image->getTotalSizeInBytes() );
+
+              if ( _previous.valid() && sameLayout(_image.get(), _previous.get()) )
+              {
+                  if ( _hash == _previousHash )
+                  {
+                      _unchanged = true;
+                  }
+                  else
+                  {
+                      // find the band of rows that changed.
+                      unsigned rowSize = _image->getRowSizeInBytes();
+                      unsigned rows    = _image->t() * _image->r();
+                      unsigned first = rows, last = 0;
+                      for( unsigned row = 0; row < rows; ++row )
+                      {
+                          if ( ::memcmp(_image->data() + row*rowSize, _previous->data() + row*rowSize, rowSize) != 0 )
+                          {
+                              if ( row < first ) first = row;
+                              last = row;
+                          }
+                      }
+                      _unchanged = first == rows;
+                      _firstRow  = _unchanged ? 0 : first;
+                      _numRows   = _unchanged ? 0 : last - first + 1;
+                  }
+              }
+          }
+
+          _previous = 0L;
           _done = true;
       }
 
-      bool _done;
-      osg::ref_ptr< osg::Image > _image;
       std::string _filename;
+      osg::ref_ptr< osg::Image > _previous;
+      unsigned _previousHash;
+      osg::ref_ptr< osg::Image > _image;
+      unsigned _hash;
+      bool _unchanged;
+      unsigned _firstRow;  // changed rows, when the layout is unchanged
+      unsigned _numRows;
+      bool _done;
 };
 
 
 
-/*
- * RefreshImage is a special ImageStream that reloads an image from a filename and
- * updates it's internal image data.
- */
 class RefreshImage : public osg::ImageStream
 {
 public:
@@ -86,10 +157,16 @@ public:
       _filename(filename),
           _time(time),
           _lastUpdateTime(0),
+          _hash(0),
           osg::ImageStream()
       {                    
           osg::ref_ptr< osg::Image > image = osgDB::readImageFile( filename );
-          if (image.valid()) copyImage( image.get() );
+          if (image.valid())
+          {
+              copyImage( image.get() );
+              _source = image.get();
+              _hash = hashBytes( image->data(), image->getTotalSizeInBytes() );
+          }
       }      
 
 
@@ -130,9 +207,27 @@ public:
           if (_loadImageOp.valid() && _loadImageOp->_done)
           {              
               osg::ref_ptr< osg::Image > image = _loadImageOp->_image.get();
-              if (image.valid())
+              if (image.valid() && !_loadImageOp->_unchanged)
               {
-                  copyImage( image.get() );
+                  if ( _source.valid() && sameLayout(image.get(), this) )
+                  {
+                      // same layout: copy the changed rows in place. Keeping
+                      // the buffer lets the texture update with a subload
+                      // rather than a reallocation.
+                      unsigned rowSize = getRowSizeInBytes();
+                      memcpy(
+                          data() + _loadImageOp->_firstRow*rowSize,
+                          image->data() + _loadImageOp->_firstRow*rowSize,
+                          _loadImageOp->_numRows*rowSize );
+                      dirty();
+                  }
+                  else
+                  {
+                      copyImage( image.get() );
+                  }
+
+                  _source = image.get();
+                  _hash = _loadImageOp->_hash;
               }
               _lastUpdateTime = osg::Timer::instance()->time_s();
               _loadImageOp = 0;
@@ -158,13 +253,10 @@ public:
       {                               
           updateImage();
           double time = osg::Timer::instance()->time_s();
-          osg::Timer_t ticks = osg::Timer::instance()->tick();          
           //If we've let enough time elapse and we're not waiting on an existing load image operation then add one to the queue
           if (!_loadImageOp.valid() && (time - _lastUpdateTime > _time))
           {
-              std::stringstream ss;
-              std::string file = ss.str();              
-              _loadImageOp = new LoadImageOperation(_filename);
+              _loadImageOp = new LoadImageOperation(_filename, _source.get(), _hash);
               getOperationsThread()->add( _loadImageOp.get() );
           }
       }
@@ -173,6 +265,8 @@ public:
       double _time;
       double _lastUpdateTime;
       osg::ref_ptr< LoadImageOperation > _loadImageOp;      
+      osg::ref_ptr< osg::Image > _source; // last image loaded, for comparison
+      unsigned _hash;                     // hash of its pixels
 };
 
 
@@ -61,9 +61,17 @@ JavaScriptCoreEngine::executeScript(const std::string& script)
  {   
     // Evaluate script.
     JSStringRef scriptJS = JSStringCreateWithUTF8CString(script.c_str());
-    JSValueRef result = JSEvaluateScript(_ctx, scriptJS, NULL, NULL, 0, NULL);
+    ScriptResult result = executeScript(scriptJS);
     JSStringRelease(scriptJS);
-    
+
+    return result;
+}
+
+ScriptResult
+JavaScriptCoreEngine::executeScript(JSStringRef scriptJS)
+{
+    JSValueRef result = JSEvaluateScript(_ctx, scriptJS, NULL, NULL, 0, NULL);
+
     // Convert result to string, unless result is NULL.
     char* buf = 0L;
     if (result) {
@@ -124,3 +132,52 @@ JavaScriptCoreEngine::call(const std::string& function, osgEarth::Features::Feat
 {
     return ScriptResult("");
 }
+
+bool
+JavaScriptCoreEngine::runBatch(const std::string& code, const osgEarth::Features::FeatureList& features, std::vector<ScriptResult>& out_results, osgEarth::Features::FilterContext const* context)
+{
+  out_results.reserve(out_results.size() + features.size());
+
+  if (code.empty())
+  {
+    out_results.insert(out_results.end(), features.size(), ScriptResult(EMPTY_STRING, false, "Script is empty."));
+    return false;
+  }
+
+  // convert the script once, and let a single feature object stand in for
+  // every feature by swapping its private data.
+  JSStringRef scriptJS = JSStringCreateWithUTF8CString(code.c_str());
+  JSObjectRef jsFeature = 0L;
+
+  bool ok = true;
+  for (osgEarth::Features::FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+  {
+    osgEarth::Features::Feature* feature = const_cast<osgEarth::Features::Feature*>(i->get());
+    if (!feature)
+    {
+      out_results.push_back(ScriptResult(EMPTY_STRING, false, "Feature is null."));
+      ok = false;
+      continue;
+    }
+
+    if (!jsFeature)
+    {
+      JSStringRef featureStr = JSStringCreateWithUTF8CString("feature");
+      jsFeature = JSObjectMake(_ctx, JSFeature_class(_ctx), feature);
+      JSObjectSetProperty(_ctx, JSContextGetGlobalObject(_ctx), featureStr, jsFeature, kJSPropertyAttributeNone, NULL);
+      JSStringRelease(featureStr);
+    }
+    else
+    {
+      JSObjectSetPrivate(jsFeature, feature);
+    }
+
+    out_results.push_back(executeScript(scriptJS));
+    if (!out_results.back().success())
+      ok = false;
+  }
+
+  JSStringRelease(scriptJS);
+
+  return ok;
+}
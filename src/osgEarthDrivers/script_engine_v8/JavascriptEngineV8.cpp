@@ -33,6 +33,9 @@ using namespace osgEarth::Features;
 
 #define LC "[JavascriptEngineV8] "
 
+// most compiled scripts to keep before starting over
+#define MAX_COMPILED_SCRIPTS 256
+
 
 //----------------------------------------------------------------------------
 
@@ -72,6 +75,10 @@ JavascriptEngineV8::~JavascriptEngineV8()
     v8::Locker locker(_isolate);
     v8::Isolate::Scope isolate_scope(_isolate);
 
+    for (CompiledScripts::iterator i = _compiledScripts.begin(); i != _compiledScripts.end(); ++i)
+      i->second.Dispose();
+    _compiledScripts.clear();
+
     _globalTemplate.Dispose();
     _globalContext.Dispose();
   }
@@ -160,6 +167,55 @@ JavascriptEngineV8::executeScript(v8::Handle<v8::String> script)
   return ScriptResult(std::string(*ascii));
 }
 
+v8::Handle<v8::Script>
+JavascriptEngineV8::compileScript(const std::string& code, ScriptResult& out_error)
+{
+  CompiledScripts::iterator i = _compiledScripts.find(code);
+  if (i != _compiledScripts.end())
+    return i->second;
+
+  v8::HandleScope handle_scope;
+  v8::TryCatch try_catch;
+
+  v8::Handle<v8::Script> compiled_script = v8::Script::Compile(v8::String::New(code.c_str(), code.length()));
+  if (compiled_script.IsEmpty())
+  {
+    v8::String::AsciiValue error(try_catch.Exception());
+    out_error = ScriptResult(EMPTY_STRING, false, std::string("Script compile error: ") + std::string(*error));
+    return v8::Handle<v8::Script>();
+  }
+
+  // the code of most scripts comes from a stylesheet, so the set is small; if
+  // something generates scripts on the fly, start over rather than grow forever.
+  if (_compiledScripts.size() >= MAX_COMPILED_SCRIPTS)
+  {
+    for (CompiledScripts::iterator j = _compiledScripts.begin(); j != _compiledScripts.end(); ++j)
+      j->second.Dispose();
+    _compiledScripts.clear();
+  }
+
+  v8::Persistent<v8::Script> persistent = v8::Persistent<v8::Script>::New(compiled_script);
+  _compiledScripts[code] = persistent;
+  return persistent;
+}
+
+ScriptResult
+JavascriptEngineV8::runScript(v8::Handle<v8::Script> script)
+{
+  v8::HandleScope handle_scope;
+  v8::TryCatch try_catch;
+
+  v8::Handle<v8::Value> result = script->Run();
+  if (result.IsEmpty())
+  {
+    v8::String::AsciiValue error(try_catch.Exception());
+    return ScriptResult(EMPTY_STRING, false, std::string("Script result was empty: ") + std::string(*error));
+  }
+
+  v8::String::AsciiValue ascii(result);
+  return ScriptResult(std::string(*ascii));
+}
+
 ScriptResult
 JavascriptEngineV8::run(Script* script, osgEarth::Features::Feature const* feature, osgEarth::Features::FilterContext const* context)
 {
@@ -199,8 +255,13 @@ JavascriptEngineV8::run(const std::string& code, osgEarth::Features::Feature con
       _globalContext->Global()->Set(v8::String::New("context"), cObj);
   }
 
-  // Compile and run the script
-  ScriptResult result = executeScript(v8::String::New(code.c_str(), code.length()));
+  // Compile (or reuse) and run the script
+  ScriptResult error;
+  v8::Handle<v8::Script> script = compileScript(code, error);
+  if (script.IsEmpty())
+    return error;
+
+  ScriptResult result = runScript(script);
 
   //context.Dispose();
 
@@ -265,6 +326,75 @@ JavascriptEngineV8::call(const std::string& function, osgEarth::Features::Featur
   }
 }
 
+bool
+JavascriptEngineV8::runBatch(const std::string& code, const osgEarth::Features::FeatureList& features, std::vector<ScriptResult>& out_results, osgEarth::Features::FilterContext const* context)
+{
+  out_results.reserve(out_results.size() + features.size());
+
+  if (code.empty())
+  {
+    out_results.insert(out_results.end(), features.size(), ScriptResult(EMPTY_STRING, false, "Script is empty."));
+    return false;
+  }
+
+  // one lock, one compile and one set of wrappers for the whole list.
+  v8::Locker locker(_isolate);
+  v8::Isolate::Scope isolate_scope(_isolate);
+
+  v8::HandleScope handle_scope;
+
+  v8::Context::Scope context_scope(_globalContext);
+
+  ScriptResult error;
+  v8::Handle<v8::Script> script = compileScript(code, error);
+  if (script.IsEmpty())
+  {
+    out_results.insert(out_results.end(), features.size(), error);
+    return false;
+  }
+
+  if (context)
+  {
+    v8::Handle<v8::Object> cObj = JSFilterContext::WrapFilterContext(const_cast<FilterContext*>(context));
+    if (!cObj.IsEmpty())
+      _globalContext->Global()->Set(v8::String::New("context"), cObj);
+  }
+
+  // a single feature wrapper serves every feature; only the native pointer
+  // it holds changes between runs.
+  v8::Handle<v8::Object> fObj;
+
+  bool ok = true;
+  for (osgEarth::Features::FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+  {
+    Feature* feature = const_cast<Feature*>(i->get());
+    if (!feature)
+    {
+      out_results.push_back(ScriptResult(EMPTY_STRING, false, "Feature is null."));
+      ok = false;
+      continue;
+    }
+
+    if (fObj.IsEmpty())
+    {
+      fObj = JSFeature::WrapFeature(feature);
+      if (!fObj.IsEmpty())
+        _globalContext->Global()->Set(v8::String::New("feature"), fObj);
+    }
+    else
+    {
+      v8::HandleScope feature_scope;
+      fObj->SetInternalField(0, v8::External::New(feature));
+    }
+
+    out_results.push_back(runScript(script));
+    if (!out_results.back().success())
+      ok = false;
+  }
+
+  return ok;
+}
+
 //----------------------------------------------------------------------------
 // Constructor callbacks for constructing native objects in javascript
 
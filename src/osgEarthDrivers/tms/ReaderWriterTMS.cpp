@@ -21,6 +21,8 @@
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
 #include <osgEarthUtil/TMS>
 
 #include <osg/Notify>
@@ -32,6 +34,9 @@
 
 #include <sstream>
 #include <iomanip>
+#include <list>
+#include <map>
+#include <float.h>
 #include <string.h>
 
 #include "TMSOptions"
@@ -39,9 +44,13 @@
 using namespace osgEarth;
 using namespace osgEarth::Util;
 using namespace osgEarth::Drivers;
+using namespace osgEarth::Threading;
 
 #define LC "[TMS driver] "
 
+// number of threads fetching child tiles in the background
+#define PREFETCH_THREADS 2
+
 
 class TMSSource : public TileSource
 {
@@ -51,6 +60,12 @@ public:
         _invertY = _options.tmsType() == "google";
     }
 
+    virtual ~TMSSource()
+    {
+        // joins the prefetch threads before the store goes away.
+        _prefetchService = 0L;
+    }
+
 
     Status initialize(const osgDB::Options* dbOptions)
     {
@@ -122,6 +137,13 @@ public:
         // set up the IO options so that we do not cache TMS tiles:
         CachePolicy::NO_CACHE.apply( _dbOptions.get() );
 
+        if ( _options.prefetch() == true && _options.prefetchBudget().value() > 0 )
+        {
+            _prefetchService = new TaskService( "TMS prefetch", PREFETCH_THREADS );
+            OE_INFO << LC << "Prefetching child tiles (budget = "
+                << _options.prefetchBudget().value() << ")" << std::endl;
+        }
+
         return STATUS_OK;
     }
 
@@ -142,9 +164,43 @@ public:
         }
     }
 
-    // creates an image from the TMS repo.
+    // creates an image from the TMS repo, or from the prefetch store.
     osg::Image* createImage(const TileKey&        key,
                             ProgressCallback*     progress )
+    {
+        if ( !_prefetchService.valid() )
+            return readImage( key, progress );
+
+        osg::ref_ptr<osg::Image> image;
+
+        osg::ref_ptr<PrefetchRequest> request = takePrefetched( key );
+        if ( request.valid() )
+        {
+            // still in flight: move it to the front of the queue and wait.
+            // (Don't cancel it; a canceled request never runs.)
+            if ( !request->isCompleted() )
+            {
+                _prefetchService->reprioritize( request.get(), FLT_MAX );
+                request->_done.wait();
+            }
+            image = request->_image.get();
+        }
+        else
+        {
+            image = readImage( key, progress );
+        }
+
+        if ( image.valid() )
+        {
+            prefetchChildren( key );
+        }
+
+        return image.release();
+    }
+
+    // reads an image from the TMS repo.
+    osg::Image* readImage(const TileKey&        key,
+                          ProgressCallback*     progress )
     {
         if (_tileMap.valid() && key.getLevelOfDetail() <= _tileMap->getMaxLevel() )
         {
@@ -188,10 +244,94 @@ public:
 
 private:
 
+    // background fetch of one tile into the prefetch store.
+    struct PrefetchRequest : public TaskRequest
+    {
+        PrefetchRequest( TMSSource* source, const TileKey& key )
+            : TaskRequest( -(float)key.getLevelOfDetail() ), _source( source ), _key( key ) { }
+
+        void operator()( ProgressCallback* progress )
+        {
+            _image = _source->readImage( _key, progress );
+            _done.set();
+        }
+
+        TMSSource*               _source;
+        TileKey                  _key;
+        osg::ref_ptr<osg::Image> _image;
+        Event                    _done;
+    };
+
+    typedef std::map<std::string, osg::ref_ptr<PrefetchRequest> > PrefetchStore;
+
+    // removes and returns the prefetch request for a key, if there is one.
+    PrefetchRequest* takePrefetched( const TileKey& key )
+    {
+        ScopedMutexLock lock( _prefetchMutex );
+        PrefetchStore::iterator i = _prefetchStore.find( key.str() );
+        if ( i == _prefetchStore.end() )
+            return 0L;
+
+        osg::ref_ptr<PrefetchRequest> request = i->second;
+        _prefetchStore.erase( i );
+        _prefetchOrder.remove( key.str() );
+        return request.release();
+    }
+
+    // schedules background fetches of the children of a key, within the budget.
+    void prefetchChildren( const TileKey& key )
+    {
+        if ( key.getLevelOfDetail()+1 > _tileMap->getMaxLevel() )
+            return;
+
+        unsigned budget = _options.prefetchBudget().value();
+
+        ScopedMutexLock lock( _prefetchMutex );
+
+        for( unsigned q = 0; q < 4; ++q )
+        {
+            TileKey child = key.createChildKey( q );
+            std::string name = child.str();
+
+            if ( _prefetchStore.find(name) != _prefetchStore.end() || !_tileMap->intersectsKey(child) )
+                continue;
+
+            // make room by evicting the oldest finished fetches.
+            for( std::list<std::string>::iterator i = _prefetchOrder.begin(); 
+                 _prefetchStore.size() >= budget && i != _prefetchOrder.end(); )
+            {
+                PrefetchStore::iterator s = _prefetchStore.find( *i );
+                if ( s != _prefetchStore.end() && s->second->isCompleted() )
+                {
+                    _prefetchStore.erase( s );
+                    i = _prefetchOrder.erase( i );
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+
+            // everything in the store is still in flight.
+            if ( _prefetchStore.size() >= budget )
+                return;
+
+            PrefetchRequest* request = new PrefetchRequest( this, child );
+            _prefetchStore[name] = request;
+            _prefetchOrder.push_back( name );
+            _prefetchService->add( request );
+        }
+    }
+
     osg::ref_ptr<TMS::TileMap>   _tileMap;
     bool                         _invertY;
     const TMSOptions             _options;
     osg::ref_ptr<osgDB::Options> _dbOptions;
+
+    osg::ref_ptr<TaskService>    _prefetchService;
+    PrefetchStore                _prefetchStore;
+    std::list<std::string>       _prefetchOrder;
+    Mutex                        _prefetchMutex;
 };
 
 
@@ -148,7 +148,9 @@ public:
         _options( in_options ),
         //_directory_structure( FLAT_TASK_DIRECTORIES ),
         _profile( osgEarth::Registry::instance()->getGlobalGeodeticProfile() ),
-        _maxNumTilesInCache( in_options.terrainTileCacheSize().value() ),
+        _maxNumTilesInCache( in_options.terrainTileCacheSize().isSet() ? in_options.terrainTileCacheSize().value() : INT_MAX ),
+        _maxCacheBytes( (unsigned long long)in_options.tileFileCacheSizeMB().value() * 1048576ull ),
+        _cacheBytes( 0 ),
         _initialized( false )
     {
     }
@@ -346,7 +348,7 @@ public:
 
         osgTerrain::TileID tileID(level, tile_x, tile_y);
 
-        findTile(tileID, false, out_tile);
+        findTile(tileID, out_tile);
         if (out_tile.valid()) 
             return;
 
@@ -360,10 +362,50 @@ public:
         if ( foundInBlacklist )
         {
             OE_DEBUG << LC << "file has been found in black list : "<<filename<<std::endl;
-            insertTile(tileID, 0);
             return; //return 0;
         }        
 
+        // Siblings requested at the same time share one read of their file:
+        // the first request reads it, and the others wait for it and then
+        // look again in the cache.
+        osg::ref_ptr<FileRequest> request;
+        bool reader = false;
+        {
+            Threading::ScopedMutexLock lock( _requestsMutex );
+            FileRequests::iterator i = _requests.find( filename );
+            if ( i != _requests.end() )
+            {
+                request = i->second.get();
+            }
+            else
+            {
+                request = new FileRequest();
+                request->_mutex.lock();
+                _requests[filename] = request.get();
+                reader = true;
+            }
+        }
+
+        if ( reader )
+        {
+            readTileFile( filename, tileID, progress );
+            {
+                Threading::ScopedMutexLock lock( _requestsMutex );
+                _requests.erase( filename );
+            }
+            request->_mutex.unlock();
+        }
+        else
+        {
+            Threading::ScopedMutexLock wait( request->_mutex );
+        }
+
+        findTile(tileID, out_tile);
+    }
+
+    /** Reads a subtile file and caches the terrain tiles in it. */
+    void readTileFile( const std::string& filename, const osgTerrain::TileID& tileID, ProgressCallback* progress )
+    {
         osg::ref_ptr<osgDB::Options> localOptions = Registry::instance()->cloneOrCreateOptions();
         CachePolicy::NO_CACHE.apply( localOptions.get() );
         localOptions->setPluginData("osgearth_vpb Plugin",(void*)(1));
@@ -377,8 +419,8 @@ public:
             CollectTiles ct;
             node->accept(ct);
 
-            int base_x = (tile_x / 2) * 2;
-            int base_y = (tile_y / 2) * 2;
+            int base_x = (tileID.x / 2) * 2;
+            int base_y = (tileID.y / 2) * 2;
             
             double min_x, max_x, min_y, max_y;
             ct.getRange(min_x, min_y, max_x, max_y);
@@ -386,6 +428,8 @@ public:
             double center_x = (min_x + max_x)*0.5;
             double center_y = (min_y + max_y)*0.5;
 
+            std::vector<osgTerrain::TerrainTile*> tiles;
+
             osg::Vec3d local(0.5,0.5,0.0);
             for(unsigned int i=0; i<ct._terrainTiles.size(); ++i)
             {
@@ -397,17 +441,14 @@ public:
                     
                     int local_x = base_x + ((projected.x() > center_x) ? 1 : 0);
                     int local_y = base_y + ((projected.y() > center_y) ? 1 : 0);
-                    osgTerrain::TileID local_tileID(level, local_x, local_y);
+                    osgTerrain::TileID local_tileID(tileID.level, local_x, local_y);
                     
                     tile->setTileID(local_tileID);
-                    insertTile(local_tileID, tile);
-
-                    if ( local_tileID == tileID )
-                        out_tile = tile;
+                    tiles.push_back(tile);
                 }
-
             }
 
+            insertFile(filename, tiles);
         }
         else
         {
@@ -418,57 +459,93 @@ public:
                 _blacklistedFilenames.insert( filename );
             }
         }
-        
-        //TODO: just return it instead...
-        //findTile(tileID, false, out_tile);
     }
-    
-    void insertTile(const osgTerrain::TileID& tileID, osgTerrain::TerrainTile* tile)
+
+    /** Approximate memory held by a terrain tile's layers */
+    static unsigned long long getSizeInBytes(osgTerrain::Layer* layer)
     {
-        Threading::ScopedWriteLock exclusiveLock( _tileMapMutex );
+        unsigned long long bytes = 0;
+
+        osgTerrain::ImageLayer* imageLayer = dynamic_cast<osgTerrain::ImageLayer*>(layer);
+        if (imageLayer && imageLayer->getImage())
+            bytes += imageLayer->getImage()->getTotalSizeInBytesIncludingMipmaps();
+
+        osgTerrain::HeightFieldLayer* hfLayer = dynamic_cast<osgTerrain::HeightFieldLayer*>(layer);
+        if (hfLayer && hfLayer->getHeightField())
+            bytes += hfLayer->getHeightField()->getFloatArray()->getTotalDataSize();
 
-        if ( _tileMap.find(tileID) == _tileMap.end() )
+        osgTerrain::CompositeLayer* compositeLayer = dynamic_cast<osgTerrain::CompositeLayer*>(layer);
+        if (compositeLayer)
         {
-            _tileMap[tileID] = tile;
+            for(unsigned int i=0; i<compositeLayer->getNumLayers(); ++i)
+                bytes += getSizeInBytes(compositeLayer->getLayer(i));
+        }
 
-            _tileFIFO.push_back(tileID);
+        return bytes;
+    }
 
-            if (_tileFIFO.size() > _maxNumTilesInCache)
-            {
-                osgTerrain::TileID tileToRemove = _tileFIFO.front();
-                _tileFIFO.pop_front();
-                _tileMap.erase(tileToRemove);
+    static unsigned long long getSizeInBytes(osgTerrain::TerrainTile* tile)
+    {
+        unsigned long long bytes = getSizeInBytes(tile->getElevationLayer());
+        for(unsigned int i=0; i<tile->getNumColorLayers(); ++i)
+            bytes += getSizeInBytes(tile->getColorLayer(i));
+        return bytes;
+    }
 
-                OE_DEBUG << LC << "Pruned tileID ("<<TileKey::getLOD(tileID)<<", "<<tileID.x<<", "<<tileID.y<<")"<<std::endl;
-            }
+    /** Caches the tiles of a file, evicting the least recently used files over budget. */
+    void insertFile(const std::string& filename, const std::vector<osgTerrain::TerrainTile*>& tiles)
+    {
+        Threading::ScopedMutexLock exclusiveLock( _tileMapMutex );
 
-            OE_DEBUG << LC << "insertTile ("
-                << TileKey::getLOD(tileID)<<", "<<tileID.x<<", "<<tileID.y<<") " 
-                << " tileFIFO.size()=="<<_tileFIFO.size()<<std::endl;
+        if ( _files.find(filename) != _files.end() )
+            return;
+
+        CachedFile& file = _files[filename];
+        file._bytes = 0;
+        file._lru   = _fileLRU.insert(_fileLRU.end(), filename);
+
+        for(unsigned int i=0; i<tiles.size(); ++i)
+        {
+            const osgTerrain::TileID& id = tiles[i]->getTileID();
+            TileEntry& entry = _tileMap[id];
+            entry._tile = tiles[i];
+            entry._file = filename;
+            file._tiles.push_back(id);
+            file._bytes += getSizeInBytes(tiles[i]);
         }
-        else
+        _cacheBytes += file._bytes;
+
+        // never evict the file just read, so its tiles reach the caller.
+        while ( _fileLRU.size() > 1 && (_cacheBytes > _maxCacheBytes || _tileMap.size() > _maxNumTilesInCache) )
         {
-            OE_DEBUG << LC << "insertTile ("
-                << TileKey::getLOD(tileID)<<", "<<tileID.x<<", "<<tileID.y<<") " 
-                << " ...already in cache!"<<std::endl;
+            FileMap::iterator victim = _files.find(_fileLRU.front());
+            for(unsigned int i=0; i<victim->second._tiles.size(); ++i)
+                _tileMap.erase(victim->second._tiles[i]);
+            _cacheBytes -= victim->second._bytes;
+
+            OE_DEBUG << LC << "Pruned " << victim->first << std::endl;
+
+            _files.erase(victim);
+            _fileLRU.pop_front();
         }
+
+        OE_DEBUG << LC << "insertFile " << filename << " (" << tiles.size() << " tiles), "
+            << _files.size() << " files, " << (_cacheBytes/1048576) << " MB cached" << std::endl;
     }
 
-    void findTile(const osgTerrain::TileID& tileID, bool insertBlankTileIfNotFound, osg::ref_ptr<osgTerrain::TerrainTile>& out_tile)
+    void findTile(const osgTerrain::TileID& tileID, osg::ref_ptr<osgTerrain::TerrainTile>& out_tile)
     {
-        // read with a shared lock
+        Threading::ScopedMutexLock exclusiveLock( _tileMapMutex );
+        TileMap::iterator itr = _tileMap.find(tileID);
+        if (itr != _tileMap.end())
         {
-            Threading::ScopedReadLock sharedLock( _tileMapMutex );
-            TileMap::iterator itr = _tileMap.find(tileID);
-            if (itr != _tileMap.end())
-                out_tile = itr->second.get();
-        }
+            out_tile = itr->second._tile.get();
 
-        // upgrade lock and write:
-        if (insertBlankTileIfNotFound) 
-            insertTile(tileID, 0);
-
-        //return 0;
+            // mark the file as recently used:
+            FileMap::iterator file = _files.find(itr->second._file);
+            if ( file != _files.end() )
+                _fileLRU.splice(_fileLRU.end(), _fileLRU, file->second._lru);
+        }
     }
 
     const VPBOptions _options;
@@ -482,13 +559,37 @@ public:
     osg::ref_ptr<osg::Node> _rootNode;
     
     unsigned int _maxNumTilesInCache;
-    
-    typedef std::map<osgTerrain::TileID, osg::ref_ptr<osgTerrain::TerrainTile> > TileMap;
+    unsigned long long _maxCacheBytes;
+    unsigned long long _cacheBytes;
+
+    struct TileEntry
+    {
+        osg::ref_ptr<osgTerrain::TerrainTile> _tile;
+        std::string _file;
+    };
+    typedef std::map<osgTerrain::TileID, TileEntry> TileMap;
     TileMap _tileMap;
-    Threading::ReadWriteMutex _tileMapMutex;
-    
-    typedef std::list<osgTerrain::TileID> TileIDList;
-    TileIDList _tileFIFO;
+
+    typedef std::list<std::string> FileList;
+    struct CachedFile
+    {
+        std::vector<osgTerrain::TileID> _tiles;
+        unsigned long long _bytes;
+        FileList::iterator _lru;
+    };
+    typedef std::map<std::string, CachedFile> FileMap;
+    FileMap _files;
+    FileList _fileLRU; // least recently used first
+    Threading::Mutex _tileMapMutex;
+
+    // a file being read; other requests for it wait on the mutex.
+    struct FileRequest : public osg::Referenced
+    {
+        Threading::Mutex _mutex;
+    };
+    typedef std::map<std::string, osg::ref_ptr<FileRequest> > FileRequests;
+    FileRequests _requests;
+    Threading::Mutex _requestsMutex;
     
     typedef std::set<std::string> StringSet;
     StringSet _blacklistedFilenames;
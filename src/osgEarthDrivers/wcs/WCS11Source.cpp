@@ -22,16 +22,22 @@
 #include <osgEarth/Registry>
 #include <osgEarth/URI>
 #include <osg/Notify>
+#include <osgEarth/StringUtils>
+#include <osg/Endian>
 #include <osgDB/Registry>
 #include <iostream>
 #include <stdlib.h>
+#include <cstring>
 
 using namespace osgEarth;
 
+#define LC "[osgEarth::WCS1.1] "
+
 
 WCS11Source::WCS11Source( const TileSourceOptions& options ) :
 TileSource( options ),
-_options  ( options )
+_options  ( options ),
+_metaTiles( true, 32 )
 {
     _covFormat = _options.format().value();
     
@@ -69,9 +75,14 @@ WCS11Source::createImage(const TileKey&        key,
 
     OE_INFO << "[osgEarth::WCS1.1] Key=" << key.str() << " URL = " << request.getURL() << std::endl;
 
-    double lon0,lat0,lon1,lat1;
-    key.getExtent().getBounds( lon0, lat0, lon1, lat1 );
+    return createImage( request, progress );
+}
+
 
+osg::Image*
+WCS11Source::createImage(const HTTPRequest&    request,
+                         ProgressCallback*     progress)
+{
     // download the data. It's a multipart-mime stream, so we have to use HTTP directly.
     HTTPResponse response = HTTPClient::get( request, _dbOptions.get(), progress );
     if ( !response.isOK() )
@@ -111,16 +122,189 @@ osg::HeightField*
 WCS11Source::createHeightField(const TileKey&        key,
                                ProgressCallback*     progress)
 {
-    osg::HeightField* field = NULL;
-
-    osg::ref_ptr<osg::Image> image = createImage( key, progress );
-    if ( image.valid() )
-    {        
-        ImageToHeightFieldConverter conv;
-        conv.setRemoveNoDataValues( true );
-        field = conv.convert( image.get() );
+    unsigned metaSize = osg::clampBetween( _options.metaTileSize().value(), 1u, 8u );
+    if ( metaSize > 1 )
+    {
+        return getMetaTile( key, metaSize, progress );
+    }
+
+    return fetchHeightField( key.getExtent(), _options.tileSize().value(), _options.tileSize().value(), progress );
+}
+
+
+osg::HeightField*
+WCS11Source::fetchHeightField(const GeoExtent&  extent,
+                              int               cols,
+                              int               rows,
+                              ProgressCallback* progress)
+{
+    if ( _options.rawFloat() == false )
+    {
+        osg::HeightField* field = NULL;
+
+        osg::ref_ptr<osg::Image> image = createImage( createRequest(extent, cols, rows), progress );
+        if ( image.valid() )
+        {        
+            ImageToHeightFieldConverter conv;
+            conv.setRemoveNoDataValues( true );
+            field = conv.convert( image.get() );
+        }
+
+        return field;
+    }
+
+    HTTPRequest request = createRequest( extent, cols, rows );
+
+    OE_DEBUG << LC << "URL = " << request.getURL() << std::endl;
+
+    HTTPResponse response = HTTPClient::get( request, _dbOptions.get(), progress );
+    if ( !response.isOK() )
+    {
+        OE_WARN << LC << "WARNING: HTTP request failed" << std::endl;
+        return NULL;
+    }
+
+    unsigned int part_num = response.getNumParts() > 1? 1 : 0;
+    return readRawFloats( response.getPartStream(part_num), cols, rows );
+}
+
+
+osg::HeightField*
+WCS11Source::readRawFloats(std::istream& in, int cols, int rows) const
+{
+    std::vector<float> values( cols*rows );
+    in.read( reinterpret_cast<char*>(&values[0]), values.size()*sizeof(float) );
+    if ( in.gcount() != (std::streamsize)(values.size()*sizeof(float)) )
+    {
+        OE_WARN << LC << "WARNING: expected " << cols << "x" << rows << " floats, got "
+            << in.gcount() << " bytes; check the \"format\" and \"raw_float\" options" << std::endl;
+        return NULL;
+    }
+
+    osg::Endian order = toLower(_options.byteOrder().value()) == "little" ? osg::LittleEndian : osg::BigEndian;
+    bool swap = order != osg::getCpuByteOrder();
+
+    osg::HeightField* field = new osg::HeightField();
+    field->allocate( cols, rows );
+
+    // the coverage runs north to south; heightfield rows run south to north.
+    for( int r = 0; r < rows; ++r )
+    {
+        for( int c = 0; c < cols; ++c )
+        {
+            float h = values[r*cols + c];
+            if ( swap )
+                osg::swapBytes4( reinterpret_cast<char*>(&h) );
+
+            // NaN, and the customary "no data" markers:
+            if ( h != h || h < -1.0e30f || h <= -32767.0f )
+                h = NO_DATA_VALUE;
+
+            field->setHeight( c, rows-1-r, h );
+        }
+    }
+
+    return field;
+}
+
+
+osg::HeightField*
+WCS11Source::getMetaTile(const TileKey&    key,
+                         unsigned          metaSize,
+                         ProgressCallback* progress)
+{
+    const Profile* profile = key.getProfile();
+    unsigned lod = key.getLevelOfDetail();
+
+    unsigned tile_x, tile_y;
+    key.getTileXY( tile_x, tile_y );
+
+    unsigned tilesWide, tilesHigh;
+    profile->getNumTiles( lod, tilesWide, tilesHigh );
+
+    // the block of tiles containing this one (smaller at the edges of the profile):
+    unsigned x0 = tile_x - (tile_x % metaSize);
+    unsigned y0 = tile_y - (tile_y % metaSize);
+    unsigned blockWide = osg::minimum( metaSize, tilesWide - x0 );
+    unsigned blockHigh = osg::minimum( metaSize, tilesHigh - y0 );
+
+    std::string metaKey = Stringify() << lod << "/" << x0 << "/" << y0;
+
+    osg::ref_ptr<osg::HeightField> meta;
+    {
+        LRUCache<std::string, osg::ref_ptr<osg::HeightField> >::Record rec;
+        if ( _metaTiles.get(metaKey, rec) )
+            meta = rec.value().get();
     }
 
+    if ( !meta.valid() )
+    {
+        // one thread fetches the metatile; the others wait for it.
+        osg::ref_ptr<MetaTileRequest> request;
+        bool fetch = false;
+        {
+            Threading::ScopedMutexLock lock( _metaTileMutex );
+            MetaTileRequests::iterator i = _metaTileRequests.find( metaKey );
+            if ( i != _metaTileRequests.end() )
+            {
+                request = i->second.get();
+            }
+            else
+            {
+                request = new MetaTileRequest();
+                request->_mutex.lock();
+                _metaTileRequests[metaKey] = request.get();
+                fetch = true;
+            }
+        }
+
+        if ( fetch )
+        {
+            // shares the edge samples of neighboring tiles, as single tiles do.
+            int samples = _options.tileSize().value();
+            int cols = blockWide*(samples-1) + 1;
+            int rows = blockHigh*(samples-1) + 1;
+
+            GeoExtent nw = TileKey(lod, x0, y0, profile).getExtent();
+            GeoExtent se = TileKey(lod, x0+blockWide-1, y0+blockHigh-1, profile).getExtent();
+            GeoExtent extent( nw.getSRS(), nw.xMin(), se.yMin(), se.xMax(), nw.yMax() );
+
+            request->_field = fetchHeightField( extent, cols, rows, progress );
+            if ( request->_field.valid() )
+                _metaTiles.insert( metaKey, request->_field.get() );
+
+            {
+                Threading::ScopedMutexLock lock( _metaTileMutex );
+                _metaTileRequests.erase( metaKey );
+            }
+            request->_mutex.unlock();
+        }
+        else
+        {
+            Threading::ScopedMutexLock wait( request->_mutex );
+        }
+
+        meta = request->_field.get();
+    }
+
+    if ( !meta.valid() )
+        return NULL;
+
+    // cut this tile out of the metatile. The block's rows run north to south
+    // and the heightfield's south to north.
+    int samples = _options.tileSize().value();
+    unsigned col0 = (tile_x - x0) * (samples-1);
+    unsigned row0 = (blockHigh - 1 - (tile_y - y0)) * (samples-1);
+
+    if ( col0 + samples > meta->getNumColumns() || row0 + samples > meta->getNumRows() )
+        return NULL;
+
+    osg::HeightField* field = new osg::HeightField();
+    field->allocate( samples, samples );
+    for( int r = 0; r < samples; ++r )
+        for( int c = 0; c < samples; ++c )
+            field->setHeight( c, r, meta->getHeight(col0+c, row0+r) );
+
     return field;
 }
 
@@ -143,14 +327,19 @@ http://server/ArcGIS/services/WorldElevation/MapServer/WCSServer
 
 HTTPRequest
 WCS11Source::createRequest( const TileKey& key ) const
+{
+    return createRequest( key.getExtent(), _options.tileSize().value(), _options.tileSize().value() );
+}
+
+
+HTTPRequest
+WCS11Source::createRequest( const GeoExtent& extent, int lon_samples, int lat_samples ) const
 {
     std::stringstream buf;
 
     double lon_min, lat_min, lon_max, lat_max;
-    key.getExtent().getBounds( lon_min, lat_min, lon_max, lat_max );
+    extent.getBounds( lon_min, lat_min, lon_max, lat_max );
 
-    int lon_samples = _options.tileSize().value();
-    int lat_samples = _options.tileSize().value();
     double lon_interval = (lon_max-lon_min)/(double)(lon_samples-1);
     double lat_interval = (lat_max-lat_min)/(double)(lat_samples-1);
 
@@ -23,10 +23,13 @@
 #include <osgEarth/TileKey>
 #include <osgEarth/TileSource>
 #include <osgEarth/HTTPClient>
+#include <osgEarth/Containers>
+#include <osgEarth/ThreadingUtils>
 #include <osg/Image>
 #include <osg/Shape>
 #include <osgDB/ReaderWriter>
 #include <string>
+#include <map>
 #include "WCSOptions"
 
 using namespace osgEarth;
@@ -57,7 +60,44 @@ private:
 
     osg::ref_ptr<osgDB::Options> _dbOptions;
 
+    // a metatile being fetched; threads wanting it wait on the mutex.
+    struct MetaTileRequest : public osg::Referenced
+    {
+        Threading::Mutex                _mutex;
+        osg::ref_ptr<osg::HeightField> _field;
+    };
+    typedef std::map<std::string, osg::ref_ptr<MetaTileRequest> > MetaTileRequests;
+
+    LRUCache<std::string, osg::ref_ptr<osg::HeightField> > _metaTiles;
+    MetaTileRequests                                       _metaTileRequests;
+    Threading::Mutex                                       _metaTileMutex;
+
     HTTPRequest createRequest( const TileKey& key ) const;
+
+    HTTPRequest createRequest(
+        const GeoExtent& extent,
+        int              lon_samples,
+        int              lat_samples ) const;
+
+    osg::Image* createImage(
+        const HTTPRequest& request,
+        ProgressCallback*  progress );
+
+    osg::HeightField* fetchHeightField(
+        const GeoExtent&  extent,
+        int               cols,
+        int               rows,
+        ProgressCallback* progress );
+
+    osg::HeightField* readRawFloats(
+        std::istream& in,
+        int           cols,
+        int           rows ) const;
+
+    osg::HeightField* getMetaTile(
+        const TileKey&    key,
+        unsigned          metaSize,
+        ProgressCallback* progress );
 };
 
 #endif // OSGEARTH_WCS_PLUGIN_WCS11SOURCE_H_
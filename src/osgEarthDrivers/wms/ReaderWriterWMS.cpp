@@ -20,6 +20,7 @@
 #include <osgEarth/TileSource>
 #include <osgEarth/ImageToHeightFieldConverter>
 #include <osgEarth/Registry>
+#include <osgEarth/TaskService>
 #include <osgEarth/TimeControl>
 #include <osgEarth/XmlUtils>
 #include <osgEarthUtil/WMS>
@@ -34,6 +35,7 @@
 #include <string.h>
 #include <limits.h>
 #include <iomanip>
+#include <map>
 
 #include "TileService"
 #include "WMSOptions"
@@ -44,23 +46,8 @@ using namespace osgEarth;
 using namespace osgEarth::Util;
 using namespace osgEarth::Drivers;
 
-//----------------------------------------------------------------------------
-
-namespace
-{
-    // All looping ImageSequences deriving from this class will be in sync due to
-    // a shared reference time.
-    struct SyncImageSequence : public osg::ImageSequence
-    {
-        SyncImageSequence() : osg::ImageSequence() { }
-
-        virtual void update(osg::NodeVisitor* nv)
-        {
-            setReferenceTime( 0.0 );
-            osg::ImageSequence::update( nv );
-        }
-    };
-}
+// number of threads loading WMS-T frames in the background
+#define FRAME_THREADS 4
 
 //----------------------------------------------------------------------------
 
@@ -273,6 +260,10 @@ public:
             _dbOptions = Registry::instance()->cloneOrCreateOptions( dbOptions );
             CachePolicy::NO_CACHE.apply( _dbOptions.get() );
 
+            // WMS-T frames past the first one stream in on these threads.
+            if ( _timesVec.size() > 1 )
+                _frameService = new TaskService( "WMS-T frames", FRAME_THREADS );
+
             return STATUS_OK;
         }
         else
@@ -435,39 +426,30 @@ public:
         return image.release();
     }
 
-    /** creates a 3D image from timestamped data. */
-    osg::Image* createImageSequence( const TileKey& key, ProgressCallback* progress )
+    /** creates an image sequence that streams in its frames. */
+    osg::Image* createImageSequence( const TileKey& key, ProgressCallback* progress );
+
+    /** reads one time step of a WMS-T layer. */
+    osg::Image* createFrame( const TileKey& key, unsigned frame, ProgressCallback* progress )
     {
-        osg::ImageSequence* seq = new SyncImageSequence();
-        
-        seq->setLoopingMode( osg::ImageStream::LOOPING );
-        seq->setLength( _options.secondsPerFrame().value() * (double)_timesVec.size() );
-        if ( this->isSequencePlaying() )
-            seq->play();
+        std::string extraAttrs = std::string("TIME=") + _timesVec[frame];
 
-        for( unsigned int r=0; r<_timesVec.size(); ++r )
+        ReadResult response;
+        osgDB::ReaderWriter* reader = fetchTileAndReader( key, extraAttrs, progress, response );
+        if ( reader )
         {
-            std::string extraAttrs = std::string("TIME=") + _timesVec[r];
-
-            ReadResult response;
-            osgDB::ReaderWriter* reader = fetchTileAndReader( key, extraAttrs, progress, response );
-            if ( reader )
+            std::istringstream buf(response.getString());
+            osgDB::ReaderWriter::ReadResult readResult = reader->readImage( buf, _dbOptions.get() );
+            if ( !readResult.error() )
             {
-                std::istringstream buf(response.getString());
-                osgDB::ReaderWriter::ReadResult readResult = reader->readImage( buf, _dbOptions.get() );
-                if ( !readResult.error() )
-                {
-                    seq->addImage( readResult.getImage() );
-                }
-                else
-                {
-                    OE_WARN << "WMS: image read failed for " << createURI(key) << std::endl;
-                }
+                return readResult.takeImage();
+            }
+            else
+            {
+                OE_WARN << "WMS: image read failed for " << createURI(key) << std::endl;
             }
         }
-
-        _sequenceCache.insert( seq );
-        return seq;
+        return 0L;
     }
 
 
@@ -521,6 +503,14 @@ public:
     }
 
 
+protected:
+
+    virtual ~WMSSource()
+    {
+        // joins the frame threads.
+        _frameService = 0L;
+    }
+
 public: // SequenceControl
 
     /** Whether the implementation supports these methods */
@@ -587,10 +577,200 @@ private:
     osg::ref_ptr<osgDB::Options>     _dbOptions;
     bool                             _isPlaying;
     std::vector<SequenceFrameInfo>   _seqFrameInfoVec;
+    osg::ref_ptr<TaskService>        _frameService;
 
     mutable Threading::ThreadSafeObserverSet<osg::ImageSequence> _sequenceCache;
 };
 
+//----------------------------------------------------------------------------
+
+namespace
+{
+    // loads one WMS-T frame in the background.
+    struct FrameRequest : public TaskRequest
+    {
+        FrameRequest( WMSSource* source, const TileKey& key, unsigned frame, float priority )
+            : TaskRequest( priority ), _source( source ), _key( key ), _frame( frame ) { }
+
+        void operator()( ProgressCallback* progress )
+        {
+            osg::ref_ptr<WMSSource> source;
+            if ( _source.lock(source) )
+                _image = source->createFrame( _key, _frame, progress );
+        }
+
+        osg::observer_ptr<WMSSource> _source;
+        TileKey                      _key;
+        unsigned                     _frame;
+        osg::ref_ptr<osg::Image>     _image;
+    };
+
+    // Image sequence that loads its frames on demand. It keeps a sliding
+    // window of frames (the current one and those right after it) in memory
+    // and keeps showing the last loaded frame until the next one arrives.
+    // All looping sequences of this class stay in sync because they derive
+    // the current frame from the simulation time.
+    struct SyncImageSequence : public osg::ImageSequence
+    {
+        SyncImageSequence(WMSSource*     source,
+                          TaskService*   service,
+                          const TileKey& key,
+                          unsigned       numFrames,
+                          unsigned       window,
+                          double         secondsPerFrame )
+            : osg::ImageSequence(),
+              _source         ( source ),
+              _service        ( service ),
+              _key            ( key ),
+              _numFrames      ( numFrames ),
+              _window         ( osg::clampBetween(window, 2u, numFrames) ),
+              _secondsPerFrame( secondsPerFrame ),
+              _frame          ( 0 )
+        {
+            setLength( secondsPerFrame * (double)numFrames );
+        }
+
+        // shows a frame and keeps it in the window.
+        void setFrame( unsigned frame, osg::Image* image )
+        {
+            _frames[frame] = image;
+            show( frame, image );
+        }
+
+        virtual void update(osg::NodeVisitor* nv)
+        {
+            const osg::FrameStamp* fs = nv ? nv->getFrameStamp() : 0L;
+            if ( !fs || _numFrames == 0 )
+                return;
+
+            unsigned frame = _frame;
+            if ( getStatus() == PLAYING )
+            {
+                double t = fmod( fs->getSimulationTime(), getLength() );
+                frame = osg::clampBetween( (unsigned)(t / _secondsPerFrame), 0u, _numFrames-1 );
+            }
+
+            // collect finished loads.
+            for( Requests::iterator i = _requests.begin(); i != _requests.end(); )
+            {
+                if ( i->second->isCompleted() )
+                {
+                    if ( i->second->_image.valid() )
+                        _frames[i->first] = i->second->_image.get();
+                    _requests.erase( i++ );
+                }
+                else ++i;
+            }
+
+            // slide the window: drop frames (and loads) that fell out of it.
+            for( Frames::iterator i = _frames.begin(); i != _frames.end(); )
+            {
+                if ( !inWindow(i->first, frame) )
+                    _frames.erase( i++ );
+                else ++i;
+            }
+            for( Requests::iterator i = _requests.begin(); i != _requests.end(); )
+            {
+                if ( !inWindow(i->first, frame) )
+                {
+                    i->second->cancel();
+                    _requests.erase( i++ );
+                }
+                else ++i;
+            }
+
+            // request the frames we still need, nearest first.
+            osg::ref_ptr<TaskService> service;
+            if ( _service.lock(service) )
+            {
+                for( unsigned k = 0; k < _window; ++k )
+                {
+                    unsigned f = (frame + k) % _numFrames;
+                    if ( _frames.find(f) == _frames.end() && _requests.find(f) == _requests.end() )
+                    {
+                        FrameRequest* request = new FrameRequest( _source.get(), _key, f, -(float)k );
+                        _requests[f] = request;
+                        service->add( request );
+                    }
+                }
+            }
+
+            Frames::iterator i = _frames.find( frame );
+            if ( i != _frames.end() && (frame != _frame || i->second.get() != _shown.get()) )
+            {
+                show( frame, i->second.get() );
+            }
+        }
+
+    protected:
+        virtual ~SyncImageSequence()
+        {
+            for( Requests::iterator i = _requests.begin(); i != _requests.end(); ++i )
+                i->second->cancel();
+        }
+
+        bool inWindow( unsigned f, unsigned frame ) const
+        {
+            return (f + _numFrames - frame) % _numFrames < _window;
+        }
+
+        void show( unsigned frame, osg::Image* image )
+        {
+            // hold a reference since the pixels are not copied.
+            _shown = image;
+            _frame = frame;
+            osg::Image::setImage(
+                image->s(), image->t(), image->r(),
+                image->getInternalTextureFormat(),
+                image->getPixelFormat(),
+                image->getDataType(),
+                image->data(),
+                osg::Image::NO_DELETE,
+                image->getPacking() );
+        }
+
+        typedef std::map<unsigned, osg::ref_ptr<osg::Image> >   Frames;
+        typedef std::map<unsigned, osg::ref_ptr<FrameRequest> > Requests;
+
+        osg::observer_ptr<WMSSource>   _source;
+        osg::observer_ptr<TaskService> _service;
+        TileKey                        _key;
+        unsigned                       _numFrames;
+        unsigned                       _window;
+        double                         _secondsPerFrame;
+        unsigned                       _frame;
+        osg::ref_ptr<osg::Image>       _shown;
+        Frames                         _frames;
+        Requests                       _requests;
+    };
+}
+
+osg::Image*
+WMSSource::createImageSequence( const TileKey& key, ProgressCallback* progress )
+{
+    // only the first frame is read up front; the rest stream in as the
+    // sequence plays.
+    osg::ref_ptr<osg::Image> first = createFrame( key, 0, progress );
+    if ( !first.valid() )
+        return 0L;
+
+    SyncImageSequence* seq = new SyncImageSequence(
+        this,
+        _frameService.get(),
+        key,
+        _timesVec.size(),
+        _options.sequenceWindow().value(),
+        _options.secondsPerFrame().value() );
+
+    seq->setLoopingMode( osg::ImageStream::LOOPING );
+    seq->setFrame( 0, first.get() );
+    if ( this->isSequencePlaying() )
+        seq->play();
+
+    _sequenceCache.insert( seq );
+    return seq;
+}
+
 
 class WMSSourceFactory : public TileSourceDriver
 {
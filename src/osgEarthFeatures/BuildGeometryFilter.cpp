@@ -22,6 +22,7 @@
 #include <osgEarthSymbology/PointSymbol>
 #include <osgEarthSymbology/LineSymbol>
 #include <osgEarthSymbology/PolygonSymbol>
+#include <osgEarthSymbology/PolygonTriangulator>
 #include <osgEarthSymbology/MeshSubdivider>
 #include <osgEarthSymbology/MeshConsolidator>
 #include <osgEarth/ECEF>
@@ -222,7 +223,8 @@ BuildGeometryFilter::process( FeatureList& features, const FilterContext& contex
 
             if ( renderType == Geometry::TYPE_POLYGON )
             {
-                buildPolygon(part, featureSRS, mapSRS, makeECEF, true, osgGeom);
+                bool earClip = polySymbol && polySymbol->triangulation() == PolygonSymbol::TRIANGULATION_EAR_CLIPPING;
+                buildPolygon(part, featureSRS, mapSRS, makeECEF, true, earClip, osgGeom);
                 allPoints = static_cast<osg::Vec3Array*>( osgGeom->getVertexArray() );
             }
             else
@@ -304,7 +306,7 @@ BuildGeometryFilter::process( FeatureList& features, const FilterContext& contex
                 osg::Geometry* outline = new osg::Geometry();
                 outline->setUseVertexBufferObjects( _useVertexBufferObjects.value() );
 
-                buildPolygon(part, featureSRS, mapSRS, makeECEF, false, outline);
+                buildPolygon(part, featureSRS, mapSRS, makeECEF, false, false, outline);
 
                 if ( outline->getVertexArray()->getVertexBufferObject() )
                     outline->getVertexArray()->getVertexBufferObject()->setUsage(GL_STATIC_DRAW_ARB);                
@@ -368,6 +370,7 @@ BuildGeometryFilter::buildPolygon(Geometry*               ring,
                                   const SpatialReference* mapSRS,
                                   bool                    makeECEF,
                                   bool                    tessellate,
+                                  bool                    earClip,
                                   osg::Geometry*          osgGeom)
 {
     if ( !ring->isValid() )
@@ -380,6 +383,10 @@ BuildGeometryFilter::buildPolygon(Geometry*               ring,
     GLenum mode = GL_LINE_LOOP;
     osgGeom->addPrimitiveSet( new osg::DrawArrays( mode, 0, ring->size() ) );
 
+    // the rings, in the order in which their points went into the vertex array:
+    std::vector<const Geometry*> rings;
+    rings.push_back( ring );
+
     Polygon* poly = dynamic_cast<Polygon*>(ring);
     if ( poly )
     {
@@ -394,6 +401,7 @@ BuildGeometryFilter::buildPolygon(Geometry*               ring,
 
                 osgGeom->addPrimitiveSet( new osg::DrawArrays( mode, offset, hole->size() ) );
                 offset += hole->size();
+                rings.push_back( hole );
             }            
         }
     }
@@ -401,11 +409,22 @@ BuildGeometryFilter::buildPolygon(Geometry*               ring,
 
     if ( tessellate )
     {
-        osgUtil::Tessellator tess;
-        tess.setTessellationType( osgUtil::Tessellator::TESS_TYPE_GEOMETRY );
-        tess.setWindingType( osgUtil::Tessellator::TESS_WINDING_POSITIVE );
-        //tess.setBoundaryOnly( true );
-        tess.retessellatePolygons( *osgGeom );
+        // the ear clipper works on the source points; if it declines the
+        // polygon, the GLU tessellator takes over.
+        std::vector<unsigned> triangles;
+        if ( earClip && PolygonTriangulator::triangulate(rings, triangles) )
+        {
+            osgGeom->removePrimitiveSet( 0, osgGeom->getNumPrimitiveSets() );
+            osgGeom->addPrimitiveSet( new osg::DrawElementsUInt(GL_TRIANGLES, triangles.begin(), triangles.end()) );
+        }
+        else
+        {
+            osgUtil::Tessellator tess;
+            tess.setTessellationType( osgUtil::Tessellator::TESS_TYPE_GEOMETRY );
+            tess.setWindingType( osgUtil::Tessellator::TESS_WINDING_POSITIVE );
+            //tess.setBoundaryOnly( true );
+            tess.retessellatePolygons( *osgGeom );
+        }
     }
 
     //// Normal computation.
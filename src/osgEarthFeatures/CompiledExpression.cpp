@@ -0,0 +1,287 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/CompiledExpression>
+#include <osgEarthFeatures/ScriptEngine>
+#include <osgEarthFeatures/Session>
+#include <osgEarth/StringUtils>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+#define LC "[CompiledExpression] "
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // binds the variables of an expression to schema indexes.
+    template<typename VARIABLES>
+    void bindVariables(const VARIABLES&          vars,
+                       const AttributeSchema*    schema,
+                       std::vector<std::string>& names,
+                       std::vector<std::string>& lowerNames,
+                       std::vector<int>&         indexes)
+    {
+        for( typename VARIABLES::const_iterator i = vars.begin(); i != vars.end(); ++i )
+        {
+            std::string lowerName = toLower(i->first);
+            names.push_back( i->first );
+            lowerNames.push_back( lowerName );
+            indexes.push_back( schema ? schema->find(lowerName) : -1 );
+        }
+    }
+
+    ScriptResult runScript( const std::string& code, const Feature* feature, FilterContext const* context )
+    {
+        ScriptEngine* engine = context && context->getSession() ? context->getSession()->getScriptEngine() : 0L;
+        return engine ? engine->run(code, feature, context) : ScriptResult();
+    }
+
+    // runs a script variable over every feature that doesn't carry it as an
+    // attribute, in a single call into the engine. Warns once on failure.
+    void runScripts(const std::string&         code,
+                    const FeatureList&         features,
+                    FilterContext const*       context,
+                    std::vector<ScriptResult>& results)
+    {
+        ScriptEngine* engine = context && context->getSession() ? context->getSession()->getScriptEngine() : 0L;
+        if ( !engine )
+        {
+            results.resize( features.size() );
+            return;
+        }
+
+        if ( !engine->runBatch(code, features, results, context) )
+        {
+            for( unsigned k = 0; k < results.size(); ++k )
+            {
+                if ( !results[k].success() )
+                {
+                    OE_WARN << LC << "Script error:" << results[k].message() << std::endl;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+CompiledNumericExpression::CompiledNumericExpression(const NumericExpression& expr,
+                                                     const AttributeSchema*   schema) :
+_schema( schema )
+{
+    expr.compile( _program );
+    bindVariables( expr.variables(), schema, _names, _lowerNames, _indexes );
+}
+
+void
+CompiledNumericExpression::bind( const Feature* feature, FilterContext const* context, double* values ) const
+{
+    for( unsigned i = 0; i < _indexes.size(); ++i )
+    {
+        values[i] = 0.0;
+        const AttributeValue* a = feature->getAttr( _schema.get(), _indexes[i], _lowerNames[i] );
+        if ( a )
+        {
+            values[i] = a->getDouble( 0.0 );
+        }
+        else if ( context )
+        {
+            //No attr found, look for script
+            ScriptResult result = runScript( _names[i], feature, context );
+            if ( result.success() )
+                values[i] = result.asDouble();
+            else if ( context->getSession() && context->getSession()->getScriptEngine() )
+                OE_WARN << LC << "Script error:" << result.message() << std::endl;
+        }
+    }
+}
+
+double
+CompiledNumericExpression::eval( const Feature* feature, FilterContext const* context ) const
+{
+    if ( _indexes.empty() || !feature )
+        return _program.run( 0L );
+
+    double              local[16];
+    std::vector<double> heap;
+    double*             values = local;
+    if ( _indexes.size() > 16 )
+    {
+        heap.resize( _indexes.size() );
+        values = &heap[0];
+    }
+
+    bind( feature, context, values );
+    return _program.run( values );
+}
+
+void
+CompiledNumericExpression::eval( const FeatureList& features, std::vector<double>& output, FilterContext const* context ) const
+{
+    output.reserve( output.size() + features.size() );
+
+    if ( isConstant() )
+    {
+        output.insert( output.end(), features.size(), _program.run(0L) );
+        return;
+    }
+
+    // bind the attributes feature by feature. Variables that a feature doesn't
+    // carry are scripts; those run in one batch per variable.
+    unsigned numVars = _indexes.size();
+    std::vector<double> values( features.size() * numVars, 0.0 );
+
+    for( unsigned i = 0; i < numVars; ++i )
+    {
+        FeatureList           scripted;
+        std::vector<unsigned> slots;
+
+        unsigned f = 0;
+        for( FeatureList::const_iterator j = features.begin(); j != features.end(); ++j, ++f )
+        {
+            const AttributeValue* a = j->get()->getAttr( _schema.get(), _indexes[i], _lowerNames[i] );
+            if ( a )
+            {
+                values[f*numVars + i] = a->getDouble( 0.0 );
+            }
+            else if ( context )
+            {
+                scripted.push_back( j->get() );
+                slots.push_back( f );
+            }
+        }
+
+        if ( !scripted.empty() )
+        {
+            std::vector<ScriptResult> results;
+            runScripts( _names[i], scripted, context, results );
+            for( unsigned k = 0; k < slots.size() && k < results.size(); ++k )
+            {
+                if ( results[k].success() )
+                    values[slots[k]*numVars + i] = results[k].asDouble();
+            }
+        }
+    }
+
+    for( unsigned f = 0; f < features.size(); ++f )
+    {
+        output.push_back( _program.run(numVars > 0 ? &values[f*numVars] : 0L) );
+    }
+}
+
+//------------------------------------------------------------------------
+
+CompiledStringExpression::CompiledStringExpression(const StringExpression& expr,
+                                                   const AttributeSchema*  schema) :
+_schema( schema )
+{
+    expr.compile( _program );
+    bindVariables( expr.variables(), schema, _names, _lowerNames, _indexes );
+}
+
+void
+CompiledStringExpression::bind( const Feature* feature, FilterContext const* context, std::string* values ) const
+{
+    for( unsigned i = 0; i < _indexes.size(); ++i )
+    {
+        values[i].clear();
+        const AttributeValue* a = feature->getAttr( _schema.get(), _indexes[i], _lowerNames[i] );
+        if ( a )
+        {
+            values[i] = a->getString();
+        }
+        else if ( context )
+        {
+            //No attr found, look for script
+            ScriptResult result = runScript( _names[i], feature, context );
+            if ( result.success() )
+                values[i] = result.asString();
+            else if ( context->getSession() && context->getSession()->getScriptEngine() )
+                OE_WARN << LC << "Script error:" << result.message() << std::endl;
+        }
+    }
+}
+
+std::string
+CompiledStringExpression::eval( const Feature* feature, FilterContext const* context ) const
+{
+    if ( _indexes.empty() || !feature )
+        return _program.run( 0L );
+
+    std::vector<std::string> values( _indexes.size() );
+    bind( feature, context, &values[0] );
+    return _program.run( &values[0] );
+}
+
+void
+CompiledStringExpression::eval( const FeatureList& features, std::vector<std::string>& output, FilterContext const* context ) const
+{
+    output.reserve( output.size() + features.size() );
+
+    if ( isConstant() )
+    {
+        output.insert( output.end(), features.size(), _program.run(0L) );
+        return;
+    }
+
+    // bind the attributes feature by feature. Variables that a feature doesn't
+    // carry are scripts; those run in one batch per variable.
+    unsigned numVars = _indexes.size();
+    std::vector<std::string> values( features.size() * numVars );
+
+    for( unsigned i = 0; i < numVars; ++i )
+    {
+        FeatureList           scripted;
+        std::vector<unsigned> slots;
+
+        unsigned f = 0;
+        for( FeatureList::const_iterator j = features.begin(); j != features.end(); ++j, ++f )
+        {
+            const AttributeValue* a = j->get()->getAttr( _schema.get(), _indexes[i], _lowerNames[i] );
+            if ( a )
+            {
+                values[f*numVars + i] = a->getString();
+            }
+            else if ( context )
+            {
+                scripted.push_back( j->get() );
+                slots.push_back( f );
+            }
+        }
+
+        if ( !scripted.empty() )
+        {
+            std::vector<ScriptResult> results;
+            runScripts( _names[i], scripted, context, results );
+            for( unsigned k = 0; k < slots.size() && k < results.size(); ++k )
+            {
+                if ( results[k].success() )
+                    values[slots[k]*numVars + i] = results[k].asString();
+            }
+        }
+    }
+
+    for( unsigned f = 0; f < features.size(); ++f )
+    {
+        output.push_back( _program.run(numVars > 0 ? &values[f*numVars] : 0L) );
+    }
+}
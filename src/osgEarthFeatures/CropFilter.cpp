@@ -17,13 +17,85 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/CropFilter>
+#include <osgEarthSymbology/PreparedPolygon>
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
 
 #define LC "[CropFilter] "
 
+// smallest run of features worth handing to another thread
+#define MIN_FEATURES_PER_RUN 128
+
 using namespace osgEarth;
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
 
+//------------------------------------------------------------------------
+
+#ifdef OSGEARTH_HAVE_GEOS
+
+namespace
+{
+    Threading::Mutex          s_cropServiceMutex;
+    osg::ref_ptr<TaskService> s_cropService;
+
+    TaskService* getCropService()
+    {
+        Threading::ScopedMutexLock lock( s_cropServiceMutex );
+        if ( !s_cropService.valid() )
+        {
+            s_cropService = new TaskService(
+                "CropFilter",
+                osg::maximum( 2, OpenThreads::GetNumberOfProcessors() ) );
+        }
+        return s_cropService.get();
+    }
+
+    // crops a run of features against one prepared copy of the crop polygon
+    // (prepared geometries are not thread-safe, so each run makes its own).
+    // A NULL result discards the feature.
+    struct CropRun
+    {
+        void execute()
+        {
+            osg::ref_ptr<PreparedPolygon> prepared = new PreparedPolygon( _poly );
+
+            for( unsigned i = _first; i < _last; ++i )
+            {
+                Geometry* featureGeom = (*_features)[i]->getGeometry();
+                if ( !featureGeom || !featureGeom->isValid() )
+                    continue;
+
+                // test for trivial acceptance:
+                const Bounds bounds = featureGeom->getBounds();
+                if ( !bounds.isValid() )
+                    continue;
+
+                if ( _extent->contains(bounds) )
+                {
+                    (*_results)[i] = featureGeom;
+                }
+                else
+                {
+                    osg::ref_ptr<Geometry> croppedGeometry;
+                    if ( prepared->crop(featureGeom, croppedGeometry) && croppedGeometry->isValid() )
+                        (*_results)[i] = croppedGeometry.get();
+                }
+            }
+        }
+
+        const Symbology::Polygon*              _poly;
+        const GeoExtent*                       _extent;
+        std::vector<Feature*>*                 _features;
+        std::vector< osg::ref_ptr<Geometry> >* _results;
+        unsigned                               _first, _last;
+    };
+}
+
+#endif // OSGEARTH_HAVE_GEOS
+
+//------------------------------------------------------------------------
+
 CropFilter::CropFilter( CropFilter::Method method ) :
 _method( method )
 {
@@ -77,61 +149,76 @@ CropFilter::push( FeatureList& input, FilterContext& context )
     {
 #ifdef OSGEARTH_HAVE_GEOS
 
-        // create the intersection polygon:
-        osg::ref_ptr<Symbology::Polygon> poly;
-        
-        for( FeatureList::iterator i = input.begin(); i != input.end();  )
+        // the intersection polygon:
+        osg::ref_ptr<Symbology::Polygon> poly = new Symbology::Polygon();
+        poly->push_back( osg::Vec3d( extent.xMin(), extent.yMin(), 0 ));
+        poly->push_back( osg::Vec3d( extent.xMax(), extent.yMin(), 0 ));
+        poly->push_back( osg::Vec3d( extent.xMax(), extent.yMax(), 0 ));
+        poly->push_back( osg::Vec3d( extent.xMin(), extent.yMax(), 0 ));
+
+        std::vector<Feature*> features;
+        features.reserve( input.size() );
+        for( FeatureList::iterator i = input.begin(); i != input.end(); ++i )
+            features.push_back( i->get() );
+
+        std::vector< osg::ref_ptr<Geometry> > results( features.size() );
+
+        // crop in contiguous runs; a large list runs them concurrently
+        // (the calling thread takes the first one).
+        unsigned numRuns = 1;
+        if ( features.size() >= 2*MIN_FEATURES_PER_RUN )
         {
-            bool keepFeature = false;
+            numRuns = osg::minimum(
+                (unsigned)OpenThreads::GetNumberOfProcessors(),
+                (unsigned)features.size() / MIN_FEATURES_PER_RUN );
+            numRuns = osg::maximum( numRuns, 1u );
+        }
 
-            Feature* feature = i->get();
+        unsigned runSize = (features.size() + numRuns - 1) / numRuns;
 
-            Symbology::Geometry* featureGeom = feature->getGeometry();
-            if ( featureGeom && featureGeom->isValid() )
-            {
-                // test for trivial acceptance:
-                const Bounds bounds = featureGeom->getBounds();
-                if ( !bounds.isValid() )
-                {
-                    //nop
-                }
+        typedef ParallelTask<CropRun> CropTask;
+        std::vector< osg::ref_ptr<CropTask> > tasks;
+        tasks.reserve( numRuns );
 
-                else if ( extent.contains( bounds ) )
-                {
-                    keepFeature = true;
-                    newExtent.expandToInclude( bounds );
-                }
+        TaskService* service = numRuns > 1 ? getCropService() : 0L;
+        Threading::MultiEvent done( (int)numRuns-1 );
 
-                // then move on to the cropping operation:
-                else
-                {
-                    if ( !poly.valid() )
-                    {
-                        poly = new Symbology::Polygon();
-                        poly->push_back( osg::Vec3d( extent.xMin(), extent.yMin(), 0 ));
-                        poly->push_back( osg::Vec3d( extent.xMax(), extent.yMin(), 0 ));
-                        poly->push_back( osg::Vec3d( extent.xMax(), extent.yMax(), 0 ));
-                        poly->push_back( osg::Vec3d( extent.xMin(), extent.yMax(), 0 ));
-                    }
+        for( unsigned r = 0; r < numRuns; ++r )
+        {
+            CropTask* task = r > 0 ? new CropTask( &done ) : new CropTask();
+            task->_poly     = poly.get();
+            task->_extent   = &extent;
+            task->_features = &features;
+            task->_results  = &results;
+            task->_first    = osg::minimum( r * runSize, (unsigned)features.size() );
+            task->_last     = osg::minimum( task->_first + runSize, (unsigned)features.size() );
+            tasks.push_back( task );
+
+            if ( r > 0 )
+                service->add( task );
+        }
 
-                    osg::ref_ptr<Geometry> croppedGeometry;
-                    if ( featureGeom->crop( poly.get(), croppedGeometry ) )
-                    {
-                        if ( croppedGeometry->isValid() )
-                        {
-                            feature->setGeometry( croppedGeometry.get() );
-                            keepFeature = true;
-                            newExtent.expandToInclude( croppedGeometry->getBounds() );
-                        }
-                    }
-                }
-            }
+        tasks[0]->execute();
+        if ( numRuns > 1 )
+            done.wait();
 
-            if ( keepFeature )
+        // apply the results in order.
+        unsigned index = 0;
+        for( FeatureList::iterator i = input.begin(); i != input.end(); ++index )
+        {
+            Geometry* result = results[index].get();
+            if ( result )
+            {
+                if ( result != (*i)->getGeometry() )
+                    (*i)->setGeometry( result );
+                newExtent.expandToInclude( result->getBounds() );
                 ++i;
+            }
             else
+            {
                 i = input.erase( i );
-        }  
+            }
+        }
 
 #else // OSGEARTH_HAVE_GEOS
 
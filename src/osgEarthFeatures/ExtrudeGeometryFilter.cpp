@@ -17,14 +17,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/ExtrudeGeometryFilter>
+#include <osgEarthFeatures/CompiledExpression>
 #include <osgEarthFeatures/FeatureSourceIndexNode>
 #include <osgEarthSymbology/MeshSubdivider>
 #include <osgEarthSymbology/MeshConsolidator>
+#include <osgEarthSymbology/PolygonTriangulator>
 #include <osgEarth/ECEF>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/ShaderGenerator>
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
 #include <osg/Geode>
 #include <osg/Geometry>
 #include <osg/MatrixTransform>
@@ -35,9 +39,13 @@
 #include <osg/LineWidth>
 #include <osg/PolygonOffset>
 #include <osgEarth/Version>
+#include <OpenThreads/Thread>
 
 #define LC "[ExtrudeGeometryFilter] "
 
+// smallest number of parts worth handing to a thread of its own
+#define MIN_PARTS_PER_RUN 64
+
 using namespace osgEarth;
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
@@ -69,8 +77,45 @@ namespace
 
         return atan2( p2.x()-p1.x(), p2.y()-p1.y() );
     }
+
+    // threads that build runs of parts for large feature lists. This is its own
+    // service (and not e.g. the style group service) so that a task waiting on
+    // its runs never waits on itself.
+    Threading::Mutex          s_buildServiceMutex;
+    osg::ref_ptr<TaskService> s_buildService;
+
+    TaskService* getBuildService()
+    {
+        Threading::ScopedMutexLock lock( s_buildServiceMutex );
+        if ( !s_buildService.valid() )
+        {
+            s_buildService = new TaskService(
+                "ExtrudeGeometryFilter",
+                osg::maximum( 2, OpenThreads::GetNumberOfProcessors() ) );
+        }
+        return s_buildService.get();
+    }
 }
 
+/**
+ * Builds one run of parts (see ExtrudeGeometryFilter::process).
+ */
+struct ExtrudeGeometryFilter::BuildParts
+{
+    BuildParts() : _filter(0L), _parts(0L), _first(0), _last(0), _context(0L) { }
+
+    void execute()
+    {
+        _filter->buildParts( *_parts, _first, _last, _output, *_context );
+    }
+
+    ExtrudeGeometryFilter* _filter;
+    const PartList*        _parts;
+    unsigned               _first, _last;
+    FilterContext*         _context;
+    Output                 _output;
+};
+
 //------------------------------------------------------------------------
 
 ExtrudeGeometryFilter::ExtrudeGeometryFilter() :
@@ -79,7 +124,9 @@ _mergeGeometry      ( true ),
 _wallAngleThresh_deg( 60.0 ),
 _styleDirty         ( true ),
 _makeStencilVolume  ( false ),
-_useVertexBufferObjects( true )
+_useVertexBufferObjects( true ),
+_batching           ( false ),
+_maxThreads         ( osg::maximum(1, OpenThreads::GetNumberOfProcessors()) )
 {
     //NOP
 }
@@ -419,6 +466,7 @@ ExtrudeGeometryFilter::extrudeGeometry(const Geometry*         input,
 
         //osg::DrawElementsUShort* idx = new osg::DrawElementsUShort( GL_TRIANGLES );
         osg::DrawElementsUInt* idx = new osg::DrawElementsUInt( GL_TRIANGLES );
+        idx->reserve( 6 * part->size() );
 
         for( Geometry::const_iterator m = part->begin(); m != part->end(); ++m )
         {
@@ -633,20 +681,9 @@ ExtrudeGeometryFilter::addDrawable(osg::Drawable*      drawable,
                                    osg::StateSet*      stateSet,
                                    const std::string&  name,
                                    Feature*            feature,
-                                   FeatureSourceIndex* index )
+                                   FeatureSourceIndex* index,
+                                   Output&             output )
 {
-    // find the geode for the active stateset, creating a new one if necessary. NULL is a 
-    // valid key as well.
-    osg::Geode* geode = _geodes[stateSet].get();
-    if ( !geode )
-    {
-        geode = new osg::Geode();
-        geode->setStateSet( stateSet );
-        _geodes[stateSet] = geode;
-    }
-
-    geode->addDrawable( drawable );
-
     if ( !name.empty() )
     {
         drawable->setName( name );
@@ -656,6 +693,34 @@ ExtrudeGeometryFilter::addDrawable(osg::Drawable*      drawable,
     {
         index->tagPrimitiveSets( drawable, feature );
     }
+
+    // when merging, copy the geometry straight into the mesh for its stateset.
+    // (the index tags above travel along with the primitives.)
+    osg::Geometry* geom = drawable->asGeometry();
+    if ( _batching && geom )
+    {
+        osg::ref_ptr<MeshBatch>& batch = output._batches[stateSet];
+        if ( !batch.valid() )
+        {
+            batch = new MeshBatch( _useVertexBufferObjects.get() );
+            batch->reserve( output._batchReserve );
+        }
+
+        if ( batch->append(*geom) )
+            return;
+    }
+
+    // find the geode for the active stateset, creating a new one if necessary. NULL is a 
+    // valid key as well.
+    osg::Geode* geode = output._geodes[stateSet].get();
+    if ( !geode )
+    {
+        geode = new osg::Geode();
+        geode->setStateSet( stateSet );
+        output._geodes[stateSet] = geode;
+    }
+
+    geode->addDrawable( drawable );
 }
 
 bool
@@ -665,7 +730,33 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
     Random wallSkinPRNG( _wallSkinSymbol.valid()? *_wallSkinSymbol->randomSeed() : 0, Random::METHOD_FAST );
     Random roofSkinPRNG( _roofSkinSymbol.valid()? *_roofSkinSymbol->randomSeed() : 0, Random::METHOD_FAST );
 
-    for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
+    // evaluate the height expressions for all the features up front, with the
+    // variables bound to the feature schema.
+    const AttributeSchema* schema = context.profile() ? context.profile()->getAttributeSchema() : 0L;
+
+    std::vector<double> heights;
+    if ( !_heightCallback.valid() && _heightExpr.isSet() )
+    {
+        CompiledNumericExpression heightExpr( *_heightExpr, schema );
+        heightExpr.eval( features, heights, &context );
+    }
+
+    std::vector<double> offsets;
+    if ( _heightOffsetExpr.isSet() )
+    {
+        CompiledNumericExpression offsetExpr( *_heightOffsetExpr, schema );
+        offsetExpr.eval( features, offsets, &context );
+    }
+
+    // first pass, in feature order: work out everything that depends on the
+    // order of the features (the skin PRNGs) or that may not be safe to call
+    // from several threads (height callbacks, name scripts). The geometry
+    // comes out the same no matter how the second pass is split up.
+    PartList parts;
+    parts.reserve( features.size() );
+
+    unsigned featureIndex = 0;
+    for( FeatureList::iterator f = features.begin(); f != features.end(); ++f, ++featureIndex )
     {
         Feature* input = f->get();
 
@@ -674,36 +765,12 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
         {
             Geometry* part = iter.next();
 
-            osg::ref_ptr<osg::Geometry> walls = new osg::Geometry();
-            walls->setUseVertexBufferObjects( _useVertexBufferObjects.get() );
-            
-            osg::ref_ptr<osg::Geometry> rooflines = 0L;
-            osg::ref_ptr<osg::Geometry> baselines = 0L;
-            osg::ref_ptr<osg::Geometry> outlines  = 0L;
-            
+            // prep the shapes by making sure all polys are open:
             if ( part->getType() == Geometry::TYPE_POLYGON )
             {
-                rooflines = new osg::Geometry();
-                rooflines->setUseVertexBufferObjects( _useVertexBufferObjects.get() );
-
-                // prep the shapes by making sure all polys are open:
                 static_cast<Polygon*>(part)->open();
             }
 
-            // fire up the outline geometry if we have a line symbol.
-            if ( _outlineSymbol != 0L )
-            {
-                outlines = new osg::Geometry();
-                outlines->setUseVertexBufferObjects( _useVertexBufferObjects.get() );
-            }
-
-            // make a base cap if we're doing stencil volumes.
-            if ( _makeStencilVolume )
-            {
-                baselines = new osg::Geometry();
-                baselines->setUseVertexBufferObjects( _useVertexBufferObjects.get() );
-            }
-
             // calculate the extrusion height:
             float height;
 
@@ -713,7 +780,7 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
             }
             else if ( _heightExpr.isSet() )
             {
-                height = input->eval( _heightExpr.mutable_value(), &context );
+                height = heights[featureIndex];
             }
             else
             {
@@ -724,12 +791,9 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
             float offset = 0.0;
             if ( _heightOffsetExpr.isSet() )
             {
-                offset = input->eval( _heightOffsetExpr.mutable_value(), &context );
+                offset = offsets[featureIndex];
             }
 
-            osg::ref_ptr<osg::StateSet> wallStateSet;
-            osg::ref_ptr<osg::StateSet> roofStateSet;
-
             // calculate the wall texturing:
             SkinResource* wallSkin = 0L;
             if ( _wallSkinSymbol.valid() )
@@ -763,116 +827,277 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                 }
             }
 
-            // calculate the colors:
-            osg::Vec4f wallColor(1,1,1,1), wallBaseColor(1,1,1,1), roofColor(1,1,1,1), outlineColor(1,1,1,1);
+            parts.push_back( Part() );
+            Part& p = parts.back();
+            p._feature  = input;
+            p._geom     = part;
+            p._height   = height;
+            p._offset   = offset;
+            p._wallSkin = wallSkin;
+            p._roofSkin = roofSkin;
+
+            if ( !_featureNameExpr.empty() )
+                p._name = input->eval( _featureNameExpr, &context );
+        }
+    }
+
+    // second pass: build the geometry. A large list is split into contiguous
+    // runs that build concurrently (the calling thread takes the first one).
+    unsigned numRuns = 1;
+    if ( _maxThreads > 1 && parts.size() >= 2*MIN_PARTS_PER_RUN )
+    {
+        numRuns = osg::minimum( _maxThreads, (unsigned)parts.size() / MIN_PARTS_PER_RUN );
+    }
+
+    unsigned runSize = (parts.size() + numRuns - 1) / numRuns;
+
+    typedef ParallelTask<BuildParts> BuildTask;
+    std::vector< osg::ref_ptr<BuildTask> > tasks;
+    tasks.reserve( numRuns );
+
+    TaskService* service = numRuns > 1 ? getBuildService() : 0L;
+    Threading::MultiEvent done( (int)numRuns-1 );
 
-            if ( _wallPolygonSymbol.valid() )
+    for( unsigned i = 0; i < numRuns; ++i )
+    {
+        BuildTask* task = i > 0 ? new BuildTask( &done ) : new BuildTask();
+        task->_filter  = this;
+        task->_parts   = &parts;
+        task->_first   = osg::minimum( i * runSize, (unsigned)parts.size() );
+        task->_last    = osg::minimum( task->_first + runSize, (unsigned)parts.size() );
+        task->_context = &context;
+        tasks.push_back( task );
+
+        if ( i > 0 )
+            service->add( task );
+    }
+
+    tasks[0]->execute();
+    if ( numRuns > 1 )
+        done.wait();
+
+    // merge the runs in order, so the drawables land in the same order they
+    // would if a single thread had built them all.
+    for( unsigned i = 0; i < tasks.size(); ++i )
+    {
+        SortedGeodeMap& geodes = tasks[i]->_output._geodes;
+        for( SortedGeodeMap::iterator g = geodes.begin(); g != geodes.end(); ++g )
+        {
+            osg::ref_ptr<osg::Geode>& geode = _geodes[g->first];
+            if ( !geode.valid() )
             {
-                wallColor = _wallPolygonSymbol->fill()->color();
-                if ( _extrusionSymbol->wallGradientPercentage().isSet() )
-                {
-                    wallBaseColor = Color(wallColor).brightness( 1.0 - *_extrusionSymbol->wallGradientPercentage() );
-                }
-                else
-                {
-                    wallBaseColor = wallColor;
-                }
+                geode = g->second.get();
             }
-            if ( _roofPolygonSymbol.valid() )
+            else
             {
-                roofColor = _roofPolygonSymbol->fill()->color();
+                for( unsigned d = 0; d < g->second->getNumDrawables(); ++d )
+                    geode->addDrawable( g->second->getDrawable(d) );
             }
-            if ( _outlineSymbol.valid() )
+        }
+    }
+
+    // the drawables that could not be batched (outlines, for example) still get
+    // consolidated the old way.
+    if ( _batching )
+    {
+        for( SortedGeodeMap::iterator i = _geodes.begin(); i != _geodes.end(); ++i )
+        {
+            MeshConsolidator::run( *i->second.get() );
+        }
+    }
+
+    // collect the batched meshes into the geodes for their statesets.
+    for( unsigned i = 0; i < tasks.size(); ++i )
+    {
+        SortedBatchMap& batches = tasks[i]->_output._batches;
+        for( SortedBatchMap::iterator b = batches.begin(); b != batches.end(); ++b )
+        {
+            osg::ref_ptr<osg::Geode>& geode = _geodes[b->first];
+            if ( !geode.valid() )
             {
-                outlineColor = _outlineSymbol->stroke()->color();
+                geode = new osg::Geode();
+                geode->setStateSet( b->first );
             }
+            b->second->addTo( *geode.get() );
+        }
+    }
 
-            // Create the extruded geometry!
-            if (extrudeGeometry( 
-                    part, height, offset, 
-                    *_extrusionSymbol->flatten(),
-                    walls.get(), rooflines.get(), baselines.get(), outlines.get(),
-                    wallColor, wallBaseColor, roofColor, outlineColor,
-                    wallSkin, roofSkin,
-                    context ) )
-            {      
-                if ( wallSkin )
-                {
-                    context.resourceCache()->getStateSet( wallSkin, wallStateSet );
-                }
+    return true;
+}
 
-                // generate per-vertex normals, altering the geometry as necessary to avoid
-                // smoothing around sharp corners
-    #if OSG_MIN_VERSION_REQUIRED(2,9,9)
-                //Crease angle threshold wasn't added until
-                osgUtil::SmoothingVisitor::smooth(
-                    *walls.get(), 
-                    osg::DegreesToRadians(_wallAngleThresh_deg) );            
-    #else
-                osgUtil::SmoothingVisitor::smooth(*walls.get());            
-    #endif
+void
+ExtrudeGeometryFilter::buildParts(const PartList& parts,
+                                  unsigned        first,
+                                  unsigned        last,
+                                  Output&         output,
+                                  FilterContext&  context )
+{
+    // size the mesh batches for a rough estimate of the output: each footprint
+    // point makes a few wall vertices and a roof vertex.
+    if ( _batching )
+    {
+        unsigned numPoints = 0;
+        for( unsigned i = first; i < last; ++i )
+            numPoints += parts[i]._geom->getTotalPointCount();
+        output._batchReserve = numPoints * 5;
+    }
 
-                // tessellate and add the roofs if necessary:
-                if ( rooflines.valid() )
-                {
-                    osgUtil::Tessellator tess;
-                    tess.setTessellationType( osgUtil::Tessellator::TESS_TYPE_GEOMETRY );
-                    tess.setWindingType( osgUtil::Tessellator::TESS_WINDING_ODD );
-                    tess.retessellatePolygons( *(rooflines.get()) );
+    // the colors are the same for every part.
+    osg::Vec4f wallColor(1,1,1,1), wallBaseColor(1,1,1,1), roofColor(1,1,1,1), outlineColor(1,1,1,1);
 
-                    // generate default normals (no crease angle necessary; they are all pointing up)
-                    // TODO do this manually; probably faster
-                    if ( !_makeStencilVolume )
-                        osgUtil::SmoothingVisitor::smooth( *rooflines.get() );
+    if ( _wallPolygonSymbol.valid() )
+    {
+        wallColor = _wallPolygonSymbol->fill()->color();
+        if ( _extrusionSymbol->wallGradientPercentage().isSet() )
+        {
+            wallBaseColor = Color(wallColor).brightness( 1.0 - *_extrusionSymbol->wallGradientPercentage() );
+        }
+        else
+        {
+            wallBaseColor = wallColor;
+        }
+    }
+    if ( _roofPolygonSymbol.valid() )
+    {
+        roofColor = _roofPolygonSymbol->fill()->color();
+    }
+    if ( _outlineSymbol.valid() )
+    {
+        outlineColor = _outlineSymbol->stroke()->color();
+    }
 
-                    // texture the rooflines if necessary
-                    //applyOverlayTexturing( rooflines.get(), input, env );
+    bool earClip =
+        _roofPolygonSymbol.valid() &&
+        _roofPolygonSymbol->triangulation() == PolygonSymbol::TRIANGULATION_EAR_CLIPPING;
 
-                    // mark this geometry as DYNAMIC because otherwise the OSG optimizer will destroy it.
-                    // TODO: why??
-                    //rooflines->setDataVariance( osg::Object::DYNAMIC );
+    FeatureSourceIndex* index = context.featureIndex();
 
-                    if ( roofSkin )
-                    {
-                        context.resourceCache()->getStateSet( roofSkin, roofStateSet );
-                    }
-                }
+    std::vector<const Geometry*> rings;
+    std::vector<unsigned>        triangles;
 
-                if ( baselines.valid() )
-                {
-                    osgUtil::Tessellator tess;
-                    tess.setTessellationType( osgUtil::Tessellator::TESS_TYPE_GEOMETRY );
-                    tess.setWindingType( osgUtil::Tessellator::TESS_WINDING_ODD );
-                    tess.retessellatePolygons( *(baselines.get()) );
-                }
+    for( unsigned i = first; i < last; ++i )
+    {
+        const Part& p    = parts[i];
+        Geometry*   part = p._geom;
+
+        osg::ref_ptr<osg::Geometry> walls = new osg::Geometry();
+        walls->setUseVertexBufferObjects( _useVertexBufferObjects.get() );
+        
+        osg::ref_ptr<osg::Geometry> rooflines = 0L;
+        osg::ref_ptr<osg::Geometry> baselines = 0L;
+        osg::ref_ptr<osg::Geometry> outlines  = 0L;
+        
+        if ( part->getType() == Geometry::TYPE_POLYGON )
+        {
+            rooflines = new osg::Geometry();
+            rooflines->setUseVertexBufferObjects( _useVertexBufferObjects.get() );
+        }
 
-                std::string name;
-                if ( !_featureNameExpr.empty() )
-                    name = input->eval( _featureNameExpr, &context );
+        // fire up the outline geometry if we have a line symbol.
+        if ( _outlineSymbol != 0L )
+        {
+            outlines = new osg::Geometry();
+            outlines->setUseVertexBufferObjects( _useVertexBufferObjects.get() );
+        }
 
-                FeatureSourceIndex* index = context.featureIndex();
+        // make a base cap if we're doing stencil volumes.
+        if ( _makeStencilVolume )
+        {
+            baselines = new osg::Geometry();
+            baselines->setUseVertexBufferObjects( _useVertexBufferObjects.get() );
+        }
 
-                addDrawable( walls.get(), wallStateSet.get(), name, input, index );
+        osg::ref_ptr<osg::StateSet> wallStateSet;
+        osg::ref_ptr<osg::StateSet> roofStateSet;
+
+        // Create the extruded geometry!
+        if (extrudeGeometry( 
+                part, p._height, p._offset, 
+                *_extrusionSymbol->flatten(),
+                walls.get(), rooflines.get(), baselines.get(), outlines.get(),
+                wallColor, wallBaseColor, roofColor, outlineColor,
+                p._wallSkin, p._roofSkin,
+                context ) )
+        {      
+            if ( p._wallSkin )
+            {
+                context.resourceCache()->getStateSet( p._wallSkin, wallStateSet );
+            }
 
-                if ( rooflines.valid() )
+            // generate per-vertex normals, altering the geometry as necessary to avoid
+            // smoothing around sharp corners
+    #if OSG_MIN_VERSION_REQUIRED(2,9,9)
+            //Crease angle threshold wasn't added until
+            osgUtil::SmoothingVisitor::smooth(
+                *walls.get(), 
+                osg::DegreesToRadians(_wallAngleThresh_deg) );            
+    #else
+            osgUtil::SmoothingVisitor::smooth(*walls.get());            
+    #endif
+
+            // tessellate and add the roofs if necessary:
+            if ( rooflines.valid() )
+            {
+                // the roof points follow the part's rings in iterator order.
+                rings.clear();
+                triangles.clear();
+                if ( earClip )
                 {
-                    addDrawable( rooflines.get(), roofStateSet.get(), name, input, index );
+                    ConstGeometryIterator r( part );
+                    while( r.hasMore() )
+                        rings.push_back( r.next() );
                 }
 
-                if ( baselines.valid() )
+                if ( earClip && PolygonTriangulator::triangulate(rings, triangles) )
+                {
+                    rooflines->removePrimitiveSet( 0, rooflines->getNumPrimitiveSets() );
+                    rooflines->addPrimitiveSet( new osg::DrawElementsUInt(GL_TRIANGLES, triangles.begin(), triangles.end()) );
+                }
+                else
                 {
-                    addDrawable( baselines.get(), 0L, name, input, index );
+                    osgUtil::Tessellator tess;
+                    tess.setTessellationType( osgUtil::Tessellator::TESS_TYPE_GEOMETRY );
+                    tess.setWindingType( osgUtil::Tessellator::TESS_WINDING_ODD );
+                    tess.retessellatePolygons( *(rooflines.get()) );
                 }
 
-                if ( outlines.valid() )
+                // generate default normals (no crease angle necessary; they are all pointing up)
+                // TODO do this manually; probably faster
+                if ( !_makeStencilVolume )
+                    osgUtil::SmoothingVisitor::smooth( *rooflines.get() );
+
+                if ( p._roofSkin )
                 {
-                    addDrawable( outlines.get(), 0L, name, input, index );
+                    context.resourceCache()->getStateSet( p._roofSkin, roofStateSet );
                 }
-            }   
-        }
-    }
+            }
 
-    return true;
+            if ( baselines.valid() )
+            {
+                osgUtil::Tessellator tess;
+                tess.setTessellationType( osgUtil::Tessellator::TESS_TYPE_GEOMETRY );
+                tess.setWindingType( osgUtil::Tessellator::TESS_WINDING_ODD );
+                tess.retessellatePolygons( *(baselines.get()) );
+            }
+
+            addDrawable( walls.get(), wallStateSet.get(), p._name, p._feature, index, output );
+
+            if ( rooflines.valid() )
+            {
+                addDrawable( rooflines.get(), roofStateSet.get(), p._name, p._feature, index, output );
+            }
+
+            if ( baselines.valid() )
+            {
+                addDrawable( baselines.get(), 0L, p._name, p._feature, index, output );
+            }
+
+            if ( outlines.valid() )
+            {
+                addDrawable( outlines.get(), 0L, p._name, p._feature, index, output );
+            }
+        }   
+    }
 }
 
 osg::Node*
@@ -922,27 +1147,13 @@ ExtrudeGeometryFilter::push( FeatureList& input, FilterContext& context )
     // calculate the localization matrices (_local2world and _world2local)
     computeLocalizers( context );
 
+    // when merging, build the meshes as we go instead of consolidating the
+    // drawables afterwards.
+    _batching = _mergeGeometry == true && _featureNameExpr.empty();
+
     // push all the features through the extruder.
     bool ok = process( input, context );
 
-    // convert everything to triangles and combine drawables.
-    if ( _mergeGeometry == true && _featureNameExpr.empty() )
-    {
-        for( SortedGeodeMap::iterator i = _geodes.begin(); i != _geodes.end(); ++i )
-        {
-#if 1
-            MeshConsolidator::run( *i->second.get() );
-#else
-        osgUtil::Optimizer opt;
-        opt.optimize( i->second.get(),
-            osgUtil::Optimizer::VERTEX_PRETRANSFORM |
-            osgUtil::Optimizer::INDEX_MESH |
-            osgUtil::Optimizer::VERTEX_POSTTRANSFORM |
-            osgUtil::Optimizer::MERGE_GEOMETRY );
-#endif
-        }
-    }
-
     // parent geometry with a delocalizer (if necessary)
     osg::Group* group = createDelocalizeGroup();
     
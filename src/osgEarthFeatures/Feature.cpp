@@ -30,13 +30,58 @@ using namespace osgEarth::Symbology;
 
 //----------------------------------------------------------------------------
 
+unsigned
+AttributeSchema::getOrAdd( const std::string& name )
+{
+    {
+        Threading::ScopedReadLock shared( _mutex );
+        IndexMap::const_iterator i = _index.find( name );
+        if ( i != _index.end() )
+            return i->second;
+    }
+
+    Threading::ScopedWriteLock exclusive( _mutex );
+    IndexMap::const_iterator i = _index.find( name ); // double check
+    if ( i != _index.end() )
+        return i->second;
+
+    unsigned index = _names.size();
+    _names.push_back( name );
+    _index[name] = index;
+    return index;
+}
+
+int
+AttributeSchema::find( const std::string& name ) const
+{
+    Threading::ScopedReadLock shared( _mutex );
+    IndexMap::const_iterator i = _index.find( name );
+    return i != _index.end() ? (int)i->second : -1;
+}
+
+std::string
+AttributeSchema::getName( unsigned index ) const
+{
+    Threading::ScopedReadLock shared( _mutex );
+    return index < _names.size() ? _names[index] : EMPTY_STRING;
+}
+
+unsigned
+AttributeSchema::size() const
+{
+    Threading::ScopedReadLock shared( _mutex );
+    return _names.size();
+}
+
+//----------------------------------------------------------------------------
+
 FeatureProfile::FeatureProfile( const GeoExtent& extent ) :
 _extent    ( extent ),
 _firstLevel( 0 ),
 _maxLevel  ( -1 ),
 _tiled     ( false )
 {
-    //nop
+    _attrSchema = new AttributeSchema();
 }
 
 bool
@@ -144,8 +189,9 @@ AttributeValue::getBool( bool defaultValue ) const
 //----------------------------------------------------------------------------
 
 Feature::Feature( FeatureID fid ) :
-_fid( fid ),
-_srs( 0L )
+_fid       ( fid ),
+_srs       ( 0L ),
+_attrsStale( false )
 //_cachedBoundingPolytopeValid( false )
 {
     //NOP
@@ -154,7 +200,8 @@ _srs( 0L )
 Feature::Feature( Geometry* geom, const SpatialReference* srs, const Style& style, FeatureID fid ) :
 _geom ( geom ),
 _srs  ( srs ),
-_fid  ( fid )
+_fid  ( fid ),
+_attrsStale( false )
 {
     if ( !style.empty() )
         _style = style;
@@ -164,10 +211,14 @@ _fid  ( fid )
 
 Feature::Feature( const Feature& rhs, const osg::CopyOp& copyOp ) :
 _fid      ( rhs._fid ),
-_attrs    ( rhs._attrs ),
-_style    ( rhs._style ),
-_geoInterp( rhs._geoInterp ),
-_srs      ( rhs._srs.get() )
+_attrs      ( rhs._attrs ),
+_attrSchema ( rhs._attrSchema.get() ),
+_attrValues ( rhs._attrValues ),
+_attrPresent( rhs._attrPresent ),
+_attrsStale ( rhs._attrsStale ),
+_style      ( rhs._style ),
+_geoInterp  ( rhs._geoInterp ),
+_srs        ( rhs._srs.get() )
 {
     if ( rhs._geom.valid() )
         _geom = rhs._geom->clone();
@@ -206,7 +257,7 @@ Feature::dirty()
 void
 Feature::set( const std::string& name, const std::string& value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = attr(name);
     a.first = ATTRTYPE_STRING;
     a.second.stringValue = value;
     a.second.set = true;
@@ -215,7 +266,7 @@ Feature::set( const std::string& name, const std::string& value )
 void
 Feature::set( const std::string& name, double value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = attr(name);
     a.first = ATTRTYPE_DOUBLE;
     a.second.doubleValue = value;
     a.second.set = true;
@@ -224,7 +275,7 @@ Feature::set( const std::string& name, double value )
 void
 Feature::set( const std::string& name, int value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = attr(name);
     a.first = ATTRTYPE_INT;
     a.second.intValue = value;
     a.second.set = true;
@@ -233,7 +284,7 @@ Feature::set( const std::string& name, int value )
 void
 Feature::set( const std::string& name, bool value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = attr(name);
     a.first = ATTRTYPE_BOOL;
     a.second.boolValue = value;
     a.second.set = true;
@@ -242,14 +293,14 @@ Feature::set( const std::string& name, bool value )
 void
 Feature::setNull( const std::string& name)
 {
-    AttributeValue& a = _attrs[name];    
+    AttributeValue& a = attr(name);    
     a.second.set = false;
 }
 
 void
 Feature::setNull( const std::string& name, AttributeType type)
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = attr(name);
     a.first = type;    
     a.second.set = false;
 }
@@ -257,45 +308,121 @@ Feature::setNull( const std::string& name, AttributeType type)
 
 
 
+AttributeValue&
+Feature::attr( const std::string& name )
+{
+    if ( !_attrSchema.valid() )
+        return _attrs[name];
+
+    unsigned i = _attrSchema->getOrAdd( name );
+    if ( i >= _attrValues.size() )
+    {
+        _attrValues.resize( i+1 );
+        _attrPresent.resize( i+1, false );
+    }
+    _attrPresent[i] = true;
+    _attrsStale = true;
+    return _attrValues[i];
+}
+
+const AttributeValue*
+Feature::findAttr( const std::string& lowerName ) const
+{
+    if ( !_attrSchema.valid() )
+    {
+        AttributeTable::const_iterator i = _attrs.find( lowerName );
+        return i != _attrs.end() ? &i->second : 0L;
+    }
+
+    int i = _attrSchema->find( lowerName );
+    return i >= 0 && (unsigned)i < _attrValues.size() && _attrPresent[i] ? &_attrValues[i] : 0L;
+}
+
+const AttributeValue*
+Feature::getAttr( const AttributeSchema* schema, int index, const std::string& lowerName ) const
+{
+    if ( schema && schema == _attrSchema.get() && index >= 0 )
+    {
+        return (unsigned)index < _attrValues.size() && _attrPresent[index] ? &_attrValues[index] : 0L;
+    }
+    return findAttr( lowerName );
+}
+
+const AttributeTable&
+Feature::getAttrs() const
+{
+    if ( _attrsStale )
+    {
+        _attrs.clear();
+        for( unsigned i = 0; i < _attrValues.size(); ++i )
+        {
+            if ( _attrPresent[i] )
+                _attrs[_attrSchema->getName(i)] = _attrValues[i];
+        }
+        _attrsStale = false;
+    }
+    return _attrs;
+}
+
+void
+Feature::setAttributeSchema( AttributeSchema* schema )
+{
+    if ( schema == _attrSchema.get() )
+        return;
+
+    AttributeTable current = getAttrs();
+
+    _attrSchema = schema;
+    _attrs.clear();
+    _attrValues.clear();
+    _attrPresent.clear();
+    _attrsStale = false;
+
+    for( AttributeTable::const_iterator i = current.begin(); i != current.end(); ++i )
+    {
+        attr(i->first) = i->second;
+    }
+}
+
 bool
 Feature::hasAttr( const std::string& name ) const
 {
-    return _attrs.find(toLower(name)) != _attrs.end();
+    return findAttr(toLower(name)) != 0L;
 }
 
 std::string
 Feature::getString( const std::string& name ) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getString() : EMPTY_STRING;
+    const AttributeValue* i = findAttr(toLower(name));
+    return i ? i->getString() : EMPTY_STRING;
 }
 
 double
 Feature::getDouble( const std::string& name, double defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getDouble(defaultValue) : defaultValue;
+    const AttributeValue* i = findAttr(toLower(name));
+    return i ? i->getDouble(defaultValue) : defaultValue;
 }
 
 int
 Feature::getInt( const std::string& name, int defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getInt(defaultValue) : defaultValue;
+    const AttributeValue* i = findAttr(toLower(name));
+    return i ? i->getInt(defaultValue) : defaultValue;
 }
 
 bool
 Feature::getBool( const std::string& name, bool defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getBool(defaultValue) : defaultValue;
+    const AttributeValue* i = findAttr(toLower(name));
+    return i ? i->getBool(defaultValue) : defaultValue;
 }
 
 bool
 Feature::isSet( const std::string& name) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.second.set : false;
+    const AttributeValue* i = findAttr(toLower(name));
+    return i ? i->second.set : false;
 }
 
 double
@@ -305,10 +432,10 @@ Feature::eval( NumericExpression& expr, FilterContext const* context ) const
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
       double val = 0.0;
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+      const AttributeValue* ai = findAttr(toLower(i->first));
+      if (ai)
       {
-        val = ai->second.getDouble(0.0);
+        val = ai->getDouble(0.0);
       }
       else if (context)
       {
@@ -337,10 +464,10 @@ Feature::eval( StringExpression& expr, FilterContext const* context ) const
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
       std::string val = "";
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+      const AttributeValue* ai = findAttr(toLower(i->first));
+      if (ai)
       {
-        val = ai->second.getString();
+        val = ai->getString();
       }
       else if (context)
       {
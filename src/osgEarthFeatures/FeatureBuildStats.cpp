@@ -0,0 +1,160 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/FeatureBuildStats>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/NodeVisitor>
+#include <sstream>
+#include <iomanip>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+#define LC "[FeatureBuildStats] "
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    struct VertexCounter : public osg::NodeVisitor
+    {
+        VertexCounter() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _count(0)
+        {
+            setNodeMaskOverride( ~0 );
+        }
+
+        void apply( osg::Geode& geode )
+        {
+            for( unsigned i = 0; i < geode.getNumDrawables(); ++i )
+            {
+                const osg::Geometry* geom = geode.getDrawable(i)->asGeometry();
+                if ( geom && geom->getVertexArray() )
+                    _count += geom->getVertexArray()->getNumElements();
+            }
+        }
+
+        unsigned _count;
+    };
+}
+
+//------------------------------------------------------------------------
+
+FeatureBuildStats::StageTimer::StageTimer( FeatureBuildStats* stats, const char* name ) :
+_stats( stats ),
+_name ( name ),
+_start( stats ? osg::Timer::instance()->tick() : 0 )
+{
+    //nop
+}
+
+void
+FeatureBuildStats::StageTimer::done( const FeatureList& features, const osg::Node* output )
+{
+    if ( _stats )
+    {
+        // take the time before counting, so it doesn't include the count.
+        double t = osg::Timer::instance()->delta_s( _start, osg::Timer::instance()->tick() );
+        unsigned vertices = output ? countVertices( output ) : countPoints( features );
+        _stats->record( _name, t, features.size(), vertices );
+        _stats = 0L;
+    }
+}
+
+void
+FeatureBuildStats::StageTimer::done( unsigned features, unsigned vertices )
+{
+    if ( _stats )
+    {
+        _stats->record( _name, osg::Timer::instance()->delta_s(_start, osg::Timer::instance()->tick()), features, vertices );
+        _stats = 0L;
+    }
+}
+
+//------------------------------------------------------------------------
+
+void
+FeatureBuildStats::record( const std::string& name, double seconds, unsigned features, unsigned vertices )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    Stage& stage = _stages[name];
+    stage._count++;
+    stage._time     += seconds;
+    stage._features += features;
+    stage._vertices += vertices;
+}
+
+void
+FeatureBuildStats::getStages( StageMap& out ) const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    out = _stages;
+}
+
+void
+FeatureBuildStats::reset()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _stages.clear();
+}
+
+std::string
+FeatureBuildStats::toString() const
+{
+    StageMap stages;
+    getStages( stages );
+
+    std::stringstream buf;
+    buf << std::fixed << std::setprecision(3);
+    for( StageMap::const_iterator i = stages.begin(); i != stages.end(); ++i )
+    {
+        const Stage& s = i->second;
+        buf << i->first
+            << ": runs=" << s._count
+            << " total_ms=" << 1000.0*s._time
+            << " avg_ms=" << s.getAverageTime()
+            << " features=" << s._features
+            << " vertices=" << s._vertices
+            << "\n";
+    }
+    return buf.str();
+}
+
+unsigned
+FeatureBuildStats::countVertices( const osg::Node* node )
+{
+    if ( !node )
+        return 0;
+
+    VertexCounter counter;
+    const_cast<osg::Node*>(node)->accept( counter );
+    return counter._count;
+}
+
+unsigned
+FeatureBuildStats::countPoints( const FeatureList& features )
+{
+    unsigned count = 0;
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+    {
+        const Geometry* geom = i->get() ? i->get()->getGeometry() : 0L;
+        if ( geom )
+            count += geom->getTotalPointCount();
+    }
+    return count;
+}
@@ -71,6 +71,7 @@ _tileSizeFactor( 15.0f ),
 _minRange      ( 0.0f ),
 _maxRange      ( 0.0f ),
 _cropFeatures  ( false ),
+_simplifyResolution( 0u ),
 _priorityOffset( 0.0f ),
 _priorityScale ( 1.0f )
 {
@@ -82,6 +83,7 @@ FeatureDisplayLayout::fromConfig( const Config& conf )
 {
     conf.getIfSet( "tile_size_factor", _tileSizeFactor );
     conf.getIfSet( "crop_features",    _cropFeatures );
+    conf.getIfSet( "simplify_resolution", _simplifyResolution );
     conf.getIfSet( "priority_offset",  _priorityOffset );
     conf.getIfSet( "priority_scale",   _priorityScale );
     conf.getIfSet( "min_range",        _minRange );
@@ -97,6 +99,7 @@ FeatureDisplayLayout::getConfig() const
     Config conf( "layout" );
     conf.addIfSet( "tile_size_factor", _tileSizeFactor );
     conf.addIfSet( "crop_features",    _cropFeatures );
+    conf.addIfSet( "simplify_resolution", _simplifyResolution );
     conf.addIfSet( "priority_offset",  _priorityOffset );
     conf.addIfSet( "priority_scale",   _priorityScale );
     conf.addIfSet( "min_range",        _minRange );
@@ -21,14 +21,18 @@
 using namespace osgEarth::Features;
 
 FeatureListSource::FeatureListSource():
-FeatureSource()
+FeatureSource (),
+_packMaxError ( 0.0 ),
+_indexListSize( 0 )
 {
     //nop
 }
 
 FeatureListSource::FeatureListSource(const GeoExtent& defaultExtent ) :
 FeatureSource (),
-_defaultExtent( defaultExtent )
+_defaultExtent( defaultExtent ),
+_packMaxError ( 0.0 ),
+_indexListSize( 0 )
 {
     //nop
 }
@@ -36,10 +40,22 @@ _defaultExtent( defaultExtent )
 FeatureCursor*
 FeatureListSource::createFeatureCursor( const Symbology::Query& query )
 {
+    // answer a spatial query from the index rather than scanning the list.
+    FeatureList  hits;
+    FeatureList* candidates = &_features;
+    if ( query.bounds().isSet() )
+    {
+        osg::ref_ptr<FeatureSpatialIndex> index;
+        getOrCreateIndex( index );
+        index->query( *query.bounds(), hits );
+        candidates = &hits;
+    }
+
     //Create a copy of all of the features before returning the cursor.
     //The processing filters in osgEarth can modify the features as they are operating and we don't want our original data destroyed.
+    //Copying also unpacks any packed geometry.
     FeatureList cursorFeatures;
-    for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
+    for (FeatureList::iterator itr = candidates->begin(); itr != candidates->end(); ++itr)
     {
         Feature* feature = new osgEarth::Features::Feature(*(itr->get()), osg::CopyOp::DEEP_COPY_ALL);        
         cursorFeatures.push_back( feature );
@@ -47,6 +63,37 @@ FeatureListSource::createFeatureCursor( const Symbology::Query& query )
     return new FeatureListCursor( cursorFeatures );
 }
 
+void
+FeatureListSource::setGeometryPacking( double maxError )
+{
+    _packMaxError = maxError;
+    if ( _packMaxError <= 0.0 )
+        return;
+
+    for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
+    {
+        Geometry* geom = itr->get()->getGeometry();
+        if ( geom )
+            geom->pack( _packMaxError );
+    }
+}
+
+void
+FeatureListSource::getOrCreateIndex( osg::ref_ptr<FeatureSpatialIndex>& out_index )
+{
+    Threading::ScopedMutexLock lock( _indexMutex );
+
+    // rebuild whenever the list changed. The size check catches edits made
+    // through getFeatures() without a call to dirty().
+    if ( !_index.valid() || outOfSyncWith(_indexRevision) || _indexListSize != _features.size() )
+    {
+        _index = new FeatureSpatialIndex( _features );
+        _indexListSize = _features.size();
+        sync( _indexRevision );
+    }
+    out_index = _index.get();
+}
+
 const FeatureProfile*
 FeatureListSource::createFeatureProfile()
 {    
@@ -108,6 +155,8 @@ FeatureListSource::getFeature( FeatureID fid )
 bool FeatureListSource::insertFeature(Feature* feature)
 {
     dirtyFeatureProfile();
+    if ( _packMaxError > 0.0 && feature && feature->getGeometry() )
+        feature->getGeometry()->pack( _packMaxError );
     _features.push_back( feature );
     dirty();
     return true;
@@ -18,8 +18,11 @@
  */
 
 #include <osgEarthFeatures/FeatureModelGraph>
+#include <osgEarthFeatures/CompiledExpression>
 #include <osgEarthFeatures/CropFilter>
+#include <osgEarthFeatures/FeaturePredicate>
 #include <osgEarthFeatures/FeatureSourceIndexNode>
+#include <osgEarthFeatures/SimplifyFilter>
 #include <osgEarth/Capabilities>
 #include <osgEarth/ClampableNode>
 #include <osgEarth/CullingUtils>
@@ -27,9 +30,13 @@
 #include <osgEarth/ElevationLOD>
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/FadeEffect>
+#include <osgEarth/MemoryArena>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarth/TaskService>
 #include <osgEarth/ThreadingUtils>
+#include <osgEarth/TraceRecorder>
 
 #include <osg/CullFace>
 #include <osg/PagedLOD>
@@ -38,6 +45,7 @@
 #include <osgDB/ReaderWriter>
 #include <osgDB/WriteFile>
 #include <osgUtil/Optimizer>
+#include <OpenThreads/Thread>
 
 #define LC "[FeatureModelGraph] "
 
@@ -97,6 +105,47 @@ namespace
     }
 }
 
+//---------------------------------------------------------------------------
+
+namespace
+{
+    // pool shared by all graphs for compiling style bins concurrently.
+    Threading::Mutex          s_styleServiceMutex;
+    osg::ref_ptr<TaskService> s_styleService;
+
+    TaskService* getStyleService()
+    {
+        Threading::ScopedMutexLock lock( s_styleServiceMutex );
+        if ( !s_styleService.valid() )
+        {
+            s_styleService = new TaskService(
+                "FeatureModelGraph style groups",
+                osg::maximum( 2, OpenThreads::GetNumberOfProcessors() ) );
+        }
+        return s_styleService.get();
+    }
+}
+
+/**
+ * Compiles one style bin (see FeatureModelGraph::queryAndSortIntoStyleGroups).
+ */
+struct FeatureModelGraph::CompileStyleBin
+{
+    CompileStyleBin() : _graph(0L), _style(0L), _features(0L), _context(0L), _compiled(false) { }
+
+    void execute()
+    {
+        _compiled = _graph->compileStyleNode( *_style, *_features, *_context, _node );
+    }
+
+    FeatureModelGraph*      _graph;
+    const Style*            _style;
+    FeatureList*            _features;
+    const FilterContext*    _context;
+    osg::ref_ptr<osg::Node> _node;
+    bool                    _compiled;
+};
+
 
 /**
  * A pseudo-loader for paged feature tiles.
@@ -215,10 +264,17 @@ _overlayInstalled  ( 0L ),
 _overlayPlaceholder( 0L ),
 _clampable         ( 0L ),
 _drapeable         ( 0L ),
-_overlayChange     ( OVERLAY_NO_CHANGE )
+_overlayChange     ( OVERLAY_NO_CHANGE ),
+_tileCachePolicy   ( CachePolicy::NO_CACHE ),
+_styleHash         ( 0u ),
+_simplified        ( true, 4096 ),
+_buildStats        ( new FeatureBuildStats() ),
+_buildStatsEnabled ( options.buildStats() == true )
 {
     _uid = osgEarthFeatureModelPseudoLoader::registerGraph( this );
 
+    Registry::addMemoryReporter( this );
+
     // operations that get applied after a new node gets merged into the 
     // scene graph by the pager.
     _postMergeOperations = new RefNodeOperationVector();
@@ -311,6 +367,12 @@ _overlayChange     ( OVERLAY_NO_CHANGE )
         OE_INFO << LC << "Added fading post-merge operation" << std::endl;
     }
 
+    // persistent cache for compiled tiles, if requested.
+    if ( _options.cacheTiles() == true )
+    {
+        setupTileCache();
+    }
+
     ADJUST_EVENT_TRAV_COUNT( this, 1 );
 
     redraw();
@@ -318,9 +380,51 @@ _overlayChange     ( OVERLAY_NO_CHANGE )
 
 FeatureModelGraph::~FeatureModelGraph()
 {
+    Registry::removeMemoryReporter( this );
     osgEarthFeatureModelPseudoLoader::unregisterGraph( _uid );
 }
 
+void
+FeatureModelGraph::setupTileCache()
+{
+    const Map* map = _session->getMap();
+    Cache* cache = map ? map->getCache() : 0L;
+    if ( !cache )
+    {
+        OE_INFO << LC << "Tile caching requested, but the map has no cache" << std::endl;
+        return;
+    }
+
+    // an override policy wins; then this layer's own policy; then the default.
+    optional<CachePolicy> policy;
+    if ( _options.cachePolicy().isSet() && !Registry::instance()->overrideCachePolicy().isSet() )
+        policy = *_options.cachePolicy();
+    else
+        Registry::instance()->getCachePolicy( policy, _session->getDBOptions() );
+
+    if ( policy.isSet() )
+        _tileCachePolicy = *policy;
+    else
+        _tileCachePolicy = CachePolicy::DEFAULT;
+
+    if ( !_tileCachePolicy.isCacheReadable() && !_tileCachePolicy.isCacheWriteable() )
+        return;
+
+    // the bin is unique to the feature data and to the layout that tiles it.
+    Config sig;
+    sig.add( _session->getFeatureSource()->getFeatureSourceOptions().getConfig() );
+    if ( _options.layout().isSet() )
+        sig.add( _options.layout()->getConfig() );
+
+    std::string binID = Stringify() << "fmg_" << std::hex << hashString( sig.toJSON(false) );
+    _tileCacheBin = cache->addBin( binID );
+
+    if ( _tileCacheBin.valid() )
+    {
+        OE_INFO << LC << "Caching compiled tiles in bin \"" << binID << "\"" << std::endl;
+    }
+}
+
 void
 FeatureModelGraph::dirty()
 {
@@ -464,6 +568,17 @@ FeatureModelGraph::load( unsigned lod, unsigned tileX, unsigned tileY, const std
     OE_DEBUG << LC
         << "load: " << lod << "_" << tileX << "_" << tileY << std::endl;
 
+    // the features and geometries this build reads and filters all die with
+    // it, so carve them out of one arena instead of the heap.
+    MemoryArena::Scope arenaScope;
+
+    // names the tile in the compiled-tile cache.
+    std::string tileName = Stringify() << lod << "_" << tileX << "_" << tileY;
+
+    ScopedTrace trace( "load " + tileName, "features" );
+
+    FeatureBuildStats::StageTimer tileTimer( activeBuildStats(), "tile" );
+
     osg::Group* result = 0L;
     
     if ( _useTiledSource )
@@ -494,7 +609,7 @@ FeatureModelGraph::load( unsigned lod, unsigned tileX, unsigned tileY, const std
             
             // Construct a tile key that will be used to query the source for this tile.
             TileKey key(lod, tileX, tileY, featureProfile->getProfile());
-            geometry = buildLevel( level, tileExtent, &key );
+            geometry = buildLevel( level, tileExtent, &key, tileName );
             result = geometry;
         }
 
@@ -527,7 +642,7 @@ FeatureModelGraph::load( unsigned lod, unsigned tileX, unsigned tileY, const std
         // maximum camera range.
 
         FeatureLevel all( 0.0f, FLT_MAX );
-        result = buildLevel( all, GeoExtent::INVALID, 0 );
+        result = buildLevel( all, GeoExtent::INVALID, 0, "all" );
     }
 
     else if ( (int)lod < _lodmap.size() )
@@ -548,7 +663,7 @@ FeatureModelGraph::load( unsigned lod, unsigned tileX, unsigned tileY, const std
                 s_getTileExtent( lod, tileX, tileY, _usableFeatureExtent ) :
                 _usableFeatureExtent;
 
-            geometry = buildLevel( *level, tileExtent, 0 );
+            geometry = buildLevel( *level, tileExtent, 0, tileName );
             result = geometry;
         }
 
@@ -581,6 +696,23 @@ FeatureModelGraph::load( unsigned lod, unsigned tileX, unsigned tileY, const std
         //RemoveEmptyGroupsVisitor::run( result );
     }
 
+    tileTimer.done( FeatureList(), result );
+
+    // measure the tile now, while only this thread can see it.
+    {
+        MemoryCounter counter;
+        counter.add( result );
+        TileSize size;
+        size._node  = result;
+        size._bytes = counter.getBytes();
+        Threading::ScopedMutexLock lock( _tileSizesMutex );
+        _tileSizes.push_back( size );
+
+        // the oldest tiles tend to expire first; drop those entries as we go.
+        while( !_tileSizes.front()._node.valid() )
+            _tileSizes.pop_front();
+    }
+
     if ( result->getNumChildren() == 0 )
     {
         // if the result group contains no data, blacklist it so we never try to load it again.
@@ -593,6 +725,28 @@ FeatureModelGraph::load( unsigned lod, unsigned tileX, unsigned tileY, const std
 }
 
 
+void
+FeatureModelGraph::getMemoryUsage( MemoryUsageMap& usage ) const
+{
+    double total = 0.0;
+    Threading::ScopedMutexLock lock( _tileSizesMutex );
+    for( std::list<TileSize>::iterator i = _tileSizes.begin(); i != _tileSizes.end(); )
+    {
+        if ( i->_node.valid() )
+        {
+            total += i->_bytes;
+            ++i;
+        }
+        else
+        {
+            // the pager expired it.
+            i = _tileSizes.erase( i );
+        }
+    }
+    usage["feature_tiles"] += total;
+}
+
+
 void
 FeatureModelGraph::buildSubTilePagedLODs(unsigned        parentLOD,
                                          unsigned        parentTileX,
@@ -657,7 +811,10 @@ FeatureModelGraph::buildSubTilePagedLODs(unsigned        parentLOD,
  * data source.
  */
 osg::Group*
-FeatureModelGraph::buildLevel( const FeatureLevel& level, const GeoExtent& extent, const TileKey* key )
+FeatureModelGraph::buildLevel(const FeatureLevel& level,
+                              const GeoExtent&    extent,
+                              const TileKey*      key,
+                              const std::string&  tileName)
 {
     // set up for feature indexing if appropriate:
     osg::ref_ptr<osg::Group> group;
@@ -673,51 +830,83 @@ FeatureModelGraph::buildLevel( const FeatureLevel& level, const GeoExtent& exten
         group = new osg::Group();
     }
 
-    // form the baseline query, which does a spatial query based on the working extent.
-    Query query;
-    if ( extent.isValid() )
-        query.bounds() = extent.bounds();
-
-    // add a tile key to the query if there is one, to support TFS-style queries
-    if ( key )
-        query.tileKey() = *key;
+    // look for a compiled copy of the tile. Indexed tiles never go in the cache,
+    // since the index has to reference live features.
+    std::string cacheKey;
+    bool        fromCache = false;
 
-    // does the level have a style name set?
-    if ( level.styleName().isSet() )
+    if ( _tileCacheBin.valid() && !tileName.empty() && !index )
     {
-        osg::Node* node = 0L;
-        const Style* style = _session->styles()->getStyle( *level.styleName(), false );
-        if ( style )
-        {
-            // found a specific style to use.
-            node = createStyleGroup( *style, query, index );
-            if ( node )
-                group->addChild( node );
-        }
-        else
+        cacheKey = Stringify() << tileName << "_" << std::hex << _styleHash << "_" << std::dec << (int)_revision;
+
+        if ( _tileCachePolicy.isCacheReadable() )
         {
-            const StyleSelector* selector = _session->styles()->getSelector( *level.styleName() );
-            if ( selector )
+            ReadResult r = _tileCacheBin->readObject( cacheKey, _tileCachePolicy.maxAge().value() );
+            osg::Group* cached = r.succeeded() ? r.get<osg::Group>() : 0L;
+            if ( cached )
             {
-                buildStyleGroups( selector, query, index, group.get() );
+                group = cached;
+                fromCache = true;
             }
         }
     }
 
-    else
+    if ( !fromCache )
     {
-        Style defaultStyle;
+        // form the baseline query, which does a spatial query based on the working extent.
+        Query query;
+        if ( extent.isValid() )
+            query.bounds() = extent.bounds();
+
+        // add a tile key to the query if there is one, to support TFS-style queries
+        if ( key )
+            query.tileKey() = *key;
 
-        if ( _session->styles()->selectors().size() == 0 )
+        // does the level have a style name set?
+        if ( level.styleName().isSet() )
         {
-            // attempt to glean the style from the feature source name:
-            defaultStyle = *_session->styles()->getStyle( 
-                *_session->getFeatureSource()->getFeatureSourceOptions().name() );
+            osg::Node* node = 0L;
+            const Style* style = _session->styles()->getStyle( *level.styleName(), false );
+            if ( style )
+            {
+                // found a specific style to use.
+                node = createStyleGroup( *style, query, index );
+                if ( node )
+                    group->addChild( node );
+            }
+            else
+            {
+                const StyleSelector* selector = _session->styles()->getSelector( *level.styleName() );
+                if ( selector )
+                {
+                    buildStyleGroups( selector, query, index, group.get() );
+                }
+            }
+        }
+
+        else
+        {
+            Style defaultStyle;
+
+            if ( _session->styles()->selectors().size() == 0 )
+            {
+                // attempt to glean the style from the feature source name:
+                defaultStyle = *_session->styles()->getStyle( 
+                    *_session->getFeatureSource()->getFeatureSourceOptions().name() );
+            }
+
+            osg::Node* node = build( defaultStyle, query, extent, index );
+            if ( node )
+                group->addChild( node );
         }
+    }
 
-        osg::Node* node = build( defaultStyle, query, extent, index );
-        if ( node )
-            group->addChild( node );
+    // store the tile for next time. Once the graph needs a clamping or draping
+    // decorator, stop writing: a cache hit would bypass the style checks that
+    // install it.
+    if ( !fromCache && !cacheKey.empty() && _tileCachePolicy.isCacheWriteable() && !_clampable && !_drapeable )
+    {
+        _tileCacheBin->write( cacheKey, group.get() );
     }
 
     if ( group->getNumChildren() > 0 )
@@ -766,6 +955,15 @@ FeatureModelGraph::buildLevel( const FeatureLevel& level, const GeoExtent& exten
             }
         }
 
+        // hide the tile while the terrain occludes it. The query results
+        // are reused across frames, so this costs no CPU-side ray tests.
+        if ( _options.occlusionQuery() == true && Registry::capabilities().supportsOcclusionQuery() )
+        {
+            OcclusionQueryGroup* oq = new OcclusionQueryGroup();
+            oq->addChild( group.get() );
+            group = oq;
+        }
+
         // if indexing is enabled, build the index now.
         if ( index )
             index->reindex();
@@ -808,6 +1006,7 @@ FeatureModelGraph::build(const Style&        defaultStyle,
                 osg::ref_ptr<FeatureCursor> cursor = new FeatureListCursor(list);
 
                 FilterContext context( _session.get(), featureProfile, workingExtent, index );
+                context.setBuildStats( activeBuildStats() );
 
                 // note: gridding is not supported for embedded styles.
                 osg::ref_ptr<osg::Node> node;
@@ -846,10 +1045,23 @@ FeatureModelGraph::build(const Style&        defaultStyle,
         // a create a node for each style group.
         if ( styles->selectors().size() > 0 )
         {
-            for( StyleSelectorList::const_iterator i = styles->selectors().begin(); i != styles->selectors().end(); ++i )
+            // gather the selectors that need their own query. In single-pass mode, most
+            // selectors are sorted out of one shared read of the feature source.
+            std::vector<const StyleSelector*> selectors;
+            if ( _options.singlePassSelectors() == true )
+            {
+                queryAndSortIntoSelectors( defaultStyle, baseQuery, index, group.get(), selectors );
+            }
+            else
+            {
+                for( StyleSelectorList::const_iterator i = styles->selectors().begin(); i != styles->selectors().end(); ++i )
+                    selectors.push_back( &(*i) );
+            }
+
+            for( std::vector<const StyleSelector*>::const_iterator i = selectors.begin(); i != selectors.end(); ++i )
             {
                 // pull the selected style...
-                const StyleSelector& sel = *i;
+                const StyleSelector& sel = **i;
 
                 // if the selector uses an expression to select the style name, then we must perform the
                 // query and then SORT the features into style groups.
@@ -973,6 +1185,7 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
     const GeoExtent& extent = featureProfile->getExtent();
     
     // query the feature source:
+    FeatureBuildStats::StageTimer queryTimer( activeBuildStats(), "query" );
     osg::ref_ptr<FeatureCursor> cursor = _session->getFeatureSource()->createFeatureCursor( query );
     if ( !cursor.valid() )
         return;
@@ -980,55 +1193,222 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
     // establish the working bounds and a context:
     Bounds bounds = query.bounds().isSet() ? *query.bounds() : extent.bounds();
     FilterContext context( _session.get(), featureProfile, GeoExtent(featureProfile->getSRS(), bounds), index );
-    StringExpression styleExprCopy( styleExpr );
+    context.setBuildStats( activeBuildStats() );
 
-    // visit each feature and run the expression to sort it into a bin.
-    std::map<std::string, FeatureList> styleBins;
+    FeatureList features;
     while( cursor->hasMore() )
     {
         osg::ref_ptr<Feature> feature = cursor->nextFeature();
         if ( feature.valid() )
-        {
-            const std::string& styleString = feature->eval( styleExprCopy, &context );
-            styleBins[styleString].push_back( feature.get() );
-        }
+            features.push_back( feature.get() );
+    }
+    queryTimer.done( features );
+
+    sortIntoStyleGroups( features, styleExpr, context, parent );
+}
+
+
+void
+FeatureModelGraph::sortIntoStyleGroups(FeatureList&            features,
+                                       const StringExpression& styleExpr,
+                                       const FilterContext&    context,
+                                       osg::Group*             parent)
+{
+    const FeatureProfile* featureProfile = _session->getFeatureSource()->getFeatureProfile();
+
+    FeatureBuildStats::StageTimer sortTimer( context.buildStats(), "sort" );
+
+    // run the expression over the whole tile at once, then sort each feature
+    // into the bin for its result.
+    CompiledStringExpression compiledStyleExpr( styleExpr, featureProfile->getAttributeSchema() );
+    std::vector<std::string> styleStrings;
+    compiledStyleExpr.eval( features, styleStrings, &context );
+
+    std::map<std::string, FeatureList> styleBins;
+    unsigned f = 0;
+    for( FeatureList::iterator i = features.begin(); i != features.end(); ++i, ++f )
+    {
+        styleBins[styleStrings[f]].push_back( i->get() );
     }
 
-    // next create a style group per bin.
+    // resolve the style of each bin.
+    std::vector<Style>        binStyles;
+    std::vector<FeatureList*> binFeatures;
     for( std::map<std::string,FeatureList>::iterator i = styleBins.begin(); i != styleBins.end(); ++i )
     {
         const std::string& styleString = i->first;
         FeatureList&       workingSet  = i->second;
 
-        // resolve the style:
+        // resolve the style. Inline styles are parsed and style names are looked
+        // up in the stylesheet, WITHOUT falling back on a default style: for style
+        // expressions, the user must be explicity about default styling; this is
+        // because there is no other way to exclude unwanted features.
         Style combinedStyle;
+        _session->resolveStyle( styleString, styleExpr.uriContext(), combinedStyle );
 
-        // if the style string begins with an open bracket, it's an inline style definition.
-        if ( styleString.length() > 0 && styleString.at(0) == '{' )
+        // if there is a valid style, queue the bin for compilation. (Otherwise we will skip
+        // the feature.)
+        if ( !combinedStyle.empty() )
         {
-            Config conf( "style", styleString );
-            conf.setReferrer( styleExpr.uriContext().referrer() );
-            conf.set( "type", "text/css" );
-            combinedStyle = Style(conf);
+            binStyles.push_back( combinedStyle );
+            binFeatures.push_back( &workingSet );
         }
+    }
+
+    sortTimer.done( features.size(), 0u );
+
+    // compile the bins. They are independent, so they can run concurrently;
+    // the calling thread compiles the first one itself.
+    typedef ParallelTask<CompileStyleBin> CompileBinTask;
+    std::vector< osg::ref_ptr<CompileBinTask> > tasks;
+    tasks.reserve( binStyles.size() );
+
+    TaskService* service =
+        _options.parallelStyles() == true && binStyles.size() > 1 ? getStyleService() : 0L;
+
+    Threading::MultiEvent done( service ? (int)binStyles.size()-1 : 0 );
 
-        // otherwise, look up the style in the stylesheet. Do NOT fall back on a default
-        // style in this case: for style expressions, the user must be explicity about 
-        // default styling; this is because there is no other way to exclude unwanted
-        // features.
+    for( unsigned i = 0; i < binStyles.size(); ++i )
+    {
+        CompileBinTask* task = service && i > 0 ? new CompileBinTask( &done ) : new CompileBinTask();
+        task->_graph    = this;
+        task->_style    = &binStyles[i];
+        task->_features = binFeatures[i];
+        task->_context  = &context;
+        tasks.push_back( task );
+
+        if ( service && i > 0 )
+            service->add( task );
+    }
+
+    if ( tasks.size() > 0 )
+    {
+        if ( service )
+        {
+            tasks[0]->execute();
+            done.wait();
+        }
         else
         {
-            const Style* selectedStyle = _session->styles()->getStyle(styleString, false);
-            if ( selectedStyle )
-                combinedStyle = *selectedStyle;
+            for( unsigned i = 0; i < tasks.size(); ++i )
+                tasks[i]->execute();
         }
+    }
 
-        // if there is a valid style, create the node and add it. (Otherwise we will skip
-        // the feature.)
-        if ( !combinedStyle.empty() )
+    // merge the results in style order so the output is deterministic.
+    for( unsigned i = 0; i < tasks.size(); ++i )
+    {
+        CompileBinTask* task = tasks[i].get();
+        if ( task->_compiled )
         {
-            osg::Group* styleGroup = createStyleGroup(combinedStyle, workingSet, context);
+            osg::Group* styleGroup = getOrCreateStyleGroupFromFactory( binStyles[i] );
             if ( styleGroup )
+            {
+                if ( task->_node.valid() )
+                    styleGroup->addChild( task->_node.get() );
+                parent->addChild( styleGroup );
+            }
+        }
+    }
+}
+
+
+/**
+ * Querys the feature source once;
+ * Evaluates each selector's query in memory to route the features into per-selector bins;
+ * Compiles each bin as if it had come from its own query.
+ * Selectors whose queries cannot be evaluated in memory are returned in "out_unsorted"
+ * so the caller can run them against the feature source as usual.
+ */
+void
+FeatureModelGraph::queryAndSortIntoSelectors(const Style&                       defaultStyle,
+                                             const Query&                       baseQuery,
+                                             FeatureSourceIndex*                index,
+                                             osg::Group*                        parent,
+                                             std::vector<const StyleSelector*>& out_unsorted)
+{
+    const StyleSheet*     styles         = _session->styles();
+    const FeatureProfile* featureProfile = _session->getFeatureSource()->getFeatureProfile();
+
+    // compile the selector queries; the ones we can't evaluate go back to the caller.
+    std::vector<const StyleSelector*> selectors;
+    std::vector<FeaturePredicate>     predicates;
+    for( StyleSelectorList::const_iterator i = styles->selectors().begin(); i != styles->selectors().end(); ++i )
+    {
+        FeaturePredicate predicate( *i->query(), featureProfile->getAttributeSchema() );
+        if ( predicate.isValid() )
+        {
+            selectors.push_back( &(*i) );
+            predicates.push_back( predicate );
+        }
+        else
+        {
+            out_unsorted.push_back( &(*i) );
+        }
+    }
+
+    // a single selector gains nothing from the shared read.
+    if ( selectors.size() < 2 )
+    {
+        out_unsorted.insert( out_unsorted.end(), selectors.begin(), selectors.end() );
+        return;
+    }
+
+    // query the feature source:
+    FeatureBuildStats::StageTimer queryTimer( activeBuildStats(), "query" );
+    osg::ref_ptr<FeatureCursor> cursor = _session->getFeatureSource()->createFeatureCursor( baseQuery );
+    if ( !cursor.valid() )
+        return;
+
+    // establish the working bounds and a context:
+    const GeoExtent& extent = featureProfile->getExtent();
+    Bounds bounds = baseQuery.bounds().isSet() ? *baseQuery.bounds() : extent.bounds();
+    FilterContext context( _session.get(), featureProfile, GeoExtent(featureProfile->getSRS(), bounds), index );
+    context.setBuildStats( activeBuildStats() );
+
+    // route each feature to every selector that matches it. The filters modify the
+    // features they compile, so every bin after the first gets its own copy.
+    std::vector<FeatureList> bins( selectors.size() );
+    while( cursor->hasMore() )
+    {
+        osg::ref_ptr<Feature> feature = cursor->nextFeature();
+        if ( !feature.valid() )
+            continue;
+
+        bool routed = false;
+        for( unsigned k = 0; k < selectors.size(); ++k )
+        {
+            if ( predicates[k].matches(feature.get()) )
+            {
+                bins[k].push_back( routed ? new Feature(*feature.get()) : feature.get() );
+                routed = true;
+            }
+        }
+    }
+
+    unsigned routedCount = 0;
+    for( unsigned k = 0; k < bins.size(); ++k )
+        routedCount += bins[k].size();
+    queryTimer.done( routedCount, 0u );
+
+    // compile the bins in selector order.
+    for( unsigned k = 0; k < selectors.size(); ++k )
+    {
+        const StyleSelector& sel = *selectors[k];
+        if ( bins[k].empty() )
+            continue;
+
+        if ( sel.styleExpression().isSet() )
+        {
+            sortIntoStyleGroups( bins[k], *sel.styleExpression(), context, parent );
+        }
+        else
+        {
+            const Style* selectedStyle = styles->getStyle( sel.getSelectedStyleName() );
+            Style combinedStyle = selectedStyle ? defaultStyle.combineWith( *selectedStyle ) : defaultStyle;
+
+            osg::Group* styleGroup = createStyleGroup( combinedStyle, bins[k], context );
+            if ( styleGroup && !parent->containsNode(styleGroup) )
                 parent->addChild( styleGroup );
         }
     }
@@ -1042,7 +1422,40 @@ FeatureModelGraph::createStyleGroup(const Style&         style,
 {
     osg::Group* styleGroup = 0L;
 
+    osg::ref_ptr<osg::Node> node;
+    if ( compileStyleNode(style, workingSet, contextPrototype, node) )
+    {
+        styleGroup = getOrCreateStyleGroupFromFactory( style );
+
+        // if it returned a node, add it. (it doesn't necessarily have to)
+        if ( node.valid() )
+            styleGroup->addChild( node.get() );
+    }
+
+    return styleGroup;
+}
+
+
+// crops a feature list and compiles it into a node. Touches no shared state of the
+// graph, so independent lists can be compiled concurrently.
+bool
+FeatureModelGraph::compileStyleNode(const Style&             style,
+                                    FeatureList&             workingSet,
+                                    const FilterContext&     contextPrototype,
+                                    osg::ref_ptr<osg::Node>& out_node)
+{
     FilterContext context(contextPrototype);
+    FeatureBuildStats* stats = context.buildStats();
+
+    // simplify the full geometry before cropping, so the result does not depend
+    // on the cell it's cropped to:
+    {
+        FeatureBuildStats::StageTimer timer( stats, "simplify" );
+        simplifyFeatures( workingSet, context );
+        timer.done( workingSet );
+    }
+
+    FeatureBuildStats::StageTimer cropTimer( stats, "crop" );
 
     // first Crop the feature set to the working extent:
     CropFilter crop( 
@@ -1062,24 +1475,85 @@ FeatureModelGraph::createStyleGroup(const Style&         style,
         context = crop2.push( workingSet, context );
     }
 
+    cropTimer.done( workingSet );
+
     // finally, compile the features into a node.
     if ( workingSet.size() > 0 )
     {
-        osg::ref_ptr<osg::Node> node;
+        FeatureBuildStats::StageTimer timer( stats, "compile" );
         osg::ref_ptr<FeatureCursor> newCursor = new FeatureListCursor(workingSet);
+        bool ok = _factory->createOrUpdateNode( newCursor.get(), style, context, out_node );
+        timer.done( workingSet, out_node.get() );
+        return ok;
+    }
 
-        if ( _factory->createOrUpdateNode( newCursor.get(), style, context, node ) )
-        {
-            if ( !styleGroup )
-                styleGroup = getOrCreateStyleGroupFromFactory( style );
+    return false;
+}
+
+
+bool
+FeatureModelGraph::SimplifyKey::operator < (const SimplifyKey& rhs) const
+{
+    if ( _fid < rhs._fid ) return true;
+    if ( _fid > rhs._fid ) return false;
+    if ( _xmin < rhs._xmin ) return true;
+    if ( _xmin > rhs._xmin ) return false;
+    if ( _ymin < rhs._ymin ) return true;
+    if ( _ymin > rhs._ymin ) return false;
+    return _tolerance < rhs._tolerance;
+}
+
+
+// replaces the geometry of each feature with a simplified copy, whose tolerance
+// follows from the size of the working extent. Each style that draws the same
+// feature in the same tile shares the simplified version.
+void
+FeatureModelGraph::simplifyFeatures(FeatureList&         workingSet,
+                                    const FilterContext& context)
+{
+    if ( !_options.layout().isSet() || _options.layout()->simplifyResolution().value() == 0u )
+        return;
+
+    if ( !context.extent().isSet() || !context.extent()->isValid() )
+        return;
+
+    const GeoExtent& extent = *context.extent();
+    double tolerance = extent.width() / (double)_options.layout()->simplifyResolution().value();
 
-            // if it returned a node, add it. (it doesn't necessarily have to)
-            if ( node.valid() )
-                styleGroup->addChild( node.get() );
+    // feature IDs are only unique within a tile for some sources, so the key
+    // includes the tile.
+    SimplifyKey key;
+    key._xmin      = extent.xMin();
+    key._ymin      = extent.yMin();
+    key._tolerance = tolerance;
+
+    for( FeatureList::iterator i = workingSet.begin(); i != workingSet.end(); ++i )
+    {
+        Feature* feature = i->get();
+        if ( !feature || !feature->getGeometry() )
+            continue;
+
+        Geometry::Type type = feature->getGeometry()->getComponentType();
+        if ( type == Geometry::TYPE_POINTSET || type == Geometry::TYPE_UNKNOWN )
+            continue;
+
+        key._fid = feature->getFID();
+
+        // downstream filters change geometry in place, so the cache keeps its
+        // own copy and hands out clones.
+        LRUCache<SimplifyKey, osg::ref_ptr<Geometry> >::Record rec;
+        if ( _simplified.get(key, rec) )
+        {
+            feature->setGeometry( rec.value()->clone() );
+        }
+        else
+        {
+            osg::ref_ptr<Geometry> simplified = feature->getGeometry()->clone();
+            SimplifyFilter::simplify( simplified.get(), tolerance );
+            _simplified.insert( key, simplified.get() );
+            feature->setGeometry( simplified->clone() );
         }
     }
-
-    return styleGroup;
 }
 
 
@@ -1097,6 +1571,7 @@ FeatureModelGraph::createStyleGroup(const Style&        style,
     const GeoExtent& extent = featureProfile->getExtent();
     
     // query the feature source:
+    FeatureBuildStats::StageTimer queryTimer( activeBuildStats(), "query" );
     osg::ref_ptr<FeatureCursor> cursor = _session->getFeatureSource()->createFeatureCursor( query );
 
     if ( cursor.valid() && cursor->hasMore() )
@@ -1105,12 +1580,14 @@ FeatureModelGraph::createStyleGroup(const Style&        style,
             query.bounds().isSet() ? *query.bounds() : extent.bounds();
 
         FilterContext context( _session.get(), featureProfile, GeoExtent(featureProfile->getSRS(), cellBounds), index );
+        context.setBuildStats( activeBuildStats() );
 
         // start by culling our feature list to the working extent. By default, this is done by
         // checking feature centroids. But the user can override this to crop feature geometry to
         // the cell boundaries.
         FeatureList workingSet;
         cursor->fill( workingSet );
+        queryTimer.done( workingSet );
 
         styleGroup = createStyleGroup(style, workingSet, context);
     }
@@ -1283,6 +1760,12 @@ FeatureModelGraph::redraw()
     _overlayPlaceholder = new osg::Group();
     _overlayInstalled   = _overlayPlaceholder;
 
+    // sync up front, so that tiles built from here on carry the current revision
+    // (and style sheet) in their cache keys.
+    _session->getFeatureSource()->sync( _revision );
+    if ( _tileCacheBin.valid() && _session->styles() )
+        _styleHash = hashString( _session->styles()->getConfig().toJSON(false) );
+
     osg::Node* node = 0;
     // if there's a display schema in place, set up for quadtree paging.
     if ( _options.layout().isSet() || _useTiledSource )
@@ -1294,7 +1777,7 @@ FeatureModelGraph::redraw()
         FeatureLevel defaultLevel( 0.0f, FLT_MAX );
         
         //Remove all current children
-        node = buildLevel( defaultLevel, GeoExtent::INVALID, 0 );
+        node = buildLevel( defaultLevel, GeoExtent::INVALID, 0, "all" );
     }
 
     float minRange = -FLT_MAX;
@@ -1340,7 +1823,6 @@ FeatureModelGraph::redraw()
 
     addChild( node );
 
-    _session->getFeatureSource()->sync( _revision );
     _dirty = false;
 }
 
@@ -35,8 +35,13 @@ _lit               ( true ),
 _maxGranularity_deg( 1.0 ),
 _mergeGeometry     ( false ),
 _clusterCulling    ( true ),
+_occlusionQuery    ( false ),
 _backfaceCulling   ( true ),
-_alphaBlending     ( true )
+_alphaBlending     ( true ),
+_parallelStyles    ( false ),
+_singlePassSelectors( false ),
+_cacheTiles        ( false ),
+_buildStats        ( false )
 {
     fromConfig( _conf );
 }
@@ -59,8 +64,13 @@ FeatureModelSourceOptions::fromConfig( const Config& conf )
     conf.getIfSet( "max_granularity",  _maxGranularity_deg );
     conf.getIfSet( "merge_geometry",   _mergeGeometry );
     conf.getIfSet( "cluster_culling",  _clusterCulling );
+    conf.getIfSet( "occlusion_query",  _occlusionQuery );
     conf.getIfSet( "backface_culling", _backfaceCulling );
     conf.getIfSet( "alpha_blending",   _alphaBlending );
+    conf.getIfSet( "parallel_styles",  _parallelStyles );
+    conf.getIfSet( "single_pass_selectors", _singlePassSelectors );
+    conf.getIfSet( "cache_tiles",      _cacheTiles );
+    conf.getIfSet( "build_stats",      _buildStats );
 
 }
 
@@ -85,8 +95,13 @@ FeatureModelSourceOptions::getConfig() const
     conf.updateIfSet( "max_granularity",  _maxGranularity_deg );
     conf.updateIfSet( "merge_geometry",   _mergeGeometry );
     conf.updateIfSet( "cluster_culling",  _clusterCulling );
+    conf.updateIfSet( "occlusion_query",  _occlusionQuery );
     conf.updateIfSet( "backface_culling", _backfaceCulling );
     conf.updateIfSet( "alpha_blending",   _alphaBlending );
+    conf.updateIfSet( "parallel_styles",  _parallelStyles );
+    conf.updateIfSet( "single_pass_selectors", _singlePassSelectors );
+    conf.updateIfSet( "cache_tiles",      _cacheTiles );
+    conf.updateIfSet( "build_stats",      _buildStats );
 
     return conf;
 }
@@ -0,0 +1,634 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/FeaturePredicate>
+#include <osgEarth/StringUtils>
+#include <cctype>
+#include <cstdlib>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+#define LC "[FeaturePredicate] "
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    struct Token
+    {
+        enum Kind { IDENT, NUMBER, STRING, OP, END };
+        Kind        _kind;
+        std::string _text;
+        double      _number;
+    };
+
+    // splits a WHERE clause into tokens. Returns false on a character
+    // that has no place in the supported subset.
+    bool tokenize( const std::string& in, std::vector<Token>& out )
+    {
+        unsigned i = 0;
+        while( i < in.size() )
+        {
+            char c = in[i];
+            Token t;
+            t._number = 0.0;
+
+            if ( ::isspace((unsigned char)c) )
+            {
+                ++i;
+                continue;
+            }
+            else if ( c == '\'' || c == '"' )
+            {
+                // 'string literal' or "quoted identifier"; a doubled quote escapes itself.
+                t._kind = c == '\'' ? Token::STRING : Token::IDENT;
+                ++i;
+                bool closed = false;
+                while( i < in.size() )
+                {
+                    if ( in[i] == c )
+                    {
+                        if ( i+1 < in.size() && in[i+1] == c )
+                        {
+                            t._text += c;
+                            i += 2;
+                            continue;
+                        }
+                        closed = true;
+                        ++i;
+                        break;
+                    }
+                    t._text += in[i++];
+                }
+                if ( !closed )
+                    return false;
+            }
+            else if ( ::isdigit((unsigned char)c) || (c == '.' && i+1 < in.size() && ::isdigit((unsigned char)in[i+1])) )
+            {
+                const char* begin = in.c_str() + i;
+                char* end = 0L;
+                t._kind   = Token::NUMBER;
+                t._number = ::strtod( begin, &end );
+                t._text   = std::string( begin, (const char*)end );
+                i += (unsigned)(end - begin);
+            }
+            else if ( ::isalpha((unsigned char)c) || c == '_' )
+            {
+                t._kind = Token::IDENT;
+                while( i < in.size() && (::isalnum((unsigned char)in[i]) || in[i] == '_' || in[i] == '.') )
+                    t._text += in[i++];
+            }
+            else
+            {
+                t._kind = Token::OP;
+                std::string two = in.substr( i, 2 );
+                if ( two == "<=" || two == ">=" || two == "<>" || two == "!=" || two == "==" )
+                {
+                    t._text = two;
+                    i += 2;
+                }
+                else if ( c == '=' || c == '<' || c == '>' || c == '(' || c == ')' || c == ',' || c == '-' )
+                {
+                    t._text = std::string( 1, c );
+                    ++i;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+
+            out.push_back( t );
+        }
+
+        Token end;
+        end._kind   = Token::END;
+        end._number = 0.0;
+        out.push_back( end );
+        return true;
+    }
+
+    // parses the whole string as a number.
+    bool toNumber( const std::string& text, double& out )
+    {
+        if ( text.empty() )
+            return false;
+        const char* begin = text.c_str();
+        char* end = 0L;
+        out = ::strtod( begin, &end );
+        while( *end && ::isspace((unsigned char)*end) ) ++end;
+        return end != begin && *end == '\0';
+    }
+
+    // SQL LIKE: '%' matches any run of characters, '_' any single one. Case-insensitive.
+    bool like( const std::string& text, const std::string& pattern )
+    {
+        unsigned t = 0, p = 0;
+        int starP = -1, starT = -1;
+        while( t < text.size() )
+        {
+            if ( p < pattern.size() && pattern[p] == '%' )
+            {
+                starP = p++;
+                starT = t;
+            }
+            else if ( p < pattern.size() &&
+                      (pattern[p] == '_' || ::tolower((unsigned char)pattern[p]) == ::tolower((unsigned char)text[t])) )
+            {
+                ++p;
+                ++t;
+            }
+            else if ( starP >= 0 )
+            {
+                p = starP + 1;
+                t = ++starT;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        while( p < pattern.size() && pattern[p] == '%' )
+            ++p;
+        return p == pattern.size();
+    }
+}
+
+//------------------------------------------------------------------------
+
+// the value of an operand for one feature.
+struct FeaturePredicate::Value
+{
+    bool        _null;
+    bool        _numeric;
+    double      _number;
+    std::string _text;
+};
+
+// recursive-descent parser that fills in the node table of a predicate.
+struct FeaturePredicate::Parser
+{
+    Parser( FeaturePredicate& pred, const std::vector<Token>& tokens )
+        : _pred( pred ), _tokens( tokens ), _pos( 0 ) { }
+
+    FeaturePredicate&         _pred;
+    const std::vector<Token>& _tokens;
+    unsigned                  _pos;
+
+    const Token& peek() const { return _tokens[_pos]; }
+
+    bool isKeyword( const char* word ) const
+    {
+        return peek()._kind == Token::IDENT && ciEquals( peek()._text, word );
+    }
+
+    bool isOp( const char* op ) const
+    {
+        return peek()._kind == Token::OP && peek()._text == op;
+    }
+
+    int addNode( const Node& node )
+    {
+        _pred._nodes.push_back( node );
+        return (int)_pred._nodes.size() - 1;
+    }
+
+    static Node makeNode( Node::Type type )
+    {
+        Node node;
+        node._type    = type;
+        node._compare = Node::EQ;
+        node._negate  = false;
+        return node;
+    }
+
+    // or := and { OR and }
+    int parseOr()
+    {
+        int lhs = parseAnd();
+        if ( lhs < 0 || !isKeyword("OR") )
+            return lhs;
+
+        Node node = makeNode( Node::OR );
+        node._children.push_back( lhs );
+        while( isKeyword("OR") )
+        {
+            ++_pos;
+            int rhs = parseAnd();
+            if ( rhs < 0 ) return -1;
+            node._children.push_back( rhs );
+        }
+        return addNode( node );
+    }
+
+    // and := not { AND not }
+    int parseAnd()
+    {
+        int lhs = parseNot();
+        if ( lhs < 0 || !isKeyword("AND") )
+            return lhs;
+
+        Node node = makeNode( Node::AND );
+        node._children.push_back( lhs );
+        while( isKeyword("AND") )
+        {
+            ++_pos;
+            int rhs = parseNot();
+            if ( rhs < 0 ) return -1;
+            node._children.push_back( rhs );
+        }
+        return addNode( node );
+    }
+
+    // not := NOT not | predicate
+    int parseNot()
+    {
+        if ( isKeyword("NOT") )
+        {
+            ++_pos;
+            int child = parseNot();
+            if ( child < 0 ) return -1;
+            Node node = makeNode( Node::NOT );
+            node._children.push_back( child );
+            return addNode( node );
+        }
+        return parsePredicate();
+    }
+
+    // operand := number | -number | 'string' | attribute
+    bool parseOperand( Operand& out )
+    {
+        out._number = 0.0;
+        out._index  = -1;
+
+        bool negative = false;
+        if ( isOp("-") )
+        {
+            negative = true;
+            ++_pos;
+            if ( peek()._kind != Token::NUMBER )
+                return false;
+        }
+
+        const Token& t = peek();
+        if ( t._kind == Token::NUMBER )
+        {
+            out._type   = Operand::NUMBER;
+            out._number = negative ? -t._number : t._number;
+            out._string = negative ? "-" + t._text : t._text;
+        }
+        else if ( t._kind == Token::STRING )
+        {
+            out._type   = Operand::STRING;
+            out._string = t._text;
+        }
+        else if ( t._kind == Token::IDENT && !isReserved(t._text) )
+        {
+            out._type   = Operand::ATTRIBUTE;
+            out._string = toLower( t._text );
+            out._index  = _pred._schema.valid() ? _pred._schema->find( out._string ) : -1;
+        }
+        else
+        {
+            return false;
+        }
+
+        ++_pos;
+        return true;
+    }
+
+    static bool isReserved( const std::string& word )
+    {
+        static const char* reserved[] = { "AND", "OR", "NOT", "IN", "LIKE", "BETWEEN", "IS", "NULL", "SELECT", 0L };
+        for( const char** r = reserved; *r; ++r )
+            if ( ciEquals(word, *r) )
+                return true;
+        return false;
+    }
+
+    // predicate := ( or ) | operand cmp operand | operand [NOT] IN ( operand, ... )
+    //            | operand [NOT] LIKE operand | operand [NOT] BETWEEN operand AND operand
+    //            | operand IS [NOT] NULL
+    int parsePredicate()
+    {
+        if ( isOp("(") )
+        {
+            ++_pos;
+            int inner = parseOr();
+            if ( inner < 0 || !isOp(")") ) return -1;
+            ++_pos;
+            return inner;
+        }
+
+        Operand lhs;
+        if ( !parseOperand(lhs) )
+            return -1;
+
+        if ( peek()._kind == Token::OP )
+        {
+            const std::string& op = peek()._text;
+            Node node = makeNode( Node::COMPARE );
+            if      ( op == "=" || op == "==" )  node._compare = Node::EQ;
+            else if ( op == "<>" || op == "!=" ) node._compare = Node::NE;
+            else if ( op == "<" )                node._compare = Node::LT;
+            else if ( op == ">" )                node._compare = Node::GT;
+            else if ( op == "<=" )               node._compare = Node::LE;
+            else if ( op == ">=" )               node._compare = Node::GE;
+            else return -1;
+            ++_pos;
+
+            Operand rhs;
+            if ( !parseOperand(rhs) ) return -1;
+            node._operands.push_back( lhs );
+            node._operands.push_back( rhs );
+            return addNode( node );
+        }
+
+        if ( isKeyword("IS") )
+        {
+            ++_pos;
+            Node node = makeNode( Node::IS_NULL );
+            if ( isKeyword("NOT") )
+            {
+                node._negate = true;
+                ++_pos;
+            }
+            if ( !isKeyword("NULL") ) return -1;
+            ++_pos;
+            node._operands.push_back( lhs );
+            return addNode( node );
+        }
+
+        bool negate = false;
+        if ( isKeyword("NOT") )
+        {
+            negate = true;
+            ++_pos;
+        }
+
+        if ( isKeyword("IN") )
+        {
+            ++_pos;
+            if ( !isOp("(") ) return -1;
+            ++_pos;
+
+            Node node = makeNode( Node::IN );
+            node._negate = negate;
+            node._operands.push_back( lhs );
+            for( ;; )
+            {
+                Operand item;
+                if ( !parseOperand(item) ) return -1;
+                node._operands.push_back( item );
+                if ( isOp(",") ) { ++_pos; continue; }
+                if ( isOp(")") ) { ++_pos; break; }
+                return -1;
+            }
+            return addNode( node );
+        }
+
+        if ( isKeyword("LIKE") )
+        {
+            ++_pos;
+            Operand pattern;
+            if ( !parseOperand(pattern) ) return -1;
+            Node node = makeNode( Node::LIKE );
+            node._negate = negate;
+            node._operands.push_back( lhs );
+            node._operands.push_back( pattern );
+            return addNode( node );
+        }
+
+        if ( isKeyword("BETWEEN") )
+        {
+            ++_pos;
+            Operand lo, hi;
+            if ( !parseOperand(lo) || !isKeyword("AND") ) return -1;
+            ++_pos;
+            if ( !parseOperand(hi) ) return -1;
+            Node node = makeNode( Node::BETWEEN );
+            node._negate = negate;
+            node._operands.push_back( lhs );
+            node._operands.push_back( lo );
+            node._operands.push_back( hi );
+            return addNode( node );
+        }
+
+        return -1;
+    }
+};
+
+//------------------------------------------------------------------------
+
+FeaturePredicate::FeaturePredicate( const Query& query, const AttributeSchema* schema ) :
+_valid ( false ),
+_root  ( -1 ),
+_schema( schema )
+{
+    // these need the feature source.
+    if ( query.tileKey().isSet() || (query.orderby().isSet() && !query.orderby()->empty()) )
+        return;
+
+    _bounds = query.bounds();
+
+    std::string expr = query.expression().isSet() ? trim(*query.expression()) : "";
+    if ( expr.empty() )
+    {
+        _nodes.push_back( Parser::makeNode(Node::ALWAYS) );
+        _root  = 0;
+        _valid = true;
+        return;
+    }
+
+    std::vector<Token> tokens;
+    if ( !tokenize(expr, tokens) )
+        return;
+
+    Parser parser( *this, tokens );
+    _root  = parser.parseOr();
+    _valid = _root >= 0 && parser.peek()._kind == Token::END;
+
+    if ( !_valid )
+    {
+        OE_DEBUG << LC << "Cannot evaluate \"" << expr << "\" in memory" << std::endl;
+        _nodes.clear();
+        _root = -1;
+    }
+}
+
+bool
+FeaturePredicate::matches( const Feature* feature ) const
+{
+    if ( !_valid || !feature )
+        return false;
+
+    if ( _bounds.isSet() && _bounds->valid() )
+    {
+        const Geometry* geom = feature->getGeometry();
+        if ( !geom )
+            return false;
+
+        Bounds b = geom->getBounds();
+        if (b.xMax() < _bounds->xMin() || b.xMin() > _bounds->xMax() ||
+            b.yMax() < _bounds->yMin() || b.yMin() > _bounds->yMax() )
+        {
+            return false;
+        }
+    }
+
+    return eval( _root, feature );
+}
+
+bool
+FeaturePredicate::eval( int index, const Feature* feature ) const
+{
+    const Node& node = _nodes[index];
+
+    // resolve the operands (IN resolves its list as it goes):
+    Value values[3];
+    unsigned numValues = node._type == Node::IN ? 1 : node._operands.size();
+    for( unsigned i = 0; i < numValues && i < 3; ++i )
+    {
+        resolve( node._operands[i], feature, values[i] );
+    }
+
+    int c = 0;
+    switch( node._type )
+    {
+    case Node::ALWAYS:
+        return true;
+
+    case Node::OR:
+        for( unsigned i = 0; i < node._children.size(); ++i )
+            if ( eval(node._children[i], feature) )
+                return true;
+        return false;
+
+    case Node::AND:
+        for( unsigned i = 0; i < node._children.size(); ++i )
+            if ( !eval(node._children[i], feature) )
+                return false;
+        return true;
+
+    case Node::NOT:
+        return !eval( node._children[0], feature );
+
+    case Node::COMPARE:
+        if ( !compareValues(values[0], values[1], c) )
+            return false;
+        switch( node._compare )
+        {
+        case Node::EQ: return c == 0;
+        case Node::NE: return c != 0;
+        case Node::LT: return c < 0;
+        case Node::GT: return c > 0;
+        case Node::LE: return c <= 0;
+        case Node::GE: return c >= 0;
+        }
+        return false;
+
+    case Node::IS_NULL:
+        return values[0]._null != node._negate;
+
+    case Node::LIKE:
+        if ( values[0]._null || values[1]._null )
+            return false;
+        return like( values[0]._text, values[1]._text ) != node._negate;
+
+    case Node::BETWEEN:
+        {
+            int lo = 0, hi = 0;
+            if ( !compareValues(values[0], values[1], lo) || !compareValues(values[0], values[2], hi) )
+                return false;
+            return (lo >= 0 && hi <= 0) != node._negate;
+        }
+
+    case Node::IN:
+        {
+            if ( values[0]._null )
+                return false;
+            for( unsigned i = 1; i < node._operands.size(); ++i )
+            {
+                Value item;
+                resolve( node._operands[i], feature, item );
+                if ( compareValues(values[0], item, c) && c == 0 )
+                    return !node._negate;
+            }
+            return node._negate;
+        }
+    }
+
+    return false;
+}
+
+void
+FeaturePredicate::resolve( const Operand& op, const Feature* feature, Value& v ) const
+{
+    v._null    = false;
+    v._numeric = false;
+    v._number  = 0.0;
+
+    if ( op._type == Operand::NUMBER )
+    {
+        v._numeric = true;
+        v._number  = op._number;
+        v._text    = op._string;
+    }
+    else if ( op._type == Operand::STRING )
+    {
+        v._text = op._string;
+    }
+    else
+    {
+        const AttributeValue* a = feature->getAttr( _schema.get(), op._index, op._string );
+        if ( !a || !a->second.set )
+        {
+            v._null = true;
+        }
+        else
+        {
+            v._text    = a->getString();
+            v._numeric = a->first == ATTRTYPE_INT || a->first == ATTRTYPE_DOUBLE || a->first == ATTRTYPE_BOOL;
+            v._number  = v._numeric ? a->getDouble() : 0.0;
+        }
+    }
+}
+
+// -1, 0 or 1; returns false if either value is NULL.
+bool
+FeaturePredicate::compareValues( const Value& a, const Value& b, int& out )
+{
+    if ( a._null || b._null )
+        return false;
+
+    if ( a._numeric || b._numeric )
+    {
+        double x = a._number, y = b._number;
+        if ( (a._numeric || toNumber(a._text, x)) && (b._numeric || toNumber(b._text, y)) )
+        {
+            out = x < y ? -1 : x > y ? 1 : 0;
+            return true;
+        }
+    }
+
+    int c = a._text.compare( b._text );
+    out = c < 0 ? -1 : c > 0 ? 1 : 0;
+    return true;
+}
@@ -18,6 +18,7 @@
  */
 #include <osgEarthFeatures/FeatureSourceIndexNode>
 #include <osg/MatrixTransform>
+#include <osg/Geometry>
 #include <algorithm>
 
 using namespace osgEarth;
@@ -34,9 +35,11 @@ using namespace osgEarth::Features;
 
 
 FeatureSourceIndexOptions::FeatureSourceIndexOptions(const Config& conf) :
-_embedFeatures( false )
+_embedFeatures( false ),
+_objectIDs    ( false )
 {
     conf.getIfSet( "embed_features", _embedFeatures );
+    conf.getIfSet( "object_ids",     _objectIDs );
 }
 
 Config
@@ -44,18 +47,60 @@ FeatureSourceIndexOptions::getConfig() const
 {
     Config conf("feature_indexing");
     conf.addIfSet( "embed_features", _embedFeatures );
+    conf.addIfSet( "object_ids",     _objectIDs );
     return conf;
 }
 
 
 //-----------------------------------------------------------------------------
 
-FeatureSourceIndexNode::Collect::Collect( FeatureIDDrawSetMap& index ) :
+struct FeatureSourceIndexNode::LessGeometry
+{
+    bool operator()( const Entry& lhs, const Entry& rhs ) const
+    {
+        if ( lhs._geom.get() < rhs._geom.get() ) return true;
+        if ( lhs._geom.get() > rhs._geom.get() ) return false;
+        return lhs._firstPrim < rhs._firstPrim;
+    }
+};
+
+struct FeatureSourceIndexNode::LessFID
+{
+    LessFID( const Entries& entries ) : _entries( entries ) { }
+    bool operator()( unsigned lhs, unsigned rhs ) const { return _entries[lhs]._fid < _entries[rhs]._fid; }
+    bool operator()( unsigned lhs, FeatureID rhs ) const { return _entries[lhs]._fid < rhs; }
+    bool operator()( FeatureID lhs, unsigned rhs ) const { return lhs < _entries[rhs]._fid; }
+    const Entries& _entries;
+};
+
+struct FeatureSourceIndexNode::LessPrimSet
+{
+    LessPrimSet( const Entries& entries ) : _entries( entries ) { }
+    bool operator()( unsigned lhs, unsigned rhs ) const { return _entries[lhs]._pset.get() < _entries[rhs]._pset.get(); }
+    bool operator()( unsigned lhs, const osg::PrimitiveSet* rhs ) const { return _entries[lhs]._pset.get() < rhs; }
+    const Entries& _entries;
+};
+
+namespace
+{
+    struct LessNodeFID
+    {
+        template<typename T>
+        bool operator()( const T& lhs, const T& rhs ) const { return lhs._fid < rhs._fid; }
+    };
+}
+
+//-----------------------------------------------------------------------------
+
+FeatureSourceIndexNode::Collect::Collect(const FeatureSourceIndexNode& owner,
+                                         Entries&                      entries,
+                                         NodeEntries&                  nodes) :
 osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
-_index          ( index ),
-_psets          ( 0 )
+_owner          ( owner ),
+_entries        ( entries ),
+_nodes          ( nodes )
 {
-    _index.clear();
+    //nop
 }
 
 void
@@ -64,8 +109,10 @@ FeatureSourceIndexNode::Collect::apply( osg::Node& node )
     RefFeatureID* fid = dynamic_cast<RefFeatureID*>( node.getUserData() );
     if ( fid )
     {
-        FeatureDrawSet& drawSet = _index[*fid];
-        drawSet.nodes().push_back( &node );
+        NodeEntry e;
+        e._fid  = *fid;
+        e._node = &node;
+        _nodes.push_back( e );
     }
     traverse(node);
 }
@@ -76,8 +123,10 @@ FeatureSourceIndexNode::Collect::apply( osg::Geode& geode )
     RefFeatureID* fid = dynamic_cast<RefFeatureID*>( geode.getUserData() );
     if ( fid )
     {
-        FeatureDrawSet& drawSet = _index[*fid];
-        drawSet.nodes().push_back( &geode );
+        NodeEntry e;
+        e._fid  = *fid;
+        e._node = &geode;
+        _nodes.push_back( e );
     }
     else
     {
@@ -86,17 +135,32 @@ FeatureSourceIndexNode::Collect::apply( osg::Geode& geode )
             osg::Geometry* geom = dynamic_cast<osg::Geometry*>( geode.getDrawable(i) );
             if ( geom )
             {
+                // primitive indices count every primitive set in the geometry,
+                // tagged or not, to match the results of an intersection test.
+                unsigned firstPrim = 0;
                 osg::Geometry::PrimitiveSetList& psets = geom->getPrimitiveSetList();
                 for( unsigned p = 0; p < psets.size(); ++p )
                 {
                     osg::PrimitiveSet* pset = psets[p];
-                    RefFeatureID* fid = dynamic_cast<RefFeatureID*>( pset->getUserData() );
-                    if ( fid )
+                    unsigned numPrims = pset->getNumPrimitives();
+
+                    // a fresh tag, or an entry carried over from the last reindex:
+                    FeatureID id;
+                    if ( _owner.getFID(pset, id) )
                     {
-                        FeatureDrawSet& drawSet = _index[*fid];
-                        drawSet.getOrCreateSlice(geom).push_back(pset);
-                        _psets++;
+                        Entry e;
+                        e._fid       = id;
+                        e._geom      = geom;
+                        e._pset      = pset;
+                        e._firstPrim = firstPrim;
+                        e._numPrims  = numPrims;
+                        _entries.push_back( e );
+
+                        if ( pset->getUserData() )
+                            pset->setUserData( 0L );
                     }
+
+                    firstPrim += numPrims;
                 }
             }
         }
@@ -116,16 +180,132 @@ _options      ( options )
 }
 
 
+FeatureSourceIndexNode::~FeatureSourceIndexNode()
+{
+    for( ObjectIDMap::const_iterator i = _objectIDs.begin(); i != _objectIDs.end(); ++i )
+        ObjectIndex::instance()->remove( i->second );
+}
+
+
 // Rebuilds the feature index based on all the tagged primitive sets found in a graph
 void
 FeatureSourceIndexNode::reindex()
 {
     _drawSets.clear();
 
-    Collect c(_drawSets);
+    Entries     entries;
+    NodeEntries nodes;
+    entries.reserve( _entries.size() );
+
+    Collect c(*this, entries, nodes);
     this->accept( c );
 
-    OE_DEBUG << LC << "Reindexed; draw sets = " << _drawSets.size() << std::endl;
+    _entries.swap( entries );
+    _nodes.swap( nodes );
+
+    std::sort( _entries.begin(), _entries.end(), LessGeometry() );
+    std::stable_sort( _nodes.begin(), _nodes.end(), LessNodeFID() );
+
+    _byFID.resize( _entries.size() );
+    for( unsigned i = 0; i < _entries.size(); ++i )
+        _byFID[i] = i;
+    _byPrimSet = _byFID;
+
+    std::stable_sort( _byFID.begin(), _byFID.end(), LessFID(_entries) );
+    std::sort( _byPrimSet.begin(), _byPrimSet.end(), LessPrimSet(_entries) );
+
+    // release any slack left over from the previous index.
+    Entries(_entries).swap( _entries );
+    NodeEntries(_nodes).swap( _nodes );
+
+    if ( _options.objectIDs() == true )
+        assignObjectIDs();
+
+    OE_DEBUG << LC << "Reindexed; primitive sets = " << _entries.size() << ", nodes = " << _nodes.size() << std::endl;
+}
+
+
+// Gives each indexed feature an object ID and writes the IDs into the
+// subgraph: per vertex for tagged primitive sets, per node for tagged nodes.
+void
+FeatureSourceIndexNode::assignObjectIDs()
+{
+    ObjectIndex* index = ObjectIndex::instance();
+
+    // keep the IDs of features that are still here; release the rest.
+    ObjectIDMap ids;
+    for( Entries::const_iterator e = _entries.begin(); e != _entries.end(); ++e )
+        ids[e->_fid] = 0;
+    for( NodeEntries::const_iterator n = _nodes.begin(); n != _nodes.end(); ++n )
+        ids[n->_fid] = 0;
+
+    for( ObjectIDMap::const_iterator i = _objectIDs.begin(); i != _objectIDs.end(); ++i )
+    {
+        ObjectIDMap::iterator j = ids.find( i->first );
+        if ( j != ids.end() )
+            j->second = i->second;
+        else
+            index->remove( i->second );
+    }
+
+    for( ObjectIDMap::iterator i = ids.begin(); i != ids.end(); ++i )
+    {
+        if ( i->second == 0 )
+            i->second = index->insert( this, i->first );
+    }
+
+    _objectIDs.swap( ids );
+
+    // entries are sorted by geometry, so each geometry's sets are adjacent.
+    // Vertices shared by two features take the ID of the last one.
+    osg::Geometry*   geom = 0L;
+    osg::FloatArray* attr = 0L;
+    for( Entries::const_iterator e = _entries.begin(); e != _entries.end(); ++e )
+    {
+        if ( e->_geom.get() != geom )
+        {
+            geom = e->_geom.get();
+            unsigned numVerts = geom->getVertexArray() ? geom->getVertexArray()->getNumElements() : 0;
+
+            attr = dynamic_cast<osg::FloatArray*>( geom->getVertexAttribArray(ObjectIndex::getAttribLocation()) );
+            if ( !attr || attr->size() != numVerts )
+            {
+                attr = new osg::FloatArray( numVerts );
+                geom->setVertexAttribArray    ( ObjectIndex::getAttribLocation(), attr );
+                geom->setVertexAttribBinding  ( ObjectIndex::getAttribLocation(), osg::Geometry::BIND_PER_VERTEX );
+                geom->setVertexAttribNormalize( ObjectIndex::getAttribLocation(), false );
+            }
+            else
+            {
+                attr->dirty();
+            }
+        }
+
+        float id = (float)_objectIDs[e->_fid];
+        for( unsigned i = 0; i < e->_pset->getNumIndices(); ++i )
+        {
+            unsigned v = e->_pset->index(i);
+            if ( v < attr->size() )
+                (*attr)[v] = id;
+        }
+    }
+
+    for( NodeEntries::const_iterator n = _nodes.begin(); n != _nodes.end(); ++n )
+    {
+        n->_node->getOrCreateStateSet()->addUniform( ObjectIndex::createUniform(_objectIDs[n->_fid]) );
+    }
+}
+
+
+bool
+FeatureSourceIndexNode::getObjectID(const FeatureID& fid, ObjectID& output) const
+{
+    ObjectIDMap::const_iterator i = _objectIDs.find( fid );
+    if ( i == _objectIDs.end() )
+        return false;
+
+    output = i->second;
+    return true;
 }
 
 
@@ -152,6 +332,7 @@ FeatureSourceIndexNode::tagPrimitiveSets(osg::Drawable* drawable, Feature* featu
 
         if ( _options.embedFeatures() == true )
         {
+            Threading::ScopedMutexLock lock( _featuresMutex );
             _features[feature->getFID()] = feature;
         }
     }
@@ -165,6 +346,7 @@ FeatureSourceIndexNode::tagNode( osg::Node* node, Feature* feature ) const
 
     if ( _options.embedFeatures() == true )
     {
+        Threading::ScopedMutexLock lock( _featuresMutex );
         _features[feature->getFID()] = feature;
     }
 }
@@ -173,6 +355,10 @@ FeatureSourceIndexNode::tagNode( osg::Node* node, Feature* feature ) const
 bool
 FeatureSourceIndexNode::getFID(osg::PrimitiveSet* primSet, FeatureID& output) const
 {
+    if ( primSet == 0L )
+        return false;
+
+    // tagged, but not indexed yet:
     const RefFeatureID* fid = dynamic_cast<const RefFeatureID*>( primSet->getUserData() );
     if ( fid )
     {
@@ -180,6 +366,15 @@ FeatureSourceIndexNode::getFID(osg::PrimitiveSet* primSet, FeatureID& output) co
         return true;
     }
 
+    EntryIndex::const_iterator i = std::lower_bound(
+        _byPrimSet.begin(), _byPrimSet.end(), primSet, LessPrimSet(_entries) );
+
+    if ( i != _byPrimSet.end() && _entries[*i]._pset.get() == primSet )
+    {
+        output = _entries[*i]._fid;
+        return true;
+    }
+
     OE_DEBUG << LC << "getFID failed b/c the primSet was not tagged with a RefFeatureID" << std::endl;
     return false;
 }
@@ -191,45 +386,30 @@ FeatureSourceIndexNode::getFID(osg::Drawable* drawable, int primIndex, FeatureID
     if ( drawable == 0L || primIndex < 0 )
         return false;
 
-    for( FeatureIDDrawSetMap::const_iterator i = _drawSets.begin(); i != _drawSets.end(); ++i )
+    osg::Geometry* geom = drawable->asGeometry();
+    if ( geom && !_entries.empty() )
     {
-        const FeatureDrawSet& drawSet = i->second;
-        FeatureDrawSet::DrawableSlices::const_iterator d = drawSet.slice(drawable);
-        if ( d != drawSet.slices().end() )
+        // find the last entry of this geometry that starts at or before primIndex.
+        Entry key;
+        key._geom      = geom;
+        key._firstPrim = (unsigned)primIndex;
+
+        Entries::const_iterator e = std::upper_bound( _entries.begin(), _entries.end(), key, LessGeometry() );
+        if ( e != _entries.begin() )
         {
-            const osg::Geometry* geom = drawable->asGeometry();
-            if ( geom )
+            --e;
+            if ( e->_geom == geom && (unsigned)primIndex < e->_firstPrim + e->_numPrims )
             {
-                const osg::Geometry::PrimitiveSetList& geomPrimSets = geom->getPrimitiveSetList();
-
-                unsigned encounteredPrims = 0;
-                for( osg::Geometry::PrimitiveSetList::const_iterator p = geomPrimSets.begin(); p != geomPrimSets.end(); ++p )
-                {
-                    const osg::PrimitiveSet* pset = p->get();
-                    unsigned numPrims = pset->getNumPrimitives();
-                    encounteredPrims += numPrims;
-
-                    if ( encounteredPrims > (unsigned)primIndex )
-                    {
-                        const RefFeatureID* fid = dynamic_cast<const RefFeatureID*>( pset->getUserData() );
-                        if ( fid )
-                        {
-                            output = *fid;
-                            return true;
-                        }
-                        else
-                        {
-                            OE_DEBUG << LC << "INTERNAL: found primset, but it's not tagged with a FID" << std::endl;
-                            return false;
-                        }
-                    }
-                }
+                output = e->_fid;
+                return true;
             }
         }
     }
 
     // see if we have a node in the path
-    for( osg::Node* node = drawable->getParent(0); node != 0L; node = (node->getNumParents()>0?node->getParent(0):0L) )
+    for( osg::Node* node = drawable->getNumParents() > 0 ? drawable->getParent(0) : 0L;
+         node != 0L;
+         node = (node->getNumParents()>0?node->getParent(0):0L) )
     {
         RefFeatureID* fid = dynamic_cast<RefFeatureID*>( node->getUserData() );
         if ( fid )
@@ -250,7 +430,34 @@ FeatureSourceIndexNode::getDrawSet(const FeatureID& fid )
     static FeatureDrawSet s_empty;
 
     FeatureIDDrawSetMap::iterator i = _drawSets.find(fid);
-    return i != _drawSets.end() ? i->second : s_empty;
+    if ( i != _drawSets.end() )
+        return i->second;
+
+    std::pair<EntryIndex::const_iterator, EntryIndex::const_iterator> prims = std::equal_range(
+        _byFID.begin(), _byFID.end(), fid, LessFID(_entries) );
+
+    NodeEntry key;
+    key._fid = fid;
+    std::pair<NodeEntries::const_iterator, NodeEntries::const_iterator> nodes = std::equal_range(
+        _nodes.begin(), _nodes.end(), key, LessNodeFID() );
+
+    if ( prims.first == prims.second && nodes.first == nodes.second )
+        return s_empty;
+
+    FeatureDrawSet& drawSet = _drawSets[fid];
+
+    for( EntryIndex::const_iterator p = prims.first; p != prims.second; ++p )
+    {
+        const Entry& e = _entries[*p];
+        drawSet.getOrCreateSlice(e._geom.get()).push_back(e._pset.get());
+    }
+
+    for( NodeEntries::const_iterator n = nodes.first; n != nodes.second; ++n )
+    {
+        drawSet.nodes().push_back( n->_node );
+    }
+
+    return drawSet;
 }
 
 
@@ -259,6 +466,7 @@ FeatureSourceIndexNode::getFeature(const FeatureID& fid, const Feature*& output)
 {
     if ( _options.embedFeatures() == true )
     {
+        Threading::ScopedMutexLock lock( _featuresMutex );
         FeatureMap::const_iterator f = _features.find(fid);
 
         if(f != _features.end())
@@ -0,0 +1,233 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/FeatureSpatialIndex>
+#include <algorithm>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+#define LC "[FeatureSpatialIndex] "
+
+// maximum number of children per tree node
+#define NODE_CAPACITY 16
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    template<typename NODE>
+    bool lessCenterX( const NODE& lhs, const NODE& rhs )
+    {
+        return (lhs._xmin + lhs._xmax) < (rhs._xmin + rhs._xmax);
+    }
+
+    template<typename NODE>
+    bool lessCenterY( const NODE& lhs, const NODE& rhs )
+    {
+        return (lhs._ymin + lhs._ymax) < (rhs._ymin + rhs._ymax);
+    }
+
+    template<typename NODE>
+    bool overlaps( const NODE& n, double xmin, double ymin, double xmax, double ymax )
+    {
+        return n._xmin <= xmax && n._xmax >= xmin && n._ymin <= ymax && n._ymax >= ymin;
+    }
+}
+
+//------------------------------------------------------------------------
+
+FeatureSpatialIndex::FeatureSpatialIndex()
+{
+    //nop
+}
+
+FeatureSpatialIndex::FeatureSpatialIndex( const FeatureList& features )
+{
+    build( features );
+}
+
+void
+FeatureSpatialIndex::sortTiles( NodeVector& nodes )
+{
+    // Sort-Tile-Recursive: order by x, cut into vertical slices of whole
+    // nodes, then order each slice by y.
+    unsigned numParents = (nodes.size() + NODE_CAPACITY - 1) / NODE_CAPACITY;
+    unsigned numSlices  = (unsigned)::ceil( ::sqrt((double)numParents) );
+    unsigned sliceSize  = numSlices * NODE_CAPACITY;
+
+    std::sort( nodes.begin(), nodes.end(), lessCenterX<Node> );
+
+    for( unsigned i = 0; i < nodes.size(); i += sliceSize )
+    {
+        unsigned end = std::min( i + sliceSize, (unsigned)nodes.size() );
+        std::sort( nodes.begin() + i, nodes.begin() + end, lessCenterY<Node> );
+    }
+}
+
+void
+FeatureSpatialIndex::group( const NodeVector& children, bool leaf, unsigned base, NodeVector& out_parents )
+{
+    out_parents.clear();
+    out_parents.reserve( (children.size() + NODE_CAPACITY - 1) / NODE_CAPACITY );
+
+    for( unsigned i = 0; i < children.size(); i += NODE_CAPACITY )
+    {
+        Node parent;
+        parent._first = base + i;
+        parent._count = std::min( (unsigned)NODE_CAPACITY, (unsigned)children.size() - i );
+        parent._leaf  = leaf;
+        parent._xmin  = children[i]._xmin;
+        parent._ymin  = children[i]._ymin;
+        parent._xmax  = children[i]._xmax;
+        parent._ymax  = children[i]._ymax;
+
+        for( unsigned c = i+1; c < i + parent._count; ++c )
+        {
+            parent._xmin = std::min( parent._xmin, children[c]._xmin );
+            parent._ymin = std::min( parent._ymin, children[c]._ymin );
+            parent._xmax = std::max( parent._xmax, children[c]._xmax );
+            parent._ymax = std::max( parent._ymax, children[c]._ymax );
+        }
+
+        out_parents.push_back( parent );
+    }
+}
+
+void
+FeatureSpatialIndex::build( const FeatureList& features )
+{
+    _features.clear();
+    _entries.clear();
+    _ordinals.clear();
+    _nodes.clear();
+    _bounds = Bounds();
+
+    std::vector< osg::ref_ptr<Feature> > unsorted;
+    unsorted.reserve( features.size() );
+
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+    {
+        Feature* feature = i->get();
+        if ( !feature || !feature->getGeometry() )
+            continue;
+
+        Bounds b = feature->getGeometry()->getBounds();
+        if ( !b.isValid() )
+            continue;
+
+        Node entry;
+        entry._xmin  = b.xMin();
+        entry._ymin  = b.yMin();
+        entry._xmax  = b.xMax();
+        entry._ymax  = b.yMax();
+        entry._first = unsorted.size();
+        entry._count = 0;
+        entry._leaf  = false;
+        _entries.push_back( entry );
+
+        unsorted.push_back( feature );
+        _bounds.expandBy( b );
+    }
+
+    if ( _entries.empty() )
+        return;
+
+    // order the features themselves so that each leaf covers a contiguous run.
+    sortTiles( _entries );
+    _features.resize( _entries.size() );
+    _ordinals.resize( _entries.size() );
+    for( unsigned i = 0; i < _entries.size(); ++i )
+    {
+        _features[i] = unsorted[_entries[i]._first];
+        _ordinals[i] = _entries[i]._first;
+        _entries[i]._first = i;
+    }
+
+    NodeVector level;
+    group( _entries, true, 0, level );
+
+    // pack the levels bottom-up; each level is stored before its parents.
+    while( level.size() > 1 )
+    {
+        sortTiles( level );
+        unsigned base = _nodes.size();
+        _nodes.insert( _nodes.end(), level.begin(), level.end() );
+
+        NodeVector parents;
+        group( level, false, base, parents );
+        level.swap( parents );
+    }
+
+    _nodes.push_back( level.front() );
+
+    OE_DEBUG << LC << "Indexed " << _features.size() << " features in "
+        << _nodes.size() << " nodes" << std::endl;
+}
+
+unsigned
+FeatureSpatialIndex::query( const Bounds& bounds, FeatureList& output ) const
+{
+    if ( _nodes.empty() || !bounds.isValid() )
+        return 0;
+
+    double xmin = bounds.xMin(), ymin = bounds.yMin();
+    double xmax = bounds.xMax(), ymax = bounds.yMax();
+
+    // (ordinal, slot) of each hit
+    std::vector< std::pair<unsigned,unsigned> > hits;
+    std::vector<unsigned> stack;
+    stack.push_back( _nodes.size()-1 );
+
+    while( !stack.empty() )
+    {
+        const Node& node = _nodes[stack.back()];
+        stack.pop_back();
+
+        if ( !overlaps(node, xmin, ymin, xmax, ymax) )
+            continue;
+
+        if ( node._leaf )
+        {
+            for( unsigned i = node._first; i < node._first + node._count; ++i )
+            {
+                if ( overlaps(_entries[i], xmin, ymin, xmax, ymax) )
+                {
+                    hits.push_back( std::make_pair(_ordinals[i], i) );
+                }
+            }
+        }
+        else
+        {
+            for( unsigned i = node._first; i < node._first + node._count; ++i )
+            {
+                stack.push_back( i );
+            }
+        }
+    }
+
+    // report hits in their original order.
+    std::sort( hits.begin(), hits.end() );
+    for( unsigned i = 0; i < hits.size(); ++i )
+    {
+        output.push_back( _features[hits[i].second].get() );
+    }
+
+    return hits.size();
+}
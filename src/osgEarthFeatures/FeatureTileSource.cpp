@@ -20,6 +20,7 @@
 #include <osgEarth/Registry>
 #include <osgDB/WriteFile>
 #include <osg/Notify>
+#include <cstring>
 
 using namespace osgEarth;
 using namespace osgEarth::Features;
@@ -31,7 +32,8 @@ using namespace osgEarth::Symbology;
 
 FeatureTileSourceOptions::FeatureTileSourceOptions( const ConfigOptions& options ) :
 TileSourceOptions( options ),
-_geomTypeOverride( Geometry::TYPE_UNKNOWN )
+_geomTypeOverride( Geometry::TYPE_UNKNOWN ),
+_metaTileSize    ( 1 )
 {
     fromConfig( _conf );
 }
@@ -43,6 +45,7 @@ FeatureTileSourceOptions::getConfig() const
 
     conf.updateObjIfSet( "features", _featureOptions );
     conf.updateObjIfSet( "styles", _styles );
+    conf.updateIfSet( "metatile_size", _metaTileSize );
 
     if ( _geomTypeOverride.isSet() ) {
         if ( _geomTypeOverride == Geometry::TYPE_LINESTRING )
@@ -71,6 +74,7 @@ FeatureTileSourceOptions::fromConfig( const Config& conf )
     //    _featureOptions->merge( ConfigOptions(conf.child("features")) );
 
     conf.getObjIfSet( "styles", _styles );
+    conf.getIfSet( "metatile_size", _metaTileSize );
     
     std::string gt = conf.value( "geometry_type" );
     if ( gt == "line" || gt == "lines" || gt == "linestring" )
@@ -86,7 +90,8 @@ FeatureTileSourceOptions::fromConfig( const Config& conf )
 FeatureTileSource::FeatureTileSource( const TileSourceOptions& options ) :
 TileSource  ( options ),
 _options    ( options.getConfig() ),
-_initialized( false )
+_initialized( false ),
+_metaTiles  ( 16 )
 {
     if ( _options.featureSource().valid() )
     {
@@ -152,6 +157,104 @@ FeatureTileSource::createImage( const TileKey& key, ProgressCallback* progress )
     if ( !_features.valid() || !_features->getFeatureProfile() )
         return 0L;
 
+    if ( _options.metaTileSize().value() > 1 )
+        return createMetaTileImage( key, progress );
+
+    return renderImage( key.getExtent(), getPixelsPerTile(), getPixelsPerTile(), progress );
+}
+
+
+osg::Image*
+FeatureTileSource::createMetaTileImage( const TileKey& key, ProgressCallback* progress )
+{
+    const Profile* profile = key.getProfile();
+    unsigned lod  = key.getLOD();
+    unsigned size = _options.metaTileSize().value();
+
+    // the block of tiles containing the key, clamped to the edges of the profile:
+    unsigned tilesWide, tilesHigh;
+    profile->getNumTiles( lod, tilesWide, tilesHigh );
+
+    unsigned x0 = (key.getTileX() / size) * size;
+    unsigned y0 = (key.getTileY() / size) * size;
+    unsigned nx = osg::minimum( size, tilesWide - x0 );
+    unsigned ny = osg::minimum( size, tilesHigh - y0 );
+
+    TileKey metaKey( lod, x0, y0, profile );
+
+    osg::ref_ptr<MetaTile> meta;
+    {
+        Threading::ScopedMutexLock lock( _metaTilesMutex );
+        MetaTileCache::Record rec;
+        if ( _metaTiles.get(metaKey, rec) )
+        {
+            meta = rec.value().get();
+        }
+        else
+        {
+            meta = new MetaTile();
+            _metaTiles.insert( metaKey, meta.get() );
+        }
+    }
+
+    // other tiles of the same block wait here while the first one renders.
+    Threading::ScopedMutexLock lock( meta->_mutex );
+
+    MetaTile::Images::iterator i = meta->_images.find( key );
+    if ( i == meta->_images.end() )
+    {
+        // tile extents share edges, so the corner tiles bound the block.
+        TileKey nw( lod, x0,      y0,      profile );
+        TileKey se( lod, x0+nx-1, y0+ny-1, profile );
+        GeoExtent extent(
+            profile->getSRS(),
+            nw.getExtent().xMin(), se.getExtent().yMin(),
+            se.getExtent().xMax(), nw.getExtent().yMax() );
+
+        unsigned ppt = getPixelsPerTile();
+        osg::ref_ptr<osg::Image> image = renderImage( extent, nx*ppt, ny*ppt, progress );
+        if ( !image.valid() )
+            return 0L;
+
+        // split the block up. Image rows run south to north, tile rows north to south.
+        unsigned pixelBytes = image->getPixelSizeInBits() / 8;
+        meta->_images.clear();
+
+        for( unsigned ty = 0; ty < ny; ++ty )
+        {
+            for( unsigned tx = 0; tx < nx; ++tx )
+            {
+                osg::Image* tile = new osg::Image();
+                tile->allocateImage( ppt, ppt, 1, image->getPixelFormat(), image->getDataType() );
+                tile->setInternalTextureFormat( image->getInternalTextureFormat() );
+
+                unsigned firstRow = (ny-1-ty) * ppt;
+                for( unsigned r = 0; r < ppt; ++r )
+                {
+                    ::memcpy( tile->data(0, r), image->data(tx*ppt, firstRow+r), ppt*pixelBytes );
+                }
+
+                meta->_images[TileKey(lod, x0+tx, y0+ty, profile)] = tile;
+            }
+        }
+
+        i = meta->_images.find( key );
+        if ( i == meta->_images.end() )
+            return 0L;
+    }
+
+    osg::ref_ptr<osg::Image> result = i->second.get();
+    meta->_images.erase( i );
+    return result.release();
+}
+
+
+osg::Image*
+FeatureTileSource::renderImage(const GeoExtent&  extent,
+                               unsigned          width,
+                               unsigned          height,
+                               ProgressCallback* progress)
+{
     // style data
     const StyleSheet* styles = _options.styles();
 
@@ -160,7 +263,7 @@ FeatureTileSource::createImage( const TileKey& key, ProgressCallback* progress )
 
 	// allocate the image.
 	osg::ref_ptr<osg::Image> image = new osg::Image();
-	image->allocateImage( getPixelsPerTile(), getPixelsPerTile(), 1, GL_RGBA, GL_UNSIGNED_BYTE );
+	image->allocateImage( width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE );
 
     preProcess( image.get(), buildData.get() );
 
@@ -178,7 +281,7 @@ FeatureTileSource::createImage( const TileKey& key, ProgressCallback* progress )
                 list.push_back( feature );
                 renderFeaturesForStyle( 
                     *feature->style(), list, buildData.get(),
-                    key.getExtent(), image.get() );
+                    extent, image.get() );
             }
         }
     }
@@ -190,18 +293,18 @@ FeatureTileSource::createImage( const TileKey& key, ProgressCallback* progress )
             {
                 const StyleSelector& sel = *i;
                 const Style* style = styles->getStyle( sel.getSelectedStyleName() );
-                queryAndRenderFeaturesForStyle( *style, sel.query().value(), buildData.get(), key.getExtent(), image.get() );
+                queryAndRenderFeaturesForStyle( *style, sel.query().value(), buildData.get(), extent, image.get() );
             }
         }
         else
         {
             const Style* style = styles->getDefaultStyle();
-            queryAndRenderFeaturesForStyle( *style, Query(), buildData.get(), key.getExtent(), image.get() );
+            queryAndRenderFeaturesForStyle( *style, Query(), buildData.get(), extent, image.get() );
         }
     }
     else
     {
-        queryAndRenderFeaturesForStyle( Style(), Query(), buildData.get(), key.getExtent(), image.get() );
+        queryAndRenderFeaturesForStyle( Style(), Query(), buildData.get(), extent, image.get() );
     }
 
     // final tile processing after all styles are done
@@ -61,7 +61,8 @@ _referenceFrame       ( rhs._referenceFrame ),
 _inverseReferenceFrame( rhs._inverseReferenceFrame ),
 _optimizerHints       ( rhs._optimizerHints ),
 _resourceCache        ( rhs._resourceCache.get() ),
-_index                ( rhs._index )
+_index                ( rhs._index ),
+_buildStats           ( rhs._buildStats.get() )
 {
     //nop
 }
@@ -0,0 +1,837 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthFeatures/GeoJSONReader>
+#include <osgEarthSymbology/Geometry>
+#include <osgEarth/StringUtils>
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define LC "[GeoJSONReader] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // Nested "coordinates" arrays. The positions of every innermost array go
+    // into one list; _ends[0] holds the end (in _points) of each array of
+    // positions, _ends[1] the end (in _ends[0]) of each array of those, and
+    // _ends[2] the end (in _ends[1]) of each array of polygons.
+    struct Coords
+    {
+        Coords() : _depth(0) { }
+        unsigned                _depth;
+        std::vector<osg::Vec3d> _points;
+        std::vector<unsigned>   _ends[3];
+    };
+
+    struct Property
+    {
+        enum Kind { KIND_STRING, KIND_DOUBLE, KIND_INT, KIND_BOOL, KIND_NULL };
+        Property() : _kind(KIND_NULL), _double(0.0), _int(0), _bool(false) { }
+        std::string _name;
+        Kind        _kind;
+        std::string _string;
+        double      _double;
+        int         _int;
+        bool        _bool;
+    };
+    typedef std::vector<Property> Properties;
+
+    // The members of one JSON object, held until the object closes. GeoJSON
+    // members come in any order, so "type" may follow the data it describes.
+    struct Object
+    {
+        Object() : _hasId(false), _id(0L), _hasCoords(false), _hasGeometry(false) { }
+        std::string            _type;
+        bool                   _hasId;
+        FeatureID              _id;
+        bool                   _hasCoords;
+        Coords                 _coords;
+        GeometryCollection     _geometries;
+        bool                   _hasGeometry;
+        osg::ref_ptr<Geometry> _geometry;
+        Properties             _properties;
+    };
+
+    class Parser
+    {
+    public:
+        Parser( const std::string& buffer, const SpatialReference* srs, AttributeSchema* schema ) :
+          _begin  ( buffer.c_str() ),
+          _p      ( buffer.c_str() ),
+          _end    ( buffer.c_str() + buffer.size() ),
+          _srs    ( srs ),
+          _schema ( schema ),
+          _nextFID( 0L )
+        {
+            //nop
+        }
+
+        bool parse( FeatureList& out )
+        {
+            ws();
+            Object obj;
+            if ( !readObject(obj, out) )
+                return false;
+
+            ws();
+            if ( _p != _end )
+                return fail( "unexpected text after the document" );
+
+            // a lone Feature or geometry:
+            if ( obj._type != "FeatureCollection" )
+            {
+                Feature* feature = createFeature( obj );
+                if ( feature )
+                    out.push_back( feature );
+            }
+            return true;
+        }
+
+        const std::string& getError() const { return _error; }
+
+    private:
+        const char*                    _begin;
+        const char*                    _p;
+        const char*                    _end;
+        const SpatialReference*        _srs;
+        AttributeSchema*               _schema;
+        FeatureID                      _nextFID;
+        std::string                    _error;
+
+        // --- lexical ---
+
+        bool fail( const std::string& what )
+        {
+            if ( _error.empty() )
+                _error = Stringify() << what << " at offset " << (unsigned)(_p - _begin);
+            return false;
+        }
+
+        void ws()
+        {
+            while( _p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r') )
+                ++_p;
+        }
+
+        bool accept( char c )
+        {
+            if ( _p < _end && *_p == c )
+            {
+                ++_p;
+                return true;
+            }
+            return false;
+        }
+
+        bool expect( char c )
+        {
+            return accept(c) ? true : fail( Stringify() << "expected '" << c << "'" );
+        }
+
+        bool readLiteral( const char* literal )
+        {
+            size_t len = ::strlen( literal );
+            if ( (size_t)(_end - _p) >= len && ::strncmp(_p, literal, len) == 0 )
+            {
+                _p += len;
+                return true;
+            }
+            return fail( Stringify() << "expected \"" << literal << "\"" );
+        }
+
+        static void appendUTF8( unsigned code, std::string& out )
+        {
+            if ( code < 0x80 ) {
+                out += (char)code;
+            }
+            else if ( code < 0x800 ) {
+                out += (char)(0xC0 | (code >> 6));
+                out += (char)(0x80 | (code & 0x3F));
+            }
+            else if ( code < 0x10000 ) {
+                out += (char)(0xE0 | (code >> 12));
+                out += (char)(0x80 | ((code >> 6) & 0x3F));
+                out += (char)(0x80 | (code & 0x3F));
+            }
+            else {
+                out += (char)(0xF0 | (code >> 18));
+                out += (char)(0x80 | ((code >> 12) & 0x3F));
+                out += (char)(0x80 | ((code >> 6) & 0x3F));
+                out += (char)(0x80 | (code & 0x3F));
+            }
+        }
+
+        bool readHex4( unsigned& out )
+        {
+            if ( _end - _p < 4 )
+                return fail( "truncated \\u escape" );
+
+            out = 0;
+            for( int i = 0; i < 4; ++i, ++_p )
+            {
+                char c = *_p;
+                out <<= 4;
+                if      ( c >= '0' && c <= '9' ) out |= (unsigned)(c - '0');
+                else if ( c >= 'a' && c <= 'f' ) out |= (unsigned)(c - 'a' + 10);
+                else if ( c >= 'A' && c <= 'F' ) out |= (unsigned)(c - 'A' + 10);
+                else return fail( "bad \\u escape" );
+            }
+            return true;
+        }
+
+        bool readString( std::string& out )
+        {
+            out.clear();
+            if ( !expect('"') )
+                return false;
+
+            for(;;)
+            {
+                // copy runs of plain characters in one go.
+                const char* run = _p;
+                while( _p < _end && *_p != '"' && *_p != '\\' )
+                    ++_p;
+                out.append( run, _p - run );
+
+                if ( _p >= _end )
+                    return fail( "unterminated string" );
+
+                if ( *_p++ == '"' )
+                    return true;
+
+                // escape sequence
+                if ( _p >= _end )
+                    return fail( "unterminated string" );
+
+                char c = *_p++;
+                switch( c )
+                {
+                case '"':  out += '"';  break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/';  break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u':
+                    {
+                        unsigned code;
+                        if ( !readHex4(code) )
+                            return false;
+
+                        // surrogate pair:
+                        if ( code >= 0xD800 && code < 0xDC00 && _end - _p >= 6 && _p[0] == '\\' && _p[1] == 'u' )
+                        {
+                            _p += 2;
+                            unsigned low;
+                            if ( !readHex4(low) )
+                                return false;
+                            if ( low >= 0xDC00 && low < 0xE000 )
+                                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        appendUTF8( code, out );
+                    }
+                    break;
+                default:
+                    return fail( "bad escape sequence" );
+                }
+            }
+        }
+
+        bool readNumber( double& out, bool& out_isInt )
+        {
+            const char* start = _p;
+            out_isInt = true;
+
+            accept('-');
+            if ( _p >= _end || !::isdigit((unsigned char)*_p) )
+                return fail( "expected a number" );
+            while( _p < _end && ::isdigit((unsigned char)*_p) ) ++_p;
+
+            if ( accept('.') )
+            {
+                out_isInt = false;
+                if ( _p >= _end || !::isdigit((unsigned char)*_p) )
+                    return fail( "bad number" );
+                while( _p < _end && ::isdigit((unsigned char)*_p) ) ++_p;
+            }
+
+            if ( _p < _end && (*_p == 'e' || *_p == 'E') )
+            {
+                out_isInt = false;
+                ++_p;
+                if ( !accept('+') ) accept('-');
+                if ( _p >= _end || !::isdigit((unsigned char)*_p) )
+                    return fail( "bad number" );
+                while( _p < _end && ::isdigit((unsigned char)*_p) ) ++_p;
+            }
+
+            // the text is a valid JSON number, and the character after it
+            // cannot continue one, so strtod reads exactly this span.
+            out = ::strtod( start, 0L );
+            return true;
+        }
+
+        bool skipValue()
+        {
+            ws();
+            if ( _p >= _end )
+                return fail( "expected a value" );
+
+            switch( *_p )
+            {
+            case '"':
+                {
+                    std::string ignore;
+                    return readString( ignore );
+                }
+            case '{':
+                {
+                    ++_p;
+                    ws();
+                    if ( accept('}') )
+                        return true;
+                    for(;;)
+                    {
+                        std::string key;
+                        ws();
+                        if ( !readString(key) ) return false;
+                        ws();
+                        if ( !expect(':') ) return false;
+                        if ( !skipValue() ) return false;
+                        ws();
+                        if ( accept(',') ) continue;
+                        if ( accept('}') ) return true;
+                        return fail( "expected ',' or '}'" );
+                    }
+                }
+            case '[':
+                {
+                    ++_p;
+                    ws();
+                    if ( accept(']') )
+                        return true;
+                    for(;;)
+                    {
+                        if ( !skipValue() ) return false;
+                        ws();
+                        if ( accept(',') ) continue;
+                        if ( accept(']') ) return true;
+                        return fail( "expected ',' or ']'" );
+                    }
+                }
+            case 't': return readLiteral( "true" );
+            case 'f': return readLiteral( "false" );
+            case 'n': return readLiteral( "null" );
+            default:
+                {
+                    double ignore;
+                    bool   isInt;
+                    return readNumber( ignore, isInt );
+                }
+            }
+        }
+
+        // --- GeoJSON ---
+
+        bool readObject( Object& obj, FeatureList& out )
+        {
+            if ( !expect('{') )
+                return false;
+
+            ws();
+            if ( accept('}') )
+                return true;
+
+            std::string key;
+            for(;;)
+            {
+                ws();
+                if ( !readString(key) ) return false;
+                ws();
+                if ( !expect(':') ) return false;
+                ws();
+
+                bool ok =
+                    key == "type"        ? readString( obj._type ) :
+                    key == "features"    ? readFeatures( out ) :
+                    key == "geometry"    ? readGeometryMember( obj ) :
+                    key == "geometries"  ? readGeometries( obj ) :
+                    key == "coordinates" ? readCoords( obj ) :
+                    key == "properties"  ? readProperties( obj._properties ) :
+                    key == "id"          ? readId( obj ) :
+                                           skipValue();
+                if ( !ok )
+                    return false;
+
+                ws();
+                if ( accept(',') ) continue;
+                if ( accept('}') ) return true;
+                return fail( "expected ',' or '}'" );
+            }
+        }
+
+        bool readFeatures( FeatureList& out )
+        {
+            if ( !expect('[') )
+                return false;
+
+            ws();
+            if ( accept(']') )
+                return true;
+
+            for(;;)
+            {
+                ws();
+                Object obj;
+                if ( !readObject(obj, out) )
+                    return false;
+
+                Feature* feature = createFeature( obj );
+                if ( feature )
+                    out.push_back( feature );
+
+                ws();
+                if ( accept(',') ) continue;
+                if ( accept(']') ) return true;
+                return fail( "expected ',' or ']'" );
+            }
+        }
+
+        bool readGeometryMember( Object& obj )
+        {
+            obj._hasGeometry = true;
+            if ( _p < _end && *_p == 'n' )
+                return readLiteral( "null" );
+
+            Object geom;
+            FeatureList ignore;
+            if ( !readObject(geom, ignore) )
+                return false;
+
+            obj._geometry = createGeometry( geom );
+            return true;
+        }
+
+        bool readGeometries( Object& obj )
+        {
+            if ( !expect('[') )
+                return false;
+
+            ws();
+            if ( accept(']') )
+                return true;
+
+            for(;;)
+            {
+                ws();
+                Object geom;
+                FeatureList ignore;
+                if ( !readObject(geom, ignore) )
+                    return false;
+
+                Geometry* part = createGeometry( geom );
+                if ( part )
+                    obj._geometries.push_back( part );
+
+                ws();
+                if ( accept(',') ) continue;
+                if ( accept(']') ) return true;
+                return fail( "expected ',' or ']'" );
+            }
+        }
+
+        bool readCoords( Object& obj )
+        {
+            if ( _p < _end && *_p == 'n' )
+                return readLiteral( "null" );
+
+            obj._hasCoords = true;
+            return readCoordArray( obj._coords, obj._coords._depth );
+        }
+
+        // closes an array of nesting depth 2 (positions), 3 or 4.
+        static void closeArray( Coords& c, unsigned depth )
+        {
+            c._ends[depth-2].push_back( depth == 2 ? c._points.size() : c._ends[depth-3].size() );
+        }
+
+        bool readCoordArray( Coords& c, unsigned& out_depth )
+        {
+            if ( !expect('[') )
+                return false;
+
+            ws();
+
+            // an empty array counts as an empty list of positions.
+            if ( accept(']') )
+            {
+                out_depth = 2;
+                closeArray( c, out_depth );
+                return true;
+            }
+
+            if ( *_p != '[' )
+            {
+                // a position:
+                osg::Vec3d p;
+                unsigned n = 0;
+                for(;;)
+                {
+                    double value;
+                    bool   isInt;
+                    if ( !readNumber(value, isInt) )
+                        return false;
+                    if ( n < 3 )
+                        p[n] = value;
+                    ++n;
+
+                    ws();
+                    if ( accept(',') ) { ws(); continue; }
+                    if ( accept(']') ) break;
+                    return fail( "expected ',' or ']' in a position" );
+                }
+
+                if ( n < 2 )
+                    return fail( "a position needs at least two numbers" );
+
+                c._points.push_back( p );
+                out_depth = 1;
+                return true;
+            }
+
+            unsigned depth = 0;
+            for(;;)
+            {
+                unsigned childDepth = 0;
+                if ( !readCoordArray(c, childDepth) )
+                    return false;
+                depth = osg::maximum( depth, childDepth + 1 );
+
+                ws();
+                if ( accept(',') ) { ws(); continue; }
+                if ( accept(']') ) break;
+                return fail( "expected ',' or ']' in coordinates" );
+            }
+
+            if ( depth > 4 )
+                return fail( "coordinates are nested too deeply" );
+
+            closeArray( c, depth );
+            out_depth = depth;
+            return true;
+        }
+
+        bool readProperties( Properties& props )
+        {
+            if ( _p < _end && *_p == 'n' )
+                return readLiteral( "null" );
+
+            if ( !expect('{') )
+                return false;
+
+            ws();
+            if ( accept('}') )
+                return true;
+
+            for(;;)
+            {
+                Property prop;
+                ws();
+                if ( !readString(prop._name) ) return false;
+                ws();
+                if ( !expect(':') ) return false;
+                ws();
+
+                // attribute names are lower case, as they are for OGR sources.
+                std::transform( prop._name.begin(), prop._name.end(), prop._name.begin(), ::tolower );
+
+                if ( _p >= _end )
+                    return fail( "expected a value" );
+
+                char c = *_p;
+                if ( c == '"' )
+                {
+                    prop._kind = Property::KIND_STRING;
+                    if ( !readString(prop._string) ) return false;
+                }
+                else if ( c == 't' || c == 'f' )
+                {
+                    prop._kind = Property::KIND_BOOL;
+                    prop._bool = c == 't';
+                    if ( !readLiteral(prop._bool ? "true" : "false") ) return false;
+                }
+                else if ( c == 'n' )
+                {
+                    prop._kind = Property::KIND_NULL;
+                    if ( !readLiteral("null") ) return false;
+                }
+                else if ( c == '{' || c == '[' )
+                {
+                    // nested values are kept as their JSON text.
+                    const char* start = _p;
+                    if ( !skipValue() ) return false;
+                    prop._kind = Property::KIND_STRING;
+                    prop._string.assign( start, _p - start );
+                }
+                else
+                {
+                    bool isInt;
+                    if ( !readNumber(prop._double, isInt) ) return false;
+                    if ( isInt && prop._double >= (double)INT_MIN && prop._double <= (double)INT_MAX )
+                    {
+                        prop._kind = Property::KIND_INT;
+                        prop._int  = (int)prop._double;
+                    }
+                    else
+                    {
+                        prop._kind = Property::KIND_DOUBLE;
+                    }
+                }
+
+                props.push_back( prop );
+
+                ws();
+                if ( accept(',') ) continue;
+                if ( accept('}') ) return true;
+                return fail( "expected ',' or '}'" );
+            }
+        }
+
+        bool readId( Object& obj )
+        {
+            if ( _p < _end && *_p == '"' )
+            {
+                // string IDs (e.g. "roads.12") don't make a FID; keep them as an attribute.
+                Property prop;
+                prop._name = "id";
+                prop._kind = Property::KIND_STRING;
+                if ( !readString(prop._string) )
+                    return false;
+                obj._properties.push_back( prop );
+                return true;
+            }
+
+            if ( _p < _end && (*_p == '-' || ::isdigit((unsigned char)*_p)) )
+            {
+                double value;
+                bool   isInt;
+                if ( !readNumber(value, isInt) )
+                    return false;
+                if ( isInt && value >= 0.0 )
+                {
+                    obj._hasId = true;
+                    obj._id    = (FeatureID)value;
+                }
+                return true;
+            }
+
+            return skipValue();
+        }
+
+        // --- building ---
+
+        // Appends points [first, last) to a geometry, reversing them and dropping
+        // repeats the same way OgrUtils does.
+        static void populate( const Coords& c, unsigned first, unsigned last, Geometry* target )
+        {
+            for( unsigned i = last; i > first; --i )
+            {
+                const osg::Vec3d& p = c._points[i-1];
+                if ( target->size() == 0 || p != target->back() )
+                    target->push_back( p );
+            }
+        }
+
+        static unsigned begin( const std::vector<unsigned>& ends, unsigned i )
+        {
+            return i > 0 ? ends[i-1] : 0u;
+        }
+
+        static Polygon* createPolygon( const Coords& c, unsigned firstRing, unsigned lastRing )
+        {
+            osg::ref_ptr<Polygon> poly;
+            for( unsigned r = firstRing; r < lastRing; ++r )
+            {
+                unsigned first = begin( c._ends[0], r );
+                unsigned last  = c._ends[0][r];
+
+                if ( !poly.valid() )
+                {
+                    poly = new Polygon( last-first );
+                    populate( c, first, last, poly.get() );
+                    poly->open();
+                    poly->rewind( Ring::ORIENTATION_CCW );
+                }
+                else
+                {
+                    osg::ref_ptr<Ring> hole = new Ring( last-first );
+                    populate( c, first, last, hole.get() );
+                    hole->open();
+                    if ( hole->isValid() )
+                    {
+                        hole->rewind( Ring::ORIENTATION_CW );
+                        poly->getHoles().push_back( hole.get() );
+                    }
+                }
+            }
+            return poly.valid() && poly->isValid() ? poly.release() : 0L;
+        }
+
+        static Geometry* createGeometry( const Object& obj )
+        {
+            const std::string& type = obj._type;
+            const Coords&      c    = obj._coords;
+
+            if ( type == "GeometryCollection" )
+            {
+                return obj._geometries.empty() ? 0L : new MultiGeometry( obj._geometries );
+            }
+
+            if ( !obj._hasCoords )
+                return 0L;
+
+            osg::ref_ptr<Geometry> geom;
+
+            if ( type == "Point" && c._depth == 1 )
+            {
+                geom = new PointSet( 1 );
+                geom->push_back( c._points[0] );
+            }
+            else if ( type == "LineString" && c._depth == 2 )
+            {
+                geom = new LineString( c._ends[0][0] );
+                populate( c, 0, c._ends[0][0], geom.get() );
+            }
+            else if ( type == "Polygon" && c._depth == 3 )
+            {
+                geom = createPolygon( c, 0, c._ends[0].size() );
+            }
+            else if ( type == "MultiPoint" && c._depth == 2 )
+            {
+                MultiGeometry* multi = new MultiGeometry();
+                geom = multi;
+                for( unsigned i = 0; i < c._points.size(); ++i )
+                {
+                    PointSet* point = new PointSet( 1 );
+                    point->push_back( c._points[i] );
+                    multi->add( point );
+                }
+            }
+            else if ( type == "MultiLineString" && c._depth == 3 )
+            {
+                MultiGeometry* multi = new MultiGeometry();
+                geom = multi;
+                for( unsigned i = 0; i < c._ends[0].size(); ++i )
+                {
+                    osg::ref_ptr<LineString> line = new LineString();
+                    populate( c, begin(c._ends[0], i), c._ends[0][i], line.get() );
+                    if ( line->isValid() )
+                        multi->add( line.get() );
+                }
+            }
+            else if ( type == "MultiPolygon" && c._depth == 4 )
+            {
+                MultiGeometry* multi = new MultiGeometry();
+                geom = multi;
+                for( unsigned i = 0; i < c._ends[1].size(); ++i )
+                {
+                    Polygon* poly = createPolygon( c, begin(c._ends[1], i), c._ends[1][i] );
+                    if ( poly )
+                        multi->add( poly );
+                }
+            }
+
+            return geom.valid() && geom->isValid() ? geom.release() : 0L;
+        }
+
+        Feature* createFeature( const Object& obj )
+        {
+            osg::ref_ptr<Geometry> geom;
+            if ( obj._type == "Feature" )
+            {
+                geom = obj._geometry.get();
+            }
+            else
+            {
+                geom = createGeometry( obj );
+                if ( !geom.valid() )
+                    return 0L;
+            }
+
+            // like OGR, number features in document order unless they carry an ID.
+            FeatureID fid = obj._hasId ? obj._id : _nextFID;
+            ++_nextFID;
+
+            Feature* feature = new Feature( geom.get(), _srs, Style(), fid );
+            if ( _schema )
+                feature->setAttributeSchema( _schema );
+
+            for( Properties::const_iterator i = obj._properties.begin(); i != obj._properties.end(); ++i )
+            {
+                switch( i->_kind )
+                {
+                case Property::KIND_STRING: feature->set( i->_name, i->_string ); break;
+                case Property::KIND_DOUBLE: feature->set( i->_name, i->_double ); break;
+                case Property::KIND_INT:    feature->set( i->_name, i->_int );    break;
+                case Property::KIND_BOOL:   feature->set( i->_name, i->_bool );   break;
+                default:                    feature->setNull( i->_name );         break;
+                }
+            }
+
+            return feature;
+        }
+    };
+}
+
+//------------------------------------------------------------------------
+
+GeoJSONReader::GeoJSONReader( const SpatialReference* srs ) :
+_srs( srs )
+{
+    //nop
+}
+
+bool
+GeoJSONReader::read( const std::string& buffer, FeatureList& out_features )
+{
+    Parser parser( buffer, _srs.get(), _schema.get() );
+
+    FeatureList features;
+    if ( !parser.parse(features) )
+    {
+        _error = parser.getError();
+        OE_DEBUG << LC << "Failed to parse GeoJSON: " << _error << std::endl;
+        return false;
+    }
+
+    _error.clear();
+    out_features.splice( out_features.end(), features );
+    return true;
+}
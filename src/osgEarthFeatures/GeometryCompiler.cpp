@@ -85,6 +85,7 @@ _maxGranularity_deg( 1.0 ),
 _mergeGeometry     ( false ),
 _clustering        ( false ),
 _instancing        ( false ),
+_instancingTexture ( false ),
 _ignoreAlt         ( false ),
 _useVertexBufferObjects( true ),
 _shaderPolicy      ( SHADERPOLICY_GENERATE )
@@ -100,6 +101,7 @@ GeometryCompilerOptions::fromConfig( const Config& conf )
     conf.getIfSet   ( "merge_geometry",   _mergeGeometry );
     conf.getIfSet   ( "clustering",       _clustering );
     conf.getIfSet   ( "instancing",       _instancing );
+    conf.getIfSet   ( "instancing_texture", _instancingTexture );
     conf.getObjIfSet( "feature_name",     _featureNameExpr );
     conf.getIfSet   ( "ignore_altitude",  _ignoreAlt );
     conf.getIfSet   ( "geo_interpolation", "great_circle", _geoInterp, GEOINTERP_GREAT_CIRCLE );
@@ -119,6 +121,7 @@ GeometryCompilerOptions::getConfig() const
     conf.addIfSet   ( "merge_geometry",   _mergeGeometry );
     conf.addIfSet   ( "clustering",       _clustering );
     conf.addIfSet   ( "instancing",       _instancing );
+    conf.addIfSet   ( "instancing_texture", _instancingTexture );
     conf.addObjIfSet( "feature_name",     _featureNameExpr );
     conf.addIfSet   ( "ignore_altitude",  _ignoreAlt );
     conf.addIfSet   ( "geo_interpolation", "great_circle", _geoInterp, GEOINTERP_GREAT_CIRCLE );
@@ -216,6 +219,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         sharedCX.extent() = sharedCX.profile()->getExtent();
     }
 
+    // per-stage timing, if the caller is collecting it.
+    FeatureBuildStats* stats = sharedCX.buildStats();
+
     // ref_ptr's to hold defaults in case we need them.
     osg::ref_ptr<PointSymbol>   defaultPoint;
     osg::ref_ptr<LineSymbol>    defaultLine;
@@ -235,9 +241,11 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     // check whether we need tessellation:
     if ( line && line->tessellation().isSet() )
     {
+        FeatureBuildStats::StageTimer timer( stats, "tessellate" );
         TemplateFeatureFilter<TessellateOperator> filter;
         filter.setNumPartitions( *line->tessellation() );
         sharedCX = filter.push( workingSet, sharedCX );
+        timer.done( workingSet );
     }
 
     // if the style was empty, use some defaults based on the geometry type of the
@@ -273,13 +281,15 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     // resample the geometry if necessary:
     if (_options.resampleMode().isSet())
     {
+        FeatureBuildStats::StageTimer timer( stats, "resample" );
         ResampleFilter resample;
         resample.resampleMode() = *_options.resampleMode();        
         if (_options.resampleMaxLength().isSet())
         {
             resample.maxLength() = *_options.resampleMaxLength();
         }                   
-        sharedCX = resample.push( workingSet, sharedCX );        
+        sharedCX = resample.push( workingSet, sharedCX );
+        timer.done( workingSet );
     }    
     
     // check whether we need to do elevation clamping:
@@ -299,38 +309,47 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if ( marker->placement() == MarkerSymbol::PLACEMENT_RANDOM   ||
              marker->placement() == MarkerSymbol::PLACEMENT_INTERVAL )
         {
+            FeatureBuildStats::StageTimer timer( stats, "scatter" );
             ScatterFilter scatter;
             scatter.setDensity( *marker->density() );
             scatter.setRandom( marker->placement() == MarkerSymbol::PLACEMENT_RANDOM );
             scatter.setRandomSeed( *marker->randomSeed() );
             markerCX = scatter.push( workingSet, markerCX );
+            timer.done( workingSet );
         }
         else if ( marker->placement() == MarkerSymbol::PLACEMENT_CENTROID )
         {
+            FeatureBuildStats::StageTimer timer( stats, "centroid" );
             CentroidFilter centroid;
             centroid.push( workingSet, markerCX );
+            timer.done( workingSet );
         }
 
         if ( altRequired )
         {
+            FeatureBuildStats::StageTimer timer( stats, "altitude" );
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
             markerCX = clamp.push( workingSet, markerCX );
+            timer.done( workingSet );
 
             // don't set this; we changed the input data.
             //altRequired = false;
         }
 
+        FeatureBuildStats::StageTimer timer( stats, "substitute_model" );
         SubstituteModelFilter sub( style );
 
         sub.setClustering( *_options.clustering() );
 
         sub.setUseDrawInstanced( *_options.instancing() );
+        sub.setUseInstanceTexture( *_options.instancingTexture() );
 
         if ( _options.featureName().isSet() )
             sub.setFeatureNameExpr( *_options.featureName() );
 
         osg::Node* node = sub.push( workingSet, markerCX );
+        timer.done( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -348,28 +367,35 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if ( instance->placement() == InstanceSymbol::PLACEMENT_RANDOM   ||
              instance->placement() == InstanceSymbol::PLACEMENT_INTERVAL )
         {
+            FeatureBuildStats::StageTimer timer( stats, "scatter" );
             ScatterFilter scatter;
             scatter.setDensity( *instance->density() );
             scatter.setRandom( instance->placement() == InstanceSymbol::PLACEMENT_RANDOM );
             scatter.setRandomSeed( *instance->randomSeed() );
             localCX = scatter.push( workingSet, localCX );
+            timer.done( workingSet );
         }
         else if ( instance->placement() == InstanceSymbol::PLACEMENT_CENTROID )
         {
+            FeatureBuildStats::StageTimer timer( stats, "centroid" );
             CentroidFilter centroid;
             centroid.push( workingSet, localCX );
+            timer.done( workingSet );
         }
 
         if ( altRequired )
         {
+            FeatureBuildStats::StageTimer timer( stats, "altitude" );
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
             localCX = clamp.push( workingSet, localCX );
+            timer.done( workingSet );
 
             // don't set this; we changed the input data.
             //altRequired = false;
         }
 
+        FeatureBuildStats::StageTimer timer( stats, "substitute_model" );
         SubstituteModelFilter sub( style );
 
         // activate clustering
@@ -377,12 +403,14 @@ GeometryCompiler::compile(FeatureList&          workingSet,
 
         // activate draw-instancing
         sub.setUseDrawInstanced( *_options.instancing() );
+        sub.setUseInstanceTexture( *_options.instancingTexture() );
 
         // activate feature naming
         if ( _options.featureName().isSet() )
             sub.setFeatureNameExpr( *_options.featureName() );
 
         osg::Node* node = sub.push( workingSet, localCX );
+        timer.done( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -400,12 +428,15 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     {
         if ( altRequired )
         {
+            FeatureBuildStats::StageTimer timer( stats, "altitude" );
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
             sharedCX = clamp.push( workingSet, sharedCX );
+            timer.done( workingSet );
             altRequired = false;
         }
 
+        FeatureBuildStats::StageTimer timer( stats, "extrude" );
         ExtrudeGeometryFilter extrude;
         extrude.setStyle( style );
 
@@ -416,6 +447,7 @@ GeometryCompiler::compile(FeatureList&          workingSet,
             extrude.useVertexBufferObjects() = *_options.useVertexBufferObjects();
 
         osg::Node* node = extrude.push( workingSet, sharedCX );
+        timer.done( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -427,14 +459,18 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     {
         if ( altRequired )
         {
+            FeatureBuildStats::StageTimer timer( stats, "altitude" );
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
             sharedCX = clamp.push( workingSet, sharedCX );
+            timer.done( workingSet );
             altRequired = false;
         }
 
+        FeatureBuildStats::StageTimer timer( stats, "polygonize_lines" );
         PolygonizeLinesFilter filter( style );
         osg::Node* node = filter.push( workingSet, sharedCX );
+        timer.done( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -446,12 +482,15 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     {
         if ( altRequired )
         {
+            FeatureBuildStats::StageTimer timer( stats, "altitude" );
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
             sharedCX = clamp.push( workingSet, sharedCX );
+            timer.done( workingSet );
             altRequired = false;
         }
 
+        FeatureBuildStats::StageTimer timer( stats, "build_geometry" );
         BuildGeometryFilter filter( style );
         if ( _options.maxGranularity().isSet() )
             filter.maxGranularity() = *_options.maxGranularity();
@@ -465,6 +504,7 @@ GeometryCompiler::compile(FeatureList&          workingSet,
             filter.useVertexBufferObjects() = *_options.useVertexBufferObjects();
 
         osg::Node* node = filter.push( workingSet, sharedCX );
+        timer.done( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -475,14 +515,18 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     {
         if ( altRequired )
         {
+            FeatureBuildStats::StageTimer timer( stats, "altitude" );
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
             sharedCX = clamp.push( workingSet, sharedCX );
+            timer.done( workingSet );
             altRequired = false;
         }
 
+        FeatureBuildStats::StageTimer timer( stats, "build_text" );
         BuildTextFilter filter( style );
         osg::Node* node = filter.push( workingSet, sharedCX );
+        timer.done( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -501,8 +545,10 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     {
         if ( _options.shaderPolicy() == SHADERPOLICY_GENERATE )
         {
+            FeatureBuildStats::StageTimer timer( stats, "generate_shaders" );
             ShaderGenerator gen( 0L );  // no ss cache because we will optimize later
             resultGroup->accept( gen );
+            timer.done( workingSet.size(), 0u );
         }
         else if ( _options.shaderPolicy() == SHADERPOLICY_DISABLE )
         {
@@ -513,7 +559,11 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     }
 
     // Optimize stateset sharing.
-    sscache->optimize( resultGroup.get() );
+    {
+        FeatureBuildStats::StageTimer timer( stats, "share_state" );
+        sscache->optimize( resultGroup.get() );
+        timer.done( workingSet.size(), 0u );
+    }
     
     // todo: this helps a lot, but is currently broken for non-triangle
     // geometries. (gw, 12-17-2012)
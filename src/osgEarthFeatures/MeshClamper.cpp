@@ -55,6 +55,13 @@ _offset         ( offset )
     //nop
 }
 
+void
+MeshClamper::setClampingExtent( const GeoExtent& extent )
+{
+    // vertices are tested in the terrain's SRS, so express the extent in it too.
+    _extent = extent.isValid() && _terrainSRS.valid() ? extent.transform( _terrainSRS.get() ) : extent;
+}
+
 void
 MeshClamper::apply( osg::Transform& xform )
 {
@@ -157,6 +164,22 @@ MeshClamper::apply( osg::Geode& geode )
                 }
 #endif
 
+                // skip vertices outside the clamping extent. (The z-offsets above must
+                // still be recorded for them, so this test comes afterwards.)
+                if ( _extent.isValid() )
+                {
+                    double x = vw.x(), y = vw.y();
+                    if ( _geocentric )
+                    {
+                        double lat, lon, hae;
+                        em->convertXYZToLatLongHeight(vw.x(), vw.y(), vw.z(), lat, lon, hae);
+                        x = osg::RadiansToDegrees(lon);
+                        y = osg::RadiansToDegrees(lat);
+                    }
+                    if ( !_extent.contains(x, y) )
+                        continue;
+                }
+
                 lsi->reset();
                 lsi->setStart( vw + n_vector*r*_scale );
                 lsi->setEnd( vw - n_vector*r );
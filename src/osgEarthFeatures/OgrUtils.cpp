@@ -261,7 +261,13 @@ OGRGeometryH
 }
 
 Feature*
-    OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs )
+OgrUtils::createFeature( OGRFeatureH handle, const FeatureProfile* profile )
+{
+    return createFeature( handle, profile->getSRS(), profile->getAttributeSchema() );
+}
+
+Feature*
+    OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs, AttributeSchema* schema )
 {
     long fid = OGR_F_GetFID( handle );
 
@@ -275,6 +281,8 @@ Feature*
     }
 
     Feature* feature = new Feature( geom, srs, Style(), fid );
+    if ( schema )
+        feature->setAttributeSchema( schema );
 
     int numAttrs = OGR_F_GetFieldCount(handle); 
     for (int i = 0; i < numAttrs; ++i) 
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/ScriptEngine>
+#include <osgEarthFeatures/Feature>
 #include <osgEarth/Notify>
 #include <osgEarth/Registry>
 #include <osgDB/ReadFile>
@@ -66,6 +67,24 @@ ScriptEngineOptions::getConfig() const
 
 //------------------------------------------------------------------------
 
+bool
+ScriptEngine::runBatch(const std::string& code, const FeatureList& features, std::vector<ScriptResult>& out_results, FilterContext const* context)
+{
+  bool ok = true;
+  out_results.reserve( out_results.size() + features.size() );
+
+  for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+  {
+    out_results.push_back( run(code, i->get(), context) );
+    if ( !out_results.back().success() )
+      ok = false;
+  }
+
+  return ok;
+}
+
+//------------------------------------------------------------------------
+
 #undef  LC
 #define LC "[ScriptEngineFactory] "
 #define SCRIPT_ENGINE_OPTIONS_TAG "__osgEarth::Features::ScriptEngineOptions"
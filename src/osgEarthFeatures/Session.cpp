@@ -40,7 +40,8 @@ osg::Referenced( true ),
 _map           ( map ),
 _mapInfo       ( map ),
 _featureSource ( source ),
-_dbOptions     ( dbOptions )
+_dbOptions     ( dbOptions ),
+_resolvedStyles( true, 256 )
 {
     if ( styles )
         setStyles( styles );
@@ -84,6 +85,7 @@ void
 Session::setStyles( StyleSheet* value )
 {
     _styles = value ? value : new StyleSheet();
+    _resolvedStyles.clear();
 
     // Go ahead and create the script engine for the StyleSheet
     if (_styles && _styles->script())
@@ -92,6 +94,44 @@ Session::setStyles( StyleSheet* value )
       _styleScriptEngine = 0L;
 }
 
+bool
+Session::resolveStyle( const std::string& styleString, const URIContext& uriContext, Style& out_style )
+{
+    bool inlineStyle = styleString.length() > 0 && styleString.at(0) == '{';
+
+    // inline styles resolve relative paths against their own context.
+    std::string key = inlineStyle ? uriContext.referrer() + "\n" + styleString : styleString;
+
+    LRUCache<std::string, Style>::Record record;
+    if ( !_resolvedStyles.get(key, record) )
+    {
+        Style style;
+        if ( inlineStyle )
+        {
+            Config conf( "style", styleString );
+            conf.setReferrer( uriContext.referrer() );
+            conf.set( "type", "text/css" );
+            style = Style(conf);
+        }
+        else if ( _styles.valid() )
+        {
+            const Style* named = _styles->getStyle( styleString, false );
+            if ( named )
+                style = *named;
+        }
+
+        // cache misses too, so unknown names don't keep searching the sheet.
+        _resolvedStyles.insert( key, style );
+        out_style = style;
+    }
+    else
+    {
+        out_style = record.value();
+    }
+
+    return !out_style.empty();
+}
+
 ScriptEngine*
 Session::getScriptEngine() const
 {
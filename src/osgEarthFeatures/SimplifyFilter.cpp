@@ -0,0 +1,215 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/SimplifyFilter>
+#include <vector>
+
+#define LC "[SimplifyFilter] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+OSGEARTH_REGISTER_SIMPLE_FEATUREFILTER(simplify, SimplifyFilter );
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // squared distance from p to the segment a-b, in the XY plane.
+    double distance2( const osg::Vec3d& p, const osg::Vec3d& a, const osg::Vec3d& b )
+    {
+        double dx = b.x() - a.x(), dy = b.y() - a.y();
+        double len2 = dx*dx + dy*dy;
+        double t = len2 > 0.0 ? ((p.x()-a.x())*dx + (p.y()-a.y())*dy) / len2 : 0.0;
+        t = osg::clampBetween( t, 0.0, 1.0 );
+        double ex = a.x() + t*dx - p.x(), ey = a.y() + t*dy - p.y();
+        return ex*ex + ey*ey;
+    }
+
+    // marks the points between "first" and "last" that the simplified line must keep.
+    // Uses an explicit stack so that long coastlines don't exhaust the call stack.
+    void douglasPeucker(const std::vector<osg::Vec3d>& points,
+                        unsigned                        first,
+                        unsigned                        last,
+                        double                          tolerance2,
+                        std::vector<bool>&              keep )
+    {
+        std::vector< std::pair<unsigned,unsigned> > spans;
+        spans.push_back( std::make_pair(first, last) );
+
+        while( !spans.empty() )
+        {
+            unsigned a = spans.back().first;
+            unsigned b = spans.back().second;
+            spans.pop_back();
+
+            double   maxDist = 0.0;
+            unsigned index   = a;
+            for( unsigned i = a+1; i < b; ++i )
+            {
+                double d = distance2( points[i], points[a], points[b] );
+                if ( d > maxDist )
+                {
+                    maxDist = d;
+                    index   = i;
+                }
+            }
+
+            if ( maxDist > tolerance2 )
+            {
+                keep[index] = true;
+                spans.push_back( std::make_pair(a, index) );
+                spans.push_back( std::make_pair(index, b) );
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+void
+SimplifyFilter::simplify( Geometry* geom, double tolerance )
+{
+    if ( !geom || tolerance <= 0.0 )
+        return;
+
+    double tolerance2 = tolerance * tolerance;
+
+    GeometryIterator i( geom, true );
+    while( i.hasMore() )
+    {
+        Geometry* part = i.next();
+
+        bool closed =
+            part->getType() == Geometry::TYPE_RING ||
+            part->getType() == Geometry::TYPE_POLYGON;
+
+        if ( !closed && part->getType() != Geometry::TYPE_LINESTRING )
+            continue;
+
+        unsigned minPoints = closed ? 3 : 2;
+        if ( part->size() <= minPoints )
+            continue;
+
+        // rings get their first point repeated at the end, so that the closing
+        // segment takes part in the simplification.
+        std::vector<osg::Vec3d> points( part->begin(), part->end() );
+        bool repeated = points.front() == points.back();
+        if ( closed && !repeated )
+            points.push_back( points.front() );
+
+        unsigned last = points.size() - 1;
+        std::vector<bool> keep( points.size(), false );
+        keep[0] = keep[last] = true;
+
+        if ( closed )
+        {
+            // both ends of a ring are the same point, so split it at the point
+            // farthest from the start and simplify the two halves.
+            unsigned farthest = 0;
+            double   maxDist  = 0.0;
+            for( unsigned k = 1; k < last; ++k )
+            {
+                double dx = points[k].x() - points[0].x(), dy = points[k].y() - points[0].y();
+                double d  = dx*dx + dy*dy;
+                if ( d > maxDist )
+                {
+                    maxDist  = d;
+                    farthest = k;
+                }
+            }
+            if ( farthest == 0 )
+                continue;
+
+            keep[farthest] = true;
+            douglasPeucker( points, 0, farthest, tolerance2, keep );
+            douglasPeucker( points, farthest, last, tolerance2, keep );
+        }
+        else
+        {
+            douglasPeucker( points, 0, last, tolerance2, keep );
+        }
+
+        Vec3dVector simplified;
+        simplified.reserve( points.size() );
+        for( unsigned k = 0; k <= last; ++k )
+        {
+            if ( keep[k] )
+                simplified.push_back( points[k] );
+        }
+
+        // for rings, the repeated start point doesn't count.
+        unsigned numPoints = closed ? simplified.size()-1 : simplified.size();
+        if ( closed && !repeated )
+            simplified.pop_back();
+
+        if ( numPoints >= minPoints && simplified.size() < part->size() )
+        {
+            part->clear();
+            part->insert( part->begin(), simplified.begin(), simplified.end() );
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+SimplifyFilter::SimplifyFilter() :
+_tolerance( 0.0 )
+{
+    //NOP
+}
+
+SimplifyFilter::SimplifyFilter( double tolerance ) :
+_tolerance( tolerance )
+{
+    //NOP
+}
+
+SimplifyFilter::SimplifyFilter( const Config& conf ) :
+_tolerance( 0.0 )
+{
+    if ( conf.key() == "simplify" )
+    {
+        conf.getIfSet( "tolerance", _tolerance );
+    }
+}
+
+Config
+SimplifyFilter::getConfig() const
+{
+    Config config( "simplify" );
+    config.addIfSet( "tolerance", _tolerance );
+    return config;
+}
+
+FilterContext
+SimplifyFilter::push( FeatureList& input, FilterContext& context )
+{
+    if ( _tolerance.value() <= 0.0 )
+        return context;
+
+    for( FeatureList::iterator i = input.begin(); i != input.end(); ++i )
+    {
+        Feature* feature = i->get();
+        if ( feature && feature->getGeometry() )
+            simplify( feature->getGeometry(), _tolerance.value() );
+    }
+
+    return context;
+}
@@ -65,6 +65,14 @@ namespace
             traverse(node, nv);
         }
     };
+
+    // transforms and colors of the instances of one model, for texture instancing
+    struct ModelInstances
+    {
+        std::vector<osg::Matrixd> _matrices;
+        std::vector<osg::Vec4f>   _colors;
+    };
+    typedef std::map< osg::ref_ptr<osg::Node>, ModelInstances > ModelInstanceMap;
 }
 
 //------------------------------------------------------------------------
@@ -73,6 +81,7 @@ SubstituteModelFilter::SubstituteModelFilter( const Style& style ) :
 _style                ( style ),
 _cluster              ( false ),
 _useDrawInstanced     ( false ),
+_useInstanceTexture   ( false ),
 _merge                ( true ),
 _normalScalingRequired( false ),
 _instanceCache        ( false )     // cache per object so MT not required
@@ -149,6 +158,19 @@ SubstituteModelFilter::process(const FeatureList&           features,
     if ( modelSymbol )
         headingEx = *modelSymbol->heading();
 
+    // texture instancing collects the instances of each model instead of
+    // making a transform for each one.
+    bool useInstanceTexture =
+        _useDrawInstanced && _useInstanceTexture && modelSymbol != 0L &&
+        Registry::capabilities().supportsDrawInstanced();
+
+    ModelInstanceMap instances;
+
+    StringExpression colorEx;
+    bool useColor = useInstanceTexture && modelSymbol->color().isSet();
+    if ( useColor )
+        colorEx = *modelSymbol->color();
+
     for( FeatureList::const_iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -184,6 +206,12 @@ SubstituteModelFilter::process(const FeatureList&           features,
             rotationMatrix.makeRotate( osg::Quat(osg::DegreesToRadians(heading), osg::Vec3(0,0,1)) );
         }
 
+        osg::Vec4f color(1,1,1,1);
+        if ( useColor )
+        {
+            color = Color( input->eval(colorEx, &context) );
+        }
+
         // how that we have a marker source, create a node for it
         std::pair<URI,float> key( instanceURI, scale );
 
@@ -260,6 +288,15 @@ SubstituteModelFilter::process(const FeatureList&           features,
                         mat = rotationMatrix * scaleMatrix *  osg::Matrixd::translate( point ) * _world2local;
                     }
 
+                    if ( useInstanceTexture )
+                    {
+                        ModelInstances& mi = instances[model.get()];
+                        mi._matrices.push_back( mat );
+                        if ( useColor )
+                            mi._colors.push_back( color );
+                        continue;
+                    }
+
                     osg::MatrixTransform* xform = new osg::MatrixTransform();
                     xform->setMatrix( mat );
                     xform->setDataVariance( osg::Object::STATIC );
@@ -283,6 +320,15 @@ SubstituteModelFilter::process(const FeatureList&           features,
         }
     }
 
+    // one instanced node per model:
+    for( ModelInstanceMap::iterator i = instances.begin(); i != instances.end(); ++i )
+    {
+        osg::Node* node = DrawInstanced::createTextureInstancedNode(
+            i->first.get(), i->second._matrices, i->second._colors );
+        if ( node )
+            attachPoint->addChild( node );
+    }
+
     if ( iconSymbol )
     {
         // activate decluttering for icons if requested
@@ -299,7 +345,11 @@ SubstituteModelFilter::process(const FeatureList&           features,
     }
 
     // active DrawInstanced if required:
-    if ( _useDrawInstanced && Registry::capabilities().supportsDrawInstanced() )
+    if ( useInstanceTexture )
+    {
+        DrawInstanced::installTextureInstancing( attachPoint->getOrCreateStateSet() );
+    }
+    else if ( _useDrawInstanced && Registry::capabilities().supportsDrawInstanced() )
     {
         DrawInstanced::convertGraphToUseDrawInstanced( attachPoint );
 
@@ -164,11 +164,62 @@ TransformFilter::push( FeatureList& input, FilterContext& incx )
 {
     _bbox = osg::BoundingBoxd();
 
-    // first transform all the points into the output SRS, collecting a bounding box as we go:
-    bool ok = true;
-    for( FeatureList::iterator i = input.begin(); i != input.end(); i++ )
-        if ( !push( i->get(), incx ) )
-            ok = false;
+    const SpatialReference* inputSRS = incx.profile()->getSRS();
+
+    bool needsSRSXform =
+        _outputSRS.valid() &&
+        ( ! inputSRS->isEquivalentTo( _outputSRS.get() ) );
+
+    bool needsMatrixXform = !_mat.isIdentity();
+
+    // first transform all the points into the output SRS, collecting a bounding box as we go.
+    // The points of every feature go into one array, so the SRS transformation runs
+    // once for the whole set instead of once per part.
+    if ( needsSRSXform || needsMatrixXform || _localize )
+    {
+        std::vector<Geometry*>  parts;
+        std::vector<osg::Vec3d> points;
+
+        for( FeatureList::iterator i = input.begin(); i != input.end(); i++ )
+        {
+            Feature* feature = i->get();
+            if ( !feature || !feature->getGeometry() )
+                continue;
+
+            GeometryIterator iter( feature->getGeometry() );
+            while( iter.hasMore() )
+            {
+                Geometry* geom = iter.next();
+                parts.push_back( geom );
+                points.insert( points.end(), geom->begin(), geom->end() );
+            }
+        }
+
+        // pre-transform the points before doing an SRS transformation.
+        if ( needsMatrixXform )
+        {
+            for( unsigned i=0; i < points.size(); ++i )
+                points[i] = points[i] * _mat;
+        }
+
+        if ( needsSRSXform && points.size() > 0 )
+        {
+            inputSRS->transform( points, _outputSRS.get() );
+        }
+
+        // copy the results back into the geometry, updating the bounding box.
+        std::vector<osg::Vec3d>::const_iterator p = points.begin();
+        for( std::vector<Geometry*>::iterator i = parts.begin(); i != parts.end(); ++i )
+        {
+            Geometry* geom = *i;
+            for( unsigned k=0; k < geom->size(); ++k, ++p )
+            {
+                (*geom)[k] = *p;
+                if ( _localize )
+                    _bbox.expandBy( *p );
+            }
+        }
+    }
 
     FilterContext outcx( incx );
 
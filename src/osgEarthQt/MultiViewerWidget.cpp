@@ -33,7 +33,8 @@ using namespace osgEarth;
 using namespace osgEarth::QtGui;
 
 
-MultiViewerWidget::MultiViewerWidget(osg::Node* scene)
+MultiViewerWidget::MultiViewerWidget(osg::Node* scene) :
+_shareContexts( true )
 {
   initialize();
 
@@ -44,10 +45,16 @@ MultiViewerWidget::MultiViewerWidget(osg::Node* scene)
 void MultiViewerWidget::initialize()
 {
   setThreadingModel(osgViewer::Viewer::SingleThreaded);
+
+  // one pager for all views; see createViewWidget.
+  _pager = osgDB::DatabasePager::create();
 }
 
 osgViewer::View* MultiViewerWidget::createViewWidget(osg::Node* scene, osgViewer::View* shared)
 {
+  if (!shared && _shareContexts && getNumViews() > 0)
+    shared = getView(0);
+
   osgViewer::View* view = new osgViewer::View();
   view->setCamera(createCamera(0, 0, 100, 100, (shared ? shared->getCamera()->getGraphicsContext() : 0L)));
   view->setCameraManipulator(new osgEarth::Util::EarthManipulator());
@@ -59,8 +66,19 @@ osgViewer::View* MultiViewerWidget::createViewWidget(osg::Node* scene, osgViewer
   if (scene)
     view->setSceneData(scene);
 
+  // The pager belongs to the view's osgViewer::Scene, which is shared by
+  // views with the same scene root; views with different roots would each
+  // get their own pager, and request and compile the same tiles separately.
+  // (Calling setSceneData on the view later replaces it.)
+  view->setDatabasePager(_pager.get());
+
   addView(view);
 
+  // a view added after realize() still compiles through the viewer's
+  // incremental compile operation.
+  if (getIncrementalCompileOperation())
+    _pager->setIncrementalCompileOperation(getIncrementalCompileOperation());
+
   layoutWidgets();
 
   return view;
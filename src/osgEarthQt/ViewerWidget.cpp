@@ -20,6 +20,8 @@
 
 #include <osgEarthUtil/EarthManipulator>
 
+#include <osg/Timer>
+#include <osgDB/DatabasePager>
 #include <osgGA/StateSetManipulator>
 #include <osgQt/GraphicsWindowQt>
 #include <osgViewer/Viewer>
@@ -33,7 +35,12 @@ using namespace osgEarth;
 using namespace osgEarth::QtGui;
 
 
-ViewerWidget::ViewerWidget(osg::Node* scene)
+ViewerWidget::ViewerWidget(osg::Node* scene) :
+_minInterval    ( 20 ),
+_maxIdleInterval( 100 ),
+_frameCost      ( 0.0 ),
+_redrawRequested( true ),
+_cameraMoved    ( false )
 {
     // create a new viewer (a simple osgViewer::Viewer)
     createViewer();
@@ -49,7 +56,12 @@ ViewerWidget::ViewerWidget(osg::Node* scene)
 }
 
 ViewerWidget::ViewerWidget(osgViewer::ViewerBase* viewer) :
-_viewer( viewer )
+_minInterval    ( 20 ),
+_maxIdleInterval( 100 ),
+_frameCost      ( 0.0 ),
+_redrawRequested( true ),
+_cameraMoved    ( false ),
+_viewer         ( viewer )
 {
     if ( !_viewer.valid() )
     {
@@ -92,9 +104,48 @@ ViewerWidget::~ViewerWidget()
 void
 ViewerWidget::setTimerInterval(int milliseconds)
 {
-    if ( _timer.interval() != milliseconds )
+    _minInterval = osg::maximum( milliseconds, 0 );
+    if ( _timer.interval() != _minInterval )
     {
-        _timer.start( milliseconds );
+        _timer.start( _minInterval );
+    }
+}
+
+
+void
+ViewerWidget::setOnDemand(bool value)
+{
+    if ( _viewer.valid() )
+    {
+        _viewer->setRunFrameScheme( value ? osgViewer::ViewerBase::ON_DEMAND : osgViewer::ViewerBase::CONTINUOUS );
+        requestRedraw();
+    }
+}
+
+
+bool
+ViewerWidget::getOnDemand() const
+{
+    return _viewer.valid() && _viewer->getRunFrameScheme() == osgViewer::ViewerBase::ON_DEMAND;
+}
+
+
+void
+ViewerWidget::setMaxIdleInterval(int milliseconds)
+{
+    _maxIdleInterval = osg::maximum( milliseconds, _minInterval );
+}
+
+
+void
+ViewerWidget::requestRedraw()
+{
+    _redrawRequested = true;
+
+    // don't wait out an idle interval.
+    if ( _timer.interval() > _minInterval )
+    {
+        _timer.start( _minInterval );
     }
 }
 
@@ -102,8 +153,71 @@ ViewerWidget::setTimerInterval(int milliseconds)
 void ViewerWidget::installFrameTimer()
 {    
     // start the frame timer.
-    connect(&_timer, SIGNAL(timeout()), this, SLOT(update()));
-    _timer.start(20);
+    connect(&_timer, SIGNAL(timeout()), this, SLOT(onTimer()));
+    _timer.start(_minInterval);
+}
+
+
+void ViewerWidget::onTimer()
+{
+    if ( !_viewer.valid() )
+        return;
+
+    if ( !getOnDemand() )
+    {
+        if ( _timer.interval() != _minInterval )
+            _timer.setInterval( _minInterval );
+        update();
+    }
+
+    else if ( checkNeedToDoFrame() )
+    {
+        // pace frames to what they actually cost, so we don't queue up
+        // paint events faster than the viewer can draw them.
+        int interval = osg::maximum( _minInterval, (int)(_frameCost + 0.5) );
+        if ( _timer.interval() != interval )
+            _timer.setInterval( interval );
+        update();
+    }
+
+    else
+    {
+        // idle: back off the polling rate.
+        int interval = osg::minimum( osg::maximum(_timer.interval(), 1) * 2, _maxIdleInterval );
+        if ( _timer.interval() != interval )
+            _timer.setInterval( interval );
+    }
+}
+
+
+bool ViewerWidget::checkNeedToDoFrame()
+{
+    if ( _redrawRequested || _cameraMoved )
+        return true;
+
+    // pending input:
+    if ( _gc.valid() && _gc->getEventQueue() && !_gc->getEventQueue()->empty() )
+        return true;
+
+    // (The viewer's own checkNeedToDoFrame() is no help here, since it
+    // answers true whenever the scene has update callbacks, which an
+    // osgEarth scene always does.)
+    osgViewer::ViewerBase::Views views;
+    getViews( views );
+    for( osgViewer::ViewerBase::Views::iterator v = views.begin(); v != views.end(); ++v )
+    {
+        osgViewer::View* view = *v;
+
+        if ( view->getEventQueue() && !view->getEventQueue()->empty() )
+            return true;
+
+        // paging in progress, or loaded data waiting to merge:
+        osgDB::DatabasePager* pager = view->getDatabasePager();
+        if ( pager && (pager->requiresUpdateSceneGraph() || pager->getFileRequestListSize() > 0) )
+            return true;
+    }
+
+    return false;
 }
 
 
@@ -167,9 +281,55 @@ void ViewerWidget::reconfigure( osgViewer::View* view )
       
 void ViewerWidget::paintEvent(QPaintEvent* e)
 {
-    if (_viewer->getRunFrameScheme() == osgViewer::ViewerBase::CONTINUOUS || 
-        _viewer->checkNeedToDoFrame() )
+    if ( !_viewer.valid() )
+        return;
+
+    // Paint events come from the frame timer (which already decided that a
+    // frame is due) or from Qt itself (expose, resize), so always draw.
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    _viewer->frame();
+    _frameCost = osg::Timer::instance()->delta_m( start, osg::Timer::instance()->tick() );
+
+    _redrawRequested = false;
+
+    // note camera motion, so that manipulator animations keep drawing.
+    osgViewer::ViewerBase::Views views;
+    getViews( views );
+    _cameraMoved = views.size() != _viewMatrices.size();
+    _viewMatrices.resize( views.size() );
+    for( unsigned i = 0; i < views.size(); ++i )
+    {
+        const osg::Matrixd& vm = views[i]->getCamera()->getViewMatrix();
+        if ( vm != _viewMatrices[i] )
+        {
+            _viewMatrices[i] = vm;
+            _cameraMoved = true;
+        }
+    }
+}
+
+
+bool ViewerWidget::event(QEvent* e)
+{
+    bool handled = osgQt::GLWidget::event( e );
+
+    // wake an idle on-demand widget as soon as the user does something.
+    switch( e->type() )
     {
-        _viewer->frame();
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::MouseMove:
+    case QEvent::Wheel:
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease:
+    case QEvent::Resize:
+        if ( getOnDemand() )
+            requestRedraw();
+        break;
+    default:
+        break;
     }
+
+    return handled;
 }
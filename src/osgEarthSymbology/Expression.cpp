@@ -19,6 +19,7 @@
 #include <osgEarthSymbology/Expression>
 #include <osgEarth/StringUtils>
 #include <algorithm>
+#include <map>
 
 using namespace osgEarth;
 using namespace osgEarth::Symbology;
@@ -343,6 +344,143 @@ NumericExpression::eval() const
     return !osg::isNaN( _value ) ? _value : 0.0;
 }
 
+void
+NumericExpression::compile( Program& out ) const
+{
+    out._code.clear();
+    out._maxDepth = 0;
+    out._numVars  = _vars.size();
+
+    // which variable each VARIABLE atom stands for:
+    std::map<unsigned, unsigned> varAtoms;
+    for( unsigned v = 0; v < _vars.size(); ++v )
+        varAtoms[_vars[v].second] = v;
+
+    // simulate the evaluation stack. "constant" tracks which slots hold a
+    // fixed value; a constant slot is always the result of a single PUSH,
+    // so an operator on two constants folds into one PUSH.
+    std::vector<bool> constant;
+
+    for( unsigned i = 0; i < _rpn.size(); ++i )
+    {
+        const Atom& a = _rpn[i];
+        Program::Instruction instr;
+        instr._value = 0.0;
+        instr._var   = 0;
+
+        if ( a.first == OPERAND || a.first == VARIABLE )
+        {
+            std::map<unsigned, unsigned>::const_iterator v = varAtoms.find( i );
+            if ( a.first == VARIABLE && v != varAtoms.end() )
+            {
+                instr._code = Program::LOAD;
+                instr._var  = v->second;
+                constant.push_back( false );
+            }
+            else
+            {
+                instr._code  = Program::PUSH;
+                instr._value = a.second;
+                constant.push_back( true );
+            }
+            out._code.push_back( instr );
+            out._maxDepth = std::max( out._maxDepth, (unsigned)constant.size() );
+            continue;
+        }
+
+        instr._code =
+            a.first == ADD  ? Program::ADD :
+            a.first == SUB  ? Program::SUB :
+            a.first == MULT ? Program::MULT :
+            a.first == DIV  ? Program::DIV :
+            a.first == MOD  ? Program::MOD :
+            a.first == MIN  ? Program::MIN :
+                              Program::MAX;
+
+        // eval() ignores an operator that lacks operands; so do we.
+        if ( constant.size() < 2 )
+            continue;
+
+        bool foldable = constant[constant.size()-1] && constant[constant.size()-2];
+        constant.pop_back();
+
+        if ( foldable )
+        {
+            double op2 = out._code.back()._value; out._code.pop_back();
+            double op1 = out._code.back()._value;
+            out._code.back()._value = Program::apply( instr._code, op1, op2 );
+        }
+        else
+        {
+            constant.back() = false;
+            out._code.push_back( instr );
+        }
+    }
+}
+
+double
+NumericExpression::Program::apply( Code code, double op1, double op2 )
+{
+    switch( code )
+    {
+    case ADD:  return op1 + op2;
+    case SUB:  return op1 - op2;
+    case MULT: return op1 * op2;
+    case DIV:  return op1 / op2;
+    case MOD:  return fmod(op1, op2);
+    case MIN:  return std::min(op1, op2);
+    case MAX:  return std::max(op1, op2);
+    default:   return 0.0;
+    }
+}
+
+bool
+NumericExpression::Program::isConstant() const
+{
+    for( unsigned i = 0; i < _code.size(); ++i )
+    {
+        if ( _code[i]._code == LOAD )
+            return false;
+    }
+    return true;
+}
+
+double
+NumericExpression::Program::run( const double* values ) const
+{
+    // most expressions are shallow; avoid the heap for those.
+    double              local[16];
+    std::vector<double> heap;
+    double*             s = local;
+    if ( _maxDepth > 16 )
+    {
+        heap.resize( _maxDepth );
+        s = &heap[0];
+    }
+
+    unsigned top = 0;
+    for( unsigned i = 0; i < _code.size(); ++i )
+    {
+        const Instruction& instr = _code[i];
+        if ( instr._code == PUSH )
+        {
+            s[top++] = instr._value;
+        }
+        else if ( instr._code == LOAD )
+        {
+            s[top++] = values[instr._var];
+        }
+        else
+        {
+            double op2 = s[--top];
+            s[top-1] = apply( instr._code, s[top-1], op2 );
+        }
+    }
+
+    double value = top > 0 ? s[top-1] : 0.0;
+    return !osg::isNaN( value ) ? value : 0.0;
+}
+
 //------------------------------------------------------------------------
 
 StringExpression::StringExpression( const std::string& expr ) : 
@@ -383,6 +521,9 @@ StringExpression::setInfix( const std::string& expr )
 void
 StringExpression::setLiteral( const std::string& expr )
 {
+    _infix.clear();
+    _vars.clear();
+    _infix.push_back( Atom(OPERAND, expr) );
     _src = "\"" + expr + "\"";
     _value = expr;
     _dirty = false;
@@ -413,6 +554,9 @@ StringExpression::getConfig() const
 void
 StringExpression::init()
 {
+    _infix.clear();
+    _vars.clear();
+
     bool inQuotes = false;
     int inVar = 0;
     int startPos = 0;
@@ -533,3 +677,62 @@ StringExpression::eval() const
 
     return _value;
 }
+
+void
+StringExpression::compile( Program& out ) const
+{
+    out._parts.clear();
+    out._numVars = _vars.size();
+
+    // which variable each VARIABLE atom stands for:
+    std::map<unsigned, unsigned> varAtoms;
+    for( unsigned v = 0; v < _vars.size(); ++v )
+        varAtoms[_vars[v].second] = v;
+
+    for( unsigned i = 0; i < _infix.size(); ++i )
+    {
+        std::map<unsigned, unsigned>::const_iterator v = varAtoms.find( i );
+        if ( _infix[i].first == VARIABLE && v != varAtoms.end() )
+        {
+            Program::Part part;
+            part._var = v->second;
+            out._parts.push_back( part );
+        }
+        else if ( !out._parts.empty() && out._parts.back()._var < 0 )
+        {
+            out._parts.back()._literal += _infix[i].second;
+        }
+        else
+        {
+            Program::Part part;
+            part._literal = _infix[i].second;
+            part._var     = -1;
+            out._parts.push_back( part );
+        }
+    }
+}
+
+bool
+StringExpression::Program::isConstant() const
+{
+    for( unsigned i = 0; i < _parts.size(); ++i )
+    {
+        if ( _parts[i]._var >= 0 )
+            return false;
+    }
+    return true;
+}
+
+std::string
+StringExpression::Program::run( const std::string* values ) const
+{
+    if ( _parts.size() == 1 )
+        return _parts[0]._var < 0 ? _parts[0]._literal : values[_parts[0]._var];
+
+    std::string result;
+    for( unsigned i = 0; i < _parts.size(); ++i )
+    {
+        result += _parts[i]._var < 0 ? _parts[i]._literal : values[_parts[i]._var];
+    }
+    return result;
+}
@@ -38,7 +38,8 @@ using namespace geos::operation;
 
 
 Geometry::Geometry( const Geometry& rhs ) :
-osgEarth::MixinVector<osg::Vec3d,osg::Referenced>( rhs )
+osgEarth::MixinVector<osg::Vec3d,osg::Referenced>( rhs ),
+_packed( rhs._packed )
 {
     //nop
 }
@@ -58,12 +59,15 @@ Geometry::Geometry( const Vec3dVector* data )
 int
 Geometry::getTotalPointCount() const
 {
-    return size();
+    return _packed.valid() ? (int)_packed->_offsets.size() : (int)size();
 }
 
 Bounds
 Geometry::getBounds() const
 {
+    if ( _packed.valid() )
+        return _packed->_bounds;
+
     Bounds bounds;
     for( const_iterator i = begin(); i != end(); ++i )
         bounds.expandBy( i->x(), i->y(), i->z() );
@@ -75,22 +79,29 @@ Geometry::cloneAs( const Geometry::Type& newType ) const
 {
     //if ( newType == getType() )        
     //    return static_cast<Geometry*>( clone() );
+
+    Vec3dVector temp;
+    const Vec3dVector* points = getPoints( temp );
     
     switch( newType )
     {
     case TYPE_POINTSET:
-        return new PointSet( &this->asVector() );
+        return new PointSet( points );
     case TYPE_LINESTRING:
-        return new LineString( &this->asVector() );
+        return new LineString( points );
     case TYPE_RING:
-        return new Ring( &this->asVector() );
+        return new Ring( points );
     case TYPE_POLYGON:
         if ( dynamic_cast<const Polygon*>(this) )
-            return new Polygon( *static_cast<const Polygon*>(this) );
+        {
+            Polygon* poly = new Polygon( *static_cast<const Polygon*>(this) );
+            poly->unpack();
+            return poly;
+        }
         else
-            return new Polygon( &this->asVector() );
+            return new Polygon( points );
     case TYPE_UNKNOWN:
-        return new Geometry( &this->asVector() );
+        return new Geometry( points );
     default:
         break;
     }
@@ -352,6 +363,56 @@ Geometry::delocalize( const osg::Vec3d& offset )
     }
 }
 
+bool
+Geometry::pack( double maxError )
+{
+    if ( _packed.valid() || empty() )
+        return true;
+
+    osg::ref_ptr<Packed> packed = new Packed();
+    packed->_bounds = getBounds();
+    packed->_origin = packed->_bounds.center();
+    packed->_offsets.reserve( size() );
+
+    for( const_iterator i = begin(); i != end(); ++i )
+    {
+        osg::Vec3f offset( *i - packed->_origin );
+        if ( (packed->_origin + osg::Vec3d(offset) - *i).length() > maxError )
+            return false;
+        packed->_offsets.push_back( offset );
+    }
+
+    _packed = packed.get();
+
+    // release the double-precision storage, not just its contents.
+    Vec3dVector().swap( asVector() );
+    return true;
+}
+
+void
+Geometry::unpack()
+{
+    if ( !_packed.valid() )
+        return;
+
+    Vec3dVector points;
+    getPoints( points );
+    asVector().swap( points );
+    _packed = 0L;
+}
+
+const Vec3dVector*
+Geometry::getPoints( Vec3dVector& temp ) const
+{
+    if ( !_packed.valid() )
+        return &asVector();
+
+    temp.reserve( _packed->_offsets.size() );
+    for( std::vector<osg::Vec3f>::const_iterator i = _packed->_offsets.begin(); i != _packed->_offsets.end(); ++i )
+        temp.push_back( _packed->_origin + osg::Vec3d(*i) );
+    return &temp;
+}
+
 void 
 Geometry::rewind( Orientation orientation )
 {
@@ -483,9 +544,10 @@ Ring::cloneAs( const Geometry::Type& newType ) const
 {
     if ( newType == TYPE_LINESTRING )
     {
-        LineString* line = new LineString( &this->asVector() );
+        Vec3dVector temp;
+        LineString* line = new LineString( getPoints(temp) );
         if ( line->size() > 1 && line->front() != line->back() )
-            line->push_back( front() );
+            line->push_back( line->front() );
         return line;
     }
     else return Geometry::cloneAs( newType );
@@ -592,6 +654,31 @@ Polygon::open()
         (*i)->open();
 }
 
+bool
+Polygon::pack( double maxError )
+{
+    if ( !Ring::pack(maxError) )
+        return false;
+
+    for( RingCollection::const_iterator i = _holes.begin(); i != _holes.end(); ++i )
+    {
+        if ( !(*i)->pack(maxError) )
+        {
+            unpack();
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+Polygon::unpack()
+{
+    Ring::unpack();
+    for( RingCollection::const_iterator i = _holes.begin(); i != _holes.end(); ++i )
+        (*i)->unpack();
+}
+
 //----------------------------------------------------------------------------
 
 MultiGeometry::MultiGeometry( const MultiGeometry& rhs ) :
@@ -680,6 +767,27 @@ MultiGeometry::rewind( Orientation orientation )
     }
 }
 
+bool
+MultiGeometry::pack( double maxError )
+{
+    for( GeometryCollection::const_iterator i = _parts.begin(); i != _parts.end(); ++i )
+    {
+        if ( !i->get()->pack(maxError) )
+        {
+            unpack();
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+MultiGeometry::unpack()
+{
+    for( GeometryCollection::const_iterator i = _parts.begin(); i != _parts.end(); ++i )
+        i->get()->unpack();
+}
+
 //----------------------------------------------------------------------------
 
 GeometryIterator::GeometryIterator( Geometry* geom, bool holes ) :
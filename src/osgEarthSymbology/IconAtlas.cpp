@@ -0,0 +1,175 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthSymbology/IconAtlas>
+#include <osgEarth/ImageUtils>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+#define LC "[IconAtlas] "
+
+// empty pixels between packed icons, to keep filtering from bleeding them together
+#define GUTTER 2
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+
+//---------------------------------------------------------------------------
+
+IconAtlas*
+IconAtlas::instance()
+{
+    static osg::ref_ptr<IconAtlas> s_atlas;
+    static Threading::Mutex        s_atlasMutex;
+
+    if ( !s_atlas.valid() )
+    {
+        Threading::ScopedMutexLock lock( s_atlasMutex );
+        if ( !s_atlas.valid() ) // double-check
+            s_atlas = new IconAtlas();
+    }
+    return s_atlas.get();
+}
+
+IconAtlas::IconAtlas() :
+_enabled    ( true ),
+_pageSize   ( 1024 ),
+_maxIconSize( 256 )
+{
+    //nop
+}
+
+unsigned
+IconAtlas::getNumPages() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _pages.size();
+}
+
+IconAtlas::Page*
+IconAtlas::allocate( int width, int height, int& out_x, int& out_y )
+{
+    int w = width + GUTTER, h = height + GUTTER;
+
+    // try the current shelf of the last page, then a new shelf, then a new page.
+    if ( !_pages.empty() )
+    {
+        Page& page = _pages.back();
+        int size = page._image->s();
+
+        if ( page._cursorX + w > size )
+        {
+            page._shelfY     += page._shelfHeight;
+            page._shelfHeight = 0;
+            page._cursorX     = 0;
+        }
+
+        if ( page._shelfY + h <= size && page._cursorX + w <= size )
+        {
+            out_x = page._cursorX;
+            out_y = page._shelfY;
+            page._cursorX    += w;
+            page._shelfHeight = osg::maximum( page._shelfHeight, h );
+            return &page;
+        }
+    }
+
+    Page page;
+    page._image = new osg::Image();
+    page._image->allocateImage( _pageSize, _pageSize, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+    page._image->setInternalTextureFormat( GL_RGBA8 );
+    ::memset( page._image->data(), 0, page._image->getTotalSizeInBytes() );
+
+    // no mipmaps: they would blend neighboring icons together.
+    page._texture = new osg::Texture2D( page._image.get() );
+    page._texture->setFilter( osg::Texture::MIN_FILTER, osg::Texture::LINEAR );
+    page._texture->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
+    page._texture->setWrap  ( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
+    page._texture->setWrap  ( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE );
+    page._texture->setResizeNonPowerOfTwoHint( false );
+    page._texture->setUnRefImageDataAfterApply( false );
+
+    page._stateSet = new osg::StateSet();
+    page._stateSet->setTextureAttributeAndModes( 0, page._texture.get(), osg::StateAttribute::ON );
+    page._stateSet->setMode( GL_CULL_FACE, osg::StateAttribute::OFF );
+    page._stateSet->setMode( GL_LIGHTING, osg::StateAttribute::OFF );
+
+    page._shelfY      = 0;
+    page._shelfHeight = h;
+    page._cursorX     = w;
+    _pages.push_back( page );
+
+    OE_DEBUG << LC << "Allocated atlas page " << _pages.size() << std::endl;
+
+    out_x = 0;
+    out_y = 0;
+    return &_pages.back();
+}
+
+bool
+IconAtlas::getOrAdd( const osg::Image* image, Entry& out_entry )
+{
+    if ( !_enabled || !image || image->s() < 1 || image->t() < 1 || image->r() != 1 )
+        return false;
+
+    if ( (unsigned)image->s() > _maxIconSize || (unsigned)image->t() > _maxIconSize ||
+         (unsigned)image->s() + GUTTER > _pageSize || (unsigned)image->t() + GUTTER > _pageSize )
+        return false;
+
+    std::string key = image->getFileName();
+    if ( key.empty() )
+    {
+        std::stringstream buf;
+        buf << "image:" << image;
+        key = buf.str();
+    }
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    std::map<std::string, Record>::const_iterator i = _records.find( key );
+    if ( i != _records.end() )
+    {
+        out_entry = i->second._entry;
+        return true;
+    }
+
+    int x, y;
+    Page* page = allocate( image->s(), image->t(), x, y );
+    if ( !ImageUtils::copyAsSubImage(image, page->_image.get(), x, y) )
+        return false;
+    page->_image->dirty();
+
+    // sample half a texel in from the edges so the gutter never bleeds in.
+    float size = (float)page->_image->s();
+    Record& record = _records[key];
+    record._entry._stateSet = page->_stateSet.get();
+    record._entry._texture  = page->_texture.get();
+    record._entry._minUV.set( ((float)x + 0.5f)/size, ((float)y + 0.5f)/size );
+    record._entry._maxUV.set( ((float)(x + image->s()) - 0.5f)/size, ((float)(y + image->t()) - 0.5f)/size );
+
+    // rows were copied as-is, so flip the rectangle for top-down images.
+    if ( image->getOrigin() == osg::Image::TOP_LEFT )
+        std::swap( record._entry._minUV.y(), record._entry._maxUV.y() );
+
+    if ( image->getFileName().empty() )
+        record._image = image;
+
+    out_entry = record._entry;
+    return true;
+}
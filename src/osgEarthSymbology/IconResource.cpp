@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthSymbology/IconResource>
+#include <osgEarthSymbology/IconAtlas>
 #include <osgEarth/StringUtils>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Registry>
@@ -57,8 +58,20 @@ namespace
 
         bool flip = image->getOrigin()==osg::Image::TOP_LEFT;
 
+        // the icon atlas lets icons share one texture (and one StateSet).
+        IconAtlas::Entry atlas;
+        bool useAtlas = !useRect && IconAtlas::instance()->getOrAdd( image, atlas );
+
         osg::Vec2Array* texcoords = new osg::Vec2Array(4);
-        if ( useRect )
+        if ( useAtlas )
+        {
+            // the atlas takes care of the image orientation.
+            (*texcoords)[0].set(atlas._minUV.x(), atlas._minUV.y());
+            (*texcoords)[1].set(atlas._maxUV.x(), atlas._minUV.y());
+            (*texcoords)[2].set(atlas._maxUV.x(), atlas._maxUV.y());
+            (*texcoords)[3].set(atlas._minUV.x(), atlas._maxUV.y());
+        }
+        else if ( useRect )
         {
             (*texcoords)[0].set(0.0f,      flip ? height-1.0f : 0.0f);
             (*texcoords)[1].set(width-1.0f,flip ? height-1.0f : 0.0f);
@@ -81,35 +94,46 @@ namespace
 
         geometry->addPrimitiveSet( new osg::DrawArrays(GL_QUADS, 0, 4));
 
-        osg::StateSet* stateSet = geometry->getOrCreateStateSet();
+        osg::Geode* geode = new osg::Geode;
+        geode->addDrawable( geometry );
 
-        osg::Texture* texture;
+        osg::StateSet* stateSet;
 
-        if ( useRect )
+        if ( useAtlas )
         {
-            texture = new osg::TextureRectangle( image );
+            // the texture lives in the atlas page's shared state; the rest goes on the geode.
+            geometry->setStateSet( atlas._stateSet.get() );
+            stateSet = geode->getOrCreateStateSet();
         }
         else
         {
-            texture = new osg::Texture2D( image );
+            stateSet = geometry->getOrCreateStateSet();
+
+            osg::Texture* texture;
+
+            if ( useRect )
+            {
+                texture = new osg::TextureRectangle( image );
+            }
+            else
+            {
+                texture = new osg::Texture2D( image );
+            }
+
+            texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+            texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+            texture->setWrap  (osg::Texture::WRAP_S,     osg::Texture::CLAMP_TO_EDGE );
+            texture->setWrap  (osg::Texture::WRAP_T,     osg::Texture::CLAMP_TO_EDGE );
+            if ( Registry::capabilities().supportsNonPowerOfTwoTextures() )
+                texture->setResizeNonPowerOfTwoHint( false );
+
+            stateSet->setTextureAttributeAndModes(0, texture, osg::StateAttribute::ON);
         }
 
-        texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
-        texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
-        texture->setWrap  (osg::Texture::WRAP_S,     osg::Texture::CLAMP_TO_EDGE );
-        texture->setWrap  (osg::Texture::WRAP_T,     osg::Texture::CLAMP_TO_EDGE );
-        if ( Registry::capabilities().supportsNonPowerOfTwoTextures() )
-            texture->setResizeNonPowerOfTwoHint( false );
-
-        stateSet->setTextureAttributeAndModes(0, texture, osg::StateAttribute::ON);
-
         stateSet->setMode( GL_BLEND, 1 );
         stateSet->setRenderBinDetails( 95, "DepthSortedBin" );
         stateSet->setAttributeAndModes( new osg::Depth(osg::Depth::ALWAYS,false), 1 );
 
-        osg::Geode* geode = new osg::Geode;
-        geode->addDrawable( geometry );
-
         return geode;
         //osg::AutoTransform* at = new osg::AutoTransform;
         //at->setAutoScaleToScreen( true );
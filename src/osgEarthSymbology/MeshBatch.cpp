@@ -0,0 +1,264 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthSymbology/MeshBatch>
+#include <osgEarthSymbology/MeshConsolidator>
+#include <osgEarth/Notify>
+#include <algorithm>
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+
+#define LC "[MeshBatch] "
+
+// layout bits: per-vertex colors, normals, then one bit per texture unit.
+#define LAYOUT_COLORS     0x01u
+#define LAYOUT_NORMALS    0x02u
+#define LAYOUT_UNIT_SHIFT 2
+#define MAX_UNITS         8
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    bool isPolygonal( GLenum mode )
+    {
+        return
+            mode == osg::PrimitiveSet::TRIANGLES      ||
+            mode == osg::PrimitiveSet::TRIANGLE_STRIP ||
+            mode == osg::PrimitiveSet::TRIANGLE_FAN   ||
+            mode == osg::PrimitiveSet::QUADS          ||
+            mode == osg::PrimitiveSet::QUAD_STRIP     ||
+            mode == osg::PrimitiveSet::POLYGON;
+    }
+
+    // releases the unused part of the reserved arrays, and shrinks 32-bit
+    // indices to 16 bits when the mesh is small enough.
+    void finish( osg::Geometry* geom )
+    {
+        geom->getVertexArray()->trim();
+        if ( geom->getColorArray() )
+            geom->getColorArray()->trim();
+        if ( geom->getNormalArray() )
+            geom->getNormalArray()->trim();
+        for( unsigned u = 0; u < geom->getNumTexCoordArrays(); ++u )
+        {
+            if ( geom->getTexCoordArray(u) )
+                geom->getTexCoordArray(u)->trim();
+        }
+
+        if ( geom->getVertexArray()->getNumElements() > 0xFFFF )
+            return;
+
+        for( unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i )
+        {
+            osg::DrawElementsUInt* de = dynamic_cast<osg::DrawElementsUInt*>( geom->getPrimitiveSet(i) );
+            if ( de )
+            {
+                osg::DrawElementsUShort* small = new osg::DrawElementsUShort( de->getMode() );
+                small->reserve( de->size() );
+                for( unsigned j = 0; j < de->size(); ++j )
+                    small->push_back( (GLushort)(*de)[j] );
+                small->setUserData( de->getUserData() );
+                geom->setPrimitiveSet( i, small );
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+MeshBatch::MeshBatch( bool useVBOs, unsigned maxVerts ) :
+_useVBOs    ( useVBOs ),
+_maxVerts   ( maxVerts ),
+_reserve    ( 0 ),
+_numAppended( 0 )
+{
+#ifdef OSG_GLES2_AVAILABLE
+    // GLES only supports UShort, not UInt
+    _maxVerts = std::min( _maxVerts, 0xFFFFu );
+#endif
+}
+
+void
+MeshBatch::startTarget( Target& t, unsigned layout, const std::vector<unsigned>& units )
+{
+    if ( t._geom.valid() )
+        _finished.push_back( t._geom.get() );
+
+    unsigned reserve = std::min( _reserve, _maxVerts );
+
+    t = Target();
+    t._geom = new osg::Geometry();
+    t._geom->setUseVertexBufferObjects( _useVBOs );
+    t._geom->setUseDisplayList( !_useVBOs );
+
+    t._verts = new osg::Vec3Array();
+    t._verts->reserve( reserve );
+    t._geom->setVertexArray( t._verts );
+
+    if ( layout & LAYOUT_COLORS )
+    {
+        t._colors = new osg::Vec4Array();
+        t._colors->reserve( reserve );
+        t._geom->setColorArray( t._colors );
+        t._geom->setColorBinding( osg::Geometry::BIND_PER_VERTEX );
+    }
+
+    if ( layout & LAYOUT_NORMALS )
+    {
+        t._normals = new osg::Vec3Array();
+        t._normals->reserve( reserve );
+        t._geom->setNormalArray( t._normals );
+        t._geom->setNormalBinding( osg::Geometry::BIND_PER_VERTEX );
+    }
+
+    for( unsigned i = 0; i < units.size(); ++i )
+    {
+        osg::Vec2Array* texCoords = new osg::Vec2Array();
+        texCoords->reserve( reserve );
+        t._geom->setTexCoordArray( units[i], texCoords );
+        t._texCoords.push_back( texCoords );
+    }
+}
+
+bool
+MeshBatch::append( osg::Geometry& geom )
+{
+    osg::Vec3Array* verts = dynamic_cast<osg::Vec3Array*>( geom.getVertexArray() );
+    if ( !verts || verts->empty() || geom.getStateSet() || geom.getVertexAttribArrayList().size() > 0 )
+        return false;
+
+    unsigned numVerts = verts->size();
+    if ( numVerts > _maxVerts )
+        return false;
+
+    // work out the array layout; everything must be bound per-vertex.
+    unsigned layout = 0;
+
+    osg::Vec4Array* colors = dynamic_cast<osg::Vec4Array*>( geom.getColorArray() );
+    if ( geom.getColorArray() )
+    {
+        if ( !colors || colors->size() != numVerts || geom.getColorBinding() != osg::Geometry::BIND_PER_VERTEX )
+            return false;
+        layout |= LAYOUT_COLORS;
+    }
+
+    osg::Vec3Array* normals = dynamic_cast<osg::Vec3Array*>( geom.getNormalArray() );
+    if ( geom.getNormalArray() )
+    {
+        if ( !normals || normals->size() != numVerts || geom.getNormalBinding() != osg::Geometry::BIND_PER_VERTEX )
+            return false;
+        layout |= LAYOUT_NORMALS;
+    }
+
+    if ( geom.getSecondaryColorArray() || geom.getFogCoordArray() )
+        return false;
+
+    std::vector<unsigned>        units;
+    std::vector<osg::Vec2Array*> texCoords;
+    for( unsigned u = 0; u < geom.getNumTexCoordArrays(); ++u )
+    {
+        if ( geom.getTexCoordArray(u) )
+        {
+            osg::Vec2Array* tc = dynamic_cast<osg::Vec2Array*>( geom.getTexCoordArray(u) );
+            if ( u >= MAX_UNITS || !tc || tc->size() != numVerts )
+                return false;
+            units.push_back( u );
+            texCoords.push_back( tc );
+            layout |= 1u << (LAYOUT_UNIT_SHIFT + u);
+        }
+    }
+
+    // only polygons merge into a triangle mesh.
+    for( unsigned i = 0; i < geom.getNumPrimitiveSets(); ++i )
+    {
+        if ( !isPolygonal(geom.getPrimitiveSet(i)->getMode()) )
+            return false;
+    }
+
+    // (the conversion declines geometries it can't handle, e.g. ones with
+    // mixed user data; those stay out of the batch.)
+    MeshConsolidator::convertToTriangles( geom );
+    for( unsigned i = 0; i < geom.getNumPrimitiveSets(); ++i )
+    {
+        if ( geom.getPrimitiveSet(i)->getMode() != osg::PrimitiveSet::TRIANGLES )
+            return false;
+    }
+
+    Target& t = _targets[layout];
+    if ( !t._geom.valid() || t._verts->size() + numVerts > _maxVerts )
+    {
+        startTarget( t, layout, units );
+    }
+
+    unsigned offset = t._verts->size();
+
+    t._verts->insert( t._verts->end(), verts->begin(), verts->end() );
+    if ( colors )
+        t._colors->insert( t._colors->end(), colors->begin(), colors->end() );
+    if ( normals )
+        t._normals->insert( t._normals->end(), normals->begin(), normals->end() );
+    for( unsigned i = 0; i < texCoords.size(); ++i )
+        t._texCoords[i]->insert( t._texCoords[i]->end(), texCoords[i]->begin(), texCoords[i]->end() );
+
+    // runs of primitives with the same user data share one primitive set.
+    for( unsigned i = 0; i < geom.getNumPrimitiveSets(); ++i )
+    {
+        osg::PrimitiveSet* pset = geom.getPrimitiveSet(i);
+
+        if ( !t._prims || t._userData != pset->getUserData() )
+        {
+            t._prims    = new osg::DrawElementsUInt( osg::PrimitiveSet::TRIANGLES );
+            t._userData = pset->getUserData();
+            t._prims->setUserData( t._userData );
+            t._geom->addPrimitiveSet( t._prims );
+        }
+
+        unsigned numIndices = pset->getNumIndices();
+        t._prims->reserve( t._prims->size() + numIndices );
+        for( unsigned j = 0; j < numIndices; ++j )
+            t._prims->push_back( offset + pset->index(j) );
+    }
+
+    ++_numAppended;
+    return true;
+}
+
+void
+MeshBatch::addTo( osg::Geode& geode )
+{
+    for( TargetMap::iterator i = _targets.begin(); i != _targets.end(); ++i )
+    {
+        if ( i->second._geom.valid() )
+            _finished.push_back( i->second._geom.get() );
+    }
+    _targets.clear();
+
+    for( unsigned i = 0; i < _finished.size(); ++i )
+    {
+        finish( _finished[i].get() );
+        geode.addDrawable( _finished[i].get() );
+    }
+
+    OE_DEBUG << LC << "Batched " << _numAppended << " geometries into "
+        << _finished.size() << " meshes" << std::endl;
+
+    _finished.clear();
+    _numAppended = 0;
+}
@@ -41,6 +41,7 @@ ModelSymbol::getConfig() const
     conf.addObjIfSet( "heading",    _heading );
     conf.addObjIfSet( "pitch",      _pitch );
     conf.addObjIfSet( "roll",       _roll );
+    conf.addObjIfSet( "color",      _color );
     
     conf.addIfSet( "auto_scale", _autoScale );
     conf.addIfSet( "alias_map", _uriAliasMap );
@@ -55,6 +56,7 @@ ModelSymbol::mergeConfig( const Config& conf )
     conf.getObjIfSet( "heading", _heading );
     conf.getObjIfSet( "pitch",   _pitch );
     conf.getObjIfSet( "roll",    _roll );
+    conf.getObjIfSet( "color",   _color );
 
     conf.getIfSet( "auto_scale", _autoScale );
     conf.getIfSet( "alias_map", _uriAliasMap );
@@ -100,5 +102,8 @@ ModelSymbol::parseSLD(const Config& c, Style& style)
     else if ( match(c.key(), "model-heading") ) {
         style.getOrCreate<ModelSymbol>()->heading() = NumericExpression(c.value());
     }
+    else if ( match(c.key(), "model-color") ) {
+        style.getOrCreate<ModelSymbol>()->color() = StringExpression(c.value());
+    }
 
 }
\ No newline at end of file
@@ -23,8 +23,9 @@ using namespace osgEarth;
 using namespace osgEarth::Symbology;
 
 PolygonSymbol::PolygonSymbol( const Config& conf ) :
-Symbol( conf ),
-_fill ( Fill() )
+Symbol        ( conf ),
+_fill         ( Fill() ),
+_triangulation( TRIANGULATION_GLU )
 {
     mergeConfig(conf);
 }
@@ -35,6 +36,8 @@ PolygonSymbol::getConfig() const
     Config conf = Symbol::getConfig();
     conf.key() = "polygon";
     conf.addObjIfSet( "fill", _fill );
+    conf.addIfSet   ( "triangulation", "glu",          _triangulation, TRIANGULATION_GLU );
+    conf.addIfSet   ( "triangulation", "ear_clipping", _triangulation, TRIANGULATION_EAR_CLIPPING );
     return conf;
 }
 
@@ -42,6 +45,8 @@ void
 PolygonSymbol::mergeConfig(const Config& conf )
 {
     conf.getObjIfSet( "fill", _fill );
+    conf.getIfSet   ( "triangulation", "glu",          _triangulation, TRIANGULATION_GLU );
+    conf.getIfSet   ( "triangulation", "ear_clipping", _triangulation, TRIANGULATION_EAR_CLIPPING );
 }
 
 void
@@ -53,4 +58,10 @@ PolygonSymbol::parseSLD(const Config& c, Style& style)
     else if ( match(c.key(), "fill-opacity") ) {
         style.getOrCreate<PolygonSymbol>()->fill()->color().a() = as<float>( c.value(), 1.0f );
     }
+    else if ( match(c.key(), "fill-triangulation") ) {
+        if      ( match(c.value(), "glu") )
+            style.getOrCreate<PolygonSymbol>()->triangulation() = TRIANGULATION_GLU;
+        else if ( match(c.value(), "ear-clipping") )
+            style.getOrCreate<PolygonSymbol>()->triangulation() = TRIANGULATION_EAR_CLIPPING;
+    }
 }
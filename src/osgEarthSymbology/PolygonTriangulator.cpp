@@ -0,0 +1,416 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthSymbology/PolygonTriangulator>
+#include <algorithm>
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+
+#define LC "[PolygonTriangulator] "
+
+// largest polygon (in points) that we will clip; see getMaxPoints()
+#define MAX_POINTS 2048
+
+namespace
+{
+    // One vertex of the polygon being clipped. The bridges that join the holes
+    // to the outer ring visit two points twice, so nodes may share an index.
+    struct Node
+    {
+        unsigned _index;
+        double   _x, _y;
+        unsigned _prev, _next;
+    };
+
+    typedef std::vector<Node> NodeList;
+
+    // twice the signed area of triangle abc; positive when abc is counter-clockwise.
+    inline double cross( const Node& a, const Node& b, const Node& c )
+    {
+        return (b._x-a._x)*(c._y-a._y) - (b._y-a._y)*(c._x-a._x);
+    }
+
+    inline bool equals( const Node& a, const Node& b )
+    {
+        return a._x == b._x && a._y == b._y;
+    }
+
+    // whether p lies inside or on the counter-clockwise triangle abc.
+    inline bool inTriangle( const Node& a, const Node& b, const Node& c, const Node& p )
+    {
+        return cross(a, b, p) >= 0.0 && cross(b, c, p) >= 0.0 && cross(c, a, p) >= 0.0;
+    }
+
+    // whether p (known to be collinear with ab) lies within segment ab.
+    inline bool onSegment( const Node& a, const Node& b, const Node& p )
+    {
+        return
+            p._x >= std::min(a._x, b._x) && p._x <= std::max(a._x, b._x) &&
+            p._y >= std::min(a._y, b._y) && p._y <= std::max(a._y, b._y);
+    }
+
+    // whether segments ab and cd cross or touch. Segments that only share an
+    // endpoint do not count.
+    bool crosses( const Node& a, const Node& b, const Node& c, const Node& d )
+    {
+        if ( equals(a, c) || equals(a, d) || equals(b, c) || equals(b, d) )
+            return false;
+
+        double d1 = cross(a, b, c), d2 = cross(a, b, d);
+        double d3 = cross(c, d, a), d4 = cross(c, d, b);
+
+        if ( ((d1 > 0.0 && d2 < 0.0) || (d1 < 0.0 && d2 > 0.0)) &&
+             ((d3 > 0.0 && d4 < 0.0) || (d3 < 0.0 && d4 > 0.0)) )
+            return true;
+
+        return
+            (d1 == 0.0 && onSegment(a, b, c)) ||
+            (d2 == 0.0 && onSegment(a, b, d)) ||
+            (d3 == 0.0 && onSegment(c, d, a)) ||
+            (d4 == 0.0 && onSegment(c, d, b));
+    }
+
+    // whether segment ab crosses any edge of the ring that contains "start".
+    bool crossesRing( const NodeList& nodes, unsigned start, const Node& a, const Node& b )
+    {
+        unsigned n = start;
+        do
+        {
+            if ( crosses(a, b, nodes[n], nodes[nodes[n]._next]) )
+                return true;
+            n = nodes[n]._next;
+        }
+        while( n != start );
+        return false;
+    }
+
+    // whether a diagonal from node n toward p leaves n into the interior of the
+    // polygon (which lies to the left of each edge).
+    bool locallyInside( const NodeList& nodes, unsigned n, const Node& p )
+    {
+        const Node& v = nodes[n];
+        const Node& a = nodes[v._prev];
+        const Node& b = nodes[v._next];
+
+        if ( cross(a, v, b) >= 0.0 )
+            return cross(a, v, p) > 0.0 && cross(v, b, p) > 0.0;
+        else
+            return cross(a, v, p) > 0.0 || cross(v, b, p) > 0.0;
+    }
+
+    // whether no other point of the ring lies in the triangle prev-cur-next.
+    bool isEar( const NodeList& nodes, unsigned prev, unsigned cur, unsigned next )
+    {
+        const Node& a = nodes[prev];
+        const Node& b = nodes[cur];
+        const Node& c = nodes[next];
+
+        for( unsigned n = nodes[next]._next; n != prev; n = nodes[n]._next )
+        {
+            const Node& p = nodes[n];
+            if ( !equals(p, a) && !equals(p, b) && !equals(p, c) && inTriangle(a, b, c, p) )
+                return false;
+        }
+        return true;
+    }
+
+    // Appends a ring to the node list as a circular list, wound as requested.
+    // Returns the position of its first node, or -1 if the ring has no area.
+    int addRing( const Geometry* ring, unsigned base, bool ccw, NodeList& nodes )
+    {
+        const std::vector<osg::Vec3d>& v = ring->asVector();
+
+        // skip repeated points, including the closing point of a closed ring.
+        std::vector<unsigned> points;
+        points.reserve( v.size() );
+        for( unsigned i = 0; i < v.size(); ++i )
+        {
+            if ( points.empty() || v[i].x() != v[points.back()].x() || v[i].y() != v[points.back()].y() )
+                points.push_back( i );
+        }
+        while( points.size() > 1 && v[points.front()].x() == v[points.back()].x() && v[points.front()].y() == v[points.back()].y() )
+            points.pop_back();
+
+        unsigned size = points.size();
+        if ( size < 3 )
+            return -1;
+
+        double area = 0.0;
+        for( unsigned i = 0; i < size; ++i )
+        {
+            const osg::Vec3d& p = v[points[i]];
+            const osg::Vec3d& q = v[points[(i+1) % size]];
+            area += p.x()*q.y() - q.x()*p.y();
+        }
+        if ( area == 0.0 )
+            return -1;
+
+        if ( (area > 0.0) != ccw )
+            std::reverse( points.begin(), points.end() );
+
+        unsigned first = nodes.size();
+        for( unsigned i = 0; i < size; ++i )
+        {
+            Node node;
+            node._index = base + points[i];
+            node._x     = v[points[i]].x();
+            node._y     = v[points[i]].y();
+            node._prev  = first + (i + size - 1) % size;
+            node._next  = first + (i + 1) % size;
+            nodes.push_back( node );
+        }
+        return (int)first;
+    }
+
+    // sorts holes so the one reaching farthest in +X comes first.
+    struct SortByMaxX
+    {
+        SortByMaxX( const NodeList& nodes ) : _nodes( nodes ) { }
+        bool operator()( unsigned lhs, unsigned rhs ) const
+        {
+            return _nodes[lhs]._x > _nodes[rhs]._x;
+        }
+        const NodeList& _nodes;
+    };
+
+    // sorts candidate bridge ends by their distance from a hole point.
+    struct SortByDistance
+    {
+        SortByDistance( const NodeList& nodes, const Node& from ) : _nodes( nodes ), _from( from ) { }
+        double dist2( unsigned n ) const
+        {
+            double dx = _nodes[n]._x - _from._x, dy = _nodes[n]._y - _from._y;
+            return dx*dx + dy*dy;
+        }
+        bool operator()( unsigned lhs, unsigned rhs ) const
+        {
+            return dist2(lhs) < dist2(rhs);
+        }
+        const NodeList& _nodes;
+        Node            _from;
+    };
+
+    // Joins a hole into the outer ring by cutting along the shortest diagonal
+    // from its point "m" to an outer point that crosses no edge. Returns false
+    // if there is no such diagonal.
+    bool bridgeHole( NodeList& nodes, unsigned outer, unsigned m, const std::vector<unsigned>& otherHoles )
+    {
+        std::vector<unsigned> candidates;
+        unsigned n = outer;
+        do
+        {
+            candidates.push_back( n );
+            n = nodes[n]._next;
+        }
+        while( n != outer );
+
+        std::sort( candidates.begin(), candidates.end(), SortByDistance(nodes, nodes[m]) );
+
+        for( unsigned i = 0; i < candidates.size(); ++i )
+        {
+            unsigned p = candidates[i];
+            const Node& mNode = nodes[m];
+            const Node& pNode = nodes[p];
+
+            if ( equals(mNode, pNode) )
+                continue;
+
+            if ( !locallyInside(nodes, p, mNode) || !locallyInside(nodes, m, pNode) )
+                continue;
+
+            if ( crossesRing(nodes, outer, mNode, pNode) || crossesRing(nodes, m, mNode, pNode) )
+                continue;
+
+            bool blocked = false;
+            for( unsigned h = 0; h < otherHoles.size() && !blocked; ++h )
+                blocked = crossesRing( nodes, otherHoles[h], mNode, pNode );
+            if ( blocked )
+                continue;
+
+            // splice: p -> m -> (around the hole) -> m' -> p' -> (rest of the outer ring)
+            unsigned pNext = nodes[p]._next;
+            unsigned mPrev = nodes[m]._prev;
+
+            unsigned m2 = nodes.size();
+            nodes.push_back( nodes[m] );
+            unsigned p2 = nodes.size();
+            nodes.push_back( nodes[p] );
+
+            nodes[p]._next     = m;
+            nodes[m]._prev     = p;
+            nodes[mPrev]._next = m2;
+            nodes[m2]._prev    = mPrev;
+            nodes[m2]._next    = p2;
+            nodes[p2]._prev    = m2;
+            nodes[p2]._next    = pNext;
+            nodes[pNext]._prev = p2;
+            return true;
+        }
+
+        return false;
+    }
+}
+
+//------------------------------------------------------------------------
+
+unsigned
+PolygonTriangulator::getMaxPoints()
+{
+    return MAX_POINTS;
+}
+
+bool
+PolygonTriangulator::triangulate(const std::vector<const Geometry*>& rings,
+                                 std::vector<unsigned>&               out_indices)
+{
+    if ( rings.empty() || !rings[0] )
+        return false;
+
+    unsigned totalPoints = 0;
+    for( unsigned r = 0; r < rings.size(); ++r )
+        totalPoints += rings[r] ? rings[r]->size() : 0;
+    if ( totalPoints > MAX_POINTS )
+        return false;
+
+    NodeList nodes;
+    nodes.reserve( totalPoints + 2*rings.size() );
+
+    // outer ring counter-clockwise, holes clockwise, so that the interior is
+    // always on the left.
+    int outerStart = addRing( rings[0], 0, true, nodes );
+    if ( outerStart < 0 )
+        return false;
+    unsigned outer = (unsigned)outerStart;
+
+    std::vector<unsigned> holes;
+    std::vector<unsigned> ringStarts;
+    ringStarts.push_back( outer );
+
+    unsigned base = rings[0]->size();
+    for( unsigned r = 1; r < rings.size(); ++r )
+    {
+        if ( !rings[r] )
+            continue;
+        int start = addRing( rings[r], base, false, nodes );
+        base += rings[r]->size();
+        if ( start >= 0 )
+        {
+            ringStarts.push_back( (unsigned)start );
+            holes.push_back( (unsigned)start );
+        }
+    }
+
+    // the rings must not cross themselves or each other.
+    for( unsigned e = 0; e < nodes.size(); ++e )
+    {
+        const Node& a = nodes[e];
+        const Node& b = nodes[a._next];
+        for( unsigned r = 0; r < ringStarts.size(); ++r )
+        {
+            if ( crossesRing(nodes, ringStarts[r], a, b) )
+                return false;
+        }
+    }
+
+    // bridge each hole to the outer ring, starting with the one that reaches
+    // farthest in +X from its rightmost point.
+    for( unsigned h = 0; h < holes.size(); ++h )
+    {
+        unsigned m = holes[h];
+        for( unsigned n = nodes[m]._next; n != holes[h]; n = nodes[n]._next )
+        {
+            if ( nodes[n]._x > nodes[m]._x )
+                m = n;
+        }
+        holes[h] = m;
+    }
+    std::sort( holes.begin(), holes.end(), SortByMaxX(nodes) );
+
+    for( unsigned h = 0; h < holes.size(); ++h )
+    {
+        std::vector<unsigned> otherHoles( holes.begin() + h + 1, holes.end() );
+        if ( !bridgeHole(nodes, outer, holes[h], otherHoles) )
+            return false;
+    }
+
+    // clip ears until one triangle remains.
+    unsigned count = 0;
+    unsigned n = outer;
+    do
+    {
+        ++count;
+        n = nodes[n]._next;
+    }
+    while( n != outer );
+
+    std::vector<unsigned> triangles;
+    triangles.reserve( 3 * (count - 2) );
+
+    unsigned cur   = outer;
+    unsigned stall = 0;
+
+    while( count > 3 )
+    {
+        unsigned prev = nodes[cur]._prev;
+        unsigned next = nodes[cur]._next;
+        double   c    = cross( nodes[prev], nodes[cur], nodes[next] );
+
+        // a collinear point (or repeat point) adds no area; just drop it.
+        bool clip = c == 0.0 || (c > 0.0 && isEar(nodes, prev, cur, next));
+
+        if ( clip )
+        {
+            if ( c > 0.0 )
+            {
+                triangles.push_back( nodes[prev]._index );
+                triangles.push_back( nodes[cur]._index );
+                triangles.push_back( nodes[next]._index );
+            }
+
+            nodes[prev]._next = next;
+            nodes[next]._prev = prev;
+            --count;
+            cur   = next;
+            stall = 0;
+        }
+        else
+        {
+            cur = next;
+            if ( ++stall > count )
+                return false;
+        }
+    }
+
+    {
+        unsigned prev = nodes[cur]._prev;
+        unsigned next = nodes[cur]._next;
+        if ( cross(nodes[prev], nodes[cur], nodes[next]) > 0.0 )
+        {
+            triangles.push_back( nodes[prev]._index );
+            triangles.push_back( nodes[cur]._index );
+            triangles.push_back( nodes[next]._index );
+        }
+    }
+
+    if ( triangles.empty() )
+        return false;
+
+    out_indices.insert( out_indices.end(), triangles.begin(), triangles.end() );
+    return true;
+}
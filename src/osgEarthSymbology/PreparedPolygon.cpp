@@ -0,0 +1,223 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2013 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthSymbology/PreparedPolygon>
+#include <osgEarthSymbology/GEOS>
+
+#ifdef OSGEARTH_HAVE_GEOS
+#  include <geos/geom/Geometry.h>
+#  include <geos/geom/GeometryFactory.h>
+#  include <geos/geom/prep/PreparedGeometry.h>
+#  include <geos/geom/prep/PreparedGeometryFactory.h>
+#  include <geos/operation/overlay/OverlayOp.h>
+using namespace geos;
+using namespace geos::operation;
+#endif
+
+#define LC "[PreparedPolygon] "
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+
+//------------------------------------------------------------------------
+
+PreparedPolygon::PreparedPolygon( const Polygon* polygon ) :
+_polygon ( polygon ),
+_isBox   ( false ),
+_geom    ( 0L ),
+_prepared( 0L )
+{
+    if ( !polygon || !polygon->isValid() )
+        return;
+
+    _bounds = polygon->getBounds();
+
+    // an axis-aligned rectangle lets envelope tests decide containment exactly.
+    if ( polygon->getHoles().empty() && (polygon->size() == 4 || (polygon->size() == 5 && polygon->front() == polygon->back())) )
+    {
+        _isBox = true;
+        for( Polygon::const_iterator i = polygon->begin(); i != polygon->end() && _isBox; ++i )
+        {
+            _isBox =
+                (i->x() == _bounds.xMin() || i->x() == _bounds.xMax()) &&
+                (i->y() == _bounds.yMin() || i->y() == _bounds.yMax());
+        }
+    }
+
+#ifdef OSGEARTH_HAVE_GEOS
+    _geom = GEOSUtils::importGeometry( polygon );
+    if ( _geom )
+    {
+        try {
+            _prepared = geom::prep::PreparedGeometryFactory::prepare( _geom );
+        }
+        catch( ... ) {
+            _prepared = 0L;
+            OE_NOTICE << LC << "GEOS exception preparing the operand" << std::endl;
+        }
+    }
+#endif // OSGEARTH_HAVE_GEOS
+}
+
+PreparedPolygon::~PreparedPolygon()
+{
+#ifdef OSGEARTH_HAVE_GEOS
+    if ( _prepared )
+        geom::prep::PreparedGeometryFactory::destroy( _prepared );
+    if ( _geom )
+        _geom->getFactory()->destroyGeometry( _geom );
+#endif // OSGEARTH_HAVE_GEOS
+}
+
+PreparedPolygon::Relation
+PreparedPolygon::relate( const Geometry* input, geos::geom::Geometry*& out_imported ) const
+{
+    out_imported = 0L;
+
+    Bounds b = input ? input->getBounds() : Bounds();
+    if ( !b.valid() || !_bounds.valid() )
+        return RELATION_OUTSIDE;
+
+    // envelopes first:
+    if ( b.xMin() > _bounds.xMax() || b.xMax() < _bounds.xMin() ||
+         b.yMin() > _bounds.yMax() || b.yMax() < _bounds.yMin() )
+        return RELATION_OUTSIDE;
+
+    if ( _isBox && _bounds.contains(b) )
+        return RELATION_INSIDE;
+
+#ifdef OSGEARTH_HAVE_GEOS
+    if ( _prepared )
+    {
+        out_imported = GEOSUtils::importGeometry( input );
+        if ( out_imported )
+        {
+            try {
+                if ( _prepared->contains(out_imported) )
+                    return RELATION_INSIDE;
+                if ( !_prepared->intersects(out_imported) )
+                    return RELATION_OUTSIDE;
+            }
+            catch( ... ) {
+                // fall back on the full overlay.
+            }
+        }
+    }
+#endif // OSGEARTH_HAVE_GEOS
+
+    return RELATION_CROSSES;
+}
+
+bool
+PreparedPolygon::runOverlay( geos::geom::Geometry* input, int op, osg::ref_ptr<Geometry>& output ) const
+{
+#ifdef OSGEARTH_HAVE_GEOS
+
+    if ( !input || !_geom )
+        return false;
+
+    geom::Geometry* outGeom = 0L;
+    try {
+        outGeom = overlay::OverlayOp::overlayOp( input, _geom, (overlay::OverlayOp::OpCode)op );
+    }
+    catch( ... ) {
+        outGeom = 0L;
+        OE_NOTICE << LC << "GEOS overlay op exception, skipping feature" << std::endl;
+    }
+
+    if ( outGeom )
+    {
+        output = GEOSUtils::exportGeometry( outGeom );
+        outGeom->getFactory()->destroyGeometry( outGeom );
+        if ( output.valid() && !output->isValid() )
+        {
+            output = 0L;
+        }
+    }
+    return output.valid();
+
+#else // OSGEARTH_HAVE_GEOS
+
+    OE_WARN << LC << "Overlay failed - GEOS not available" << std::endl;
+    return false;
+
+#endif // OSGEARTH_HAVE_GEOS
+}
+
+bool
+PreparedPolygon::crop( const Geometry* input, osg::ref_ptr<Geometry>& output ) const
+{
+    output = 0L;
+
+    geos::geom::Geometry* imported = 0L;
+    Relation r = relate( input, imported );
+
+    if ( r == RELATION_INSIDE )
+    {
+        output = input->clone();
+    }
+    else if ( r == RELATION_CROSSES )
+    {
+#ifdef OSGEARTH_HAVE_GEOS
+        if ( !imported )
+            imported = GEOSUtils::importGeometry( input );
+        runOverlay( imported, overlay::OverlayOp::opINTERSECTION, output );
+#else
+        OE_WARN << LC << "Crop failed - GEOS not available" << std::endl;
+#endif
+    }
+
+#ifdef OSGEARTH_HAVE_GEOS
+    if ( imported )
+        imported->getFactory()->destroyGeometry( imported );
+#endif
+
+    return output.valid();
+}
+
+bool
+PreparedPolygon::difference( const Geometry* input, osg::ref_ptr<Geometry>& output ) const
+{
+    output = 0L;
+
+    geos::geom::Geometry* imported = 0L;
+    Relation r = relate( input, imported );
+
+    if ( r == RELATION_OUTSIDE )
+    {
+        if ( input && input->isValid() )
+            output = input->clone();
+    }
+    else if ( r == RELATION_CROSSES )
+    {
+#ifdef OSGEARTH_HAVE_GEOS
+        if ( !imported )
+            imported = GEOSUtils::importGeometry( input );
+        runOverlay( imported, overlay::OverlayOp::opDIFFERENCE, output );
+#else
+        OE_WARN << LC << "Difference failed - GEOS not available" << std::endl;
+#endif
+    }
+
+#ifdef OSGEARTH_HAVE_GEOS
+    if ( imported )
+        imported->getFactory()->destroyGeometry( imported );
+#endif
+
+    return output.valid();
+}
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthSymbology/ResourceCache>
+#include <osgEarthSymbology/SharedResourceCache>
 
 using namespace osgEarth;
 using namespace osgEarth::Symbology;
@@ -66,7 +67,7 @@ ResourceCache::getStateSet(SkinResource*                skin,
             else
             {
                 // still not there, make it.
-                output = skin->createStateSet( _dbOptions.get() );
+                output = createStateSet( skin );
                 if ( output.valid() )
                     _skinCache.insert( key, output.get() );
             }
@@ -82,7 +83,7 @@ ResourceCache::getStateSet(SkinResource*                skin,
         }
         else
         {
-            output = skin->createStateSet( _dbOptions.get() );
+            output = createStateSet( skin );
             if ( output.valid() )
                 _skinCache.insert( key, output.get() );
         }
@@ -126,7 +127,7 @@ ResourceCache::getInstanceNode(InstanceResource*        res,
             else
             {
                 // still not there, make it.
-                output = res->createNode( _dbOptions.get() );
+                output = createInstanceNode( res );
                 if ( output.valid() )
                     _instanceCache.insert( key, output.get() );
             }
@@ -142,7 +143,7 @@ ResourceCache::getInstanceNode(InstanceResource*        res,
         }
         else
         {
-            output = res->createNode( _dbOptions.get() );
+            output = createInstanceNode( res );
             if ( output.valid() )
                 _instanceCache.insert( key, output.get() );
         }
@@ -186,7 +187,7 @@ ResourceCache::getMarkerNode(MarkerResource*          marker,
             else
             {
                 // still not there, make it.
-                output = marker->createNode( _dbOptions.get() );
+                output = createMarkerNode( marker );
                 if ( output.valid() )
                     _markerCache.insert( key, output.get() );
             }
@@ -202,7 +203,7 @@ ResourceCache::getMarkerNode(MarkerResource*          marker,
         }
         else
         {
-            output = marker->createNode( _dbOptions.get() );
+            output = createMarkerNode( marker );
             if ( output.valid() )
                 _markerCache.insert( key, output.get() );
         }
@@ -210,3 +211,42 @@ ResourceCache::getMarkerNode(MarkerResource*          marker,
 
     return output.valid();
 }
+
+// Cache misses go to the process-wide cache (when enabled) so that other
+// contexts, layers and sessions share the objects.
+
+osg::StateSet*
+ResourceCache::createStateSet( SkinResource* skin )
+{
+    SharedResourceCache* shared = SharedResourceCache::instance();
+    if ( !shared->isEnabled() )
+        return skin->createStateSet( _dbOptions.get() );
+
+    osg::ref_ptr<osg::StateSet> output;
+    shared->getStateSet( skin, _dbOptions.get(), output );
+    return output.release();
+}
+
+osg::Node*
+ResourceCache::createInstanceNode( InstanceResource* res )
+{
+    SharedResourceCache* shared = SharedResourceCache::instance();
+    if ( !shared->isEnabled() )
+        return res->createNode( _dbOptions.get() );
+
+    osg::ref_ptr<osg::Node> output;
+    shared->getInstanceNode( res, _dbOptions.get(), output );
+    return output.release();
+}
+
+osg::Node*
+ResourceCache::createMarkerNode( MarkerResource* marker )
+{
+    SharedResourceCache* shared = SharedResourceCache::instance();
+    if ( !shared->isEnabled() )
+        return marker->createNode( _dbOptions.get() );
+
+    osg::ref_ptr<osg::Node> output;
+    shared->getMarkerNode( marker, _dbOptions.get(), output );
+    return output.release();
+}
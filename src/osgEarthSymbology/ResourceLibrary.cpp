@@ -22,7 +22,9 @@
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/XmlUtils>
 #include <osgEarth/Random>
+#include <osgEarth/StringUtils>
 #include <iterator>
+#include <sstream>
 #include <algorithm>
 #include <fstream>
 
@@ -35,7 +37,8 @@ using namespace OpenThreads;
 //------------------------------------------------------------------------
 
 ResourceLibrary::ResourceLibrary(const Config& conf) :
-_initialized( false )
+_initialized   ( false ),
+_skinIndexDirty( true )
 {
     mergeConfig( conf );
 }
@@ -43,8 +46,9 @@ _initialized( false )
 ResourceLibrary::ResourceLibrary(const std::string&    name,
                                  const URI&            uri) :
 _name       ( name ),
-_uri        ( uri, uri ),
-_initialized( false )
+_uri           ( uri, uri ),
+_initialized   ( false ),
+_skinIndexDirty( true )
 {
     //nop
 }
@@ -126,6 +130,7 @@ ResourceLibrary::addResource( Resource* resource )
     {
         Threading::ScopedWriteLock exclusive(_mutex);
         _skins[resource->name()] = static_cast<SkinResource*>(resource);
+        _skinIndexDirty = true;
     }
     else if ( dynamic_cast<MarkerResource*>(resource) )
     {
@@ -150,6 +155,7 @@ ResourceLibrary::removeResource( Resource* resource )
     {
         Threading::ScopedWriteLock exclusive(_mutex);
         _skins.erase( resource->name() );
+        _skinIndexDirty = true;
     }
     else if ( dynamic_cast<MarkerResource*>( resource ) )
     {
@@ -221,23 +227,20 @@ ResourceLibrary::getSkins( const SkinSymbol* symbol, SkinResourceVector& output,
 {
     const_cast<ResourceLibrary*>(this)->initialize( dbOptions );
     Threading::ScopedReadLock shared( _mutex );
+    Threading::ScopedMutexLock lock( _skinIndexMutex );
 
-    for( ResourceMap<SkinResource>::const_iterator i = _skins.begin(); i != _skins.end(); ++i )
-    {
-        SkinResource* skin = i->second.get();
-        if ( matches(symbol, skin) )
-        {
-            output.push_back( skin );
-        }
-    }
+    const SkinResourceVector& skins = selectSkins( symbol );
+    output.insert( output.end(), skins.begin(), skins.end() );
 }
 
 SkinResource*
 ResourceLibrary::getSkin( const SkinSymbol* symbol, Random& prng, const osgDB::Options* dbOptions ) const
 {
     const_cast<ResourceLibrary*>(this)->initialize( dbOptions );
-    SkinResourceVector candidates;
-    getSkins( symbol, candidates );
+    Threading::ScopedReadLock shared( _mutex );
+    Threading::ScopedMutexLock lock( _skinIndexMutex );
+
+    const SkinResourceVector& candidates = selectSkins( symbol );
     unsigned size = candidates.size();
     if ( size == 0 )
     {
@@ -253,6 +256,113 @@ ResourceLibrary::getSkin( const SkinSymbol* symbol, Random& prng, const osgDB::O
     }
 }
 
+const SkinResourceVector&
+ResourceLibrary::selectSkins( const SkinSymbol* symbol ) const
+{
+    if ( _skinIndexDirty )
+    {
+        _skinsByTag.clear();
+        _skinSelections.clear();
+        for( ResourceMap<SkinResource>::const_iterator i = _skins.begin(); i != _skins.end(); ++i )
+        {
+            const TagSet& tags = i->second->tags();
+            for( TagSet::const_iterator t = tags.begin(); t != tags.end(); ++t )
+                _skinsByTag[*t].push_back( i->second.get() );
+        }
+        _skinIndexDirty = false;
+    }
+
+    // everything but the object height identifies the selection.
+    SkinSymbol base( *symbol );
+    base.objectHeight().unset();
+
+    std::stringstream buf;
+    buf << base.tagString() << "|";
+    if ( base.isTiled().isSet() )         buf << *base.isTiled();
+    buf << "|";
+    if ( base.minObjectHeight().isSet() ) buf << *base.minObjectHeight();
+    buf << "|";
+    if ( base.maxObjectHeight().isSet() ) buf << *base.maxObjectHeight();
+    std::string key = buf.str();
+
+    SkinSelectionMap::iterator s = _skinSelections.find( key );
+    if ( s == _skinSelections.end() )
+    {
+        SkinSelection& sel = _skinSelections[key];
+
+        // start from the shortest tag list (or all skins), in name order.
+        SkinResourceVector all;
+        const SkinResourceVector* start = 0L;
+        bool none = false;
+        for( TagSet::const_iterator t = base.tags().begin(); t != base.tags().end() && !none; ++t )
+        {
+            std::string tag = toLower( *t );
+            SkinTagIndex::const_iterator i = _skinsByTag.find( tag );
+            if ( i == _skinsByTag.end() )
+                none = true;
+            else if ( !start || i->second.size() < start->size() )
+                start = &i->second;
+        }
+        if ( !start )
+        {
+            for( ResourceMap<SkinResource>::const_iterator i = _skins.begin(); i != _skins.end(); ++i )
+                all.push_back( i->second.get() );
+            start = &all;
+        }
+
+        if ( !none )
+        {
+            for( SkinResourceVector::const_iterator i = start->begin(); i != start->end(); ++i )
+            {
+                if ( matches(&base, i->get()) )
+                    sel._all.push_back( i->get() );
+            }
+        }
+
+        // object height bounds split the height axis into regions with
+        // constant candidate lists: below, at and between the bounds.
+        for( SkinResourceVector::const_iterator i = sel._all.begin(); i != sel._all.end(); ++i )
+        {
+            if ( (*i)->minObjectHeight().isSet() ) sel._breaks.push_back( *(*i)->minObjectHeight() );
+            if ( (*i)->maxObjectHeight().isSet() ) sel._breaks.push_back( *(*i)->maxObjectHeight() );
+        }
+        std::sort( sel._breaks.begin(), sel._breaks.end() );
+        sel._breaks.erase( std::unique(sel._breaks.begin(), sel._breaks.end()), sel._breaks.end() );
+
+        unsigned k = sel._breaks.size();
+        if ( k > 0 )
+        {
+            sel._regions.resize( 2*k + 1 );
+            for( unsigned r = 0; r < sel._regions.size(); ++r )
+            {
+                unsigned j = r/2;
+                SkinSymbol probe( base );
+                probe.objectHeight() =
+                    r % 2 == 1 ? sel._breaks[j] :
+                    j == 0     ? sel._breaks[0] - 1.0f :
+                    j == k     ? sel._breaks[k-1] + 1.0f :
+                                 0.5f*(sel._breaks[j-1] + sel._breaks[j]);
+
+                for( SkinResourceVector::const_iterator i = sel._all.begin(); i != sel._all.end(); ++i )
+                {
+                    if ( matches(&probe, i->get()) )
+                        sel._regions[r].push_back( i->get() );
+                }
+            }
+        }
+
+        s = _skinSelections.find( key );
+    }
+
+    const SkinSelection& sel = s->second;
+    if ( !symbol->objectHeight().isSet() || sel._breaks.empty() )
+        return sel._all;
+
+    float h = *symbol->objectHeight();
+    unsigned j = std::lower_bound( sel._breaks.begin(), sel._breaks.end(), h ) - sel._breaks.begin();
+    return j < sel._breaks.size() && sel._breaks[j] == h ? sel._regions[2*j+1] : sel._regions[2*j];
+}
+
 bool
 ResourceLibrary::matches( const SkinSymbol* q, SkinResource* s ) const
 {
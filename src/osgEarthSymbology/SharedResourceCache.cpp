@@ -0,0 +1,329 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthSymbology/SharedResourceCache>
+#include <osgEarth/URI>
+#include <osgEarth/Registry>
+#include <osg/NodeVisitor>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Texture>
+#include <set>
+
+#define LC "[SharedResourceCache] "
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // estimates the memory held by a node or state set: texture images plus
+    // geometry arrays, counting shared objects once.
+    struct SizeCounter : public osg::NodeVisitor
+    {
+        SizeCounter() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN), _bytes(0) { }
+
+        void apply( osg::Node& node )
+        {
+            count( node.getStateSet() );
+            traverse( node );
+        }
+
+        void apply( osg::Geode& geode )
+        {
+            count( geode.getStateSet() );
+            for( unsigned i = 0; i < geode.getNumDrawables(); ++i )
+            {
+                osg::Drawable* d = geode.getDrawable(i);
+                count( d->getStateSet() );
+
+                osg::Geometry* geom = d->asGeometry();
+                if ( geom )
+                {
+                    count( geom->getVertexArray() );
+                    count( geom->getNormalArray() );
+                    count( geom->getColorArray() );
+                    for( unsigned t = 0; t < geom->getNumTexCoordArrays(); ++t )
+                        count( geom->getTexCoordArray(t) );
+                    for( unsigned a = 0; a < geom->getNumVertexAttribArrays(); ++a )
+                        count( geom->getVertexAttribArray(a) );
+                    for( unsigned p = 0; p < geom->getNumPrimitiveSets(); ++p )
+                    {
+                        osg::DrawElements* de = geom->getPrimitiveSet(p)->getDrawElements();
+                        if ( de && _seen.insert(de).second )
+                            _bytes += de->getTotalDataSize();
+                    }
+                }
+            }
+            traverse( geode );
+        }
+
+        void count( const osg::StateSet* ss )
+        {
+            if ( !ss || !_seen.insert(ss).second )
+                return;
+
+            const osg::StateSet::TextureAttributeList& texAttrs = ss->getTextureAttributeList();
+            for( unsigned unit = 0; unit < texAttrs.size(); ++unit )
+            {
+                const osg::Texture* tex = dynamic_cast<const osg::Texture*>(
+                    ss->getTextureAttribute(unit, osg::StateAttribute::TEXTURE) );
+                if ( tex && _seen.insert(tex).second )
+                {
+                    for( unsigned i = 0; i < tex->getNumImages(); ++i )
+                    {
+                        const osg::Image* image = tex->getImage(i);
+                        if ( image && _seen.insert(image).second )
+                            _bytes += image->getTotalSizeInBytes();
+                    }
+                }
+            }
+        }
+
+        void count( const osg::Array* array )
+        {
+            if ( array && _seen.insert(array).second )
+                _bytes += array->getTotalDataSize();
+        }
+
+        std::set<const osg::Object*> _seen;
+        unsigned                     _bytes;
+    };
+}
+
+//------------------------------------------------------------------------
+
+SharedResourceCache*
+SharedResourceCache::instance()
+{
+    static osg::ref_ptr<SharedResourceCache> s_cache;
+    static Threading::Mutex                  s_cacheMutex;
+
+    if ( !s_cache.valid() )
+    {
+        Threading::ScopedMutexLock lock( s_cacheMutex );
+        if ( !s_cache.valid() ) // double-check
+            s_cache = new SharedResourceCache();
+    }
+    return s_cache.get();
+}
+
+SharedResourceCache::SharedResourceCache() :
+_enabled  ( true ),
+_maxBytes ( 256u * 1024u * 1024u ),
+_bytes    ( 0 ),
+_queries  ( 0 ),
+_hits     ( 0 ),
+_evictions( 0 )
+{
+    Registry::addMemoryReporter( this );
+}
+
+SharedResourceCache::~SharedResourceCache()
+{
+    Registry::removeMemoryReporter( this );
+}
+
+void
+SharedResourceCache::setMaxSizeInBytes( unsigned value )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _maxBytes = value;
+    evict();
+}
+
+SharedResourceCache::Stats
+SharedResourceCache::getStats() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    Stats stats;
+    stats._entries     = _entries.size();
+    stats._sizeInBytes = _bytes;
+    stats._queries     = _queries;
+    stats._hits        = _hits;
+    stats._evictions   = _evictions;
+    return stats;
+}
+
+void
+SharedResourceCache::getMemoryUsage( MemoryUsageMap& usage ) const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    usage["resource_cache"] += _bytes;
+}
+
+void
+SharedResourceCache::clear()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _entries.clear();
+    _lru.clear();
+    _bytes     = 0;
+    _queries   = 0;
+    _hits      = 0;
+    _evictions = 0;
+}
+
+std::string
+SharedResourceCache::makeKey( const Config& conf, const osgDB::Options* dbOptions ) const
+{
+    // relative resource URIs resolve against the referrer, so it's part of the key.
+    std::string key = conf.toJSON(false);
+    if ( dbOptions )
+    {
+        key += "|" + URIContext(dbOptions).referrer();
+        key += "|" + dbOptions->getOptionString();
+    }
+    return key;
+}
+
+bool
+SharedResourceCache::get( const std::string& key, osg::ref_ptr<osg::Object>& output )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    ++_queries;
+
+    EntryMap::iterator i = _entries.find( key );
+    if ( i == _entries.end() )
+        return false;
+
+    ++_hits;
+    _lru.splice( _lru.end(), _lru, i->second._lru );
+    output = i->second._object.get();
+    return true;
+}
+
+void
+SharedResourceCache::insert( const std::string& key, osg::ref_ptr<osg::Object>& object )
+{
+    // measure outside the lock; large models take a while.
+    SizeCounter counter;
+    osg::Node*     node = dynamic_cast<osg::Node*>( object.get() );
+    osg::StateSet* ss   = dynamic_cast<osg::StateSet*>( object.get() );
+    if ( node )
+        node->accept( counter );
+    else if ( ss )
+        counter.count( ss );
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    // another thread may have created the same resource in the meantime;
+    // keep the first one so everyone shares it.
+    EntryMap::iterator i = _entries.find( key );
+    if ( i != _entries.end() )
+    {
+        object = i->second._object.get();
+        return;
+    }
+
+    Entry& entry  = _entries[key];
+    entry._object = object.get();
+    entry._size   = counter._bytes;
+    entry._lru    = _lru.insert( _lru.end(), key );
+    _bytes += entry._size;
+
+    evict();
+}
+
+void
+SharedResourceCache::evict()
+{
+    // never evict the most recent entry, even if it alone exceeds the budget.
+    while( _bytes > _maxBytes && _lru.size() > 1 )
+    {
+        EntryMap::iterator i = _entries.find( _lru.front() );
+        _lru.pop_front();
+        if ( i != _entries.end() )
+        {
+            _bytes -= i->second._size;
+            _entries.erase( i );
+            ++_evictions;
+        }
+    }
+}
+
+bool
+SharedResourceCache::getStateSet(SkinResource*                skin,
+                                 const osgDB::Options*        dbOptions,
+                                 osg::ref_ptr<osg::StateSet>& output)
+{
+    output = 0L;
+    if ( !skin )
+        return false;
+
+    std::string key = "skin:" + makeKey( skin->getConfig(), dbOptions );
+
+    osg::ref_ptr<osg::Object> object;
+    if ( !get(key, object) )
+    {
+        object = skin->createStateSet( dbOptions );
+        if ( object.valid() )
+            insert( key, object );
+    }
+
+    output = dynamic_cast<osg::StateSet*>( object.get() );
+    return output.valid();
+}
+
+bool
+SharedResourceCache::getInstanceNode(InstanceResource*        res,
+                                     const osgDB::Options*    dbOptions,
+                                     osg::ref_ptr<osg::Node>& output)
+{
+    output = 0L;
+    if ( !res )
+        return false;
+
+    std::string key = "instance:" + makeKey( res->getConfig(), dbOptions );
+
+    osg::ref_ptr<osg::Object> object;
+    if ( !get(key, object) )
+    {
+        object = res->createNode( dbOptions );
+        if ( object.valid() )
+            insert( key, object );
+    }
+
+    output = dynamic_cast<osg::Node*>( object.get() );
+    return output.valid();
+}
+
+bool
+SharedResourceCache::getMarkerNode(MarkerResource*          marker,
+                                   const osgDB::Options*    dbOptions,
+                                   osg::ref_ptr<osg::Node>& output)
+{
+    output = 0L;
+    if ( !marker )
+        return false;
+
+    std::string key = "marker:" + makeKey( marker->getConfig(), dbOptions );
+
+    osg::ref_ptr<osg::Object> object;
+    if ( !get(key, object) )
+    {
+        object = marker->createNode( dbOptions );
+        if ( object.valid() )
+            insert( key, object );
+    }
+
+    output = dynamic_cast<osg::Node*>( object.get() );
+    return output.valid();
+}
@@ -0,0 +1,190 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <osgEarthUtil/AsyncTerrainQuery>
+#include <osgEarth/MapNode>
+#include <osgEarth/Terrain>
+#include <osgEarth/ThreadingUtils>
+#include <osgViewer/View>
+
+#define LC "[AsyncTerrainQuery] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+using namespace osgEarth::Threading;
+
+//-----------------------------------------------------------------------
+
+namespace
+{
+    bool computePickRay( osg::View* view, float x, float y, osg::Vec3d& out_start, osg::Vec3d& out_end )
+    {
+        osgViewer::View* view2 = dynamic_cast<osgViewer::View*>( view );
+        if ( !view2 )
+            return false;
+
+        float local_x, local_y;
+        const osg::Camera* camera = view2->getCameraContainingPosition( x, y, local_x, local_y );
+        if ( !camera || !camera->getViewport() )
+            return false;
+
+        osg::Matrixd matrix =
+            camera->getViewMatrix() *
+            camera->getProjectionMatrix() *
+            camera->getViewport()->computeWindowMatrix();
+
+        osg::Matrixd inverse;
+        if ( !inverse.invert(matrix) )
+            return false;
+
+        out_start = osg::Vec3d(local_x, local_y, 0.0) * inverse;
+        out_end   = osg::Vec3d(local_x, local_y, 1.0) * inverse;
+        return true;
+    }
+}
+
+//-----------------------------------------------------------------------
+
+// State shared with the worker, so the worker never holds the query itself.
+struct AsyncTerrainQuery::Queue : public osg::Referenced
+{
+    Queue( Terrain* terrain ) :
+        _terrain   ( terrain ),
+        _pending   ( false ),
+        _running   ( false ),
+        _ready     ( false ),
+        _generation( 0u ) { }
+
+    osg::observer_ptr<Terrain> _terrain;
+    Threading::Mutex           _mutex;
+    bool                       _pending;     // a query is waiting
+    bool                       _running;     // a QueryTask is scheduled or working
+    bool                       _ready;       // _result has not been polled yet
+    unsigned                   _generation;  // bumped by cancel()
+    osg::Vec3d                 _start, _end;
+    float                      _x, _y;
+    Result                     _result;
+};
+
+// Resolves waiting queries until there are none left.
+struct AsyncTerrainQuery::QueryTask : public TaskRequest
+{
+    QueryTask( Queue* queue ) : _queue( queue ) { }
+
+    void operator()( ProgressCallback* progress )
+    {
+        Queue* q = _queue.get();
+        for( ;; )
+        {
+            Result   result;
+            osg::Vec3d start, end;
+            unsigned generation;
+            {
+                ScopedMutexLock lock( q->_mutex );
+                if ( !q->_pending )
+                {
+                    q->_running = false;
+                    return;
+                }
+                start       = q->_start;
+                end         = q->_end;
+                result._x   = q->_x;
+                result._y   = q->_y;
+                generation  = q->_generation;
+                q->_pending = false;
+            }
+
+            osg::ref_ptr<Terrain> terrain;
+            if ( q->_terrain.lock(terrain) )
+                result._hit = terrain->intersect( start, end, result._world );
+
+            ScopedMutexLock lock( q->_mutex );
+            if ( generation == q->_generation )
+            {
+                q->_result = result;
+                q->_ready  = true;
+            }
+        }
+    }
+
+    osg::ref_ptr<Queue> _queue;
+};
+
+//-----------------------------------------------------------------------
+
+AsyncTerrainQuery::AsyncTerrainQuery( MapNode* mapNode )
+{
+    _queue   = new Queue( mapNode ? mapNode->getTerrain() : 0L );
+    _service = new TaskService( "AsyncTerrainQuery", 1 );
+}
+
+AsyncTerrainQuery::~AsyncTerrainQuery()
+{
+    cancel();
+}
+
+bool
+AsyncTerrainQuery::post( osg::View* view, float x, float y )
+{
+    osg::Vec3d start, end;
+    if ( !computePickRay(view, x, y, start, end) )
+        return false;
+
+    ScopedMutexLock lock( _queue->_mutex );
+    _queue->_start   = start;
+    _queue->_end     = end;
+    _queue->_x       = x;
+    _queue->_y       = y;
+    _queue->_pending = true;
+
+    if ( !_queue->_running )
+    {
+        _queue->_running = true;
+        _service->add( new QueryTask(_queue.get()) );
+    }
+    return true;
+}
+
+bool
+AsyncTerrainQuery::poll( Result& out_result )
+{
+    ScopedMutexLock lock( _queue->_mutex );
+    if ( !_queue->_ready )
+        return false;
+
+    out_result     = _queue->_result;
+    _queue->_ready = false;
+    return true;
+}
+
+void
+AsyncTerrainQuery::cancel()
+{
+    ScopedMutexLock lock( _queue->_mutex );
+    _queue->_pending = false;
+    _queue->_ready   = false;
+    _queue->_generation++;
+}
+
+bool
+AsyncTerrainQuery::isBusy() const
+{
+    ScopedMutexLock lock( _queue->_mutex );
+    return _queue->_pending || _queue->_running;
+}
@@ -126,3 +126,13 @@ BrightnessContrastColorFilter::getConfig() const
     conf.add( "c", val[1] );
     return conf;
 }
+
+bool
+BrightnessContrastColorFilter::getConstantCode(std::string& out_code) const
+{
+    osg::Vec2f bc;
+    m_bc->get(bc);
+    out_code = osgEarth::Stringify()
+        << "color.rgb = clamp(((color.rgb - 0.5) * " << glslFloat(bc[1]) << " + 0.5) * " << glslFloat(bc[0]) << ", 0.0, 1.0);\n";
+    return true;
+}
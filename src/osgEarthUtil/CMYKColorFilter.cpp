@@ -187,3 +187,13 @@ CMYKColorFilter::getConfig() const
     conf.add( "k", val[3] );
     return conf;
 }
+
+bool
+CMYKColorFilter::getConstantCode(std::string& out_code) const
+{
+    osg::Vec4f cmyk;
+    m_cmyk->get(cmyk);
+    out_code = osgEarth::Stringify()
+        << "color.rgb = clamp(color.rgb - vec3(" << glslFloat(cmyk[0]+cmyk[3]) << ", " << glslFloat(cmyk[1]+cmyk[3]) << ", " << glslFloat(cmyk[2]+cmyk[3]) << "), 0.0, 1.0);\n";
+    return true;
+}
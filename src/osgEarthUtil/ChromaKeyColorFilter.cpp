@@ -161,3 +161,15 @@ ChromaKeyColorFilter::getConfig() const
 
     return conf;
 }
+
+bool
+ChromaKeyColorFilter::getConstantCode(std::string& out_code) const
+{
+    osg::Vec3f rgb;
+    float      dist;
+    _color->get(rgb);
+    _distance->get(dist);
+    out_code = osgEarth::Stringify()
+        << "if (distance(color.rgb, vec3(" << glslFloat(rgb[0]) << ", " << glslFloat(rgb[1]) << ", " << glslFloat(rgb[2]) << ")) <= " << glslFloat(dist) << ") color.a = 0.0;\n";
+    return true;
+}
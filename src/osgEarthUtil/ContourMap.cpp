@@ -59,6 +59,28 @@ namespace
         "    vec4 texel = texture1D( oe_contour_xfer, oe_contour_lookup ); \n"
         "    color.rgb = mix(color.rgb, texel.rgb, texel.a * oe_contour_opacity); \n"
         "} \n";
+
+    // per-fragment heights from the tile's elevation texture, when the
+    // engine provides one; no vertex shader needed.
+    const char* fs_elevation =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+
+        "uniform sampler1D oe_contour_xfer; \n"
+        "uniform float oe_contour_opacity; \n"
+        "uniform float oe_contour_min; \n"
+        "uniform float oe_contour_range; \n"
+        "uniform sampler2D oe_terrain_tex; \n"
+        "uniform mat4 oe_terrain_tex_matrix; \n"
+        "varying vec4 oe_layer_tilec; \n"
+
+        "void oe_contour_fragment( inout vec4 color ) \n"
+        "{ \n"
+        "    float height = texture2D(oe_terrain_tex, (oe_terrain_tex_matrix * oe_layer_tilec).st).r; \n"
+        "    float lookup = clamp( (height-oe_contour_min)/oe_contour_range, 0.0, 1.0 ); \n"
+        "    vec4 texel = texture1D( oe_contour_xfer, lookup ); \n"
+        "    color.rgb = mix(color.rgb, texel.rgb, texel.a * oe_contour_opacity); \n"
+        "} \n";
 }
 
 
@@ -162,8 +184,15 @@ ContourMap::onInstall(TerrainEngineNode* engine)
         // before the terrain's layers.)
         VirtualProgram* vp = VirtualProgram::getOrCreate(stateset);
 
-        vp->setFunction( "oe_contour_vertex",   vs, ShaderComp::LOCATION_VERTEX_MODEL);
-        vp->setFunction( "oe_contour_fragment", fs, ShaderComp::LOCATION_FRAGMENT_COLORING ); //, -1.0);
+        if ( engine->requireElevationTextures() >= 0 )
+        {
+            vp->setFunction( "oe_contour_fragment", fs_elevation, ShaderComp::LOCATION_FRAGMENT_COLORING );
+        }
+        else
+        {
+            vp->setFunction( "oe_contour_vertex",   vs, ShaderComp::LOCATION_VERTEX_MODEL);
+            vp->setFunction( "oe_contour_fragment", fs, ShaderComp::LOCATION_FRAGMENT_COLORING ); //, -1.0);
+        }
 
         // Install some uniforms that tell the shader the height range of the color map.
         stateset->addUniform( _xferMin.get() );
@@ -214,6 +214,7 @@ Control::init()
     _active = false;
     _absorbEvents = true;
     _dirty = true;
+    _drawViewportHeight = 0.0f;
 }
 
 void
@@ -457,6 +458,70 @@ Control::dirty()
     }
 }
 
+void
+Control::dirtyAll()
+{
+    _dirty = true;
+}
+
+void
+Control::updateSize(const ControlContext& cx, osg::Vec2f& out_size)
+{
+    if ( _dirty )
+    {
+        calcSize( cx, out_size );
+        _layoutSize    = _renderSize;
+        _layoutOutSize = out_size;
+    }
+    else
+    {
+        // a clean control (and everything under it) measures the same as last time.
+        restoreSize();
+        out_size = _layoutOutSize;
+    }
+}
+
+void
+Control::restoreSize()
+{
+    _renderSize = _layoutSize;
+}
+
+void
+Control::updatePos(const ControlContext& cx, const osg::Vec2f& cursor, const osg::Vec2f& parentSize)
+{
+    // if neither the control nor the space it's placed in changed, neither
+    // did the positions of anything under it.
+    if ( !_dirty && cursor == _layoutCursor && parentSize == _layoutParentSize && _renderSize == _layoutRenderSize )
+        return;
+
+    calcPos( cx, cursor, parentSize );
+    _layoutCursor     = cursor;
+    _layoutParentSize = parentSize;
+    _layoutRenderSize = _renderSize;
+}
+
+void
+Control::updateDrawables(const ControlContext& cx, DrawableList& out)
+{
+    float vph = cx._vp.valid() ? cx._vp->height() : 0.0f;
+
+    if ( !_dirty && _renderPos == _drawPos && _renderSize == _drawSize && vph == _drawViewportHeight )
+    {
+        out.insert( out.end(), _drawCache.begin(), _drawCache.end() );
+        return;
+    }
+
+    DrawableList::size_type first = out.size();
+    draw( cx, out );
+    _drawCache.assign( out.begin() + first, out.end() );
+
+    _drawPos            = _renderPos;
+    _drawSize           = _renderSize;
+    _drawViewportHeight = vph;
+    _dirty              = false;
+}
+
 void
 Control::calcSize(const ControlContext& cx, osg::Vec2f& out_size)
 {
@@ -540,24 +605,33 @@ Control::draw(const ControlContext& cx, DrawableList& out )
         {
             float vph = cx._vp->height(); // - padding().bottom();
 
-            _geom = new osg::Geometry();
-            _geom->setUseVertexBufferObjects(true);
+            // reuse the quad from the last pass, updating it in place.
+            if ( !_geom.valid() )
+            {
+                _geom = new osg::Geometry();
+                _geom->setUseVertexBufferObjects(true);
+                _geom->setVertexArray( new osg::Vec3Array(4) );
+                _geom->addPrimitiveSet( new osg::DrawArrays( GL_QUADS, 0, 4 ) );
+                _geom->setColorArray( new osg::Vec4Array(1) );
+                _geom->setColorBinding( osg::Geometry::BIND_OVERALL );
+            }
 
             float rx = _renderPos.x() - padding().left();
             float ry = _renderPos.y() - padding().top();
 
-            osg::Vec3Array* verts = new osg::Vec3Array(4);
-            _geom->setVertexArray( verts );
+            osg::Vec3Array* verts = static_cast<osg::Vec3Array*>( _geom->getVertexArray() );
             (*verts)[0].set( rx, vph - ry, 0 );
             (*verts)[1].set( rx, vph - ry - _renderSize.y(), 0 );
             (*verts)[2].set( rx + _renderSize.x(), vph - ry - _renderSize.y(), 0 );
             (*verts)[3].set( rx + _renderSize.x(), vph - ry, 0 );
-            _geom->addPrimitiveSet( new osg::DrawArrays( GL_QUADS, 0, 4 ) );
+            verts->dirty();
 
-            osg::Vec4Array* colors = new osg::Vec4Array(1);
+            osg::Vec4Array* colors = static_cast<osg::Vec4Array*>( _geom->getColorArray() );
             (*colors)[0] = _active && _activeColor.isSet() ? _activeColor.value() : _backColor.value();
-            _geom->setColorArray( colors );
-            _geom->setColorBinding( osg::Geometry::BIND_OVERALL );
+            colors->dirty();
+
+            _geom->dirtyBound();
+            _geom->dirtyDisplayList();
 
             out.push_back( _geom.get() );
         }
@@ -603,6 +677,24 @@ Control::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa,
 
 namespace
 {
+    // replaces the drawables in a control's geode, unless they are the same
+    // ones (which are updated in place and need no change to the scene graph).
+    void setDrawables( osg::Geode* geode, const DrawableList& drawables )
+    {
+        bool same = geode->getNumDrawables() == drawables.size();
+        for( unsigned i = 0; same && i < drawables.size(); ++i )
+            same = geode->getDrawable(i) == drawables[i].get();
+        if ( same )
+            return;
+
+        geode->removeDrawables( 0, geode->getNumDrawables() );
+        for( DrawableList::const_iterator j = drawables.begin(); j != drawables.end(); ++j )
+        {
+            j->get()->setDataVariance( osg::Object::DYNAMIC );
+            geode->addDrawable( j->get() );
+        }
+    }
+
     // override osg Text to get at some of the internal properties
     struct LabelText : public osgText::Text
     {
@@ -779,33 +871,48 @@ LabelControl::calcSize(const ControlContext& cx, osg::Vec2f& out_size)
     if ( visible() == true )
     {
         // we have to create the drawable during the layout pass so we can calculate its size.
-        LabelText* t = new LabelText();
+        // After that it's updated in place: each property is only set when it changed,
+        // since every change makes the text lay out its glyphs again.
+        LabelText* t = static_cast<LabelText*>( _drawable.get() );
+        if ( !t )
+        {
+            t = new LabelText();
 
 #if 1
-        // needs a special shader
-        // todo: doesn't work. why?
-        osg::Program* program = new osg::Program();
-        program->addShader( new osg::Shader( osg::Shader::VERTEX, s_controlVertexShader ) );
-        program->addShader( new osg::Shader( osg::Shader::FRAGMENT, s_labelControlFragmentShader ) );
-        t->getOrCreateStateSet()->setAttributeAndModes( program, osg::StateAttribute::ON );
+            // needs a special shader
+            // todo: doesn't work. why?
+            osg::Program* program = new osg::Program();
+            program->addShader( new osg::Shader( osg::Shader::VERTEX, s_controlVertexShader ) );
+            program->addShader( new osg::Shader( osg::Shader::FRAGMENT, s_labelControlFragmentShader ) );
+            t->getOrCreateStateSet()->setAttributeAndModes( program, osg::StateAttribute::ON );
 #endif
 
-        t->setText( _text, _encoding );
-        // yes, object coords. screen coords won't work becuase the bounding box will be wrong.
-        t->setCharacterSizeMode( osgText::Text::OBJECT_COORDS );
-        t->setCharacterSize( _fontSize );
-        // always align to top. layout alignment gets calculated layer in Control::calcPos().
-        t->setAlignment( osgText::Text::LEFT_TOP ); 
-        t->setColor( foreColor().value() );
-        if ( _font.valid() )
+            // yes, object coords. screen coords won't work becuase the bounding box will be wrong.
+            t->setCharacterSizeMode( osgText::Text::OBJECT_COORDS );
+            // always align to top. layout alignment gets calculated layer in Control::calcPos().
+            t->setAlignment( osgText::Text::LEFT_TOP ); 
+        }
+
+        osgText::String text( _text, _encoding );
+        if ( text != t->getText() )
+            t->setText( text );
+        if ( t->getCharacterHeight() != _fontSize )
+            t->setCharacterSize( _fontSize );
+        if ( t->getColor() != foreColor().value() )
+            t->setColor( foreColor().value() );
+        if ( _font.valid() && t->getFont() != _font.get() )
             t->setFont( _font.get() );
 
         if ( haloColor().isSet() )
         {
-            t->setBackdropType( _backdropType );
-            t->setBackdropImplementation( _backdropImpl );
-            t->setBackdropOffset( _backdropOffset );
-            t->setBackdropColor( haloColor().value() );
+            if ( t->getBackdropType() != _backdropType )
+                t->setBackdropType( _backdropType );
+            if ( t->getBackdropImplementation() != _backdropImpl )
+                t->setBackdropImplementation( _backdropImpl );
+            if ( t->getBackdropHorizontalOffset() != _backdropOffset || t->getBackdropVerticalOffset() != _backdropOffset )
+                t->setBackdropOffset( _backdropOffset );
+            if ( t->getBackdropColor() != haloColor().value() )
+                t->setBackdropColor( haloColor().value() );
         }
 
         osg::BoundingBox bbox = t->getTextBB();
@@ -853,8 +960,9 @@ LabelControl::draw( const ControlContext& cx, DrawableList& out )
         float vph = cx._vp->height(); // - padding().bottom();
 
         LabelText* t = static_cast<LabelText*>( _drawable.get() );
-        osg::BoundingBox bbox = t->getTextBB();
-        t->setPosition( osg::Vec3( _renderPos.x(), vph - _renderPos.y(), 0 ) );
+        osg::Vec3 pos( _renderPos.x(), vph - _renderPos.y(), 0 );
+        if ( t->getPosition() != pos )
+            t->setPosition( pos );
         out.push_back( _drawable.get() );
     }
 }
@@ -1502,6 +1610,22 @@ Container::calcSize(const ControlContext& cx, osg::Vec2f& out_size)
     }
 }
 
+void
+Container::dirtyAll()
+{
+    Control::dirtyAll();
+    for( ControlList::const_iterator i = children().begin(); i != children().end(); ++i )
+        i->get()->dirtyAll();
+}
+
+void
+Container::restoreSize()
+{
+    Control::restoreSize();
+    for( ControlList::const_iterator i = children().begin(); i != children().end(); ++i )
+        i->get()->restoreSize();
+}
+
 void
 Container::calcFill(const ControlContext& cx)
 {
@@ -1609,7 +1733,7 @@ VBox::calcSize(const ControlContext& cx, osg::Vec2f& out_size)
             osg::Vec2f childSize;
             bool first = i == _controls.begin();
 
-            child->calcSize( cx, childSize );
+            child->updateSize( cx, childSize );
 
             _renderSize.x() = osg::maximum( _renderSize.x(), childSize.x() );
             _renderSize.y() += first ? childSize.y() : childSpacing() + childSize.y();
@@ -1683,7 +1807,7 @@ VBox::calcPos(const ControlContext& cx, const osg::Vec2f& cursor, const osg::Vec
     for( ControlList::const_iterator i = _controls.begin(); i != _controls.end(); ++i )
     {
         Control* child = i->get();
-        child->calcPos( cx, childCursor, renderArea ); // GW1
+        child->updatePos( cx, childCursor, renderArea ); // GW1
         float deltaY = child->margin().top() + child->renderSize().y() + child->margin().bottom() + childSpacing();
         childCursor.y() += deltaY;
         renderArea.y() -= deltaY;
@@ -1697,7 +1821,7 @@ VBox::draw( const ControlContext& cx, DrawableList& out )
     {
         Container::draw( cx, out );
         for( ControlList::const_iterator i = _controls.begin(); i != _controls.end(); ++i )
-            i->get()->draw( cx, out );
+            i->get()->updateDrawables( cx, out );
     }
 }
 
@@ -1751,7 +1875,7 @@ HBox::calcSize(const ControlContext& cx, osg::Vec2f& out_size)
             osg::Vec2f childSize;
             bool first = i == _controls.begin();
 
-            child->calcSize( cx, childSize );
+            child->updateSize( cx, childSize );
 
             _renderSize.x() += first ? childSize.x() : childSpacing() + childSize.x();
             _renderSize.y() = osg::maximum( _renderSize.y(), childSize.y() );
@@ -1822,7 +1946,7 @@ HBox::calcPos(const ControlContext& cx, const osg::Vec2f& cursor, const osg::Vec
     for( ControlList::const_iterator i = _controls.begin(); i != _controls.end(); ++i )
     {
         Control* child = i->get();
-        child->calcPos( cx, childCursor, renderArea );
+        child->updatePos( cx, childCursor, renderArea );
         float deltaX = child->margin().left() + child->renderSize().x() + child->margin().right() + childSpacing();
         childCursor.x() += deltaX;
         renderArea.x() -= deltaX;        
@@ -1834,7 +1958,7 @@ HBox::draw( const ControlContext& cx, DrawableList& out )
 {
     Container::draw( cx, out );
     for( ControlList::const_iterator i = _controls.begin(); i != _controls.end(); ++i )
-        i->get()->draw( cx, out );
+        i->get()->updateDrawables( cx, out );
 }
 
 // ---------------------------------------------------------------------------
@@ -1968,7 +2092,7 @@ Grid::calcSize( const ControlContext& cx, osg::Vec2f& out_size )
                     if ( child )
                     {
                         osg::Vec2f childSize;
-                        child->calcSize( cx, childSize );
+                        child->updateSize( cx, childSize );
 
                         if ( childSize.x() > _colWidths[c] )
                             _colWidths[c] = childSize.x();
@@ -2044,7 +2168,7 @@ Grid::calcPos( const ControlContext& cx, const osg::Vec2f& cursor, const osg::Ve
             if ( child )
             {
                 osg::Vec2f cellSize( _colWidths[c], _rowHeights[r] );
-                child->calcPos( cx, childCursor, cellSize );
+                child->updatePos( cx, childCursor, cellSize );
             }
             childCursor.x() += _colWidths[c] + childSpacing();
         }
@@ -2060,7 +2184,7 @@ Grid::draw( const ControlContext& cx, DrawableList& out )
     {
         Container::draw( cx, out );
         for( ControlList::const_iterator i = _children.begin(); i != _children.end(); ++i )
-            i->get()->draw( cx, out );
+            i->get()->updateDrawables( cx, out );
     }
 }
 
@@ -2356,7 +2480,7 @@ ControlNodeBin::draw( const ControlContext& context, bool newContext, int bin )
           // even if they're obscured...that way they will regenerate properly next time
           if ( newContext )
           {
-              control->dirty();
+              control->dirtyAll();
           }
 
           bool visible = true;
@@ -2418,26 +2542,18 @@ ControlNodeBin::draw( const ControlContext& context, bool newContext, int bin )
                   // if the control changed, we need to rebuild its drawables:
                   if ( control->isDirty() )
                   {
-                      // clear out the geode:
-                      geode->removeDrawables( 0, geode->getNumDrawables() );
-
                       // calculate the size of the control in screen space:
                       osg::Vec2f dummySize;
-                      control->calcSize( context, dummySize );
+                      control->updateSize( context, dummySize );
                       control->calcFill( context );
 
                       // only need to do this if the control has children ... (pos is always 0,0)
-                      control->calcPos( context, osg::Vec2f(0,0), size );
+                      control->updatePos( context, osg::Vec2f(0,0), size );
                    
                       // build the drawables for the geode and insert them:
                       DrawableList drawables;
-                      control->draw( context, drawables );
-
-                      for( DrawableList::iterator j = drawables.begin(); j != drawables.end(); ++j )
-                      {
-                          j->get()->setDataVariance( osg::Object::DYNAMIC );
-                          geode->addDrawable( j->get() );
-                      }
+                      control->updateDrawables( context, drawables );
+                      setDrawables( geode, drawables );
                   }
 
                   if ( _fading )
@@ -2725,25 +2841,23 @@ ControlCanvas::update( const osg::FrameStamp* frameStamp )
     for( ControlList::iterator i = _controls.begin(); i != _controls.end(); ++i )
     {
         Control* control = i->get();
-        if ( control->isDirty() || _contextDirty )
+
+        // a new context (e.g. a resized viewport) invalidates all cached layout.
+        if ( _contextDirty )
+            control->dirtyAll();
+
+        if ( control->isDirty() )
         {
             osg::Vec2f size;
-            control->calcSize( _context, size );
+            control->updateSize( _context, size );
             control->calcFill( _context );
 
             osg::Vec2f surfaceSize( _context._vp->width(), _context._vp->height() );
-            control->calcPos( _context, osg::Vec2f(0,0), surfaceSize );
+            control->updatePos( _context, osg::Vec2f(0,0), surfaceSize );
 
-            osg::Geode* geode = _geodeTable[control];
-            geode->removeDrawables( 0, geode->getNumDrawables() );
             DrawableList drawables;
-            control->draw( _context, drawables );
-
-            for( DrawableList::iterator j = drawables.begin(); j != drawables.end(); ++j )
-            {
-                j->get()->setDataVariance( osg::Object::DYNAMIC );
-                geode->addDrawable( j->get() );
-            }
+            control->updateDrawables( _context, drawables );
+            setDrawables( _geodeTable[control], drawables );
         }
     }
 
@@ -18,8 +18,17 @@
 */
 #include <osgEarthUtil/DataScanner>
 #include <osgEarthDrivers/gdal/GDALOptions>
+#include <osgEarth/Registry>
+#include <osgEarth/TaskService>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <OpenThreads/Thread>
+#include <gdal.h>
+#include <sys/stat.h>
+#include <cfloat>
+#include <fstream>
+#include <sstream>
+#include <map>
 
 #define LC "[DataScanner] "
 
@@ -27,11 +36,70 @@ using namespace osgEarth;
 using namespace osgEarth::Util;
 using namespace osgEarth::Drivers;
 
+#define METADATA_FILE_VERSION 1
+
 namespace
 {
-    void traverse(const std::string&              path,
-                  const std::vector<std::string>& extensions,
-                  ImageLayerVector&               out_imageLayers)
+    typedef DataScanner::FileInfo       FileInfo;
+    typedef DataScanner::FileInfoVector FileInfoVector;
+    typedef std::map<std::string, FileInfo> FileInfoMap;
+
+    /** Opens one file with GDAL and records its metadata. */
+    struct ProbeFile
+    {
+        ProbeFile() : _info(0L) { }
+
+        void execute()
+        {
+            // Each probe opens its own dataset, and GDAL handles on distinct
+            // files are independent, so probes run without the global GDAL
+            // lock; the drivers were registered when the Registry was created.
+            GDALDatasetH ds = GDALOpen( _info->_path.c_str(), GA_ReadOnly );
+            if ( !ds )
+                return;
+
+            _info->_width  = GDALGetRasterXSize( ds );
+            _info->_height = GDALGetRasterYSize( ds );
+            _info->_bands  = GDALGetRasterCount( ds );
+            if ( _info->_bands > 0 )
+                _info->_bandType = GDALGetDataTypeName( GDALGetRasterDataType(GDALGetRasterBand(ds, 1)) );
+
+            const char* wkt = GDALGetProjectionRef( ds );
+            if ( wkt )
+                _info->_srs = wkt;
+
+            double gt[6];
+            if ( GDALGetGeoTransform(ds, gt) == CE_None )
+            {
+                _info->_xmin = _info->_ymin =  DBL_MAX;
+                _info->_xmax = _info->_ymax = -DBL_MAX;
+                for( unsigned c = 0; c < 4; ++c )
+                {
+                    double px = (c & 1) ? _info->_width  : 0.0;
+                    double py = (c & 2) ? _info->_height : 0.0;
+                    double x = gt[0] + px*gt[1] + py*gt[2];
+                    double y = gt[3] + px*gt[4] + py*gt[5];
+                    _info->_xmin = osg::minimum( _info->_xmin, x );
+                    _info->_xmax = osg::maximum( _info->_xmax, x );
+                    _info->_ymin = osg::minimum( _info->_ymin, y );
+                    _info->_ymax = osg::maximum( _info->_ymax, y );
+                }
+                _info->_hasExtent = true;
+            }
+
+            GDALClose( ds );
+
+            _info->_valid = _info->_bands > 0 && _info->_width > 0 && _info->_height > 0;
+        }
+
+        FileInfo* _info;
+    };
+
+    typedef ParallelTask<ProbeFile> ProbeFileTask;
+
+    void collect(const std::string&              path,
+                 const std::vector<std::string>& extensions,
+                 FileInfoVector&                 out_files)
     {
         if ( osgDB::fileType(path) == osgDB::DIRECTORY )
         {
@@ -42,7 +110,7 @@ namespace
                     continue;
 
                 std::string filepath = osgDB::concatPaths( path, *f );
-                traverse( filepath, extensions, out_imageLayers );
+                collect( filepath, extensions, out_files );
             }
         }
 
@@ -52,26 +120,201 @@ namespace
 
             if ( std::find(extensions.begin(), extensions.end(), ext) != extensions.end() )
             {
-                GDALOptions gdal;
-                gdal.url() = path;
-                //gdal.interpolation() = INTERP_NEAREST;
+                struct stat buf;
+                if ( ::stat(path.c_str(), &buf) != 0 )
+                    return;
+
+                FileInfo info;
+                info._path  = path;
+                info._size  = (long long)buf.st_size;
+                info._mtime = (long long)buf.st_mtime;
+                out_files.push_back( info );
+            }
+        }
+    }
+
+    bool readCache( const std::string& filename, FileInfoMap& out_cache )
+    {
+        std::ifstream in( filename.c_str() );
+        if ( !in.is_open() )
+            return false;
+
+        std::stringstream buf;
+        buf << in.rdbuf();
 
-                ImageLayerOptions options( path, gdal );
-                options.cachePolicy() = CachePolicy::NO_CACHE;
+        Config conf;
+        if ( !conf.fromJSON(buf.str()) || conf.value<int>("file_version", 0) != METADATA_FILE_VERSION )
+        {
+            OE_INFO << LC << "Ignoring unreadable metadata cache " << filename << std::endl;
+            return false;
+        }
 
-                ImageLayer* layer = new ImageLayer(options);
-                out_imageLayers.push_back( layer );
-                OE_INFO << LC << "Found " << path << std::endl;
+        ConfigSet files = conf.children( "file" );
+        for( ConfigSet::const_iterator i = files.begin(); i != files.end(); ++i )
+        {
+            FileInfo info;
+            i->getIfSet( "path",       info._path );
+            i->getIfSet( "size",       info._size );
+            i->getIfSet( "mtime",      info._mtime );
+            i->getIfSet( "srs",        info._srs );
+            i->getIfSet( "xmin",       info._xmin );
+            i->getIfSet( "ymin",       info._ymin );
+            i->getIfSet( "xmax",       info._xmax );
+            i->getIfSet( "ymax",       info._ymax );
+            i->getIfSet( "width",      info._width );
+            i->getIfSet( "height",     info._height );
+            i->getIfSet( "bands",      info._bands );
+            i->getIfSet( "band_type",  info._bandType );
+            i->getIfSet( "has_extent", info._hasExtent );
+            i->getIfSet( "valid",      info._valid );
+            if ( !info._path.empty() )
+                out_cache[info._path] = info;
+        }
+        return true;
+    }
+
+    bool writeCache( const std::string& filename, const FileInfoMap& cache )
+    {
+        Config conf( "metadata" );
+        conf.add( "file_version", METADATA_FILE_VERSION );
+
+        for( FileInfoMap::const_iterator i = cache.begin(); i != cache.end(); ++i )
+        {
+            const FileInfo& info = i->second;
+            Config file( "file" );
+            file.add( "path",       info._path );
+            file.add( "size",       info._size );
+            file.add( "mtime",      info._mtime );
+            file.add( "valid",      info._valid );
+            if ( !info._srs.empty() )
+                file.add( "srs", info._srs );
+            if ( info._hasExtent )
+            {
+                file.add( "has_extent", true );
+                file.add( "xmin", info._xmin );
+                file.add( "ymin", info._ymin );
+                file.add( "xmax", info._xmax );
+                file.add( "ymax", info._ymax );
             }
+            file.add( "width",      info._width );
+            file.add( "height",     info._height );
+            file.add( "bands",      info._bands );
+            if ( !info._bandType.empty() )
+                file.add( "band_type", info._bandType );
+            conf.add( file );
         }
+
+        std::ofstream out( filename.c_str() );
+        if ( !out.is_open() )
+        {
+            OE_WARN << LC << "Cannot write metadata cache " << filename << std::endl;
+            return false;
+        }
+
+        out << conf.toJSON( true );
+        out.flush();
+        return !out.fail();
     }
 }
 
+//------------------------------------------------------------------------
+
+DataScanner::DataScanner() :
+_numThreads( OpenThreads::GetNumberOfProcessors() )
+{
+    //nop
+}
+
+void
+DataScanner::scan(const std::string&              absRootPath,
+                  const std::vector<std::string>& extensions,
+                  FileInfoVector&                 out_files) const
+{
+    // makes sure the GDAL drivers are registered before any probe runs.
+    Registry::instance();
+
+    FileInfoVector files;
+    collect( absRootPath, extensions, files );
+
+    FileInfoMap cache;
+    if ( !_cacheFile.empty() )
+        readCache( _cacheFile, cache );
+
+    // reuse what the cache knows about unchanged files, probe the rest.
+    std::vector< osg::ref_ptr<ProbeFileTask> > tasks;
+    for( FileInfoVector::iterator i = files.begin(); i != files.end(); ++i )
+    {
+        FileInfoMap::const_iterator c = cache.find( i->_path );
+        if ( c != cache.end() && c->second._size == i->_size && c->second._mtime == i->_mtime )
+        {
+            *i = c->second;
+        }
+        else
+        {
+            ProbeFileTask* task = new ProbeFileTask();
+            task->_info = &(*i);
+            tasks.push_back( task );
+        }
+    }
+
+    OE_INFO << LC << "Scanned " << files.size() << " files under " << absRootPath
+        << "; " << tasks.size() << " new or changed" << std::endl;
+
+    if ( !tasks.empty() )
+    {
+        Threading::MultiEvent semaphore( tasks.size() );
+        osg::ref_ptr<TaskService> service;
+        if ( _numThreads > 0 )
+            service = new TaskService( "DataScanner", osg::minimum(_numThreads, (unsigned)tasks.size()) );
+
+        for( unsigned t = 0; t < tasks.size(); ++t )
+        {
+            tasks[t]->_mev = &semaphore;
+            if ( service.valid() )
+                service->add( tasks[t].get() );
+            else
+                (*tasks[t])( 0L );
+        }
+
+        semaphore.wait();
+
+        if ( !_cacheFile.empty() )
+        {
+            // keep the entries of files outside this scan for other roots.
+            for( FileInfoVector::const_iterator i = files.begin(); i != files.end(); ++i )
+                cache[i->_path] = *i;
+            writeCache( _cacheFile, cache );
+        }
+    }
+
+    out_files.insert( out_files.end(), files.begin(), files.end() );
+}
 
 void
 DataScanner::findImageLayers(const std::string&              absRootPath,
                              const std::vector<std::string>& extensions,
                              ImageLayerVector&               out_imageLayers) const
 {
-    traverse( absRootPath, extensions, out_imageLayers );
+    FileInfoVector files;
+    scan( absRootPath, extensions, files );
+
+    for( FileInfoVector::const_iterator i = files.begin(); i != files.end(); ++i )
+    {
+        if ( !i->_valid )
+        {
+            OE_INFO << LC << "Skipping " << i->_path << ", GDAL cannot read it" << std::endl;
+            continue;
+        }
+
+        GDALOptions gdal;
+        gdal.url() = i->_path;
+        //gdal.interpolation() = INTERP_NEAREST;
+
+        ImageLayerOptions options( i->_path, gdal );
+        options.cachePolicy() = CachePolicy::NO_CACHE;
+
+        ImageLayer* layer = new ImageLayer(options);
+        out_imageLayers.push_back( layer );
+        OE_INFO << LC << "Found " << i->_path << std::endl;
+    }
 }
@@ -596,7 +596,9 @@ EarthManipulator::established()
         {
             _terrainCallback = new ManipTerrainCallback( this );
             mapNode->getTerrain()->addTerrainCallback( _terrainCallback );
+            _terrain = mapNode->getTerrain();
         }
+        _groundQueries.clear();
 
         // find a CSN node - if there is one, we want to attach the manip to that
         _csn = findRelativeNodeOfType<osg::CoordinateSystemNode>( safeNode.get(), _findNodeTraversalMask );
@@ -1128,6 +1130,39 @@ EarthManipulator::getTetherNode() const
 
 bool
 EarthManipulator::intersect(const osg::Vec3d& start, const osg::Vec3d& end, osg::Vec3d& intersection) const
+{
+    for( std::vector<GroundQuery>::const_iterator i = _groundQueries.begin(); i != _groundQueries.end(); ++i )
+    {
+        if ( i->_start == start && i->_end == end )
+        {
+            if ( i->_found )
+                intersection = i->_hit;
+            return i->_found;
+        }
+    }
+
+    GroundQuery query;
+    query._start = start;
+    query._end   = end;
+
+    osg::ref_ptr<Terrain> terrain;
+    if ( _intersectTraversalMask == 0xffffffff && _terrain.lock(terrain) )
+        query._found = terrain->intersect( start, end, query._hit );
+    else
+        query._found = intersectScene( start, end, query._hit );
+
+    // a drag visits only a handful of segments per frame.
+    if ( _groundQueries.size() >= 16 )
+        _groundQueries.erase( _groundQueries.begin() );
+    _groundQueries.push_back( query );
+
+    if ( query._found )
+        intersection = query._hit;
+    return query._found;
+}
+
+bool
+EarthManipulator::intersectScene(const osg::Vec3d& start, const osg::Vec3d& end, osg::Vec3d& intersection) const
 {
     osg::ref_ptr<osg::Node> safeNode = _node.get();
     if ( safeNode.valid() )
@@ -1352,6 +1387,9 @@ EarthManipulator::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapt
         // this factor adjusts for the variation of frame rate relative to 60fps
         _t_factor = _delta_t / 0.01666666666;
 
+        // the camera (or the terrain) may have moved since the last frame.
+        _groundQueries.clear();
+
         if ( _has_pending_viewpoint && _node.valid() )
         {
             _has_pending_viewpoint = false;
@@ -1874,7 +1912,7 @@ EarthManipulator::setByMatrix(const osg::Matrixd& matrix)
     
     osg::Vec3d ip;
     bool hitFound = false;
-    if (intersect(start_segment, end_segment, ip))
+    if (intersectScene(start_segment, end_segment, ip))
     {
         setCenter( ip );
         _centerRotation = makeCenterRotation(_center);
@@ -1894,7 +1932,7 @@ EarthManipulator::setByMatrix(const osg::Matrixd& matrix)
 
         osg::Vec3d eyeUp = getUpVector(eyeCoordFrame);
 
-        if (intersect(eye + eyeUp*distance, eye - eyeUp*distance, ip))
+        if (intersectScene(eye + eyeUp*distance, eye - eyeUp*distance, ip))
         {
             setCenter( ip );
             _centerRotation = makeCenterRotation(_center);
@@ -1957,7 +1995,7 @@ EarthManipulator::setByLookAt(const osg::Vec3d& eye,const osg::Vec3d& center,con
             // compute the intersection with the scene.s
             
             osg::Vec3d ip;
-            if (intersect(eye, endPoint, ip))
+            if (intersectScene(eye, endPoint, ip))
             {
                 setCenter( ip );
                 setDistance( (ip-eye).length() );
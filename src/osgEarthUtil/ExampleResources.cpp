@@ -23,17 +23,21 @@
 #include <osgEarthUtil/MGRSFormatter>
 #include <osgEarthUtil/MouseCoordsTool>
 #include <osgEarthUtil/AutoClipPlaneHandler>
+#include <osgEarthUtil/FrameRateGovernor>
 #include <osgEarthUtil/DataScanner>
 
 #include <osgEarthUtil/NormalMap>
 #include <osgEarthUtil/DetailTexture>
+#include <osgEarthUtil/NoiseMap>
 #include <osgEarthUtil/LODBlending>
 #include <osgEarthUtil/VerticalScale>
 #include <osgEarthUtil/ContourMap>
 
 #include <osgEarthAnnotation/AnnotationData>
 #include <osgEarthAnnotation/AnnotationRegistry>
+#include <osgEarth/Capabilities>
 #include <osgEarth/Decluttering>
+#include <osgEarth/Registry>
 
 #include <osgEarth/XmlUtils>
 #include <osgEarth/StringUtils>
@@ -41,10 +45,14 @@
 #include <osgEarthDrivers/kml/KML>
 
 #include <osgGA/StateSetManipulator>
+#include <osgViewer/ViewerBase>
 #include <osgViewer/ViewerEventHandlers>
 #include <osgDB/FileNameUtils>
 #include <osgDB/WriteFile>
 
+#include <cfloat>
+#include <iomanip>
+
 #define KML_PUSHPIN_URL "http://demo.pelicanmapping.com/icons/pushpin_yellow.png"
 
 #define VP_DURATION          4.5     // time to fly to a viewpoint
@@ -212,6 +220,56 @@ MouseCoordsControlFactory::create(MapNode*         mapNode,
 
 //------------------------------------------------------------------------
 
+namespace
+{
+    struct MemoryUsageHandler : public osgGA::GUIEventHandler
+    {
+        MemoryUsageHandler( Grid* grid, double refreshSeconds )
+            : _grid(grid), _refresh(refreshSeconds), _last(-DBL_MAX) { }
+
+        bool handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa )
+        {
+            if ( ea.getEventType() == ea.FRAME && ea.getTime() - _last >= _refresh && _grid.valid() )
+            {
+                _last = ea.getTime();
+
+                MemoryUsageMap usage;
+                Registry::instance()->getMemoryUsage( usage );
+
+                _grid->clearControls();
+                double total = 0.0;
+                unsigned row = 0;
+                for( MemoryUsageMap::const_iterator i = usage.begin(); i != usage.end(); ++i, ++row )
+                {
+                    _grid->setControl( 0, row, new LabelControl(i->first, 13.0f) );
+                    _grid->setControl( 1, row, new LabelControl(Stringify() << std::fixed << std::setprecision(1) << i->second/1048576.0 << " MB", 13.0f) );
+                    total += i->second;
+                }
+                _grid->setControl( 0, row, new LabelControl("total", 13.0f, osg::Vec4f(1,1,0,1)) );
+                _grid->setControl( 1, row, new LabelControl(Stringify() << std::fixed << std::setprecision(1) << total/1048576.0 << " MB", 13.0f, osg::Vec4f(1,1,0,1)) );
+            }
+            return false;
+        }
+
+        osg::observer_ptr<Grid> _grid;
+        double                  _refresh;
+        double                  _last;
+    };
+}
+
+Control*
+MemoryUsageControlFactory::create(osgViewer::View* view,
+                                  double           refreshSeconds) const
+{
+    Grid* grid = new Grid();
+    grid->setChildSpacing( 5 );
+    grid->setBackColor( Color(Color::Black, 0.8) );
+    view->addEventHandler( new MemoryUsageHandler(grid, refreshSeconds) );
+    return grid;
+}
+
+//------------------------------------------------------------------------
+
 namespace
 {
     struct SkySliderHandler : public ControlEventHandler
@@ -528,6 +586,10 @@ MapNodeHelper::parse(MapNode*             mapNode,
     bool useCoords     = args.read("--coords") || useMGRS || useDMS || useDD;
     bool useOrtho      = args.read("--ortho");
     bool useAutoClip   = args.read("--autoclip");
+    bool useMemory     = args.read("--memory");
+
+    double governorHz = 0.0;
+    args.read("--governor", governorHz);
 
     float ambientBrightness = 0.2f;
     args.read("--ambientBrightness", ambientBrightness);
@@ -541,6 +603,9 @@ MapNodeHelper::parse(MapNode*             mapNode,
     std::string imageExtensions;
     args.read("--image-extensions", imageExtensions);
 
+    std::string imageMetadata;
+    args.read("--image-metadata", imageMetadata);
+
     // install a canvas for any UI controls we plan to create:
     ControlCanvas* canvas = ControlCanvas::get(view, false);
 
@@ -566,6 +631,7 @@ MapNodeHelper::parse(MapNode*             mapNode,
     // some terrain effects.
     const Config& normalMapConf   = externals.child("normal_map");
     const Config& detailTexConf   = externals.child("detail_texture");
+    const Config& noiseMapConf    = externals.child("noise_map");
     const Config& lodBlendingConf = externals.child("lod_blending");
     const Config& vertScaleConf   = externals.child("vertical_scale");
     const Config& contourMapConf  = externals.child("contour_map");
@@ -686,6 +752,15 @@ MapNodeHelper::parse(MapNode*             mapNode,
         canvas->addControl( readout );
     }
 
+    // Configure the memory usage readout:
+    if ( useMemory )
+    {
+        Control* c = MemoryUsageControlFactory().create(view);
+        c->setHorizAlign( Control::ALIGN_RIGHT );
+        c->setVertAlign( Control::ALIGN_TOP );
+        canvas->addControl( c );
+    }
+
     // Configure for an ortho camera:
     if ( useOrtho )
     {
@@ -702,6 +777,16 @@ MapNodeHelper::parse(MapNode*             mapNode,
         mapNode->addCullCallback( new AutoClipPlaneCullCallback(mapNode) );
     }
 
+    // Trade terrain and feature detail, paging and compile budgets for frame rate:
+    if ( governorHz > 0.0 )
+    {
+        FrameRateGovernor* governor = new FrameRateGovernor( governorHz );
+        if ( mapNode->getTerrainEngine() )
+            governor->addLODScale( mapNode->getTerrainEngine(), 3.0f );
+        governor->addLODScale( mapNode->getModelLayerGroup(), 2.0f );
+        view->addEventHandler( governor );
+    }
+
     // Scan for images if necessary.
     if ( !imageFolder.empty() )
     {
@@ -714,28 +799,23 @@ MapNodeHelper::parse(MapNode*             mapNode,
         OE_INFO << LC << "Loading images from " << imageFolder << "..." << std::endl;
         ImageLayerVector imageLayers;
         DataScanner scanner;
+        scanner.setMetadataCache( imageMetadata );
         scanner.findImageLayers( imageFolder, extensions, imageLayers );
 
         if ( imageLayers.size() > 0 )
         {
-            mapNode->getMap()->beginUpdate();
-            for( ImageLayerVector::iterator i = imageLayers.begin(); i != imageLayers.end(); ++i )
-            {
-                mapNode->getMap()->addImageLayer( i->get() );
-            }
-            mapNode->getMap()->endUpdate();
+            // starts the layers' tile sources in parallel.
+            mapNode->getMap()->addLayers( imageLayers, ElevationLayerVector() );
         }
         OE_INFO << LC << "...found " << imageLayers.size() << " image layers." << std::endl;
     }
 
-    // Install a normal map layer.
+    // Install a normal map layer. Without a layer, the effect derives normals
+    // from the terrain's elevation textures.
     if ( !normalMapConf.empty() )
     {
         osg::ref_ptr<NormalMap> effect = new NormalMap(normalMapConf, mapNode->getMap());
-        if ( effect->getNormalMapLayer() )
-        {
-            mapNode->getTerrainEngine()->addEffect( effect.get() );
-        }
+        mapNode->getTerrainEngine()->addEffect( effect.get() );
     }
 
     // Install a detail texturer
@@ -748,6 +828,12 @@ MapNodeHelper::parse(MapNode*             mapNode,
         }
     }
 
+    // Install procedural noise detail
+    if ( !noiseMapConf.empty() )
+    {
+        mapNode->getTerrainEngine()->addEffect( new NoiseMap(noiseMapConf) );
+    }
+
     // Install elevation morphing
     if ( !lodBlendingConf.empty() )
     {
@@ -807,6 +893,10 @@ MapNodeHelper::configureView( osgViewer::View* view ) const
     view->addEventHandler(new osgViewer::ThreadingHandler());
     view->addEventHandler(new osgViewer::LODScaleHandler());
     view->addEventHandler(new osgGA::StateSetManipulator(view->getCamera()->getOrCreateStateSet()));
+
+    // check (or take) the graphics capabilities on the real context.
+    if ( view->getViewerBase() && !view->getViewerBase()->getRealizeOperation() )
+        view->getViewerBase()->setRealizeOperation( new CapabilitiesCheckOperation() );
 }
 
 
@@ -823,8 +913,11 @@ MapNodeHelper::usage() const
         << "  --mgrs                        : show MGRS coords under mouse\n"
         << "  --ortho                       : use an orthographic camera\n"
         << "  --autoclip                    : installs an auto-clip plane callback\n"
+        << "  --memory                      : show the memory held by each osgEarth subsystem\n"
+        << "  --governor <hz>               : lower detail as needed to hold a frame rate\n"
         << "  --images [path]               : finds and loads image layers from folder [path]\n"
         << "  --image-extensions [ext,...]  : with --images, extensions to use\n"
+        << "  --image-metadata [file]       : with --images, caches file metadata between runs\n"
         << "  --out-earth [file]            : write the loaded map to an earth file\n"
         << "  --uniform [name] [min] [max]  : create a uniform controller with min/max values\n";
 }
@@ -55,8 +55,118 @@ void
 FeatureQueryTool::setMapNode( MapNode* mapNode )
 {
     _mapNode = mapNode;
+
+    if ( _rttPicker.valid() )
+    {
+        _rttPicker->getGroup()->removeChildren( 0, _rttPicker->getGroup()->getNumChildren() );
+        if ( mapNode )
+            _rttPicker->addChild( mapNode->getModelLayerGroup() );
+    }
+}
+
+void
+FeatureQueryTool::setUseObjectIDPicking( bool value )
+{
+    if ( value == _rttPicker.valid() )
+        return;
+
+    if ( value )
+    {
+        _rttPicker = new RTTPicker();
+        if ( getMapNode() )
+            _rttPicker->addChild( getMapNode()->getModelLayerGroup() );
+    }
+    else
+    {
+        _rttPicker = 0L;
+    }
+}
+
+void
+FeatureQueryTool::fireHit( FeatureSourceIndexNode* index, FeatureID fid, const Callback::EventArgs& args )
+{
+    for( Callbacks::iterator i = _callbacks.begin(); i != _callbacks.end(); )
+    {
+        if ( i->valid() )
+        {
+            i->get()->onHit( index, fid, args );
+            ++i;
+        }
+        else
+        {
+            i = _callbacks.erase( i );
+        }
+    }
+}
+
+void
+FeatureQueryTool::fireMiss( const Callback::EventArgs& args )
+{
+    for( Callbacks::iterator i = _callbacks.begin(); i != _callbacks.end(); )
+    {
+        if ( i->valid() )
+        {
+            i->get()->onMiss( args );
+            ++i;
+        }
+        else
+        {
+            i = _callbacks.erase( i );
+        }
+    }
 }
 
+// Resolves an object ID pick to a feature and reports it to the tool's
+// callbacks, with the event that started the pick.
+struct FeatureQueryTool::RTTPickCallback : public RTTPicker::Callback
+{
+    RTTPickCallback( FeatureQueryTool* tool, const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa )
+        : _tool( tool ), _ea( &ea ), _aa( &aa ) { }
+
+    void onHit( ObjectID id )
+    {
+        osg::ref_ptr<FeatureQueryTool> tool;
+        if ( !_tool.lock(tool) )
+            return;
+
+        osg::ref_ptr<osg::Referenced> owner;
+        unsigned long                 data;
+        FeatureSourceIndexNode*       index = 0L;
+        if ( ObjectIndex::instance()->get(id, owner, data) )
+            index = dynamic_cast<FeatureSourceIndexNode*>( owner.get() );
+
+        Callback::EventArgs args;
+        args._ea = _ea.get();
+        args._aa = _aa;
+
+        if ( index )
+        {
+            OE_DEBUG << LC << "HIT: feature ID = " << (unsigned)data << std::endl;
+            tool->fireHit( index, (FeatureID)data, args );
+        }
+        else
+        {
+            tool->fireMiss( args );
+        }
+    }
+
+    void onMiss()
+    {
+        osg::ref_ptr<FeatureQueryTool> tool;
+        if ( !_tool.lock(tool) )
+            return;
+
+        Callback::EventArgs args;
+        args._ea = _ea.get();
+        args._aa = _aa;
+        tool->fireMiss( args );
+    }
+
+    osg::observer_ptr<FeatureQueryTool>       _tool;
+    osg::ref_ptr<const osgGA::GUIEventAdapter> _ea;
+    osgGA::GUIActionAdapter*                  _aa;
+};
+
 bool
 FeatureQueryTool::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa )
 {
@@ -76,7 +186,17 @@ FeatureQueryTool::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdap
             fabs(ea.getY()-_mouseDownY) <= 3.0;
     }
 
-    if ( attempt && getMapNode() )
+    // let the ID-buffer picker (if any) finish and issue its requests.
+    if ( _rttPicker.valid() )
+        _rttPicker->handle( ea, aa );
+
+    if ( attempt && getMapNode() && _rttPicker.valid() )
+    {
+        _rttPicker->pick( aa.asView(), ea.getX(), ea.getY(), new RTTPickCallback(this, ea, aa) );
+        _mouseDown = false;
+    }
+
+    else if ( attempt && getMapNode() )
     {
         osg::View* view = aa.asView();
 
@@ -121,18 +241,7 @@ FeatureQueryTool::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdap
                 args._aa = &aa;
                 args._worldPoint = closestWorldPt;
 
-                for( Callbacks::iterator i = _callbacks.begin(); i != _callbacks.end(); )
-                {
-                    if ( i->valid() )
-                    {
-                        i->get()->onHit( closestIndex, closestFID, args );
-                        ++i;
-                    }
-                    else
-                    {
-                        i = _callbacks.erase( i );
-                    }
-                }
+                fireHit( closestIndex, closestFID, args );
 
                 handled = true;
             }
@@ -146,18 +255,7 @@ FeatureQueryTool::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdap
             args._ea = &ea;
             args._aa = &aa;
 
-            for( Callbacks::iterator i = _callbacks.begin(); i != _callbacks.end(); )
-            {
-                if ( i->valid() )
-                {
-                    i->get()->onMiss( args );
-                    ++i;
-                }
-                else
-                {
-                    i = _callbacks.erase( i );
-                }
-            }
+            fireMiss( args );
         }
 
         _mouseDown = false;
@@ -0,0 +1,298 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthUtil/FrameRateGovernor>
+#include <osgEarth/CullingUtils>
+#include <osgEarth/Notify>
+#include <osgViewer/View>
+#include <osgDB/DatabasePager>
+#include <osgUtil/IncrementalCompileOperation>
+#include <osg/CullStack>
+
+#define LC "[FrameRateGovernor] "
+
+using namespace osgEarth::Util;
+using namespace osgEarth;
+
+// frame intervals longer than this are pauses (e.g. on-demand rendering), not load.
+#define MAX_FRAME_INTERVAL 1.0
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    /** Cull callback that multiplies the LOD scale of its subgraph. */
+    struct LODScaleCallback : public osg::NodeCallback
+    {
+        LODScaleCallback() : _factor( 1.0f ) { }
+
+        void operator()( osg::Node* node, osg::NodeVisitor* nv )
+        {
+            osg::CullStack* cs = dynamic_cast<osg::CullStack*>( nv );
+            if ( cs && _factor != 1.0f )
+            {
+                float lodScale = cs->getLODScale();
+                cs->setLODScale( lodScale * _factor );
+                traverse( node, nv );
+                cs->setLODScale( lodScale );
+            }
+            else
+            {
+                traverse( node, nv );
+            }
+        }
+
+        float _factor;
+    };
+
+    template<typename T>
+    T lerp( T worst, T best, float quality )
+    {
+        return (T)( (double)worst + (double)quality * ((double)best - (double)worst) );
+    }
+}
+
+//------------------------------------------------------------------------
+
+FrameRateGovernor::FrameRateGovernor( double targetFrameRate ) :
+_targetHz        ( 30.0 ),
+_hysteresis      ( 0.1 ),
+_degradeFrames   ( 10 ),
+_improveFrames   ( 60 ),
+_degradeStep     ( 0.1f ),
+_improveStep     ( 0.05f ),
+_quality         ( 1.0f ),
+_lastFrame       ( 0 ),
+_frameTime       ( 0.0 ),
+_overCount       ( 0 ),
+_underCount      ( 0 ),
+_pagerLimitsSet  ( false ),
+_bestPagedLODs   ( 0 ),
+_worstPagedLODs  ( 0 ),
+_compileLimitsSet( false ),
+_bestObjects     ( 0 ),
+_worstObjects    ( 0 ),
+_bestCompileTime ( 0.0 ),
+_worstCompileTime( 0.0 )
+{
+    setTargetFrameRate( targetFrameRate );
+}
+
+void
+FrameRateGovernor::setTargetFrameRate( double hz )
+{
+    _targetHz = osg::maximum( hz, 1.0 );
+}
+
+void
+FrameRateGovernor::setResponse( unsigned degradeFrames, unsigned improveFrames )
+{
+    _degradeFrames = osg::maximum( degradeFrames, 1u );
+    _improveFrames = osg::maximum( improveFrames, 1u );
+}
+
+void
+FrameRateGovernor::setStepSizes( float degradeStep, float improveStep )
+{
+    _degradeStep = osg::clampBetween( degradeStep, 0.01f, 1.0f );
+    _improveStep = osg::clampBetween( improveStep, 0.01f, 1.0f );
+}
+
+void
+FrameRateGovernor::addLODScale( osg::Node* node, float maxFactor )
+{
+    if ( !node )
+        return;
+
+    removeLODScale( node );
+
+    LODScaleTarget target;
+    target._node       = node;
+    target._maxFactor  = osg::maximum( maxFactor, 1.0f );
+    target._baseFactor = 1.0f;
+
+    LODScaleGroup* group = dynamic_cast<LODScaleGroup*>( node );
+    if ( group )
+    {
+        target._baseFactor = group->getLODScaleFactor();
+    }
+    else
+    {
+        target._callback = new LODScaleCallback();
+        node->addCullCallback( target._callback.get() );
+    }
+
+    _lodScales.push_back( target );
+}
+
+void
+FrameRateGovernor::removeLODScale( osg::Node* node )
+{
+    for( LODScaleTargets::iterator i = _lodScales.begin(); i != _lodScales.end(); )
+    {
+        osg::ref_ptr<osg::Node> safeNode = i->_node.get();
+        if ( !safeNode.valid() || safeNode.get() == node )
+        {
+            if ( safeNode.valid() )
+            {
+                // put it back the way we found it.
+                if ( i->_callback.valid() )
+                    safeNode->removeCullCallback( i->_callback.get() );
+                else
+                    static_cast<LODScaleGroup*>( safeNode.get() )->setLODScaleFactor( i->_baseFactor );
+            }
+            i = _lodScales.erase( i );
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+void
+FrameRateGovernor::setPagedLODLimits( unsigned best, unsigned worst )
+{
+    _bestPagedLODs  = best;
+    _worstPagedLODs = osg::minimum( worst, best );
+    _pagerLimitsSet = true;
+}
+
+void
+FrameRateGovernor::setCompileLimits( unsigned bestObjects, unsigned worstObjects, double bestTime, double worstTime )
+{
+    _bestObjects      = osg::maximum( bestObjects, 1u );
+    _worstObjects     = osg::clampBetween( worstObjects, 1u, _bestObjects );
+    _bestCompileTime  = osg::maximum( bestTime, 0.0 );
+    _worstCompileTime = osg::clampBetween( worstTime, 0.0, _bestCompileTime );
+    _compileLimitsSet = true;
+}
+
+bool
+FrameRateGovernor::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa )
+{
+    if ( ea.getEventType() != osgGA::GUIEventAdapter::FRAME )
+        return false;
+
+    osg::Timer_t now = osg::Timer::instance()->tick();
+    if ( _lastFrame == 0 )
+    {
+        _lastFrame = now;
+        return false;
+    }
+
+    double dt = osg::Timer::instance()->delta_s( _lastFrame, now );
+    _lastFrame = now;
+    if ( dt > MAX_FRAME_INTERVAL )
+        return false;
+
+    _frameTime = _frameTime > 0.0 ? 0.9*_frameTime + 0.1*dt : dt;
+
+    double target = 1.0/_targetHz;
+
+    if ( _frameTime > target * (1.0 + _hysteresis) )
+    {
+        _underCount = 0;
+        if ( ++_overCount >= _degradeFrames && _quality > 0.0f )
+        {
+            _overCount = 0;
+            step( -_degradeStep, aa );
+        }
+    }
+    else if ( _frameTime < target * (1.0 - _hysteresis) )
+    {
+        _overCount = 0;
+        if ( ++_underCount >= _improveFrames && _quality < 1.0f )
+        {
+            _underCount = 0;
+            step( _improveStep, aa );
+        }
+    }
+    else
+    {
+        _overCount  = 0;
+        _underCount = 0;
+    }
+
+    return false;
+}
+
+void
+FrameRateGovernor::step( float delta, osgGA::GUIActionAdapter& aa )
+{
+    _quality = osg::clampBetween( _quality + delta, 0.0f, 1.0f );
+
+    OE_INFO << LC << "Frame time " << getFrameTime() << " ms; quality now " << _quality << std::endl;
+
+    apply( aa );
+}
+
+void
+FrameRateGovernor::apply( osgGA::GUIActionAdapter& aa )
+{
+    // LOD scales:
+    for( LODScaleTargets::iterator i = _lodScales.begin(); i != _lodScales.end(); )
+    {
+        osg::ref_ptr<osg::Node> node = i->_node.get();
+        if ( !node.valid() )
+        {
+            i = _lodScales.erase( i );
+            continue;
+        }
+
+        float factor = lerp( i->_maxFactor, 1.0f, _quality );
+        if ( i->_callback.valid() )
+            static_cast<LODScaleCallback*>( i->_callback.get() )->_factor = factor;
+        else
+            static_cast<LODScaleGroup*>( node.get() )->setLODScaleFactor( i->_baseFactor * factor );
+        ++i;
+    }
+
+    osgViewer::View* view = dynamic_cast<osgViewer::View*>( &aa );
+    osgDB::DatabasePager* pager = view ? view->getDatabasePager() : 0L;
+    if ( !pager )
+        return;
+
+    // paging budget; the first time through, the pager's own settings are "best".
+    if ( !_pagerLimitsSet )
+    {
+        _bestPagedLODs  = pager->getTargetMaximumNumberOfPageLOD();
+        _worstPagedLODs = _bestPagedLODs / 2;
+        _pagerLimitsSet = true;
+    }
+    if ( _bestPagedLODs > 0 )
+    {
+        pager->setTargetMaximumNumberOfPageLOD( lerp(_worstPagedLODs, _bestPagedLODs, _quality) );
+    }
+
+    // merge and compile budgets:
+    osgUtil::IncrementalCompileOperation* ico = pager->getIncrementalCompileOperation();
+    if ( ico )
+    {
+        if ( !_compileLimitsSet )
+        {
+            _bestObjects      = ico->getMaximumNumOfObjectsToCompilePerFrame();
+            _worstObjects     = osg::maximum( _bestObjects/4, 1u );
+            _bestCompileTime  = ico->getMinimumTimeAvailableForGLCompileAndDeletePerFrame();
+            _worstCompileTime = _bestCompileTime * 0.25;
+            _compileLimitsSet = true;
+        }
+        ico->setMaximumNumOfObjectsToCompilePerFrame( osg::maximum(lerp(_worstObjects, _bestObjects, _quality), 1u) );
+        ico->setMinimumTimeAvailableForGLCompileAndDeletePerFrame( lerp(_worstCompileTime, _bestCompileTime, _quality) );
+    }
+}
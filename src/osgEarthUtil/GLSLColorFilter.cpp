@@ -100,3 +100,14 @@ GLSLColorFilter::getConfig() const
     Config conf("glsl", getCode());
     return conf;
 }
+
+bool
+GLSLColorFilter::getConstantCode(std::string& out_code) const
+{
+    // a "return" would leave the whole fused chain.
+    if ( _code.find("return") != std::string::npos )
+        return false;
+
+    out_code = _code + "\n";
+    return true;
+}
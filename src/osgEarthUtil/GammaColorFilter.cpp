@@ -148,3 +148,12 @@ GammaColorFilter::getConfig() const
     }
     return conf;
 }
+
+bool
+GammaColorFilter::getConstantCode(std::string& out_code) const
+{
+    osg::Vec3f gamma = getGamma();
+    out_code = osgEarth::Stringify()
+        << "color.rgb = pow(color.rgb, vec3(" << glslFloat(1.0f/gamma[0]) << ", " << glslFloat(1.0f/gamma[1]) << ", " << glslFloat(1.0f/gamma[2]) << "));\n";
+    return true;
+}
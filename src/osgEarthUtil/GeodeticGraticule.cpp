@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthUtil/GeodeticGraticule>
+#include <osgEarthUtil/GraticuleTileCache>
 #include <osgEarthUtil/LatLongFormatter>
 
 #include <osgEarthFeatures/GeometryCompiler>
@@ -332,8 +333,16 @@ GeodeticGraticule::buildTile( const TileKey& key, Map* map ) const
     osg::ref_ptr<Session> session = new Session( map );
     FilterContext context( session.get(), _featureProfile.get(), tileExtent );
 
-    // make sure we get sufficient tessellation:
-    compiler.options().maxGranularity() = std::min(cellWidth, cellHeight) / 16.0;
+    // make sure we get sufficient tessellation; but a level that is never seen
+    // up close (because the next level replaces it) can use longer segments.
+    double nearestRange = level._minRange;
+    if ( key.getLevelOfDetail() + 1 < _options->levels().size() )
+        nearestRange = std::max( level._minRange, _options->levels()[key.getLevelOfDetail()+1]._maxRange );
+
+    compiler.options().maxGranularity() = GraticuleTileCache::getGranularity(
+        nearestRange,
+        std::min(cellWidth, cellHeight) / 16.0,
+        tileExtent.getSRS() );
 
     compiler.options().geoInterp() = GEOINTERP_GREAT_CIRCLE;
     osg::Node* lonNode = compiler.compile(lonLines, lineStyle, context);
@@ -0,0 +1,290 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <osgEarthUtil/GraticuleTileCache>
+#include <osgEarth/Cache>
+#include <osgEarth/Map>
+#include <osgEarth/Registry>
+#include <osgEarth/SpatialReference>
+#include <osgEarth/StringUtils>
+#include <osgEarthSymbology/Geometry>
+#include <osg/Math>
+#include <cmath>
+#include <sstream>
+
+#define LC "[GraticuleTileCache] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+using namespace osgEarth::Symbology;
+using namespace osgEarth::Threading;
+
+// bump when the encoding or the tile layout of any graticule changes.
+#define TILE_VERSION 1
+
+// computed tiles kept in memory, per cache.
+#define MAX_TILES_IN_MEMORY 512
+
+//---------------------------------------------------------------------------
+
+namespace
+{
+    typedef std::map<std::string, osg::observer_ptr<GraticuleTileCache> > CacheRegistry;
+    Threading::Mutex s_registryMutex;
+    CacheRegistry    s_registry;
+}
+
+//---------------------------------------------------------------------------
+
+void
+GraticuleTile::addLine( const osg::Vec3d& start, const osg::Vec3d& end, GeoInterpolation interp )
+{
+    Line line;
+    line._start  = start;
+    line._end    = end;
+    line._interp = interp;
+    _lines.push_back( line );
+}
+
+void
+GraticuleTile::addLabel( const osg::Vec3d& position, const std::string& text, float size )
+{
+    Label label;
+    label._position = position;
+    label._text     = text;
+    label._size     = size;
+    _labels.push_back( label );
+}
+
+void
+GraticuleTile::getFeatures( const SpatialReference* srs, FeatureList& out_features, int interp ) const
+{
+    for( std::vector<Line>::const_iterator i = _lines.begin(); i != _lines.end(); ++i )
+    {
+        if ( interp >= 0 && (int)i->_interp != interp )
+            continue;
+
+        Feature* f = new Feature( new LineString(2), srs );
+        f->geoInterp() = i->_interp;
+        f->getGeometry()->push_back( i->_start );
+        f->getGeometry()->push_back( i->_end );
+        out_features.push_back( f );
+    }
+}
+
+std::string
+GraticuleTile::encode() const
+{
+    std::stringstream buf;
+    buf.precision( 15 );
+
+    for( std::vector<Line>::const_iterator i = _lines.begin(); i != _lines.end(); ++i )
+    {
+        buf << "L " << (int)i->_interp << " "
+            << i->_start.x() << " " << i->_start.y() << " " << i->_start.z() << " "
+            << i->_end.x()   << " " << i->_end.y()   << " " << i->_end.z()   << "\n";
+    }
+
+    // text goes last on its line, since it may contain spaces.
+    for( std::vector<Label>::const_iterator i = _labels.begin(); i != _labels.end(); ++i )
+    {
+        buf << "T " << i->_size << " "
+            << i->_position.x() << " " << i->_position.y() << " " << i->_position.z() << " "
+            << i->_text << "\n";
+    }
+
+    return buf.str();
+}
+
+bool
+GraticuleTile::decode( const std::string& input )
+{
+    _lines.clear();
+    _labels.clear();
+
+    std::stringstream buf( input );
+    std::string line;
+    while( std::getline(buf, line) )
+    {
+        if ( line.empty() )
+            continue;
+
+        std::stringstream in( line );
+        char tag;
+        in >> tag;
+
+        if ( tag == 'L' )
+        {
+            int interp;
+            Line l;
+            in >> interp
+               >> l._start.x() >> l._start.y() >> l._start.z()
+               >> l._end.x()   >> l._end.y()   >> l._end.z();
+            if ( in.fail() )
+                return false;
+            l._interp = (GeoInterpolation)interp;
+            _lines.push_back( l );
+        }
+        else if ( tag == 'T' )
+        {
+            Label t;
+            in >> t._size >> t._position.x() >> t._position.y() >> t._position.z();
+            if ( in.fail() )
+                return false;
+            in.get(); // the separating space
+            std::getline( in, t._text );
+            _labels.push_back( t );
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+
+GraticuleTileCache*
+GraticuleTileCache::get( const std::string& type, const Map* map )
+{
+    // tiles depend on the kind of graticule and on the map's SRS.
+    std::stringstream sig;
+    sig << TILE_VERSION << "\n" << type << "\n";
+    if ( map && map->getProfile() )
+        sig << map->getProfile()->getHorizSignature();
+
+    std::string binID = Stringify() << "graticule_" << type << "_" << std::hex << hashString( sig.str() );
+
+    ScopedMutexLock lock( s_registryMutex );
+
+    osg::ref_ptr<GraticuleTileCache> cache;
+    CacheRegistry::iterator i = s_registry.find( binID );
+    if ( i != s_registry.end() )
+        i->second.lock( cache );
+
+    if ( !cache.valid() )
+    {
+        cache = new GraticuleTileCache( binID, map );
+        s_registry[binID] = cache.get();
+    }
+
+    // the caller takes the reference.
+    return cache.release();
+}
+
+GraticuleTileCache::GraticuleTileCache( const std::string& binID, const Map* map ) :
+_binID ( binID ),
+_policy( CachePolicy::NO_CACHE )
+{
+    Cache* cache = map ? map->getCache() : 0L;
+    if ( !cache )
+        return;
+
+    optional<CachePolicy> policy;
+    Registry::instance()->getCachePolicy( policy, map->getDBOptions() );
+    _policy = policy.isSet() ? *policy : CachePolicy::DEFAULT;
+
+    if ( _policy.isCacheReadable() || _policy.isCacheWriteable() )
+    {
+        _bin = cache->addBin( _binID );
+        if ( _bin.valid() )
+        {
+            OE_INFO << LC << "Caching graticule tiles in bin \"" << _binID << "\"" << std::endl;
+        }
+    }
+}
+
+bool
+GraticuleTileCache::getTile( const std::string& name, osg::ref_ptr<GraticuleTile>& out_tile ) const
+{
+    {
+        ScopedMutexLock lock( _mutex );
+        TileMap::const_iterator i = _tiles.find( name );
+        if ( i != _tiles.end() )
+        {
+            out_tile = i->second.get();
+            return true;
+        }
+    }
+
+    if ( !_bin.valid() || !_policy.isCacheReadable() )
+        return false;
+
+    ReadResult r = _bin->readString( name, _policy.maxAge().value() );
+    if ( !r.succeeded() )
+        return false;
+
+    osg::ref_ptr<GraticuleTile> tile = new GraticuleTile();
+    if ( !tile->decode(r.getString()) )
+    {
+        OE_WARN << LC << "Discarding unreadable tile \"" << name << "\" in bin \"" << _binID << "\"" << std::endl;
+        return false;
+    }
+
+    const_cast<GraticuleTileCache*>(this)->remember( name, tile.get() );
+    out_tile = tile.get();
+    return true;
+}
+
+void
+GraticuleTileCache::putTile( const std::string& name, GraticuleTile* tile )
+{
+    if ( !tile )
+        return;
+
+    if ( remember(name, tile) && _bin.valid() && _policy.isCacheWriteable() )
+    {
+        osg::ref_ptr<StringObject> value = new StringObject( tile->encode() );
+        _bin->write( name, value.get() );
+    }
+}
+
+bool
+GraticuleTileCache::remember( const std::string& name, GraticuleTile* tile )
+{
+    ScopedMutexLock lock( _mutex );
+
+    bool isNew = _tiles.find( name ) == _tiles.end();
+    if ( isNew )
+        _order.push_back( name );
+    _tiles[name] = tile;
+
+    while( _order.size() > MAX_TILES_IN_MEMORY )
+    {
+        _tiles.erase( _order.front() );
+        _order.pop_front();
+    }
+    return isNew;
+}
+
+double
+GraticuleTileCache::getGranularity( double nearestRange, double finest, const SpatialReference* srs )
+{
+    if ( !srs || !srs->getEllipsoid() || nearestRange <= 0.0 )
+        return finest;
+
+    // the chord of an arc of angle a sags R*a^2/8 below it; keep that under
+    // a thousandth of the viewing distance (about a pixel at 1000 pixels).
+    double R = srs->getEllipsoid()->getRadiusEquator();
+    double a = sqrt( 8.0 * 0.001 * nearestRange / R );
+
+    double deg = osg::clampBelow( osg::RadiansToDegrees(a), 15.0 );
+    return osg::maximum( deg, finest );
+}
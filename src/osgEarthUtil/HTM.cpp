@@ -97,6 +97,10 @@ HTMNode::HTMNode(HTMGroup*         root,
     _root = root;
     _tri.set( v0, v1, v2 );
     _dataCount = 0;
+    _depth = 0;
+    _traversals = 0;
+    _trivialAccepts = 0;
+    _culled = 0;
 
     // init the bounding sphere
     _bs.expandBy( _tri._v[0] * 6380000);
@@ -145,137 +149,61 @@ HTMNode::HTMNode(HTMGroup*         root,
 HTMNode*
 HTMNode::insert(osg::Node* node)
 {
-    HTMNode* leaf = this;
-
     dirtyBound();
 
-    _data.push_back( node );
+    _data.insert( node );
+    _dataCount = _data.size();
+    updateClusterText();
 
-    if (_data.size() >= _root->getSplitThreshold() &&
-        getNumChildren() == 0 )
+    // splitting hands all the data (including this node) to the new children.
+    if ( isLeaf() && _dataCount >= _root->getSplitThreshold() && _depth < _root->getMaxDepth() )
     {
         split();
+        HTMGroup::NodeMap::const_iterator i = _root->_nodeTable.find( node );
+        return i != _root->_nodeTable.end() ? i->second : this;
     }
 
-    if ( _children.size() > 0 )
-    {
-        const osg::Vec3d& p = node->getBound().center();
-
-        for(unsigned i=0; i<_children.size(); ++i)
-        {
-            HTMNode* child = dynamic_cast<HTMNode*>(_children[i].get());
-            if ( child && child->contains(p) )
-            {
-                leaf = child->insert(node);
-                break;
-            }
-        }
-    }
-
-    _dataCount++;
-
-    dynamic_cast<osgText::Text*>(dynamic_cast<osg::Geode*>(_clusterNode.get())->getDrawable(0))
-        ->setText( Stringify() << _dataCount );
-
-    return leaf;
-}
-
-bool
-HTMNode::remove(osg::Node* node)
-{
-    NodeList::iterator i = std::find( _data.begin(), _data.end(), node );
-    if ( i != _data.end() )
-    {
-        dirtyBound();
-
-        _data.erase( i );
-        _dataCount--;
-
-        bool found = false;
-        for(unsigned i=0; i<_children.size() && !found; ++i)
-        {
-            HTMNode* child = dynamic_cast<HTMNode*>(_children[i].get());
-            if ( child )
-            {
-                found = child->remove( node );
-            }
-        }
-
-        return found;
-    }
-    else
-    {
-        return false;
-    }
+    return insertIntoChildren( node );
 }
 
 HTMNode*
-HTMNode::findLeaf(osg::Node* node)
+HTMNode::insertIntoChildren(osg::Node* node)
 {
-    HTMNode* leaf = 0L;
+    osg::Vec3d p = node->getBound().center();
+    p.normalize();
 
-    NodeList::iterator i = std::find( _data.begin(), _data.end(), node );
-    if ( i != _data.end() )
+    for(unsigned i=0; i<_children.size(); ++i)
     {
-        leaf = this;
-        for(unsigned i=0; i<_children.size(); ++i)
+        HTMNode* child = static_cast<HTMNode*>(_children[i].get());
+        if ( child->contains(p) )
         {
-            HTMNode* child = dynamic_cast<HTMNode*>(_children[i].get());
-            HTMNode* leaf2 = child->findLeaf( node );
-            if ( leaf2 )
-            {
-                leaf = leaf2;
-                break;
-            }
+            return child->insert(node);
         }
     }
 
-    return leaf;
+    // a leaf, or a point that falls between the children due to roundoff.
+    _root->_nodeTable[node] = this;
+    return this;
 }
 
-bool
-HTMNode::refresh(osg::Node* node)
+void
+HTMNode::removeData(osg::Node* node)
 {
-    const osg::Vec3d& p = node->getBound().center();
-
-    if ( contains(p) )
+    NodeList::iterator i = _data.find( node );
+    if ( i != _data.end() )
     {
-        // already in this node; if there are children, re-insert
-        // into the new child.
-        if ( _children.size() > 0 )
-        {
-            for(unsigned i=0; i<_children.size(); ++i)
-            {
-                HTMNode* child = dynamic_cast<HTMNode*>(_children[i].get());
-                if ( child && child->contains(p) )
-                {
-                    child->insert(node);
-                    break;
-                }
-            }
-        }
-        return true; // done.
+        dirtyBound();
+        _data.erase( i );
+        _dataCount = _data.size();
+        updateClusterText();
     }
-    else
-    {
-        std::remove( _data.begin(), _data.end(), node );
-        _dataCount--;
-
-        HTMNode* parentNode = dynamic_cast<HTMNode*>( getParent(0) );
-        if ( parentNode )
-        {
-            return parentNode->refresh( node );
-        }
-        HTMGroup* parentGroup = dynamic_cast<HTMGroup*>( getParent(0) );
-        if ( parentGroup )
-        {
-            return parentGroup->addChild( node );
-        }
+}
 
-        // should never get here
-        OE_WARN << LC << "trouble." << std::endl;
-        return false;
-    }
+void
+HTMNode::updateClusterText()
+{
+    static_cast<osgText::Text*>(static_cast<osg::Geode*>(_clusterNode.get())->getDrawable(0))
+        ->setText( Stringify() << _dataCount );
 }
 
 void
@@ -294,31 +222,22 @@ HTMNode::split()
     c[2] = new HTMNode(_root, _tri._v[2], w[2], w[1]);
     c[3] = new HTMNode(_root, w[0], w[1], w[2]);
 
+    // add the node children
+    for(unsigned i=0; i<4; ++i)
+    {
+        c[i]->_depth = _depth + 1;
+        c[i]->setName( Stringify() << getName() << i );
+        osg::Group::addChild( c[i] );
+    }
+
     // distibute the data amongst the children
     for(NodeList::iterator i = _data.begin(); i != _data.end(); ++i)
     {
-        osg::Node* node = i->get();
-        const osg::BoundingSphere& bs = node->getBound();
-        
-        osg::Vec3d p = node->getBound().center();
-        p.normalize(); // need?
-
-        for(unsigned j=0; j<4; ++j)
-        {
-            if ( c[j]->contains(p) )
-            {
-                c[j]->insert( node );
-                break;
-            }
-        }
+        insertIntoChildren( i->get() );
     }
 
-    // add the node children
     for(unsigned i=0; i<4; ++i)
     {
-        c[i]->setName( Stringify() << getName() << i );
-        osg::Group::addChild( c[i] );
-
         OE_DEBUG << LC << "  htmid " << c[i]->getName() << " size = " << c[i]->dataCount() << std::endl;
     }
 }
@@ -326,10 +245,55 @@ HTMNode::split()
 void
 HTMNode::merge()
 {
+    if ( isLeaf() || _dataCount >= _root->getMergeThreshold() )
+        return;
+
+    // only collapse the bottom of the mesh; deeper cells merge first.
+    for(unsigned i=0; i<_children.size(); ++i)
+    {
+        if ( !static_cast<HTMNode*>(_children[i].get())->isLeaf() )
+            return;
+    }
+
+    OE_DEBUG << LC << "Merging htmid:" << getName() << std::endl;
+
+    // this cell already holds all the children's data.
+    for(NodeList::iterator i = _data.begin(); i != _data.end(); ++i)
+    {
+        _root->_nodeTable[i->get()] = this;
+    }
+
+    osg::Group::removeChildren( 0, getNumChildren() );
     dirtyBound();
+}
+
+void
+HTMNode::getCellStats(HTMGroup::CellStatsVector& out) const
+{
+    HTMGroup::CellStats stats;
+    stats._htmid          = getName();
+    stats._dataCount      = _dataCount;
+    stats._isLeaf         = isLeaf();
+    stats._traversals     = _traversals;
+    stats._trivialAccepts = _trivialAccepts;
+    stats._culled         = _culled;
+    out.push_back( stats );
+
+    for(unsigned i=0; i<_children.size(); ++i)
+    {
+        static_cast<const HTMNode*>(_children[i].get())->getCellStats( out );
+    }
+}
 
-    OE_INFO << LC << "Merging htmid:" << getName() << std::endl;
-    //todo
+void
+HTMNode::resetCellStats()
+{
+    _traversals = _trivialAccepts = _culled = 0;
+
+    for(unsigned i=0; i<_children.size(); ++i)
+    {
+        static_cast<HTMNode*>(_children[i].get())->resetCellStats();
+    }
 }
 
 bool
@@ -388,6 +352,9 @@ HTMNode::traverse(osg::NodeVisitor& nv)
 
     osg::Polytope* frustum = 0L;
 
+    if ( cull )
+        ++_traversals;
+
     if ( activeOnly )
     {
         // first make sure this node is in range.
@@ -407,7 +374,7 @@ HTMNode::traverse(osg::NodeVisitor& nv)
                 frustum = &cv->getCurrentCullingSet().getFrustum();
                 if ( entirelyWithin(*frustum) )
                 {
-                    OE_DEBUG << LC << getName() << ": trivially accepted. yay!" << std::endl;
+                    ++_trivialAccepts;
                 }
                 else
                 {
@@ -454,6 +421,10 @@ HTMNode::traverse(osg::NodeVisitor& nv)
                 {
                     child->accept( nv );
                 }
+                else if ( cull )
+                {
+                    ++child->_culled;
+                }
             }
         }
         else
@@ -476,7 +447,8 @@ HTMNode::computeBound() const
 HTMGroup::HTMGroup() :
 _dataCount     ( 0 ),
 _splitThreshold( 48 ),
-_mergeThreshold( 48 ),
+_mergeThreshold( 12 ),
+_maxDepth      ( 16 ),
 _debug         ( false ),
 _cluster       ( false )
 {
@@ -511,57 +483,112 @@ _cluster       ( false )
 bool
 HTMGroup::insert(osg::Node* node)
 {
+    if ( !node || _nodeTable.find(node) != _nodeTable.end() )
+        return false;
+
     osg::Vec3d p = node->getBound().center();
     p.normalize();
 
-    bool inserted = false;
-
     for(unsigned i=0; i<8; ++i)
     {
         HTMNode* child = static_cast<HTMNode*>(_children[i].get());
         if ( child->contains(p) )
         {
             child->insert(node);
-            inserted = true;
-            //_dataCount++;
-            break;
+            _dataCount++;
+            return true;
         }
     }
 
-    return inserted;
+    return false;
 }
 
 bool
 HTMGroup::remove(osg::Node* node)
 {
-    bool found = false;
+    NodeMap::iterator i = _nodeTable.find( node );
+    if ( i == _nodeTable.end() )
+        return false;
 
-    for(unsigned i=0; i<8 && !found; ++i)
+    HTMNode* cell = i->second;
+    _nodeTable.erase( i );
+    _dataCount--;
+
+    // every cell on the path to the root holds the node; merging on the way
+    // up lets a collapse cascade toward the root.
+    while ( cell )
     {
-        HTMNode* child = static_cast<HTMNode*>(_children[i].get());
-        found = child->remove( node );
+        HTMNode* parent = cell->getParentCell();
+        cell->removeData( node );
+        cell->merge();
+        cell = parent;
     }
 
-    return found;
+    return true;
 }
 
 bool
 HTMGroup::refresh(osg::Node* node)
 {
-    HTMNode* leaf = 0L;
+    NodeMap::iterator i = _nodeTable.find( node );
+    if ( i == _nodeTable.end() )
+        return false;
 
-    for(unsigned i=0; i<8 && !leaf; ++i)
+    osg::Vec3d p = node->getBound().center();
+    p.normalize();
+
+    // the common case: the node is still inside its cell.
+    HTMNode* cell = i->second;
+    if ( cell->contains(p) )
+        return true;
+
+    // climb to the first cell that still contains the node, leaving the
+    // cells it moved out of.
+    while ( cell && !cell->contains(p) )
     {
-        HTMNode* child = static_cast<HTMNode*>(_children[i].get());
-        leaf = child->findLeaf( node );
-        if ( leaf )
+        HTMNode* parent = cell->getParentCell();
+        cell->removeData( node );
+        cell->merge();
+        cell = parent;
+    }
+
+    if ( cell )
+    {
+        // that cell already holds the node, so only descend from it.
+        cell->insertIntoChildren( node );
+    }
+    else
+    {
+        // moved to a different base triangle.
+        _nodeTable.erase( node );
+        _dataCount--;
+        if ( !insert(node) )
         {
-            leaf->refresh( node );
-            break;
+            OE_WARN << LC << "Failed to relocate node \"" << node->getName() << "\"" << std::endl;
+            return false;
         }
     }
 
-    return leaf != 0L;
+    return true;
+}
+
+void
+HTMGroup::getCellStats(CellStatsVector& out_stats) const
+{
+    out_stats.clear();
+    for(unsigned i=0; i<_children.size(); ++i)
+    {
+        static_cast<const HTMNode*>(_children[i].get())->getCellStats( out_stats );
+    }
+}
+
+void
+HTMGroup::resetCellStats()
+{
+    for(unsigned i=0; i<_children.size(); ++i)
+    {
+        static_cast<HTMNode*>(_children[i].get())->resetCellStats();
+    }
 }
 
 void 
@@ -0,0 +1,165 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthUtil/LineOfSight>
+#include <osgEarth/GeoData>
+#include <OpenThreads/Thread>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define LC "[HeightFieldLineOfSight] "
+
+// upper bound on the number of samples along one ray
+#define MAX_SAMPLES 65536
+
+//------------------------------------------------------------------------
+
+struct HeightFieldLineOfSight::ComputeRay
+{
+    void execute()
+    {
+        _los->compute( *_ray );
+    }
+
+    const HeightFieldLineOfSight* _los;
+    Ray*                          _ray;
+};
+
+//------------------------------------------------------------------------
+
+HeightFieldLineOfSight::HeightFieldLineOfSight( const Map* map ) :
+_resolution( 10.0 )
+{
+    if ( map )
+    {
+        _mapSRS    = map->getProfile()->getSRS();
+        _elevation = ElevationService::get( map );
+    }
+}
+
+HeightFieldLineOfSight::~HeightFieldLineOfSight()
+{
+    //nop
+}
+
+void
+HeightFieldLineOfSight::setResolution( double meters )
+{
+    _resolution = osg::maximum( meters, 0.01 );
+}
+
+bool
+HeightFieldLineOfSight::compute( Ray& ray ) const
+{
+    ray._hasLOS = true;
+
+    if ( !_elevation.valid() || !_mapSRS.valid() )
+        return true;
+
+    osg::Vec3d delta  = ray._end - ray._start;
+    double     length = delta.length();
+    if ( length <= 0.0 )
+        return true;
+
+    // elevation queries take their resolution in map units.
+    double queryResolution = _resolution;
+    if ( _mapSRS->isGeographic() )
+    {
+        double radius = _mapSRS->getEllipsoid()->getRadiusEquator();
+        queryResolution = osg::RadiansToDegrees( _resolution / radius );
+    }
+
+    unsigned numSamples = (unsigned)ceil( length / _resolution );
+    numSamples = osg::clampBetween( numSamples, 2u, (unsigned)MAX_SAMPLES );
+
+    // Only the interior samples are tested. The end points usually sit right
+    // on the terrain, where the sampled height would make the test flicker.
+    double prevT         = 0.0;
+    double prevClearance = 0.0;
+    bool   havePrev      = false;
+
+    for( unsigned i = 1; i < numSamples; ++i )
+    {
+        double     t     = (double)i / (double)numSamples;
+        osg::Vec3d world = ray._start + delta * t;
+
+        GeoPoint sample;
+        if ( !sample.fromWorld(_mapSRS.get(), world) )
+            continue;
+
+        double height;
+        GeoPoint ground( _mapSRS.get(), sample.x(), sample.y(), 0.0, ALTMODE_ABSOLUTE );
+        if ( !_elevation->getElevation(ground, height, queryResolution) )
+            continue;
+
+        double clearance = sample.z() - height;
+        if ( clearance < 0.0 )
+        {
+            // place the hit where the ray crosses the terrain between this
+            // sample and the previous one.
+            double hitT = t;
+            if ( havePrev )
+                hitT = prevT + (t - prevT) * (prevClearance / (prevClearance - clearance));
+
+            ray._hit    = ray._start + delta * hitT;
+            ray._hasLOS = false;
+            return false;
+        }
+
+        prevT         = t;
+        prevClearance = clearance;
+        havePrev      = true;
+    }
+
+    return true;
+}
+
+void
+HeightFieldLineOfSight::compute( std::vector<Ray>& rays )
+{
+    if ( rays.size() < 2 )
+    {
+        for( unsigned i = 0; i < rays.size(); ++i )
+            compute( rays[i] );
+        return;
+    }
+
+    {
+        Threading::ScopedMutexLock lock( _serviceMutex );
+        if ( !_service.valid() )
+        {
+            _service = new TaskService( "HeightFieldLineOfSight", OpenThreads::GetNumberOfProcessors() );
+        }
+    }
+
+    // one task per ray; they share the elevation service's tile cache, so
+    // neighboring rays mostly read heightfields that are already loaded.
+    Threading::MultiEvent semaphore( rays.size() );
+
+    for( unsigned i = 0; i < rays.size(); ++i )
+    {
+        ParallelTask<ComputeRay>* task = new ParallelTask<ComputeRay>( &semaphore );
+        task->_los = this;
+        task->_ray = &rays[i];
+        _service->add( task );
+    }
+
+    semaphore.wait();
+}
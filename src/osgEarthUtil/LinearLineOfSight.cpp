@@ -86,7 +86,9 @@ _badColor(1.0f, 0.0f, 0.0f, 1.0f),
 _displayMode( LineOfSight::MODE_SPLIT ),
 //_startAltitudeMode( ALTMODE_ABSOLUTE ),
 //_endAltitudeMode( ALTMODE_ABSOLUTE ),
-_terrainOnly( false )
+_terrainOnly( false ),
+_computeMode( LineOfSight::COMPUTE_SCENE ),
+_resolution( 10.0 )
 {
     compute(getNode());
     subscribeToTerrain();
@@ -109,7 +111,9 @@ _badColor(1.0f, 0.0f, 0.0f, 1.0f),
 _displayMode( LineOfSight::MODE_SPLIT ),
 //_startAltitudeMode( ALTMODE_ABSOLUTE ),
 //_endAltitudeMode( ALTMODE_ABSOLUTE ),
-_terrainOnly( false )
+_terrainOnly( false ),
+_computeMode( LineOfSight::COMPUTE_SCENE ),
+_resolution( 10.0 )
 {
     compute(getNode());    
     subscribeToTerrain();
@@ -146,6 +150,7 @@ LinearLineOfSightNode::setMapNode( MapNode* mapNode )
         }
 
         _mapNode = mapNode;
+        _heightFieldLOS = 0L;
 
         if ( _mapNode.valid() && _terrainChangedCallback.valid() )
         {
@@ -160,6 +165,11 @@ void
 LinearLineOfSightNode::terrainChanged( const osgEarth::TileKey& tileKey, osg::Node* terrain )
 {
     OE_DEBUG << "LineOfSightNode::terrainChanged" << std::endl;
+
+    // the elevation data does not change as tiles page in.
+    if ( _computeMode == LineOfSight::COMPUTE_HEIGHTFIELD )
+        return;
+
     //Make a temporary group that contains both the old MapNode as well as the new incoming terrain.
     //Because this function is called from the database pager thread we need to include both b/c 
     //the new terrain isn't yet merged with the new terrain.
@@ -295,21 +305,40 @@ LinearLineOfSightNode::compute(osg::Node* node, bool backgroundThread)
       _end.transform(mapSRS).toWorld( _endWorld, terrain );
 
 
-      DPLineSegmentIntersector* lsi = new DPLineSegmentIntersector(_startWorld, _endWorld);
-      osgUtil::IntersectionVisitor iv( lsi );
-
-      node->accept( iv );
-
-      DPLineSegmentIntersector::Intersections& hits = lsi->getIntersections();
-      if ( hits.size() > 0 )
+      if ( _computeMode == LineOfSight::COMPUTE_HEIGHTFIELD )
       {
-          _hasLOS = false;
-          _hitWorld = hits.begin()->getWorldIntersectPoint();
-          _hit.fromWorld( mapSRS, _hitWorld );
+          if ( !_heightFieldLOS.valid() )
+          {
+              _heightFieldLOS = new HeightFieldLineOfSight( getMapNode()->getMap() );
+              _heightFieldLOS->setResolution( _resolution );
+          }
+
+          HeightFieldLineOfSight::Ray ray( _startWorld, _endWorld );
+          _hasLOS = _heightFieldLOS->compute( ray );
+          if ( !_hasLOS )
+          {
+              _hitWorld = ray._hit;
+              _hit.fromWorld( mapSRS, _hitWorld );
+          }
       }
       else
       {
-          _hasLOS = true;
+          DPLineSegmentIntersector* lsi = new DPLineSegmentIntersector(_startWorld, _endWorld);
+          osgUtil::IntersectionVisitor iv( lsi );
+
+          node->accept( iv );
+
+          DPLineSegmentIntersector::Intersections& hits = lsi->getIntersections();
+          if ( hits.size() > 0 )
+          {
+              _hasLOS = false;
+              _hitWorld = hits.begin()->getWorldIntersectPoint();
+              _hit.fromWorld( mapSRS, _hitWorld );
+          }
+          else
+          {
+              _hasLOS = true;
+          }
       }
     }
 
@@ -463,6 +492,41 @@ LinearLineOfSightNode::setTerrainOnly( bool terrainOnly )
     }
 }
 
+LineOfSight::ComputeMode
+LinearLineOfSightNode::getComputeMode() const
+{
+    return _computeMode;
+}
+
+void
+LinearLineOfSightNode::setComputeMode( LineOfSight::ComputeMode computeMode )
+{
+    if (_computeMode != computeMode)
+    {
+        _computeMode = computeMode;
+        compute(getNode());
+    }
+}
+
+double
+LinearLineOfSightNode::getResolution() const
+{
+    return _resolution;
+}
+
+void
+LinearLineOfSightNode::setResolution( double resolution )
+{
+    if (_resolution != resolution)
+    {
+        _resolution = resolution;
+        if ( _heightFieldLOS.valid() )
+            _heightFieldLOS->setResolution( _resolution );
+        if ( _computeMode == LineOfSight::COMPUTE_HEIGHTFIELD )
+            compute(getNode());
+    }
+}
+
 osg::Node*
 LinearLineOfSightNode::getNode()
 {
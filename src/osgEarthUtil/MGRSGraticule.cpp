@@ -114,8 +114,8 @@ MGRSGraticule::buildGZDChildren( osg::Group* parent, const std::string& gzd )
     return plod;
 }
 
-osg::Node*
-MGRSGraticule::buildSQIDTiles( const std::string& gzd )
+GraticuleTile*
+MGRSGraticule::computeSQIDTile( const std::string& gzd )
 {
     const GeoExtent& extent = _gzd[gzd];
 
@@ -123,32 +123,12 @@ MGRSGraticule::buildSQIDTiles( const std::string& gzd )
     unsigned zone;
     char letter;
     sscanf( gzd.c_str(), "%u%c", &zone, &letter );
-    
-    TextSymbol* textSym = _options->secondaryStyle()->get<TextSymbol>();
-    if ( !textSym )
-        textSym = _options->primaryStyle()->getOrCreate<TextSymbol>();
 
-    AltitudeSymbol* alt = _options->secondaryStyle()->get<AltitudeSymbol>();
     double h = 0.0;
 
-    TextSymbolizer ts( textSym );
     MGRSFormatter mgrs(MGRSFormatter::PRECISION_100000M);
-    osg::Geode* textGeode = new osg::Geode();
-    textGeode->getOrCreateStateSet()->setRenderBinDetails( 9999, "DepthSortedBin" );    
-    textGeode->getOrCreateStateSet()->setAttributeAndModes( _depthAttribute, 1 );
 
-    const SpatialReference* ecefSRS = extent.getSRS()->getECEF();
-    osg::Vec3d centerMap, centerECEF;
-    extent.getCentroid(centerMap.x(), centerMap.y());
-    extent.getSRS()->transform(centerMap, ecefSRS, centerECEF);
-    //extent.getSRS()->transformToECEF(centerMap, centerECEF);
-
-    osg::Matrix local2world;
-    ecefSRS->createLocalToWorld( centerECEF, local2world ); //= ECEF::createLocalToWorld(centerECEF);
-    osg::Matrix world2local;
-    world2local.invert(local2world);
-
-    FeatureList features;
+    GraticuleTile* tile = new GraticuleTile();
 
     std::vector<GeoExtent> sqidExtents;
 
@@ -233,39 +213,16 @@ MGRSGraticule::buildSQIDTiles( const std::string& gzd )
             // and draw valid sqid geometry.
             if ( sw.x() < se.x() )
             {
-                Feature* lat = new Feature(new LineString(2), extent.getSRS());
-                lat->geoInterp() = GEOINTERP_RHUMB_LINE;
-                lat->getGeometry()->push_back( sw );
-                lat->getGeometry()->push_back( se );
-                features.push_back(lat);
-
-                Feature* lon = new Feature(new LineString(2), extent.getSRS());
-                lon->geoInterp() = GEOINTERP_GREAT_CIRCLE;
-                lon->getGeometry()->push_back( sw );
-                lon->getGeometry()->push_back( nw );
-                features.push_back(lon);
+                tile->addLine( sw, se, GEOINTERP_RHUMB_LINE );
+                tile->addLine( sw, nw, GEOINTERP_GREAT_CIRCLE );
 
                 // and the text label:
                 osg::Vec3d sqidTextMap = (nw + se) * 0.5;
                 sqidTextMap.z() += 1000.0;
-                osg::Vec3d sqidTextECEF;
-                extent.getSRS()->transform(sqidTextMap, ecefSRS, sqidTextECEF);
-                //extent.getSRS()->transformToECEF(sqidTextMap, sqidTextECEF);
-                osg::Vec3d sqidLocal;
-                sqidLocal = sqidTextECEF * world2local;
 
                 MGRSCoord mgrsCoord;
                 if ( mgrs.transform( GeoPoint(extent.getSRS(),sqidTextMap,ALTMODE_ABSOLUTE), mgrsCoord) )
-                {
-                    textSym->size() = utmWidth/3.0;        
-                    osgText::Text* d = ts.create( mgrsCoord.sqid );
-
-                    osg::Matrixd textLocal2World;
-                    ecefSRS->createLocalToWorld( sqidTextECEF, textLocal2World );
-
-                    d->setPosition( sqidLocal );
-                    textGeode->addDrawable( d );
-                }
+                    tile->addLabel( sqidTextMap, mgrsCoord.sqid, utmWidth/3.0 );
             }
         }
     }
@@ -287,27 +244,19 @@ MGRSGraticule::buildSQIDTiles( const std::string& gzd )
             for( double x = 0.0; x < 1200000.0; x += 100000.0 )
             {
                 double yminmax = sqrt( r2 - x*x );
-                Feature* f = new Feature( new LineString(2), extent.getSRS() );
-                f->geoInterp() = GEOINTERP_GREAT_CIRCLE;
                 osg::Vec3d p0, p1;
                 ups->transform( osg::Vec3d(-x, -yminmax, 0), extent.getSRS(), p0 );
                 ups->transform( osg::Vec3d(-x,  yminmax, 0), extent.getSRS(), p1 );
-                f->getGeometry()->push_back( p0 );
-                f->getGeometry()->push_back( p1 );
-                features.push_back( f );
+                tile->addLine( p0, p1, GEOINTERP_GREAT_CIRCLE );
             }
 
             for( double y = -1100000.0; y < 1200000.0; y += 100000.0 )
             {
                 double xmax = sqrt( r2 - y*y );
-                Feature* f = new Feature( new LineString(2), extent.getSRS() );
-                f->geoInterp() = GEOINTERP_GREAT_CIRCLE;
                 osg::Vec3d p0, p1;
                 ups->transform( osg::Vec3d(-xmax, y, 0), extent.getSRS(), p0 );
                 ups->transform( osg::Vec3d(    0, y, 0), extent.getSRS(), p1 );
-                f->getGeometry()->push_back( p0 );
-                f->getGeometry()->push_back( p1 );
-                features.push_back( f );
+                tile->addLine( p0, p1, GEOINTERP_GREAT_CIRCLE );
             }
 
             for( double x = -1200000.0; x < 0.0; x += 100000.0 )
@@ -319,21 +268,9 @@ MGRSGraticule::buildSQIDTiles( const std::string& gzd )
                     if ( sqidTextMap.y() < -80.0 )
                     {
                         sqidTextMap.z() += 1000.0;
-                        osg::Vec3d sqidTextECEF;
-                        extent.getSRS()->transform(sqidTextMap, ecefSRS, sqidTextECEF);
-                        //extent.getSRS()->transformToECEF(sqidTextMap, sqidTextECEF);
-                        osg::Vec3d sqidLocal = sqidTextECEF * world2local;
-
                         MGRSCoord mgrsCoord;
                         if ( mgrs.transform( GeoPoint(extent.getSRS(),sqidTextMap,ALTMODE_ABSOLUTE), mgrsCoord) )
-                        {
-                            textSym->size() = 33000.0;
-                            osgText::Text* d = ts.create( mgrsCoord.sqid );
-                            osg::Matrixd textLocal2World;
-                            ecefSRS->createLocalToWorld( sqidTextECEF, textLocal2World );
-                            d->setPosition( sqidLocal );
-                            textGeode->addDrawable( d );
-                        }
+                            tile->addLabel( sqidTextMap, mgrsCoord.sqid, 33000.0f );
                     }
                 }
             }
@@ -344,27 +281,19 @@ MGRSGraticule::buildSQIDTiles( const std::string& gzd )
             for( double x = 100000.0; x < 1200000.0; x += 100000.0 )
             {
                 double yminmax = sqrt( r2 - x*x );
-                Feature* f = new Feature( new LineString(2), extent.getSRS() );
-                f->geoInterp() = GEOINTERP_GREAT_CIRCLE;
                 osg::Vec3d p0, p1;
                 ups->transform( osg::Vec3d(x, -yminmax, 0), extent.getSRS(), p0 );
                 ups->transform( osg::Vec3d(x,  yminmax, 0), extent.getSRS(), p1 );
-                f->getGeometry()->push_back( p0 );
-                f->getGeometry()->push_back( p1 );
-                features.push_back( f );
+                tile->addLine( p0, p1, GEOINTERP_GREAT_CIRCLE );
             }
 
             for( double y = -1100000.0; y < 1200000.0; y += 100000.0 )
             {
                 double xmax = sqrt( r2 - y*y );
-                Feature* f = new Feature( new LineString(2), extent.getSRS() );
-                f->geoInterp() = GEOINTERP_GREAT_CIRCLE;
                 osg::Vec3d p0, p1;
                 ups->transform( osg::Vec3d(    0, y, 0), extent.getSRS(), p0 );
                 ups->transform( osg::Vec3d( xmax, y, 0), extent.getSRS(), p1 );
-                f->getGeometry()->push_back( p0 );
-                f->getGeometry()->push_back( p1 );
-                features.push_back( f );
+                tile->addLine( p0, p1, GEOINTERP_GREAT_CIRCLE );
             }
 
             for( double x = 0.0; x < 1200000.0; x += 100000.0 )
@@ -376,21 +305,9 @@ MGRSGraticule::buildSQIDTiles( const std::string& gzd )
                     if ( sqidTextMap.y() < -80.0 )
                     {
                         sqidTextMap.z() += 1000.0;
-                        osg::Vec3d sqidTextECEF;
-                        extent.getSRS()->transform(sqidTextMap, ecefSRS, sqidTextECEF);
-                        //extent.getSRS()->transformToECEF(sqidTextMap, sqidTextECEF);
-                        osg::Vec3d sqidLocal = sqidTextECEF * world2local;
-
                         MGRSCoord mgrsCoord;
                         if ( mgrs.transform( GeoPoint(extent.getSRS(),sqidTextMap,ALTMODE_ABSOLUTE), mgrsCoord) )
-                        {
-                            textSym->size() = 33000.0;
-                            osgText::Text* d = ts.create( mgrsCoord.sqid );
-                            osg::Matrixd textLocal2World;
-                            ecefSRS->createLocalToWorld( sqidTextECEF, textLocal2World );
-                            d->setPosition( sqidLocal );
-                            textGeode->addDrawable( d );
-                        }
+                            tile->addLabel( sqidTextMap, mgrsCoord.sqid, 33000.0f );
                     }
                 }
             }
@@ -414,27 +331,19 @@ MGRSGraticule::buildSQIDTiles( const std::string& gzd )
             for( double x = 0.0; x < 700000.0; x += 100000.0 )
             {
                 double yminmax = sqrt( r2 - x*x );
-                Feature* f = new Feature( new LineString(2), extent.getSRS() );
-                f->geoInterp() = GEOINTERP_GREAT_CIRCLE;
                 osg::Vec3d p0, p1;
                 ups->transform( osg::Vec3d(-x, -yminmax, 0), extent.getSRS(), p0 );
                 ups->transform( osg::Vec3d(-x,  yminmax, 0), extent.getSRS(), p1 );
-                f->getGeometry()->push_back( p0 );
-                f->getGeometry()->push_back( p1 );
-                features.push_back( f );
+                tile->addLine( p0, p1, GEOINTERP_GREAT_CIRCLE );
             }
 
             for( double y = -600000.0; y < 700000.0; y += 100000.0 )
             {
                 double xmax = sqrt( r2 - y*y );
-                Feature* f = new Feature( new LineString(2), extent.getSRS() );
-                f->geoInterp() = GEOINTERP_GREAT_CIRCLE;
                 osg::Vec3d p0, p1;
                 ups->transform( osg::Vec3d(-xmax, y, 0), extent.getSRS(), p0 );
                 ups->transform( osg::Vec3d(    0, y, 0), extent.getSRS(), p1 );
-                f->getGeometry()->push_back( p0 );
-                f->getGeometry()->push_back( p1 );
-                features.push_back( f );
+                tile->addLine( p0, p1, GEOINTERP_GREAT_CIRCLE );
             }
 
             for( double x = -700000.0; x < 0.0; x += 100000.0 )
@@ -446,21 +355,9 @@ MGRSGraticule::buildSQIDTiles( const std::string& gzd )
                     if ( sqidTextMap.y() > 84.0 )
                     {
                         sqidTextMap.z() += 1000.0;
-                        osg::Vec3d sqidTextECEF;
-                        extent.getSRS()->transform(sqidTextMap, ecefSRS, sqidTextECEF);
-                        //extent.getSRS()->transformToECEF(sqidTextMap, sqidTextECEF);
-                        osg::Vec3d sqidLocal = sqidTextECEF * world2local;
-
                         MGRSCoord mgrsCoord;
                         if ( mgrs.transform( GeoPoint(extent.getSRS(),sqidTextMap,ALTMODE_ABSOLUTE), mgrsCoord) )
-                        {
-                            textSym->size() = 33000.0;
-                            osgText::Text* d = ts.create( mgrsCoord.sqid );
-                            osg::Matrixd textLocal2World;
-                            ecefSRS->createLocalToWorld( sqidTextECEF, textLocal2World );
-                            d->setPosition( sqidLocal );
-                            textGeode->addDrawable( d );
-                        }
+                            tile->addLabel( sqidTextMap, mgrsCoord.sqid, 33000.0f );
                     }
                 }
             }
@@ -471,27 +368,19 @@ MGRSGraticule::buildSQIDTiles( const std::string& gzd )
             for( double x = 100000.0; x < 700000.0; x += 100000.0 )
             {
                 double yminmax = sqrt( r2 - x*x );
-                Feature* f = new Feature( new LineString(2), extent.getSRS() );
-                f->geoInterp() = GEOINTERP_GREAT_CIRCLE;
                 osg::Vec3d p0, p1;
                 ups->transform( osg::Vec3d(x, -yminmax, 0), extent.getSRS(), p0 );
                 ups->transform( osg::Vec3d(x,  yminmax, 0), extent.getSRS(), p1 );
-                f->getGeometry()->push_back( p0 );
-                f->getGeometry()->push_back( p1 );
-                features.push_back( f );
+                tile->addLine( p0, p1, GEOINTERP_GREAT_CIRCLE );
             }
 
             for( double y = -600000.0; y < 700000.0; y += 100000.0 )
             {
                 double xmax = sqrt( r2 - y*y );
-                Feature* f = new Feature( new LineString(2), extent.getSRS() );
-                f->geoInterp() = GEOINTERP_GREAT_CIRCLE;
                 osg::Vec3d p0, p1;
                 ups->transform( osg::Vec3d(    0, y, 0), extent.getSRS(), p0 );
                 ups->transform( osg::Vec3d( xmax, y, 0), extent.getSRS(), p1 );
-                f->getGeometry()->push_back( p0 );
-                f->getGeometry()->push_back( p1 );
-                features.push_back( f );
+                tile->addLine( p0, p1, GEOINTERP_GREAT_CIRCLE );
             }
 
             for( double x = 0.0; x < 700000.0; x += 100000.0 )
@@ -503,27 +392,66 @@ MGRSGraticule::buildSQIDTiles( const std::string& gzd )
                     if ( sqidTextMap.y() > 84.0 )
                     {
                         sqidTextMap.z() += 1000.0;
-                        osg::Vec3d sqidTextECEF;
-                        extent.getSRS()->transform(sqidTextMap, ecefSRS, sqidTextECEF);
-                        //extent.getSRS()->transformToECEF(sqidTextMap, sqidTextECEF);
-                        osg::Vec3d sqidLocal = sqidTextECEF * world2local;
-
                         MGRSCoord mgrsCoord;
                         if ( mgrs.transform( GeoPoint(extent.getSRS(),sqidTextMap,ALTMODE_ABSOLUTE), mgrsCoord) )
-                        {
-                            textSym->size() = 33000.0;
-                            osgText::Text* d = ts.create( mgrsCoord.sqid );
-                            osg::Matrixd textLocal2World;
-                            ecefSRS->createLocalToWorld( sqidTextECEF, textLocal2World );
-                            d->setPosition( sqidLocal );
-                            textGeode->addDrawable( d );
-                        }
+                            tile->addLabel( sqidTextMap, mgrsCoord.sqid, 33000.0f );
                     }
                 }
             }
         }
     }
 
+    return tile;
+}
+
+osg::Node*
+MGRSGraticule::buildSQIDTiles( const std::string& gzd )
+{
+    const GeoExtent& extent = _gzd[gzd];
+
+    // the lines and labels are the same every time, and the slow part.
+    std::string tileName = "sqid_" + gzd;
+    osg::ref_ptr<GraticuleTile> tile;
+    if ( !_tileCache.valid() || !_tileCache->getTile(tileName, tile) )
+    {
+        tile = computeSQIDTile( gzd );
+        if ( _tileCache.valid() )
+            _tileCache->putTile( tileName, tile.get() );
+    }
+
+    TextSymbol* textSym = _options->secondaryStyle()->get<TextSymbol>();
+    if ( !textSym )
+        textSym = _options->primaryStyle()->getOrCreate<TextSymbol>();
+
+    TextSymbolizer ts( textSym );
+    osg::Geode* textGeode = new osg::Geode();
+    textGeode->getOrCreateStateSet()->setRenderBinDetails( 9999, "DepthSortedBin" );    
+    textGeode->getOrCreateStateSet()->setAttributeAndModes( _depthAttribute, 1 );
+
+    const SpatialReference* ecefSRS = extent.getSRS()->getECEF();
+    osg::Vec3d centerMap, centerECEF;
+    extent.getCentroid(centerMap.x(), centerMap.y());
+    extent.getSRS()->transform(centerMap, ecefSRS, centerECEF);
+
+    osg::Matrix local2world;
+    ecefSRS->createLocalToWorld( centerECEF, local2world );
+    osg::Matrix world2local;
+    world2local.invert(local2world);
+
+    for( std::vector<GraticuleTile::Label>::const_iterator i = tile->_labels.begin(); i != tile->_labels.end(); ++i )
+    {
+        osg::Vec3d sqidTextECEF;
+        extent.getSRS()->transform(i->_position, ecefSRS, sqidTextECEF);
+
+        textSym->size() = i->_size;
+        osgText::Text* d = ts.create( i->_text );
+        d->setPosition( sqidTextECEF * world2local );
+        textGeode->addDrawable( d );
+    }
+
+    FeatureList features;
+    tile->getFeatures( extent.getSRS(), features );
+
     osg::Group* group = new osg::Group();
 
     Style lineStyle;
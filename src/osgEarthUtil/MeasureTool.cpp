@@ -19,10 +19,13 @@
 
 #include <osgEarthUtil/MeasureTool>
 #include <osgEarth/GeoMath>
+#include <osgEarth/Terrain>
 
 #include <osgEarthFeatures/Feature>
 #include <osgEarthAnnotation/FeatureNode>
 
+#include <algorithm>
+
 #define LC "[MeasureTool] "
 
 using namespace osgEarth;
@@ -43,7 +46,9 @@ _finished          (false),
 _geoInterpolation  (GEOINTERP_GREAT_CIRCLE),
 _mouseButton       (osgGA::GUIEventAdapter::LEFT_MOUSE_BUTTON),
 _isPath            (false),
-_intersectionMask  (0xffffffff)
+_intersectionMask  (0xffffffff),
+_movePending       (false),
+_numCleanSegments  (0)
 {
     setMapNode( mapNode );
 }
@@ -62,6 +67,8 @@ MeasureToolHandler::setMapNode( MapNode* mapNode )
     if ( oldMapNode != mapNode )
     {
         _mapNode = mapNode;
+        _query = mapNode ? new AsyncTerrainQuery( mapNode ) : 0L;
+        _movePending = false;
         rebuild();
     }
 }
@@ -73,7 +80,9 @@ MeasureToolHandler::rebuild()
     if ( _group.valid() && _featureNode.valid() )
     {
         _group->removeChild( _featureNode.get() );
-        _featureNode = 0L;
+        _group->removeChild( _tempFeatureNode.get() );
+        _featureNode     = 0L;
+        _tempFeatureNode = 0L;
     }
 
     if ( !getMapNode() )
@@ -100,10 +109,24 @@ MeasureToolHandler::rebuild()
     ls->tessellation() = 20;
     _feature->style()->add( alt );
 
-    _featureNode = new FeatureNode( getMapNode(), _feature.get() );
+    _pathFeature = new Feature( new LineString(), getMapNode()->getMapSRS() );
+    _pathFeature->geoInterp() = _geoInterpolation;
+    _pathFeature->style() = _feature->style();
+
+    _tempFeature = new Feature( new LineString(), getMapNode()->getMapSRS() );
+    _tempFeature->geoInterp() = _geoInterpolation;
+    _tempFeature->style() = _feature->style();
+
+    _featureNode = new FeatureNode( getMapNode(), _pathFeature.get() );
     _featureNode->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
 
+    _tempFeatureNode = new FeatureNode( getMapNode(), _tempFeature.get() );
+    _tempFeatureNode->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+
     _group->addChild (_featureNode.get() );
+    _group->addChild (_tempFeatureNode.get() );
+
+    _numCleanSegments = 0;
 
 #ifdef SHOW_EXTENT
 
@@ -153,8 +176,12 @@ MeasureToolHandler::setGeoInterpolation( GeoInterpolation geoInterpolation )
     if (_geoInterpolation != geoInterpolation)
     {
         _geoInterpolation = geoInterpolation;
-        _feature->geoInterp() = _geoInterpolation;
+        _feature->geoInterp()     = _geoInterpolation;
+        _pathFeature->geoInterp() = _geoInterpolation;
+        _tempFeature->geoInterp() = _geoInterpolation;
         _featureNode->init();
+        _tempFeatureNode->init();
+        _numCleanSegments = 0;
         fireDistanceChanged();
     }
 }
@@ -162,8 +189,11 @@ MeasureToolHandler::setGeoInterpolation( GeoInterpolation geoInterpolation )
 void
 MeasureToolHandler::setLineStyle( const Style& style )
 {
-     _feature->style() = style;
+     _feature->style()     = style;
+     _pathFeature->style() = style;
+     _tempFeature->style() = style;
      _featureNode->init();
+     _tempFeatureNode->init();
 }
 
 bool MeasureToolHandler::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa )
@@ -187,6 +217,11 @@ bool MeasureToolHandler::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIAct
         _mouseDown = false;
         if (osg::equivalent(ea.getX(), _mouseDownX) && osg::equivalent(ea.getY(), _mouseDownY))
         {
+            // a move still in flight would land after (and on top of) the click.
+            if ( _query.valid() )
+                _query->cancel();
+            _movePending = false;
+
             double lon, lat;
             if (getLocationAt(view, ea.getX(), ea.getY(), lon, lat))
             {
@@ -208,7 +243,8 @@ bool MeasureToolHandler::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIAct
                     {                     
                         _feature->getGeometry()->push_back( osg::Vec3d( lon, lat, 0 ) );
                     }
-                    _featureNode->init();
+                    updatePath();
+                    updateTemporarySegment();
 
                     //_gotFirstLocation = false;
                     //_finished = true;
@@ -252,42 +288,127 @@ bool MeasureToolHandler::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIAct
     {
         if (_gotFirstLocation)
         {
+            // resolve the point under the mouse off the event thread (or, with a
+            // custom mask, once on the next frame) instead of on every move.
+            if (_intersectionMask == 0xffffffff && _query.valid())
+            {
+                if (_query->post(view, ea.getX(), ea.getY()))
+                    aa.requestRedraw();
+            }
+            else
+            {
+                _movePending = true;
+                _moveX = ea.getX();
+                _moveY = ea.getY();
+                aa.requestRedraw();
+            }
+        }
+    }
+    else if (ea.getEventType() == osgGA::GUIEventAdapter::FRAME)
+    {
+        if (_query.valid() && getMapNode())
+        {
+            AsyncTerrainQuery::Result result;
+            if (_query->poll(result) && result._hit)
+            {
+                double lon, lat;
+                toLonLat(result._world, lon, lat);
+                moveTemporaryPoint(lon, lat);
+                aa.requestRedraw();
+            }
+
+            if (_query->isBusy())
+                aa.requestRedraw();
+        }
+
+        if (_movePending)
+        {
+            _movePending = false;
             double lon, lat;
-            if (getLocationAt(view, ea.getX(), ea.getY(), lon, lat))
+            if (getLocationAt(view, _moveX, _moveY, lon, lat))
             {
-                if (!_lastPointTemporary)
-                {
-                    _feature->getGeometry()->push_back( osg::Vec3d( lon, lat, 0 ) );                 
-                    _lastPointTemporary = true;
-                }                        
-                else
-                {
-                    _feature->getGeometry()->back() = osg::Vec3d( lon, lat, 0 );
-                }
-                _featureNode->init();
-                fireDistanceChanged();
+                moveTemporaryPoint(lon, lat);
                 aa.requestRedraw();
             }
         }
-    }    
+    }
     return false;
 }
 
+void MeasureToolHandler::moveTemporaryPoint(double lon, double lat)
+{
+    if (!_gotFirstLocation)
+        return;
+
+    if (!_lastPointTemporary)
+    {
+        _feature->getGeometry()->push_back( osg::Vec3d( lon, lat, 0 ) );
+        _lastPointTemporary = true;
+    }
+    else
+    {
+        _feature->getGeometry()->back() = osg::Vec3d( lon, lat, 0 );
+    }
+    updateTemporarySegment();
+    fireDistanceChanged();
+}
+
+void MeasureToolHandler::updatePath()
+{
+    // everything but the point under the mouse:
+    Geometry* path = _feature->getGeometry();
+    unsigned num = path->size();
+    if ( _lastPointTemporary && num > 0 )
+        --num;
+
+    _pathFeature->getGeometry()->assign( path->begin(), path->begin() + num );
+    _featureNode->init();
+}
+
+void MeasureToolHandler::updateTemporarySegment()
+{
+    // the last fixed point and the point under the mouse:
+    Geometry* path = _feature->getGeometry();
+    Geometry* temp = _tempFeature->getGeometry();
+    temp->clear();
+    if ( _lastPointTemporary && path->size() > 1 )
+        temp->assign( path->end() - 2, path->end() );
+
+    _tempFeatureNode->init();
+}
+
+void MeasureToolHandler::toLonLat(const osg::Vec3d& point, double& lon, double& lat)
+{
+    double lat_rad, lon_rad, height;
+    getMapNode()->getMap()->getProfile()->getSRS()->getEllipsoid()->convertXYZToLatLongHeight(
+        point.x(), point.y(), point.z(), lat_rad, lon_rad, height );
+
+    lat = osg::RadiansToDegrees( lat_rad );
+    lon = osg::RadiansToDegrees( lon_rad );
+}
+
 bool MeasureToolHandler::getLocationAt(osgViewer::View* view, double x, double y, double &lon, double &lat)
 {
+    if ( !getMapNode() )
+        return false;
+
+    // with the default mask, pick on the terrain (over its heightfields when resident).
+    if ( _intersectionMask == 0xffffffff )
+    {
+        osg::Vec3d point;
+        if ( !getMapNode()->getTerrain()->getWorldCoordsUnderMouse(view, x, y, point) )
+            return false;
+
+        toLonLat( point, lon, lat );
+        return true;
+    }
+
     osgUtil::LineSegmentIntersector::Intersections results;            
-    if ( getMapNode() &&  view->computeIntersections( x, y, results, _intersectionMask ) )
+    if ( view->computeIntersections( x, y, results, _intersectionMask ) )
     {
         // find the first hit under the mouse:
         osgUtil::LineSegmentIntersector::Intersection first = *(results.begin());
-        osg::Vec3d point = first.getWorldIntersectPoint();
-
-        double lat_rad, lon_rad, height;       
-        getMapNode()->getMap()->getProfile()->getSRS()->getEllipsoid()->convertXYZToLatLongHeight( 
-            point.x(), point.y(), point.z(), lat_rad, lon_rad, height );
-
-        lat = osg::RadiansToDegrees( lat_rad );
-        lon = osg::RadiansToDegrees( lon_rad );
+        toLonLat( first.getWorldIntersectPoint(), lon, lat );
         return true;
     }
     return false;
@@ -297,8 +418,10 @@ void MeasureToolHandler::clear()
 {
     //Clear the locations    
     _feature->getGeometry()->clear();
-    //_features->dirty();
-    _featureNode->init();
+    _lastPointTemporary = false;
+    _numCleanSegments = 0;
+    updatePath();
+    updateTemporarySegment();
 
 #ifdef SHOW_EXTENT
     _extentFeature->getGeometry()->clear();
@@ -307,6 +430,10 @@ void MeasureToolHandler::clear()
 
     fireDistanceChanged();
 
+    if ( _query.valid() )
+        _query->cancel();
+    _movePending = false;
+
     _gotFirstLocation = false; 
     _lastPointTemporary = false; 
 }
@@ -332,14 +459,33 @@ void MeasureToolHandler::addEventHandler(MeasureToolEventHandler* handler )
 
 void MeasureToolHandler::fireDistanceChanged()
 {
-    double distance = 0;
-    if (_geoInterpolation == GEOINTERP_GREAT_CIRCLE)
+    // only measure the segments that changed since the last call.
+    const std::vector<osg::Vec3d>& points = _feature->getGeometry()->asVector();
+    unsigned numSegments = points.size() > 1 ? points.size()-1 : 0;
+
+    _numCleanSegments = osg::minimum( _numCleanSegments, numSegments );
+    _segmentLengths.resize( numSegments );
+
+    if ( _numCleanSegments < numSegments )
     {
-        distance = GeoMath::distance(_feature->getGeometry()->asVector());
+        std::vector<osg::Vec3d> dirty( points.begin() + _numCleanSegments, points.end() );
+        std::vector<double>     lengths;
+
+        if (_geoInterpolation == GEOINTERP_GREAT_CIRCLE)
+            GeoMath::distances( dirty, lengths );
+        else
+            GeoMath::rhumbDistances( dirty, lengths );
+
+        std::copy( lengths.begin(), lengths.end(), _segmentLengths.begin() + _numCleanSegments );
     }
-    else if (_geoInterpolation == GEOINTERP_RHUMB_LINE) 
+
+    // the segment to the point under the mouse will change again.
+    _numCleanSegments = _lastPointTemporary && numSegments > 0 ? numSegments-1 : numSegments;
+
+    double distance = 0;
+    for (unsigned i = 0; i < numSegments; ++i)
     {
-        distance = GeoMath::rhumbDistance(_feature->getGeometry()->asVector());
+        distance += _segmentLengths[i];
     }
     for (MeasureToolEventHandlerList::const_iterator i = _eventHandlers.begin(); i != _eventHandlers.end(); ++i)
     {
@@ -34,6 +34,8 @@ _mapNode( mapNode )
 {
     _mapNodePath.push_back( mapNode->getTerrainEngine() );
 
+    _query = new AsyncTerrainQuery( mapNode );
+
     if ( label )
     {
         addCallback( new MouseCoordsLabelCallback(label, formatter) );
@@ -51,25 +53,49 @@ MouseCoordsTool::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapt
 {
     if (ea.getEventType() == ea.MOVE || ea.getEventType() == ea.DRAG)
     {
-        osg::Vec3d world;
-        if ( _mapNode->getTerrain()->getWorldCoordsUnderMouse(aa.asView(), ea.getX(), ea.getY(), world) )
+        if ( _query->post(aa.asView(), ea.getX(), ea.getY()) )
         {
-            GeoPoint map;
-            map.fromWorld( _mapNode->getMapSRS(), world );
-
-            for( Callbacks::iterator i = _callbacks.begin(); i != _callbacks.end(); ++i )
-                i->get()->set( map, aa.asView(), _mapNode );
+            // keep frames (and so FRAME events) coming until the answer arrives.
+            aa.requestRedraw();
         }
         else
         {
-            for( Callbacks::iterator i = _callbacks.begin(); i != _callbacks.end(); ++i )
-                i->get()->reset( aa.asView(), _mapNode );
+            _query->cancel();
+            fire( AsyncTerrainQuery::Result(), aa.asView() );
         }
     }
 
+    else if ( ea.getEventType() == ea.FRAME )
+    {
+        AsyncTerrainQuery::Result result;
+        if ( _query->poll(result) )
+            fire( result, aa.asView() );
+
+        if ( _query->isBusy() )
+            aa.requestRedraw();
+    }
+
     return false;
 }
 
+void
+MouseCoordsTool::fire( const AsyncTerrainQuery::Result& result, osg::View* view )
+{
+    if ( result._hit )
+    {
+        GeoPoint map;
+        map.fromWorld( _mapNode->getMapSRS(), result._world );
+
+        for( Callbacks::iterator i = _callbacks.begin(); i != _callbacks.end(); ++i )
+            i->get()->set( map, view, _mapNode );
+    }
+    else
+    {
+        for( Callbacks::iterator i = _callbacks.begin(); i != _callbacks.end(); ++i )
+            i->get()->reset( view, _mapNode );
+    }
+}
+
 //-----------------------------------------------------------------------
 
 MouseCoordsLabelCallback::MouseCoordsLabelCallback( LabelControl* label, Formatter* formatter ) :
@@ -0,0 +1,407 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthUtil/NoiseMap>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/StringUtils>
+
+#define LC "[NoiseMap] "
+
+// most octaves the shader will sum
+#define MAX_OCTAVES     8
+#define MAX_OCTAVES_STR "8"
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const char* vs =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+
+        "uniform mat4 osg_ViewMatrixInverse; \n"
+        "varying vec3 oe_Normal; \n"
+        "varying vec3 oe_noise_world; \n"
+        "varying vec3 oe_noise_up; \n"
+
+        "void oe_noise_vertex(inout vec4 VertexVIEW) \n"
+        "{ \n"
+        "    oe_noise_world = (osg_ViewMatrixInverse * VertexVIEW).xyz; \n"
+        "    oe_noise_up    = normalize(mat3(osg_ViewMatrixInverse) * oe_Normal); \n"
+        "} \n";
+
+    // 3D simplex noise, after Stefan Gustavson and Ian McEwan (Ashima Arts,
+    // MIT license), summed over octaves the way libnoise's Perlin module does.
+    const char* noise =
+        "uniform float oe_noise_frequency; \n"
+        "uniform int   oe_noise_octaves; \n"
+        "uniform float oe_noise_persistence; \n"
+        "uniform float oe_noise_lacunarity; \n"
+        "uniform vec3  oe_noise_seed; \n"
+
+        "vec3 oe_noise_mod289(vec3 x) { return x - floor(x * (1.0/289.0)) * 289.0; } \n"
+        "vec4 oe_noise_mod289(vec4 x) { return x - floor(x * (1.0/289.0)) * 289.0; } \n"
+        "vec4 oe_noise_permute(vec4 x) { return oe_noise_mod289(((x*34.0)+1.0)*x); } \n"
+
+        "float oe_noise_simplex(vec3 v) \n"
+        "{ \n"
+        "    const vec2 C = vec2(1.0/6.0, 1.0/3.0); \n"
+        "    const vec4 D = vec4(0.0, 0.5, 1.0, 2.0); \n"
+
+        "    vec3 i  = floor(v + dot(v, C.yyy)); \n"
+        "    vec3 x0 = v - i + dot(i, C.xxx); \n"
+        "    vec3 g  = step(x0.yzx, x0.xyz); \n"
+        "    vec3 l  = 1.0 - g; \n"
+        "    vec3 i1 = min(g.xyz, l.zxy); \n"
+        "    vec3 i2 = max(g.xyz, l.zxy); \n"
+        "    vec3 x1 = x0 - i1 + C.xxx; \n"
+        "    vec3 x2 = x0 - i2 + C.yyy; \n"
+        "    vec3 x3 = x0 - D.yyy; \n"
+
+        "    i = oe_noise_mod289(i); \n"
+        "    vec4 p = oe_noise_permute(oe_noise_permute(oe_noise_permute( \n"
+        "                 i.z + vec4(0.0, i1.z, i2.z, 1.0)) \n"
+        "               + i.y + vec4(0.0, i1.y, i2.y, 1.0)) \n"
+        "               + i.x + vec4(0.0, i1.x, i2.x, 1.0)); \n"
+
+        "    vec3 ns = 0.142857142857 * D.wyz - D.xzx; \n"
+        "    vec4 j  = p - 49.0 * floor(p * ns.z * ns.z); \n"
+        "    vec4 x_ = floor(j * ns.z); \n"
+        "    vec4 y_ = floor(j - 7.0 * x_); \n"
+        "    vec4 x  = x_ * ns.x + ns.yyyy; \n"
+        "    vec4 y  = y_ * ns.x + ns.yyyy; \n"
+        "    vec4 h  = 1.0 - abs(x) - abs(y); \n"
+        "    vec4 b0 = vec4(x.xy, y.xy); \n"
+        "    vec4 b1 = vec4(x.zw, y.zw); \n"
+        "    vec4 s0 = floor(b0)*2.0 + 1.0; \n"
+        "    vec4 s1 = floor(b1)*2.0 + 1.0; \n"
+        "    vec4 sh = -step(h, vec4(0.0)); \n"
+        "    vec4 a0 = b0.xzyw + s0.xzyw*sh.xxyy; \n"
+        "    vec4 a1 = b1.xzyw + s1.xzyw*sh.zzww; \n"
+        "    vec3 p0 = vec3(a0.xy, h.x); \n"
+        "    vec3 p1 = vec3(a0.zw, h.y); \n"
+        "    vec3 p2 = vec3(a1.xy, h.z); \n"
+        "    vec3 p3 = vec3(a1.zw, h.w); \n"
+
+        "    vec4 norm = 1.79284291400159 - 0.85373472095314 * vec4(dot(p0,p0), dot(p1,p1), dot(p2,p2), dot(p3,p3)); \n"
+        "    p0 *= norm.x; p1 *= norm.y; p2 *= norm.z; p3 *= norm.w; \n"
+
+        "    vec4 m = max(0.6 - vec4(dot(x0,x0), dot(x1,x1), dot(x2,x2), dot(x3,x3)), 0.0); \n"
+        "    m = m * m; \n"
+        "    return 42.0 * dot(m*m, vec4(dot(p0,x0), dot(p1,x1), dot(p2,x2), dot(p3,x3))); \n"
+        "} \n"
+
+        "float oe_noise_fractal(vec3 world) \n"
+        "{ \n"
+        "    float f = oe_noise_frequency; \n"
+        "    float a = 1.0; \n"
+        "    float n = 0.0; \n"
+        "    for(int i=0; i<" MAX_OCTAVES_STR "; ++i) \n"
+        "    { \n"
+        "        if ( i >= oe_noise_octaves ) break; \n"
+        "        n += a * oe_noise_simplex(world*f + oe_noise_seed); \n"
+        "        f *= oe_noise_lacunarity; \n"
+        "        a *= oe_noise_persistence; \n"
+        "    } \n"
+        "    return n; \n"
+        "} \n";
+
+    // color mode: lighten and darken, like a detail texture.
+    const char* fs_color =
+        "uniform float oe_noise_intensity; \n"
+        "varying vec3  oe_noise_world; \n"
+
+        "void oe_noise_fragment(inout vec4 color) \n"
+        "{ \n"
+        "    float n = oe_noise_fractal(oe_noise_world); \n"
+        "    color.rgb = clamp( color.rgb + vec3(0.5*n*oe_noise_intensity), 0.0, 1.0 ); \n"
+        "} \n";
+
+    // normal map mode: lights the surface with the normal of the noise height
+    // field (scale * noise) laid over the terrain.
+    const char* vs_lighting =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+
+        "void oe_lighting_vertex(inout vec4 VertexVIEW) \n"
+        "{ \n"
+        "} \n";
+
+    const char* fs_lighting =
+        "uniform bool  oe_mode_GL_LIGHTING; \n"
+        "uniform float oe_noise_scale; \n"
+        "uniform mat4  osg_ViewMatrix; \n"
+        "varying vec3  oe_noise_world; \n"
+        "varying vec3  oe_noise_up; \n"
+
+        "void oe_lighting_fragment(inout vec4 color) \n"
+        "{ \n"
+        "    if (oe_mode_GL_LIGHTING) \n"
+        "    { \n"
+        "        vec3 up    = normalize(oe_noise_up); \n"
+        "        vec3 east  = normalize(cross(vec3(0.0, 0.0, 1.0), up) + vec3(1e-6, 0.0, 0.0)); \n"
+        "        vec3 north = cross(up, east); \n"
+
+        // sample at a quarter wavelength of the finest octave.
+        "        float d = 0.25 / (oe_noise_frequency * pow(oe_noise_lacunarity, float(oe_noise_octaves-1))); \n"
+        "        float k = oe_noise_scale / (2.0*d); \n"
+        "        float dhdx = k * (oe_noise_fractal(oe_noise_world + d*east)  - oe_noise_fractal(oe_noise_world - d*east)); \n"
+        "        float dhdy = k * (oe_noise_fractal(oe_noise_world + d*north) - oe_noise_fractal(oe_noise_world - d*north)); \n"
+
+        "        vec3 N = normalize(mat3(osg_ViewMatrix) * normalize(up - dhdx*east - dhdy*north)); \n"
+        "        vec3 L = normalize(gl_LightSource[0].position.xyz); \n"
+
+        "        vec4 ambient = gl_LightSource[0].ambient * gl_FrontMaterial.ambient; \n"
+        "        vec4 diffuse = gl_LightSource[0].diffuse * gl_FrontMaterial.diffuse * max(dot(L, N), 0.0); \n"
+
+        "        color.rgb = (ambient.rgb*color.rgb) + (diffuse.rgb*color.rgb); \n"
+        "    } \n"
+        "} \n";
+
+    std::string makeFragmentShader( const char* body )
+    {
+        return Stringify()
+            << "#version " GLSL_VERSION_STR "\n"
+            << GLSL_DEFAULT_PRECISION_FLOAT "\n"
+            << noise
+            << body;
+    }
+}
+
+
+NoiseMap::NoiseMap() :
+TerrainEffect(),
+_frequency   ( 1.0 ),
+_resolution  ( 1.0 ),
+_octaves     ( 3 ),
+_persistence ( 0.5f ),
+_lacunarity  ( 2.0f ),
+_seed        ( 0 ),
+_scale       ( 1.0f ),
+_intensity   ( 0.25f ),
+_normalMap   ( false )
+{
+    init();
+}
+
+NoiseMap::NoiseMap(const Config& conf) :
+TerrainEffect(),
+_frequency   ( 1.0 ),
+_resolution  ( 1.0 ),
+_octaves     ( 3 ),
+_persistence ( 0.5f ),
+_lacunarity  ( 2.0f ),
+_seed        ( 0 ),
+_scale       ( 1.0f ),
+_intensity   ( 0.25f ),
+_normalMap   ( false )
+{
+    mergeConfig(conf);
+    init();
+}
+
+
+void
+NoiseMap::init()
+{
+    // resolution is the reciprocal of frequency, as in the noise driver.
+    if ( _resolution.isSet() && !_resolution.isSetTo(0.0) )
+    {
+        _frequency.init( 1.0 / *_resolution );
+    }
+
+    _frequencyUniform   = new osg::Uniform(osg::Uniform::FLOAT,      "oe_noise_frequency");
+    _octavesUniform     = new osg::Uniform(osg::Uniform::INT,        "oe_noise_octaves");
+    _persistenceUniform = new osg::Uniform(osg::Uniform::FLOAT,      "oe_noise_persistence");
+    _lacunarityUniform  = new osg::Uniform(osg::Uniform::FLOAT,      "oe_noise_lacunarity");
+    _seedUniform        = new osg::Uniform(osg::Uniform::FLOAT_VEC3, "oe_noise_seed");
+    _scaleUniform       = new osg::Uniform(osg::Uniform::FLOAT,      "oe_noise_scale");
+    _intensityUniform   = new osg::Uniform(osg::Uniform::FLOAT,      "oe_noise_intensity");
+
+    setFrequency  ( _frequency.get() );
+    setOctaves    ( _octaves.get() );
+    setPersistence( _persistence.get() );
+    setLacunarity ( _lacunarity.get() );
+    setSeed       ( _seed.get() );
+    setScale      ( _scale.get() );
+    setIntensity  ( _intensity.get() );
+}
+
+
+void
+NoiseMap::setFrequency(double value)
+{
+    _frequency = value;
+    _frequencyUniform->set( (float)value );
+}
+
+
+void
+NoiseMap::setOctaves(unsigned value)
+{
+    _octaves = osg::clampBetween( value, 1u, (unsigned)MAX_OCTAVES );
+    _octavesUniform->set( (int)_octaves.get() );
+}
+
+
+void
+NoiseMap::setPersistence(float value)
+{
+    _persistence = value;
+    _persistenceUniform->set( value );
+}
+
+
+void
+NoiseMap::setLacunarity(float value)
+{
+    _lacunarity = value;
+    _lacunarityUniform->set( value );
+}
+
+
+void
+NoiseMap::setSeed(int value)
+{
+    _seed = value;
+
+    // the seed just moves the sample point within the noise lattice.
+    double s = (double)value;
+    _seedUniform->set( osg::Vec3f(
+        (float)fmod(s * 17.31, 289.0),
+        (float)fmod(s * 41.17, 289.0),
+        (float)fmod(s * 7.93,  289.0) ) );
+}
+
+
+void
+NoiseMap::setScale(float value)
+{
+    _scale = value;
+    _scaleUniform->set( value );
+}
+
+
+void
+NoiseMap::setIntensity(float value)
+{
+    _intensity = osg::clampBetween( value, 0.0f, 1.0f );
+    _intensityUniform->set( _intensity.get() );
+}
+
+
+void
+NoiseMap::onInstall(TerrainEngineNode* engine)
+{
+    if ( engine )
+    {
+        osg::StateSet* stateset = engine->getOrCreateStateSet();
+
+        stateset->addUniform( _frequencyUniform.get() );
+        stateset->addUniform( _octavesUniform.get() );
+        stateset->addUniform( _persistenceUniform.get() );
+        stateset->addUniform( _lacunarityUniform.get() );
+        stateset->addUniform( _seedUniform.get() );
+        stateset->addUniform( _scaleUniform.get() );
+        stateset->addUniform( _intensityUniform.get() );
+
+        VirtualProgram* vp = VirtualProgram::getOrCreate(stateset);
+        vp->setFunction( "oe_noise_vertex", vs, ShaderComp::LOCATION_VERTEX_VIEW );
+
+        if ( _normalMap == true )
+        {
+            // these special (built-in) function names are for the main lighting shaders.
+            // using them here will override the default lighting.
+            vp->setFunction( "oe_lighting_vertex",   vs_lighting, ShaderComp::LOCATION_VERTEX_VIEW, 0.0 );
+            vp->setFunction( "oe_lighting_fragment", makeFragmentShader(fs_lighting), ShaderComp::LOCATION_FRAGMENT_LIGHTING, 0.0 );
+        }
+        else
+        {
+            vp->setFunction( "oe_noise_fragment", makeFragmentShader(fs_color), ShaderComp::LOCATION_FRAGMENT_COLORING );
+        }
+    }
+}
+
+
+void
+NoiseMap::onUninstall(TerrainEngineNode* engine)
+{
+    osg::StateSet* stateset = engine ? engine->getStateSet() : 0L;
+    if ( stateset )
+    {
+        stateset->removeUniform( _frequencyUniform.get() );
+        stateset->removeUniform( _octavesUniform.get() );
+        stateset->removeUniform( _persistenceUniform.get() );
+        stateset->removeUniform( _lacunarityUniform.get() );
+        stateset->removeUniform( _seedUniform.get() );
+        stateset->removeUniform( _scaleUniform.get() );
+        stateset->removeUniform( _intensityUniform.get() );
+
+        VirtualProgram* vp = VirtualProgram::get(stateset);
+        if ( vp )
+        {
+            vp->removeShader( "oe_noise_vertex" );
+            if ( _normalMap == true )
+            {
+                vp->removeShader( "oe_lighting_vertex" );
+                vp->removeShader( "oe_lighting_fragment" );
+            }
+            else
+            {
+                vp->removeShader( "oe_noise_fragment" );
+            }
+        }
+    }
+}
+
+
+//-------------------------------------------------------------
+
+void
+NoiseMap::mergeConfig(const Config& conf)
+{
+    // same names as the noise driver's options.
+    conf.getIfSet( "frequency",   _frequency );
+    conf.getIfSet( "resolution",  _resolution );
+    conf.getIfSet( "octaves",     _octaves );
+    conf.getIfSet( "persistence", _persistence );
+    conf.getIfSet( "lacunarity",  _lacunarity );
+    conf.getIfSet( "seed",        _seed );
+    conf.getIfSet( "scale",       _scale );
+    conf.getIfSet( "intensity",   _intensity );
+    conf.getIfSet( "normal_map",  _normalMap );
+}
+
+Config
+NoiseMap::getConfig() const
+{
+    Config conf("noise_map");
+    conf.addIfSet( "frequency",   _frequency );
+    conf.addIfSet( "octaves",     _octaves );
+    conf.addIfSet( "persistence", _persistence );
+    conf.addIfSet( "lacunarity",  _lacunarity );
+    conf.addIfSet( "seed",        _seed );
+    conf.addIfSet( "scale",       _scale );
+    conf.addIfSet( "intensity",   _intensity );
+    conf.addIfSet( "normal_map",  _normalMap );
+    return conf;
+}
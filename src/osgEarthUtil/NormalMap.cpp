@@ -21,6 +21,7 @@
 #include <osgEarth/Capabilities>
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/TerrainEngineNode>
+#include <osgEarth/StringUtils>
 
 #define LC "[NormalMap] "
 
@@ -60,16 +61,43 @@ namespace
         "    } \n"
         "} \n";
 
-    const char* fs =
-        "#version " GLSL_VERSION_STR "\n"
-        GLSL_DEFAULT_PRECISION_FLOAT "\n"
-
+    // normal from the normal map layer:
+    const char* fs_normal_layer =
         "uniform sampler2D oe_nmap_tex; \n"
+        "varying vec4 oe_layer_tilec; \n"
+
+        "vec3 oe_nmap_normal() \n"
+        "{ \n"
+        "    return normalize(texture2D(oe_nmap_tex, oe_layer_tilec.st).xyz * 2.0 - 1.0); \n"
+        "} \n";
+
+    // normal from the gradient of the tile's elevation texture, in the
+    // same (east, north, up) tangent space the vertex shader sets up.
+    const char* fs_normal_elevation =
+        "uniform sampler2D oe_terrain_tex; \n"
+        "uniform mat4 oe_terrain_tex_matrix; \n"
+        "uniform vec4 oe_terrain_tex_size; \n"
+        "varying vec4 oe_layer_tilec; \n"
+
+        "vec3 oe_nmap_normal() \n"
+        "{ \n"
+        "    vec2 c  = (oe_terrain_tex_matrix * oe_layer_tilec).st; \n"
+        "    vec2 dt = 1.0/oe_terrain_tex_size.xy; \n"
+        "    float w = texture2D(oe_terrain_tex, c - vec2(dt.x, 0.0)).r; \n"
+        "    float e = texture2D(oe_terrain_tex, c + vec2(dt.x, 0.0)).r; \n"
+        "    float s = texture2D(oe_terrain_tex, c - vec2(0.0, dt.y)).r; \n"
+        "    float n = texture2D(oe_terrain_tex, c + vec2(0.0, dt.y)).r; \n"
+        "    return normalize(vec3( \n"
+        "        (w-e)/(2.0*oe_terrain_tex_size.z), \n"
+        "        (s-n)/(2.0*oe_terrain_tex_size.w), \n"
+        "        1.0)); \n"
+        "} \n";
+
+    const char* fs =
         "uniform float oe_nmap_startlod; \n"
         "uniform vec4 oe_tile_key; \n"
         "uniform bool oe_mode_GL_LIGHTING; \n"
 
-        "varying vec4 oe_layer_tilec; \n"
         "varying vec3 oe_nmap_light; \n"
         "varying vec3 oe_nmap_view; \n"
 
@@ -78,7 +106,7 @@ namespace
         "    if (oe_mode_GL_LIGHTING) \n"
         "    { \n"
         "        vec3 L = normalize(oe_nmap_light); \n"
-        "        vec3 N = normalize(texture2D(oe_nmap_tex, oe_layer_tilec.st).xyz * 2.0 - 1.0); \n"
+        "        vec3 N = oe_nmap_normal(); \n"
         "        vec3 V = normalize(oe_nmap_view); \n"
 
         "        vec4 ambient  = gl_LightSource[0].ambient * gl_FrontMaterial.ambient; \n"
@@ -144,13 +172,31 @@ NormalMap::onInstall(TerrainEngineNode* engine)
     if ( engine )
     {
         osg::StateSet* stateset = engine->getOrCreateStateSet();
+        const char* fs_normal = 0L;
         if ( _layer.valid() )
         {
             OE_NOTICE << LC << "Installing layer " << _layer->getName() << " as normal map" << std::endl;
             int unit = *_layer->shareImageUnit();
             _samplerUniform = stateset->getOrCreateUniform("oe_nmap_tex", osg::Uniform::SAMPLER_2D);
             _samplerUniform->set(unit);
+            fs_normal = fs_normal_layer;
         }
+        else if ( engine->requireElevationTextures() >= 0 )
+        {
+            OE_NOTICE << LC << "Deriving normals from the terrain's elevation textures" << std::endl;
+            fs_normal = fs_normal_elevation;
+        }
+        else
+        {
+            OE_WARN << LC << "No normal map layer, and the terrain engine has no elevation textures; disabled." << std::endl;
+            return;
+        }
+
+        std::string fs_full = Stringify()
+            << "#version " GLSL_VERSION_STR "\n"
+            << GLSL_DEFAULT_PRECISION_FLOAT "\n"
+            << fs_normal
+            << fs;
         
         stateset->addUniform( _startLODUniform.get() );
 
@@ -159,7 +205,7 @@ NormalMap::onInstall(TerrainEngineNode* engine)
         // these special (built-in) function names are for the main lighting shaders.
         // using them here will override the default lighting.
         vp->setFunction( "oe_lighting_vertex",   vs, ShaderComp::LOCATION_VERTEX_VIEW, 0.0 );
-        vp->setFunction( "oe_lighting_fragment", fs, ShaderComp::LOCATION_FRAGMENT_LIGHTING, 0.0 );
+        vp->setFunction( "oe_lighting_fragment", fs_full, ShaderComp::LOCATION_FRAGMENT_LIGHTING, 0.0 );
     }
 }
 
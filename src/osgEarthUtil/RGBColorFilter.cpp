@@ -128,3 +128,13 @@ RGBColorFilter::getConfig() const
     conf.add( "b", val[2] );
     return conf;
 }
+
+bool
+RGBColorFilter::getConstantCode(std::string& out_code) const
+{
+    osg::Vec3f rgb;
+    m_rgb->get(rgb);
+    out_code = osgEarth::Stringify()
+        << "color.rgb = clamp(color.rgb + vec3(" << glslFloat(rgb[0]) << ", " << glslFloat(rgb[1]) << ", " << glslFloat(rgb[2]) << "), 0.0, 1.0);\n";
+    return true;
+}
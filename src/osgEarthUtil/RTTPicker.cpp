@@ -0,0 +1,302 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2013 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthUtil/RTTPicker>
+#include <osgEarth/VirtualProgram>
+#include <osgViewer/View>
+#include <osgViewer/ViewerBase>
+
+#define LC "[RTTPicker] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+//-----------------------------------------------------------------------
+
+namespace
+{
+    // picks the per-vertex ID if there is one, the per-node ID otherwise.
+    const char* pickVertexShader =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+        "attribute float oe_pick_objectid_attr; \n"
+        "uniform float oe_pick_objectid; \n"
+        "varying float oe_pick_v; \n"
+        "void oe_pick_vertex(inout vec4 VertexMODEL) \n"
+        "{ \n"
+        "    oe_pick_v = oe_pick_objectid_attr > 0.0 ? oe_pick_objectid_attr : oe_pick_objectid; \n"
+        "} \n";
+
+    // encodes the 24-bit object ID into RGB; runs after everything else
+    // so that no coloring or lighting function can change it.
+    const char* pickFragmentShader =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+        "varying float oe_pick_v; \n"
+        "void oe_pick_fragment(inout vec4 color) \n"
+        "{ \n"
+        "    float id = floor(oe_pick_v + 0.5); \n"
+        "    float b  = floor(id / 65536.0); \n"
+        "    float g  = floor((id - b*65536.0) / 256.0); \n"
+        "    float r  = id - b*65536.0 - g*256.0; \n"
+        "    color = vec4(r/255.0, g/255.0, b/255.0, id > 0.0 ? 1.0 : 0.0); \n"
+        "} \n";
+
+    // records the last frame in which the pick camera was drawn.
+    struct DrawMonitor : public osg::Camera::DrawCallback
+    {
+        DrawMonitor() : _drawn( false ), _frame( 0 ) { }
+
+        void operator()( osg::RenderInfo& renderInfo ) const
+        {
+            const osg::FrameStamp* fs = renderInfo.getState()->getFrameStamp();
+            Threading::ScopedMutexLock lock( _mutex );
+            _frame = fs ? fs->getFrameNumber() : _frame + 1;
+            _drawn = true;
+        }
+
+        bool drawnSince( unsigned frame ) const
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            return _drawn && _frame >= frame;
+        }
+
+        mutable bool             _drawn;
+        mutable unsigned         _frame;
+        mutable Threading::Mutex _mutex;
+    };
+}
+
+//-----------------------------------------------------------------------
+
+RTTPicker::RTTPicker( int bufferSize ) :
+_bufferSize( osg::maximum(bufferSize, 1) )
+{
+    _group = new osg::Group();
+
+    _pickStateSet = new osg::StateSet();
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate( _pickStateSet.get() );
+    vp->setFunction( "oe_pick_vertex",   pickVertexShader,   ShaderComp::LOCATION_VERTEX_MODEL );
+    vp->setFunction( "oe_pick_fragment", pickFragmentShader, ShaderComp::LOCATION_FRAGMENT_LIGHTING, FLT_MAX );
+    vp->addBindAttribLocation( ObjectIndex::getAttribName(), ObjectIndex::getAttribLocation() );
+
+    // objects without an ID still occlude the ones behind them.
+    _pickStateSet->addUniform( ObjectIndex::createUniform(0) );
+
+    // blending would mix neighboring IDs into a meaningless one.
+    _pickStateSet->setMode( GL_BLEND, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE );
+}
+
+RTTPicker::~RTTPicker()
+{
+    for( PickContexts::iterator pc = _pickContexts.begin(); pc != _pickContexts.end(); ++pc )
+    {
+        osg::ref_ptr<osg::View> view;
+        if ( pc->_view.lock(view) )
+        {
+            unsigned i = view->findSlaveIndexForCamera( pc->_pickCamera.get() );
+            if ( i < view->getNumSlaves() )
+                view->removeSlave( i );
+        }
+    }
+}
+
+bool
+RTTPicker::addChild( osg::Node* child )
+{
+    return _group->addChild( child );
+}
+
+RTTPicker::PickContext*
+RTTPicker::getOrCreatePickContext( osg::View* view )
+{
+    for( PickContexts::iterator pc = _pickContexts.begin(); pc != _pickContexts.end(); ++pc )
+    {
+        if ( pc->_view.get() == view )
+            return &(*pc);
+    }
+
+    osg::GraphicsContext* gc = view->getCamera() ? view->getCamera()->getGraphicsContext() : 0L;
+    if ( !gc )
+    {
+        OE_WARN << LC << "View has no graphics context to pick with" << std::endl;
+        return 0L;
+    }
+
+    PickContext pc;
+    pc._view        = view;
+    pc._hasPending  = false;
+    pc._inFlight    = false;
+    pc._issuedFrame = 0;
+
+    pc._image = new osg::Image();
+    pc._image->allocateImage( _bufferSize, _bufferSize, 1, GL_RGB, GL_UNSIGNED_BYTE );
+
+    DrawMonitor* monitor = new DrawMonitor();
+    pc._drawMonitor = monitor;
+
+    osg::Camera* cam = new osg::Camera();
+    cam->setName( "oe.RTTPicker" );
+    cam->setGraphicsContext( gc );
+    cam->setReferenceFrame( osg::Camera::RELATIVE_RF );
+    cam->setRenderOrder( osg::Camera::PRE_RENDER );
+    cam->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
+    cam->setViewport( 0, 0, _bufferSize, _bufferSize );
+    cam->setClearColor( osg::Vec4(0,0,0,0) );
+    cam->setClearMask( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    cam->attach( osg::Camera::COLOR_BUFFER0, pc._image.get() );
+    cam->attach( osg::Camera::DEPTH_BUFFER, GL_DEPTH_COMPONENT24 );
+    cam->setFinalDrawCallback( monitor );
+    cam->setStateSet( _pickStateSet.get() );
+    cam->setAllowEventFocus( false );
+    cam->setNodeMask( 0 );
+    cam->addChild( _group.get() );
+    pc._pickCamera = cam;
+
+    // the viewer sets up its threads per camera, so restart them for the new one.
+    osgViewer::View*       viewerView = dynamic_cast<osgViewer::View*>( view );
+    osgViewer::ViewerBase* viewer     = viewerView ? viewerView->getViewerBase() : 0L;
+    bool restart = viewer && viewer->areThreadsRunning();
+    if ( restart )
+        viewer->stopThreading();
+
+    view->addSlave( cam, false );
+
+    if ( restart )
+        viewer->startThreading();
+
+    _pickContexts.push_back( pc );
+    return &_pickContexts.back();
+}
+
+bool
+RTTPicker::pick( osg::View* view, float x, float y, Callback* callback )
+{
+    if ( !view || !callback )
+        return false;
+
+    PickContext* pc = getOrCreatePickContext( view );
+    if ( !pc )
+        return false;
+
+    pc->_pending._x        = x;
+    pc->_pending._y        = y;
+    pc->_pending._callback = callback;
+    pc->_hasPending        = true;
+    return true;
+}
+
+void
+RTTPicker::issue( PickContext& pc, unsigned frameNumber )
+{
+    osg::ref_ptr<osg::View> view;
+    if ( !pc._view.lock(view) )
+        return;
+
+    const osg::Viewport* vp = view->getCamera()->getViewport();
+    unsigned i = view->findSlaveIndexForCamera( pc._pickCamera.get() );
+    if ( !vp || vp->width() <= 0 || vp->height() <= 0 || i >= view->getNumSlaves() )
+        return;
+
+    // zoom the master's projection in on the pick point, so that the
+    // buffer covers a bufferSize-pixel window around it.
+    double nx = 2.0*(pc._pending._x - vp->x())/vp->width()  - 1.0;
+    double ny = 2.0*(pc._pending._y - vp->y())/vp->height() - 1.0;
+
+    view->getSlave(i)._projectionOffset =
+        osg::Matrix::translate( -nx, -ny, 0.0 ) *
+        osg::Matrix::scale( vp->width()/(double)_bufferSize, vp->height()/(double)_bufferSize, 1.0 );
+
+    pc._issued      = pc._pending;
+    pc._issuedFrame = frameNumber;
+    pc._inFlight    = true;
+    pc._hasPending  = false;
+    pc._pending._callback = 0L;
+}
+
+void
+RTTPicker::complete( PickContext& pc )
+{
+    // nearest object to the center of the buffer wins.
+    ObjectID id = 0;
+    float    bestDist2 = FLT_MAX;
+    float    center = 0.5f * (float)(_bufferSize-1);
+
+    for( int t = 0; t < _bufferSize; ++t )
+    {
+        for( int s = 0; s < _bufferSize; ++s )
+        {
+            const unsigned char* pixel = pc._image->data( s, t );
+            ObjectID pixelID = (ObjectID)pixel[0] | ((ObjectID)pixel[1] << 8) | ((ObjectID)pixel[2] << 16);
+            if ( pixelID != 0 )
+            {
+                float dist2 = ((float)s-center)*((float)s-center) + ((float)t-center)*((float)t-center);
+                if ( dist2 < bestDist2 )
+                {
+                    id        = pixelID;
+                    bestDist2 = dist2;
+                }
+            }
+        }
+    }
+
+    osg::ref_ptr<Callback> callback = pc._issued._callback.get();
+    pc._issued._callback = 0L;
+    pc._inFlight = false;
+
+    if ( id != 0 )
+        callback->onHit( id );
+    else
+        callback->onMiss();
+}
+
+bool
+RTTPicker::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa )
+{
+    if ( ea.getEventType() != osgGA::GUIEventAdapter::FRAME )
+        return false;
+
+    osg::View* view = aa.asView();
+    if ( !view || !view->getFrameStamp() )
+        return false;
+
+    unsigned frameNumber = view->getFrameStamp()->getFrameNumber();
+
+    for( PickContexts::iterator pc = _pickContexts.begin(); pc != _pickContexts.end(); ++pc )
+    {
+        if ( pc->_view.get() != view )
+            continue;
+
+        if ( pc->_inFlight )
+        {
+            const DrawMonitor* monitor = dynamic_cast<const DrawMonitor*>( pc->_drawMonitor.get() );
+            if ( monitor && monitor->drawnSince(pc->_issuedFrame) )
+                complete( *pc );
+        }
+
+        if ( !pc->_inFlight && pc->_hasPending )
+        {
+            issue( *pc, frameNumber );
+        }
+
+        pc->_pickCamera->setNodeMask( pc->_inFlight ? ~0u : 0u );
+    }
+
+    return false;
+}
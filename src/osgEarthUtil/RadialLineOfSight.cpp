@@ -126,7 +126,9 @@ _outlineColor( 1.0f, 1.0f, 1.0f, 1.0f),
 _displayMode( LineOfSight::MODE_SPLIT ),
 //_altitudeMode( ALTMODE_ABSOLUTE ),
 _fill(false),
-_terrainOnly( false )
+_terrainOnly( false ),
+_computeMode( LineOfSight::COMPUTE_SCENE ),
+_resolution( 10.0 )
 {
     compute(getNode());
     _terrainChangedCallback = new RadialLineOfSightNodeTerrainChangedCallback( this );
@@ -155,6 +157,7 @@ RadialLineOfSightNode::setMapNode( MapNode* mapNode )
         }
 
         _mapNode = mapNode;
+        _heightFieldLOS = 0L;
 
         if ( _mapNode.valid() && _terrainChangedCallback.valid() )
         {
@@ -251,6 +254,41 @@ void RadialLineOfSightNode::setTerrainOnly( bool terrainOnly )
     }
 }
 
+LineOfSight::ComputeMode
+RadialLineOfSightNode::getComputeMode() const
+{
+    return _computeMode;
+}
+
+void
+RadialLineOfSightNode::setComputeMode( LineOfSight::ComputeMode computeMode )
+{
+    if (_computeMode != computeMode)
+    {
+        _computeMode = computeMode;
+        compute(getNode());
+    }
+}
+
+double
+RadialLineOfSightNode::getResolution() const
+{
+    return _resolution;
+}
+
+void
+RadialLineOfSightNode::setResolution( double resolution )
+{
+    if (_resolution != resolution)
+    {
+        _resolution = resolution;
+        if ( _heightFieldLOS.valid() )
+            _heightFieldLOS->setResolution( _resolution );
+        if ( _computeMode == LineOfSight::COMPUTE_HEIGHTFIELD )
+            compute(getNode());
+    }
+}
+
 osg::Node*
 RadialLineOfSightNode::getNode()
 {
@@ -263,6 +301,11 @@ void
 RadialLineOfSightNode::terrainChanged( const osgEarth::TileKey& tileKey, osg::Node* terrain )
 {
     OE_DEBUG << "RadialLineOfSightNode::terrainChanged" << std::endl;
+
+    // the elevation data does not change as tiles page in.
+    if ( _computeMode == LineOfSight::COMPUTE_HEIGHTFIELD )
+        return;
+
     //Make a temporary group that contains both the old MapNode as well as the new incoming terrain.
     //Because this function is called from the database pager thread we need to include both b/c 
     //the new terrain isn't yet merged with the new terrain.
@@ -285,6 +328,46 @@ RadialLineOfSightNode::compute(osg::Node* node, bool backgroundThread)
     }
 }
 
+void
+RadialLineOfSightNode::computeSpokes(osg::Node* node, std::vector<HeightFieldLineOfSight::Ray>& spokes)
+{
+    if (_computeMode == LineOfSight::COMPUTE_HEIGHTFIELD)
+    {
+        if ( !_heightFieldLOS.valid() )
+        {
+            _heightFieldLOS = new HeightFieldLineOfSight( getMapNode()->getMap() );
+            _heightFieldLOS->setResolution( _resolution );
+        }
+        _heightFieldLOS->compute( spokes );
+        return;
+    }
+
+    osg::ref_ptr<osgUtil::IntersectorGroup> ivGroup = new osgUtil::IntersectorGroup();
+
+    for (unsigned int i = 0; i < spokes.size(); i++)
+    {
+        osg::ref_ptr<DPLineSegmentIntersector> dplsi = new DPLineSegmentIntersector( spokes[i]._start, spokes[i]._end );
+        ivGroup->addIntersector( dplsi.get() );
+    }
+
+    osgUtil::IntersectionVisitor iv;
+    iv.setIntersector( ivGroup.get() );
+
+    node->accept( iv );
+
+    for (unsigned int i = 0; i < spokes.size(); i++)
+    {
+        DPLineSegmentIntersector* los = static_cast<DPLineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
+        DPLineSegmentIntersector::Intersections& hits = los->getIntersections();
+
+        spokes[i]._hasLOS = hits.empty();
+        if (!spokes[i]._hasLOS)
+        {
+            spokes[i]._hit = hits.begin()->getWorldIntersectPoint();
+        }
+    }
+}
+
 void
 RadialLineOfSightNode::compute_line(osg::Node* node, bool backgroundThread)
 {    
@@ -321,7 +404,8 @@ RadialLineOfSightNode::compute_line(osg::Node* node, bool backgroundThread)
     osg::Vec3d previousEnd;
     osg::Vec3d firstEnd;
 
-    osg::ref_ptr<osgUtil::IntersectorGroup> ivGroup = new osgUtil::IntersectorGroup();
+    std::vector<HeightFieldLineOfSight::Ray> spokes;
+    spokes.reserve(_numSpokes);
 
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
@@ -329,29 +413,18 @@ RadialLineOfSightNode::compute_line(osg::Node* node, bool backgroundThread)
         osg::Quat quat(angle, up );
         osg::Vec3d spoke = quat * (side * _radius);
         osg::Vec3d end = _centerWorld + spoke;
-        osg::ref_ptr<DPLineSegmentIntersector> dplsi = new DPLineSegmentIntersector( _centerWorld, end );
-        ivGroup->addIntersector( dplsi.get() );
+        spokes.push_back( HeightFieldLineOfSight::Ray( _centerWorld, end ) );
     }
 
-    osgUtil::IntersectionVisitor iv;
-    iv.setIntersector( ivGroup.get() );
-
-    node->accept( iv );
+    computeSpokes( node, spokes );
 
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
-        DPLineSegmentIntersector* los = dynamic_cast<DPLineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
-        DPLineSegmentIntersector::Intersections& hits = los->getIntersections();
-
-        osg::Vec3d start = los->getStart();
-        osg::Vec3d end = los->getEnd();
+        osg::Vec3d start = spokes[i]._start;
+        osg::Vec3d end = spokes[i]._end;
 
-        osg::Vec3d hit;
-        bool hasLOS = hits.empty();
-        if (!hasLOS)
-        {
-            hit = hits.begin()->getWorldIntersectPoint();
-        }
+        osg::Vec3d hit = spokes[i]._hit;
+        bool hasLOS = spokes[i]._hasLOS;
 
         if (hasLOS)
         {
@@ -468,7 +541,8 @@ RadialLineOfSightNode::compute_fill(osg::Node* node, bool backgroundThread)
     geometry->setColorArray( colors );
     geometry->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
 
-    osg::ref_ptr<osgUtil::IntersectorGroup> ivGroup = new osgUtil::IntersectorGroup();
+    std::vector<HeightFieldLineOfSight::Ray> spokes;
+    spokes.reserve(_numSpokes);
 
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
@@ -476,34 +550,25 @@ RadialLineOfSightNode::compute_fill(osg::Node* node, bool backgroundThread)
         osg::Quat quat(angle, up );
         osg::Vec3d spoke = quat * (side * _radius);
         osg::Vec3d end = _centerWorld + spoke;        
-        osg::ref_ptr<DPLineSegmentIntersector> dplsi = new DPLineSegmentIntersector( _centerWorld, end );
-        ivGroup->addIntersector( dplsi.get() );
+        spokes.push_back( HeightFieldLineOfSight::Ray( _centerWorld, end ) );
     }
 
-    osgUtil::IntersectionVisitor iv;
-    iv.setIntersector( ivGroup.get() );
-
-    node->accept( iv );
+    computeSpokes( node, spokes );
 
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
         //Get the current hit
-        DPLineSegmentIntersector* los = dynamic_cast<DPLineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
-        DPLineSegmentIntersector::Intersections& hits = los->getIntersections();
-
-        osg::Vec3d currEnd = los->getEnd();
-        bool currHasLOS = hits.empty();
-        osg::Vec3d currHit = currHasLOS ? osg::Vec3d() : hits.begin()->getWorldIntersectPoint();
+        osg::Vec3d currEnd = spokes[i]._end;
+        bool currHasLOS = spokes[i]._hasLOS;
+        osg::Vec3d currHit = currHasLOS ? osg::Vec3d() : spokes[i]._hit;
 
         //Get the next hit
         unsigned int nextIndex = i + 1;
         if (nextIndex == _numSpokes) nextIndex = 0;
-        DPLineSegmentIntersector* losNext = static_cast<DPLineSegmentIntersector*>(ivGroup->getIntersectors()[nextIndex].get());
-        DPLineSegmentIntersector::Intersections& hitsNext = losNext->getIntersections();
 
-        osg::Vec3d nextEnd = losNext->getEnd();
-        bool nextHasLOS = hitsNext.empty();
-        osg::Vec3d nextHit = nextHasLOS ? osg::Vec3d() : hitsNext.begin()->getWorldIntersectPoint();
+        osg::Vec3d nextEnd = spokes[nextIndex]._end;
+        bool nextHasLOS = spokes[nextIndex]._hasLOS;
+        osg::Vec3d nextHit = nextHasLOS ? osg::Vec3d() : spokes[nextIndex]._hit;
         
         if (currHasLOS && nextHasLOS)
         {
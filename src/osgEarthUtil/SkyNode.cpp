@@ -27,6 +27,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/CullingUtils>
+#include <osgEarth/ThreadingUtils>
 
 #include <osg/MatrixTransform>
 #include <osg/ShapeDrawable>
@@ -41,6 +42,7 @@
 #include <osg/Depth>
 #include <osg/Quat>
 
+#include <map>
 #include <sstream>
 #include <time.h>
 
@@ -56,6 +58,58 @@ using namespace osgEarth::Util;
 #define BIN_MOON        -100001
 #define BIN_ATMOSPHERE  -100000
 
+// ephemeris results kept by DefaultEphemerisProvider
+#define MAX_EPHEMERIS_ENTRIES 256
+
+//---------------------------------------------------------------------------
+
+namespace
+{
+    // star fields shared between SkyNodes, by catalog, magnitude cutoff and radius.
+    typedef std::map<std::string, osg::observer_ptr<osg::Node> > StarFieldMap;
+    Threading::Mutex s_starFieldsMutex;
+    StarFieldMap     s_starFields;
+
+    // the embedded catalog, parsed on first use.
+    Threading::Mutex s_defaultStarsMutex;
+
+    // DefaultEphemerisProvider results, by time.
+    struct EphemerisTime
+    {
+        int    _year, _month, _date;
+        double _hoursUTC;
+        bool operator < (const EphemerisTime& rhs) const {
+            if ( _year  != rhs._year  ) return _year  < rhs._year;
+            if ( _month != rhs._month ) return _month < rhs._month;
+            if ( _date  != rhs._date  ) return _date  < rhs._date;
+            return _hoursUTC < rhs._hoursUTC;
+        }
+    };
+    typedef std::map<EphemerisTime, osg::Vec3d> EphemerisMap;
+    Threading::Mutex s_ephemerisMutex;
+    EphemerisMap     s_sunPositions;
+    EphemerisMap     s_moonPositions;
+
+    bool getCachedPosition( const EphemerisMap& cache, const EphemerisTime& t, osg::Vec3d& out_pos )
+    {
+        Threading::ScopedMutexLock lock( s_ephemerisMutex );
+        EphemerisMap::const_iterator i = cache.find( t );
+        if ( i == cache.end() )
+            return false;
+        out_pos = i->second;
+        return true;
+    }
+
+    void cachePosition( EphemerisMap& cache, const EphemerisTime& t, const osg::Vec3d& pos )
+    {
+        Threading::ScopedMutexLock lock( s_ephemerisMutex );
+        // an animated clock never repeats a time, so just start over when full.
+        if ( cache.size() >= MAX_EPHEMERIS_ENTRIES )
+            cache.clear();
+        cache[t] = pos;
+    }
+}
+
 //---------------------------------------------------------------------------
 
 namespace
@@ -704,15 +758,29 @@ namespace
 osg::Vec3d
 DefaultEphemerisProvider::getSunPosition( int year, int month, int date, double hoursUTC )
 {
-    Sun sun;
-    return sun.getPosition( year, month, date, hoursUTC );
+    EphemerisTime t = { year, month, date, hoursUTC };
+    osg::Vec3d pos;
+    if ( !getCachedPosition(s_sunPositions, t, pos) )
+    {
+        Sun sun;
+        pos = sun.getPosition( year, month, date, hoursUTC );
+        cachePosition( s_sunPositions, t, pos );
+    }
+    return pos;
 }
 
 osg::Vec3d
 DefaultEphemerisProvider::getMoonPosition( int year, int month, int date, double hoursUTC )
 {
-    Moon moon;
-    return moon.getPosition( year, month, date, hoursUTC );
+    EphemerisTime t = { year, month, date, hoursUTC };
+    osg::Vec3d pos;
+    if ( !getCachedPosition(s_moonPositions, t, pos) )
+    {
+        Moon moon;
+        pos = moon.getPosition( year, month, date, hoursUTC );
+        cachePosition( s_moonPositions, t, pos );
+    }
+    return pos;
 }
 
 //---------------------------------------------------------------------------
@@ -1441,6 +1509,15 @@ SkyNode::makeStars(const std::string& starFile)
 {
   _starRadius = 20000.0 * (_sunDistance > 0.0 ? _sunDistance : _outerRadius);
 
+  // reuse a star field that another SkyNode already built.
+  std::string key = Stringify() << starFile << ";" << _minStarMagnitude << ";" << _starRadius;
+  {
+    Threading::ScopedMutexLock lock( s_starFieldsMutex );
+    StarFieldMap::iterator i = s_starFields.find( key );
+    if ( i != s_starFields.end() && i->second.lock(_stars) )
+      return;
+  }
+
   std::vector<StarData> stars;
 
   if( starFile.empty() || parseStarFile(starFile, stars) == false )
@@ -1454,6 +1531,9 @@ SkyNode::makeStars(const std::string& starFile)
   osg::Node* starNode = buildStarGeometry(stars);
 
   _stars = starNode;
+
+  Threading::ScopedMutexLock lock( s_starFieldsMutex );
+  s_starFields[key] = _stars.get();
 }
 
 osg::Node*
@@ -1524,13 +1604,24 @@ SkyNode::getDefaultStars(std::vector<StarData>& out_stars)
 {
   out_stars.clear();
 
-  for(const char **sptr = s_defaultStarData; *sptr; sptr++)
+  // parse the embedded catalog text only once.
+  static std::vector<StarData> s_stars;
   {
-    std::stringstream ss(*sptr);
-    out_stars.push_back(StarData(ss));
+    Threading::ScopedMutexLock lock( s_defaultStarsMutex );
+    if ( s_stars.empty() )
+    {
+      for(const char **sptr = s_defaultStarData; *sptr; sptr++)
+      {
+        std::stringstream ss(*sptr);
+        s_stars.push_back(StarData(ss));
+      }
+    }
+  }
 
-    if (out_stars[out_stars.size() - 1].magnitude < _minStarMagnitude)
-      out_stars.pop_back();
+  for(std::vector<StarData>::const_iterator i = s_stars.begin(); i != s_stars.end(); ++i)
+  {
+    if (i->magnitude >= _minStarMagnitude)
+      out_stars.push_back(*i);
   }
 }
 
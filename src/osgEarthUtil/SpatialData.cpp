@@ -19,15 +19,22 @@
 #include <osgEarthUtil/SpatialData>
 #include <osgEarth/Registry>
 #include <osgEarth/CullingUtils>
+#include <osgEarth/TaskService>
 #include <osg/PolygonOffset>
 #include <osg/Polytope>
 #include <osg/Geometry>
 #include <osg/Depth>
 #include <osgText/Text>
+#include <OpenThreads/Thread>
+#include <algorithm>
 #include <sstream>
 
 #define LC "[GeoGraph] "
 
+// bulk loading stops splitting at this depth, so that a pile of objects at
+// a single location cannot split forever.
+#define MAX_BULK_DEPTH 32
+
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
@@ -99,6 +106,59 @@ namespace
 
         return objects.end();
     }
+
+    struct HigherPriority
+    {
+        bool operator()( const GeoCell::BulkRecord& lhs, const GeoCell::BulkRecord& rhs ) const {
+            return lhs._priority > rhs._priority;
+        }
+    };
+
+    // evaluates a range of objects and sorts them into per-root-cell buckets.
+    struct PartitionObjects
+    {
+        void execute()
+        {
+            _buckets.resize( _width*_height );
+            for( unsigned i = _begin; i < _end; ++i )
+            {
+                GeoCell::BulkRecord r;
+                r._object = (*_objects)[i].get();
+                if ( r._object && r._object->getLocation(r._location) && _extent->contains(r._location.x(), r._location.y()) )
+                {
+                    r._priority = r._object->getPriority();
+                    _buckets[getIndex(*_extent, r._location, _width, _height)].push_back( r );
+                }
+            }
+        }
+
+        const std::vector< osg::ref_ptr<GeoObject> >* _objects;
+        unsigned                                      _begin, _end;
+        const GeoExtent*                              _extent;
+        unsigned                                      _width, _height;
+        std::vector<GeoCell::BulkRecordVector>        _buckets;
+    };
+
+    struct BuildCell
+    {
+        void execute()
+        {
+            _cell->bulkLoad( *_records );
+        }
+
+        GeoCell*                   _cell;
+        GeoCell::BulkRecordVector* _records;
+    };
+
+    void collectCells( GeoCell* cell, std::vector<GeoCell*>& out )
+    {
+        for( unsigned i=0; i<cell->getNumChildren(); ++i )
+        {
+            GeoCell* child = static_cast<GeoCell*>( cell->getChild(i) );
+            out.push_back( child );
+            collectCells( child, out );
+        }
+    }
 }
 
 //------------------------------------------------------------------------
@@ -113,7 +173,8 @@ GeoObject::GeoObject()
 GeoGraph::GeoGraph(const GeoExtent& extent, float maxRange, unsigned maxObjects,
                    unsigned splitDim, float splitRangeFactor,
                    unsigned rootWidth, unsigned rootHeight ) :
-GeoCell( extent, maxRange, maxObjects, splitDim, splitRangeFactor, 0 )
+GeoCell( extent, maxRange, maxObjects, splitDim, splitRangeFactor, 0 ),
+_cellsDirty( true )
 {
     _rootWidth = osg::maximum( rootWidth, (unsigned)2 );
     _rootHeight = osg::maximum( rootHeight, (unsigned)2 );
@@ -155,11 +216,143 @@ GeoGraph::insertObject( GeoObject* object )
     if ( object->getLocation(loc) )
     {
         unsigned index = getIndex( _extent, loc, _rootWidth, _rootHeight );
-        return static_cast<GeoCell*>(getChild(index))->insertObject( object );
+        if ( static_cast<GeoCell*>(getChild(index))->insertObject( object ) )
+        {
+            _count++;
+            return true;
+        }
     }
-    else
+    return false;
+}
+
+unsigned
+GeoGraph::insertObjects( const std::vector< osg::ref_ptr<GeoObject> >& objects, unsigned numThreads )
+{
+    if ( objects.empty() )
+        return 0;
+
+    if ( numThreads == 0 )
+        numThreads = OpenThreads::GetNumberOfProcessors();
+    numThreads = osg::clampBetween( numThreads, 1u, (unsigned)objects.size() );
+
+    osg::ref_ptr<TaskService> service;
+    if ( numThreads > 1 )
+        service = new TaskService( "GeoGraph bulk load", numThreads );
+
+    // 1. evaluate the objects and partition them by root cell. Each task
+    //    fills its own buckets, and the calling thread takes the first one.
+    typedef ParallelTask<PartitionObjects> PartitionTask;
+    std::vector< osg::ref_ptr<PartitionTask> > partitions;
+
+    unsigned chunk = (objects.size() + numThreads - 1) / numThreads;
+    Threading::MultiEvent partitioned( (int)numThreads-1 );
+
+    for( unsigned i=0; i<numThreads; ++i )
     {
-        return false;
+        PartitionTask* task = i > 0 ? new PartitionTask( &partitioned ) : new PartitionTask();
+        task->_objects = &objects;
+        task->_begin   = osg::minimum( i*chunk, (unsigned)objects.size() );
+        task->_end     = osg::minimum( task->_begin + chunk, (unsigned)objects.size() );
+        task->_extent  = &_extent;
+        task->_width   = _rootWidth;
+        task->_height  = _rootHeight;
+        partitions.push_back( task );
+
+        if ( i > 0 )
+            service->add( task );
+    }
+
+    partitions[0]->execute();
+    if ( numThreads > 1 )
+        partitioned.wait();
+
+    // 2. gather the buckets and build each root cell's subtree.
+    unsigned numRoots = _rootWidth*_rootHeight;
+    std::vector<GeoCell::BulkRecordVector> roots( numRoots );
+    unsigned inserted = 0;
+
+    typedef ParallelTask<BuildCell> BuildTask;
+    std::vector< osg::ref_ptr<BuildTask> > builds;
+
+    for( unsigned r=0; r<numRoots; ++r )
+    {
+        unsigned total = 0;
+        for( unsigned i=0; i<partitions.size(); ++i )
+            total += partitions[i]->_buckets[r].size();
+        if ( total == 0 )
+            continue;
+
+        GeoCell::BulkRecordVector& records = roots[r];
+        records.reserve( total );
+        for( unsigned i=0; i<partitions.size(); ++i )
+        {
+            GeoCell::BulkRecordVector& bucket = partitions[i]->_buckets[r];
+            records.insert( records.end(), bucket.begin(), bucket.end() );
+            GeoCell::BulkRecordVector().swap( bucket );
+        }
+
+        GeoCell* cell = static_cast<GeoCell*>( getChild(r) );
+        if ( cell->getNumObjects() > 0 )
+        {
+            for( unsigned i=0; i<records.size(); ++i )
+            {
+                if ( cell->insertObject(records[i]._object) )
+                    ++inserted;
+            }
+            GeoCell::BulkRecordVector().swap( records );
+        }
+        else
+        {
+            inserted += records.size();
+            BuildTask* task = new BuildTask();
+            task->_cell    = cell;
+            task->_records = &records;
+            builds.push_back( task );
+        }
+    }
+
+    if ( builds.size() > 0 )
+    {
+        Threading::MultiEvent built( (int)builds.size()-1 );
+        for( unsigned i=1; i<builds.size(); ++i )
+        {
+            builds[i]->_mev = &built;
+            if ( service.valid() )
+                service->add( builds[i].get() );
+            else
+                builds[i]->execute();
+        }
+
+        builds[0]->execute();
+        if ( service.valid() && builds.size() > 1 )
+            built.wait();
+    }
+
+    _count += inserted;
+    _cellsDirty = true;
+
+    return inserted;
+}
+
+const std::vector<GeoCell*>&
+GeoGraph::getCells()
+{
+    if ( _cellsDirty )
+    {
+        _cells.clear();
+        collectCells( this, _cells );
+        _cellsDirty = false;
+    }
+    return _cells;
+}
+
+void
+GeoGraph::visitCells( GeoCellVisitor& visitor )
+{
+    const std::vector<GeoCell*>& cells = getCells();
+    for( std::vector<GeoCell*>::const_iterator i = cells.begin(); i != cells.end(); ++i )
+    {
+        visitor( *i, (*i)->getObjects() );
     }
 }
 
@@ -410,6 +603,7 @@ GeoCell::insertObject( GeoObject* object )
                 return false;
             }
         }
+        _count++;
         return true;
     }
     else
@@ -418,6 +612,51 @@ GeoCell::insertObject( GeoObject* object )
     }
 }
 
+void
+GeoCell::bulkLoad( BulkRecordVector& records )
+{
+    _count += records.size();
+
+    // keep the highest-priority objects here, just like insertObject().
+    unsigned keep = records.size();
+    if ( keep > _maxObjects && _depth < MAX_BULK_DEPTH )
+    {
+        std::nth_element( records.begin(), records.begin() + _maxObjects, records.end(), HigherPriority() );
+        keep = _maxObjects;
+    }
+
+    for( unsigned i=0; i<keep; ++i )
+    {
+        records[i]._object->_cell = this;
+        _objects.insert( GeoObjectPair(records[i]._priority, records[i]._object) );
+    }
+
+    if ( keep == records.size() )
+    {
+        BulkRecordVector().swap( records );
+        return;
+    }
+
+    if ( getNumChildren() == 0 )
+        split();
+
+    // partition the rest amongst the children.
+    std::vector<BulkRecordVector> buckets( _splitDim*_splitDim );
+    for( unsigned i=keep; i<records.size(); ++i )
+    {
+        buckets[getIndex(_extent, records[i]._location, _splitDim, _splitDim)].push_back( records[i] );
+    }
+
+    // release the records before descending.
+    BulkRecordVector().swap( records );
+
+    for( unsigned i=0; i<buckets.size(); ++i )
+    {
+        if ( buckets[i].size() > 0 )
+            static_cast<GeoCell*>(getChild(i))->bulkLoad( buckets[i] );
+    }
+}
+
 void
 GeoCell::split()
 {
@@ -445,6 +684,15 @@ GeoCell::split()
                 newRange );
         }
     }
+
+    // let the graph know its flat cell array is out of date.
+    GeoCell* root = this;
+    while( root->_depth > 0 && root->getNumParents() > 0 )
+        root = static_cast<GeoCell*>( root->getParent(0) );
+
+    GeoGraph* graph = dynamic_cast<GeoGraph*>( root );
+    if ( graph )
+        graph->_cellsDirty = true;
 }
 
 bool
@@ -19,11 +19,20 @@
 #include <osgEarthUtil/TFSPackager>
 
 #include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarth/TaskService>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
 
 #define LC "[TFSPackager] "
 
+// most tiles handed to the writer threads at once
+#define MAX_BATCH 64u
+
 using namespace osgEarth;
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
@@ -40,7 +49,8 @@ class FeatureTile : public osg::Referenced
 public:
     FeatureTile( const TileKey& key ):
       _key( key ),
-          _isSplit( false )
+          _isSplit( false ),
+          _numFeatures( 0 )
       {        
       }
 
@@ -86,12 +96,21 @@ public:
           return _features;
       }
 
+      /** Number of features assigned to the tile, whether listed by ID or spilled */
+      unsigned int getNumFeatures() const { return _numFeatures; }
+      void incrementNumFeatures() { ++_numFeatures; }
+
+      /** Serialized features not yet spilled to disk (external-memory mode) */
+      std::string& getBucket() { return _bucket; }
+
 
 private:    
     FeatureIDList _features;
     TileKey _key;   
     osg::ref_ptr<FeatureTile> _children[4];
     bool _isSplit;
+    unsigned int _numFeatures;
+    std::string _bucket;
 };
 
 class FeatureTileVisitor : public osg::Referenced
@@ -110,10 +129,280 @@ void FeatureTile::accept(FeatureTileVisitor* v)
 
 /******************************************************************************************/
 
+namespace
+{
+    template<typename T>
+    void writeValue( std::ostream& out, const T& value )
+    {
+        out.write( reinterpret_cast<const char*>(&value), sizeof(T) );
+    }
+
+    template<typename T>
+    void readValue( std::istream& in, T& value )
+    {
+        in.read( reinterpret_cast<char*>(&value), sizeof(T) );
+    }
+
+    void writeString( std::ostream& out, const std::string& value )
+    {
+        writeValue( out, (unsigned)value.size() );
+        out.write( value.data(), value.size() );
+    }
+
+    void readString( std::istream& in, std::string& value )
+    {
+        unsigned size = 0;
+        readValue( in, size );
+        value.resize( size );
+        if ( size > 0 )
+            in.read( &value[0], size );
+    }
+
+    void writeGeometry( std::ostream& out, const Geometry* geom )
+    {
+        int type = geom ? (int)geom->getType() : (int)Geometry::TYPE_UNKNOWN;
+        writeValue( out, type );
+        if ( !geom )
+            return;
+
+        if ( type == Geometry::TYPE_MULTI )
+        {
+            const GeometryCollection& parts = static_cast<const MultiGeometry*>(geom)->getComponents();
+            writeValue( out, (unsigned)parts.size() );
+            for( GeometryCollection::const_iterator i = parts.begin(); i != parts.end(); ++i )
+                writeGeometry( out, i->get() );
+            return;
+        }
+
+        writeValue( out, (unsigned)geom->size() );
+        if ( geom->size() > 0 )
+            out.write( reinterpret_cast<const char*>(&(*geom)[0]), geom->size() * sizeof(osg::Vec3d) );
+
+        if ( type == Geometry::TYPE_POLYGON )
+        {
+            const RingCollection& holes = static_cast<const Polygon*>(geom)->getHoles();
+            writeValue( out, (unsigned)holes.size() );
+            for( RingCollection::const_iterator i = holes.begin(); i != holes.end(); ++i )
+                writeGeometry( out, i->get() );
+        }
+    }
+
+    Geometry* readGeometry( std::istream& in )
+    {
+        int type = Geometry::TYPE_UNKNOWN;
+        readValue( in, type );
+
+        if ( type == Geometry::TYPE_MULTI )
+        {
+            MultiGeometry* multi = new MultiGeometry();
+            unsigned numParts = 0;
+            readValue( in, numParts );
+            for( unsigned i = 0; i < numParts && in.good(); ++i )
+            {
+                Geometry* part = readGeometry( in );
+                if ( part )
+                    multi->getComponents().push_back( part );
+            }
+            return multi;
+        }
+
+        Geometry* geom =
+            type == Geometry::TYPE_POINTSET   ? (Geometry*)new PointSet() :
+            type == Geometry::TYPE_LINESTRING ? (Geometry*)new LineString() :
+            type == Geometry::TYPE_RING       ? (Geometry*)new Ring() :
+            type == Geometry::TYPE_POLYGON    ? (Geometry*)new Polygon() :
+            0L;
+        if ( !geom )
+            return 0L;
+
+        unsigned numPoints = 0;
+        readValue( in, numPoints );
+        geom->resize( numPoints );
+        if ( numPoints > 0 )
+            in.read( reinterpret_cast<char*>(&(*geom)[0]), numPoints * sizeof(osg::Vec3d) );
+
+        if ( type == Geometry::TYPE_POLYGON )
+        {
+            unsigned numHoles = 0;
+            readValue( in, numHoles );
+            for( unsigned i = 0; i < numHoles && in.good(); ++i )
+            {
+                osg::ref_ptr<Geometry> hole = readGeometry( in );
+                if ( dynamic_cast<Ring*>(hole.get()) )
+                    static_cast<Polygon*>(geom)->getHoles().push_back( static_cast<Ring*>(hole.get()) );
+            }
+        }
+        return geom;
+    }
+
+    void writeFeature( std::ostream& out, Feature* feature )
+    {
+        writeValue( out, feature->getFID() );
+
+        const AttributeTable& attrs = feature->getAttrs();
+        writeValue( out, (unsigned)attrs.size() );
+        for( AttributeTable::const_iterator i = attrs.begin(); i != attrs.end(); ++i )
+        {
+            const AttributeValueUnion& value = i->second.second;
+            writeString( out, i->first );
+            writeValue ( out, (int)i->second.first );
+            writeValue ( out, value.set );
+            writeString( out, value.stringValue );
+            writeValue ( out, value.doubleValue );
+            writeValue ( out, value.intValue );
+            writeValue ( out, value.boolValue );
+        }
+
+        // packed geometries hold no points of their own; a clone unpacks them.
+        osg::ref_ptr<Geometry> geom = feature->getGeometry();
+        if ( geom.valid() && geom->isPacked() )
+            geom = geom->clone();
+        writeGeometry( out, geom.get() );
+    }
+
+    Feature* readFeature( std::istream& in, const SpatialReference* srs )
+    {
+        FeatureID fid = 0;
+        readValue( in, fid );
+
+        unsigned numAttrs = 0;
+        readValue( in, numAttrs );
+
+        std::vector< std::pair<std::string, AttributeValue> > attrs( numAttrs );
+        for( unsigned i = 0; i < numAttrs && in.good(); ++i )
+        {
+            int type = ATTRTYPE_UNSPECIFIED;
+            AttributeValueUnion& value = attrs[i].second.second;
+            readString( in, attrs[i].first );
+            readValue ( in, type );
+            readValue ( in, value.set );
+            readString( in, value.stringValue );
+            readValue ( in, value.doubleValue );
+            readValue ( in, value.intValue );
+            readValue ( in, value.boolValue );
+            attrs[i].second.first = (AttributeType)type;
+        }
+
+        Geometry* geom = readGeometry( in );
+        if ( in.fail() )
+        {
+            delete geom;
+            return 0L;
+        }
+
+        Feature* feature = new Feature( geom, srs, Style(), fid );
+        for( unsigned i = 0; i < attrs.size(); ++i )
+        {
+            const std::string&         name  = attrs[i].first;
+            const AttributeValueUnion& value = attrs[i].second.second;
+            AttributeType              type  = attrs[i].second.first;
+
+            if ( !value.set )
+                feature->setNull( name, type );
+            else if ( type == ATTRTYPE_STRING )
+                feature->set( name, value.stringValue );
+            else if ( type == ATTRTYPE_DOUBLE )
+                feature->set( name, value.doubleValue );
+            else if ( type == ATTRTYPE_INT )
+                feature->set( name, value.intValue );
+            else if ( type == ATTRTYPE_BOOL )
+                feature->set( name, value.boolValue );
+        }
+        return feature;
+    }
+}
+
+/**
+ * Holds the features assigned to each tile in external-memory mode. Features
+ * are buffered per tile, and the buffers are appended to one temporary file
+ * per tile whenever together they grow past the memory ceiling.
+ */
+class FeatureSpill : public osg::Referenced
+{
+public:
+    FeatureSpill( const std::string& path, unsigned long maxBytes ) :
+      _path( path ),
+          _maxBytes( maxBytes ),
+          _bytes( 0 ),
+          _numFlushes( 0 )
+      {
+      }
+
+      void add( FeatureTile* tile, Feature* feature )
+      {
+          std::ostringstream buf( std::ios_base::out | std::ios_base::binary );
+          writeFeature( buf, feature );
+
+          std::string& bucket = tile->getBucket();
+          if ( bucket.empty() )
+              _dirty.push_back( tile );
+          bucket += buf.str();
+
+          _bytes += buf.str().size();
+          if ( _bytes > _maxBytes )
+              flush();
+      }
+
+      void flush()
+      {
+          for( std::vector< osg::ref_ptr<FeatureTile> >::iterator i = _dirty.begin(); i != _dirty.end(); ++i )
+          {
+              std::string& bucket = (*i)->getBucket();
+              std::ofstream out( getFileName((*i)->getKey()).c_str(), std::ios_base::out | std::ios_base::app | std::ios_base::binary );
+              out.write( bucket.data(), bucket.size() );
+              if ( out.fail() )
+              {
+                  OE_WARN << LC << "Failed to spill features of tile " << (*i)->getKey().str() << std::endl;
+              }
+              std::string().swap( bucket ); // release the memory
+          }
+          _dirty.clear();
+          _bytes = 0;
+          ++_numFlushes;
+      }
+
+      /** Reads back the features of a tile; call after the final flush(). */
+      void read( const TileKey& key, const SpatialReference* srs, FeatureList& out ) const
+      {
+          std::ifstream in( getFileName(key).c_str(), std::ios_base::in | std::ios_base::binary );
+          while ( in.is_open() && in.peek() != std::char_traits<char>::eof() )
+          {
+              Feature* feature = readFeature( in, srs );
+              if ( !feature )
+              {
+                  OE_WARN << LC << "Corrupt spill file for tile " << key.str() << std::endl;
+                  break;
+              }
+              out.push_back( feature );
+          }
+      }
+
+      void remove( const TileKey& key ) const
+      {
+          ::remove( getFileName(key).c_str() );
+      }
+
+      std::string getFileName( const TileKey& key ) const
+      {
+          return osgDB::concatPaths( _path, Stringify() << key.getLevelOfDetail() << "_" << key.getTileX() << "_" << key.getTileY() << ".bin" );
+      }
+
+      unsigned getNumFlushes() const { return _numFlushes; }
+
+private:
+    std::string _path;
+    unsigned long _maxBytes;
+    unsigned long _bytes;
+    unsigned _numFlushes;
+    std::vector< osg::ref_ptr<FeatureTile> > _dirty;
+};
+
+/******************************************************************************************/
+
 class AddFeatureVisitor : public FeatureTileVisitor
 {
 public:
-    AddFeatureVisitor( Feature* feature, int maxFeatures, int firstLevel, int maxLevel, CropFilter::Method cropMethod):
+    AddFeatureVisitor( Feature* feature, int maxFeatures, int firstLevel, int maxLevel, CropFilter::Method cropMethod, FeatureSpill* spill =0L):
       _feature( feature ),
           _maxFeatures( maxFeatures ),      
           _maxLevel( maxLevel ),
@@ -121,7 +410,8 @@ public:
           _added(false),
           _numAdded( 0 ),
           _levelAdded(-1),
-          _cropMethod( cropMethod )
+          _cropMethod( cropMethod ),
+          _spill( spill )
       {
 
       }
@@ -138,7 +428,7 @@ public:
               //If the node contains the feature, and it doesn't contain the max number of features add it.  If it's already full then 
               //split it.
               if (tile->getKey().getLevelOfDetail() >= (unsigned int)_firstLevel && 
-                  (tile->getFeatures().size() < (unsigned int)_maxFeatures || tile->getKey().getLevelOfDetail() == _maxLevel || tile->getKey().getLevelOfDetail() == _levelAdded))
+                  (tile->getNumFeatures() < (unsigned int)_maxFeatures || tile->getKey().getLevelOfDetail() == _maxLevel || tile->getKey().getLevelOfDetail() == _levelAdded))
               {
                   if (_levelAdded < 0 || _levelAdded == tile->getKey().getLevelOfDetail())
                   {
@@ -155,7 +445,11 @@ public:
                       if (!features.empty() && clone->getGeometry() && clone->getGeometry()->isValid())
                       {
                           //tile->getFeatures().push_back( clone );
-                          tile->getFeatures().push_back( clone->getFID() );
+                          if ( _spill.valid() )
+                              _spill->add( tile, _feature.get() );
+                          else
+                              tile->getFeatures().push_back( clone->getFID() );
+                          tile->incrementNumFeatures();
                           _added = true;
                           _levelAdded = tile->getKey().getLevelOfDetail();
                           _numAdded++;                   
@@ -192,84 +486,83 @@ public:
 
 
       osg::ref_ptr< Feature > _feature;
+      osg::ref_ptr< FeatureSpill > _spill;
 };
 
 
 /******************************************************************************************/
-class WriteFeaturesVisitor : public FeatureTileVisitor
+class CollectTilesVisitor : public FeatureTileVisitor
 {
 public:
-    WriteFeaturesVisitor(FeatureSource* features, const std::string& dest, CropFilter::Method cropMethod, const SpatialReference* srs):
-      _dest( dest ),
-          _features( features ),
-          _cropMethod( cropMethod ),
-          _srs( srs )
+      virtual void traverse( FeatureTile* tile)
       {
-
+          if (tile->getNumFeatures() > 0)
+          {
+              _tiles.push_back( tile );
+          }
+          tile->traverse( this );
       }
 
-      virtual void traverse( FeatureTile* tile)
-      {
-          if (tile->getFeatures().size() > 0)
-          {                 
-              //Actually load up the features
-              FeatureList features;
-              for (FeatureIDList::const_iterator i = tile->getFeatures().begin(); i != tile->getFeatures().end(); i++)
-              {
-                  Feature* f = _features->getFeature( *i );                  
+      std::vector< osg::ref_ptr<FeatureTile> > _tiles;
+};
 
-                  if (f)
-                  {
-                      //Reproject the feature to the dest SRS if it's not already
-                      if (!f->getSRS()->isEquivalentTo( _srs ) )
-                      {
-                          f->transform( _srs );
-                      }
-                      features.push_back( f );
-                  }
-                  else
-                  {
-                      OE_NOTICE << "couldn't get feature " << *i << std::endl;
-                  }
-              }
+namespace
+{
+    /** Crops the features of a tile to its extent and writes them out as GeoJSON. */
+    void writeFeatureTile( FeatureTile* tile, FeatureList& features, const std::string& dest, CropFilter::Method cropMethod )
+    {
+        //Need to do the cropping again since these are brand new features coming from the feature source.
+        CropFilter cropFilter(cropMethod);
+        FilterContext context(0);
+        context.extent() = tile->getExtent();
+        cropFilter.push( features, context );
 
-              //Need to do the cropping again since these are brand new features coming from the feature source.
-              CropFilter cropFilter(_cropMethod);
-              FilterContext context(0);
-              context.extent() = tile->getExtent();
-              cropFilter.push( features, context );
+        std::string contents = Feature::featuresToGeoJSON( features );
+        std::stringstream buf;
+        int x =  tile->getKey().getTileX();
+        unsigned int numRows, numCols;
+        tile->getKey().getProfile()->getNumTiles(tile->getKey().getLevelOfDetail(), numCols, numRows);
+        int y  = numRows - tile->getKey().getTileY() - 1;
 
-              std::string contents = Feature::featuresToGeoJSON( features );
-              std::stringstream buf;
-              int x =  tile->getKey().getTileX();
-              unsigned int numRows, numCols;
-              tile->getKey().getProfile()->getNumTiles(tile->getKey().getLevelOfDetail(), numCols, numRows);
-              int y  = numRows - tile->getKey().getTileY() - 1;
+        buf << dest << "/" << tile->getKey().getLevelOfDetail() << "/" << x << "/" << y << ".json";
+        std::string filename = buf.str();
+        //OE_NOTICE << "Writing " << features.size() << " features to " << filename << std::endl;
 
-              buf << _dest << "/" << tile->getKey().getLevelOfDetail() << "/" << x << "/" << y << ".json";
-              std::string filename = buf.str();
-              //OE_NOTICE << "Writing " << features.size() << " features to " << filename << std::endl;
+        if ( !osgDB::fileExists( osgDB::getFilePath(filename) ) )
+            osgDB::makeDirectoryForFile( filename );
 
-              if ( !osgDB::fileExists( osgDB::getFilePath(filename) ) )
-                  osgDB::makeDirectoryForFile( filename );
 
+        std::fstream output( filename.c_str(), std::ios_base::out );
+        if ( output.is_open() )
+        {
+            output << contents;
+            output.flush();
+            output.close();                
+        }            
+    }
 
-              std::fstream output( filename.c_str(), std::ios_base::out );
-              if ( output.is_open() )
-              {
-                  output << contents;
-                  output.flush();
-                  output.close();                
-              }            
-          }
-          tile->traverse( this );        
-      }
+    /** Writes one tile; runs on a worker thread. */
+    struct WriteTile
+    {
+        void execute()
+        {
+            if ( _spill.valid() )
+            {
+                _spill->read( _tile->getKey(), _srs.get(), _features );
+                _spill->remove( _tile->getKey() );
+            }
+            writeFeatureTile( _tile.get(), _features, _dest, _cropMethod );
+            _features.clear();
+        }
 
-      osg::ref_ptr< FeatureSource > _features;
-      std::string _dest;      
-      CropFilter::Method _cropMethod;
-      osg::ref_ptr< const SpatialReference > _srs;
-};
+        osg::ref_ptr<FeatureTile>              _tile;
+        FeatureList                            _features;
+        osg::ref_ptr<FeatureSpill>             _spill;
+        std::string                            _dest;
+        CropFilter::Method                     _cropMethod;
+        osg::ref_ptr<const SpatialReference>   _srs;
+    };
+}
 
 
 
@@ -279,7 +572,9 @@ TFSPackager::TFSPackager():
 _firstLevel( 0 ),
     _maxLevel( 10 ),
     _maxFeatures( 300 ),
-    _method( CropFilter::METHOD_CENTROID )
+    _method( CropFilter::METHOD_CENTROID ),
+    _maxMemory( 0 ),
+    _numThreads( 0 )
 {
 }
 
@@ -305,6 +600,20 @@ void
 
     TileKey rootKey = TileKey(0, 0, 0, profile );    
 
+    //In external-memory mode, the features themselves go into per-tile spill files
+    osg::ref_ptr< FeatureSpill > spill;
+    std::string spillPath;
+    if (_maxMemory > 0)
+    {
+        spillPath = _tempPath.empty() ? osgDB::concatPaths( destination, "tfs_spill" ) : _tempPath;
+        if ( !osgDB::fileExists(spillPath) && !osgDB::makeDirectory(spillPath) )
+        {
+            OE_WARN << LC << "Cannot create spill folder " << spillPath << std::endl;
+            return;
+        }
+        spill = new FeatureSpill( spillPath, (unsigned long)_maxMemory * 1024ul * 1024ul );
+    }
+
 
     osg::ref_ptr< FeatureTile > root = new FeatureTile( rootKey );
     //Loop through all the features and try to insert them into the quadtree
@@ -327,7 +636,7 @@ void
         if (feature->getGeometry() && feature->getGeometry()->getBounds().valid() && feature->getGeometry()->isValid())
         {
 
-            AddFeatureVisitor v(feature.get(), _maxFeatures, _firstLevel, _maxLevel, _method);
+            AddFeatureVisitor v(feature.get(), _maxFeatures, _firstLevel, _maxLevel, _method, spill.get());
             root->accept( &v );
             if (!v._added)
             {
@@ -352,8 +661,78 @@ void
     }   
     OE_NOTICE << "Added=" << added << " Skipped=" << skipped << " Failed=" << failed << std::endl;
 
-    WriteFeaturesVisitor write(features, destination, _method, _srs);
-    root->accept( &write );
+    if (spill.valid())
+    {
+        spill->flush();
+        OE_NOTICE << LC << "Spilled features to " << spillPath << " " << spill->getNumFlushes() << " times" << std::endl;
+    }
+
+    CollectTilesVisitor collect;
+    root->accept( &collect );
+
+    osg::ref_ptr< TaskService > service;
+    if (_numThreads > 0)
+    {
+        service = new TaskService( "TFSPackager", _numThreads );
+    }
+
+    //Write the tiles a batch at a time, so only a batch of tiles' features is in memory
+    for (unsigned int first = 0; first < collect._tiles.size(); first += MAX_BATCH)
+    {
+        unsigned int last = std::min( first + MAX_BATCH, (unsigned int)collect._tiles.size() );
+
+        Threading::MultiEvent semaphore( last - first );
+        std::vector< osg::ref_ptr< ParallelTask<WriteTile> > > tasks;
+
+        for (unsigned int t = first; t < last; ++t)
+        {
+            FeatureTile* tile = collect._tiles[t].get();
+
+            ParallelTask<WriteTile>* task = new ParallelTask<WriteTile>( &semaphore );
+            task->_tile       = tile;
+            task->_spill      = spill.get();
+            task->_dest       = destination;
+            task->_cropMethod = _method;
+            task->_srs        = _srs.get();
+
+            //Feature sources aren't safe to read from several threads, so
+            //the features are loaded here and only written on the workers.
+            if (!spill.valid())
+            {
+                for (FeatureIDList::const_iterator i = tile->getFeatures().begin(); i != tile->getFeatures().end(); i++)
+                {
+                    Feature* f = features->getFeature( *i );                  
+
+                    if (f)
+                    {
+                        //Reproject the feature to the dest SRS if it's not already
+                        if (!f->getSRS()->isEquivalentTo( _srs ) )
+                        {
+                            f->transform( _srs );
+                        }
+                        task->_features.push_back( f );
+                    }
+                    else
+                    {
+                        OE_NOTICE << "couldn't get feature " << *i << std::endl;
+                    }
+                }
+            }
+
+            tasks.push_back( task );
+            if (service.valid())
+                service->add( task );
+            else
+                (*task)( 0L );
+        }
+
+        semaphore.wait();
+    }
+
+    if (spill.valid() && _tempPath.empty())
+    {
+        ::remove( spillPath.c_str() );
+    }
 
     //Write out the meta doc
     TFSLayer layer;
@@ -366,4 +745,3 @@ void
     TFSReaderWriter::write( layer, osgDB::concatPaths( destination, "tfs.xml"));
 
 }
-
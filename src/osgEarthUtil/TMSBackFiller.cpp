@@ -20,19 +20,116 @@
 #include <osgEarth/ImageUtils>
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageMosaic>
+#include <osgEarth/TaskService>
 
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define OE_BACKFILL_SSE2 1
+#endif
+
 #define LC "[TMSBackFiller] "
 
+// most tiles of a level in flight at once; each holds four child images.
+#define MAX_BATCH 64u
+
 using namespace osgEarth::Util;
 using namespace osgEarth;
 
-TMSBackFiller::TMSBackFiller()
+namespace
 {
+    /** Whether the four children can go through boxDownsample(). */
+    bool canBoxDownsample( osg::Image* const* children )
+    {
+        const osg::Image* first = children[0];
+        if ( first->getDataType() != GL_UNSIGNED_BYTE || first->r() != 1 ||
+             first->s() % 2 != 0 || first->t() % 2 != 0 )
+            return false;
+
+        GLenum format = first->getPixelFormat();
+        if ( format != GL_RGBA && format != GL_RGB && format != GL_LUMINANCE &&
+             format != GL_LUMINANCE_ALPHA && format != GL_ALPHA )
+            return false;
+
+        for( unsigned i = 1; i < 4; ++i )
+        {
+            const osg::Image* child = children[i];
+            if ( child->s() != first->s() || child->t() != first->t() || child->r() != 1 ||
+                 child->getPixelFormat() != format || child->getDataType() != GL_UNSIGNED_BYTE )
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * Averages each 2x2 block of texels of an 8-bit child tile into one
+     * quadrant of the parent tile, starting at column s0, row t0.
+     */
+    void boxDownsample( const osg::Image* child, osg::Image* parent, unsigned s0, unsigned t0 )
+    {
+        const unsigned bpp   = osg::Image::computeNumComponents( child->getPixelFormat() );
+        const unsigned halfS = child->s() / 2;
+        const unsigned halfT = child->t() / 2;
+
+        for( unsigned t = 0; t < halfT; ++t )
+        {
+            const unsigned char* r0  = child->data( 0, 2*t );
+            const unsigned char* r1  = child->data( 0, 2*t+1 );
+            unsigned char*       out = parent->data( s0, t0+t );
+            unsigned             p   = 0;
+
+#ifdef OE_BACKFILL_SSE2
+            // RGBA: four input texels (16 bytes) per row make two output texels.
+            if ( bpp == 4 )
+            {
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i two  = _mm_set1_epi16( 2 );
+
+                for( ; p+1 < halfS; p += 2 )
+                {
+                    __m128i a = _mm_loadu_si128( (const __m128i*)(r0 + p*8) );
+                    __m128i b = _mm_loadu_si128( (const __m128i*)(r1 + p*8) );
+
+                    // vertical sums, 16 bits per channel:
+                    __m128i lo = _mm_add_epi16( _mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero) );
+                    __m128i hi = _mm_add_epi16( _mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero) );
+
+                    // horizontal sums of neighboring texels:
+                    lo = _mm_add_epi16( lo, _mm_srli_si128(lo, 8) );
+                    hi = _mm_add_epi16( hi, _mm_srli_si128(hi, 8) );
+
+                    __m128i sum = _mm_srli_epi16( _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2 );
+                    _mm_storel_epi64( (__m128i*)(out + p*4), _mm_packus_epi16(sum, zero) );
+                }
+            }
+#endif
+            for( ; p < halfS; ++p )
+            {
+                for( unsigned c = 0; c < bpp; ++c )
+                {
+                    unsigned i = 2*p*bpp + c, j = i + bpp;
+                    out[p*bpp + c] = (unsigned char)((r0[i] + r0[j] + r1[i] + r1[j] + 2) >> 2);
+                }
+            }
+        }
+    }
+}
+
+TMSBackFiller::TMSBackFiller() :
+_minLevel  ( 0 ),
+_maxLevel  ( ~0u ),
+_numThreads( 0 ),
+_verbose   ( false )
+{
+}
+
+void TMSBackFiller::ProcessTile::execute()
+{
+    _backFiller->processKey( _key );
 }
 
 
@@ -67,14 +164,23 @@ void TMSBackFiller::process( const std::string& tms, osgDB::Options* options )
             TileKey ll = profile->createTileKey(extent.xMin(), extent.yMin(), level);
             TileKey ur = profile->createTileKey(extent.xMax(), extent.yMax(), level);
 
+            // The level is done in batches, so only a batch worth of child
+            // tiles is in memory at a time. Each level is finished before the
+            // next one up starts, because that one reads its tiles.
+            std::vector<TileKey> keys;
             for (unsigned int x = ll.getTileX(); x <= ur.getTileX(); x++)
             {
                 for (unsigned int y = ur.getTileY(); y <= ll.getTileY(); y++)
                 {
-                    TileKey key = TileKey(level, x, y, profile.get());
-                    processKey( key );
+                    keys.push_back( TileKey(level, x, y, profile.get()) );
+                    if ( keys.size() == MAX_BATCH )
+                    {
+                        processKeys( keys );
+                        keys.clear();
+                    }
                 }
-            }                
+            }
+            processKeys( keys );
 
         }            
     }
@@ -84,6 +190,36 @@ void TMSBackFiller::process( const std::string& tms, osgDB::Options* options )
     }
 }
 
+void TMSBackFiller::processKeys( const std::vector<TileKey>& keys )
+{
+    if ( keys.empty() )
+        return;
+
+    if ( _numThreads == 0 )
+    {
+        for( std::vector<TileKey>::const_iterator i = keys.begin(); i != keys.end(); ++i )
+            processKey( *i );
+        return;
+    }
+
+    if ( !_service.valid() )
+        _service = new TaskService( "TMSBackFiller", _numThreads );
+
+    Threading::MultiEvent semaphore( keys.size() );
+    std::vector< osg::ref_ptr< ParallelTask<ProcessTile> > > tasks;
+
+    for( std::vector<TileKey>::const_iterator i = keys.begin(); i != keys.end(); ++i )
+    {
+        ParallelTask<ProcessTile>* task = new ParallelTask<ProcessTile>( &semaphore );
+        task->_backFiller = this;
+        task->_key        = *i;
+        tasks.push_back( task );
+        _service->add( task );
+    }
+
+    semaphore.wait();
+}
+
 void TMSBackFiller::processKey( const TileKey& key )
 {
     if (_verbose) OE_NOTICE << "Processing key " << key.str() << std::endl;
@@ -100,7 +236,27 @@ void TMSBackFiller::processKey( const TileKey& key )
     osg::ref_ptr< osg::Image > lr = readTile( lrKey );
 
     if (ul.valid() && ur.valid() && ll.valid() && lr.valid())
-    {            
+    {
+        osg::Image* children[4] = { ul.get(), ur.get(), ll.get(), lr.get() };
+        if ( canBoxDownsample(children) )
+        {
+            // Average the children straight into their quadrants of a tile
+            // the same size as one of them. The northern children are the
+            // upper half of the image.
+            osg::ref_ptr<osg::Image> image = new osg::Image();
+            image->allocateImage( ul->s(), ul->t(), 1, ul->getPixelFormat(), GL_UNSIGNED_BYTE );
+            image->setInternalTextureFormat( ul->getInternalTextureFormat() );
+
+            unsigned halfS = ul->s() / 2, halfT = ul->t() / 2;
+            boxDownsample( ul.get(), image.get(), 0,     halfT );
+            boxDownsample( ur.get(), image.get(), halfS, halfT );
+            boxDownsample( ll.get(), image.get(), 0,     0 );
+            boxDownsample( lr.get(), image.get(), halfS, 0 );
+
+            writeTile( key, image.get() );
+            return;
+        }
+
         //Merge them together
         ImageMosaic mosaic;
         mosaic.getImages().push_back( TileImage( ul.get(), ulKey ) );
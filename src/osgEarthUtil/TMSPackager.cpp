@@ -20,12 +20,16 @@
 #include <osgEarthUtil/TMS>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/ImageToHeightFieldConverter>
+#include <osgEarth/TaskService>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/WriteFile>
 
 #define LC "[TMSPackager] "
 
+// most tiles handed to the workers at once
+#define MAX_BATCH 256u
+
 using namespace osgEarth::Util;
 using namespace osgEarth;
 
@@ -33,6 +37,7 @@ using namespace osgEarth;
 TMSPackager::TMSPackager(const Profile* outProfile, osgDB::Options* imageWriteOptions) :
 _outProfile         ( outProfile ),
 _maxLevel           ( 99 ),
+_numThreads         ( 0 ),
 _verbose            ( false ),
 _overwrite          ( false ),
 _keepEmptyImageTiles( false ),
@@ -70,209 +75,256 @@ TMSPackager::shouldPackageKey( const TileKey& key ) const
 }
 
 
-TMSPackager::Result
+void
+TMSPackager::PackageTile::execute()
+{
+    if ( _imageLayer.valid() )
+        _result = _packager->packageImageTile( _imageLayer.get(), _key, _rootDir, _extension, _output.get() );
+    else if ( _elevationLayer.valid() )
+        _result = _packager->packageElevationTile( _elevationLayer.get(), _key, _rootDir, _extension );
+}
+
+
+TMSPackager::TileResult
 TMSPackager::packageImageTile(ImageLayer*          layer,
                               const TileKey&       key,
                               const std::string&   rootDir,
                               const std::string&   extension,
-                              unsigned&            out_maxLevel )
+                              TileSource*          output ) const
 {
-    unsigned minLevel = layer->getImageLayerOptions().minLevel().isSet() ?
-        *layer->getImageLayerOptions().minLevel() : 0;
-    
+    TileResult result;
 
-    if ( shouldPackageKey(key) && key.getLevelOfDetail() >= minLevel )
+    unsigned w, h;
+    key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
+
+    std::string path = Stringify() 
+        << rootDir 
+        << "/" << key.getLevelOfDetail() 
+        << "/" << key.getTileX() 
+        << "/" << h - key.getTileY() - 1
+        << "." << extension;
+
+    result.tileOK = !output && osgDB::fileExists(path) && !_overwrite;
+    if ( !result.tileOK )
     {
-        unsigned w, h;
-        key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
-
-        std::string path = Stringify() 
-            << rootDir 
-            << "/" << key.getLevelOfDetail() 
-            << "/" << key.getTileX() 
-            << "/" << h - key.getTileY() - 1
-            << "." << extension;
-
-        bool isSingleColor = false;
-        bool tileOK = osgDB::fileExists(path) && !_overwrite;
-        if ( !tileOK )
+        GeoImage image = layer->createImage( key );
+        if ( image.valid() )
         {
-            GeoImage image = layer->createImage( key );
-            if ( image.valid() )
+            // Check for single color
+            if ( !_subdivideSingleColorImageTiles )
             {
-                // Check for single color
-                if ( !_subdivideSingleColorImageTiles )
+                result.isSingleColor = ImageUtils::isSingleColorImage(image.getImage());
+                if ( _verbose && result.isSingleColor )
                 {
-                    isSingleColor = ImageUtils::isSingleColorImage(image.getImage());
-                    if ( _verbose )
-                    {
-                        OE_NOTICE << LC << "Not subdividing single color tile " << key.str() << std::endl;
-                    }
+                    OE_NOTICE << LC << "Not subdividing single color tile " << key.str() << std::endl;
                 }
+            }
 
-                // check for empty:
-                if ( !_keepEmptyImageTiles && ImageUtils::isEmptyImage(image.getImage()) )
+            // check for empty:
+            if ( !_keepEmptyImageTiles && ImageUtils::isEmptyImage(image.getImage()) )
+            {
+                if ( _verbose )
                 {
-                    if ( _verbose )
-                    {
-                        OE_NOTICE << LC << "Skipping empty tile " << key.str() << std::endl;
-                    }
+                    OE_NOTICE << LC << "Skipping empty tile " << key.str() << std::endl;
+                }
+            }
+            else
+            {
+                // convert to RGB if necessary
+                osg::ref_ptr<osg::Image> final = image.getImage();
+                if ( (extension == "jpg" || extension == "jpeg") && final->getPixelFormat() != GL_RGB )
+                    final = ImageUtils::convertToRGB8( image.getImage() );
+
+                if ( output )
+                {
+                    result.tileOK = output->storeImage( key, final.get() );
                 }
                 else
                 {
-                    // convert to RGB if necessary
-                    osg::ref_ptr<osg::Image> final = image.getImage();
-                    if ( extension == "jpg" && final->getPixelFormat() != GL_RGB )
-                        final = ImageUtils::convertToRGB8( image.getImage() );
-
                     // dump it to disk
                     osgDB::makeDirectoryForFile( path );
-                    tileOK = osgDB::writeImageFile( *final.get(), path, _imageWriteOptions);
-
-                    if ( _verbose )
-                    {
-                        if ( tileOK ) {
-                            OE_NOTICE << LC << "Wrote tile " << key.str() << " (" << key.getExtent().toString() << ")" << std::endl;
-                        }
-                        else {
-                            OE_NOTICE << LC << "Error write tile " << key.str() << std::endl;
-                        }
-                    }
+                    result.tileOK = osgDB::writeImageFile( *final.get(), path, _imageWriteOptions);
+                }
 
-                    if ( _abortOnError && !tileOK )
-                    {
-                        return Result( Stringify() << "Aborting, write failed for tile " << key.str() );
+                if ( _verbose )
+                {
+                    if ( result.tileOK ) {
+                        OE_NOTICE << LC << "Wrote tile " << key.str() << " (" << key.getExtent().toString() << ")" << std::endl;
+                    }
+                    else {
+                        OE_NOTICE << LC << "Error write tile " << key.str() << std::endl;
                     }
                 }
+
+                if ( !result.tileOK )
+                {
+                    result.error = Stringify() << "Aborting, write failed for tile " << key.str();
+                }
             }
         }
-        else
+    }
+    else
+    {
+        if ( _verbose )
         {
-            if ( _verbose )
-            {
-                OE_NOTICE << LC << "Tile " << key.str() << " already exists" << std::endl;
-            }
+            OE_NOTICE << LC << "Tile " << key.str() << " already exists" << std::endl;
         }
+    }
 
-        // increment the maximum detected tile level:
-        if ( tileOK && key.getLevelOfDetail() > out_maxLevel )
-        {
-            out_maxLevel = key.getLevelOfDetail();
-        }
+    return result;
+}
+
+
+TMSPackager::TileResult
+TMSPackager::packageElevationTile(ElevationLayer*      layer,
+                                  const TileKey&       key,
+                                  const std::string&   rootDir,
+                                  const std::string&   extension) const
+{
+    TileResult result;
 
-        // see if subdivision should continue.
-        unsigned lod = key.getLevelOfDetail();
-        const ImageLayerOptions& options = layer->getImageLayerOptions();
+    unsigned w, h;
+    key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
 
-        unsigned layerMaxLevel = (options.maxLevel().isSet()? *options.maxLevel() : 99);
-        unsigned maxLevel = std::min(_maxLevel, layerMaxLevel);
-        bool subdivide =
-            (options.minLevel().isSet() && lod < *options.minLevel()) ||
-            (tileOK && lod+1 < maxLevel);
+    std::string path = Stringify() 
+        << rootDir 
+        << "/" << key.getLevelOfDetail() 
+        << "/" << key.getTileX() 
+        << "/" << h - key.getTileY() - 1
+        << "." << extension;
 
-        // subdivide if necessary:
-        if ( (subdivide == true) && (isSingleColor == false) )
+    result.tileOK = osgDB::fileExists(path) && !_overwrite;
+    if ( !result.tileOK )
+    {
+        GeoHeightField hf = layer->createHeightField( key );
+        if ( hf.valid() )
         {
-            for( unsigned q=0; q<4; ++q )
+            // convert the HF to an image
+            ImageToHeightFieldConverter conv;
+            osg::ref_ptr<osg::Image> image = conv.convert( hf.getHeightField() );
+
+            // dump it to disk
+            osgDB::makeDirectoryForFile( path );
+            result.tileOK = osgDB::writeImageFile( *image.get(), path );
+
+            if ( _verbose )
             {
-                TileKey childKey = key.createChildKey(q);
-                Result r = packageImageTile( layer, childKey, rootDir, extension, out_maxLevel );
-                if ( _abortOnError && !r.ok )
-                    return r;
+                if ( result.tileOK ) {
+                    OE_NOTICE << LC << "Wrote tile " << key.str() << " (" << key.getExtent().toString() << ")" << std::endl;
+                }
+                else {
+                    OE_NOTICE << LC << "Error write tile " << key.str() << std::endl;
+                }
+            }
+
+            if ( !result.tileOK )
+            {
+                result.error = Stringify() << "Aborting, write failed for tile " << key.str();
             }
         }
     }
+    else
+    {
+        if ( _verbose )
+        {
+            OE_NOTICE << LC << "Tile " << key.str() << " already exists" << std::endl;
+        }
+    }
 
-    return Result();
+    return result;
 }
 
 
 TMSPackager::Result
-TMSPackager::packageElevationTile(ElevationLayer*      layer,
-                                  const TileKey&       key,
-                                  const std::string&   rootDir,
-                                  const std::string&   extension,
-                                  unsigned&            out_maxLevel)
+TMSPackager::packageTiles(ImageLayer*                 imageLayer,
+                          ElevationLayer*             elevationLayer,
+                          const std::vector<TileKey>& rootKeys,
+                          const std::string&          rootDir,
+                          const std::string&          extension,
+                          TileSource*                 output,
+                          unsigned&                   out_maxLevel)
 {
-    unsigned minLevel = layer->getElevationLayerOptions().minLevel().isSet() ?
-        *layer->getElevationLayerOptions().minLevel() : 0;
+    const TerrainLayerOptions& options = imageLayer ?
+        static_cast<const TerrainLayerOptions&>( imageLayer->getImageLayerOptions() ) :
+        static_cast<const TerrainLayerOptions&>( elevationLayer->getElevationLayerOptions() );
 
-    if ( shouldPackageKey(key) && key.getLevelOfDetail() >= minLevel )
-    {
-        unsigned w, h;
-        key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
-
-        std::string path = Stringify() 
-            << rootDir 
-            << "/" << key.getLevelOfDetail() 
-            << "/" << key.getTileX() 
-            << "/" << h - key.getTileY() - 1
-            << "." << extension;
-
-        bool tileOK = osgDB::fileExists(path) && !_overwrite;
-        if ( !tileOK )
-        {
+    unsigned minLevel      = options.minLevel().isSet() ? *options.minLevel() : 0;
+    unsigned layerMaxLevel = options.maxLevel().isSet() ? *options.maxLevel() : 99;
+    unsigned maxLevel      = std::min(_maxLevel, layerMaxLevel);
 
-            GeoHeightField hf = layer->createHeightField( key );
-            if ( hf.valid() )
-            {
-                // convert the HF to an image
-                ImageToHeightFieldConverter conv;
-                osg::ref_ptr<osg::Image> image = conv.convert( hf.getHeightField() );
+    osg::ref_ptr<TaskService> service;
+    if ( _numThreads > 0 )
+        service = new TaskService( "TMSPackager", _numThreads );
 
-                // dump it to disk
-                osgDB::makeDirectoryForFile( path );
-                tileOK = osgDB::writeImageFile( *image.get(), path );
+    // Work through the pyramid depth-first, a batch of tiles at a time, so
+    // that the pending keys stay few. A tile's children are pushed once the
+    // tile is done and calls for subdivision.
+    std::vector<TileKey> stack( rootKeys.rbegin(), rootKeys.rend() );
 
-                if ( _verbose )
-                {
-                    if ( tileOK ) {
-                        OE_NOTICE << LC << "Wrote tile " << key.str() << " (" << key.getExtent().toString() << ")" << std::endl;
-                    }
-                    else {
-                        OE_NOTICE << LC << "Error write tile " << key.str() << std::endl;
-                    }
-                }
+    while ( !stack.empty() )
+    {
+        unsigned batchSize = std::min( MAX_BATCH, (unsigned)stack.size() );
+        std::vector<TileKey> batch( stack.end() - batchSize, stack.end() );
+        stack.resize( stack.size() - batchSize );
 
-                if ( _abortOnError && !tileOK )
-                {
-                    return Result( Stringify() << "Aborting, write failed for tile " << key.str() );
-                }
-            }
-        }
-        else
+        std::vector< osg::ref_ptr< ParallelTask<PackageTile> > > tasks;
+        for( std::vector<TileKey>::const_iterator i = batch.begin(); i != batch.end(); ++i )
         {
-            if ( _verbose )
+            if ( shouldPackageKey(*i) && i->getLevelOfDetail() >= minLevel )
             {
-                OE_NOTICE << LC << "Tile " << key.str() << " already exists" << std::endl;
+                ParallelTask<PackageTile>* task = new ParallelTask<PackageTile>();
+                task->_packager       = this;
+                task->_imageLayer     = imageLayer;
+                task->_elevationLayer = elevationLayer;
+                task->_key            = *i;
+                task->_rootDir        = rootDir;
+                task->_extension      = extension;
+                task->_output         = output;
+                tasks.push_back( task );
             }
         }
 
-        // increment the maximum detected tile level:
-        if ( tileOK && key.getLevelOfDetail() > out_maxLevel )
+        if ( tasks.empty() )
+            continue;
+
+        Threading::MultiEvent semaphore( tasks.size() );
+        for( unsigned i = 0; i < tasks.size(); ++i )
         {
-            out_maxLevel = key.getLevelOfDetail();
+            tasks[i]->_mev = &semaphore;
+            if ( service.valid() )
+                service->add( tasks[i].get() );
+            else
+                (*tasks[i])( 0L );
         }
+        semaphore.wait();
 
-        // see if subdivision should continue.
-        unsigned lod = key.getLevelOfDetail();
-        const ElevationLayerOptions& options = layer->getElevationLayerOptions();
+        // collect the children in reverse so the stack pops them in order.
+        for( unsigned i = tasks.size(); i-- > 0; )
+        {
+            const TileResult& result = tasks[i]->_result;
+            const TileKey&    key    = tasks[i]->_key;
+            unsigned          lod    = key.getLevelOfDetail();
 
-        unsigned layerMaxLevel = (options.maxLevel().isSet()? *options.maxLevel() : 99);
-        unsigned maxLevel = std::min(_maxLevel, layerMaxLevel);
-        bool subdivide =
-            (options.minLevel().isSet() && lod < *options.minLevel()) ||
-            (tileOK && lod+1 < maxLevel);
+            if ( _abortOnError && !result.error.empty() )
+                return Result( result.error );
 
-        // subdivide if necessary:
-        if ( subdivide )
-        {
-            for( unsigned q=0; q<4; ++q )
+            // increment the maximum detected tile level:
+            if ( result.tileOK && lod > out_maxLevel )
+            {
+                out_maxLevel = lod;
+            }
+
+            // see if subdivision should continue.
+            bool subdivide =
+                (options.minLevel().isSet() && lod < *options.minLevel()) ||
+                (result.tileOK && lod+1 < maxLevel);
+
+            if ( subdivide && !result.isSingleColor )
             {
-                TileKey childKey = key.createChildKey(q);
-                Result r = packageElevationTile( layer, childKey, rootDir, extension, out_maxLevel );
-                if ( _abortOnError && !r.ok )
-                    return r;
+                for( unsigned q=4; q-- > 0; )
+                {
+                    stack.push_back( key.createChildKey(q) );
+                }
             }
         }
     }
@@ -349,12 +401,9 @@ TMSPackager::package(ImageLayer*        layer,
 
     // package the tile hierarchy
     unsigned maxLevel = 0;
-    for( std::vector<TileKey>::const_iterator i = rootKeys.begin(); i != rootKeys.end(); ++i )
-    {
-        Result r = packageImageTile( layer, *i, rootFolder, extension, maxLevel );
-        if ( _abortOnError && !r.ok )
-            return r;
-    }
+    Result r = packageTiles( layer, 0L, rootKeys, rootFolder, extension, 0L, maxLevel );
+    if ( !r.ok )
+        return r;
 
     // create the tile map metadata:
     osg::ref_ptr<TMS::TileMap> tileMap = TMS::TileMap::create(
@@ -377,6 +426,39 @@ TMSPackager::package(ImageLayer*        layer,
 }
 
 
+TMSPackager::Result
+TMSPackager::package(ImageLayer* layer,
+                     TileSource* output)
+{
+    if ( !layer || !_outProfile.valid() )
+        return Result( "Illegal null layer or profile" );
+
+    if ( !output || !output->isWritable() )
+        return Result( "Output tile source is not writable" );
+
+    if ( !output->getProfile() || !output->getProfile()->isEquivalentTo(_outProfile.get()) )
+        return Result( "Output tile source profile does not match the packaging profile" );
+
+    // collect the root tile keys in preparation for packaging:
+    std::vector<TileKey> rootKeys;
+    _outProfile->getRootKeys( rootKeys );
+
+    if ( rootKeys.size() == 0 )
+        return Result( "Unable to calculate root key set" );
+
+    std::string extension = toLower( output->getExtension() );
+
+    if ( _verbose )
+    {
+        OE_NOTICE << LC << "Extension = " << extension << std::endl;
+    }
+
+    // package the tile hierarchy
+    unsigned maxLevel = 0;
+    return packageTiles( layer, 0L, rootKeys, "", extension, output, maxLevel );
+}
+
+
 TMSPackager::Result
 TMSPackager::package(ElevationLayer*    layer,
                      const std::string& rootFolder)
@@ -412,12 +494,9 @@ TMSPackager::package(ElevationLayer*    layer,
         return Result( "Unable to determine heightfield size" );
 
     unsigned maxLevel = 0;
-    for( std::vector<TileKey>::const_iterator i = rootKeys.begin(); i != rootKeys.end(); ++i )
-    {
-        Result r = packageElevationTile( layer, *i, rootFolder, extension, maxLevel );
-        if ( _abortOnError && !r.ok )
-            return r;
-    }
+    Result r = packageTiles( 0L, layer, rootKeys, rootFolder, extension, 0L, maxLevel );
+    if ( !r.ok )
+        return r;
 
     // create the tile map metadata:
     osg::ref_ptr<TMS::TileMap> tileMap = TMS::TileMap::create(
@@ -20,6 +20,8 @@
 #include <osgEarth/MapNode>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/GeoMath>
+#include <osgEarth/ElevationService>
+#include <osgEarth/TaskService>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -88,33 +90,71 @@ TerrainProfile::getElevationRanges(double &min, double &max ) const
 }
 
 /***************************************************/
+
+// samples in a profile, unless the user says otherwise
+#define DEFAULT_NUM_SAMPLES 100
+
+// meters per degree of latitude (near enough for choosing a data resolution)
+#define METERS_PER_DEGREE 111319.49
+
+struct TerrainProfileCalculator::ResampleTask : public TaskRequest
+{
+    ResampleTask( TerrainProfileCalculator* calc ) : _calc( calc ) { }
+
+    void operator()( ProgressCallback* progress )
+    {
+        _calc->resample();
+    }
+
+    // raw pointer: the calculator shuts down the service (waiting for us)
+    // before it goes away.
+    TerrainProfileCalculator* _calc;
+};
+
 TerrainProfileCalculator::TerrainProfileCalculator(MapNode* mapNode, const GeoPoint& start, const GeoPoint& end):
 _mapNode( mapNode ),
 _start( start),
 _end( end )
 {        
-    _mapNode->getTerrain()->addTerrainCallback( this );        
+    init();
     recompute();
 }
 
 TerrainProfileCalculator::TerrainProfileCalculator(MapNode* mapNode):
 _mapNode( mapNode )
 {
+    init();
+}
+
+void TerrainProfileCalculator::init()
+{
+    _numSamples = DEFAULT_NUM_SAMPLES;
+    _resolution = 0.0;
+    _generation = 0;
+    _queued     = false;
+    _elevation  = ElevationService::get( _mapNode->getMap() );
+    _service    = new TaskService( "TerrainProfileCalculator", 1 );
+
     _mapNode->getTerrain()->addTerrainCallback( this );
 }
 
 TerrainProfileCalculator::~TerrainProfileCalculator()
 {
     _mapNode->getTerrain()->removeTerrainCallback( this );
+
+    // waits for a running pass to finish.
+    _service = 0L;
 }
 
 void TerrainProfileCalculator::addChangedCallback( ChangedCallback* callback )
 {
+    Threading::ScopedMutexLock lock( _mutex );
     _changedCallbacks.push_back( callback );
 }
 
 void TerrainProfileCalculator::removeChangedCallback( ChangedCallback* callback )
 {
+    Threading::ScopedMutexLock lock( _mutex );
     ChangedCallbackList::iterator i = std::find( _changedCallbacks.begin(), _changedCallbacks.end(), callback);
     if (i != _changedCallbacks.end())
     {
@@ -122,8 +162,9 @@ void TerrainProfileCalculator::removeChangedCallback( ChangedCallback* callback
     }    
 }
 
-const TerrainProfile& TerrainProfileCalculator::getProfile() const
+TerrainProfile TerrainProfileCalculator::getProfile() const
 {
+    Threading::ScopedMutexLock lock( _mutex );
     return _profile;
 }
 
@@ -147,44 +188,172 @@ void TerrainProfileCalculator::setStartEnd(const GeoPoint& start, const GeoPoint
     }
 }
 
+void TerrainProfileCalculator::setNumSamples( unsigned value )
+{
+    value = osg::maximum( value, 2u );
+    if ( value != _numSamples )
+    {
+        _numSamples = value;
+        recompute();
+    }
+}
+
 void TerrainProfileCalculator::onTileAdded(const osgEarth::TileKey& tileKey, osg::Node* terrain, TerrainCallbackContext&)
 {
-    if (_start.isValid() && _end.isValid())
+    const GeoExtent&        extent = tileKey.getExtent();
+    const SpatialReference* mapSRS = _mapNode->getMapSRS();
+
+    bool schedule = false;
     {
-        GeoExtent extent( _start.getSRS());
-        extent.expandToInclude(_start.x(), _start.y());
-        extent.expandToInclude(_end.x(), _end.y());
+        // queue up only the samples the new tile covers; a pass that is
+        // already queued picks them up along with everything else.
+        Threading::ScopedMutexLock lock( _mutex );
 
-        if (tileKey.getExtent().intersects( extent ))
+        unsigned numDirty = _dirty.size();
+        for( unsigned i = 0; i < _samples.size(); ++i )
         {
-            recompute();
+            if ( extent.contains(_samples[i]._mapCoord, mapSRS) )
+                _dirty.insert( i );
+        }
+
+        if ( _dirty.size() > numDirty && !_queued )
+        {
+            _queued  = true;
+            schedule = true;
         }
     }
+
+    if ( schedule )
+        _service->add( new ResampleTask(this) );
 }
 
 void TerrainProfileCalculator::recompute()
 {
     if (_start.isValid() && _end.isValid())
     {
-        //computeTerrainProfile( _mapNode.get(), _start, _end, _numSamples, _profile);
-        osg::Vec3d start, end;
-        _start.toWorld( start, _mapNode->getTerrain() );
-        _end.toWorld( end, _mapNode->getTerrain() );
-        osgSim::ElevationSlice slice;
-        slice.setStartPoint( start );
-        slice.setEndPoint( end );
-        slice.setDatabaseCacheReadCallback( 0 );
-        slice.computeIntersections( _mapNode->getTerrainEngine());
-        _profile.clear();
-        for (unsigned int i = 0; i < slice.getDistanceHeightIntersections().size(); i++)
+        GeoPoint geoStart(_start);
+        geoStart.makeGeographic();
+
+        GeoPoint geoEnd(_end);
+        geoEnd.makeGeographic();
+
+        double startXRad = osg::DegreesToRadians( geoStart.x() );
+        double startYRad = osg::DegreesToRadians( geoStart.y() );
+        double endXRad = osg::DegreesToRadians( geoEnd.x() );
+        double endYRad = osg::DegreesToRadians( geoEnd.y() );
+
+        double distance = osgEarth::GeoMath::distance(startYRad, startXRad, endYRad, endXRad );
+        double spacing  = distance / ((double)_numSamples - 1.0);
+
+        // lay the samples out along the great circle, in map coordinates:
+        std::vector<osg::Vec3d> coords( _numSamples );
+        for (unsigned int i = 0; i < _numSamples; i++)
+        {
+            double t = (double)i / ((double)_numSamples - 1.0);
+            double lat, lon;
+            GeoMath::interpolate( startYRad, startXRad, endYRad, endXRad, t, lat, lon );
+            coords[i].set( osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), 0.0 );
+        }
+
+        const SpatialReference* mapSRS = _mapNode->getMapSRS();
+        geoStart.getSRS()->transform( coords, mapSRS );
+
+        SampleVector samples( _numSamples );
+        for (unsigned int i = 0; i < _numSamples; i++)
+        {
+            samples[i]._mapCoord  = coords[i];
+            samples[i]._distance  = spacing * (double)i;
+            samples[i]._elevation = 0.0;
+        }
+
+        bool schedule = false;
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            _samples.swap( samples );
+            _resolution = mapSRS->isGeographic() ? spacing / METERS_PER_DEGREE : spacing;
+            ++_generation;
+
+            _dirty.clear();
+            for (unsigned int i = 0; i < _numSamples; i++)
+                _dirty.insert( i );
+
+            if ( !_queued )
+            {
+                _queued  = true;
+                schedule = true;
+            }
+        }
+
+        if ( schedule )
+            _service->add( new ResampleTask(this) );
+    }
+}
+
+void TerrainProfileCalculator::resample()
+{
+    const SpatialReference* mapSRS = _mapNode->getMapSRS();
+
+    for( ;; )
+    {
+        std::vector<unsigned>   indices;
+        std::vector<osg::Vec3d> coords;
+        unsigned                generation;
+        double                  resolution;
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            if ( _dirty.empty() )
+            {
+                _queued = false;
+                return;
+            }
+
+            for( std::set<unsigned>::const_iterator i = _dirty.begin(); i != _dirty.end(); ++i )
+            {
+                indices.push_back( *i );
+                coords.push_back( _samples[*i]._mapCoord );
+            }
+            _dirty.clear();
+            generation = _generation;
+            resolution = _resolution;
+        }
+
+        // sample outside the lock so tile events never wait on data.
+        std::vector<double> elevations( indices.size(), 0.0 );
+        for( unsigned k = 0; k < indices.size(); ++k )
         {
-            _profile.addElevation( slice.getDistanceHeightIntersections()[i].first, slice.getDistanceHeightIntersections()[i].second);
+            GeoPoint point( mapSRS, coords[k], ALTMODE_ABSOLUTE );
+            double   h;
+            if ( _elevation->getElevation(point, h, resolution) )
+                elevations[k] = h;
+        }
+
+        ChangedCallbackList callbacks;
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+
+            // the samples were rebuilt while we worked; those results are stale.
+            if ( generation != _generation )
+                continue;
+
+            for( unsigned k = 0; k < indices.size(); ++k )
+                _samples[indices[k]]._elevation = elevations[k];
+
+            // more tiles arrived meanwhile; publish once the burst settles.
+            if ( !_dirty.empty() )
+                continue;
+
+            _profile.clear();
+            for( unsigned i = 0; i < _samples.size(); ++i )
+                _profile.addElevation( _samples[i]._distance, _samples[i]._elevation );
+
+            callbacks = _changedCallbacks;
         }
 
-        for( ChangedCallbackList::iterator i = _changedCallbacks.begin(); i != _changedCallbacks.end(); i++ )
+        for( ChangedCallbackList::iterator i = callbacks.begin(); i != callbacks.end(); i++ )
         {
-            if ( i->get() )
-                i->get()->onChanged(this);
+            osg::ref_ptr<ChangedCallback> cb = i->get();
+            if ( cb.valid() )
+                cb->onChanged(this);
         }
     }
 }
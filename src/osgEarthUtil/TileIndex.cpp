@@ -23,6 +23,8 @@
 #include <ogr_api.h>
 #include <osgEarthFeatures/OgrUtils>
 #include <osgDB/FileUtils>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -32,7 +34,22 @@ using namespace std;
 
 #define OGR_SCOPED_LOCK GDAL_SCOPED_LOCK
 
-TileIndex::TileIndex()
+namespace
+{
+    // modification time of a file, or -1 if it doesn't exist
+    long getModifiedTime( const std::string& filename )
+    {
+        struct stat buf;
+        if ( ::stat( filename.c_str(), &buf ) != 0 )
+            return -1L;
+        return (long)buf.st_mtime;
+    }
+}
+
+TileIndex::TileIndex() :
+_indexTime ( -1L ),
+_indexDirty( false ),
+_lastCheck ( 0 )
 {
 }
 
@@ -49,6 +66,21 @@ TileIndex*
         return 0;
     }
 
+    osg::ref_ptr< FeatureSource> features = openFeatures( filename );
+    if (!features.valid())
+    {
+        return 0;
+    }
+
+    TileIndex* index = new TileIndex();
+    index->_features = features.get();
+    index->_filename = filename;
+    return index;
+}
+
+FeatureSource*
+    TileIndex::openFeatures(const std::string& filename)
+{
     //Load up an index file
     OGRFeatureOptions featureOpt;
     featureOpt.url() = filename;        
@@ -64,10 +96,7 @@ TileIndex*
     features->initialize();
     features->getFeatureProfile();    
 
-    TileIndex* index = new TileIndex();
-    index->_features = features.get();
-    index->_filename = filename;
-    return index;
+    return features.release();
 }
 
 TileIndex*
@@ -105,21 +134,75 @@ void
     TileIndex::getFiles(const osgEarth::GeoExtent& extent, std::vector< std::string >& files)
 {            
     files.clear();
-    osgEarth::Symbology::Query query;    
 
-    GeoExtent transformed = extent.transform( _features->getFeatureProfile()->getSRS() );
-    query.bounds() = transformed.bounds();
-    osg::ref_ptr< osgEarth::Features::FeatureCursor> cursor = _features->createFeatureCursor( query );
+    osg::ref_ptr< const SpatialReference > srs;
+    osg::ref_ptr< FeatureSpatialIndex > index = getIndex( srs );
+    if (!index.valid() || !srs.valid())
+    {
+        return;
+    }
+
+    GeoExtent transformed = extent.transform( srs.get() );
+
+    FeatureList hits;
+    index->query( transformed.bounds(), hits );
+    for (FeatureList::const_iterator i = hits.begin(); i != hits.end(); ++i)
+    {
+        files.push_back( i->get()->getString("location") );
+    }
+}
+
+FeatureSpatialIndex*
+    TileIndex::getIndex(osg::ref_ptr<const SpatialReference>& out_srs)
+{
+    Threading::ScopedMutexLock lock( _indexMutex );
+
+    out_srs = _features->getFeatureProfile() ? _features->getFeatureProfile()->getSRS() : 0L;
+
+    // look for changes to the shapefile at most once a second.
+    osg::Timer_t now = osg::Timer::instance()->tick();
+    if (_index.valid() && !_indexDirty && osg::Timer::instance()->delta_s(_lastCheck, now) < 1.0)
+    {
+        return _index.get();
+    }
+    _lastCheck = now;
 
-    while (cursor->hasMore())
+    long modified = getModifiedTime( _filename );
+    if (_index.valid() && !_indexDirty && modified == _indexTime)
     {
-        osg::ref_ptr< osgEarth::Features::Feature> feature = cursor->nextFeature();
+        return _index.get();
+    }
+
+    // changed by someone else; reopen it to see the changes.
+    if (_index.valid() && !_indexDirty)
+    {
+        osg::ref_ptr< FeatureSource > features = openFeatures( _filename );
+        if (features.valid())
+        {
+            _features = features.get();
+        }
+    }
+
+    // read every entry once, and resolve its location while we're at it.
+    FeatureList entries;
+    osg::ref_ptr< FeatureCursor > cursor = _features->createFeatureCursor( Query() );
+    while (cursor.valid() && cursor->hasMore())
+    {
+        osg::ref_ptr< Feature > feature = cursor->nextFeature();
         if (feature.valid())
         {
-            std::string location = getFullPath(_filename, feature->getString("location"));            
-            files.push_back( location );
+            feature->set( "location", getFullPath(_filename, feature->getString("location")) );
+            entries.push_back( feature.get() );
         }
-    }    
+    }
+
+    out_srs     = _features->getFeatureProfile() ? _features->getFeatureProfile()->getSRS() : 0L;
+    _index      = new FeatureSpatialIndex( entries );
+    _indexTime  = modified;
+    _indexDirty = false;
+
+    OE_INFO << "[TileIndex] Indexed " << _index->getNumFeatures() << " files from " << _filename << std::endl;
+    return _index.get();
 }
 
 bool TileIndex::add( const std::string& filename, const GeoExtent& extent )
@@ -137,6 +220,9 @@ bool TileIndex::add( const std::string& filename, const GeoExtent& extent )
     const SpatialReference* wgs84 = SpatialReference::create("epsg:4326");
     feature->transform( wgs84 );
 
-    return _features->insertFeature( feature.get() );    
-    return true;
+    bool ok = _features->insertFeature( feature.get() );
+
+    Threading::ScopedMutexLock lock( _indexMutex );
+    _indexDirty = true;
+    return ok;
 }
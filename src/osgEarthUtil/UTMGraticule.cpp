@@ -156,6 +156,8 @@ UTMGraticule::rebuild()
 
     _featureProfile = new FeatureProfile(_profile->getSRS());
 
+    _tileCache = GraticuleTileCache::get( "utm", getMapNode()->getMap() );
+
     //todo: do this right..
     osg::StateSet* set = this->getOrCreateStateSet();
     set->setMode( GL_LIGHTING, 0 );
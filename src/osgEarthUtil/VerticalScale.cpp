@@ -90,6 +90,10 @@ VerticalScale::setScale(float scale)
     {
         _scale = scale;
         _scaleUniform->set( _scale.get() );
+
+        osg::ref_ptr<Terrain> terrain;
+        if ( _terrain.lock(terrain) )
+            terrain->setVerticalScale( _scale.get() );
     }
 }
 
@@ -105,6 +109,10 @@ VerticalScale::onInstall(TerrainEngineNode* engine)
 
         VirtualProgram* vp = VirtualProgram::getOrCreate(stateset);
         vp->setFunction( "oe_vertscale_vertex", vs, ShaderComp::LOCATION_VERTEX_MODEL );
+
+        _terrain = engine->getTerrain();
+        if ( _terrain.valid() )
+            _terrain->setVerticalScale( _scale.get() );
     }
 }
 
@@ -125,6 +133,10 @@ VerticalScale::onUninstall(TerrainEngineNode* engine)
                 vp->removeShader( "oe_vertscale_vertex" );
             }
         }
+
+        if ( engine->getTerrain() )
+            engine->getTerrain()->setVerticalScale( 1.0f );
+        _terrain = 0L;
     }
 }
 